@@ -45,10 +45,52 @@
 #define	RTC_BM		31
 
 
+// Timings, in nS. The chip is specified down to 2V where it's slowest, so
+//	use those: 1uS each half of the clock, 4uS from CE to the first clock.
+
+#define	T_HALF		1000
+#define	T_CE		4000
+
+
 // Locals
 
 static int dPin, cPin, sPin ;
 
+static wpiPin_t dHandle = NULL, cHandle = NULL, sHandle = NULL ;
+static int      dOutput ;
+
+
+/*
+ * nsWait:
+ *	Spin for the given number of nS - far too short to sleep for.
+ *********************************************************************************
+ */
+
+static inline void nsWait (unsigned int ns)
+{
+  unsigned long long deadline = nanos64 () + ns ;
+
+  while (nanos64 () < deadline)
+    ;
+}
+
+
+/*
+ * dsDirection:
+ *	Turn the data pin round, but only when it actually needs it
+ *********************************************************************************
+ */
+
+static void dsDirection (int output)
+{
+  if (output == dOutput)
+    return ;
+
+  pinMode (dPin, output ? OUTPUT : INPUT) ;
+  dOutput = output ;
+}
+
+
 /*
  * dsShiftIn:
  *	Shift a number in from the chip, LSB first. Note that the data is
@@ -61,13 +103,13 @@ static unsigned int dsShiftIn (void)
   uint8_t value = 0 ;
   int i ;
 
-  pinMode (dPin, INPUT) ;	delayMicroseconds (1) ;
+  dsDirection (FALSE) ;
 
   for (i = 0 ; i < 8 ; ++i)
   {
-    value |= (digitalRead (dPin) << i) ;
-    digitalWrite (cPin, HIGH) ; delayMicroseconds (1) ;
-    digitalWrite (cPin, LOW) ;	delayMicroseconds (1) ;
+    value |= (wpiPinRead (dHandle) << i) ;
+    wpiPinWrite (cHandle, HIGH) ; nsWait (T_HALF) ;
+    wpiPinWrite (cHandle, LOW) ;  nsWait (T_HALF) ;
   }
 
   return value;
@@ -85,17 +127,34 @@ static void dsShiftOut (unsigned int data)
 {
   int i ;
 
-  pinMode (dPin, OUTPUT) ;
+  dsDirection (TRUE) ;
 
   for (i = 0 ; i < 8 ; ++i)
   {
-    digitalWrite (dPin, data & (1 << i)) ;	delayMicroseconds (1) ;
-    digitalWrite (cPin, HIGH) ;			delayMicroseconds (1) ;
-    digitalWrite (cPin, LOW) ;			delayMicroseconds (1) ;
+    wpiPinWrite (dHandle, data & (1 << i)) ;
+    wpiPinWrite (cHandle, HIGH) ; nsWait (T_HALF) ;
+    wpiPinWrite (cHandle, LOW) ;  nsWait (T_HALF) ;
   }
 }
 
 
+/*
+ * dsStart: dsStop:
+ *	Frame a transfer with the chip enable
+ *********************************************************************************
+ */
+
+static void dsStart (void)
+{
+  wpiPinWrite (sHandle, HIGH) ; nsWait (T_CE) ;
+}
+
+static void dsStop (void)
+{
+  wpiPinWrite (sHandle, LOW) ;  nsWait (T_CE) ;
+}
+
+
 /*
  * ds1302regRead: ds1302regWrite:
  *	Read/Write a value to an RTC Register or RAM location on the chip
@@ -106,20 +165,20 @@ static unsigned int ds1302regRead (const int reg)
 {
   unsigned int data ;
 
-  digitalWrite (sPin, HIGH) ; delayMicroseconds (1) ;
+  dsStart () ;
     dsShiftOut (reg) ;
     data = dsShiftIn () ;
-  digitalWrite (sPin, LOW)  ; delayMicroseconds (1) ;
+  dsStop () ;
 
   return data ;
 }
 
 static void ds1302regWrite (const int reg, const unsigned int data)
 {
-  digitalWrite (sPin, HIGH) ; delayMicroseconds (1) ;
+  dsStart () ;
     dsShiftOut (reg) ;
     dsShiftOut (data) ;
-  digitalWrite (sPin, LOW)  ; delayMicroseconds (1) ;
+  dsStop () ;
 }
 
 
@@ -167,13 +226,13 @@ void ds1302clockRead (int clockData [8])
   int i ;
   unsigned int regVal = 0x81 | ((RTC_BM & 0x1F) << 1) ;
 
-  digitalWrite (sPin, HIGH) ; delayMicroseconds (1) ;
+  dsStart () ;
 
   dsShiftOut (regVal) ;
   for (i = 0 ; i < 8 ; ++i)
     clockData [i] = dsShiftIn () ;
 
-  digitalWrite (sPin, LOW) ;  delayMicroseconds (1) ;
+  dsStop () ;
 }
 
 
@@ -188,13 +247,65 @@ void ds1302clockWrite (const int clockData [8])
   int i ;
   unsigned int regVal = 0x80 | ((RTC_BM & 0x1F) << 1) ;
 
-  digitalWrite (sPin, HIGH) ; delayMicroseconds (1) ;
+  dsStart () ;
 
   dsShiftOut (regVal) ;
   for (i = 0 ; i < 8 ; ++i)
     dsShiftOut (clockData [i]) ;
 
-  digitalWrite (sPin, LOW) ;  delayMicroseconds (1) ;
+  dsStop () ;
+}
+
+
+/*
+ * ds1302ramBurstRead: ds1302ramBurstWrite:
+ *	Read/Write the first n (up to 31) bytes of RAM in a single operation.
+ *	Burst mode always starts at address 0, but the chip doesn't mind it
+ *	being cut short.
+ *	Returns the number of bytes transferred.
+ *********************************************************************************
+ */
+
+int ds1302ramBurstRead (unsigned char *data, int n)
+{
+  int i ;
+
+  if (n > DS1302_RAM_SIZE)
+    n = DS1302_RAM_SIZE ;
+
+  if (n <= 0)
+    return 0 ;
+
+  dsStart () ;
+
+  dsShiftOut (0xC1 | ((RTC_BM & 0x1F) << 1)) ;
+  for (i = 0 ; i < n ; ++i)
+    data [i] = dsShiftIn () ;
+
+  dsStop () ;
+
+  return n ;
+}
+
+int ds1302ramBurstWrite (const unsigned char *data, int n)
+{
+  int i ;
+
+  if (n > DS1302_RAM_SIZE)
+    n = DS1302_RAM_SIZE ;
+
+  if (n <= 0)
+    return 0 ;
+
+  dsStart () ;
+
+  dsShiftOut (0xC0 | ((RTC_BM & 0x1F) << 1)) ;
+  for (i = 0 ; i < n ; ++i)
+    dsShiftOut (data [i]) ;
+
+  dsStop () ;
+
+  return n ;
 }
 
 
@@ -235,6 +346,17 @@ void ds1302setup (const int clockPin, const int dataPin, const int csPin)
   pinMode (dPin, OUTPUT) ;
   pinMode (cPin, OUTPUT) ;
   pinMode (sPin, OUTPUT) ;
+  dOutput = TRUE ;
+
+// Resolve the pins once - the bit-banging then works on the handles
+
+  if (dHandle != NULL) wiringPiPinClose (dHandle) ;
+  if (cHandle != NULL) wiringPiPinClose (cHandle) ;
+  if (sHandle != NULL) wiringPiPinClose (sHandle) ;
+
+  dHandle = wiringPiPinOpen (dPin) ;
+  cHandle = wiringPiPinOpen (cPin) ;
+  sHandle = wiringPiPinOpen (sPin) ;
 
   ds1302rtcWrite (RTC_WP, 0) ;	// Remove write-protect
 }
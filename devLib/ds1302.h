@@ -22,6 +22,8 @@
  ***********************************************************************
  */
 
+#define	DS1302_RAM_SIZE	31
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -31,6 +33,8 @@ extern void         ds1302rtcWrite      (const int reg, const unsigned int data)
 
 extern unsigned int ds1302ramRead       (const int addr) ;
 extern void         ds1302ramWrite      (const int addr, const unsigned int data) ;
+extern int          ds1302ramBurstRead  (unsigned char *data, int n) ;
+extern int          ds1302ramBurstWrite (const unsigned char *data, int n) ;
 
 extern void         ds1302clockRead     (int clockData [8]) ;
 extern void         ds1302clockWrite    (const int clockData [8]) ;
@@ -40,6 +40,10 @@
 
 #include <wiringPi.h>
 #include <wiringPiSPI.h>
+#include <mcp3002.h>
+#include <mcp4802.h>
+#include <adcStream.h>
+#include <dacStream.h>
 
 #include "gertboard.h"
 
@@ -50,6 +54,11 @@
 #define	SPI_A2D		      0
 #define	SPI_D2A		      1
 
+// Pin base of the mcp3002 (ADC) and mcp4802 (DAC) nodes for streaming,
+//	or -1 before gertboardStreamSetup ()
+
+static int streamBase = -1 ;
+
 
 /*
  * gertboardAnalogWrite:
@@ -162,3 +171,102 @@ int gertboardAnalogSetup (const int pinBase)
 
   return 0 ;
 }
+
+
+/*
+ * gertboardStreamSetup:
+ *	Set up the Gertboard's converters for streaming, as an mcp3002 node
+ *	at pinBase (the ADC channels) and an mcp4802 at pinBase + 2 (the
+ *	DAC channels), so 4 pins in all; they can be used with analogRead
+ *	and analogWrite as usual too.
+ *********************************************************************************
+ */
+
+int gertboardStreamSetup (const int pinBase)
+{
+  if (!mcp3002Setup (pinBase, SPI_A2D) || !mcp4802Setup (pinBase + 2, SPI_D2A))
+    return -1 ;
+
+  streamBase = pinBase ;
+
+  return 0 ;
+}
+
+
+/*
+ * gertboardRecordStart:
+ * gertboardRecordRead:
+ * gertboardRecordStop:
+ *	Sample an ADC channel at a fixed rate in the background (via
+ *	adcStream) into a ring holding a second's worth, and collect the
+ *	10-bit samples as they come. gertboardRecordRead doesn't block and
+ *	returns the number of samples it got.
+ *********************************************************************************
+ */
+
+int gertboardRecordStart (const int chan, const int sampleRate)
+{
+  int pin ;
+
+  if ((streamBase < 0) || (chan < 0) || (chan > 1))
+    return -1 ;
+
+  pin = streamBase + chan ;
+
+  return adcStreamStart (&pin, 1, sampleRate, sampleRate) ;
+}
+
+int gertboardRecordRead (int *samples, const int maxSamples)
+{
+  struct adcSampleStruct block [64] ;
+  int got = 0, n, i ;
+
+  while (got < maxSamples)
+  {
+    n = maxSamples - got ;
+    if (n > 64)
+      n = 64 ;
+
+    if ((n = adcStreamRead (block, n)) == 0)
+      break ;
+
+    for (i = 0 ; i < n ; ++i)
+      samples [got++] = block [i].value ;
+  }
+
+  return got ;
+}
+
+void gertboardRecordStop (void)
+{
+  adcStreamStop () ;
+}
+
+
+/*
+ * gertboardPlay:
+ * gertboardPlayBusy:
+ * gertboardPlayStop:
+ *	Play a buffer of 8-bit samples out of a DAC channel at a fixed rate
+ *	in the background (via dacStream). The samples are copied, so the
+ *	buffer can be re-used straight away.
+ *********************************************************************************
+ */
+
+int gertboardPlay (const int chan, const int *samples, const int numSamples, const int sampleRate)
+{
+  if ((streamBase < 0) || (chan < 0) || (chan > 1))
+    return -1 ;
+
+  return dacStreamStart (streamBase + 2 + chan, samples, numSamples, sampleRate, 1) ;
+}
+
+int gertboardPlayBusy (void)
+{
+  return dacStreamBusy () ;
+}
+
+void gertboardPlayStop (void)
+{
+  dacStreamStop () ;
+}
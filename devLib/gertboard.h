@@ -40,6 +40,16 @@ extern int  gertboardSPISetup    (void) ;
 
 extern int  gertboardAnalogSetup (const int pinBase) ;
 
+// Streaming
+
+extern int  gertboardStreamSetup (const int pinBase) ;
+extern int  gertboardRecordStart (const int chan, const int sampleRate) ;
+extern int  gertboardRecordRead  (int *samples, const int maxSamples) ;
+extern void gertboardRecordStop  (void) ;
+extern int  gertboardPlay        (const int chan, const int *samples, const int numSamples, const int sampleRate) ;
+extern int  gertboardPlayBusy    (void) ;
+extern void gertboardPlayStop    (void) ;
+
 #ifdef __cplusplus
 }
 #endif
@@ -26,6 +26,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdarg.h>
 
 #include <wiringPi.h>
@@ -67,12 +68,55 @@
 
 #define	LCD_CDSHIFT_RL	0x04
 
+// Bit 7 of a status read: the controller is busy
+
+#define	LCD_BUSY	0x80
+
+// How long we'll wait for the busy flag before assuming it isn't working
+
+#define	LCD_BUSY_TIMEOUT	10000
+
+// Most values we'll queue up for one digitalWriteSequence
+
+#define	LCD_SEQ_MAX		192
+
 struct lcdDataStruct
 {
   int bits, rows, cols ;
   int rsPin, strbPin ;
   int dataPins [8] ;
   int cx, cy ;
+  int rwPin ;		// -1 if RW is tied low, else we poll the busy flag
+  int rsState ;
+  int native ;		// All the data pins are on-board: set them in one go
+
+// What's on the display (shadow) and, when buffered, what we want there
+//	(frame) - lcdFlush sends the difference. hx, hy is where the display's
+//	address counter is, if hValid.
+
+  unsigned char *shadow, *frame ;
+  int buffered, shadowValid ;
+  int hx, hy, hValid ;
+
+// On an I/O expander with digitalWriteSequence (an I2C backpack) each
+//	nibble and its E strobe are queued up as values for all the pins at
+//	once, relative to seqBase, and sent in one transaction. The bus is
+//	slow enough that it makes the timing. batch holds off sending until
+//	the end of a string.
+
+  int seq, seqBase, batch ;
+  unsigned int seqMask, seqRs, seqE, seqData [8] ;
+  int seqRsOut ;		// RS as last queued
+  int queued ;
+  unsigned int queue [LCD_SEQ_MAX] ;
+
+// What's in the 8 CGRAM slots, if cgValid has their bit, and when each
+//	was last asked for, for lcdCharAlloc
+
+  unsigned char cgram [8][8] ;
+  unsigned int  cgValid ;
+  unsigned int  cgUsed [8] ;
+  unsigned int  cgClock ;
 } ;
 
 struct lcdDataStruct *lcds [MAX_LCDS] ;
@@ -94,6 +138,16 @@ static const int rowOff [4] = { 0x00, 0x40, 0x14, 0x54 } ;
 static void strobe (const struct lcdDataStruct *lcd)
 {
 
+// With the busy flag we only need the E pulse itself to be long enough
+//	(450nS) - we'll wait for the controller before the next one.
+
+  if (lcd->rwPin != -1)
+  {
+    digitalWrite (lcd->strbPin, 1) ; delayMicroseconds (1) ;
+    digitalWrite (lcd->strbPin, 0) ;
+    return ;
+  }
+
 // Note timing changes for new version of delayMicroseconds ()
 
   digitalWrite (lcd->strbPin, 1) ; delayMicroseconds (50) ;
@@ -102,41 +156,169 @@ static void strobe (const struct lcdDataStruct *lcd)
 
 
 /*
- * sentDataCmd:
- *	Send an data or command byte to the display.
+ * setRs:
+ *	Set the register select line, remembering it for waitBusy
  *********************************************************************************
  */
 
-static void sendDataCmd (const struct lcdDataStruct *lcd, unsigned char data)
+static void setRs (struct lcdDataStruct *lcd, int value)
 {
-  register unsigned char myData = data ;
-  unsigned char          i, d4 ;
+  if (!lcd->seq)
+    digitalWrite (lcd->rsPin, value) ;
+  lcd->rsState = value ;
+}
 
-  if (lcd->bits == 4)
+
+/*
+ * seqSend:
+ * seqNibble:
+ *	Send what's queued, and queue up 4 or 8 bits with RS and the E
+ *	strobe. RS gets a value of its own to settle in before E goes up,
+ *	but only when it changes.
+ *********************************************************************************
+ */
+
+static void seqSend (struct lcdDataStruct *lcd)
+{
+  if (lcd->queued > 0)
+    digitalWriteSequence (lcd->seqBase, lcd->seqMask, lcd->queue, lcd->queued) ;
+  lcd->queued = 0 ;
+}
+
+static void seqNibble (struct lcdDataStruct *lcd, unsigned int data, int bits)
+{
+  unsigned int value ;
+  int i ;
+
+  if (lcd->queued + 3 > LCD_SEQ_MAX)
+    seqSend (lcd) ;
+
+  value = lcd->rsState ? lcd->seqRs : 0 ;
+  for (i = 0 ; i < bits ; ++i)
+    if ((data & (1 << i)) != 0)
+      value |= lcd->seqData [i] ;
+
+  if (lcd->rsState != lcd->seqRsOut)
   {
-    d4 = (myData >> 4) & 0x0F;
-    for (i = 0 ; i < 4 ; ++i)
-    {
-      digitalWrite (lcd->dataPins [i], (d4 & 1)) ;
-      d4 >>= 1 ;
-    }
-    strobe (lcd) ;
+    lcd->queue [lcd->queued++] = value ;
+    lcd->seqRsOut = lcd->rsState ;
+  }
+
+  lcd->queue [lcd->queued++] = value | lcd->seqE ;
+  lcd->queue [lcd->queued++] = value ;
+}
+
+
+/*
+ * waitBusy:
+ *	Read the status register until the busy flag goes, then put the bus
+ *	back how we found it. Only if we've got the RW pin - and note the data
+ *	lines are driven by the display here, so a 5v display needs level
+ *	shifting on them.
+ *********************************************************************************
+ */
+
+static void waitBusy (struct lcdDataStruct *lcd)
+{
+  unsigned int start ;
+  int i, busy, busyPin ;
+
+  if (lcd->rwPin == -1)
+    return ;
+
+  busyPin = lcd->dataPins [lcd->bits - 1] ;
 
-    d4 = myData & 0x0F ;
-    for (i = 0 ; i < 4 ; ++i)
+  for (i = 0 ; i < lcd->bits ; ++i)
+    pinMode (lcd->dataPins [i], INPUT) ;
+
+  if (lcd->rsState)
+    digitalWrite (lcd->rsPin, 0) ;
+  digitalWrite (lcd->rwPin, 1) ;
+
+  start = micros () ;
+  do
+  {
+    digitalWrite (lcd->strbPin, 1) ; delayMicroseconds (1) ;
+    busy = digitalRead (busyPin) ;
+    digitalWrite (lcd->strbPin, 0) ;
+
+    if (lcd->bits == 4)		// Clock the low nibble out too
     {
-      digitalWrite (lcd->dataPins [i], (d4 & 1)) ;
-      d4 >>= 1 ;
+      delayMicroseconds (1) ;
+      digitalWrite (lcd->strbPin, 1) ; delayMicroseconds (1) ;
+      digitalWrite (lcd->strbPin, 0) ;
     }
   }
-  else
+  while (busy && ((micros () - start) < LCD_BUSY_TIMEOUT)) ;
+
+  digitalWrite (lcd->rwPin, 0) ;
+  if (lcd->rsState)
+    digitalWrite (lcd->rsPin, 1) ;
+
+  for (i = 0 ; i < lcd->bits ; ++i)
+    pinMode (lcd->dataPins [i], OUTPUT) ;
+}
+
+
+/*
+ * sendBits:
+ *	Put 4 or 8 bits on the data lines - all at once if they're all
+ *	on-board pins, otherwise one at a time.
+ *********************************************************************************
+ */
+
+static void sendBits (const struct lcdDataStruct *lcd, unsigned char data, int bits)
+{
+  int i ;
+
+  if (lcd->native)
   {
-    for (i = 0 ; i < 8 ; ++i)
+    digitalWritePins (lcd->dataPins, bits, data) ;
+    return ;
+  }
+
+  for (i = 0 ; i < bits ; ++i)
+  {
+    digitalWrite (lcd->dataPins [i], (data & 1)) ;
+    data >>= 1 ;
+  }
+}
+
+
+/*
+ * sentDataCmd:
+ *	Send an data or command byte to the display.
+ *********************************************************************************
+ */
+
+static void sendDataCmd (struct lcdDataStruct *lcd, unsigned char data)
+{
+  if (lcd->seq)
+  {
+    if (lcd->bits == 4)
     {
-      digitalWrite (lcd->dataPins [i], (myData & 1)) ;
-      myData >>= 1 ;
+      seqNibble (lcd, data >> 4, 4) ;
+      seqNibble (lcd, data,      4) ;
     }
+    else
+      seqNibble (lcd, data, 8) ;
+
+    if (lcd->batch == 0)
+      seqSend (lcd) ;
+    return ;
   }
+
+  waitBusy (lcd) ;
+
+  if (lcd->bits == 4)
+  {
+    sendBits (lcd, (data >> 4) & 0x0F, 4) ;
+    strobe   (lcd) ;
+    sendBits (lcd, data & 0x0F, 4) ;
+  }
+  else
+    sendBits (lcd, data, 8) ;
+
   strobe (lcd) ;
 }
 
@@ -147,26 +329,29 @@ static void sendDataCmd (const struct lcdDataStruct *lcd, unsigned char data)
  *********************************************************************************
  */
 
-static void putCommand (const struct lcdDataStruct *lcd, unsigned char command)
+static void putCommand (struct lcdDataStruct *lcd, unsigned char command)
 {
-  digitalWrite (lcd->rsPin,   0) ;
-  sendDataCmd  (lcd, command) ;
-  delay (2) ;
+  setRs       (lcd, 0) ;
+  sendDataCmd (lcd, command) ;
+  if (lcd->seq)
+    seqSend (lcd) ;
+  if (lcd->rwPin == -1)
+    delay (2) ;
 }
 
-static void put4Command (const struct lcdDataStruct *lcd, unsigned char command)
+static void put4Command (struct lcdDataStruct *lcd, unsigned char command)
 {
-  register unsigned char myCommand = command ;
-  register unsigned char i ;
-
-  digitalWrite (lcd->rsPin,   0) ;
+  setRs (lcd, 0) ;
 
-  for (i = 0 ; i < 4 ; ++i)
+  if (lcd->seq)
   {
-    digitalWrite (lcd->dataPins [i], (myCommand & 1)) ;
-    myCommand >>= 1 ;
+    seqNibble (lcd, command & 0x0F, 4) ;
+    seqSend   (lcd) ;
+    return ;
   }
-  strobe (lcd) ;
+
+  sendBits (lcd, command & 0x0F, 4) ;
+  strobe   (lcd) ;
 }
 
 
@@ -186,19 +371,36 @@ void lcdHome (const int fd)
 {
   struct lcdDataStruct *lcd = lcds [fd] ;
 
-  putCommand (lcd, LCD_HOME) ;
   lcd->cx = lcd->cy = 0 ;
-  delay (5) ;
+  if (lcd->buffered)
+    return ;
+
+  putCommand (lcd, LCD_HOME) ;
+  lcd->hx = lcd->hy = 0 ;
+  lcd->hValid = TRUE ;
+  if (lcd->rwPin == -1)
+    delay (5) ;
 }
 
 void lcdClear (const int fd)
 {
   struct lcdDataStruct *lcd = lcds [fd] ;
 
+  lcd->cx = lcd->cy = 0 ;
+  if (lcd->buffered)
+  {
+    memset (lcd->frame, ' ', lcd->rows * lcd->cols) ;
+    return ;
+  }
+
   putCommand (lcd, LCD_CLEAR) ;
   putCommand (lcd, LCD_HOME) ;
-  lcd->cx = lcd->cy = 0 ;
-  delay (5) ;
+  memset (lcd->shadow, ' ', lcd->rows * lcd->cols) ;
+  lcd->shadowValid = TRUE ;
+  lcd->hx = lcd->hy = 0 ;
+  lcd->hValid = TRUE ;
+  if (lcd->rwPin == -1)
+    delay (5) ;
 }
 
 
@@ -255,6 +457,13 @@ void lcdSendCommand (const int fd, unsigned char command)
 {
   struct lcdDataStruct *lcd = lcds [fd] ;
   putCommand (lcd, command) ;
+
+// Could be anything, so we no longer know what's on the display - or in
+//	the CGRAM if it's pointing there now
+
+  lcd->shadowValid = lcd->hValid = FALSE ;
+  if ((command & (LCD_DGRAM | LCD_CGRAM)) == LCD_CGRAM)
+    lcd->cgValid = 0 ;
 }
 
 
@@ -274,29 +483,118 @@ void lcdPosition (const int fd, int x, int y)
   if ((y > lcd->rows) || (y < 0))
     return ;
 
-  putCommand (lcd, x + (LCD_DGRAM | rowOff [y])) ;
-
   lcd->cx = x ;
   lcd->cy = y ;
+
+  if (lcd->buffered)
+    return ;
+
+  if (lcd->hValid && (lcd->hx == x) && (lcd->hy == y))	// Already there
+    return ;
+
+  putCommand (lcd, x + (LCD_DGRAM | rowOff [y])) ;
+
+  lcd->hx     = x ;
+  lcd->hy     = y ;
+  lcd->hValid = TRUE ;
+}
+
+
+/*
+ * cgMatch:
+ *	Is this slot known to have this glyph? Only the bottom 5 bits of
+ *	each row are pixels.
+ *********************************************************************************
+ */
+
+static int cgMatch (const struct lcdDataStruct *lcd, int index, const unsigned char data [8])
+{
+  int i ;
+
+  if ((lcd->cgValid & (1 << index)) == 0)
+    return FALSE ;
+
+  for (i = 0 ; i < 8 ; ++i)
+    if (lcd->cgram [index][i] != (data [i] & 0x1F))
+      return FALSE ;
+
+  return TRUE ;
 }
 
 
 /*
+ * cgUpload:
  * lcdCharDef:
- *	Defines a new character in the CGRAM
+ * lcdCharAlloc:
+ *	Defines a new character in the CGRAM - unless it's already there.
+ *	lcdCharAlloc finds a slot for a glyph itself: the one it's already
+ *	in, or an unused one, or else the one least recently asked for, and
+ *	returns it (0-7) to lcdPutchar with. Anything still on the display
+ *	from a slot that gets reused changes with it.
+ *	Either way the cursor needs an lcdPosition afterwards if the glyph
+ *	was sent.
  *********************************************************************************
  */
 
+static void cgUpload (struct lcdDataStruct *lcd, int index, const unsigned char data [8])
+{
+  int i ;
+
+  putCommand (lcd, LCD_CGRAM | (index << 3)) ;
+
+  setRs (lcd, 1) ;
+  ++lcd->batch ;
+    for (i = 0 ; i < 8 ; ++i)
+      sendDataCmd (lcd, data [i]) ;
+  --lcd->batch ;
+  if (lcd->seq)
+    seqSend (lcd) ;
+
+  lcd->hValid = FALSE ;		// The address counter's in CGRAM now
+
+  for (i = 0 ; i < 8 ; ++i)
+    lcd->cgram [index][i] = data [i] & 0x1F ;
+  lcd->cgValid |= 1 << index ;
+}
+
 void lcdCharDef (const int fd, int index, unsigned char data [8])
 {
   struct lcdDataStruct *lcd = lcds [fd] ;
-  int i ;
 
-  putCommand (lcd, LCD_CGRAM | ((index & 7) << 3)) ;
+  index &= 7 ;
+  lcd->cgUsed [index] = ++lcd->cgClock ;
+
+  if (!cgMatch (lcd, index, data))
+    cgUpload (lcd, index, data) ;
+}
+
+int lcdCharAlloc (const int fd, const unsigned char data [8])
+{
+  struct lcdDataStruct *lcd = lcds [fd] ;
+  int i, slot = -1 ;
+
+  for (i = 0 ; i < 8 ; ++i)
+    if (cgMatch (lcd, i, data))
+    {
+      lcd->cgUsed [i] = ++lcd->cgClock ;
+      return i ;
+    }
 
-  digitalWrite (lcd->rsPin, 1) ;
   for (i = 0 ; i < 8 ; ++i)
-    sendDataCmd (lcd, data [i]) ;
+  {
+    if ((lcd->cgValid & (1 << i)) == 0)
+    {
+      slot = i ;
+      break ;
+    }
+    if ((slot == -1) || ((int)(lcd->cgUsed [i] - lcd->cgUsed [slot]) < 0))
+      slot = i ;
+  }
+
+  lcd->cgUsed [slot] = ++lcd->cgClock ;
+  cgUpload (lcd, slot, data) ;
+
+  return slot ;
 }
 
 
@@ -311,16 +609,39 @@ void lcdPutchar (const int fd, unsigned char data)
 {
   struct lcdDataStruct *lcd = lcds [fd] ;
 
-  digitalWrite (lcd->rsPin, 1) ;
-  sendDataCmd  (lcd, data) ;
+  if (lcd->buffered)
+  {
+    if ((lcd->cx < lcd->cols) && (lcd->cy < lcd->rows))
+      lcd->frame [lcd->cy * lcd->cols + lcd->cx] = data ;
+
+    if (++lcd->cx >= lcd->cols)
+    {
+      lcd->cx = 0 ;
+      if (++lcd->cy >= lcd->rows)
+	lcd->cy = 0 ;
+    }
+    return ;
+  }
+
+  setRs       (lcd, 1) ;
+  sendDataCmd (lcd, data) ;
 
-  if (++lcd->cx == lcd->cols)
+  if (lcd->hValid && (lcd->hx < lcd->cols) && (lcd->hy < lcd->rows))
+  {
+    lcd->shadow [lcd->hy * lcd->cols + lcd->hx] = data ;
+    ++lcd->hx ;
+  }
+
+  if (++lcd->cx >= lcd->cols)
   {
     lcd->cx = 0 ;
-    if (++lcd->cy == lcd->rows)
+    if (++lcd->cy >= lcd->rows)
       lcd->cy = 0 ;
     
     putCommand (lcd, lcd->cx + (LCD_DGRAM | rowOff [lcd->cy])) ;
+    lcd->hx     = lcd->cx ;
+    lcd->hy     = lcd->cy ;
+    lcd->hValid = TRUE ;
   }
 }
 
@@ -333,8 +654,104 @@ void lcdPutchar (const int fd, unsigned char data)
 
 void lcdPuts (const int fd, const char *string)
 {
-  while (*string)
-    lcdPutchar (fd, *string++) ;
+  struct lcdDataStruct *lcd = lcds [fd] ;
+
+  ++lcd->batch ;
+    while (*string)
+      lcdPutchar (fd, *string++) ;
+  --lcd->batch ;
+
+  if (lcd->seq)
+    seqSend (lcd) ;
+}
+
+
+/*
+ * lcdBuffer:
+ * lcdFlush:
+ *	With buffering on, everything that writes to the display (lcdPutchar,
+ *	lcdPuts, lcdPrintf, lcdPosition, lcdHome and lcdClear) only writes to
+ *	a copy of it in memory, and lcdFlush sends just the cells that have
+ *	changed since the last time, moving the cursor only where it needs to.
+ *	Turning it off flushes.
+ *********************************************************************************
+ */
+
+void lcdFlush (const int fd)
+{
+  struct lcdDataStruct *lcd = lcds [fd] ;
+  unsigned char *want, *have ;
+  int x, y, end, next ;
+
+  if (!lcd->buffered)
+    return ;
+
+  ++lcd->batch ;
+
+  for (y = 0 ; y < lcd->rows ; ++y)
+  {
+    want = lcd->frame  + y * lcd->cols ;
+    have = lcd->shadow + y * lcd->cols ;
+
+    for (x = 0 ; x < lcd->cols ; x = end)
+    {
+      if (lcd->shadowValid && (want [x] == have [x]))
+      {
+	end = x + 1 ;
+	continue ;
+      }
+
+// A run of changes - carrying on over a single unchanged cell is no dearer
+//	than moving the cursor past it
+
+      for (end = x + 1 ; end < lcd->cols ; ++end)
+      {
+	if (!lcd->shadowValid || (want [end] != have [end]))
+	  continue ;
+	next = end + 1 ;
+	if ((next < lcd->cols) && (want [next] != have [next]))
+	  continue ;
+	break ;
+      }
+
+      if (!lcd->hValid || (lcd->hx != x) || (lcd->hy != y))
+	putCommand (lcd, x + (LCD_DGRAM | rowOff [y])) ;
+
+      setRs (lcd, 1) ;
+      for (next = x ; next < end ; ++next)
+      {
+	sendDataCmd (lcd, want [next]) ;
+	have [next] = want [next] ;
+      }
+
+      lcd->hx     = end ;
+      lcd->hy     = y ;
+      lcd->hValid = (end < lcd->cols) ;		// Where it goes after the end depends on the display
+    }
+  }
+
+  --lcd->batch ;
+  if (lcd->seq)
+    seqSend (lcd) ;
+
+  lcd->shadowValid = TRUE ;
+}
+
+void lcdBuffer (const int fd, int state)
+{
+  struct lcdDataStruct *lcd = lcds [fd] ;
+
+  if (state && !lcd->buffered)
+  {
+    memcpy (lcd->frame, lcd->shadow, lcd->rows * lcd->cols) ;
+    lcd->buffered = TRUE ;
+  }
+  else if (!state && lcd->buffered)
+  {
+    lcdFlush (fd) ;
+    lcd->buffered = FALSE ;
+    lcdPosition (fd, lcd->cx, lcd->cy) ;
+  }
 }
 
 
@@ -357,10 +774,59 @@ void lcdPrintf (const int fd, const char *message, ...)
 }
 
 
+/*
+ * seqSetup:
+ *	See if all the pins are on the one node with digitalWriteSequence,
+ *	and if so work out the bit for each of them
+ *********************************************************************************
+ */
+
+static void seqSetup (struct lcdDataStruct *lcd, int bits)
+{
+  struct wiringPiNodeStruct *node ;
+  int pins [10] ;
+  int i, n, off ;
+
+  if ((lcd->rsPin & PI_GPIO_MASK) == 0)
+    return ;
+
+  if (((node = wiringPiFindNode (lcd->rsPin)) == NULL) || (node->digitalWriteSequence == NULL))
+    return ;
+
+  pins [0] = lcd->rsPin ;
+  pins [1] = lcd->strbPin ;
+  for (n = 2, i = 0 ; i < bits ; ++i)
+    pins [n++] = lcd->dataPins [i] ;
+
+  for (i = 0 ; i < n ; ++i)
+  {
+    off = pins [i] - node->pinBase ;
+    if ((pins [i] > node->pinMax) || (off < 0) || (off > 31))
+      return ;
+  }
+
+  lcd->seqBase = node->pinBase ;
+  lcd->seqRs   = 1u << (lcd->rsPin   - node->pinBase) ;
+  lcd->seqE    = 1u << (lcd->strbPin - node->pinBase) ;
+  lcd->seqMask = lcd->seqRs | lcd->seqE ;
+
+  for (i = 0 ; i < bits ; ++i)
+  {
+    lcd->seqData [i] = 1u << (lcd->dataPins [i] - node->pinBase) ;
+    lcd->seqMask    |= lcd->seqData [i] ;
+  }
+
+  lcd->seq = TRUE ;
+}
+
+
 /*
  * lcdInit:
+ * lcdInitRW:
  *	Take a lot of parameters and initialise the LCD, and return a handle to
  *	that LCD, or -1 if any error.
+ *	With the RW pin (rather than it being tied to 0v) we wait on the busy
+ *	flag instead of fixed delays, which is several times faster.
  *********************************************************************************
  */
 
@@ -368,6 +834,14 @@ int lcdInit (const int rows, const int cols, const int bits,
 	const int rs, const int strb,
 	const int d0, const int d1, const int d2, const int d3, const int d4,
 	const int d5, const int d6, const int d7)
+{
+  return lcdInitRW (rows, cols, bits, rs, -1, strb, d0, d1, d2, d3, d4, d5, d6, d7) ;
+}
+
+int lcdInitRW (const int rows, const int cols, const int bits,
+	const int rs, const int rw, const int strb,
+	const int d0, const int d1, const int d2, const int d3, const int d4,
+	const int d5, const int d6, const int d7)
 {
   static int initialised = 0 ;
 
@@ -419,6 +893,30 @@ int lcdInit (const int rows, const int cols, const int bits,
   lcd->cols    = cols ;
   lcd->cx      = 0 ;
   lcd->cy      = 0 ;
+  lcd->rwPin   = -1 ;		// Until we're through the reset sequence
+  lcd->rsState = 0 ;
+  lcd->native  = TRUE ;
+  lcd->buffered    = FALSE ;
+  lcd->shadowValid = FALSE ;
+  lcd->hValid      = FALSE ;
+  lcd->hx = lcd->hy = 0 ;
+  lcd->seq      = FALSE ;
+  lcd->batch    = 0 ;
+  lcd->queued   = 0 ;
+  lcd->seqRsOut = 0 ;
+  lcd->cgValid  = 0 ;
+  lcd->cgClock  = 0 ;
+  memset (lcd->cgUsed, 0, sizeof (lcd->cgUsed)) ;
+
+  lcd->shadow = (unsigned char *)calloc (rows * cols + 1, 1) ;
+  lcd->frame  = (unsigned char *)calloc (rows * cols + 1, 1) ;
+  if ((lcd->shadow == NULL) || (lcd->frame == NULL))
+  {
+    free (lcd->shadow) ;
+    free (lcd->frame) ;
+    free (lcd) ;
+    return -1 ;
+  }
 
   lcd->dataPins [0] = d0 ;
   lcd->dataPins [1] = d1 ;
@@ -429,10 +927,18 @@ int lcdInit (const int rows, const int cols, const int bits,
   lcd->dataPins [6] = d6 ;
   lcd->dataPins [7] = d7 ;
 
+  for (i = 0 ; i < bits ; ++i)
+    if ((lcd->dataPins [i] & PI_GPIO_MASK) != 0)
+      lcd->native = FALSE ;
+
   lcds [lcdFd] = lcd ;
 
   digitalWrite (lcd->rsPin,   0) ; pinMode (lcd->rsPin,   OUTPUT) ;
   digitalWrite (lcd->strbPin, 0) ; pinMode (lcd->strbPin, OUTPUT) ;
+  if (rw != -1)
+  {
+    digitalWrite (rw, 0) ; pinMode (rw, OUTPUT) ;
+  }
 
   for (i = 0 ; i < bits ; ++i)
   {
@@ -441,6 +947,9 @@ int lcdInit (const int rows, const int cols, const int bits,
   }
   delay (35) ; // mS
 
+  if (rw == -1)
+    seqSetup (lcd, bits) ;
+
 
 // 4-bit mode?
 //	OK. This is a PIG and it's not at all obvious from the documentation I had,
@@ -481,6 +990,10 @@ int lcdInit (const int rows, const int cols, const int bits,
     putCommand (lcd, func) ; delay (35) ;
   }
 
+// The busy flag can be read from here on
+
+  lcd->rwPin = rw ;
+
 // Rest of the initialisation sequence
 
   lcdDisplay     (lcdFd, TRUE) ;
@@ -32,10 +32,13 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
 
 #include <wiringPi.h>
 
-#include "font.h"
+#include "lcd128x64Font.h"
 #include "lcd128x64.h"
 
 // Size
@@ -52,15 +55,95 @@
 #define	RS		13
 
 // Software copy of the framebuffer
-//	it's 8-bit deep although the display itself is only 1-bit deep.
+//	Laid out the same as the controllers' memory: 8 pages of 8 rows, a
+//	byte per column with the top row (of the page on the controller) in
+//	bit 0. The display is mounted upside down, so our y goes up the page
+//	and our x runs backwards along each controller.
+//	dirty has a bit per column for each page on each controller (CS1 is
+//	[0]), set when the byte changes and cleared once it's been sent.
 
-static unsigned char frameBuffer [LCD_WIDTH * LCD_HEIGHT] ;
+#define	LCD_PAGES	(LCD_HEIGHT / 8)
+
+static unsigned char frameBuffer [LCD_PAGES][LCD_WIDTH] ;
+static uint64_t      dirty       [LCD_PAGES][2] ;
 
 static int maxX,    maxY ;
 static int lastX,   lastY ;
 static int xOrigin, yOrigin ;
 static int lcdOrientation = 0 ;
 
+// The orientation and origin worked out once, rather than per pixel:
+//	framebuffer x = xf [0] * x + xf [1] * y + xf [2]
+//	row up the pages (0 at the bottom of page 0) = rf [0] * x + rf [1] * y + rf [2]
+
+static int xf [3], rf [3] ;
+
+// Glyphs for the current orientation: a byte per framebuffer column, bit n
+//	for the n'th row up from glyphR. glyphX and glyphR are where the glyph's
+//	corner ends up relative to where the x, y we're given does.
+//	The natural orientation uses lcd128x64Font as it is, the others turn
+//	its glyphs round into the cache the first time each one's used.
+
+static const unsigned char (*glyphSet)[8] = lcd128x64Font ;
+static unsigned char glyphs      [256][8] ;
+static unsigned char glyphCached [256] ;
+static int           glyphX, glyphR ;
+static int           glyphTranspose, glyphRevBytes, glyphRevBits ;
+
+// How an 8x8 block of pixels turns into 8 framebuffer column bytes for
+//	the current orientation. The block goes in as a 64-bit word, byte j
+//	for the j'th row up and bit i of it the i'th pixel along; after
+//	bit-matrix transpose, byte and/or bit reversal as set here, byte n is
+//	the column glyphX + n along from the block's corner, with bit 0 at
+//	row glyphR.
+
+static int blockTranspose, blockRevBytes, blockRevBits ;
+
+/*
+ * transpose8:
+ * reverseBits8:
+ *	Bit-matrix transpose of an 8x8 block in a 64-bit word (byte j, bit i
+ *	to byte i, bit j), and reversal of the bits in each byte.
+ *********************************************************************************
+ */
+
+static uint64_t transpose8 (uint64_t m)
+{
+  uint64_t t ;
+
+  t = (m ^ (m >>  7)) & 0x00AA00AA00AA00AAULL ; m ^= t ^ (t <<  7) ;
+  t = (m ^ (m >> 14)) & 0x0000CCCC0000CCCCULL ; m ^= t ^ (t << 14) ;
+  t = (m ^ (m >> 28)) & 0x00000000F0F0F0F0ULL ; m ^= t ^ (t << 28) ;
+
+  return m ;
+}
+
+static uint64_t reverseBits8 (uint64_t m)
+{
+  m = ((m >> 1) & 0x5555555555555555ULL) | ((m & 0x5555555555555555ULL) << 1) ;
+  m = ((m >> 2) & 0x3333333333333333ULL) | ((m & 0x3333333333333333ULL) << 2) ;
+  m = ((m >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((m & 0x0F0F0F0F0F0F0F0FULL) << 4) ;
+
+  return m ;
+}
+
+
+/*
+ * orientBlock:
+ *	Turn an 8x8 block of pixels into framebuffer column bytes
+ *********************************************************************************
+ */
+
+static uint64_t orientBlock (uint64_t m)
+{
+  if (blockTranspose) m = transpose8 (m) ;
+  if (blockRevBytes)  m = __builtin_bswap64 (m) ;
+  if (blockRevBits)   m = reverseBits8 (m) ;
+
+  return m ;
+}
+
+
 /*
  * strobe:
  *	Toggle the strobe (Really the "E") pin to the device.
@@ -118,55 +201,159 @@ static void setLine (int line, const int chip)
 
 
 /*
- * lcd128x64update:
- *	Copy our software version to the real display
+ * fbWrite:
+ *	Change the bits in mask of the framebuffer byte for page, x (after
+ *	orientation) and note the column's dirty if it's different.
  *********************************************************************************
  */
 
-void lcd128x64update (void)
+static void fbWrite (int page, int x, unsigned char mask, unsigned char bits)
 {
-  int line, x, y, fbLoc ;
-  unsigned char byte ;
+  unsigned char *p   = &frameBuffer [page][x] ;
+  unsigned char  new = (*p & ~mask) | (bits & mask) ;
 
-// Left side 
+  if (new == *p)
+    return ;
 
-  for (line = 0 ; line < 8 ; ++line)
-  {
-    setCol  (0,    CS1) ;
-    setLine (line, CS1) ;
+  *p = new ;
+  dirty [page][x >> 6] |= (uint64_t)1 << (63 - (x & 63)) ;
+}
 
-    for (x = 63 ; x >= 0 ; --x)
-    {
-      byte = 0 ;
-      for (y = 0 ; y < 8 ; ++y)
-      {
-	fbLoc = x + (((7 - line) * 8) + (7 - y)) * LCD_WIDTH ;
-	if (frameBuffer [fbLoc] != 0)
-	  byte |= (1 << y) ;
-      }
-      sendData (byte, CS1) ;
-    }
+
+/*
+ * fbWrite8:
+ *	Replace 8 framebuffer bytes along a page at once, bits in memory
+ *	order, and note the columns that change.
+ *********************************************************************************
+ */
+
+static void fbWrite8 (int page, int x, uint64_t bits)
+{
+  uint64_t old, diff ;
+  int i ;
+
+  memcpy (&old, &frameBuffer [page][x], 8) ;
+  if ((diff = le64toh (old ^ bits)) == 0)
+    return ;
+
+  memcpy (&frameBuffer [page][x], &bits, 8) ;
+
+  for (i = 0 ; diff != 0 ; ++i, diff >>= 8)
+    if ((diff & 0xFF) != 0)
+      dirty [page][(x + i) >> 6] |= (uint64_t)1 << (63 - ((x + i) & 63)) ;
+}
+
+
+/*
+ * columnWrite:
+ *	Write up to 24 rows of one framebuffer column at once: bit n of mask
+ *	and bits is row r0 + n. Clips.
+ *********************************************************************************
+ */
+
+static void columnWrite (int x, int r0, uint32_t mask, uint32_t bits)
+{
+  uint64_t m, b ;
+  int page ;
+
+  if ((x < 0) || (x >= LCD_WIDTH) || (r0 >= LCD_HEIGHT) || (r0 <= -32))
+    return ;
+
+  if (r0 < 0)
+  {
+    mask >>= -r0 ;
+    bits >>= -r0 ;
+    r0     = 0 ;
   }
 
-// Right side 
+  m = (uint64_t)mask << (r0 & 7) ;
+  b = (uint64_t)bits << (r0 & 7) ;
+
+  for (page = r0 >> 3 ; (m != 0) && (page < LCD_PAGES) ; ++page, m >>= 8, b >>= 8)
+    if ((m & 0xFF) != 0)
+      fbWrite (page, x, m & 0xFF, b & 0xFF) ;
+}
+
+
+/*
+ * fbFill:
+ *	Fill a rectangle of the framebuffer, a page byte (8 rows) at a time.
+ *	The corners can be either way round, and it clips.
+ *********************************************************************************
+ */
 
-  for (line = 0 ; line < 8 ; ++line)
+static void fbFill (int x0, int r0, int x1, int r1, int colour)
+{
+  unsigned char value = (colour != 0) ? 0xFF : 0x00 ;
+  unsigned char mask ;
+  int x, page, p0, p1, tmp ;
+
+  if (x0 > x1) { tmp = x0 ; x0 = x1 ; x1 = tmp ; }
+  if (r0 > r1) { tmp = r0 ; r0 = r1 ; r1 = tmp ; }
+
+  if (x0 < 0)               x0 = 0 ;
+  if (x1 >= LCD_WIDTH)      x1 = LCD_WIDTH - 1 ;
+  if (r0 < 0)               r0 = 0 ;
+  if (r1 >= LCD_HEIGHT)     r1 = LCD_HEIGHT - 1 ;
+
+  if ((x0 > x1) || (r0 > r1))
+    return ;
+
+  p0 = r0 >> 3 ;
+  p1 = r1 >> 3 ;
+
+  for (page = p0 ; page <= p1 ; ++page)
   {
-    setCol  (0,    CS2) ;
-    setLine (line, CS2) ;
+    mask = 0xFF ;
+    if (page == p0) mask &= 0xFF << (r0 & 7) ;
+    if (page == p1) mask &= 0xFF >> (7 - (r1 & 7)) ;
+
+    for (x = x0 ; x <= x1 ; ++x)
+      fbWrite (page, x, mask, value) ;
+  }
+}
+
+
+/*
+ * lcd128x64update:
+ *	Copy our software version to the real display - just the runs of
+ *	columns that have changed since last time.
+ *********************************************************************************
+ */
+
+void lcd128x64update (void)
+{
+  static const int chips [2] = { CS1, CS2 } ;
+  int page, side, col, end, x ;
+  uint64_t d ;
 
-    for (x = 127 ; x >= 64 ; --x)
+  for (side = 0 ; side < 2 ; ++side)
+    for (page = 0 ; page < LCD_PAGES ; ++page)
     {
-      byte = 0 ;
-      for (y = 0 ; y < 8 ; ++y)
+      if ((d = dirty [page][side]) == 0)
+	continue ;
+
+      setLine (page, chips [side]) ;
+
+      for (col = 0 ; col < 64 ; col = end)
       {
-	fbLoc = x + (((7 - line) * 8) + (7 - y)) * LCD_WIDTH ;
-	if (frameBuffer [fbLoc] != 0)
-	  byte |= (1 << y) ;
+	if ((d & ((uint64_t)1 << col)) == 0)
+	{
+	  end = col + 1 ;
+	  continue ;
+	}
+
+	for (end = col + 1 ; (end < 64) && ((d & ((uint64_t)1 << end)) != 0) ; ++end)
+	  ;
+
+	setCol (col, chips [side]) ;
+
+	for (x = col ; x < end ; ++x)
+	  sendData (frameBuffer [page][side * 64 + 63 - x], chips [side]) ;
       }
-      sendData (byte, CS2) ;
+
+      dirty [page][side] = 0 ;
     }
-  }
 }
 
 
@@ -176,10 +363,55 @@ void lcd128x64update (void)
  *********************************************************************************
  */
 
+static void setTransform (void)
+{
+  int i, j, fx, fr, minX, minR ;
+
+  switch (lcdOrientation)
+  {
+    case 0:  xf [0] =  1 ; xf [1] =  0 ; xf [2] =   0 ; rf [0] =  0 ; rf [1] =  1 ; rf [2] =  0 ; break ;
+    case 1:  xf [0] =  0 ; xf [1] =  1 ; xf [2] =   0 ; rf [0] = -1 ; rf [1] =  0 ; rf [2] = 63 ; break ;
+    case 2:  xf [0] = -1 ; xf [1] =  0 ; xf [2] = 127 ; rf [0] =  0 ; rf [1] = -1 ; rf [2] = 63 ; break ;
+    default: xf [0] =  0 ; xf [1] = -1 ; xf [2] = 127 ; rf [0] =  1 ; rf [1] =  0 ; rf [2] =  0 ; break ;
+  }
+
+  xf [2] += xf [0] * xOrigin + xf [1] * yOrigin ;
+  rf [2] += rf [0] * xOrigin + rf [1] * yOrigin ;
+
+// Where an 8x8 glyph's corner goes - the cache is relative to it
+
+  minX = minR = 0 ;
+  for (i = 0 ; i < 8 ; i += 7)
+    for (j = 0 ; j < 8 ; j += 7)
+    {
+      fx = xf [0] * i + xf [1] * j ;
+      fr = rf [0] * i + rf [1] * j ;
+      if (fx < minX) minX = fx ;
+      if (fr < minR) minR = fr ;
+    }
+  glyphX = minX ;
+  glyphR = minR ;
+
+  blockTranspose = (lcdOrientation == 0) || (lcdOrientation == 2) ;
+  blockRevBytes  = (lcdOrientation == 2) || (lcdOrientation == 3) ;
+  blockRevBits   = (lcdOrientation == 1) || (lcdOrientation == 2) ;
+
+// The font's already the right way round for 0, so the glyph turn is
+//	relative to that
+
+  glyphTranspose = (lcdOrientation == 1) || (lcdOrientation == 3) ;
+  glyphRevBytes  = (lcdOrientation == 2) || (lcdOrientation == 3) ;
+  glyphRevBits   = (lcdOrientation == 1) || (lcdOrientation == 2) ;
+
+  glyphSet = (lcdOrientation == 0) ? lcd128x64Font : (const unsigned char (*)[8])glyphs ;
+  memset (glyphCached, 0, sizeof (glyphCached)) ;
+}
+
 void lcd128x64setOrigin (int x, int y)
 {
   xOrigin = x ;
   yOrigin = y ;
+  setTransform () ;
 }
 
 
@@ -197,8 +429,6 @@ void lcd128x64setOrientation (int orientation)
 {
   lcdOrientation = orientation & 3 ;
 
-  lcd128x64setOrigin (0,0) ;
-
   switch (lcdOrientation)
   {
     case 0:
@@ -221,6 +451,8 @@ void lcd128x64setOrientation (int orientation)
       maxY = LCD_WIDTH ;
       break ;
   }
+
+  lcd128x64setOrigin (0,0) ;
 }
 
 
@@ -293,15 +525,88 @@ void lcd128x64getScreenSize (int *x, int *y)
 
 void lcd128x64point (int x, int y, int colour)
 {
+  int fx, fr ;
+
   lastX = x ;
   lastY = y ;
 
-  lcd128x64orientCoordinates (&x, &y) ;
+  fx = xf [0] * x + xf [1] * y + xf [2] ;
+  fr = rf [0] * x + rf [1] * y + rf [2] ;
 
-  if ((x < 0) || (x >= LCD_WIDTH) || (y < 0) || (y >= LCD_HEIGHT))
+  if ((fx < 0) || (fx >= LCD_WIDTH) || (fr < 0) || (fr >= LCD_HEIGHT))
     return ;
 
-  frameBuffer [x + y * LCD_WIDTH] = colour ;
+  fbWrite (fr >> 3, fx, 1 << (fr & 7), (colour != 0) ? 0xFF : 0x00) ;
+}
+
+
+/*
+ * lcd128x64fill:
+ *	Fill a rectangle - straight into the framebuffer, 8 rows at a time
+ *********************************************************************************
+ */
+
+void lcd128x64fill (int x1, int y1, int x2, int y2, int colour)
+{
+  fbFill (xf [0] * x1 + xf [1] * y1 + xf [2], rf [0] * x1 + rf [1] * y1 + rf [2],
+	  xf [0] * x2 + xf [1] * y2 + xf [2], rf [0] * x2 + rf [1] * y2 + rf [2], colour) ;
+}
+
+
+/*
+ * lcd128x64blit:
+ *	Draw a w x h bitmap with its top left corner at x, y + h - 1 (so it
+ *	sits above x, y like the text does). Rows are top first, each
+ *	(w + 7) / 8 bytes, most significant bit on the left. A bgCol of -1
+ *	leaves the background alone.
+ *********************************************************************************
+ */
+
+void lcd128x64blit (int x, int y, int w, int h, const unsigned char *bitmap, int bgCol, int fgCol)
+{
+  uint64_t on, valid ;
+  unsigned char colMask ;
+  uint32_t mask, bits ;
+  int stride = (w + 7) / 8 ;
+  int bx, by, j, row, fx, fr ;
+
+// In 8x8 blocks from the bottom left, each turned into column bytes in one go
+
+  for (by = 0 ; by < h ; by += 8)
+    for (bx = 0 ; bx < stride ; ++bx)
+    {
+      colMask = (w - bx * 8 >= 8) ? 0xFF : (0xFF00 >> (w - bx * 8)) & 0xFF ;
+
+      on = valid = 0 ;
+      for (j = 0 ; (j < 8) && (by + j < h) ; ++j)
+      {
+	row    = h - 1 - by - j ;
+	on    |= (uint64_t)(bitmap [row * stride + bx] & colMask) << (j * 8) ;
+	valid |= (uint64_t)colMask << (j * 8) ;
+      }
+
+      on    = orientBlock (reverseBits8 (on)) ;
+      valid = orientBlock (reverseBits8 (valid)) ;
+
+      fx = xf [0] * (x + bx * 8) + xf [1] * (y + by) + xf [2] + glyphX ;
+      fr = rf [0] * (x + bx * 8) + rf [1] * (y + by) + rf [2] + glyphR ;
+
+      for (j = 0 ; j < 8 ; ++j, on >>= 8, valid >>= 8)
+      {
+	if (bgCol < 0)
+	{
+	  mask = on & valid & 0xFF ;
+	  bits = fgCol ? 0xFF : 0x00 ;
+	}
+	else
+	{
+	  mask = valid & 0xFF ;
+	  bits = (fgCol ? on : 0) | (bgCol ? ~on : 0) ;
+	}
+	if (mask != 0)
+	  columnWrite (fx + j, fr, mask, bits & 0xFF) ;
+      }
+    }
 }
 
 
@@ -320,6 +625,14 @@ void lcd128x64line (int x0, int y0, int x1, int y1, int colour)
   lastX = x1 ;
   lastY = y1 ;
 
+// Straight ones are just thin rectangles
+
+  if ((x0 == x1) || (y0 == y1))
+  {
+    lcd128x64fill (x0, y0, x1, y1, colour) ;
+    return ;
+  }
+
   dx = abs (x1 - x0) ;
   dy = abs (y1 - y0) ;
 
@@ -366,19 +679,8 @@ void lcd128x64lineTo (int x, int y, int colour)
 
 void lcd128x64rectangle (int x1, int y1, int x2, int y2, int colour, int filled)
 {
-  register int x ;
-
   if (filled)
-  {
-    /**/ if (x1 == x2)
-      lcd128x64line (x1, y1, x2, y2, colour) ;
-    else if (x1 < x2)
-      for (x = x1 ; x <= x2 ; ++x)
-	lcd128x64line (x, y1, x, y2, colour) ;
-    else
-      for (x = x2 ; x <= x1 ; ++x)
-	lcd128x64line (x, y1, x, y2, colour) ;
-  }
+    lcd128x64fill (x1, y1, x2, y2, colour) ;
   else
   {
     lcd128x64line   (x1, y1, x2, y1, colour) ;
@@ -547,32 +849,54 @@ void lcd128x64ellipse (int cx, int cy, int xRadius, int yRadius, int colour, int
  *********************************************************************************
  */
 
+static void cacheGlyph (int c)
+{
+  uint64_t m ;
+
+  memcpy (&m, lcd128x64Font [c], 8) ;
+  m = le64toh (m) ;
+
+  if (glyphTranspose) m = transpose8 (m) ;
+  if (glyphRevBytes)  m = __builtin_bswap64 (m) ;
+  if (glyphRevBits)   m = reverseBits8 (m) ;
+
+  m = htole64 (m) ;
+  memcpy (glyphs [c], &m, 8) ;
+
+  glyphCached [c] = TRUE ;
+}
+
 void lcd128x64putchar (int x, int y, int c, int bgCol, int fgCol)
 {
-  int y1, y2 ;
+  const unsigned char *g ;
+  uint32_t on, off ;
+  int fx, fr, i ;
+
+  c &= 0xFF ;
 
-  unsigned char line ;
-  unsigned char *fontPtr ;
+  if ((glyphSet == glyphs) && !glyphCached [c])
+    cacheGlyph (c) ;
 
-// Can't print if we're offscreen
+  g  = glyphSet [c] ;
+  fx = xf [0] * x + xf [1] * y + xf [2] + glyphX ;
+  fr = rf [0] * x + rf [1] * y + rf [2] + glyphR ;
 
-//if ((x < 0) || (x >= (maxX - fontWidth)) || (y < 0) || (y >= (maxY - fontHeight)))
-//  return ;
+// Sitting on a page and all on the screen: that's 8 bytes in one go
+
+  if (((fr & 7) == 0) && (fr >= 0) && (fr < LCD_HEIGHT) && (fx >= 0) && (fx <= (LCD_WIDTH - 8)))
+  {
+    uint64_t bits ;
 
-  fontPtr = font + c * fontHeight ;
+    memcpy (&bits, g, 8) ;
+    fbWrite8 (fr >> 3, fx, (fgCol ? bits : 0) | (bgCol ? ~bits : 0)) ;
+    return ;
+  }
 
-  for (y1 = fontHeight - 1 ; y1 >= 0 ; --y1)
+  for (i = 0 ; i < 8 ; ++i)
   {
-    y2 = y + y1 ;
-    line = *fontPtr++ ;
-    lcd128x64point (x + 0, y2, (line & 0x80) == 0 ? bgCol : fgCol) ;
-    lcd128x64point (x + 1, y2, (line & 0x40) == 0 ? bgCol : fgCol) ;
-    lcd128x64point (x + 2, y2, (line & 0x20) == 0 ? bgCol : fgCol) ;
-    lcd128x64point (x + 3, y2, (line & 0x10) == 0 ? bgCol : fgCol) ;
-    lcd128x64point (x + 4, y2, (line & 0x08) == 0 ? bgCol : fgCol) ;
-    lcd128x64point (x + 5, y2, (line & 0x04) == 0 ? bgCol : fgCol) ;
-    lcd128x64point (x + 6, y2, (line & 0x02) == 0 ? bgCol : fgCol) ;
-    lcd128x64point (x + 7, y2, (line & 0x01) == 0 ? bgCol : fgCol) ;
+    on  = g [i] ;
+    off = ~on & 0xFF ;
+    columnWrite (fx + i, fr, 0xFF, (fgCol ? on : 0) | (bgCol ? off : 0)) ;
   }
 }
 
@@ -626,11 +950,7 @@ void lcd128x64puts (int x, int y, const char *str, int bgCol, int fgCol)
 
 void lcd128x64clear (int colour)
 {
-  register int i ;
-  register unsigned char *ptr = frameBuffer ;
-
-  for (i = 0 ; i < (maxX * maxY) ; ++i)
-    *ptr++ = colour ;
+  fbFill (0, 0, LCD_WIDTH - 1, LCD_HEIGHT - 1, colour) ;
 }
 
 
@@ -665,7 +985,10 @@ int lcd128x64setup (void)
   sendCommand (0x3F, CS2) ;	// Display ON
   sendCommand (0xC0, CS2) ;	// Set display start line to 0
 
+// We don't know what's on there, so send the lot the first time
+
   lcd128x64clear          (0) ;
+  memset (dirty, 0xFF, sizeof (dirty)) ;
   lcd128x64setOrientation (0) ;
   lcd128x64update         () ;
 
@@ -26,6 +26,8 @@ extern void lcd128x64setOrientation    (int orientation) ;
 extern void lcd128x64orientCoordinates (int *x, int *y) ;
 extern void lcd128x64getScreenSize     (int *x, int *y) ;
 extern void lcd128x64point             (int  x, int  y, int colour) ;
+extern void lcd128x64fill              (int x1, int y1, int x2, int y2, int colour) ;
+extern void lcd128x64blit              (int  x, int  y, int w, int h, const unsigned char *bitmap, int bgCol, int fgCol) ;
 extern void lcd128x64line              (int x0, int y0, int x1, int y1, int colour) ;
 extern void lcd128x64lineTo            (int  x, int  y, int colour) ;
 extern void lcd128x64rectangle         (int x1, int y1, int x2, int y2, int colour, int filled) ;
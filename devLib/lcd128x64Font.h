@@ -0,0 +1,289 @@
+/*
+ * lcd128x64Font.h:
+ *	The 8x8 font from font.h pre-packed for the 128x64 LCD's framebuffer:
+ *	each glyph is the 8 column bytes it occupies in the natural (0)
+ *	orientation, bit 0 at the bottom row, so it can go straight into a
+ *	page without being turned round first.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+static const int fontHeight = 8 ;
+static const int fontWidth  = 8 ;
+
+static const unsigned char lcd128x64Font [256][8] =
+{
+  { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	/* 0x00 */
+  { 0x7E, 0x81, 0xA9, 0x8D, 0x8D, 0xA9, 0x81, 0x7E },	/* 0x01 */
+  { 0x7E, 0xFF, 0xD7, 0xF3, 0xF3, 0xD7, 0xFF, 0x7E },	/* 0x02 */
+  { 0x70, 0xF8, 0xFC, 0x7E, 0xFC, 0xF8, 0x70, 0x00 },	/* 0x03 */
+  { 0x10, 0x38, 0x7C, 0xFE, 0x7C, 0x38, 0x10, 0x00 },	/* 0x04 */
+  { 0x1C, 0x5C, 0xF9, 0xFF, 0xF9, 0x5C, 0x1C, 0x00 },	/* 0x05 */
+  { 0x18, 0x3C, 0x7D, 0xFF, 0x7D, 0x3C, 0x18, 0x00 },	/* 0x06 */
+  { 0x00, 0x00, 0x18, 0x3C, 0x3C, 0x18, 0x00, 0x00 },	/* 0x07 */
+  { 0xFF, 0xFF, 0xE7, 0xC3, 0xC3, 0xE7, 0xFF, 0xFF },	/* 0x08 */
+  { 0x00, 0x3C, 0x66, 0x42, 0x42, 0x66, 0x3C, 0x00 },	/* 0x09 */
+  { 0xFF, 0xC3, 0x99, 0xBD, 0xBD, 0x99, 0xC3, 0xFF },	/* 0x0A */
+  { 0x0E, 0x1F, 0x11, 0x11, 0xBF, 0xFE, 0xE0, 0xF0 },	/* 0x0B */
+  { 0x00, 0x72, 0xFA, 0x8F, 0x8F, 0xFA, 0x72, 0x00 },	/* 0x0C */
+  { 0x03, 0x07, 0xFF, 0xFE, 0xA0, 0xA0, 0xE0, 0xE0 },	/* 0x0D */
+  { 0x03, 0xFF, 0xFE, 0xA0, 0xA0, 0xA6, 0xFE, 0xFC },	/* 0x0E */
+  { 0x5A, 0x5A, 0x3C, 0xE7, 0xE7, 0x3C, 0x5A, 0x5A },	/* 0x0F */
+  { 0xFE, 0x7C, 0x7C, 0x38, 0x38, 0x10, 0x10, 0x00 },	/* 0x10 */
+  { 0x10, 0x10, 0x38, 0x38, 0x7C, 0x7C, 0xFE, 0x00 },	/* 0x11 */
+  { 0x00, 0x24, 0x66, 0xFF, 0xFF, 0x66, 0x24, 0x00 },	/* 0x12 */
+  { 0x00, 0xFA, 0xFA, 0x00, 0x00, 0xFA, 0xFA, 0x00 },	/* 0x13 */
+  { 0x60, 0xF0, 0x90, 0xFE, 0xFE, 0x80, 0xFE, 0xFE },	/* 0x14 */
+  { 0x02, 0x59, 0xFD, 0xA5, 0xA5, 0xBF, 0x9A, 0x40 },	/* 0x15 */
+  { 0x00, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x00 },	/* 0x16 */
+  { 0x01, 0x29, 0x6D, 0xFF, 0xFF, 0x6D, 0x29, 0x01 },	/* 0x17 */
+  { 0x00, 0x20, 0x60, 0xFE, 0xFE, 0x60, 0x20, 0x00 },	/* 0x18 */
+  { 0x00, 0x08, 0x0C, 0xFE, 0xFE, 0x0C, 0x08, 0x00 },	/* 0x19 */
+  { 0x10, 0x10, 0x10, 0x54, 0x7C, 0x38, 0x10, 0x00 },	/* 0x1A */
+  { 0x10, 0x38, 0x7C, 0x54, 0x10, 0x10, 0x10, 0x00 },	/* 0x1B */
+  { 0x3C, 0x3C, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00 },	/* 0x1C */
+  { 0x10, 0x38, 0x7C, 0x10, 0x10, 0x7C, 0x38, 0x10 },	/* 0x1D */
+  { 0x0C, 0x1C, 0x3C, 0x7C, 0x7C, 0x3C, 0x1C, 0x0C },	/* 0x1E */
+  { 0x60, 0x70, 0x78, 0x7C, 0x7C, 0x78, 0x70, 0x60 },	/* 0x1F */
+  { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	/* 0x20 ' ' */
+  { 0x00, 0x00, 0x70, 0xFA, 0xFA, 0x70, 0x00, 0x00 },	/* 0x21 '!' */
+  { 0x00, 0xC0, 0xC0, 0x00, 0xC0, 0xC0, 0x00, 0x00 },	/* 0x22 '"' */
+  { 0x28, 0xFE, 0xFE, 0x28, 0xFE, 0xFE, 0x28, 0x00 },	/* 0x23 '#' */
+  { 0x00, 0x24, 0x74, 0xD6, 0xD6, 0x5C, 0x48, 0x00 },	/* 0x24 '$' */
+  { 0x62, 0x66, 0x0C, 0x18, 0x30, 0x66, 0x46, 0x00 },	/* 0x25 '%' */
+  { 0x0C, 0x7E, 0xF2, 0x9A, 0xEC, 0x5E, 0x12, 0x00 },	/* 0x26 '&' */
+  { 0x00, 0x00, 0x20, 0xE0, 0xC0, 0x00, 0x00, 0x00 },	/* 0x27 ''' */
+  { 0x00, 0x00, 0x38, 0x7C, 0xC6, 0x82, 0x00, 0x00 },	/* 0x28 '(' */
+  { 0x00, 0x00, 0x82, 0xC6, 0x7C, 0x38, 0x00, 0x00 },	/* 0x29 ')' */
+  { 0x10, 0x54, 0x7C, 0x38, 0x38, 0x7C, 0x54, 0x10 },	/* 0x2A '*' */
+  { 0x00, 0x10, 0x10, 0x7C, 0x7C, 0x10, 0x10, 0x00 },	/* 0x2B '+' */
+  { 0x00, 0x00, 0x01, 0x07, 0x06, 0x00, 0x00, 0x00 },	/* 0x2C ',' */
+  { 0x00, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00 },	/* 0x2D '-' */
+  { 0x00, 0x00, 0x00, 0x06, 0x06, 0x00, 0x00, 0x00 },	/* 0x2E '.' */
+  { 0x02, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xC0, 0x80 },	/* 0x2F '/' */
+  { 0x7C, 0xFE, 0x9A, 0xBA, 0xB2, 0xFE, 0x7C, 0x00 },	/* 0x30 '0' */
+  { 0x00, 0x40, 0x40, 0xFE, 0xFE, 0x00, 0x00, 0x00 },	/* 0x31 '1' */
+  { 0x42, 0xC6, 0x8E, 0x9A, 0xB2, 0xE2, 0x42, 0x00 },	/* 0x32 '2' */
+  { 0x44, 0xC6, 0x82, 0x92, 0x92, 0xFE, 0x6C, 0x00 },	/* 0x33 '3' */
+  { 0x18, 0x38, 0x68, 0xC8, 0xFE, 0xFE, 0x08, 0x00 },	/* 0x34 '4' */
+  { 0xE4, 0xE6, 0xA2, 0xA2, 0xA2, 0xBE, 0x9C, 0x00 },	/* 0x35 '5' */
+  { 0x3C, 0x7E, 0xD2, 0x92, 0x92, 0x1E, 0x0C, 0x00 },	/* 0x36 '6' */
+  { 0x80, 0x86, 0x8E, 0x98, 0xB0, 0xE0, 0xC0, 0x00 },	/* 0x37 '7' */
+  { 0x6C, 0xFE, 0x92, 0x92, 0x92, 0xFE, 0x6C, 0x00 },	/* 0x38 '8' */
+  { 0x60, 0xF0, 0x92, 0x92, 0x96, 0xFC, 0x78, 0x00 },	/* 0x39 '9' */
+  { 0x00, 0x00, 0x00, 0x66, 0x66, 0x00, 0x00, 0x00 },	/* 0x3A ':' */
+  { 0x00, 0x00, 0x01, 0x67, 0x66, 0x00, 0x00, 0x00 },	/* 0x3B ';' */
+  { 0x00, 0x10, 0x38, 0x6C, 0xC6, 0x82, 0x00, 0x00 },	/* 0x3C '<' */
+  { 0x00, 0x24, 0x24, 0x24, 0x24, 0x24, 0x24, 0x00 },	/* 0x3D '=' */
+  { 0x00, 0x00, 0x82, 0xC6, 0x6C, 0x38, 0x10, 0x00 },	/* 0x3E '>' */
+  { 0x00, 0x40, 0xC0, 0x8A, 0x9A, 0xF0, 0x60, 0x00 },	/* 0x3F '?' */
+  { 0x7C, 0xFE, 0x82, 0xBA, 0xBA, 0xFA, 0x78, 0x00 },	/* 0x40 '@' */
+  { 0x1E, 0x3E, 0x68, 0xC8, 0x68, 0x3E, 0x1E, 0x00 },	/* 0x41 'A' */
+  { 0xFE, 0xFE, 0x92, 0x92, 0x92, 0xFE, 0x6C, 0x00 },	/* 0x42 'B' */
+  { 0x7C, 0xFE, 0x82, 0x82, 0x82, 0xC6, 0x44, 0x00 },	/* 0x43 'C' */
+  { 0xFE, 0xFE, 0x82, 0x82, 0x82, 0xFE, 0x7C, 0x00 },	/* 0x44 'D' */
+  { 0xFE, 0xFE, 0x92, 0x92, 0x92, 0x82, 0x82, 0x00 },	/* 0x45 'E' */
+  { 0xFE, 0xFE, 0x90, 0x90, 0x90, 0x80, 0x80, 0x00 },	/* 0x46 'F' */
+  { 0x7C, 0xFE, 0x82, 0x82, 0x92, 0xDE, 0x5C, 0x00 },	/* 0x47 'G' */
+  { 0xFE, 0xFE, 0x10, 0x10, 0x10, 0xFE, 0xFE, 0x00 },	/* 0x48 'H' */
+  { 0x00, 0x82, 0x82, 0xFE, 0xFE, 0x82, 0x82, 0x00 },	/* 0x49 'I' */
+  { 0x0C, 0x0E, 0x02, 0x02, 0x02, 0xFE, 0xFC, 0x00 },	/* 0x4A 'J' */
+  { 0xFE, 0xFE, 0x10, 0x38, 0x6C, 0xC6, 0x82, 0x00 },	/* 0x4B 'K' */
+  { 0xFE, 0xFE, 0x02, 0x02, 0x02, 0x02, 0x02, 0x00 },	/* 0x4C 'L' */
+  { 0xFE, 0x7E, 0x30, 0x18, 0x30, 0x7E, 0xFE, 0x00 },	/* 0x4D 'M' */
+  { 0xFE, 0xFE, 0x60, 0x30, 0x18, 0xFE, 0xFE, 0x00 },	/* 0x4E 'N' */
+  { 0x7C, 0xFE, 0x82, 0x82, 0x82, 0xFE, 0x7C, 0x00 },	/* 0x4F 'O' */
+  { 0xFE, 0xFE, 0x90, 0x90, 0x90, 0xF0, 0x60, 0x00 },	/* 0x50 'P' */
+  { 0x7C, 0xFE, 0x8A, 0x8E, 0x86, 0xFF, 0x7D, 0x00 },	/* 0x51 'Q' */
+  { 0xFE, 0xFE, 0x90, 0x98, 0x9C, 0xF6, 0x62, 0x00 },	/* 0x52 'R' */
+  { 0x44, 0xE6, 0xB2, 0x92, 0x9A, 0xCE, 0x44, 0x00 },	/* 0x53 'S' */
+  { 0x00, 0x80, 0x80, 0xFE, 0xFE, 0x80, 0x80, 0x00 },	/* 0x54 'T' */
+  { 0xFC, 0xFE, 0x02, 0x02, 0x02, 0xFE, 0xFC, 0x00 },	/* 0x55 'U' */
+  { 0xC0, 0xF0, 0x3C, 0x0E, 0x0E, 0x3C, 0xF0, 0xC0 },	/* 0x56 'V' */
+  { 0xFE, 0xFE, 0x0C, 0x18, 0x0C, 0xFE, 0xFE, 0x00 },	/* 0x57 'W' */
+  { 0x82, 0xC6, 0x6C, 0x38, 0x38, 0x6C, 0xC6, 0x82 },	/* 0x58 'X' */
+  { 0xC0, 0xE0, 0x30, 0x1E, 0x1E, 0x30, 0xE0, 0xC0 },	/* 0x59 'Y' */
+  { 0x82, 0x86, 0x8E, 0x9A, 0xB2, 0xE2, 0xC2, 0x00 },	/* 0x5A 'Z' */
+  { 0x00, 0x00, 0xFE, 0xFE, 0x82, 0x82, 0x00, 0x00 },	/* 0x5B '[' */
+  { 0x80, 0xC0, 0x60, 0x30, 0x18, 0x0C, 0x06, 0x02 },	/* 0x5C */
+  { 0x00, 0x00, 0x82, 0x82, 0xFE, 0xFE, 0x00, 0x00 },	/* 0x5D ']' */
+  { 0x10, 0x30, 0x60, 0xC0, 0x60, 0x30, 0x10, 0x00 },	/* 0x5E '^' */
+  { 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00 },	/* 0x5F '_' */
+  { 0x00, 0x00, 0x00, 0xC0, 0xE0, 0x20, 0x00, 0x00 },	/* 0x60 '`' */
+  { 0x04, 0x2E, 0x2A, 0x2A, 0x2A, 0x3E, 0x1E, 0x00 },	/* 0x61 'a' */
+  { 0xFE, 0xFE, 0x22, 0x22, 0x22, 0x3E, 0x1C, 0x00 },	/* 0x62 'b' */
+  { 0x1C, 0x3E, 0x22, 0x22, 0x22, 0x36, 0x14, 0x00 },	/* 0x63 'c' */
+  { 0x1C, 0x3E, 0x22, 0x22, 0x22, 0xFE, 0xFE, 0x00 },	/* 0x64 'd' */
+  { 0x1C, 0x3E, 0x2A, 0x2A, 0x2A, 0x3A, 0x18, 0x00 },	/* 0x65 'e' */
+  { 0x10, 0x7E, 0xFE, 0x90, 0x80, 0xC0, 0x40, 0x00 },	/* 0x66 'f' */
+  { 0x18, 0x3D, 0x25, 0x25, 0x25, 0x3F, 0x3E, 0x00 },	/* 0x67 'g' */
+  { 0xFE, 0xFE, 0x20, 0x20, 0x20, 0x3E, 0x1E, 0x00 },	/* 0x68 'h' */
+  { 0x00, 0x00, 0x20, 0xBE, 0xBE, 0x00, 0x00, 0x00 },	/* 0x69 'i' */
+  { 0x02, 0x03, 0x01, 0x01, 0x01, 0xBF, 0xBE, 0x00 },	/* 0x6A 'j' */
+  { 0xFE, 0xFE, 0x08, 0x1C, 0x36, 0x22, 0x00, 0x00 },	/* 0x6B 'k' */
+  { 0x00, 0x00, 0x80, 0xFE, 0xFE, 0x00, 0x00, 0x00 },	/* 0x6C 'l' */
+  { 0x3E, 0x3E, 0x30, 0x18, 0x30, 0x3E, 0x1E, 0x00 },	/* 0x6D 'm' */
+  { 0x3E, 0x3E, 0x20, 0x20, 0x20, 0x3E, 0x1E, 0x00 },	/* 0x6E 'n' */
+  { 0x1C, 0x3E, 0x22, 0x22, 0x22, 0x3E, 0x1C, 0x00 },	/* 0x6F 'o' */
+  { 0x3F, 0x3F, 0x24, 0x24, 0x24, 0x3C, 0x18, 0x00 },	/* 0x70 'p' */
+  { 0x18, 0x3C, 0x24, 0x24, 0x24, 0x3F, 0x3F, 0x00 },	/* 0x71 'q' */
+  { 0x3E, 0x3E, 0x10, 0x20, 0x20, 0x30, 0x10, 0x00 },	/* 0x72 'r' */
+  { 0x12, 0x3A, 0x2A, 0x2A, 0x2A, 0x2E, 0x24, 0x00 },	/* 0x73 's' */
+  { 0x00, 0x20, 0xFC, 0xFE, 0x22, 0x26, 0x04, 0x00 },	/* 0x74 't' */
+  { 0x3C, 0x3E, 0x02, 0x02, 0x02, 0x3E, 0x3C, 0x00 },	/* 0x75 'u' */
+  { 0x38, 0x3C, 0x06, 0x02, 0x06, 0x3C, 0x38, 0x00 },	/* 0x76 'v' */
+  { 0x3C, 0x3E, 0x06, 0x0C, 0x06, 0x3E, 0x3C, 0x00 },	/* 0x77 'w' */
+  { 0x22, 0x36, 0x1C, 0x08, 0x1C, 0x36, 0x22, 0x00 },	/* 0x78 'x' */
+  { 0x20, 0x31, 0x1B, 0x0E, 0x0C, 0x18, 0x30, 0x20 },	/* 0x79 'y' */
+  { 0x22, 0x26, 0x2E, 0x2A, 0x3A, 0x32, 0x22, 0x00 },	/* 0x7A 'z' */
+  { 0x00, 0x10, 0x10, 0x7C, 0xEE, 0x82, 0x82, 0x00 },	/* 0x7B '{' */
+  { 0x00, 0x00, 0x00, 0xFE, 0xFE, 0x00, 0x00, 0x00 },	/* 0x7C '|' */
+  { 0x00, 0x82, 0x82, 0xEE, 0x7C, 0x10, 0x10, 0x00 },	/* 0x7D '}' */
+  { 0x40, 0x80, 0x80, 0xC0, 0x40, 0x40, 0x80, 0x00 },	/* 0x7E '~' */
+  { 0x0E, 0x1E, 0x32, 0x62, 0x32, 0x1E, 0x0E, 0x00 },	/* 0x7F */
+  { 0x78, 0xFD, 0x85, 0x85, 0x87, 0xCE, 0x48, 0x00 },	/* 0x80 */
+  { 0xBC, 0xBE, 0x02, 0x02, 0xBC, 0xBE, 0x02, 0x00 },	/* 0x81 */
+  { 0x1C, 0x3E, 0x2A, 0x6A, 0xEA, 0xBA, 0x18, 0x00 },	/* 0x82 */
+  { 0x44, 0xAE, 0xAA, 0xAA, 0xBC, 0x9E, 0x42, 0x00 },	/* 0x83 */
+  { 0x84, 0xAE, 0x2A, 0x2A, 0x3C, 0x9E, 0x82, 0x00 },	/* 0x84 */
+  { 0x04, 0x2E, 0xAA, 0xEA, 0x7C, 0x1E, 0x02, 0x00 },	/* 0x85 */
+  { 0x04, 0x2E, 0xEA, 0xEA, 0x3C, 0x1E, 0x02, 0x00 },	/* 0x86 */
+  { 0x18, 0x3C, 0x25, 0x25, 0x27, 0x26, 0x24, 0x00 },	/* 0x87 */
+  { 0x5C, 0xBE, 0xAA, 0xAA, 0xAA, 0xBA, 0x58, 0x00 },	/* 0x88 */
+  { 0x9C, 0xBE, 0x2A, 0x2A, 0x2A, 0xBA, 0x98, 0x00 },	/* 0x89 */
+  { 0x1C, 0x3E, 0xAA, 0xEA, 0x6A, 0x3A, 0x18, 0x00 },	/* 0x8A */
+  { 0x00, 0x80, 0xA2, 0x3E, 0x3E, 0x82, 0x80, 0x00 },	/* 0x8B */
+  { 0x40, 0x80, 0xA2, 0xBE, 0xBE, 0x82, 0x40, 0x00 },	/* 0x8C */
+  { 0x00, 0x00, 0x92, 0xDE, 0x5E, 0x02, 0x00, 0x00 },	/* 0x8D */
+  { 0x9E, 0xBE, 0x68, 0x48, 0x68, 0xBE, 0x9E, 0x00 },	/* 0x8E */
+  { 0x1E, 0x7E, 0xE8, 0xA8, 0xE8, 0x7E, 0x1E, 0x00 },	/* 0x8F */
+  { 0x3E, 0x3E, 0x6A, 0xEA, 0xAA, 0x22, 0x22, 0x00 },	/* 0x90 */
+  { 0x04, 0x2E, 0x2A, 0x3E, 0x3E, 0x2A, 0x2A, 0x00 },	/* 0x91 */
+  { 0x3E, 0x7E, 0xD0, 0x90, 0xFE, 0xFE, 0x92, 0x00 },	/* 0x92 */
+  { 0x5C, 0xBE, 0xA2, 0xA2, 0xA2, 0xBE, 0x5C, 0x00 },	/* 0x93 */
+  { 0x9C, 0xBE, 0x22, 0x22, 0x22, 0xBE, 0x9C, 0x00 },	/* 0x94 */
+  { 0x1C, 0x3E, 0xA2, 0xE2, 0x62, 0x3E, 0x1C, 0x00 },	/* 0x95 */
+  { 0x5C, 0x9E, 0x82, 0x82, 0x9C, 0x5E, 0x02, 0x00 },	/* 0x96 */
+  { 0x3C, 0xBE, 0xC2, 0x42, 0x3C, 0x3E, 0x02, 0x00 },	/* 0x97 */
+  { 0xB9, 0xBD, 0x05, 0x05, 0x05, 0xBF, 0xBE, 0x00 },	/* 0x98 */
+  { 0x98, 0xBC, 0x66, 0x42, 0x66, 0xBC, 0x98, 0x00 },	/* 0x99 */
+  { 0xBC, 0xBE, 0x02, 0x02, 0x02, 0xBE, 0xBC, 0x00 },	/* 0x9A */
+  { 0x18, 0x3C, 0x24, 0xE7, 0xE7, 0x24, 0x24, 0x00 },	/* 0x9B */
+  { 0x12, 0x7E, 0xFE, 0x92, 0xC2, 0x66, 0x04, 0x00 },	/* 0x9C */
+  { 0x00, 0xD4, 0xF4, 0x3F, 0x3F, 0xF4, 0xD4, 0x00 },	/* 0x9D */
+  { 0xFF, 0xFF, 0x90, 0x90, 0xF4, 0x6F, 0x1F, 0x05 },	/* 0x9E */
+  { 0x04, 0x06, 0x12, 0x7E, 0xFC, 0x90, 0xC0, 0x40 },	/* 0x9F */
+  { 0x04, 0x2E, 0x6A, 0xEA, 0xBC, 0x1E, 0x02, 0x00 },	/* 0xA0 */
+  { 0x00, 0x00, 0x12, 0x5E, 0xDE, 0x82, 0x00, 0x00 },	/* 0xA1 */
+  { 0x1C, 0x3E, 0x22, 0x62, 0xE2, 0xBE, 0x1C, 0x00 },	/* 0xA2 */
+  { 0x3C, 0x3E, 0x42, 0xC2, 0xBC, 0x3E, 0x02, 0x00 },	/* 0xA3 */
+  { 0x50, 0xDE, 0x8E, 0xD0, 0x50, 0xDE, 0x8E, 0x00 },	/* 0xA4 */
+  { 0x5E, 0xDE, 0x98, 0xCC, 0x46, 0xDE, 0x9E, 0x00 },	/* 0xA5 */
+  { 0x00, 0x64, 0xF4, 0x94, 0xF4, 0xF4, 0x14, 0x00 },	/* 0xA6 */
+  { 0x00, 0x64, 0xF4, 0x94, 0xF4, 0x64, 0x00, 0x00 },	/* 0xA7 */
+  { 0x00, 0x04, 0x0E, 0xBA, 0xB2, 0x02, 0x06, 0x04 },	/* 0xA8 */
+  { 0x1C, 0x1C, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00 },	/* 0xA9 */
+  { 0x10, 0x10, 0x10, 0x10, 0x10, 0x1C, 0x1C, 0x00 },	/* 0xAA */
+  { 0x42, 0xF6, 0xFC, 0x18, 0x33, 0x77, 0xDD, 0x89 },	/* 0xAB */
+  { 0x42, 0xF6, 0xFC, 0x1A, 0x36, 0x6B, 0xDF, 0x82 },	/* 0xAC */
+  { 0x00, 0x00, 0x0C, 0xBE, 0xBE, 0x0C, 0x00, 0x00 },	/* 0xAD */
+  { 0x10, 0x38, 0x6C, 0x44, 0x10, 0x38, 0x6C, 0x44 },	/* 0xAE */
+  { 0x44, 0x6C, 0x38, 0x10, 0x44, 0x6C, 0x38, 0x10 },	/* 0xAF */
+  { 0x55, 0x00, 0xAA, 0x00, 0x55, 0x00, 0xAA, 0x00 },	/* 0xB0 */
+  { 0x55, 0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55, 0xAA },	/* 0xB1 */
+  { 0x55, 0xFF, 0xAA, 0xFF, 0x55, 0xFF, 0xAA, 0xFF },	/* 0xB2 */
+  { 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0x00 },	/* 0xB3 */
+  { 0x08, 0x08, 0x08, 0xFF, 0xFF, 0x00, 0x00, 0x00 },	/* 0xB4 */
+  { 0x28, 0x28, 0x28, 0xFF, 0xFF, 0x00, 0x00, 0x00 },	/* 0xB5 */
+  { 0x08, 0x08, 0xFF, 0xFF, 0x00, 0xFF, 0xFF, 0x00 },	/* 0xB6 */
+  { 0x08, 0x08, 0x0F, 0x0F, 0x08, 0x0F, 0x0F, 0x00 },	/* 0xB7 */
+  { 0x28, 0x28, 0x28, 0x3F, 0x3F, 0x00, 0x00, 0x00 },	/* 0xB8 */
+  { 0x28, 0x28, 0xEF, 0xEF, 0x00, 0xFF, 0xFF, 0x00 },	/* 0xB9 */
+  { 0x00, 0x00, 0xFF, 0xFF, 0x00, 0xFF, 0xFF, 0x00 },	/* 0xBA */
+  { 0x28, 0x28, 0x2F, 0x2F, 0x20, 0x3F, 0x3F, 0x00 },	/* 0xBB */
+  { 0x28, 0x28, 0xE8, 0xE8, 0x08, 0xF8, 0xF8, 0x00 },	/* 0xBC */
+  { 0x08, 0x08, 0xF8, 0xF8, 0x08, 0xF8, 0xF8, 0x00 },	/* 0xBD */
+  { 0x28, 0x28, 0x28, 0xF8, 0xF8, 0x00, 0x00, 0x00 },	/* 0xBE */
+  { 0x08, 0x08, 0x08, 0x0F, 0x0F, 0x00, 0x00, 0x00 },	/* 0xBF */
+  { 0x00, 0x00, 0x00, 0xF8, 0xF8, 0x08, 0x08, 0x08 },	/* 0xC0 */
+  { 0x08, 0x08, 0x08, 0xF8, 0xF8, 0x08, 0x08, 0x08 },	/* 0xC1 */
+  { 0x08, 0x08, 0x08, 0x0F, 0x0F, 0x08, 0x08, 0x08 },	/* 0xC2 */
+  { 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x08, 0x08, 0x08 },	/* 0xC3 */
+  { 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08 },	/* 0xC4 */
+  { 0x08, 0x08, 0x08, 0xFF, 0xFF, 0x08, 0x08, 0x08 },	/* 0xC5 */
+  { 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x28, 0x28, 0x28 },	/* 0xC6 */
+  { 0x00, 0x00, 0xFF, 0xFF, 0x00, 0xFF, 0xFF, 0x08 },	/* 0xC7 */
+  { 0x00, 0x00, 0xF8, 0xF8, 0x08, 0xE8, 0xE8, 0x28 },	/* 0xC8 */
+  { 0x00, 0x00, 0x3F, 0x3F, 0x20, 0x2F, 0x2F, 0x28 },	/* 0xC9 */
+  { 0x28, 0x28, 0xE8, 0xE8, 0x08, 0xE8, 0xE8, 0x28 },	/* 0xCA */
+  { 0x28, 0x28, 0x2F, 0x2F, 0x20, 0x2F, 0x2F, 0x28 },	/* 0xCB */
+  { 0x00, 0x00, 0xFF, 0xFF, 0x00, 0xEF, 0xEF, 0x28 },	/* 0xCC */
+  { 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28 },	/* 0xCD */
+  { 0x28, 0x28, 0xEF, 0xEF, 0x00, 0xEF, 0xEF, 0x28 },	/* 0xCE */
+  { 0x28, 0x28, 0x28, 0xE8, 0xE8, 0x28, 0x28, 0x28 },	/* 0xCF */
+  { 0x08, 0x08, 0xF8, 0xF8, 0x08, 0xF8, 0xF8, 0x08 },	/* 0xD0 */
+  { 0x28, 0x28, 0x28, 0x2F, 0x2F, 0x28, 0x28, 0x28 },	/* 0xD1 */
+  { 0x08, 0x08, 0x0F, 0x0F, 0x08, 0x0F, 0x0F, 0x08 },	/* 0xD2 */
+  { 0x00, 0x00, 0xF8, 0xF8, 0x08, 0xF8, 0xF8, 0x08 },	/* 0xD3 */
+  { 0x00, 0x00, 0x00, 0xF8, 0xF8, 0x28, 0x28, 0x28 },	/* 0xD4 */
+  { 0x00, 0x00, 0x00, 0x3F, 0x3F, 0x28, 0x28, 0x28 },	/* 0xD5 */
+  { 0x00, 0x00, 0x0F, 0x0F, 0x08, 0x0F, 0x0F, 0x08 },	/* 0xD6 */
+  { 0x08, 0x08, 0xFF, 0xFF, 0x08, 0xFF, 0xFF, 0x08 },	/* 0xD7 */
+  { 0x28, 0x28, 0x28, 0xFF, 0xFF, 0x28, 0x28, 0x28 },	/* 0xD8 */
+  { 0x08, 0x08, 0x08, 0xF8, 0xF8, 0x00, 0x00, 0x00 },	/* 0xD9 */
+  { 0x00, 0x00, 0x00, 0x0F, 0x0F, 0x08, 0x08, 0x08 },	/* 0xDA */
+  { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF },	/* 0xDB */
+  { 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F },	/* 0xDC */
+  { 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00 },	/* 0xDD */
+  { 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF },	/* 0xDE */
+  { 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0 },	/* 0xDF */
+  { 0x1C, 0x3E, 0x22, 0x36, 0x1C, 0x36, 0x22, 0x00 },	/* 0xE0 */
+  { 0x7E, 0xFE, 0x80, 0x90, 0xFA, 0x6E, 0x04, 0x00 },	/* 0xE1 */
+  { 0xFE, 0xFE, 0x80, 0x80, 0x80, 0xC0, 0xC0, 0x00 },	/* 0xE2 */
+  { 0x20, 0x3E, 0x3E, 0x20, 0x3E, 0x3E, 0x20, 0x00 },	/* 0xE3 */
+  { 0xC6, 0xEE, 0xBA, 0x92, 0x82, 0xC6, 0xC6, 0x00 },	/* 0xE4 */
+  { 0x1C, 0x3E, 0x22, 0x3E, 0x3C, 0x20, 0x20, 0x00 },	/* 0xE5 */
+  { 0x01, 0x3F, 0x3E, 0x02, 0x02, 0x3E, 0x3C, 0x00 },	/* 0xE6 */
+  { 0x20, 0x60, 0x40, 0x7E, 0x3E, 0x60, 0x40, 0x00 },	/* 0xE7 */
+  { 0x00, 0x99, 0xBD, 0xE7, 0xE7, 0xBD, 0x99, 0x00 },	/* 0xE8 */
+  { 0x38, 0x7C, 0xD6, 0x92, 0xD6, 0x7C, 0x38, 0x00 },	/* 0xE9 */
+  { 0x32, 0x7E, 0xCE, 0x80, 0xCE, 0x7E, 0x32, 0x00 },	/* 0xEA */
+  { 0x00, 0x0C, 0x1E, 0x52, 0xF2, 0xBE, 0x9C, 0x00 },	/* 0xEB */
+  { 0x18, 0x3C, 0x24, 0x3C, 0x3C, 0x24, 0x3C, 0x18 },	/* 0xEC */
+  { 0x19, 0x3F, 0x26, 0x3C, 0x7C, 0xE4, 0xBC, 0x18 },	/* 0xED */
+  { 0x00, 0x38, 0x7C, 0xD6, 0x92, 0x92, 0x92, 0x00 },	/* 0xEE */
+  { 0x3E, 0x7E, 0x40, 0x40, 0x40, 0x7E, 0x3E, 0x00 },	/* 0xEF */
+  { 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x54, 0x00 },	/* 0xF0 */
+  { 0x00, 0x22, 0x22, 0xFA, 0xFA, 0x22, 0x22, 0x00 },	/* 0xF1 */
+  { 0x00, 0x02, 0x8A, 0xDA, 0x72, 0x22, 0x02, 0x00 },	/* 0xF2 */
+  { 0x00, 0x02, 0x22, 0x72, 0xDA, 0x8A, 0x02, 0x00 },	/* 0xF3 */
+  { 0x00, 0x00, 0x00, 0x7F, 0xFF, 0x80, 0xE0, 0x60 },	/* 0xF4 */
+  { 0x06, 0x07, 0x01, 0xFF, 0xFE, 0x00, 0x00, 0x00 },	/* 0xF5 */
+  { 0x00, 0x10, 0x10, 0x54, 0x54, 0x10, 0x10, 0x00 },	/* 0xF6 */
+  { 0x24, 0x6C, 0x48, 0x6C, 0x24, 0x6C, 0x48, 0x00 },	/* 0xF7 */
+  { 0x00, 0x60, 0xF0, 0x90, 0xF0, 0x60, 0x00, 0x00 },	/* 0xF8 */
+  { 0x00, 0x00, 0x00, 0x18, 0x18, 0x00, 0x00, 0x00 },	/* 0xF9 */
+  { 0x00, 0x00, 0x00, 0x10, 0x10, 0x00, 0x00, 0x00 },	/* 0xFA */
+  { 0x08, 0x0C, 0x0E, 0x03, 0xFF, 0xFF, 0x80, 0x80 },	/* 0xFB */
+  { 0x00, 0x80, 0xF8, 0x78, 0x80, 0xF8, 0x78, 0x00 },	/* 0xFC */
+  { 0x00, 0x88, 0x98, 0xB8, 0xE8, 0x48, 0x00, 0x00 },	/* 0xFD */
+  { 0x00, 0x00, 0x3C, 0x3C, 0x3C, 0x3C, 0x00, 0x00 },	/* 0xFE */
+  { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	/* 0xFF */
+} ;
@@ -24,6 +24,7 @@
 
 #include <sys/time.h>
 #include <stdio.h>
+#include <string.h>
 //#include <stdlib.h>
 //#include <unistd.h>
 
@@ -107,10 +108,112 @@ static unsigned int maxDetectClockByte (const int pin)
 }
 
 
+/*
+ * maxDetectEdges:
+ *	Get the pin ready to have its edges timed by the kernel, the first
+ *	time we see it. Returns FALSE if that can't be done here, and we fall
+ *	back to polling the pin.
+ *********************************************************************************
+ */
+
+#define	MAXDETECT_EVENTS	256
+
+static int maxDetectEdges (const int pin)
+{
+  static int state [64] ;	// 0: Not tried, 1: Yes, -1: No
+
+  if ((pin < 0) || (pin > 63))
+    return FALSE ;
+
+  if (state [pin] == 0)
+  {
+    if (wiringPiEventPrecise (pin) && (wiringPiEventEnable (pin, MAXDETECT_EVENTS) == 0) &&
+	(wiringPiISR (pin, INT_EDGE_BOTH, NULL) == 0))
+      state [pin] = 1 ;
+    else
+      state [pin] = -1 ;
+  }
+
+  return state [pin] == 1 ;
+}
+
+
+/*
+ * maxDetectDecode:
+ *	Work the 40 bits out from the edges after the fact. Each bit is a
+ *	low of about 50µS then a high of 26-28µS for a 0 or 70µS for a 1,
+ *	and the line's left high after the last one, so the bits are the last
+ *	40 complete high pulses - anything before that is the wake-up and the
+ *	sensor's 80µS response.
+ *********************************************************************************
+ */
+
+static int maxDetectDecode (const struct wpiEdgeEventStruct *events, int count, unsigned char localBuf [5])
+{
+  unsigned int widths [MAXDETECT_EVENTS / 2] ;
+  unsigned int width ;
+  int i, pulses = 0, first ;
+
+  for (i = 0 ; i < count - 1 ; ++i)
+    if ((events [i].edge == INT_EDGE_RISING) && (events [i + 1].edge == INT_EDGE_FALLING))
+      widths [pulses++] = (unsigned int)((events [i + 1].timestamp - events [i].timestamp) / 1000) ;
+
+  if (pulses < 40)
+    return FALSE ;
+
+  memset (localBuf, 0, 5) ;
+  first = pulses - 40 ;
+
+  for (i = 0 ; i < 40 ; ++i)
+  {
+    if ((width = widths [first + i]) > 100)	// Not one of ours
+      return FALSE ;
+    localBuf [i / 8] = (localBuf [i / 8] << 1) | ((width > 48) ? 1 : 0) ;
+  }
+
+  return TRUE ;
+}
+
+
+/*
+ * maxDetectEdgeRead:
+ *	Wake the sensor up and go to sleep while the kernel times its reply
+ *	for us - the whole thing takes about 5mS after the wake-up pulse.
+ *	Nothing here minds being pre-empted.
+ *********************************************************************************
+ */
+
+static int maxDetectEdgeRead (const int pin, unsigned char localBuf [5])
+{
+  struct wpiEdgeEventStruct events [MAXDETECT_EVENTS] ;
+  int count, n ;
+
+// Throw away anything left over from last time
+
+  while (wiringPiEventReadPin (pin, events, MAXDETECT_EVENTS) > 0)
+    ;
+
+  pinMode      (pin, OUTPUT) ;
+  digitalWrite (pin, 0) ; delay             (10) ;
+  digitalWrite (pin, 1) ; delayMicroseconds (40) ;
+  pinMode      (pin, INPUT) ;
+
+  delay (8) ;
+
+  for (count = 0 ; count < MAXDETECT_EVENTS ; count += n)
+    if ((n = wiringPiEventReadPin (pin, events + count, MAXDETECT_EVENTS - count)) <= 0)
+      break ;
+
+  return maxDetectDecode (events, count, localBuf) ;
+}
+
+
 /*
  * maxDetectRead:
  *	Read in and return the 4 data bytes from the MaxDetect sensor.
- *	Return TRUE/FALSE depending on the checksum validity
+ *	Return TRUE/FALSE depending on the checksum validity.
+ *	With the GPIO character device the kernel times the edges for us;
+ *	without it we poll the pin and hope we don't get pre-empted.
  *********************************************************************************
  */
 
@@ -121,6 +224,23 @@ int maxDetectRead (const int pin, unsigned char buffer [4])
   unsigned char localBuf [5] ;
   struct timeval now, then, took ;
 
+// Let the kernel time it if we can
+
+  if (maxDetectEdges (pin))
+  {
+    if (!maxDetectEdgeRead (pin, localBuf))
+      return FALSE ;
+
+    checksum = 0 ;
+    for (i = 0 ; i < 4 ; ++i)
+    {
+      buffer [i] = localBuf [i] ;
+      checksum += localBuf [i] ;
+    }
+
+    return (checksum & 0xFF) == localBuf [4] ;
+  }
+
 // See how long we took
 
   gettimeofday (&then, NULL) ;
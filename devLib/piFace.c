@@ -30,9 +30,24 @@
 
 #include <wiringPi.h>
 #include <mcp23s17.h>
+#include <mcp23x17isr.h>
 
 #include "piFace.h"
 
+// Input change callbacks, by board: the PiFace inputs are port B of
+//	its mcp23s17, which lives at pinBase + 16
+
+#define	MAX_PIFACES	4
+
+struct piFaceIntStruct
+{
+  int   pinBase ;
+  void (*functions [8])(int pin, int value) ;
+} ;
+
+static struct piFaceIntStruct piFaces [MAX_PIFACES] ;
+static int                    numPiFaces = 0 ;
+
 
 /*
  * myDigitalWrite:
@@ -86,14 +101,17 @@ void myPullUpDnControl (struct wiringPiNodeStruct *node, int pin, int pud)
  *********************************************************************************
  */
 
-int piFaceSetup (const int pinBase)
+static int doPiFaceSetup (const int pinBase, const int intPin)
 {
   int    i ;
   struct wiringPiNodeStruct *node ;
 
 // Create an mcp23s17 instance:
 
-   mcp23s17Setup (pinBase + 16, 0, 0) ;
+  if (intPin < 0)
+    mcp23s17Setup (pinBase + 16, 0, 0) ;
+  else if (!mcp23s17SetupInt (pinBase + 16, 0, 0, intPin))
+    return -1 ;
 
 // Set the direction bits
 
@@ -110,3 +128,86 @@ int piFaceSetup (const int pinBase)
 
   return 0 ;
 }
+
+int piFaceSetup (const int pinBase)
+{
+  return doPiFaceSetup (pinBase, -1) ;
+}
+
+
+/*
+ * piFaceSetupInt:
+ *	As above, but with the mcp23s17's interrupt output (INTB, on
+ *	BCM_GPIO 25 on the PiFace) connected to the given Pi pin, so the
+ *	inputs can have change callbacks with piFaceISR () rather than
+ *	being polled over SPI.
+ *********************************************************************************
+ */
+
+int piFaceSetupInt (const int pinBase, const int intPin)
+{
+  if (numPiFaces == MAX_PIFACES)
+    return -1 ;
+
+  if (doPiFaceSetup (pinBase, intPin) < 0)
+    return -1 ;
+
+  piFaces [numPiFaces++].pinBase = pinBase ;
+
+  return 0 ;
+}
+
+
+/*
+ * piFaceDispatch:
+ *	The mcp23x17ISR callback: map the mcp23s17 pin back to the PiFace
+ *	input and call its function
+ *********************************************************************************
+ */
+
+static void piFaceDispatch (int pin, int value)
+{
+  struct piFaceIntStruct *pf ;
+  int i, input ;
+
+  for (i = 0 ; i < numPiFaces ; ++i)
+  {
+    pf    = &piFaces [i] ;
+    input = pin - (pf->pinBase + 16 + 8) ;
+    if ((input >= 0) && (input < 8) && (pf->functions [input] != NULL))
+    {
+      pf->functions [input] (pf->pinBase + input, value) ;
+      return ;
+    }
+  }
+}
+
+
+/*
+ * piFaceISR:
+ *	Call the function whenever one of the inputs (pinBase + 0 to 7)
+ *	changes, with the given INT_EDGE_ mode. It's called from the ISR
+ *	thread with the pin and its level when it changed, read once from
+ *	INTCAP. A NULL function stops it.
+ *	Returns 0 or -1.
+ *********************************************************************************
+ */
+
+int piFaceISR (int pin, int mode, void (*function)(int pin, int value))
+{
+  struct piFaceIntStruct *pf ;
+  int i, input ;
+
+  for (i = 0 ; i < numPiFaces ; ++i)
+  {
+    pf    = &piFaces [i] ;
+    input = pin - pf->pinBase ;
+    if ((input >= 0) && (input < 8))
+    {
+      pf->functions [input] = function ;
+      return mcp23x17ISR (pf->pinBase + 16 + 8 + input, mode, (function == NULL) ? NULL : piFaceDispatch) ;
+    }
+  }
+
+  return -1 ;
+}
@@ -25,7 +25,13 @@
 extern "C" {
 #endif
 
-extern int  piFaceSetup (const int pinBase) ;
+// The mcp23s17 INTB output is wired to BCM_GPIO 25
+
+#define	PIFACE_INT_GPIO	25
+
+extern int  piFaceSetup    (const int pinBase) ;
+extern int  piFaceSetupInt (const int pinBase, const int intPin) ;
+extern int  piFaceISR      (int pin, int mode, void (*function)(int pin, int value)) ;
 
 #ifdef __cplusplus
 }
@@ -22,6 +22,8 @@
  ***********************************************************************
  */
 
+#include <string.h>
+
 #include <wiringPi.h>
 #include <sn3218.h>
 
@@ -33,6 +35,12 @@ static int leg0 [6] = {  6,  7,  8,  5,  4,  9 } ;
 static int leg1 [6] = { 17, 16, 15, 13, 11, 10 } ;
 static int leg2 [6] = {  0,  1,  2,  3, 14, 12 } ;
 
+static int *legs [3] = { leg0, leg1, leg2 } ;
+
+// What's on the LEDs now, so multi-LED changes can go out as one frame
+
+static unsigned char frame [18] ;
+
 
 /*
  * piGlow1:
@@ -54,6 +62,7 @@ void piGlow1 (const int leg, const int ring, const int intensity)
   else
     legLeds = leg2 ;
 
+  frame [legLeds [ring]] = intensity ;
   analogWrite (PIGLOW_BASE + legLeds [ring], intensity) ;
 }
 
@@ -79,7 +88,9 @@ void piGlowLeg (const int leg, const int intensity)
     legLeds = leg2 ;
 
   for (i = 0 ; i < 6 ; ++i)
-    analogWrite (PIGLOW_BASE + legLeds [i], intensity) ;
+    frame [legLeds [i]] = intensity ;
+
+  sn3218WriteFrameRaw (frame) ;
 }
 
 
@@ -94,9 +105,29 @@ void piGlowRing (const int ring, const int intensity)
   if ((ring < 0) || (ring > 5))
     return ;
 
-  analogWrite (PIGLOW_BASE + leg0 [ring], intensity) ;
-  analogWrite (PIGLOW_BASE + leg1 [ring], intensity) ;
-  analogWrite (PIGLOW_BASE + leg2 [ring], intensity) ;
+  frame [leg0 [ring]] = intensity ;
+  frame [leg1 [ring]] = intensity ;
+  frame [leg2 [ring]] = intensity ;
+
+  sn3218WriteFrameRaw (frame) ;
+}
+
+
+/*
+ * piGlowFrame:
+ *	Set every LED at once, by leg then ring, in one update.
+ *********************************************************************************
+ */
+
+void piGlowFrame (const unsigned char intensity [3][6])
+{
+  int leg, ring ;
+
+  for (leg = 0 ; leg < 3 ; ++leg)
+    for (ring = 0 ; ring < 6 ; ++ring)
+      frame [legs [leg][ring]] = intensity [leg][ring] ;
+
+  sn3218WriteFrameRaw (frame) ;
 }
 
 /*
@@ -111,8 +142,7 @@ void piGlowSetup (int clear)
 
   if (clear)
   {
-    piGlowLeg (0, 0) ;
-    piGlowLeg (1, 0) ;
-    piGlowLeg (2, 0) ;
+    memset (frame, 0, sizeof (frame)) ;
+    sn3218WriteFrameRaw (frame) ;
   }
 }
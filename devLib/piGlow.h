@@ -38,6 +38,7 @@ extern "C" {
 extern void piGlow1     (const int leg,  const int ring, const int intensity) ;
 extern void piGlowLeg   (const int leg,  const int intensity) ;
 extern void piGlowRing  (const int ring, const int intensity) ;
+extern void piGlowFrame (const unsigned char intensity [3][6]) ;
 extern void piGlowSetup (int clear) ;
 
 #ifdef __cplusplus
@@ -111,3 +111,90 @@ unsigned int readNesJoystick (int joystick)
 
   return value ^ 0xFF ;
 }
+
+
+/*
+ * readNesJoysticks:
+ *	Scan the first n joysticks together, putting the results in out [].
+ *	Controllers normally share the latch and clock lines, so each is only
+ *	pulsed once and every data pin is sampled from a single snapshot of the
+ *	GPIO levels per clock - four players take as long as one.
+ *	Returns the number scanned.
+ *********************************************************************************
+ */
+
+static void pulseAll (const unsigned int *pins, int numPins, int value)
+{
+  int i ;
+
+  for (i = 0 ; i < numPins ; ++i)
+    digitalWrite (pins [i], value) ;
+}
+
+static void readAll (const int *pins, int numPins, unsigned int *out)
+{
+  unsigned char levels [MAX_NES_JOYSTICKS] ;
+  int i ;
+
+// Not all on-board? Do it slowly.
+
+  if (digitalReadPins (pins, numPins, levels) != numPins)
+    for (i = 0 ; i < numPins ; ++i)
+      levels [i] = digitalRead (pins [i]) ;
+
+  for (i = 0 ; i < numPins ; ++i)
+    out [i] = (out [i] << 1) | (levels [i] != LOW) ;
+}
+
+int readNesJoysticks (int n, unsigned int out [])
+{
+  unsigned int lPins [MAX_NES_JOYSTICKS], cPins [MAX_NES_JOYSTICKS] ;
+  int          dPins [MAX_NES_JOYSTICKS] ;
+  int numL = 0, numC = 0 ;
+  int i, j ;
+
+  if (n > joysticks)
+    n = joysticks ;
+
+  if (n <= 0)
+    return 0 ;
+
+// Gather the distinct latch and clock pins
+
+  for (i = 0 ; i < n ; ++i)
+  {
+    dPins [i] = nesPins [i].dPin ;
+    out   [i] = 0 ;
+
+    for (j = 0 ; (j < numL) && (lPins [j] != nesPins [i].lPin) ; ++j)
+      ;
+    if (j == numL)
+      lPins [numL++] = nesPins [i].lPin ;
+
+    for (j = 0 ; (j < numC) && (cPins [j] != nesPins [i].cPin) ; ++j)
+      ;
+    if (j == numC)
+      cPins [numC++] = nesPins [i].cPin ;
+  }
+
+// Toggle Latch - which presents the first bit
+
+  pulseAll (lPins, numL, HIGH) ; delayMicroseconds (PULSE_TIME) ;
+  pulseAll (lPins, numL, LOW)  ; delayMicroseconds (PULSE_TIME) ;
+
+  readAll (dPins, n, out) ;
+
+// Now get the next 7 bits with the clock
+
+  for (i = 0 ; i < 7 ; ++i)
+  {
+    pulseAll (cPins, numC, HIGH) ; delayMicroseconds (PULSE_TIME) ;
+    pulseAll (cPins, numC, LOW)  ; delayMicroseconds (PULSE_TIME) ;
+    readAll (dPins, n, out) ;
+  }
+
+  for (i = 0 ; i < n ; ++i)
+    out [i] ^= 0xFF ;
+
+  return n ;
+}
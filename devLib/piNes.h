@@ -39,6 +39,7 @@ extern "C" {
 
 extern int          setupNesJoystick (int dPin, int cPin, int lPin) ;
 extern unsigned int  readNesJoystick (int joystick) ;
+extern int          readNesJoysticks (int n, unsigned int out []) ;
 
 #ifdef __cplusplus
 }
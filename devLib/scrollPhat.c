@@ -27,10 +27,12 @@
 #include <stdarg.h>
 #include <string.h>
 #include <time.h>
+#include <errno.h>
+#include <pthread.h>
 
 #include <wiringPiI2C.h>
 
-#include "scrollPhatFont.h"
+#include "scrollPhatFontCols.h"
 #include "scrollPhat.h"
 
 // Size
@@ -47,46 +49,45 @@
 
 static unsigned char frameBuffer [SP_WIDTH * SP_HEIGHT] ;
 
-static int lastX,   lastY ;
-static int printDelayFactor  ;
-static int scrollPhatFd ;
-
-static int putcharX ;
+// ... and what's actually on the display, as the column bytes we last
+//	sent it. We only send the columns that change.
 
-#undef	DEBUG
+static unsigned char shownColumns [SP_WIDTH] ;
+static int           shownValid = 0 ;
 
+static pthread_mutex_t phatLock = PTHREAD_MUTEX_INITIALIZER ;
 
-/*
- * delay:
- *	Wait for some number of milliseconds.
- *	This taken from wiringPi as there is no-need to include the whole of
- *	wiringPi just for the delay function.
- *********************************************************************************
- */
+// Background scrolling
 
-static void delay (unsigned int howLong)
-{
-  struct timespec sleeper, dummy ;
+static pthread_t       scrollThread ;
+static int             scrolling   = 0 ;	// Thread exists
+static volatile int    scrollStop  = 0 ;
+static volatile int    scrollBusy  = 0 ;	// Message still moving
+static char           *scrollText  = NULL ;
 
-  sleeper.tv_sec  = (time_t)(howLong / 1000) ;
-  sleeper.tv_nsec = (long)(howLong % 1000) * 1000000 ;
+static int lastX,   lastY ;
+static int printDelayFactor  ;
+static int scrollPhatFd ;
 
-  nanosleep (&sleeper, &dummy) ;
-}
+static int putcharX ;
 
+#undef	DEBUG
 
 
 /*
  * scrollPhatUpdate:
- *	Copy our software version to the real display
+ *	Copy our software version to the real display. Only the columns that
+ *	differ from what's already there are sent, in one block write, and
+ *	nothing at all is sent if nothing has changed.
  *********************************************************************************
  */
 
-void scrollPhatUpdate (void)
+static void updateDisplay (void)
 {
   register int x, y ;
   register unsigned char data, pixel ;
   unsigned char pixels [SP_WIDTH] ;
+  int first, last ;
 
 #ifdef	DEBUG
   printf ("+-----------+\n") ;
@@ -114,10 +115,32 @@ void scrollPhatUpdate (void)
     pixels [x] = data ;
   }
 
-  for (x = 0 ; x < SP_WIDTH ; ++x)
-    wiringPiI2CWriteReg8 (scrollPhatFd, 1 + x, pixels [x]) ;
+  for (first = 0 ; first < SP_WIDTH ; ++first)
+    if (!shownValid || (pixels [first] != shownColumns [first]))
+      break ;
+
+  if (first == SP_WIDTH)
+    return ;
+
+  for (last = SP_WIDTH - 1 ; last > first ; --last)
+    if (!shownValid || (pixels [last] != shownColumns [last]))
+      break ;
+
+  if (wiringPiI2CWriteBlock (scrollPhatFd, 1 + first, &pixels [first], last - first + 1) < 0)
+    for (x = first ; x <= last ; ++x)
+      wiringPiI2CWriteReg8 (scrollPhatFd, 1 + x, pixels [x]) ;
 
   wiringPiI2CWriteReg8 (scrollPhatFd, 0x0C, 0) ;
+
+  memcpy (shownColumns, pixels, SP_WIDTH) ;
+  shownValid = 1 ;
+}
+
+void scrollPhatUpdate (void)
+{
+  pthread_mutex_lock   (&phatLock) ;
+  updateDisplay () ;
+  pthread_mutex_unlock (&phatLock) ;
 }
 
 
@@ -235,8 +258,8 @@ void scrollPhatRectangle (int x1, int y1, int x2, int y2, int colour, int filled
  * scrollPhatPutchar:
  *      Print a single character to the screen then advance the pointer by an
  *	appropriate ammount (variable width font).
- *      We rely on the clipping done by the pixel plot function to keep us
- *      out of trouble.
+ *	The font's packed a column at a time with the widths worked out, so
+ *	it goes in a column at a time and anything off the screen is skipped.
  *	Return the width + space
  *********************************************************************************
  */
@@ -245,10 +268,9 @@ int scrollPhatPutchar (int c)
 {
   register int x, y ;
 
-  unsigned char line ;
-  unsigned char *fontPtr ;
-  unsigned char *p2 ;
-  int lineWidth, width, mask ;
+  const struct scrollPhatGlyph *g ;
+  unsigned char column ;
+  int width, px ;
 
 // The font is printable characters, uppercase only...
 //	and somewhat varaible width...
@@ -259,47 +281,24 @@ int scrollPhatPutchar (int c)
   else
     c -= 32 ;
 
-  fontPtr = scrollPhatFont + c * fontHeight ;
+  g     = &scrollPhatFontCols [c & 63] ;
+  width = g->width ;
 
-// Work out width of this character
-//	There probably is a more efficient way to do this, but...
+// The glyph and a line of space after it
 
-  p2    = fontPtr ;
-  width = 0 ;
-  for (y = 0 ; y < fontHeight ; ++y)
+  for (x = 0 ; x <= width ; ++x)
   {
-    mask = 0x80 ;
-    for (lineWidth = 8 ; lineWidth > 0 ; --lineWidth)
-    {
-      if ((*p2 & mask) != 0)
-	break ;
-      mask >>= 1 ;
-    }
-    if (lineWidth > width)
-      width = lineWidth ;
+    px = putcharX + x ;
+    if ((px < 0) || (px >= SP_WIDTH))
+      continue ;
 
-    ++p2 ;
+    column = (x < width) ? g->cols [x] : 0 ;
+    for (y = 0 ; y < SP_FONT_HEIGHT ; ++y)
+      frameBuffer [px + y * SP_WIDTH] = (column >> y) & 1 ;
   }
 
-  if (width == 0)	// Likely to be a blank or space character
-    width = 3 ;
-
-  for (y = fontHeight - 1 ; y >= 0 ; --y)
-  {
-    x    = 0 ;
-    line = *fontPtr++ ;
-    for (mask = 1 << (width - 1) ; mask != 0 ; mask >>= 1)
-    {
-      scrollPhatPoint (putcharX + x, y, (line & mask)) ;
-      ++x ;
-    }
-  }
-
-// make a line of space
-
-  for (y = fontHeight - 1 ; y >= 0 ; --y)
-    scrollPhatPoint (putcharX + width, y, 0) ;
-
+  lastX    = putcharX + width ;
+  lastY    = 0 ;
   putcharX = putcharX + width + 1 ;
 
   return width + 1 ;
@@ -308,41 +307,114 @@ int scrollPhatPutchar (int c)
 
 /*
  * scrollPhatPuts:
+ * scrollPhatPutsAsync:
  *	Send a string to the display - and scroll it across.
  *	This is somewhat of a hack in that we print the entire string to the
  *	display and let the point clipping take care of what's off-screen...
+ *	The scrolling is done by a thread, one pixel every print-speed mS. The
+ *	async version returns straight away (replacing anything that's still
+ *	scrolling) and scrollPhatBusy () says when it's done. scrollPhatPuts
+ *	waits for it.
  *********************************************************************************
  */
 
-void scrollPhatPuts (const char *str)
+static void drawText (const char *str, int x)
 {
-  int i ;
-  int movingX = 0 ;
-  const char *s ;
-  int pixelLen ;
+  putcharX = x ;
+  while (*str)
+    scrollPhatPutchar (*str++) ;
+}
 
-// Print it once, then we know the width in pixels...
+static void *scrollPhatThread (void *arg)
+{
+  const char *str = (const char *)arg ;
+  struct timespec next ;
+  int i, pixelLen ;
 
-  putcharX = 0 ;
-  s = str ;
-  while (*s)
-    scrollPhatPutchar (*s++) ;
+// Print it once, then we know the width in pixels...
 
-  pixelLen = putcharX ;
+  pthread_mutex_lock (&phatLock) ;
+    drawText (str, 0) ;
+    pixelLen = putcharX ;
+  pthread_mutex_unlock (&phatLock) ;
 
 // Now scroll it by printing it and moving left one pixel
 
-  movingX = 0 ;
-  for (i = 0 ; i < pixelLen ; ++i)
+  clock_gettime (CLOCK_MONOTONIC, &next) ;
+
+  for (i = 0 ; (i < pixelLen) && !scrollStop ; ++i)
   {
-    putcharX = movingX ;
-    s = str ;
-    while (*s)
-      scrollPhatPutchar (*s++) ;
-    --movingX ;
-    scrollPhatUpdate () ;
-    delay (printDelayFactor) ;
+    pthread_mutex_lock (&phatLock) ;
+      drawText (str, -i) ;
+      updateDisplay () ;
+    pthread_mutex_unlock (&phatLock) ;
+
+    next.tv_nsec += (long)printDelayFactor * 1000000 ;
+    while (next.tv_nsec >= 1000000000)
+    {
+      next.tv_nsec -= 1000000000 ;
+      ++next.tv_sec ;
+    }
+    while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+      ;
   }
+
+  scrollBusy = 0 ;
+
+  return NULL ;
+}
+
+static void stopScrolling (void)
+{
+  if (!scrolling)
+    return ;
+
+  scrollStop = 1 ;
+  pthread_join (scrollThread, NULL) ;
+  scrolling  = 0 ;
+
+  free (scrollText) ;
+  scrollText = NULL ;
+}
+
+int scrollPhatPutsAsync (const char *str)
+{
+  stopScrolling () ;
+
+  if ((scrollText = strdup (str)) == NULL)
+    return -1 ;
+
+  scrollStop = 0 ;
+  scrollBusy = 1 ;
+
+  if (pthread_create (&scrollThread, NULL, scrollPhatThread, scrollText) != 0)
+  {
+    scrollBusy = 0 ;
+    free (scrollText) ;
+    scrollText = NULL ;
+    return -1 ;
+  }
+
+  scrolling = 1 ;
+
+  return 0 ;
+}
+
+int scrollPhatBusy (void)
+{
+  return scrollBusy ;
+}
+
+void scrollPhatPuts (const char *str)
+{
+  if (scrollPhatPutsAsync (str) < 0)
+    return ;
+
+  pthread_join (scrollThread, NULL) ;
+  scrolling = 0 ;
+
+  free (scrollText) ;
+  scrollText = NULL ;
 }
 
 
@@ -391,6 +463,8 @@ void scrollPhatClear (void)
   register int i ;
   register unsigned char *ptr = frameBuffer ;
 
+  stopScrolling () ;
+
   for (i = 0 ; i < (SP_WIDTH * SP_HEIGHT) ; ++i)
     *ptr++ = 0 ;
 
@@ -32,6 +32,8 @@ extern void scrollPhatClear      (void) ;
 extern int  scrollPhatPutchar    (int c) ;
 //extern void scrollPhatPutchar    (int c) ;
 extern void scrollPhatPuts       (const char *str) ;
+extern int  scrollPhatPutsAsync  (const char *str) ;
+extern int  scrollPhatBusy       (void) ;
 extern void scrollPhatPrintf     (const char *message, ...) ;
 extern void scrollPhatPrintSpeed (const int cps10) ;
 
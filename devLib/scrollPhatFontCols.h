@@ -0,0 +1,103 @@
+/*
+ * scrollPhatFontCols.h:
+ *	The Scroll Phat font from scrollPhatFont.h pre-packed a column at a
+ *	time: the width of each glyph (blanks are 3) and a byte per column,
+ *	bit y for the pixel at row y, so nothing's worked out as it's drawn.
+ *	Space to _ only, 0x20 onwards.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#define	SP_FONT_HEIGHT	5
+#define	SP_FONT_COLS	5
+
+struct scrollPhatGlyph
+{
+  unsigned char width ;
+  unsigned char cols [SP_FONT_COLS] ;
+} ;
+
+static const struct scrollPhatGlyph scrollPhatFontCols [64] =
+{
+  { 3, { 0x00, 0x00, 0x00, 0x00, 0x00 } },	/* 0x20 ' ' */
+  { 1, { 0x1D, 0x00, 0x00, 0x00, 0x00 } },	/* 0x21 '!' */
+  { 3, { 0x18, 0x00, 0x18, 0x00, 0x00 } },	/* 0x22 '"' */
+  { 4, { 0x1F, 0x0A, 0x0A, 0x1F, 0x00 } },	/* 0x23 '#' */
+  { 4, { 0x03, 0x0A, 0x0E, 0x18, 0x00 } },	/* 0x24 '$' */
+  { 4, { 0x13, 0x04, 0x04, 0x19, 0x00 } },	/* 0x25 '%' */
+  { 4, { 0x0A, 0x15, 0x12, 0x01, 0x00 } },	/* 0x26 '&' */
+  { 2, { 0x08, 0x10, 0x00, 0x00, 0x00 } },	/* 0x27 ''' */
+  { 4, { 0x04, 0x0A, 0x11, 0x11, 0x00 } },	/* 0x28 '(' */
+  { 4, { 0x11, 0x11, 0x0A, 0x04, 0x00 } },	/* 0x29 ')' */
+  { 4, { 0x15, 0x0E, 0x0E, 0x15, 0x00 } },	/* 0x2A '*' */
+  { 4, { 0x04, 0x1F, 0x1F, 0x04, 0x00 } },	/* 0x2B '+' */
+  { 2, { 0x01, 0x02, 0x00, 0x00, 0x00 } },	/* 0x2C ',' */
+  { 4, { 0x04, 0x04, 0x04, 0x04, 0x00 } },	/* 0x2D '-' */
+  { 1, { 0x01, 0x00, 0x00, 0x00, 0x00 } },	/* 0x2E '.' */
+  { 4, { 0x03, 0x06, 0x08, 0x18, 0x00 } },	/* 0x2F '/' */
+  { 4, { 0x0E, 0x11, 0x11, 0x0E, 0x00 } },	/* 0x30 '0' */
+  { 3, { 0x09, 0x1F, 0x01, 0x00, 0x00 } },	/* 0x31 '1' */
+  { 4, { 0x03, 0x15, 0x15, 0x09, 0x00 } },	/* 0x32 '2' */
+  { 4, { 0x15, 0x15, 0x15, 0x0A, 0x00 } },	/* 0x33 '3' */
+  { 4, { 0x0C, 0x14, 0x1F, 0x04, 0x00 } },	/* 0x34 '4' */
+  { 4, { 0x1D, 0x15, 0x15, 0x16, 0x00 } },	/* 0x35 '5' */
+  { 4, { 0x06, 0x09, 0x15, 0x02, 0x00 } },	/* 0x36 '6' */
+  { 4, { 0x11, 0x12, 0x14, 0x18, 0x00 } },	/* 0x37 '7' */
+  { 4, { 0x0A, 0x15, 0x15, 0x0A, 0x00 } },	/* 0x38 '8' */
+  { 4, { 0x08, 0x14, 0x15, 0x0E, 0x00 } },	/* 0x39 '9' */
+  { 1, { 0x0A, 0x00, 0x00, 0x00, 0x00 } },	/* 0x3A ':' */
+  { 2, { 0x01, 0x0A, 0x00, 0x00, 0x00 } },	/* 0x3B ';' */
+  { 4, { 0x04, 0x0A, 0x11, 0x00, 0x00 } },	/* 0x3C '<' */
+  { 4, { 0x0A, 0x0A, 0x0A, 0x0A, 0x00 } },	/* 0x3D '=' */
+  { 3, { 0x00, 0x00, 0x00, 0x00, 0x00 } },	/* 0x3E '>' */
+  { 3, { 0x10, 0x15, 0x08, 0x00, 0x00 } },	/* 0x3F '?' */
+  { 4, { 0x0C, 0x1A, 0x11, 0x09, 0x00 } },	/* 0x40 '@' */
+  { 4, { 0x0F, 0x14, 0x14, 0x0F, 0x00 } },	/* 0x41 'A' */
+  { 4, { 0x1F, 0x15, 0x15, 0x0A, 0x00 } },	/* 0x42 'B' */
+  { 4, { 0x0E, 0x11, 0x11, 0x0A, 0x00 } },	/* 0x43 'C' */
+  { 4, { 0x1F, 0x11, 0x11, 0x0E, 0x00 } },	/* 0x44 'D' */
+  { 4, { 0x1F, 0x15, 0x15, 0x11, 0x00 } },	/* 0x45 'E' */
+  { 4, { 0x1F, 0x14, 0x14, 0x10, 0x00 } },	/* 0x46 'F' */
+  { 4, { 0x0E, 0x11, 0x13, 0x0A, 0x00 } },	/* 0x47 'G' */
+  { 4, { 0x1F, 0x04, 0x04, 0x1F, 0x00 } },	/* 0x48 'H' */
+  { 3, { 0x11, 0x1F, 0x11, 0x00, 0x00 } },	/* 0x49 'I' */
+  { 4, { 0x02, 0x11, 0x1E, 0x10, 0x00 } },	/* 0x4A 'J' */
+  { 4, { 0x1F, 0x04, 0x0A, 0x11, 0x00 } },	/* 0x4B 'K' */
+  { 3, { 0x1F, 0x01, 0x01, 0x00, 0x00 } },	/* 0x4C 'L' */
+  { 5, { 0x1F, 0x08, 0x04, 0x08, 0x1F } },	/* 0x4D 'M' */
+  { 4, { 0x1F, 0x08, 0x04, 0x1F, 0x00 } },	/* 0x4E 'N' */
+  { 4, { 0x0E, 0x11, 0x11, 0x0E, 0x00 } },	/* 0x4F 'O' */
+  { 4, { 0x1F, 0x14, 0x14, 0x08, 0x00 } },	/* 0x50 'P' */
+  { 4, { 0x0E, 0x11, 0x12, 0x0D, 0x00 } },	/* 0x51 'Q' */
+  { 4, { 0x1F, 0x14, 0x16, 0x0D, 0x00 } },	/* 0x52 'R' */
+  { 4, { 0x08, 0x15, 0x15, 0x02, 0x00 } },	/* 0x53 'S' */
+  { 3, { 0x10, 0x1F, 0x10, 0x00, 0x00 } },	/* 0x54 'T' */
+  { 4, { 0x1E, 0x01, 0x01, 0x1E, 0x00 } },	/* 0x55 'U' */
+  { 5, { 0x1C, 0x02, 0x01, 0x02, 0x1C } },	/* 0x56 'V' */
+  { 5, { 0x1F, 0x01, 0x02, 0x01, 0x1F } },	/* 0x57 'W' */
+  { 4, { 0x1B, 0x04, 0x04, 0x1B, 0x00 } },	/* 0x58 'X' */
+  { 5, { 0x10, 0x08, 0x07, 0x08, 0x10 } },	/* 0x59 'Y' */
+  { 4, { 0x13, 0x15, 0x15, 0x19, 0x00 } },	/* 0x5A 'Z' */
+  { 4, { 0x1F, 0x11, 0x11, 0x00, 0x00 } },	/* 0x5B '[' */
+  { 4, { 0x18, 0x0C, 0x06, 0x03, 0x00 } },	/* 0x5C '\' */
+  { 3, { 0x11, 0x11, 0x1F, 0x00, 0x00 } },	/* 0x5D ']' */
+  { 4, { 0x08, 0x10, 0x10, 0x08, 0x00 } },	/* 0x5E '^' */
+  { 4, { 0x01, 0x01, 0x01, 0x01, 0x00 } },	/* 0x5F '_' */
+} ;
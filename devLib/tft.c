@@ -0,0 +1,602 @@
+/*
+ * tft.c:
+ *	Colour TFT displays on SPI: ILI9341 and ST7789 controllers
+ *
+ * Copyright (c) 2020 Gordon Henderson.
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+/*
+ * Notes:
+ *	Everything is drawn into an RGB565 framebuffer in memory, and the
+ *	rectangle around whatever's been drawn since the last update is all
+ *	that gets sent: the column and row address set commands for it, a
+ *	memory write, then its pixels in one go. The pixels are turned into
+ *	the controller's big-endian order a chunk at a time by
+ *	wiringPiSPIStream while the chunk before goes out, so there's no
+ *	copy of the frame and no hand splitting at the spidev buffer size.
+ *	The SPI driver does the transfers themselves by DMA.
+ *
+ *	tftUpdateAsync does the same through the bus's SPI queue and returns
+ *	at once: the rectangle is copied out (so drawing can carry on) and
+ *	each step is queued from the callback of the one before, as D/C has
+ *	to change in between. tftWait waits for it.
+ *
+ *	D/C is a GPIO pin. The reset pin is optional (-1).
+ *********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <wiringPi.h>
+#include <wiringPiSPI.h>
+
+#include "tft.h"
+
+// Commands, the same on both
+
+#define	TFT_SWRESET	0x01
+#define	TFT_SLPOUT	0x11
+#define	TFT_NORON	0x13
+#define	TFT_INVON	0x21
+#define	TFT_DISPON	0x29
+#define	TFT_CASET	0x2A
+#define	TFT_RASET	0x2B
+#define	TFT_RAMWR	0x2C
+#define	TFT_MADCTL	0x36
+#define	TFT_COLMOD	0x3A
+
+// Pixels per async chunk: the spidev buffer, as it is unless changed
+
+#define	TFT_CHUNK	4096
+
+// The address window steps before the pixels, for tftUpdateAsync
+
+#define	TFT_STEPS	5
+
+struct tftDataStruct
+{
+  int       type, channel, dcPin ;
+  int       rotation ;
+  int       physW, physH ;	// At rotation 0
+  int       width, height ;	// As rotated
+  int       xOffset, yOffset ;
+  uint16_t *fb ;
+
+// Dirty rectangle, inclusive; x0 > x1 for none
+
+  int dx0, dy0, dx1, dy1 ;
+
+// Window being streamed out by tftUpdate
+
+  int wx, wy, ww ;
+
+// tftUpdateAsync
+
+  pthread_mutex_t      lock ;
+  pthread_cond_t       idle ;
+  int                  busy, failed ;
+  struct wpiSpiRequest req ;
+  struct wpiSpiSeg     seg ;
+  int                  step ;
+  unsigned char        steps [TFT_STEPS][4] ;
+  unsigned int         stepLen [TFT_STEPS] ;
+  unsigned char       *pixels ;	// Copy of the rectangle, big-endian
+  unsigned int         pixelBytes ;
+} ;
+
+static struct tftDataStruct *tfts [MAX_TFTS] ;
+
+
+/*
+ * tftCommand:
+ *	Send a command and its parameters, synchronously
+ *********************************************************************************
+ */
+
+static int tftCommand (struct tftDataStruct *tft, unsigned char cmd, const unsigned char *data, int len)
+{
+  unsigned char buf [16] ;
+
+  digitalWrite (tft->dcPin, LOW) ;
+  buf [0] = cmd ;
+  if (wiringPiSPIDataRW (tft->channel, buf, 1) < 0)
+    return -1 ;
+
+  if (len == 0)
+    return 0 ;
+
+  digitalWrite (tft->dcPin, HIGH) ;
+  memcpy (buf, data, len) ;
+  return (wiringPiSPIDataRW (tft->channel, buf, len) < 0) ? -1 : 0 ;
+}
+
+
+/*
+ * windowData:
+ *	The parameters of the column and row address set commands for a
+ *	rectangle
+ *********************************************************************************
+ */
+
+static void windowData (struct tftDataStruct *tft, int x0, int y0, int x1, int y1, unsigned char cols [4], unsigned char rows [4])
+{
+  x0 += tft->xOffset ; x1 += tft->xOffset ;
+  y0 += tft->yOffset ; y1 += tft->yOffset ;
+
+  cols [0] = x0 >> 8 ; cols [1] = x0 & 0xFF ; cols [2] = x1 >> 8 ; cols [3] = x1 & 0xFF ;
+  rows [0] = y0 >> 8 ; rows [1] = y0 & 0xFF ; rows [2] = y1 >> 8 ; rows [3] = y1 & 0xFF ;
+}
+
+
+/*
+ * toWire:
+ *	Copy pixels out of the framebuffer in the controller's byte order
+ *********************************************************************************
+ */
+
+static void toWire (unsigned char *buf, const uint16_t *fb, int n)
+{
+  int i ;
+
+  for (i = 0 ; i < n ; ++i)
+  {
+    *buf++ = fb [i] >> 8 ;
+    *buf++ = fb [i] & 0xFF ;
+  }
+}
+
+
+/*
+ * tftSetRotation:
+ * tftSetOffset:
+ * tftGetSize:
+ *	Rotation 0-3 is a quarter turn clockwise at a time; what's in the
+ *	framebuffer isn't turned with it, so clear it after. Some ST7789
+ *	panels are smaller than the controller's memory and need an offset.
+ *********************************************************************************
+ */
+
+void tftSetRotation (int fd, int rotation)
+{
+  static const unsigned char madctl [2][4] =
+  {
+    { 0x48, 0x28, 0x88, 0xE8 },		// ILI9341: BGR panel
+    { 0x00, 0x60, 0xC0, 0xA0 },		// ST7789
+  } ;
+  struct tftDataStruct *tft = tfts [fd] ;
+
+  tftWait (fd) ;
+
+  tft->rotation = rotation & 3 ;
+  if ((tft->rotation & 1) == 0)
+  {
+    tft->width  = tft->physW ;
+    tft->height = tft->physH ;
+  }
+  else
+  {
+    tft->width  = tft->physH ;
+    tft->height = tft->physW ;
+  }
+
+  (void)tftCommand (tft, TFT_MADCTL, &madctl [tft->type][tft->rotation], 1) ;
+  tftDirty (fd, 0, 0, tft->width, tft->height) ;
+}
+
+void tftSetOffset (int fd, int xOffset, int yOffset)
+{
+  tfts [fd]->xOffset = xOffset ;
+  tfts [fd]->yOffset = yOffset ;
+}
+
+void tftGetSize (int fd, int *width, int *height)
+{
+  *width  = tfts [fd]->width ;
+  *height = tfts [fd]->height ;
+}
+
+
+/*
+ * tftFrameBuffer:
+ * tftDirty:
+ *	To draw into the framebuffer directly: width pixels a row. Say
+ *	where with tftDirty so it gets sent.
+ *********************************************************************************
+ */
+
+uint16_t *tftFrameBuffer (int fd)
+{
+  return tfts [fd]->fb ;
+}
+
+void tftDirty (int fd, int x, int y, int w, int h)
+{
+  struct tftDataStruct *tft = tfts [fd] ;
+  int x1 = x + w - 1, y1 = y + h - 1 ;
+
+  if (x < 0) x = 0 ;
+  if (y < 0) y = 0 ;
+  if (x1 >= tft->width)  x1 = tft->width  - 1 ;
+  if (y1 >= tft->height) y1 = tft->height - 1 ;
+  if ((x > x1) || (y > y1))
+    return ;
+
+  if (tft->dx0 > tft->dx1)
+  {
+    tft->dx0 = x  ; tft->dy0 = y ;
+    tft->dx1 = x1 ; tft->dy1 = y1 ;
+    return ;
+  }
+
+  if (x  < tft->dx0) tft->dx0 = x ;
+  if (y  < tft->dy0) tft->dy0 = y ;
+  if (x1 > tft->dx1) tft->dx1 = x1 ;
+  if (y1 > tft->dy1) tft->dy1 = y1 ;
+}
+
+
+/*
+ * tftPoint: tftFill: tftBlit: tftClear:
+ *	Drawing, clipped to the screen
+ *********************************************************************************
+ */
+
+void tftPoint (int fd, int x, int y, uint16_t colour)
+{
+  struct tftDataStruct *tft = tfts [fd] ;
+
+  if ((x < 0) || (y < 0) || (x >= tft->width) || (y >= tft->height))
+    return ;
+
+  tft->fb [y * tft->width + x] = colour ;
+  tftDirty (fd, x, y, 1, 1) ;
+}
+
+void tftFill (int fd, int x, int y, int w, int h, uint16_t colour)
+{
+  struct tftDataStruct *tft = tfts [fd] ;
+  uint16_t *row ;
+  int i, j ;
+
+  if (x < 0) { w += x ; x = 0 ; }
+  if (y < 0) { h += y ; y = 0 ; }
+  if (x + w > tft->width)  w = tft->width  - x ;
+  if (y + h > tft->height) h = tft->height - y ;
+  if ((w <= 0) || (h <= 0))
+    return ;
+
+  for (j = 0 ; j < h ; ++j)
+  {
+    row = &tft->fb [(y + j) * tft->width + x] ;
+    for (i = 0 ; i < w ; ++i)
+      row [i] = colour ;
+  }
+  tftDirty (fd, x, y, w, h) ;
+}
+
+void tftBlit (int fd, int x, int y, int w, int h, const uint16_t *pixels)
+{
+  struct tftDataStruct *tft = tfts [fd] ;
+  int sx = 0, sy = 0, sw = w, j ;
+
+  if (x < 0) { sx = -x ; w += x ; x = 0 ; }
+  if (y < 0) { sy = -y ; h += y ; y = 0 ; }
+  if (x + w > tft->width)  w = tft->width  - x ;
+  if (y + h > tft->height) h = tft->height - y ;
+  if ((w <= 0) || (h <= 0))
+    return ;
+
+  for (j = 0 ; j < h ; ++j)
+    memcpy (&tft->fb [(y + j) * tft->width + x], &pixels [(sy + j) * sw + sx], w * sizeof (uint16_t)) ;
+  tftDirty (fd, x, y, w, h) ;
+}
+
+void tftClear (int fd, uint16_t colour)
+{
+  tftFill (fd, 0, 0, tfts [fd]->width, tfts [fd]->height, colour) ;
+}
+
+
+/*
+ * streamFill:
+ *	wiringPiSPIStream callback for tftUpdate: the next lot of the window
+ *	out of the framebuffer. Offsets and lengths are always even.
+ *********************************************************************************
+ */
+
+static int streamFill (void *arg, unsigned char *buf, unsigned int offset, unsigned int len)
+{
+  struct tftDataStruct *tft = (struct tftDataStruct *)arg ;
+  unsigned int p = offset / 2, n = len / 2, run ;
+  int row, col ;
+
+  while (n > 0)
+  {
+    row = p / tft->ww ;
+    col = p % tft->ww ;
+    run = tft->ww - col ;
+    if (run > n)
+      run = n ;
+    toWire (buf, &tft->fb [(tft->wy + row) * tft->width + tft->wx + col], run) ;
+    buf += 2 * run ;
+    p   += run ;
+    n   -= run ;
+  }
+
+  return 0 ;
+}
+
+
+/*
+ * tftUpdate:
+ *	Send the dirty rectangle, and wait for it. Returns 0, or -1 if the
+ *	SPI transfers failed.
+ *********************************************************************************
+ */
+
+int tftUpdate (int fd)
+{
+  struct tftDataStruct *tft = tfts [fd] ;
+  unsigned char cols [4], rows [4] ;
+  unsigned int bytes ;
+  int wh ;
+
+  tftWait (fd) ;
+
+  if (tft->dx0 > tft->dx1)
+    return 0 ;
+
+  tft->wx = tft->dx0 ;
+  tft->wy = tft->dy0 ;
+  tft->ww = tft->dx1 - tft->dx0 + 1 ;
+  wh      = tft->dy1 - tft->dy0 + 1 ;
+  bytes   = 2 * tft->ww * wh ;
+
+  windowData (tft, tft->dx0, tft->dy0, tft->dx1, tft->dy1, cols, rows) ;
+  tft->dx0 = 1 ; tft->dx1 = 0 ;
+
+  if ((tftCommand (tft, TFT_CASET, cols, 4) < 0) ||
+      (tftCommand (tft, TFT_RASET, rows, 4) < 0) ||
+      (tftCommand (tft, TFT_RAMWR, NULL, 0) < 0))
+    return -1 ;
+
+  digitalWrite (tft->dcPin, HIGH) ;
+  return (wiringPiSPIStream (tft->channel, bytes, streamFill, tft) < 0) ? -1 : 0 ;
+}
+
+
+/*
+ * asyncStep: asyncNext:
+ *	Queue the next step of an asynchronous update: the five command and
+ *	address steps, then the pixels a chunk at a time. Called from the
+ *	SPI worker when each one is done.
+ *********************************************************************************
+ */
+
+static void asyncNext (struct wpiSpiRequest *req) ;
+
+static void asyncStep (struct tftDataStruct *tft)
+{
+  unsigned int offset = 0, n = 0 ;
+  int dc ;
+
+  if (tft->step < TFT_STEPS)
+  {
+    dc = tft->step & 1 ;		// Commands on the even steps, parameters on the odd
+    tft->seg.tx  = tft->steps [tft->step] ;
+    tft->seg.len = tft->stepLen [tft->step] ;
+  }
+  else
+  {
+    dc     = 1 ;
+    offset = (tft->step - TFT_STEPS) * TFT_CHUNK ;
+    n      = tft->pixelBytes - offset ;
+    if (n > TFT_CHUNK)
+      n = TFT_CHUNK ;
+    tft->seg.tx  = tft->pixels + offset ;
+    tft->seg.len = n ;
+  }
+
+  digitalWrite (tft->dcPin, dc) ;
+
+  if (wiringPiSPISubmit (tft->channel, &tft->req, asyncNext) < 0)
+  {
+    pthread_mutex_lock (&tft->lock) ;
+      tft->failed = TRUE ;
+      tft->busy   = FALSE ;
+      pthread_cond_broadcast (&tft->idle) ;
+    pthread_mutex_unlock (&tft->lock) ;
+  }
+}
+
+static void asyncNext (struct wpiSpiRequest *req)
+{
+  struct tftDataStruct *tft = (struct tftDataStruct *)req->userData ;
+  int done ;
+
+  ++tft->step ;
+  done = (req->result < 0) || ((tft->step >= TFT_STEPS) && ((unsigned int)(tft->step - TFT_STEPS) * TFT_CHUNK >= tft->pixelBytes)) ;
+
+  if (!done)
+  {
+    asyncStep (tft) ;
+    return ;
+  }
+
+  pthread_mutex_lock (&tft->lock) ;
+    tft->failed = (req->result < 0) ;
+    tft->busy   = FALSE ;
+    pthread_cond_broadcast (&tft->idle) ;
+  pthread_mutex_unlock (&tft->lock) ;
+}
+
+
+/*
+ * tftUpdateAsync:
+ * tftBusy:
+ * tftWait:
+ *	Start sending the dirty rectangle and return; the framebuffer is
+ *	free to draw in again straight away. tftWait returns 0 once it's
+ *	gone, or -1 if it failed.
+ *********************************************************************************
+ */
+
+int tftUpdateAsync (int fd)
+{
+  struct tftDataStruct *tft = tfts [fd] ;
+  int y, w ;
+
+  tftWait (fd) ;
+
+  if (tft->dx0 > tft->dx1)
+    return 0 ;
+
+  tft->steps [0][0] = TFT_CASET ; tft->stepLen [0] = 1 ;
+  tft->steps [2][0] = TFT_RASET ; tft->stepLen [2] = 1 ;
+  tft->steps [4][0] = TFT_RAMWR ; tft->stepLen [4] = 1 ;
+  tft->stepLen [1] = tft->stepLen [3] = 4 ;
+  windowData (tft, tft->dx0, tft->dy0, tft->dx1, tft->dy1, tft->steps [1], tft->steps [3]) ;
+
+  w = tft->dx1 - tft->dx0 + 1 ;
+  for (y = tft->dy0 ; y <= tft->dy1 ; ++y)
+    toWire (tft->pixels + 2 * w * (y - tft->dy0), &tft->fb [y * tft->width + tft->dx0], w) ;
+  tft->pixelBytes = 2 * w * (tft->dy1 - tft->dy0 + 1) ;
+  tft->dx0 = 1 ; tft->dx1 = 0 ;
+
+  memset (&tft->seg, 0, sizeof (tft->seg)) ;
+  memset (&tft->req, 0, sizeof (tft->req)) ;
+  tft->req.segs     = &tft->seg ;
+  tft->req.numSegs  = 1 ;
+  tft->req.userData = tft ;
+
+  tft->step   = 0 ;
+  tft->failed = FALSE ;
+  tft->busy   = TRUE ;
+  asyncStep (tft) ;
+
+  return tft->failed ? -1 : 0 ;
+}
+
+int tftBusy (int fd)
+{
+  return __atomic_load_n (&tfts [fd]->busy, __ATOMIC_ACQUIRE) ;
+}
+
+int tftWait (int fd)
+{
+  struct tftDataStruct *tft = tfts [fd] ;
+  int res ;
+
+  pthread_mutex_lock (&tft->lock) ;
+    while (tft->busy)
+      pthread_cond_wait (&tft->idle, &tft->lock) ;
+    res = tft->failed ? -1 : 0 ;
+  pthread_mutex_unlock (&tft->lock) ;
+
+  return res ;
+}
+
+
+/*
+ * tftSetup:
+ *	Set up a display on an SPI channel (which this opens, at speed Hz),
+ *	reset and initialise it, and clear it to black. width and height are
+ *	the panel's at rotation 0 - 240x320 for most ILI9341s, 240x240 or
+ *	240x320 for ST7789s.
+ *	Returns a handle for the other functions, or -1.
+ *********************************************************************************
+ */
+
+int tftSetup (int type, int spiChannel, int speed, int dcPin, int resetPin, int width, int height)
+{
+  static const unsigned char colmod = 0x55 ;	// 16 bits a pixel
+  struct tftDataStruct *tft ;
+  int i, fd = -1 ;
+
+  if (((type != TFT_ILI9341) && (type != TFT_ST7789)) || (width < 1) || (height < 1))
+    return -1 ;
+
+  for (i = 0 ; i < MAX_TFTS ; ++i)
+    if (tfts [i] == NULL)
+    {
+      fd = i ;
+      break ;
+    }
+  if (fd == -1)
+    return -1 ;
+
+  if (wiringPiSPISetup (spiChannel, speed) < 0)
+    return -1 ;
+
+  if ((tft = (struct tftDataStruct *)calloc (1, sizeof (struct tftDataStruct))) == NULL)
+    return -1 ;
+
+  tft->fb     = (uint16_t *)calloc (width * height, sizeof (uint16_t)) ;
+  tft->pixels = (unsigned char *)malloc (width * height * 2) ;
+  if ((tft->fb == NULL) || (tft->pixels == NULL))
+  {
+    free (tft->fb) ;
+    free (tft->pixels) ;
+    free (tft) ;
+    return -1 ;
+  }
+
+  tft->type    = type ;
+  tft->channel = spiChannel ;
+  tft->dcPin   = dcPin ;
+  tft->physW   = tft->width  = width ;
+  tft->physH   = tft->height = height ;
+  tft->dx0     = 1 ;
+  tft->dx1     = 0 ;
+  pthread_mutex_init (&tft->lock, NULL) ;
+  pthread_cond_init  (&tft->idle, NULL) ;
+
+  tfts [fd] = tft ;
+
+  pinMode (dcPin, OUTPUT) ;
+  if (resetPin >= 0)
+  {
+    pinMode      (resetPin, OUTPUT) ;
+    digitalWrite (resetPin, LOW) ;
+    delay (10) ;
+    digitalWrite (resetPin, HIGH) ;
+    delay (120) ;
+  }
+
+  (void)tftCommand (tft, TFT_SWRESET, NULL, 0) ; delay (150) ;
+  (void)tftCommand (tft, TFT_SLPOUT,  NULL, 0) ; delay (120) ;
+  (void)tftCommand (tft, TFT_COLMOD,  &colmod, 1) ;
+  if (type == TFT_ST7789)
+  {
+    (void)tftCommand (tft, TFT_INVON, NULL, 0) ;	// The panels are built inverted
+    (void)tftCommand (tft, TFT_NORON, NULL, 0) ;
+  }
+  tftSetRotation (fd, 0) ;
+  (void)tftCommand (tft, TFT_DISPON, NULL, 0) ;
+
+  tftClear  (fd, TFT_BLACK) ;
+  (void)tftUpdate (fd) ;
+
+  return fd ;
+}
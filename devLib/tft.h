@@ -0,0 +1,68 @@
+/*
+ * tft.h:
+ *	Colour TFT displays on SPI: ILI9341 and ST7789 controllers
+ *
+ * Copyright (c) 2020 Gordon Henderson.
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <stdint.h>
+
+#define	MAX_TFTS	4
+
+// Controllers
+
+#define	TFT_ILI9341	0
+#define	TFT_ST7789	1
+
+// RGB565 colours
+
+#define	TFT_RGB(r,g,b)	((uint16_t)((((r) & 0xF8) << 8) | (((g) & 0xFC) << 3) | (((b) & 0xFF) >> 3)))
+
+#define	TFT_BLACK	0x0000
+#define	TFT_WHITE	0xFFFF
+#define	TFT_RED		0xF800
+#define	TFT_GREEN	0x07E0
+#define	TFT_BLUE	0x001F
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int       tftSetup       (int type, int spiChannel, int speed, int dcPin, int resetPin, int width, int height) ;
+extern void      tftSetRotation (int fd, int rotation) ;
+extern void      tftSetOffset   (int fd, int xOffset, int yOffset) ;
+extern void      tftGetSize     (int fd, int *width, int *height) ;
+
+extern uint16_t *tftFrameBuffer (int fd) ;
+extern void      tftDirty       (int fd, int x, int y, int w, int h) ;
+
+extern void      tftPoint       (int fd, int x, int y, uint16_t colour) ;
+extern void      tftFill        (int fd, int x, int y, int w, int h, uint16_t colour) ;
+extern void      tftBlit        (int fd, int x, int y, int w, int h, const uint16_t *pixels) ;
+extern void      tftClear       (int fd, uint16_t colour) ;
+
+extern int       tftUpdate      (int fd) ;
+extern int       tftUpdateAsync (int fd) ;
+extern int       tftBusy        (int fd) ;
+extern int       tftWait        (int fd) ;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,473 @@
+/*
+ * ws2812.c:
+ *	Drive strips of WS2812/SK6812 addressable LEDs from the SPI MOSI pin
+ *
+ * Copyright (c) 2020 Gordon Henderson.
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+/*
+ * Notes:
+ *	The LEDs want a 1.25uS bit cell: a 0 is high for about 0.4uS then
+ *	low, a 1 high for about 0.8uS. That's far too quick for digitalWrite
+ *	under Linux, but clocking the SPI at 2.4MHz and sending 3 SPI bits
+ *	per LED bit - 100 for a 0, 110 for a 1 - gets it exactly, and the
+ *	SPI hardware does all the timing. Only MOSI is connected (through a
+ *	3.3v to 5v buffer for most strips); the clock and CS pins are unused.
+ *
+ *	Each strip has the pixel buffer you draw into and two transmit
+ *	buffers. ws2812Show () encodes the pixels into whichever transmit
+ *	buffer isn't going out - three table lookups per colour byte - and
+ *	hands it to the SPI bus worker thread and returns, so you can draw
+ *	the next frame while this one is sent.
+ *
+ *	The kernel spidev driver won't take more than its bufsiz (4096 bytes
+ *	by default - about 450 pixels) in one go, so longer strips are sent
+ *	in pieces, back to back. Add  spidev.bufsiz=65536  to
+ *	/boot/cmdline.txt to send up to 7000 or so pixels in one transfer.
+ *
+ *	A strip takes 30uS per pixel to send, so one strip can only manage
+ *	about 550 pixels at 60 frames a second. Put longer runs on more than
+ *	one SPI bus (the Pi 4 has several) - each bus has its own worker, so
+ *	they all go out at the same time.
+ *********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <wiringPi.h>
+#include <wiringPiSPI.h>
+
+#include "ws2812.h"
+
+#define	WS2812_SPI_SPEED	2400000
+
+// The strip latches once the data line has been low for 280uS (50uS for
+//	older parts) - that's this many zero bytes on the end of every frame
+
+#define	WS2812_RESET_BYTES	96
+
+#define	SPIDEV_BUFSIZ		"/sys/module/spidev/parameters/bufsiz"
+
+// Each colour byte as the 3 SPI bytes that send it
+
+static uint8_t encodeTable [256][3] ;
+static pthread_once_t encodeOnce = PTHREAD_ONCE_INIT ;
+
+struct ws2812TxStruct
+{
+  uint8_t              *data ;
+  unsigned int          sent ;
+  int                   busy ;		// Queued, waiting or going out
+  struct wpiSpiSeg      seg ;
+  struct wpiSpiRequest  req ;
+} ;
+
+struct ws2812Struct
+{
+  int                   channel ;
+  int                   numPixels ;
+  int                   type ;
+  int                   bytesPerPixel ;
+  unsigned int          txLen ;
+  unsigned int          chunk ;		// The most we can send in one go
+  unsigned int         *pixels ;
+
+  pthread_mutex_t       lock ;
+  pthread_cond_t        idle ;
+  struct ws2812TxStruct tx [2] ;
+  int                   last ;		// Buffer last shown
+  int                   waiting ;	// Buffer to send when the other's done, or -1
+  int                   error ;
+} ;
+
+static struct ws2812Struct *strips [MAX_WS2812_STRIPS] ;
+static int                  numStrips = 0 ;
+
+
+/*
+ * encodeInit:
+ *	Build the table: each bit b becomes 1b0, most significant first.
+ *********************************************************************************
+ */
+
+static void encodeInit (void)
+{
+  uint32_t bits ;
+  int byte, bit ;
+
+  for (byte = 0 ; byte < 256 ; ++byte)
+  {
+    for (bits = 0, bit = 7 ; bit >= 0 ; --bit)
+      bits = (bits << 3) | (((byte >> bit) & 1) ? 6 : 4) ;
+
+    encodeTable [byte][0] = bits >> 16 ;
+    encodeTable [byte][1] = bits >>  8 ;
+    encodeTable [byte][2] = bits ;
+  }
+}
+
+
+/*
+ * spiChunk:
+ *	How much spidev will take in one message. It's kept to a whole number
+ *	of colour bytes so the gap between pieces only ever stretches a low.
+ *********************************************************************************
+ */
+
+static unsigned int spiChunk (void)
+{
+  FILE *fd ;
+  unsigned int bufsiz = 4096 ;
+
+  if ((fd = fopen (SPIDEV_BUFSIZ, "r")) != NULL)
+  {
+    if ((fscanf (fd, "%u", &bufsiz) != 1) || (bufsiz < 3))
+      bufsiz = 4096 ;
+    fclose (fd) ;
+  }
+
+  return bufsiz - (bufsiz % 3) ;
+}
+
+
+/*
+ * getStrip:
+ *********************************************************************************
+ */
+
+static struct ws2812Struct *getStrip (int strip)
+{
+  if ((strip < 0) || (strip >= numStrips))
+    return NULL ;
+
+  return strips [strip] ;
+}
+
+
+/*
+ * sendPiece:
+ *	Queue the next piece of a transmit buffer. Called with the strip
+ *	locked.
+ *********************************************************************************
+ */
+
+static void sendDone (struct wpiSpiRequest *req) ;
+
+static int sendPiece (struct ws2812Struct *s, struct ws2812TxStruct *tx)
+{
+  unsigned int len = s->txLen - tx->sent ;
+
+  if (len > s->chunk)
+    len = s->chunk ;
+
+  tx->seg.tx       = tx->data + tx->sent ;
+  tx->seg.len      = len ;
+  tx->req.segs     = &tx->seg ;
+  tx->req.numSegs  = 1 ;
+  tx->req.userData = s ;
+
+  return wiringPiSPISubmit (s->channel, &tx->req, sendDone) ;
+}
+
+
+/*
+ * sendFinish:
+ *	A transmit buffer is free again - start the one that's waiting behind
+ *	it, if any. Called with the strip locked.
+ *********************************************************************************
+ */
+
+static void sendFinish (struct ws2812Struct *s, int buffer)
+{
+  int next = s->waiting ;
+
+  s->tx [buffer].busy = FALSE ;
+
+  if (next != -1)
+  {
+    s->waiting = -1 ;
+    if (sendPiece (s, &s->tx [next]) < 0)
+    {
+      s->error          = TRUE ;
+      s->tx [next].busy = FALSE ;
+    }
+  }
+
+  pthread_cond_broadcast (&s->idle) ;
+}
+
+
+/*
+ * sendDone:
+ *	Called by the SPI worker thread as each piece goes out.
+ *********************************************************************************
+ */
+
+static void sendDone (struct wpiSpiRequest *req)
+{
+  struct ws2812Struct   *s  = (struct ws2812Struct *)req->userData ;
+  int                    buffer = (req == &s->tx [1].req) ? 1 : 0 ;
+  struct ws2812TxStruct *tx = &s->tx [buffer] ;
+
+  pthread_mutex_lock (&s->lock) ;
+
+  if (req->result < 0)
+    s->error = TRUE ;
+  else
+  {
+    tx->sent += tx->seg.len ;
+    if (tx->sent < s->txLen)
+    {
+      if (sendPiece (s, tx) == 0)
+      {
+	pthread_mutex_unlock (&s->lock) ;
+	return ;
+      }
+      s->error = TRUE ;
+    }
+  }
+
+  sendFinish (s, buffer) ;
+  pthread_mutex_unlock (&s->lock) ;
+}
+
+
+/*
+ * encode:
+ *	Turn the pixels into SPI bytes in the order the strip wants them.
+ *********************************************************************************
+ */
+
+static void encode (struct ws2812Struct *s, uint8_t *out)
+{
+  const unsigned int *pixel = s->pixels ;
+  unsigned int colour, bytes ;
+  int i, j ;
+
+  for (i = 0 ; i < s->numPixels ; ++i)
+  {
+    colour = *pixel++ ;
+
+// RGB: R G B, GRB: G R B, GRBW: G R B W
+
+    if (s->type == WS2812_RGB)
+      bytes = colour & 0xFFFFFF ;
+    else
+      bytes = (((colour >> 8) & 0xFF) << 16) | (((colour >> 16) & 0xFF) << 8) | (colour & 0xFF) ;
+
+    if (s->bytesPerPixel == 4)
+      bytes = (bytes << 8) | (colour >> 24) ;
+
+    for (j = (s->bytesPerPixel - 1) * 8 ; j >= 0 ; j -= 8)
+    {
+      memcpy (out, encodeTable [(bytes >> j) & 0xFF], 3) ;
+      out += 3 ;
+    }
+  }
+}
+
+
+/*
+ * ws2812Setup:
+ *	Create a strip of numPixels LEDs of the given type on the SPI
+ *	channel (WPI_SPI_CHANNEL (bus, cs) for other buses). All off until
+ *	the first ws2812Show ().
+ *	Returns the strip number or -1.
+ *********************************************************************************
+ */
+
+int ws2812Setup (int channel, int numPixels, int type)
+{
+  struct ws2812Struct *s ;
+  int i ;
+
+  if ((numStrips == MAX_WS2812_STRIPS) || (numPixels < 1) || (type < WS2812_GRB) || (type > SK6812_GRBW))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  pthread_once (&encodeOnce, encodeInit) ;
+
+  if (wiringPiSPISetup (channel, WS2812_SPI_SPEED) < 0)
+    return -1 ;
+
+  if ((s = calloc (1, sizeof (struct ws2812Struct))) == NULL)
+    return -1 ;
+
+  s->channel       = channel ;
+  s->numPixels     = numPixels ;
+  s->type          = type ;
+  s->bytesPerPixel = (type == SK6812_GRBW) ? 4 : 3 ;
+  s->txLen         = numPixels * s->bytesPerPixel * 3 + WS2812_RESET_BYTES ;
+  s->chunk         = spiChunk () ;
+  s->last          = 1 ;
+  s->waiting       = -1 ;
+
+  s->pixels = calloc (numPixels, sizeof (unsigned int)) ;
+  for (i = 0 ; i < 2 ; ++i)
+    s->tx [i].data = calloc (1, s->txLen) ;		// The reset bytes stay 0
+
+  if ((s->pixels == NULL) || (s->tx [0].data == NULL) || (s->tx [1].data == NULL))
+  {
+    free (s->pixels) ;
+    free (s->tx [0].data) ;
+    free (s->tx [1].data) ;
+    free (s) ;
+    return -1 ;
+  }
+
+  pthread_mutex_init (&s->lock, NULL) ;
+  pthread_cond_init  (&s->idle, NULL) ;
+
+  strips [numStrips] = s ;
+  return numStrips++ ;
+}
+
+
+/*
+ * ws2812Pixels:
+ *	The pixel buffer itself, for drawing a lot of pixels quickly. It can
+ *	be changed at any time, even while a frame is going out.
+ *********************************************************************************
+ */
+
+unsigned int *ws2812Pixels (int strip)
+{
+  struct ws2812Struct *s = getStrip (strip) ;
+
+  return (s == NULL) ? NULL : s->pixels ;
+}
+
+
+/*
+ * ws2812SetPixel: ws2812GetPixel: ws2812Fill:
+ *********************************************************************************
+ */
+
+void ws2812SetPixel (int strip, int pixel, unsigned int colour)
+{
+  struct ws2812Struct *s = getStrip (strip) ;
+
+  if ((s != NULL) && (pixel >= 0) && (pixel < s->numPixels))
+    s->pixels [pixel] = colour ;
+}
+
+unsigned int ws2812GetPixel (int strip, int pixel)
+{
+  struct ws2812Struct *s = getStrip (strip) ;
+
+  if ((s != NULL) && (pixel >= 0) && (pixel < s->numPixels))
+    return s->pixels [pixel] ;
+
+  return 0 ;
+}
+
+void ws2812Fill (int strip, unsigned int colour)
+{
+  struct ws2812Struct *s = getStrip (strip) ;
+  int i ;
+
+  if (s != NULL)
+    for (i = 0 ; i < s->numPixels ; ++i)
+      s->pixels [i] = colour ;
+}
+
+
+/*
+ * ws2812Show:
+ *	Send the pixels to the strip and return without waiting. If the last
+ *	frame is still going out this one follows straight after it; only if
+ *	both buffers are busy do we wait, for the older one.
+ *	Returns 0, or -1 if a previous frame (or this one) failed to send.
+ *********************************************************************************
+ */
+
+int ws2812Show (int strip)
+{
+  struct ws2812Struct   *s = getStrip (strip) ;
+  struct ws2812TxStruct *tx ;
+  int buffer, res = 0 ;
+
+  if (s == NULL)
+    return -1 ;
+
+  pthread_mutex_lock (&s->lock) ;
+    buffer = s->last ^ 1 ;
+    tx     = &s->tx [buffer] ;
+    while (tx->busy)
+      pthread_cond_wait (&s->idle, &s->lock) ;
+  pthread_mutex_unlock (&s->lock) ;
+
+  encode (s, tx->data) ;
+
+  pthread_mutex_lock (&s->lock) ;
+    tx->busy = TRUE ;
+    tx->sent = 0 ;
+    s->last  = buffer ;
+
+    /**/ if (s->tx [buffer ^ 1].busy)
+      s->waiting = buffer ;
+    else if (sendPiece (s, tx) < 0)
+    {
+      tx->busy = FALSE ;
+      s->error = TRUE ;
+    }
+
+    if (s->error)
+    {
+      s->error = FALSE ;
+      res      = -1 ;
+    }
+  pthread_mutex_unlock (&s->lock) ;
+
+  return res ;
+}
+
+
+/*
+ * ws2812Wait:
+ *	Wait for everything shown so far to have gone out.
+ *	Returns 0, or -1 if any of it failed to send.
+ *********************************************************************************
+ */
+
+int ws2812Wait (int strip)
+{
+  struct ws2812Struct *s = getStrip (strip) ;
+  int res ;
+
+  if (s == NULL)
+    return -1 ;
+
+  pthread_mutex_lock (&s->lock) ;
+    while (s->tx [0].busy || s->tx [1].busy)
+      pthread_cond_wait (&s->idle, &s->lock) ;
+    res      = s->error ? -1 : 0 ;
+    s->error = FALSE ;
+  pthread_mutex_unlock (&s->lock) ;
+
+  return res ;
+}
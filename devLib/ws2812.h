@@ -0,0 +1,51 @@
+/*
+ * ws2812.h:
+ *	Drive strips of WS2812/SK6812 addressable LEDs from the SPI MOSI pin
+ *
+ * Copyright (c) 2020 Gordon Henderson.
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#define	MAX_WS2812_STRIPS	8
+
+// Strip types - the order the colours go down the wire
+
+#define	WS2812_GRB		0
+#define	WS2812_RGB		1
+#define	SK6812_GRBW		2
+
+// Colours are 0xWWRRGGBB (white is only used by the SK6812)
+
+#define	WS2812_COLOUR(r,g,b)	((((r) & 0xFF) << 16) | (((g) & 0xFF) << 8) | ((b) & 0xFF))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int           ws2812Setup    (int channel, int numPixels, int type) ;
+extern unsigned int *ws2812Pixels   (int strip) ;
+extern void          ws2812SetPixel (int strip, int pixel, unsigned int colour) ;
+extern unsigned int  ws2812GetPixel (int strip, int pixel) ;
+extern void          ws2812Fill     (int strip, unsigned int colour) ;
+extern int           ws2812Show     (int strip) ;
+extern int           ws2812Wait     (int strip) ;
+
+#ifdef __cplusplus
+}
+#endif
@@ -7,18 +7,17 @@
  */
 
 #include <stdio.h>
-#include <sys/time.h>
 
 #include <wiringPi.h>
 #include <gertboard.h>
 
 #define	B_SIZE	40000
+#define	RATE	20000
 
 int main ()
 {
-  int i ;
-  struct timeval tStart, tEnd, tTaken ;
-  unsigned char buffer [B_SIZE] ;
+  int i, n ;
+  int buffer [B_SIZE] ;
 
   printf ("\n") ;
   printf ("Gertboard demo: Recorder\n") ;
@@ -29,32 +28,45 @@ int main ()
 
   wiringPiSetupSys () ;
 
-// Initialise the Gertboard analog hardware at pin 100
+// Initialise the Gertboard analog hardware for streaming at pin 100
 
-  gertboardAnalogSetup (100) ;
+  if (gertboardStreamSetup (100) < 0)
+  {
+    fprintf (stderr, "Unable to setup the Gertboard\n") ;
+    return 1 ;
+  }
 
-  gettimeofday (&tStart, NULL) ;
+  printf ("Recording %d samples at %d samples/sec ...\n", B_SIZE, RATE) ;
 
-  for (i = 0 ; i < B_SIZE ; ++i)
-    buffer [i] = analogRead (100) >> 2 ;
+  if (gertboardRecordStart (0, RATE) < 0)
+  {
+    fprintf (stderr, "Unable to start recording\n") ;
+    return 1 ;
+  }
 
-  gettimeofday (&tEnd, NULL) ;
-  
-  timersub (&tEnd, &tStart, &tTaken) ;
+  for (i = 0 ; i < B_SIZE ; i += n)
+  {
+    if ((n = gertboardRecordRead (&buffer [i], B_SIZE - i)) == 0)
+      delay (10) ;
+  }
 
-  printf ("Time taken for %d  reads: %ld.%ld\n", B_SIZE, tTaken.tv_sec, tTaken.tv_usec) ;
+  gertboardRecordStop () ;
 
-  gettimeofday (&tStart, NULL) ;
+// 10-bit ADC to 8-bit DAC
 
   for (i = 0 ; i < B_SIZE ; ++i)
-   analogWrite (100, buffer [i]) ;
+    buffer [i] >>= 2 ;
+
+  printf ("Playing back ...\n") ;
 
-  gettimeofday (&tEnd, NULL) ;
-  
-  timersub (&tEnd, &tStart, &tTaken) ;
+  if (gertboardPlay (0, buffer, B_SIZE, RATE) < 0)
+  {
+    fprintf (stderr, "Unable to start playback\n") ;
+    return 1 ;
+  }
 
-  printf ("Time taken for %d writes: %ld.%ld\n", B_SIZE, tTaken.tv_sec, tTaken.tv_usec) ;
+  while (gertboardPlayBusy ())
+    delay (10) ;
 
   return 0 ;
 }
-
@@ -37,24 +37,27 @@ int outputs [4] = { 0,0,0,0 } ;
 
 
 /*
- * scanButton:
- *	Read the guiven button - if it's pressed, then flip the state
+ * buttonPushed:
+ *	Called from the ISR thread when a button goes down - flip the state
  *	of the correspoinding output pin
  *********************************************************************************
  */
 
-void scanButton (int button)
+void buttonPushed (int pin, int value)
 {
-  if (digitalRead (PIFACE_BASE + button) == LOW)
-  {
-    outputs [button] ^= 1 ;
-    digitalWrite (PIFACE_BASE + button, outputs [button]) ;
-    printf ("Button %d pushed - output now: %s\n",
-		button, (outputs [button] == 0) ? "Off" : "On") ;
-  }
+  static unsigned int last [4] ;
+  int button = pin - PIFACE_BASE ;
 
-  while (digitalRead (PIFACE_BASE + button) == LOW)
-    delay (1) ;
+  (void)value ;
+
+  if ((millis () - last [button]) < 50)		// Contact bounce
+    return ;
+  last [button] = millis () ;
+
+  outputs [button] ^= 1 ;
+  digitalWrite (PIFACE_BASE + button, outputs [button]) ;
+  printf ("Button %d pushed - output now: %s\n",
+		button, (outputs [button] == 0) ? "Off" : "On") ;
 }
 
 
@@ -80,7 +83,14 @@ int main (void)
 
   wiringPiSetupSys () ;
 
-  piFaceSetup (PIFACE_BASE) ;
+// Use the PiFace interrupt line so we're not reading the buttons over
+//	SPI all the time
+
+  if (piFaceSetupInt (PIFACE_BASE, PIFACE_INT_GPIO) < 0)
+  {
+    fprintf (stderr, "Unable to set up the PiFace\n") ;
+    return 1 ;
+  }
 
 // Enable internal pull-ups & start with all off
 
@@ -90,14 +100,13 @@ int main (void)
     digitalWrite    (PIFACE_BASE + pin, 0) ;
   }
 
-// Loop, scanning the buttons
+// The buttons pull the inputs low
+
+  for (button = 0 ; button < 4 ; ++button)
+    piFaceISR (PIFACE_BASE + button, INT_EDGE_FALLING, buttonPushed) ;
 
   for (;;)
-  {
-    for (button = 0 ; button < 4 ; ++button)
-      scanButton (button) ;
-    delay (5) ;
-  }
+    delay (1000) ;
 
   return 0 ;
 }
@@ -55,17 +55,14 @@ static void Signal_handler(int sig);
 
 /*
  * myInterrupt:
+ *	One function for all the pins - the context is the pin's counter
  *********************************************************************************
  */
 
-void myInterrupt0 (void) { ++globalCounter [0] ; }
-void myInterrupt1 (void) { ++globalCounter [1] ; }
-void myInterrupt2 (void) { ++globalCounter [2] ; }
-void myInterrupt3 (void) { ++globalCounter [3] ; }
-void myInterrupt4 (void) { ++globalCounter [4] ; }
-void myInterrupt5 (void) { ++globalCounter [5] ; }
-void myInterrupt6 (void) { ++globalCounter [6] ; }
-void myInterrupt7 (void) { ++globalCounter [7] ; }
+static void myInterrupt (void *context, UNU const struct wpiEdgeEventStruct *event)
+{
+  ++*(volatile int *)context ;
+}
 
 
 /*
@@ -89,14 +86,8 @@ int main (void)
   }
 
 
-  wiringPiISR (0, INT_EDGE_FALLING, &myInterrupt0) ;
-  wiringPiISR (1, INT_EDGE_FALLING, &myInterrupt1) ;
-  wiringPiISR (2, INT_EDGE_FALLING, &myInterrupt2) ;
-  wiringPiISR (3, INT_EDGE_FALLING, &myInterrupt3) ;
-  wiringPiISR (4, INT_EDGE_FALLING, &myInterrupt4) ;
-  wiringPiISR (5, INT_EDGE_FALLING, &myInterrupt5) ;
-  wiringPiISR (6, INT_EDGE_FALLING, &myInterrupt6) ;
-  wiringPiISR (7, INT_EDGE_FALLING, &myInterrupt7) ;
+  for (pin = 0 ; pin < 8 ; ++pin)
+    wiringPiISRex (pin, INT_EDGE_FALLING, myInterrupt, (void *)&globalCounter [pin]) ;
 
   // Set the handler for SIGTERM (15)
   signal(SIGTERM, Signal_handler);
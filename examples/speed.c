@@ -58,6 +58,36 @@ void speedTest (int pin, int maxCount)
 }
 
 
+void speedTestHandle (int pin, int maxCount)
+{
+  int count, sum, perSec, i ;
+  unsigned int start, end ;
+  wpiPin_t h ;
+
+  if ((h = wiringPiPinOpen (pin)) == NULL)
+    return ;
+
+  sum = 0 ;
+
+  for (i = 0 ; i < PASSES ; ++i)
+  {
+    start = millis () ;
+    for (count = 0 ; count < maxCount ; ++count)
+      wpiPinWrite (h, 1) ;
+    end = millis () ;
+    printf (" %6d", end - start) ;
+    fflush (stdout) ;
+    sum += (end - start) ;
+  }
+
+  wpiPinWrite (h, 0) ;
+  wiringPiPinClose (h) ;
+  printf (". Av: %6dmS", sum / PASSES) ;
+  perSec = (int)(double)maxCount / (double)((double)sum / (double)PASSES) * 1000.0 ;
+  printf (": %7d/sec\n", perSec) ;
+}
+
+
 int main (void)
 {
   printf ("Raspberry Pi wiringPi GPIO speed test program\n") ;
@@ -70,6 +100,11 @@ int main (void)
   pinMode (0, OUTPUT) ;
   speedTest (0, FAST_COUNT) ;
 
+// Pre-resolved handle
+
+  printf ("\nPin handle method: (%8d iterations)\n", FAST_COUNT) ;
+  speedTestHandle (0, FAST_COUNT) ;
+
 // GPIO
 
   printf ("\nNative GPIO method: (%8d iterations)\n", FAST_COUNT) ;
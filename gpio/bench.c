@@ -0,0 +1,583 @@
+/*
+ * bench.c:
+ *	gpio bench - a standard set of throughput and latency measurements,
+ *	printed one per line as "name value unit" so runs on different
+ *	boards and kernels can be compared with nothing more than diff or awk.
+ *	Copyright (c) 2012-2018 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/utsname.h>
+
+#include <wiringPi.h>
+#include <wiringPiSPI.h>
+#include <wiringPiI2C.h>
+#include <wiringPiSim.h>
+#include <drcNet.h>
+
+#include <mcp23008.h>
+#include <mcp23016.h>
+#include <mcp23017.h>
+#include <mcp23s08.h>
+#include <mcp23s17.h>
+#include <pcf8574.h>
+#include <pcf8591.h>
+#include <ads1115.h>
+#include <mcp3422.h>
+#include <sn3218.h>
+#include <pca9685.h>
+#include <bmp180.h>
+#include <htu21d.h>
+#include <mcp3002.h>
+#include <mcp3004.h>
+#include <mcp4802.h>
+#include <max31855.h>
+#include <max5322.h>
+#include <sr595.h>
+
+#include <scrollPhat.h>
+#include <gertboard.h>
+
+#include "../version.h"
+
+#ifndef TRUE
+#  define	TRUE	(1==1)
+#  define	FALSE	(1==2)
+#endif
+
+#define	LATENCY_SAMPLES	200
+#define	DRC_PIN_BASE	20000
+
+static unsigned int testMs = 1000 ;
+
+
+/*
+ * report:
+ *	Everything goes out through here so the format stays the same
+ *********************************************************************************
+ */
+
+static void report (const char *name, double value, const char *unit)
+{
+  printf ("%-32s %14.1f %s\n", name, value, unit) ;
+  fflush (stdout) ;
+}
+
+
+/*
+ * reportSpread:
+ *	Sort the samples (nS) and report min, median, 99th percentile and max
+ *********************************************************************************
+ */
+
+static int compareSamples (const void *a, const void *b)
+{
+  unsigned long long x = *(const unsigned long long *)a ;
+  unsigned long long y = *(const unsigned long long *)b ;
+
+  return (x < y) ? -1 : (x > y) ;
+}
+
+static void reportSpread (const char *name, unsigned long long *samples, int n)
+{
+  char label [64] ;
+
+  if (n == 0)
+    return ;
+
+  qsort (samples, n, sizeof (samples [0]), compareSamples) ;
+
+  sprintf (label, "%s.min", name) ; report (label, (double)samples [0],            "ns") ;
+  sprintf (label, "%s.p50", name) ; report (label, (double)samples [n / 2],        "ns") ;
+  sprintf (label, "%s.p99", name) ; report (label, (double)samples [(n * 99) / 100], "ns") ;
+  sprintf (label, "%s.max", name) ; report (label, (double)samples [n - 1],        "ns") ;
+}
+
+
+/*
+ * Rate tests:
+ *	Run the operation in chunks until the time is up, then report the
+ *	operations per second.
+ *********************************************************************************
+ */
+
+#define	RATE_TEST(name, op)							\
+  {										\
+    unsigned long long start = nanos64 (), end = start + testMs * 1000000ULL ;	\
+    unsigned long long now, count = 0 ;					\
+    int k ;									\
+    do									\
+    {										\
+      for (k = 0 ; k < 1000 ; ++k)						\
+	{ op ; }								\
+      count += 1000 ;								\
+    } while ((now = nanos64 ()) < end) ;					\
+    report (name, (double)count * 1e9 / (double)(now - start), "ops/s") ;	\
+  }
+
+static void benchToggle (int pin)
+{
+  wpiPin_t handle ;
+
+  digitalWrite (pin, LOW) ;
+  pinMode      (pin, OUTPUT) ;
+
+  RATE_TEST ("toggle.digitalWrite", digitalWrite (pin, k & 1)) ;
+
+  if ((handle = wiringPiPinOpen (pin)) != NULL)
+  {
+    RATE_TEST ("toggle.handle", wpiPinWrite (handle, k & 1)) ;
+    wiringPiPinClose (handle) ;
+  }
+
+  RATE_TEST ("toggle.masked", digitalWriteMasked (pin, k & 1, 1)) ;
+
+  digitalWrite (pin, LOW) ;
+  pinMode      (pin, INPUT) ;
+}
+
+static void benchRead (int pin)
+{
+  volatile int sink ;
+  wpiPin_t handle ;
+
+  RATE_TEST ("read.digitalRead", sink = digitalRead (pin)) ;
+
+  if ((handle = wiringPiPinOpen (pin)) != NULL)
+  {
+    RATE_TEST ("read.handle", sink = wpiPinRead (handle)) ;
+    wiringPiPinClose (handle) ;
+  }
+
+  (void)sink ;
+}
+
+
+/*
+ * benchDelay:
+ *	How late does delayMicroseconds () come back? The spread, and a
+ *	histogram of the overshoot.
+ *********************************************************************************
+ */
+
+static void benchDelay (void)
+{
+  static const unsigned int requests [] = { 1, 10, 100, 1000 } ;
+  static const unsigned int buckets  [] = { 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000 } ;
+  static const int numBuckets = sizeof (buckets) / sizeof (buckets [0]) ;
+
+  unsigned long long samples [LATENCY_SAMPLES] ;
+  unsigned long long t0, late ;
+  int counts [16] ;
+  char label [64] ;
+  unsigned int r ;
+  int i, b ;
+
+  for (r = 0 ; r < sizeof (requests) / sizeof (requests [0]) ; ++r)
+  {
+    memset (counts, 0, sizeof (counts)) ;
+
+    for (i = 0 ; i < LATENCY_SAMPLES ; ++i)
+    {
+      t0 = nanos64 () ;
+      delayMicroseconds (requests [r]) ;
+      late = nanos64 () - t0 ;
+      late = (late > requests [r] * 1000ULL) ? late - requests [r] * 1000ULL : 0 ;
+      samples [i] = late ;
+
+      for (b = 0 ; (b < numBuckets) && (late >= buckets [b]) ; ++b)
+	;
+      counts [b]++ ;
+    }
+
+    sprintf (label, "delay.%uus.late", requests [r]) ;
+    reportSpread (label, samples, LATENCY_SAMPLES) ;
+
+    for (b = 0 ; b <= numBuckets ; ++b)
+    {
+      if (b < numBuckets)
+	sprintf (label, "delay.%uus.hist.lt%uus", requests [r], buckets [b] / 1000) ;
+      else
+	sprintf (label, "delay.%uus.hist.ge%uus", requests [r], buckets [numBuckets - 1] / 1000) ;
+      report (label, (double)counts [b], "count") ;
+    }
+  }
+}
+
+
+/*
+ * benchIsr:
+ *	Toggle an output wired to an input and time how long it takes for
+ *	the ISR to be called, and for the edge's timestamp, if the kernel's
+ *	giving us those.
+ *********************************************************************************
+ */
+
+static volatile unsigned long long isrTime ;
+static volatile unsigned int       isrCount ;
+
+static void isrHandler (void)
+{
+  isrTime = nanos64 () ;
+  __atomic_add_fetch (&isrCount, 1, __ATOMIC_RELEASE) ;
+}
+
+static void benchIsr (int outPin, int inPin)
+{
+  unsigned long long callSamples [LATENCY_SAMPLES], edgeSamples [LATENCY_SAMPLES] ;
+  struct wpiEdgeEventStruct events [16] ;
+  unsigned long long t0, timeout ;
+  unsigned int count ;
+  int i, n, numCall = 0, numEdge = 0, missed = 0 ;
+  int precise ;
+
+  digitalWrite (outPin, LOW) ;
+  pinMode      (outPin, OUTPUT) ;
+  pinMode      (inPin,  INPUT) ;
+
+  if ((wiringPiEventEnable (inPin, 256) < 0) || (wiringPiISR (inPin, INT_EDGE_BOTH, isrHandler) < 0))
+  {
+    fprintf (stderr, "gpio: bench: Unable to set up an ISR on pin %d: %s\n", inPin, strerror (errno)) ;
+    return ;
+  }
+  precise = wiringPiEventPrecise (inPin) ;
+
+  delay (10) ;
+  while (wiringPiEventReadPin (inPin, events, 16) > 0)
+    ;
+
+  for (i = 0 ; i < LATENCY_SAMPLES ; ++i)
+  {
+    count = __atomic_load_n (&isrCount, __ATOMIC_ACQUIRE) ;
+    t0    = nanos64 () ;
+    digitalWrite (outPin, (i & 1) ? LOW : HIGH) ;
+
+    timeout = t0 + 100000000ULL ;
+    while ((__atomic_load_n (&isrCount, __ATOMIC_ACQUIRE) == count) && (nanos64 () < timeout))
+      ;
+
+    if (__atomic_load_n (&isrCount, __ATOMIC_ACQUIRE) == count)
+      ++missed ;
+    else
+      callSamples [numCall++] = isrTime - t0 ;
+
+    if ((n = wiringPiEventReadPin (inPin, events, 16)) > 0)
+      if (precise && (events [n - 1].timestamp >= t0))
+	edgeSamples [numEdge++] = events [n - 1].timestamp - t0 ;
+
+    delay (1) ;
+  }
+
+  reportSpread ("isr.callback", callSamples, numCall) ;
+  reportSpread ("isr.timestamp", edgeSamples, numEdge) ;
+  report       ("isr.missed", (double)missed, "count") ;
+
+  digitalWrite (outPin, LOW) ;
+  pinMode      (outPin, INPUT) ;
+}
+
+
+/*
+ * benchSpi: benchI2c:
+ *	Transactions per second. A 4-byte SPI transfer and a single byte
+ *	I2C read - roughly what an ADC read costs.
+ *********************************************************************************
+ */
+
+static void benchSpi (int channel, int speed)
+{
+  unsigned char data [4] ;
+
+  if (wiringPiSPISetup (channel, speed) < 0)
+  {
+    fprintf (stderr, "gpio: bench: Unable to open SPI channel %d: %s\n", channel, strerror (errno)) ;
+    return ;
+  }
+
+  RATE_TEST ("spi.transfer4", memset (data, 0, sizeof (data)) ; wiringPiSPIDataRW (channel, data, 4)) ;
+
+  wiringPiSPIClose (channel) ;
+}
+
+static void benchI2c (int address)
+{
+  int fd ;
+
+  if ((fd = wiringPiI2CSetup (address)) < 0)
+  {
+    fprintf (stderr, "gpio: bench: Unable to open I2C device 0x%02X: %s\n", address, strerror (errno)) ;
+    return ;
+  }
+
+  if (wiringPiI2CRead (fd) < 0)
+  {
+    fprintf (stderr, "gpio: bench: No reply from I2C device 0x%02X\n", address) ;
+    return ;
+  }
+
+  RATE_TEST ("i2c.read", wiringPiI2CRead (fd)) ;
+}
+
+
+/*
+ * benchDrcNet:
+ *	Round trip time of a digitalRead to a wiringPiD server
+ *********************************************************************************
+ */
+
+static void benchDrcNet (char *spec)
+{
+  unsigned long long samples [LATENCY_SAMPLES] ;
+  unsigned long long t0 ;
+  char *host, *port, *password ;
+  int i ;
+
+  host = spec ;
+  if (((port = strchr (host, ':')) == NULL) || ((password = strchr (port + 1, ':')) == NULL))
+  {
+    fprintf (stderr, "gpio: bench: drcNet wants host:port:password\n") ;
+    return ;
+  }
+  *port++     = 0 ;
+  *password++ = 0 ;
+
+  if (!drcSetupNet (DRC_PIN_BASE, 64, host, port, password))
+  {
+    fprintf (stderr, "gpio: bench: Unable to connect to %s:%s\n", host, port) ;
+    return ;
+  }
+
+  for (i = 0 ; i < LATENCY_SAMPLES ; ++i)
+  {
+    t0 = nanos64 () ;
+    (void)digitalRead (DRC_PIN_BASE) ;
+    samples [i] = nanos64 () - t0 ;
+  }
+
+  reportSpread ("drcnet.rtt", samples, LATENCY_SAMPLES) ;
+}
+
+
+/*
+ * Bus counts:
+ *	Every driver's operations, run against the simulator's I2C and SPI
+ *	buses, and what each one cost: transactions, bytes and the time a
+ *	real bus would have taken. These are exact, so make bench-counts
+ *	can hold them against the committed bench.counts and an extra
+ *	transaction anywhere shows up.
+ *********************************************************************************
+ */
+
+#define	COUNT_TEST(name, op)						\
+  {									\
+    wiringPiSimBusCounts (WPI_SIM_I2C, NULL, TRUE) ;			\
+    wiringPiSimBusCounts (WPI_SIM_SPI, NULL, TRUE) ;			\
+    op ;								\
+    countReport (name) ;						\
+  }
+
+static void countReport (const char *name)
+{
+  struct wiringPiSimCountStruct i2c, spi ;
+  char label [64] ;
+
+  wiringPiSimBusCounts (WPI_SIM_I2C, &i2c, FALSE) ;
+  wiringPiSimBusCounts (WPI_SIM_SPI, &spi, FALSE) ;
+
+  sprintf (label, "%s.trans", name) ; report (label, (double)(i2c.transactions + spi.transactions), "count") ;
+  sprintf (label, "%s.bytes", name) ; report (label, (double)(i2c.bytes        + spi.bytes),        "bytes") ;
+  sprintf (label, "%s.bus",   name) ; report (label, (double)(i2c.busNs + spi.busNs) / 1e3,        "us") ;
+}
+
+// The operations for each kind of driver, on its first pins
+
+static void countDigital (const char *driver, int pinBase)
+{
+  char name [64] ;
+
+  sprintf (name, "%s.pinMode",         driver) ; COUNT_TEST (name, pinMode         (pinBase,     OUTPUT)) ;
+  sprintf (name, "%s.digitalWrite",    driver) ; COUNT_TEST (name, digitalWrite    (pinBase,     HIGH)) ;
+  sprintf (name, "%s.digitalRead",     driver) ; COUNT_TEST (name, digitalRead     (pinBase + 1)) ;
+  sprintf (name, "%s.pullUpDnControl", driver) ; COUNT_TEST (name, pullUpDnControl (pinBase + 1, PUD_UP)) ;
+  sprintf (name, "%s.digitalWrite8",   driver) ; COUNT_TEST (name, digitalWrite8   (pinBase,     0x55)) ;
+  sprintf (name, "%s.digitalRead8",    driver) ; COUNT_TEST (name, digitalRead8    (pinBase)) ;
+}
+
+static void countAnalog (const char *driver, int pinBase, int reads, int writes)
+{
+  char name [64] ;
+
+  if (reads)
+  {
+    sprintf (name, "%s.analogRead", driver) ;
+    COUNT_TEST (name, analogRead (pinBase)) ;
+  }
+
+  if (writes)
+  {
+    sprintf (name, "%s.analogWrite", driver) ;
+    COUNT_TEST (name, analogWrite (pinBase, 100)) ;
+  }
+}
+
+// The datasheet's worked example for the bmp180: its calibration data,
+//	then a raw temperature and pressure, so the sums don't divide by zero
+
+static const unsigned char bmp180Cal [22] = { 0x01, 0x98, 0xFF, 0xB8, 0xC7, 0xD1, 0x7F, 0xE5, 0x7F, 0xF5, 0x5A, 0x71, 0x18, 0x2E, 0x00, 0x04, 0x80, 0x00, 0xDD, 0xF9, 0x0B, 0x34 } ;
+static const unsigned char bmp180Raw  [3] = { 0x6C, 0xFA, 0x00 } ;
+
+static const int pca9685Frame [16] = { 205, 307, 410, 205, 307, 410, 205, 307, 410, 205, 307, 410, 205, 307, 410, 4096 } ;
+
+static void benchCounts (void)
+{
+  int base = 1000 ;
+
+// I2C, each at an address of its own
+
+  wiringPiSimI2c (0x20) ; COUNT_TEST ("mcp23008.setup", mcp23008Setup (base, 0x20)) ; countDigital ("mcp23008", base) ; base += 100 ;
+  wiringPiSimI2c (0x21) ; COUNT_TEST ("mcp23016.setup", mcp23016Setup (base, 0x21)) ; countDigital ("mcp23016", base) ; base += 100 ;
+  wiringPiSimI2c (0x22) ; COUNT_TEST ("mcp23017.setup", mcp23017Setup (base, 0x22)) ; countDigital ("mcp23017", base) ; base += 100 ;
+  wiringPiSimI2c (0x23) ; COUNT_TEST ("pcf8574.setup",  pcf8574Setup  (base, 0x23)) ; countDigital ("pcf8574",  base) ; base += 100 ;
+
+  wiringPiSimI2c (0x48) ; COUNT_TEST ("pcf8591.setup",  pcf8591Setup  (base, 0x48)) ;          countAnalog ("pcf8591", base, TRUE,  TRUE)  ; base += 100 ;
+  wiringPiSimI2c (0x49) ; COUNT_TEST ("ads1115.setup",  ads1115Setup  (base, 0x49)) ;          countAnalog ("ads1115", base, TRUE,  FALSE) ; base += 100 ;
+  wiringPiSimI2c (0x68) ; COUNT_TEST ("mcp3422.setup",  mcp3422Setup  (base, 0x68, 0, 0)) ;    countAnalog ("mcp3422", base, TRUE,  FALSE) ; base += 100 ;
+  wiringPiSimI2c (0x54) ; COUNT_TEST ("sn3218.setup",   sn3218Setup   (base)) ;                countAnalog ("sn3218",  base, FALSE, TRUE)  ; base += 100 ;
+  wiringPiSimI2c (0x41) ; COUNT_TEST ("pca9685.setup",  pca9685Setup  (base, 0x41, 50)) ;     countAnalog ("pca9685", base, FALSE, TRUE)  ;
+  COUNT_TEST ("pca9685.writeFrame", pca9685WriteFrame (base, pca9685Frame)) ; base += 100 ;
+  wiringPiSimI2c (0x77) ;
+  wiringPiSimI2cLoad (0x77, 0xAA, bmp180Cal, sizeof (bmp180Cal)) ;
+  wiringPiSimI2cLoad (0x77, 0xF6, bmp180Raw, sizeof (bmp180Raw)) ;
+  COUNT_TEST ("bmp180.setup",   bmp180Setup   (base)) ;                countAnalog ("bmp180",  base, TRUE,  FALSE) ; base += 100 ;
+  wiringPiSimI2c (0x40) ; COUNT_TEST ("htu21d.setup",   htu21dSetup   (base)) ;                countAnalog ("htu21d",  base, TRUE,  FALSE) ; base += 100 ;
+
+// SPI
+
+  COUNT_TEST ("mcp23s08.setup", mcp23s08Setup (base, 0, 0)) ; countDigital ("mcp23s08", base) ; base += 100 ;
+  COUNT_TEST ("mcp23s17.setup", mcp23s17Setup (base, 0, 1)) ; countDigital ("mcp23s17", base) ; base += 100 ;
+  COUNT_TEST ("sr595.setup",    sr595SetupSPI (base, 16, 1, 1000000)) ; countDigital ("sr595", base) ; base += 100 ;
+
+  COUNT_TEST ("mcp3002.setup",  mcp3002Setup  (base, 0)) ; countAnalog ("mcp3002",  base, TRUE,  FALSE) ; base += 100 ;
+  COUNT_TEST ("mcp3004.setup",  mcp3004Setup  (base, 0)) ; countAnalog ("mcp3004",  base, TRUE,  FALSE) ; base += 100 ;
+  COUNT_TEST ("mcp4802.setup",  mcp4802Setup  (base, 1)) ; countAnalog ("mcp4802",  base, FALSE, TRUE)  ; base += 100 ;
+  COUNT_TEST ("max31855.setup", max31855Setup (base, 0)) ; countAnalog ("max31855", base, TRUE,  FALSE) ; base += 100 ;
+  COUNT_TEST ("max5322.setup",  max5322Setup  (base, 1)) ; countAnalog ("max5322",  base, FALSE, TRUE)  ; base += 100 ;
+
+// devLib
+
+  COUNT_TEST ("gertboard.setup", gertboardAnalogSetup (base)) ; countAnalog ("gertboard", base, TRUE, TRUE) ; base += 100 ;
+
+  wiringPiSimI2c (0x60) ;
+  COUNT_TEST ("scrollPhat.setup",  scrollPhatSetup ()) ;
+  COUNT_TEST ("scrollPhat.putchar", scrollPhatPutchar ('A')) ;
+  COUNT_TEST ("scrollPhat.update",  scrollPhatUpdate ()) ;
+}
+
+
+/*
+ * doBench:
+ *	gpio bench [-t ms] [-p pin] [-l outPin:inPin] [-s channel[:speed]]
+ *		   [-i address] [-n host:port:password]
+ *	The read and delay tests always run; the rest only when they're given
+ *	something to work on - toggling a pin nobody asked us to isn't polite.
+ *********************************************************************************
+ */
+
+void doBench (int argc, char *argv [])
+{
+  struct utsname uts ;
+  int   model, rev, mem, maker, overVolted ;
+  int   pin = -1, outPin = -1, inPin = -1 ;
+  int   spiChannel = -1, spiSpeed = 1000000, i2cAddress = -1 ;
+  char *drcSpec = NULL ;
+  int   counts = FALSE ;
+  int   i ;
+
+  for (i = 2 ; i < argc ; ++i)
+  {
+    if (strcmp (argv [i], "-c") == 0)
+    {
+      counts = TRUE ;
+      continue ;
+    }
+
+    if (i + 1 == argc)
+      break ;
+
+    /**/ if (strcmp (argv [i], "-t") == 0) testMs = atoi (argv [++i]) ;
+    else if (strcmp (argv [i], "-p") == 0) pin    = atoi (argv [++i]) ;
+    else if (strcmp (argv [i], "-l") == 0) { if (sscanf (argv [++i], "%d:%d", &outPin, &inPin) != 2) break ; }
+    else if (strcmp (argv [i], "-s") == 0) { if (sscanf (argv [++i], "%d:%d", &spiChannel, &spiSpeed) < 1) break ; }
+    else if (strcmp (argv [i], "-i") == 0) i2cAddress = (int)strtol (argv [++i], NULL, 0) ;
+    else if (strcmp (argv [i], "-n") == 0) drcSpec    = argv [++i] ;
+    else
+      break ;
+  }
+
+  if ((i != argc) || (testMs == 0))
+  {
+    fprintf (stderr, "Usage: %s bench [-c] [-t ms] [-p pin] [-l outPin:inPin] [-s channel[:speed]] [-i address] [-n host:port:password]\n", argv [0]) ;
+    exit (1) ;
+  }
+
+// The counts go on their own, with nothing that changes from run to run
+
+  if (counts)
+  {
+    if (!wiringPiSimActive ())
+    {
+      fprintf (stderr, "%s: bench: -c needs the simulator - set WIRINGPI_SIM\n", argv [0]) ;
+      exit (1) ;
+    }
+    printf ("# gpio bench -c, simulated buses\n") ;
+    benchCounts () ;
+    return ;
+  }
+
+  piBoardId (&model, &rev, &mem, &maker, &overVolted) ;
+  uname (&uts) ;
+
+  printf ("# gpio bench, version %s\n", VERSION) ;
+  printf ("# board %s rev %s, %d MB\n", piModelNames [model], piRevisionNames [rev], mem) ;
+  printf ("# kernel %s %s\n", uts.release, uts.machine) ;
+
+  benchRead  ((pin < 0) ? 0 : pin) ;
+  benchDelay () ;
+
+  if (pin >= 0)
+    benchToggle (pin) ;
+
+  if (outPin >= 0)
+    benchIsr (outPin, inPin) ;
+
+  if (spiChannel >= 0)
+    benchSpi (spiChannel, spiSpeed) ;
+
+  if (i2cAddress >= 0)
+    benchI2c (i2cAddress) ;
+
+  if (drcSpec != NULL)
+    benchDrcNet (drcSpec) ;
+}
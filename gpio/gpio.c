@@ -30,12 +30,19 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <signal.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <dirent.h>
+#include <limits.h>
 
 #include <wiringPi.h>
 #include <wpiExtensions.h>
+#include <wiringPiCapture.h>
+#include <wiringPiLog.h>
+#include <wiringPiI2C.h>
 
 #include <gertboard.h>
 #include <piFace.h>
@@ -49,6 +56,7 @@ extern int wiringPiDebug ;
 extern void doReadall    (void) ;
 extern void doAllReadall (void) ;
 extern void doQmode      (int argc, char *argv []) ;
+extern void doBench      (int argc, char *argv []) ;
 
 #ifndef TRUE
 #  define	TRUE	(1==1)
@@ -56,7 +64,6 @@ extern void doQmode      (int argc, char *argv []) ;
 #endif
 
 #define	PI_USB_POWER_CONTROL	38
-#define	I2CDETECT		"i2cdetect"
 #define	MODPROBE		"modprobe"
 #define	RMMOD			"rmmod"
 
@@ -66,20 +73,31 @@ char *usage = "Usage: gpio -v                Show Version\n"
               "       gpio -h                Show Help\n"
               "       gpio -V                Show gpio Layout version\n"
               "       gpio [-g|-1|-p] ...    Use bcm-gpio | physical | piFace pin numbering scheme...\n"
-              "       [-x extension:params] [[ -x ...]] ...\n"
+              "       [-x extension:params] [[ -x ...]] [-f extension file] ...\n"
+              "       gpio [-g|-1|-p] [-x ...] -b [file]\n"
               "       gpio <mode/read/write/aread/awritewb/pwm/pwmTone/clock> ...\n"
+              "       gpio clock <pin> <freq> [osc|plld|pllc|any [mash]]\n"
               "       gpio <toggle/blink> <pin>\n"
               "       gpio readall\n"
               "       gpio unexportall/exports\n"
               "       gpio export/edge/unexport ...\n"
               "       gpio wfi <pin> <mode>\n"
+              "       gpio monitor [-o file] [-s] [-q] [-t secs] <pin> ...\n"
+              "       gpio stats [pid]\n"
+              "       gpio busstat [pid]\n"
+              "       gpio top [pid]\n"
+              "       gpio flight [-c] [pid]\n"
+              "       gpio capture [-n records] [-t ms] [-x pin:level] [-a records] [-c cpu] <file> <pin> ...\n"
+              "       gpio capture -e <file>\n"
+              "       gpio log [-f secs] [-t secs] <dir|file>\n"
+              "       gpio bench [-t ms] [-p pin] [-l out:in] [-s chan[:speed]] [-i addr] [-n host:port:pass] [-c]\n"
               "       gpio drive <group> <value>\n"
-              "       gpio pwm-bal/pwm-ms \n"
-              "       gpio pwmr <range> \n"
+              "       gpio pwm-bal/pwm-ms [channel]\n"
+              "       gpio pwmr <range> [channel]\n"
               "       gpio pwmc <divider> \n"
               "       gpio load spi/i2c\n"
               "       gpio unload spi/i2c\n"
-              "       gpio i2cd/i2cdetect\n"
+              "       gpio i2cd/i2cdetect [bus|all]\n"
               "       gpio rbx/rbd\n"
               "       gpio wb <value>\n"
               "       gpio usbp high/low\n"
@@ -353,32 +371,88 @@ static void doUnLoad (int argc, char *argv [])
 
 /*
  * doI2Cdetect:
- *	Run the i2cdetect command with the right runes for this Pi revision
+ *	Scan an I2C bus and show what's on it, i2cdetect style. The bus is
+ *	the usual one for this Pi, or a number, device or soft:N; "all"
+ *	scans every /dev/i2c-N at once.
  *********************************************************************************
  */
 
-static void doI2Cdetect (UNU int argc, char *argv [])
+static void printI2Cscan (const char *device, const unsigned char *found)
 {
-  int port = piGpioLayout () == 1 ? 0 : 1 ;
-  char *c, *command ;
+  int row, col, addr ;
 
-  if ((c = findExecutable (I2CDETECT)) == NULL)
+  printf ("%s:\n", device) ;
+  printf ("     0  1  2  3  4  5  6  7  8  9  a  b  c  d  e  f") ;
+  for (row = 0 ; row < 128 ; row += 16)
   {
-    fprintf (stderr, "%s: Unable to find i2cdetect command: %s\n", argv [0], strerror (errno)) ;
-    return ;
+    printf ("\n%02x: ", row) ;
+    for (col = 0 ; col < 16 ; ++col)
+    {
+      addr = row + col ;
+      /**/ if ((addr < 0x03) || (addr > 0x77))
+	printf ("   ") ;
+      else if (found [addr] == WPI_I2C_SCAN_BUSY)
+	printf ("UU ") ;
+      else if (found [addr] == WPI_I2C_SCAN_FOUND)
+	printf ("%02x ", addr) ;
+      else
+	printf ("-- ") ;
+    }
   }
+  printf ("\n") ;
+}
+
+static void doI2Cdetect (int argc, char *argv [])
+{
+  unsigned char found [32][128] ;
+  char names [32][16], device [32] ;
+  const char *list [32] ;
+  int  counts [32] ;
+  int  i, n ;
+
+  /**/ if (argc < 3)
+    snprintf (device, sizeof (device), "/dev/i2c-%d", piGpioLayout () == 1 ? 0 : 1) ;
+  else if (isdigit (*argv [2]))
+    snprintf (device, sizeof (device), "/dev/i2c-%d", atoi (argv [2])) ;
+  else
+    snprintf (device, sizeof (device), "%s", argv [2]) ;
 
-  if (!moduleLoaded ("i2c_dev"))
+  if ((strncmp (device, "soft:", 5) != 0) && !moduleLoaded ("i2c_dev"))
   {
     fprintf (stderr, "%s: The I2C kernel module(s) are not loaded.\n", argv [0]) ;
     return ;
   }
 
-  command = malloc (strlen (c) + 16) ;
-  sprintf (command, "%s -y %d", c, port) ;
-  if (system (command) < 0)
-    fprintf (stderr, "%s: Unable to run i2cdetect: %s\n", argv [0], strerror (errno)) ;
+  if (strcasecmp (device, "all") != 0)
+  {
+    if (wiringPiI2CScan (device, WPI_I2C_PROBE_AUTO, found [0]) < 0)
+      fprintf (stderr, "%s: Unable to scan %s: %s\n", argv [0], device, strerror (errno)) ;
+    else
+      printI2Cscan (device, found [0]) ;
+    return ;
+  }
+
+  for (i = n = 0 ; i < 32 ; ++i)
+  {
+    sprintf (names [n], "/dev/i2c-%d", i) ;
+    if (access (names [n], F_OK) == 0)
+    {
+      list [n] = names [n] ;
+      ++n ;
+    }
+  }
+
+  if (wiringPiI2CScanBuses (list, n, WPI_I2C_PROBE_AUTO, found, counts) < 0)
+  {
+    fprintf (stderr, "%s: Unable to scan the I2C buses: %s\n", argv [0], strerror (errno)) ;
+    return ;
+  }
 
+  for (i = 0 ; i < n ; ++i)
+    if (counts [i] < 0)
+      fprintf (stderr, "%s: Unable to scan %s\n", argv [0], names [i]) ;
+    else
+      printI2Cscan (names [i], found [i]) ;
 }
 
 
@@ -428,153 +502,1209 @@ static void doExports (UNU int argc, UNU char *argv [])
     sprintf (fName, "/sys/class/gpio/gpio%d/value", i) ;
     if ((fd = open (fName, O_RDONLY)) == -1)
     {
-      printf ("No Value file (huh?)\n") ;
-      continue ;
+      printf ("No Value file (huh?)\n") ;
+      continue ;
+    }
+
+    if ((l = read (fd, buf, 16)) == 0)
+      sprintf (buf, "%s", "?") ;
+
+    buf [l] = 0 ;
+    if ((buf [strlen (buf) - 1]) == '\n')
+      buf [strlen (buf) - 1] = 0 ;
+
+    printf ("  %s", buf) ;
+
+// Read any edge trigger file
+
+    sprintf (fName, "/sys/class/gpio/gpio%d/edge", i) ;
+    if ((fd = open (fName, O_RDONLY)) == -1)
+    {
+      printf ("\n") ;
+      continue ;
+    }
+
+    if ((l = read (fd, buf, 16)) == 0)
+      sprintf (buf, "%s", "?") ;
+
+    buf [l] = 0 ;
+    if ((buf [strlen (buf) - 1]) == '\n')
+      buf [strlen (buf) - 1] = 0 ;
+
+    printf ("  %-8s\n", buf) ;
+
+    close (fd) ;
+  }
+}
+
+
+/*
+ * doExport:
+ *	gpio export pin mode
+ *	This uses the /sys/class/gpio device interface.
+ *********************************************************************************
+ */
+
+void doExport (int argc, char *argv [])
+{
+  FILE *fd ;
+  int pin ;
+  char *mode ;
+  char fName [128] ;
+
+  if (argc != 4)
+  {
+    fprintf (stderr, "Usage: %s export pin mode\n", argv [0]) ;
+    exit (1) ;
+  }
+
+  pin = atoi (argv [2]) ;
+
+  mode = argv [3] ;
+
+  if ((fd = fopen ("/sys/class/gpio/export", "w")) == NULL)
+  {
+    fprintf (stderr, "%s: Unable to open GPIO export interface: %s\n", argv [0], strerror (errno)) ;
+    exit (1) ;
+  }
+
+  fprintf (fd, "%d\n", pin) ;
+  fclose (fd) ;
+
+  sprintf (fName, "/sys/class/gpio/gpio%d/direction", pin) ;
+  if ((fd = fopen (fName, "w")) == NULL)
+  {
+    fprintf (stderr, "%s: Unable to open GPIO direction interface for pin %d: %s\n", argv [0], pin, strerror (errno)) ;
+    exit (1) ;
+  }
+
+  /**/ if ((strcasecmp (mode, "in")   == 0) || (strcasecmp (mode, "input")  == 0))
+    fprintf (fd, "in\n") ;
+  else if ((strcasecmp (mode, "out")  == 0) || (strcasecmp (mode, "output") == 0))
+    fprintf (fd, "out\n") ;
+  else if ((strcasecmp (mode, "high") == 0) || (strcasecmp (mode, "up")     == 0))
+    fprintf (fd, "high\n") ;
+  else if ((strcasecmp (mode, "low")  == 0) || (strcasecmp (mode, "down")   == 0))
+    fprintf (fd, "low\n") ;
+  else
+  {
+    fprintf (stderr, "%s: Invalid mode: %s. Should be in, out, high or low\n", argv [1], mode) ;
+    exit (1) ;
+  }
+
+  fclose (fd) ;
+
+// Change ownership so the current user can actually use it
+
+  sprintf (fName, "/sys/class/gpio/gpio%d/value", pin) ;
+  changeOwner (argv [0], fName) ;
+
+  sprintf (fName, "/sys/class/gpio/gpio%d/edge", pin) ;
+  changeOwner (argv [0], fName) ;
+
+}
+
+
+/*
+ * doWfi:
+ *	gpio wfi pin mode
+ *	Wait for Interrupt on a given pin.
+ *	Slight cheat here - it's easier to actually use ISR now (which calls
+ *	gpio to set the pin modes!) then we simply sleep, and expect the thread
+ *	to exit the program. Crude but effective.
+ *********************************************************************************
+ */
+
+static void wfi (void)
+  { exit (0) ; }
+
+void doWfi (int argc, char *argv [])
+{
+  int pin, mode ;
+
+  if (argc != 4)
+  {
+    fprintf (stderr, "Usage: %s wfi pin mode\n", argv [0]) ;
+    exit (1) ;
+  }
+
+  pin  = atoi (argv [2]) ;
+
+  /**/ if (strcasecmp (argv [3], "rising")  == 0) mode = INT_EDGE_RISING ;
+  else if (strcasecmp (argv [3], "falling") == 0) mode = INT_EDGE_FALLING ;
+  else if (strcasecmp (argv [3], "both")    == 0) mode = INT_EDGE_BOTH ;
+  else
+  {
+    fprintf (stderr, "%s: wfi: Invalid mode: %s. Should be rising, falling or both\n", argv [1], argv [3]) ;
+    exit (1) ;
+  }
+
+  if (wiringPiISR (pin, mode, &wfi) < 0)
+  {
+    fprintf (stderr, "%s: wfi: Unable to setup ISR: %s\n", argv [1], strerror (errno)) ;
+    exit (1) ;
+  }
+
+  for (;;)
+    delay (9999) ;
+}
+
+
+
+/*
+ * doMonitor:
+ *	gpio monitor [-o file] [-s] [-q] [-t seconds] <pin> ...
+ *	Stream every edge on the pins with its nS timestamp - as text to stdout,
+ *	or as binary struct wpiEdgeEventStruct records to a file with -o.
+ *	-s adds a line of statistics per pin every second: edges, frequency
+ *	and duty cycle; -q drops the per-edge lines. It runs until interrupted,
+ *	or for -t seconds.
+ *	The edges come from the event rings, recorded by the one epoll dispatch
+ *	thread, so nothing is lost between wake-ups while we print.
+ *********************************************************************************
+ */
+
+#define	MAX_MONITOR_PINS	64
+#define	MONITOR_BATCH		256
+
+struct monitorStats
+{
+  int                pin ;
+  int                level ;		// -1 until we've seen an edge
+  unsigned long long lastEdge ;
+  unsigned long long highNs, totalNs ;
+  unsigned int       edges, rising ;
+  unsigned int       totalEdges ;
+} ;
+
+static volatile int monitorStop = FALSE ;
+
+static void monitorSignal (UNU int sig)
+  { monitorStop = TRUE ; }
+
+static void monitorPrintStats (FILE *out, struct monitorStats *stats, int numPins, double seconds)
+{
+  struct monitorStats *st ;
+  int i ;
+
+  for (i = 0 ; i < numPins ; ++i)
+  {
+    st = &stats [i] ;
+    fprintf (out, "pin %3d: %8u edges  %10.1f Hz  duty ", st->pin, st->edges, (double)st->rising / seconds) ;
+    if (st->totalNs == 0)
+      fprintf (out, "    -  ") ;
+    else
+      fprintf (out, "%5.1f%%", 100.0 * (double)st->highNs / (double)st->totalNs) ;
+    fprintf (out, "  total %u, overruns %u\n", st->totalEdges, wiringPiEventOverruns (st->pin)) ;
+
+    st->edges = st->rising = 0 ;
+    st->highNs = st->totalNs = 0 ;
+  }
+  fflush (out) ;
+}
+
+void doMonitor (int argc, char *argv [])
+{
+  struct wpiEdgeEventStruct events [MONITOR_BATCH] ;
+  struct monitorStats stats [MAX_MONITOR_PINS] ;
+  struct monitorStats *st ;
+  FILE *out = NULL ;
+  int   showStats = FALSE, quiet = FALSE ;
+  int   numPins = 0, i, j, n ;
+  unsigned long long now, start, nextStats, stopAt = 0 ;
+
+  for (i = 2 ; (i < argc) && (argv [i][0] == '-') ; ++i)
+  {
+    /**/ if ((strcmp (argv [i], "-o") == 0) && (i + 1 < argc))
+    {
+      if ((out = fopen (argv [++i], "wb")) == NULL)
+      {
+	fprintf (stderr, "%s: monitor: Unable to open %s: %s\n", argv [0], argv [i], strerror (errno)) ;
+	exit (1) ;
+      }
+    }
+    else if ((strcmp (argv [i], "-t") == 0) && (i + 1 < argc))
+      stopAt = (unsigned long long)atoi (argv [++i]) * 1000000000ULL ;
+    else if (strcmp (argv [i], "-s") == 0)
+      showStats = TRUE ;
+    else if (strcmp (argv [i], "-q") == 0)
+      quiet = TRUE ;
+    else
+      break ;
+  }
+
+  if (i == argc)
+  {
+    fprintf (stderr, "Usage: %s monitor [-o file] [-s] [-q] [-t seconds] <pin> ...\n", argv [0]) ;
+    exit (1) ;
+  }
+
+// Everything on the one dispatch thread, and a decent ring per pin
+
+  (void)wiringPiISRDispatch (1) ;
+
+  for (; (i < argc) && (numPins < MAX_MONITOR_PINS) ; ++i)
+  {
+    st = &stats [numPins] ;
+    memset (st, 0, sizeof (*st)) ;
+    st->pin   = atoi (argv [i]) ;
+    st->level = -1 ;
+
+    if ((wiringPiEventEnable (st->pin, 4096) < 0) || (wiringPiISR (st->pin, INT_EDGE_BOTH, NULL) < 0))
+    {
+      fprintf (stderr, "%s: monitor: Unable to monitor pin %d: %s\n", argv [0], st->pin, strerror (errno)) ;
+      exit (1) ;
+    }
+
+    if (!wiringPiEventPrecise (st->pin))
+      fprintf (stderr, "%s: monitor: pin %d: no GPIO character device - timestamps are approximate\n", argv [0], st->pin) ;
+
+    ++numPins ;
+  }
+
+  signal (SIGINT,  monitorSignal) ;
+  signal (SIGTERM, monitorSignal) ;
+
+  start     = nanos64 () ;
+  nextStats = start + 1000000000ULL ;
+  if (stopAt != 0)
+    stopAt += start ;
+
+  while (!monitorStop)
+  {
+    if ((n = wiringPiEventRead (events, MONITOR_BATCH)) == 0)
+      delay (1) ;
+
+    for (i = 0 ; i < n ; ++i)
+    {
+      for (j = 0 ; (j < numPins) && (stats [j].pin != events [i].pin) ; ++j)
+	;
+      if (j == numPins)
+	continue ;
+
+      st = &stats [j] ;
+      if (st->level >= 0)
+      {
+	st->totalNs += events [i].timestamp - st->lastEdge ;
+	if (st->level == HIGH)
+	  st->highNs += events [i].timestamp - st->lastEdge ;
+      }
+      st->level    = (events [i].edge == INT_EDGE_RISING) ? HIGH : LOW ;
+      st->lastEdge = events [i].timestamp ;
+      st->edges++ ;
+      st->totalEdges++ ;
+      if (st->level == HIGH)
+	st->rising++ ;
+
+      /**/ if (out != NULL)
+	fwrite (&events [i], sizeof (events [i]), 1, out) ;
+      else if (!quiet)
+	printf ("%llu.%09llu %d %s\n", events [i].timestamp / 1000000000ULL, events [i].timestamp % 1000000000ULL,
+		events [i].pin, (events [i].edge == INT_EDGE_RISING) ? "rising" : "falling") ;
+    }
+
+    if ((n == 0) && (out == NULL) && !quiet)
+      fflush (stdout) ;
+
+    now = nanos64 () ;
+    if (showStats && (now >= nextStats))
+    {
+      monitorPrintStats ((out == NULL) && quiet ? stdout : stderr, stats, numPins, (double)(now - nextStats + 1000000000ULL) / 1e9) ;
+      nextStats = now + 1000000000ULL ;
+    }
+
+    if ((stopAt != 0) && (now >= stopAt))
+      break ;
+  }
+
+  if (out != NULL)
+    fclose (out) ;
+  else
+    fflush (stdout) ;
+}
+
+
+
+/*
+ * doStats:
+ *	gpio stats [pid]
+ *	Print the latency histograms that programs run with WIRINGPI_STATS
+ *	set are sharing - the given one, or all of them.
+ *********************************************************************************
+ */
+
+static void statsTime (char *buf, unsigned long long ns)
+{
+  /**/ if (ns < 1000ULL)
+    sprintf (buf, "%lluns", ns) ;
+  else if (ns < 1000000ULL)
+    sprintf (buf, "%.1fus", (double)ns / 1e3) ;
+  else
+    sprintf (buf, "%.1fms", (double)ns / 1e6) ;
+}
+
+static struct wpiStatsTableStruct *statsOpen (const char *cmd, int pid)
+{
+  struct wpiStatsTableStruct *table ;
+  char name [64] ;
+  int fd ;
+
+  sprintf (name, "/dev/shm" WPI_STATS_SHM, pid) ;
+  if ((fd = open (name, O_RDONLY)) < 0)
+  {
+    fprintf (stderr, "gpio: %s: No statistics for pid %d: %s\n", cmd, pid, strerror (errno)) ;
+    return NULL ;
+  }
+
+  table = (struct wpiStatsTableStruct *)mmap (NULL, sizeof (*table), PROT_READ, MAP_SHARED, fd, 0) ;
+  close (fd) ;
+
+  if ((table == MAP_FAILED) || (table->magic != WPI_STATS_MAGIC))
+  {
+    fprintf (stderr, "gpio: %s: %s isn't a statistics table\n", cmd, name) ;
+    if (table != MAP_FAILED)
+      munmap (table, sizeof (*table)) ;
+    return NULL ;
+  }
+
+  return table ;
+}
+
+static void statsShow (int pid)
+{
+  static const char *typeNames [WPI_STATS_TYPES] = { "isr", "softPwm", "softServo" } ;
+  struct wpiStatsTableStruct *table ;
+  struct wpiLatencyStruct *h ;
+  char t1 [16], t2 [16] ;
+  int type, index, b ;
+
+  if ((table = statsOpen ("stats", pid)) == NULL)
+    return ;
+
+  printf ("pid %d:\n", table->pid) ;
+
+  for (type = 0 ; type < WPI_STATS_TYPES ; ++type)
+    for (index = 0 ; index < WPI_STATS_INDEXES ; ++index)
+    {
+      h = &table->hist [type][index] ;
+      if (h->count == 0)
+	continue ;
+
+      statsTime (t1, h->sumNs / h->count) ;
+      statsTime (t2, h->maxNs) ;
+      printf ("  %-9s %2d: %10u  mean %8s  max %8s\n", typeNames [type], index, h->count, t1, t2) ;
+
+      printf ("              ") ;
+      for (b = 0 ; b < WPI_STATS_BUCKETS ; ++b)
+	if (h->bucket [b] != 0)
+	{
+	  statsTime (t1, (b == 0) ? 0 : 1ULL << b) ;
+	  printf (" %s%s:%u", (b == 0) ? "=" : (b == WPI_STATS_BUCKETS - 1) ? ">" : "<", t1, h->bucket [b]) ;
+	}
+      printf ("\n") ;
+    }
+
+  munmap (table, sizeof (*table)) ;
+}
+
+void doStats (int argc, char *argv [])
+{
+  DIR *dir ;
+  struct dirent *d ;
+  int pid ;
+
+  if (argc > 3)
+  {
+    fprintf (stderr, "Usage: %s stats [pid]\n", argv [0]) ;
+    exit (1) ;
+  }
+
+  if (argc == 3)
+  {
+    statsShow (atoi (argv [2])) ;
+    return ;
+  }
+
+  if ((dir = opendir ("/dev/shm")) == NULL)
+  {
+    fprintf (stderr, "%s: stats: Unable to read /dev/shm: %s\n", argv [0], strerror (errno)) ;
+    exit (1) ;
+  }
+
+  while ((d = readdir (dir)) != NULL)
+    if (sscanf (d->d_name, WPI_STATS_SHM + 1, &pid) == 1)
+      statsShow (pid) ;
+
+  closedir (dir) ;
+}
+
+
+/*
+ * doBusStat:
+ *	gpio busstat [pid]
+ *	Print the bus and device transaction counters of programs run with
+ *	WIRINGPI_STATS set, with how busy each was over a one second sample.
+ *********************************************************************************
+ */
+
+static const char *busNames [] = { "?", "i2c", "spi", "serial", "drcnet" } ;
+
+static void busStatShow (int pid)
+{
+  struct wpiStatsTableStruct *table ;
+  struct wpiBusStatsStruct before [WPI_BUS_SLOTS], *b ;
+  unsigned long long t0, t1 ;
+  char dev [16], t [16] ;
+  int slot ;
+
+  if ((table = statsOpen ("busstat", pid)) == NULL)
+    return ;
+
+  memcpy (before, table->bus, sizeof (before)) ;
+  t0 = nanos64 () ;
+  delay (1000) ;
+  t1 = nanos64 () ;
+
+  printf ("pid %d:\n", table->pid) ;
+  printf ("  %-6s %-23s %6s %12s %12s %8s %8s %9s %6s\n", "bus", "name", "device", "transactions", "bytes", "errors", "retries", "mean", "busy") ;
+
+  for (slot = 0 ; slot < WPI_BUS_SLOTS ; ++slot)
+  {
+    b = &table->bus [slot] ;
+    if ((b->type <= 0) || (b->type > WPI_BUS_DRCNET))
+      continue ;
+
+    /**/ if (b->device < 0)
+      strcpy (dev, "-") ;
+    else if (b->type == WPI_BUS_I2C)
+      sprintf (dev, "0x%02X", b->device) ;
+    else
+      sprintf (dev, "%d", b->device) ;
+
+    statsTime (t, (b->transactions == 0) ? 0 : b->busyNs / b->transactions) ;
+
+    printf ("  %-6s %-23.23s %6s %12llu %12llu %8llu %8llu %9s %5.1f%%\n",
+	busNames [b->type], b->name, dev, b->transactions, b->bytes, b->errors, b->retries, t,
+	(t1 > t0) ? 100.0 * (double)(b->busyNs - before [slot].busyNs) / (double)(t1 - t0) : 0.0) ;
+  }
+
+  munmap (table, sizeof (*table)) ;
+}
+
+void doBusStat (int argc, char *argv [])
+{
+  DIR *dir ;
+  struct dirent *d ;
+  int pid ;
+
+  if (argc > 3)
+  {
+    fprintf (stderr, "Usage: %s busstat [pid]\n", argv [0]) ;
+    exit (1) ;
+  }
+
+  if (argc == 3)
+  {
+    busStatShow (atoi (argv [2])) ;
+    return ;
+  }
+
+  if ((dir = opendir ("/dev/shm")) == NULL)
+  {
+    fprintf (stderr, "%s: busstat: Unable to read /dev/shm: %s\n", argv [0], strerror (errno)) ;
+    exit (1) ;
+  }
+
+  while ((d = readdir (dir)) != NULL)
+    if (sscanf (d->d_name, WPI_STATS_SHM + 1, &pid) == 1)
+      busStatShow (pid) ;
+
+  closedir (dir) ;
+}
+
+
+/*
+ * doTop:
+ *	gpio top [pid]
+ *	Attach to the statistics of a program run with WIRINGPI_STATS set -
+ *	the given one, or the first we find - and show what it's been doing
+ *	each second: the busiest pins, ISRs, soft PWM and servo edges,
+ *	extension nodes and buses, until it exits or we're interrupted.
+ *********************************************************************************
+ */
+
+#define	TOP_ROWS	(64 + WPI_STATS_TYPES * WPI_STATS_INDEXES + WPI_STATS_NODES + WPI_BUS_SLOTS)
+
+struct topRowStruct
+{
+  int    section ;
+  double rate ;
+  char   text [96] ;
+} ;
+
+static int topCompare (const void *a, const void *b)
+{
+  const struct topRowStruct *ra = (const struct topRowStruct *)a ;
+  const struct topRowStruct *rb = (const struct topRowStruct *)b ;
+
+  if (ra->section != rb->section)
+    return ra->section - rb->section ;
+
+  return (ra->rate < rb->rate) ? 1 : (ra->rate > rb->rate) ? -1 : 0 ;
+}
+
+static void topShow (const struct wpiStatsTableStruct *was, const struct wpiStatsTableStruct *now, double secs)
+{
+  static const char *headings [] =
+  {
+    "  pin       reads/s    writes/s",
+    "  isr  gpio   calls/s      mean       max",
+    "  softPwm      pin   edges/s  mean late  max late",
+    "  softServo          edges/s  mean late  max late",
+    "  node   pins              calls/s",
+    "  bus    name                    device      trans/s     bytes/s    errors/s   busy",
+  } ;
+  static struct topRowStruct rows [TOP_ROWS] ;
+  const struct wpiLatencyStruct *h0, *h1 ;
+  const struct wpiBusStatsStruct *b0, *b1 ;
+  double reads, writes ;
+  char t1 [16], t2 [16], dev [16] ;
+  int n = 0, i, type, index, section = -1 ;
+
+  for (i = 0 ; i < 64 ; ++i)
+  {
+    reads  = (double)(now->pins [i].reads  - was->pins [i].reads)  / secs ;
+    writes = (double)(now->pins [i].writes - was->pins [i].writes) / secs ;
+    if ((reads == 0.0) && (writes == 0.0))
+      continue ;
+    rows [n].section = 0 ;
+    rows [n].rate    = reads + writes ;
+    snprintf (rows [n].text, sizeof (rows [0].text), "  %3d  %12.1f%12.1f", i, reads, writes) ;
+    ++n ;
+  }
+
+  for (type = 0 ; type < WPI_STATS_TYPES ; ++type)
+    for (index = 0 ; index < WPI_STATS_INDEXES ; ++index)
+    {
+      h0 = &was->hist [type][index] ;
+      h1 = &now->hist [type][index] ;
+      if (h1->count == h0->count)
+	continue ;
+      statsTime (t1, (h1->sumNs - h0->sumNs) / (h1->count - h0->count)) ;
+      statsTime (t2, h1->maxNs) ;
+      rows [n].section = 1 + type ;
+      rows [n].rate    = (double)(h1->count - h0->count) / secs ;
+      /**/ if (type == WPI_STATS_SOFTSERVO)
+	snprintf (rows [n].text, sizeof (rows [0].text), "                     %10.1f%11s%10s", rows [n].rate, t1, t2) ;
+      else if (type == WPI_STATS_SOFTPWM)
+	snprintf (rows [n].text, sizeof (rows [0].text), "               %3d%10.1f%11s%10s", index, rows [n].rate, t1, t2) ;
+      else
+	snprintf (rows [n].text, sizeof (rows [0].text), "         %3d%10.1f%10s%10s", index, rows [n].rate, t1, t2) ;
+      ++n ;
+    }
+
+  for (i = 0 ; i < WPI_STATS_NODES ; ++i)
+  {
+    if ((now->nodes [i].pinMax == 0) || (now->nodes [i].pinBase != was->nodes [i].pinBase) || (now->nodes [i].calls == was->nodes [i].calls))
+      continue ;
+    rows [n].section = 1 + WPI_STATS_TYPES ;
+    rows [n].rate    = (double)(now->nodes [i].calls - was->nodes [i].calls) / secs ;
+    snprintf (rows [n].text, sizeof (rows [0].text), "  %6d-%-6d %18.1f", now->nodes [i].pinBase, now->nodes [i].pinMax, rows [n].rate) ;
+    ++n ;
+  }
+
+  for (i = 0 ; i < WPI_BUS_SLOTS ; ++i)
+  {
+    b0 = &was->bus [i] ;
+    b1 = &now->bus [i] ;
+    if ((b1->type <= 0) || (b1->type > WPI_BUS_DRCNET) || (b1->transactions == b0->transactions))
+      continue ;
+
+    /**/ if (b1->device < 0)
+      strcpy (dev, "-") ;
+    else if (b1->type == WPI_BUS_I2C)
+      sprintf (dev, "0x%02X", b1->device) ;
+    else
+      sprintf (dev, "%d", b1->device) ;
+
+    rows [n].section = 2 + WPI_STATS_TYPES ;
+    rows [n].rate    = (double)(b1->busyNs - b0->busyNs) / secs ;	// Busiest first
+    snprintf (rows [n].text, sizeof (rows [0].text), "  %-6s %-23.23s %6s %12.1f%12.1f%12.1f %5.1f%%",
+	busNames [b1->type], b1->name, dev,
+	(double)(b1->transactions - b0->transactions) / secs,
+	(double)(b1->bytes - b0->bytes) / secs,
+	(double)(b1->errors - b0->errors) / secs,
+	rows [n].rate / 1e7) ;
+    ++n ;
+  }
+
+  qsort (rows, n, sizeof (rows [0]), topCompare) ;
+
+  printf ("\033[H\033[J") ;
+  printf ("gpio top - pid %d\n", now->pid) ;
+
+  for (i = 0 ; i < n ; ++i)
+  {
+    if (rows [i].section != section)
+    {
+      section = rows [i].section ;
+      printf ("\n%s\n", headings [section]) ;
+    }
+    printf ("%s\n", rows [i].text) ;
+  }
+
+  if (n == 0)
+    printf ("\n  Nothing happening\n") ;
+
+  fflush (stdout) ;
+}
+
+void doTop (int argc, char *argv [])
+{
+  static struct wpiStatsTableStruct was, now ;
+  struct wpiStatsTableStruct *table ;
+  unsigned long long t0, t1 ;
+  DIR *dir ;
+  struct dirent *d ;
+  int pid = -1 ;
+
+  if (argc > 3)
+  {
+    fprintf (stderr, "Usage: %s top [pid]\n", argv [0]) ;
+    exit (1) ;
+  }
+
+  if (argc == 3)
+    pid = atoi (argv [2]) ;
+  else
+  {
+    if ((dir = opendir ("/dev/shm")) == NULL)
+    {
+      fprintf (stderr, "%s: top: Unable to read /dev/shm: %s\n", argv [0], strerror (errno)) ;
+      exit (1) ;
+    }
+    while ((d = readdir (dir)) != NULL)
+      if (sscanf (d->d_name, WPI_STATS_SHM + 1, &pid) == 1)
+	break ;
+    closedir (dir) ;
+
+    if (d == NULL)
+    {
+      fprintf (stderr, "%s: top: No programs are sharing statistics\n", argv [0]) ;
+      exit (1) ;
+    }
+  }
+
+  if ((table = statsOpen ("top", pid)) == NULL)
+    exit (1) ;
+
+  memcpy (&was, table, sizeof (was)) ;
+  t0 = nanos64 () ;
+
+  for (;;)
+  {
+    delay (1000) ;
+
+    memcpy (&now, table, sizeof (now)) ;
+    t1 = nanos64 () ;
+
+    topShow (&was, &now, (double)(t1 - t0) / 1e9) ;
+
+    if ((kill (pid, 0) < 0) && (errno == ESRCH))
+    {
+      printf ("\npid %d has gone\n", pid) ;
+      break ;
+    }
+
+    memcpy (&was, &now, sizeof (was)) ;
+    t0 = t1 ;
+  }
+
+  munmap (table, sizeof (*table)) ;
+}
+
+
+/*
+ * doFlight:
+ *	gpio flight [-c] [pid]
+ *	Dump the flight recorders of programs run with WIRINGPI_FLIGHT set -
+ *	the given one, or all of them - merged into time order. The tables
+ *	stay behind when a program exits or crashes; -c removes those.
+ *********************************************************************************
+ */
+
+struct flightEntry
+{
+  unsigned long long ticks ;
+  int tid ;
+  struct wpiFlightRecordStruct *rec ;
+} ;
+
+static int flightCompare (const void *a, const void *b)
+{
+  const struct flightEntry *ea = (const struct flightEntry *)a ;
+  const struct flightEntry *eb = (const struct flightEntry *)b ;
+
+  return (ea->ticks < eb->ticks) ? -1 : (ea->ticks > eb->ticks) ? 1 : 0 ;
+}
+
+static void flightShow (int pid, int clean)
+{
+  static const char *opNames [] = { "?", "mode", "pud", "write", "pwm", "awrite", "masked" } ;
+  struct wpiFlightTableStruct *table ;
+  struct wpiFlightRecordStruct *data ;
+  struct flightEntry *entries ;
+  struct stat st ;
+  unsigned long long head, ns ;
+  char name [64] ;
+  int fd, i, n, count, running ;
+
+  sprintf (name, "/dev/shm" WPI_FLIGHT_SHM, pid) ;
+  running = (kill (pid, 0) == 0) || (errno == EPERM) ;
+
+  if (clean)
+  {
+    if (!running && (unlink (name) == 0))
+      printf ("pid %d: removed\n", pid) ;
+    return ;
+  }
+
+  if ((fd = open (name, O_RDONLY)) < 0)
+  {
+    fprintf (stderr, "gpio: flight: No flight recorder for pid %d: %s\n", pid, strerror (errno)) ;
+    return ;
+  }
+
+  if ((fstat (fd, &st) < 0) || ((size_t)st.st_size < sizeof (*table)))
+    table = MAP_FAILED ;
+  else
+    table = (struct wpiFlightTableStruct *)mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0) ;
+  close (fd) ;
+
+  if ((table == MAP_FAILED) || (table->magic != WPI_FLIGHT_MAGIC) || (table->threads > WPI_FLIGHT_THREADS) ||
+	((size_t)st.st_size < sizeof (*table) + (size_t)table->threads * table->records * sizeof (*data)))
+  {
+    fprintf (stderr, "gpio: flight: %s isn't a flight recorder\n", name) ;
+    if (table != MAP_FAILED)
+      munmap (table, st.st_size) ;
+    return ;
+  }
+
+  data = (struct wpiFlightRecordStruct *)(table + 1) ;
+
+  if ((entries = malloc ((size_t)table->threads * table->records * sizeof (*entries))) == NULL)
+  {
+    fprintf (stderr, "gpio: flight: Out of memory\n") ;
+    munmap (table, st.st_size) ;
+    return ;
+  }
+
+  printf ("pid %d: %s\n", table->pid, running ? "running" : "gone") ;
+
+// The newest records of every ring that's been used
+
+  count = 0 ;
+  for (i = 0 ; i < (int)table->threads ; ++i)
+  {
+    if ((head = table->ring [i].head) == 0)
+      continue ;
+
+    printf ("  thread %d: %llu records%s\n", table->ring [i].tid, head,
+	(table->ring [i].state == WPI_FLIGHT_LIVE) ? "" : ", exited") ;
+
+    for (n = (head < table->records) ? (int)head : (int)table->records ; n > 0 ; --n)
+    {
+      entries [count].rec   = &data [i * table->records + ((head - n) & (table->records - 1))] ;
+      entries [count].ticks = entries [count].rec->ticks ;
+      entries [count].tid   = table->ring [i].tid ;
+      ++count ;
+    }
+  }
+
+  qsort (entries, count, sizeof (*entries), flightCompare) ;
+
+  for (i = 0 ; i < count ; ++i)
+  {
+    ns = table->nsBase + (unsigned long long)((double)(entries [i].ticks - table->tickBase) * 1e9 / (double)table->tickHz) ;
+    printf ("%llu.%09llu %6d %-6s %4d %d\n", ns / 1000000000ULL, ns % 1000000000ULL, entries [i].tid,
+	(entries [i].rec->op < sizeof (opNames) / sizeof (opNames [0])) ? opNames [entries [i].rec->op] : "?",
+	entries [i].rec->pin, entries [i].rec->value) ;
+  }
+
+  free (entries) ;
+  munmap (table, st.st_size) ;
+}
+
+void doFlight (int argc, char *argv [])
+{
+  DIR *dir ;
+  struct dirent *d ;
+  int pid, clean = FALSE ;
+
+  if ((argc > 2) && (strcmp (argv [2], "-c") == 0))
+  {
+    clean = TRUE ;
+    --argc ; ++argv ;
+  }
+
+  if (argc > 3)
+  {
+    fprintf (stderr, "Usage: %s flight [-c] [pid]\n", argv [0]) ;
+    exit (1) ;
+  }
+
+  if (argc == 3)
+  {
+    flightShow (atoi (argv [2]), clean) ;
+    return ;
+  }
+
+  if ((dir = opendir ("/dev/shm")) == NULL)
+  {
+    fprintf (stderr, "%s: flight: Unable to read /dev/shm: %s\n", argv [0], strerror (errno)) ;
+    exit (1) ;
+  }
+
+  while ((d = readdir (dir)) != NULL)
+    if (sscanf (d->d_name, WPI_FLIGHT_SHM + 1, &pid) == 1)
+      flightShow (pid, clean) ;
+
+  closedir (dir) ;
+}
+
+
+/*
+ * doCapture:
+ *	gpio capture [-n records] [-t ms] [-x pin:level] ... [-a records] [-c cpu] <file> <pin> ...
+ *	gpio capture -e <file>
+ *	Record every change on the pins into a ring in the file, as a logic
+ *	analyser would, until interrupted, -t ms have passed, or -a records
+ *	after the -x trigger condition (all of them at once) first holds.
+ *	-c runs the sampling on that CPU at real-time priority - use one kept
+ *	free with isolcpus=. -e turns a capture file into a VCD on stdout,
+ *	which GTKWave, PulseView and sigrok-cli all read.
+ *********************************************************************************
+ */
+
+static volatile int captureInterrupted = FALSE ;
+
+static void captureSignal (UNU int sig)
+  { captureInterrupted = TRUE ; }
+
+static void captureVcd (char *argv [], const char *file)
+{
+  struct wpiCaptureHeaderStruct *h ;
+  struct wpiCaptureRecordStruct *r ;
+  struct stat st ;
+  uint64_t first, i, n, t ;
+  uint32_t levels, changed ;
+  int fd, bit ;
+
+  if ((fd = open (file, O_RDONLY)) < 0)
+  {
+    fprintf (stderr, "%s: capture: Unable to open %s: %s\n", argv [0], file, strerror (errno)) ;
+    exit (1) ;
+  }
+
+  fstat (fd, &st) ;
+  h = (struct wpiCaptureHeaderStruct *)mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0) ;
+  close (fd) ;
+
+  if ((h == MAP_FAILED) || (st.st_size < WPI_CAPTURE_DATA) || (h->magic != WPI_CAPTURE_MAGIC) ||
+      ((uint64_t)st.st_size < WPI_CAPTURE_DATA + (uint64_t)h->records * sizeof (*r)))
+  {
+    fprintf (stderr, "%s: capture: %s isn't a capture file\n", argv [0], file) ;
+    exit (1) ;
+  }
+
+  r     = (struct wpiCaptureRecordStruct *)((char *)h + WPI_CAPTURE_DATA) ;
+  n     = (h->head < h->records) ? h->head : h->records ;
+  first = h->head - n ;
+
+  printf ("$comment wiringPi capture: %llu samples, %llu records%s $end\n",
+	(unsigned long long)h->samples, (unsigned long long)h->head, (h->head > n) ? " (wrapped)" : "") ;
+  printf ("$timescale 1ns $end\n$scope module gpio $end\n") ;
+  for (bit = 0 ; bit < 32 ; ++bit)
+    if ((h->mask & (1u << bit)) != 0)
+      printf ("$var wire 1 %c gpio%d $end\n", '!' + bit, bit) ;
+  printf ("$upscope $end\n$enddefinitions $end\n") ;
+
+  for (t = 0, levels = 0, i = 0 ; i < n ; ++i)
+  {
+    if (i == 0)
+      changed = h->mask ;
+    else
+    {
+      t      += r [(first + i) % h->records].deltaNs ;
+      changed = r [(first + i) % h->records].levels ^ levels ;
+      if (changed == 0)
+	continue ;
+    }
+
+    levels = r [(first + i) % h->records].levels ;
+    printf ("#%llu\n", (unsigned long long)t) ;
+    if ((h->trigger != WPI_CAPTURE_NONE) && (first + i == h->trigger))
+      printf ("$comment trigger $end\n") ;
+    for (bit = 0 ; bit < 32 ; ++bit)
+      if ((changed & (1u << bit)) != 0)
+	printf ("%d%c\n", (levels >> bit) & 1, '!' + bit) ;
+  }
+
+  if (h->endNs > h->baseNs)
+    printf ("#%llu\n", (unsigned long long)(h->endNs - h->baseNs)) ;
+
+  munmap (h, st.st_size) ;
+}
+
+void doCapture (int argc, char *argv [])
+{
+  struct wpiCaptureHeaderStruct *h ;
+  wpiPin_t     handle ;
+  unsigned int records = 1000000, ms = 0, post = 0, mask = 0, trigMask = 0, trigValue = 0 ;
+  unsigned int cpuMask = 0, waited ;
+  int          i, pin, level, fd ;
+  const char  *file ;
+
+  if ((argc == 4) && (strcmp (argv [2], "-e") == 0))
+  {
+    captureVcd (argv, argv [3]) ;
+    return ;
+  }
+
+  for (i = 2 ; (i < argc) && (argv [i][0] == '-') ; ++i)
+  {
+    /**/ if ((strcmp (argv [i], "-n") == 0) && (i + 1 < argc))
+      records = (unsigned int)atoi (argv [++i]) ;
+    else if ((strcmp (argv [i], "-t") == 0) && (i + 1 < argc))
+      ms = (unsigned int)atoi (argv [++i]) ;
+    else if ((strcmp (argv [i], "-a") == 0) && (i + 1 < argc))
+      post = (unsigned int)atoi (argv [++i]) ;
+    else if ((strcmp (argv [i], "-c") == 0) && (i + 1 < argc))
+      cpuMask |= 1u << atoi (argv [++i]) ;
+    else if ((strcmp (argv [i], "-x") == 0) && (i + 1 < argc) && (sscanf (argv [i + 1], "%d:%d", &pin, &level) == 2))
+    {
+      ++i ;
+      if (((handle = wiringPiPinOpen (pin)) == NULL) || (handle->gpio < 0) || (handle->gpio > 31))
+      {
+	fprintf (stderr, "%s: capture: Can't trigger on pin %d\n", argv [0], pin) ;
+	exit (1) ;
+      }
+      trigMask |= handle->mask ;
+      if (level)
+	trigValue |= handle->mask ;
+      wiringPiPinClose (handle) ;
+    }
+    else
+      break ;
+  }
+
+  if (i + 2 > argc)
+  {
+    fprintf (stderr, "Usage: %s capture [-n records] [-t ms] [-x pin:level] ... [-a records] [-c cpu] <file> <pin> ...\n", argv [0]) ;
+    fprintf (stderr, "       %s capture -e <file>\n", argv [0]) ;
+    exit (1) ;
+  }
+
+  file = argv [i++] ;
+
+// Only the on-board GPIO can be sampled at the register
+
+  for (; i < argc ; ++i)
+  {
+    pin = atoi (argv [i]) ;
+    if (((handle = wiringPiPinOpen (pin)) == NULL) || (handle->gpio < 0) || (handle->gpio > 31))
+    {
+      fprintf (stderr, "%s: capture: Pin %d isn't an on-board GPIO\n", argv [0], pin) ;
+      exit (1) ;
     }
+    mask |= handle->mask ;
+    wiringPiPinClose (handle) ;
+  }
 
-    if ((l = read (fd, buf, 16)) == 0)
-      sprintf (buf, "%s", "?") ;
+  captureTrigger (trigMask & mask, trigValue, post) ;
 
-    buf [l] = 0 ;
-    if ((buf [strlen (buf) - 1]) == '\n')
-      buf [strlen (buf) - 1] = 0 ;
+  if (captureStart (file, records, mask, cpuMask) < 0)
+  {
+    fprintf (stderr, "%s: capture: Unable to start: %s\n", argv [0], strerror (errno)) ;
+    exit (1) ;
+  }
 
-    printf ("  %s", buf) ;
+  signal (SIGINT,  captureSignal) ;
+  signal (SIGTERM, captureSignal) ;
 
-// Read any edge trigger file
+  for (waited = 0 ; !captureWait (100) && !captureInterrupted ; )
+    if ((ms != 0) && ((waited += 100) >= ms))
+      break ;
 
-    sprintf (fName, "/sys/class/gpio/gpio%d/edge", i) ;
-    if ((fd = open (fName, O_RDONLY)) == -1)
-    {
-      printf ("\n") ;
-      continue ;
-    }
+  captureStop () ;
 
-    if ((l = read (fd, buf, 16)) == 0)
-      sprintf (buf, "%s", "?") ;
+// Summary
 
-    buf [l] = 0 ;
-    if ((buf [strlen (buf) - 1]) == '\n')
-      buf [strlen (buf) - 1] = 0 ;
+  if ((fd = open (file, O_RDONLY)) < 0)
+    return ;
 
-    printf ("  %-8s\n", buf) ;
+  h = (struct wpiCaptureHeaderStruct *)mmap (NULL, WPI_CAPTURE_DATA, PROT_READ, MAP_SHARED, fd, 0) ;
+  close (fd) ;
+  if (h == MAP_FAILED)
+    return ;
 
-    close (fd) ;
-  }
+  fprintf (stderr, "%llu samples in %.3f s (%.1f MHz), %llu changes",
+	(unsigned long long)h->samples, (double)(h->endNs - h->startNs) / 1e9,
+	(double)h->samples / ((double)(h->endNs - h->startNs) / 1e3), (unsigned long long)h->head) ;
+  if (h->head > h->records)
+    fprintf (stderr, ", the last %u kept", h->records) ;
+  if (trigMask != 0)
+    fprintf (stderr, (h->trigger == WPI_CAPTURE_NONE) ? ", not triggered" : ", triggered") ;
+  fprintf (stderr, "\n") ;
+
+  munmap (h, WPI_CAPTURE_DATA) ;
 }
 
 
 /*
- * doExport:
- *	gpio export pin mode
- *	This uses the /sys/class/gpio device interface.
+ * doLog:
+ *	gpio log [-f secs] [-t secs] <dir|file>
+ *	Print the records of a wiringPiLog segment file, or of all of them in
+ *	a directory in order, one per line as seconds.nanoseconds and the
+ *	values. -f and -t limit it to the records between those times (on
+ *	the clock the program logged with); the index gets to the first.
  *********************************************************************************
  */
 
-void doExport (int argc, char *argv [])
+static int logCompare (const void *a, const void *b)
 {
-  FILE *fd ;
-  int pin ;
-  char *mode ;
-  char fName [128] ;
-
-  if (argc != 4)
-  {
-    fprintf (stderr, "Usage: %s export pin mode\n", argv [0]) ;
-    exit (1) ;
-  }
+  unsigned long long sa = *(const unsigned long long *)a ;
+  unsigned long long sb = *(const unsigned long long *)b ;
 
-  pin = atoi (argv [2]) ;
+  return (sa < sb) ? -1 : (sa > sb) ? 1 : 0 ;
+}
 
-  mode = argv [3] ;
+static void logShow (char *argv [], const char *file, unsigned long long fromNs, unsigned long long toNs)
+{
+  struct wpiLogHeaderStruct *h ;
+  struct wpiLogRecordStruct *r ;
+  struct stat st ;
+  uint64_t i, count ;
+  uint32_t v, slot ;
+  int fd ;
 
-  if ((fd = fopen ("/sys/class/gpio/export", "w")) == NULL)
+  if ((fd = open (file, O_RDONLY)) < 0)
   {
-    fprintf (stderr, "%s: Unable to open GPIO export interface: %s\n", argv [0], strerror (errno)) ;
-    exit (1) ;
+    fprintf (stderr, "%s: log: Unable to open %s: %s\n", argv [0], file, strerror (errno)) ;
+    return ;
   }
 
-  fprintf (fd, "%d\n", pin) ;
-  fclose (fd) ;
+  if ((fstat (fd, &st) < 0) || (st.st_size < WPI_LOG_DATA))
+    h = MAP_FAILED ;
+  else
+    h = (struct wpiLogHeaderStruct *)mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0) ;
+  close (fd) ;
 
-  sprintf (fName, "/sys/class/gpio/gpio%d/direction", pin) ;
-  if ((fd = fopen (fName, "w")) == NULL)
+  if ((h == MAP_FAILED) || (h->magic != WPI_LOG_MAGIC) || (h->indexStride == 0) ||
+      (h->numValues > WPI_LOG_MAX_VALUES) || (h->recordSize < sizeof (*r) + h->numValues * sizeof (int32_t)))
   {
-    fprintf (stderr, "%s: Unable to open GPIO direction interface for pin %d: %s\n", argv [0], pin, strerror (errno)) ;
-    exit (1) ;
+    fprintf (stderr, "%s: log: %s isn't a log segment\n", argv [0], file) ;
+    if (h != MAP_FAILED)
+      munmap (h, st.st_size) ;
+    return ;
   }
 
-  /**/ if ((strcasecmp (mode, "in")   == 0) || (strcasecmp (mode, "input")  == 0))
-    fprintf (fd, "in\n") ;
-  else if ((strcasecmp (mode, "out")  == 0) || (strcasecmp (mode, "output") == 0))
-    fprintf (fd, "out\n") ;
-  else if ((strcasecmp (mode, "high") == 0) || (strcasecmp (mode, "up")     == 0))
-    fprintf (fd, "high\n") ;
-  else if ((strcasecmp (mode, "low")  == 0) || (strcasecmp (mode, "down")   == 0))
-    fprintf (fd, "low\n") ;
-  else
+// Only what's been finished, and what's in the file
+
+  count = __atomic_load_n (&h->count, __ATOMIC_ACQUIRE) ;
+  if (count > ((uint64_t)st.st_size - WPI_LOG_DATA) / h->recordSize)
+    count = ((uint64_t)st.st_size - WPI_LOG_DATA) / h->recordSize ;
+
+  if ((count == 0) || (h->lastNs < fromNs) || (h->firstNs > toNs))
   {
-    fprintf (stderr, "%s: Invalid mode: %s. Should be in, out, high or low\n", argv [1], mode) ;
-    exit (1) ;
+    munmap (h, st.st_size) ;
+    return ;
   }
 
-  fclose (fd) ;
+// Skip the index slots that are all before the start
 
-// Change ownership so the current user can actually use it
+  for (slot = 0 ; ((slot + 1) * (uint64_t)h->indexStride < count) && (slot + 1 < WPI_LOG_INDEX) && (h->index [slot + 1] < fromNs) ; ++slot)
+    ;
 
-  sprintf (fName, "/sys/class/gpio/gpio%d/value", pin) ;
-  changeOwner (argv [0], fName) ;
+  for (i = (uint64_t)slot * h->indexStride ; i < count ; ++i)
+  {
+    r = (struct wpiLogRecordStruct *)((char *)h + WPI_LOG_DATA + i * h->recordSize) ;
+    if (r->timeNs < fromNs)
+      continue ;
+    if (r->timeNs > toNs)
+      break ;
 
-  sprintf (fName, "/sys/class/gpio/gpio%d/edge", pin) ;
-  changeOwner (argv [0], fName) ;
+    printf ("%llu.%09llu", (unsigned long long)r->timeNs / 1000000000ULL, (unsigned long long)r->timeNs % 1000000000ULL) ;
+    for (v = 0 ; v < h->numValues ; ++v)
+      printf (" %d", r->values [v]) ;
+    printf ("\n") ;
+  }
 
+  munmap (h, st.st_size) ;
 }
 
-
-/*
- * doWfi:
- *	gpio wfi pin mode
- *	Wait for Interrupt on a given pin.
- *	Slight cheat here - it's easier to actually use ISR now (which calls
- *	gpio to set the pin modes!) then we simply sleep, and expect the thread
- *	to exit the program. Crude but effective.
- *********************************************************************************
- */
-
-static void wfi (void)
-  { exit (0) ; }
-
-void doWfi (int argc, char *argv [])
+void doLog (int argc, char *argv [])
 {
-  int pin, mode ;
+  unsigned long long fromNs = 0, toNs = ~0ULL ;
+  unsigned long long *sequences = NULL ;
+  char name [PATH_MAX] ;
+  struct dirent *d ;
+  struct stat st ;
+  DIR *dir ;
+  int i, n = 0 ;
+
+  while ((argc > 3) && ((strcmp (argv [2], "-f") == 0) || (strcmp (argv [2], "-t") == 0)))
+  {
+    if (argv [2][1] == 'f')
+      fromNs = (unsigned long long)(atof (argv [3]) * 1e9) ;
+    else
+      toNs   = (unsigned long long)(atof (argv [3]) * 1e9) ;
+    for (i = 4 ; i < argc ; ++i)
+      argv [i - 2] = argv [i] ;
+    argc -= 2 ;
+  }
 
-  if (argc != 4)
+  if (argc != 3)
   {
-    fprintf (stderr, "Usage: %s wfi pin mode\n", argv [0]) ;
+    fprintf (stderr, "Usage: %s log [-f secs] [-t secs] <dir|file>\n", argv [0]) ;
     exit (1) ;
   }
 
-  pin  = atoi (argv [2]) ;
+  if ((stat (argv [2], &st) < 0) || !S_ISDIR (st.st_mode))
+  {
+    logShow (argv, argv [2], fromNs, toNs) ;
+    return ;
+  }
 
-  /**/ if (strcasecmp (argv [3], "rising")  == 0) mode = INT_EDGE_RISING ;
-  else if (strcasecmp (argv [3], "falling") == 0) mode = INT_EDGE_FALLING ;
-  else if (strcasecmp (argv [3], "both")    == 0) mode = INT_EDGE_BOTH ;
-  else
+  if ((dir = opendir (argv [2])) == NULL)
   {
-    fprintf (stderr, "%s: wfi: Invalid mode: %s. Should be rising, falling or both\n", argv [1], argv [3]) ;
+    fprintf (stderr, "%s: log: Unable to read %s: %s\n", argv [0], argv [2], strerror (errno)) ;
     exit (1) ;
   }
 
-  if (wiringPiISR (pin, mode, &wfi) < 0)
+  while ((d = readdir (dir)) != NULL)
   {
-    fprintf (stderr, "%s: wfi: Unable to setup ISR: %s\n", argv [1], strerror (errno)) ;
-    exit (1) ;
+    if ((n % 64) == 0)
+      if ((sequences = realloc (sequences, (n + 64) * sizeof (*sequences))) == NULL)
+      {
+	fprintf (stderr, "%s: log: Out of memory\n", argv [0]) ;
+	exit (1) ;
+      }
+    if (sscanf (d->d_name, WPI_LOG_SCAN, &sequences [n]) == 1)
+      ++n ;
   }
+  closedir (dir) ;
 
-  for (;;)
-    delay (9999) ;
-}
+  qsort (sequences, n, sizeof (*sequences), logCompare) ;
+
+  for (i = 0 ; i < n ; ++i)
+  {
+    snprintf (name, sizeof (name), "%s/" WPI_LOG_NAME, argv [2], sequences [i]) ;
+    logShow (argv, name, fromNs, toNs) ;
+  }
 
+  free (sequences) ;
+}
 
 
 /*
@@ -1151,16 +2281,19 @@ void doPwmTone (int argc, char *argv [])
 /*
  * doClock:
  *	Output a clock on a pin
+ *	gpio clock <pin> <freq> [osc|plld|pllc|any [mash]]
+ *	With a source it says what was actually achieved.
  *********************************************************************************
  */
 
 void doClock (int argc, char *argv [])
 {
-  int pin, freq ;
+  int pin, freq, source, mash = WPI_CLOCK_MASH_AUTO ;
+  double got ;
 
-  if (argc != 4)
+  if ((argc < 4) || (argc > 6))
   {
-    fprintf (stderr, "Usage: %s clock <pin> <freq>\n", argv [0]) ;
+    fprintf (stderr, "Usage: %s clock <pin> <freq> [osc|plld|pllc|any [mash]]\n", argv [0]) ;
     exit (1) ;
   }
 
@@ -1168,7 +2301,32 @@ void doClock (int argc, char *argv [])
 
   freq = atoi (argv [3]) ;
 
-  gpioClockSet (pin, freq) ;
+  if (argc == 4)
+  {
+    gpioClockSet (pin, freq) ;
+    return ;
+  }
+
+  /**/ if (strcasecmp (argv [4], "osc")  == 0) source = WPI_CLOCK_OSC ;
+  else if (strcasecmp (argv [4], "plld") == 0) source = WPI_CLOCK_PLLD ;
+  else if (strcasecmp (argv [4], "pllc") == 0) source = WPI_CLOCK_PLLC ;
+  else if (strcasecmp (argv [4], "any")  == 0) source = WPI_CLOCK_ANY ;
+  else
+  {
+    fprintf (stderr, "%s: clock: Unknown source: %s\n", argv [0], argv [4]) ;
+    exit (1) ;
+  }
+
+  if (argc == 6)
+    mash = atoi (argv [5]) ;
+
+  if ((got = gpioClockSetFreq (pin, (double)freq, source, mash)) < 0.0)
+  {
+    fprintf (stderr, "%s: clock: Unable to make %dHz on pin %d\n", argv [0], freq, pin) ;
+    exit (1) ;
+  }
+
+  printf ("%.3f\n", got) ;
 }
 
 
@@ -1198,22 +2356,29 @@ void doPwm (int argc, char *argv [])
 
 /*
  * doPwmMode: doPwmRange: doPwmClock:
- *	Change the PWM mode, range and clock divider values
+ *	Change the PWM mode, range and clock divider values - for all
+ *	channels, or just one when given
  *********************************************************************************
  */
 
-static void doPwmMode (int mode)
+static void doPwmMode (int argc, char *argv [], int mode)
 {
-  pwmSetMode (mode) ;
+  if (argc == 2)
+    pwmSetMode (mode) ;
+  else if (pwmSetModeCh (atoi (argv [2]), mode) < 0)
+  {
+    fprintf (stderr, "%s: Invalid PWM channel: %s\n", argv [0], argv [2]) ;
+    exit (1) ;
+  }
 }
 
 static void doPwmRange (int argc, char *argv [])
 {
   unsigned int range ;
 
-  if (argc != 3)
+  if ((argc != 3) && (argc != 4))
   {
-    fprintf (stderr, "Usage: %s pwmr <range>\n", argv [0]) ;
+    fprintf (stderr, "Usage: %s pwmr <range> [channel]\n", argv [0]) ;
     exit (1) ;
   }
 
@@ -1225,7 +2390,13 @@ static void doPwmRange (int argc, char *argv [])
     exit (1) ;
   }
 
-  pwmSetRange (range) ;
+  if (argc == 3)
+    pwmSetRange (range) ;
+  else if (pwmSetRangeCh (atoi (argv [3]), range) < 0)
+  {
+    fprintf (stderr, "%s: Invalid PWM channel: %s\n", argv [0], argv [3]) ;
+    exit (1) ;
+  }
 }
 
 static void doPwmClock (int argc, char *argv [])
@@ -1300,6 +2471,133 @@ static void doVersion (char *argv [])
 }
 
 
+/*
+ * doCommand:
+ *	Run a single command once wiringPi has been set up.
+ *	Returns FALSE if we don't know it.
+ *********************************************************************************
+ */
+
+static int doCommand (int argc, char *argv [])
+{
+// Core wiringPi functions
+
+  /**/ if (strcasecmp (argv [1], "mode"   ) == 0) doMode      (argc, argv) ;
+  else if (strcasecmp (argv [1], "read"   ) == 0) doRead      (argc, argv) ;
+  else if (strcasecmp (argv [1], "write"  ) == 0) doWrite     (argc, argv) ;
+  else if (strcasecmp (argv [1], "pwm"    ) == 0) doPwm       (argc, argv) ;
+  else if (strcasecmp (argv [1], "awrite" ) == 0) doAwrite    (argc, argv) ;
+  else if (strcasecmp (argv [1], "aread"  ) == 0) doAread     (argc, argv) ;
+
+// GPIO Nicies
+
+  else if (strcasecmp (argv [1], "toggle" ) == 0) doToggle    (argc, argv) ;
+  else if (strcasecmp (argv [1], "blink"  ) == 0) doBlink     (argc, argv) ;
+
+// Pi Specifics
+
+  else if (strcasecmp (argv [1], "pwm-bal"  ) == 0) doPwmMode    (argc, argv, PWM_MODE_BAL) ;
+  else if (strcasecmp (argv [1], "pwm-ms"   ) == 0) doPwmMode    (argc, argv, PWM_MODE_MS) ;
+  else if (strcasecmp (argv [1], "pwmr"     ) == 0) doPwmRange   (argc, argv) ;
+  else if (strcasecmp (argv [1], "pwmc"     ) == 0) doPwmClock   (argc, argv) ;
+  else if (strcasecmp (argv [1], "pwmTone"  ) == 0) doPwmTone    (argc, argv) ;
+  else if (strcasecmp (argv [1], "drive"    ) == 0) doPadDrive   (argc, argv) ;
+  else if (strcasecmp (argv [1], "readall"  ) == 0) doReadall    () ;
+  else if (strcasecmp (argv [1], "nreadall" ) == 0) doReadall    () ;
+  else if (strcasecmp (argv [1], "pins"     ) == 0) doReadall    () ;
+  else if (strcasecmp (argv [1], "qmode"    ) == 0) doQmode      (argc, argv) ;
+  else if (strcasecmp (argv [1], "i2cdetect") == 0) doI2Cdetect  (argc, argv) ;
+  else if (strcasecmp (argv [1], "i2cd"     ) == 0) doI2Cdetect  (argc, argv) ;
+  else if (strcasecmp (argv [1], "reset"    ) == 0) doReset      (argv [0]) ;
+  else if (strcasecmp (argv [1], "wb"       ) == 0) doWriteByte  (argc, argv) ;
+  else if (strcasecmp (argv [1], "rbx"      ) == 0) doReadByte   (argc, argv, TRUE) ;
+  else if (strcasecmp (argv [1], "rbd"      ) == 0) doReadByte   (argc, argv, FALSE) ;
+  else if (strcasecmp (argv [1], "clock"    ) == 0) doClock      (argc, argv) ;
+  else if (strcasecmp (argv [1], "wfi"      ) == 0) doWfi        (argc, argv) ;
+  else if (strcasecmp (argv [1], "monitor"  ) == 0) doMonitor    (argc, argv) ;
+  else if (strcasecmp (argv [1], "bench"    ) == 0) doBench      (argc, argv) ;
+  else if (strcasecmp (argv [1], "stats"    ) == 0) doStats      (argc, argv) ;
+  else if (strcasecmp (argv [1], "busstat"  ) == 0) doBusStat    (argc, argv) ;
+  else if (strcasecmp (argv [1], "top"      ) == 0) doTop        (argc, argv) ;
+  else if (strcasecmp (argv [1], "flight"   ) == 0) doFlight     (argc, argv) ;
+  else if (strcasecmp (argv [1], "capture"  ) == 0) doCapture    (argc, argv) ;
+  else if (strcasecmp (argv [1], "log"      ) == 0) doLog        (argc, argv) ;
+
+// The ones main () handles before setting up, but are fine after
+
+  else if (strcasecmp (argv [1], "exports"  ) == 0) doExports    (argc, argv) ;
+  else if (strcasecmp (argv [1], "export"   ) == 0) doExport     (argc, argv) ;
+  else if (strcasecmp (argv [1], "edge"     ) == 0) doEdge       (argc, argv) ;
+  else if (strcasecmp (argv [1], "unexport" ) == 0) doUnexport   (argc, argv) ;
+  else if (strcasecmp (argv [1], "load"     ) == 0) doLoad       (argc, argv) ;
+  else if (strcasecmp (argv [1], "unload"   ) == 0) doUnLoad     (argc, argv) ;
+  else if (strcasecmp (argv [1], "usbp"     ) == 0) doUsbP       (argc, argv) ;
+  else if (strcasecmp (argv [1], "gbr"      ) == 0) doGbr        (argc, argv) ;
+  else if (strcasecmp (argv [1], "gbw"      ) == 0) doGbw        (argc, argv) ;
+  else
+    return FALSE ;
+
+  return TRUE ;
+}
+
+
+/*
+ * doBatch:
+ *	gpio -b [file]
+ *	Run commands, one per line, from the file or stdin, so the setup and
+ *	board detection is only done once rather than for every command.
+ *	Blank lines and anything after a # are ignored. Any error stops it.
+ *********************************************************************************
+ */
+
+#define	MAX_BATCH_ARGS	64
+
+static void doBatch (char *progName, const char *fileName)
+{
+  FILE *fd ;
+  char  line [1024] ;
+  char *argv [MAX_BATCH_ARGS + 1] ;
+  char *p ;
+  int   argc, lineNo = 0 ;
+
+  /**/ if ((fileName == NULL) || (strcmp (fileName, "-") == 0))
+    fd = stdin ;
+  else if ((fd = fopen (fileName, "r")) == NULL)
+  {
+    fprintf (stderr, "%s: Unable to open %s: %s\n", progName, fileName, strerror (errno)) ;
+    exit (EXIT_FAILURE) ;
+  }
+
+  while (fgets (line, sizeof (line), fd) != NULL)
+  {
+    ++lineNo ;
+
+    if ((p = strchr (line, '#')) != NULL)
+      *p = 0 ;
+
+    argv [0] = progName ;
+    argc     = 1 ;
+    for (p = strtok (line, " \t\r\n") ; (p != NULL) && (argc < MAX_BATCH_ARGS) ; p = strtok (NULL, " \t\r\n"))
+      argv [argc++] = p ;
+    argv [argc] = NULL ;
+
+    if (argc == 1)
+      continue ;
+
+    if (!doCommand (argc, argv))
+    {
+      fprintf (stderr, "%s: line %d: Unknown command: %s.\n", progName, lineNo, argv [1]) ;
+      exit (EXIT_FAILURE) ;
+    }
+
+    fflush (stdout) ;
+  }
+
+  if (fd != stdin)
+    fclose (fd) ;
+}
+
+
 /*
  * main:
  *	Start here
@@ -1464,18 +2762,27 @@ int main (int argc, char *argv [])
 
 // Check for -x argument to load in a new extension
 //	-x extension:base:args
+//	or -f for a file full of them
 //	Can load many modules, but unless daemon mode we can only send one
 //	command at a time.
 
-  while (strcasecmp (argv [1], "-x") == 0)
+  while ((strcasecmp (argv [1], "-x") == 0) || (strcmp (argv [1], "-f") == 0))
   {
     if (argc < 3)
     {
-      fprintf (stderr, "%s: -x missing extension command.\n", argv [0]) ;
+      fprintf (stderr, "%s: %s missing extension %s.\n", argv [0], argv [1], (argv [1][1] == 'f') ? "file" : "command") ;
       exit (EXIT_FAILURE) ;
     }
 
-    if (!loadWPiExtension (argv [0], argv [2], TRUE))
+    if (argv [1][1] == 'f')
+    {
+      if (!wiringPiLoadConfig (argv [0], argv [2], TRUE))
+      {
+	fprintf (stderr, "%s: Extension file %s failed to load\n", argv [0], argv [2]) ;
+	exit (EXIT_FAILURE) ;
+      }
+    }
+    else if (!loadWPiExtension (argv [0], argv [2], TRUE))
     {
       fprintf (stderr, "%s: Extension load failed: %s\n", argv [0], strerror (errno)) ;
       exit (EXIT_FAILURE) ;
@@ -1494,41 +2801,15 @@ int main (int argc, char *argv [])
     exit (EXIT_FAILURE) ;
   }
 
-// Core wiringPi functions
-
-  /**/ if (strcasecmp (argv [1], "mode"   ) == 0) doMode      (argc, argv) ;
-  else if (strcasecmp (argv [1], "read"   ) == 0) doRead      (argc, argv) ;
-  else if (strcasecmp (argv [1], "write"  ) == 0) doWrite     (argc, argv) ;
-  else if (strcasecmp (argv [1], "pwm"    ) == 0) doPwm       (argc, argv) ;
-  else if (strcasecmp (argv [1], "awrite" ) == 0) doAwrite    (argc, argv) ;
-  else if (strcasecmp (argv [1], "aread"  ) == 0) doAread     (argc, argv) ;
-
-// GPIO Nicies
+// Check for -b: batch mode - everything else comes from a file or stdin
 
-  else if (strcasecmp (argv [1], "toggle" ) == 0) doToggle    (argc, argv) ;
-  else if (strcasecmp (argv [1], "blink"  ) == 0) doBlink     (argc, argv) ;
-
-// Pi Specifics
+  if (strcasecmp (argv [1], "-b") == 0)
+  {
+    doBatch (argv [0], (argc > 2) ? argv [2] : NULL) ;
+    return 0 ;
+  }
 
-  else if (strcasecmp (argv [1], "pwm-bal"  ) == 0) doPwmMode    (PWM_MODE_BAL) ;
-  else if (strcasecmp (argv [1], "pwm-ms"   ) == 0) doPwmMode    (PWM_MODE_MS) ;
-  else if (strcasecmp (argv [1], "pwmr"     ) == 0) doPwmRange   (argc, argv) ;
-  else if (strcasecmp (argv [1], "pwmc"     ) == 0) doPwmClock   (argc, argv) ;
-  else if (strcasecmp (argv [1], "pwmTone"  ) == 0) doPwmTone    (argc, argv) ;
-  else if (strcasecmp (argv [1], "drive"    ) == 0) doPadDrive   (argc, argv) ;
-  else if (strcasecmp (argv [1], "readall"  ) == 0) doReadall    () ;
-  else if (strcasecmp (argv [1], "nreadall" ) == 0) doReadall    () ;
-  else if (strcasecmp (argv [1], "pins"     ) == 0) doReadall    () ;
-  else if (strcasecmp (argv [1], "qmode"    ) == 0) doQmode      (argc, argv) ;
-  else if (strcasecmp (argv [1], "i2cdetect") == 0) doI2Cdetect  (argc, argv) ;
-  else if (strcasecmp (argv [1], "i2cd"     ) == 0) doI2Cdetect  (argc, argv) ;
-  else if (strcasecmp (argv [1], "reset"    ) == 0) doReset      (argv [0]) ;
-  else if (strcasecmp (argv [1], "wb"       ) == 0) doWriteByte  (argc, argv) ;
-  else if (strcasecmp (argv [1], "rbx"      ) == 0) doReadByte   (argc, argv, TRUE) ;
-  else if (strcasecmp (argv [1], "rbd"      ) == 0) doReadByte   (argc, argv, FALSE) ;
-  else if (strcasecmp (argv [1], "clock"    ) == 0) doClock      (argc, argv) ;
-  else if (strcasecmp (argv [1], "wfi"      ) == 0) doWfi        (argc, argv) ;
-  else
+  if (!doCommand (argc, argv))
   {
     fprintf (stderr, "%s: Unknown command: %s.\n", argv [0], argv [1]) ;
     exit (EXIT_FAILURE) ;
@@ -148,6 +148,34 @@ static char *physNames [64] =
 } ;
 
 
+/*
+ * pinAlt: pinValue:
+ *	Mode and value of a pin, from one snapshot of the registers taken for
+ *	the whole table where we can, so it's all from the same instant.
+ *	pin is in the current mode, bcm the BCM_GPIO number or -1.
+ *********************************************************************************
+ */
+
+static struct wpiStateStruct state ;
+static int haveState = FALSE ;
+
+static int pinAlt (int pin, int bcm)
+{
+  if (haveState && (bcm >= 0))
+    return (state.fsel [bcm / 10] >> ((bcm % 10) * 3)) & 7 ;
+
+  return getAlt (pin) ;
+}
+
+static int pinValue (int pin, int bcm)
+{
+  if (haveState && (bcm >= 0))
+    return ((state.level [bcm >> 5] >> (bcm & 31)) & 1) ? HIGH : LOW ;
+
+  return digitalRead (pin) ;
+}
+
+
 /*
  * readallPhys:
  *	Given a physical pin output the data on it and the next pin:
@@ -177,8 +205,8 @@ static void readallPhys (int physPin)
     else
       pin = physToWpi [physPin] ;
 
-    printf (" | %4s", alts [getAlt (pin)]) ;
-    printf (" | %d", digitalRead (pin)) ;
+    printf (" | %4s", alts [pinAlt (pin, physPinToGpio (physPin))]) ;
+    printf (" | %d", pinValue (pin, physPinToGpio (physPin))) ;
   }
 
 // Pin numbers:
@@ -200,8 +228,8 @@ static void readallPhys (int physPin)
     else
       pin = physToWpi [physPin] ;
 
-    printf (" | %d", digitalRead (pin)) ;
-    printf (" | %-4s", alts [getAlt (pin)]) ;
+    printf (" | %d", pinValue (pin, physPinToGpio (physPin))) ;
+    printf (" | %-4s", alts [pinAlt (pin, physPinToGpio (physPin))]) ;
   }
 
   printf (" | %-5s", physNames [physPin]) ;
@@ -224,7 +252,7 @@ static void readallPhys (int physPin)
 
 static void allReadall (void)
 {
-  int pin ;
+  int pin, bcm ;
 
   printf ("+-----+------+-------+      +-----+------+-------+\n") ;
   printf ("| Pin | Mode | Value |      | Pin | Mode | Value |\n") ;
@@ -232,13 +260,15 @@ static void allReadall (void)
 
   for (pin = 0 ; pin < 27 ; ++pin)
   {
+    bcm = (wpMode == WPI_MODE_GPIO) ? pin : -1 ;
+
     printf ("| %3d ", pin) ;
-    printf ("| %-4s ", alts [getAlt (pin)]) ;
-    printf ("| %s  ", digitalRead (pin) == HIGH ? "High" : "Low ") ;
+    printf ("| %-4s ", alts [pinAlt (pin, bcm)]) ;
+    printf ("| %s  ", pinValue (pin, bcm) == HIGH ? "High" : "Low ") ;
     printf ("|      ") ;
     printf ("| %3d ", pin + 27) ;
-    printf ("| %-4s ", alts [getAlt (pin + 27)]) ;
-    printf ("| %s  ", digitalRead (pin + 27) == HIGH ? "High" : "Low ") ;
+    printf ("| %-4s ", alts [pinAlt (pin + 27, (bcm < 0) ? -1 : bcm + 27)]) ;
+    printf ("| %s  ", pinValue (pin + 27, (bcm < 0) ? -1 : bcm + 27) == HIGH ? "High" : "Low ") ;
     printf ("|\n") ;
   }
 
@@ -311,6 +341,10 @@ static void plus2header (int model)
     printf (" +-----+-----+---------+------+---+---Pi 3A+-+---+------+---------+-----+-----+\n") ;
   else if (model == PI_MODEL_4B)
     printf (" +-----+-----+---------+------+---+---Pi 4B--+---+------+---------+-----+-----+\n") ;
+  else if (model == PI_MODEL_5)
+    printf (" +-----+-----+---------+------+---+---Pi 5---+---+------+---------+-----+-----+\n") ;
+  else if (model == PI_MODEL_500)
+    printf (" +-----+-----+---------+------+---+--Pi 500--+---+------+---------+-----+-----+\n") ;
   else
     printf (" +-----+-----+---------+------+---+---Pi ?---+---+------+---------+-----+-----+\n") ;
 }
@@ -352,6 +386,8 @@ void doReadall (void)
 
   piBoardId (&model, &rev, &mem, &maker, &overVolted) ;
 
+  haveState = (wiringPiSnapshot (&state) == 0) ;
+
   /**/ if ((model == PI_MODEL_A) || (model == PI_MODEL_B))
     abReadall (model, rev) ;
   else if ((model == PI_MODEL_BP) || (model == PI_MODEL_AP) ||
@@ -359,9 +395,11 @@ void doReadall (void)
 	(model == PI_MODEL_3AP)  ||
 	(model == PI_MODEL_3B)   || (model == PI_MODEL_3BP) ||
 	(model == PI_MODEL_4B)   ||
+	(model == PI_MODEL_5)    || (model == PI_MODEL_500)  ||
 	(model == PI_MODEL_ZERO) || (model == PI_MODEL_ZERO_W))
     piPlusReadall (model) ;
-  else if ((model == PI_MODEL_CM) || (model == PI_MODEL_CM3) || ((model == PI_MODEL_CM3P)))
+  else if ((model == PI_MODEL_CM) || (model == PI_MODEL_CM3) || ((model == PI_MODEL_CM3P)) ||
+	(model == PI_MODEL_CM5) || (model == PI_MODEL_CM5L))
     allReadall () ;
   else
     printf ("Oops - unable to determine board type... model: %d\n", model) ;
@@ -376,6 +414,7 @@ void doReadall (void)
 
 void doAllReadall (void)
 {
+  haveState = (wiringPiSnapshot (&state) == 0) ;
   allReadall () ;
 }
 
@@ -0,0 +1,700 @@
+/*
+ * adcStream.c:
+ *	Continuous fixed-rate sampling of analog pins
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+/*
+ * Notes:
+ *	A thread reads every configured analog pin once per sample period,
+ *	against absolute deadlines, and puts the results with a timestamp into
+ *	a single producer, single consumer piRing for the program to drain in
+ *	blocks with adcStreamRead.
+ *
+ *	Pins can be on any device node with analogRead, but where two or more
+ *	pins are on the same MCP3002 or MCP300x the whole chip is read with
+ *	its ReadAll function - one SPI transaction for all its channels.
+ *
+ *	The ring is one sample per pin per scan; if it fills up then whole
+ *	scans are dropped and counted by adcStreamOverruns.
+ *
+ *	adcStreamShare () publishes every scan into a named shared memory
+ *	ring as well, for any number of other processes to read at once
+ *	without going near the bus. The producer never waits for them: each
+ *	reader has a cursor of its own (in a slot in the segment, so they can
+ *	be seen), and reads the samples where they lie. head only moves on
+ *	once a scan is complete, and a reader looks at it again when it's
+ *	done with the samples - if the producer has come round the ring and
+ *	over them in the meantime, that's an overrun, and it's told so.
+ *********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "wiringPi.h"
+#include "piThread.h"
+#include "mcp3002.h"
+#include "mcp3004.h"
+#include "adcStream.h"
+
+#define	MAX_ADC_PINS	64
+
+// How each pin is read
+
+#define	READ_SINGLE	0
+#define	READ_MCP3002	1
+#define	READ_MCP3004	2
+
+struct adcPinStruct
+{
+  int pin ;
+  int how ;
+  int pinBase ;
+  int first ;			// TRUE for the first pin of a ReadAll group
+} ;
+
+static struct adcPinStruct adcPins [MAX_ADC_PINS] ;
+static int                 numAdcPins ;
+
+static struct piRingStruct *ring = NULL ;
+static unsigned int         overruns ;
+
+static unsigned long long periodNs ;
+static volatile int       running = FALSE ;
+static pthread_t          adcThread ;
+
+static volatile unsigned int       jitterMax ;
+static volatile unsigned long long jitterSum ;
+static volatile unsigned int       jitterCount ;
+
+// The shared ring: a header, the reader slots, then size samples
+
+#define	ADC_SHM_MAGIC	0x41444331	// "ADC1"
+#define	ADC_SHM_VERSION	1
+#define	ADC_SHM_READERS	16
+
+struct adcShmReaderStruct
+{
+  int32_t  pid ;			// 0 for a free slot
+  uint32_t overruns ;
+  uint64_t cursor ;			// The next sample it'll read
+} ;
+
+struct adcShmStruct
+{
+  uint32_t magic ;			// Set last, once the rest is ready
+  uint32_t version ;
+  uint32_t size ;			// Samples - a power of 2
+  uint32_t sampleSize ;
+  uint32_t numPins ;			// In each scan
+  uint32_t running ;
+  uint32_t changes ;			// Up one every scan - for the futex
+  uint32_t waiters ;
+  uint64_t periodNs ;
+  uint64_t head ;			// Samples ever written
+  struct adcShmReaderStruct readers [ADC_SHM_READERS] ;
+  struct adcSampleStruct    samples [] ;
+} ;
+
+#define	ADC_SHM_SIZE(n)	(sizeof (struct adcShmStruct) + (size_t)(n) * sizeof (struct adcSampleStruct))
+
+struct adcShareStruct
+{
+  struct adcShmStruct *shm ;
+  size_t               mapSize ;
+  int                  slot ;
+  uint64_t             cursor ;
+  unsigned int         overruns ;
+} ;
+
+static struct adcShmStruct *shared = NULL ;
+static size_t               sharedSize ;
+static char                 sharedName [64] ;
+
+
+/*
+ * publish:
+ *	Put a scan in the shared ring and wake anyone waiting for it
+ *********************************************************************************
+ */
+
+static void publish (const struct adcSampleStruct *samples, int n)
+{
+  uint64_t head = shared->head ;
+  uint32_t mask = shared->size - 1 ;
+  int i ;
+
+  for (i = 0 ; i < n ; ++i)
+    shared->samples [(head + i) & mask] = samples [i] ;
+
+  __atomic_store_n (&shared->head, head + n, __ATOMIC_RELEASE) ;
+  __atomic_add_fetch (&shared->changes, 1, __ATOMIC_SEQ_CST) ;
+
+  if (__atomic_load_n (&shared->waiters, __ATOMIC_SEQ_CST) != 0)
+    piFutexWake (&shared->changes, INT32_MAX) ;
+}
+
+
+/*
+ * scan:
+ *	Read all the pins once into the ring
+ *********************************************************************************
+ */
+
+static void scan (void)
+{
+  struct adcSampleStruct samples [MAX_ADC_PINS] ;
+  struct adcSampleStruct *s ;
+  unsigned long long now ;
+  int values [8] ;
+  int i, ok = FALSE ;
+
+  if ((piRingSpace (ring) < (unsigned int)numAdcPins) && (shared == NULL))	// Full, and no-one else wants it
+  {
+    ++overruns ;
+    return ;
+  }
+
+  now = nanos64 () ;
+
+  for (i = 0 ; i < numAdcPins ; ++i)
+  {
+    struct adcPinStruct *p = &adcPins [i] ;
+
+    s = &samples [i] ;
+    s->timestamp = now ;
+    s->pin       = p->pin ;
+
+    if (p->first)
+    {
+      /**/ if (p->how == READ_MCP3004)
+	ok = mcp3004ReadAll (p->pinBase, values) > 0 ;
+      else
+	ok = mcp3002ReadAll (p->pinBase, values) > 0 ;
+    }
+
+    if (p->how != READ_SINGLE)
+      s->value = ok ? values [p->pin - p->pinBase] : -1 ;	// The chip's read failed
+    else
+      s->value = analogRead (p->pin) ;
+  }
+
+  if (shared != NULL)
+    publish (samples, numAdcPins) ;
+
+  if (piRingSpace (ring) < (unsigned int)numAdcPins)
+    ++overruns ;
+  else
+    piRingPush (ring, samples, numAdcPins) ;
+}
+
+
+/*
+ * adcStreamThread:
+ *********************************************************************************
+ */
+
+static void *adcStreamThread (void *arg)
+{
+  unsigned long long next, now ;
+  unsigned int late ;
+
+  (void)arg ;
+
+  piHiPri (60) ;
+
+  next = nanos64 () ;
+
+  while (running)
+  {
+    delayUntilNanos (next) ;
+
+    now  = nanos64 () ;
+    late = (now > next) ? (unsigned int)(now - next) : 0 ;
+    if (late > jitterMax)
+      jitterMax = late ;
+    jitterSum   += late ;
+    jitterCount += 1 ;
+
+    scan () ;
+
+    next += periodNs ;
+    if (next + periodNs < nanos64 ())	// Way behind - re-sync
+      next = nanos64 () ;
+  }
+
+  return NULL ;
+}
+
+
+/*
+ * sortPins:
+ *	Group the pins by how they're read, with the pins on one chip
+ *	together so a scan only reads each chip once. Which chip it is comes
+ *	from how it was set up, not from reading it.
+ *********************************************************************************
+ */
+
+static int sortPins (const int *pins, int numPins)
+{
+  struct wiringPiNodeStruct *node ;
+  int i, j, how ;
+
+  numAdcPins = 0 ;
+
+  for (i = 0 ; i < numPins ; ++i)
+  {
+    if ((node = wiringPiFindNode (pins [i])) == NULL)
+      return -1 ;
+
+    /**/ if (mcp3004Channels (node->pinBase) > 0)
+      how = READ_MCP3004 ;
+    else if (mcp3002Channels (node->pinBase) > 0)
+      how = READ_MCP3002 ;
+    else
+      how = READ_SINGLE ;
+
+// Put it after any other pins on the same chip
+
+    for (j = numAdcPins ; j > 0 ; --j)
+      if ((how != READ_SINGLE) && (adcPins [j - 1].pinBase == node->pinBase))
+	break ;
+    if (j == 0)
+      j = numAdcPins ;
+
+    memmove (&adcPins [j + 1], &adcPins [j], (numAdcPins - j) * sizeof (adcPins [0])) ;
+    adcPins [j].pin     = pins [i] ;
+    adcPins [j].how     = how ;
+    adcPins [j].pinBase = node->pinBase ;
+    adcPins [j].first   = FALSE ;
+    ++numAdcPins ;
+  }
+
+  for (i = 0 ; i < numAdcPins ; ++i)
+    adcPins [i].first = (adcPins [i].how != READ_SINGLE) &&
+	((i == 0) || (adcPins [i - 1].pinBase != adcPins [i].pinBase)) ;
+
+  return 0 ;
+}
+
+
+/*
+ * adcStreamStart:
+ *	Start sampling the given analog pins at sampleRate scans per second
+ *	into a ring of at least ringSize samples (rounded up to a power of 2).
+ *	Returns 0 or -1.
+ *********************************************************************************
+ */
+
+int adcStreamStart (const int *pins, int numPins, int sampleRate, int ringSize)
+{
+  unsigned int size = 16 ;
+
+  if (running || (numPins < 1) || (numPins > MAX_ADC_PINS) || (sampleRate <= 0))
+    return -1 ;
+
+  if (sortPins (pins, numPins) < 0)
+    return -1 ;
+
+  if (ringSize > 16)
+    size = ringSize ;
+  if (size < (unsigned int)numPins * 2)
+    size = numPins * 2 ;
+
+  piRingFree (ring) ;
+  if ((ring = piRingCreate (PI_RING_SPSC, sizeof (struct adcSampleStruct), size, FALSE)) == NULL)
+    return -1 ;
+
+  overruns = 0 ;
+  jitterMax = jitterSum = jitterCount = 0 ;
+  periodNs = 1000000000ULL / sampleRate ;
+
+  if (shared != NULL)
+  {
+    shared->numPins  = numAdcPins ;
+    shared->periodNs = periodNs ;
+    shared->running  = TRUE ;
+  }
+
+  running = TRUE ;
+  if (pthread_create (&adcThread, NULL, adcStreamThread, NULL) != 0)
+  {
+    running = FALSE ;
+    return -1 ;
+  }
+
+  return 0 ;
+}
+
+
+/*
+ * adcStreamRead:
+ *	Take up to maxSamples samples out of the ring, oldest first.
+ *	Doesn't block. Returns the number of samples.
+ *********************************************************************************
+ */
+
+int adcStreamRead (struct adcSampleStruct *samples, int maxSamples)
+{
+  if ((ring == NULL) || (maxSamples <= 0))
+    return 0 ;
+
+  return piRingPop (ring, samples, maxSamples) ;
+}
+
+
+/*
+ * adcStreamOverruns:
+ * adcStreamJitter:
+ *	How many scans have been dropped because the ring was full, and how
+ *	late (in nS) the scans have started since the last call.
+ *********************************************************************************
+ */
+
+unsigned int adcStreamOverruns (void)
+{
+  return overruns ;
+}
+
+int adcStreamJitter (unsigned int *maxNs, unsigned int *meanNs)
+{
+  if (maxNs != NULL)
+    *maxNs = jitterMax ;
+  if (meanNs != NULL)
+    *meanNs = (jitterCount == 0) ? 0 : (unsigned int)(jitterSum / jitterCount) ;
+
+  jitterMax = jitterSum = jitterCount = 0 ;
+
+  return 0 ;
+}
+
+
+/*
+ * adcStreamStop:
+ *********************************************************************************
+ */
+
+void adcStreamStop (void)
+{
+  if (!running)
+    return ;
+
+  running = FALSE ;
+  pthread_join (adcThread, NULL) ;
+
+  if (shared != NULL)
+    shared->running = FALSE ;
+}
+
+
+/*
+ * adcStreamShare:
+ *	Publish the stream in the shared memory ring name as well, of at
+ *	least size samples (rounded up to a power of 2), for adcShareOpen ()
+ *	in other processes. Call it before adcStreamStart (). Any ring of that
+ *	name that's left over is thrown away first; a NULL name stops sharing
+ *	and removes it.
+ *	Returns 0 or -1 with errno set.
+ *********************************************************************************
+ */
+
+int adcStreamShare (const char *name, int size)
+{
+  struct adcShmStruct *shm ;
+  unsigned int n = 16 ;
+  void *ptr ;
+  int fd ;
+
+  if (running)			// Not under the thread's feet
+  {
+    errno = EBUSY ;
+    return -1 ;
+  }
+
+  if (shared != NULL)
+  {
+    munmap (shared, sharedSize) ;
+    shm_unlink (sharedName) ;
+    shared = NULL ;
+  }
+
+  if (name == NULL)
+    return 0 ;
+
+  if (strlen (name) >= sizeof (sharedName))
+  {
+    errno = ENAMETOOLONG ;
+    return -1 ;
+  }
+
+  while ((n < (unsigned int)size) && (n < 0x40000000))
+    n <<= 1 ;
+
+  shm_unlink (name) ;
+  if ((fd = shm_open (name, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0666)) < 0)
+    return -1 ;
+
+  if (ftruncate (fd, ADC_SHM_SIZE (n)) < 0)
+  {
+    close (fd) ;
+    shm_unlink (name) ;
+    return -1 ;
+  }
+
+  ptr = mmap (NULL, ADC_SHM_SIZE (n), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) ;
+  close (fd) ;
+
+  if (ptr == MAP_FAILED)
+  {
+    shm_unlink (name) ;
+    return -1 ;
+  }
+
+// Fault it all in now so the sampling thread never does
+
+  memset (ptr, 0, ADC_SHM_SIZE (n)) ;
+
+  shm             = (struct adcShmStruct *)ptr ;
+  shm->version    = ADC_SHM_VERSION ;
+  shm->size       = n ;
+  shm->sampleSize = sizeof (struct adcSampleStruct) ;
+  __atomic_store_n (&shm->magic, ADC_SHM_MAGIC, __ATOMIC_RELEASE) ;
+
+  strcpy (sharedName, name) ;
+  sharedSize = ADC_SHM_SIZE (n) ;
+  shared     = shm ;
+
+  return 0 ;
+}
+
+
+/*
+ * adcShareOpen: adcShareClose:
+ *	A reader of the shared ring name, in any process. It starts with the
+ *	next scan to come. Slots left by readers that have died are taken
+ *	back. Open returns NULL with errno set if there's no such ring or
+ *	all ADC_SHM_READERS are taken.
+ *********************************************************************************
+ */
+
+struct adcShareStruct *adcShareOpen (const char *name)
+{
+  struct adcShareStruct *r ;
+  struct adcShmStruct *shm ;
+  struct stat st ;
+  int32_t pid, old ;
+  void *ptr ;
+  int fd, i ;
+
+  if ((fd = shm_open (name, O_RDWR | O_CLOEXEC, 0666)) < 0)
+    return NULL ;
+
+  if ((fstat (fd, &st) < 0) || (st.st_size < (off_t)sizeof (struct adcShmStruct)))
+  {
+    close (fd) ;
+    errno = EINVAL ;
+    return NULL ;
+  }
+
+  ptr = mmap (NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) ;
+  close (fd) ;
+  if (ptr == MAP_FAILED)
+    return NULL ;
+
+  shm = (struct adcShmStruct *)ptr ;
+
+  if ((__atomic_load_n (&shm->magic, __ATOMIC_ACQUIRE) != ADC_SHM_MAGIC) || (shm->version != ADC_SHM_VERSION) ||
+      (shm->sampleSize != sizeof (struct adcSampleStruct)) || ((off_t)ADC_SHM_SIZE (shm->size) > st.st_size))
+  {
+    munmap (ptr, st.st_size) ;
+    errno = EINVAL ;
+    return NULL ;
+  }
+
+  if ((r = (struct adcShareStruct *)calloc (1, sizeof (*r))) == NULL)
+  {
+    munmap (ptr, st.st_size) ;
+    return NULL ;
+  }
+
+  r->shm     = shm ;
+  r->mapSize = st.st_size ;
+  r->slot    = -1 ;
+  r->cursor  = __atomic_load_n (&shm->head, __ATOMIC_ACQUIRE) ;
+
+  pid = (int32_t)getpid () ;
+  for (i = 0 ; (i < ADC_SHM_READERS) && (r->slot < 0) ; ++i)
+  {
+    old = __atomic_load_n (&shm->readers [i].pid, __ATOMIC_ACQUIRE) ;
+    if ((old != 0) && ((kill (old, 0) == 0) || (errno != ESRCH)))	// Still there
+      continue ;
+    if (__atomic_compare_exchange_n (&shm->readers [i].pid, &old, pid, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+      r->slot = i ;
+  }
+
+  if (r->slot < 0)
+  {
+    munmap (ptr, r->mapSize) ;
+    free (r) ;
+    errno = ENOSPC ;
+    return NULL ;
+  }
+
+  shm->readers [r->slot].overruns = 0 ;
+  shm->readers [r->slot].cursor   = r->cursor ;
+
+  return r ;
+}
+
+void adcShareClose (struct adcShareStruct *r)
+{
+  if (r == NULL)
+    return ;
+
+  __atomic_store_n (&r->shm->readers [r->slot].pid, 0, __ATOMIC_RELEASE) ;
+  munmap (r->shm, r->mapSize) ;
+  free (r) ;
+}
+
+
+/*
+ * adcSharePeek: adcShareDone:
+ *	Peek points samples at the next ones in the ring, in place, and
+ *	returns how many there are in a row (0 if none, or -1 if the stream's
+ *	stopped with nothing left) - they may carry on again from the start
+ *	of the ring. Done moves the cursor on past n of them when you've
+ *	finished, and returns 0 - or -1 if the producer has been over them
+ *	since the peek, in which case they're not to be trusted and are
+ *	counted as overruns.
+ *	If the reader's fallen a whole ring behind, Peek skips it on to the
+ *	middle of what's there, counting what it's missed as overruns too.
+ *********************************************************************************
+ */
+
+int adcSharePeek (struct adcShareStruct *r, const struct adcSampleStruct **samples)
+{
+  struct adcShmStruct *shm = r->shm ;
+  uint64_t head = __atomic_load_n (&shm->head, __ATOMIC_ACQUIRE) ;
+  uint64_t avail, toEnd ;
+
+  if (head - r->cursor > shm->size)
+  {
+    r->overruns += (unsigned int)(head - r->cursor - shm->size / 2) ;
+    r->cursor    = head - shm->size / 2 ;
+    shm->readers [r->slot].overruns = r->overruns ;
+  }
+
+  if ((avail = head - r->cursor) == 0)
+    return shm->running ? 0 : -1 ;
+
+  toEnd = shm->size - (r->cursor & (shm->size - 1)) ;
+  if (avail > toEnd)
+    avail = toEnd ;
+
+  *samples = &shm->samples [r->cursor & (shm->size - 1)] ;
+
+  return (int)avail ;
+}
+
+int adcShareDone (struct adcShareStruct *r, int n)
+{
+  struct adcShmStruct *shm = r->shm ;
+  uint64_t head ;
+  int res = 0 ;
+
+  __atomic_thread_fence (__ATOMIC_ACQUIRE) ;	// Our reads of the samples are done before this
+  head = __atomic_load_n (&shm->head, __ATOMIC_ACQUIRE) ;
+
+  if (head + shm->numPins - r->cursor > shm->size)	// Over the first of them, or part way
+  {
+    r->overruns += n ;
+    res = -1 ;
+  }
+
+  r->cursor += n ;
+  shm->readers [r->slot].cursor   = r->cursor ;
+  shm->readers [r->slot].overruns = r->overruns ;
+
+  return res ;
+}
+
+
+/*
+ * adcShareWait:
+ *	Wait up to timeoutMs (-1: forever) for there to be something to read.
+ *	Returns how many samples there are waiting.
+ *********************************************************************************
+ */
+
+int adcShareWait (struct adcShareStruct *r, int timeoutMs)
+{
+  struct adcShmStruct *shm = r->shm ;
+  struct timespec ts ;
+  uint32_t changes ;
+
+  ts.tv_sec  = timeoutMs / 1000 ;
+  ts.tv_nsec = (timeoutMs % 1000) * 1000000L ;
+
+  __atomic_add_fetch (&shm->waiters, 1, __ATOMIC_SEQ_CST) ;
+
+  changes = __atomic_load_n (&shm->changes, __ATOMIC_SEQ_CST) ;
+  if ((__atomic_load_n (&shm->head, __ATOMIC_ACQUIRE) == r->cursor) && (timeoutMs != 0))
+    piFutexWait (&shm->changes, changes, (timeoutMs > 0) ? &ts : NULL) ;
+
+  __atomic_sub_fetch (&shm->waiters, 1, __ATOMIC_SEQ_CST) ;
+
+  return (int)(__atomic_load_n (&shm->head, __ATOMIC_ACQUIRE) - r->cursor) ;
+}
+
+
+/*
+ * adcShareOverruns: adcShareInfo:
+ *	How many samples this reader has missed, and how each scan is laid
+ *	out - the number of pins in it and the nS between scans.
+ *********************************************************************************
+ */
+
+unsigned int adcShareOverruns (struct adcShareStruct *r)
+{
+  return r->overruns ;
+}
+
+int adcShareInfo (struct adcShareStruct *r, int *numPins, unsigned long long *periodNs)
+{
+  if (numPins != NULL)
+    *numPins = (int)r->shm->numPins ;
+  if (periodNs != NULL)
+    *periodNs = r->shm->periodNs ;
+
+  return r->shm->running ? 0 : -1 ;
+}
@@ -0,0 +1,61 @@
+/*
+ * adcStream.h:
+ *	Continuous fixed-rate sampling of analog pins
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+// adcSampleStruct:
+//	One sample from adcStreamRead. The timestamp is nanos64 () when the
+//	scan it was part of was read.
+
+struct adcSampleStruct
+{
+  unsigned long long timestamp ;
+  int                pin ;
+  int                value ;
+} ;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int          adcStreamStart    (const int *pins, int numPins, int sampleRate, int ringSize) ;
+extern int          adcStreamRead     (struct adcSampleStruct *samples, int maxSamples) ;
+extern unsigned int adcStreamOverruns (void) ;
+extern int          adcStreamJitter   (unsigned int *maxNs, unsigned int *meanNs) ;
+extern void         adcStreamStop     (void) ;
+extern int          adcStreamShare    (const char *name, int size) ;
+
+// Readers of a shared stream, in any process: see adcStream.c
+
+struct adcShareStruct ;
+
+extern struct adcShareStruct *adcShareOpen (const char *name) ;
+extern int          adcSharePeek      (struct adcShareStruct *reader, const struct adcSampleStruct **samples) ;
+extern int          adcShareDone      (struct adcShareStruct *reader, int n) ;
+extern int          adcShareWait      (struct adcShareStruct *reader, int timeoutMs) ;
+extern unsigned int adcShareOverruns  (struct adcShareStruct *reader) ;
+extern int          adcShareInfo      (struct adcShareStruct *reader, int *numPins, unsigned long long *periodNs) ;
+extern void         adcShareClose     (struct adcShareStruct *reader) ;
+
+#ifdef __cplusplus
+}
+#endif
@@ -29,12 +29,26 @@
  * channels as usual, also some fake digitalOutputs - these are the control
  * registers that allow the user to put it into single/diff mode, set the
  * gain and data rates.
+ * Writing TRUE to the third one puts the chip into continuous conversion
+ * mode: the multiplexor stays on the last channel read and an analogRead
+ * of that channel is then just one read of the conversion register. With
+ * ads1115ReadyPin () the ALERT/RDY output signals each new conversion and
+ * analogRead returns the latest one without touching the bus at all.
+ * ads1115ScanStart () goes further and runs a thread that cycles round a
+ * set of channels back to back, so analogRead of any of them is a lookup.
+ * Or ads1115Comparator () leaves the chip converting one channel against
+ * a pair of thresholds, with ALERT/RDY telling us - through the ISR dispatcher,
+ * see ads1115AlertPin () - when it goes past them, and no bus traffic at
+ * all until it does.
  *********************************************************************************
  */
 
 #include <byteswap.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
 
 #include <wiringPi.h>
 #include <wiringPiI2C.h>
@@ -85,8 +99,9 @@
 #define	CONFIG_DR_32SPS		(0x0040)	//  32 samples per second
 #define	CONFIG_DR_64SPS		(0x0060)	//  64 samples per second
 #define	CONFIG_DR_128SPS	(0x0080)	// 128 samples per second (default)
-#define	CONFIG_DR_475SPS	(0x00A0)	// 475 samples per second
-#define	CONFIG_DR_860SPS	(0x00C0)	// 860 samples per second
+#define	CONFIG_DR_250SPS	(0x00A0)	// 250 samples per second
+#define	CONFIG_DR_475SPS	(0x00C0)	// 475 samples per second
+#define	CONFIG_DR_860SPS	(0x00E0)	// 860 samples per second
 
 // Comparator mode
 
@@ -117,16 +132,287 @@
 #define	CONFIG_DEFAULT		(0x8583)	// From the datasheet
 
 
+// Registers
+
+#define	REG_CONVERSION		0
+#define	REG_CONFIG		1
+#define	REG_LO_THRESH		2
+#define	REG_HI_THRESH		3
+
 static const uint16_t dataRates [8] =
 {
-  CONFIG_DR_8SPS, CONFIG_DR_16SPS, CONFIG_DR_32SPS, CONFIG_DR_64SPS, CONFIG_DR_128SPS, CONFIG_DR_475SPS, CONFIG_DR_860SPS
+  CONFIG_DR_8SPS, CONFIG_DR_16SPS, CONFIG_DR_32SPS, CONFIG_DR_64SPS, CONFIG_DR_128SPS, CONFIG_DR_250SPS, CONFIG_DR_475SPS, CONFIG_DR_860SPS
 } ;
 
+static const int samplesPerSec [8] = { 8, 16, 32, 64, 128, 250, 475, 860 } ;
+
 static const uint16_t gains [6] =
 {
   CONFIG_PGA_6_144V, CONFIG_PGA_4_096V, CONFIG_PGA_2_048V, CONFIG_PGA_1_024V, CONFIG_PGA_0_512V, CONFIG_PGA_0_256V
 } ;
 
+static const uint16_t muxes [8] =
+{
+  CONFIG_MUX_SINGLE_0, CONFIG_MUX_SINGLE_1, CONFIG_MUX_SINGLE_2, CONFIG_MUX_SINGLE_3,
+  CONFIG_MUX_DIFF_0_1, CONFIG_MUX_DIFF_2_3, CONFIG_MUX_DIFF_0_3, CONFIG_MUX_DIFF_1_3
+} ;
+
+
+// Per-chip state for continuous mode. node->data3 says which one.
+
+#define	MAX_ADS1115	8
+
+struct ads1115Struct
+{
+  struct wiringPiNodeStruct *node ;
+  pthread_mutex_t  lock ;
+  pthread_cond_t   cond ;
+  int              continuous ;
+  int              config ;		// Running continuous config, or -1
+  int              readyPin ;		// Pi pin on ALERT/RDY, or -1
+  unsigned int     seq ;		// Bumped by each RDY interrupt
+  int16_t          latest ;
+
+  pthread_t        scanThread ;
+  volatile int     scanning ;
+  unsigned int     scanMask ;		// Channels being scanned
+  unsigned int     scanValid ;		// Channels with a value yet
+  int              values [8] ;
+
+  int              compare ;		// Running comparator config, or -1
+  int              compChan ;
+  int              compFlags ;
+  int              alertPin ;		// Pi pin on ALERT/RDY as an alert, or -1
+  struct piRingStruct *alerts ;
+  unsigned int     alertsLost ;
+  void           (*alertFn)(void *context, const struct ads1115AlertEvent *event) ;
+  void            *alertContext ;
+} ;
+
+static struct ads1115Struct chips [MAX_ADS1115] ;
+static int                  numChips = 0 ;
+
+
+/*
+ * readReg:
+ * writeReg:
+ *	The chip is big-endian, SMBus words are little-endian.
+ *********************************************************************************
+ */
+
+static int16_t readReg (int fd, int reg)
+{
+  return (int16_t)__bswap_16 ((uint16_t)wiringPiI2CReadReg16 (fd, reg)) ;
+}
+
+static void writeReg (int fd, int reg, uint16_t value)
+{
+  wiringPiI2CWriteReg16 (fd, reg, __bswap_16 (value)) ;
+}
+
+
+/*
+ * conversionUs:
+ *	How long one conversion takes at the node's data rate - with 10%
+ *	on top for the internal oscillator.
+ *********************************************************************************
+ */
+
+static unsigned int conversionUs (struct wiringPiNodeStruct *node)
+{
+  int i ;
+
+  for (i = 0 ; i < 8 ; ++i)
+    if (dataRates [i] == node->data1)
+      return 1100000 / samplesPerSec [i] + 50 ;
+
+  return 1100000 / 128 + 50 ;
+}
+
+
+/*
+ * readyIsr:
+ *	ALERT/RDY has pulsed - a new conversion is ready. The ISR runs in the
+ *	wiringPi interrupt thread so it can go to the bus itself.
+ *********************************************************************************
+ */
+
+static void readyIsr (struct ads1115Struct *c)
+{
+  int16_t value ;
+
+  value = readReg (c->node->fd, REG_CONVERSION) ;
+
+  pthread_mutex_lock (&c->lock) ;
+    c->latest = value ;
+    ++c->seq ;
+    pthread_cond_broadcast (&c->cond) ;
+  pthread_mutex_unlock (&c->lock) ;
+}
+
+// wiringPiISR functions have no argument, so one per chip slot
+
+#define	ADS_ISR(n)	static void adsIsr##n (void) { readyIsr (&chips [n]) ; }
+
+ADS_ISR (0)  ADS_ISR (1)  ADS_ISR (2)  ADS_ISR (3)
+ADS_ISR (4)  ADS_ISR (5)  ADS_ISR (6)  ADS_ISR (7)
+
+static void (*isrs [MAX_ADS1115])(void) =
+{
+  adsIsr0, adsIsr1, adsIsr2, adsIsr3, adsIsr4, adsIsr5, adsIsr6, adsIsr7,
+} ;
+
+
+/*
+ * continuousRead:
+ *	Return the latest conversion for the given config, switching the
+ *	multiplexor (and waiting for a fresh conversion) if it's not the one
+ *	the chip is running now. Called with the chip locked.
+ *********************************************************************************
+ */
+
+static int16_t continuousRead (struct ads1115Struct *c, uint16_t config)
+{
+  struct wiringPiNodeStruct *node = c->node ;
+  struct timespec deadline ;
+  unsigned int want, us ;
+
+  if (c->config == (int)config)
+  {
+    if (c->readyPin == -1)
+      return readReg (node->fd, REG_CONVERSION) ;
+    if (c->seq != 0)
+      return c->latest ;
+  }
+
+  want = c->seq + 1 ;
+  us   = conversionUs (node) ;
+
+  if (c->config != (int)config)
+  {
+    writeReg (node->fd, REG_CONFIG, config) ;
+    c->config = config ;
+    want      = c->seq + 2 ;	// One may already be on its way with the old mux
+  }
+
+  if (c->readyPin == -1)
+  {
+    delayMicroseconds (us) ;
+    return readReg (node->fd, REG_CONVERSION) ;
+  }
+
+// Wait for the RDY interrupt(s) - but not forever
+
+  clock_gettime (CLOCK_REALTIME, &deadline) ;
+  deadline.tv_nsec += (us * 3 % 1000000) * 1000 ;
+  deadline.tv_sec  += us * 3 / 1000000 + 1 ;
+  if (deadline.tv_nsec >= 1000000000)
+  {
+    deadline.tv_nsec -= 1000000000 ;
+    ++deadline.tv_sec ;
+  }
+
+  while ((int)(c->seq - want) < 0)
+    if (pthread_cond_timedwait (&c->cond, &c->lock, &deadline) == ETIMEDOUT)
+      return readReg (node->fd, REG_CONVERSION) ;
+
+  return c->latest ;
+}
+
+
+/*
+ * channelConfig:
+ *	Build the config word to convert one channel with the node's gain
+ *	and data rate.
+ *********************************************************************************
+ */
+
+static uint16_t channelConfig (struct wiringPiNodeStruct *node, int chan)
+{
+  uint16_t config = CONFIG_DEFAULT ;
+
+  config &= ~(CONFIG_PGA_MASK | CONFIG_DR_MASK | CONFIG_MUX_MASK) ;
+  config |= node->data0 | node->data1 | muxes [chan & 7] ;
+
+  return config ;
+}
+
+
+/*
+ * singleShot:
+ *	Start a conversion and wait for its result. The ALERT/RDY interrupt
+ *	is used if we have it, otherwise we sleep for the conversion time and
+ *	then poll the OS bit. Called with the chip locked.
+ *********************************************************************************
+ */
+
+static int16_t singleShot (struct ads1115Struct *c, uint16_t config)
+{
+  struct wiringPiNodeStruct *node = c->node ;
+  struct timespec deadline ;
+  unsigned int want ;
+
+  if (c->readyPin != -1)
+    config &= ~CONFIG_CQUE_MASK ;
+
+  want = c->seq + 1 ;
+  writeReg (node->fd, REG_CONFIG, config | CONFIG_OS_SINGLE) ;
+  c->config = -1 ;
+
+  if (c->readyPin != -1)
+  {
+    clock_gettime (CLOCK_REALTIME, &deadline) ;
+    deadline.tv_sec += 1 ;
+    while ((int)(c->seq - want) < 0)
+      if (pthread_cond_timedwait (&c->cond, &c->lock, &deadline) == ETIMEDOUT)
+	break ;
+    if ((int)(c->seq - want) >= 0)
+      return c->latest ;
+  }
+  else
+    delayMicroseconds (conversionUs (node)) ;
+
+  while ((readReg (node->fd, REG_CONFIG) & CONFIG_OS_MASK) == 0)
+    delayMicroseconds (50) ;
+
+  return readReg (node->fd, REG_CONVERSION) ;
+}
+
+
+/*
+ * scanThread:
+ *	Convert each channel in the scan set in turn, starting the next one
+ *	as soon as the last result is in, and keep the latest values. The
+ *	lock is dropped between conversions so configuration changes and
+ *	ads1115ScanStop get a look in.
+ *********************************************************************************
+ */
+
+static void *scanThread (void *arg)
+{
+  struct ads1115Struct *c = (struct ads1115Struct *)arg ;
+  int chan = 0 ;
+  int16_t result ;
+
+  while (c->scanning)
+  {
+    if ((c->scanMask & (1 << chan)) != 0)
+    {
+      pthread_mutex_lock (&c->lock) ;
+	result = singleShot (c, channelConfig (c->node, chan)) ;
+	if ((chan < 4) && (result < 0))
+	  result = 0 ;
+	c->values [chan] = result ;
+	c->scanValid |= (1 << chan) ;
+	pthread_cond_broadcast (&c->cond) ;
+      pthread_mutex_unlock (&c->lock) ;
+    }
+    chan = (chan + 1) & 7 ;
+  }
+
+  return NULL ;
+}
+
 
 /*
  * analogRead:
@@ -138,60 +424,63 @@ static const uint16_t gains [6] =
 
 static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
 {
+  struct ads1115Struct *c = &chips [node->data3] ;
   int chan = pin - node->pinBase ;
   int16_t  result ;
-  uint16_t config = CONFIG_DEFAULT ;
+  uint16_t config ;
 
   chan &= 7 ;
 
-// Setup the configuration register
-
-//	Set PGA/voltage range
+// Setup the configuration register: gain, sample speed and the
+//	single-ended channel or differential mode
 
-  config &= ~CONFIG_PGA_MASK ;
-  config |= node->data0 ;
+  config = channelConfig (node, chan) ;
 
-//	Set sample speed
+  pthread_mutex_lock (&c->lock) ;
 
-  config &= ~CONFIG_DR_MASK ;
-  config |= node->data1 ;
+// Scanning? Then it's just a look-up once the channel has been round once
 
-//	Set single-ended channel or differential mode
+  if (c->scanning && ((c->scanMask & (1 << chan)) != 0))
+  {
+    while (c->scanning && ((c->scanValid & (1 << chan)) == 0))
+      pthread_cond_wait (&c->cond, &c->lock) ;
+    if (c->scanning)
+    {
+      result = c->values [chan] ;
+      pthread_mutex_unlock (&c->lock) ;
+      return result ;
+    }
+  }
 
-  config &= ~CONFIG_MUX_MASK ;
+// The comparator's running: its own channel is converting all the time,
+//	anything else is a single shot and then the comparator starts again
 
-  switch (chan)
+  if (c->compare != -1)
   {
-    case 0: config |= CONFIG_MUX_SINGLE_0 ; break ;
-    case 1: config |= CONFIG_MUX_SINGLE_1 ; break ;
-    case 2: config |= CONFIG_MUX_SINGLE_2 ; break ;
-    case 3: config |= CONFIG_MUX_SINGLE_3 ; break ;
-
-    case 4: config |= CONFIG_MUX_DIFF_0_1 ; break ;
-    case 5: config |= CONFIG_MUX_DIFF_2_3 ; break ;
-    case 6: config |= CONFIG_MUX_DIFF_0_3 ; break ;
-    case 7: config |= CONFIG_MUX_DIFF_1_3 ; break ;
+    if (chan == c->compChan)
+      result = readReg (node->fd, REG_CONVERSION) ;
+    else
+    {
+      result = singleShot (c, (config & ~CONFIG_CQUE_MASK) | CONFIG_CQUE_NONE) ;
+      writeReg (node->fd, REG_CONFIG, c->compare) ;
+    }
   }
+  else if (c->continuous)
+  {
 
-//	Start a single conversion
-
-  config |= CONFIG_OS_SINGLE ;
-  config = __bswap_16 (config) ;
-  wiringPiI2CWriteReg16 (node->fd, 1, config) ;
+// Continuous mode, and if we're using ALERT/RDY then set the comparator
+//	up to pulse it after every conversion
 
-// Wait for the conversion to complete
+    config &= ~(CONFIG_OS_MASK | CONFIG_MODE) ;
+    if (c->readyPin != -1)
+      config &= ~CONFIG_CQUE_MASK ;
 
-  for (;;)
-  {
-    result =  wiringPiI2CReadReg16 (node->fd, 1) ;
-    result = __bswap_16 (result) ;
-    if ((result & CONFIG_OS_MASK) != 0)
-      break ;
-    delayMicroseconds (100) ;
+    result = continuousRead (c, config) ;
   }
+  else
+    result = singleShot (c, config) ;
 
-  result =  wiringPiI2CReadReg16 (node->fd, 0) ;
-  result = __bswap_16 (result) ;
+  pthread_mutex_unlock (&c->lock) ;
 
 // Sometimes with a 0v input on a single-ended channel the internal 0v reference
 //	can be higher than the input, so you get a negative result...
@@ -207,30 +496,46 @@ static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
  * digitalWrite:
  *	It may seem odd to have a digital write here, but it's the best way
  *	to pass paramters into the chip in the wiringPi way of things.
- *	We have 2 digital registers:
+ *	We have 3 digital registers:
  *		0 is the gain control
  *		1 is the data rate control
+ *		2 is continuous conversion mode on/off
+ *	Changing the gain or rate while running continuously takes effect
+ *	on the next read.
  *********************************************************************************
  */
 
 static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int data)
 {
+  struct ads1115Struct *c = &chips [node->data3] ;
   int chan = pin - node->pinBase ;
   chan &= 3 ;
 
-  if (chan == 0)	// Gain Control
+  pthread_mutex_lock (&c->lock) ;
+
+  /**/ if (chan == 0)	// Gain Control
   {
-    if ( (data < 0) || (data > 6) )	// Use default if out of range
+    if ( (data < 0) || (data > 5) )	// Use default if out of range
       data = 2 ;
     node->data0 = gains [data] ;
   }
-  else			// Data rate control
+  else if (chan == 1)	// Data rate control
   {
     if ( (data < 0) || (data > 7) )	// Use default if out of range
       data = 4 ;
     node->data1 = dataRates [data] ;	// Bugfix 0-1 by "Eric de jong (gm)" <ericdejong@gmx.net> - Thanks.
   }
-  
+  else if (chan == 2)	// Continuous mode
+  {
+    c->continuous = (data != 0) ;
+    if (!c->continuous && (c->config != -1))
+    {
+      writeReg (node->fd, REG_CONFIG, CONFIG_DEFAULT & ~CONFIG_OS_MASK) ;	// Back to single-shot/power-down
+      c->config = -1 ;
+    }
+  }
+
+  pthread_mutex_unlock (&c->lock) ;
 }
 
 
@@ -259,8 +564,7 @@ static void myAnalogWrite (struct wiringPiNodeStruct *node, int pin, int data)
   else
     ndata = (int16_t)data ;
 
-  ndata = __bswap_16 (ndata) ;
-  wiringPiI2CWriteReg16 (node->fd, reg, data) ;
+  writeReg (node->fd, reg, (uint16_t)ndata) ;
 }
 
 
@@ -275,19 +579,366 @@ static void myAnalogWrite (struct wiringPiNodeStruct *node, int pin, int data)
 int ads1115Setup (const int pinBase, int i2cAddr)
 {
   struct wiringPiNodeStruct *node ;
+  struct ads1115Struct *c ;
   int fd ;
 
+  if (numChips == MAX_ADS1115)
+    return wiringPiFailure (WPI_ALMOST, "ads1115Setup: Too many devices (max %d)\n", MAX_ADS1115) ;
+
   if ((fd = wiringPiI2CSetup (i2cAddr)) < 0)
     return FALSE ;
 
   node = wiringPiNewNode (pinBase, 8) ;
 
+  c = &chips [numChips] ;
+  c->node       = node ;
+  c->continuous = FALSE ;
+  c->config     = -1 ;
+  c->readyPin   = -1 ;
+  c->seq        = 0 ;
+  c->scanning   = FALSE ;
+  c->compare    = -1 ;
+  c->alertPin   = -1 ;
+  pthread_mutex_init (&c->lock, NULL) ;
+  pthread_cond_init  (&c->cond, NULL) ;
+
   node->fd           = fd ;
   node->data0        = CONFIG_PGA_4_096V ;	// Gain in data0
   node->data1        = CONFIG_DR_128SPS ;	// Samples/sec in data1
   node->analogRead   = myAnalogRead ;
   node->analogWrite  = myAnalogWrite ;
   node->digitalWrite = myDigitalWrite ;
+  node->data3        = numChips++ ;
 
   return TRUE ;
 }
+
+
+/*
+ * findChip:
+ *	Get our state for the ADS1115 at the given pin base.
+ *********************************************************************************
+ */
+
+static struct ads1115Struct *findChip (int pinBase)
+{
+  struct wiringPiNodeStruct *node = wiringPiFindNode (pinBase) ;
+
+  if ((node == NULL) || (node->data3 >= (unsigned int)numChips) || (chips [node->data3].node != node))
+    return NULL ;
+
+  return &chips [node->data3] ;
+}
+
+
+/*
+ * ads1115ReadyPin:
+ *	Use the chip's ALERT/RDY output, wired to the given Pi pin, as a
+ *	conversion-ready interrupt and put the chip into continuous mode.
+ *	The threshold registers are set up for RDY operation, so the
+ *	comparator can't be used as well.
+ *********************************************************************************
+ */
+
+int ads1115ReadyPin (int pinBase, int pin)
+{
+  struct wiringPiNodeStruct *node ;
+  struct ads1115Struct *c ;
+
+  if ((c = findChip (pinBase)) == NULL)
+    return wiringPiFailure (WPI_ALMOST, "ads1115ReadyPin: No ADS1115 at pin %d\n", pinBase) ;
+
+  if ((c->compare != -1) || (c->alertPin != -1))
+    return wiringPiFailure (WPI_ALMOST, "ads1115ReadyPin: ALERT/RDY is in use by the comparator\n") ;
+
+  node = c->node ;
+
+// RDY mode is the MSB of Hi_thresh set and of Lo_thresh clear
+
+  writeReg (node->fd, REG_LO_THRESH, 0x0000) ;
+  writeReg (node->fd, REG_HI_THRESH, 0x8000) ;
+
+  if (wiringPiISR (pin, INT_EDGE_FALLING, isrs [node->data3]) < 0)
+    return -1 ;
+
+  pthread_mutex_lock (&c->lock) ;
+    c->readyPin   = pin ;
+    c->continuous = TRUE ;
+    c->config     = -1 ;	// Force a config write with the comparator on
+  pthread_mutex_unlock (&c->lock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * ads1115ScanStart:
+ * ads1115ScanStop:
+ *	Start and stop the background scan of the channels in the mask (bit
+ *	0 for channel 0, and so on up to 7). While it runs analogRead of those
+ *	channels returns the latest value without waiting. The scan uses the
+ *	gain and data rate in force at the time of each conversion and the
+ *	ALERT/RDY interrupt if it's set up.
+ *********************************************************************************
+ */
+
+int ads1115ScanStart (int pinBase, unsigned int channels)
+{
+  struct ads1115Struct *c ;
+
+  if ((c = findChip (pinBase)) == NULL)
+    return wiringPiFailure (WPI_ALMOST, "ads1115ScanStart: No ADS1115 at pin %d\n", pinBase) ;
+
+  if ((channels & 0xFF) == 0)
+    return wiringPiFailure (WPI_ALMOST, "ads1115ScanStart: No channels to scan\n") ;
+
+  if (c->compare != -1)
+    return wiringPiFailure (WPI_ALMOST, "ads1115ScanStart: The comparator is running\n") ;
+
+  ads1115ScanStop (pinBase) ;
+
+  pthread_mutex_lock (&c->lock) ;
+    c->scanMask  = channels & 0xFF ;
+    c->scanValid = 0 ;
+    c->scanning  = TRUE ;
+  pthread_mutex_unlock (&c->lock) ;
+
+  if (pthread_create (&c->scanThread, NULL, scanThread, c) != 0)
+  {
+    c->scanning = FALSE ;
+    return wiringPiFailure (WPI_ALMOST, "ads1115ScanStart: Unable to start thread\n") ;
+  }
+
+  return 0 ;
+}
+
+void ads1115ScanStop (int pinBase)
+{
+  struct ads1115Struct *c ;
+
+  if (((c = findChip (pinBase)) == NULL) || !c->scanning)
+    return ;
+
+  pthread_mutex_lock (&c->lock) ;
+    c->scanning = FALSE ;
+    pthread_cond_broadcast (&c->cond) ;
+  pthread_mutex_unlock (&c->lock) ;
+
+  pthread_join (c->scanThread, NULL) ;
+}
+
+
+/*
+ * alertEdge:
+ *	ALERT/RDY has changed - from the ISR dispatcher, so it can go to the
+ *	bus itself. When it asserts we read the conversion that did it, which
+ *	also lets go of a latched alert.
+ *********************************************************************************
+ */
+
+static void alertEdge (void *context, const struct wpiEdgeEventStruct *edge)
+{
+  struct ads1115Struct *c = (struct ads1115Struct *)context ;
+  struct ads1115AlertEvent event ;
+  void (*fn)(void *, const struct ads1115AlertEvent *) ;
+  void  *fnContext ;
+  int    activeHigh, running ;
+
+  pthread_mutex_lock (&c->lock) ;
+    running    = c->compare != -1 ;
+    activeHigh = (c->compFlags & ADS1115_COMP_ACTIVE_HIGH) != 0 ;
+    fn         = c->alertFn ;
+    fnContext  = c->alertContext ;
+  pthread_mutex_unlock (&c->lock) ;
+
+  if (!running)
+    return ;
+
+  event.ns       = edge->timestamp ;
+  event.asserted = (edge->edge == INT_EDGE_RISING) == activeHigh ;
+  event.value    = event.asserted ? readReg (c->node->fd, REG_CONVERSION) : 0 ;
+
+  if (piRingPush (c->alerts, &event, 1) != 1)
+    __atomic_add_fetch (&c->alertsLost, 1, __ATOMIC_RELAXED) ;
+
+  if (fn != NULL)
+    fn (fnContext, &event) ;
+}
+
+
+/*
+ * ads1115Comparator:
+ *	Leave the chip converting chan (0-7, as for analogRead) continuously
+ *	at the node's gain and data rate, and assert ALERT/RDY when it goes
+ *	past the thresholds, in the chip's own codes:
+ *	  Normally when it goes above high, until it falls below low again.
+ *	  With ADS1115_COMP_WINDOW whenever it's outside low to high.
+ *	It has to be out for queue (1, 2 or 4) conversions in a row, and with
+ *	ADS1115_COMP_LATCH stays asserted until the conversion's read.
+ *	analogRead of chan is then one read of the conversion register; of
+ *	any other channel, a single shot and the comparator started again.
+ *	Returns 0, or -1.
+ *********************************************************************************
+ */
+
+int ads1115Comparator (int pinBase, int chan, int low, int high, int flags, int queue)
+{
+  struct ads1115Struct *c ;
+  struct wiringPiNodeStruct *node ;
+  uint16_t config ;
+
+  if ((c = findChip (pinBase)) == NULL)
+    return wiringPiFailure (WPI_ALMOST, "ads1115Comparator: No ADS1115 at pin %d\n", pinBase) ;
+
+  if ((chan < 0) || (chan > 7) || (low < -32768) || (high > 32767) || (low > high))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  if (c->scanning || (c->readyPin != -1))
+    return wiringPiFailure (WPI_ALMOST, "ads1115Comparator: The chip is scanning or using ALERT/RDY for RDY\n") ;
+
+  node   = c->node ;
+  config = channelConfig (node, chan) & ~(CONFIG_OS_MASK | CONFIG_MODE | CONFIG_CMODE_MASK | CONFIG_CPOL_MASK | CONFIG_CLAT_MASK | CONFIG_CQUE_MASK) ;
+
+  if ((flags & ADS1115_COMP_WINDOW)      != 0) config |= CONFIG_CMODE_WINDOW ;
+  if ((flags & ADS1115_COMP_ACTIVE_HIGH) != 0) config |= CONFIG_CPOL_ACTVHI ;
+  if ((flags & ADS1115_COMP_LATCH)       != 0) config |= CONFIG_CLAT_LATCH ;
+
+  /**/ if (queue >= 4)
+    config |= CONFIG_CQUE_4CONV ;
+  else if (queue >= 2)
+    config |= CONFIG_CQUE_2CONV ;
+  else
+    config |= CONFIG_CQUE_1CONV ;
+
+  pthread_mutex_lock (&c->lock) ;
+    writeReg (node->fd, REG_LO_THRESH, (uint16_t)(int16_t)low) ;
+    writeReg (node->fd, REG_HI_THRESH, (uint16_t)(int16_t)high) ;
+    writeReg (node->fd, REG_CONFIG,    config) ;
+    c->compare   = config ;
+    c->compChan  = chan ;
+    c->compFlags = flags ;
+    c->config    = -1 ;
+  pthread_mutex_unlock (&c->lock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * ads1115ComparatorOff:
+ *	Stop the comparator, and the chip back to single shots
+ *********************************************************************************
+ */
+
+void ads1115ComparatorOff (int pinBase)
+{
+  struct ads1115Struct *c ;
+
+  if (((c = findChip (pinBase)) == NULL) || (c->compare == -1))
+    return ;
+
+  pthread_mutex_lock (&c->lock) ;
+    writeReg (c->node->fd, REG_CONFIG, CONFIG_DEFAULT & ~CONFIG_OS_MASK) ;
+    c->compare = -1 ;
+    c->config  = -1 ;
+  pthread_mutex_unlock (&c->lock) ;
+}
+
+
+/*
+ * ads1115AlertPin:
+ *	Take the chip's ALERT/RDY, wired to the given Pi pin, as the
+ *	comparator's alert. Each time it asserts or lets go an event goes
+ *	into a ring - see ads1115AlertRead () - and to function, if it's not
+ *	NULL, called on the ISR dispatcher thread. Call it again to change
+ *	the function; the pin stays the same.
+ *	Returns 0, or -1.
+ *********************************************************************************
+ */
+
+int ads1115AlertPin (int pinBase, int pin, void (*function)(void *context, const struct ads1115AlertEvent *event), void *context)
+{
+  struct ads1115Struct *c ;
+
+  if ((c = findChip (pinBase)) == NULL)
+    return wiringPiFailure (WPI_ALMOST, "ads1115AlertPin: No ADS1115 at pin %d\n", pinBase) ;
+
+  if (c->readyPin != -1)
+    return wiringPiFailure (WPI_ALMOST, "ads1115AlertPin: ALERT/RDY is in use for RDY\n") ;
+
+  if ((c->alertPin != -1) && (c->alertPin != pin))
+  {
+    errno = EBUSY ;
+    return -1 ;
+  }
+
+  pthread_mutex_lock (&c->lock) ;
+    c->alertFn      = function ;
+    c->alertContext = context ;
+  pthread_mutex_unlock (&c->lock) ;
+
+  if (c->alertPin != -1)
+    return 0 ;
+
+  if ((c->alerts = piRingCreate (PI_RING_SPSC, sizeof (struct ads1115AlertEvent), ADS1115_ALERT_DEPTH, TRUE)) == NULL)
+  {
+    errno = ENOMEM ;
+    return -1 ;
+  }
+
+  pullUpDnControl (pin, PUD_UP) ;		// It's open drain
+  if (wiringPiISRex (pin, INT_EDGE_BOTH, alertEdge, c) < 0)
+  {
+    piRingFree (c->alerts) ;
+    c->alerts = NULL ;
+    return -1 ;
+  }
+
+  c->alertPin = pin ;
+
+  return 0 ;
+}
+
+
+/*
+ * ads1115AlertRead:
+ * ads1115AlertFd:
+ * ads1115AlertLost:
+ *	Take up to max alert events, oldest first, returning how many; an fd
+ *	that polls readable while there are some; and how many were lost
+ *	because the ring was full.
+ *********************************************************************************
+ */
+
+int ads1115AlertRead (int pinBase, struct ads1115AlertEvent *events, int max)
+{
+  struct ads1115Struct *c ;
+
+  if (((c = findChip (pinBase)) == NULL) || (c->alerts == NULL) || (max < 1))
+    return 0 ;
+
+  return (int)piRingPop (c->alerts, events, (unsigned int)max) ;
+}
+
+int ads1115AlertFd (int pinBase)
+{
+  struct ads1115Struct *c ;
+
+  if (((c = findChip (pinBase)) == NULL) || (c->alerts == NULL))
+    return -1 ;
+
+  return piRingFd (c->alerts) ;
+}
+
+unsigned int ads1115AlertLost (int pinBase)
+{
+  struct ads1115Struct *c ;
+
+  if ((c = findChip (pinBase)) == NULL)
+    return 0 ;
+
+  return __atomic_load_n (&c->alertsLost, __ATOMIC_RELAXED) ;
+}
@@ -44,11 +44,41 @@
 #define	ADS1115_DR_475		6
 #define	ADS1115_DR_860		7
 
+//	Comparator flags
+
+#define	ADS1115_COMP_WINDOW	1
+#define	ADS1115_COMP_LATCH	2
+#define	ADS1115_COMP_ACTIVE_HIGH	4
+
+#define	ADS1115_ALERT_DEPTH	32
+
+// ads1115AlertEvent:
+//	ALERT/RDY asserted, or let go. value is the conversion that set it
+//	off (in the chip's codes), and ns the edge time.
+
+struct ads1115AlertEvent
+{
+  unsigned long long ns ;
+  int                value ;
+  int                asserted ;
+} ;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-extern int ads1115Setup (int pinBase, int i2cAddress) ;
+extern int ads1115Setup    (int pinBase, int i2cAddress) ;
+extern int ads1115ReadyPin (int pinBase, int pin) ;
+
+extern int  ads1115ScanStart (int pinBase, unsigned int channels) ;
+extern void ads1115ScanStop  (int pinBase) ;
+
+extern int          ads1115Comparator    (int pinBase, int chan, int low, int high, int flags, int queue) ;
+extern void         ads1115ComparatorOff (int pinBase) ;
+extern int          ads1115AlertPin      (int pinBase, int pin, void (*function)(void *context, const struct ads1115AlertEvent *event), void *context) ;
+extern int          ads1115AlertRead     (int pinBase, struct ads1115AlertEvent *events, int max) ;
+extern int          ads1115AlertFd       (int pinBase) ;
+extern unsigned int ads1115AlertLost     (int pinBase) ;
 
 #ifdef __cplusplus
 }
@@ -32,6 +32,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "wiringPi.h"
 #include "wiringPiI2C.h"
@@ -41,7 +42,6 @@
 #undef	DEBUG
 
 #define	I2C_ADDRESS	0x77
-#define	BMP180_OSS	   0
 
 
 // Static calibration data
@@ -54,7 +54,6 @@ static uint16_t AC4, AC5, AC6 ;
 static  int16_t VB1, VB2 ;
 static  int16_t  MB,  MC, MD ;
 
-static double c5, c6, mc, md, x0, x1, x2, yy0, yy1, yy2, p0, p1, p2 ;
 
 // Pressure & Temp variables
 
@@ -70,71 +69,254 @@ static int altitude ;
 
 uint16_t read16 (int fd, int reg)
 {
-  return (wiringPiI2CReadReg8 (fd, reg) <<  8) | wiringPiI2CReadReg8 (fd, reg + 1) ;
+  int word = wiringPiI2CReadReg16 (fd, reg) ;	// SMBus words are little-endian
 
+  return ((word & 0xFF) << 8) | ((word >> 8) & 0xFF) ;
 }
 
 
+// Measurement state machine
+//	A measurement is a temperature conversion followed by a pressure one.
+//	bmp180Start () kicks one off and bmp180Collect () moves it along when
+//	the current conversion is due, so nobody has to sit in a delay.
+
+#define	BMP_IDLE	0
+#define	BMP_TEMP	1
+#define	BMP_PRESS	2
+
+static const unsigned int pressUs [4] = { 4500, 7500, 13500, 25500 } ;
+
+static int             bmpFd    = -1 ;
+static int             bmpPinBase ;
+static int             bmpState = BMP_IDLE ;
+static unsigned int    bmpDue ;
+static int32_t         bmpB5 ;		// From the temperature, for the pressure
+static int             bmpOss   = 0 ;	// Pressure oversampling: 1, 2, 4 or 8 samples
+static int             bmpOssRun ;	//  and for the conversion in progress
+static volatile int    bmpValid = FALSE ;
+static pthread_mutex_t bmpLock  = PTHREAD_MUTEX_INITIALIZER ;
+
+static pthread_t       bmpThread ;
+static volatile int    bmpPeriod = 0 ;	// Async mode when non-zero
+
+
 /*
- * bmp180ReadTempPress:
- *	Does the hard work of reading the sensor
+ * bmp180Start:
+ *	Start a temperature + pressure measurement, if one isn't running.
+ *********************************************************************************
+ */
+
+int bmp180Start (void)
+{
+  if ((bmpFd == -1) || (wiringPiFindNode (bmpPinBase) == NULL))	// Looking it up does any lazy init
+    return -1 ;
+
+  pthread_mutex_lock (&bmpLock) ;
+
+  if (bmpState == BMP_IDLE)
+  {
+    wiringPiI2CWriteReg8 (bmpFd, 0xF4, 0x2E) ;
+    bmpDue   = micros () + 4500 ;
+    bmpState = BMP_TEMP ;
+  }
+
+  pthread_mutex_unlock (&bmpLock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * bmp180Oversampling:
+ *	Set the pressure oversampling, 0 to 3 for 1 to 8 samples. Each step
+ *	halves the noise but takes longer - 4.5mS up to 25.5mS.
  *********************************************************************************
  */
 
-static void bmp180ReadTempPress (int fd)
+int bmp180Oversampling (int oss)
 {
-  double fTemp, fPress ;
-  double tu, a ;
-  double pu, s, x, y, z ;
+  if ((oss < 0) || (oss > 3))
+    return -1 ;
+
+  pthread_mutex_lock (&bmpLock) ;
+    bmpOss = oss ;
+  pthread_mutex_unlock (&bmpLock) ;
 
+  return 0 ;
+}
+
+
+/*
+ * bmp180Collect:
+ *	Move the measurement along if its conversion is done. Returns TRUE
+ *	when a whole measurement has been completed and the values updated,
+ *	FALSE while it's still in progress (or if none was started.)
+ *********************************************************************************
+ */
+
+int bmp180Collect (void)
+{
   uint8_t data [4] ;
+  int32_t ut, up, x1, x2, x3, b3, b6, p ;
+  uint32_t b4, b7 ;
+  int done = FALSE ;
 
-// Start a temperature sensor reading
+  pthread_mutex_lock (&bmpLock) ;
 
-  wiringPiI2CWriteReg8 (fd, 0xF4, 0x2E) ;
-  delay (5) ;
+  if ((bmpState == BMP_IDLE) || ((int)(micros () - bmpDue) < 0))
+  {
+    pthread_mutex_unlock (&bmpLock) ;
+    return FALSE ;
+  }
 
-// Read the raw data
+  if (bmpState == BMP_TEMP)
+  {
 
-  data [0] = wiringPiI2CReadReg8 (fd, 0xF6) ;
-  data [1] = wiringPiI2CReadReg8 (fd, 0xF7) ;
+// Read the raw data
 
-// And calculate...
+    if (wiringPiI2CReadBlock (bmpFd, 0xF6, data, 2) < 0)
+    {
+      data [0] = wiringPiI2CReadReg8 (bmpFd, 0xF6) ;
+      data [1] = wiringPiI2CReadReg8 (bmpFd, 0xF7) ;
+    }
 
-  tu = (data [0] * 256.0) + data [1] ;
+// And calculate, as the datasheet does it, in 0.1C
 
-  a = c5 * (tu - c6) ;
-  fTemp = a + (mc / (a + md)) ;
-  cTemp = (int)rint (((100.0 * fTemp) + 0.5) / 10.0) ;
+    ut    = (data [0] << 8) | data [1] ;
+    x1    = ((ut - AC6) * AC5) >> 15 ;
+    x2    = (MC * 2048) / (x1 + MD) ;
+    bmpB5 = x1 + x2 ;
+    cTemp = (bmpB5 + 8) >> 4 ;
 
 #ifdef	DEBUG
-  printf ("fTemp: %f, cTemp: %6d\n", fTemp, cTemp) ;
+    printf ("ut: %d, cTemp: %d\n", ut, cTemp) ;
 #endif
 
 // Start a pressure snsor reading
 
-  wiringPiI2CWriteReg8 (fd, 0xF4, 0x34 | (BMP180_OSS << 6)) ;
-  delay (5) ;
+    bmpOssRun = bmpOss ;
+    wiringPiI2CWriteReg8 (bmpFd, 0xF4, 0x34 | (bmpOssRun << 6)) ;
+    bmpDue   = micros () + pressUs [bmpOssRun] ;
+    bmpState = BMP_PRESS ;
+  }
+  else
+  {
 
 // Read the raw data
 
-  data [0] = wiringPiI2CReadReg8 (fd, 0xF6) ;
-  data [1] = wiringPiI2CReadReg8 (fd, 0xF7) ;
-  data [2] = wiringPiI2CReadReg8 (fd, 0xF8) ;
+    if (wiringPiI2CReadBlock (bmpFd, 0xF6, data, 3) < 0)
+    {
+      data [0] = wiringPiI2CReadReg8 (bmpFd, 0xF6) ;
+      data [1] = wiringPiI2CReadReg8 (bmpFd, 0xF7) ;
+      data [2] = wiringPiI2CReadReg8 (bmpFd, 0xF8) ;
+    }
+
+// And calculate, in Pa
+
+    up = ((data [0] << 16) | (data [1] << 8) | data [2]) >> (8 - bmpOssRun) ;
+
+    b6 = bmpB5 - 4000 ;
+    x1 = (VB2 * ((b6 * b6) >> 12)) >> 11 ;
+    x2 = (AC2 * b6) >> 11 ;
+    x3 = x1 + x2 ;
+    b3 = ((((int32_t)AC1 * 4 + x3) << bmpOssRun) + 2) / 4 ;
 
-// And calculate...
+    x1 = (AC3 * b6) >> 13 ;
+    x2 = (VB1 * ((b6 * b6) >> 12)) >> 16 ;
+    x3 = ((x1 + x2) + 2) >> 2 ;
+    b4 = (AC4 * (uint32_t)(x3 + 32768)) >> 15 ;
+    b7 = ((uint32_t)up - b3) * (50000 >> bmpOssRun) ;
 
-  pu = ((double)data [0] * 256.0) + (double)data [1] + ((double)data [2] / 256.0) ;
-  s = fTemp - 25.0 ;
-  x = (x2 * pow (s, 2.0)) + (x1 * s) + x0 ;
-  y = (yy2 * pow (s, 2.0)) + (yy1 * s) + yy0 ;
-  z = (pu - x) / y ;
-  fPress = (p2 * pow (z, 2.0)) + (p1 * z) + p0 ;
-  cPress = (int)rint (((100.0 * fPress) + 0.5) / 10.0) ;
+    if (b7 < 0x80000000)
+      p = (b7 * 2) / b4 ;
+    else
+      p = (b7 / b4) * 2 ;
+
+    x1 = (p >> 8) * (p >> 8) ;
+    x1 = (x1 * 3038) >> 16 ;
+    x2 = (-7357 * p) >> 16 ;
+    p += (x1 + x2 + 3791) >> 4 ;
+
+    cPress = (p + 5) / 10 ;		// 0.1mB
 
 #ifdef	DEBUG
-  printf ("fPress: %f, cPress: %6d\n", fPress, cPress) ;
+    printf ("up: %d, p: %d, cPress: %6d\n", up, p, cPress) ;
 #endif
+
+    bmpState = BMP_IDLE ;
+    bmpValid = TRUE ;
+    done     = TRUE ;
+  }
+
+  pthread_mutex_unlock (&bmpLock) ;
+
+  return done ;
+}
+
+
+/*
+ * bmp180ReadTempPress:
+ *	Do a whole measurement and wait for it.
+ *********************************************************************************
+ */
+
+static void bmp180ReadTempPress (void)
+{
+  bmp180Start () ;
+
+  while (!bmp180Collect ())
+    delayMicroseconds (500) ;
+}
+
+
+/*
+ * bmp180Thread:
+ * bmp180Async:
+ *	In async mode a thread keeps measurements going every periodMs and
+ *	analogRead just returns the latest values. A period of 0 stops it.
+ *********************************************************************************
+ */
+
+static void *bmp180Thread (UNU void *arg)
+{
+  unsigned int next = millis () ;
+
+  while (bmpPeriod != 0)
+  {
+    bmp180ReadTempPress () ;
+
+    next += bmpPeriod ;
+    if ((int)(next - millis ()) > 0)
+      delay (next - millis ()) ;
+    else
+      next = millis () ;
+  }
+
+  return NULL ;
+}
+
+int bmp180Async (int periodMs)
+{
+  if ((bmpFd == -1) || (wiringPiFindNode (bmpPinBase) == NULL))
+    return -1 ;
+
+  if (bmpPeriod != 0)			// Stop any running thread
+  {
+    bmpPeriod = 0 ;
+    pthread_join (bmpThread, NULL) ;
+  }
+
+  if (periodMs <= 0)
+    return 0 ;
+
+  bmpPeriod = periodMs ;
+  if (pthread_create (&bmpThread, NULL, bmp180Thread, NULL) != 0)
+  {
+    bmpPeriod = 0 ;
+    return wiringPiFailure (WPI_ALMOST, "bmp180Async: Unable to start thread\n") ;
+  }
+
+  return 0 ;
 }
 
 
@@ -162,7 +344,15 @@ static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
 {
   int chan = pin - node->pinBase ;
 
-  bmp180ReadTempPress (node->fd) ;
+// In async mode we wait for the first measurement, then never again
+
+  if (bmpPeriod != 0)
+  {
+    while (!bmpValid)
+      delay (1) ;
+  }
+  else
+    bmp180ReadTempPress () ;
 
   /**/ if (chan == 0)	// Read Temperature
     return cTemp ;
@@ -176,6 +366,47 @@ static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
 }
 
 
+/*
+ * myInit:
+ *	Read the calibration data
+ *********************************************************************************
+ */
+
+static int myInit (struct wiringPiNodeStruct *node)
+{
+  uint8_t calib [22] ;
+  int fd = node->fd ;
+
+// Read calibration data - all 22 bytes in one go if we can
+
+  if (wiringPiI2CReadBlock (fd, 0xAA, calib, 22) == 22)
+  {
+#define	CAL(n)	((calib [(n) * 2] << 8) | calib [(n) * 2 + 1])
+    AC1 = CAL (0) ; AC2 = CAL (1) ; AC3 = CAL (2) ;
+    AC4 = CAL (3) ; AC5 = CAL (4) ; AC6 = CAL (5) ;
+    VB1 = CAL (6) ; VB2 = CAL (7) ;
+     MB = CAL (8) ;  MC = CAL (9) ;  MD = CAL (10) ;
+#undef	CAL
+  }
+  else
+  {
+    AC1 = read16 (fd, 0xAA) ;
+    AC2 = read16 (fd, 0xAC) ;
+    AC3 = read16 (fd, 0xAE) ;
+    AC4 = read16 (fd, 0xB0) ;
+    AC5 = read16 (fd, 0xB2) ;
+    AC6 = read16 (fd, 0xB4) ;
+    VB1 = read16 (fd, 0xB6) ;
+    VB2 = read16 (fd, 0xB8) ;
+     MB = read16 (fd, 0xBA) ;
+     MC = read16 (fd, 0xBC) ;
+     MD = read16 (fd, 0xBE) ;
+  }
+
+  return TRUE ;
+}
+
+
 /*
  * bmp180Setup:
  *	Create a new instance of a PCF8591 I2C GPIO interface. We know it
@@ -187,7 +418,6 @@ static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
 
 int bmp180Setup (const int pinBase)
 {
-  double c3, c4, b1 ;
   int fd ;
   struct wiringPiNodeStruct *node ;
 
@@ -199,39 +429,8 @@ int bmp180Setup (const int pinBase)
   node->fd          = fd ;
   node->analogRead  = myAnalogRead ;
   node->analogWrite = myAnalogWrite ;
+  bmpFd             = fd ;
+  bmpPinBase        = pinBase ;
 
-// Read calibration data
-
-  AC1 = read16 (fd, 0xAA) ;
-  AC2 = read16 (fd, 0xAC) ;
-  AC3 = read16 (fd, 0xAE) ;
-  AC4 = read16 (fd, 0xB0) ;
-  AC5 = read16 (fd, 0xB2) ;
-  AC6 = read16 (fd, 0xB4) ;
-  VB1 = read16 (fd, 0xB6) ;
-  VB2 = read16 (fd, 0xB8) ;
-   MB = read16 (fd, 0xBA) ;
-   MC = read16 (fd, 0xBC) ;
-   MD = read16 (fd, 0xBE) ;
-
-// Calculate coefficients
-
-  c3 = 160.0 * pow (2.0, -15.0) * AC3 ;
-  c4 = pow (10.0, -3.0) * pow(2.0,-15.0) * AC4 ;
-  b1 = pow (160.0, 2.0) * pow(2.0,-30.0) * VB1 ;
-  c5 = (pow (2.0, -15.0) / 160.0) * AC5 ;
-  c6 = AC6 ;
-  mc = (pow (2.0, 11.0) / pow(160.0,2.0)) * MC ;
-  md = MD / 160.0 ;
-  x0 = AC1 ;
-  x1 = 160.0 * pow (2.0, -13.0) * AC2 ;
-  x2 = pow (160.0, 2.0) * pow(2.0,-25.0) * VB2 ;
-  yy0 = c4 * pow (2.0, 15.0) ;
-  yy1 = c4 * c3 ;
-  yy2 = c4 * b1 ;
-  p0 = (3791.0 - 8.0) / 1600.0 ;
-  p1 = 1.0 - 7357.0 * pow (2.0, -20.0) ;
-  p2 = 3038.0 * 100.0 * pow (2.0,  -36.0) ;
-
-  return TRUE ;
+  return wiringPiNodeInit (node, myInit) ;
 }
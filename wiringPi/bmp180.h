@@ -27,7 +27,12 @@
 extern "C" {
 #endif
 
-extern int bmp180Setup (const int pinBase) ;
+extern int bmp180Setup   (const int pinBase) ;
+
+extern int bmp180Start   (void) ;
+extern int bmp180Collect (void) ;
+extern int bmp180Async   (int periodMs) ;
+extern int bmp180Oversampling (int oss) ;
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,394 @@
+/*
+ * bscI2c.c:
+ *	I2C straight to the BSC master registers
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+/*
+ * Notes:
+ *	Every wiringPiI2CReadReg8 () through i2c-dev is an ioctl and a trip
+ *	through the kernel's I2C core and the bcm2835 driver, with interrupts
+ *	for the FIFO and completion. For short polled register accesses
+ *	that's most of the time the transaction takes. Here we drive the
+ *	BSC master's FIFO directly through /dev/mem instead, spinning on
+ *	its status register.
+ *
+ *	The kernel's driver still owns the controller and we don't tell it;
+ *	nothing else should use the bus while we do. It also keeps doing
+ *	what we don't: a transfer we can't do as one FIFO-driven sequence
+ *	fails with ENOTSUP and wiringPiI2C sends it through /dev/i2c-N
+ *	instead. What we do is a single write or read of any length, and a
+ *	write of up to a FIFO's worth followed by a read with a repeated
+ *	start - which is every register access.
+ *
+ *	The repeated start: once the write has started (TA), we load the
+ *	read's length and set ST again with READ; the controller goes
+ *	straight on to the read when the write's last byte has gone, with
+ *	no stop in between. That only works if the whole write is in the
+ *	FIFO by then, hence the limit.
+ *
+ *	Clock stretching: the controller waits for a stretched SCL itself,
+ *	for up to CLKT SCL cycles, which we set to about STRETCH_NS, then
+ *	gives up and flags it - ETIMEDOUT, as softI2c. We also give up
+ *	ourselves if the transfer doesn't finish in time.
+ *
+ *	Speed is set with the divider from the core clock. We don't know the
+ *	core clock, but the kernel does: it's its own divider times the
+ *	clock-frequency in the device tree. The new speed applies to the
+ *	kernel's transfers on the bus too.
+ *
+ *	BCM283x/2711 with /dev/mem only; there's nothing like it on the RP1.
+ *	Set a bus up, then open devices on it through wiringPiI2C as "bsc:N"
+ *	(or wiringPiI2CDefaultBus ("bsc:1")).
+ *********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "wiringPi.h"
+#include "wiringPiI2C.h"
+#include "bscI2c.h"
+
+#define	STRETCH_NS	25000000ULL	// 25mS as SMBus
+
+// Registers (word offsets) and bits
+
+#define	BSC_C		0
+#define	BSC_S		1
+#define	BSC_DLEN	2
+#define	BSC_A		3
+#define	BSC_FIFO	4
+#define	BSC_DIV		5
+#define	BSC_DEL		6
+#define	BSC_CLKT	7
+
+#define	BSC_C_I2CEN	0x8000
+#define	BSC_C_ST	0x0080
+#define	BSC_C_CLEAR	0x0030
+#define	BSC_C_READ	0x0001
+
+#define	BSC_S_CLKT	0x0200
+#define	BSC_S_ERR	0x0100
+#define	BSC_S_RXD	0x0020
+#define	BSC_S_TXD	0x0010
+#define	BSC_S_DONE	0x0002
+#define	BSC_S_TA	0x0001
+
+#define	BSC_FIFO_SIZE	16
+
+struct bscI2cStruct
+{
+  int                    used ;
+  volatile unsigned int *bsc ;
+  unsigned int           byteNs ;	// 9 SCL cycles
+} ;
+
+static struct bscI2cStruct bscI2cs [WPI_BSC_I2C_MAX_BUS] ;
+
+static const unsigned int bscOffsets [WPI_BSC_I2C_MAX_BUS] = { 0x205000, 0x804000 } ;
+static const char * const bscNodes   [WPI_BSC_I2C_MAX_BUS] =
+{
+  "/proc/device-tree/soc/i2c@7e205000/clock-frequency",
+  "/proc/device-tree/soc/i2c@7e804000/clock-frequency",
+} ;
+
+
+/*
+ * dtSpeed:
+ *	The speed the kernel runs a bus at, from the device tree: a big
+ *	endian 32-bit number. 100KHz if it's not there, as the kernel would.
+ *********************************************************************************
+ */
+
+static unsigned int dtSpeed (int bus)
+{
+  FILE *f ;
+  unsigned char b [4] ;
+  unsigned int speed = 100000 ;
+
+  if ((f = fopen (bscNodes [bus], "rb")) != NULL)
+  {
+    if (fread (b, 1, 4, f) == 4)
+      speed = ((unsigned int)b [0] << 24) | (b [1] << 16) | (b [2] << 8) | b [3] ;
+    fclose (f) ;
+  }
+
+  return (speed == 0) ? 100000 : speed ;
+}
+
+
+/*
+ * Transfer primitives:
+ *	start a transfer, wait for it, and sort out how it ended. All return
+ *	0, or -1 with errno set.
+ *********************************************************************************
+ */
+
+static void bscStart (volatile unsigned int *bsc, int addr, unsigned int len, uint32_t how)
+{
+  *(bsc + BSC_A)    = addr ;
+  *(bsc + BSC_DLEN) = len ;
+  *(bsc + BSC_C)    = BSC_C_I2CEN | BSC_C_ST | how ;
+}
+
+static int bscFinish (volatile unsigned int *bsc, int timedOut)
+{
+  uint32_t s = *(bsc + BSC_S) ;
+
+  *(bsc + BSC_C) = BSC_C_CLEAR ;		// Abandon anything left, disabled
+  *(bsc + BSC_S) = BSC_S_CLKT | BSC_S_ERR | BSC_S_DONE ;
+  __sync_synchronize () ;
+
+  /**/ if ((s & BSC_S_CLKT) != 0)
+    errno = ETIMEDOUT ;
+  else if ((s & BSC_S_ERR) != 0)		// NAK
+    errno = EIO ;
+  else if (timedOut)
+    errno = ETIMEDOUT ;
+  else
+    return 0 ;
+
+  return -1 ;
+}
+
+// bscWrite: bscRead:
+//	Keep the FIFO fed, or emptied, until the controller says it's done
+
+static int bscWrite (volatile unsigned int *bsc, const unsigned char *buf, unsigned int len, unsigned int sent, unsigned long long giveUp)
+{
+  while ((*(bsc + BSC_S) & BSC_S_DONE) == 0)
+  {
+    while ((sent < len) && ((*(bsc + BSC_S) & BSC_S_TXD) != 0))
+      *(bsc + BSC_FIFO) = buf [sent++] ;
+
+    if ((*(bsc + BSC_S) & (BSC_S_ERR | BSC_S_CLKT)) != 0)
+      break ;
+    if (nanos64 () > giveUp)
+      return bscFinish (bsc, TRUE) ;
+  }
+
+  return bscFinish (bsc, FALSE) ;
+}
+
+static int bscRead (volatile unsigned int *bsc, unsigned char *buf, unsigned int len, unsigned long long giveUp)
+{
+  unsigned int got = 0 ;
+
+  for (;;)
+  {
+    while ((got < len) && ((*(bsc + BSC_S) & BSC_S_RXD) != 0))
+      buf [got++] = *(bsc + BSC_FIFO) & 0xFF ;
+
+    if ((*(bsc + BSC_S) & BSC_S_DONE) != 0)
+    {
+      while ((got < len) && ((*(bsc + BSC_S) & BSC_S_RXD) != 0))
+	buf [got++] = *(bsc + BSC_FIFO) & 0xFF ;
+      break ;
+    }
+
+    if ((*(bsc + BSC_S) & (BSC_S_ERR | BSC_S_CLKT)) != 0)
+      break ;
+    if (nanos64 () > giveUp)
+      return bscFinish (bsc, TRUE) ;
+  }
+
+  if (bscFinish (bsc, FALSE) < 0)
+    return -1 ;
+
+  if (got < len)			// Shouldn't happen
+  {
+    errno = EIO ;
+    return -1 ;
+  }
+
+  return 0 ;
+}
+
+
+/*
+ * bscI2cTransfer:
+ *	Run a list of messages as one transaction, if it's a shape we can
+ *	do: one plain read or write, or a short write then a read with a
+ *	repeated start. The caller (wiringPiI2C) holds the bus lock.
+ *	Returns 0, or -1 with errno ENOTSUP for the kernel to do it, EIO for
+ *	a NAK or ETIMEDOUT if a slave held the clock low for too long.
+ *********************************************************************************
+ */
+
+int bscI2cTransfer (int bus, const int *addrs, const struct wpiI2cMsg *msgs, int numMsgs)
+{
+  struct bscI2cStruct *b ;
+  volatile unsigned int *bsc ;
+  const unsigned char *out ;
+  unsigned long long giveUp ;
+  unsigned int i, n ;
+
+  if (!bscI2cActive (bus))
+  {
+    errno = ENODEV ;
+    return -1 ;
+  }
+
+  if ((numMsgs > 2) || ((numMsgs == 2) &&
+	(msgs [0].read || !msgs [1].read || (msgs [0].len == 0) || (msgs [0].len > BSC_FIFO_SIZE) || (addrs [0] != addrs [1]))))
+  {
+    errno = ENOTSUP ;
+    return -1 ;
+  }
+
+  b      = &bscI2cs [bus] ;
+  bsc    = b->bsc ;
+  n      = msgs [0].len + ((numMsgs == 2) ? msgs [1].len : 0) + 2 ;
+  giveUp = nanos64 () + STRETCH_NS + (unsigned long long)b->byteNs * n ;
+
+  *(bsc + BSC_C) = BSC_C_I2CEN | BSC_C_CLEAR ;
+  *(bsc + BSC_S) = BSC_S_CLKT | BSC_S_ERR | BSC_S_DONE ;
+  __sync_synchronize () ;
+
+  if (numMsgs == 1)
+  {
+    if (msgs [0].read)
+    {
+      bscStart (bsc, addrs [0], msgs [0].len, BSC_C_READ) ;
+      return bscRead (bsc, (unsigned char *)msgs [0].buf, msgs [0].len, giveUp) ;
+    }
+
+// Prime the FIFO before starting, so the first bytes go back to back
+
+    out = (const unsigned char *)msgs [0].buf ;
+    n   = (msgs [0].len < BSC_FIFO_SIZE) ? msgs [0].len : BSC_FIFO_SIZE ;
+    for (i = 0 ; i < n ; ++i)
+      *(bsc + BSC_FIFO) = out [i] ;
+    bscStart (bsc, addrs [0], msgs [0].len, 0) ;
+    return bscWrite (bsc, out, msgs [0].len, n, giveUp) ;
+  }
+
+// Write then read: all the write goes in the FIFO, and we wait for it to start
+
+  out = (const unsigned char *)msgs [0].buf ;
+  for (i = 0 ; i < msgs [0].len ; ++i)
+    *(bsc + BSC_FIFO) = out [i] ;
+  bscStart (bsc, addrs [0], msgs [0].len, 0) ;
+
+  while ((*(bsc + BSC_S) & (BSC_S_TA | BSC_S_DONE)) == 0)
+    if (nanos64 () > giveUp)
+      return bscFinish (bsc, TRUE) ;
+
+  bscStart (bsc, addrs [1], msgs [1].len, BSC_C_READ) ;
+
+  return bscRead (bsc, (unsigned char *)msgs [1].buf, msgs [1].len, giveUp) ;
+}
+
+
+/*
+ * bscI2cSetup:
+ *	Take over a BSC master for direct transfers. speed is in Hz - 0 to
+ *	leave it as the kernel has it.
+ *	Returns 0 or -1 with errno set: ENODEV if there's no such controller
+ *	we can get at (a Pi 5, no /dev/mem, or simulating).
+ *********************************************************************************
+ */
+
+int bscI2cSetup (int bus, int speed)
+{
+  static int warned = FALSE ;
+  struct bscI2cStruct *b ;
+  unsigned int kernelDiv, core, div, clkt ;
+
+  if ((bus < 0) || (bus >= WPI_BSC_I2C_MAX_BUS) || bscI2cs [bus].used || (speed < 0))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  b = &bscI2cs [bus] ;
+
+  if ((b->bsc == NULL) && ((b->bsc = wiringPiPeriMap (bscOffsets [bus], 4096)) == NULL))
+  {
+    errno = ENODEV ;
+    return -1 ;
+  }
+
+// The core clock from the kernel's setting, and our divider from that
+
+  kernelDiv = *(b->bsc + BSC_DIV) & 0xFFFF ;
+  if (kernelDiv == 0)
+    kernelDiv = 32768 ;
+  core = kernelDiv * dtSpeed (bus) ;
+
+  if (speed == 0)
+    div = kernelDiv ;
+  else
+  {
+    div = (core + speed - 1) / speed ;
+    div = (div + 1) & ~1U ;			// Even, rounding down the speed
+    if (div < 2)
+      div = 2 ;
+    if (div > 0xFFFE)
+      div = 0xFFFE ;
+    *(b->bsc + BSC_DIV) = div ;
+  }
+
+  speed     = core / div ;
+  b->byteNs = (unsigned int)(9000000000ULL / speed) ;
+
+  clkt = (unsigned int)((unsigned long long)speed * STRETCH_NS / 1000000000ULL) ;
+  *(b->bsc + BSC_CLKT) = (clkt > 0xFFFF) ? 0xFFFF : clkt ;
+
+  b->used = TRUE ;
+
+  if (!warned)
+  {
+    warned = TRUE ;
+    fprintf (stderr, "bscI2cSetup: using BSC%d directly - nothing else must use it\n", bus) ;
+  }
+
+  return 0 ;
+}
+
+
+/*
+ * bscI2cActive:
+ * bscI2cClose:
+ *	Is a bus set up, and finish with one. The controller is left to the
+ *	kernel as it is, at whatever speed we set.
+ *********************************************************************************
+ */
+
+int bscI2cActive (int bus)
+{
+  return (bus >= 0) && (bus < WPI_BSC_I2C_MAX_BUS) && bscI2cs [bus].used ;
+}
+
+int bscI2cClose (int bus)
+{
+  if (!bscI2cActive (bus))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  bscI2cs [bus].used = FALSE ;
+
+  return 0 ;
+}
@@ -0,0 +1,47 @@
+/*
+ * bscI2c.h:
+ *	I2C straight to the BSC master registers
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+// BSC0 (the ID EEPROM pins) and BSC1 (the header's SDA.1/SCL.1)
+
+#define	WPI_BSC_I2C_MAX_BUS	2
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// For programs
+
+extern int bscI2cSetup (int bus, int speed) ;
+extern int bscI2cClose (int bus) ;
+
+// For the rest of wiringPi
+
+struct wpiI2cMsg ;
+
+extern int bscI2cActive   (int bus) ;
+extern int bscI2cTransfer (int bus, const int *addrs, const struct wpiI2cMsg *msgs, int numMsgs) ;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,221 @@
+/*
+ * dacStream.c:
+ *	Fixed-rate waveform output on SPI DACs
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+/*
+ * Notes:
+ *	Every sample is packed into its DAC command up front and each gets
+ *	an SPI segment of its own, with CS dropped after it (which is when
+ *	the DAC latches it) and a delay that fills out the sample period.
+ *	A thread sends them WPI_SPI_MAX_SEGS at a time, each message started
+ *	against an absolute deadline, so it's one ioctl per 32 samples and
+ *	the kernel does the pacing within a message to the microsecond.
+ *
+ *	Works with pins on an mcp4802 or max5322.
+ *********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "wiringPi.h"
+#include "wiringPiSPI.h"
+#include "mcp4802.h"
+#include "max5322.h"
+#include "dacStream.h"
+
+static unsigned char    *words = NULL ;		// 2 bytes a sample
+static struct wpiSpiSeg *segs  = NULL ;
+static int               numWords ;
+static int               spiChannel ;
+static int               repeats ;
+
+static unsigned long long periodNs ;
+static volatile int       running = FALSE ;
+static int                started = FALSE ;
+static pthread_t          dacThread ;
+static volatile unsigned int late ;
+
+
+/*
+ * dacStreamThread:
+ *********************************************************************************
+ */
+
+static void *dacStreamThread (UNU void *arg)
+{
+  struct wpiSpiSeg msg [WPI_SPI_MAX_SEGS] ;
+  unsigned long long next ;
+  int pos = 0, pass = 0, n ;
+
+  piHiPri (60) ;
+
+  next = nanos64 () ;
+
+  while (running)
+  {
+    if ((n = numWords - pos) > WPI_SPI_MAX_SEGS)
+      n = WPI_SPI_MAX_SEGS ;
+
+// The last segment ends the message: CS goes up anyway and the next
+//	message's deadline does its pacing
+
+    memcpy (msg, &segs [pos], n * sizeof (msg [0])) ;
+    msg [n - 1].csChange = FALSE ;
+    msg [n - 1].delayUs  = 0 ;
+
+    delayUntilNanos (next) ;
+    if (nanos64 () > next + periodNs)
+      ++late ;
+
+    wiringPiSPITransfer (spiChannel, msg, n) ;
+
+    next += n * periodNs ;
+    if (next + WPI_SPI_MAX_SEGS * periodNs < nanos64 ())	// Way behind - re-sync
+      next = nanos64 () ;
+
+    if ((pos += n) == numWords)
+    {
+      pos = 0 ;
+      if ((repeats != 0) && (++pass == repeats))
+	break ;
+    }
+  }
+
+  running = FALSE ;
+  return NULL ;
+}
+
+
+/*
+ * dacStreamStart:
+ *	Play numSamples samples out of a DAC pin at sampleRate samples per
+ *	second, repeat times over (0 for until dacStreamStop ()). The samples
+ *	are copied, so the buffer can go as soon as this returns.
+ *	Returns 0 or -1.
+ *********************************************************************************
+ */
+
+int dacStreamStart (int pin, const int *samples, int numSamples, int sampleRate, int repeat)
+{
+  unsigned int speed, wordUs, delayUs ;
+  int i, channel ;
+
+  if (running || (numSamples < 1) || (sampleRate <= 0) || (repeat < 0))
+    return -1 ;
+
+  dacStreamStop () ;
+
+  free (words) ;
+  free (segs) ;
+  words = malloc (numSamples * 2) ;
+  segs  = calloc (numSamples, sizeof (*segs)) ;
+  if ((words == NULL) || (segs == NULL))
+    return -1 ;
+
+  /**/ if ((channel = mcp4802Pack (pin, 0, words)) >= 0)
+  {
+    speed = MCP4802_SPI_SPEED ;
+    for (i = 0 ; i < numSamples ; ++i)
+      (void)mcp4802Pack (pin, samples [i], &words [i * 2]) ;
+  }
+  else if ((channel = max5322Pack (pin, 0, words)) >= 0)
+  {
+    speed = MAX5322_SPI_SPEED ;
+    for (i = 0 ; i < numSamples ; ++i)
+      (void)max5322Pack (pin, samples [i], &words [i * 2]) ;
+  }
+  else
+    return -1 ;
+
+  wordUs   = (16 * 1000000 + speed - 1) / speed ;
+  periodNs = 1000000000ULL / sampleRate ;
+
+  if (periodNs < wordUs * 1000ULL)		// Faster than the bus
+    return -1 ;
+
+// Spread any fraction of a microsecond in the period over the samples
+
+  for (i = 0 ; i < numSamples ; ++i)
+  {
+    delayUs = (unsigned int)(((i + 1) * periodNs) / 1000 - (i * periodNs) / 1000) ;
+
+    segs [i].tx       = &words [i * 2] ;
+    segs [i].len      = 2 ;
+    segs [i].csChange = TRUE ;
+    segs [i].speedHz  = speed ;
+    segs [i].delayUs  = (delayUs > wordUs) ? delayUs - wordUs : 0 ;
+  }
+
+  numWords   = numSamples ;
+  spiChannel = channel ;
+  repeats    = repeat ;
+  late       = 0 ;
+
+  running = TRUE ;
+  if (pthread_create (&dacThread, NULL, dacStreamThread, NULL) != 0)
+  {
+    running = FALSE ;
+    return -1 ;
+  }
+  started = TRUE ;
+
+  return 0 ;
+}
+
+
+/*
+ * dacStreamBusy:
+ * dacStreamLate:
+ *	Whether the stream is still playing, and how many of its messages
+ *	started more than a sample period late.
+ *********************************************************************************
+ */
+
+int dacStreamBusy (void)
+{
+  return running ;
+}
+
+unsigned int dacStreamLate (void)
+{
+  return late ;
+}
+
+
+/*
+ * dacStreamStop:
+ *********************************************************************************
+ */
+
+void dacStreamStop (void)
+{
+  if (!started)
+    return ;
+
+  running = FALSE ;
+  pthread_join (dacThread, NULL) ;
+  started = FALSE ;
+}
@@ -27,16 +27,202 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <string.h>
 #include <errno.h>
+#include <stddef.h>
 #include <crypt.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 
 
 #include "wiringPi.h"
 #include "drcNet.h"
 #include "../wiringPiD/drcNetCmd.h"
+#include "wiringPiTrace.h"
+
+// Per-remote state: the command batch being built up, and the
+//	subscriptions and queued edge events for drcNetISR.
+//	The lock is held for each complete request/reply on the socket so the
+//	event thread never reads the reply to someone else's request.
+
+#define	MAX_DRCNET	32
+#define	MAX_DRCNET_PINS	64
+#define	EVENT_QUEUE	64
+
+struct drcNetRemoteStruct
+{
+  struct wiringPiNodeStruct *node ;
+  pthread_mutex_t            lock ;
+
+  int                        active ;		// Batching
+  int                        deferred ;		// ... for wiringPiCommit
+  int                        count ;
+  struct drcNetComStruct     cmds [DRCN_MAX_BATCH + 1] ;	// [0] is the header
+
+  void (*isrs [MAX_DRCNET_PINS])(const struct wpiEdgeEventStruct *event) ;
+  int                        isrModes    [MAX_DRCNET_PINS] ;
+  int                        isrDebounce [MAX_DRCNET_PINS] ;
+  int                        threadRunning ;
+  int                        wakeFd ;
+  unsigned int               evHead, evTail ;
+  struct wpiEdgeEventStruct  events [EVENT_QUEUE] ;
+
+  int                        udpFd ;		// UDP writes, or -1
+  struct drcNetUdpKeyStruct  udpKey ;
+  uint32_t                   udpSeq ;
+
+  struct drcNetShmStruct    *shm ;		// Shared memory, or NULL
+
+  char                       host [128] ;	// For drcNetReconnect
+  char                       port [32] ;
+  char                      *password ;
+
+  int                        slot ;		// Bus statistics, or -1
+
+  int                        clockSamples ;	// drcNetTimeSync's so far
+  int64_t                    clockOffset ;	// Their CLOCK_MONOTONIC less ours ...
+  uint64_t                   clockRef ;		// ... at this on ours
+  uint64_t                   clockError ;	// ... give or take this
+  double                     clockDrift ;	// ... going up this much a nS
+  int                        driftSet ;
+  int64_t                    driftOffset ;	// Where the drift's measured from
+  uint64_t                   driftRef ;
+  uint64_t                   driftError ;
+
+  int                        cacheOn ;		// drcNetCache
+  uint64_t                   analogTtl ;	// nS, 0 to not cache analogReads
+  unsigned char              digitalState [MAX_DRCNET_PINS] ;	// CACHE_
+  unsigned char              digitalValue [MAX_DRCNET_PINS] ;
+  unsigned char              digitalOut   [MAX_DRCNET_PINS] ;	// We made it an OUTPUT
+  uint64_t                   digitalDue   [MAX_DRCNET_PINS] ;	// A digitalWriteAt, or 0
+  int                        analogValue  [MAX_DRCNET_PINS] ;
+  uint64_t                   analogTime   [MAX_DRCNET_PINS] ;	// When read, or 0
+
+  struct drcNetAsyncStruct  *asyncHead ;	// drcNetSubmit's waiting for replies,
+  struct drcNetAsyncStruct  *asyncTail ;	//	in the order they went
+  int                        asyncWatched ;	// Socket in asyncEpoll, or -1
+} ;
+
+// A digital pin in the cache: not looked at yet, subscribed to both
+//	edges so the value's kept up to date, subscribed but needing reading
+//	again, or one we can't (the server won't, or there's a drcNetISR
+//	wanting only some edges) so it's read every time.
+
+#define	CACHE_UNKNOWN		0
+#define	CACHE_VALID		1
+#define	CACHE_STALE		2
+#define	CACHE_NEVER		3
+
+static int  startEvents (struct drcNetRemoteStruct *r) ;
+static void cacheReset  (struct drcNetRemoteStruct *r) ;
+static void asyncFail   (struct drcNetRemoteStruct *r) ;
+
+static struct drcNetRemoteStruct remotes [MAX_DRCNET] ;
+
+// drcNetSubmit: each one is a batch frame, and its reply is the next
+//	batch reply on the socket. Whoever has the remote locked and finds it
+//	- the loop thread, or someone waiting for a reply of their own -
+//	takes it off the remote and on to the done list, and the loop thread
+//	calls them back.
+
+#define	MAX_ASYNC		1024
+
+struct drcNetAsyncStruct
+{
+  struct drcNetRemoteStruct *r ;
+  struct drcNetOpStruct     *ops ;
+  int                        n ;
+  int                        status ;
+  unsigned long long         t0 ;
+  void (*callback)(void *context, struct drcNetOpStruct *ops, int n, int status) ;
+  void                      *context ;
+  struct drcNetAsyncStruct  *next ;
+} ;
+
+static struct drcNetAsyncStruct  asyncPool [MAX_ASYNC] ;
+static struct drcNetAsyncStruct *asyncFree ;
+static struct drcNetAsyncStruct *asyncDoneHead, *asyncDoneTail ;
+static int                       asyncPending = 0 ;
+static int                       asyncWake    = -1 ;
+static int                       asyncEpoll   = -1 ;	// drcNetAsyncFd: no loop thread
+static pthread_mutex_t           asyncLock    = PTHREAD_MUTEX_INITIALIZER ;
+
+// Sessions we can resume with servers we've logged in to before, rather
+//	than answering the challenge with the password.
+
+struct drcNetSessionCacheStruct
+{
+  char                       host [128] ;
+  char                       port [32] ;
+  int                        valid ;
+  struct drcNetSessionStruct session ;
+} ;
+
+static struct drcNetSessionCacheStruct sessionCache [MAX_DRCNET] ;
+static pthread_mutex_t sessionLock = PTHREAD_MUTEX_INITIALIZER ;
+
+static struct drcNetRemoteStruct *findRemote (struct wiringPiNodeStruct *node)
+{
+  int i ;
+
+  for (i = 0 ; i < MAX_DRCNET ; ++i)
+    if (remotes [i].node == node)
+      return &remotes [i] ;
+
+  return NULL ;
+}
+
+static int remoteSlot (struct drcNetRemoteStruct *r)
+{
+  return (r == NULL) ? -1 : r->slot ;
+}
+
+static void lockRemote (struct drcNetRemoteStruct *r)
+{
+  if (r != NULL)
+    pthread_mutex_lock (&r->lock) ;
+}
+
+static void unlockRemote (struct drcNetRemoteStruct *r)
+{
+  if (r != NULL)
+    pthread_mutex_unlock (&r->lock) ;
+}
+
+// Moving times between our CLOCK_MONOTONIC and theirs, once there's been
+//	a drcNetTimeSync
+
+static uint64_t toRemote (const struct drcNetRemoteStruct *r, uint64_t local)
+{
+  return local + r->clockOffset + (int64_t)(r->clockDrift * (double)(int64_t)(local - r->clockRef)) ;
+}
+
+static uint64_t toLocal (const struct drcNetRemoteStruct *r, uint64_t remote)
+{
+  uint64_t guess = remote - r->clockOffset ;
+
+  return guess - (int64_t)(r->clockDrift * (double)(int64_t)(guess - r->clockRef)) ;
+}
+
+// One copy of the SipHash for both the UDP MAC and resuming sessions
+
+static __attribute__ ((noinline)) uint64_t sipHash (const uint8_t key [16], const void *data, unsigned int len)
+{
+  return drcNetSipHash (key, data, len) ;
+}
 
 
 /*
@@ -91,16 +277,139 @@ static char *getChallenge (int fd)
 }
 
 
+/*
+ * findSession:
+ * saveSession:
+ *	Look after the session cache. findSession returns a copy of the one
+ *	for host and port, if we have one.
+ *********************************************************************************
+ */
+
+static int findSession (const char *host, const char *port, struct drcNetSessionStruct *session)
+{
+  int i, found = FALSE ;
+
+  pthread_mutex_lock (&sessionLock) ;
+    for (i = 0 ; i < MAX_DRCNET ; ++i)
+      if (sessionCache [i].valid && (strcmp (sessionCache [i].host, host) == 0) && (strcmp (sessionCache [i].port, port) == 0))
+      {
+	*session = sessionCache [i].session ;
+	found    = TRUE ;
+	break ;
+      }
+  pthread_mutex_unlock (&sessionLock) ;
+
+  return found ;
+}
+
+static void saveSession (const char *host, const char *port, const struct drcNetSessionStruct *session)
+{
+  struct drcNetSessionCacheStruct *c = NULL ;
+  int i ;
+
+  pthread_mutex_lock (&sessionLock) ;
+    for (i = 0 ; i < MAX_DRCNET ; ++i)
+      if ((strcmp (sessionCache [i].host, host) == 0) && (strcmp (sessionCache [i].port, port) == 0))
+      {
+	c = &sessionCache [i] ;
+	break ;
+      }
+
+    for (i = 0 ; (c == NULL) && (i < MAX_DRCNET) ; ++i)
+      if (!sessionCache [i].valid)
+	c = &sessionCache [i] ;
+
+    if (c == NULL)
+      c = &sessionCache [0] ;
+
+    if (session == NULL)
+      c->valid = FALSE ;
+    else
+    {
+      snprintf (c->host, sizeof (c->host), "%s", host) ;
+      snprintf (c->port, sizeof (c->port), "%s", port) ;
+      c->session = *session ;
+      c->valid   = TRUE ;
+    }
+  pthread_mutex_unlock (&sessionLock) ;
+}
+
+
+/*
+ * sendLogin:
+ *	Send our answer to the challenge with a request for a session straight
+ *	after it, then wait for the reply to that. Getting the reply at all
+ *	means we're in - the server just hangs up on a bad answer.
+ *	Returns 1 with a new session, 0 if we're in but the server couldn't
+ *	make one, -1 if we're not in.
+ *********************************************************************************
+ */
+
+static int sendLogin (int fd, const char *answer, int len, struct drcNetSessionStruct *session)
+{
+  struct drcNetComStruct cmd ;
+  char buf [128] ;
+
+  cmd.pin  = 0 ;
+  cmd.cmd  = DRCN_SESSION ;
+  cmd.data = 0 ;
+
+  memcpy (buf, answer, len) ;
+  memcpy (buf + len, &cmd, sizeof (cmd)) ;
+  len += sizeof (cmd) ;
+
+  if (write (fd, buf, len) != len)
+    return -1 ;
+
+  if (recv (fd, &cmd, sizeof (cmd), MSG_WAITALL) != sizeof (cmd))
+    return -1 ;
+
+  if ((cmd.cmd & DRCN_CMD_MASK) != DRCN_SESSION)
+    return -1 ;
+
+  if (cmd.data != sizeof (*session))
+    return 0 ;
+
+  if (recv (fd, session, sizeof (*session), MSG_WAITALL) != sizeof (*session))
+    return -1 ;
+
+  return 1 ;
+}
+
+
+/*
+ * resume:
+ *	Answer the challenge with a session we had before - no crypt ()
+ *	needed, and our answer can't be replayed as the salt is new each time.
+ *	Returns as sendLogin.
+ *********************************************************************************
+ */
+
+static int resume (int fd, struct drcNetSessionStruct *session)
+{
+  char *challenge ;
+  char  answer [DRCN_RESUME_LEN + 1] ;
+
+  if ((challenge = getChallenge (fd)) == NULL)
+    return -1 ;
+
+  snprintf (answer, sizeof (answer), "Resume %016" PRIx64 " %016" PRIx64 "\n",
+	session->id, sipHash (session->key, challenge, strlen (challenge))) ;
+
+  return sendLogin (fd, answer, DRCN_RESUME_LEN, session) ;
+}
+
+
 /*
  * authenticate:
  *	Read in the challenge from the server, use it to encrypt our password
- *	and send it back to the server. Wait for a reply back from the server
- *	to say that we're good to go.
+ *	and send it back to the server, asking for a session as we go.
  *	The server will simply disconnect on a bad response. No 3 chances here.
+ *	Returns as sendLogin.
  *********************************************************************************
  */
 
-static int authenticate (int fd, const char *pass)
+static int authenticate (int fd, const char *pass, struct drcNetSessionStruct *session)
 {
   char *challenge ;
   char *encrypted ;
@@ -124,21 +433,17 @@ static int authenticate (int fd, const char *pass)
 
 // 86 characters is the length of the SHA-256 hash
 
-  if (write (fd, encrypted + 20, 86) == 86)
-    return 0 ;
-  else
-    return -1 ;
+  return sendLogin (fd, encrypted + 20, 86, session) ;
 }
 
 
 /*
- * _drcSetupNet:
- *	Do the hard work of establishing a network connection and authenticating
- *	the password.
+ * connectTo:
+ *	Make the network connection
  *********************************************************************************
  */
 
-int _drcSetupNet (const char *ipAddress, const char *port, const char *password)
+static int connectTo (const char *ipAddress, const char *port)
 {
   struct addrinfo hints;
   struct addrinfo *result, *rp ;
@@ -181,225 +486,2749 @@ int _drcSetupNet (const char *ipAddress, const char *port, const char *password)
       continue ;
 
     if (connect (remoteFd, rp->ai_addr, rp->ai_addrlen) < 0)
-      continue ;
-
-    if (authenticate (remoteFd, password) < 0)
     {
       close (remoteFd) ;
-      errno = EACCES ;		// Permission denied
-      return -1 ;
+      continue ;
     }
-    else
-      return remoteFd ;
+
+    freeaddrinfo (result) ;
+    return remoteFd ;
   }
 
+  freeaddrinfo (result) ;
   errno = EHOSTUNREACH ;	// Host unreachable - may not be right, but good enough
   return -1 ; // Nothing connected
 }
 
 
 /*
- * myPinMode:
- *	Change the pin mode on the remote DRC device
+ * _drcSetupNet:
+ *	Do the hard work of establishing a network connection and authenticating
+ *	the password. If we've been here before we try to resume the session
+ *	from last time first, which is one round trip and no hashing; if the
+ *	server has forgotten it (restarted, or timed it out) it hangs up and
+ *	we start again with the password.
  *********************************************************************************
  */
 
-static void myPinMode (struct wiringPiNodeStruct *node, int pin, int mode)
+int _drcSetupNet (const char *ipAddress, const char *port, const char *password)
 {
-  struct drcNetComStruct cmd ;
+  struct drcNetSessionStruct session ;
+  int remoteFd, result ;
 
-  cmd.pin  = pin - node->pinBase ;
-  cmd.cmd  = DRCN_PIN_MODE ;
-  cmd.data = mode ;
+  if (findSession (ipAddress, port, &session))
+  {
+    if ((remoteFd = connectTo (ipAddress, port)) < 0)
+      return -1 ;
+
+    if ((result = resume (remoteFd, &session)) >= 0)
+    {
+      saveSession (ipAddress, port, (result > 0) ? &session : NULL) ;
+      return remoteFd ;
+    }
+
+    close (remoteFd) ;
+    saveSession (ipAddress, port, NULL) ;
+  }
+
+  if ((remoteFd = connectTo (ipAddress, port)) < 0)
+    return -1 ;
+
+  if ((result = authenticate (remoteFd, password, &session)) < 0)
+  {
+    close (remoteFd) ;
+    errno = EACCES ;		// Permission denied
+    return -1 ;
+  }
+
+  if (result > 0)
+    saveSession (ipAddress, port, &session) ;
 
-  (void)send (node->fd, &cmd, sizeof (cmd), 0) ;
-  (void)recv (node->fd, &cmd, sizeof (cmd), 0) ;
+  return remoteFd ;
 }
 
 
 /*
- * myPullUpDnControl:
+ * recvReply:
+ *	Get the next reply from the server. Edge events it's pushed to us
+ *	can turn up at any time, so queue any of those we find on the way for
+ *	the event thread to deliver.
  *********************************************************************************
  */
 
-static void myPullUpDnControl (struct wiringPiNodeStruct *node, int pin, int mode)
+static int recvEvents (struct drcNetRemoteStruct *r, int fd, uint32_t count)
 {
-  struct drcNetComStruct cmd ;
+  struct drcNetEventStruct ev ;
+  uint64_t one = 1 ;
+  uint32_t i ;
+  int      pin ;
 
-  cmd.pin  = pin - node->pinBase ;
-  cmd.cmd  = DRCN_PULL_UP_DN ;
-  cmd.data = mode ;
+  for (i = 0 ; i < count ; ++i)
+  {
+    if (recv (fd, &ev, sizeof (ev), MSG_WAITALL) != sizeof (ev))
+      return -1 ;
 
-  (void)send (node->fd, &cmd, sizeof (cmd), 0) ;
-  (void)recv (node->fd, &cmd, sizeof (cmd), 0) ;
-}
+    if (r == NULL)
+      continue ;
+
+// An edge leaves the pin at its new level - that's the cache up to date
 
+    if (ev.pin < MAX_DRCNET_PINS)
+    {
+      if (r->digitalState [ev.pin] == CACHE_VALID)
+	r->digitalValue [ev.pin] = (ev.edge == INT_EDGE_RISING) ? HIGH : LOW ;
+      if (r->isrs [ev.pin] == NULL)
+	continue ;		// Only for the cache
+    }
+
+    if ((r->evHead - r->evTail) == EVENT_QUEUE)
+      continue ;		// Nowhere to put it
+
+    pin = r->node->pinBase + ev.pin ;
+    r->events [r->evHead % EVENT_QUEUE].pin       = pin ;
+    r->events [r->evHead % EVENT_QUEUE].edge      = ev.edge ;
+    r->events [r->evHead % EVENT_QUEUE].timestamp = (r->clockSamples > 0) ? toLocal (r, ev.timestamp) : ev.timestamp ;
+    ++r->evHead ;
+  }
+
+  if ((r != NULL) && (count > 0) && (r->wakeFd != -1))
+    write (r->wakeFd, &one, sizeof (one)) ;
+
+  return 0 ;
+}
 
 /*
- * myDigitalWrite:
+ * asyncDone:
+ * asyncReply:
+ *	Hand a drcNetSubmit on to the loop thread to call back, and fill one
+ *	in from its reply frame. Called with the remote locked.
  *********************************************************************************
  */
 
-static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
+static void asyncDone (struct drcNetAsyncStruct *a, int status)
 {
-  struct drcNetComStruct cmd ;
+  uint64_t one = 1 ;
 
-  cmd.pin  = pin - node->pinBase ;
-  cmd.cmd  = DRCN_DIGITAL_WRITE ;
-  cmd.data = value ;
+  a->status = status ;
+  a->next   = NULL ;
+
+  pthread_mutex_lock (&asyncLock) ;
+    if (asyncDoneTail == NULL)
+      asyncDoneHead = a ;
+    else
+      asyncDoneTail->next = a ;
+    asyncDoneTail = a ;
+  pthread_mutex_unlock (&asyncLock) ;
+
+  write (asyncWake, &one, sizeof (one)) ;
+}
 
-  (void)send (node->fd, &cmd, sizeof (cmd), 0) ;
-  (void)recv (node->fd, &cmd, sizeof (cmd), 0) ;
+static int asyncReply (struct drcNetRemoteStruct *r, int fd, const struct drcNetComStruct *header)
+{
+  struct drcNetComStruct    reply [DRCN_MAX_BATCH] ;
+  struct drcNetAsyncStruct *a = r->asyncHead ;
+  ssize_t  len ;
+  uint32_t i, j ;
+
+  if ((r->asyncHead = a->next) == NULL)
+    r->asyncTail = NULL ;
+
+  if (header->data > DRCN_MAX_BATCH)
+  {
+    asyncDone (a, -1) ;
+    return -1 ;
+  }
+
+  len = header->data * sizeof (struct drcNetComStruct) ;
+  if ((len > 0) && (recv (fd, reply, len, MSG_WAITALL) != len))
+  {
+    asyncDone (a, -1) ;
+    return -1 ;
+  }
+
+// The reads come back in order, so they go to the read ops in order
+
+  for (i = 0, j = 0 ; (i < (uint32_t)a->n) && (j < header->data) ; ++i)
+    if ((a->ops [i].op == DRCNET_DIGITAL_READ) || (a->ops [i].op == DRCNET_ANALOG_READ))
+      a->ops [i].value = (int)reply [j++].data ;
+
+  wiringPiBusStatsEnd (r->slot, a->t0, (a->n + 1 + header->data + 1) * sizeof (struct drcNetComStruct), FALSE) ;
+
+  asyncDone (a, 0) ;
+
+  return 0 ;
 }
 
 
 /*
- * myDigitalWrite8:
+ * otherFrame:
+ *	A frame that isn't the reply we're after: an edge event, or the reply
+ *	to a drcNetSubmit sent before. Returns TRUE if it was one of those
+ *	(and it's dealt with), FALSE if it's ours, or -1 if the socket's gone.
  *********************************************************************************
+ */
 
-static void myDigitalWrite8 (struct wiringPiNodeStruct *node, int pin, int value)
+static int otherFrame (struct drcNetRemoteStruct *r, int fd, const struct drcNetComStruct *cmd)
 {
-  struct drcNetComStruct cmd ;
+  if ((cmd->cmd & DRCN_CMD_MASK) == DRCN_EVENT)
+    return (recvEvents (r, fd, cmd->data) < 0) ? -1 : TRUE ;
 
-  cmd.pin  = pin - node->pinBase ;
-  cmd.cmd  = DRCN_DIGITAL_WRITE8 ;
-  cmd.data = value ;
+  if (((cmd->cmd & DRCN_CMD_MASK) == DRCN_BATCH) && (r != NULL) && (r->asyncHead != NULL))
+    return (asyncReply (r, fd, cmd) < 0) ? -1 : TRUE ;
 
-  (void)send (node->fd, &cmd, sizeof (cmd), 0) ;
-  (void)recv (node->fd, &cmd, sizeof (cmd), 0) ;
+  return FALSE ;
+}
+
+static int recvReply (struct wiringPiNodeStruct *node, struct drcNetComStruct *cmd)
+{
+  int other ;
+
+  for (;;)
+  {
+    if (recv (node->fd, cmd, sizeof (*cmd), MSG_WAITALL) != sizeof (*cmd))
+      return -1 ;
+
+    if ((other = otherFrame (findRemote (node), node->fd, cmd)) < 0)
+      return -1 ;
+
+    if (!other)
+      return 0 ;
+  }
 }
- */
 
 
 /*
- * myAnalogWrite:
+ * flushBatch:
+ *	Send a batch as one frame and get the reply frame back. The values
+ *	from any reads are stored in results (if not NULL.)
+ *	Called with the remote locked.
  *********************************************************************************
  */
 
-static void myAnalogWrite (struct wiringPiNodeStruct *node, int pin, int value)
+static int _flushBatch (struct drcNetRemoteStruct *b, int *results)
 {
-  struct drcNetComStruct cmd ;
+  struct drcNetComStruct reply [DRCN_MAX_BATCH + 1] ;
+  ssize_t  len ;
+  uint32_t i ;
 
-  cmd.pin  = pin - node->pinBase ;
-  cmd.cmd  = DRCN_ANALOG_WRITE ;
-  cmd.data = value ;
+  if (b->count == 0)
+    return 0 ;
+
+  b->cmds [0].pin  = 0 ;
+  b->cmds [0].cmd  = DRCN_BATCH ;
+  b->cmds [0].data = b->count ;
+
+  len      = (b->count + 1) * sizeof (struct drcNetComStruct) ;
+  b->count = 0 ;
+
+  if (send (b->node->fd, b->cmds, len, 0) != len)
+    return -1 ;
+
+  if (recvReply (b->node, &reply [0]) < 0)
+    return -1 ;
+
+  if (((reply [0].cmd & DRCN_CMD_MASK) != DRCN_BATCH) || (reply [0].data > DRCN_MAX_BATCH))
+    return -1 ;
+
+  len = reply [0].data * sizeof (struct drcNetComStruct) ;
+  if ((len > 0) && (recv (b->node->fd, &reply [1], len, MSG_WAITALL) != len))
+    return -1 ;
+
+  if (results != NULL)
+    for (i = 1 ; i <= reply [0].data ; ++i)
+      results [i - 1] = reply [i].data ;
 
-  (void)send (node->fd, &cmd, sizeof (cmd), 0) ;
-  (void)recv (node->fd, &cmd, sizeof (cmd), 0) ;
+  return reply [0].data ;
+}
+
+WPI_TRACE_SEMAPHORE (drcnet_batch) ;
+
+static int flushBatch (struct drcNetRemoteStruct *b, int *results)
+{
+  int len = (b->count + 1) * sizeof (struct drcNetComStruct) ;	// Before it's sent and reset
+  unsigned long long t0 ;
+  int result ;
+  WPI_TRACE_BEGIN (drcnet_batch) ;
+
+  t0     = wiringPiBusStatsBegin () ;
+  result = _flushBatch (b, results) ;
+  if (len > (int)sizeof (struct drcNetComStruct))
+    wiringPiBusStatsEnd (b->slot, t0, len + ((result > 0) ? result : 0) * sizeof (struct drcNetComStruct), result < 0) ;
+
+  WPI_TRACE_END (drcnet_batch, b->node, len, result) ;
+
+  return result ;
 }
 
 
 /*
- * myPwmWrite:
+ * udpSend:
+ *	Send a write as a signed datagram. Called with the remote locked.
  *********************************************************************************
  */
 
-static void myPwmWrite (struct wiringPiNodeStruct *node, int pin, int value)
+static int udpSend (struct drcNetRemoteStruct *r, const struct drcNetComStruct *cmd)
 {
-  struct drcNetComStruct cmd ;
+  struct drcNetUdpStruct dgram ;
+  int len ;
 
-  cmd.pin  = pin - node->pinBase ;
-  cmd.cmd  = DRCN_PWM_WRITE ;
-  cmd.data = value ;
+  len = offsetof (struct drcNetUdpStruct, cmds) + sizeof (struct drcNetComStruct) ;
+
+  dgram.session  = r->udpKey.session ;
+  dgram.seq      = ++r->udpSeq ;
+  dgram.count    = 1 ;
+  dgram.mac      = 0 ;
+  dgram.cmds [0] = *cmd ;
+  dgram.mac      = sipHash (r->udpKey.key, &dgram, len) ;
 
-  (void)send (node->fd, &cmd, sizeof (cmd), 0) ;
-  (void)recv (node->fd, &cmd, sizeof (cmd), 0) ;
+  return (send (r->udpFd, &dgram, len, 0) == len) ? 0 : -1 ;
 }
 
 
 /*
- * myAnalogRead:
+ * shmSend:
+ *	Put a command on the shared memory ring and, if we want one, wait for
+ *	the reply with the same tag. Called with the remote locked.
  *********************************************************************************
  */
 
-static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
+static int shmSend (struct drcNetRemoteStruct *r, struct drcNetComStruct *cmd, int wantReply)
 {
-  struct drcNetComStruct cmd ;
+  uint32_t tag = cmd->cmd & DRCN_TAG_MASK ;
 
-  cmd.pin  = pin - node->pinBase ;
-  cmd.cmd  = DRCN_ANALOG_READ ;
-  cmd.data = 0 ;
+  while (drcNetShmPush (&r->shm->toServer, cmd) < 0)
+  {
+    if (!__atomic_load_n (&r->shm->alive, __ATOMIC_ACQUIRE))
+      return -1 ;
+    usleep (100) ;
+  }
 
-  (void)send (node->fd, &cmd, sizeof (cmd), 0) ;
-  (void)recv (node->fd, &cmd, sizeof (cmd), 0) ;
+  if (!wantReply)
+    return 0 ;
 
-  return cmd.data ;
+  for (;;)
+  {
+    if (drcNetShmPop (r->shm, &r->shm->toClient, cmd, NULL) < 0)
+      return -1 ;
+    if ((cmd->cmd & DRCN_TAG_MASK) == tag)
+      return 0 ;
+  }
 }
 
 
 /*
- * myDigitalRead:
+ * coalesce:
+ *	A write to a pin already in the batch - with nothing else for that
+ *	pin after it - just replaces the value: last write wins.
  *********************************************************************************
  */
 
-static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
+static int coalesce (struct drcNetRemoteStruct *r, const struct drcNetComStruct *cmd)
 {
-  struct drcNetComStruct cmd ;
+  int i ;
 
-  cmd.pin  = pin - node->pinBase ;
-  cmd.cmd  = DRCN_DIGITAL_READ ;
-  cmd.data = 0 ;
+  if ((cmd->cmd != DRCN_DIGITAL_WRITE) && (cmd->cmd != DRCN_ANALOG_WRITE) && (cmd->cmd != DRCN_PWM_WRITE))
+    return FALSE ;
 
-  (void)send (node->fd, &cmd, sizeof (cmd), 0) ;
-  (void)recv (node->fd, &cmd, sizeof (cmd), 0) ;
+  for (i = r->count ; i > 0 ; --i)
+    if (r->cmds [i].pin == cmd->pin)
+    {
+      if (r->cmds [i].cmd != cmd->cmd)
+	return FALSE ;
+      r->cmds [i].data = cmd->data ;
+      return TRUE ;
+    }
 
-  return cmd.data ;
+  return FALSE ;
 }
 
 
 /*
- * myDigitalRead8:
+ * cacheWrite:
+ *	Keep the cache right through a write of our own. Only pins we've made
+ *	outputs take the value we wrote - anything else just needs reading
+ *	again. Called with the remote locked.
  *********************************************************************************
+ */
 
-static unsigned int myDigitalRead8 (struct wiringPiNodeStruct *node, int pin)
+static void cacheWrite (struct drcNetRemoteStruct *r, const struct drcNetComStruct *cmd)
 {
-  struct drcNetComStruct cmd ;
+  uint32_t pin  = cmd->pin ;
+  uint32_t bits = cmd->data ;
+  uint32_t mask, i ;
 
-  cmd.pin  = pin - node->pinBase ;
-  cmd.cmd  = DRCN_DIGITAL_READ8 ;
-  cmd.data = 0 ;
+  if ((r == NULL) || !r->cacheOn || (pin >= MAX_DRCNET_PINS))
+    return ;
 
-  (void)send (node->fd, &cmd, sizeof (cmd), 0) ;
-  (void)recv (node->fd, &cmd, sizeof (cmd), 0) ;
+  switch (cmd->cmd & DRCN_CMD_MASK)
+  {
+    case DRCN_DIGITAL_WRITE:      mask = 1 ; bits = (bits != LOW) ; break ;
+    case DRCN_DIGITAL_WRITE8:     mask = 0xFF ;   break ;
+    case DRCN_DIGITAL_WRITE16:    mask = 0xFFFF ; break ;
+    case DRCN_DIGITAL_WRITE_MASK: mask = bits >> 16 ; break ;
+
+    case DRCN_PIN_MODE:
+      r->digitalOut [pin] = (bits == OUTPUT) ;
+      // Fall through
+    case DRCN_PULL_UP_DN:
+      if (r->digitalState [pin] == CACHE_VALID)
+	r->digitalState [pin] = CACHE_STALE ;
+      return ;
+
+    case DRCN_ANALOG_WRITE:
+      r->analogTime [pin] = 0 ;
+      return ;
+
+    default:
+      return ;
+  }
 
-  return cmd.data ;
+  for (i = 0 ; (i < 16) && (pin + i < MAX_DRCNET_PINS) ; ++i)
+  {
+    if (((mask >> i) & 1) == 0 || (r->digitalState [pin + i] != CACHE_VALID))
+      continue ;
+    if (r->digitalOut [pin + i])
+      r->digitalValue [pin + i] = (bits >> i) & 1 ;
+    else
+      r->digitalState [pin + i] = CACHE_STALE ;
+  }
 }
- */
 
 
 /*
- * drcNet:
- *	Create a new instance of an DRC GPIO interface.
- *	Could be a variable nunber of pins here - we might not know in advance.
+ * sendCommand:
+ *	Send a command that doesn't return anything. Normally we wait for the
+ *	server to echo it back, but in pipelined mode we don't - the server
+ *	is told not to reply and drcNetSync () can be used to catch up.
  *********************************************************************************
  */
 
-int drcSetupNet (const int pinBase, const int numPins, const char *ipAddress, const char *port, const char *password)
+static void _sendCommand (struct wiringPiNodeStruct *node, int pin, uint32_t command, uint32_t data)
 {
-  int fd, len ;
-  struct wiringPiNodeStruct *node ;
+  struct drcNetComStruct cmd ;
+  struct drcNetRemoteStruct *r = findRemote (node) ;
+  unsigned long long t0 ;
+  int ok ;
 
-  if ((fd = _drcSetupNet (ipAddress, port, password)) < 0)
-    return FALSE ;
+  lockRemote (r) ;
 
-  len = sizeof (struct drcNetComStruct) ;
+  cmd.pin  = pin - node->pinBase ;
+  cmd.cmd  = command ;
+  cmd.data = data ;
 
-  if (setsockopt (fd, SOL_SOCKET, SO_RCVLOWAT, (void *)&len, sizeof (len)) < 0)
-    return FALSE ;
+  cacheWrite (r, &cmd) ;
 
-  node = wiringPiNewNode (pinBase, numPins) ;
+  t0 = wiringPiBusStatsBegin () ;
 
-  node->fd               = fd ;
+// Inside wiringPiBegin, or when async, we batch until myFlush
+
+  if ((r != NULL) && (r->shm == NULL) && !r->active && wiringPiNodeDeferred (node))
+    r->active = r->deferred = TRUE ;
+
+// Local shared memory beats everything, else UDP for fire and forget
+
+  if ((r != NULL) && (r->shm != NULL))
+  {
+    if (node->data0)
+    {
+      cmd.cmd |= DRCN_NO_ACK ;
+      ++node->data2 ;
+    }
+    ok = (shmSend (r, &cmd, !node->data0) == 0) ;
+    wiringPiBusStatsEnd (r->slot, t0, sizeof (cmd), !ok) ;
+    unlockRemote (r) ;
+    return ;
+  }
+
+  if ((r != NULL) && (r->udpFd != -1) && !r->active)
+  {
+    if ((ok = (udpSend (r, &cmd) == 0)))
+      ++node->data2 ;
+    wiringPiBusStatsEnd (r->slot, t0, sizeof (cmd), !ok) ;
+    unlockRemote (r) ;
+    return ;
+  }
+
+  if ((r != NULL) && r->active)
+  {
+    if (!coalesce (r, &cmd))
+    {
+      if (r->count == DRCN_MAX_BATCH)
+        flushBatch (r, NULL) ;
+      ++r->count ;
+      r->cmds [r->count] = cmd ;
+    }
+    if (r->deferred)
+      wiringPiNodeChanged (node) ;
+    unlockRemote (r) ;
+    return ;
+  }
+
+  if (node->data0)		// Pipelined
+  {
+    cmd.cmd |= DRCN_NO_ACK ;
+    ok = (send (node->fd, &cmd, sizeof (cmd), 0) == sizeof (cmd)) ;
+    ++node->data2 ;		// Unacknowledged count
+    wiringPiBusStatsEnd (remoteSlot (r), t0, sizeof (cmd), !ok) ;
+  }
+  else
+  {
+    ok = (send (node->fd, &cmd, sizeof (cmd), 0) == sizeof (cmd)) && (recvReply (node, &cmd) == 0) ;
+    wiringPiBusStatsEnd (remoteSlot (r), t0, 2 * sizeof (cmd), !ok) ;
+  }
+
+  unlockRemote (r) ;
+}
+
+WPI_TRACE_SEMAPHORE (drcnet_send) ;
+
+static void sendCommand (struct wiringPiNodeStruct *node, int pin, uint32_t command, uint32_t data)
+{
+  WPI_TRACE_BEGIN (drcnet_send) ;
+
+  _sendCommand (node, pin, command, data) ;
+
+  WPI_TRACE_END (drcnet_send, pin, node, command) ;
+}
+
+
+/*
+ * transact:
+ *	Send a command and wait for its reply. In pipelined mode each one
+ *	carries a tag so we can be sure the reply we get is the one we asked for.
+ *********************************************************************************
+ */
+
+static uint32_t _transact (struct wiringPiNodeStruct *node, int pin, uint32_t command, uint32_t data)
+{
+  struct drcNetComStruct cmd ;
+  struct drcNetRemoteStruct *r = findRemote (node) ;
+  uint32_t tag, result = 0 ;
+  unsigned long long t0 ;
+  int ok = FALSE ;
+
+  lockRemote (r) ;
+
+// Anything batched up has to go first
+
+  if ((r != NULL) && r->active)
+    flushBatch (r, NULL) ;
+
+  t0 = wiringPiBusStatsBegin () ;
+
+// Only tag in pipelined mode - older servers don't know about tags
+
+  tag = node->data0 ? ((node->data1++ << DRCN_TAG_SHIFT) & DRCN_TAG_MASK) : 0 ;
+
+  cmd.pin  = pin - node->pinBase ;
+  cmd.cmd  = command | tag ;
+  cmd.data = data ;
+
+  if ((r != NULL) && (r->shm != NULL) && (command != DRCN_SUBSCRIBE))
+  {
+    if ((ok = (shmSend (r, &cmd, TRUE) == 0)))
+      result = cmd.data ;
+  }
+  else if (send (node->fd, &cmd, sizeof (cmd), 0) == sizeof (cmd))
+  {
+    while (recvReply (node, &cmd) == 0)
+      if ((cmd.cmd & DRCN_TAG_MASK) == tag)
+      {
+        result = cmd.data ;
+        ok     = TRUE ;
+        break ;
+      }
+  }
+
+  wiringPiBusStatsEnd (remoteSlot (r), t0, 2 * sizeof (cmd), !ok) ;
+
+  unlockRemote (r) ;
+
+  return result ;
+}
+
+WPI_TRACE_SEMAPHORE (drcnet_transact) ;
+
+static uint32_t transact (struct wiringPiNodeStruct *node, int pin, uint32_t command, uint32_t data)
+{
+  uint32_t result ;
+  WPI_TRACE_BEGIN (drcnet_transact) ;
+
+  result = _transact (node, pin, command, data) ;
+
+  WPI_TRACE_END (drcnet_transact, pin, node, command) ;
+
+  return result ;
+}
+
+
+/*
+ * myFlush:
+ *	Send any batch started for wiringPiBegin
+ *********************************************************************************
+ */
+
+static void myFlush (struct wiringPiNodeStruct *node)
+{
+  struct drcNetRemoteStruct *r = findRemote (node) ;
+
+  if (r == NULL)
+    return ;
+
+  lockRemote (r) ;
+    if (r->deferred)
+    {
+      (void)flushBatch (r, NULL) ;
+      r->active = r->deferred = FALSE ;
+    }
+  unlockRemote (r) ;
+}
+
+
+/*
+ * myPinMode:
+ *	Change the pin mode on the remote DRC device
+ *********************************************************************************
+ */
+
+static void myPinMode (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  sendCommand (node, pin, DRCN_PIN_MODE, value) ;
+}
+
+
+/*
+ * myPullUpDnControl:
+ *********************************************************************************
+ */
+
+static void myPullUpDnControl (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  sendCommand (node, pin, DRCN_PULL_UP_DN, value) ;
+}
+
+
+/*
+ * myDigitalWrite:
+ *********************************************************************************
+ */
+
+static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  sendCommand (node, pin, DRCN_DIGITAL_WRITE, value) ;
+}
+
+
+/*
+ * myDigitalWrite8:
+ * myDigitalWrite16:
+ * myDigitalWriteMasked:
+ *	A whole port in one command. Only the bottom 16 bits of a masked
+ *	write get there - which is as wide as anything we do.
+ *********************************************************************************
+ */
+
+static void myDigitalWrite8 (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  sendCommand (node, pin, DRCN_DIGITAL_WRITE8, value & 0xFF) ;
+}
+
+static void myDigitalWrite16 (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  sendCommand (node, pin, DRCN_DIGITAL_WRITE16, value & 0xFFFF) ;
+}
+
+static void myDigitalWriteMasked (struct wiringPiNodeStruct *node, int pin, unsigned int value, unsigned int mask)
+{
+  sendCommand (node, pin, DRCN_DIGITAL_WRITE_MASK, ((mask & 0xFFFF) << 16) | (value & mask & 0xFFFF)) ;
+}
+
+
+/*
+ * myAnalogWrite:
+ *********************************************************************************
+ */
+
+static void myAnalogWrite (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  sendCommand (node, pin, DRCN_ANALOG_WRITE, value) ;
+}
+
+
+/*
+ * myPwmWrite:
+ *********************************************************************************
+ */
+
+static void myPwmWrite (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  sendCommand (node, pin, DRCN_PWM_WRITE, value) ;
+}
+
+
+/*
+ * cacheFill:
+ *	Start keeping a digital pin in the cache: subscribe to both edges -
+ *	unless a drcNetISR already has - and read where it is now. Edges from
+ *	then on keep it right. Called with the remote locked.
+ *********************************************************************************
+ */
+
+static void cacheFill (struct wiringPiNodeStruct *node, struct drcNetRemoteStruct *r, int pin, int local)
+{
+  if (r->digitalState [local] == CACHE_NEVER)
+    return ;
+
+  if (r->digitalState [local] == CACHE_UNKNOWN)
+  {
+    if (r->isrs [local] != NULL)
+    {
+      if ((r->isrModes [local] != INT_EDGE_BOTH) || (r->isrDebounce [local] != 0))
+      {
+	r->digitalState [local] = CACHE_NEVER ;
+	return ;
+      }
+    }
+    else if ((transact (node, pin, DRCN_SUBSCRIBE, INT_EDGE_BOTH) != 0) || (startEvents (r) < 0))
+    {
+      r->digitalState [local] = CACHE_NEVER ;
+      return ;
+    }
+  }
+
+  r->digitalValue [local] = transact (node, pin, DRCN_DIGITAL_READ, 0) ? HIGH : LOW ;
+  r->digitalState [local] = CACHE_VALID ;
+}
+
+
+/*
+ * myAnalogRead:
+ * myDigitalRead:
+ * myDigitalRead8:
+ * myDigitalRead16:
+ *********************************************************************************
+ */
+
+static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
+{
+  struct drcNetRemoteStruct *r = findRemote (node) ;
+  int      local = pin - node->pinBase ;
+  uint64_t now ;
+  int      value ;
+
+  if ((r == NULL) || !r->cacheOn || (r->analogTtl == 0) || (local >= MAX_DRCNET_PINS))
+    return transact (node, pin, DRCN_ANALOG_READ, 0) ;
+
+  lockRemote (r) ;
+    now = drcNetClock () ;
+    if ((r->analogTime [local] == 0) || ((now - r->analogTime [local]) >= r->analogTtl))
+    {
+      r->analogValue [local] = transact (node, pin, DRCN_ANALOG_READ, 0) ;
+      r->analogTime  [local] = now ;
+    }
+    value = r->analogValue [local] ;
+  unlockRemote (r) ;
+
+  return value ;
+}
+
+static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
+{
+  struct drcNetRemoteStruct *r = findRemote (node) ;
+  int local = pin - node->pinBase ;
+  int value ;
+
+  if ((r == NULL) || !r->cacheOn || (local >= MAX_DRCNET_PINS))
+    return transact (node, pin, DRCN_DIGITAL_READ, 0) ;
+
+  lockRemote (r) ;
+    if ((r->digitalDue [local] != 0) && (drcNetClock () >= r->digitalDue [local]))
+    {
+      r->digitalDue [local] = 0 ;
+      if (r->digitalState [local] == CACHE_VALID)
+	r->digitalState [local] = CACHE_STALE ;
+    }
+
+    if (r->digitalState [local] != CACHE_VALID)
+      cacheFill (node, r, pin, local) ;
+
+    value = (r->digitalState [local] == CACHE_VALID) ? r->digitalValue [local] : transact (node, pin, DRCN_DIGITAL_READ, 0) ;
+  unlockRemote (r) ;
+
+  return value ;
+}
+
+static unsigned int myDigitalRead8 (struct wiringPiNodeStruct *node, int pin)
+{
+  return transact (node, pin, DRCN_DIGITAL_READ8, 0) ;
+}
+
+static unsigned int myDigitalRead16 (struct wiringPiNodeStruct *node, int pin)
+{
+  return transact (node, pin, DRCN_DIGITAL_READ16, 0) ;
+}
+
+
+/*
+ * drcNetPipeline:
+ *	Turn pipelined mode on or off for the remote at pinBase. In pipelined
+ *	mode writes are sent without waiting for the server to acknowledge
+ *	them, so a run of writes costs one trip rather than one each. Needs a
+ *	wiringPiD that knows about DRCN_NO_ACK.
+ *********************************************************************************
+ */
+
+static struct wiringPiNodeStruct *findDrcNet (const int pinBase)
+{
+  struct wiringPiNodeStruct *node = wiringPiFindNode (pinBase) ;
+
+  if ((node == NULL) || (node->pinMode != myPinMode))
+    return NULL ;
+
+  return node ;
+}
+
+int drcNetPipeline (const int pinBase, const int on)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if ((node = findDrcNet (pinBase)) == NULL)
+    return -1 ;
+
+  if (!on && node->data0)
+    drcNetSync (pinBase) ;
+
+  node->data0 = on ? 1 : 0 ;
+
+  return 0 ;
+}
+
+
+/*
+ * drcNetSync:
+ *	Wait for the server to have carried out everything we've sent it.
+ *	Returns the number of un-acknowledged commands it ran since the last
+ *	sync, or -1 if it doesn't agree with what we sent.
+ *********************************************************************************
+ */
+
+int drcNetSync (const int pinBase)
+{
+  struct wiringPiNodeStruct *node ;
+  uint32_t done ;
+  unsigned int sent ;
+
+  if ((node = findDrcNet (pinBase)) == NULL)
+    return -1 ;
+
+  sent        = node->data2 ;
+  node->data2 = 0 ;
+
+  done = transact (node, node->pinBase, DRCN_SYNC, 0) ;
+
+  return (done == sent) ? (int)done : -1 ;
+}
+
+
+/*
+ * drcNetBatchBegin:
+ * drcNetBatchEnd:
+ *	Between these, writes to the remote at pinBase are collected and sent
+ *	as one batch frame (or more, every DRCN_MAX_BATCH commands.) A read
+ *	sends what's been collected first. drcNetBatchEnd sends the rest and
+ *	waits for the server to have done it.
+ *********************************************************************************
+ */
+
+int drcNetBatchBegin (const int pinBase)
+{
+  struct wiringPiNodeStruct *node ;
+  struct drcNetRemoteStruct *r ;
+
+  if ((node = findDrcNet (pinBase)) == NULL)
+    return -1 ;
+
+  if ((r = findRemote (node)) == NULL)
+    return -1 ;
+
+  lockRemote (r) ;
+    r->active   = TRUE ;
+    r->deferred = FALSE ;	// It's ours until drcNetBatchEnd now
+  unlockRemote (r) ;
+
+  return 0 ;
+}
+
+int drcNetBatchEnd (const int pinBase)
+{
+  struct wiringPiNodeStruct *node ;
+  struct drcNetRemoteStruct *r ;
+  int result ;
+
+  if ((node = findDrcNet (pinBase)) == NULL)
+    return -1 ;
+
+  if ((r = findRemote (node)) == NULL)
+    return 0 ;
+
+  lockRemote (r) ;
+    result    = flushBatch (r, NULL) ;
+    r->active = FALSE ;
+  unlockRemote (r) ;
+
+  return (result < 0) ? -1 : 0 ;
+}
+
+
+/*
+ * clockSample:
+ *	A few rounds of DRCN_TIME, keeping the one with the shortest round
+ *	trip - its offset is the one least upset by the network. The drift
+ *	is only worked out again once we're far enough on from where last
+ *	time it was that the error in the two offsets hardly matters.
+ *	Called with the remote locked.
+ *********************************************************************************
+ */
+
+#define	CLOCK_ROUNDS		8
+#define	DRIFT_SPAN		100000		// Times the errors: 10ppm at worst
+
+static int clockSample (struct drcNetRemoteStruct *r)
+{
+  struct wiringPiNodeStruct *node = r->node ;
+  struct drcNetComStruct     cmd ;
+  struct drcNetTimeStruct    t ;
+  uint64_t t1, t4, rtt, at = 0, error = UINT64_MAX ;
+  int64_t  offset = 0 ;
+  uint32_t tag ;
+  int i ;
+
+  if (r->active)
+    flushBatch (r, NULL) ;
+
+  for (i = 0 ; i < CLOCK_ROUNDS ; ++i)
+  {
+    tag = node->data0 ? ((node->data1++ << DRCN_TAG_SHIFT) & DRCN_TAG_MASK) : 0 ;
+
+    cmd.pin  = 0 ;
+    cmd.cmd  = DRCN_TIME | tag ;
+    cmd.data = 0 ;
+
+    t1 = drcNetClock () ;
+    if (send (node->fd, &cmd, sizeof (cmd), 0) != sizeof (cmd))
+      return -1 ;
+
+    do
+      if (recvReply (node, &cmd) < 0)
+	return -1 ;
+    while ((cmd.cmd & DRCN_TAG_MASK) != tag) ;
+
+    if (((cmd.cmd & DRCN_CMD_MASK) != DRCN_TIME) || (cmd.data != sizeof (t)) ||
+	(recv (node->fd, &t, sizeof (t), MSG_WAITALL) != sizeof (t)))
+      return -1 ;
+    t4 = drcNetClock () ;
+
+    rtt = (t4 - t1) - (t.sent - t.received) ;
+    if (rtt / 2 < error)
+    {
+      error  = rtt / 2 ;
+      offset = ((int64_t)(t.received - t1) + (int64_t)(t.sent - t4)) / 2 ;
+      at     = t1 + (t4 - t1) / 2 ;
+    }
+  }
+
+  if (r->clockSamples == 0)
+  {
+    r->driftOffset = offset ;
+    r->driftRef    = at ;
+    r->driftError  = error ;
+  }
+  else if ((at - r->driftRef) > DRIFT_SPAN * (r->driftError + error))
+  {
+    double drift = (double)(offset - r->driftOffset) / (double)(at - r->driftRef) ;
+
+    r->clockDrift  = r->driftSet ? (r->clockDrift + drift) / 2 : drift ;
+    r->driftSet    = TRUE ;
+    r->driftOffset = offset ;
+    r->driftRef    = at ;
+    r->driftError  = error ;
+  }
+
+  r->clockOffset = offset ;
+  r->clockRef    = at ;
+  r->clockError  = error ;
+  ++r->clockSamples ;
+
+  return 0 ;
+}
+
+
+/*
+ * drcNetTimeSync:
+ *	Work out (again) how the clock on the server at pinBase is from ours,
+ *	so the timestamps on its drcNetISR events are on our CLOCK_MONOTONIC
+ *	and digitalWriteAt () times are on its. Call it every so often: each
+ *	time the offset's brought up to date, and once they've been far
+ *	enough apart the drift between the clocks is taken into account too.
+ *	Returns how far out it could be in nS, or -1.
+ *********************************************************************************
+ */
+
+long long drcNetTimeSync (const int pinBase)
+{
+  struct wiringPiNodeStruct *node ;
+  struct drcNetRemoteStruct *r ;
+  long long result ;
+
+  if (((node = findDrcNet (pinBase)) == NULL) || ((r = findRemote (node)) == NULL))
+    return -1 ;
+
+  lockRemote (r) ;
+    result = (clockSample (r) < 0) ? -1 : (long long)r->clockError ;
+  unlockRemote (r) ;
+
+  return result ;
+}
+
+
+/*
+ * drcNetTimeToLocal:
+ * drcNetTimeToRemote:
+ *	CLOCK_MONOTONIC nS on the server at pinBase to ours, and back.
+ *	Unchanged if there's not been a drcNetTimeSync.
+ *********************************************************************************
+ */
+
+unsigned long long drcNetTimeToLocal (const int pinBase, unsigned long long remoteNs)
+{
+  struct wiringPiNodeStruct *node ;
+  struct drcNetRemoteStruct *r ;
+
+  if (((node = findDrcNet (pinBase)) == NULL) || ((r = findRemote (node)) == NULL) || (r->clockSamples == 0))
+    return remoteNs ;
+
+  return toLocal (r, remoteNs) ;
+}
+
+unsigned long long drcNetTimeToRemote (const int pinBase, unsigned long long localNs)
+{
+  struct wiringPiNodeStruct *node ;
+  struct drcNetRemoteStruct *r ;
+
+  if (((node = findDrcNet (pinBase)) == NULL) || ((r = findRemote (node)) == NULL) || (r->clockSamples == 0))
+    return localNs ;
+
+  return toRemote (r, localNs) ;
+}
+
+
+/*
+ * sendWriteAt:
+ *	Send a DRCN_WRITE_AT for tNs on our nanos64 () clock, syncing the
+ *	clocks first if they never have been. Called with the remote locked.
+ *********************************************************************************
+ */
+
+static int sendWriteAt (struct drcNetRemoteStruct *r, struct drcNetComStruct *cmd, unsigned long long tNs)
+{
+  unsigned char buf [sizeof (*cmd) + sizeof (uint64_t)] ;
+  uint64_t when ;
+
+  if ((r->clockSamples == 0) && (clockSample (r) < 0))
+    return -1 ;
+
+  if (r->active)
+    flushBatch (r, NULL) ;
+
+  when = toRemote (r, drcNetClock () + (tNs - nanos64 ())) ;
+
+  memcpy (buf,                 cmd,   sizeof (*cmd)) ;
+  memcpy (buf + sizeof (*cmd), &when, sizeof (when)) ;
+
+  return (send (r->node->fd, buf, sizeof (buf), 0) == sizeof (buf)) ? 0 : -1 ;
+}
+
+
+/*
+ * cacheDue:
+ *	A digitalWriteAt () on a pin: it'll need reading again once it's done.
+ *	Called with the remote locked.
+ *********************************************************************************
+ */
+
+static void cacheDue (struct drcNetRemoteStruct *r, uint32_t pin, unsigned long long tNs)
+{
+  if ((r == NULL) || !r->cacheOn || (pin >= MAX_DRCNET_PINS))
+    return ;
+
+  r->digitalDue [pin] = drcNetClock () + ((tNs > nanos64 ()) ? (tNs - nanos64 ()) : 0) + 1 ;
+}
+
+
+/*
+ * myDigitalWriteAt:
+ *	digitalWriteAt () on a remote pin: the server does it at the time, so
+ *	it's as close as its clock and ours agree rather than whenever it gets
+ *	there.
+ *********************************************************************************
+ */
+
+static int myDigitalWriteAt (struct wiringPiNodeStruct *node, int pin, int value, unsigned long long tNs)
+{
+  struct drcNetComStruct     cmd ;
+  struct drcNetRemoteStruct *r = findRemote (node) ;
+  unsigned long long t0 ;
+  uint32_t tag ;
+  int ok = FALSE ;
+
+  lockRemote (r) ;
+
+  t0  = wiringPiBusStatsBegin () ;
+  tag = node->data0 ? ((node->data1++ << DRCN_TAG_SHIFT) & DRCN_TAG_MASK) : 0 ;
+
+  cmd.pin  = pin - node->pinBase ;
+  cmd.cmd  = DRCN_WRITE_AT | tag | (node->data0 ? DRCN_NO_ACK : 0) ;
+  cmd.data = (value != LOW) ? HIGH : LOW ;
+
+  cacheDue (r, cmd.pin, tNs) ;
+
+  if (sendWriteAt (r, &cmd, tNs) == 0)
+  {
+    if (node->data0)		// Pipelined
+    {
+      ++node->data2 ;
+      ok = TRUE ;
+    }
+    else
+      ok = (recvReply (node, &cmd) == 0) && (cmd.data == 0) ;
+  }
+
+  wiringPiBusStatsEnd (r->slot, t0, 2 * sizeof (cmd) + sizeof (uint64_t), !ok) ;
+
+  unlockRemote (r) ;
+
+  if (!ok)
+  {
+    errno = EIO ;
+    return -1 ;
+  }
+
+  return 0 ;
+}
+
+
+/*
+ * drcNetReadMulti:
+ * drcNetAnalogReadMulti:
+ * drcNetDigitalReadMulti:
+ *	Read a set of remote pins in one batch frame each way. Anything
+ *	queued by drcNetBatchBegin goes in the same frame, ahead of the reads.
+ *	Returns 0, or -1 on a network error.
+ *********************************************************************************
+ */
+
+static int drcNetReadMulti (const int pinBase, uint32_t command, const int *pins, int *values, const int count)
+{
+  struct wiringPiNodeStruct *node ;
+  struct drcNetRemoteStruct  temp, *b, *r ;
+  int done, chunk, i, wasActive ;
+
+  if ((node = findDrcNet (pinBase)) == NULL)
+    return -1 ;
+
+  r = b = findRemote (node) ;
+
+// Over shared memory there's no batching - and it wouldn't help much
+
+  if ((r != NULL) && (r->shm != NULL))
+  {
+    for (i = 0 ; i < count ; ++i)
+      values [i] = transact (node, pins [i], command, 0) ;
+    return 0 ;
+  }
+
+  if (r == NULL)
+  {
+    memset (&temp, 0, sizeof (temp)) ;
+    temp.node = node ;
+    b = &temp ;
+  }
+
+  lockRemote (r) ;
+
+  wasActive = b->active ;
+  b->active = FALSE ;		// So reads don't end up in sendCommand ()
+
+  for (done = 0 ; done < count ; done += chunk)
+  {
+    if (b->count == DRCN_MAX_BATCH)
+      if (flushBatch (b, NULL) < 0)
+        break ;
+
+    chunk = count - done ;
+    if (chunk > DRCN_MAX_BATCH - b->count)
+      chunk = DRCN_MAX_BATCH - b->count ;
+
+    for (i = 0 ; i < chunk ; ++i)
+    {
+      ++b->count ;
+      b->cmds [b->count].pin  = pins [done + i] - node->pinBase ;
+      b->cmds [b->count].cmd  = command ;
+      b->cmds [b->count].data = 0 ;
+    }
+
+    if (flushBatch (b, values + done) != chunk)
+      break ;
+  }
+
+  b->active = wasActive ;
+
+  unlockRemote (r) ;
+
+  return (done >= count) ? 0 : -1 ;
+}
+
+int drcNetAnalogReadMulti (const int pinBase, const int *pins, int *values, const int count)
+{
+  return drcNetReadMulti (pinBase, DRCN_ANALOG_READ, pins, values, count) ;
+}
+
+int drcNetDigitalReadMulti (const int pinBase, const int *pins, int *values, const int count)
+{
+  return drcNetReadMulti (pinBase, DRCN_DIGITAL_READ, pins, values, count) ;
+}
+
+
+/*
+ * openTransport:
+ *	Ask the server for a UDP key or shared memory socket name - a reply
+ *	header with the length in data, then that many bytes. Returns the
+ *	length or -1.
+ *	Called with the remote locked.
+ *********************************************************************************
+ */
+
+static int openTransport (struct wiringPiNodeStruct *node, uint32_t command, uint32_t data, void *buf, int max)
+{
+  struct drcNetComStruct cmd ;
+
+  cmd.pin  = 0 ;
+  cmd.cmd  = command ;
+  cmd.data = data ;
+
+  if (send (node->fd, &cmd, sizeof (cmd), 0) != sizeof (cmd))
+    return -1 ;
+
+  do
+  {
+    if (recvReply (node, &cmd) < 0)
+      return -1 ;
+  }
+  while ((cmd.cmd & DRCN_CMD_MASK) != command) ;
+
+  if ((cmd.data == 0) || ((int)cmd.data > max))
+    return -1 ;
+
+  if (recv (node->fd, buf, cmd.data, MSG_WAITALL) != (ssize_t)cmd.data)
+    return -1 ;
+
+  return cmd.data ;
+}
+
+
+/*
+ * drcNetUdp:
+ *	Send writes to the remote at pinBase as signed, unacknowledged UDP
+ *	datagrams rather than over the TCP connection. Reads still use TCP,
+ *	and there's no ordering between the two - use drcNetSync () where
+ *	it matters, which also says if any datagrams went missing.
+ *********************************************************************************
+ */
+
+int drcNetUdp (const int pinBase, const int on)
+{
+  struct wiringPiNodeStruct *node ;
+  struct drcNetRemoteStruct *r ;
+  struct sockaddr_storage peer ;
+  socklen_t peerLen = sizeof (peer) ;
+  int fd ;
+
+  if (((node = findDrcNet (pinBase)) == NULL) || ((r = findRemote (node)) == NULL))
+    return -1 ;
+
+  lockRemote (r) ;
+
+  if (!on)
+  {
+    if (r->udpFd != -1)
+      close (r->udpFd) ;
+    r->udpFd = -1 ;
+    unlockRemote (r) ;
+    return 0 ;
+  }
+
+  if (r->udpFd != -1)
+  {
+    unlockRemote (r) ;
+    return 0 ;
+  }
+
+  if (openTransport (node, DRCN_UDP_OPEN, 0, &r->udpKey, sizeof (r->udpKey)) != sizeof (r->udpKey))
+    goto fail ;
+
+  if (getpeername (node->fd, (struct sockaddr *)&peer, &peerLen) < 0)
+    goto fail ;
+
+  if ((fd = socket (peer.ss_family, SOCK_DGRAM | SOCK_CLOEXEC, 0)) < 0)
+    goto fail ;
+
+  if (connect (fd, (struct sockaddr *)&peer, peerLen) < 0)
+  {
+    close (fd) ;
+    goto fail ;
+  }
+
+  r->udpFd  = fd ;
+  r->udpSeq = 0 ;
+
+  unlockRemote (r) ;
+  return 0 ;
+
+fail:
+  unlockRemote (r) ;
+  return -1 ;
+}
+
+
+/*
+ * shmReceive:
+ *	Collect the shared memory from the abstract socket the server told us
+ *	about - it only gives it to us, having checked who we are.
+ *	Returns the memfd or -1.
+ *********************************************************************************
+ */
+
+static int shmReceive (const char *name, int len)
+{
+  struct sockaddr_un addr ;
+  struct timeval     tv = { 1, 0 } ;
+  struct msghdr      msg ;
+  struct iovec       iov ;
+  struct cmsghdr    *cmsg ;
+  union { char buf [CMSG_SPACE (sizeof (int))] ; struct cmsghdr align ; } control ;
+  char byte ;
+  int  sock, fd = -1 ;
+
+  if ((len <= 0) || (len > (int)sizeof (addr.sun_path) - 1))
+    return -1 ;
+
+  memset (&addr, 0, sizeof (addr)) ;
+  addr.sun_family = AF_UNIX ;
+  memcpy (addr.sun_path + 1, name, len) ;
+
+  if ((sock = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+    return -1 ;
+
+  setsockopt (sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof (tv)) ;
+
+  if (connect (sock, (struct sockaddr *)&addr, offsetof (struct sockaddr_un, sun_path) + 1 + len) < 0)
+  {
+    close (sock) ;
+    return -1 ;
+  }
+
+  iov.iov_base = &byte ;
+  iov.iov_len  = 1 ;
+  memset (&msg, 0, sizeof (msg)) ;
+  msg.msg_iov        = &iov ;
+  msg.msg_iovlen     = 1 ;
+  msg.msg_control    = control.buf ;
+  msg.msg_controllen = sizeof (control.buf) ;
+
+  if (recvmsg (sock, &msg, MSG_CMSG_CLOEXEC) == 1)
+  {
+    cmsg = CMSG_FIRSTHDR (&msg) ;
+    if ((cmsg != NULL) && (cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS) &&
+	(cmsg->cmsg_len == CMSG_LEN (sizeof (int))))
+      memcpy (&fd, CMSG_DATA (cmsg), sizeof (int)) ;
+  }
+
+  close (sock) ;
+
+  return fd ;
+}
+
+
+/*
+ * drcNetShm:
+ *	For a wiringPiD on the same machine: swap to a pair of rings in
+ *	shared memory for commands and replies, so nothing goes near a socket.
+ *	Drc events still come over TCP.
+ *********************************************************************************
+ */
+
+int drcNetShm (const int pinBase, const int on)
+{
+  struct wiringPiNodeStruct *node ;
+  struct drcNetRemoteStruct *r ;
+  struct drcNetComStruct cmd ;
+  struct stat st ;
+  char name [64] ;
+  void *ptr ;
+  int fd, len ;
+
+  if (((node = findDrcNet (pinBase)) == NULL) || ((r = findRemote (node)) == NULL))
+    return -1 ;
+
+  lockRemote (r) ;
+
+  if (!on)
+  {
+    if (r->shm != NULL)
+    {
+      __atomic_store_n (&r->shm->alive, FALSE, __ATOMIC_RELEASE) ;
+      munmap (r->shm, sizeof (struct drcNetShmStruct)) ;
+      r->shm = NULL ;
+    }
+    unlockRemote (r) ;
+    return 0 ;
+  }
+
+  if (r->shm != NULL)
+  {
+    unlockRemote (r) ;
+    return 0 ;
+  }
+
+  if ((len = openTransport (node, DRCN_SHM_OPEN, (uint32_t)getpid (), name, sizeof (name))) < 2)
+    goto fail ;
+  name [sizeof (name) - 1] = 0 ;
+
+  if ((fd = shmReceive (name, len - 1)) < 0)
+    goto fail ;
+
+  ptr = MAP_FAILED ;
+  if ((fstat (fd, &st) == 0) && (st.st_size >= (off_t)sizeof (struct drcNetShmStruct)))
+    ptr = mmap (NULL, sizeof (struct drcNetShmStruct), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) ;
+  close (fd) ;
+
+  if (ptr == MAP_FAILED)
+    goto fail ;
+
+  r->shm = (struct drcNetShmStruct *)ptr ;
+
+  if (r->shm->magic != DRCN_SHM_MAGIC)
+  {
+    munmap (ptr, sizeof (struct drcNetShmStruct)) ;
+    r->shm = NULL ;
+    goto fail ;
+  }
+
+// Send a sync through it first - that tells the server we've got it, and
+//	that anything we'd sent before (pipelined) is done.
+
+  cmd.pin  = 0 ;
+  cmd.cmd  = DRCN_SYNC ;
+  cmd.data = 0 ;
+  if (shmSend (r, &cmd, TRUE) < 0)
+  {
+    munmap (r->shm, sizeof (struct drcNetShmStruct)) ;
+    r->shm = NULL ;
+    goto fail ;
+  }
+
+  unlockRemote (r) ;
+  return 0 ;
+
+fail:
+  unlockRemote (r) ;
+  return -1 ;
+}
+
+
+/*
+ * eventThread:
+ *	Watch the socket for events the server pushes when nothing else is
+ *	talking to it, and call the drcNetISR functions for everything queued.
+ *********************************************************************************
+ */
+
+static void *eventThread (void *arg)
+{
+  struct drcNetRemoteStruct *r = (struct drcNetRemoteStruct *)arg ;
+  struct drcNetComStruct     cmd ;
+  struct wpiEdgeEventStruct  ev ;
+  struct pollfd polls [2] ;
+  uint64_t dummy ;
+  int      avail, local ;
+  void   (*isr)(const struct wpiEdgeEventStruct *) ;
+
+  polls [0].fd     = r->node->fd ;
+  polls [0].events = POLLIN ;
+  polls [1].fd     = r->wakeFd ;
+  polls [1].events = POLLIN ;
+
+  for (;;)
+  {
+    if (poll (polls, 2, -1) < 0)
+    {
+      if (errno == EINTR)
+        continue ;
+      break ;
+    }
+
+    if ((polls [0].revents & (POLLERR | POLLHUP | POLLNVAL)) != 0)
+      break ;
+
+    if ((polls [1].revents & POLLIN) != 0)
+      (void)read (r->wakeFd, &dummy, sizeof (dummy)) ;
+
+// Only read if nobody else is waiting for a reply and it's still there.
+//	Just the one frame: recvReply () would go on to wait for a reply
+//	that's never coming, with the lock held. With no-one else to answer
+//	it has to be an event or a drcNetSubmit's.
+
+    lockRemote (r) ;
+      if ((polls [0].revents & POLLIN) != 0)
+        if ((ioctl (r->node->fd, FIONREAD, &avail) == 0) && (avail >= (int)sizeof (cmd)))
+          if (recv (r->node->fd, &cmd, sizeof (cmd), MSG_WAITALL) == sizeof (cmd))
+	    (void)otherFrame (r, r->node->fd, &cmd) ;
+    unlockRemote (r) ;
+
+    for (;;)
+    {
+      lockRemote (r) ;
+        if (r->evTail == r->evHead)
+        {
+          unlockRemote (r) ;
+          break ;
+        }
+        ev    = r->events [r->evTail++ % EVENT_QUEUE] ;
+        local = ev.pin - r->node->pinBase ;
+        isr   = ((local >= 0) && (local < MAX_DRCNET_PINS)) ? r->isrs [local] : NULL ;
+      unlockRemote (r) ;
+
+      if (isr != NULL)
+        isr (&ev) ;
+    }
+  }
+
+  lockRemote (r) ;
+    close (r->wakeFd) ;
+    r->wakeFd        = -1 ;
+    r->threadRunning = FALSE ;
+  unlockRemote (r) ;
+
+  return NULL ;
+}
+
+
+/*
+ * startEvents:
+ *	Start the thread for drcNetISR, if it's not already going
+ *********************************************************************************
+ */
+
+static int startEvents (struct drcNetRemoteStruct *r)
+{
+  pthread_t thread ;
+
+  if (r->threadRunning)
+    return 0 ;
+
+  if ((r->wakeFd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+    return -1 ;
+
+  if (pthread_create (&thread, NULL, eventThread, r) != 0)
+  {
+    close (r->wakeFd) ;
+    r->wakeFd = -1 ;
+    return -1 ;
+  }
+
+  pthread_detach (thread) ;
+  r->threadRunning = TRUE ;
+
+  return 0 ;
+}
+
+
+/*
+ * drcNetISR:
+ *	The remote equivalent of wiringPiISR: ask the server to tell us about
+ *	edges on a pin (INT_EDGE_FALLING, _RISING or _BOTH), ignoring any
+ *	that come within debounceMs of the last one, and call function for
+ *	each with the timestamp (the servers CLOCK_MONOTONIC, or ours once
+ *	there's been a drcNetTimeSync) it saw it at.
+ *	The function is called from a thread of our own. Passing NULL
+ *	cancels the subscription. Only the servers on-board pins can do this.
+ *********************************************************************************
+ */
+
+int drcNetISR (int pin, int mode, int debounceMs, void (*function)(const struct wpiEdgeEventStruct *event))
+{
+  struct wiringPiNodeStruct *node ;
+  struct drcNetRemoteStruct *r ;
+  int local ;
+
+  if (((node = wiringPiFindNode (pin)) == NULL) || (node->pinMode != myPinMode))
+    return -1 ;
+
+  if (((r = findRemote (node)) == NULL) || ((local = pin - node->pinBase) >= MAX_DRCNET_PINS))
+    return -1 ;
+
+  if (function == NULL)
+    mode = 0 ;
+  else if ((mode < INT_EDGE_FALLING) || (mode > INT_EDGE_BOTH) || (debounceMs < 0))
+    return -1 ;
+
+  lockRemote (r) ;
+    r->isrs        [local] = function ;
+    r->isrModes    [local] = mode ;
+    r->isrDebounce [local] = debounceMs ;
+  unlockRemote (r) ;
+
+  if (transact (node, pin, DRCN_SUBSCRIBE, (uint32_t)mode | ((uint32_t)debounceMs << 8)) != 0)
+  {
+    lockRemote (r) ;
+      r->isrs [local] = NULL ;
+    unlockRemote (r) ;
+    return -1 ;
+  }
+
+// The cache needs every edge: it's lost them, or keeps them, or can't
+//	have them while this subscription's there
+
+  lockRemote (r) ;
+    /**/ if (function == NULL)
+      r->digitalState [local] = CACHE_UNKNOWN ;
+    else if ((mode != INT_EDGE_BOTH) || (debounceMs != 0))
+      r->digitalState [local] = CACHE_NEVER ;
+    else if (r->digitalState [local] == CACHE_NEVER)
+      r->digitalState [local] = CACHE_UNKNOWN ;
+  unlockRemote (r) ;
+
+  if (function != NULL)
+  {
+    lockRemote (r) ;
+      local = startEvents (r) ;
+    unlockRemote (r) ;
+    return local ;
+  }
+
+  return 0 ;
+}
+
+
+/*
+ * nodeEdge:
+ * myIsr:
+ *	The node's isr op: wiringPiISR () on one of our pins is a drcNetISR
+ *	subscription handing its events on to wiringPiNodeEdge ().
+ *********************************************************************************
+ */
+
+static void nodeEdge (const struct wpiEdgeEventStruct *event)
+{
+  wiringPiNodeEdge (event->pin, event->edge, event->timestamp) ;
+}
+
+static int myIsr (UNU struct wiringPiNodeStruct *node, int pin, int mode)
+{
+  return drcNetISR (pin, mode, 0, (mode == INT_EDGE_SETUP) ? NULL : nodeEdge) ;
+}
+
+
+/*
+ * setupSocket:
+ * drcNet:
+ *	Create a new instance of an DRC GPIO interface.
+ *	Could be a variable nunber of pins here - we might not know in advance.
+ *********************************************************************************
+ */
+
+static int setupSocket (int fd)
+{
+  int len ;
+
+  len = sizeof (struct drcNetComStruct) ;
+
+  if (setsockopt (fd, SOL_SOCKET, SO_RCVLOWAT, (void *)&len, sizeof (len)) < 0)
+    return -1 ;
+
+// Every command is one send, so Nagle only ever adds latency
+
+  len = 1 ;
+  setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, (void *)&len, sizeof (len)) ;
+
+  return 0 ;
+}
+
+int drcSetupNet (const int pinBase, const int numPins, const char *ipAddress, const char *port, const char *password)
+{
+  pthread_mutexattr_t attr ;
+  char name [WPI_BUS_NAME] ;
+  int fd ;
+  struct wiringPiNodeStruct *node ;
+  struct drcNetRemoteStruct *r ;
+
+  if ((fd = _drcSetupNet (ipAddress, port, password)) < 0)
+    return FALSE ;
+
+  if (setupSocket (fd) < 0)
+  {
+    close (fd) ;
+    return FALSE ;
+  }
+
+  node = wiringPiNewNode (pinBase, numPins) ;
+
+  node->fd               = fd ;
+  node->data0            = 0 ;		// Not pipelined
+  node->data1            = 0 ;		// Next read tag
+  node->data2            = 0 ;		// Writes not yet acknowledged
   node->pinMode          = myPinMode ;
   node->pullUpDnControl  = myPullUpDnControl ;
   node->analogRead       = myAnalogRead ;
-  node->analogRead       = myAnalogRead ;
   node->analogWrite      = myAnalogWrite ;
   node->digitalRead      = myDigitalRead ;
   node->digitalWrite     = myDigitalWrite ;
-//node->digitalRead8     = myDigitalRead8 ;
-//node->digitalWrite8    = myDigitalWrite8 ;
+  node->digitalRead8     = myDigitalRead8 ;
+  node->digitalRead16    = myDigitalRead16 ;
+  node->digitalWrite8    = myDigitalWrite8 ;
+  node->digitalWrite16   = myDigitalWrite16 ;
+  node->digitalWriteMasked = myDigitalWriteMasked ;
   node->pwmWrite         = myPwmWrite ;
+  node->flush            = myFlush ;
+  node->isr              = myIsr ;
+
+// Batching and drcNetISR need some state of our own - if we've run out
+//	then the remote still works without them.
+
+  if ((r = findRemote (NULL)) != NULL)
+  {
+    memset (r, 0, sizeof (*r)) ;
+    r->node   = node ;
+    r->wakeFd = -1 ;
+    r->udpFd  = -1 ;
+    r->asyncWatched = -1 ;
+    snprintf (r->host, sizeof (r->host), "%s", ipAddress) ;
+    snprintf (r->port, sizeof (r->port), "%s", port) ;
+    snprintf (name,    sizeof (name),    "%s:%s", ipAddress, port) ;
+    r->slot     = wiringPiBusStatsSlot (WPI_BUS_DRCNET, name, -1) ;
+    r->password = strdup (password) ;
+    node->digitalWriteAt = myDigitalWriteAt ;
+    pthread_mutexattr_init    (&attr) ;
+    pthread_mutexattr_settype (&attr, PTHREAD_MUTEX_RECURSIVE) ;
+    pthread_mutex_init        (&r->lock, &attr) ;
+    pthread_mutexattr_destroy (&attr) ;
+  }
+
+  return TRUE ;
+}
+
+
+/*
+ * cacheReset:
+ * drcNetCache:
+ *	Turn the read cache for the remote at pinBase on or off. With it on a
+ *	digitalRead () of a pin subscribes to its edges the first time, and
+ *	from then on is answered from what they say - the network only
+ *	carries changes. analogTtlMs, if not 0, is how long an analogRead ()
+ *	is good for. Needs a server that can do drcNetISR on those pins;
+ *	anything else is read every time, as before.
+ *********************************************************************************
+ */
+
+static void cacheReset (struct drcNetRemoteStruct *r)
+{
+  memset (r->digitalState, CACHE_UNKNOWN, sizeof (r->digitalState)) ;
+  memset (r->digitalDue,   0,             sizeof (r->digitalDue)) ;
+  memset (r->analogTime,   0,             sizeof (r->analogTime)) ;
+}
+
+int drcNetCache (const int pinBase, const int on, const int analogTtlMs)
+{
+  struct wiringPiNodeStruct *node ;
+  struct drcNetRemoteStruct *r ;
+  int local ;
+
+  if (((node = findDrcNet (pinBase)) == NULL) || ((r = findRemote (node)) == NULL) || (analogTtlMs < 0))
+    return -1 ;
+
+  lockRemote (r) ;
+
+// Hand back the subscriptions that were only for the cache
+
+    if (!on)
+      for (local = 0 ; local < MAX_DRCNET_PINS ; ++local)
+	if ((r->isrs [local] == NULL) && ((r->digitalState [local] == CACHE_VALID) || (r->digitalState [local] == CACHE_STALE)))
+	  (void)transact (node, pinBase + local, DRCN_SUBSCRIBE, 0) ;
+
+    cacheReset (r) ;
+    r->cacheOn   = on ? TRUE : FALSE ;
+    r->analogTtl = (uint64_t)analogTtlMs * 1000000ULL ;
+
+  unlockRemote (r) ;
+
+  return 0 ;
+}
+
+
+/*
+ * drcNetReconnect:
+ *	The connection to the remote at pinBase has gone (or we think it's
+ *	about to). Make a new one - resuming the session if the server still
+ *	has it - and put back the UDP or shared memory transport and the
+ *	drcNetISR subscriptions we had. Anything batched or pipelined on the
+ *	old connection is lost.
+ *********************************************************************************
+ */
+
+int drcNetReconnect (const int pinBase)
+{
+  struct wiringPiNodeStruct *node ;
+  struct drcNetRemoteStruct *r ;
+  int fd, wasUdp, wasShm, running, local, result = 0 ;
+
+  if (((node = findDrcNet (pinBase)) == NULL) || ((r = findRemote (node)) == NULL) || (r->password == NULL))
+    return -1 ;
+
+// Wake the event thread by hanging up under it and wait for it to go
+
+  lockRemote (r) ;
+    if (node->fd != -1)
+      shutdown (node->fd, SHUT_RDWR) ;
+  unlockRemote (r) ;
+
+  do
+  {
+    lockRemote (r) ;
+      running = r->threadRunning ;
+    unlockRemote (r) ;
+    if (running)
+      delay (1) ;
+  }
+  while (running) ;
+
+  lockRemote (r) ;
+    wasUdp = (r->udpFd != -1) ;
+    wasShm = (r->shm   != NULL) ;
+    drcNetUdp (pinBase, FALSE) ;
+    drcNetShm (pinBase, FALSE) ;
+
+    r->active = FALSE ;
+    r->count  = 0 ;
+    cacheReset (r) ;
+    asyncFail  (r) ;
+
+// Out of drcNetAsyncFd's set before it's closed: the new socket's likely
+//	to get the same number, and asyncWatch would think it was still there
+
+    if ((r->asyncWatched != -1) && (asyncEpoll != -1))
+      (void)epoll_ctl (asyncEpoll, EPOLL_CTL_DEL, r->asyncWatched, NULL) ;
+    r->asyncWatched = -1 ;
+
+    if (node->fd != -1)
+      close (node->fd) ;
+    node->fd    = -1 ;
+    node->data1 = 0 ;
+    node->data2 = 0 ;
+
+    wiringPiBusStatsRetry (r->slot) ;
+
+    if ((fd = _drcSetupNet (r->host, r->port, r->password)) < 0)
+    {
+      unlockRemote (r) ;
+      return -1 ;
+    }
+
+    if (setupSocket (fd) < 0)
+    {
+      close (fd) ;
+      unlockRemote (r) ;
+      return -1 ;
+    }
+
+    node->fd = fd ;
+
+    if (wasUdp && (drcNetUdp (pinBase, TRUE) < 0))
+      result = -1 ;
+    if (wasShm && (drcNetShm (pinBase, TRUE) < 0))
+      result = -1 ;
+
+    for (local = 0 ; local < MAX_DRCNET_PINS ; ++local)
+      if (r->isrs [local] != NULL)
+      {
+	if (transact (node, pinBase + local, DRCN_SUBSCRIBE, (uint32_t)r->isrModes [local] | ((uint32_t)r->isrDebounce [local] << 8)) != 0)
+	  result = -1 ;
+	else if (startEvents (r) < 0)
+	  result = -1 ;
+      }
+  unlockRemote (r) ;
+
+  return result ;
+}
+
+
+/*
+ * Groups:
+ *	A node whose writes go to the same pin on every member - drcNet
+ *	nodes already set up. Each member gets the command in turn without
+ *	waiting, then we collect the acknowledgements, so the lot costs one
+ *	round trip rather than one per member. Reads come from the first.
+ *	Every member stays locked for the whole exchange, always in the same
+ *	order, so nothing else gets in between a command and its reply.
+ *********************************************************************************
+ */
+
+#define	MAX_DRCNET_GROUPS	4
+
+struct drcNetGroupStruct
+{
+  struct wiringPiNodeStruct *node ;
+  int                        count ;
+  int                        confirmed ;	// By the last command
+  struct wiringPiNodeStruct *members [MAX_DRCNET] ;
+} ;
+
+static struct drcNetGroupStruct groups [MAX_DRCNET_GROUPS] ;
+static int numGroups = 0 ;
+
+static int lockOrder (struct wiringPiNodeStruct *m)
+{
+  struct drcNetRemoteStruct *r = findRemote (m) ;
+
+  return (r == NULL) ? MAX_DRCNET : (int)(r - remotes) ;
+}
+
+static void lockGroup (struct drcNetGroupStruct *g, int lock)
+{
+  int i ;
+
+  for (i = 0 ; i < g->count ; ++i)
+    if (lock)
+      lockRemote (findRemote (g->members [i])) ;
+    else
+      unlockRemote (findRemote (g->members [g->count - 1 - i])) ;
+}
+
+
+/*
+ * fanOut:
+ *	Send a write to every member, then wait for each one to confirm it.
+ *	A DRCN_WRITE_AT is for tNs, and goes over TCP even to shared memory.
+ *********************************************************************************
+ */
+
+static int _fanOut (struct wiringPiNodeStruct *node, int pin, uint32_t command, uint32_t data, unsigned long long tNs)
+{
+  struct drcNetGroupStruct  *g = &groups [node->data3] ;
+  struct drcNetRemoteStruct *r ;
+  struct wiringPiNodeStruct *m ;
+  struct drcNetComStruct     cmd ;
+  uint32_t tags [MAX_DRCNET] ;
+  int      sent [MAX_DRCNET] ;
+  unsigned long long t0 ;
+  int i, ok, confirmed = 0 ;
+
+  lockGroup (g, TRUE) ;
+
+  for (i = 0 ; i < g->count ; ++i)
+  {
+    m = g->members [i] ;
+    r = findRemote (m) ;
+
+    if ((r != NULL) && r->active)		// Anything batched goes first
+      flushBatch (r, NULL) ;
+
+    tags [i] = m->data0 ? ((m->data1++ << DRCN_TAG_SHIFT) & DRCN_TAG_MASK) : 0 ;
+
+    cmd.pin  = pin - node->pinBase ;
+    cmd.cmd  = command | tags [i] ;
+    cmd.data = data ;
+
+    if (command == DRCN_WRITE_AT)
+      cacheDue (r, cmd.pin, tNs) ;
+    else
+      cacheWrite (r, &cmd) ;
+
+    /**/ if (command == DRCN_WRITE_AT)
+      sent [i] = (r != NULL) && (sendWriteAt (r, &cmd, tNs) == 0) ;
+    else if ((r != NULL) && (r->shm != NULL))
+      sent [i] = (shmSend (r, &cmd, FALSE) == 0) ;
+    else
+      sent [i] = (send (m->fd, &cmd, sizeof (cmd), 0) == sizeof (cmd)) ;
+  }
+
+  t0 = wiringPiBusStatsBegin () ;
+
+  for (i = 0 ; i < g->count ; ++i)
+  {
+    m  = g->members [i] ;
+    r  = findRemote (m) ;
+    ok = FALSE ;
+
+    if (sent [i])
+    {
+      if ((r != NULL) && (r->shm != NULL) && (command != DRCN_WRITE_AT))
+      {
+	while (drcNetShmPop (r->shm, &r->shm->toClient, &cmd, NULL) == 0)
+	  if ((cmd.cmd & DRCN_TAG_MASK) == tags [i])
+	  {
+	    ok = TRUE ;
+	    break ;
+	  }
+      }
+      else
+      {
+	while (recvReply (m, &cmd) == 0)
+	  if ((cmd.cmd & DRCN_TAG_MASK) == tags [i])
+	  {
+	    ok = (command != DRCN_WRITE_AT) || (cmd.data == 0) ;
+	    break ;
+	  }
+      }
+    }
+
+    if (ok)
+      ++confirmed ;
+    wiringPiBusStatsEnd (remoteSlot (r), t0, 2 * sizeof (cmd), !ok) ;
+  }
+
+  g->confirmed = confirmed ;
+
+  lockGroup (g, FALSE) ;
+
+  return (confirmed == g->count) ? 0 : -1 ;
+}
+
+WPI_TRACE_SEMAPHORE (drcnet_group) ;
+
+static int fanOutAt (struct wiringPiNodeStruct *node, int pin, uint32_t command, uint32_t data, unsigned long long tNs)
+{
+  int result ;
+  WPI_TRACE_BEGIN (drcnet_group) ;
+
+  result = _fanOut (node, pin, command, data, tNs) ;
+
+  WPI_TRACE_END (drcnet_group, pin, node, command) ;
+
+  return result ;
+}
+
+static void fanOut (struct wiringPiNodeStruct *node, int pin, uint32_t command, uint32_t data)
+{
+  (void)fanOutAt (node, pin, command, data, 0) ;
+}
+
+static void groupPinMode (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  fanOut (node, pin, DRCN_PIN_MODE, value) ;
+}
+
+static void groupPullUpDnControl (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  fanOut (node, pin, DRCN_PULL_UP_DN, value) ;
+}
+
+static void groupDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  fanOut (node, pin, DRCN_DIGITAL_WRITE, value) ;
+}
+
+static void groupDigitalWrite8 (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  fanOut (node, pin, DRCN_DIGITAL_WRITE8, value & 0xFF) ;
+}
+
+static void groupDigitalWrite16 (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  fanOut (node, pin, DRCN_DIGITAL_WRITE16, value & 0xFFFF) ;
+}
+
+static void groupDigitalWriteMasked (struct wiringPiNodeStruct *node, int pin, unsigned int value, unsigned int mask)
+{
+  fanOut (node, pin, DRCN_DIGITAL_WRITE_MASK, ((mask & 0xFFFF) << 16) | (value & mask & 0xFFFF)) ;
+}
+
+static void groupAnalogWrite (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  fanOut (node, pin, DRCN_ANALOG_WRITE, value) ;
+}
+
+static void groupPwmWrite (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  fanOut (node, pin, DRCN_PWM_WRITE, value) ;
+}
+
+static int groupDigitalWriteAt (struct wiringPiNodeStruct *node, int pin, int value, unsigned long long tNs)
+{
+  if (fanOutAt (node, pin, DRCN_WRITE_AT, (value != LOW) ? HIGH : LOW, tNs) < 0)
+  {
+    errno = EIO ;
+    return -1 ;
+  }
+
+  return 0 ;
+}
+
+static int groupAnalogRead (struct wiringPiNodeStruct *node, int pin)
+{
+  struct wiringPiNodeStruct *m = groups [node->data3].members [0] ;
+
+  return myAnalogRead (m, m->pinBase + pin - node->pinBase) ;
+}
+
+static int groupDigitalRead (struct wiringPiNodeStruct *node, int pin)
+{
+  struct wiringPiNodeStruct *m = groups [node->data3].members [0] ;
+
+  return myDigitalRead (m, m->pinBase + pin - node->pinBase) ;
+}
+
+
+/*
+ * drcNetGroup:
+ *	Make a group at pinBase of numPins from the drcNet nodes at
+ *	memberBases. Pin N of the group is pin N of every member.
+ *	Returns TRUE or FALSE, like drcSetupNet.
+ *********************************************************************************
+ */
+
+int drcNetGroup (const int pinBase, const int numPins, const int *memberBases, const int count)
+{
+  struct drcNetGroupStruct  *g ;
+  struct wiringPiNodeStruct *node, *m ;
+  int i, j ;
+
+  if ((numGroups == MAX_DRCNET_GROUPS) || (count < 1) || (count > MAX_DRCNET) || (numPins < 1))
+    return FALSE ;
+
+  g = &groups [numGroups] ;
+  memset (g, 0, sizeof (*g)) ;
+
+  for (i = 0 ; i < count ; ++i)
+  {
+    if ((m = findDrcNet (memberBases [i])) == NULL)
+      return FALSE ;
+    if ((m->pinMax - m->pinBase + 1) < numPins)
+      return FALSE ;
+    for (j = 0 ; j < g->count ; ++j)
+      if (g->members [j] == m)
+	return FALSE ;
+    g->members [g->count++] = m ;
+  }
+
+// Lock order is the order in remotes [], so two groups sharing members
+//	can't deadlock. Members without a remote don't lock and go last.
+
+  for (i = 1 ; i < g->count ; ++i)
+    for (j = i ; (j > 0) && (lockOrder (g->members [j]) < lockOrder (g->members [j - 1])) ; --j)
+    {
+      m                  = g->members [j] ;
+      g->members [j]     = g->members [j - 1] ;
+      g->members [j - 1] = m ;
+    }
+
+  node = wiringPiNewNode (pinBase, numPins) ;
+
+  node->data3              = numGroups++ ;
+  node->pinMode            = groupPinMode ;
+  node->pullUpDnControl    = groupPullUpDnControl ;
+  node->analogRead         = groupAnalogRead ;
+  node->analogWrite        = groupAnalogWrite ;
+  node->digitalRead        = groupDigitalRead ;
+  node->digitalWrite       = groupDigitalWrite ;
+  node->digitalWrite8      = groupDigitalWrite8 ;
+  node->digitalWrite16     = groupDigitalWrite16 ;
+  node->digitalWriteMasked = groupDigitalWriteMasked ;
+  node->pwmWrite           = groupPwmWrite ;
+  node->digitalWriteAt     = groupDigitalWriteAt ;
+
+  g->node      = node ;
+  g->confirmed = g->count ;
 
   return TRUE ;
 }
+
+
+/*
+ * drcNetGroupConfirmed:
+ *	How many members of the group at pinBase confirmed the last command
+ *	sent to it, or -1 if it's not a group.
+ *********************************************************************************
+ */
+
+int drcNetGroupConfirmed (const int pinBase)
+{
+  struct wiringPiNodeStruct *node = wiringPiFindNode (pinBase) ;
+
+  if ((node == NULL) || (node->pinMode != groupPinMode))
+    return -1 ;
+
+  return groups [node->data3].confirmed ;
+}
+
+
+/*
+ * asyncFail:
+ *	The connection's gone: everything still waiting on it has failed.
+ *	Called with the remote locked.
+ *********************************************************************************
+ */
+
+static void asyncFail (struct drcNetRemoteStruct *r)
+{
+  struct drcNetAsyncStruct *a ;
+
+  while ((a = r->asyncHead) != NULL)
+  {
+    r->asyncHead = a->next ;
+    wiringPiBusStatsEnd (r->slot, a->t0, 0, TRUE) ;
+    asyncDone (a, -1) ;
+  }
+
+  r->asyncTail = NULL ;
+}
+
+
+/*
+ * asyncService: asyncThread:
+ *	The one loop for every remote: wait on the sockets of those with
+ *	something in flight, take the replies off as they come and call
+ *	back whatever's done. asyncService is one go round, waiting up to
+ *	timeout mS; the loop thread just does it for ever.
+ *********************************************************************************
+ */
+
+static int asyncService (int timeout)
+{
+  struct pollfd              polls [MAX_DRCNET + 1] ;
+  struct drcNetRemoteStruct *who   [MAX_DRCNET + 1] ;
+  struct drcNetAsyncStruct  *done, *a ;
+  struct drcNetComStruct     cmd ;
+  struct drcNetRemoteStruct *r ;
+  uint64_t dummy ;
+  int i, n, avail, count = 0 ;
+
+  polls [0].fd     = asyncWake ;
+  polls [0].events = POLLIN ;
+
+  for (n = 1, i = 0 ; i < MAX_DRCNET ; ++i)
+  {
+    r = &remotes [i] ;
+    if (r->node == NULL)
+      continue ;
+    lockRemote (r) ;
+      if ((r->asyncHead != NULL) && (r->node->fd != -1))
+      {
+	polls [n].fd     = r->node->fd ;
+	polls [n].events = POLLIN ;
+	who   [n++]      = r ;
+      }
+    unlockRemote (r) ;
+  }
+
+  if (poll (polls, n, timeout) < 0)
+    return -1 ;
+
+  if ((polls [0].revents & POLLIN) != 0)
+    (void)read (asyncWake, &dummy, sizeof (dummy)) ;
+
+  for (i = 1 ; i < n ; ++i)
+  {
+    if (polls [i].revents == 0)
+      continue ;
+
+    r = who [i] ;
+    lockRemote (r) ;
+      if ((polls [i].revents & (POLLERR | POLLHUP | POLLNVAL)) != 0)
+	asyncFail (r) ;
+      else
+	while ((r->asyncHead != NULL) && (ioctl (r->node->fd, FIONREAD, &avail) == 0) && (avail >= (int)sizeof (cmd)))
+	{
+	  if ((recv (r->node->fd, &cmd, sizeof (cmd), MSG_WAITALL) != sizeof (cmd)) || (otherFrame (r, r->node->fd, &cmd) < 0))
+	  {
+	    asyncFail (r) ;
+	    break ;
+	  }
+	}
+    unlockRemote (r) ;
+  }
+
+// Call back everything that's done, wherever it was finished
+
+  pthread_mutex_lock (&asyncLock) ;
+    done          = asyncDoneHead ;
+    asyncDoneHead = asyncDoneTail = NULL ;
+  pthread_mutex_unlock (&asyncLock) ;
+
+  while ((a = done) != NULL)
+  {
+    done = a->next ;
+
+    if (a->callback != NULL)
+      a->callback (a->context, a->ops, a->n, a->status) ;
+
+    pthread_mutex_lock (&asyncLock) ;
+      a->next   = asyncFree ;
+      asyncFree = a ;
+      --asyncPending ;
+    pthread_mutex_unlock (&asyncLock) ;
+    ++count ;
+  }
+
+  return count ;
+}
+
+static void *asyncThread (void *arg)
+{
+  (void)arg ;
+
+  for (;;)
+    if ((asyncService (-1) < 0) && (errno != EINTR))
+      break ;
+
+  return NULL ;
+}
+
+
+/*
+ * asyncWatch:
+ *	With no loop thread, keep the caller's epoll set watching just the
+ *	sockets with something in flight - as the loop thread's poll would.
+ *********************************************************************************
+ */
+
+static void asyncWatch (void)
+{
+  struct drcNetRemoteStruct *r ;
+  struct epoll_event ev ;
+  int i, want ;
+
+  for (i = 0 ; i < MAX_DRCNET ; ++i)
+  {
+    r = &remotes [i] ;
+    if (r->node == NULL)
+      continue ;
+
+    lockRemote (r) ;
+      want = (r->asyncHead != NULL) ? r->node->fd : -1 ;
+      if (want != r->asyncWatched)
+      {
+	if (r->asyncWatched != -1)
+	  (void)epoll_ctl (asyncEpoll, EPOLL_CTL_DEL, r->asyncWatched, NULL) ;	// May be closed already
+	r->asyncWatched = -1 ;
+	if (want != -1)
+	{
+	  ev.events  = EPOLLIN ;
+	  ev.data.fd = want ;
+	  if (epoll_ctl (asyncEpoll, EPOLL_CTL_ADD, want, &ev) == 0)
+	    r->asyncWatched = want ;
+	}
+      }
+    unlockRemote (r) ;
+  }
+}
+
+
+/*
+ * asyncGet:
+ *	A free drcNetSubmit, starting the loop thread the first time.
+ *	Returns NULL with errno set if there isn't one.
+ *********************************************************************************
+ */
+
+static struct drcNetAsyncStruct *asyncGet (void)
+{
+  struct drcNetAsyncStruct *a ;
+  pthread_t thread ;
+  int i ;
+
+  pthread_mutex_lock (&asyncLock) ;
+
+  if (asyncWake == -1)
+  {
+    if ((asyncWake = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+    {
+      pthread_mutex_unlock (&asyncLock) ;
+      return NULL ;
+    }
+
+    if (asyncEpoll == -1)
+    {
+      if (pthread_create (&thread, NULL, asyncThread, NULL) != 0)
+      {
+	close (asyncWake) ;
+	asyncWake = -1 ;
+	pthread_mutex_unlock (&asyncLock) ;
+	errno = EAGAIN ;
+	return NULL ;
+      }
+      pthread_detach (thread) ;
+    }
+
+    for (asyncFree = NULL, i = MAX_ASYNC - 1 ; i >= 0 ; --i)
+    {
+      asyncPool [i].next = asyncFree ;
+      asyncFree          = &asyncPool [i] ;
+    }
+  }
+
+  if ((a = asyncFree) == NULL)
+    errno = ENOSPC ;
+  else
+  {
+    asyncFree = a->next ;
+    ++asyncPending ;
+  }
+
+  pthread_mutex_unlock (&asyncLock) ;
+
+  return a ;
+}
+
+
+/*
+ * drcNetSubmit:
+ *	Send n (up to DRCNET_MAX_OPS) operations to the remote at pinBase as
+ *	one batch and return straight away. When the server's done them the
+ *	loop thread calls callback with status 0 and the reads filled in -
+ *	or -1 if the connection went - so ops has to stay there till then.
+ *	Any number of these can be in flight, to any number of remotes, and
+ *	they're done in order on each; the usual blocking calls still work
+ *	in amongst them. Returns 0 or -1 with errno set.
+ *********************************************************************************
+ */
+
+int drcNetSubmit (const int pinBase, struct drcNetOpStruct *ops, const int n,
+	void (*callback)(void *context, struct drcNetOpStruct *ops, int n, int status), void *context)
+{
+  static const uint32_t commands [] =
+  {
+    DRCN_PIN_MODE, DRCN_PULL_UP_DN, DRCN_DIGITAL_WRITE, DRCN_ANALOG_WRITE,
+    DRCN_PWM_WRITE, DRCN_DIGITAL_READ, DRCN_ANALOG_READ,
+  } ;
+  struct drcNetComStruct     cmds [DRCNET_MAX_OPS + 1] ;
+  struct wiringPiNodeStruct *node ;
+  struct drcNetRemoteStruct *r ;
+  struct drcNetAsyncStruct  *a ;
+  uint64_t one = 1 ;
+  ssize_t len ;
+  int i ;
+
+  if (((node = findDrcNet (pinBase)) == NULL) || ((r = findRemote (node)) == NULL))
+  {
+    errno = ENODEV ;
+    return -1 ;
+  }
+
+  if ((ops == NULL) || (n < 1) || (n > DRCNET_MAX_OPS))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  cmds [0].pin  = 0 ;
+  cmds [0].cmd  = DRCN_BATCH ;
+  cmds [0].data = n ;
+
+  for (i = 0 ; i < n ; ++i)
+  {
+    if ((ops [i].op < DRCNET_PIN_MODE) || (ops [i].op > DRCNET_ANALOG_READ) || (ops [i].pin < node->pinBase) || (ops [i].pin > node->pinMax))
+    {
+      errno = EINVAL ;
+      return -1 ;
+    }
+    cmds [i + 1].pin  = ops [i].pin - node->pinBase ;
+    cmds [i + 1].cmd  = commands [ops [i].op] ;
+    cmds [i + 1].data = ops [i].value ;
+  }
+
+  if ((a = asyncGet ()) == NULL)
+    return -1 ;
+
+  a->r        = r ;
+  a->ops      = ops ;
+  a->n        = n ;
+  a->callback = callback ;
+  a->context  = context ;
+  a->next     = NULL ;
+
+  len = (n + 1) * sizeof (struct drcNetComStruct) ;
+
+  lockRemote (r) ;
+
+    if (r->active)		// Anything batched goes first
+      flushBatch (r, NULL) ;
+
+    for (i = 0 ; i < n ; ++i)
+      cacheWrite (r, &cmds [i + 1]) ;
+
+    a->t0 = wiringPiBusStatsBegin () ;
+
+    if (send (node->fd, cmds, len, 0) != len)
+    {
+      wiringPiBusStatsEnd (r->slot, a->t0, 0, TRUE) ;
+      unlockRemote (r) ;
+      pthread_mutex_lock (&asyncLock) ;
+	a->next   = asyncFree ;
+	asyncFree = a ;
+	--asyncPending ;
+      pthread_mutex_unlock (&asyncLock) ;
+      errno = EIO ;
+      return -1 ;
+    }
+
+    if (r->asyncTail == NULL)
+      r->asyncHead = a ;
+    else
+      r->asyncTail->next = a ;
+    r->asyncTail = a ;
+
+  unlockRemote (r) ;
+
+  write (asyncWake, &one, sizeof (one)) ;	// It's got another socket to watch
+
+  return 0 ;
+}
+
+
+/*
+ * drcNetAsyncPending:
+ *	How many drcNetSubmit's haven't been called back yet
+ *********************************************************************************
+ */
+
+int drcNetAsyncPending (void)
+{
+  int n ;
+
+  pthread_mutex_lock (&asyncLock) ;
+    n = asyncPending ;
+  pthread_mutex_unlock (&asyncLock) ;
+
+  return n ;
+}
+
+
+/*
+ * drcNetAsyncFd: drcNetAsyncPoll:
+ *	drcNetSubmit with no loop thread: ask for the fd before the first
+ *	submit and watch it for reading in your own event loop, and when it's
+ *	ready drcNetAsyncPoll takes the replies off without blocking and
+ *	calls back whatever's done - from the caller's thread.
+ *	Returns the fd, or -1 with errno EBUSY if the loop thread's already
+ *	running. Poll returns the number called back.
+ *********************************************************************************
+ */
+
+int drcNetAsyncFd (void)
+{
+  struct epoll_event ev ;
+  int i ;
+
+  pthread_mutex_lock (&asyncLock) ;
+
+  if (asyncEpoll != -1)
+  {
+    pthread_mutex_unlock (&asyncLock) ;
+    return asyncEpoll ;
+  }
+
+  if (asyncWake != -1)
+  {
+    pthread_mutex_unlock (&asyncLock) ;
+    errno = EBUSY ;
+    return -1 ;
+  }
+
+  if ((asyncEpoll = epoll_create1 (EPOLL_CLOEXEC)) < 0)
+    goto fail ;
+
+  if ((asyncWake = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+    goto fail ;
+
+  ev.events  = EPOLLIN ;
+  ev.data.fd = asyncWake ;
+  if (epoll_ctl (asyncEpoll, EPOLL_CTL_ADD, asyncWake, &ev) < 0)
+    goto fail ;
+
+  for (asyncFree = NULL, i = MAX_ASYNC - 1 ; i >= 0 ; --i)
+  {
+    asyncPool [i].next = asyncFree ;
+    asyncFree          = &asyncPool [i] ;
+  }
+
+  pthread_mutex_unlock (&asyncLock) ;
+  return asyncEpoll ;
+
+fail:
+  if (asyncWake  != -1) close (asyncWake) ;
+  if (asyncEpoll != -1) close (asyncEpoll) ;
+  asyncWake = asyncEpoll = -1 ;
+  pthread_mutex_unlock (&asyncLock) ;
+  return -1 ;
+}
+
+int drcNetAsyncPoll (void)
+{
+  int n ;
+
+  if (asyncEpoll == -1)
+  {
+    errno = EBUSY ;
+    return -1 ;
+  }
+
+  asyncWatch () ;
+  n = asyncService (0) ;
+  asyncWatch () ;		// Some may have nothing left in flight now
+
+  return n ;
+}
+
+
+/*
+ * drcNetMacro:
+ *	Have the server at pinBase run n (up to DRCNET_MAX_OPS) steps itself,
+ *	timed by its own clock, and get back what every read step (and wait)
+ *	found, in order - up to maxResults of them in results. Loops can run
+ *	the reads more times than there are steps.
+ *	Returns the number of results, or -1 with errno set: ETIMEDOUT if it
+ *	went on too long for the server (more than a second, or too many
+ *	steps) and was stopped - results has what it got to - or EINVAL if
+ *	a LOOP or SKIP goes outside the macro.
+ *********************************************************************************
+ */
+
+int drcNetMacro (const int pinBase, const struct drcNetOpStruct *steps, const int n, int *results, const int maxResults)
+{
+  static const uint32_t commands [] =
+  {
+    DRCN_PIN_MODE,  DRCN_PULL_UP_DN, DRCN_DIGITAL_WRITE, DRCN_ANALOG_WRITE,
+    DRCN_PWM_WRITE, DRCN_DIGITAL_READ, DRCN_ANALOG_READ,
+    DRCN_M_DELAY,   DRCN_M_LOOP,
+    DRCN_M_SKIP_EQ, DRCN_M_SKIP_NE,  DRCN_M_SKIP_LT,     DRCN_M_SKIP_GE,
+    DRCN_M_WAIT,    DRCN_M_WAIT,
+  } ;
+  struct drcNetComStruct     cmds [DRCNET_MAX_OPS + 1] ;
+  struct drcNetComStruct     reply [DRCN_MACRO_RESULTS] ;
+  struct drcNetComStruct    *c ;
+  struct wiringPiNodeStruct *node ;
+  struct drcNetRemoteStruct *r ;
+  unsigned long long t0 ;
+  uint32_t tag, status = 0 ;
+  ssize_t  len ;
+  int i, count = -1 ;
+
+  if (((node = findDrcNet (pinBase)) == NULL) || ((r = findRemote (node)) == NULL))
+  {
+    errno = ENODEV ;
+    return -1 ;
+  }
+
+  if ((steps == NULL) || (n < 1) || (n > DRCNET_MAX_OPS) || ((results == NULL) && (maxResults > 0)))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  for (i = 0 ; i < n ; ++i)
+  {
+    c = &cmds [i + 1] ;
+
+    if ((steps [i].op < DRCNET_PIN_MODE) || (steps [i].op > DRCNET_WAIT_LOW))
+    {
+      errno = EINVAL ;
+      return -1 ;
+    }
+
+    c->cmd  = commands [steps [i].op] ;
+    c->pin  = steps [i].pin ;
+    c->data = steps [i].value ;
+
+    if ((steps [i].op >= DRCNET_LOOP) && (steps [i].op <= DRCNET_SKIP_GE))
+    {
+      if ((steps [i].pin < 0) || ((steps [i].op == DRCNET_LOOP) && (steps [i].pin > i)) ||
+          ((steps [i].op != DRCNET_LOOP) && (steps [i].pin > n - i - 1)))
+      {
+	errno = EINVAL ;
+	return -1 ;
+      }
+      continue ;
+    }
+
+    if (steps [i].op == DRCNET_DELAY_US)
+      continue ;
+
+    if ((steps [i].pin < node->pinBase) || (steps [i].pin > node->pinMax))
+    {
+      errno = EINVAL ;
+      return -1 ;
+    }
+    c->pin = steps [i].pin - node->pinBase ;
+
+    if ((steps [i].op == DRCNET_WAIT_HIGH) || (steps [i].op == DRCNET_WAIT_LOW))
+      c->data = ((uint32_t)steps [i].value << 1) | ((steps [i].op == DRCNET_WAIT_HIGH) ? 1 : 0) ;
+  }
+
+  lockRemote (r) ;
+
+  if (r->active)		// Anything batched goes first
+    flushBatch (r, NULL) ;
+
+  for (i = 1 ; i <= n ; ++i)
+    cacheWrite (r, &cmds [i]) ;
+
+  t0  = wiringPiBusStatsBegin () ;
+  tag = node->data0 ? ((node->data1++ << DRCN_TAG_SHIFT) & DRCN_TAG_MASK) : 0 ;
+
+  cmds [0].pin  = 0 ;
+  cmds [0].cmd  = DRCN_MACRO | tag ;
+  cmds [0].data = n ;
+
+  len = (n + 1) * sizeof (struct drcNetComStruct) ;
+
+  if (send (node->fd, cmds, len, 0) == len)
+  {
+    while (recvReply (node, &cmds [0]) == 0)
+    {
+      if ((cmds [0].cmd & DRCN_TAG_MASK) != tag)
+	continue ;
+
+      if (((cmds [0].cmd & DRCN_CMD_MASK) != DRCN_MACRO) || (cmds [0].data > DRCN_MACRO_RESULTS))
+	break ;
+
+      len = cmds [0].data * sizeof (struct drcNetComStruct) ;
+      if ((len > 0) && (recv (node->fd, reply, len, MSG_WAITALL) != len))
+	break ;
+
+      for (i = 0 ; (i < (int)cmds [0].data) && (i < maxResults) ; ++i)
+	results [i] = (int)reply [i].data ;
+
+      count  = cmds [0].data ;
+      status = cmds [0].pin ;
+      break ;
+    }
+  }
+
+  wiringPiBusStatsEnd (r->slot, t0, (n + 1 + ((count > 0) ? count : 0) + 1) * sizeof (struct drcNetComStruct), count < 0) ;
+
+  unlockRemote (r) ;
+
+  if (count < 0)
+  {
+    errno = EIO ;
+    return -1 ;
+  }
+
+  if (status != 0)
+  {
+    errno = (status == DRCN_MACRO_BAD) ? EINVAL : ETIMEDOUT ;
+    return -1 ;
+  }
+
+  return count ;
+}
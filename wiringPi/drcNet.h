@@ -31,11 +31,75 @@ struct drcNetStruct
 } ;
 **************/
 
+// drcNetSubmit: one operation. value is what to write, or for a read
+//	is filled in with what was read before the callback's called.
+
+#define	DRCNET_PIN_MODE		0
+#define	DRCNET_PULL_UP_DN	1
+#define	DRCNET_DIGITAL_WRITE	2
+#define	DRCNET_ANALOG_WRITE	3
+#define	DRCNET_PWM_WRITE	4
+#define	DRCNET_DIGITAL_READ	5
+#define	DRCNET_ANALOG_READ	6
+
+#define	DRCNET_MAX_OPS		64
+
+// drcNetMacro: those, and steps the server runs itself. The pins are the
+//	pins, except for LOOP and SKIP where pin is a step number or count.
+
+#define	DRCNET_DELAY_US		7	// value uS on from the last delay ended
+#define	DRCNET_LOOP		8	// Back to step pin, till it's all been done value times
+#define	DRCNET_SKIP_EQ		9	// Skip the next pin steps (at most to the end) if the last read was value
+#define	DRCNET_SKIP_NE		10	//	... wasn't
+#define	DRCNET_SKIP_LT		11	//	... was less than
+#define	DRCNET_SKIP_GE		12	//	... was at least
+#define	DRCNET_WAIT_HIGH	13	// Wait up to value uS for pin to go HIGH: reads 1 if it did
+#define	DRCNET_WAIT_LOW		14
+
+struct drcNetOpStruct
+{
+  int pin ;
+  int op ;
+  int value ;
+} ;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-extern int drcSetupNet (const int pinBase, const int numPins, const char *ipAddress, const char *port, const char *password) ;
+struct wpiEdgeEventStruct ;
+
+extern int drcSetupNet     (const int pinBase, const int numPins, const char *ipAddress, const char *port, const char *password) ;
+extern int drcNetReconnect (const int pinBase) ;
+
+extern int drcNetPipeline (const int pinBase, const int on) ;
+extern int drcNetSync     (const int pinBase) ;
+
+extern int drcNetBatchBegin       (const int pinBase) ;
+extern int drcNetBatchEnd         (const int pinBase) ;
+extern int drcNetAnalogReadMulti  (const int pinBase, const int *pins, int *values, const int count) ;
+extern int drcNetDigitalReadMulti (const int pinBase, const int *pins, int *values, const int count) ;
+
+extern int drcNetCache (const int pinBase, const int on, const int analogTtlMs) ;
+
+extern int drcNetUdp (const int pinBase, const int on) ;
+extern int drcNetShm (const int pinBase, const int on) ;
+
+extern int drcNetGroup          (const int pinBase, const int numPins, const int *memberBases, const int count) ;
+extern int drcNetGroupConfirmed (const int pinBase) ;
+
+extern          long long drcNetTimeSync     (const int pinBase) ;
+extern unsigned long long drcNetTimeToLocal  (const int pinBase, unsigned long long remoteNs) ;
+extern unsigned long long drcNetTimeToRemote (const int pinBase, unsigned long long localNs) ;
+
+extern int drcNetSubmit       (const int pinBase, struct drcNetOpStruct *ops, const int n,
+				void (*callback)(void *context, struct drcNetOpStruct *ops, int n, int status), void *context) ;
+extern int drcNetAsyncPending (void) ;
+extern int drcNetAsyncFd      (void) ;
+extern int drcNetAsyncPoll    (void) ;
+extern int drcNetMacro        (const int pinBase, const struct drcNetOpStruct *steps, const int n, int *results, const int maxResults) ;
+
+extern int drcNetISR (int pin, int mode, int debounceMs, void (*function)(const struct wpiEdgeEventStruct *event)) ;
 
 #ifdef __cplusplus
 }
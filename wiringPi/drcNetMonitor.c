@@ -0,0 +1,417 @@
+/*
+ * drcNetMonitor.c:
+ *	Read-only pins, from what a wiringPiD multicasts.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+/*
+ * Notes:
+ *	A wiringPiD started with -M multicasts the pins it's watching; this
+ *	listens and keeps an image of them as a node, so digitalRead () and
+ *	analogRead () of pinBase + the server's pin number come from it and
+ *	never touch the network. Writes go nowhere. Only pins the server
+ *	publishes have values - anything else reads 0.
+ *
+ *	Missing a datagram, or the server restarting, leaves the image as it
+ *	was until the next keyframe (every DRCN_MCAST_KEY_MS) puts it right;
+ *	drcNetMonitorInSync () says whether it's in step at the moment, and
+ *	isn't if nothing's been heard for three keyframes.
+ *********************************************************************************
+ */
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stddef.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+
+#include "wiringPi.h"
+#include "drcNetMonitor.h"
+#include "../wiringPiD/drcNetCmd.h"
+
+#define	MAX_MONITORS	4
+#define	SILENT_NS	(3ULL * DRCN_MCAST_KEY_MS * 1000000)
+
+struct monitorStruct
+{
+  struct wiringPiNodeStruct *node ;
+  int       fd ;
+  volatile int running ;
+  pthread_t thread ;
+
+  int      *digital ;			// numPins of each
+  int      *analog ;
+
+  int       synced ;
+  uint32_t  source ;
+  uint32_t  seq ;			// Expected next
+  uint64_t  heard ;			// drcNetClock () of the last datagram
+
+  unsigned int    changes ;
+  pthread_mutex_t lock ;
+  pthread_cond_t  changed ;
+} ;
+
+static struct monitorStruct *monitors [MAX_MONITORS] ;
+static pthread_mutex_t monitorsLock = PTHREAD_MUTEX_INITIALIZER ;
+
+
+/*
+ * findMonitor:
+ *********************************************************************************
+ */
+
+static struct monitorStruct *findMonitor (int pinBase)
+{
+  int i ;
+
+  for (i = 0 ; i < MAX_MONITORS ; ++i)
+    if ((monitors [i] != NULL) && (monitors [i]->node->pinBase == pinBase))
+      return monitors [i] ;
+
+  return NULL ;
+}
+
+static struct monitorStruct *nodeMonitor (struct wiringPiNodeStruct *node)
+{
+  int i ;
+
+  for (i = 0 ; i < MAX_MONITORS ; ++i)
+    if ((monitors [i] != NULL) && (monitors [i]->node == node))
+      return monitors [i] ;
+
+  return NULL ;
+}
+
+
+/*
+ * myDigitalRead:
+ * myAnalogRead:
+ *	From the image
+ *********************************************************************************
+ */
+
+static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
+{
+  struct monitorStruct *m = nodeMonitor (node) ;
+
+  return (m == NULL) ? 0 : __atomic_load_n (&m->digital [pin - node->pinBase], __ATOMIC_RELAXED) ;
+}
+
+static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
+{
+  struct monitorStruct *m = nodeMonitor (node) ;
+
+  return (m == NULL) ? 0 : __atomic_load_n (&m->analog [pin - node->pinBase], __ATOMIC_RELAXED) ;
+}
+
+
+/*
+ * apply:
+ *	Take in a datagram, if it's one we can
+ *********************************************************************************
+ */
+
+static void apply (struct monitorStruct *m, const struct drcNetMcastStruct *frame)
+{
+  int numPins = m->node->pinMax - m->node->pinBase + 1 ;
+  int keyframe = (frame->flags & DRCN_MCAST_KEYFRAME) != 0 ;
+  uint32_t pin ;
+  int *value ;
+  int i, changed = FALSE ;
+
+  if (keyframe)
+  {
+    m->synced = TRUE ;
+    m->source = frame->source ;
+  }
+  else if (!m->synced || (frame->source != m->source) || (frame->seq != m->seq))
+  {
+    m->synced = FALSE ;		// Wait for the next keyframe
+    return ;
+  }
+
+  m->seq = frame->seq + 1 ;
+
+  for (i = 0 ; i < frame->count ; ++i)
+  {
+    pin = frame->pins [i].pin & ~DRCN_MCAST_ANALOG ;
+    if (pin >= (uint32_t)numPins)
+      continue ;
+    value = ((frame->pins [i].pin & DRCN_MCAST_ANALOG) != 0) ? &m->analog [pin] : &m->digital [pin] ;
+    if (*value != frame->pins [i].value)
+    {
+      __atomic_store_n (value, frame->pins [i].value, __ATOMIC_RELAXED) ;
+      changed = TRUE ;
+    }
+  }
+
+  if (changed)
+  {
+    ++m->changes ;
+    pthread_cond_broadcast (&m->changed) ;
+  }
+}
+
+
+/*
+ * monitorThread:
+ *	Listen for datagrams
+ *********************************************************************************
+ */
+
+static void *monitorThread (void *arg)
+{
+  struct monitorStruct *m = (struct monitorStruct *)arg ;
+  struct drcNetMcastStruct frame ;
+  struct pollfd pfd ;
+  ssize_t len ;
+
+  pfd.fd     = m->fd ;
+  pfd.events = POLLIN ;
+
+  while (m->running)
+  {
+    if (poll (&pfd, 1, 100) <= 0)	// To notice being stopped
+      continue ;
+
+    if ((len = recv (m->fd, &frame, sizeof (frame), 0)) < (ssize_t)offsetof (struct drcNetMcastStruct, pins))
+      continue ;
+
+    if ((frame.magic != DRCN_MCAST_MAGIC) || (frame.count > DRCN_MCAST_MAX_PINS) ||
+	(len != (ssize_t)(offsetof (struct drcNetMcastStruct, pins) + frame.count * sizeof (struct drcNetMcastPinStruct))))
+      continue ;
+
+    pthread_mutex_lock (&m->lock) ;
+      m->heard = drcNetClock () ;
+      apply (m, &frame) ;
+    pthread_mutex_unlock (&m->lock) ;
+  }
+
+  return NULL ;
+}
+
+
+/*
+ * drcNetMonitorSetup:
+ *	Listen to a wiringPiD's multicast group (NULL and 0 for the default
+ *	group and port) and make its pins 0 to numPins - 1 our pinBase
+ *	onwards. Returns TRUE or FALSE, with errno set.
+ *********************************************************************************
+ */
+
+static void freeMonitor (struct monitorStruct *m)
+{
+  if (m->fd >= 0)
+    close (m->fd) ;
+  free (m->digital) ;
+  free (m->analog) ;
+  pthread_mutex_destroy (&m->lock) ;
+  pthread_cond_destroy  (&m->changed) ;
+  free (m) ;
+}
+
+int drcNetMonitorSetup (const int pinBase, const int numPins, const char *group, const int port)
+{
+  struct monitorStruct *m ;
+  struct sockaddr_in addr ;
+  struct ip_mreq mreq ;
+  int i, slot, on = 1 ;
+
+  if ((numPins < 1) || (port < 0) || (port > 65535))
+  {
+    errno = EINVAL ;
+    return FALSE ;
+  }
+
+  memset (&mreq, 0, sizeof (mreq)) ;
+  if ((inet_pton (AF_INET, (group == NULL) ? DRCN_MCAST_GROUP : group, &mreq.imr_multiaddr) != 1) ||
+	!IN_MULTICAST (ntohl (mreq.imr_multiaddr.s_addr)))
+  {
+    errno = EINVAL ;
+    return FALSE ;
+  }
+  mreq.imr_interface.s_addr = htonl (INADDR_ANY) ;
+
+  if ((m = calloc (1, sizeof (*m))) == NULL)
+    return FALSE ;
+
+  pthread_mutex_init (&m->lock,    NULL) ;
+  pthread_cond_init  (&m->changed, NULL) ;
+
+  m->digital = calloc (numPins, sizeof (int)) ;
+  m->analog  = calloc (numPins, sizeof (int)) ;
+
+  if ((m->digital == NULL) || (m->analog == NULL) || ((m->fd = socket (AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)) < 0))
+  {
+    m->fd = -1 ;
+    freeMonitor (m) ;
+    return FALSE ;
+  }
+
+  memset (&addr, 0, sizeof (addr)) ;
+  addr.sin_family      = AF_INET ;
+  addr.sin_port        = htons ((port == 0) ? DRCN_MCAST_PORT : port) ;
+  addr.sin_addr        = mreq.imr_multiaddr ;
+
+// Others on this box will want to listen too
+
+  setsockopt (m->fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof (on)) ;
+
+  if ((bind (m->fd, (struct sockaddr *)&addr, sizeof (addr)) < 0) ||
+      (setsockopt (m->fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof (mreq)) < 0))
+  {
+    freeMonitor (m) ;
+    return FALSE ;
+  }
+
+  pthread_mutex_lock (&monitorsLock) ;
+
+  for (slot = -1, i = 0 ; i < MAX_MONITORS ; ++i)
+    if (monitors [i] == NULL)
+    {
+      slot = i ;
+      break ;
+    }
+
+  if (slot < 0)
+  {
+    pthread_mutex_unlock (&monitorsLock) ;
+    freeMonitor (m) ;
+    errno = ENOSPC ;
+    return FALSE ;
+  }
+
+  m->node              = wiringPiNewNode (pinBase, numPins) ;
+  m->node->digitalRead = myDigitalRead ;
+  m->node->analogRead  = myAnalogRead ;
+  m->running           = TRUE ;
+  monitors [slot]      = m ;
+
+  pthread_mutex_unlock (&monitorsLock) ;
+
+  if (pthread_create (&m->thread, NULL, monitorThread, m) != 0)
+  {
+    m->running = FALSE ;
+    errno = EAGAIN ;
+    return FALSE ;
+  }
+
+  return TRUE ;
+}
+
+
+/*
+ * drcNetMonitorInSync:
+ *	Is the image up to date? 1 yes, 0 no, -1 if there's no monitor there.
+ *********************************************************************************
+ */
+
+int drcNetMonitorInSync (const int pinBase)
+{
+  struct monitorStruct *m ;
+  int result ;
+
+  if ((m = findMonitor (pinBase)) == NULL)
+  {
+    errno = ENODEV ;
+    return -1 ;
+  }
+
+  pthread_mutex_lock (&m->lock) ;
+    result = m->synced && ((drcNetClock () - m->heard) < SILENT_NS) ;
+  pthread_mutex_unlock (&m->lock) ;
+
+  return result ? 1 : 0 ;
+}
+
+
+/*
+ * drcNetMonitorWait:
+ *	Wait until something's changed since last (what we returned last
+ *	time, or 0), for up to timeoutMs (-1 forever). Returns the count of
+ *	changes to pass next time.
+ *********************************************************************************
+ */
+
+unsigned int drcNetMonitorWait (const int pinBase, unsigned int last, int timeoutMs)
+{
+  struct monitorStruct *m ;
+  struct timespec ts ;
+  unsigned int changes ;
+
+  if ((m = findMonitor (pinBase)) == NULL)
+    return last ;
+
+  clock_gettime (CLOCK_REALTIME, &ts) ;
+  if (timeoutMs >= 0)
+  {
+    ts.tv_sec  += timeoutMs / 1000 ;
+    ts.tv_nsec += (timeoutMs % 1000) * 1000000L ;
+    if (ts.tv_nsec >= 1000000000L)
+    {
+      ts.tv_nsec -= 1000000000L ;
+      ++ts.tv_sec ;
+    }
+  }
+
+  pthread_mutex_lock (&m->lock) ;
+    while (m->changes == last)
+    {
+      if (timeoutMs < 0)
+	pthread_cond_wait (&m->changed, &m->lock) ;
+      else if (pthread_cond_timedwait (&m->changed, &m->lock, &ts) == ETIMEDOUT)
+	break ;
+    }
+    changes = m->changes ;
+  pthread_mutex_unlock (&m->lock) ;
+
+  return changes ;
+}
+
+
+/*
+ * drcNetMonitorStop:
+ *	Stop listening. The pins keep their last values.
+ *********************************************************************************
+ */
+
+void drcNetMonitorStop (const int pinBase)
+{
+  struct monitorStruct *m ;
+
+  if (((m = findMonitor (pinBase)) == NULL) || !m->running)
+    return ;
+
+  m->running = FALSE ;
+  pthread_join (m->thread, NULL) ;
+
+  close (m->fd) ;
+  m->fd = -1 ;
+}
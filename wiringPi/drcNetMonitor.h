@@ -0,0 +1,36 @@
+/*
+ * drcNetMonitor.h:
+ *	Read-only pins, from what a wiringPiD multicasts.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int          drcNetMonitorSetup  (const int pinBase, const int numPins, const char *group, const int port) ;
+extern int          drcNetMonitorInSync (const int pinBase) ;
+extern unsigned int drcNetMonitorWait   (const int pinBase, unsigned int last, int timeoutMs) ;
+extern void         drcNetMonitorStop   (const int pinBase) ;
+
+#ifdef __cplusplus
+}
+#endif
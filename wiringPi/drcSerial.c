@@ -32,6 +32,98 @@
 
 #include "drcSerial.h"
 
+// The ATmega's receive buffer is only 64 bytes, so when pipelining reads
+//	we keep no more than this many commands in flight at once.
+
+#define	DRC_PIPELINE	16
+
+
+/*
+ * readReply:
+ *	Collect len bytes of replies from the remote end
+ *********************************************************************************
+ */
+
+static int readReply (const int fd, unsigned char *buf, int len)
+{
+  int got, n ;
+
+  for (got = 0 ; got < len ; got += n)
+    if ((n = serialRead (fd, buf + got, len - got, 10000)) <= 0)
+      return -1 ;
+
+  return 0 ;
+}
+
+
+/*
+ * pipelineRead:
+ *	Send a read command for each pin and collect the replies, keeping
+ *	up to DRC_PIPELINE of them on the wire at a time. Each reply is
+ *	replyLen bytes.
+ *********************************************************************************
+ */
+
+static int pipelineRead (struct wiringPiNodeStruct *node, unsigned char command, const int *pins, int stride, int first, int n, int replyLen, unsigned char *replies)
+{
+  unsigned char cmd [DRC_PIPELINE * 2] ;
+  int done, chunk, i ;
+
+  for (done = 0 ; done < n ; done += chunk)
+  {
+    chunk = n - done ;
+    if (chunk > DRC_PIPELINE)
+      chunk = DRC_PIPELINE ;
+
+    for (i = 0 ; i < chunk ; ++i)
+    {
+      cmd [i * 2]     = command ;
+      cmd [i * 2 + 1] = ((pins != NULL) ? pins [done + i] : first + (done + i) * stride) - node->pinBase ;
+    }
+
+    if (serialWrite (node->fd, cmd, chunk * 2) < 0)
+      return -1 ;
+
+    if (readReply (node->fd, replies + done * replyLen, chunk * replyLen) < 0)
+      return -1 ;
+  }
+
+  return 0 ;
+}
+
+
+/*
+ * sendCmd:
+ *	Send a command that has no reply. Inside wiringPiBegin the output
+ *	is buffered until wiringPiCommit calls myFlush - node->data1 says
+ *	we did that, and node->data0 that drcBatchBegin has it anyway.
+ *********************************************************************************
+ */
+
+static void sendCmd (struct wiringPiNodeStruct *node, const unsigned char *cmd, int len)
+{
+  if (!node->data0 && !node->data1 && wiringPiDeferred ())
+    if (serialBufferOut (node->fd, SERIAL_OUT_BUF_SIZE) == 0)
+      node->data1 = TRUE ;
+
+  serialWrite (node->fd, cmd, len) ;
+}
+
+
+/*
+ * myFlush:
+ *********************************************************************************
+ */
+
+static void myFlush (struct wiringPiNodeStruct *node)
+{
+  if (node->data1)
+  {
+    serialBufferOut (node->fd, 0) ;
+    node->data1 = FALSE ;
+  }
+}
+
 
 /*
  * myPinMode:
@@ -41,14 +133,17 @@
 
 static void myPinMode (struct wiringPiNodeStruct *node, int pin, int mode)
 {
+  unsigned char cmd [2] ;
+
   /**/ if (mode == OUTPUT)
-    serialPutchar (node->fd, 'o') ;       // Input
+    cmd [0] = 'o' ;       // Output
   else if (mode == PWM_OUTPUT)
-    serialPutchar (node->fd, 'p') ;       // PWM
+    cmd [0] = 'p' ;       // PWM
   else
-    serialPutchar (node->fd, 'i') ;       // Default to input
+    cmd [0] = 'i' ;       // Default to input
 
-  serialPutchar (node->fd, pin - node->pinBase) ;
+  cmd [1] = pin - node->pinBase ;
+  sendCmd (node, cmd, 2) ;
 }
 
 
@@ -61,21 +156,26 @@ static void myPinMode (struct wiringPiNodeStruct *node, int pin, int mode)
 static void myPullUpDnControl (struct wiringPiNodeStruct *node, int pin, int mode)
 {
 
+  unsigned char cmd [4] ;
+  int len = 2 ;
+
 // Force pin into input mode
 
-  serialPutchar (node->fd, 'i' ) ;
-  serialPutchar (node->fd, pin - node->pinBase) ;
+  cmd [0] = 'i' ;
+  cmd [1] = pin - node->pinBase ;
 
   /**/ if (mode == PUD_UP)
   {
-    serialPutchar (node->fd, '1') ;
-    serialPutchar (node->fd, pin - node->pinBase) ;
+    cmd [len++] = '1' ;
+    cmd [len++] = pin - node->pinBase ;
   }
   else if (mode == PUD_OFF)
   {
-    serialPutchar (node->fd, '0') ;
-    serialPutchar (node->fd, pin - node->pinBase) ;
+    cmd [len++] = '0' ;
+    cmd [len++] = pin - node->pinBase ;
   }
+
+  sendCmd (node, cmd, len) ;
 }
 
 
@@ -86,8 +186,11 @@ static void myPullUpDnControl (struct wiringPiNodeStruct *node, int pin, int mod
 
 static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
 {
-  serialPutchar (node->fd, value == 0 ? '0' : '1') ;
-  serialPutchar (node->fd, pin - node->pinBase) ;
+  unsigned char cmd [2] ;
+
+  cmd [0] = value == 0 ? '0' : '1' ;
+  cmd [1] = pin - node->pinBase ;
+  sendCmd (node, cmd, 2) ;
 }
 
 
@@ -98,9 +201,12 @@ static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
 
 static void myPwmWrite (struct wiringPiNodeStruct *node, int pin, int value)
 {
-  serialPutchar (node->fd, 'v') ;
-  serialPutchar (node->fd, pin - node->pinBase) ;
-  serialPutchar (node->fd, value & 0xFF) ;
+  unsigned char cmd [3] ;
+
+  cmd [0] = 'v' ;
+  cmd [1] = pin - node->pinBase ;
+  cmd [2] = value & 0xFF ;
+  sendCmd (node, cmd, 3) ;
 }
 
 
@@ -111,14 +217,17 @@ static void myPwmWrite (struct wiringPiNodeStruct *node, int pin, int value)
 
 static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
 {
-  int vHi, vLo ;
+  unsigned char cmd [2] ;
+  unsigned char reply [2] ;
 
-  serialPutchar (node->fd, 'a') ;
-  serialPutchar (node->fd, pin - node->pinBase) ;
-  vHi = serialGetchar (node->fd) ;
-  vLo = serialGetchar (node->fd) ;
+  cmd [0] = 'a' ;
+  cmd [1] = pin - node->pinBase ;
+  serialWrite (node->fd, cmd, 2) ;
 
-  return (vHi << 8) | vLo ;
+  if (readReply (node->fd, reply, 2) < 0)
+    return -1 ;
+
+  return (reply [0] << 8) | reply [1] ;
 }
 
 
@@ -129,12 +238,158 @@ static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
 
 static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
 {
-  serialPutchar (node->fd, 'r') ; // Send read command
-  serialPutchar (node->fd, pin - node->pinBase) ;
+  unsigned char cmd [2] ;
+
+  cmd [0] = 'r' ;		// Send read command
+  cmd [1] = pin - node->pinBase ;
+  serialWrite (node->fd, cmd, 2) ;
   return (serialGetchar (node->fd) == '0') ? 0 : 1 ;
 }
 
 
+/*
+ * myDigitalRead8:
+ * myDigitalRead16:
+ *	There's no port read command in the DRC firmware, so pipeline the
+ *	single pin reads instead - one write, one lot of replies.
+ *********************************************************************************
+ */
+
+static unsigned int digitalReadBits (struct wiringPiNodeStruct *node, int pin, int bits)
+{
+  unsigned char replies [16] ;
+  unsigned int  value = 0 ;
+  int i ;
+
+// Only the pins the node has - any past the end read as 0, as they do
+//	for everyone else
+
+  if ((pin < node->pinBase) || (pin > node->pinMax))
+    return 0 ;
+
+  if (bits > node->pinMax - pin + 1)
+    bits = node->pinMax - pin + 1 ;
+
+  if (pipelineRead (node, 'r', NULL, 1, pin, bits, 1, replies) < 0)
+    return 0 ;
+
+  for (i = 0 ; i < bits ; ++i)
+    if (replies [i] != '0')
+      value |= 1 << i ;
+
+  return value ;
+}
+
+static unsigned int myDigitalRead8  (struct wiringPiNodeStruct *node, int pin) { return digitalReadBits (node, pin,  8) ; }
+static unsigned int myDigitalRead16 (struct wiringPiNodeStruct *node, int pin) { return digitalReadBits (node, pin, 16) ; }
+
+
+/*
+ * drcBatchBegin:
+ * drcBatchEnd:
+ *	Between these, pinMode, digitalWrite, pwmWrite etc. on the DRC at
+ *	pinBase are queued up and sent in as few writes as possible. Any read
+ *	sends the queue first, so its reply is in order. drcBatchEnd sends
+ *	anything left.
+ *********************************************************************************
+ */
+
+static struct wiringPiNodeStruct *findDrc (const int pinBase)
+{
+  struct wiringPiNodeStruct *node = wiringPiFindNode (pinBase) ;
+
+  if ((node == NULL) || (node->pinMode != myPinMode))
+    return NULL ;
+
+  return node ;
+}
+
+int drcBatchBegin (const int pinBase)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if ((node = findDrc (pinBase)) == NULL)
+    return -1 ;
+
+  node->data0 = TRUE ;
+  node->data1 = FALSE ;
+
+  return serialBufferOut (node->fd, SERIAL_OUT_BUF_SIZE) ;
+}
+
+int drcBatchEnd (const int pinBase)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if ((node = findDrc (pinBase)) == NULL)
+    return -1 ;
+
+  node->data0 = FALSE ;
+
+  return serialBufferOut (node->fd, 0) ;
+}
+
+
+/*
+ * drcAnalogReadMulti:
+ * drcDigitalReadMulti:
+ *	Read several pins at once, pipelining the commands rather than paying
+ *	a full round trip for each. Pins are normal wiringPi pin numbers on
+ *	the DRC at pinBase. Returns 0, or -1 if the remote end doesn't answer.
+ *********************************************************************************
+ */
+
+int drcAnalogReadMulti (const int pinBase, const int *pins, int *values, const int count)
+{
+  struct wiringPiNodeStruct *node ;
+  unsigned char replies [DRC_PIPELINE * 2] ;
+  int done, chunk, i ;
+
+  if ((node = findDrc (pinBase)) == NULL)
+    return -1 ;
+
+  for (done = 0 ; done < count ; done += chunk)
+  {
+    chunk = count - done ;
+    if (chunk > DRC_PIPELINE)
+      chunk = DRC_PIPELINE ;
+
+    if (pipelineRead (node, 'a', pins + done, 0, 0, chunk, 2, replies) < 0)
+      return -1 ;
+
+    for (i = 0 ; i < chunk ; ++i)
+      values [done + i] = (replies [i * 2] << 8) | replies [i * 2 + 1] ;
+  }
+
+  return 0 ;
+}
+
+int drcDigitalReadMulti (const int pinBase, const int *pins, int *values, const int count)
+{
+  struct wiringPiNodeStruct *node ;
+  unsigned char replies [DRC_PIPELINE] ;
+  int done, chunk, i ;
+
+  if ((node = findDrc (pinBase)) == NULL)
+    return -1 ;
+
+  for (done = 0 ; done < count ; done += chunk)
+  {
+    chunk = count - done ;
+    if (chunk > DRC_PIPELINE)
+      chunk = DRC_PIPELINE ;
+
+    if (pipelineRead (node, 'r', pins + done, 0, 0, chunk, 1, replies) < 0)
+      return -1 ;
+
+    for (i = 0 ; i < chunk ; ++i)
+      values [done + i] = (replies [i] == '0') ? 0 : 1 ;
+  }
+
+  return 0 ;
+}
+
+
 /*
  * drcSetup:
  *	Create a new instance of an DRC GPIO interface.
@@ -190,7 +445,10 @@ int drcSetupSerial (const int pinBase, const int numPins, const char *device, co
   node->analogRead      = myAnalogRead ;
   node->digitalRead     = myDigitalRead ;
   node->digitalWrite    = myDigitalWrite ;
+  node->digitalRead8    = myDigitalRead8 ;
+  node->digitalRead16   = myDigitalRead16 ;
   node->pwmWrite        = myPwmWrite ;
+  node->flush           = myFlush ;
 
   return TRUE ;
 }
@@ -28,6 +28,11 @@ extern "C" {
 
 extern int drcSetupSerial (const int pinBase, const int numPins, const char *device, const int baud) ;
 
+extern int drcBatchBegin       (const int pinBase) ;
+extern int drcBatchEnd         (const int pinBase) ;
+extern int drcAnalogReadMulti  (const int pinBase, const int *pins, int *values, const int count) ;
+extern int drcDigitalReadMulti (const int pinBase, const int *pins, int *values, const int count) ;
+
 #ifdef __cplusplus
 }
 #endif
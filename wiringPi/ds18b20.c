@@ -30,9 +30,15 @@
 #include <unistd.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <malloc.h>
 #include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <libgen.h>
+#include <limits.h>
+#include <pthread.h>
 
 #include "wiringPi.h"
 
@@ -40,51 +46,78 @@
 
 #define	W1_PREFIX	"/sys/bus/w1/devices/28-"
 #define	W1_POSTFIX	"/w1_slave"
+#define	W1_TEMP		"/temperature"
+#define	W1_BULK		"/therm_bulk_read"
+
+// Cached probes, and the 1-Wire busses they're on - each bus has a thread
+//	of its own to keep them up to date.
+
+#define	MAX_PROBES	32
+#define	MAX_BUSSES	4
+
+struct ds18b20BusStruct
+{
+  char         path [PATH_MAX] ;	// Bus master directory
+  int          bulkFd ;			// therm_bulk_read, or -1 if there isn't one
+  int          periodMs ;
+  int          running ;
+} ;
+
+struct ds18b20ProbeStruct
+{
+  struct wiringPiNodeStruct *node ;
+  struct ds18b20BusStruct   *bus ;
+  int          fd ;
+  int          isSlave ;		// fd is w1_slave rather than temperature
+  int          valid ;
+  int          value ;
+  unsigned int stamp ;			// millis () when we got it
+} ;
+
+static struct ds18b20BusStruct   busses [MAX_BUSSES] ;
+static struct ds18b20ProbeStruct probes [MAX_PROBES] ;
+static pthread_mutex_t           probeLock = PTHREAD_MUTEX_INITIALIZER ;
 
 
 /*
- * myAnalogRead:
+ * readTemp:
+ *	Read and decode a reading, from either w1_slave (two short lines, with
+ *	YES at the end of the first and t= on the second) or temperature
+ *	(just the number). Either way it's degrees * 1000, which we round to
+ *	degrees * 10. Returns 0 or one of the -999x codes.
  *********************************************************************************
  */
 
-static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
+static int readTemp (int fd, int isSlave, int *result)
 {
-  int  chan = pin - node->pinBase ;
-  int  fd = node->fd ;
-  char buffer [4096] ;
+  char buffer [256] ;
   char *p ;
-  int  temp, sign ;
-
-  if (chan != 0)
-    return -9999 ;
-
-// Rewind the file - we're keeping it open to keep things going
-//	smoothly
-
-  lseek (fd, 0, SEEK_SET) ;
+  int  len, temp, sign ;
 
-// Read the file - we know it's only a couple of lines, so this ought to be
-//	more than enough
+// Both files are tiny and we're keeping them open, so read from the start
 
-  if (read (fd, buffer, 4096) <= 0)	// Read nothing, or it failed in some odd way
+  if ((len = pread (fd, buffer, sizeof (buffer) - 1, 0)) <= 0)	// Read nothing, or it failed in some odd way
     return -9998 ;
+  buffer [len] = 0 ;
 
-// Look for YES, then t=
-
-  if (strstr (buffer, "YES") == NULL)
-    return -9997 ;
+  if (isSlave)
+  {
+    if (((p = strchr (buffer, '\n')) == NULL) || (p - buffer < 3) || (strncmp (p - 3, "YES", 3) != 0))
+      return -9997 ;
 
-  if ((p = strstr (buffer, "t=")) == NULL)
-    return -9996 ;
+    if ((p = strstr (p, "t=")) == NULL)
+      return -9996 ;
 
 // p points to the 't', so we skip over it...
 
-  p += 2 ;
+    p += 2 ;
+  }
+  else
+    p = buffer ;
 
 // and extract the number
 //	(without caring about overflow)
 
-
   if (*p == '-')	// Negative number?
   {
     sign = -1 ;
@@ -93,6 +126,9 @@ static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
   else
     sign = 1 ;
 
+  if (!isdigit (*p))
+    return -9996 ;
+
   temp = 0 ;
   while (isdigit (*p))
   {
@@ -103,35 +139,225 @@ static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
 // We know it returns temp * 1000, but we only really want temp * 10, so
 //	do a bit of rounding...
 
-  temp = (temp + 50) / 100 ;
-  return temp * sign ;
+  *result = sign * ((temp + 50) / 100) ;
+
+  return 0 ;
 }
 
 
 /*
- * ds18b20Setup:
- *	Create a new instance of a DS18B20 temperature sensor.
+ * myAnalogRead:
+ *	Straight from the sensor - this takes the full conversion time
  *********************************************************************************
  */
 
-int ds18b20Setup (const int pinBase, const char *deviceId)
+static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
+{
+  int  temp, err ;
+
+  if (pin != node->pinBase)
+    return -9999 ;
+
+  if ((err = readTemp (node->fd, TRUE, &temp)) < 0)
+    return err ;
+
+  return temp ;
+}
+
+
+/*
+ * findProbe:
+ * myCachedRead:
+ *	The last reading the bus thread got, so no waiting, or -9995 if
+ *	there hasn't been one yet.
+ *********************************************************************************
+ */
+
+static struct ds18b20ProbeStruct *findProbe (struct wiringPiNodeStruct *node)
+{
+  int i ;
+
+  for (i = 0 ; i < MAX_PROBES ; ++i)
+    if (probes [i].node == node)
+      return &probes [i] ;
+
+  return NULL ;
+}
+
+static int myCachedRead (struct wiringPiNodeStruct *node, int pin)
+{
+  struct ds18b20ProbeStruct *probe ;
+  int temp = -9995 ;
+
+  if (pin != node->pinBase)
+    return -9999 ;
+
+  pthread_mutex_lock (&probeLock) ;
+    if (((probe = findProbe (node)) != NULL) && probe->valid)
+      temp = probe->value ;
+  pthread_mutex_unlock (&probeLock) ;
+
+  return temp ;
+}
+
+
+/*
+ * ds18b20Timestamp:
+ *	When (in millis ()) the cached reading for pin was taken, or 0 if
+ *	there isn't one.
+ *********************************************************************************
+ */
+
+unsigned int ds18b20Timestamp (const int pin)
+{
+  struct ds18b20ProbeStruct *probe ;
+  unsigned int stamp = 0 ;
+
+  pthread_mutex_lock (&probeLock) ;
+    if (((probe = findProbe (wiringPiFindNode (pin))) != NULL) && probe->valid)
+      stamp = probe->stamp ;
+  pthread_mutex_unlock (&probeLock) ;
+
+  return stamp ;
+}
+
+
+/*
+ * bulkConvert:
+ *	Tell every sensor on the bus to convert at once (SKIP ROM, CONVERT T)
+ *	and wait for them all to finish. Reading temperature or w1_slave
+ *	after this gets the result rather than starting another conversion.
+ *	therm_bulk_read reads -1 while any are still converting.
+ *********************************************************************************
+ */
+
+static int bulkConvert (struct ds18b20BusStruct *bus)
+{
+  char buf [16] ;
+  int  i, len ;
+
+  if (pwrite (bus->bulkFd, "trigger\n", 8, 0) != 8)
+    return -1 ;
+
+  for (i = 0 ; i < 100 ; ++i)		// A second is plenty, even at 12 bits
+  {
+    if ((len = pread (bus->bulkFd, buf, sizeof (buf) - 1, 0)) <= 0)
+      return -1 ;
+    buf [len] = 0 ;
+    if (atoi (buf) != -1)
+      return 0 ;
+    delay (10) ;
+  }
+
+  return -1 ;
+}
+
+
+/*
+ * busThread:
+ *	Keep the cached readings for the probes on one bus up to date, once
+ *	every periodMs. With bulk conversion that's one conversion time per
+ *	period however many probes there are; without (older kernels) we have
+ *	to read them one after the other.
+ *********************************************************************************
+ */
+
+static void *busThread (void *arg)
+{
+  struct ds18b20BusStruct *bus = (struct ds18b20BusStruct *)arg ;
+  struct timespec next ;
+  int i, fd, isSlave, err, temp ;
+
+  clock_gettime (CLOCK_MONOTONIC, &next) ;
+
+  for (;;)
+  {
+    if (bus->bulkFd != -1)
+      (void)bulkConvert (bus) ;
+
+    for (i = 0 ; i < MAX_PROBES ; ++i)
+    {
+      pthread_mutex_lock (&probeLock) ;
+	fd      = (probes [i].bus == bus) ? probes [i].fd : -1 ;
+	isSlave = probes [i].isSlave ;
+      pthread_mutex_unlock (&probeLock) ;
+
+      if (fd == -1)
+	continue ;
+
+      err = readTemp (fd, isSlave, &temp) ;
+
+      pthread_mutex_lock (&probeLock) ;
+	if ((err == 0) && (probes [i].fd == fd))
+	{
+	  probes [i].value = temp ;
+	  probes [i].stamp = millis () ;
+	  probes [i].valid = TRUE ;
+	}
+      pthread_mutex_unlock (&probeLock) ;
+    }
+
+    next.tv_sec  += bus->periodMs / 1000 ;
+    next.tv_nsec += (bus->periodMs % 1000) * 1000000 ;
+    if (next.tv_nsec >= 1000000000)
+    {
+      next.tv_nsec -= 1000000000 ;
+      ++next.tv_sec ;
+    }
+    while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+      ;
+  }
+
+  return NULL ;
+}
+
+
+/*
+ * openProbe:
+ *	Open the w1_slave file for a sensor - or the bus master directory
+ *	it lives in, if busPath isn't NULL.
+ *********************************************************************************
+ */
+
+static int openProbe (const char *deviceId, const char *postfix, char *busPath)
 {
-  int fd ;
-  struct wiringPiNodeStruct *node ;
   char *fileName ;
+  char  real [PATH_MAX] ;
+  int   fd = -1 ;
 
 // Allocate space for the filename
 
-  if ((fileName = malloc (strlen (W1_PREFIX) + strlen (W1_POSTFIX) + strlen (deviceId) + 1)) == NULL)
-    return FALSE ;
+  if ((fileName = malloc (strlen (W1_PREFIX) + strlen (postfix) + strlen (deviceId) + 1)) == NULL)
+    return -1 ;
 
-  sprintf (fileName, "%s%s%s", W1_PREFIX, deviceId, W1_POSTFIX) ;
+  sprintf (fileName, "%s%s%s", W1_PREFIX, deviceId, postfix) ;
 
-  fd = open (fileName, O_RDONLY) ;
+  if (busPath == NULL)
+    fd = open (fileName, O_RDONLY) ;
+  else if (realpath (fileName, real) != NULL)		// .../w1_bus_masterN/28-xxx
+  {
+    strcpy (busPath, dirname (real)) ;
+    fd = 0 ;
+  }
 
   free (fileName) ;
 
-  if (fd < 0)
+  return fd ;
+}
+
+
+/*
+ * ds18b20Setup:
+ *	Create a new instance of a DS18B20 temperature sensor.
+ *********************************************************************************
+ */
+
+int ds18b20Setup (const int pinBase, const char *deviceId)
+{
+  int fd ;
+  struct wiringPiNodeStruct *node ;
+
+  if ((fd = openProbe (deviceId, W1_POSTFIX, NULL)) < 0)
     return FALSE ;
 
 // We'll keep the file open, to make access a little faster
@@ -144,3 +370,92 @@ int ds18b20Setup (const int pinBase, const char *deviceId)
 
   return TRUE ;
 }
+
+
+/*
+ * ds18b20SetupCached:
+ *	As above, but analogRead returns straight away with the latest
+ *	reading from a thread that refreshes every probe on the same 1-Wire
+ *	bus at once, every periodMs - ds18b20Timestamp says how old it is.
+ *	The fastest period asked for on a bus wins.
+ *********************************************************************************
+ */
+
+int ds18b20SetupCached (const int pinBase, const char *deviceId, const int periodMs)
+{
+  struct wiringPiNodeStruct *node ;
+  struct ds18b20ProbeStruct *probe = NULL ;
+  struct ds18b20BusStruct   *bus   = NULL ;
+  char      busPath [PATH_MAX], bulk [PATH_MAX + 32] ;
+  pthread_t thread ;
+  int fd, isSlave = FALSE, i ;
+
+  if (periodMs < 1)
+    return FALSE ;
+
+  if (openProbe (deviceId, "", busPath) < 0)
+    return FALSE ;
+
+// The temperature file is just the number; older kernels don't have it
+
+  if ((fd = openProbe (deviceId, W1_TEMP, NULL)) < 0)
+  {
+    if ((fd = openProbe (deviceId, W1_POSTFIX, NULL)) < 0)
+      return FALSE ;
+    isSlave = TRUE ;
+  }
+
+  pthread_mutex_lock (&probeLock) ;
+
+  for (i = 0 ; (probe == NULL) && (i < MAX_PROBES) ; ++i)
+    if (probes [i].bus == NULL)
+      probe = &probes [i] ;
+
+  for (i = 0 ; (bus == NULL) && (i < MAX_BUSSES) ; ++i)
+    if (busses [i].running && (strcmp (busses [i].path, busPath) == 0))
+      bus = &busses [i] ;
+
+  for (i = 0 ; (bus == NULL) && (i < MAX_BUSSES) ; ++i)
+    if (!busses [i].running)
+    {
+      bus = &busses [i] ;
+      strcpy (bus->path, busPath) ;
+      sprintf (bulk, "%s%s", busPath, W1_BULK) ;
+      bus->bulkFd   = open (bulk, O_RDWR) ;
+      bus->periodMs = periodMs ;
+      if (pthread_create (&thread, NULL, busThread, bus) != 0)
+      {
+	if (bus->bulkFd != -1)
+	  close (bus->bulkFd) ;
+	bus = NULL ;
+	break ;
+      }
+      pthread_detach (thread) ;
+      bus->running = TRUE ;
+    }
+
+  if ((probe == NULL) || (bus == NULL))
+  {
+    pthread_mutex_unlock (&probeLock) ;
+    close (fd) ;
+    return FALSE ;
+  }
+
+  if (periodMs < bus->periodMs)
+    bus->periodMs = periodMs ;
+
+  node = wiringPiNewNode (pinBase, 1) ;
+
+  node->fd         = fd ;
+  node->analogRead = myCachedRead ;
+
+  probe->node    = node ;
+  probe->bus     = bus ;
+  probe->fd      = fd ;
+  probe->isSlave = isSlave ;
+  probe->valid   = FALSE ;
+
+  pthread_mutex_unlock (&probeLock) ;
+
+  return TRUE ;
+}
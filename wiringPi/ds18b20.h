@@ -27,7 +27,9 @@
 extern "C" {
 #endif
 
-extern int ds18b20Setup (const int pinBase, const char *serialNum) ;
+extern int          ds18b20Setup       (const int pinBase, const char *serialNum) ;
+extern int          ds18b20SetupCached (const int pinBase, const char *serialNum, const int periodMs) ;
+extern unsigned int ds18b20Timestamp   (const int pin) ;
 
 #ifdef __cplusplus
 }
@@ -24,9 +24,11 @@
  */
 
 #include <unistd.h>
+#include <errno.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "wiringPi.h"
 #include "wiringPiI2C.h"
@@ -45,69 +47,274 @@ int checksum (UNU uint8_t data [4])
 
 
 
+// Measurement state machine
+//	A measurement is a temperature conversion followed by a humidity one,
+//	both in no-hold mode: the chip NAKs the read until it's finished, so
+//	htu21dCollect () can just try once the conversion is due. A NAK past
+//	the datasheet's longest conversion (50mS and 16mS) plus a margin, or
+//	any other error, and the measurement's abandoned.
+
+#define	HTU_IDLE	0
+#define	HTU_TEMP	1
+#define	HTU_HUMID	2
+
+#define	HTU_NOT_READY	-9996
+#define	HTU_MARGIN	10
+
+static int             htuFd    = -1 ;
+static int             htuState = HTU_IDLE ;
+static unsigned int    htuDue, htuGiveUp ;
+static int             htuTemp, htuHumid ;
+static volatile int    htuValid = FALSE ;
+static volatile int    htuError = FALSE ;	// The last measurement failed
+static pthread_mutex_t htuLock  = PTHREAD_MUTEX_INITIALIZER ;
+
+static pthread_t       htuThread ;
+static volatile int    htuPeriod = 0 ;	// Async mode when non-zero
+
+
 /*
- * myAnalogRead:
+ * readTemp:
+ * readHumid:
+ *	Collect and convert the results. HTU_NOT_READY if the chip NAK'd
+ *	the read, -9998 for any other I2C error.
  *********************************************************************************
  */
 
-static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
+static int readTemp (int fd)
 {
-  int chan = pin - node->pinBase ;
-  int fd   = node->fd ;
-  uint8_t data [4] ;
-  uint32_t sTemp, sHumid ;
-  double   fTemp, fHumid ;
-  int      cTemp, cHumid ;
+  uint8_t  data [4] ;
+  uint32_t sTemp ;
+  double   fTemp ;
 
-  /**/ if (chan == 0)	// Read Temperature
+  if (wiringPiI2CReadBytes (fd, data, 3) != 3)
+    return ((errno == ENXIO) || (errno == EREMOTEIO)) ? HTU_NOT_READY : -9998 ;
+
+  if (!checksum (data))
+    return -9997 ;
+
+  sTemp = (data [0] << 8) | data [1] ;
+  fTemp = -48.85 + 175.72 * (double)sTemp / 63356.0 ;
+  return (int)rint (((100.0 * fTemp) + 0.5) / 10.0) ;
+}
+
+static int readHumid (int fd)
+{
+  uint8_t  data [4] ;
+  uint32_t sHumid ;
+  double   fHumid ;
+
+  if (wiringPiI2CReadBytes (fd, data, 3) != 3)
+    return ((errno == ENXIO) || (errno == EREMOTEIO)) ? HTU_NOT_READY : -9998 ;
+
+  if (!checksum (data))
+    return -9997 ;
+
+  sHumid = (data [0] << 8) | data [1] ;
+  fHumid = -6.0 + 125.0 * (double)sHumid / 65536.0 ;
+  return (int)rint (((100.0 * fHumid) + 0.5) / 10.0) ;
+}
+
+
+/*
+ * htu21dStart:
+ *	Start a temperature + humidity measurement, if one isn't running.
+ *********************************************************************************
+ */
+
+int htu21dStart (void)
+{
+  uint8_t cmd = 0xF3 ;
+  int     result = 0 ;
+
+  if (htuFd == -1)
+    return -1 ;
+
+  pthread_mutex_lock (&htuLock) ;
+
+  if (htuState == HTU_IDLE)
   {
+    if (wiringPiI2CWriteBytes (htuFd, &cmd, 1) != 1)
+      result = -1 ;
+    else
+    {
+      htuDue    = millis () + 44 ;		// Typical, 14-bit
+      htuGiveUp = millis () + 50 + HTU_MARGIN ;	// Maximum
+      htuState  = HTU_TEMP ;
+    }
+  }
 
-// Send read temperature command:
+  pthread_mutex_unlock (&htuLock) ;
 
-    data [0] = 0xF3 ;
-    if (write (fd, data, 1) != 1)
-      return -9999 ;
+  return result ;
+}
 
-// Wait then read the data
 
-    delay (50) ;
-    if (read (fd, data, 3) != 3)
-      return -9998 ;
+/*
+ * htu21dCollect:
+ *	Move the measurement along if its conversion is done. Returns TRUE
+ *	when a whole measurement has been completed and the values updated,
+ *	FALSE while it's still in progress (or if none was started), or -1
+ *	if it failed and has been abandoned.
+ *********************************************************************************
+ */
+
+int htu21dCollect (void)
+{
+  uint8_t cmd = 0xF5 ;
+  int     value, done = FALSE ;
 
-    if (!checksum (data))
-      return -9997 ;
+  pthread_mutex_lock (&htuLock) ;
 
-// Do the calculation
+  if ((htuState == HTU_IDLE) || ((int)(htuDue - millis ()) > 0))
+  {
+    pthread_mutex_unlock (&htuLock) ;
+    return FALSE ;
+  }
+
+  value = (htuState == HTU_TEMP) ? readTemp (htuFd) : readHumid (htuFd) ;
 
-    sTemp = (data [0] << 8) | data [1] ;
-    fTemp = -48.85 + 175.72 * (double)sTemp / 63356.0 ;
-    cTemp = (int)rint (((100.0 * fTemp) + 0.5) / 10.0) ;
-    return cTemp ;
+  /**/ if ((value == HTU_NOT_READY) && ((int)(htuGiveUp - millis ()) > 0))
+    htuDue = millis () + 1 ;
+  else if (value <= HTU_NOT_READY)		// Or -9997, -9998
+  {
+    htuState = HTU_IDLE ;
+    htuError = TRUE ;
+    done     = -1 ;
   }
-  else if (chan == 1)	// humidity
+  else if (htuState == HTU_TEMP)
   {
-// Send read humidity command:
+    htuTemp = value ;
+    if (wiringPiI2CWriteBytes (htuFd, &cmd, 1) != 1)
+    {
+      htuState = HTU_IDLE ;
+      htuError = TRUE ;
+      done     = -1 ;
+    }
+    else
+    {
+      htuDue    = millis () + 14 ;		// Typical, 12-bit
+      htuGiveUp = millis () + 16 + HTU_MARGIN ;	// Maximum
+      htuState  = HTU_HUMID ;
+    }
+  }
+  else
+  {
+    htuHumid = value ;
+    htuState = HTU_IDLE ;
+    htuValid = TRUE ;
+    htuError = FALSE ;
+    done     = TRUE ;
+  }
 
-    data [0] = 0xF5 ;
-    if (write (fd, data, 1) != 1)
-      return -9999 ;
+  pthread_mutex_unlock (&htuLock) ;
 
-// Wait then read the data
+  return done ;
+}
 
-    delay (50) ;
-    if (read (fd, data, 3) != 3)
-      return -9998 ;
 
-    if (!checksum (data))
-      return -9997 ;
+/*
+ * htu21dThread:
+ * htu21dAsync:
+ *	In async mode a thread keeps measurements going every periodMs and
+ *	analogRead just returns the latest values. A period of 0 stops it.
+ *********************************************************************************
+ */
 
-    sHumid = (data [0] << 8) | data [1] ;
-    fHumid = -6.0 + 125.0 * (double)sHumid / 65536.0 ;
-    cHumid = (int)rint (((100.0 * fHumid) + 0.5) / 10.0) ;
-    return cHumid ;
+static void *htu21dThread (UNU void *arg)
+{
+  unsigned int next = millis () ;
+
+  while (htuPeriod != 0)
+  {
+    if (htu21dStart () < 0)
+      htuError = TRUE ;
+    else
+      while ((htuPeriod != 0) && (htu21dCollect () == FALSE))
+	delay (1) ;
+
+    next += htuPeriod ;
+    if ((int)(next - millis ()) > 0)
+      delay (next - millis ()) ;
+    else
+      next = millis () ;
   }
-  else
+
+  return NULL ;
+}
+
+int htu21dAsync (int periodMs)
+{
+  if (htuFd == -1)
+    return -1 ;
+
+  if (htuPeriod != 0)			// Stop any running thread
+  {
+    htuPeriod = 0 ;
+    pthread_join (htuThread, NULL) ;
+  }
+
+  if (periodMs <= 0)
+    return 0 ;
+
+  htuPeriod = periodMs ;
+  htuError  = FALSE ;
+  if (pthread_create (&htuThread, NULL, htu21dThread, NULL) != 0)
+  {
+    htuPeriod = 0 ;
+    return wiringPiFailure (WPI_ALMOST, "htu21dAsync: Unable to start thread\n") ;
+  }
+
+  return 0 ;
+}
+
+
+/*
+ * myAnalogRead:
+ *	In async mode return the latest values, otherwise measure the one
+ *	we've been asked for and wait.
+ *********************************************************************************
+ */
+
+static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
+{
+  int chan = pin - node->pinBase ;
+  int fd   = node->fd ;
+  uint8_t data [4] ;
+  int     value ;
+
+  if ((chan != 0) && (chan != 1))
     return -9999 ;
+
+  if (htuPeriod != 0)
+  {
+    while (!htuValid && !htuError)
+      delay (1) ;
+    if (!htuValid)			// Never had a good one
+      return -9998 ;
+    return (chan == 0) ? htuTemp : htuHumid ;
+  }
+
+// Send read temperature or humidity command:
+
+  data [0] = (chan == 0) ? 0xF3 : 0xF5 ;
+
+  pthread_mutex_lock (&htuLock) ;
+
+  if (wiringPiI2CWriteBytes (fd, data, 1) != 1)
+    value = -9999 ;
+  else
+  {
+
+// Wait then read the data
+
+    delay (50) ;
+    value = (chan == 0) ? readTemp (fd) : readHumid (fd) ;
+  }
+
+  pthread_mutex_unlock (&htuLock) ;
+
+  return value ;
 }
 
 
@@ -124,7 +331,7 @@ int htu21dSetup (const int pinBase)
   int fd ;
   struct wiringPiNodeStruct *node ;
   uint8_t data ;
-  int status ;
+  int status, i ;
 
   if ((fd = wiringPiI2CSetup (I2C_ADDRESS)) < 0)
     return FALSE ;
@@ -133,18 +340,23 @@ int htu21dSetup (const int pinBase)
 
   node->fd         = fd ;
   node->analogRead = myAnalogRead ;
+  htuFd            = fd ;
 
 // Send a reset code to it:
 
   data = 0xFE ;
-  if (write (fd, &data, 1) != 1)
+  if (wiringPiI2CWriteBytes (fd, &data, 1) != 1)
     return FALSE ;
 
-  delay (15) ;
+// Read the status register to check it's really there - it won't answer
+//	until the reset is done, which is under 15mS
 
-// Read the status register to check it's really there
-
-  status = wiringPiI2CReadReg8 (fd, 0xE7) ;
+  for (i = 0 ; i < 15 ; ++i)
+  {
+    delay (1) ;
+    if ((status = wiringPiI2CReadReg8 (fd, 0xE7)) >= 0)
+      break ;
+  }
 
   return (status == 0x02) ? TRUE : FALSE ;
 }
@@ -27,7 +27,11 @@
 extern "C" {
 #endif
 
-extern int htu21dSetup (const int pinBase) ;
+extern int htu21dSetup   (const int pinBase) ;
+
+extern int htu21dStart   (void) ;
+extern int htu21dCollect (void) ;
+extern int htu21dAsync   (int periodMs) ;
 
 #ifdef __cplusplus
 }
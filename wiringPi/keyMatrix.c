@@ -0,0 +1,435 @@
+/*
+ * keyMatrix.c:
+ *	Background scanning of keypads and button matrices
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+/*
+ * Notes:
+ *	A periodic task (piPeriodicCreate) scans the whole matrix each tick:
+ *	each row in turn is pulled low and the columns, pulled up, read for
+ *	the keys down in it. Every key is debounced on its own - it has to
+ *	read the same for debounceMs worth of scans before it counts - so
+ *	any number can be down at once, and each change goes into a ring of
+ *	events for the program to read when it likes (or poll the fd of).
+ *
+ *	With the rows and columns all on-board they're one port (see
+ *	wiringPiPort), so driving a row is one masked store per bank and
+ *	reading the columns one load of GPLEV. Rows on an expander, with
+ *	consecutive pin numbers, take one digitalWriteMasked transaction,
+ *	and columns one digitalRead8 or 16. Anything else goes a pin at a
+ *	time.
+ *
+ *	Without KEY_MATRIX_DIODES the rows sit at LOW and are switched
+ *	between output (being scanned) and input (floating) instead, so two
+ *	keys down in the same column never join a high row to a low one.
+ *	That costs a pinMode or two per row.
+ *********************************************************************************
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "wiringPi.h"
+#include "wiringPiPort.h"
+#include "keyMatrix.h"
+
+#define	KEY_MATRIX_SETTLE_NS	5000		// After a row changes, before reading
+#define	KEY_MATRIX_EVENTS	64
+#define	KEY_MATRIX_PRI		50
+
+// How the rows are driven and the columns read
+
+#define	IO_PORT			0		// Rows and columns in the one port
+#define	IO_NODE			1		// Consecutive pins on an extension node
+#define	IO_PINS			2
+
+struct keyMatrixStruct
+{
+  int          numRows, numCols, flags ;
+  int          rowPins [KEY_MATRIX_MAX_ROWS] ;
+  int          colPins [KEY_MATRIX_MAX_COLS] ;
+  int          rowIo, colIo ;
+  wpiPort_t    port ;
+  unsigned int rowMask, colMask ;
+
+  int          task ;
+  volatile int closing, inScan ;
+  unsigned int debounce ;			// Scans
+
+  uint16_t     state  [KEY_MATRIX_MAX_ROWS] ;	// Debounced, bit per column
+  uint8_t      count  [KEY_MATRIX_MAX_ROWS][KEY_MATRIX_MAX_COLS] ;	// Scans it's read different
+  char         keymap [KEY_MATRIX_MAX_ROWS * KEY_MATRIX_MAX_COLS] ;
+  int          haveMap ;
+
+  struct piRingStruct *ring ;
+  uint64_t             lost ;			// Events the ring had no room for
+} ;
+
+
+/*
+ * consecutive:
+ *	Are the pins all on one node, one after the other?
+ *********************************************************************************
+ */
+
+static int consecutive (const int *pins, int n)
+{
+  int i ;
+
+  if ((pins [0] & PI_GPIO_MASK) == 0)
+    return FALSE ;
+
+  for (i = 1 ; i < n ; ++i)
+    if (pins [i] != pins [0] + i)
+      return FALSE ;
+
+  return wiringPiFindNode (pins [0]) == wiringPiFindNode (pins [n - 1]) ;
+}
+
+
+/*
+ * selectRow:
+ *	Pull row r low, and the others up (with diodes) or off - r of -1
+ *	for none at all
+ *********************************************************************************
+ */
+
+static void selectRow (struct keyMatrixStruct *m, int r, int last)
+{
+  unsigned int value ;
+  int i ;
+
+  if ((m->flags & KEY_MATRIX_DIODES) == 0)
+  {
+    if (last >= 0) pinMode (m->rowPins [last], INPUT) ;
+    if (r    >= 0) pinMode (m->rowPins [r],    OUTPUT) ;	// Already LOW
+    return ;
+  }
+
+  value = (r < 0) ? m->rowMask : (m->rowMask & ~(1u << r)) ;
+
+  /**/ if (m->rowIo == IO_PORT)
+    wpiPortWrite (m->port, value) ;
+  else if (m->rowIo == IO_NODE)
+    digitalWriteMasked (m->rowPins [0], value, m->rowMask) ;
+  else
+    for (i = 0 ; i < m->numRows ; ++i)
+      digitalWrite (m->rowPins [i], (value >> i) & 1) ;
+}
+
+
+/*
+ * readCols:
+ *	The columns with a key down in the row being scanned (read LOW)
+ *********************************************************************************
+ */
+
+static unsigned int readCols (struct keyMatrixStruct *m)
+{
+  unsigned int value = 0 ;
+  int i ;
+
+  /**/ if (m->colIo == IO_PORT)
+    value = wpiPortRead (m->port) >> m->numRows ;
+  else if (m->colIo == IO_NODE)
+    value = (m->numCols <= 8) ? digitalRead8 (m->colPins [0]) : digitalRead16 (m->colPins [0]) ;
+  else
+    for (i = 0 ; i < m->numCols ; ++i)
+      if (digitalRead (m->colPins [i]) != LOW)
+	value |= 1u << i ;
+
+  return ~value & m->colMask ;
+}
+
+
+/*
+ * scan:
+ *	The periodic task: scan the matrix, debounce, queue the changes
+ *********************************************************************************
+ */
+
+static void scan (void *ctx)
+{
+  struct keyMatrixStruct *m = (struct keyMatrixStruct *)ctx ;
+  struct keyMatrixEventStruct ev ;
+  unsigned int down, changed ;
+  uint64_t now ;
+  int r, c ;
+
+  m->inScan = TRUE ;
+  if (m->closing)
+  {
+    m->inScan = FALSE ;
+    return ;
+  }
+
+  now = nanos64 () ;
+
+  for (r = 0 ; r < m->numRows ; ++r)
+  {
+    selectRow (m, r, r - 1) ;
+    delayNanoseconds (KEY_MATRIX_SETTLE_NS) ;
+    down    = readCols (m) ;
+    changed = down ^ m->state [r] ;
+
+    for (c = 0 ; c < m->numCols ; ++c)
+    {
+      if ((changed & (1u << c)) == 0)
+      {
+	m->count [r][c] = 0 ;
+	continue ;
+      }
+      if (++m->count [r][c] < m->debounce)
+	continue ;
+
+      m->count [r][c] = 0 ;
+      m->state [r]   ^= 1u << c ;
+
+      ev.ns      = now ;
+      ev.key     = r * m->numCols + c ;
+      ev.code    = m->haveMap ? (unsigned char)m->keymap [ev.key] : ev.key ;
+      ev.pressed = (down & (1u << c)) != 0 ;
+      if (piRingPush (m->ring, &ev, 1) == 0)
+	++m->lost ;
+    }
+  }
+  selectRow (m, -1, m->numRows - 1) ;
+
+  m->inScan = FALSE ;
+}
+
+
+/*
+ * keyMatrixSetup:
+ *	Start scanning a matrix every periodUs, with a key having to read
+ *	the same for debounceMs before it's taken as down or up. Columns are
+ *	pulled up; the rows are driven.
+ *	Returns the matrix, or NULL with errno set.
+ *********************************************************************************
+ */
+
+keyMatrix_t keyMatrixSetup (const int *rowPins, int numRows, const int *colPins, int numCols,
+			    unsigned int periodUs, unsigned int debounceMs, int flags)
+{
+  struct keyMatrixStruct *m ;
+  int pins [WPI_PORT_MAX_PINS] ;
+  int i, onBoard = TRUE ;
+
+  if ((rowPins == NULL) || (colPins == NULL) || (periodUs == 0) ||
+      (numRows < 1) || (numRows > KEY_MATRIX_MAX_ROWS) || (numCols < 1) || (numCols > KEY_MATRIX_MAX_COLS))
+  {
+    errno = EINVAL ;
+    return NULL ;
+  }
+
+  if ((m = (struct keyMatrixStruct *)calloc (1, sizeof (struct keyMatrixStruct))) == NULL)
+    return NULL ;
+
+  m->numRows  = numRows ;
+  m->numCols  = numCols ;
+  m->flags    = flags ;
+  m->rowMask  = (1u << numRows) - 1 ;
+  m->colMask  = (1u << numCols) - 1 ;
+  m->task     = -1 ;
+  m->debounce = (debounceMs * 1000 + periodUs - 1) / periodUs ;
+  if (m->debounce == 0)
+    m->debounce = 1 ;
+  if (m->debounce > 255)
+    m->debounce = 255 ;
+  memcpy (m->rowPins, rowPins, numRows * sizeof (int)) ;
+  memcpy (m->colPins, colPins, numCols * sizeof (int)) ;
+
+  for (i = 0 ; i < numRows ; ++i) if ((rowPins [i] & PI_GPIO_MASK) != 0) onBoard = FALSE ;
+  for (i = 0 ; i < numCols ; ++i) if ((colPins [i] & PI_GPIO_MASK) != 0) onBoard = FALSE ;
+
+  if (onBoard && (numRows + numCols >= WPI_PORT_MIN_PINS))
+  {
+    memcpy (pins,           rowPins, numRows * sizeof (int)) ;
+    memcpy (pins + numRows, colPins, numCols * sizeof (int)) ;
+    m->port = wiringPiPortOpen (pins, numRows + numCols) ;
+  }
+
+  if (m->port != NULL)
+    m->rowIo = m->colIo = IO_PORT ;
+  else
+  {
+    m->rowIo = consecutive (rowPins, numRows) ? IO_NODE : IO_PINS ;
+    m->colIo = consecutive (colPins, numCols) ? IO_NODE : IO_PINS ;
+  }
+
+  if ((m->ring = piRingCreate (PI_RING_SPSC, sizeof (struct keyMatrixEventStruct), KEY_MATRIX_EVENTS, TRUE)) == NULL)
+  {
+    keyMatrixClose (m) ;
+    return NULL ;
+  }
+
+  for (i = 0 ; i < numCols ; ++i)
+  {
+    pinMode         (colPins [i], INPUT) ;
+    pullUpDnControl (colPins [i], PUD_UP) ;
+  }
+
+  for (i = 0 ; i < numRows ; ++i)
+  {
+    if ((flags & KEY_MATRIX_DIODES) != 0)
+    {
+      digitalWrite (rowPins [i], HIGH) ;
+      pinMode      (rowPins [i], OUTPUT) ;
+    }
+    else
+    {
+      pinMode      (rowPins [i], INPUT) ;
+      digitalWrite (rowPins [i], LOW) ;	// For when it's switched to output
+    }
+  }
+
+  if ((m->task = piPeriodicCreate ((unsigned long long)periodUs * 1000, scan, m, KEY_MATRIX_PRI)) < 0)
+  {
+    keyMatrixClose (m) ;
+    errno = EAGAIN ;
+    return NULL ;
+  }
+
+  return m ;
+}
+
+
+/*
+ * keyMatrixClose:
+ *	Stop scanning and free it all. The rows are left as inputs.
+ *********************************************************************************
+ */
+
+void keyMatrixClose (keyMatrix_t m)
+{
+  int i ;
+
+  if (m == NULL)
+    return ;
+
+  m->closing = TRUE ;
+  if (m->task != -1)
+  {
+    piPeriodicDelete (m->task) ;
+    delay (1) ;				// A tick that's already started
+    while (m->inScan)
+      delay (1) ;
+  }
+
+  for (i = 0 ; i < m->numRows ; ++i)
+    pinMode (m->rowPins [i], INPUT) ;
+
+  if (m->ring != NULL)
+    piRingFree (m->ring) ;
+  wiringPiPortClose (m->port) ;
+  free (m) ;
+}
+
+
+/*
+ * keyMatrixKeymap:
+ *	Give each key a character for the events' code: map has one for
+ *	each key, a row at a time - "123A456B789C*0#D" for the usual 4x4.
+ *	NULL to go back to key numbers.
+ *********************************************************************************
+ */
+
+void keyMatrixKeymap (keyMatrix_t m, const char *map)
+{
+  int n = m->numRows * m->numCols ;
+
+  if (map == NULL)
+  {
+    m->haveMap = FALSE ;
+    return ;
+  }
+
+  memset  (m->keymap, 0, sizeof (m->keymap)) ;
+  strncpy (m->keymap, map, n) ;
+  m->haveMap = TRUE ;
+}
+
+
+/*
+ * keyMatrixRead:
+ * keyMatrixWait:
+ * keyMatrixFd:
+ *	Take up to max events without waiting; wait up to mS (-1 for ever)
+ *	for one; or an fd that polls readable while there are any.
+ *	keyMatrixRead returns the number taken, keyMatrixWait 1 or 0 on a
+ *	timeout.
+ *********************************************************************************
+ */
+
+int keyMatrixRead (keyMatrix_t m, struct keyMatrixEventStruct *events, int max)
+{
+  if (max <= 0)
+    return 0 ;
+
+  return (int)piRingPop (m->ring, events, (unsigned int)max) ;
+}
+
+int keyMatrixWait (keyMatrix_t m, struct keyMatrixEventStruct *event, int mS)
+{
+  struct pollfd pfd ;
+
+  for (;;)
+  {
+    if (piRingPop (m->ring, event, 1) == 1)
+      return 1 ;
+
+    pfd.fd     = piRingFd (m->ring) ;
+    pfd.events = POLLIN ;
+    if (poll (&pfd, 1, mS) <= 0)
+      return piRingPop (m->ring, event, 1) ;
+  }
+}
+
+int keyMatrixFd (keyMatrix_t m)
+{
+  return piRingFd (m->ring) ;
+}
+
+
+/*
+ * keyMatrixPressed:
+ * keyMatrixLost:
+ *	Is a key down (debounced) now; and how many events have been
+ *	dropped with the ring full.
+ *********************************************************************************
+ */
+
+int keyMatrixPressed (keyMatrix_t m, int key)
+{
+  if ((key < 0) || (key >= m->numRows * m->numCols))
+    return FALSE ;
+
+  return (m->state [key / m->numCols] & (1u << (key % m->numCols))) != 0 ;
+}
+
+uint64_t keyMatrixLost (keyMatrix_t m)
+{
+  return m->lost ;
+}
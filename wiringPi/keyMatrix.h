@@ -0,0 +1,65 @@
+/*
+ * keyMatrix.h:
+ *	Background scanning of keypads and button matrices
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <stdint.h>
+
+#define	KEY_MATRIX_MAX_ROWS	16
+#define	KEY_MATRIX_MAX_COLS	16
+
+// Flags: with diodes (or series resistors) on the keys the rows can be
+//	driven high and low; without, the rows not being scanned are left
+//	floating so two keys down in one column can't short two rows.
+
+#define	KEY_MATRIX_DIODES	1
+
+// Events: key is row * numCols + col; code is its character from the
+//	keymap, or the key number without one
+
+struct keyMatrixEventStruct
+{
+  uint64_t ns ;			// nanos64 () at the scan that saw it
+  int      key ;
+  int      code ;
+  int      pressed ;		// TRUE going down, FALSE coming up
+} ;
+
+typedef struct keyMatrixStruct *keyMatrix_t ;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern keyMatrix_t keyMatrixSetup   (const int *rowPins, int numRows, const int *colPins, int numCols,
+				     unsigned int periodUs, unsigned int debounceMs, int flags) ;
+extern void        keyMatrixClose   (keyMatrix_t m) ;
+extern void        keyMatrixKeymap  (keyMatrix_t m, const char *map) ;
+extern int         keyMatrixRead    (keyMatrix_t m, struct keyMatrixEventStruct *events, int max) ;
+extern int         keyMatrixWait    (keyMatrix_t m, struct keyMatrixEventStruct *event, int mS) ;
+extern int         keyMatrixFd      (keyMatrix_t m) ;
+extern int         keyMatrixPressed (keyMatrix_t m, int key) ;
+extern uint64_t    keyMatrixLost    (keyMatrix_t m) ;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,386 @@
+/*
+ * ledMux.c:
+ *	Background refresh of multiplexed 7-segment displays and LED matrices
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+/*
+ * Notes:
+ *	A periodic task (piPeriodicCreate) lights one digit per tick,
+ *	refreshHz times a second for each. With the pins all on-board they
+ *	are one port (see wiringPiPort), and a tick is two masked stores per
+ *	bank: the digit before turned off, then the segments of this one
+ *	and it turned on. Brightness below the full LED_MUX_MAX_LEVEL is the
+ *	fraction of the tick the digit stays lit; turning it off early is
+ *	left to the timed write engine (digitalWriteMaskAt), which puts it to
+ *	within a few uS, so the tick doesn't wait about.
+ *
+ *	On an expander, with the segments and then the digits on one run of
+ *	consecutive pins, the two writes go as one digitalWriteSequence;
+ *	there the brightness can only be full or off. Anything else goes a
+ *	pin at a time.
+ *
+ *	The frame is just the segments for each digit - for an LED matrix
+ *	the columns lit in each row - and can be changed at any time.
+ *********************************************************************************
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "wiringPi.h"
+#include "wiringPiPort.h"
+#include "ledMux.h"
+
+#define	LED_MUX_PRI		55
+
+#define	IO_PORT			0
+#define	IO_NODE			1
+#define	IO_PINS			2
+
+struct ledMuxStruct
+{
+  int          numSegs, numDigits, flags ;
+  int          pins [LED_MUX_MAX_SEGS + LED_MUX_MAX_DIGITS] ;	// Segments then digits
+  int          io ;
+  wpiPort_t    port ;
+  unsigned int segMask, digitMask ;		// In port bits
+  unsigned int digitPins [2] ;			// The digit pins in each bank
+
+  volatile unsigned int segs  [LED_MUX_MAX_DIGITS] ;
+  volatile int          level [LED_MUX_MAX_DIGITS] ;
+
+  unsigned long long tickNs ;
+  int          digit, task ;
+  volatile int closing, inTick ;
+} ;
+
+
+/*
+ * ledMuxSevenSeg:
+ *	The segments for a character on a 7-segment digit: 0-9, A-Z as well
+ *	as they go, a few bits of punctuation; anything else is blank.
+ *********************************************************************************
+ */
+
+unsigned int ledMuxSevenSeg (int c)
+{
+  static const unsigned char digits [10] =
+    { 0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F } ;
+  static const unsigned char letters [26] =
+  {
+    0x77, 0x7C, 0x39, 0x5E, 0x79, 0x71, 0x3D, 0x76, 0x06, 0x1E,	// A-J
+    0x75, 0x38, 0x37, 0x54, 0x5C, 0x73, 0x67, 0x50, 0x6D, 0x78,	// K-T
+    0x3E, 0x1C, 0x7E, 0x76, 0x6E, 0x5B,				// U-Z
+  } ;
+
+  /**/ if ((c >= '0') && (c <= '9'))
+    return digits [c - '0'] ;
+  else if ((c >= 'A') && (c <= 'Z'))
+    return letters [c - 'A'] ;
+  else if ((c >= 'a') && (c <= 'z'))
+    return letters [c - 'a'] ;
+  else if (c == '-')
+    return 0x40 ;
+  else if (c == '_')
+    return 0x08 ;
+  else if (c == '=')
+    return 0x48 ;
+  else if ((c == '\'') || (c == '`'))
+    return 0x20 ;
+  else if (c == '.')
+    return LED_MUX_DP ;
+
+  return 0 ;
+}
+
+
+/*
+ * portValue:
+ *	The state of every pin with a digit lit (or -1 for none)
+ *********************************************************************************
+ */
+
+static unsigned int portValue (struct ledMuxStruct *m, int digit, unsigned int segs)
+{
+  unsigned int value = 0 ;
+
+  if (digit >= 0)
+    value = (segs & ((1u << m->numSegs) - 1)) | (1u << (m->numSegs + digit)) ;
+
+  if ((m->flags & LED_MUX_SEG_LOW)   != 0) value ^= m->segMask ;
+  if ((m->flags & LED_MUX_DIGIT_LOW) != 0) value ^= m->digitMask ;
+
+  return value ;
+}
+
+
+/*
+ * pinsWrite:
+ *	Write the pins the slow way: all of them, or just the digits
+ *********************************************************************************
+ */
+
+static void pinsWrite (struct ledMuxStruct *m, unsigned int value, int digitsOnly)
+{
+  int i ;
+
+  for (i = digitsOnly ? m->numSegs : 0 ; i < m->numSegs + m->numDigits ; ++i)
+    digitalWrite (m->pins [i], (value >> i) & 1) ;
+}
+
+
+/*
+ * tick:
+ *	The periodic task: the digit before off, the next one on, and its
+ *	turning off queued if it's not at full brightness
+ *********************************************************************************
+ */
+
+static void tick (void *ctx)
+{
+  struct ledMuxStruct *m = (struct ledMuxStruct *)ctx ;
+  unsigned int set [2], clr [2], offSet [2], offClr [2], blank, show, values [2] ;
+  unsigned long long now ;
+  int b, d, level ;
+
+  m->inTick = TRUE ;
+  if (m->closing)
+  {
+    m->inTick = FALSE ;
+    return ;
+  }
+
+  d        = m->digit ;
+  m->digit = (d + 1) % m->numDigits ;
+  level    = m->level [d] ;
+
+  blank = portValue (m, -1, 0) ;
+  show  = (level > 0) ? portValue (m, d, m->segs [d]) : blank ;
+
+  /**/ if (m->io == IO_PORT)
+  {
+    now = nanos64 () ;
+    (void)wpiPortMasks (m->port, blank, offSet, offClr) ;
+    (void)wpiPortMasks (m->port, show,  set,    clr) ;
+    for (b = 0 ; b < 2 ; ++b)
+    {
+      offSet [b] &= m->digitPins [b] ;
+      offClr [b] &= m->digitPins [b] ;
+      if ((offSet [b] | offClr [b]) != 0) digitalWriteMask (b, offSet [b], offClr [b]) ;
+    }
+    for (b = 0 ; b < 2 ; ++b)
+      if ((set [b] | clr [b]) != 0)
+	digitalWriteMask (b, set [b], clr [b]) ;
+
+    if ((level > 0) && (level < LED_MUX_MAX_LEVEL))
+      for (b = 0 ; b < 2 ; ++b)
+	if ((offSet [b] | offClr [b]) != 0)
+	  (void)digitalWriteMaskAt (b, offSet [b], offClr [b], now + m->tickNs * level / LED_MUX_MAX_LEVEL) ;
+  }
+  else if (m->io == IO_NODE)
+  {
+    values [0] = (show & m->segMask) | (blank & m->digitMask) ;	// Off while the segments change
+    values [1] = show ;
+    digitalWriteSequence (m->pins [0], m->segMask | m->digitMask, values, 2) ;
+  }
+  else
+  {
+    pinsWrite (m, blank, TRUE) ;
+    pinsWrite (m, show,  FALSE) ;
+  }
+
+  m->inTick = FALSE ;
+}
+
+
+/*
+ * ledMuxSetup:
+ *	Start refreshing a display of numDigits digits (or rows) of numSegs
+ *	segments (or columns), each digit lit refreshHz times a second. It
+ *	starts blank, at full brightness.
+ *	Returns the display, or NULL with errno set.
+ *********************************************************************************
+ */
+
+ledMux_t ledMuxSetup (const int *segPins, int numSegs, const int *digitPins, int numDigits,
+		      unsigned int refreshHz, int flags)
+{
+  struct ledMuxStruct *m ;
+  unsigned int set [2], clr [2] ;
+  int i, n, onBoard = TRUE, consecutive = TRUE ;
+
+  if ((segPins == NULL) || (digitPins == NULL) || (refreshHz == 0) ||
+      (numSegs < 1) || (numSegs > LED_MUX_MAX_SEGS) || (numDigits < 1) || (numDigits > LED_MUX_MAX_DIGITS))
+  {
+    errno = EINVAL ;
+    return NULL ;
+  }
+
+  if ((m = (struct ledMuxStruct *)calloc (1, sizeof (struct ledMuxStruct))) == NULL)
+    return NULL ;
+
+  n = numSegs + numDigits ;
+  m->numSegs   = numSegs ;
+  m->numDigits = numDigits ;
+  m->flags     = flags ;
+  m->task      = -1 ;
+  m->segMask   = (1u << numSegs) - 1 ;
+  m->digitMask = ((1u << numDigits) - 1) << numSegs ;
+  m->tickNs    = 1000000000ULL / ((unsigned long long)refreshHz * numDigits) ;
+  memcpy (m->pins,           segPins,   numSegs   * sizeof (int)) ;
+  memcpy (m->pins + numSegs, digitPins, numDigits * sizeof (int)) ;
+
+  for (i = 0 ; i < numDigits ; ++i)
+    m->level [i] = LED_MUX_MAX_LEVEL ;
+
+  for (i = 0 ; i < n ; ++i)
+  {
+    if ((m->pins [i] & PI_GPIO_MASK) != 0) onBoard     = FALSE ;
+    if (m->pins [i] != m->pins [0] + i)    consecutive = FALSE ;
+  }
+
+  if (onBoard && (n >= WPI_PORT_MIN_PINS) && (n <= WPI_PORT_MAX_PINS) &&
+      ((m->port = wiringPiPortOpen (m->pins, n)) != NULL) &&
+      (wpiPortMasks (m->port, m->digitMask, set, clr) >= 0))
+  {
+    m->io = IO_PORT ;
+    m->digitPins [0] = set [0] ;		// Only the digits are set in that
+    m->digitPins [1] = set [1] ;
+  }
+  else
+  {
+    wiringPiPortClose (m->port) ;
+    m->port = NULL ;
+    m->io   = (consecutive && !onBoard && (wiringPiFindNode (m->pins [0]) == wiringPiFindNode (m->pins [n - 1]))) ? IO_NODE : IO_PINS ;
+  }
+
+  for (i = 0 ; i < n ; ++i)
+    pinMode (m->pins [i], OUTPUT) ;
+  pinsWrite (m, portValue (m, -1, 0), FALSE) ;
+
+  if ((m->task = piPeriodicCreate (m->tickNs, tick, m, LED_MUX_PRI)) < 0)
+  {
+    ledMuxClose (m) ;
+    errno = EAGAIN ;
+    return NULL ;
+  }
+
+  return m ;
+}
+
+
+/*
+ * ledMuxClose:
+ *	Stop refreshing, and leave the display blank
+ *********************************************************************************
+ */
+
+void ledMuxClose (ledMux_t m)
+{
+  if (m == NULL)
+    return ;
+
+  m->closing = TRUE ;
+  if (m->task != -1)
+  {
+    piPeriodicDelete (m->task) ;
+    delay (1) ;				// A tick that's already started
+    while (m->inTick)
+      delay (1) ;
+    delay (1 + m->tickNs / 1000000) ;	// And its timed write
+  }
+
+  pinsWrite (m, portValue (m, -1, 0), FALSE) ;
+  wiringPiPortClose (m->port) ;
+  free (m) ;
+}
+
+
+/*
+ * ledMuxWrite:
+ * ledMuxFrame:
+ * ledMuxPuts:
+ *	Change what's shown: one digit's segments, all of them, or a string
+ *	on a 7-segment display, run through ledMuxSevenSeg with any '.'
+ *	going on the point of the digit before. ledMuxPuts returns the
+ *	number of digits used; the rest are blanked.
+ *********************************************************************************
+ */
+
+void ledMuxWrite (ledMux_t m, int digit, unsigned int segs)
+{
+  if ((digit >= 0) && (digit < m->numDigits))
+    m->segs [digit] = segs ;
+}
+
+void ledMuxFrame (ledMux_t m, const unsigned int *segs)
+{
+  int i ;
+
+  for (i = 0 ; i < m->numDigits ; ++i)
+    m->segs [i] = segs [i] ;
+}
+
+int ledMuxPuts (ledMux_t m, const char *str)
+{
+  unsigned int segs [LED_MUX_MAX_DIGITS] ;
+  int d = 0 ;
+
+  memset (segs, 0, sizeof (segs)) ;
+
+  for (; (*str != 0) ; ++str)
+  {
+    if ((*str == '.') && (d > 0) && ((segs [d - 1] & LED_MUX_DP) == 0))
+    {
+      segs [d - 1] |= LED_MUX_DP ;
+      continue ;
+    }
+    if (d == m->numDigits)
+      break ;
+    segs [d++] = ledMuxSevenSeg (*str) ;
+  }
+
+  ledMuxFrame (m, segs) ;
+
+  return d ;
+}
+
+
+/*
+ * ledMuxBrightness:
+ *	Set one digit's brightness - or all of them, for digit -1 - from 0
+ *	(off) to LED_MUX_MAX_LEVEL
+ *********************************************************************************
+ */
+
+void ledMuxBrightness (ledMux_t m, int digit, int level)
+{
+  int i ;
+
+  if (level < 0)                 level = 0 ;
+  if (level > LED_MUX_MAX_LEVEL) level = LED_MUX_MAX_LEVEL ;
+
+  for (i = 0 ; i < m->numDigits ; ++i)
+    if ((digit == -1) || (digit == i))
+      m->level [i] = level ;
+}
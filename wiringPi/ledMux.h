@@ -0,0 +1,57 @@
+/*
+ * ledMux.h:
+ *	Background refresh of multiplexed 7-segment displays and LED matrices
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#define	LED_MUX_MAX_SEGS	16
+#define	LED_MUX_MAX_DIGITS	16
+#define	LED_MUX_MAX_LEVEL	255
+
+// Flags: which way round the pins are. Segments (or matrix columns) and
+//	digits (or rows) are active high unless these say otherwise - a
+//	common anode display with transistors on the digits might want both.
+
+#define	LED_MUX_SEG_LOW		1
+#define	LED_MUX_DIGIT_LOW	2
+
+// 7-segment bits: a is bit 0, through g as bit 6, and the point bit 7
+
+#define	LED_MUX_DP		0x80
+
+typedef struct ledMuxStruct *ledMux_t ;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern ledMux_t     ledMuxSetup      (const int *segPins, int numSegs, const int *digitPins, int numDigits,
+				      unsigned int refreshHz, int flags) ;
+extern void         ledMuxClose      (ledMux_t m) ;
+extern void         ledMuxWrite      (ledMux_t m, int digit, unsigned int segs) ;
+extern void         ledMuxFrame      (ledMux_t m, const unsigned int *segs) ;
+extern void         ledMuxBrightness (ledMux_t m, int digit, int level) ;
+extern int          ledMuxPuts       (ledMux_t m, const char *str) ;
+extern unsigned int ledMuxSevenSeg   (int c) ;
+
+#ifdef __cplusplus
+}
+#endif
@@ -24,19 +24,69 @@
 
 #include <byteswap.h>
 #include <stdint.h>
+#include <string.h>
+#include <pthread.h>
 
 #include <wiringPi.h>
 #include <wiringPiSPI.h>
 
 #include "max31855.h"
 
-static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
+// Each chip's last frame. All four channels decode the same one, so a
+//	fault check and a temperature read agree. The chip only converts
+//	every 100mS or so anyway - reading it more often than that just gets
+//	the same conversion again.
+
+#define	MAX_MAX31855		32
+#define	MAX31855_CONVERSION_MS	100
+
+struct max31855Struct
 {
+  struct wiringPiNodeStruct *node ;
+  unsigned int       maxAgeUs ;
+  uint32_t           frame ;	// As it came off the wire
+  unsigned long long stamp ;	// micros64 () when it did
+  int                valid ;
+} ;
+
+static struct max31855Struct max31855s [MAX_MAX31855] ;
+static pthread_mutex_t       max31855Lock = PTHREAD_MUTEX_INITIALIZER ;
+
+
+/*
+ * frameRead:
+ *	Fetch a new frame from the chip - it's read only, nothing to send.
+ *	Call with the lock held.
+ *********************************************************************************
+ */
+
+static void frameRead (struct max31855Struct *chip)
+{
+  struct wpiSpiSeg seg ;
   uint32_t spiData ;
-  int temp ;
-  int chan = pin - node->pinBase ;
 
-  wiringPiSPIDataRW (node->fd, (unsigned char *)&spiData, 4) ;
+  memset (&seg, 0, sizeof (seg)) ;
+  seg.rx  = &spiData ;
+  seg.len = 4 ;
+
+  if (wiringPiSPITransfer (chip->node->fd, &seg, 1) == 4)
+  {
+    chip->frame = spiData ;
+    chip->stamp = micros64 () ;
+    chip->valid = TRUE ;
+  }
+}
+
+
+/*
+ * frameDecode:
+ *	Turn a frame into whichever of the 4 channels was asked for
+ *********************************************************************************
+ */
+
+static int frameDecode (uint32_t spiData, int chan)
+{
+  int temp ;
 
   spiData = __bswap_32(spiData) ;
 
@@ -76,24 +126,170 @@ static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
 }
 
 
+static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
+{
+  struct max31855Struct *chip = &max31855s [node->data0] ;
+  uint32_t frame ;
+
+  pthread_mutex_lock (&max31855Lock) ;
+
+  if (!chip->valid || ((micros64 () - chip->stamp) >= chip->maxAgeUs))
+    frameRead (chip) ;
+  frame = chip->frame ;
+
+  pthread_mutex_unlock (&max31855Lock) ;
+
+  return frameDecode (frame, pin - node->pinBase) ;
+}
+
+
+/*
+ * max31855ReadAll:
+ *	Refresh the frames of a whole set of chips at once, given their
+ *	pinBases. Every transfer is queued for the SPI bus workers before
+ *	we wait for any of them, so the chips on a bus are read back to back
+ *	and the buses all run at the same time. Reads of the chips' channels
+ *	then decode these frames until they go stale.
+ *	Returns how many of them were read or -1 for bad parameters.
+ *********************************************************************************
+ */
+
+struct bulkStruct
+{
+  pthread_mutex_t lock ;
+  pthread_cond_t  done ;
+  int             pending ;
+} ;
+
+static void bulkDone (struct wpiSpiRequest *req)
+{
+  struct bulkStruct *bulk = (struct bulkStruct *)req->userData ;
+
+  pthread_mutex_lock   (&bulk->lock) ;
+  if (--bulk->pending == 0)
+    pthread_cond_signal (&bulk->done) ;
+  pthread_mutex_unlock (&bulk->lock) ;
+}
+
+int max31855ReadAll (const int *pinBases, int numChips)
+{
+  struct max31855Struct    *chips [MAX_MAX31855] ;
+  struct wpiSpiSeg          segs  [MAX_MAX31855] ;
+  struct wpiSpiRequest      reqs  [MAX_MAX31855] ;
+  uint32_t                  data  [MAX_MAX31855] ;
+  struct wiringPiNodeStruct *node ;
+  struct bulkStruct bulk ;
+  unsigned long long stamp ;
+  int i, good = 0 ;
+
+  if ((numChips < 1) || (numChips > MAX_MAX31855))
+    return -1 ;
+
+  for (i = 0 ; i < numChips ; ++i)
+  {
+    if (((node = wiringPiFindNode (pinBases [i])) == NULL) || (node->analogRead != myAnalogRead))
+      return -1 ;
+    chips [i] = &max31855s [node->data0] ;
+  }
+
+  pthread_mutex_init (&bulk.lock, NULL) ;
+  pthread_cond_init  (&bulk.done, NULL) ;
+  bulk.pending = numChips ;
+
+  memset (segs, 0, sizeof (segs)) ;
+  memset (reqs, 0, sizeof (reqs)) ;
+
+  for (i = 0 ; i < numChips ; ++i)
+  {
+    segs [i].rx       = &data [i] ;
+    segs [i].len      = 4 ;
+    reqs [i].segs     = &segs [i] ;
+    reqs [i].numSegs  = 1 ;
+    reqs [i].userData = &bulk ;
+
+    if (wiringPiSPISubmit (chips [i]->node->fd, &reqs [i], bulkDone) != 0)
+    {
+      reqs [i].result = -1 ;
+      bulkDone (&reqs [i]) ;
+    }
+  }
+
+  pthread_mutex_lock (&bulk.lock) ;
+  while (bulk.pending != 0)
+    pthread_cond_wait (&bulk.done, &bulk.lock) ;
+  pthread_mutex_unlock (&bulk.lock) ;
+
+  pthread_cond_destroy  (&bulk.done) ;
+  pthread_mutex_destroy (&bulk.lock) ;
+
+  stamp = micros64 () ;
+
+  pthread_mutex_lock (&max31855Lock) ;
+
+  for (i = 0 ; i < numChips ; ++i)
+    if (reqs [i].result == 4)
+    {
+      chips [i]->frame = data [i] ;
+      chips [i]->stamp = stamp ;
+      chips [i]->valid = TRUE ;
+      ++good ;
+    }
+
+  pthread_mutex_unlock (&max31855Lock) ;
+
+  return good ;
+}
+
+
 /*
  * max31855Setup:
  *	Create a new wiringPi device node for an max31855 on the Pi's
  *	SPI interface.
+ * max31855SetupCached:
+ *	As above, but with how long (in mS) a frame can serve reads before
+ *	it's read again. 0 reads the chip afresh for every read.
  *********************************************************************************
  */
 
-int max31855Setup (const int pinBase, int spiChannel)
+int max31855SetupCached (const int pinBase, int spiChannel, int maxAgeMs)
 {
   struct wiringPiNodeStruct *node ;
+  int i ;
+
+  if (maxAgeMs < 0)
+    return FALSE ;
 
   if (wiringPiSPISetup (spiChannel, 5000000) < 0)	// 5MHz - prob 4 on the Pi
     return FALSE ;
 
+  pthread_mutex_lock (&max31855Lock) ;
+
+  for (i = 0 ; i < MAX_MAX31855 ; ++i)
+    if (max31855s [i].node == NULL)
+      break ;
+
+  if (i == MAX_MAX31855)
+  {
+    pthread_mutex_unlock (&max31855Lock) ;
+    return FALSE ;
+  }
+
   node = wiringPiNewNode (pinBase, 4) ;
 
   node->fd         = spiChannel ;
+  node->data0      = i ;
   node->analogRead = myAnalogRead ;
 
+  max31855s [i].node     = node ;
+  max31855s [i].maxAgeUs = (unsigned int)maxAgeMs * 1000 ;
+  max31855s [i].valid    = FALSE ;
+
+  pthread_mutex_unlock (&max31855Lock) ;
+
   return TRUE ;
 }
+
+int max31855Setup (const int pinBase, int spiChannel)
+{
+  return max31855SetupCached (pinBase, spiChannel, MAX31855_CONVERSION_MS) ;
+}
@@ -26,7 +26,9 @@
 extern "C" {
 #endif
 
-extern int max31855Setup (int pinBase, int spiChannel) ;
+extern int max31855Setup       (int pinBase, int spiChannel) ;
+extern int max31855SetupCached (int pinBase, int spiChannel, int maxAgeMs) ;
+extern int max31855ReadAll     (const int *pinBases, int numChips) ;
 
 #ifdef __cplusplus
 }
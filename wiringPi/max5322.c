@@ -22,22 +22,22 @@
  ***********************************************************************
  */
 
+#include <stddef.h>
+
 #include <wiringPi.h>
 #include <wiringPiSPI.h>
 
 #include "max5322.h"
 
 /*
- * myAnalogWrite:
- *	Write analog value on the given pin
+ * pack:
+ *	The 2 byte command that sets a channel to a value
  *********************************************************************************
  */
 
-static void myAnalogWrite (struct wiringPiNodeStruct *node, int pin, int value)
+static void pack (int chan, int value, unsigned char *spiData)
 {
-  unsigned char spiData [2] ;
   unsigned char chanBits, dataBits ;
-  int chan = pin - node->pinBase ;
 
   if (chan == 0)
     chanBits = 0b01000000 ;
@@ -49,10 +49,45 @@ static void myAnalogWrite (struct wiringPiNodeStruct *node, int pin, int value)
 
   spiData [0] = chanBits ;
   spiData [1] = dataBits ;
+}
+
+
+/*
+ * myAnalogWrite:
+ *	Write analog value on the given pin
+ *********************************************************************************
+ */
+
+static void myAnalogWrite (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  unsigned char spiData [2] ;
+
+  pack (pin - node->pinBase, value, spiData) ;
 
   wiringPiSPIDataRW (node->fd, spiData, 2) ;
 }
 
+
+/*
+ * max5322Pack:
+ *	Make the command for a value on a pin without sending it - for
+ *	streaming. Returns the SPI channel to send it to, or -1 if the pin
+ *	isn't on a max5322.
+ *********************************************************************************
+ */
+
+int max5322Pack (int pin, int value, unsigned char *cmd)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if (((node = wiringPiFindNode (pin)) == NULL) || (node->analogWrite != myAnalogWrite))
+    return -1 ;
+
+  pack (pin - node->pinBase, value, cmd) ;
+
+  return node->fd ;
+}
+
 /*
  * max5322Setup:
  *	Create a new wiringPi device node for an max5322 on the Pi's
@@ -65,7 +100,7 @@ int max5322Setup (const int pinBase, int spiChannel)
   struct wiringPiNodeStruct *node ;
   unsigned char spiData [2] ;
 
-  if (wiringPiSPISetup (spiChannel, 8000000) < 0)	// 10MHz Max
+  if (wiringPiSPISetup (spiChannel, MAX5322_SPI_SPEED) < 0)
     return FALSE ;
 
   node = wiringPiNewNode (pinBase, 2) ;
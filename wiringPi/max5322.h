@@ -22,11 +22,14 @@
  ***********************************************************************
  */
 
+#define	MAX5322_SPI_SPEED	8000000		// 10MHz Max
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 extern int max5322Setup (int pinBase, int spiChannel) ;
+extern int max5322Pack  (int pin, int value, unsigned char *cmd) ;
 
 #ifdef __cplusplus
 }
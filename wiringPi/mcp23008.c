@@ -33,47 +33,48 @@
 
 
 /*
- * myPinMode:
+ * updateShadow:
+ *	Change one bit in a shadow register and write it back to the chip.
+ *	There is no need to read it first.
  *********************************************************************************
  */
 
-static void myPinMode (struct wiringPiNodeStruct *node, int pin, int mode)
+static void updateShadow (struct wiringPiNodeStruct *node, unsigned int *word, int shift, int reg, int pin, int set)
 {
-  int mask, old, reg ;
+  unsigned int value ;
 
-  reg  = MCP23x08_IODIR ;
-  mask = 1 << (pin - node->pinBase) ;
-  old  = wiringPiI2CReadReg8 (node->fd, reg) ;
+  value = SHADOW_GET (*word, shift) ;
 
-  if (mode == OUTPUT)
-    old &= (~mask) ;
+  if (set)
+    value |=   (1 << pin) ;
   else
-    old |=   mask ;
+    value &= (~(1 << pin)) ;
+
+  wiringPiI2CWriteReg8 (node->fd, reg, value) ;
 
-  wiringPiI2CWriteReg8 (node->fd, reg, old) ;
+  SHADOW_PUT (*word, shift, value) ;
 }
 
 
 /*
- * myPullUpDnControl:
+ * myPinMode:
  *********************************************************************************
  */
 
-static void myPullUpDnControl (struct wiringPiNodeStruct *node, int pin, int mode)
+static void myPinMode (struct wiringPiNodeStruct *node, int pin, int mode)
 {
-  int mask, old, reg ;
-
-  reg  = MCP23x08_GPPU ;
-  mask = 1 << (pin - node->pinBase) ;
+  updateShadow (node, &node->data3, SHADOW_IODIR, MCP23x08_IODIR, (pin - node->pinBase) & 7, mode != OUTPUT) ;
+}
 
-  old  = wiringPiI2CReadReg8 (node->fd, reg) ;
 
-  if (mode == PUD_UP)
-    old |=   mask ;
-  else
-    old &= (~mask) ;
+/*
+ * myPullUpDnControl:
+ *********************************************************************************
+ */
 
-  wiringPiI2CWriteReg8 (node->fd, reg, old) ;
+static void myPullUpDnControl (struct wiringPiNodeStruct *node, int pin, int mode)
+{
+  updateShadow (node, &node->data3, SHADOW_GPPU, MCP23x08_GPPU, (pin - node->pinBase) & 7, mode == PUD_UP) ;
 }
 
 
@@ -84,18 +85,39 @@ static void myPullUpDnControl (struct wiringPiNodeStruct *node, int pin, int mod
 
 static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
 {
-  int bit, old ;
+  updateShadow (node, &node->data2, SHADOW_OLAT, MCP23x08_GPIO, (pin - node->pinBase) & 7, value != LOW) ;
+}
 
-  bit  = 1 << ((pin - node->pinBase) & 7) ;
 
-  old = node->data2 ;
-  if (value == LOW)
-    old &= (~bit) ;
-  else
-    old |=   bit ;
+/*
+ * myDigitalWriteSequence:
+ *	With IOCON.SEQOP set the address pointer stays put, so a block write
+ *	to GPIO is a sequence of writes to it in one transaction.
+ *********************************************************************************
+ */
 
-  wiringPiI2CWriteReg8 (node->fd, MCP23x08_GPIO, old) ;
-  node->data2 = old ;
+static void myDigitalWriteSequence (struct wiringPiNodeStruct *node, int pin, unsigned int mask, const unsigned int *values, int count)
+{
+  unsigned char buf [WPI_I2C_MAX_BLOCK] ;
+  unsigned int bits, olat ;
+  int shift, i, n ;
+
+  shift = (pin - node->pinBase) & 7 ;
+  bits  = (mask << shift) & 0xFF ;
+  olat  = SHADOW_GET (node->data2, SHADOW_OLAT) ;
+
+  for ( ; count > 0 ; values += n, count -= n)
+  {
+    n = (count > WPI_I2C_MAX_BLOCK) ? WPI_I2C_MAX_BLOCK : count ;
+    for (i = 0 ; i < n ; ++i)
+    {
+      olat    = (olat & ~bits) | ((values [i] << shift) & bits) ;
+      buf [i] = olat ;
+    }
+    wiringPiI2CWriteBlock (node->fd, MCP23x08_GPIO, buf, n) ;
+  }
+
+  SHADOW_PUT (node->data2, SHADOW_OLAT, olat) ;
 }
 
 
@@ -118,6 +140,28 @@ static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
 }
 
 
+/*
+ * myInit:
+ *	The registers we change later are read once here to load the shadows.
+ *********************************************************************************
+ */
+
+static int myInit (struct wiringPiNodeStruct *node)
+{
+  int fd = node->fd ;
+
+  wiringPiI2CWriteReg8 (fd, MCP23x08_IOCON, IOCON_INIT) ;
+
+  node->data2 = node->data3 = 0 ;
+  SHADOW_PUT (node->data2, SHADOW_OLAT,  wiringPiI2CReadReg8 (fd, MCP23x08_OLAT)) ;
+  SHADOW_PUT (node->data2, SHADOW_IPOL,  wiringPiI2CReadReg8 (fd, MCP23x08_IPOL)) ;
+  SHADOW_PUT (node->data3, SHADOW_IODIR, wiringPiI2CReadReg8 (fd, MCP23x08_IODIR)) ;
+  SHADOW_PUT (node->data3, SHADOW_GPPU,  wiringPiI2CReadReg8 (fd, MCP23x08_GPPU)) ;
+
+  return TRUE ;
+}
+
+
 /*
  * mcp23008Setup:
  *	Create a new instance of an MCP23008 I2C GPIO interface. We know it
@@ -134,8 +178,6 @@ int mcp23008Setup (const int pinBase, const int i2cAddress)
   if ((fd = wiringPiI2CSetup (i2cAddress)) < 0)
     return FALSE ;
 
-  wiringPiI2CWriteReg8 (fd, MCP23x08_IOCON, IOCON_INIT) ;
-
   node = wiringPiNewNode (pinBase, 8) ;
 
   node->fd              = fd ;
@@ -143,7 +185,7 @@ int mcp23008Setup (const int pinBase, const int i2cAddress)
   node->pullUpDnControl = myPullUpDnControl ;
   node->digitalRead     = myDigitalRead ;
   node->digitalWrite    = myDigitalWrite ;
-  node->data2           = wiringPiI2CReadReg8 (fd, MCP23x08_OLAT) ;
+  node->digitalWriteSequence = myDigitalWriteSequence ;
 
-  return TRUE ;
+  return wiringPiNodeInit (node, myInit) ;
 }
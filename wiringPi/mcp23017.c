@@ -28,38 +28,47 @@
 #include "wiringPi.h"
 #include "wiringPiI2C.h"
 #include "mcp23x0817.h"
+#include "mcp23x17isr.h"
 
 #include "mcp23017.h"
 
 
+
 /*
- * myPinMode:
+ * updateShadow:
+ *	Change one bit in a 16-bit shadow register and write the affected
+ *	bank back to the chip. There is no need to read it first.
  *********************************************************************************
  */
 
-static void myPinMode (struct wiringPiNodeStruct *node, int pin, int mode)
+static void updateShadow (struct wiringPiNodeStruct *node, unsigned int *word, int shift, int regA, int regB, int pin, int set)
 {
-  int mask, old, reg ;
+  unsigned int value ;
 
-  pin -= node->pinBase ;
+  value = SHADOW_GET (*word, shift) ;
 
-  if (pin < 8)		// Bank A
-    reg  = MCP23x17_IODIRA ;
+  if (set)
+    value |=   (1 << pin) ;
   else
-  {
-    reg  = MCP23x17_IODIRB ;
-    pin &= 0x07 ;
-  }
-
-  mask = 1 << pin ;
-  old  = wiringPiI2CReadReg8 (node->fd, reg) ;
+    value &= (~(1 << pin)) ;
 
-  if (mode == OUTPUT)
-    old &= (~mask) ;
+  if (pin < 8)
+    wiringPiI2CWriteReg8 (node->fd, regA, value & 0xFF) ;
   else
-    old |=   mask ;
+    wiringPiI2CWriteReg8 (node->fd, regB, value >> 8) ;
+
+  SHADOW_PUT (*word, shift, value) ;
+}
 
-  wiringPiI2CWriteReg8 (node->fd, reg, old) ;
+
+/*
+ * myPinMode:
+ *********************************************************************************
+ */
+
+static void myPinMode (struct wiringPiNodeStruct *node, int pin, int mode)
+{
+  updateShadow (node, &node->data3, SHADOW_IODIR, MCP23x17_IODIRA, MCP23x17_IODIRB, pin - node->pinBase, mode != OUTPUT) ;
 }
 
 
@@ -70,96 +79,248 @@ static void myPinMode (struct wiringPiNodeStruct *node, int pin, int mode)
 
 static void myPullUpDnControl (struct wiringPiNodeStruct *node, int pin, int mode)
 {
-  int mask, old, reg ;
+  updateShadow (node, &node->data3, SHADOW_GPPU, MCP23x17_GPPUA, MCP23x17_GPPUB, pin - node->pinBase, mode == PUD_UP) ;
+}
+
+
+/*
+ * shadowMask:
+ *	The pins we can answer digitalRead for from the output latch shadow
+ *	without going to the chip: the outputs, if wiringPiNodeCacheOutputs
+ *	is on for the node.
+ *********************************************************************************
+ */
+
+static unsigned int shadowMask (struct wiringPiNodeStruct *node)
+{
+  if ((node->flags & WPI_NODE_CACHE_OUTPUTS) == 0)
+    return 0 ;
+
+  return ~SHADOW_GET (node->data3, SHADOW_IODIR) & 0xFFFF ;
+}
+
+
+/*
+ * myDigitalRead:
+ *********************************************************************************
+ */
+
+static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
+{
+  int mask, value, gpio ;
 
   pin -= node->pinBase ;
 
+  if ((shadowMask (node) & (1 << pin)) != 0)
+    return (SHADOW_GET (node->data2, SHADOW_OLAT) >> pin) & 1 ;
+
   if (pin < 8)		// Bank A
-    reg  = MCP23x17_GPPUA ;
+    gpio  = MCP23x17_GPIOA ;
   else
   {
-    reg  = MCP23x17_GPPUB ;
-    pin &= 0x07 ;
+    gpio  = MCP23x17_GPIOB ;
+    pin  &= 0x07 ;
   }
 
-  mask = 1 << pin ;
-  old  = wiringPiI2CReadReg8 (node->fd, reg) ;
+  mask  = 1 << pin ;
+  value = wiringPiI2CReadReg8 (node->fd, gpio) ;
+
+  if ((value & mask) == 0)
+    return LOW ;
+  else 
+    return HIGH ;
+}
+
+
+/*
+ * myDigitalRead8:
+ * myDigitalRead16:
+ *	With IOCON.SEQOP set and BANK clear the chip's address pointer toggles
+ *	between the A and B registers, so a two byte access at GPIOA covers
+ *	both banks in one transaction. Outputs can come from the shadow.
+ *********************************************************************************
+ */
+
+static unsigned int readBits (struct wiringPiNodeStruct *node, int pin, unsigned int width)
+{
+  unsigned int out, bits, value ;
+
+  pin -= node->pinBase ;
+
+  out  = shadowMask (node) ;
+  bits = (width << pin) & 0xFFFF ;
+
+// Only go to the chip if there's an input in there
 
-  if (mode == PUD_UP)
-    old |=   mask ;
+  /**/ if ((bits & ~out) == 0)
+    value = 0 ;
+  else if ((bits & 0xFF00) == 0)
+    value = wiringPiI2CReadReg8 (node->fd, MCP23x17_GPIOA) ;
+  else if ((bits & 0x00FF) == 0)
+    value = wiringPiI2CReadReg8 (node->fd, MCP23x17_GPIOB) << 8 ;
   else
-    old &= (~mask) ;
+    value = (unsigned int)wiringPiI2CReadReg16 (node->fd, MCP23x17_GPIOA) ;
+
+  value = (value & ~out) | (SHADOW_GET (node->data2, SHADOW_OLAT) & out) ;
+
+  return (value >> pin) & width ;
+}
 
-  wiringPiI2CWriteReg8 (node->fd, reg, old) ;
+static unsigned int myDigitalRead16 (struct wiringPiNodeStruct *node, int pin)
+{
+  return readBits (node, pin, 0xFFFF) ;
+}
+
+static unsigned int myDigitalRead8 (struct wiringPiNodeStruct *node, int pin)
+{
+  return readBits (node, pin, 0x00FF) ;
 }
 
 
 /*
- * myDigitalWrite:
+ * writeLatch:
+ *	Write the bank(s) with any of the bits in them out from the shadow -
+ *	both in one transaction if need be. Anything held back for
+ *	wiringPiCommit in those banks goes with them.
+ *	It may be the async worker here, so the pending bits are cleared
+ *	before the shadow is read - anything changed after that goes next time.
  *********************************************************************************
  */
 
-static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
+static void writeLatch (struct wiringPiNodeStruct *node, unsigned int bits)
 {
-  int bit, old ;
+  unsigned int olat ;
 
-  pin -= node->pinBase ;	// Pin now 0-15
+  if ((bits & 0x00FF) != 0) bits |= 0x00FF ;
+  if ((bits & 0xFF00) != 0) bits |= 0xFF00 ;
 
-  bit = 1 << (pin & 7) ;
+  __atomic_fetch_and (&node->data1, ~bits, __ATOMIC_ACQ_REL) ;	// Pending bits
+  olat = SHADOW_GET (__atomic_load_n (&node->data2, __ATOMIC_ACQUIRE), SHADOW_OLAT) ;
 
-  if (pin < 8)			// Bank A
-  {
-    old = node->data2 ;
+  /**/ if (bits == 0x00FF)
+    wiringPiI2CWriteReg8 (node->fd, MCP23x17_GPIOA, olat & 0xFF) ;
+  else if (bits == 0xFF00)
+    wiringPiI2CWriteReg8 (node->fd, MCP23x17_GPIOB, olat >> 8) ;
+  else if (bits != 0)
+    wiringPiI2CWriteReg16 (node->fd, MCP23x17_GPIOA, olat) ;
+}
 
-    if (value == LOW)
-      old &= (~bit) ;
-    else
-      old |=   bit ;
 
-    wiringPiI2CWriteReg8 (node->fd, MCP23x17_GPIOA, old) ;
-    node->data2 = old ;
-  }
-  else				// Bank B
-  {
-    old = node->data3 ;
+/*
+ * myDigitalWriteMasked:
+ * myDigitalWrite:
+ * myDigitalWrite8:
+ * myDigitalWrite16:
+ *	Update the output latch shadow and write out only the bank(s) that
+ *	actually changed - or, inside wiringPiBegin/wiringPiCommit or when
+ *	async, just remember which they were.
+ *********************************************************************************
+ */
+
+static void myDigitalWriteMasked (struct wiringPiNodeStruct *node, int pin, unsigned int value, unsigned int mask)
+{
+  unsigned int olat, bits ;
+
+  pin -= node->pinBase ;
 
-    if (value == LOW)
-      old &= (~bit) ;
-    else
-      old |=   bit ;
+  bits = (mask << pin) & 0xFFFF ;
+  olat = SHADOW_GET (node->data2, SHADOW_OLAT) ;
+  olat = (olat & ~bits) | ((value << pin) & bits) ;
 
-    wiringPiI2CWriteReg8 (node->fd, MCP23x17_GPIOB, old) ;
-    node->data3 = old ;
+  SHADOW_PUT (node->data2, SHADOW_OLAT, olat) ;
+
+  if (wiringPiNodeDeferred (node))
+  {
+    __atomic_fetch_or (&node->data1, bits, __ATOMIC_RELEASE) ;
+    wiringPiNodeChanged (node) ;
   }
+  else
+    writeLatch (node, bits) ;
+}
+
+static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  myDigitalWriteMasked (node, pin, (value != LOW) ? 1 : 0, 1) ;
+}
+
+static void myDigitalWrite8 (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  myDigitalWriteMasked (node, pin, value, 0x00FF) ;
+}
+
+static void myDigitalWrite16 (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  myDigitalWriteMasked (node, pin, value, 0xFFFF) ;
 }
 
 
 /*
- * myDigitalRead:
+ * myDigitalWriteSequence:
+ *	With SEQOP the address pointer toggles between GPIOA and GPIOB, so
+ *	a block of A, B pairs is a sequence of 16-bit writes in one
+ *	transaction. Anything held back for wiringPiCommit goes with it.
  *********************************************************************************
  */
 
-static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
+static void myDigitalWriteSequence (struct wiringPiNodeStruct *node, int pin, unsigned int mask, const unsigned int *values, int count)
 {
-  int mask, value, gpio ;
+  unsigned char buf [WPI_I2C_MAX_BLOCK] ;
+  unsigned int bits, olat ;
+  int i, n ;
 
   pin -= node->pinBase ;
 
-  if (pin < 8)		// Bank A
-    gpio  = MCP23x17_GPIOA ;
-  else
+  bits = (mask << pin) & 0xFFFF ;
+
+  __atomic_fetch_and (&node->data1, ~0xFFFFu, __ATOMIC_ACQ_REL) ;	// Pending bits
+  olat = SHADOW_GET (__atomic_load_n (&node->data2, __ATOMIC_ACQUIRE), SHADOW_OLAT) ;
+
+  for ( ; count > 0 ; values += n, count -= n)
   {
-    gpio  = MCP23x17_GPIOB ;
-    pin  &= 0x07 ;
+    n = (count > WPI_I2C_MAX_BLOCK / 2) ? WPI_I2C_MAX_BLOCK / 2 : count ;
+    for (i = 0 ; i < n ; ++i)
+    {
+      olat = (olat & ~bits) | ((values [i] << pin) & bits) ;
+      buf [i * 2]     = olat & 0xFF ;
+      buf [i * 2 + 1] = olat >> 8 ;
+    }
+    SHADOW_PUT (node->data2, SHADOW_OLAT, olat) ;
+    wiringPiI2CWriteBlock (node->fd, MCP23x17_GPIOA, buf, n * 2) ;
   }
+}
 
-  mask  = 1 << pin ;
-  value = wiringPiI2CReadReg8 (node->fd, gpio) ;
 
-  if ((value & mask) == 0)
-    return LOW ;
-  else 
-    return HIGH ;
+/*
+ * myFlush:
+ *	Send whatever's been held back by wiringPiBegin
+ *********************************************************************************
+ */
+
+static void myFlush (struct wiringPiNodeStruct *node)
+{
+  writeLatch (node, __atomic_load_n (&node->data1, __ATOMIC_ACQUIRE)) ;
+}
+
+
+/*
+ * myInit:
+ *	The registers we change later are read once here to load the shadows.
+ *********************************************************************************
+ */
+
+static int myInit (struct wiringPiNodeStruct *node)
+{
+  int fd = node->fd ;
+
+  wiringPiI2CWriteReg8 (fd, MCP23x17_IOCON, IOCON_INIT) ;
+
+  node->data1 = node->data2 = node->data3 = 0 ;
+  SHADOW_PUT (node->data2, SHADOW_OLAT,  wiringPiI2CReadReg16 (fd, MCP23x17_OLATA)) ;
+  SHADOW_PUT (node->data2, SHADOW_IPOL,  wiringPiI2CReadReg16 (fd, MCP23x17_IPOLA)) ;
+  SHADOW_PUT (node->data3, SHADOW_IODIR, wiringPiI2CReadReg16 (fd, MCP23x17_IODIRA)) ;
+  SHADOW_PUT (node->data3, SHADOW_GPPU,  wiringPiI2CReadReg16 (fd, MCP23x17_GPPUA)) ;
+
+  return TRUE ;
 }
 
 
@@ -179,8 +340,6 @@ int mcp23017Setup (const int pinBase, const int i2cAddress)
   if ((fd = wiringPiI2CSetup (i2cAddress)) < 0)
     return FALSE ;
 
-  wiringPiI2CWriteReg8 (fd, MCP23x17_IOCON, IOCON_INIT) ;
-
   node = wiringPiNewNode (pinBase, 16) ;
 
   node->fd              = fd ;
@@ -188,8 +347,49 @@ int mcp23017Setup (const int pinBase, const int i2cAddress)
   node->pullUpDnControl = myPullUpDnControl ;
   node->digitalRead     = myDigitalRead ;
   node->digitalWrite    = myDigitalWrite ;
-  node->data2           = wiringPiI2CReadReg8 (fd, MCP23x17_OLATA) ;
-  node->data3           = wiringPiI2CReadReg8 (fd, MCP23x17_OLATB) ;
+  node->digitalRead8    = myDigitalRead8 ;
+  node->digitalRead16   = myDigitalRead16 ;
+  node->digitalWrite8   = myDigitalWrite8 ;
+  node->digitalWrite16  = myDigitalWrite16 ;
+  node->digitalWriteMasked = myDigitalWriteMasked ;
+  node->digitalWriteSequence = myDigitalWriteSequence ;
+  node->flush           = myFlush ;
+
+  return wiringPiNodeInit (node, myInit) ;
+}
+
+
+/*
+ * mcp23017SetupInt:
+ *	As above, but with the chip's INTA/INTB outputs (mirrored so either
+ *	will do) connected to the given Pi pin. Expander pins can then be
+ *	given change callbacks with mcp23x17ISR () rather than being polled.
+ *********************************************************************************
+ */
+
+static unsigned int i2cReadWord (struct wiringPiNodeStruct *node, int reg)
+{
+  return wiringPiI2CReadReg16 (node->fd, reg) ;
+}
+
+static void i2cWriteWord (struct wiringPiNodeStruct *node, int reg, unsigned int value)
+{
+  wiringPiI2CWriteReg16 (node->fd, reg, value) ;
+}
+
+int mcp23017SetupInt (const int pinBase, const int i2cAddress, const int intPin)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if (!mcp23017Setup (pinBase, i2cAddress))
+    return FALSE ;
+
+  node = wiringPiFindNode (pinBase) ;
+
+  wiringPiI2CWriteReg8 (node->fd, MCP23x17_IOCON, IOCON_INIT | IOCON_MIRROR) ;
+
+  if (mcp23x17IntAttach (node, intPin, i2cReadWord, i2cWriteWord) < 0)
+    return FALSE ;
 
   return TRUE ;
 }
@@ -26,7 +26,8 @@
 extern "C" {
 #endif
 
-extern int mcp23017Setup (const int pinBase, const int i2cAddress) ;
+extern int mcp23017Setup    (const int pinBase, const int i2cAddress) ;
+extern int mcp23017SetupInt (const int pinBase, const int i2cAddress, const int intPin) ;
 
 #ifdef __cplusplus
 }
@@ -72,47 +72,48 @@ static uint8_t readByte (uint8_t spiPort, uint8_t devId, uint8_t reg)
 
 
 /*
- * myPinMode:
+ * updateShadow:
+ *	Change one bit in a shadow register and write it back to the chip.
+ *	There is no need to read it first.
  *********************************************************************************
  */
 
-static void myPinMode (struct wiringPiNodeStruct *node, int pin, int mode)
+static void updateShadow (struct wiringPiNodeStruct *node, unsigned int *word, int shift, int reg, int pin, int set)
 {
-  int mask, old, reg ;
+  unsigned int value ;
 
-  reg  = MCP23x08_IODIR ;
-  mask = 1 << (pin - node->pinBase) ;
-  old  = readByte (node->data0, node->data1, reg) ;
+  value = SHADOW_GET (*word, shift) ;
 
-  if (mode == OUTPUT)
-    old &= (~mask) ;
+  if (set)
+    value |=   (1 << pin) ;
   else
-    old |=   mask ;
+    value &= (~(1 << pin)) ;
+
+  writeByte (node->data0, node->data1, reg, value) ;
 
-  writeByte (node->data0, node->data1, reg, old) ;
+  SHADOW_PUT (*word, shift, value) ;
 }
 
 
 /*
- * myPullUpDnControl:
+ * myPinMode:
  *********************************************************************************
  */
 
-static void myPullUpDnControl (struct wiringPiNodeStruct *node, int pin, int mode)
+static void myPinMode (struct wiringPiNodeStruct *node, int pin, int mode)
 {
-  int mask, old, reg ;
-
-  reg  = MCP23x08_GPPU ;
-  mask = 1 << (pin - node->pinBase) ;
+  updateShadow (node, &node->data3, SHADOW_IODIR, MCP23x08_IODIR, (pin - node->pinBase) & 7, mode != OUTPUT) ;
+}
 
-  old  = readByte (node->data0, node->data1, reg) ;
 
-  if (mode == PUD_UP)
-    old |=   mask ;
-  else
-    old &= (~mask) ;
+/*
+ * myPullUpDnControl:
+ *********************************************************************************
+ */
 
-  writeByte (node->data0, node->data1, reg, old) ;
+static void myPullUpDnControl (struct wiringPiNodeStruct *node, int pin, int mode)
+{
+  updateShadow (node, &node->data3, SHADOW_GPPU, MCP23x08_GPPU, (pin - node->pinBase) & 7, mode == PUD_UP) ;
 }
 
 
@@ -123,18 +124,7 @@ static void myPullUpDnControl (struct wiringPiNodeStruct *node, int pin, int mod
 
 static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
 {
-  int bit, old ;
-
-  bit  = 1 << ((pin - node->pinBase) & 7) ;
-
-  old = node->data2 ;
-  if (value == LOW)
-    old &= (~bit) ;
-  else
-    old |=   bit ;
-
-  writeByte (node->data0, node->data1, MCP23x08_GPIO, old) ;
-  node->data2 = old ;
+  updateShadow (node, &node->data2, SHADOW_OLAT, MCP23x08_GPIO, (pin - node->pinBase) & 7, value != LOW) ;
 }
 
 
@@ -162,6 +152,7 @@ static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
  *	Create a new instance of an MCP23s08 SPI GPIO interface. We know it
  *	has 8 pins, so all we need to know here is the SPI address and the
  *	user-defined pin base.
+ *	The registers we change later are read once here to load the shadows.
  *********************************************************************************
  */
 
@@ -182,7 +173,12 @@ int mcp23s08Setup (const int pinBase, const int spiPort, const int devId)
   node->pullUpDnControl = myPullUpDnControl ;
   node->digitalRead     = myDigitalRead ;
   node->digitalWrite    = myDigitalWrite ;
-  node->data2           = readByte (spiPort, devId, MCP23x08_OLAT) ;
+
+  node->data2 = node->data3 = 0 ;
+  SHADOW_PUT (node->data2, SHADOW_OLAT,  readByte (spiPort, devId, MCP23x08_OLAT)) ;
+  SHADOW_PUT (node->data2, SHADOW_IPOL,  readByte (spiPort, devId, MCP23x08_IPOL)) ;
+  SHADOW_PUT (node->data3, SHADOW_IODIR, readByte (spiPort, devId, MCP23x08_IODIR)) ;
+  SHADOW_PUT (node->data3, SHADOW_GPPU,  readByte (spiPort, devId, MCP23x08_GPPU)) ;
 
   return TRUE ;
 }
@@ -28,6 +28,7 @@
 #include "wiringPi.h"
 #include "wiringPiSPI.h"
 #include "mcp23x0817.h"
+#include "mcp23x17isr.h"
 
 #include "mcp23s17.h"
 
@@ -72,104 +73,112 @@ static uint8_t readByte (uint8_t spiPort, uint8_t devId, uint8_t reg)
 
 
 /*
- * myPinMode:
+ * writeWord:
+ * readWord:
+ *	Access an A/B register pair in one transaction - the A register
+ *	is in the low byte.
  *********************************************************************************
  */
 
-static void myPinMode (struct wiringPiNodeStruct *node, int pin, int mode)
+static void writeWord (uint8_t spiPort, uint8_t devId, uint8_t reg, unsigned int data)
 {
-  int mask, old, reg ;
+  uint8_t spiData [4] ;
 
-  pin -= node->pinBase ;
+  spiData [0] = CMD_WRITE | ((devId & 7) << 1) ;
+  spiData [1] = reg ;
+  spiData [2] = data & 0xFF ;
+  spiData [3] = data >> 8 ;
 
-  if (pin < 8)		// Bank A
-    reg  = MCP23x17_IODIRA ;
-  else
-  {
-    reg  = MCP23x17_IODIRB ;
-    pin &= 0x07 ;
-  }
+  wiringPiSPIDataRW (spiPort, spiData, 4) ;
+}
 
-  mask = 1 << pin ;
-  old  = readByte (node->data0, node->data1, reg) ;
+static unsigned int readWord (uint8_t spiPort, uint8_t devId, uint8_t reg)
+{
+  uint8_t spiData [4] ;
 
-  if (mode == OUTPUT)
-    old &= (~mask) ;
-  else
-    old |=   mask ;
+  spiData [0] = CMD_READ | ((devId & 7) << 1) ;
+  spiData [1] = reg ;
+
+  wiringPiSPIDataRW (spiPort, spiData, 4) ;
 
-  writeByte (node->data0, node->data1, reg, old) ;
+  return spiData [2] | (spiData [3] << 8) ;
 }
 
 
 /*
- * myPullUpDnControl:
+ * updateShadow:
+ *	Change one bit in a 16-bit shadow register and write the affected
+ *	bank back to the chip. There is no need to read it first.
  *********************************************************************************
  */
 
-static void myPullUpDnControl (struct wiringPiNodeStruct *node, int pin, int mode)
+static void updateShadow (struct wiringPiNodeStruct *node, unsigned int *word, int shift, int regA, int regB, int pin, int set)
 {
-  int mask, old, reg ;
+  unsigned int value ;
 
-  pin -= node->pinBase ;
+  value = SHADOW_GET (*word, shift) ;
 
-  if (pin < 8)		// Bank A
-    reg  = MCP23x17_GPPUA ;
+  if (set)
+    value |=   (1 << pin) ;
   else
-  {
-    reg  = MCP23x17_GPPUB ;
-    pin &= 0x07 ;
-  }
+    value &= (~(1 << pin)) ;
 
-  mask = 1 << pin ;
-  old  = readByte (node->data0, node->data1, reg) ;
-
-  if (mode == PUD_UP)
-    old |=   mask ;
+  if (pin < 8)
+    writeByte (node->data0, node->data1, regA, value & 0xFF) ;
   else
-    old &= (~mask) ;
+    writeByte (node->data0, node->data1, regB, value >> 8) ;
 
-  writeByte (node->data0, node->data1, reg, old) ;
+  SHADOW_PUT (*word, shift, value) ;
 }
 
 
 /*
- * myDigitalWrite:
+ * myPinMode:
  *********************************************************************************
  */
 
-static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
+static void myPinMode (struct wiringPiNodeStruct *node, int pin, int mode)
+{
+  updateShadow (node, &node->data3, SHADOW_IODIR, MCP23x17_IODIRA, MCP23x17_IODIRB, pin - node->pinBase, mode != OUTPUT) ;
+}
+
+
+/*
+ * myPullUpDnControl:
+ *********************************************************************************
+ */
+
+static void myPullUpDnControl (struct wiringPiNodeStruct *node, int pin, int mode)
 {
-  int bit, old ;
+  updateShadow (node, &node->data3, SHADOW_GPPU, MCP23x17_GPPUA, MCP23x17_GPPUB, pin - node->pinBase, mode == PUD_UP) ;
+}
 
-  pin -= node->pinBase ;	// Pin now 0-15
 
-  bit = 1 << (pin & 7) ;
+/*
+ * myDigitalWrite:
+ *********************************************************************************
+ */
 
-  if (pin < 8)			// Bank A
-  {
-    old = node->data2 ;
+static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  updateShadow (node, &node->data2, SHADOW_OLAT, MCP23x17_GPIOA, MCP23x17_GPIOB, pin - node->pinBase, value != LOW) ;
+}
 
-    if (value == LOW)
-      old &= (~bit) ;
-    else
-      old |=   bit ;
 
-    writeByte (node->data0, node->data1, MCP23x17_GPIOA, old) ;
-    node->data2 = old ;
-  }
-  else				// Bank B
-  {
-    old = node->data3 ;
+/*
+ * shadowMask:
+ *	The pins we can answer digitalRead for from the output latch shadow
+ *	without going to the chip: the outputs, if wiringPiNodeCacheOutputs
+ *	is on for the node.
+ *********************************************************************************
+ */
 
-    if (value == LOW)
-      old &= (~bit) ;
-    else
-      old |=   bit ;
+static unsigned int shadowMask (struct wiringPiNodeStruct *node)
+{
+  if ((node->flags & WPI_NODE_CACHE_OUTPUTS) == 0)
+    return 0 ;
 
-    writeByte (node->data0, node->data1, MCP23x17_GPIOB, old) ;
-    node->data3 = old ;
-  }
+  return ~SHADOW_GET (node->data3, SHADOW_IODIR) & 0xFFFF ;
 }
 
 
@@ -184,6 +193,9 @@ static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
 
   pin -= node->pinBase ;
 
+  if ((shadowMask (node) & (1 << pin)) != 0)
+    return (SHADOW_GET (node->data2, SHADOW_OLAT) >> pin) & 1 ;
+
   if (pin < 8)		// Bank A
     gpio  = MCP23x17_GPIOA ;
   else
@@ -202,11 +214,97 @@ static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
 }
 
 
+/*
+ * myDigitalRead8:
+ * myDigitalRead16:
+ *	With IOCON.SEQOP set and BANK clear the chip's address pointer toggles
+ *	between the A and B registers, so a two byte access at GPIOA covers
+ *	both banks in one transaction. Outputs can come from the shadow.
+ *********************************************************************************
+ */
+
+static unsigned int readBits (struct wiringPiNodeStruct *node, int pin, unsigned int width)
+{
+  unsigned int out, bits, value ;
+
+  pin -= node->pinBase ;
+
+  out  = shadowMask (node) ;
+  bits = (width << pin) & 0xFFFF ;
+
+// Only go to the chip if there's an input in there
+
+  /**/ if ((bits & ~out) == 0)
+    value = 0 ;
+  else if ((bits & 0xFF00) == 0)
+    value = readByte (node->data0, node->data1, MCP23x17_GPIOA) ;
+  else if ((bits & 0x00FF) == 0)
+    value = readByte (node->data0, node->data1, MCP23x17_GPIOB) << 8 ;
+  else
+    value = readWord (node->data0, node->data1, MCP23x17_GPIOA) ;
+
+  value = (value & ~out) | (SHADOW_GET (node->data2, SHADOW_OLAT) & out) ;
+
+  return (value >> pin) & width ;
+}
+
+static unsigned int myDigitalRead16 (struct wiringPiNodeStruct *node, int pin)
+{
+  return readBits (node, pin, 0xFFFF) ;
+}
+
+static unsigned int myDigitalRead8 (struct wiringPiNodeStruct *node, int pin)
+{
+  return readBits (node, pin, 0x00FF) ;
+}
+
+
+/*
+ * myDigitalWriteMasked:
+ * myDigitalWrite8:
+ * myDigitalWrite16:
+ *	Update the output latch shadow and write out only the bank(s) that
+ *	actually changed - both in one transaction if need be.
+ *********************************************************************************
+ */
+
+static void myDigitalWriteMasked (struct wiringPiNodeStruct *node, int pin, unsigned int value, unsigned int mask)
+{
+  unsigned int olat, bits ;
+
+  pin -= node->pinBase ;
+
+  bits = (mask << pin) & 0xFFFF ;
+  olat = SHADOW_GET (node->data2, SHADOW_OLAT) ;
+  olat = (olat & ~bits) | ((value << pin) & bits) ;
+
+  /**/ if ((bits & 0xFF00) == 0)
+    writeByte (node->data0, node->data1, MCP23x17_GPIOA, olat & 0xFF) ;
+  else if ((bits & 0x00FF) == 0)
+    writeByte (node->data0, node->data1, MCP23x17_GPIOB, olat >> 8) ;
+  else
+    writeWord (node->data0, node->data1, MCP23x17_GPIOA, olat) ;
+
+  SHADOW_PUT (node->data2, SHADOW_OLAT, olat) ;
+}
+
+static void myDigitalWrite8 (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  myDigitalWriteMasked (node, pin, value, 0x00FF) ;
+}
+
+static void myDigitalWrite16 (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  myDigitalWriteMasked (node, pin, value, 0xFFFF) ;
+}
+
+
 /*
  * mcp23s17Setup:
  *	Create a new instance of an MCP23s17 SPI GPIO interface. We know it
  *	has 16 pins, so all we need to know here is the SPI address and the
  *	user-defined pin base.
+ *	The registers we change later are read once here to load the shadows.
  *********************************************************************************
  */
 
@@ -228,8 +326,54 @@ int mcp23s17Setup (const int pinBase, const int spiPort, const int devId)
   node->pullUpDnControl = myPullUpDnControl ;
   node->digitalRead     = myDigitalRead ;
   node->digitalWrite    = myDigitalWrite ;
-  node->data2           = readByte (spiPort, devId, MCP23x17_OLATA) ;
-  node->data3           = readByte (spiPort, devId, MCP23x17_OLATB) ;
+  node->digitalRead8    = myDigitalRead8 ;
+  node->digitalRead16   = myDigitalRead16 ;
+  node->digitalWrite8   = myDigitalWrite8 ;
+  node->digitalWrite16  = myDigitalWrite16 ;
+  node->digitalWriteMasked = myDigitalWriteMasked ;
+
+  node->data2 = node->data3 = 0 ;
+  SHADOW_PUT (node->data2, SHADOW_OLAT,  readWord (spiPort, devId, MCP23x17_OLATA)) ;
+  SHADOW_PUT (node->data2, SHADOW_IPOL,  readWord (spiPort, devId, MCP23x17_IPOLA)) ;
+  SHADOW_PUT (node->data3, SHADOW_IODIR, readWord (spiPort, devId, MCP23x17_IODIRA)) ;
+  SHADOW_PUT (node->data3, SHADOW_GPPU,  readWord (spiPort, devId, MCP23x17_GPPUA)) ;
+
+  return TRUE ;
+}
+
+
+/*
+ * mcp23s17SetupInt:
+ *	As above, but with the chip's INTA/INTB outputs (mirrored so either
+ *	will do) connected to the given Pi pin. Expander pins can then be
+ *	given change callbacks with mcp23x17ISR () rather than being polled.
+ *********************************************************************************
+ */
+
+static unsigned int spiReadWord (struct wiringPiNodeStruct *node, int reg)
+{
+  return readWord (node->data0, node->data1, reg) ;
+}
+
+static void spiWriteWord (struct wiringPiNodeStruct *node, int reg, unsigned int value)
+{
+  writeWord (node->data0, node->data1, reg, value) ;
+}
+
+int mcp23s17SetupInt (const int pinBase, const int spiPort, const int devId, const int intPin)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if (!mcp23s17Setup (pinBase, spiPort, devId))
+    return FALSE ;
+
+  node = wiringPiFindNode (pinBase) ;
+
+  writeByte (spiPort, devId, MCP23x17_IOCON,  IOCON_INIT | IOCON_HAEN | IOCON_MIRROR) ;
+  writeByte (spiPort, devId, MCP23x17_IOCONB, IOCON_INIT | IOCON_HAEN | IOCON_MIRROR) ;
+
+  if (mcp23x17IntAttach (node, intPin, spiReadWord, spiWriteWord) < 0)
+    return FALSE ;
 
   return TRUE ;
 }
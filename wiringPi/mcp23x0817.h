@@ -81,6 +81,22 @@
 
 #define	IOCON_INIT	(IOCON_SEQOP)
 
+// Shadow registers
+//	The drivers keep copies of the registers they modify in the node so
+//	that configuration changes never need to read the chip first. Each
+//	copy is 16 bits wide - bank A in the low byte, bank B in the high byte
+//	(only the low byte is used on the 8-bit devices):
+//	  node->data2: OLAT in bits 0-15, IPOL in 16-31
+//	  node->data3: IODIR in bits 0-15, GPPU in 16-31
+
+#define	SHADOW_OLAT	0
+#define	SHADOW_IPOL	16
+#define	SHADOW_IODIR	0
+#define	SHADOW_GPPU	16
+
+#define	SHADOW_GET(word,shift)		(((word) >> (shift)) & 0xFFFFu)
+#define	SHADOW_PUT(word,shift,value)	(word) = ((word) & ~(0xFFFFu << (shift))) | (((value) & 0xFFFFu) << (shift))
+
 // SPI Command codes
 
 #define	CMD_WRITE	0x40
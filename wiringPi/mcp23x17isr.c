@@ -0,0 +1,228 @@
+/*
+ * mcp23x17isr.c:
+ *	Interrupt-on-change support for the MCP23017 and MCP23S17
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "wiringPi.h"
+#include "mcp23x0817.h"
+
+#include "mcp23x17isr.h"
+
+
+// One of these for each expander that has its INT output wired to a Pi
+//	GPIO. The chip is set up with INTA and INTB mirrored so a single pin
+//	does for both banks.
+
+#define	MAX_INT_CHIPS	8
+
+struct mcpIntStruct
+{
+  struct wiringPiNodeStruct *node ;
+  mcp23x17ReadWord_t         readWord ;
+  mcp23x17WriteWord_t        writeWord ;
+  unsigned int               gpinten ;		// Shadow of GPINTENA/B
+  int                        modes     [16] ;
+  void                     (*functions [16])(int pin, int value) ;
+} ;
+
+static struct mcpIntStruct chips [MAX_INT_CHIPS] ;
+static int                 numChips = 0 ;
+
+static pthread_mutex_t intMutex = PTHREAD_MUTEX_INITIALIZER ;
+
+
+/*
+ * serviceChip:
+ *	Called from the wiringPi ISR thread when the INT line falls. INTF says
+ *	which pins caused it and INTCAP holds their levels at the time - reading
+ *	INTCAP also clears the interrupt. Keep going until INTF is clear as the
+ *	line won't fall again while it's still asserted.
+ *********************************************************************************
+ */
+
+static void serviceChip (struct mcpIntStruct *chip)
+{
+  struct wiringPiNodeStruct *node = chip->node ;
+  unsigned int intf, cap ;
+  int pin, value, mode, tries ;
+  void (*function)(int, int) ;
+
+  for (tries = 0 ; tries < 4 ; ++tries)
+  {
+    intf = chip->readWord (node, MCP23x17_INTFA) & 0xFFFF ;
+    if (intf == 0)
+      break ;
+    cap  = chip->readWord (node, MCP23x17_INTCAPA) ;
+
+    for (pin = 0 ; pin < 16 ; ++pin)
+    {
+      if ((intf & (1 << pin)) == 0)
+	continue ;
+
+      function = chip->functions [pin] ;
+      mode     = chip->modes     [pin] ;
+      value    = (cap >> pin) & 1 ;
+
+      if (function == NULL)
+	continue ;
+
+      if ((mode == INT_EDGE_BOTH) || ((mode == INT_EDGE_RISING) && value) || ((mode == INT_EDGE_FALLING) && !value))
+	function (node->pinBase + pin, value) ;
+    }
+  }
+}
+
+// wiringPiISR functions take no argument, so each chip slot needs
+//	its own little handler.
+
+#define	MCP_ISR(n)	static void mcpIsr##n (void) { serviceChip (&chips [n]) ; }
+
+MCP_ISR (0)  MCP_ISR (1)  MCP_ISR (2)  MCP_ISR (3)
+MCP_ISR (4)  MCP_ISR (5)  MCP_ISR (6)  MCP_ISR (7)
+
+static void (*isrs [MAX_INT_CHIPS])(void) =
+{
+  mcpIsr0, mcpIsr1, mcpIsr2, mcpIsr3, mcpIsr4, mcpIsr5, mcpIsr6, mcpIsr7,
+} ;
+
+
+/*
+ * nodeEdge:
+ * myIsr:
+ *	The node's isr op, so wiringPiISR () and the event rings work on our
+ *	pins as well as mcp23x17ISR (). INT_EDGE_SETUP turns it off.
+ *********************************************************************************
+ */
+
+static void nodeEdge (int pin, int value)
+{
+  wiringPiNodeEdge (pin, value ? INT_EDGE_RISING : INT_EDGE_FALLING, 0) ;
+}
+
+static int myIsr (UNU struct wiringPiNodeStruct *node, int pin, int mode)
+{
+  if (mode == INT_EDGE_SETUP)
+    return mcp23x17ISR (pin, INT_EDGE_BOTH, NULL) ;
+
+  return mcp23x17ISR (pin, mode, nodeEdge) ;
+}
+
+
+/*
+ * mcp23x17IntAttach:
+ *	Called by the drivers once the chip is set up (with IOCON.MIRROR) to
+ *	start handling its interrupt output on the given Pi pin. All pins start
+ *	with interrupt-on-change disabled.
+ *********************************************************************************
+ */
+
+int mcp23x17IntAttach (struct wiringPiNodeStruct *node, int intPin, mcp23x17ReadWord_t readWord, mcp23x17WriteWord_t writeWord)
+{
+  struct mcpIntStruct *chip ;
+
+  pthread_mutex_lock (&intMutex) ;
+
+  if (numChips == MAX_INT_CHIPS)
+  {
+    pthread_mutex_unlock (&intMutex) ;
+    return wiringPiFailure (WPI_ALMOST, "mcp23x17IntAttach: Too many interrupt driven expanders (max %d)\n", MAX_INT_CHIPS) ;
+  }
+
+  chip            = &chips [numChips] ;
+  chip->node      = node ;
+  chip->readWord  = readWord ;
+  chip->writeWord = writeWord ;
+  chip->gpinten   = 0 ;
+
+// Compare against the previous value (INTCON clear) and throw away
+//	anything already latched
+
+  writeWord (node, MCP23x17_GPINTENA, 0) ;
+  writeWord (node, MCP23x17_INTCONA,  0) ;
+  (void)readWord (node, MCP23x17_INTCAPA) ;
+
+  if (wiringPiISR (intPin, INT_EDGE_FALLING, isrs [numChips]) < 0)
+  {
+    pthread_mutex_unlock (&intMutex) ;
+    return -1 ;
+  }
+
+  node->isr = myIsr ;
+
+  ++numChips ;
+  pthread_mutex_unlock (&intMutex) ;
+
+  return 0 ;
+}
+
+
+/*
+ * mcp23x17ISR:
+ *	Call the function when the given expander pin changes. The mode is
+ *	INT_EDGE_RISING, INT_EDGE_FALLING or INT_EDGE_BOTH and the function
+ *	gets the pin and its level as captured by the chip. A NULL function
+ *	turns interrupt-on-change off for the pin.
+ *********************************************************************************
+ */
+
+int mcp23x17ISR (int pin, int mode, void (*function)(int pin, int value))
+{
+  struct mcpIntStruct *chip = NULL ;
+  int i, bit ;
+
+  if ((mode != INT_EDGE_RISING) && (mode != INT_EDGE_FALLING) && (mode != INT_EDGE_BOTH))
+    return wiringPiFailure (WPI_ALMOST, "mcp23x17ISR: Invalid mode %d\n", mode) ;
+
+  pthread_mutex_lock (&intMutex) ;
+
+  for (i = 0 ; i < numChips ; ++i)
+    if ((pin >= chips [i].node->pinBase) && (pin <= chips [i].node->pinMax))
+    {
+      chip = &chips [i] ;
+      break ;
+    }
+
+  if (chip == NULL)
+  {
+    pthread_mutex_unlock (&intMutex) ;
+    return wiringPiFailure (WPI_ALMOST, "mcp23x17ISR: Pin %d is not on an interrupt driven expander\n", pin) ;
+  }
+
+  bit = pin - chip->node->pinBase ;
+
+  chip->modes     [bit] = mode ;
+  chip->functions [bit] = function ;
+
+  if (function != NULL)
+    chip->gpinten |=   (1 << bit) ;
+  else
+    chip->gpinten &= (~(1 << bit)) ;
+
+  chip->writeWord (chip->node, MCP23x17_GPINTENA, chip->gpinten) ;
+
+  pthread_mutex_unlock (&intMutex) ;
+
+  return 0 ;
+}
@@ -0,0 +1,40 @@
+/*
+ * mcp23x17isr.h:
+ *	Interrupt-on-change support for the MCP23017 and MCP23S17
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+// Register access supplied by the I2C and SPI drivers. Word accesses
+//	cover an A/B register pair with the A register in the low byte.
+
+typedef unsigned int (*mcp23x17ReadWord_t)  (struct wiringPiNodeStruct *node, int reg) ;
+typedef void         (*mcp23x17WriteWord_t) (struct wiringPiNodeStruct *node, int reg, unsigned int value) ;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int mcp23x17IntAttach (struct wiringPiNodeStruct *node, int intPin, mcp23x17ReadWord_t readWord, mcp23x17WriteWord_t writeWord) ;
+extern int mcp23x17ISR       (int pin, int mode, void (*function)(int pin, int value)) ;
+
+#ifdef __cplusplus
+}
+#endif
@@ -22,6 +22,8 @@
  ***********************************************************************
  */
 
+#include <string.h>
+
 #include <wiringPi.h>
 #include <wiringPiSPI.h>
 
@@ -35,8 +37,9 @@
 
 static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
 {
-  unsigned char spiData [2] ;
+  unsigned char cmd [2], spiData [2] ;
   unsigned char chanBits ;
+  struct wpiSpiSeg seg ;
   int chan = pin - node->pinBase ;
 
   if (chan == 0)
@@ -44,15 +47,99 @@ static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
   else
     chanBits = 0b11110000 ;
 
-  spiData [0] = chanBits ;
-  spiData [1] = 0 ;
+  cmd [0] = chanBits ;
+  cmd [1] = 0 ;
+
+  memset (&seg, 0, sizeof (seg)) ;
+  seg.tx  = cmd ;
+  seg.rx  = spiData ;
+  seg.len = 2 ;
 
-  wiringPiSPIDataRW (node->fd, spiData, 2) ;
+  wiringPiSPITransfer (node->fd, &seg, 1) ;
 
   return ((spiData [0] << 8) | (spiData [1] >> 1)) & 0x3FF ;
 }
 
 
+/*
+ * myAnalogReadRange:
+ *	Both channels (or just the one) in one SPI transaction.
+ *	Returns count, or -1 on error.
+ *********************************************************************************
+ */
+
+static int myAnalogReadRange (struct wiringPiNodeStruct *node, int pin, int count, int *values)
+{
+  struct wpiSpiSeg segs [2] ;
+  unsigned char cmd [2][2], spiData [2][2] ;
+  int first = pin - node->pinBase ;
+  int i ;
+
+  memset (segs, 0, sizeof (segs)) ;
+
+  for (i = 0 ; i < count ; ++i)
+  {
+    cmd [i][0] = ((first + i) == 0) ? 0b11010000 : 0b11110000 ;
+    cmd [i][1] = 0 ;
+
+    segs [i].tx       = cmd [i] ;
+    segs [i].rx       = spiData [i] ;
+    segs [i].len      = 2 ;
+    segs [i].csChange = (i != count - 1) ;
+  }
+
+  if (wiringPiSPITransfer (node->fd, segs, count) < 0)
+    return -1 ;
+
+  for (i = 0 ; i < count ; ++i)
+    values [i] = ((spiData [i][0] << 8) | (spiData [i][1] >> 1)) & 0x3FF ;
+
+  return count ;
+}
+
+
+/*
+ * mcp3002ReadAll:
+ *	Read both channels in one SPI transaction. values must have room
+ *	for 2. Returns 2, or -1 on error.
+ *********************************************************************************
+ */
+
+int mcp3002ReadAll (int pinBase, int *values)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if ((node = wiringPiFindNode (pinBase)) == NULL)
+    return -1 ;
+
+  if (node->analogRead != myAnalogRead)	// Not one of ours
+    return -1 ;
+
+  return myAnalogReadRange (node, node->pinBase, node->data0, values) ;
+}
+
+
+/*
+ * mcp3002Channels:
+ *	How many channels the chip at pinBase has, as recorded at setup -
+ *	without going near the bus. -1 if it's not one of ours.
+ *********************************************************************************
+ */
+
+int mcp3002Channels (int pinBase)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if ((node = wiringPiFindNode (pinBase)) == NULL)
+    return -1 ;
+
+  if (node->analogRead != myAnalogRead)	// Not one of ours
+    return -1 ;
+
+  return node->data0 ;
+}
+
+
 /*
  * mcp3002Setup:
  *	Create a new wiringPi device node for an mcp3002 on the Pi's
@@ -69,8 +156,10 @@ int mcp3002Setup (const int pinBase, int spiChannel)
 
   node = wiringPiNewNode (pinBase, 2) ;
 
-  node->fd         = spiChannel ;
-  node->analogRead = myAnalogRead ;
+  node->fd              = spiChannel ;
+  node->data0           = 2 ;		// Channels
+  node->analogRead      = myAnalogRead ;
+  node->analogReadRange = myAnalogReadRange ;
 
   return TRUE ;
 }
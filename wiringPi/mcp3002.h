@@ -26,7 +26,9 @@
 extern "C" {
 #endif
 
-extern int mcp3002Setup (int pinBase, int spiChannel) ;
+extern int mcp3002Setup    (int pinBase, int spiChannel) ;
+extern int mcp3002ReadAll  (int pinBase, int *values) ;
+extern int mcp3002Channels (int pinBase) ;
 
 #ifdef __cplusplus
 }
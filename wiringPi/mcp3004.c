@@ -24,6 +24,8 @@
  ***********************************************************************
  */
 
+#include <string.h>
+
 #include <wiringPi.h>
 #include <wiringPiSPI.h>
 
@@ -37,22 +39,153 @@
 
 static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
 {
-  unsigned char spiData [3] ;
+  unsigned char cmd [3], spiData [3] ;
   unsigned char chanBits ;
+  struct wpiSpiSeg seg ;
   int chan = pin - node->pinBase ;
 
   chanBits = 0b10000000 | (chan << 4) ;
 
-  spiData [0] = 1 ;		// Start bit
-  spiData [1] = chanBits ;
-  spiData [2] = 0 ;
+  cmd [0] = 1 ;		// Start bit
+  cmd [1] = chanBits ;
+  cmd [2] = 0 ;
+
+  memset (&seg, 0, sizeof (seg)) ;
+  seg.tx  = cmd ;
+  seg.rx  = spiData ;
+  seg.len = 3 ;
 
-  wiringPiSPIDataRW (node->fd, spiData, 3) ;
+  wiringPiSPITransfer (node->fd, &seg, 1) ;
 
   return ((spiData [1] << 8) | spiData [2]) & 0x3FF ;
 }
 
 
+/*
+ * myAnalogReadMulti:
+ *	count conversions of one channel, as few SPI transactions as it
+ *	takes, with CS dropped between them to start each conversion.
+ *********************************************************************************
+ */
+
+static int myAnalogReadMulti (struct wiringPiNodeStruct *node, int pin, int *values, int count)
+{
+  struct wpiSpiSeg segs [WPI_SPI_MAX_SEGS] ;
+  unsigned char cmd [3], spiData [WPI_SPI_MAX_SEGS][3] ;
+  int chan = pin - node->pinBase ;
+  int done, n, i ;
+
+  cmd [0] = 1 ;		// Start bit
+  cmd [1] = 0b10000000 | (chan << 4) ;
+  cmd [2] = 0 ;
+
+  memset (segs, 0, sizeof (segs)) ;
+  for (i = 0 ; i < WPI_SPI_MAX_SEGS ; ++i)
+  {
+    segs [i].tx       = cmd ;
+    segs [i].rx       = spiData [i] ;
+    segs [i].len      = 3 ;
+    segs [i].csChange = 1 ;
+  }
+
+  for (done = 0 ; done < count ; done += n)
+  {
+    n = (count - done > WPI_SPI_MAX_SEGS) ? WPI_SPI_MAX_SEGS : count - done ;
+
+    segs [n - 1].csChange = 0 ;
+    if (wiringPiSPITransfer (node->fd, segs, n) < 0)
+      return (done > 0) ? done : -1 ;
+    segs [n - 1].csChange = 1 ;
+
+    for (i = 0 ; i < n ; ++i)
+      values [done + i] = ((spiData [i][1] << 8) | spiData [i][2]) & 0x3FF ;
+  }
+
+  return count ;
+}
+
+
+/*
+ * myAnalogReadRange:
+ *	count consecutive channels from pin in one SPI transaction - one
+ *	segment per channel, with CS dropped between them to start each
+ *	conversion. Returns count, or -1 on error.
+ *********************************************************************************
+ */
+
+static int myAnalogReadRange (struct wiringPiNodeStruct *node, int pin, int count, int *values)
+{
+  struct wpiSpiSeg segs [8] ;
+  unsigned char cmd [8][3], spiData [8][3] ;
+  int first = pin - node->pinBase ;
+  int i ;
+
+  memset (segs, 0, sizeof (segs)) ;
+
+  for (i = 0 ; i < count ; ++i)
+  {
+    cmd [i][0] = 1 ;		// Start bit
+    cmd [i][1] = 0b10000000 | ((first + i) << 4) ;
+    cmd [i][2] = 0 ;
+
+    segs [i].tx       = cmd [i] ;
+    segs [i].rx       = spiData [i] ;
+    segs [i].len      = 3 ;
+    segs [i].csChange = (i != count - 1) ;
+  }
+
+  if (wiringPiSPITransfer (node->fd, segs, count) < 0)
+    return -1 ;
+
+  for (i = 0 ; i < count ; ++i)
+    values [i] = ((spiData [i][1] << 8) | spiData [i][2]) & 0x3FF ;
+
+  return count ;
+}
+
+
+/*
+ * mcp3004ReadAll:
+ *	Read all 8 channels in one SPI transaction. values must have room
+ *	for 8. Returns 8, or -1 on error.
+ *********************************************************************************
+ */
+
+int mcp3004ReadAll (int pinBase, int *values)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if ((node = wiringPiFindNode (pinBase)) == NULL)
+    return -1 ;
+
+  if (node->analogRead != myAnalogRead)	// Not one of ours
+    return -1 ;
+
+  return myAnalogReadRange (node, node->pinBase, node->data0, values) ;
+}
+
+
+/*
+ * mcp3004Channels:
+ *	How many channels the chip at pinBase has, as recorded at setup -
+ *	without going near the bus. -1 if it's not one of ours.
+ *********************************************************************************
+ */
+
+int mcp3004Channels (int pinBase)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if ((node = wiringPiFindNode (pinBase)) == NULL)
+    return -1 ;
+
+  if (node->analogRead != myAnalogRead)	// Not one of ours
+    return -1 ;
+
+  return node->data0 ;
+}
+
+
 /*
  * mcp3004Setup:
  *	Create a new wiringPi device node for an mcp3004 on the Pi's
@@ -69,8 +202,11 @@ int mcp3004Setup (const int pinBase, int spiChannel)
 
   node = wiringPiNewNode (pinBase, 8) ;
 
-  node->fd         = spiChannel ;
-  node->analogRead = myAnalogRead ;
+  node->fd              = spiChannel ;
+  node->data0           = 8 ;		// Channels
+  node->analogRead      = myAnalogRead ;
+  node->analogReadMulti = myAnalogReadMulti ;
+  node->analogReadRange = myAnalogReadRange ;
 
   return TRUE ;
 }
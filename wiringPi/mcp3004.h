@@ -26,7 +26,9 @@
 extern "C" {
 #endif
 
-extern int mcp3004Setup (int pinBase, int spiChannel) ;
+extern int mcp3004Setup    (int pinBase, int spiChannel) ;
+extern int mcp3004ReadAll  (int pinBase, int *values) ;
+extern int mcp3004Channels (int pinBase) ;
 
 #ifdef __cplusplus
 }
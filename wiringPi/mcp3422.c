@@ -29,6 +29,7 @@
 #include <unistd.h>
 #include <stdint.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
 
 #include <wiringPi.h>
@@ -37,69 +38,265 @@
 #include "mcp3422.h"
 
 
+// Per-chip state for continuous mode and the background scan.
+//	node->data3 says which one.
+//	busLock covers the I2C traffic and the chip's configuration, lock
+//	the scan results, so reading a scanned channel never waits on the bus.
+
+#define	MAX_MCP3422	8
+
+struct mcp3422Struct
+{
+  struct wiringPiNodeStruct *node ;
+  pthread_mutex_t  busLock ;
+  int              contChan ;		// Channel in continuous mode, or -1
+  int              contValid ;		// It's produced a result since
+  int              restart ;		// Something else re-configured the chip
+
+  pthread_mutex_t  lock ;
+  pthread_cond_t   cond ;
+  pthread_t        scanThread ;
+  volatile int     scanning ;
+  unsigned int     scanMask ;		// Channels being scanned
+  unsigned int     scanValid ;		// Channels with a value yet
+  int              values [4] ;
+} ;
+
+static struct mcp3422Struct chips [MAX_MCP3422] ;
+static int                  numChips = 0 ;
+
+// Conversion times in uS for each sample rate
+
+static const unsigned int conversionUs [4] = { 4167, 16667, 66667, 266667 } ;
+
+// Configuration register bits
+
+#define	CONFIG_RDY		0x80
+#define	CONFIG_CONTINUOUS	0x10
+
+
 /*
- * waitForConversion:
- *	Common code to wait for the ADC to finish conversion
+ * configure:
+ *	Write the configuration register: a channel, one-shot (with RDY set
+ *	to start a conversion) or continuous, plus the sample rate and gain.
+ *	In continuous mode a new configuration restarts the conversion.
  *********************************************************************************
  */
 
-void waitForConversion (int fd, unsigned char *buffer, int n)
+static void configure (struct wiringPiNodeStruct *node, int realChan, unsigned char mode)
 {
-  for (;;)
-  {
-    read (fd, buffer, n) ;
-    if ((buffer [n-1] & 0x80) == 0)
-      break ;
-    delay (1) ;
-  }
+  wiringPiI2CWrite (node->fd, mode | (realChan << 5) | (node->data0 << 2) | (node->data1)) ;
 }
 
+
 /*
- * myAnalogRead:
- *	Read a channel from the device
+ * readResult:
+ *	Read the output register - always 4 bytes, which for every sample
+ *	rate ends with the configuration byte and its RDY bit - optionally
+ *	polling until RDY says there's a new result. Checks about 50 times a
+ *	conversion and gives up after two conversion times.
+ *	Returns the value, or -1 on a bus error or timeout.
  *********************************************************************************
  */
 
-int myAnalogRead (struct wiringPiNodeStruct *node, int chan)
+static int readResult (struct wiringPiNodeStruct *node, int wait)
 {
-  unsigned char config ;
   unsigned char buffer [4] ;
-  int value = 0 ;
-  int realChan = (chan & 3) - node->pinBase ;
-
-// One-shot mode, trigger plus the other configs.
+  unsigned int  us = conversionUs [node->data0 & 3] ;
+  unsigned int  then = micros () ;
 
-  config = 0x80 | (realChan << 5) | (node->data0 << 2) | (node->data1) ;
-  
-  wiringPiI2CWrite (node->fd, config) ;
+  for (;;)
+  {
+    if (wiringPiI2CReadBytes (node->fd, buffer, 4) != 4)
+      return -1 ;
+    if (!wait || ((buffer [3] & CONFIG_RDY) == 0))
+      break ;
+    if ((micros () - then) > 2 * us)
+      return -1 ;
+    delayMicroseconds (us / 50) ;
+  }
 
   switch (node->data0)	// Sample rate
   {
     case MCP3422_SR_3_75:			// 18 bits
-      waitForConversion (node->fd, &buffer [0], 4) ;
-      value = ((buffer [0] & 3) << 16) | (buffer [1] << 8) | buffer [2] ;
-      break ;
+      return ((buffer [0] & 3) << 16) | (buffer [1] << 8) | buffer [2] ;
 
     case MCP3422_SR_15:				// 16 bits
-      waitForConversion (node->fd, buffer, 3) ;
-      value = (buffer [0] << 8) | buffer [1] ;
-      break ;
+      return (buffer [0] << 8) | buffer [1] ;
 
     case MCP3422_SR_60:				// 14 bits
-      waitForConversion (node->fd, buffer, 3) ;
-      value = ((buffer [0] & 0x3F) << 8) | buffer [1] ;
-      break ;
+      return ((buffer [0] & 0x3F) << 8) | buffer [1] ;
 
-    case MCP3422_SR_240:			// 12 bits - default
-      waitForConversion (node->fd, buffer, 3) ;
-      value = ((buffer [0] & 0x0F) << 8) | buffer [1] ;
-      break ;
+    default:					// 12 bits - default
+      return ((buffer [0] & 0x0F) << 8) | buffer [1] ;
+  }
+}
+
+
+/*
+ * convert:
+ *	Start a one-shot conversion on a channel, sleep for most of the
+ *	conversion time rather than hammering the bus, then collect the
+ *	result. Puts a continuous channel back afterwards.
+ *	Called with the bus locked.
+ *********************************************************************************
+ */
+
+static int convert (struct mcp3422Struct *c, int realChan)
+{
+  struct wiringPiNodeStruct *node = c->node ;
+  int value ;
+
+  configure (node, realChan, CONFIG_RDY) ;
+
+  delayMicroseconds (conversionUs [node->data0 & 3] * 9 / 10) ;
+
+  value = readResult (node, TRUE) ;
+
+  c->restart = TRUE ;
+  if ((c->contChan >= 0) && !c->scanning)
+  {
+    configure (node, c->contChan, CONFIG_CONTINUOUS) ;
+    c->contValid = FALSE ;
   }
 
   return value ;
 }
 
 
+/*
+ * nextChannel:
+ *	After chan in the scan set
+ *********************************************************************************
+ */
+
+static int nextChannel (unsigned int mask, int chan)
+{
+  do
+    chan = (chan + 1) & 3 ;
+  while ((mask & (1 << chan)) == 0) ;
+
+  return chan ;
+}
+
+
+/*
+ * scanThread:
+ *	Convert each channel in the scan set in turn, in continuous mode:
+ *	as soon as a result is in the chip goes on to the next channel,
+ *	before we've done anything with it, and we keep the latest values.
+ *	If a one-shot read gets onto the bus in between, start again.
+ *********************************************************************************
+ */
+
+static void *scanThread (void *arg)
+{
+  struct mcp3422Struct *c = (struct mcp3422Struct *)arg ;
+  struct wiringPiNodeStruct *node = c->node ;
+  unsigned int delayUs = conversionUs [node->data0 & 3] * 9 / 10 ;
+  int chan = nextChannel (c->scanMask, 3) ;
+  int next, value ;
+
+  pthread_mutex_lock (&c->busLock) ;
+    configure (node, chan, CONFIG_CONTINUOUS) ;
+    c->restart = FALSE ;
+  pthread_mutex_unlock (&c->busLock) ;
+
+  while (c->scanning)
+  {
+    delayMicroseconds (delayUs) ;
+
+    pthread_mutex_lock (&c->busLock) ;
+
+    if (c->restart)
+    {
+      configure (node, chan, CONFIG_CONTINUOUS) ;
+      c->restart = FALSE ;
+      pthread_mutex_unlock (&c->busLock) ;
+      continue ;
+    }
+
+    value = readResult (node, TRUE) ;
+    next  = nextChannel (c->scanMask, chan) ;
+    if (next != chan)
+      configure (node, next, CONFIG_CONTINUOUS) ;
+
+    pthread_mutex_unlock (&c->busLock) ;
+
+    if (value >= 0)
+    {
+      pthread_mutex_lock (&c->lock) ;
+	c->values [chan] = value ;
+	c->scanValid |= (1 << chan) ;
+	pthread_cond_broadcast (&c->cond) ;
+      pthread_mutex_unlock (&c->lock) ;
+    }
+
+    chan = next ;
+  }
+
+// Back to the continuous channel, if any, else let the chip go idle
+
+  pthread_mutex_lock (&c->busLock) ;
+    if (c->contChan >= 0)
+      configure (node, c->contChan, CONFIG_CONTINUOUS) ;
+    else
+      configure (node, chan, 0) ;
+    c->contValid = FALSE ;
+  pthread_mutex_unlock (&c->busLock) ;
+
+  return NULL ;
+}
+
+
+/*
+ * myAnalogRead:
+ *	Read a channel from the device - from the scan table if the
+ *	channel's being scanned, the output register if it's the one in
+ *	continuous mode, otherwise with a one-shot conversion.
+ *	Returns -1 if the chip doesn't answer.
+ *********************************************************************************
+ */
+
+static int myAnalogRead (struct wiringPiNodeStruct *node, int chan)
+{
+  struct mcp3422Struct *c = &chips [node->data3] ;
+  int realChan = (chan - node->pinBase) & 3 ;
+  int value ;
+
+  pthread_mutex_lock (&c->lock) ;
+
+  if (c->scanning && ((c->scanMask & (1 << realChan)) != 0))
+  {
+    while (c->scanning && ((c->scanValid & (1 << realChan)) == 0))
+      pthread_cond_wait (&c->cond, &c->lock) ;
+    if (c->scanning)
+    {
+      value = c->values [realChan] ;
+      pthread_mutex_unlock (&c->lock) ;
+      return value ;
+    }
+  }
+
+  pthread_mutex_unlock (&c->lock) ;
+
+  pthread_mutex_lock (&c->busLock) ;
+
+  if ((realChan == c->contChan) && !c->scanning)
+  {
+    value = readResult (node, !c->contValid) ;
+    if (value >= 0)
+      c->contValid = TRUE ;
+  }
+  else
+    value = convert (c, realChan) ;
+
+  pthread_mutex_unlock (&c->busLock) ;
+
+  return value ;
+}
+
+
 /*
  * mcp3422Setup:
  *	Create a new wiringPi device node for the mcp3422
@@ -110,16 +307,142 @@ int mcp3422Setup (int pinBase, int i2cAddress, int sampleRate, int gain)
 {
   int fd ;
   struct wiringPiNodeStruct *node ;
+  struct mcp3422Struct *c ;
+
+  if (numChips == MAX_MCP3422)
+    return wiringPiFailure (WPI_ALMOST, "mcp3422Setup: Too many devices (max %d)\n", MAX_MCP3422) ;
 
   if ((fd = wiringPiI2CSetup (i2cAddress)) < 0)
     return FALSE ;
 
   node = wiringPiNewNode (pinBase, 4) ;
 
+  c = &chips [numChips] ;
+  c->node     = node ;
+  c->contChan = -1 ;
+  c->scanning = FALSE ;
+  pthread_mutex_init (&c->busLock, NULL) ;
+  pthread_mutex_init (&c->lock,    NULL) ;
+  pthread_cond_init  (&c->cond,    NULL) ;
+
   node->fd         = fd ;
-  node->data0      = sampleRate ;
-  node->data1      = gain ;
+  node->data0      = sampleRate & 3 ;
+  node->data1      = gain & 3 ;
+  node->data3      = numChips++ ;
   node->analogRead = myAnalogRead ;
 
   return TRUE ;
 }
+
+
+/*
+ * findChip:
+ *	The chip a pin's on
+ *********************************************************************************
+ */
+
+static struct mcp3422Struct *findChip (int pin)
+{
+  struct wiringPiNodeStruct *node = wiringPiFindNode (pin) ;
+
+  if ((node == NULL) || (node->data3 >= (unsigned int)numChips) || (chips [node->data3].node != node))
+    return NULL ;
+
+  return &chips [node->data3] ;
+}
+
+
+/*
+ * mcp3422Continuous:
+ *	Put the chip into continuous conversion on this pin's channel, or
+ *	take it out again. analogRead of the pin then returns the latest
+ *	result straight away, at the cost of one-shot reads of the other
+ *	channels, which have to start it again. There's one converter, so
+ *	it's one channel per chip.
+ *********************************************************************************
+ */
+
+int mcp3422Continuous (int pin, int enable)
+{
+  struct mcp3422Struct *c ;
+  int realChan ;
+
+  if ((c = findChip (pin)) == NULL)
+    return wiringPiFailure (WPI_ALMOST, "mcp3422Continuous: No MCP3422 at pin %d\n", pin) ;
+
+  realChan = (pin - c->node->pinBase) & 3 ;
+
+  pthread_mutex_lock (&c->busLock) ;
+
+  if (enable)
+    c->contChan = realChan ;
+  else if (c->contChan == realChan)
+    c->contChan = -1 ;
+  else
+  {
+    pthread_mutex_unlock (&c->busLock) ;
+    return 0 ;
+  }
+
+  if (!c->scanning)
+  {
+    configure (c->node, realChan, enable ? CONFIG_CONTINUOUS : 0) ;
+    c->contValid = FALSE ;
+  }
+
+  pthread_mutex_unlock (&c->busLock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * mcp3422ScanStart:
+ * mcp3422ScanStop:
+ *	Start and stop the background scan of the channels in the mask (bit
+ *	0 for channel 0 up to bit 3). While it runs analogRead of those
+ *	channels returns the latest value without waiting.
+ *********************************************************************************
+ */
+
+int mcp3422ScanStart (int pinBase, unsigned int channels)
+{
+  struct mcp3422Struct *c ;
+
+  if ((c = findChip (pinBase)) == NULL)
+    return wiringPiFailure (WPI_ALMOST, "mcp3422ScanStart: No MCP3422 at pin %d\n", pinBase) ;
+
+  if ((channels & 0x0F) == 0)
+    return wiringPiFailure (WPI_ALMOST, "mcp3422ScanStart: No channels to scan\n") ;
+
+  mcp3422ScanStop (pinBase) ;
+
+  pthread_mutex_lock (&c->lock) ;
+    c->scanMask  = channels & 0x0F ;
+    c->scanValid = 0 ;
+    c->scanning  = TRUE ;
+  pthread_mutex_unlock (&c->lock) ;
+
+  if (pthread_create (&c->scanThread, NULL, scanThread, c) != 0)
+  {
+    c->scanning = FALSE ;
+    return wiringPiFailure (WPI_ALMOST, "mcp3422ScanStart: Unable to start thread\n") ;
+  }
+
+  return 0 ;
+}
+
+void mcp3422ScanStop (int pinBase)
+{
+  struct mcp3422Struct *c ;
+
+  if (((c = findChip (pinBase)) == NULL) || !c->scanning)
+    return ;
+
+  pthread_mutex_lock (&c->lock) ;
+    c->scanning = FALSE ;
+    pthread_cond_broadcast (&c->cond) ;
+  pthread_mutex_unlock (&c->lock) ;
+
+  pthread_join (c->scanThread, NULL) ;
+}
@@ -36,7 +36,10 @@
 extern "C" {
 #endif
 
-extern int mcp3422Setup (int pinBase, int i2cAddress, int sampleRate, int gain) ;
+extern int  mcp3422Setup      (int pinBase, int i2cAddress, int sampleRate, int gain) ;
+extern int  mcp3422Continuous (int pin, int enable) ;
+extern int  mcp3422ScanStart  (int pinBase, unsigned int channels) ;
+extern void mcp3422ScanStop   (int pinBase) ;
 
 #ifdef __cplusplus
 }
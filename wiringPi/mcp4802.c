@@ -22,22 +22,22 @@
  ***********************************************************************
  */
 
+#include <stddef.h>
+
 #include <wiringPi.h>
 #include <wiringPiSPI.h>
 
 #include "mcp4802.h"
 
 /*
- * myAnalogWrite:
- *	Write analog value on the given pin
+ * pack:
+ *	The 2 byte command that sets a channel to a value
  *********************************************************************************
  */
 
-static void myAnalogWrite (struct wiringPiNodeStruct *node, int pin, int value)
+static void pack (int chan, int value, unsigned char *spiData)
 {
-  unsigned char spiData [2] ;
   unsigned char chanBits, dataBits ;
-  int chan = pin - node->pinBase ;
 
   if (chan == 0)
     chanBits = 0x30 ;
@@ -49,10 +49,45 @@ static void myAnalogWrite (struct wiringPiNodeStruct *node, int pin, int value)
 
   spiData [0] = chanBits ;
   spiData [1] = dataBits ;
+}
+
+
+/*
+ * myAnalogWrite:
+ *	Write analog value on the given pin
+ *********************************************************************************
+ */
+
+static void myAnalogWrite (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  unsigned char spiData [2] ;
+
+  pack (pin - node->pinBase, value, spiData) ;
 
   wiringPiSPIDataRW (node->fd, spiData, 2) ;
 }
 
+
+/*
+ * mcp4802Pack:
+ *	Make the command for a value on a pin without sending it - for
+ *	streaming. Returns the SPI channel to send it to, or -1 if the pin
+ *	isn't on an mcp4802.
+ *********************************************************************************
+ */
+
+int mcp4802Pack (int pin, int value, unsigned char *cmd)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if (((node = wiringPiFindNode (pin)) == NULL) || (node->analogWrite != myAnalogWrite))
+    return -1 ;
+
+  pack (pin - node->pinBase, value, cmd) ;
+
+  return node->fd ;
+}
+
 /*
  * mcp4802Setup:
  *	Create a new wiringPi device node for an mcp4802 on the Pi's
@@ -64,7 +99,7 @@ int mcp4802Setup (const int pinBase, int spiChannel)
 {
   struct wiringPiNodeStruct *node ;
 
-  if (wiringPiSPISetup (spiChannel, 1000000) < 0)
+  if (wiringPiSPISetup (spiChannel, MCP4802_SPI_SPEED) < 0)
     return FALSE ;
 
   node = wiringPiNewNode (pinBase, 2) ;
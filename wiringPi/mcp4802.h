@@ -22,11 +22,14 @@
  ***********************************************************************
  */
 
+#define	MCP4802_SPI_SPEED	1000000
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 extern int mcp4802Setup (int pinBase, int spiChannel) ;
+extern int mcp4802Pack  (int pin, int value, unsigned char *cmd) ;
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,627 @@
+/*
+ * oneWire.c:
+ *	A 1-Wire bus master on GPIO pins, working several busses at once
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+/*
+ * Notes:
+ *	Each pin is a bus of its own, with its own pull-up (4k7 to 3.3v).
+ *	The output latches are kept low and a bus pulled low by making it
+ *	an output, let go by making it an input again - pinModeMask (), so
+ *	one function select write for all the busses in a bank.
+ *	Every time slot is on all the busses we've been asked for at once:
+ *	all pulled low, the ones being sent a 1 (or read) let go after 6uS,
+ *	one read of the level register at 12uS for what came back, the rest
+ *	let go at 60uS. A slot can send each bus its own bit, which is what
+ *	lets a ROM search, or selecting a different probe on each bus, go in
+ *	parallel too. So 8 busses take as long as one.
+ *	The slots are timed by spinning on the clock, with the thread raised
+ *	to SCHED_FIFO for the transaction, as digitalBurst () does. A slot
+ *	that still went late (a 1 let go after 15uS, or read after that) is
+ *	noted and the transaction fails with EAGAIN; oneWireScratchpads ()
+ *	and oneWireSearch () try again.
+ *	Busses are numbered by their place in the pins given to oneWireOpen.
+ *********************************************************************************
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "wiringPi.h"
+#include "oneWire.h"
+
+#define	RETRIES			3
+
+// Standard speed timings, nS from the start of the slot
+
+#define	RESET_LOW_NS		480000
+#define	RESET_SAMPLE_NS		70000
+#define	RESET_DONE_NS		480000
+
+#define	SLOT_RELEASE_NS		6000
+#define	SLOT_SAMPLE_NS		12000
+#define	SLOT_LATE_NS		15000
+#define	SLOT_LOW_NS		60000
+#define	SLOT_NS			70000
+
+struct oneWireStruct
+{
+  int          numBusses ;
+  int          pins [ONE_WIRE_MAX_BUSSES] ;
+  int          bank [ONE_WIRE_MAX_BUSSES] ;
+  unsigned int bit  [ONE_WIRE_MAX_BUSSES] ;
+  unsigned int all ;				// Every bus
+  int          late ;
+
+  int                 oldPolicy, raised ;	// For the transaction
+  struct sched_param  oldParam ;
+} ;
+
+
+static inline void spinUntil (unsigned long long deadline)
+{
+  while (nanos64 () < deadline)
+    ;
+}
+
+
+/*
+ * toBanks:
+ * fromBanks:
+ *	Bus masks to and from per-bank GPIO masks
+ *********************************************************************************
+ */
+
+static void toBanks (struct oneWireStruct *ow, unsigned int busses, unsigned int masks [2])
+{
+  int i ;
+
+  masks [0] = masks [1] = 0 ;
+
+  for (i = 0 ; i < ow->numBusses ; ++i)
+    if ((busses & (1u << i)) != 0)
+      masks [ow->bank [i]] |= ow->bit [i] ;
+}
+
+static unsigned int fromBanks (struct oneWireStruct *ow, const unsigned int levels [2])
+{
+  unsigned int busses = 0 ;
+  int i ;
+
+  for (i = 0 ; i < ow->numBusses ; ++i)
+    if ((levels [ow->bank [i]] & ow->bit [i]) != 0)
+      busses |= 1u << i ;
+
+  return busses ;
+}
+
+
+// pull: let:
+//	Pull busses low, and let them go
+
+static inline void pull (const unsigned int masks [2])
+{
+  if (masks [0] != 0) pinModeMask (0, masks [0], OUTPUT) ;
+  if (masks [1] != 0) pinModeMask (1, masks [1], OUTPUT) ;
+}
+
+static inline void let (const unsigned int masks [2])
+{
+  if (masks [0] != 0) pinModeMask (0, masks [0], INPUT) ;
+  if (masks [1] != 0) pinModeMask (1, masks [1], INPUT) ;
+}
+
+
+/*
+ * txBegin:
+ * txEnd:
+ *	Either side of a transaction: the thread at the top real-time
+ *	priority, if we're allowed, and the latches low in case anyone's
+ *	been at them.
+ *********************************************************************************
+ */
+
+static void txBegin (struct oneWireStruct *ow)
+{
+  struct sched_param param ;
+  unsigned int masks [2] ;
+
+  ow->late   = FALSE ;
+  ow->raised = pthread_getschedparam (pthread_self (), &ow->oldPolicy, &ow->oldParam) == 0 ;
+  if (ow->raised)
+  {
+    param.sched_priority = sched_get_priority_max (SCHED_FIFO) ;
+    ow->raised = pthread_setschedparam (pthread_self (), SCHED_FIFO, &param) == 0 ;
+  }
+
+  toBanks (ow, ow->all, masks) ;
+  if (masks [0] != 0) digitalWriteMask (0, 0, masks [0]) ;
+  if (masks [1] != 0) digitalWriteMask (1, 0, masks [1]) ;
+}
+
+static int txEnd (struct oneWireStruct *ow, int res)
+{
+  if (ow->raised)
+    pthread_setschedparam (pthread_self (), ow->oldPolicy, &ow->oldParam) ;
+
+  if ((res >= 0) && ow->late)
+  {
+    errno = EAGAIN ;
+    return -1 ;
+  }
+
+  return res ;
+}
+
+
+/*
+ * busReset:
+ *	The reset pulse, returning the busses with something on them
+ *********************************************************************************
+ */
+
+static unsigned int busReset (struct oneWireStruct *ow, unsigned int busses)
+{
+  unsigned int masks [2], levels [2] ;
+  unsigned long long t0 ;
+
+  toBanks (ow, busses, masks) ;
+
+  t0 = nanos64 () ;
+  pull (masks) ;
+  delayUntilNanos (t0 + RESET_LOW_NS) ;
+  let (masks) ;
+
+  t0 = nanos64 () ;
+  spinUntil (t0 + RESET_SAMPLE_NS) ;
+  levels [0] = digitalReadBank (0) ;
+  levels [1] = digitalReadBank (1) ;
+  delayUntilNanos (t0 + RESET_DONE_NS) ;
+
+  return busses & ~fromBanks (ow, levels) ;	// Presence pulls it low
+}
+
+
+/*
+ * busSlot:
+ *	One time slot on busses, sending a 1 to those in ones - a read slot
+ *	is a 1 - and returning the busses which read back high
+ *********************************************************************************
+ */
+
+static unsigned int busSlot (struct oneWireStruct *ow, unsigned int busses, unsigned int ones)
+{
+  unsigned int masks [2], oneMasks [2], zeroMasks [2], levels [2] ;
+  unsigned long long t0, t1 ;
+
+  toBanks (ow, busses,          masks) ;
+  toBanks (ow, busses &  ones,  oneMasks) ;
+  toBanks (ow, busses & ~ones,  zeroMasks) ;
+
+  t0 = nanos64 () ;
+  pull (masks) ;
+  spinUntil (t0 + SLOT_RELEASE_NS) ;
+  let (oneMasks) ;
+  spinUntil (t0 + SLOT_SAMPLE_NS) ;
+  levels [0] = digitalReadBank (0) ;
+  levels [1] = digitalReadBank (1) ;
+  if ((t1 = nanos64 ()) > t0 + SLOT_LATE_NS)
+    ow->late = TRUE ;
+  spinUntil (t0 + SLOT_LOW_NS) ;
+  let (zeroMasks) ;
+  spinUntil (t0 + SLOT_NS) ;
+
+  (void)t1 ;
+  return busses & fromBanks (ow, levels) ;
+}
+
+
+/*
+ * busWriteByte:
+ * busReadByte:
+ *	The same byte on every bus; one byte from each into bytes [bus]
+ *********************************************************************************
+ */
+
+static void busWriteByte (struct oneWireStruct *ow, unsigned int busses, unsigned int byte)
+{
+  int i ;
+
+  for (i = 0 ; i < 8 ; ++i)
+    (void)busSlot (ow, busses, ((byte >> i) & 1) ? busses : 0) ;
+}
+
+static void busReadByte (struct oneWireStruct *ow, unsigned int busses, unsigned char *bytes)
+{
+  unsigned int high ;
+  int i, bus ;
+
+  for (bus = 0 ; bus < ow->numBusses ; ++bus)
+    bytes [bus] = 0 ;
+
+  for (i = 0 ; i < 8 ; ++i)
+  {
+    high = busSlot (ow, busses, busses) ;
+    for (bus = 0 ; bus < ow->numBusses ; ++bus)
+      if ((high & (1u << bus)) != 0)
+	bytes [bus] |= 1 << i ;
+  }
+}
+
+
+/*
+ * busSelect:
+ *	Match ROM with a ROM of its own on each bus, or Skip ROM for all
+ *********************************************************************************
+ */
+
+static void busSelect (struct oneWireStruct *ow, unsigned int busses, const uint64_t *roms)
+{
+  unsigned int ones ;
+  int i, bus ;
+
+  if (roms == NULL)
+  {
+    busWriteByte (ow, busses, ONE_WIRE_SKIP_ROM) ;
+    return ;
+  }
+
+  busWriteByte (ow, busses, ONE_WIRE_MATCH_ROM) ;
+  for (i = 0 ; i < 64 ; ++i)
+  {
+    ones = 0 ;
+    for (bus = 0 ; bus < ow->numBusses ; ++bus)
+      if (((roms [bus] >> i) & 1) != 0)
+	ones |= 1u << bus ;
+    (void)busSlot (ow, busses, ones) ;
+  }
+}
+
+
+/*
+ * oneWireCrc8:
+ *	The Dallas/Maxim CRC (x^8 + x^5 + x^4 + 1) - over a ROM or a
+ *	scratchpad including its CRC byte it comes out 0
+ *********************************************************************************
+ */
+
+unsigned char oneWireCrc8 (const unsigned char *data, int len)
+{
+  unsigned char crc = 0, byte ;
+  int i ;
+
+  while (len-- > 0)
+    for (byte = *data++, i = 0 ; i < 8 ; ++i, byte >>= 1)
+      crc = ((crc ^ byte) & 1) ? (crc >> 1) ^ 0x8C : (crc >> 1) ;
+
+  return crc ;
+}
+
+
+/*
+ * oneWireOpen:
+ *	A bus on each of up to ONE_WIRE_MAX_BUSSES on-board pins
+ *	Returns the busses, or NULL with errno set.
+ *********************************************************************************
+ */
+
+oneWire_t oneWireOpen (const int *pins, int numPins)
+{
+  struct oneWireStruct *ow ;
+  wpiPin_t h ;
+  int i, gpio ;
+
+  if ((pins == NULL) || (numPins < 1) || (numPins > ONE_WIRE_MAX_BUSSES))
+  {
+    errno = EINVAL ;
+    return NULL ;
+  }
+
+  if ((ow = (struct oneWireStruct *)calloc (1, sizeof (*ow))) == NULL)
+    return NULL ;
+
+  for (i = 0 ; i < numPins ; ++i)
+  {
+    if ((h = wiringPiPinOpen (pins [i])) == NULL)
+      gpio = -1 ;
+    else
+    {
+      gpio = h->gpio ;
+      wiringPiPinClose (h) ;
+    }
+
+    if ((gpio < 0) || (gpio > 53))
+    {
+      free (ow) ;
+      errno = EINVAL ;		// Only on-board pins
+      return NULL ;
+    }
+
+    ow->pins [i] = pins [i] ;
+    ow->bank [i] = gpio >> 5 ;
+    ow->bit  [i] = 1u << (gpio & 31) ;
+  }
+
+  ow->numBusses = numPins ;
+  ow->all       = (numPins == 32) ? ~0u : ((1u << numPins) - 1) ;
+
+  for (i = 0 ; i < numPins ; ++i)
+  {
+    pinMode         (pins [i], INPUT) ;
+    pullUpDnControl (pins [i], PUD_OFF) ;	// There's a proper one on the bus
+    digitalWrite    (pins [i], LOW) ;
+  }
+
+  return ow ;
+}
+
+
+/*
+ * oneWireClose:
+ * oneWireBusses:
+ *	Let the busses go; and how many there are
+ *********************************************************************************
+ */
+
+void oneWireClose (oneWire_t ow)
+{
+  int i ;
+
+  if (ow == NULL)
+    return ;
+
+  for (i = 0 ; i < ow->numBusses ; ++i)
+    pinMode (ow->pins [i], INPUT) ;
+
+  free (ow) ;
+}
+
+int oneWireBusses (oneWire_t ow)
+{
+  return ow->numBusses ;
+}
+
+
+/*
+ * oneWireReset:
+ * oneWireWrite:
+ * oneWireRead:
+ * oneWireSelect:
+ *	The primitives, each on all the busses in the mask at once (bit N for
+ *	the Nth pin). oneWireReset returns the busses that answered, the rest
+ *	0. oneWireWrite sends the same bytes to every bus; oneWireRead reads
+ *	len bytes from each into data [bus * len] on. oneWireSelect does
+ *	Match ROM with roms [bus] on each bus, or Skip ROM if roms is NULL.
+ *	All return -1 with errno EAGAIN if a slot went late.
+ *********************************************************************************
+ */
+
+int oneWireReset (oneWire_t ow, unsigned int busses)
+{
+  unsigned int present ;
+
+  txBegin (ow) ;
+  present = busReset (ow, busses & ow->all) ;
+  return txEnd (ow, (int)present) ;
+}
+
+int oneWireWrite (oneWire_t ow, unsigned int busses, const unsigned char *data, int len)
+{
+  int i ;
+
+  txBegin (ow) ;
+  for (i = 0 ; i < len ; ++i)
+    busWriteByte (ow, busses & ow->all, data [i]) ;
+  return txEnd (ow, 0) ;
+}
+
+int oneWireRead (oneWire_t ow, unsigned int busses, unsigned char *data, int len)
+{
+  unsigned char bytes [ONE_WIRE_MAX_BUSSES] ;
+  int i, bus ;
+
+  txBegin (ow) ;
+  for (i = 0 ; i < len ; ++i)
+  {
+    busReadByte (ow, busses & ow->all, bytes) ;
+    for (bus = 0 ; bus < ow->numBusses ; ++bus)
+      if ((busses & (1u << bus)) != 0)
+	data [bus * len + i] = bytes [bus] ;
+  }
+  return txEnd (ow, 0) ;
+}
+
+int oneWireSelect (oneWire_t ow, unsigned int busses, const uint64_t *roms)
+{
+  txBegin (ow) ;
+  busSelect (ow, busses & ow->all, roms) ;
+  return txEnd (ow, 0) ;
+}
+
+
+/*
+ * oneWireScratchpads:
+ *	Reset, select (as oneWireSelect) and read the 9 byte scratchpad on
+ *	every bus in the mask at once, into pads [bus * ONE_WIRE_PAD_SIZE].
+ *	Returns the busses whose scratchpad came back with a good CRC, after
+ *	trying again for any that didn't, or -1 with errno set.
+ *********************************************************************************
+ */
+
+int oneWireScratchpads (oneWire_t ow, unsigned int busses, const uint64_t *roms, unsigned char *pads)
+{
+  unsigned char bytes [ONE_WIRE_MAX_BUSSES] ;
+  unsigned int todo, good = 0, present ;
+  int try, i, bus ;
+
+  todo = busses & ow->all ;
+
+  for (try = 0 ; (try < RETRIES) && (todo != 0) ; ++try)
+  {
+    txBegin (ow) ;
+    present = busReset (ow, todo) ;
+    if (present != 0)
+    {
+      busSelect    (ow, present, roms) ;
+      busWriteByte (ow, present, ONE_WIRE_READ_PAD) ;
+      for (i = 0 ; i < ONE_WIRE_PAD_SIZE ; ++i)
+      {
+	busReadByte (ow, present, bytes) ;
+	for (bus = 0 ; bus < ow->numBusses ; ++bus)
+	  if ((present & (1u << bus)) != 0)
+	    pads [bus * ONE_WIRE_PAD_SIZE + i] = bytes [bus] ;
+      }
+    }
+    (void)txEnd (ow, 0) ;
+
+    todo = present ;			// Nothing there won't get better
+    for (bus = 0 ; bus < ow->numBusses ; ++bus)
+      if (((present & (1u << bus)) != 0) && (oneWireCrc8 (&pads [bus * ONE_WIRE_PAD_SIZE], ONE_WIRE_PAD_SIZE) == 0))
+      {
+	good |=   1u << bus ;
+	todo &= ~(1u << bus) ;
+      }
+  }
+
+  return (int)good ;
+}
+
+
+/*
+ * oneWireSearch:
+ *	Find the ROMs on every bus in the mask, all the busses searched at
+ *	once. Up to maxPerBus ROMs go into roms [bus * maxPerBus] on, and
+ *	counts [bus] says how many there were.
+ *	Returns the ROMs found in all, or -1 with errno set.
+ *********************************************************************************
+ */
+
+int oneWireSearch (oneWire_t ow, unsigned int busses, uint64_t *roms, int maxPerBus, int *counts)
+{
+  uint64_t     rom [ONE_WIRE_MAX_BUSSES] ;
+  int          lastFork [ONE_WIRE_MAX_BUSSES], fork [ONE_WIRE_MAX_BUSSES] ;
+  int          fails [ONE_WIRE_MAX_BUSSES] ;
+  unsigned int todo, active, id, cmp, dirs, b ;
+  unsigned char bytes [8] ;
+  int i, bus, dir, total = 0 ;
+
+  if ((roms == NULL) || (counts == NULL) || (maxPerBus < 1))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  todo = busses & ow->all ;
+  for (bus = 0 ; bus < ow->numBusses ; ++bus)
+  {
+    counts   [bus] = 0 ;
+    rom      [bus] = 0 ;
+    lastFork [bus] = -1 ;
+    fails    [bus] = 0 ;
+  }
+
+// Each pass finds one more ROM on every bus still going
+
+  while (todo != 0)
+  {
+    txBegin (ow) ;
+    active = busReset (ow, todo) ;
+    todo   = active ;			// Nothing on the others
+    busWriteByte (ow, active, ONE_WIRE_SEARCH_ROM) ;
+
+    for (bus = 0 ; bus < ow->numBusses ; ++bus)
+      fork [bus] = -1 ;
+
+    for (i = 0 ; (i < 64) && (active != 0) ; ++i)
+    {
+      id   = busSlot (ow, active, active) ;
+      cmp  = busSlot (ow, active, active) ;
+      dirs = 0 ;
+
+      for (bus = 0 ; bus < ow->numBusses ; ++bus)
+      {
+	if (((b = 1u << bus) & active) == 0)
+	  continue ;
+
+	/**/ if ((id & cmp & b) != 0)		// Nobody answered
+	{
+	  active &= ~b ;
+	  ++fails [bus] ;
+	  continue ;
+	}
+	else if (((id ^ cmp) & b) != 0)		// They all agree
+	  dir = (id & b) != 0 ;
+	else					// Both - go the way we didn't last time
+	{
+	  /**/ if (i < lastFork [bus])
+	    dir = (rom [bus] >> i) & 1 ;
+	  else
+	    dir = (i == lastFork [bus]) ;
+	  if (dir == 0)
+	    fork [bus] = i ;
+	}
+
+	rom [bus] = (rom [bus] & ~(1ULL << i)) | ((uint64_t)dir << i) ;
+	if (dir)
+	  dirs |= b ;
+      }
+
+      (void)busSlot (ow, active, dirs) ;
+    }
+
+    if (txEnd (ow, 0) < 0)		// Do the pass again
+    {
+      for (bus = 0 ; bus < ow->numBusses ; ++bus)
+	if ((todo & (1u << bus)) != 0)
+	  if (++fails [bus] >= RETRIES)
+	    todo &= ~(1u << bus) ;
+      continue ;
+    }
+
+    for (bus = 0 ; bus < ow->numBusses ; ++bus)
+    {
+      if (((b = 1u << bus) & todo) == 0)
+	continue ;
+
+      for (i = 0 ; i < 8 ; ++i)
+	bytes [i] = (rom [bus] >> (i * 8)) & 0xFF ;
+
+      if (((active & b) == 0) || (oneWireCrc8 (bytes, 8) != 0))
+      {
+	if (++fails [bus] >= RETRIES)
+	  todo &= ~b ;
+	continue ;
+      }
+
+      roms [bus * maxPerBus + counts [bus]] = rom [bus] ;
+      ++total ;
+      lastFork [bus] = fork [bus] ;
+      if ((++counts [bus] == maxPerBus) || (fork [bus] == -1))
+	todo &= ~b ;
+    }
+  }
+
+  return total ;
+}
@@ -0,0 +1,63 @@
+/*
+ * oneWire.h:
+ *	A 1-Wire bus master on GPIO pins, working several busses at once
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <stdint.h>
+
+#define	ONE_WIRE_MAX_BUSSES	32
+
+// ROM commands
+
+#define	ONE_WIRE_SEARCH_ROM	0xF0
+#define	ONE_WIRE_READ_ROM	0x33
+#define	ONE_WIRE_MATCH_ROM	0x55
+#define	ONE_WIRE_SKIP_ROM	0xCC
+
+// Function commands most probes (DS18B20 and friends) have
+
+#define	ONE_WIRE_CONVERT_T	0x44
+#define	ONE_WIRE_READ_PAD	0xBE
+#define	ONE_WIRE_PAD_SIZE	9
+
+typedef struct oneWireStruct *oneWire_t ;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern oneWire_t     oneWireOpen        (const int *pins, int numPins) ;
+extern void          oneWireClose       (oneWire_t ow) ;
+extern int           oneWireBusses      (oneWire_t ow) ;
+
+extern int           oneWireReset       (oneWire_t ow, unsigned int busses) ;
+extern int           oneWireWrite       (oneWire_t ow, unsigned int busses, const unsigned char *data, int len) ;
+extern int           oneWireRead        (oneWire_t ow, unsigned int busses, unsigned char *data, int len) ;
+extern int           oneWireSelect      (oneWire_t ow, unsigned int busses, const uint64_t *roms) ;
+
+extern int           oneWireSearch      (oneWire_t ow, unsigned int busses, uint64_t *roms, int maxPerBus, int *counts) ;
+extern int           oneWireScratchpads (oneWire_t ow, unsigned int busses, const uint64_t *roms, unsigned char *pads) ;
+extern unsigned char oneWireCrc8        (const unsigned char *data, int len) ;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,334 @@
+/*
+ * pca9685.c:
+ *	NXP PCA9685 16-channel, 12-bit PWM LED/servo driver
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+/*
+ * Notes:
+ *	We keep a copy of the 64 LEDn_ON/OFF registers, and a mask of the
+ *	channels that have changed since they were last sent. Sending them
+ *	is one auto-increment block from the first changed channel to the
+ *	last, so a pwmWrite is a 4 byte block and a whole frame - from
+ *	pca9685WriteFrame (), or pwmWrites between wiringPiBegin () and
+ *	wiringPiCommit () - is one transaction. The outputs change on the
+ *	STOP at the end of it, so all the channels change together.
+ *********************************************************************************
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <wiringPi.h>
+#include <wiringPiI2C.h>
+
+#include "pca9685.h"
+
+// Registers
+
+#define	PCA9685_MODE1		0x00
+#define	PCA9685_MODE2		0x01
+#define	PCA9685_LED0		0x06		// LED0_ON_L, then 4 per channel
+#define	PCA9685_PRESCALE	0xFE
+
+#define	MODE1_RESTART		0x80
+#define	MODE1_AI		0x20
+#define	MODE1_SLEEP		0x10
+#define	MODE1_ALLCALL		0x01
+#define	MODE2_OUTDRV		0x04
+
+#define	LED_FULL		0x1000		// The full on/off bit in ON_H/OFF_H
+
+#define	OSC_HZ			25000000
+
+// Per-chip state. node->data3 says which one.
+
+#define	MAX_PCA9685		16
+
+struct pca9685Struct
+{
+  struct wiringPiNodeStruct *node ;
+  pthread_mutex_t  lock ;
+  uint16_t         on  [PCA9685_PINS] ;
+  uint16_t         off [PCA9685_PINS] ;
+  unsigned int     dirty ;			// Channels not sent yet
+  double           freq ;			// What the prescaler gives
+} ;
+
+static struct pca9685Struct chips [MAX_PCA9685] ;
+static int                  numChips = 0 ;
+
+
+static struct pca9685Struct *findChip (int pin)
+{
+  struct wiringPiNodeStruct *node = wiringPiFindNode (pin) ;
+
+  if ((node == NULL) || (node->data3 >= (unsigned int)numChips) || (chips [node->data3].node != node))
+    return NULL ;
+
+  return &chips [node->data3] ;
+}
+
+
+/*
+ * writeDirty:
+ *	Send the changed channels, as one block from the first to the last
+ *********************************************************************************
+ */
+
+static int writeDirty (struct pca9685Struct *chip)
+{
+  unsigned char buf [PCA9685_PINS * 4] ;
+  int first, last, i, n, res = 0 ;
+
+  pthread_mutex_lock (&chip->lock) ;
+
+  if (chip->dirty != 0)
+  {
+    first = __builtin_ctz (chip->dirty) ;
+    last  = 31 - __builtin_clz (chip->dirty) ;
+    chip->dirty = 0 ;
+
+    for (n = 0, i = first ; i <= last ; ++i)
+    {
+      buf [n++] = chip->on  [i] & 0xFF ;
+      buf [n++] = chip->on  [i] >> 8 ;
+      buf [n++] = chip->off [i] & 0xFF ;
+      buf [n++] = chip->off [i] >> 8 ;
+    }
+
+    if ((res = wiringPiI2CWriteBlock (chip->node->fd, PCA9685_LED0 + first * 4, buf, n)) < 0)
+      for (res = 0, i = 0 ; i < n ; ++i)
+	if (wiringPiI2CWriteReg8 (chip->node->fd, PCA9685_LED0 + first * 4 + i, buf [i]) < 0)
+	  res = -1 ;
+  }
+
+  pthread_mutex_unlock (&chip->lock) ;
+
+  return (res < 0) ? -1 : 0 ;
+}
+
+
+/*
+ * setChannel:
+ *	Update the copy of a channel, and send it unless it's being held
+ *	back for wiringPiCommit
+ *********************************************************************************
+ */
+
+static void setChannel (struct pca9685Struct *chip, int channel, int on, int off)
+{
+  pthread_mutex_lock (&chip->lock) ;
+    if ((chip->on [channel] != on) || (chip->off [channel] != off))
+    {
+      chip->on  [channel] = on ;
+      chip->off [channel] = off ;
+      chip->dirty |= 1u << channel ;
+    }
+  pthread_mutex_unlock (&chip->lock) ;
+
+  if (wiringPiNodeDeferred (chip->node))
+    wiringPiNodeChanged (chip->node) ;
+  else
+    (void)writeDirty (chip) ;
+}
+
+// A value of 0 to PCA9685_FULL: the ends are the full off and on bits
+
+static void setValue (struct pca9685Struct *chip, int channel, int value)
+{
+  /**/ if (value <= 0)
+    setChannel (chip, channel, 0, LED_FULL) ;
+  else if (value >= PCA9685_FULL)
+    setChannel (chip, channel, LED_FULL, 0) ;
+  else
+    setChannel (chip, channel, 0, value) ;
+}
+
+
+/*
+ * myPwmWrite:
+ * myDigitalWrite:
+ * myFlush:
+ *	pwmWrite (and analogWrite) take 0 to PCA9685_FULL, digitalWrite is
+ *	full on or off
+ *********************************************************************************
+ */
+
+static void myPwmWrite (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  setValue (&chips [node->data3], pin - node->pinBase, value) ;
+}
+
+static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  setValue (&chips [node->data3], pin - node->pinBase, (value == LOW) ? 0 : PCA9685_FULL) ;
+}
+
+static void myFlush (struct wiringPiNodeStruct *node)
+{
+  (void)writeDirty (&chips [node->data3]) ;
+}
+
+
+/*
+ * pca9685WriteFrame:
+ *	Set all 16 channels, 0 to PCA9685_FULL, and send the ones that
+ *	changed in one block
+ *********************************************************************************
+ */
+
+int pca9685WriteFrame (int pinBase, const int values [PCA9685_PINS])
+{
+  struct pca9685Struct *chip ;
+  int i ;
+
+  if ((chip = findChip (pinBase)) == NULL)
+    return -1 ;
+
+  wiringPiBegin () ;
+    for (i = 0 ; i < PCA9685_PINS ; ++i)
+      setValue (chip, i, values [i]) ;
+  wiringPiCommit () ;
+
+  return 0 ;
+}
+
+
+/*
+ * pca9685WriteRaw:
+ * pca9685ServoWrite:
+ *	A channel's on and off counts (0-4095, or with LED_FULL) as they
+ *	go in the registers - to stagger the channels' edges, say; and a
+ *	servo pulse in uS at the current frequency
+ *********************************************************************************
+ */
+
+int pca9685WriteRaw (int pin, int on, int off)
+{
+  struct pca9685Struct *chip ;
+
+  if ((chip = findChip (pin)) == NULL)
+    return -1 ;
+
+  setChannel (chip, pin - chip->node->pinBase, on & 0x1FFF, off & 0x1FFF) ;
+
+  return 0 ;
+}
+
+int pca9685ServoWrite (int pin, int microseconds)
+{
+  struct pca9685Struct *chip ;
+
+  if ((chip = findChip (pin)) == NULL)
+    return -1 ;
+
+  setValue (chip, pin - chip->node->pinBase, (int)((double)microseconds * chip->freq * 4096.0 / 1000000.0 + 0.5)) ;
+
+  return 0 ;
+}
+
+
+/*
+ * pca9685SetFrequency:
+ *	Set the PWM frequency - 50 for most servos - from 24 to 1526Hz. The
+ *	prescaler can only be changed with the oscillator asleep.
+ *********************************************************************************
+ */
+
+int pca9685SetFrequency (int pinBase, int freq)
+{
+  struct pca9685Struct *chip ;
+  int fd, mode1, prescale ;
+
+  if (((chip = findChip (pinBase)) == NULL) || (freq <= 0))
+    return -1 ;
+
+  prescale = (int)((double)OSC_HZ / (4096.0 * freq) + 0.5) - 1 ;
+  if (prescale <   3) prescale =   3 ;
+  if (prescale > 255) prescale = 255 ;
+
+  fd = chip->node->fd ;
+  if ((mode1 = wiringPiI2CReadReg8 (fd, PCA9685_MODE1)) < 0)
+    return -1 ;
+  mode1 &= ~MODE1_RESTART ;
+
+  wiringPiI2CWriteReg8 (fd, PCA9685_MODE1,    mode1 | MODE1_SLEEP) ;
+  wiringPiI2CWriteReg8 (fd, PCA9685_PRESCALE, prescale) ;
+  wiringPiI2CWriteReg8 (fd, PCA9685_MODE1,    mode1 & ~MODE1_SLEEP) ;
+  delayMicroseconds (500) ;			// For the oscillator
+  wiringPiI2CWriteReg8 (fd, PCA9685_MODE1,    (mode1 & ~MODE1_SLEEP) | MODE1_RESTART) ;
+
+  chip->freq = (double)OSC_HZ / (4096.0 * (prescale + 1)) ;
+
+  return 0 ;
+}
+
+
+/*
+ * pca9685Setup:
+ *	Create a new wiringPi device node for a pca9685 at i2cAddress, with
+ *	all the channels off, at freq Hz (or the chip's 200Hz if 0).
+ *********************************************************************************
+ */
+
+int pca9685Setup (int pinBase, int i2cAddress, int freq)
+{
+  struct pca9685Struct *chip ;
+  struct wiringPiNodeStruct *node ;
+  int fd, i ;
+
+  if (numChips == MAX_PCA9685)
+    return FALSE ;
+
+  if ((fd = wiringPiI2CSetup (i2cAddress)) < 0)
+    return FALSE ;
+
+  if (wiringPiI2CWriteReg8 (fd, PCA9685_MODE1, MODE1_AI | MODE1_ALLCALL) < 0)
+    return FALSE ;
+  wiringPiI2CWriteReg8 (fd, PCA9685_MODE2, MODE2_OUTDRV) ;
+
+  node = wiringPiNewNode (pinBase, PCA9685_PINS) ;
+
+  node->fd           = fd ;
+  node->data3        = numChips ;
+  node->pwmWrite     = myPwmWrite ;
+  node->analogWrite  = myPwmWrite ;
+  node->digitalWrite = myDigitalWrite ;
+  node->flush        = myFlush ;
+
+  chip = &chips [numChips++] ;
+  memset (chip, 0, sizeof (*chip)) ;
+  pthread_mutex_init (&chip->lock, NULL) ;
+  chip->node = node ;
+  chip->freq = 200.0 ;
+
+  for (i = 0 ; i < PCA9685_PINS ; ++i)
+    chip->off [i] = LED_FULL ;
+  chip->dirty = (1u << PCA9685_PINS) - 1 ;
+  (void)writeDirty (chip) ;
+
+  if (freq > 0)
+    pca9685SetFrequency (pinBase, freq) ;
+
+  return TRUE ;
+}
@@ -0,0 +1,40 @@
+/*
+ * pca9685.h:
+ *	NXP PCA9685 16-channel, 12-bit PWM LED/servo driver
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#define	PCA9685_PINS		16
+#define	PCA9685_FULL		4096		// pwmWrite value for always on
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int pca9685Setup        (int pinBase, int i2cAddress, int freq) ;
+extern int pca9685SetFrequency (int pinBase, int freq) ;
+extern int pca9685WriteFrame   (int pinBase, const int values [PCA9685_PINS]) ;
+extern int pca9685WriteRaw     (int pin, int on, int off) ;
+extern int pca9685ServoWrite   (int pin, int microseconds) ;
+
+#ifdef __cplusplus
+}
+#endif
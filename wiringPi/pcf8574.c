@@ -47,9 +47,15 @@ static void myPinMode (struct wiringPiNodeStruct *node, int pin, int mode)
 
   old = node->data2 ;
   if (mode == OUTPUT)
+  {
     old &= (~bit) ;	// Write bit to 0
+    node->data3 |=   bit ;	// Outputs, for wiringPiNodeCacheOutputs
+  }
   else
+  {
     old |=   bit ;	// Write bit to 1
+    node->data3 &= (~bit) ;
+  }
 
   wiringPiI2CWrite (node->fd, old) ;
   node->data2 = old ;
@@ -79,8 +85,42 @@ static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
 }
 
 
+/*
+ * myDigitalWriteSequence:
+ *	The PCF8574 latches each byte of a write as it's acked, so a whole
+ *	sequence goes out in one transaction.
+ *********************************************************************************
+ */
+
+static void myDigitalWriteSequence (struct wiringPiNodeStruct *node, int pin, unsigned int mask, const unsigned int *values, int count)
+{
+  unsigned char buf [WPI_I2C_MAX_BLOCK] ;
+  unsigned int bits, old ;
+  int shift, i, n ;
+
+  shift = (pin - node->pinBase) & 7 ;
+  bits  = (mask << shift) & 0xFF ;
+  old   = node->data2 ;
+
+  for ( ; count > 0 ; values += n, count -= n)
+  {
+    n = (count > WPI_I2C_MAX_BLOCK) ? WPI_I2C_MAX_BLOCK : count ;
+    for (i = 0 ; i < n ; ++i)
+    {
+      old     = (old & ~bits) | ((values [i] << shift) & bits) ;
+      buf [i] = old ;
+    }
+    wiringPiI2CWriteBytes (node->fd, buf, n) ;
+  }
+
+  node->data2 = old ;
+}
+
+
 /*
  * myDigitalRead:
+ *	Pins set to OUTPUT with pinMode can be answered from what we last
+ *	wrote, if wiringPiNodeCacheOutputs is on for the node.
  *********************************************************************************
  */
 
@@ -89,7 +129,11 @@ static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
   int mask, value ;
 
   mask  = 1 << ((pin - node->pinBase) & 7) ;
-  value = wiringPiI2CRead (node->fd) ;
+
+  if (((node->flags & WPI_NODE_CACHE_OUTPUTS) != 0) && ((node->data3 & mask) != 0))
+    value = node->data2 ;
+  else
+    value = wiringPiI2CRead (node->fd) ;
 
   if ((value & mask) == 0)
     return LOW ;
@@ -120,7 +164,9 @@ int pcf8574Setup (const int pinBase, const int i2cAddress)
   node->pinMode      = myPinMode ;
   node->digitalRead  = myDigitalRead ;
   node->digitalWrite = myDigitalWrite ;
+  node->digitalWriteSequence = myDigitalWriteSequence ;
   node->data2        = wiringPiI2CRead (fd) ;
+  node->data3        = 0 ;		// No outputs yet
 
   return TRUE ;
 }
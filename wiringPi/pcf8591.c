@@ -24,12 +24,30 @@
  */
 
 #include <unistd.h>
+#include <pthread.h>
 
 #include "wiringPi.h"
 #include "wiringPiI2C.h"
 
 #include "pcf8591.h"
 
+// Cached scans: all 4 inputs from one scan, which serves reads until
+//	it's maxAgeUs old
+
+#define	MAX_PCF8591	8
+
+struct pcf8591Struct
+{
+  struct wiringPiNodeStruct *node ;
+  unsigned int       maxAgeUs ;
+  int                values [4] ;
+  unsigned long long stamp ;	// micros64 () of the scan
+  int                valid ;
+} ;
+
+static struct pcf8591Struct pcf8591s [MAX_PCF8591] ;
+static pthread_mutex_t      pcf8591Lock = PTHREAD_MUTEX_INITIALIZER ;
+
 
 /*
  * myAnalogWrite:
@@ -41,7 +59,7 @@ static void myAnalogWrite (struct wiringPiNodeStruct *node, UNU int pin, int val
   unsigned char b [2] ;
   b [0] = 0x40 ;
   b [1] = value & 0xFF ;
-  write (node->fd, b, 2) ;
+  wiringPiI2CWriteBytes (node->fd, b, 2) ;
 }
 
 
@@ -63,6 +81,151 @@ static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
 }
 
 
+/*
+ * scan:
+ *	One control write with auto-increment set, then one 5 byte read: the
+ *	first byte is the conversion from before the write, then come the 4
+ *	channels in order - all in a single combined transaction.
+ *********************************************************************************
+ */
+
+static int scan (int fd, int *values)
+{
+  unsigned char control = 0x44 ;	// Output enable (as analogWrite leaves it), auto-increment, channel 0
+  unsigned char data [5] ;
+  struct wpiI2cMsg msgs [2] ;
+  int chan ;
+
+  msgs [0].buf = &control ; msgs [0].len = 1 ; msgs [0].read = FALSE ; msgs [0].dev = 0 ;
+  msgs [1].buf = data ;     msgs [1].len = 5 ; msgs [1].read = TRUE ;  msgs [1].dev = 0 ;
+
+  if (wiringPiI2CTransfer (fd, msgs, 2) < 0)
+    return -1 ;
+
+  for (chan = 0 ; chan < 4 ; ++chan)
+    values [chan] = data [chan + 1] ;
+
+  return 4 ;
+}
+
+
+/*
+ * myCachedRead:
+ *	An input from the latest scan, scanning again if it's too old
+ *********************************************************************************
+ */
+
+static int myCachedRead (struct wiringPiNodeStruct *node, int pin)
+{
+  struct pcf8591Struct *p = &pcf8591s [node->data0] ;
+  int value ;
+
+  pthread_mutex_lock (&pcf8591Lock) ;
+
+  if (!p->valid || ((micros64 () - p->stamp) >= p->maxAgeUs))
+  {
+    if (scan (node->fd, p->values) == 4)
+    {
+      p->stamp = micros64 () ;
+      p->valid = TRUE ;
+    }
+  }
+  value = p->values [(pin - node->pinBase) & 3] ;
+
+  pthread_mutex_unlock (&pcf8591Lock) ;
+
+  return value ;
+}
+
+
+/*
+ * scanNode:
+ *	Scan all 4 inputs of one of our nodes, refreshing the cache if it
+ *	has one
+ *********************************************************************************
+ */
+
+static int scanNode (struct wiringPiNodeStruct *node, int *values)
+{
+  struct pcf8591Struct *p ;
+  int chan ;
+
+  if (node->analogRead == myAnalogRead)
+    return scan (node->fd, values) ;
+
+  p = &pcf8591s [node->data0] ;
+
+  pthread_mutex_lock (&pcf8591Lock) ;
+
+  if (scan (node->fd, p->values) != 4)
+  {
+    pthread_mutex_unlock (&pcf8591Lock) ;
+    return -1 ;
+  }
+
+  p->stamp = micros64 () ;
+  p->valid = TRUE ;
+  for (chan = 0 ; chan < 4 ; ++chan)
+    values [chan] = p->values [chan] ;
+
+  pthread_mutex_unlock (&pcf8591Lock) ;
+
+  return 4 ;
+}
+
+
+/*
+ * myAnalogReadRange:
+ *	More than one input comes from a scan - which the cached reads do
+ *	already, with at most one scan between them.
+ *********************************************************************************
+ */
+
+static int myAnalogReadRange (struct wiringPiNodeStruct *node, int pin, int count, int *values)
+{
+  int all [4] ;
+  int first = pin - node->pinBase ;
+  int i ;
+
+  if ((count == 1) || (node->analogRead == myCachedRead))
+  {
+    for (i = 0 ; i < count ; ++i)
+      values [i] = node->analogRead (node, pin + i) ;
+    return count ;
+  }
+
+  if (scanNode (node, all) != 4)
+    return -1 ;
+
+  for (i = 0 ; i < count ; ++i)
+    values [i] = all [first + i] ;
+
+  return count ;
+}
+
+
+/*
+ * pcf8591ReadAll:
+ *	Read all 4 inputs in one go - a write and a read rather than the
+ *	twelve transactions of four analogRead ()s. values must have room
+ *	for 4. Returns 4, or -1 on error.
+ *********************************************************************************
+ */
+
+int pcf8591ReadAll (int pinBase, int *values)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if ((node = wiringPiFindNode (pinBase)) == NULL)
+    return -1 ;
+
+  if ((node->analogRead != myAnalogRead) && (node->analogRead != myCachedRead))	// Not one of ours
+    return -1 ;
+
+  return scanNode (node, values) ;
+}
+
+
 /*
  * pcf8591Setup:
  *	Create a new instance of a PCF8591 I2C GPIO interface. We know it
@@ -82,9 +245,56 @@ int pcf8591Setup (const int pinBase, const int i2cAddress)
 
   node = wiringPiNewNode (pinBase, 4) ;
 
+  node->fd              = fd ;
+  node->analogRead      = myAnalogRead ;
+  node->analogWrite     = myAnalogWrite ;
+  node->analogReadRange = myAnalogReadRange ;
+
+  return TRUE ;
+}
+
+
+/*
+ * pcf8591SetupCached:
+ *	As above, but analogRead () comes from a scan of all 4 inputs, which
+ *	serves reads for maxAgeMs before the next - so polling all 4 costs
+ *	one scan. A maxAgeMs of 0 scans for every read.
+ *********************************************************************************
+ */
+
+int pcf8591SetupCached (const int pinBase, const int i2cAddress, const int maxAgeMs)
+{
+  int fd, i ;
+  struct wiringPiNodeStruct *node ;
+
+  if (maxAgeMs < 0)
+    return FALSE ;
+
+  pthread_mutex_lock (&pcf8591Lock) ;
+
+  for (i = 0 ; i < MAX_PCF8591 ; ++i)
+    if (pcf8591s [i].node == NULL)
+      break ;
+
+  if ((i == MAX_PCF8591) || ((fd = wiringPiI2CSetup (i2cAddress)) < 0))
+  {
+    pthread_mutex_unlock (&pcf8591Lock) ;
+    return FALSE ;
+  }
+
+  node = wiringPiNewNode (pinBase, 4) ;
+
   node->fd          = fd ;
-  node->analogRead  = myAnalogRead ;
-  node->analogWrite = myAnalogWrite ;
+  node->data0       = i ;
+  node->analogRead      = myCachedRead ;
+  node->analogWrite     = myAnalogWrite ;
+  node->analogReadRange = myAnalogReadRange ;
+
+  pcf8591s [i].node     = node ;
+  pcf8591s [i].maxAgeUs = (unsigned int)maxAgeMs * 1000 ;
+  pcf8591s [i].valid    = FALSE ;
+
+  pthread_mutex_unlock (&pcf8591Lock) ;
 
   return TRUE ;
 }
@@ -26,7 +26,9 @@
 extern "C" {
 #endif
 
-extern int pcf8591Setup (const int pinBase, const int i2cAddress) ;
+extern int pcf8591Setup       (const int pinBase, const int i2cAddress) ;
+extern int pcf8591SetupCached (const int pinBase, const int i2cAddress, const int maxAgeMs) ;
+extern int pcf8591ReadAll     (int pinBase, int *values) ;
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,473 @@
+/*
+ * pcmShift.c:
+ *	Clock bit streams out of the PCM peripheral
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+
+/*
+ * Notes:
+ *	The PCM block is set up as a frame of frameBits (8 to 64) clocks,
+ *	back to back, with the data MSB first on PCM_DOUT (GPIO 21), the
+ *	clock from the clock manager on PCM_CLK (GPIO 18) and a one clock
+ *	pulse on PCM_FS (GPIO 19) at the start of each frame. The outputs
+ *	change on the falling edge of the clock, so whatever's on the end
+ *	samples them on the rising edge, and FS rises once the last bit of
+ *	the frame before has been clocked in.
+ *
+ *	Frames are queued with pcmShiftWrite () and a thread keeps the 64
+ *	word FIFO topped up from the queue. When the queue runs dry it sends
+ *	the last frame again, so the outputs stay as they were: wire FS to
+ *	the latch of a chain of 74x595's that long and it's re-latched with
+ *	the same bits every frame until there's a new one, and DACs just hold
+ *	their last value. A DMA chain can't do that on its own, so it's the
+ *	thread. It sleeps for a quarter of the FIFO at a time; if the FIFO
+ *	ever runs out (pcmShiftErrors) the frame it was on is started again.
+ *
+ *	It takes over the PCM block and its clock: no audio, and not with
+ *	waveSetup (..., WAVE_PACE_PCM). Needs /dev/mem, and isn't there on
+ *	the Pi 5.
+ *********************************************************************************
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "wiringPi.h"
+#include "wiringPiConfig.h"
+#include "pcmShift.h"
+
+#define	BCM_PASSWORD		0x5A000000
+
+#define	CLOCK_OFFSET		0x101000
+#define	PCM_OFFSET		0x203000
+
+#define	PCMCLK_CNTL		38
+#define	PCMCLK_DIV		39
+
+#define	CLK_SRC_PLLD		6
+#define	CLK_ENAB		0x10
+#define	CLK_BUSY		0x80
+#define	CLK_MASH1		(1 << 9)
+
+// PCM
+
+#define	PCM_CS			0
+#define	PCM_FIFO		1
+#define	PCM_MODE		2
+#define	PCM_TXC			4
+
+#define	PCM_CS_EN		(1 << 0)
+#define	PCM_CS_TXON		(1 << 2)
+#define	PCM_CS_TXCLR		(1 << 3)
+#define	PCM_CS_TXERR		(1 << 15)
+#define	PCM_CS_TXD		(1 << 19)
+#define	PCM_CS_STBY		(1 << 25)
+
+#define	PCM_MODE_CLKI		(1 << 22)
+
+#define	PCM_FIFO_WORDS		64
+
+#define	FSEL_ALT0		4
+
+// CLK, FS, DOUT
+
+static const int pcmPins [3] = { 18, 19, 21 } ;
+
+static volatile unsigned int *clk = NULL ;
+static volatile unsigned int *pcm = NULL ;
+
+static int      frameBits, wordsPerFrame, w2 ;
+static int      pcmPri ;
+static long     sleepNs ;
+static unsigned int resyncUs ;
+static uint32_t queue [PCM_SHIFT_QUEUE] ;
+static uint32_t queueHead, queueTail ;
+static unsigned int errors ;
+
+static pthread_t        pcmThreadId ;
+static volatile int     running = FALSE ;
+static pthread_mutex_t  pcmLock = PTHREAD_MUTEX_INITIALIZER ;
+
+
+/*
+ * pcmFsel:
+ *	Set the function of one BCM_GPIO pin
+ *********************************************************************************
+ */
+
+static void pcmFsel (int pin, int fsel)
+{
+  volatile unsigned int *reg = _wiringPiGpio + (pin / 10) ;
+  int shift = (pin % 10) * 3 ;
+
+  wpiConfigLock (WPI_CONFIG_FSEL (pin / 10)) ;
+    *reg = (*reg & ~(7 << shift)) | (fsel << shift) ;
+  wpiConfigUnlock (WPI_CONFIG_FSEL (pin / 10)) ;
+}
+
+
+/*
+ * setClock:
+ *	Stop the PCM clock and start it again from PLLD at hz - with a
+ *	fractional divisor (and MASH) if need be
+ *********************************************************************************
+ */
+
+static void setClock (unsigned int hz)
+{
+  unsigned int plld, divi, divf ;
+
+  plld = (wiringPiPeriBase () == 0xFE000000) ? 750000000 : 500000000 ;	// Pi 4 runs PLLD faster
+  divi = plld / hz ;
+  divf = (unsigned int)(((unsigned long long)(plld % hz) * 4096) / hz) ;
+
+  *(clk + PCMCLK_CNTL) = BCM_PASSWORD | CLK_SRC_PLLD ;
+  delayMicroseconds (110) ;
+  while ((*(clk + PCMCLK_CNTL) & CLK_BUSY) != 0)
+    delayMicroseconds (1) ;
+
+  *(clk + PCMCLK_CNTL) = BCM_PASSWORD | ((divf != 0) ? CLK_MASH1 : 0) | CLK_SRC_PLLD ;
+  *(clk + PCMCLK_DIV)  = BCM_PASSWORD | (divi << 12) | divf ;
+  *(clk + PCMCLK_CNTL) = BCM_PASSWORD | ((divf != 0) ? CLK_MASH1 : 0) | CLK_ENAB | CLK_SRC_PLLD ;
+}
+
+
+/*
+ * channel:
+ *	A TXC channel field: width bits from clock pos of the frame
+ *********************************************************************************
+ */
+
+static uint32_t channel (int width, int pos)
+{
+  uint32_t wex = (width > 24) ? 1 : 0 ;
+
+  return (wex << 15) | (1 << 14) | ((uint32_t)pos << 4) | (uint32_t)(width - 8 - 16 * wex) ;
+}
+
+
+/*
+ * pcmThread:
+ *	Keep the FIFO full, a whole frame at a time from the queue
+ *********************************************************************************
+ */
+
+static void *pcmThread (void *arg)
+{
+  struct timespec sleeper ;
+  uint32_t frame [2] = { 0, 0 } ;
+  uint32_t tail = queueTail ;
+  int phase = 0 ;
+
+  (void)arg ;
+
+  if (pcmPri > 0)
+    (void)piHiPri (pcmPri) ;
+
+  sleeper.tv_sec  = 0 ;
+  sleeper.tv_nsec = sleepNs ;
+
+  while (running)
+  {
+    while ((*(pcm + PCM_CS) & PCM_CS_TXD) != 0)
+    {
+      if ((phase == 0) && (tail != __atomic_load_n (&queueHead, __ATOMIC_ACQUIRE)))
+      {
+	frame [0] = queue [tail & (PCM_SHIFT_QUEUE - 1)] ;
+	if (wordsPerFrame == 2)
+	  frame [1] = queue [(tail + 1) & (PCM_SHIFT_QUEUE - 1)] ;
+	tail += wordsPerFrame ;
+	__atomic_store_n (&queueTail, tail, __ATOMIC_RELEASE) ;
+      }
+
+      *(pcm + PCM_FIFO) = frame [phase] ;
+      phase = (phase + 1) % wordsPerFrame ;
+    }
+
+// Ran out: the words may now be in the wrong channels, so empty it and
+//	start this frame again
+
+    if ((*(pcm + PCM_CS) & PCM_CS_TXERR) != 0)
+    {
+      __atomic_add_fetch (&errors, 1, __ATOMIC_RELAXED) ;
+
+      *(pcm + PCM_CS) &= ~PCM_CS_TXON ;
+      *(pcm + PCM_CS) |=  PCM_CS_TXCLR ;
+      delayMicroseconds (resyncUs) ;
+      *(pcm + PCM_CS) |=  PCM_CS_TXERR ;
+
+      for (phase = 0 ; phase < wordsPerFrame ; ++phase)
+	*(pcm + PCM_FIFO) = frame [phase] ;
+      phase = 0 ;
+
+      *(pcm + PCM_CS) |=  PCM_CS_TXON ;
+    }
+
+    nanosleep (&sleeper, NULL) ;
+  }
+
+  return NULL ;
+}
+
+
+/*
+ * pcmShiftSetup:
+ *	Start clocking frames of frameBits out at clockHz, all 0 until
+ *	something's written. pri, if not 0, is the real-time priority of the
+ *	refill thread.
+ *	Returns 0 or -1 with errno set.
+ *********************************************************************************
+ */
+
+int pcmShiftSetup (int clockHz, int bits, int pri)
+{
+  long long fifoNs ;
+  uint32_t  txc ;
+  int i, w1 ;
+
+  if ((clockHz < 100000) || (clockHz > PCM_SHIFT_MAX_HZ) || (bits < PCM_SHIFT_MIN_BITS) || (bits > PCM_SHIFT_MAX_BITS))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  pthread_mutex_lock (&pcmLock) ;
+
+  if (running)
+  {
+    pthread_mutex_unlock (&pcmLock) ;
+    errno = EBUSY ;
+    return -1 ;
+  }
+
+  if ((wiringPiPeriBase () == 0) || (_wiringPiGpio == NULL))	// No /dev/mem, or a Pi 5
+  {
+    pthread_mutex_unlock (&pcmLock) ;
+    errno = ENODEV ;
+    return -1 ;
+  }
+
+  if (((clk == NULL) && ((clk = wiringPiPeriMap (CLOCK_OFFSET, 4096)) == NULL)) ||
+      ((pcm == NULL) && ((pcm = wiringPiPeriMap (PCM_OFFSET,   4096)) == NULL)))
+  {
+    pthread_mutex_unlock (&pcmLock) ;
+    errno = EACCES ;
+    return -1 ;
+  }
+
+// Up to 32 bits is one channel, more is two - each of 8 to 32 bits
+
+  /**/ if (bits <= 32)
+  {
+    w1 = bits ;
+    w2 = 0 ;
+  }
+  else if (bits >= 40)
+  {
+    w1 = 32 ;
+    w2 = bits - 32 ;
+  }
+  else
+  {
+    w1 = bits - 8 ;
+    w2 = 8 ;
+  }
+
+  frameBits     = bits ;
+  wordsPerFrame = (w2 == 0) ? 1 : 2 ;
+  pcmPri        = pri ;
+  errors        = 0 ;
+  queueHead     = queueTail = 0 ;
+
+  fifoNs   = (long long)PCM_FIFO_WORDS / wordsPerFrame * bits * 1000000000LL / clockHz ;
+  sleepNs  = (fifoNs / 4 > 10000) ? (long)(fifoNs / 4) : 10000 ;
+  resyncUs = 10 + 4000000 / clockHz ;		// A few PCM clocks for TXCLR
+
+  *(pcm + PCM_CS) = 0 ;
+  delayMicroseconds (10) ;
+
+  setClock (clockHz) ;
+
+  txc = channel (w1, 0) << 16 ;
+  if (w2 != 0)
+    txc |= channel (w2, w1) ;
+
+  *(pcm + PCM_CS)   = PCM_CS_EN | PCM_CS_STBY ;
+  *(pcm + PCM_MODE) = PCM_MODE_CLKI | ((uint32_t)(bits - 1) << 10) | 1 ;	// Frame length, FS 1 clock
+  *(pcm + PCM_TXC)  = txc ;
+  *(pcm + PCM_CS)  |= PCM_CS_TXCLR ;
+  delayMicroseconds (resyncUs) ;
+  *(pcm + PCM_CS)  |= PCM_CS_TXERR ;
+
+  for (i = 0 ; i < PCM_FIFO_WORDS / 2 ; ++i)
+    *(pcm + PCM_FIFO) = 0 ;
+
+  for (i = 0 ; i < 3 ; ++i)
+    pcmFsel (pcmPins [i], FSEL_ALT0) ;
+
+  running = TRUE ;
+  if (pthread_create (&pcmThreadId, NULL, pcmThread, NULL) != 0)
+  {
+    running = FALSE ;
+    *(pcm + PCM_CS) = 0 ;
+    for (i = 0 ; i < 3 ; ++i)
+      pcmFsel (pcmPins [i], 0) ;
+    pthread_mutex_unlock (&pcmLock) ;
+    errno = EAGAIN ;
+    return -1 ;
+  }
+
+  *(pcm + PCM_CS) |= PCM_CS_TXON ;
+
+  pthread_mutex_unlock (&pcmLock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * pcmShiftWrite:
+ *	Queue numFrames frames, each (frameBits + 7) / 8 bytes: a frameBits
+ *	number, most significant byte first, so any padding bits are the top
+ *	of the first byte. Waits for room in the queue if need be.
+ *	Returns numFrames, or -1 with errno set.
+ *********************************************************************************
+ */
+
+int pcmShiftWrite (const uint8_t *frames, int numFrames)
+{
+  struct timespec sleeper ;
+  uint64_t v, mask ;
+  int i, j, frameBytes ;
+
+  pthread_mutex_lock (&pcmLock) ;
+
+  if (!running)
+  {
+    pthread_mutex_unlock (&pcmLock) ;
+    errno = ENODEV ;
+    return -1 ;
+  }
+
+  sleeper.tv_sec  = 0 ;
+  sleeper.tv_nsec = sleepNs ;
+  frameBytes      = (frameBits + 7) / 8 ;
+  mask            = (frameBits == 64) ? ~0ULL : ((1ULL << frameBits) - 1) ;
+
+  for (i = 0 ; i < numFrames ; ++i)
+  {
+    while ((queueHead + wordsPerFrame - __atomic_load_n (&queueTail, __ATOMIC_ACQUIRE)) > PCM_SHIFT_QUEUE)
+      nanosleep (&sleeper, NULL) ;
+
+    for (v = 0, j = 0 ; j < frameBytes ; ++j)
+      v = (v << 8) | *frames++ ;
+    v &= mask ;
+
+    if (wordsPerFrame == 1)
+      queue [queueHead & (PCM_SHIFT_QUEUE - 1)] = (uint32_t)v ;
+    else
+    {
+      queue [ queueHead      & (PCM_SHIFT_QUEUE - 1)] = (uint32_t)(v >> w2) ;
+      queue [(queueHead + 1) & (PCM_SHIFT_QUEUE - 1)] = (uint32_t)(v & ((1ULL << w2) - 1)) ;
+    }
+
+    __atomic_store_n (&queueHead, queueHead + wordsPerFrame, __ATOMIC_RELEASE) ;
+  }
+
+  pthread_mutex_unlock (&pcmLock) ;
+
+  return numFrames ;
+}
+
+
+/*
+ * pcmShiftSync:
+ *	Wait for up to timeoutMs for everything queued to be in the FIFO -
+ *	it's all out on the wire at most 64 words after that.
+ *	Returns 0 or -1 with errno set.
+ *********************************************************************************
+ */
+
+int pcmShiftSync (int timeoutMs)
+{
+  unsigned long long giveUp = nanos64 () + (unsigned long long)timeoutMs * 1000000ULL ;
+
+  while (running && (__atomic_load_n (&queueTail, __ATOMIC_ACQUIRE) != __atomic_load_n (&queueHead, __ATOMIC_ACQUIRE)))
+  {
+    if (nanos64 () > giveUp)
+    {
+      errno = ETIMEDOUT ;
+      return -1 ;
+    }
+    delayMicroseconds (100) ;
+  }
+
+  if (!running)
+  {
+    errno = ENODEV ;
+    return -1 ;
+  }
+
+  return 0 ;
+}
+
+
+/*
+ * pcmShiftStop:
+ *	Stop, and put the pins back to inputs
+ *********************************************************************************
+ */
+
+void pcmShiftStop (void)
+{
+  int i ;
+
+  pthread_mutex_lock (&pcmLock) ;
+
+  if (running)
+  {
+    running = FALSE ;
+    pthread_join (pcmThreadId, NULL) ;
+
+    *(pcm + PCM_CS)      = 0 ;
+    *(clk + PCMCLK_CNTL) = BCM_PASSWORD | CLK_SRC_PLLD ;
+    for (i = 0 ; i < 3 ; ++i)
+      pcmFsel (pcmPins [i], 0) ;
+  }
+
+  pthread_mutex_unlock (&pcmLock) ;
+}
+
+
+/*
+ * pcmShiftErrors:
+ *	How many times the FIFO's run out
+ *********************************************************************************
+ */
+
+unsigned int pcmShiftErrors (void)
+{
+  return __atomic_load_n (&errors, __ATOMIC_RELAXED) ;
+}
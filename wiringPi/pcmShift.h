@@ -0,0 +1,44 @@
+/*
+ * pcmShift.h:
+ *	Clock bit streams out of the PCM peripheral
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <stdint.h>
+
+#define	PCM_SHIFT_MIN_BITS	8
+#define	PCM_SHIFT_MAX_BITS	64
+#define	PCM_SHIFT_MAX_HZ	25000000
+#define	PCM_SHIFT_QUEUE		4096		// FIFO words queued, a power of 2
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int          pcmShiftSetup  (int clockHz, int frameBits, int pri) ;
+extern int          pcmShiftWrite  (const uint8_t *frames, int numFrames) ;
+extern int          pcmShiftSync   (int timeoutMs) ;
+extern void         pcmShiftStop   (void) ;
+extern unsigned int pcmShiftErrors (void) ;
+
+#ifdef __cplusplus
+}
+#endif
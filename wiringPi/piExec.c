@@ -0,0 +1,547 @@
+/*
+ * piExec.c:
+ *	A single-thread executive for all the timed engines
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+/*
+ * Notes:
+ *	On a single core Pi (Zero, 1) every engine having a real-time thread
+ *	of its own - the softPwm engine, softTone, each piPeriodic period,
+ *	the ISR handlers - means they spend their time pre-empting each
+ *	other, and each one's timing is at the mercy of the rest. With
+ *	piExecStart () they all become tasks on one thread instead:
+ *
+ *	Timer tasks each have a deadline (nanos64 () time) and are run in
+ *	deadline order when it comes round; each returns its next deadline,
+ *	PI_EXEC_IDLE to wait for piExecWake (), or 0 if it's finished.
+ *	Watch tasks are file descriptors in an epoll set, called when the fd
+ *	is ready.
+ *
+ *	The thread waits in epoll_wait on the watches, a timerfd set for the
+ *	earliest deadline and an eventfd for piExecWake () from elsewhere.
+ *	The timerfd is set early by SPIN_NS; the last bit is done with
+ *	delayUntilNanos (), clock_nanosleep and a short spin, same as the
+ *	engines' own threads do.
+ *
+ *	Tasks run without the lock held, so they can create, wake or cancel
+ *	tasks themselves. piExecWake () on the task that's running applies
+ *	to its next deadline. A task must never block: everything on the
+ *	thread waits for it.
+ *
+ *	Engines decide for themselves when to use it: start the executive
+ *	before setting them up.
+ *********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "wiringPi.h"
+
+#define	MAX_EXEC_TASKS	64
+#define	SPIN_NS		100000ULL	// Wake this early and finish with delayUntilNanos ()
+
+#define	EXEC_FREE	0
+#define	EXEC_TIMER	1
+#define	EXEC_WATCH	2
+
+#define	WAKE_ID		(MAX_EXEC_TASKS + 0)	// epoll ids of our own fds
+#define	TIMER_ID	(MAX_EXEC_TASKS + 1)
+
+struct execTaskStruct
+{
+  int                type ;
+  int                running ;		// Its function is being called...
+  unsigned long long pending ;		// ... and a piExecWake () came in meanwhile
+  unsigned long long deadline ;
+  unsigned long long (*timerFn)(void *ctx, unsigned long long deadline) ;
+  void              (*watchFn)(void *ctx, unsigned int events) ;
+  void              *ctx ;
+  int                fd ;
+  unsigned int       lateMax ;
+  unsigned long long lateSum ;
+  unsigned int       lateCount ;
+} ;
+
+static struct execTaskStruct execTasks [MAX_EXEC_TASKS] ;
+static pthread_mutex_t       execLock = PTHREAD_MUTEX_INITIALIZER ;
+static volatile int          execRunning = FALSE ;
+static int                   epollFd  = -1 ;
+static int                   wakeFd   = -1 ;
+static int                   timerFd  = -1 ;
+
+
+/*
+ * execKick:
+ *	Get the thread to look at the deadlines again
+ *********************************************************************************
+ */
+
+static void execKick (void)
+{
+  uint64_t one = 1 ;
+
+  if (wakeFd != -1)
+    (void)write (wakeFd, &one, sizeof (one)) ;
+}
+
+
+/*
+ * earliest:
+ *	The next deadline there is, PI_EXEC_IDLE for none. Lock held.
+ *********************************************************************************
+ */
+
+static unsigned long long earliest (void)
+{
+  unsigned long long first = PI_EXEC_IDLE ;
+  int i ;
+
+  for (i = 0 ; i < MAX_EXEC_TASKS ; ++i)
+    if ((execTasks [i].type == EXEC_TIMER) && !execTasks [i].running && (execTasks [i].deadline < first))
+      first = execTasks [i].deadline ;
+
+  return first ;
+}
+
+
+/*
+ * runDue:
+ *	Run every timer task that's due now, earliest first, once each - one
+ *	that's still due after it's run waits for the next time round, so it
+ *	can't keep the watches waiting.
+ *********************************************************************************
+ */
+
+static void runDue (void)
+{
+  struct execTaskStruct *t ;
+  unsigned long long now, when, deadline, next ;
+  unsigned long long (*fn)(void *ctx, unsigned long long deadline) ;
+  void *ctx ;
+  unsigned int late ;
+  int i, due, ran [MAX_EXEC_TASKS] ;
+
+  memset (ran, 0, sizeof (ran)) ;
+  now = nanos64 () ;				// What's due by now is this pass
+
+  for (;;)
+  {
+    pthread_mutex_lock (&execLock) ;
+
+    for (due = -1, i = 0 ; i < MAX_EXEC_TASKS ; ++i)
+      if ((execTasks [i].type == EXEC_TIMER) && !ran [i] && (execTasks [i].deadline <= now) &&
+	  ((due < 0) || (execTasks [i].deadline < execTasks [due].deadline)))
+	due = i ;
+
+    if (due < 0)
+    {
+      pthread_mutex_unlock (&execLock) ;
+      return ;
+    }
+
+    ran [due]   = TRUE ;
+    t           = &execTasks [due] ;
+    t->running  = TRUE ;
+    t->pending  = PI_EXEC_IDLE ;
+    deadline    = t->deadline ;
+    fn          = t->timerFn ;
+    ctx         = t->ctx ;
+
+    when = nanos64 () ;
+    late = (when - deadline > 0xFFFFFFFFULL) ? 0xFFFFFFFF : (unsigned int)(when - deadline) ;	// Over 4S late is late enough
+    if (late > t->lateMax)
+      t->lateMax = late ;
+    t->lateSum   += late ;
+    t->lateCount += 1 ;
+
+    pthread_mutex_unlock (&execLock) ;
+
+    next = fn (ctx, deadline) ;
+
+    pthread_mutex_lock (&execLock) ;
+      if (t->type == EXEC_TIMER)		// Not cancelled while it ran
+      {
+	/**/ if (next == 0)
+	  t->type = EXEC_FREE ;
+	else
+	  t->deadline = (t->pending < next) ? t->pending : next ;
+      }
+      t->running = FALSE ;
+    pthread_mutex_unlock (&execLock) ;
+  }
+}
+
+
+/*
+ * execThread:
+ *	The executive
+ *********************************************************************************
+ */
+
+static void *execThread (UNU void *arg)
+{
+  struct epoll_event events [16] ;
+  struct itimerspec  its ;
+  struct timespec    ts ;
+  unsigned long long first, now, mono ;
+  uint64_t           count ;
+  void (*fn)(void *ctx, unsigned int events) ;
+  void *ctx ;
+  int n, i, id ;
+
+  for (;;)
+  {
+    pthread_mutex_lock (&execLock) ;
+      first = earliest () ;
+    pthread_mutex_unlock (&execLock) ;
+
+    now = nanos64 () ;
+
+// Nearly there: don't go back to sleep, just finish the wait and run it,
+//	picking up any watches that are ready as we go.
+
+    if ((first != PI_EXEC_IDLE) && (first <= now + SPIN_NS))
+    {
+      delayUntilNanos (first) ;
+      runDue () ;
+      n = epoll_wait (epollFd, events, 16, 0) ;
+    }
+    else
+    {
+      memset (&its, 0, sizeof (its)) ;
+      if (first != PI_EXEC_IDLE)
+      {
+	clock_gettime (CLOCK_MONOTONIC, &ts) ;
+	mono = (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec + (first - now) - SPIN_NS ;
+	its.it_value.tv_sec  = mono / 1000000000ULL ;
+	its.it_value.tv_nsec = mono % 1000000000ULL ;
+      }
+      (void)timerfd_settime (timerFd, TFD_TIMER_ABSTIME, &its, NULL) ;
+
+      n = epoll_wait (epollFd, events, 16, -1) ;
+    }
+
+    for (i = 0 ; i < n ; ++i)
+    {
+      id = events [i].data.u32 ;
+
+      /**/ if (id == WAKE_ID)
+	(void)read (wakeFd, &count, sizeof (count)) ;
+      else if (id == TIMER_ID)
+	(void)read (timerFd, &count, sizeof (count)) ;
+      else
+      {
+	pthread_mutex_lock (&execLock) ;
+	  fn  = (execTasks [id].type == EXEC_WATCH) ? execTasks [id].watchFn : NULL ;
+	  ctx = execTasks [id].ctx ;
+	pthread_mutex_unlock (&execLock) ;
+
+	if (fn != NULL)
+	  fn (ctx, events [i].events) ;
+      }
+    }
+  }
+
+  return NULL ;
+}
+
+
+/*
+ * piExecStart:
+ *	Start the executive thread, real-time at priority prio if we can,
+ *	kept to the CPUs in cpuMask (0 for any).
+ *	Returns 0, or -1 with errno set.
+ *********************************************************************************
+ */
+
+int piExecStart (int prio, unsigned int cpuMask)
+{
+  struct epoll_event ev ;
+  int res ;
+
+  pthread_mutex_lock (&execLock) ;
+
+  if (execRunning)
+  {
+    pthread_mutex_unlock (&execLock) ;
+    return 0 ;
+  }
+
+  epollFd = epoll_create1 (EPOLL_CLOEXEC) ;
+  wakeFd  = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK) ;
+  timerFd = timerfd_create (CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK) ;
+
+  if ((epollFd < 0) || (wakeFd < 0) || (timerFd < 0))
+    res = errno ;
+  else
+  {
+    ev.events   = EPOLLIN ;
+    ev.data.u32 = WAKE_ID ;
+    (void)epoll_ctl (epollFd, EPOLL_CTL_ADD, wakeFd, &ev) ;
+    ev.data.u32 = TIMER_ID ;
+    (void)epoll_ctl (epollFd, EPOLL_CTL_ADD, timerFd, &ev) ;
+
+    if ((res = piThreadCreateRT (execThread, NULL, SCHED_FIFO, prio, cpuMask, 0)) == EPERM)
+      res = piThreadCreateRT (execThread, NULL, SCHED_OTHER, 0, cpuMask, 0) ;
+  }
+
+  if (res != 0)
+  {
+    if (epollFd >= 0) close (epollFd) ;
+    if (wakeFd  >= 0) close (wakeFd) ;
+    if (timerFd >= 0) close (timerFd) ;
+    epollFd = wakeFd = timerFd = -1 ;
+    pthread_mutex_unlock (&execLock) ;
+    errno = res ;
+    return -1 ;
+  }
+
+  execRunning = TRUE ;
+  pthread_mutex_unlock (&execLock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * piExecActive:
+ *	Is the executive running? Engines look at this when they start.
+ *********************************************************************************
+ */
+
+int piExecActive (void)
+{
+  return execRunning ;
+}
+
+
+/*
+ * newTask:
+ *	Find a free slot. Lock held.
+ *********************************************************************************
+ */
+
+static struct execTaskStruct *newTask (int type)
+{
+  int i ;
+
+  for (i = 0 ; i < MAX_EXEC_TASKS ; ++i)
+    if ((execTasks [i].type == EXEC_FREE) && !execTasks [i].running)
+    {
+      memset (&execTasks [i], 0, sizeof (execTasks [i])) ;
+      execTasks [i].type = type ;
+      execTasks [i].fd   = -1 ;
+      return &execTasks [i] ;
+    }
+
+  return NULL ;
+}
+
+
+/*
+ * piExecTimer:
+ *	Add a timer task, first due at deadline (nanos64 () time, 0 for
+ *	now). fn is called with the deadline it was due at and returns the
+ *	next one, PI_EXEC_IDLE or 0 to finish.
+ *	Returns a task number, or -1.
+ *********************************************************************************
+ */
+
+int piExecTimer (unsigned long long deadline, unsigned long long (*fn)(void *ctx, unsigned long long deadline), void *ctx)
+{
+  struct execTaskStruct *t ;
+
+  if (!execRunning || (fn == NULL))
+  {
+    errno = execRunning ? EINVAL : ENODEV ;
+    return -1 ;
+  }
+
+  pthread_mutex_lock (&execLock) ;
+
+  if ((t = newTask (EXEC_TIMER)) == NULL)
+  {
+    pthread_mutex_unlock (&execLock) ;
+    errno = ENOSPC ;
+    return -1 ;
+  }
+
+  t->timerFn  = fn ;
+  t->ctx      = ctx ;
+  t->deadline = (deadline == 0) ? nanos64 () : deadline ;
+
+  pthread_mutex_unlock (&execLock) ;
+
+  execKick () ;
+
+  return (int)(t - execTasks) ;
+}
+
+
+/*
+ * piExecWatch:
+ *	Add a watch task: fn is called with the epoll events whenever fd is
+ *	ready for the epoll events given (EPOLLIN, etc.). Level triggered, so
+ *	fn must deal with what's there.
+ *	Returns a task number, or -1.
+ *********************************************************************************
+ */
+
+int piExecWatch (int fd, unsigned int events, void (*fn)(void *ctx, unsigned int events), void *ctx)
+{
+  struct execTaskStruct *t ;
+  struct epoll_event ev ;
+
+  if (!execRunning || (fn == NULL) || (fd < 0))
+  {
+    errno = execRunning ? EINVAL : ENODEV ;
+    return -1 ;
+  }
+
+  pthread_mutex_lock (&execLock) ;
+
+  if ((t = newTask (EXEC_WATCH)) == NULL)
+  {
+    pthread_mutex_unlock (&execLock) ;
+    errno = ENOSPC ;
+    return -1 ;
+  }
+
+  t->watchFn = fn ;
+  t->ctx     = ctx ;
+  t->fd      = fd ;
+
+  ev.events   = events ;
+  ev.data.u32 = (uint32_t)(t - execTasks) ;
+
+  if (epoll_ctl (epollFd, EPOLL_CTL_ADD, fd, &ev) < 0)
+  {
+    t->type = EXEC_FREE ;
+    pthread_mutex_unlock (&execLock) ;
+    return -1 ;
+  }
+
+  pthread_mutex_unlock (&execLock) ;
+
+  return (int)(t - execTasks) ;
+}
+
+
+/*
+ * piExecWake:
+ *	Make a timer task due no later than deadline (0 for now). This is how
+ *	an engine waiting at PI_EXEC_IDLE is told there's work.
+ *********************************************************************************
+ */
+
+void piExecWake (int task, unsigned long long deadline)
+{
+  struct execTaskStruct *t ;
+
+  if ((task < 0) || (task >= MAX_EXEC_TASKS))
+    return ;
+
+  t = &execTasks [task] ;
+
+  if (deadline == 0)
+    deadline = nanos64 () ;
+
+  pthread_mutex_lock (&execLock) ;
+    if (t->type == EXEC_TIMER)
+    {
+      if (t->running)
+      {
+	if (deadline < t->pending)
+	  t->pending = deadline ;
+      }
+      else if (deadline < t->deadline)
+	t->deadline = deadline ;
+    }
+  pthread_mutex_unlock (&execLock) ;
+
+  execKick () ;
+}
+
+
+/*
+ * piExecCancel:
+ *	Remove a task. If it's running now, that call finishes, but it's
+ *	not called again.
+ *********************************************************************************
+ */
+
+void piExecCancel (int task)
+{
+  struct execTaskStruct *t ;
+
+  if ((task < 0) || (task >= MAX_EXEC_TASKS))
+    return ;
+
+  t = &execTasks [task] ;
+
+  pthread_mutex_lock (&execLock) ;
+    if (t->type == EXEC_WATCH)
+      (void)epoll_ctl (epollFd, EPOLL_CTL_DEL, t->fd, NULL) ;
+    t->type = EXEC_FREE ;
+  pthread_mutex_unlock (&execLock) ;
+
+  execKick () ;
+}
+
+
+/*
+ * piExecStats:
+ *	How late (in nS) a timer task has been started since the last call.
+ *	Either pointer can be NULL.
+ *	Returns 0 or -1 for no such task.
+ *********************************************************************************
+ */
+
+int piExecStats (int task, unsigned int *maxNs, unsigned int *meanNs)
+{
+  struct execTaskStruct *t ;
+
+  if ((task < 0) || (task >= MAX_EXEC_TASKS) || (execTasks [task].type != EXEC_TIMER))
+    return -1 ;
+
+  t = &execTasks [task] ;
+
+  pthread_mutex_lock (&execLock) ;
+    if (maxNs != NULL)
+      *maxNs = t->lateMax ;
+    if (meanNs != NULL)
+      *meanNs = (t->lateCount == 0) ? 0 : (unsigned int)(t->lateSum / t->lateCount) ;
+    t->lateMax = t->lateSum = t->lateCount = 0 ;
+  pthread_mutex_unlock (&execLock) ;
+
+  return 0 ;
+}
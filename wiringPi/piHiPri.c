@@ -24,15 +24,97 @@
  ***********************************************************************
  */
 
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
 #include <sched.h>
 #include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
 
 #include "wiringPi.h"
+#include "wiringPiSim.h"
+
+// How much stack a real-time thread gets faulted in up front
+
+#define	RT_STACK_PREFAULT	(64 * 1024)
+
+static volatile int  rtSetup = FALSE ;
+static unsigned int  rtCpuMask ;
+
+
+/*
+ * piRtStackPrefault:
+ *	Touch the next RT_STACK_PREFAULT bytes of the calling thread's stack,
+ *	so with memory locked it'll never page fault there.
+ *********************************************************************************
+ */
+
+void piRtStackPrefault (void)
+{
+  volatile unsigned char stack [RT_STACK_PREFAULT] ;
+
+  memset ((unsigned char *)stack, 0, sizeof (stack)) ;
+}
+
+
+/*
+ * piRtCpus:
+ *	Pin the calling thread to the CPUs in mask (bit N for CPU N)
+ *********************************************************************************
+ */
+
+int piRtCpus (unsigned int mask)
+{
+  cpu_set_t cpus ;
+  int cpu ;
+
+  CPU_ZERO (&cpus) ;
+  for (cpu = 0 ; cpu < 32 ; ++cpu)
+    if ((mask & (1u << cpu)) != 0)
+      CPU_SET (cpu, &cpus) ;
+
+  return pthread_setaffinity_np (pthread_self (), sizeof (cpus), &cpus) ;
+}
+
+
+/*
+ * piRtSetup:
+ *	Get the program ready for real-time work: lock all its memory, now
+ *	and to come, and fault in the calling thread's stack. If cpuMask
+ *	isn't 0 then the library's own real-time threads - the ISR threads,
+ *	softPwm, softTone and the streaming engines - are kept to those CPUs
+ *	from then on (ideally ones kept clear with isolcpus=), and fault in
+ *	their stacks too.
+ *	Returns 0, or -1 if memory couldn't be locked (it needs root, or a
+ *	big enough RLIMIT_MEMLOCK).
+ *********************************************************************************
+ */
+
+int piRtSetup (unsigned int cpuMask)
+{
+  int res = 0 ;
+
+  if (mlockall (MCL_CURRENT | MCL_FUTURE) != 0)
+    res = -1 ;
+
+  piRtStackPrefault () ;
+
+  rtCpuMask = cpuMask ;
+  rtSetup   = TRUE ;
+
+  return res ;
+}
 
 
 /*
  * piHiPri:
  *	Attempt to set a high priority schedulling for the running program
+ *	Once piRtSetup has been called this also puts the thread on the real-
+ *	time CPUs and faults in its stack - the library's threads all start
+ *	with this.
  *********************************************************************************
  */
 
@@ -40,6 +122,13 @@ int piHiPri (const int pri)
 {
   struct sched_param sched ;
 
+  if (rtSetup)
+  {
+    if (rtCpuMask != 0)
+      (void)piRtCpus (rtCpuMask) ;
+    piRtStackPrefault () ;
+  }
+
   memset (&sched, 0, sizeof(sched)) ;
 
   if (pri > sched_get_priority_max (SCHED_RR))
@@ -49,3 +138,181 @@ int piHiPri (const int pri)
 
   return sched_setscheduler (0, SCHED_RR, &sched) ;
 }
+
+
+/*
+ * piRtPerformanceBegin: piRtPerformanceEnd:
+ *	Keep the clock and the idle states steady around real-time work.
+ *	On the CPUs in cpuMask (0 for the ones given to piRtSetup, or all of
+ *	them) the cpufreq governor is switched to performance - or, where
+ *	that's refused, scaling_min_freq is raised to the maximum - and a
+ *	/dev/cpu_dma_latency request of 0 keeps every CPU out of the deep
+ *	idle states that slow down waking up for an interrupt.
+ *	Sections nest: only the first Begin changes anything, and the last
+ *	End puts the old settings back (as does exit, if it gets that far -
+ *	the latency request goes with the process whatever happens).
+ *	Needs root; returns 0, or -1 if nothing could be changed.
+ *********************************************************************************
+ */
+
+#define	RT_MAX_CPUS	32
+
+static pthread_mutex_t perfLock = PTHREAD_MUTEX_INITIALIZER ;
+static int    perfCount = 0 ;
+static int    perfQosFd = -1 ;
+static int    perfAtExit = FALSE ;
+static char   perfGovernor [RT_MAX_CPUS][32] ;	// Empty if not changed
+static char   perfMinFreq  [RT_MAX_CPUS][32] ;
+
+static int sysRead (int cpu, const char *file, char *buf, int size)
+{
+  char path [96] ;
+  int  fd, n ;
+
+  snprintf (path, sizeof (path), "/sys/devices/system/cpu/cpu%d/cpufreq/%s", cpu, file) ;
+  if ((fd = open (path, O_RDONLY | O_CLOEXEC)) < 0)
+    return -1 ;
+  n = read (fd, buf, size - 1) ;
+  close (fd) ;
+  if (n <= 0)
+    return -1 ;
+
+  while ((n > 0) && ((buf [n - 1] == '\n') || (buf [n - 1] == ' ')))
+    --n ;
+  buf [n] = 0 ;
+
+  return n ;
+}
+
+static int sysWrite (int cpu, const char *file, const char *value)
+{
+  char path [96] ;
+  int  fd, n ;
+
+  snprintf (path, sizeof (path), "/sys/devices/system/cpu/cpu%d/cpufreq/%s", cpu, file) ;
+  if ((fd = open (path, O_WRONLY | O_CLOEXEC)) < 0)
+    return -1 ;
+  n = write (fd, value, strlen (value)) ;
+  close (fd) ;
+
+  return (n < 0) ? -1 : 0 ;
+}
+
+static void perfRestore (void)
+{
+  int cpu ;
+
+  for (cpu = 0 ; cpu < RT_MAX_CPUS ; ++cpu)
+  {
+    if (perfMinFreq [cpu][0] != 0)
+      (void)sysWrite (cpu, "scaling_min_freq", perfMinFreq [cpu]) ;
+    if (perfGovernor [cpu][0] != 0)
+      (void)sysWrite (cpu, "scaling_governor", perfGovernor [cpu]) ;
+    perfMinFreq  [cpu][0] = 0 ;
+    perfGovernor [cpu][0] = 0 ;
+  }
+
+  if (perfQosFd != -1)
+  {
+    close (perfQosFd) ;
+    perfQosFd = -1 ;
+  }
+}
+
+static void perfAtExitRestore (void)
+{
+  pthread_mutex_lock (&perfLock) ;
+    if (perfCount > 0)
+      perfRestore () ;
+    perfCount = 0 ;
+  pthread_mutex_unlock (&perfLock) ;
+}
+
+int piRtPerformanceBegin (unsigned int cpuMask)
+{
+  char    buf [32] ;
+  int32_t latency = 0 ;
+  int     cpu, changed = 0, res = 0 ;
+
+  if (wiringPiSimActive ())
+    return 0 ;
+
+  if (cpuMask == 0)
+    cpuMask = (rtCpuMask != 0) ? rtCpuMask : 0xFFFFFFFF ;
+
+  pthread_mutex_lock (&perfLock) ;
+
+  if (perfCount++ == 0)
+  {
+    if ((perfQosFd = open ("/dev/cpu_dma_latency", O_WRONLY | O_CLOEXEC)) >= 0)
+    {
+      if (write (perfQosFd, &latency, sizeof (latency)) == sizeof (latency))
+	++changed ;
+      else
+      {
+	close (perfQosFd) ;
+	perfQosFd = -1 ;
+      }
+    }
+
+    for (cpu = 0 ; cpu < RT_MAX_CPUS ; ++cpu)
+    {
+      if ((cpuMask & (1u << cpu)) == 0)
+	continue ;
+
+      if (sysRead (cpu, "scaling_governor", perfGovernor [cpu], sizeof (perfGovernor [cpu])) < 0)
+      {
+	perfGovernor [cpu][0] = 0 ;
+	continue ;			// No such CPU, or no cpufreq
+      }
+
+      if (strcmp (perfGovernor [cpu], "performance") == 0)
+      {
+	perfGovernor [cpu][0] = 0 ;	// Already there
+	++changed ;
+	continue ;
+      }
+
+      if (sysWrite (cpu, "scaling_governor", "performance") == 0)
+      {
+	++changed ;
+	continue ;
+      }
+      perfGovernor [cpu][0] = 0 ;
+
+// No performance governor (or not allowed to pick it): hold the floor
+//	up at the top instead
+
+      if ((sysRead (cpu, "cpuinfo_max_freq", buf, sizeof (buf)) > 0) &&
+	  (sysRead (cpu, "scaling_min_freq", perfMinFreq [cpu], sizeof (perfMinFreq [cpu])) > 0) &&
+	  (sysWrite (cpu, "scaling_min_freq", buf) == 0))
+	++changed ;
+      else
+	perfMinFreq [cpu][0] = 0 ;
+    }
+
+    if (!perfAtExit)
+    {
+      atexit (perfAtExitRestore) ;
+      perfAtExit = TRUE ;
+    }
+
+    if (changed == 0)
+    {
+      perfCount = 0 ;
+      res       = -1 ;
+    }
+  }
+
+  pthread_mutex_unlock (&perfLock) ;
+
+  return res ;
+}
+
+void piRtPerformanceEnd (void)
+{
+  pthread_mutex_lock (&perfLock) ;
+    if ((perfCount > 0) && (--perfCount == 0))
+      perfRestore () ;
+  pthread_mutex_unlock (&perfLock) ;
+}
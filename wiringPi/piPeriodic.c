@@ -0,0 +1,474 @@
+/*
+ * piPeriodic.c:
+ *	Periodic real-time tasks
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+/*
+ * Notes:
+ *	Each period (and priority) gets a thread of its own, woken by a
+ *	timerfd on absolute CLOCK_MONOTONIC deadlines, so nothing drifts
+ *	however long the tasks take. Tasks with the same period and priority
+ *	share the thread and run one after the other on each tick.
+ *	The timerfd tells us how many ticks have gone by since the last
+ *	read, so a tick we missed - because the tasks overran, or we weren't
+ *	scheduled in time - is counted against every task on the thread.
+ *
+ *	With the executive running (piExecStart) there are no threads here:
+ *	each task is a timer task there instead, its overruns counted from
+ *	how far behind it's been started.
+ *
+ *	A task that's had piPeriodicFd isn't called from here at all: each
+ *	tick just bumps its eventfd, and the caller's event loop runs it with
+ *	piPeriodicRun.
+ *********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+
+#include "wiringPi.h"
+
+#define	MAX_PERIODIC_TIMERS	8
+#define	MAX_PERIODIC_TASKS	32
+
+struct timerStruct
+{
+  unsigned long long periodNs ;		// 0 for a free slot
+  int                prio ;
+  int                fd ;
+  int                numTasks ;
+  uint64_t           first ;		// The first deadline
+} ;
+
+struct taskStruct
+{
+  struct timerStruct *timer ;		// NULL for a free slot, or &execTimer
+  int                 exec ;		// Its executive task
+  unsigned long long  periodNs ;
+  void (*fn)(void *ctx) ;
+  void               *ctx ;
+  int                 fd ;		// piPeriodicFd's eventfd, or -1
+  unsigned int        overruns ;
+  unsigned int        jitterMax ;
+  unsigned long long  jitterSum ;
+  unsigned int        jitterCount ;
+} ;
+
+static struct timerStruct timers [MAX_PERIODIC_TIMERS] ;
+static struct taskStruct  tasks  [MAX_PERIODIC_TASKS] ;
+static struct timerStruct execTimer ;	// For tasks on the executive
+static pthread_mutex_t    periodicLock = PTHREAD_MUTEX_INITIALIZER ;
+
+
+static uint64_t monoNanos (void)
+{
+  struct timespec ts ;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+  return (uint64_t)ts.tv_sec * (uint64_t)1000000000 + (uint64_t)ts.tv_nsec ;
+}
+
+
+/*
+ * periodicSignal:
+ *	A deferred task's tick: count how late it is and tell the event loop
+ *********************************************************************************
+ */
+
+static void periodicSignal (struct taskStruct *t, uint64_t late)
+{
+  uint64_t one = 1 ;
+
+  if (late > t->jitterMax)
+    t->jitterMax = (unsigned int)late ;
+  t->jitterSum   += late ;
+  t->jitterCount += 1 ;
+
+  (void)write (t->fd, &one, sizeof (one)) ;
+}
+
+
+/*
+ * periodicThread:
+ *	Wait for each tick and run the timer's tasks. They run without the
+ *	lock held, from a copy of the list taken at the tick, so a task can
+ *	create or delete tasks itself.
+ *********************************************************************************
+ */
+
+static void *periodicThread (void *arg)
+{
+  struct timerStruct *t = (struct timerStruct *)arg ;
+  struct taskStruct  *run [MAX_PERIODIC_TASKS] ;
+  void (*fns  [MAX_PERIODIC_TASKS])(void *ctx) ;
+  void  *ctxs [MAX_PERIODIC_TASKS] ;
+  uint64_t expirations, deadline, late ;
+  int i, n ;
+
+  (void)piHiPri (t->prio) ;		// Only effective if we run as root
+
+  deadline = t->first - t->periodNs ;
+
+  for (;;)
+  {
+    if (read (t->fd, &expirations, sizeof (expirations)) != sizeof (expirations))
+    {
+      if (errno == EINTR)
+	continue ;
+      expirations = 1 ;
+    }
+
+    deadline += expirations * t->periodNs ;
+
+    pthread_mutex_lock (&periodicLock) ;
+
+    if (t->numTasks == 0)		// All gone - give the slot back
+    {
+      close (t->fd) ;
+      t->periodNs = 0 ;
+      pthread_mutex_unlock (&periodicLock) ;
+      return NULL ;
+    }
+
+    for (i = n = 0 ; i < MAX_PERIODIC_TASKS ; ++i)
+      if (tasks [i].timer == t)
+      {
+	tasks [i].overruns += (unsigned int)(expirations - 1) ;
+	if (tasks [i].fd != -1)		// Deferred - under the lock, so the fd can't go
+	{
+	  periodicSignal (&tasks [i], monoNanos () - deadline) ;
+	  continue ;
+	}
+	run  [n] = &tasks [i] ;
+	fns  [n] = tasks [i].fn ;
+	ctxs [n] = tasks [i].ctx ;
+	++n ;
+      }
+
+    pthread_mutex_unlock (&periodicLock) ;
+
+    for (i = 0 ; i < n ; ++i)
+    {
+      late = monoNanos () - deadline ;
+      if (late > run [i]->jitterMax)
+	run [i]->jitterMax = (unsigned int)late ;
+      run [i]->jitterSum   += late ;
+      run [i]->jitterCount += 1 ;
+
+      fns [i] (ctxs [i]) ;
+    }
+  }
+
+  return NULL ;
+}
+
+
+/*
+ * periodicExec:
+ *	A task's tick on the executive. A whole period or more late counts
+ *	as overruns, and we skip on to the next deadline that's still to
+ *	come, as a timerfd would.
+ *********************************************************************************
+ */
+
+static unsigned long long periodicExec (void *ctx, unsigned long long deadline)
+{
+  struct taskStruct *t = (struct taskStruct *)ctx ;
+  unsigned long long now, late, missed ;
+
+  now  = nanos64 () ;
+  late = now - deadline ;
+
+  if (t->fd != -1)
+    periodicSignal (t, late) ;
+  else
+  {
+    if (late > t->jitterMax)
+      t->jitterMax = (unsigned int)late ;
+    t->jitterSum   += late ;
+    t->jitterCount += 1 ;
+
+    t->fn (t->ctx) ;
+  }
+
+  missed       = late / t->periodNs ;
+  t->overruns += (unsigned int)missed ;
+
+  return deadline + (missed + 1) * t->periodNs ;
+}
+
+
+/*
+ * timerStart:
+ *	Find or start the thread for a period and priority. Call with the
+ *	lock held.
+ *********************************************************************************
+ */
+
+static struct timerStruct *timerStart (unsigned long long periodNs, int prio)
+{
+  struct itimerspec its ;
+  struct timerStruct *t = NULL ;
+  pthread_t myThread ;
+  int i ;
+
+  for (i = 0 ; i < MAX_PERIODIC_TIMERS ; ++i)
+    if ((timers [i].periodNs == periodNs) && (timers [i].prio == prio))
+      return &timers [i] ;
+
+  for (i = 0 ; i < MAX_PERIODIC_TIMERS ; ++i)
+    if (timers [i].periodNs == 0)
+    {
+      t = &timers [i] ;
+      break ;
+    }
+
+  if (t == NULL)
+    return NULL ;
+
+  if ((t->fd = timerfd_create (CLOCK_MONOTONIC, TFD_CLOEXEC)) < 0)
+    return NULL ;
+
+  t->periodNs = periodNs ;
+  t->prio     = prio ;
+  t->numTasks = 0 ;
+  t->first    = monoNanos () + periodNs ;
+
+  its.it_value.tv_sec     = t->first / 1000000000ULL ;
+  its.it_value.tv_nsec    = t->first % 1000000000ULL ;
+  its.it_interval.tv_sec  = periodNs / 1000000000ULL ;
+  its.it_interval.tv_nsec = periodNs % 1000000000ULL ;
+
+  if ((timerfd_settime (t->fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) ||
+      (pthread_create (&myThread, NULL, periodicThread, t) != 0))
+  {
+    close (t->fd) ;
+    t->periodNs = 0 ;
+    return NULL ;
+  }
+
+  pthread_detach (myThread) ;
+
+  return t ;
+}
+
+
+/*
+ * piPeriodicCreate:
+ *	Call fn (ctx) every periodNs nanoseconds from a real-time thread at
+ *	priority prio, starting one period from now. Tasks with the same
+ *	period and priority share a thread and run in the order they were
+ *	created.
+ *	Returns a task number or -1.
+ *********************************************************************************
+ */
+
+int piPeriodicCreate (unsigned long long periodNs, void (*fn)(void *ctx), void *ctx, int prio)
+{
+  struct timerStruct *t ;
+  int task ;
+
+  if ((periodNs == 0) || (fn == NULL))
+    return -1 ;
+
+  pthread_mutex_lock (&periodicLock) ;
+
+  for (task = 0 ; task < MAX_PERIODIC_TASKS ; ++task)
+    if (tasks [task].timer == NULL)
+      break ;
+
+  if (task == MAX_PERIODIC_TASKS)
+  {
+    pthread_mutex_unlock (&periodicLock) ;
+    return -1 ;
+  }
+
+  if (piExecActive ())
+  {
+    memset (&tasks [task], 0, sizeof (tasks [task])) ;
+    tasks [task].fn       = fn ;
+    tasks [task].ctx      = ctx ;
+    tasks [task].fd       = -1 ;
+    tasks [task].periodNs = periodNs ;
+    if ((tasks [task].exec = piExecTimer (nanos64 () + periodNs, periodicExec, &tasks [task])) < 0)
+    {
+      pthread_mutex_unlock (&periodicLock) ;
+      return -1 ;
+    }
+    tasks [task].timer = &execTimer ;
+    pthread_mutex_unlock (&periodicLock) ;
+    return task ;
+  }
+
+  if ((t = timerStart (periodNs, prio)) == NULL)
+  {
+    pthread_mutex_unlock (&periodicLock) ;
+    return -1 ;
+  }
+
+  memset (&tasks [task], 0, sizeof (tasks [task])) ;
+  tasks [task].fn    = fn ;
+  tasks [task].ctx   = ctx ;
+  tasks [task].fd    = -1 ;
+  tasks [task].timer = t ;
+  ++t->numTasks ;
+
+  pthread_mutex_unlock (&periodicLock) ;
+
+  return task ;
+}
+
+
+/*
+ * piPeriodicDelete:
+ *	Stop a task. If its thread is in the middle of a tick it may still
+ *	be called once more. The thread goes when its last task does.
+ *********************************************************************************
+ */
+
+void piPeriodicDelete (int task)
+{
+  if ((task < 0) || (task >= MAX_PERIODIC_TASKS))
+    return ;
+
+  pthread_mutex_lock (&periodicLock) ;
+
+  if ((tasks [task].timer != NULL) && (tasks [task].fd != -1))
+  {
+    close (tasks [task].fd) ;
+    tasks [task].fd = -1 ;
+  }
+
+  /**/ if (tasks [task].timer == &execTimer)
+  {
+    piExecCancel (tasks [task].exec) ;
+    tasks [task].timer = NULL ;
+  }
+  else if (tasks [task].timer != NULL)
+  {
+    --tasks [task].timer->numTasks ;
+    tasks [task].timer = NULL ;
+  }
+
+  pthread_mutex_unlock (&periodicLock) ;
+}
+
+
+/*
+ * piPeriodicFd: piPeriodicRun:
+ *	Hand a task over to the caller's event loop: the timing stays with us,
+ *	but each tick now just makes the eventfd returned readable, and
+ *	piPeriodicRun calls the function - once, however many ticks have gone
+ *	by, the others counted as overruns - without blocking. It's the same
+ *	fd every time; it's closed when the task's deleted.
+ *	Returns the fd or -1, and the number of ticks there'd been (0 if none).
+ *********************************************************************************
+ */
+
+int piPeriodicFd (int task)
+{
+  int fd ;
+
+  if ((task < 0) || (task >= MAX_PERIODIC_TASKS))
+    return -1 ;
+
+  pthread_mutex_lock (&periodicLock) ;
+
+  if (tasks [task].timer == NULL)
+  {
+    pthread_mutex_unlock (&periodicLock) ;
+    return -1 ;
+  }
+
+  if (tasks [task].fd == -1)
+    tasks [task].fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC) ;
+  fd = tasks [task].fd ;
+
+  pthread_mutex_unlock (&periodicLock) ;
+
+  return fd ;
+}
+
+int piPeriodicRun (int task)
+{
+  struct taskStruct *t ;
+  uint64_t ticks ;
+  int fd ;
+
+  if ((task < 0) || (task >= MAX_PERIODIC_TASKS))
+    return -1 ;
+
+  t = &tasks [task] ;
+
+  pthread_mutex_lock (&periodicLock) ;
+    fd = (t->timer == NULL) ? -1 : t->fd ;
+    if ((fd == -1) || (read (fd, &ticks, sizeof (ticks)) != sizeof (ticks)))
+      ticks = 0 ;
+    else
+      t->overruns += (unsigned int)(ticks - 1) ;
+  pthread_mutex_unlock (&periodicLock) ;
+
+  if (fd == -1)
+    return -1 ;
+
+  if (ticks > 0)
+    t->fn (t->ctx) ;
+
+  return (int)ticks ;
+}
+
+
+/*
+ * piPeriodicStats:
+ *	How many ticks a task has missed, and how late (in nS) it's been
+ *	started since the last call. Any pointer can be NULL.
+ *	Returns 0 or -1 for no such task.
+ *********************************************************************************
+ */
+
+int piPeriodicStats (int task, unsigned int *overruns, unsigned int *maxNs, unsigned int *meanNs)
+{
+  struct taskStruct *t ;
+
+  if ((task < 0) || (task >= MAX_PERIODIC_TASKS) || (tasks [task].timer == NULL))
+    return -1 ;
+
+  t = &tasks [task] ;
+
+  if (overruns != NULL)
+    *overruns = t->overruns ;
+  if (maxNs != NULL)
+    *maxNs = t->jitterMax ;
+  if (meanNs != NULL)
+    *meanNs = (t->jitterCount == 0) ? 0 : (unsigned int)(t->jitterSum / t->jitterCount) ;
+
+  t->jitterMax = t->jitterSum = t->jitterCount = 0 ;
+
+  return 0 ;
+}
@@ -0,0 +1,473 @@
+/*
+ * piScan.c:
+ *	PLC style scan cycle: inputs, logic, outputs.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+
+/*
+ * Notes:
+ *	Register the input and output pins, then every period the scan
+ *	reads all the inputs into an image - one GPLEV load per bank for
+ *	the on-board pins, digitalReadRange () for each run of extension
+ *	pins - calls the logic, which works only on the images with piScanIn ()
+ *	and piScanOut (), then writes out just the outputs that changed:
+ *	one GPSET/GPCLR store per bank, and one masked write per 16 pins of
+ *	a node, all inside wiringPiBegin ()/wiringPiCommit () so a node that
+ *	can hold its writes does them in one go.
+ *	The scan runs as a piPeriodic task, so its period doesn't drift;
+ *	piScanStats () has the missed periods and how long the scans take.
+ *********************************************************************************
+ */
+
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "wiringPi.h"
+#include "piScan.h"
+
+struct scanRangeStruct
+{
+  int pin ;
+  int count ;
+  int offset ;			// Into the image
+  int onBoard ;
+} ;
+
+struct scanImageStruct
+{
+  struct scanRangeStruct ranges [PI_SCAN_MAX_RANGES] ;
+  int numRanges ;
+  int numPins ;
+  int values [PI_SCAN_MAX_PINS] ;
+} ;
+
+static struct scanImageStruct inputs ;
+static struct scanImageStruct outputs ;
+static int          written [PI_SCAN_MAX_PINS] ;	// Outputs as last written, -1 for never
+
+static pthread_mutex_t scanLock = PTHREAD_MUTEX_INITIALIZER ;
+static int          scanTask = -1 ;
+static int          scanning = FALSE ;
+static void       (*scanLogic)(void *ctx) ;
+static void        *scanCtx ;
+
+static unsigned int cycles ;
+static unsigned int scanMax ;
+static unsigned long long scanSum ;
+static unsigned int scanCount ;
+
+
+static unsigned long long monoNanos (void)
+{
+  struct timespec ts ;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec ;
+}
+
+
+/*
+ * addRange:
+ *	Add pins to an image, a run per node so each can be read or written
+ *	in one go. Call with the lock held.
+ *********************************************************************************
+ */
+
+static int addRange (struct scanImageStruct *image, int pin, int count)
+{
+  struct wiringPiNodeStruct *node ;
+  struct scanRangeStruct *r ;
+  int n ;
+
+  if ((count < 1) || (image->numPins + count > PI_SCAN_MAX_PINS))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  while (count > 0)
+  {
+    if (image->numRanges == PI_SCAN_MAX_RANGES)
+    {
+      errno = ENOSPC ;
+      return -1 ;
+    }
+
+    /**/ if ((pin & PI_GPIO_MASK) == 0)	// On-Board Pins
+    {
+      if (pin + count > 64)
+      {
+	errno = EINVAL ;
+	return -1 ;
+      }
+      n = count ;
+    }
+    else if ((node = wiringPiFindNode (pin)) == NULL)
+    {
+      errno = ENODEV ;
+      return -1 ;
+    }
+    else
+      n = (pin + count - 1 > node->pinMax) ? node->pinMax - pin + 1 : count ;
+
+    r = &image->ranges [image->numRanges++] ;
+    r->pin     = pin ;
+    r->count   = n ;
+    r->offset  = image->numPins ;
+    r->onBoard = (pin & PI_GPIO_MASK) == 0 ;
+
+    image->numPins += n ;
+    pin            += n ;
+    count          -= n ;
+  }
+
+  return 0 ;
+}
+
+
+/*
+ * piScanInputs:
+ * piScanOutputs:
+ *	Add count pins from pin on to the input or output image. On-board
+ *	and extension pins can be mixed freely, as can nodes.
+ *	Returns 0 or -1 with errno set.
+ *********************************************************************************
+ */
+
+int piScanInputs (int pin, int count)
+{
+  int result ;
+
+  pthread_mutex_lock (&scanLock) ;
+    result = addRange (&inputs, pin, count) ;
+  pthread_mutex_unlock (&scanLock) ;
+
+  return result ;
+}
+
+int piScanOutputs (int pin, int count)
+{
+  int i, first, result ;
+
+  pthread_mutex_lock (&scanLock) ;
+    first = outputs.numPins ;
+    if ((result = addRange (&outputs, pin, count)) == 0)
+      for (i = first ; i < outputs.numPins ; ++i)
+      {
+	outputs.values [i] = LOW ;
+	written        [i] = -1 ;
+      }
+  pthread_mutex_unlock (&scanLock) ;
+
+  return result ;
+}
+
+
+/*
+ * find:
+ *	The image entry for a pin, or NULL
+ *********************************************************************************
+ */
+
+static int *find (struct scanImageStruct *image, int pin)
+{
+  struct scanRangeStruct *r ;
+  int i ;
+
+  for (i = 0 ; i < image->numRanges ; ++i)
+  {
+    r = &image->ranges [i] ;
+    if ((pin >= r->pin) && (pin < r->pin + r->count))
+      return &image->values [r->offset + pin - r->pin] ;
+  }
+
+  return NULL ;
+}
+
+
+/*
+ * piScanIn:
+ * piScanOut:
+ *	For the logic: a pin as it was at the start of this scan (an output
+ *	reads back what the logic's set it to), and set an output for the
+ *	end of the scan. Pins not in the images read LOW and aren't written.
+ *********************************************************************************
+ */
+
+int piScanIn (int pin)
+{
+  int *v ;
+
+  if (((v = find (&inputs, pin)) != NULL) || ((v = find (&outputs, pin)) != NULL))
+    return *v ;
+
+  return LOW ;
+}
+
+void piScanOut (int pin, int value)
+{
+  int *v ;
+
+  if ((v = find (&outputs, pin)) != NULL)
+    *v = (value != LOW) ? HIGH : LOW ;
+}
+
+
+/*
+ * readInputs:
+ *	Snapshot the lot
+ *********************************************************************************
+ */
+
+static void readInputs (void)
+{
+  struct scanRangeStruct *r ;
+  int           pins [64] ;
+  unsigned char levels [64] ;
+  int           offsets [64] ;
+  int i, j, n = 0 ;
+
+  for (i = 0 ; i < inputs.numRanges ; ++i)
+  {
+    r = &inputs.ranges [i] ;
+    if (!r->onBoard)
+      digitalReadRange (r->pin, r->count, &inputs.values [r->offset]) ;
+    else
+      for (j = 0 ; (j < r->count) && (n < 64) ; ++j, ++n)
+      {
+	pins    [n] = r->pin + j ;
+	offsets [n] = r->offset + j ;
+      }
+  }
+
+  if ((n > 0) && (digitalReadPins (pins, n, levels) == n))
+    for (i = 0 ; i < n ; ++i)
+      inputs.values [offsets [i]] = levels [i] ;
+}
+
+
+/*
+ * writeOutputs:
+ *	Write out what's changed since the last scan: the on-board pins
+ *	gathered up for digitalWritePins (), node pins 16 at a time.
+ *********************************************************************************
+ */
+
+static void writeOutputs (void)
+{
+  struct scanRangeStruct *r ;
+  int pins [32] ;
+  unsigned int pinValues = 0 ;
+  unsigned int value, mask ;
+  int i, j, k, v, o, numPins = 0 ;
+
+  wiringPiBegin () ;
+
+  for (i = 0 ; i < outputs.numRanges ; ++i)
+  {
+    r = &outputs.ranges [i] ;
+
+    for (j = 0 ; j < r->count ; j += 16)
+    {
+      value = mask = 0 ;
+
+      for (k = 0 ; (k < 16) && (j + k < r->count) ; ++k)
+      {
+	o = r->offset + j + k ;
+	if ((v = outputs.values [o]) == written [o])
+	  continue ;
+	written [o] = v ;
+
+	if (!r->onBoard)
+	{
+	  mask  |= 1u << k ;
+	  value |= (unsigned int)v << k ;
+	  continue ;
+	}
+
+	if (numPins == 32)
+	{
+	  digitalWritePins (pins, numPins, pinValues) ;
+	  numPins = pinValues = 0 ;
+	}
+	pinValues       |= (unsigned int)v << numPins ;
+	pins [numPins++] = r->pin + j + k ;
+      }
+
+      if (mask != 0)
+	digitalWriteMasked (r->pin + j, value, mask) ;
+    }
+  }
+
+  if (numPins > 0)
+    digitalWritePins (pins, numPins, pinValues) ;
+
+  wiringPiCommit () ;
+}
+
+
+/*
+ * scanCycle:
+ *	The piPeriodic task
+ *********************************************************************************
+ */
+
+static void scanCycle (void *ctx)
+{
+  unsigned long long start ;
+  unsigned int took ;
+
+  (void)ctx ;
+
+  pthread_mutex_lock (&scanLock) ;
+
+  if (!scanning)		// Stopped, but called the once more
+  {
+    pthread_mutex_unlock (&scanLock) ;
+    return ;
+  }
+
+  start = monoNanos () ;
+
+  readInputs () ;
+  scanLogic (scanCtx) ;
+  writeOutputs () ;
+
+  took = (unsigned int)(monoNanos () - start) ;
+  if (took > scanMax)
+    scanMax = took ;
+  scanSum   += took ;
+  scanCount += 1 ;
+  cycles    += 1 ;
+
+  pthread_mutex_unlock (&scanLock) ;
+}
+
+
+/*
+ * piScanStart:
+ *	Run the scan, calling logic (ctx) between the inputs and outputs,
+ *	every periodNs from a real-time thread at priority prio. The outputs
+ *	are all written on the first scan, then only when they change.
+ *	Returns 0 or -1 with errno set.
+ *********************************************************************************
+ */
+
+int piScanStart (unsigned long long periodNs, void (*logic)(void *ctx), void *ctx, int prio)
+{
+  int i ;
+
+  if ((periodNs == 0) || (logic == NULL))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  pthread_mutex_lock (&scanLock) ;
+
+  if (scanning)
+  {
+    pthread_mutex_unlock (&scanLock) ;
+    errno = EBUSY ;
+    return -1 ;
+  }
+
+  for (i = 0 ; i < outputs.numPins ; ++i)
+    written [i] = -1 ;
+
+  scanLogic = logic ;
+  scanCtx   = ctx ;
+  cycles    = scanMax = scanCount = 0 ;
+  scanSum   = 0 ;
+  scanning  = TRUE ;
+
+  if ((scanTask = piPeriodicCreate (periodNs, scanCycle, NULL, prio)) < 0)
+  {
+    scanning = FALSE ;
+    pthread_mutex_unlock (&scanLock) ;
+    errno = EAGAIN ;
+    return -1 ;
+  }
+
+  pthread_mutex_unlock (&scanLock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * piScanStop:
+ *	Stop scanning. Once this returns the logic won't be called again.
+ *	The outputs are left as they are.
+ *********************************************************************************
+ */
+
+void piScanStop (void)
+{
+  pthread_mutex_lock (&scanLock) ;
+
+  if (scanning)
+  {
+    piPeriodicDelete (scanTask) ;
+    scanTask = -1 ;
+    scanning = FALSE ;
+  }
+
+  pthread_mutex_unlock (&scanLock) ;
+}
+
+
+/*
+ * piScanStats:
+ *	The number of scans and missed periods so far, and the longest and
+ *	average scan (in nS) since the last call. Any pointer can be NULL.
+ *	Returns 0 or -1 if it's not running.
+ *********************************************************************************
+ */
+
+int piScanStats (unsigned int *cycleCount, unsigned int *overruns, unsigned int *maxNs, unsigned int *meanNs)
+{
+  pthread_mutex_lock (&scanLock) ;
+
+  if (!scanning)
+  {
+    pthread_mutex_unlock (&scanLock) ;
+    return -1 ;
+  }
+
+  if (cycleCount != NULL)
+    *cycleCount = cycles ;
+  if (overruns != NULL)
+    (void)piPeriodicStats (scanTask, overruns, NULL, NULL) ;
+  if (maxNs != NULL)
+    *maxNs = scanMax ;
+  if (meanNs != NULL)
+    *meanNs = (scanCount == 0) ? 0 : (unsigned int)(scanSum / scanCount) ;
+
+  scanMax   = scanCount = 0 ;
+  scanSum   = 0 ;
+
+  pthread_mutex_unlock (&scanLock) ;
+
+  return 0 ;
+}
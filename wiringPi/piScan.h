@@ -0,0 +1,42 @@
+/*
+ * piScan.h:
+ *	PLC style scan cycle: inputs, logic, outputs.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#define	PI_SCAN_MAX_RANGES	32
+#define	PI_SCAN_MAX_PINS	256
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int  piScanInputs  (int pin, int count) ;
+extern int  piScanOutputs (int pin, int count) ;
+extern int  piScanStart   (unsigned long long periodNs, void (*logic)(void *ctx), void *ctx, int prio) ;
+extern void piScanStop    (void) ;
+extern int  piScanIn      (int pin) ;
+extern void piScanOut     (int pin, int value) ;
+extern int  piScanStats   (unsigned int *cycleCount, unsigned int *overruns, unsigned int *maxNs, unsigned int *meanNs) ;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,386 @@
+/*
+ * piSpin.c:
+ *	A busy-poll executive for the engines that want a CPU to spin on
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+/*
+ * Notes:
+ *	GPEDS edge polling, the logic analyser capture and the last stretch
+ *	of every digitalWriteAt () all want a CPU that's doing nothing but
+ *	looking - and a spinning thread each would take a CPU each. With
+ *	piSpinStart () they're all tasks on the one thread instead, pinned to
+ *	a CPU that's ideally been kept clear with isolcpus=, with all our
+ *	memory locked and the thread's stack faulted in before it starts.
+ *
+ *	The thread never sleeps. Each time round it reads the clock once and
+ *	calls every task with that time; a task does whatever's ready and
+ *	returns straight away - TRUE to be called again, FALSE if it's done.
+ *	Each task has a budget: a call that takes longer than that is
+ *	counted against it (piSpinStats), as that's time everything else
+ *	had to wait, so a pass round all the tasks is the latency for all.
+ *
+ *	Engines decide for themselves when to use it: start it before
+ *	setting them up. A task number has the slot's generation in it as
+ *	well as the slot, so an old one can't remove whoever has the slot
+ *	now. Each task can have a function that piSpinStop () calls if the
+ *	task's still there when it stops, for the engine to finish up or go
+ *	back to doing it another way.
+ *********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "wiringPi.h"
+#include "piThread.h"
+
+#define	MAX_SPIN_TASKS	32
+#define	SPIN_GEN_MAX	0x3FFFFFF		// So a task number stays positive
+
+struct spinTaskStruct
+{
+  int              (*fn)(void *ctx, unsigned long long now) ;	// NULL for a free slot
+  void             (*gone)(void *ctx) ;
+  void              *ctx ;
+  unsigned int       gen ;					// Goes up each time it's used
+  unsigned int       budgetNs ;
+  unsigned int       maxNs ;
+  unsigned int       overBudget ;
+} ;
+
+static struct spinTaskStruct spinTasks [MAX_SPIN_TASKS] ;
+static pthread_mutex_t       spinLock    = PTHREAD_MUTEX_INITIALIZER ;
+static volatile int          spinRunning = FALSE ;
+static volatile int          spinExited  = FALSE ;
+static volatile unsigned int spinPasses  = 0 ;
+static pthread_t             spinThreadId ;
+
+
+/*
+ * spinThread:
+ *	Round and round the tasks
+ *********************************************************************************
+ */
+
+static void *spinThread (UNU void *arg)
+{
+  int (*fn)(void *, unsigned long long) ;
+  struct spinTaskStruct *t ;
+  unsigned long long now, then ;
+  unsigned int took ;
+  int i ;
+
+  spinThreadId = pthread_self () ;
+
+  while (spinRunning)
+  {
+    now = nanos64 () ;
+
+    for (i = 0 ; i < MAX_SPIN_TASKS ; ++i)
+    {
+      t = &spinTasks [i] ;
+      if ((fn = __atomic_load_n (&t->fn, __ATOMIC_ACQUIRE)) == NULL)
+	continue ;
+
+      if (!fn (t->ctx, now))
+	__atomic_store_n (&t->fn, NULL, __ATOMIC_RELEASE) ;
+
+      then = nanos64 () ;
+      took = (unsigned int)(then - now) ;
+      if (took > t->maxNs)
+	t->maxNs = took ;
+      if (took > t->budgetNs)
+	++t->overBudget ;
+      now = then ;
+    }
+
+    __atomic_add_fetch (&spinPasses, 1, __ATOMIC_RELEASE) ;
+  }
+
+  spinExited = TRUE ;
+
+  return NULL ;
+}
+
+
+/*
+ * piSpinStart:
+ *	Start the busy-poll thread on the given CPU (or anywhere if it's
+ *	< 0), SCHED_FIFO at prio - or an ordinary thread if prio is 0, or
+ *	we're not allowed. All the program's memory is locked, now and to
+ *	come. It's not an error to start it twice.
+ *	Returns 0 or -1 with errno set.
+ *********************************************************************************
+ */
+
+int piSpinStart (int cpu, int prio)
+{
+  unsigned int cpuMask = ((cpu >= 0) && (cpu < 32)) ? (1u << cpu) : 0 ;
+  int res = EPERM ;
+
+  pthread_mutex_lock (&spinLock) ;
+
+  if (spinRunning)
+  {
+    pthread_mutex_unlock (&spinLock) ;
+    return 0 ;
+  }
+
+  (void)mlockall (MCL_CURRENT | MCL_FUTURE) ;	// Only if we're allowed
+
+  spinRunning = TRUE ;
+  spinExited  = FALSE ;
+
+  if (prio > 0)
+    res = piThreadCreateRT (spinThread, NULL, SCHED_FIFO, prio, cpuMask, 0) ;
+  if (res == EPERM)
+    res = piThreadCreateRT (spinThread, NULL, SCHED_OTHER, 0, cpuMask, 0) ;
+
+  if (res != 0)
+  {
+    spinRunning = FALSE ;
+    pthread_mutex_unlock (&spinLock) ;
+    errno = res ;
+    return -1 ;
+  }
+
+  pthread_mutex_unlock (&spinLock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * piSpinActive:
+ *	Is it running? The engines look at this as they start.
+ *********************************************************************************
+ */
+
+int piSpinActive (void)
+{
+  return spinRunning ;
+}
+
+
+/*
+ * piSpinAdd:
+ *	Have fn (ctx, now) called every time round, now being the nanos64 ()
+ *	time the pass read. budgetNs is how long it should ever take. gone
+ *	(ctx), if it's not NULL, is called by piSpinStop () if the task's
+ *	still there then - not if it's removed, or fn returns FALSE.
+ *	Returns a task number, or -1 if the executive isn't running or
+ *	there's no room.
+ *********************************************************************************
+ */
+
+int piSpinAdd (int (*fn)(void *ctx, unsigned long long now), void (*gone)(void *ctx), void *ctx, unsigned int budgetNs)
+{
+  struct spinTaskStruct *t ;
+  int task ;
+
+  if ((fn == NULL) || !spinRunning)
+    return -1 ;
+
+  pthread_mutex_lock (&spinLock) ;
+
+  for (task = 0 ; task < MAX_SPIN_TASKS ; ++task)
+    if (spinTasks [task].fn == NULL)
+      break ;
+
+  if (task == MAX_SPIN_TASKS)
+  {
+    pthread_mutex_unlock (&spinLock) ;
+    return -1 ;
+  }
+
+  t = &spinTasks [task] ;
+  t->gone       = gone ;
+  t->ctx        = ctx ;
+  t->gen        = (t->gen + 1) & SPIN_GEN_MAX ;
+  t->budgetNs   = budgetNs ;
+  t->maxNs      = 0 ;
+  t->overBudget = 0 ;
+  __atomic_store_n (&t->fn, fn, __ATOMIC_RELEASE) ;
+
+  pthread_mutex_unlock (&spinLock) ;
+
+  return (int)(t->gen * MAX_SPIN_TASKS) + task ;
+}
+
+
+/*
+ * spinFind:
+ *	Turn a task number back into its slot - if it's still that task's.
+ *	Called with the lock held.
+ *********************************************************************************
+ */
+
+static struct spinTaskStruct *spinFind (int task)
+{
+  struct spinTaskStruct *t ;
+
+  if (task < 0)
+    return NULL ;
+
+  t = &spinTasks [task % MAX_SPIN_TASKS] ;
+
+  if ((t->fn == NULL) || (t->gen != (unsigned int)(task / MAX_SPIN_TASKS)))
+    return NULL ;
+
+  return t ;
+}
+
+
+/*
+ * spinSettle:
+ *	Wait till the thread's been all the way round since now, so nothing
+ *	it had picked up before is still being called. Not on the thread.
+ *********************************************************************************
+ */
+
+static void spinSettle (void)
+{
+  unsigned int pass = __atomic_load_n (&spinPasses, __ATOMIC_ACQUIRE) ;
+
+  if (pthread_equal (pthread_self (), spinThreadId))
+    return ;
+
+  while (spinRunning && !spinExited && (__atomic_load_n (&spinPasses, __ATOMIC_ACQUIRE) - pass < 2))
+    sched_yield () ;
+}
+
+
+/*
+ * piSpinRemove:
+ *	Stop calling a task. Once it returns the function won't be called
+ *	again (unless it's called from a task, which is fine too). A task
+ *	that's already finished is left alone, as is the slot's new owner.
+ *********************************************************************************
+ */
+
+void piSpinRemove (int task)
+{
+  struct spinTaskStruct *t ;
+
+  pthread_mutex_lock (&spinLock) ;
+
+  if ((t = spinFind (task)) == NULL)
+  {
+    pthread_mutex_unlock (&spinLock) ;
+    return ;
+  }
+
+  __atomic_store_n (&t->fn, NULL, __ATOMIC_RELEASE) ;
+
+  pthread_mutex_unlock (&spinLock) ;
+
+  spinSettle () ;
+}
+
+
+/*
+ * piSpinStats:
+ *	The longest a task's taken (nS) and how many times it's gone over its
+ *	budget, since the last call. Either pointer can be NULL.
+ *	Returns 0 or -1 for no such task.
+ *********************************************************************************
+ */
+
+int piSpinStats (int task, unsigned int *maxNs, unsigned int *overBudget)
+{
+  struct spinTaskStruct *t ;
+
+  pthread_mutex_lock (&spinLock) ;
+
+  if ((t = spinFind (task)) == NULL)
+  {
+    pthread_mutex_unlock (&spinLock) ;
+    return -1 ;
+  }
+
+  if (maxNs != NULL)
+    *maxNs = t->maxNs ;
+  if (overBudget != NULL)
+    *overBudget = t->overBudget ;
+
+  t->maxNs = t->overBudget = 0 ;
+
+  pthread_mutex_unlock (&spinLock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * piSpinStop:
+ *	Stop the thread, and so everything on it, and give the CPU back.
+ *	The tasks still there have their gone functions called, once the
+ *	thread's stopped, so the engines know. Not from a task.
+ *********************************************************************************
+ */
+
+void piSpinStop (void)
+{
+  void (*gone)(void *) ;
+  void  *ctx ;
+  int    i ;
+
+  pthread_mutex_lock (&spinLock) ;
+
+  if (!spinRunning)
+  {
+    pthread_mutex_unlock (&spinLock) ;
+    return ;
+  }
+
+  spinRunning = FALSE ;
+
+  pthread_mutex_unlock (&spinLock) ;
+
+  while (!spinExited)
+    sched_yield () ;
+
+  for (i = 0 ; i < MAX_SPIN_TASKS ; ++i)
+  {
+    pthread_mutex_lock (&spinLock) ;
+
+    if (spinTasks [i].fn == NULL)
+    {
+      pthread_mutex_unlock (&spinLock) ;
+      continue ;
+    }
+
+    gone = spinTasks [i].gone ;
+    ctx  = spinTasks [i].ctx ;
+    spinTasks [i].fn = NULL ;
+
+    pthread_mutex_unlock (&spinLock) ;
+
+    if (gone != NULL)
+      gone (ctx) ;
+  }
+}
@@ -23,10 +23,42 @@
  ***********************************************************************
  */
 
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
 #include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 #include "wiringPi.h"
+#include "piThread.h"
 
-static pthread_mutex_t piMutexes [4] ;
+// Keys 0-3 are the original 4 plain mutexes, always there. piLockCreate
+//	hands out the rest.
+
+#define	MAX_PI_LOCKS	64
+
+struct piLockStruct
+{
+  int             type ;		// -1 for not in use
+  pthread_mutex_t mutex ;
+  unsigned int    next ;		// Ticket locks
+  unsigned int    serving ;
+} ;
+
+static struct piLockStruct piLocks [MAX_PI_LOCKS] =
+{
+  { PI_LOCK_NORMAL, PTHREAD_MUTEX_INITIALIZER, 0, 0 },
+  { PI_LOCK_NORMAL, PTHREAD_MUTEX_INITIALIZER, 0, 0 },
+  { PI_LOCK_NORMAL, PTHREAD_MUTEX_INITIALIZER, 0, 0 },
+  { PI_LOCK_NORMAL, PTHREAD_MUTEX_INITIALIZER, 0, 0 },
+} ;
+
+static pthread_mutex_t piLockTable = PTHREAD_MUTEX_INITIALIZER ;
+static int             numPiLocks  = 4 ;
 
 
 
@@ -43,21 +75,492 @@ int piThreadCreate (void *(*fn)(void *))
   return pthread_create (&myThread, NULL, fn, NULL) ;
 }
 
+
+/*
+ * piThreadCreateRT:
+ *	Create and start a thread with arg, with its scheduling set before it
+ *	runs: policy is SCHED_FIFO, SCHED_RR or SCHED_OTHER at priority prio,
+ *	kept to the CPUs in cpuMask (0 for any) with a stack of stackSize
+ *	bytes (0 for the default). Its stack is faulted in before fn is
+ *	called.
+ *	Returns 0 or an error number, as pthread_create - EPERM if we're not
+ *	allowed real-time scheduling.
+ *********************************************************************************
+ */
+
+struct rtStartStruct
+{
+  void *(*fn)(void *) ;
+  void  *arg ;
+} ;
+
+static void *rtStart (void *start)
+{
+  struct rtStartStruct s = *(struct rtStartStruct *)start ;
+
+  free (start) ;
+  piRtStackPrefault () ;
+
+  return s.fn (s.arg) ;
+}
+
+int piThreadCreateRT (void *(*fn)(void *), void *arg, int policy, int prio, unsigned int cpuMask, unsigned int stackSize)
+{
+  struct rtStartStruct *start ;
+  struct sched_param sched ;
+  pthread_attr_t attr ;
+  pthread_t myThread ;
+  cpu_set_t cpus ;
+  int cpu, res ;
+
+  if ((start = malloc (sizeof (*start))) == NULL)
+    return EAGAIN ;
+
+  start->fn  = fn ;
+  start->arg = arg ;
+
+  memset (&sched, 0, sizeof (sched)) ;
+  sched.sched_priority = prio ;
+
+  pthread_attr_init (&attr) ;
+  pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED) ;
+  pthread_attr_setinheritsched (&attr, PTHREAD_EXPLICIT_SCHED) ;
+
+  if (((res = pthread_attr_setschedpolicy (&attr, policy))  == 0) &&
+      ((res = pthread_attr_setschedparam  (&attr, &sched))  == 0) &&
+      ((stackSize == 0) || ((res = pthread_attr_setstacksize (&attr, stackSize)) == 0)))
+  {
+    if (cpuMask != 0)
+    {
+      CPU_ZERO (&cpus) ;
+      for (cpu = 0 ; cpu < 32 ; ++cpu)
+	if ((cpuMask & (1u << cpu)) != 0)
+	  CPU_SET (cpu, &cpus) ;
+      res = pthread_attr_setaffinity_np (&attr, sizeof (cpus), &cpus) ;
+    }
+
+    if (res == 0)
+      res = pthread_create (&myThread, &attr, rtStart, start) ;
+  }
+
+  pthread_attr_destroy (&attr) ;
+
+  if (res != 0)
+    free (start) ;
+
+  return res ;
+}
+
+
+/*
+ * piMutexInit:
+ *	Initialise a mutex of one of the PI_LOCK_ types (bar the ticket
+ *	lock, which isn't a mutex), recursive or not. The library's own bus
+ *	locks use this with PI_LOCK_PI, so a real-time thread waiting on one
+ *	lends its priority to whoever has it.
+ *	Returns 0 or an error number, as pthread_mutex_init.
+ *********************************************************************************
+ */
+
+int piMutexInit (pthread_mutex_t *mutex, int type, int recursive)
+{
+  pthread_mutexattr_t attr ;
+  int res ;
+
+  pthread_mutexattr_init (&attr) ;
+
+  /**/ if (recursive)
+    pthread_mutexattr_settype (&attr, PTHREAD_MUTEX_RECURSIVE) ;
+  else if (type == PI_LOCK_ADAPTIVE)
+    pthread_mutexattr_settype (&attr, PTHREAD_MUTEX_ADAPTIVE_NP) ;
+
+  if (type == PI_LOCK_PI)
+    pthread_mutexattr_setprotocol (&attr, PTHREAD_PRIO_INHERIT) ;
+
+  res = pthread_mutex_init (mutex, &attr) ;
+  pthread_mutexattr_destroy (&attr) ;
+
+  return res ;
+}
+
+
+/*
+ * piFutexWait: piFutexWake:
+ *	For the words in the library's shared memory segments: sleep while
+ *	*addr is val (for up to timeout, NULL for ever), and wake up to count
+ *	of those sleeping. The segments are shared between processes, so no
+ *	FUTEX_PRIVATE_FLAG. piFutexWait returns 0 or -1 with errno set -
+ *	ETIMEDOUT, or EAGAIN if *addr wasn't val.
+ *********************************************************************************
+ */
+
+int piFutexWait (uint32_t *addr, uint32_t val, const struct timespec *timeout)
+{
+  return (syscall (SYS_futex, addr, FUTEX_WAIT, val, timeout, NULL, 0) < 0) ? -1 : 0 ;
+}
+
+void piFutexWake (uint32_t *addr, int count)
+{
+  (void)syscall (SYS_futex, addr, FUTEX_WAKE, count, NULL, NULL, 0) ;
+}
+
+
+/*
+ * piLockCreate:
+ *	Make a new lock for piLock/piUnlock:
+ *	  PI_LOCK_NORMAL:   A plain mutex, like keys 0-3
+ *	  PI_LOCK_PI:       Priority inheritance - for locks real-time threads share
+ *	  PI_LOCK_ADAPTIVE: Spins a little before sleeping - for locks held briefly
+ *	  PI_LOCK_TICKET:   First come, first served - spins, yielding the CPU
+ *	Returns the key or -1.
+ *********************************************************************************
+ */
+
+int piLockCreate (int type)
+{
+  struct piLockStruct *lock ;
+  int key ;
+
+  if ((type < PI_LOCK_NORMAL) || (type > PI_LOCK_TICKET))
+    return -1 ;
+
+  pthread_mutex_lock (&piLockTable) ;
+
+  if (numPiLocks == MAX_PI_LOCKS)
+  {
+    pthread_mutex_unlock (&piLockTable) ;
+    return -1 ;
+  }
+
+  key  = numPiLocks ;
+  lock = &piLocks [key] ;
+
+  lock->next = lock->serving = 0 ;
+  if ((type != PI_LOCK_TICKET) && (piMutexInit (&lock->mutex, type, FALSE) != 0))
+  {
+    pthread_mutex_unlock (&piLockTable) ;
+    return -1 ;
+  }
+  lock->type = type ;
+
+  __atomic_store_n (&numPiLocks, key + 1, __ATOMIC_RELEASE) ;
+
+  pthread_mutex_unlock (&piLockTable) ;
+
+  return key ;
+}
+
+
 /*
  * piLock: piUnlock:
- *	Activate/Deactivate a mutex.
- *	We're keeping things simple here and only tracking 4 mutexes which
- *	is more than enough for out entry-level pthread programming
+ *	Activate/Deactivate a lock - one of the original 4 mutexes or one
+ *	from piLockCreate. Keys that don't exist are ignored.
  *********************************************************************************
  */
 
 void piLock (int key)
 {
-  pthread_mutex_lock (&piMutexes [key]) ;
+  struct piLockStruct *lock ;
+  unsigned int ticket ;
+  int spins ;
+
+  if ((key < 0) || (key >= __atomic_load_n (&numPiLocks, __ATOMIC_ACQUIRE)))
+    return ;
+
+  lock = &piLocks [key] ;
+
+  if (lock->type != PI_LOCK_TICKET)
+  {
+    pthread_mutex_lock (&lock->mutex) ;
+    return ;
+  }
+
+  ticket = __atomic_fetch_add (&lock->next, 1, __ATOMIC_RELAXED) ;
+
+  for (spins = 0 ; __atomic_load_n (&lock->serving, __ATOMIC_ACQUIRE) != ticket ; ++spins)
+    if (spins > 100)
+      sched_yield () ;
 }
 
 void piUnlock (int key)
 {
-  pthread_mutex_unlock (&piMutexes [key]) ;
+  struct piLockStruct *lock ;
+
+  if ((key < 0) || (key >= __atomic_load_n (&numPiLocks, __ATOMIC_ACQUIRE)))
+    return ;
+
+  lock = &piLocks [key] ;
+
+  if (lock->type != PI_LOCK_TICKET)
+    pthread_mutex_unlock (&lock->mutex) ;
+  else
+    __atomic_store_n (&lock->serving, lock->serving + 1, __ATOMIC_RELEASE) ;
 }
 
+
+/*
+ * Lock-free rings:
+ *	A ring of fixed size elements, for handing data from one thread to
+ *	another without locks. SPSC: one thread pushes and one pops. MPSC: any
+ *	number of threads push - each reserves its slots by moving head on
+ *	with a compare and swap, then marks each slot filled with its position
+ *	so the one consumer only takes slots that are ready.
+ *	head and tail are on cache lines of their own, so the producer(s) and
+ *	the consumer aren't forever stealing the line from each other.
+ *
+ *	With wakeup, the ring has an eventfd that's readable while there's
+ *	anything in it - push only writes it when the ring was empty, and
+ *	pop only clears it when it leaves the ring empty - so a consumer can
+ *	poll or epoll for data at a cost of a system call per batch, not per
+ *	element.
+ *********************************************************************************
+ */
+
+#define	CACHE_LINE	64
+
+struct piRingStruct
+{
+  unsigned int   head __attribute__ ((aligned (CACHE_LINE))) ;	// Producer(s)
+  unsigned int   tail __attribute__ ((aligned (CACHE_LINE))) ;	// Consumer
+  unsigned char *data __attribute__ ((aligned (CACHE_LINE))) ;
+  unsigned int  *seq ;			// MPSC: position + 1 once a slot's filled
+  unsigned int   mask ;
+  unsigned int   elemSize ;
+  int            type ;
+  int            fd ;
+} ;
+
+
+/*
+ * piRingCreate:
+ *	Make a ring of at least count elements (rounded up to a power of 2)
+ *	of elemSize bytes each. type is PI_RING_SPSC or PI_RING_MPSC, and
+ *	wakeup TRUE for an eventfd - see piRingFd.
+ *	Returns the ring or NULL.
+ *********************************************************************************
+ */
+
+struct piRingStruct *piRingCreate (int type, unsigned int elemSize, unsigned int count, int wakeup)
+{
+  struct piRingStruct *ring ;
+  void *mem ;
+  unsigned int size = 2 ;
+
+  if (((type != PI_RING_SPSC) && (type != PI_RING_MPSC)) || (elemSize == 0) || (count > 0x40000000))
+    return NULL ;
+
+  while (size < count)
+    size <<= 1 ;
+
+  if (posix_memalign (&mem, CACHE_LINE, sizeof (struct piRingStruct)) != 0)
+    return NULL ;
+
+  ring = (struct piRingStruct *)mem ;
+  memset (ring, 0, sizeof (*ring)) ;
+
+  ring->mask     = size - 1 ;
+  ring->elemSize = elemSize ;
+  ring->type     = type ;
+  ring->fd       = -1 ;
+  ring->data     = malloc ((size_t)size * elemSize) ;
+
+  if (type == PI_RING_MPSC)
+    ring->seq = calloc (size, sizeof (unsigned int)) ;
+
+  if (wakeup)
+    ring->fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC) ;
+
+  if ((ring->data == NULL) || ((type == PI_RING_MPSC) && (ring->seq == NULL)) || (wakeup && (ring->fd < 0)))
+  {
+    piRingFree (ring) ;
+    return NULL ;
+  }
+
+  return ring ;
+}
+
+
+/*
+ * piRingFree:
+ *	Nobody must be using it any more
+ *********************************************************************************
+ */
+
+void piRingFree (struct piRingStruct *ring)
+{
+  if (ring == NULL)
+    return ;
+
+  if (ring->fd >= 0)
+    close (ring->fd) ;
+
+  free (ring->seq) ;
+  free (ring->data) ;
+  free (ring) ;
+}
+
+
+/*
+ * ringCopy:
+ *	Copy n elements between a buffer and the ring from position pos,
+ *	in at most two pieces for the wrap.
+ *********************************************************************************
+ */
+
+static void ringCopy (struct piRingStruct *ring, unsigned int pos, void *buf, unsigned int n, int in)
+{
+  unsigned int start = pos & ring->mask ;
+  unsigned int first = ring->mask + 1 - start ;
+  unsigned char *ringData = ring->data + (size_t)start * ring->elemSize ;
+
+  if (first > n)
+    first = n ;
+
+  if (in)
+  {
+    memcpy (ringData, buf, (size_t)first * ring->elemSize) ;
+    memcpy (ring->data, (unsigned char *)buf + (size_t)first * ring->elemSize, (size_t)(n - first) * ring->elemSize) ;
+  }
+  else
+  {
+    memcpy (buf, ringData, (size_t)first * ring->elemSize) ;
+    memcpy ((unsigned char *)buf + (size_t)first * ring->elemSize, ring->data, (size_t)(n - first) * ring->elemSize) ;
+  }
+}
+
+
+/*
+ * piRingPush:
+ *	Add up to n elements, as many as there's room for. Returns how many.
+ *********************************************************************************
+ */
+
+unsigned int piRingPush (struct piRingStruct *ring, const void *elems, unsigned int n)
+{
+  uint64_t one = 1 ;
+  unsigned int head, space, i ;
+
+  for (;;)
+  {
+    head  = __atomic_load_n (&ring->head, __ATOMIC_RELAXED) ;
+    space = ring->mask + 1 - (head - __atomic_load_n (&ring->tail, __ATOMIC_ACQUIRE)) ;
+    if (n > space)
+      n = space ;
+    if (n == 0)
+      return 0 ;
+
+    if (ring->type == PI_RING_SPSC)
+      break ;
+
+    if (__atomic_compare_exchange_n (&ring->head, &head, head + n, TRUE, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+      break ;
+  }
+
+  ringCopy (ring, head, (void *)elems, n, TRUE) ;
+
+  if (ring->type == PI_RING_SPSC)
+    __atomic_store_n (&ring->head, head + n, __ATOMIC_RELEASE) ;
+  else
+    for (i = 0 ; i < n ; ++i)
+      __atomic_store_n (&ring->seq [(head + i) & ring->mask], head + i + 1, __ATOMIC_RELEASE) ;
+
+// Wake the consumer if it could have seen the ring empty
+
+  if (ring->fd >= 0)
+  {
+    __atomic_thread_fence (__ATOMIC_SEQ_CST) ;
+    if (__atomic_load_n (&ring->tail, __ATOMIC_RELAXED) == head)
+    {
+      (void)write (ring->fd, &one, sizeof (one)) ;
+
+// It may have all gone again before that landed, the consumer clearing
+//	the eventfd before we set it: then clear it ourselves - and set it
+//	again if anything came in while we did
+
+      __atomic_thread_fence (__ATOMIC_SEQ_CST) ;
+      if (__atomic_load_n (&ring->tail, __ATOMIC_RELAXED) == __atomic_load_n (&ring->head, __ATOMIC_RELAXED))
+      {
+	(void)read (ring->fd, &one, sizeof (one)) ;
+	__atomic_thread_fence (__ATOMIC_SEQ_CST) ;
+	if (__atomic_load_n (&ring->tail, __ATOMIC_RELAXED) != __atomic_load_n (&ring->head, __ATOMIC_RELAXED))
+	  (void)write (ring->fd, &one, sizeof (one)) ;
+      }
+    }
+  }
+
+  return n ;
+}
+
+
+/*
+ * piRingPop:
+ *	Take up to max elements, oldest first. Doesn't block.
+ *	Returns how many.
+ *********************************************************************************
+ */
+
+unsigned int piRingPop (struct piRingStruct *ring, void *elems, unsigned int max)
+{
+  uint64_t value ;
+  unsigned int tail, n ;
+
+  tail = __atomic_load_n (&ring->tail, __ATOMIC_RELAXED) ;
+
+  if (ring->type == PI_RING_SPSC)
+  {
+    n = __atomic_load_n (&ring->head, __ATOMIC_ACQUIRE) - tail ;
+    if (n > max)
+      n = max ;
+  }
+  else
+    for (n = 0 ; n < max ; ++n)
+      if (__atomic_load_n (&ring->seq [(tail + n) & ring->mask], __ATOMIC_ACQUIRE) != tail + n + 1)
+	break ;
+
+  if (n > 0)
+  {
+    ringCopy (ring, tail, elems, n, FALSE) ;
+    __atomic_store_n (&ring->tail, tail + n, __ATOMIC_RELEASE) ;
+  }
+
+// Left it empty? Clear the eventfd - and set it again if anything came
+//	in while we did
+
+  if (ring->fd >= 0)
+  {
+    __atomic_thread_fence (__ATOMIC_SEQ_CST) ;
+    if (__atomic_load_n (&ring->head, __ATOMIC_RELAXED) == tail + n)
+    {
+      (void)read (ring->fd, &value, sizeof (value)) ;
+      __atomic_thread_fence (__ATOMIC_SEQ_CST) ;
+      if (__atomic_load_n (&ring->head, __ATOMIC_RELAXED) != tail + n)
+	(void)write (ring->fd, &value, sizeof (value)) ;
+    }
+  }
+
+  return n ;
+}
+
+
+/*
+ * piRingCount: piRingSpace: piRingFd:
+ *	How much is in the ring, how much room is left, and the eventfd to
+ *	wait on for data (-1 if it was made without one).
+ *	With MPSC the count includes slots still being filled.
+ *********************************************************************************
+ */
+
+unsigned int piRingCount (struct piRingStruct *ring)
+{
+  return __atomic_load_n (&ring->head, __ATOMIC_ACQUIRE) - __atomic_load_n (&ring->tail, __ATOMIC_ACQUIRE) ;
+}
+
+unsigned int piRingSpace (struct piRingStruct *ring)
+{
+  return ring->mask + 1 - piRingCount (ring) ;
+}
+
+int piRingFd (struct piRingStruct *ring)
+{
+  return ring->fd ;
+}
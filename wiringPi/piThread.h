@@ -0,0 +1,41 @@
+/*
+ * piThread.h:
+ *	Mutexes with the PI_LOCK_ behaviours, for the rest of wiringPi and
+ *	anyone else with a pthread_mutex_t of their own.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int piMutexInit (pthread_mutex_t *mutex, int type, int recursive) ;
+
+extern int  piFutexWait (uint32_t *addr, uint32_t val, const struct timespec *timeout) ;
+extern void piFutexWake (uint32_t *addr, int count) ;
+
+#ifdef __cplusplus
+}
+#endif
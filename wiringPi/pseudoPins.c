@@ -35,61 +35,933 @@
 #define	SHARED_NAME	"wiringPiPseudoPins"
 #define	PSEUDO_PINS	64
 
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <sched.h>
+#include <time.h>
+#include <errno.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
 
 #include <wiringPi.h>
 
 #include "pseudoPins.h"
+#include "piThread.h"
+
+// The shared memory starts with a header, then a sequence count for each
+//	block of PSEUDO_BLOCK pins, then each block's owner, then the pins
+//	themselves, then the channel table and the pool their values live in.
+//	A sequence count is odd while someone is writing to its block - it's
+//	how readers know to try again. The owner is the lock writers take:
+//	0 when free, else the writer's pid, so anyone kept waiting for long
+//	can see if the writer's died and take it over - or if they're only
+//	reading, put the count right and let it go.
+//	changes goes up on every write, and is what pseudoPinsWait sleeps on.
+
+#define	PSEUDO_MAGIC	0x50535031	// "PSP1"
+#define	PSEUDO_VERSION	3
+#define	LOCK_SPINS	65536		// Tries before looking at the owner
+#define	PSEUDO_BLOCK	64
+#define	PSEUDO_MAX_PINS	65536
+#define	PSEUDO_POOL	65536		// Bytes for all the channels' values
+#define	MAX_PSEUDO	8
+#define	MAX_WATCH	64
+
+struct pseudoPinsShmStruct
+{
+  uint32_t magic ;		// Set last, once the rest is ready
+  uint32_t version ;
+  uint32_t numPins ;
+  uint32_t changes ;
+  uint32_t waiters ;
+  uint32_t chanLock ;		// Held while a channel's being made
+  uint32_t poolUsed ;
+  uint32_t pad ;
+  uint32_t data [] ;		// Sequence counts, then the pins
+} ;
+
+// A channel has a sequence count of its own, like a block of pins, so a
+//	value of any size is read whole. type is set last, when the rest is
+//	ready; 0 is a free slot.
+
+struct pseudoChannelShmStruct
+{
+  uint32_t seq ;
+  uint32_t owner ;
+  uint32_t type ;		// PSEUDO_INT64, ...
+  uint32_t size ;		// Bytes
+  uint32_t offset ;		// Into the pool
+  char     name [PSEUDO_CHANNEL_NAME] ;
+} ;
+
+// Pins with a wiringPiISR (): zero is LOW, anything else HIGH, and an
+//	edge is a change in that seen by the node's watcher thread.
+
+struct pseudoWatchStruct
+{
+  int pin ;			// On the node
+  int level ;
+} ;
+
+struct pseudoPinsStruct
+{
+  struct wiringPiNodeStruct  *node ;
+  struct pseudoPinsShmStruct *shm ;
+  uint32_t                   *seq ;
+  uint32_t                   *owner ;
+  int                        *pins ;
+  int                         numPins ;		// 0 for a node of channels
+  struct pseudoChannelShmStruct *channels ;
+  uint8_t                    *pool ;
+  struct pseudoWatchStruct    watch [MAX_WATCH] ;
+  int                         numWatch ;
+  int                         watching ;
+} ;
+
+static pthread_mutex_t watchLock = PTHREAD_MUTEX_INITIALIZER ;
+
+static struct pseudoPinsStruct pseudos [MAX_PSEUDO] ;
+static uint32_t                myPid ;
+
+#define	BLOCKS(n)	(((n) + PSEUDO_BLOCK - 1) / PSEUDO_BLOCK)
+#define	CHAN_OFFSET(n)	((((2 * BLOCKS (n) + (n)) * sizeof (uint32_t)) + 7) & ~7)
+#define	POOL_OFFSET(n)	(CHAN_OFFSET (n) + PSEUDO_MAX_CHANNELS * sizeof (struct pseudoChannelShmStruct))
+#define	SHM_SIZE(n)	(sizeof (struct pseudoPinsShmStruct) + POOL_OFFSET (n) + PSEUDO_POOL)
+
+
+/*
+ * findPseudo:
+ * findPseudoPin:
+ *	Find our state for a node (or a free slot for NULL) or for any pin on it
+ *********************************************************************************
+ */
+
+static struct pseudoPinsStruct *findPseudo (struct wiringPiNodeStruct *node)
+{
+  int i ;
+
+  for (i = 0 ; i < MAX_PSEUDO ; ++i)
+    if (pseudos [i].node == node)
+      return &pseudos [i] ;
+
+  return NULL ;
+}
+
+static struct pseudoPinsStruct *findPseudoPin (const int pin, int *myPin)
+{
+  struct wiringPiNodeStruct *node ;
+  struct pseudoPinsStruct *p ;
+
+  if (((node = wiringPiFindNode (pin)) == NULL) || ((p = findPseudo (node)) == NULL))
+    return NULL ;
+
+  *myPin = pin - p->node->pinBase ;
+
+  return p ;
+}
+
+
+/*
+ * seqLock:
+ * seqUnlock:
+ *	Take the owner word (taking it over from a writer that's died) and
+ *	make the sequence count odd - unless it's been left odd, by that
+ *	writer - then back to even and free again after.
+ *********************************************************************************
+ */
+
+static int ownerGone (uint32_t owner)
+{
+  return (owner != 0) && (owner != myPid) && (kill ((pid_t)owner, 0) < 0) && (errno == ESRCH) ;
+}
+
+static void seqLock (uint32_t *seq, uint32_t *owner)
+{
+  unsigned int spins = 0 ;
+  uint32_t old ;
+
+  for (;;)
+  {
+    old = 0 ;
+    if (__atomic_compare_exchange_n (owner, &old, myPid, FALSE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      break ;
+
+    if ((++spins % LOCK_SPINS) == 0)
+    {
+      if (ownerGone (old) && __atomic_compare_exchange_n (owner, &old, myPid, FALSE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+	break ;
+      sched_yield () ;
+    }
+  }
+
+  if ((__atomic_load_n (seq, __ATOMIC_RELAXED) & 1) == 0)
+    __atomic_add_fetch (seq, 1, __ATOMIC_ACQUIRE) ;
+}
+
+static void seqUnlock (uint32_t *seq, uint32_t *owner)
+{
+  __atomic_add_fetch (seq, 1, __ATOMIC_RELEASE) ;
+  __atomic_store_n   (owner, 0, __ATOMIC_RELEASE) ;
+}
+
+
+/*
+ * seqBegin:
+ *	Readers: wait for a sequence count to be even and return it. If it
+ *	stays odd and the writer's died, take the lock and give it straight
+ *	back to put it right.
+ *********************************************************************************
+ */
+
+static uint32_t seqBegin (uint32_t *seq, uint32_t *owner)
+{
+  unsigned int spins = 0 ;
+  uint32_t before, old ;
+
+  while (((before = __atomic_load_n (seq, __ATOMIC_ACQUIRE)) & 1) != 0)
+  {
+    if ((++spins % LOCK_SPINS) != 0)
+      continue ;
+
+    old = __atomic_load_n (owner, __ATOMIC_RELAXED) ;
+    if (ownerGone (old) && __atomic_compare_exchange_n (owner, &old, myPid, FALSE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    {
+      if ((__atomic_load_n (seq, __ATOMIC_RELAXED) & 1) != 0)
+	__atomic_add_fetch (seq, 1, __ATOMIC_RELEASE) ;
+      __atomic_store_n (owner, 0, __ATOMIC_RELEASE) ;
+    }
+    else
+      sched_yield () ;
+  }
+
+  return before ;
+}
+
+
+/*
+ * lockBlocks:
+ * unlockBlocks:
+ *	Writers: lock the blocks holding pins first to last, in order so two
+ *	writers can't deadlock, then unlock them after and wake anyone
+ *	waiting for a change.
+ *********************************************************************************
+ */
+
+static void lockBlocks (struct pseudoPinsStruct *p, int first, int last)
+{
+  int b ;
+
+  for (b = first / PSEUDO_BLOCK ; b <= last / PSEUDO_BLOCK ; ++b)
+    seqLock (&p->seq [b], &p->owner [b]) ;
+}
+
+static void unlockBlocks (struct pseudoPinsStruct *p, int first, int last)
+{
+  int b ;
+
+  for (b = first / PSEUDO_BLOCK ; b <= last / PSEUDO_BLOCK ; ++b)
+    seqUnlock (&p->seq [b], &p->owner [b]) ;
+
+  __atomic_add_fetch (&p->shm->changes, 1, __ATOMIC_SEQ_CST) ;
+
+  if (__atomic_load_n (&p->shm->waiters, __ATOMIC_SEQ_CST) != 0)
+    piFutexWake (&p->shm->changes, INT32_MAX) ;
+}
+
+
+/*
+ * myAnalogRead:
+ * myAnalogWrite:
+ *	A single pin is always consistent on its own, so reads don't need
+ *	the sequence count.
+ *********************************************************************************
+ */
 
 static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
 {
-  int *ptr   = (int *)node->data0 ;
-  int  myPin = pin - node->pinBase ;
+  struct pseudoPinsStruct *p = findPseudo (node) ;
 
-  return *(ptr + myPin) ;
+  return __atomic_load_n (&p->pins [pin - node->pinBase], __ATOMIC_ACQUIRE) ;
 }
 
 
 static void myAnalogWrite (struct wiringPiNodeStruct *node, int pin, int value)
 {
-  int *ptr   = (int *)node->data0 ;
+  struct pseudoPinsStruct *p = findPseudo (node) ;
   int  myPin = pin - node->pinBase ;
 
-  *(ptr + myPin) = value ;
+  lockBlocks   (p, myPin, myPin) ;
+    __atomic_store_n (&p->pins [myPin], value, __ATOMIC_RELAXED) ;
+  unlockBlocks (p, myPin, myPin) ;
 }
 
 
 /*
- * pseudoPinsSetup:
- *	Create a new wiringPi device node for the pseudoPins driver
+ * pseudoPinsWriteMulti:
+ *	Write count pins starting at pin, all at once as far as any
+ *	pseudoPinsRead is concerned.
+ *	Returns 0 or -1 if they're not all pseudo pins on the same node.
  *********************************************************************************
  */
 
-int pseudoPinsSetup (const int pinBase)
+int pseudoPinsWriteMulti (const int pin, const int *values, const int count)
+{
+  struct pseudoPinsStruct *p ;
+  int myPin, i ;
+
+  if (((p = findPseudoPin (pin, &myPin)) == NULL) || (count < 1) || (myPin + count > p->numPins))
+    return -1 ;
+
+  lockBlocks   (p, myPin, myPin + count - 1) ;
+    for (i = 0 ; i < count ; ++i)
+      __atomic_store_n (&p->pins [myPin + i], values [i], __ATOMIC_RELAXED) ;
+  unlockBlocks (p, myPin, myPin + count - 1) ;
+
+  return 0 ;
+}
+
+
+/*
+ * pseudoPinsRead:
+ *	Take a consistent snapshot of count pins starting at pin - no write
+ *	(or pseudoPinsWriteMulti) will be half in it. We only wait for a
+ *	writer that's part way through; we try again if one got in while we
+ *	were copying.
+ *	Returns 0 or -1 as above.
+ *********************************************************************************
+ */
+
+int pseudoPinsRead (const int pin, int *values, const int count)
+{
+  struct pseudoPinsStruct *p ;
+  uint32_t before [PSEUDO_MAX_PINS / PSEUDO_BLOCK] ;
+  int myPin, first, last, b, i, again ;
+
+  if (((p = findPseudoPin (pin, &myPin)) == NULL) || (count < 1) || (myPin + count > p->numPins))
+    return -1 ;
+
+  first = myPin / PSEUDO_BLOCK ;
+  last  = (myPin + count - 1) / PSEUDO_BLOCK ;
+
+  do
+  {
+    for (b = first ; b <= last ; ++b)
+      before [b] = seqBegin (&p->seq [b], &p->owner [b]) ;
+
+    for (i = 0 ; i < count ; ++i)
+      values [i] = __atomic_load_n (&p->pins [myPin + i], __ATOMIC_RELAXED) ;
+
+    __atomic_thread_fence (__ATOMIC_ACQUIRE) ;
+
+    for (again = FALSE, b = first ; b <= last ; ++b)
+      if (__atomic_load_n (&p->seq [b], __ATOMIC_RELAXED) != before [b])
+	again = TRUE ;
+  }
+  while (again) ;
+
+  return 0 ;
+}
+
+
+/*
+ * pseudoPinsWait:
+ *	Wait for any pin on the node holding pin to be written. Pass in what
+ *	this returned last time (or 0 to start) and it returns as soon as
+ *	there's been a write since, or after timeoutMs (-1: forever) with the
+ *	same value back if not.
+ *********************************************************************************
+ */
+
+unsigned int pseudoPinsWait (const int pin, const unsigned int last, const int timeoutMs)
+{
+  struct pseudoPinsStruct *p ;
+  struct timespec now, end, left ;
+  uint32_t changes ;
+  int myPin ;
+
+  if ((p = findPseudoPin (pin, &myPin)) == NULL)
+    return last ;
+
+  if ((changes = __atomic_load_n (&p->shm->changes, __ATOMIC_ACQUIRE)) != last)
+    return changes ;
+
+  if (timeoutMs == 0)
+    return changes ;
+
+  clock_gettime (CLOCK_MONOTONIC, &end) ;
+  end.tv_sec  += timeoutMs / 1000 ;
+  end.tv_nsec += (timeoutMs % 1000) * 1000000 ;
+  if (end.tv_nsec >= 1000000000)
+  {
+    end.tv_nsec -= 1000000000 ;
+    ++end.tv_sec ;
+  }
+
+  __atomic_add_fetch (&p->shm->waiters, 1, __ATOMIC_SEQ_CST) ;
+
+  while ((changes = __atomic_load_n (&p->shm->changes, __ATOMIC_SEQ_CST)) == last)
+  {
+    if (timeoutMs > 0)
+    {
+      clock_gettime (CLOCK_MONOTONIC, &now) ;
+      left.tv_sec  = end.tv_sec  - now.tv_sec ;
+      left.tv_nsec = end.tv_nsec - now.tv_nsec ;
+      if (left.tv_nsec < 0)
+      {
+	left.tv_nsec += 1000000000 ;
+	--left.tv_sec ;
+      }
+      if (left.tv_sec < 0)
+	break ;
+    }
+
+    if ((piFutexWait (&p->shm->changes, last, (timeoutMs > 0) ? &left : NULL) < 0) && (errno == ETIMEDOUT))
+    {
+      changes = __atomic_load_n (&p->shm->changes, __ATOMIC_SEQ_CST) ;
+      break ;
+    }
+  }
+
+  __atomic_sub_fetch (&p->shm->waiters, 1, __ATOMIC_SEQ_CST) ;
+
+  return changes ;
+}
+
+
+/*
+ * watchThread:
+ * myIsr:
+ *	The node's isr op. A thread for the node sleeps in pseudoPinsWait -
+ *	on the futex - and looks at the watched pins after every write, from
+ *	this or any other process. A pin written and put back between two
+ *	looks doesn't make an edge.
+ *	INT_EDGE_SETUP stops watching a pin.
+ *********************************************************************************
+ */
+
+static void *watchThread (void *arg)
+{
+  struct pseudoPinsStruct  *p = (struct pseudoPinsStruct *)arg ;
+  struct pseudoWatchStruct  edges [MAX_WATCH] ;
+  unsigned int last = 0 ;
+  int i, n, level ;
+
+  for (;;)
+  {
+    last = pseudoPinsWait (p->node->pinBase, last, -1) ;
+
+    pthread_mutex_lock (&watchLock) ;
+      for (n = i = 0 ; i < p->numWatch ; ++i)
+      {
+	level = __atomic_load_n (&p->pins [p->watch [i].pin], __ATOMIC_ACQUIRE) != 0 ;
+	if (level == p->watch [i].level)
+	  continue ;
+	p->watch [i].level = level ;
+	edges [n].pin      = p->node->pinBase + p->watch [i].pin ;
+	edges [n].level    = level ;
+	++n ;
+      }
+    pthread_mutex_unlock (&watchLock) ;
+
+    for (i = 0 ; i < n ; ++i)
+      wiringPiNodeEdge (edges [i].pin, edges [i].level ? INT_EDGE_RISING : INT_EDGE_FALLING, 0) ;
+  }
+
+  return NULL ;
+}
+
+static int myIsr (struct wiringPiNodeStruct *node, int pin, int mode)
+{
+  struct pseudoPinsStruct *p = findPseudo (node) ;
+  pthread_t thread ;
+  int myPin = pin - node->pinBase ;
+  int i ;
+
+  pthread_mutex_lock (&watchLock) ;
+
+  for (i = 0 ; i < p->numWatch ; ++i)
+    if (p->watch [i].pin == myPin)
+      break ;
+
+  if (mode == INT_EDGE_SETUP)
+  {
+    if (i < p->numWatch)
+      p->watch [i] = p->watch [--p->numWatch] ;
+    pthread_mutex_unlock (&watchLock) ;
+    return 0 ;
+  }
+
+  if (i == p->numWatch)
+  {
+    if (p->numWatch == MAX_WATCH)
+    {
+      pthread_mutex_unlock (&watchLock) ;
+      return -1 ;
+    }
+    p->watch [i].pin   = myPin ;
+    p->watch [i].level = __atomic_load_n (&p->pins [myPin], __ATOMIC_ACQUIRE) != 0 ;
+    ++p->numWatch ;
+  }
+
+  if (!p->watching)
+  {
+    if (pthread_create (&thread, NULL, watchThread, p) != 0)
+    {
+      p->watch [i] = p->watch [--p->numWatch] ;
+      pthread_mutex_unlock (&watchLock) ;
+      return -1 ;
+    }
+    pthread_detach (thread) ;
+    p->watching = TRUE ;
+  }
+
+  pthread_mutex_unlock (&watchLock) ;
+  return 0 ;
+}
+
+
+/*
+ * findChannel:
+ *	The channel behind a pin on a node of channels
+ *********************************************************************************
+ */
+
+static struct pseudoChannelShmStruct *findChannel (const int pin, struct pseudoPinsStruct **pp)
+{
+  struct pseudoPinsStruct *p ;
+  struct pseudoChannelShmStruct *c ;
+  int myPin ;
+
+  if (((p = findPseudoPin (pin, &myPin)) == NULL) || (p->numPins != 0))
+    return NULL ;
+
+  c = &p->channels [myPin] ;
+  if (__atomic_load_n (&c->type, __ATOMIC_ACQUIRE) == 0)
+    return NULL ;
+
+  *pp = p ;
+
+  return c ;
+}
+
+
+/*
+ * channelWrite:
+ * channelRead:
+ *	The value behind a channel's sequence count: writers take it odd,
+ *	readers try again if it was odd or has moved.
+ *********************************************************************************
+ */
+
+static void channelWrite (struct pseudoPinsStruct *p, struct pseudoChannelShmStruct *c, const void *data)
+{
+  seqLock (&c->seq, &c->owner) ;
+
+  __atomic_thread_fence (__ATOMIC_RELEASE) ;
+    memcpy (p->pool + c->offset, data, c->size) ;
+  seqUnlock (&c->seq, &c->owner) ;
+
+  __atomic_add_fetch (&p->shm->changes, 1, __ATOMIC_SEQ_CST) ;
+
+  if (__atomic_load_n (&p->shm->waiters, __ATOMIC_SEQ_CST) != 0)
+    piFutexWake (&p->shm->changes, INT32_MAX) ;
+}
+
+static void channelRead (struct pseudoPinsStruct *p, struct pseudoChannelShmStruct *c, void *data)
+{
+  uint32_t before ;
+
+  do
+  {
+    before = seqBegin (&c->seq, &c->owner) ;
+    memcpy (data, p->pool + c->offset, c->size) ;
+    __atomic_thread_fence (__ATOMIC_ACQUIRE) ;
+  }
+  while (__atomic_load_n (&c->seq, __ATOMIC_RELAXED) != before) ;
+}
+
+
+/*
+ * myChannelRead:
+ * myChannelWrite:
+ *	analogRead () and analogWrite () of a channel: the int64 or double
+ *	as an int, or the first int of a blob.
+ *********************************************************************************
+ */
+
+static int myChannelRead (UNU struct wiringPiNodeStruct *node, int pin)
+{
+  struct pseudoChannelShmStruct *c ;
+  struct pseudoPinsStruct *p ;
+  int64_t i64 ;
+  double  d ;
+  int     i ;
+  uint8_t blob [PSEUDO_MAX_BLOB] ;
+
+  if ((c = findChannel (pin, &p)) == NULL)
+    return 0 ;
+
+  switch (c->type)
+  {
+    case PSEUDO_INT64:  channelRead (p, c, &i64) ; return (int)i64 ;
+    case PSEUDO_DOUBLE: channelRead (p, c, &d)   ; return (int)lrint (d) ;
+  }
+
+  channelRead (p, c, blob) ;
+  if (c->size < sizeof (i))
+    return blob [0] ;
+  memcpy (&i, blob, sizeof (i)) ;
+
+  return i ;
+}
+
+static void myChannelWrite (UNU struct wiringPiNodeStruct *node, int pin, int value)
+{
+  struct pseudoChannelShmStruct *c ;
+  struct pseudoPinsStruct *p ;
+  int64_t i64 = value ;
+  double  d   = value ;
+
+  if ((c = findChannel (pin, &p)) == NULL)
+    return ;
+
+  /**/ if (c->type == PSEUDO_INT64)
+    channelWrite (p, c, &i64) ;
+  else if (c->type == PSEUDO_DOUBLE)
+    channelWrite (p, c, &d) ;
+}
+
+
+/*
+ * pseudoChannelOpen:
+ *	Find the channel called name on the node of channels at chanBase, or
+ *	make it if nobody has yet. PSEUDO_INT64 and PSEUDO_DOUBLE are 8 bytes,
+ *	whatever size says; a PSEUDO_BLOB is size bytes, up to PSEUDO_MAX_BLOB.
+ *	One that's already there must have the same type and size.
+ *	Returns its pin, or -1 with errno set.
+ *********************************************************************************
+ */
+
+int pseudoChannelOpen (const int chanBase, const char *name, const int type, const int size)
 {
   struct wiringPiNodeStruct *node ;
+  struct pseudoPinsStruct *p ;
+  struct pseudoChannelShmStruct *c ;
+  uint32_t bytes, unlocked ;
+  int i, free = -1, result = -1 ;
+
+  if (((node = wiringPiFindNode (chanBase)) == NULL) || ((p = findPseudo (node)) == NULL) || (p->numPins != 0))
+  {
+    errno = ENODEV ;
+    return -1 ;
+  }
+
+  /**/ if ((type == PSEUDO_INT64) || (type == PSEUDO_DOUBLE))
+    bytes = 8 ;
+  else if ((type == PSEUDO_BLOB) && (size > 0) && (size <= PSEUDO_MAX_BLOB))
+    bytes = size ;
+  else
+    bytes = 0 ;
+
+  if ((bytes == 0) || (name == NULL) || (*name == 0) || (strlen (name) >= PSEUDO_CHANNEL_NAME))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+// Another process could be making one as well
+
+  for (;;)
+  {
+    unlocked = 0 ;
+    if (__atomic_compare_exchange_n (&p->shm->chanLock, &unlocked, 1, FALSE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      break ;
+  }
+
+  for (i = 0 ; i < PSEUDO_MAX_CHANNELS ; ++i)
+  {
+    c = &p->channels [i] ;
+    if (c->type == 0)
+    {
+      if (free < 0)
+	free = i ;
+      continue ;
+    }
+    if (strcmp (c->name, name) != 0)
+      continue ;
+
+    if ((c->type == (uint32_t)type) && (c->size == bytes))
+      result = chanBase + i ;
+    else
+      errno = EEXIST ;
+    free = -2 ;
+    break ;
+  }
+
+  /**/ if (free == -1)
+    errno = ENOSPC ;
+  else if ((free >= 0) && (((p->shm->poolUsed + 7) & ~7u) + bytes > PSEUDO_POOL))
+    errno = ENOMEM ;
+  else if (free >= 0)
+  {
+    c = &p->channels [free] ;
+    c->seq    = 0 ;
+    c->owner  = 0 ;
+    c->size   = bytes ;
+    c->offset = (p->shm->poolUsed + 7) & ~7u ;
+    strcpy (c->name, name) ;
+    memset (p->pool + c->offset, 0, bytes) ;
+    p->shm->poolUsed = c->offset + bytes ;
+    __atomic_store_n (&c->type, type, __ATOMIC_RELEASE) ;
+    result = chanBase + free ;
+  }
+
+  __atomic_store_n (&p->shm->chanLock, 0, __ATOMIC_RELEASE) ;
+
+  return result ;
+}
+
+
+/*
+ * pseudoChannelWrite:
+ * pseudoChannelRead:
+ *	All of a channel's value, in or out, in one go - a blob's whole size.
+ *	Returns 0, or -1 if pin isn't an open channel.
+ *********************************************************************************
+ */
+
+int pseudoChannelWrite (const int pin, const void *data)
+{
+  struct pseudoChannelShmStruct *c ;
+  struct pseudoPinsStruct *p ;
+
+  if ((c = findChannel (pin, &p)) == NULL)
+    return -1 ;
+
+  channelWrite (p, c, data) ;
+  return 0 ;
+}
+
+int pseudoChannelRead (const int pin, void *data)
+{
+  struct pseudoChannelShmStruct *c ;
+  struct pseudoPinsStruct *p ;
+
+  if ((c = findChannel (pin, &p)) == NULL)
+    return -1 ;
+
+  channelRead (p, c, data) ;
+  return 0 ;
+}
+
+
+/*
+ * pseudoChannelWriteInt64:
+ * pseudoChannelReadInt64:
+ * pseudoChannelWriteDouble:
+ * pseudoChannelReadDouble:
+ *	For the typed ones - -1 if it's not a channel of that type
+ *********************************************************************************
+ */
+
+static int typedWrite (const int pin, const uint32_t type, const void *data)
+{
+  struct pseudoChannelShmStruct *c ;
+  struct pseudoPinsStruct *p ;
+
+  if (((c = findChannel (pin, &p)) == NULL) || (c->type != type))
+    return -1 ;
+
+  channelWrite (p, c, data) ;
+  return 0 ;
+}
+
+static int typedRead (const int pin, const uint32_t type, void *data)
+{
+  struct pseudoChannelShmStruct *c ;
+  struct pseudoPinsStruct *p ;
+
+  if (((c = findChannel (pin, &p)) == NULL) || (c->type != type))
+    return -1 ;
+
+  channelRead (p, c, data) ;
+  return 0 ;
+}
+
+int pseudoChannelWriteInt64  (const int pin, const int64_t value) { return typedWrite (pin, PSEUDO_INT64,  &value) ; }
+int pseudoChannelReadInt64   (const int pin, int64_t *value)      { return typedRead  (pin, PSEUDO_INT64,  value) ; }
+int pseudoChannelWriteDouble (const int pin, const double value)  { return typedWrite (pin, PSEUDO_DOUBLE, &value) ; }
+int pseudoChannelReadDouble  (const int pin, double *value)       { return typedRead  (pin, PSEUDO_DOUBLE, value) ; }
+
+
+/*
+ * mapShared:
+ *	Open the shared memory, setting it up if we're first. Anyone else
+ *	waits for the magic number to say it's ready, and must agree on the
+ *	number of pins.
+ *********************************************************************************
+ */
+
+static struct pseudoPinsShmStruct *mapShared (const int numPins)
+{
+  struct pseudoPinsShmStruct *shm ;
+  struct stat st ;
+  size_t size = SHM_SIZE (numPins) ;
+  int fd, creator = TRUE, tries ;
   void *ptr ;
 
-  node = wiringPiNewNode (pinBase, PSEUDO_PINS) ;
+  if ((fd = shm_open (SHARED_NAME, O_CREAT | O_EXCL | O_RDWR, 0666)) < 0)
+  {
+    if ((errno != EEXIST) || ((fd = shm_open (SHARED_NAME, O_RDWR, 0666)) < 0))
+      return NULL ;
+    creator = FALSE ;
+  }
+
+  if (creator)
+  {
+    if (ftruncate (fd, size) < 0)
+    {
+      close (fd) ;
+      return NULL ;
+    }
+  }
+  else
+  {
+    for (tries = 0 ; tries < 1000 ; ++tries)		// Wait for the creator to size it
+    {
+      if (fstat (fd, &st) < 0)
+	break ;
+      if (st.st_size >= (off_t)size)
+	break ;
+      delay (1) ;
+    }
+    if (st.st_size < (off_t)size)
+    {
+      close (fd) ;
+      return NULL ;
+    }
+  }
+
+  ptr = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) ;
+  close (fd) ;
+
+  if (ptr == MAP_FAILED)
+    return NULL ;
+
+  shm = (struct pseudoPinsShmStruct *)ptr ;
+
+  if (creator)
+  {
+    shm->version = PSEUDO_VERSION ;
+    shm->numPins = numPins ;
+    __atomic_store_n (&shm->magic, PSEUDO_MAGIC, __ATOMIC_RELEASE) ;
+    return shm ;
+  }
+
+  for (tries = 0 ; tries < 1000 ; ++tries)
+  {
+    if (__atomic_load_n (&shm->magic, __ATOMIC_ACQUIRE) == PSEUDO_MAGIC)
+      break ;
+    delay (1) ;
+  }
 
-  node->fd = shm_open (SHARED_NAME, O_CREAT | O_RDWR, 0666) ;
+  if ((shm->magic != PSEUDO_MAGIC) || (shm->version != PSEUDO_VERSION) || (shm->numPins != (uint32_t)numPins))
+  {
+    munmap (ptr, size) ;
+    errno = EINVAL ;
+    return NULL ;
+  }
 
-  if (node->fd < 0)
+  return shm ;
+}
+
+
+/*
+ * pseudoPinsSetupN:
+ * pseudoPinsSetup:
+ *	Create a new wiringPi device node for the pseudoPins driver with
+ *	numPins pins (or the original 64). Every process using them must
+ *	ask for the same number.
+ *********************************************************************************
+ */
+
+int pseudoPinsSetupN (const int pinBase, const int numPins)
+{
+  struct wiringPiNodeStruct *node ;
+  struct pseudoPinsStruct *p ;
+  struct pseudoPinsShmStruct *shm ;
+
+  if ((numPins < 1) || (numPins > PSEUDO_MAX_PINS))
     return FALSE ;
 
-  if (ftruncate (node->fd, PSEUDO_PINS * sizeof (int)) < 0)
+  if ((p = findPseudo (NULL)) == NULL)
     return FALSE ;
 
-  ptr = mmap (NULL, PSEUDO_PINS * sizeof (int), PROT_READ | PROT_WRITE, MAP_SHARED, node->fd, 0) ;
+  if ((shm = mapShared (numPins)) == NULL)
+    return FALSE ;
 
-  node->data0 = (unsigned int)ptr ;
+  node  = wiringPiNewNode (pinBase, numPins) ;
+  myPid = (uint32_t)getpid () ;
+
+  p->node     = node ;
+  p->shm      = shm ;
+  p->seq      = shm->data ;
+  p->owner    = shm->data + BLOCKS (numPins) ;
+  p->pins     = (int *)(shm->data + 2 * BLOCKS (numPins)) ;
+  p->numPins  = numPins ;
+  p->channels = (struct pseudoChannelShmStruct *)((uint8_t *)shm->data + CHAN_OFFSET (numPins)) ;
+  p->pool     = (uint8_t *)shm->data + POOL_OFFSET (numPins) ;
 
   node->analogRead  = myAnalogRead ;
   node->analogWrite = myAnalogWrite ;
+  node->isr         = myIsr ;
+
+  return TRUE ;
+}
+
+int pseudoPinsSetup (const int pinBase)
+{
+  return pseudoPinsSetupN (pinBase, PSEUDO_PINS) ;
+}
+
+
+/*
+ * pseudoChannelsSetup:
+ *	A node of PSEUDO_MAX_CHANNELS pins from chanBase for the channels in
+ *	the same shared memory as the pseudo pins at pinBase. Channels come
+ *	from pseudoChannelOpen (); the pins of ones not made yet read 0.
+ *********************************************************************************
+ */
+
+int pseudoChannelsSetup (const int chanBase, const int pinBase)
+{
+  struct wiringPiNodeStruct *node ;
+  struct pseudoPinsStruct *p, *c ;
+  int myPin ;
+
+  if (((p = findPseudoPin (pinBase, &myPin)) == NULL) || (p->numPins == 0))
+    return FALSE ;
+
+  if ((c = findPseudo (NULL)) == NULL)
+    return FALSE ;
+
+  node = wiringPiNewNode (chanBase, PSEUDO_MAX_CHANNELS) ;
+
+  *c          = *p ;
+  c->node     = node ;
+  c->pins     = NULL ;
+  c->numPins  = 0 ;
+  c->numWatch = 0 ;
+  c->watching = FALSE ;
+
+  node->analogRead  = myChannelRead ;
+  node->analogWrite = myChannelWrite ;
 
   return TRUE ;
 }
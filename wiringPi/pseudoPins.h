@@ -23,4 +23,38 @@
  ***********************************************************************
  */
 
-extern int pseudoPinsSetup (const int pinBase) ;
+#include <stdint.h>
+
+// Typed channels, alongside the pins in the shared memory
+
+#define	PSEUDO_INT64		1
+#define	PSEUDO_DOUBLE		2
+#define	PSEUDO_BLOB		3
+
+#define	PSEUDO_MAX_CHANNELS	64
+#define	PSEUDO_CHANNEL_NAME	32
+#define	PSEUDO_MAX_BLOB		1024
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int          pseudoPinsSetup      (const int pinBase) ;
+extern int          pseudoPinsSetupN     (const int pinBase, const int numPins) ;
+
+extern int          pseudoPinsRead       (const int pin, int *values, const int count) ;
+extern int          pseudoPinsWriteMulti (const int pin, const int *values, const int count) ;
+extern unsigned int pseudoPinsWait       (const int pin, const unsigned int last, const int timeoutMs) ;
+
+extern int          pseudoChannelsSetup  (const int chanBase, const int pinBase) ;
+extern int          pseudoChannelOpen    (const int chanBase, const char *name, const int type, const int size) ;
+extern int          pseudoChannelWrite   (const int pin, const void *data) ;
+extern int          pseudoChannelRead    (const int pin, void *data) ;
+extern int          pseudoChannelWriteInt64  (const int pin, const int64_t value) ;
+extern int          pseudoChannelReadInt64   (const int pin, int64_t *value) ;
+extern int          pseudoChannelWriteDouble (const int pin, const double value) ;
+extern int          pseudoChannelReadDouble  (const int pin, double *value) ;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,266 @@
+/*
+ * pulse.c:
+ *	Pulse width and frequency measurement - pulseIn () and counters.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+/*
+ * Notes:
+ *	Where the pin's edges come from the GPIO character device, the kernel
+ *	timestamps every one of them and we just work from the timestamps
+ *	afterwards, so nothing here spins and being pre-empted costs nothing
+ *	but a little latency. Each channel is just an edge ring, filled by
+ *	the interrupt code, that we empty whenever the program asks for the
+ *	figures - dozens of them use no more CPU than the edges themselves.
+ *
+ *	A pin's ring belongs to one user - don't use pulseIn () and a channel
+ *	(or rht03/maxDetect) on the same pin.
+ *********************************************************************************
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "wiringPi.h"
+#include "pulse.h"
+
+#define	PULSE_EVENTS	256
+
+struct channelStruct
+{
+  unsigned long long count ;
+  unsigned long long lastRise ;
+  unsigned int       periodUs ;
+  unsigned int       highUs ;
+} ;
+
+static int                  edges    [64] ;	// 0: not tried, 1: timed edges, -1: no
+static struct channelStruct channels [64] ;
+
+
+/*
+ * pulseEdges:
+ *	Get timestamped edges from a pin if we can
+ *********************************************************************************
+ */
+
+static int pulseEdges (int pin, int events)
+{
+  if ((pin < 0) || (pin > 63))
+    return FALSE ;
+
+  if (edges [pin] == 0)
+  {
+    if (wiringPiEventPrecise (pin) && (wiringPiEventEnable (pin, events) == 0) &&
+	(wiringPiISR (pin, INT_EDGE_BOTH, NULL) == 0))
+      edges [pin] = 1 ;
+    else
+      edges [pin] = -1 ;
+  }
+
+  return edges [pin] == 1 ;
+}
+
+
+/*
+ * pulseInPoll:
+ *	The old way, for pins without timed edges: watch the pin. Wrong if
+ *	we're pre-empted mid-pulse, but it's all there is.
+ *********************************************************************************
+ */
+
+static long pulseInPoll (int pin, int level, unsigned int timeoutUs)
+{
+  unsigned long long deadline = micros64 () + timeoutUs ;
+  unsigned long long start ;
+
+  while (digitalRead (pin) == level)		// Let any pulse already going finish
+    if (micros64 () >= deadline)
+      return 0 ;
+
+  while (digitalRead (pin) != level)
+    if (micros64 () >= deadline)
+      return 0 ;
+
+  start = micros64 () ;
+
+  while (digitalRead (pin) == level)
+    if (micros64 () >= deadline)
+      return 0 ;
+
+  return (long)(micros64 () - start) ;
+}
+
+
+/*
+ * pulseIn:
+ *	Measure the next pulse of the given level (HIGH or LOW) on a pin,
+ *	as the Arduino one does: returns its length in uS, or 0 if it hasn't
+ *	started and finished within timeoutUs.
+ *********************************************************************************
+ */
+
+long pulseIn (int pin, int level, unsigned int timeoutUs)
+{
+  struct wpiEdgeEventStruct events [16] ;
+  unsigned long long deadline, begin = 0 ;
+  int startEdge, n, i ;
+
+  if (!pulseEdges (pin, PULSE_EVENTS))
+    return pulseInPoll (pin, level, timeoutUs) ;
+
+  startEdge = (level == LOW) ? INT_EDGE_FALLING : INT_EDGE_RISING ;
+  deadline  = micros64 () + timeoutUs ;
+
+  while (wiringPiEventReadPin (pin, events, 16) > 0)	// Anything old
+    ;
+
+  for (;;)
+  {
+    while ((n = wiringPiEventReadPin (pin, events, 16)) > 0)
+      for (i = 0 ; i < n ; ++i)
+      {
+	/**/ if (begin == 0)
+	{
+	  if (events [i].edge == startEdge)
+	    begin = events [i].timestamp ;
+	}
+	else if (events [i].edge != startEdge)
+	  return (long)((events [i].timestamp - begin) / 1000) ;
+      }
+
+    if (micros64 () >= deadline)
+      return 0 ;
+
+    delay (1) ;		// The kernel's timing it, not us
+  }
+}
+
+
+/*
+ * pulseChannelCreate:
+ *	Start measuring the pulses on a pin, continuously. events is how many
+ *	edges to hold between reads (0 for the default of 256) - it's rounded
+ *	up to a power of 2.
+ *	Needs the GPIO character device. Returns 0 or -1.
+ *********************************************************************************
+ */
+
+int pulseChannelCreate (int pin, int events)
+{
+  if (events <= 0)
+    events = PULSE_EVENTS ;
+
+  if (!pulseEdges (pin, events))
+    return -1 ;
+
+  memset (&channels [pin], 0, sizeof (channels [pin])) ;
+
+  return 0 ;
+}
+
+
+/*
+ * pulseChannelRead:
+ *	Bring a channel up to date with the edges since the last read and
+ *	return what it's seen. Returns 0 or -1 if the pin isn't a channel.
+ *********************************************************************************
+ */
+
+int pulseChannelRead (int pin, struct pulseChannelStruct *result)
+{
+  struct wpiEdgeEventStruct events [32] ;
+  struct channelStruct *c ;
+  struct timespec ts ;
+  unsigned long long windowStart, now ;
+  unsigned int rises = 0 ;
+  int n, i ;
+
+  if ((pin < 0) || (pin > 63) || (edges [pin] != 1))
+    return -1 ;
+
+  c           = &channels [pin] ;
+  windowStart = c->lastRise ;
+
+  while ((n = wiringPiEventReadPin (pin, events, 32)) > 0)
+    for (i = 0 ; i < n ; ++i)
+    {
+      if (events [i].edge == INT_EDGE_RISING)
+      {
+	if (c->lastRise != 0)
+	  c->periodUs = (unsigned int)((events [i].timestamp - c->lastRise) / 1000) ;
+	if (windowStart == 0)
+	  windowStart = events [i].timestamp ;
+	else
+	  ++rises ;
+	c->lastRise = events [i].timestamp ;
+	++c->count ;
+      }
+      else if ((c->lastRise != 0) && (events [i].timestamp > c->lastRise))
+	c->highUs = (unsigned int)((events [i].timestamp - c->lastRise) / 1000) ;
+    }
+
+  result->count    = c->count ;
+  result->periodUs = c->periodUs ;
+  result->highUs   = c->highUs ;
+  result->overruns = wiringPiEventOverruns (pin) ;
+
+// Frequency over the whole window if we can, otherwise from the last
+//	period - unless it's gone quiet for a couple of those, when it's 0
+
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+  now = (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec ;
+
+  /**/ if ((c->periodUs == 0) || ((now - c->lastRise) > 2000ULL * c->periodUs))
+    result->frequency = 0.0 ;
+  else if ((rises > 0) && (c->lastRise > windowStart))
+    result->frequency = (double)rises * 1.0e9 / (double)(c->lastRise - windowStart) ;
+  else
+    result->frequency = 1.0e6 / (double)c->periodUs ;
+
+  if ((c->periodUs != 0) && (c->highUs <= c->periodUs))
+    result->duty = (double)c->highUs / (double)c->periodUs ;
+  else
+    result->duty = 0.0 ;
+
+  return 0 ;
+}
+
+
+/*
+ * pulseChannelReset:
+ *	Zero a channel's count and forget its timings
+ *********************************************************************************
+ */
+
+void pulseChannelReset (int pin)
+{
+  struct wpiEdgeEventStruct events [32] ;
+
+  if ((pin < 0) || (pin > 63) || (edges [pin] != 1))
+    return ;
+
+  while (wiringPiEventReadPin (pin, events, 32) > 0)
+    ;
+
+  memset (&channels [pin], 0, sizeof (channels [pin])) ;
+}
@@ -0,0 +1,51 @@
+/*
+ * pulse.h:
+ *	Pulse width and frequency measurement - pulseIn () and counters.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// What a pulse channel has measured. Times are in uS and the last
+//	complete period; frequency is averaged over everything since the
+//	previous pulseChannelRead () if there was more than one period.
+
+struct pulseChannelStruct
+{
+  unsigned long long count ;		// Rising edges since created or reset
+  unsigned int       periodUs ;		// Rising edge to rising edge
+  unsigned int       highUs ;		// Rising edge to falling edge
+  double             frequency ;	// Hz
+  double             duty ;		// 0.0 to 1.0
+  unsigned int       overruns ;		// Edges lost - read more often
+} ;
+
+extern long pulseIn            (int pin, int level, unsigned int timeoutUs) ;
+
+extern int  pulseChannelCreate (int pin, int events) ;
+extern int  pulseChannelRead   (int pin, struct pulseChannelStruct *result) ;
+extern void pulseChannelReset  (int pin) ;
+
+#ifdef __cplusplus
+}
+#endif
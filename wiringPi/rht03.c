@@ -24,12 +24,36 @@
 
 #include <sys/time.h>
 #include <stdio.h>
+#include <string.h>
 #include <stdio.h>
 #include <time.h>
+#include <errno.h>
+#include <pthread.h>
 
 #include "wiringPi.h"
 #include "rht03.h"
 
+// Sensors being sampled in the background. The data sheet says no more
+//	than once every 2 seconds.
+
+#define	MAX_RHT03	8
+#define	RHT03_MIN_MS	2000
+#define	RHT03_TRIES	3
+
+struct rht03Struct
+{
+  struct wiringPiNodeStruct *node ;
+  int          piPin ;
+  int          periodMs ;
+  int          valid ;
+  int          temp ;
+  int          rh ;
+  unsigned int stamp ;		// millis () of the last good reading
+} ;
+
+static struct rht03Struct rht03s [MAX_RHT03] ;
+static pthread_mutex_t    rht03Lock = PTHREAD_MUTEX_INITIALIZER ;
+
 /*
  * maxDetectLowHighWait:
  *	Wait for a transition from low to high on the bus
@@ -100,10 +124,112 @@ static unsigned int maxDetectClockByte (const int pin)
 }
 
 
+/*
+ * maxDetectEdges:
+ *	Get the pin ready to have its edges timed by the kernel, the first
+ *	time we see it. Returns FALSE if that can't be done here, and we fall
+ *	back to polling the pin.
+ *********************************************************************************
+ */
+
+#define	MAXDETECT_EVENTS	256
+
+static int maxDetectEdges (const int pin)
+{
+  static int state [64] ;	// 0: Not tried, 1: Yes, -1: No
+
+  if ((pin < 0) || (pin > 63))
+    return FALSE ;
+
+  if (state [pin] == 0)
+  {
+    if (wiringPiEventPrecise (pin) && (wiringPiEventEnable (pin, MAXDETECT_EVENTS) == 0) &&
+	(wiringPiISR (pin, INT_EDGE_BOTH, NULL) == 0))
+      state [pin] = 1 ;
+    else
+      state [pin] = -1 ;
+  }
+
+  return state [pin] == 1 ;
+}
+
+
+/*
+ * maxDetectDecode:
+ *	Work the 40 bits out from the edges after the fact. Each bit is a
+ *	low of about 50µS then a high of 26-28µS for a 0 or 70µS for a 1,
+ *	and the line's left high after the last one, so the bits are the last
+ *	40 complete high pulses - anything before that is the wake-up and the
+ *	sensor's 80µS response.
+ *********************************************************************************
+ */
+
+static int maxDetectDecode (const struct wpiEdgeEventStruct *events, int count, unsigned char localBuf [5])
+{
+  unsigned int widths [MAXDETECT_EVENTS / 2] ;
+  unsigned int width ;
+  int i, pulses = 0, first ;
+
+  for (i = 0 ; i < count - 1 ; ++i)
+    if ((events [i].edge == INT_EDGE_RISING) && (events [i + 1].edge == INT_EDGE_FALLING))
+      widths [pulses++] = (unsigned int)((events [i + 1].timestamp - events [i].timestamp) / 1000) ;
+
+  if (pulses < 40)
+    return FALSE ;
+
+  memset (localBuf, 0, 5) ;
+  first = pulses - 40 ;
+
+  for (i = 0 ; i < 40 ; ++i)
+  {
+    if ((width = widths [first + i]) > 100)	// Not one of ours
+      return FALSE ;
+    localBuf [i / 8] = (localBuf [i / 8] << 1) | ((width > 48) ? 1 : 0) ;
+  }
+
+  return TRUE ;
+}
+
+
+/*
+ * maxDetectEdgeRead:
+ *	Wake the sensor up and go to sleep while the kernel times its reply
+ *	for us - the whole thing takes about 5mS after the wake-up pulse.
+ *	Nothing here minds being pre-empted.
+ *********************************************************************************
+ */
+
+static int maxDetectEdgeRead (const int pin, unsigned char localBuf [5])
+{
+  struct wpiEdgeEventStruct events [MAXDETECT_EVENTS] ;
+  int count, n ;
+
+// Throw away anything left over from last time
+
+  while (wiringPiEventReadPin (pin, events, MAXDETECT_EVENTS) > 0)
+    ;
+
+  pinMode      (pin, OUTPUT) ;
+  digitalWrite (pin, 0) ; delay             (10) ;
+  digitalWrite (pin, 1) ; delayMicroseconds (40) ;
+  pinMode      (pin, INPUT) ;
+
+  delay (8) ;
+
+  for (count = 0 ; count < MAXDETECT_EVENTS ; count += n)
+    if ((n = wiringPiEventReadPin (pin, events + count, MAXDETECT_EVENTS - count)) <= 0)
+      break ;
+
+  return maxDetectDecode (events, count, localBuf) ;
+}
+
+
 /*
  * maxDetectRead:
  *	Read in and return the 4 data bytes from the MaxDetect sensor.
- *	Return TRUE/FALSE depending on the checksum validity
+ *	Return TRUE/FALSE depending on the checksum validity.
+ *	With the GPIO character device the kernel times the edges for us;
+ *	without it we poll the pin and hope we don't get pre-empted.
  *********************************************************************************
  */
 
@@ -114,6 +240,23 @@ static int maxDetectRead (const int pin, unsigned char buffer [4])
   unsigned char localBuf [5] ;
   struct timeval now, then, took ;
 
+// Let the kernel time it if we can
+
+  if (maxDetectEdges (pin))
+  {
+    if (!maxDetectEdgeRead (pin, localBuf))
+      return FALSE ;
+
+    checksum = 0 ;
+    for (i = 0 ; i < 4 ; ++i)
+    {
+      buffer [i] = localBuf [i] ;
+      checksum += localBuf [i] ;
+    }
+
+    return (checksum & 0xFF) == localBuf [4] ;
+  }
+
 // See how long we took
 
   gettimeofday (&then, NULL) ;
@@ -228,6 +371,112 @@ static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
 }
 
 
+/*
+ * findRht03:
+ * myCachedRead:
+ *	The last good reading of either channel - this never waits, and
+ *	returns -9995 until there's been one.
+ *********************************************************************************
+ */
+
+static struct rht03Struct *findRht03 (struct wiringPiNodeStruct *node)
+{
+  int i ;
+
+  for (i = 0 ; i < MAX_RHT03 ; ++i)
+    if (rht03s [i].node == node)
+      return &rht03s [i] ;
+
+  return NULL ;
+}
+
+static int myCachedRead (struct wiringPiNodeStruct *node, int pin)
+{
+  struct rht03Struct *r ;
+  int chan  = pin - node->pinBase ;
+  int value = -9995 ;
+
+  if (chan > 1)
+    return -9999 ;	// Bad parameters
+
+  pthread_mutex_lock (&rht03Lock) ;
+    if (((r = findRht03 (node)) != NULL) && r->valid)
+      value = (chan == 0) ? r->temp : r->rh ;
+  pthread_mutex_unlock (&rht03Lock) ;
+
+  return value ;
+}
+
+
+/*
+ * rht03Timestamp:
+ *	When (in millis ()) the cached reading for either pin was taken, or 0
+ *	if there hasn't been one.
+ *********************************************************************************
+ */
+
+unsigned int rht03Timestamp (const int pin)
+{
+  struct rht03Struct *r ;
+  unsigned int stamp = 0 ;
+
+  pthread_mutex_lock (&rht03Lock) ;
+    if (((r = findRht03 (wiringPiFindNode (pin))) != NULL) && r->valid)
+      stamp = r->stamp ;
+  pthread_mutex_unlock (&rht03Lock) ;
+
+  return stamp ;
+}
+
+
+/*
+ * samplerThread:
+ *	Read the sensor on a fixed schedule, a few tries each time, and keep
+ *	the last good reading. A failed attempt keeps the old one (and its
+ *	timestamp, so the caller can see how stale it is).
+ *********************************************************************************
+ */
+
+static void *samplerThread (void *arg)
+{
+  struct rht03Struct *r = (struct rht03Struct *)arg ;
+  struct timespec next ;
+  int temp, rh, try ;
+
+  clock_gettime (CLOCK_MONOTONIC, &next) ;
+
+  for (;;)
+  {
+    for (try = 0 ; try < RHT03_TRIES ; ++try)
+    {
+      if (myReadRHT03 (r->piPin, &temp, &rh))
+      {
+	pthread_mutex_lock (&rht03Lock) ;
+	  r->temp  = temp ;
+	  r->rh    = rh ;
+	  r->stamp = millis () ;
+	  r->valid = TRUE ;
+	pthread_mutex_unlock (&rht03Lock) ;
+	break ;
+      }
+      delay (50) ;
+    }
+
+    next.tv_sec  += r->periodMs / 1000 ;
+    next.tv_nsec += (r->periodMs % 1000) * 1000000 ;
+    if (next.tv_nsec >= 1000000000)
+    {
+      next.tv_nsec -= 1000000000 ;
+      ++next.tv_sec ;
+    }
+    while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+      ;
+  }
+
+  return NULL ;
+}
+
+
 /*
  * rht03Setup:
  *	Create a new instance of an RHT03 temperature sensor.
@@ -250,3 +499,54 @@ int rht03Setup (const int pinBase, const int piPin)
 
   return TRUE ;
 }
+
+
+/*
+ * rht03SetupCached:
+ *	As above, but a thread of its own reads the sensor every periodMs
+ *	(2 seconds at least) and analogRead just returns the latest reading,
+ *	so it never blocks. rht03Timestamp says how old it is.
+ *********************************************************************************
+ */
+
+int rht03SetupCached (const int pinBase, const int piPin, const int periodMs)
+{
+  struct wiringPiNodeStruct *node ;
+  struct rht03Struct *r ;
+  pthread_t thread ;
+
+  if ((piPin & PI_GPIO_MASK) != 0)	// Must be an on-board pin
+    return FALSE ;
+
+  pthread_mutex_lock (&rht03Lock) ;
+
+  if ((r = findRht03 (NULL)) == NULL)
+  {
+    pthread_mutex_unlock (&rht03Lock) ;
+    return FALSE ;
+  }
+
+// 2 pins - temperature and humidity
+
+  node = wiringPiNewNode (pinBase, 2) ;
+
+  node->fd         = piPin ;
+  node->analogRead = myCachedRead ;
+
+  r->node     = node ;
+  r->piPin    = piPin ;
+  r->periodMs = (periodMs < RHT03_MIN_MS) ? RHT03_MIN_MS : periodMs ;
+  r->valid    = FALSE ;
+
+  pthread_mutex_unlock (&rht03Lock) ;
+
+  if (pthread_create (&thread, NULL, samplerThread, r) != 0)
+  {
+    node->analogRead = myAnalogRead ;	// Still works, just slowly
+    return TRUE ;
+  }
+
+  pthread_detach (thread) ;
+
+  return TRUE ;
+}
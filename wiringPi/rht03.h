@@ -22,4 +22,14 @@
  ***********************************************************************
  */
 
-extern int rht03Setup (const int pinBase, const int devicePin) ;
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int          rht03Setup       (const int pinBase, const int devicePin) ;
+extern int          rht03SetupCached (const int pinBase, const int devicePin, const int periodMs) ;
+extern unsigned int rht03Timestamp   (const int pin) ;
+
+#ifdef __cplusplus
+}
+#endif
@@ -22,11 +22,99 @@
  ***********************************************************************
  */
 
+#include <stdint.h>
+#include <string.h>
+
 #include <wiringPi.h>
 #include <wiringPiI2C.h>
 
 #include "sn3218.h"
 
+// Registers
+
+#define	SN3218_PWM	0x01		// First of 18 PWM registers
+#define	SN3218_UPDATE	0x16
+
+// It has a fixed I2C address so there can only be one. We keep a copy
+//	of what's in the PWM registers.
+
+static int     sn3218Fd = -1 ;
+static uint8_t frame [18] ;
+
+// Gamma 2.2 - the LEDs' brightness looks linear to the eye with this
+
+static const uint8_t gammaTable [256] =
+{
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,
+    1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+    3,   3,   3,   3,   3,   4,   4,   4,   4,   5,   5,   5,   5,   6,   6,   6,
+    6,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,  10,  11,  11,  11,  12,
+   12,  13,  13,  13,  14,  14,  15,  15,  16,  16,  17,  17,  18,  18,  19,  19,
+   20,  20,  21,  22,  22,  23,  23,  24,  25,  25,  26,  26,  27,  28,  28,  29,
+   30,  30,  31,  32,  33,  33,  34,  35,  35,  36,  37,  38,  39,  39,  40,  41,
+   42,  43,  43,  44,  45,  46,  47,  48,  49,  49,  50,  51,  52,  53,  54,  55,
+   56,  57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,
+   73,  74,  75,  76,  77,  78,  79,  81,  82,  83,  84,  85,  87,  88,  89,  90,
+   91,  93,  94,  95,  97,  98,  99, 100, 102, 103, 105, 106, 107, 109, 110, 111,
+  113, 114, 116, 117, 119, 120, 121, 123, 124, 126, 127, 129, 130, 132, 133, 135,
+  137, 138, 140, 141, 143, 145, 146, 148, 149, 151, 153, 154, 156, 158, 159, 161,
+  163, 165, 166, 168, 170, 172, 173, 175, 177, 179, 181, 182, 184, 186, 188, 190,
+  192, 194, 196, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
+  223, 225, 227, 229, 231, 234, 236, 238, 240, 242, 244, 246, 248, 251, 253, 255,
+} ;
+
+
+/*
+ * writeFrame:
+ *	All 18 PWM registers in one auto-increment block, then the update
+ *********************************************************************************
+ */
+
+static int writeFrame (void)
+{
+  int i ;
+
+  if (wiringPiI2CWriteBlock (sn3218Fd, SN3218_PWM, frame, 18) < 0)
+    for (i = 0 ; i < 18 ; ++i)
+      wiringPiI2CWriteReg8 (sn3218Fd, SN3218_PWM + i, frame [i]) ;
+
+  return wiringPiI2CWriteReg8 (sn3218Fd, SN3218_UPDATE, 0x00) ;
+}
+
+
+/*
+ * sn3218WriteFrame:
+ * sn3218WriteFrameRaw:
+ *	Set all 18 LEDs at once - one block write and one update rather
+ *	than a pair of writes per LED. The first goes through the gamma table,
+ *	the raw one (and analogWrite) don't.
+ *********************************************************************************
+ */
+
+int sn3218WriteFrame (const uint8_t pwm [18])
+{
+  int i ;
+
+  if (sn3218Fd == -1)
+    return -1 ;
+
+  for (i = 0 ; i < 18 ; ++i)
+    frame [i] = gammaTable [pwm [i]] ;
+
+  return writeFrame () ;
+}
+
+int sn3218WriteFrameRaw (const uint8_t pwm [18])
+{
+  if (sn3218Fd == -1)
+    return -1 ;
+
+  memcpy (frame, pwm, 18) ;
+
+  return writeFrame () ;
+}
+
+
 /*
  * myAnalogWrite:
  *	Write analog value on the given pin
@@ -40,8 +128,11 @@ static void myAnalogWrite (struct wiringPiNodeStruct *node, int pin, int value)
   
   wiringPiI2CWriteReg8 (fd, chan, value & 0xFF) ;	// Value
   wiringPiI2CWriteReg8 (fd, 0x16, 0x00) ;		// Update
+
+  frame [chan - 0x01] = value & 0xFF ;
 }
 
+
 /*
  * sn3218Setup:
  *	Create a new wiringPi device node for an sn3218 on the Pi's
@@ -71,5 +162,8 @@ int sn3218Setup (const int pinBase)
   node->fd          = fd ;
   node->analogWrite = myAnalogWrite ;
 
+  sn3218Fd = fd ;
+  memset (frame, 0, sizeof (frame)) ;
+
   return TRUE ;
 }
@@ -26,7 +26,9 @@
 extern "C" {
 #endif
 
-extern int sn3218Setup (int pinBase) ;
+extern int sn3218Setup         (int pinBase) ;
+extern int sn3218WriteFrame    (const unsigned char pwm [18]) ;
+extern int sn3218WriteFrameRaw (const unsigned char pwm [18]) ;
 
 #ifdef __cplusplus
 }
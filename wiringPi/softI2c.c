@@ -0,0 +1,372 @@
+/*
+ * softI2c.c:
+ *	Bit-banged I2C on any pins
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+
+/*
+ * Notes:
+ *	Up to WPI_SOFT_I2C_MAX_BUS extra I2C buses on any pair of pins,
+ *	each with its own pull-up resistors. Open drain is emulated: the
+ *	output latch of each pin is left low and a line is pulled down by
+ *	making it an output, and let go by making it an input again - so
+ *	for on-board pins it's a single GPFSEL store either way, and GPLEV
+ *	for reading it back.
+ *
+ *	After letting go of SCL we wait for it to actually go high, so a
+ *	slave can stretch the clock, for up to STRETCH_NS.
+ *
+ *	Programs don't call the transfer code here directly; set the bus
+ *	up, then open devices on it through wiringPiI2C as "soft:N", or
+ *	with wiringPiI2CDefaultBus ("soft:N") before calling the usual
+ *	device setup functions.
+ *********************************************************************************
+ */
+
+#include <stddef.h>
+#include <errno.h>
+
+#include "wiringPi.h"
+#include "wiringPiI2C.h"
+#include "wiringPiConfig.h"
+#include "softI2c.h"
+
+#define	STRETCH_NS	25000000ULL	// 25mS as SMBus
+
+struct i2cLineStruct
+{
+  int                    pin ;
+  wpiPin_t               h ;
+  volatile unsigned int *fsel ;		// NULL to go via pinMode
+  unsigned int           shift ;
+} ;
+
+struct softI2cStruct
+{
+  int                  used ;
+  struct i2cLineStruct sda, scl ;
+  unsigned int         halfNs ;
+} ;
+
+static struct softI2cStruct softI2cs [WPI_SOFT_I2C_MAX_BUS] ;
+
+
+/*
+ * Bus primitives
+ *********************************************************************************
+ */
+
+static inline void halfWait (struct softI2cStruct *s)
+{
+  unsigned long long deadline = nanos64 () + s->halfNs ;
+
+  while (nanos64 () < deadline)
+    ;
+}
+
+static void lineDrive (struct i2cLineStruct *l, int low)
+{
+  if (l->fsel != NULL)
+  {
+    wpiConfigLock (WPI_CONFIG_FSEL (l->h->gpio / 10)) ;
+    if (low)
+      *l->fsel = (*l->fsel & ~(7 << l->shift)) | (1 << l->shift) ;
+    else
+      *l->fsel = (*l->fsel & ~(7 << l->shift)) ;
+    wpiConfigUnlock (WPI_CONFIG_FSEL (l->h->gpio / 10)) ;
+  }
+  else if (low)
+  {
+    digitalWrite (l->pin, LOW) ;
+    pinMode      (l->pin, OUTPUT) ;
+  }
+  else
+    pinMode (l->pin, INPUT) ;
+}
+
+// sclRelease:
+//	Let SCL go high, and wait for any clock stretching
+
+static int sclRelease (struct softI2cStruct *s)
+{
+  unsigned long long giveUp ;
+
+  lineDrive (&s->scl, FALSE) ;
+
+  if (wpiPinRead (s->scl.h) == LOW)
+  {
+    giveUp = nanos64 () + STRETCH_NS ;
+    while (wpiPinRead (s->scl.h) == LOW)
+      if (nanos64 () > giveUp)
+      {
+	errno = ETIMEDOUT ;
+	return -1 ;
+      }
+  }
+
+  return 0 ;
+}
+
+static int busStart (struct softI2cStruct *s)
+{
+  lineDrive (&s->sda, FALSE) ;
+  halfWait  (s) ;
+  if (sclRelease (s) < 0)
+    return -1 ;
+  halfWait  (s) ;
+  lineDrive (&s->sda, TRUE) ;
+  halfWait  (s) ;
+  lineDrive (&s->scl, TRUE) ;
+  return 0 ;
+}
+
+static void busStop (struct softI2cStruct *s)
+{
+  lineDrive (&s->sda, TRUE) ;
+  halfWait  (s) ;
+  (void)sclRelease (s) ;
+  halfWait  (s) ;
+  lineDrive (&s->sda, FALSE) ;
+  halfWait  (s) ;
+}
+
+static int busBit (struct softI2cStruct *s, int bit)
+{
+  lineDrive (&s->sda, !bit) ;
+  halfWait  (s) ;
+  if (sclRelease (s) < 0)
+    return -1 ;
+  halfWait  (s) ;
+  bit = wpiPinRead (s->sda.h) ;
+  lineDrive (&s->scl, TRUE) ;
+  return bit ;
+}
+
+// busWrite:
+//	Send a byte; returns 0 if it was ACKed
+
+static int busWrite (struct softI2cStruct *s, unsigned int byte)
+{
+  int i, ack ;
+
+  for (i = 7 ; i >= 0 ; --i)
+    if (busBit (s, (byte >> i) & 1) < 0)
+      return -1 ;
+
+  if ((ack = busBit (s, 1)) < 0)
+    return -1 ;
+
+  if (ack != LOW)
+  {
+    errno = EIO ;
+    return -1 ;
+  }
+
+  return 0 ;
+}
+
+static int busRead (struct softI2cStruct *s, int ack)
+{
+  int i, bit, byte = 0 ;
+
+  for (i = 0 ; i < 8 ; ++i)
+  {
+    if ((bit = busBit (s, 1)) < 0)
+      return -1 ;
+    byte = (byte << 1) | bit ;
+  }
+
+  if (busBit (s, !ack) < 0)
+    return -1 ;
+
+  return byte ;
+}
+
+
+/*
+ * softI2cTransfer:
+ *	Run a list of messages as one transaction, with a repeated start
+ *	between each one and a stop at the end. The caller (wiringPiI2C)
+ *	holds the bus lock.
+ *	Returns 0, or -1 with errno EIO for a NAK or ETIMEDOUT if a slave
+ *	held the clock low for too long.
+ *********************************************************************************
+ */
+
+int softI2cTransfer (int bus, const int *addrs, const struct wpiI2cMsg *msgs, int numMsgs)
+{
+  struct softI2cStruct *s ;
+  unsigned char *buf ;
+  unsigned int j ;
+  int i, v, res = 0 ;
+
+  if (!softI2cActive (bus))
+  {
+    errno = ENODEV ;
+    return -1 ;
+  }
+
+  s = &softI2cs [bus] ;
+
+  for (i = 0 ; (i < numMsgs) && (res == 0) ; ++i)
+  {
+    buf = (unsigned char *)msgs [i].buf ;
+
+    if ((res = busStart (s)) < 0)
+      break ;
+
+    if ((res = busWrite (s, (addrs [i] << 1) | (msgs [i].read ? 1 : 0))) < 0)
+      break ;
+
+    for (j = 0 ; j < msgs [i].len ; ++j)
+    {
+      if (msgs [i].read)
+      {
+	if ((v = busRead (s, j + 1 < msgs [i].len)) < 0)
+	{
+	  res = -1 ;
+	  break ;
+	}
+	buf [j] = v ;
+      }
+      else if ((res = busWrite (s, buf [j])) < 0)
+	break ;
+    }
+  }
+
+// A slave that's still holding the clock won't see a stop; just let go
+
+  if ((res < 0) && (errno == ETIMEDOUT))
+  {
+    lineDrive (&s->sda, FALSE) ;
+    lineDrive (&s->scl, FALSE) ;
+  }
+  else
+    busStop (s) ;
+
+  return res ;
+}
+
+
+/*
+ * lineOpen:
+ *	Resolve a pin, with its output latch low and let go
+ *********************************************************************************
+ */
+
+static int lineOpen (struct i2cLineStruct *l, int pin)
+{
+  if ((l->h = wiringPiPinOpen (pin)) == NULL)
+    return -1 ;
+
+  l->pin  = pin ;
+  l->fsel = NULL ;
+
+  if ((l->h->set != NULL) && (_wiringPiGpio != NULL))	// Memory mapped BCM pin
+  {
+    l->fsel  = _wiringPiGpio + (l->h->gpio / 10) ;
+    l->shift = (l->h->gpio % 10) * 3 ;
+  }
+
+  pinMode     (pin, INPUT) ;
+  wpiPinWrite (l->h, LOW) ;
+
+  return 0 ;
+}
+
+
+/*
+ * softI2cSetup:
+ *	Create a soft I2C bus on the given pins. speed is in Hz - 0 for the
+ *	standard 100KHz. If a slave is holding SDA low from an interrupted
+ *	transaction, we clock it out first.
+ *	Returns 0 or -1 with errno set.
+ *********************************************************************************
+ */
+
+int softI2cSetup (int bus, int sdaPin, int sclPin, int speed)
+{
+  struct softI2cStruct *s ;
+  int i ;
+
+  if ((bus < 0) || (bus >= WPI_SOFT_I2C_MAX_BUS) || softI2cs [bus].used || (speed < 0) || (sdaPin == sclPin))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  s = &softI2cs [bus] ;
+
+  if (lineOpen (&s->sda, sdaPin) < 0)
+  {
+    errno = ENODEV ;
+    return -1 ;
+  }
+
+  if (lineOpen (&s->scl, sclPin) < 0)
+  {
+    wiringPiPinClose (s->sda.h) ;
+    errno = ENODEV ;
+    return -1 ;
+  }
+
+  s->halfNs = 500000000U / (unsigned int)((speed == 0) ? 100000 : speed) ;
+
+// Bus recovery
+
+  for (i = 0 ; (i < 9) && (wpiPinRead (s->sda.h) == LOW) ; ++i)
+    if (busBit (s, 1) < 0)
+      break ;
+  busStop (s) ;
+
+  s->used = TRUE ;
+
+  return 0 ;
+}
+
+
+/*
+ * softI2cActive:
+ * softI2cClose:
+ *	Is a bus set up, and finish with one. The pins are left as inputs.
+ *********************************************************************************
+ */
+
+int softI2cActive (int bus)
+{
+  return (bus >= 0) && (bus < WPI_SOFT_I2C_MAX_BUS) && softI2cs [bus].used ;
+}
+
+int softI2cClose (int bus)
+{
+  if (!softI2cActive (bus))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  softI2cs [bus].used = FALSE ;
+  wiringPiPinClose (softI2cs [bus].sda.h) ;
+  wiringPiPinClose (softI2cs [bus].scl.h) ;
+
+  return 0 ;
+}
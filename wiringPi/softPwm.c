@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <malloc.h>
 #include <pthread.h>
+#include <sched.h>
 
 #include "wiringPi.h"
 #include "softPwm.h"
@@ -49,14 +50,125 @@
 //
 //	Another way to increase the frequency is to reduce the range - however
 //	that reduces the overall output accuracy...
+//
+//	softPwmCreateEx lets you pick the pulse time (tick) per pin in nS,
+//	and softPwmJitter tells you how late the edges have actually been.
+//	Edges are timed against absolute deadlines, so lateness on one edge
+//	doesn't stretch the period.
+//
+//	A channel at 0 or full range has no edges: it's parked, and its thread
+//	(or its slot in the shared engine) waits on pwmWake until softPwmWrite
+//	changes it, rather than waking up every period.
+//
+//	With the executive running (piExecStart) every channel goes on the
+//	shared engine, and the engine is a task on the executive rather than
+//	a thread.
 
 #define	PULSE_TIME	100
 
 static volatile int marks         [MAX_PINS] ;
 static volatile int range         [MAX_PINS] ;
+static volatile unsigned int ticks [MAX_PINS] ;		// nS
 static volatile pthread_t threads [MAX_PINS] ;
 static volatile int newPin = -1 ;
 
+// The shared engine:
+//	One thread runs every channel. Each channel keeps the absolute time of
+//	its next edge and the thread sleeps until the earliest of those, then
+//	applies every edge that's due with one masked write per GPIO bank. The
+//	thread exits when the last channel is stopped.
+
+#define	IDLE_NS		10000000ULL
+#define	NEVER		(~0ULL)
+
+static int engine = SOFT_PWM_THREADS ;
+
+static wpiPin_t           handles     [MAX_PINS] ;
+static unsigned long long nextEdge    [MAX_PINS] ;
+static unsigned long long periodStart [MAX_PINS] ;
+static int                inMark      [MAX_PINS] ;
+static int                level       [MAX_PINS] ;
+
+static int active [MAX_PINS] ;
+static int numActive     = 0 ;
+static int engineRunning = FALSE ;
+static int engineTask    = -1 ;		// On the executive
+
+static pthread_mutex_t engineLock = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_cond_t  pwmWake    = PTHREAD_COND_INITIALIZER ;
+
+static volatile int parked [MAX_PINS] ;
+
+// Jitter: how late each edge was, in nS
+
+static volatile unsigned int       jitterMax   [MAX_PINS] ;
+static volatile unsigned long long jitterSum   [MAX_PINS] ;
+static volatile unsigned int       jitterCount [MAX_PINS] ;
+
+
+/*
+ * jitterRecord:
+ *	Note how late an edge that should have happened at deadline was
+ *********************************************************************************
+ */
+
+static void jitterRecord (int pin, unsigned long long deadline, unsigned long long now)
+{
+  unsigned int late ;
+
+  late = (now > deadline) ? (unsigned int)(now - deadline) : 0 ;
+
+  if (late > jitterMax [pin])
+    jitterMax [pin] = late ;
+  jitterSum   [pin] += late ;
+  jitterCount [pin] += 1 ;
+
+  wiringPiStatsRecord (WPI_STATS_SOFTPWM, pin, late) ;
+}
+
+
+/*
+ * park:
+ *	Note that a channel has nothing to do while its mark stays as it is,
+ *	unless softPwmWrite has changed it already. It has to see parked or
+ *	we have to see the new mark, hence the fence. engineLock is held.
+ *********************************************************************************
+ */
+
+static void park (int pin, int mark)
+{
+  parked [pin] = TRUE ;
+  __atomic_thread_fence (__ATOMIC_SEQ_CST) ;
+  if (marks [pin] != mark)
+    parked [pin] = FALSE ;
+}
+
+
+/*
+ * waitForChange:
+ *	Park a channel's own thread until its mark changes. The thread may be
+ *	cancelled in the wait, so the lock's released by a cleanup handler.
+ *********************************************************************************
+ */
+
+static void unlockEngine (void *arg)
+{
+  (void)arg ;
+  pthread_mutex_unlock (&engineLock) ;
+}
+
+static void waitForChange (int pin, int mark)
+{
+  pthread_mutex_lock (&engineLock) ;
+  pthread_cleanup_push (unlockEngine, NULL) ;
+
+  park (pin, mark) ;
+  while (parked [pin])
+    pthread_cond_wait (&pwmWake, &engineLock) ;
+
+  pthread_cleanup_pop (1) ;
+}
+
 
 /*
  * softPwmThread:
@@ -67,6 +179,7 @@ static volatile int newPin = -1 ;
 static void *softPwmThread (void *arg)
 {
   int pin, mark, space ;
+  unsigned long long start, tick ;
   struct sched_param param ;
 
   param.sched_priority = sched_get_priority_max (SCHED_RR) ;
@@ -80,24 +193,269 @@ static void *softPwmThread (void *arg)
 
   piHiPri (90) ;
 
+  start = nanos64 () ;
+
   for (;;)
   {
     mark  = marks [pin] ;
     space = range [pin] - mark ;
+    tick  = ticks [pin] ;
+
+    if ((mark == 0) || (space == 0))		// Flat out - nothing to time
+    {
+      digitalWrite  (pin, (mark == 0) ? LOW : HIGH) ;
+      waitForChange (pin, mark) ;
+      start = nanos64 () ;
+      continue ;
+    }
 
     if (mark != 0)
-      digitalWrite (pin, HIGH) ;
-    delayMicroseconds (mark * 100) ;
+    {
+      digitalWrite    (pin, HIGH) ;
+      delayUntilNanos (start + mark * tick) ;
+      jitterRecord    (pin, start + mark * tick, nanos64 ()) ;
+    }
 
     if (space != 0)
       digitalWrite (pin, LOW) ;
-    delayMicroseconds (space * 100) ;
+
+    start += range [pin] * tick ;
+    if (start < nanos64 ())		// Fallen right behind: re-sync
+      start = nanos64 () ;
+
+    delayUntilNanos (start) ;
+    jitterRecord    (pin, start, nanos64 ()) ;
+  }
+
+  return NULL ;
+}
+
+
+/*
+ * channelEdge:
+ *	Work out what a channel in the shared engine does at its next edge,
+ *	and when the edge after that is. Returns the new output level.
+ *********************************************************************************
+ */
+
+static int channelEdge (int pin, unsigned long long now)
+{
+  unsigned long long tick = ticks [pin] ;
+  int mark, r ;
+
+  r = range [pin] ;
+
+  if (inMark [pin])				// End of the mark
+  {
+    inMark   [pin] = FALSE ;
+    nextEdge [pin] = periodStart [pin] + r * tick ;
+    return LOW ;
+  }
+
+// Start of a period. If we've fallen a whole period behind then re-sync
+//	rather than try to catch up.
+
+  periodStart [pin] = nextEdge [pin] ;
+  if (periodStart [pin] + r * tick <= now)
+    periodStart [pin] = now ;
+
+  mark = marks [pin] ;
+
+  if ((mark == 0) || (mark == r))		// Flat out one way or the other
+  {
+    nextEdge [pin] = periodStart [pin] + r * tick ;
+    park (pin, mark) ;
+    return (mark == 0) ? LOW : HIGH ;
+  }
+
+  inMark   [pin] = TRUE ;
+  nextEdge [pin] = periodStart [pin] + mark * tick ;
+  return HIGH ;
+}
+
+
+/*
+ * engineStep:
+ *	Apply every edge in the shared engine that's due. engineLock is
+ *	held. Returns when the next one is due, or NEVER if every channel
+ *	is parked.
+ *********************************************************************************
+ */
+
+static unsigned long long engineStep (void)
+{
+  unsigned long long now, wake ;
+  unsigned int setMask [2], clrMask [2] ;
+  int i, pin, value, busy ;
+
+  now  = nanos64 () ;
+  wake = now + IDLE_NS ;
+  busy = FALSE ;
+  setMask [0] = setMask [1] = clrMask [0] = clrMask [1] = 0 ;
+
+  for (i = 0 ; i < numActive ; ++i)
+  {
+    pin = active [i] ;
+
+    if (parked [pin])
+      continue ;
+
+    if (nextEdge [pin] <= now)
+    {
+      jitterRecord (pin, nextEdge [pin], now) ;
+      value = channelEdge (pin, now) ;
+
+      if (value != level [pin])
+      {
+	level [pin] = value ;
+
+	if ((handles [pin]->set != NULL) && (handles [pin]->gpio >= 0))
+	{
+	  if (value == HIGH)
+	    setMask [handles [pin]->gpio >> 5] |= handles [pin]->mask ;
+	  else
+	    clrMask [handles [pin]->gpio >> 5] |= handles [pin]->mask ;
+	}
+	else
+	  wpiPinWrite (handles [pin], value) ;
+      }
+    }
+
+    if (parked [pin])
+      continue ;
+
+    busy = TRUE ;
+    if (nextEdge [pin] < wake)
+      wake = nextEdge [pin] ;
+  }
+
+  if ((setMask [0] | clrMask [0]) != 0)
+    digitalWriteMask (0, setMask [0], clrMask [0]) ;
+  if ((setMask [1] | clrMask [1]) != 0)
+    digitalWriteMask (1, setMask [1], clrMask [1]) ;
+
+  return busy ? wake : NEVER ;
+}
+
+
+/*
+ * softPwmEngineThread:
+ *	The thread behind the shared engine
+ *********************************************************************************
+ */
+
+static void *softPwmEngineThread (void *arg)
+{
+  struct sched_param param ;
+  unsigned long long wake ;
+
+  (void)arg ;
+
+  param.sched_priority = sched_get_priority_max (SCHED_RR) ;
+  pthread_setschedparam (pthread_self (), SCHED_RR, &param) ;
+  piHiPri (90) ;
+
+  for (;;)
+  {
+    pthread_mutex_lock (&engineLock) ;
+
+    if (numActive == 0)
+    {
+      engineRunning = FALSE ;
+      pthread_mutex_unlock (&engineLock) ;
+      break ;
+    }
+
+    wake = engineStep () ;
+
+// Every channel parked: wait for a softPwmWrite (or a new or stopped
+//	channel) rather than timing anything. Otherwise a parked channel
+//	that's changed gets picked up at the next edge of the others.
+
+    if (wake == NEVER)
+    {
+      pthread_cond_wait (&pwmWake, &engineLock) ;
+      pthread_mutex_unlock (&engineLock) ;
+      continue ;
+    }
+
+    pthread_mutex_unlock (&engineLock) ;
+
+    delayUntilNanos (wake) ;
   }
 
   return NULL ;
 }
 
 
+/*
+ * softPwmEngineExec:
+ *	The shared engine as a task on the executive: the same, but waiting
+ *	is the executive's job.
+ *********************************************************************************
+ */
+
+static unsigned long long softPwmEngineExec (UNU void *ctx, UNU unsigned long long deadline)
+{
+  unsigned long long wake ;
+
+  pthread_mutex_lock (&engineLock) ;
+
+  if (numActive == 0)
+  {
+    engineRunning = FALSE ;
+    engineTask    = -1 ;
+    pthread_mutex_unlock (&engineLock) ;
+    return 0 ;
+  }
+
+  wake = engineStep () ;
+
+  pthread_mutex_unlock (&engineLock) ;
+
+  return (wake == NEVER) ? PI_EXEC_IDLE : wake ;
+}
+
+
+/*
+ * engineWake:
+ *	Tell the shared engine something's changed, however it's running.
+ *	engineLock is held.
+ *********************************************************************************
+ */
+
+static void engineWake (void)
+{
+  pthread_cond_broadcast (&pwmWake) ;
+  if (engineTask >= 0)
+    piExecWake (engineTask, 0) ;
+}
+
+
+/*
+ * softPwmEngine:
+ *	Select how new softPWM channels are run: SOFT_PWM_THREADS (the
+ *	default) gives each pin its own thread, SOFT_PWM_SHARED runs them all
+ *	from one thread. Can only be changed while no channels are running.
+ *********************************************************************************
+ */
+
+int softPwmEngine (int newEngine)
+{
+  int pin ;
+
+  if ((newEngine != SOFT_PWM_THREADS) && (newEngine != SOFT_PWM_SHARED))
+    return -1 ;
+
+  for (pin = 0 ; pin < MAX_PINS ; ++pin)
+    if (range [pin] != 0)
+      return -1 ;
+
+  engine = newEngine ;
+  return 0 ;
+}
+
+
 /*
  * softPwmWrite:
  *	Write a PWM value to the given pin
@@ -114,17 +472,92 @@ void softPwmWrite (int pin, int value)
       value = range [pin] ;
 
     marks [pin] = value ;
+
+// Un-park the channel if it's waiting for this
+
+    __atomic_thread_fence (__ATOMIC_SEQ_CST) ;
+    if (parked [pin])
+    {
+      pthread_mutex_lock (&engineLock) ;
+	parked [pin] = FALSE ;
+	engineWake () ;
+      pthread_mutex_unlock (&engineLock) ;
+    }
+  }
+}
+
+
+/*
+ * softPwmCreateShared:
+ *	Add a channel to the shared engine, starting the engine thread if
+ *	it's not already running.
+ *********************************************************************************
+ */
+
+static int softPwmCreateShared (int pin, int initialValue, int pwmRange, unsigned int tickNs)
+{
+  pthread_t myThread ;
+  int res = 0 ;
+
+  if ((handles [pin] = wiringPiPinOpen (pin)) == NULL)
+    return -1 ;
+
+  digitalWrite (pin, LOW) ;
+  pinMode      (pin, OUTPUT) ;
+
+  pthread_mutex_lock (&engineLock) ;
+
+  marks    [pin] = initialValue ;
+  range    [pin] = pwmRange ;
+  ticks    [pin] = tickNs ;
+  level    [pin] = LOW ;
+  inMark   [pin] = FALSE ;
+  nextEdge [pin] = nanos64 () ;
+  parked   [pin] = FALSE ;
+
+  active [numActive++] = pin ;
+  engineWake () ;
+
+  if (!engineRunning)
+  {
+    /**/ if (piExecActive ())
+      res = ((engineTask = piExecTimer (0, softPwmEngineExec, NULL)) < 0) ? -1 : 0 ;
+    else if ((res = pthread_create (&myThread, NULL, softPwmEngineThread, NULL)) == 0)
+      pthread_detach (myThread) ;
+
+    if (res == 0)
+      engineRunning = TRUE ;
+    else
+    {
+      --numActive ;
+      range [pin] = 0 ;
+      wiringPiPinClose (handles [pin]) ;
+      handles [pin] = NULL ;
+    }
   }
+
+  pthread_mutex_unlock (&engineLock) ;
+
+  return res ;
 }
 
 
 /*
  * softPwmCreate:
- *	Create a new softPWM thread.
+ * softPwmCreateEx:
+ *	Create a new softPWM thread. softPwmCreate uses the standard 100µS
+ *	pulse time, softPwmCreateEx lets you set it in nS - e.g. a range of
+ *	100 and a tick of 2000nS gives 5KHz. Very short ticks are timed by
+ *	hard-looping so will use a lot of CPU.
  *********************************************************************************
  */
 
 int softPwmCreate (int pin, int initialValue, int pwmRange)
+{
+  return softPwmCreateEx (pin, initialValue, pwmRange, PULSE_TIME * 1000) ;
+}
+
+int softPwmCreateEx (int pin, int initialValue, int pwmRange, unsigned int tickNs)
 {
   int res ;
   pthread_t myThread ;
@@ -136,9 +569,14 @@ int softPwmCreate (int pin, int initialValue, int pwmRange)
   if (range [pin] != 0)	// Already running on this pin
     return -1 ;
 
-  if (pwmRange <= 0)
+  if ((pwmRange <= 0) || (tickNs == 0))
     return -1 ;
 
+  jitterMax [pin] = jitterSum [pin] = jitterCount [pin] = 0 ;
+
+  if ((engine == SOFT_PWM_SHARED) || piExecActive ())	// Only the shared engine goes on the executive
+    return softPwmCreateShared (pin, initialValue, pwmRange, tickNs) ;
+
   passPin = malloc (sizeof (*passPin)) ;
   if (passPin == NULL)
     return -1 ;
@@ -146,8 +584,10 @@ int softPwmCreate (int pin, int initialValue, int pwmRange)
   digitalWrite (pin, LOW) ;
   pinMode      (pin, OUTPUT) ;
 
-  marks [pin] = initialValue ;
-  range [pin] = pwmRange ;
+  marks  [pin] = initialValue ;
+  range  [pin] = pwmRange ;
+  ticks  [pin] = tickNs ;
+  parked [pin] = FALSE ;
 
   *passPin = pin ;
   newPin   = pin ;
@@ -162,6 +602,29 @@ int softPwmCreate (int pin, int initialValue, int pwmRange)
 }
 
 
+/*
+ * softPwmJitter:
+ *	Report how late the edges on a pin have been, in nS, since it was
+ *	created or since the last call, then start counting again.
+ *********************************************************************************
+ */
+
+int softPwmJitter (int pin, unsigned int *maxNs, unsigned int *meanNs)
+{
+  if ((pin < 0) || (pin >= MAX_PINS) || (range [pin] == 0))
+    return -1 ;
+
+  if (maxNs != NULL)
+    *maxNs = jitterMax [pin] ;
+  if (meanNs != NULL)
+    *meanNs = (jitterCount [pin] == 0) ? 0 : (unsigned int)(jitterSum [pin] / jitterCount [pin]) ;
+
+  jitterMax [pin] = jitterSum [pin] = jitterCount [pin] = 0 ;
+
+  return 0 ;
+}
+
+
 /*
  * softPwmStop:
  *	Stop an existing softPWM thread
@@ -170,9 +633,29 @@ int softPwmCreate (int pin, int initialValue, int pwmRange)
 
 void softPwmStop (int pin)
 {
+  int i ;
+
   if (pin < MAX_PINS)
   {
-    if (range [pin] != 0)
+    if ((range [pin] != 0) && (handles [pin] != NULL))	// Shared engine
+    {
+      pthread_mutex_lock (&engineLock) ;
+      for (i = 0 ; i < numActive ; ++i)
+	if (active [i] == pin)
+	{
+	  active [i] = active [--numActive] ;
+	  break ;
+	}
+      range  [pin] = 0 ;
+      parked [pin] = FALSE ;
+      engineWake () ;
+      pthread_mutex_unlock (&engineLock) ;
+
+      digitalWrite (pin, LOW) ;
+      wiringPiPinClose (handles [pin]) ;
+      handles [pin] = NULL ;
+    }
+    else if (range [pin] != 0)
     {
       pthread_cancel (threads [pin]) ;
       pthread_join   (threads [pin], NULL) ;
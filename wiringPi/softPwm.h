@@ -22,13 +22,21 @@
  ***********************************************************************
  */
 
+// Engines for softPwmEngine ()
+
+#define	SOFT_PWM_THREADS	0
+#define	SOFT_PWM_SHARED		1
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-extern int  softPwmCreate (int pin, int value, int range) ;
-extern void softPwmWrite  (int pin, int value) ;
-extern void softPwmStop   (int pin) ;
+extern int  softPwmEngine (int engine) ;
+extern int  softPwmCreate   (int pin, int value, int range) ;
+extern int  softPwmCreateEx (int pin, int value, int range, unsigned int tickNs) ;
+extern void softPwmWrite    (int pin, int value) ;
+extern int  softPwmJitter   (int pin, unsigned int *maxNs, unsigned int *meanNs) ;
+extern void softPwmStop     (int pin) ;
 
 #ifdef __cplusplus
 }
@@ -25,8 +25,6 @@
 
 //#include <stdio.h>
 #include <string.h>
-#include <time.h>
-#include <sys/time.h>
 #include <pthread.h>
 
 #include "wiringPi.h"
@@ -63,93 +61,224 @@
 //
 //	If you want servo control for the Pi, then use the servoblaster kernel
 //	module.
+//
+//	It's now a lot better than it was: the frame is timed against absolute
+//	deadlines so errors don't add up from one pulse to the next, all the
+//	pulses that end at the same time go off together in one masked write
+//	and the sort is only redone when a value actually changes.
+//
+//	With the executive running (piExecStart) the thread is a task on it
+//	instead, stepping through the frame a deadline at a time: the start,
+//	then the end of each group.
+
+// MAX_SERVOS:
+//	How many servos softServoSetupEx can take. The thread turns them all on
+//	together and masks them off, so more servos costs very little.
 
-#define	MAX_SERVOS	8
+#ifndef	MAX_SERVOS
+#  define	MAX_SERVOS	32
+#endif
+
+#define	FRAME_TIME	8000		// uS
 
 static int pinMap     [MAX_SERVOS] ;	// Keep track of our pins
 static int pulseWidth [MAX_SERVOS] ;	// microseconds
+static int numServos = 0 ;
+
+static wpiPin_t handles [MAX_SERVOS] ;
+
+static volatile int changed = TRUE ;
+static pthread_mutex_t servoLock = PTHREAD_MUTEX_INITIALIZER ;
+
+// The schedule: each group of servos that end at the same time, with the
+//	bank masks to clear and any pins that can't be masked.
+
+struct servoGroupStruct
+{
+  int          width ;
+  unsigned int clr [2] ;
+  int          numSlow ;
+  int          slow [MAX_SERVOS] ;
+} ;
+
+static struct servoGroupStruct groups [MAX_SERVOS] ;
+static int numGroups ;
+static unsigned int allOn [2] ;
 
 
 /*
- * softServoThread:
- *	Thread to do the actual Servo PWM output
+ * buildSchedule:
+ *	Sort the delays (& pins), shortest first and gather them up into
+ *	groups that turn off together.
  *********************************************************************************
  */
 
-static PI_THREAD (softServoThread)
+static void buildSchedule (void)
 {
   register int i, j, k, m, tmp ;
-  int lastDelay, pin, servo ;
-
   int myDelays [MAX_SERVOS] ;
-  int myPins   [MAX_SERVOS] ;
+  int myServo  [MAX_SERVOS] ;
+  int servo, n ;
+  wpiPin_t h ;
+  struct servoGroupStruct *g = NULL ;
+
+  pthread_mutex_lock (&servoLock) ;
+    n = numServos ;
+    memcpy (myDelays, pulseWidth, sizeof (myDelays)) ;
+    changed = FALSE ;
+  pthread_mutex_unlock (&servoLock) ;
+
+  for (servo = 0 ; servo < n ; ++servo)
+    myServo [servo] = servo ;
+
+  for (m = n / 2 ; m > 0 ; m /= 2 )
+    for (j = m ; j < n ; ++j)
+      for (i = j - m ; i >= 0 ; i -= m)
+      {
+	k = i + m ;
+	if (myDelays [k] >= myDelays [i])
+	  break ;
+	else // Swap
+	{
+	  tmp = myDelays [i] ; myDelays [i] = myDelays [k] ; myDelays [k] = tmp ;
+	  tmp = myServo  [i] ; myServo  [i] = myServo  [k] ; myServo  [k] = tmp ;
+	}
+      }
+
+  numGroups = 0 ;
+  allOn [0] = allOn [1] = 0 ;
+
+  for (i = 0 ; i < n ; ++i)
+  {
+    if ((h = handles [myServo [i]]) == NULL)
+      continue ;
+
+    if ((g == NULL) || (g->width != myDelays [i]))
+    {
+      g = &groups [numGroups++] ;
+      g->width  = myDelays [i] ;
+      g->clr [0] = g->clr [1] = 0 ;
+      g->numSlow = 0 ;
+    }
 
-  struct timeval  tNow, tStart, tPeriod, tGap, tTotal ;
-  struct timespec tNs ;
+    if ((h->set != NULL) && (h->gpio >= 0))
+    {
+      g->clr [h->gpio >> 5] |= h->mask ;
+      allOn  [h->gpio >> 5] |= h->mask ;
+    }
+    else
+      g->slow [g->numSlow++] = myServo [i] ;
+  }
+}
+
+
+/*
+ * frameOn: groupOff:
+ *	Start a frame with every servo on (after picking up any changes),
+ *	and turn a group off at the end of its pulse.
+ *********************************************************************************
+ */
+
+static void frameOn (void)
+{
+  int i, j ;
+
+  if (changed)
+    buildSchedule () ;
+
+  if (allOn [0] != 0) digitalWriteMask (0, allOn [0], 0) ;
+  if (allOn [1] != 0) digitalWriteMask (1, allOn [1], 0) ;
+  for (i = 0 ; i < numGroups ; ++i)
+    for (j = 0 ; j < groups [i].numSlow ; ++j)
+      wpiPinWrite (handles [groups [i].slow [j]], HIGH) ;
+}
+
+static void groupOff (struct servoGroupStruct *g)
+{
+  int j ;
+
+  if (g->clr [0] != 0) digitalWriteMask (0, 0, g->clr [0]) ;
+  if (g->clr [1] != 0) digitalWriteMask (1, 0, g->clr [1]) ;
+  for (j = 0 ; j < g->numSlow ; ++j)
+    wpiPinWrite (handles [g->slow [j]], LOW) ;
+}
+
+
+/*
+ * softServoThread:
+ *	Thread to do the actual Servo PWM output
+ *********************************************************************************
+ */
 
-  tTotal.tv_sec  =    0 ;
-  tTotal.tv_usec = 8000 ;
+static PI_THREAD (softServoThread)
+{
+  unsigned long long frameStart ;
+  int i ;
 
   piHiPri (50) ;
 
+  frameStart = micros64 () ;
+
   for (;;)
   {
-    gettimeofday (&tStart, NULL) ;
+    frameOn () ;
 
-    memcpy (myDelays, pulseWidth, sizeof (myDelays)) ;
-    memcpy (myPins,   pinMap,     sizeof (myPins)) ;
+// Now turn each group off at its deadline
 
-// Sort the delays (& pins), shortest first
+    for (i = 0 ; i < numGroups ; ++i)
+    {
+      delayUntilMicros  (frameStart + groups [i].width) ;
+      wiringPiStatsLate (WPI_STATS_SOFTSERVO, 0, (frameStart + groups [i].width) * 1000) ;
+      groupOff (&groups [i]) ;
+    }
 
-    for (m = MAX_SERVOS / 2 ; m > 0 ; m /= 2 )
-      for (j = m ; j < MAX_SERVOS ; ++j)
-	for (i = j - m ; i >= 0 ; i -= m)
-	{
-	  k = i + m ;
-	  if (myDelays [k] >= myDelays [i])
-	    break ;
-	  else // Swap
-	  {
-	    tmp = myDelays [i] ; myDelays [i] = myDelays [k] ; myDelays [k] = tmp ;
-	    tmp = myPins   [i] ; myPins   [i] = myPins   [k] ; myPins   [k] = tmp ;
-	  }
-	}
+// Wait until the end of the time-slot. If we've fallen a whole frame
+//	behind then re-sync rather than fire off a burst of short frames.
 
-// All on
+    frameStart += FRAME_TIME ;
+    if (frameStart + FRAME_TIME < micros64 ())
+      frameStart = micros64 () ;
 
-    lastDelay = 0 ;
-    for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
-    {
-      if ((pin = myPins [servo]) == -1)
-	continue ;
+    delayUntilMicros  (frameStart) ;
+    wiringPiStatsLate (WPI_STATS_SOFTSERVO, 0, frameStart * 1000) ;
+  }
 
-      digitalWrite (pin, HIGH) ;
-      myDelays [servo] = myDelays [servo] - lastDelay ;
-      lastDelay += myDelays [servo] ;
-    }
+  return NULL ;
+}
 
-// Now loop, turning them all off as required
 
-    for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
-    {
-      if ((pin = myPins [servo]) == -1)
-	continue ;
+/*
+ * softServoExec:
+ *	The frame as an executive task: step 0 is the start of a frame, and
+ *	step n the end of group n - 1's pulses. Deadlines are in nS.
+ *********************************************************************************
+ */
 
-      delayMicroseconds (myDelays [servo]) ;
-      digitalWrite (pin, LOW) ;
-    }
+static int                execStep = 0 ;
+static unsigned long long execFrame ;
+
+static unsigned long long softServoExec (UNU void *ctx, unsigned long long deadline)
+{
+  unsigned long long now = nanos64 () ;
 
-// Wait until the end of an 8mS time-slot
+  if (deadline != 0)				// 0: the first, which is just now
+    wiringPiStatsLate (WPI_STATS_SOFTSERVO, 0, deadline) ;
 
-    gettimeofday (&tNow, NULL) ;
-    timersub (&tNow, &tStart, &tPeriod) ;
-    timersub (&tTotal, &tPeriod, &tGap) ;
-    tNs.tv_sec  = tGap.tv_sec ;
-    tNs.tv_nsec = tGap.tv_usec * 1000 ;
-    nanosleep (&tNs, NULL) ;
+  if (execStep == 0)
+  {
+    execFrame = deadline ;
+    if (execFrame + FRAME_TIME * 1000ULL < now)	// A whole frame behind (or the first)
+      execFrame = now ;
+    frameOn () ;
   }
+  else
+    groupOff (&groups [execStep - 1]) ;
 
-  return NULL ;
+  if (execStep < numGroups)
+    return execFrame + groups [execStep++].width * 1000ULL ;
+
+  execStep = 0 ;
+  return execFrame + FRAME_TIME * 1000ULL ;
 }
 
 
@@ -170,42 +299,67 @@ void softServoWrite (int servoPin, int value)
   else if (value > 1250)
     value = 1250 ;
 
-  for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
-    if (pinMap [servo] == servoPin)
-      pulseWidth [servo] = value + 1000 ; // uS
+  pthread_mutex_lock (&servoLock) ;
+    for (servo = 0 ; servo < numServos ; ++servo)
+      if ((pinMap [servo] == servoPin) && (pulseWidth [servo] != value + 1000))
+      {
+	pulseWidth [servo] = value + 1000 ; // uS
+	changed = TRUE ;
+      }
+  pthread_mutex_unlock (&servoLock) ;
 }
 
 
 /*
- * softServoSetup:
- *	Setup the software servo system
+ * softServoSetupEx:
+ *	Setup the software servo system with up to MAX_SERVOS pins.
+ *	Pins of -1 are skipped.
  *********************************************************************************
  */
 
-int softServoSetup (int p0, int p1, int p2, int p3, int p4, int p5, int p6, int p7)
+int softServoSetupEx (const int *pins, int count)
 {
   int servo ;
 
-  if (p0 != -1) { pinMode (p0, OUTPUT) ; digitalWrite (p0, LOW) ; }
-  if (p1 != -1) { pinMode (p1, OUTPUT) ; digitalWrite (p1, LOW) ; }
-  if (p2 != -1) { pinMode (p2, OUTPUT) ; digitalWrite (p2, LOW) ; }
-  if (p3 != -1) { pinMode (p3, OUTPUT) ; digitalWrite (p3, LOW) ; }
-  if (p4 != -1) { pinMode (p4, OUTPUT) ; digitalWrite (p4, LOW) ; }
-  if (p5 != -1) { pinMode (p5, OUTPUT) ; digitalWrite (p5, LOW) ; }
-  if (p6 != -1) { pinMode (p6, OUTPUT) ; digitalWrite (p6, LOW) ; }
-  if (p7 != -1) { pinMode (p7, OUTPUT) ; digitalWrite (p7, LOW) ; }
-
-  pinMap [0] = p0 ;
-  pinMap [1] = p1 ;
-  pinMap [2] = p2 ;
-  pinMap [3] = p3 ;
-  pinMap [4] = p4 ;
-  pinMap [5] = p5 ;
-  pinMap [6] = p6 ;
-  pinMap [7] = p7 ;
-
-  for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
+  if ((count < 1) || (count > MAX_SERVOS) || (numServos != 0))
+    return -1 ;
+
+  for (servo = 0 ; servo < count ; ++servo)
+  {
+    pinMap     [servo] = pins [servo] ;
     pulseWidth [servo] = 1500 ;		// Mid point
-  
+    handles    [servo] = NULL ;
+
+    if (pins [servo] == -1)
+      continue ;
+
+    pinMode      (pins [servo], OUTPUT) ;
+    digitalWrite (pins [servo], LOW) ;
+    handles [servo] = wiringPiPinOpen (pins [servo]) ;
+  }
+
+  numServos = count ;
+  changed   = TRUE ;
+
+  if (piExecActive ())
+    return (piExecTimer (0, softServoExec, NULL) < 0) ? -1 : 0 ;
+
   return piThreadCreate (softServoThread) ;
 }
+
+
+/*
+ * softServoSetup:
+ *	Setup the software servo system
+ *********************************************************************************
+ */
+
+int softServoSetup (int p0, int p1, int p2, int p3, int p4, int p5, int p6, int p7)
+{
+  int pins [8] ;
+
+  pins [0] = p0 ; pins [1] = p1 ; pins [2] = p2 ; pins [3] = p3 ;
+  pins [4] = p4 ; pins [5] = p5 ; pins [6] = p6 ; pins [7] = p7 ;
+
+  return softServoSetupEx (pins, 8) ;
+}
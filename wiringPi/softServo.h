@@ -29,6 +29,7 @@ extern "C" {
 
 extern void softServoWrite  (int pin, int value) ;
 extern int softServoSetup   (int p0, int p1, int p2, int p3, int p4, int p5, int p6, int p7) ;
+extern int softServoSetupEx (const int *pins, int count) ;
 
 #ifdef __cplusplus
 }
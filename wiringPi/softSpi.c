@@ -0,0 +1,348 @@
+/*
+ * softSpi.c:
+ *	Bit-banged SPI on any pins
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+
+/*
+ * Notes:
+ *	Up to WPI_SOFT_SPI_MAX_BUS extra SPI buses on any pins. The pins are
+ *	resolved into wpiPin handles at setup so on-board pins are clocked
+ *	with direct GPSET/GPCLR stores and sampled from GPLEV with no table
+ *	look-ups. Extension node pins work too, just a lot slower.
+ *
+ *	Each half clock period is a spin loop calibrated against nanos64 ()
+ *	once, rather than reading the clock for every edge. The time the
+ *	stores themselves take isn't counted, so the real clock rate comes
+ *	out a little under the speed asked for, never over.
+ *
+ *	The mode is the usual SPI mode 0-3: bit 1 is CPOL (clock idles
+ *	high) and bit 0 CPHA (data is sampled on the second edge).
+ *	The chip select is active low, and may be -1 to drive it yourself,
+ *	as may MOSI or MISO for a bus that only goes the one way.
+ *	The bit order takes LSBFIRST and MSBFIRST from wiringShift.h
+ *********************************************************************************
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "wiringPi.h"
+#include "wiringShift.h"
+#include "softSpi.h"
+
+struct softSpiStruct
+{
+  pthread_mutex_t lock ;
+  int          used ;
+  wpiPin_t     sclk, mosi, miso, cs ;
+  int          cpol, cpha ;
+  int          order ;
+  unsigned int halfLoops ;
+} ;
+
+static struct softSpiStruct softSpis [WPI_SOFT_SPI_MAX_BUS] ;
+static pthread_mutex_t softSpiLock = PTHREAD_MUTEX_INITIALIZER ;
+
+static unsigned long long loopsPerMs ;
+static pthread_once_t     calibrateOnce = PTHREAD_ONCE_INIT ;
+
+
+/*
+ * spin:
+ *	Burn a number of loops, and calibrate it
+ *********************************************************************************
+ */
+
+static inline void spin (unsigned int loops)
+{
+  while (loops-- > 0)
+    __asm__ volatile ("" ::: "memory") ;
+}
+
+static void calibrate (void)
+{
+  unsigned long long start, ns, best = 0 ;
+  int i ;
+
+// Best of three, in case we get scheduled out part way
+
+  for (i = 0 ; i < 3 ; ++i)
+  {
+    start = nanos64 () ;
+    spin (1000000) ;
+    ns = nanos64 () - start ;
+    if ((best == 0) || (ns < best))
+      best = ns ;
+  }
+
+  loopsPerMs = 1000000000000ULL / (best ? best : 1) ;
+}
+
+
+/*
+ * reverse:
+ *	Bit reverse a byte for LSB first transfers
+ *********************************************************************************
+ */
+
+static inline unsigned int reverse (unsigned int b)
+{
+  b = ((b & 0xF0) >> 4) | ((b & 0x0F) << 4) ;
+  b = ((b & 0xCC) >> 2) | ((b & 0x33) << 2) ;
+  b = ((b & 0xAA) >> 1) | ((b & 0x55) << 1) ;
+  return b ;
+}
+
+
+/*
+ * softSpiDataRW:
+ *	Write and read a block of data over a soft SPI bus, in the same
+ *	way as wiringPiSPIDataRW (): what comes back replaces what was sent.
+ *	Returns len, or -1 with errno set.
+ *********************************************************************************
+ */
+
+int softSpiDataRW (int bus, unsigned char *data, int len)
+{
+  struct softSpiStruct *s ;
+  unsigned int out, in, bit, half ;
+  int active, idle, j ;
+
+  if ((bus < 0) || (bus >= WPI_SOFT_SPI_MAX_BUS) || !softSpis [bus].used || (len < 0))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  s = &softSpis [bus] ;
+
+  pthread_mutex_lock (&s->lock) ;
+
+  if (!s->used)
+  {
+    pthread_mutex_unlock (&s->lock) ;
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  half   = s->halfLoops ;
+  idle   = s->cpol ;
+  active = !s->cpol ;
+
+  if (s->cs != NULL)
+  {
+    wpiPinWrite (s->cs, LOW) ;
+    spin (half) ;
+  }
+
+  for (j = 0 ; j < len ; ++j)
+  {
+    out = (s->order == LSBFIRST) ? reverse (data [j]) : data [j] ;
+    in  = 0 ;
+
+    for (bit = 0x80 ; bit != 0 ; bit >>= 1)
+    {
+      if (s->cpha == 0)
+      {
+	if (s->mosi != NULL)
+	  wpiPinWrite (s->mosi, (out & bit) != 0) ;
+	spin (half) ;
+	wpiPinWrite (s->sclk, active) ;
+	if ((s->miso != NULL) && (wpiPinRead (s->miso) != LOW))
+	  in |= bit ;
+	spin (half) ;
+	wpiPinWrite (s->sclk, idle) ;
+      }
+      else
+      {
+	wpiPinWrite (s->sclk, active) ;
+	if (s->mosi != NULL)
+	  wpiPinWrite (s->mosi, (out & bit) != 0) ;
+	spin (half) ;
+	wpiPinWrite (s->sclk, idle) ;
+	if ((s->miso != NULL) && (wpiPinRead (s->miso) != LOW))
+	  in |= bit ;
+	spin (half) ;
+      }
+    }
+
+    data [j] = (s->order == LSBFIRST) ? reverse (in) : in ;
+  }
+
+  if (s->cs != NULL)
+  {
+    spin (half) ;
+    wpiPinWrite (s->cs, HIGH) ;
+  }
+
+  pthread_mutex_unlock (&s->lock) ;
+
+  return len ;
+}
+
+
+/*
+ * softSpiBitOrder:
+ *	MSBFIRST (the default) or LSBFIRST
+ *********************************************************************************
+ */
+
+int softSpiBitOrder (int bus, int order)
+{
+  if ((bus < 0) || (bus >= WPI_SOFT_SPI_MAX_BUS) || !softSpis [bus].used || ((order != LSBFIRST) && (order != MSBFIRST)))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  pthread_mutex_lock (&softSpis [bus].lock) ;
+    softSpis [bus].order = order ;
+  pthread_mutex_unlock (&softSpis [bus].lock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * closePins:
+ *	Release the pin handles of a bus
+ *********************************************************************************
+ */
+
+static void closePins (struct softSpiStruct *s)
+{
+  if (s->sclk != NULL) wiringPiPinClose (s->sclk) ;
+  if (s->mosi != NULL) wiringPiPinClose (s->mosi) ;
+  if (s->miso != NULL) wiringPiPinClose (s->miso) ;
+  if (s->cs   != NULL) wiringPiPinClose (s->cs) ;
+
+  s->sclk = s->mosi = s->miso = s->cs = NULL ;
+}
+
+
+/*
+ * softSpiSetup:
+ *	Create a soft SPI bus. speed is in Hz, or 0 to go as fast as the
+ *	pins will toggle, and mode is 0-3. Any of mosiPin, misoPin and
+ *	csPin may be -1.
+ *	Returns 0 or -1 with errno set.
+ *********************************************************************************
+ */
+
+int softSpiSetup (int bus, int sclkPin, int mosiPin, int misoPin, int csPin, int speed, int mode)
+{
+  struct softSpiStruct *s ;
+
+  if ((bus < 0) || (bus >= WPI_SOFT_SPI_MAX_BUS) || (speed < 0) || (mode < 0) || (mode > 3))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  pthread_once (&calibrateOnce, calibrate) ;
+
+  pthread_mutex_lock (&softSpiLock) ;
+
+  s = &softSpis [bus] ;
+  if (s->used)
+  {
+    pthread_mutex_unlock (&softSpiLock) ;
+    errno = EBUSY ;
+    return -1 ;
+  }
+
+  if (                        ((s->sclk = wiringPiPinOpen (sclkPin)) == NULL)  ||
+      ((mosiPin != -1) && ((s->mosi = wiringPiPinOpen (mosiPin)) == NULL)) ||
+      ((misoPin != -1) && ((s->miso = wiringPiPinOpen (misoPin)) == NULL)) ||
+      ((csPin   != -1) && ((s->cs   = wiringPiPinOpen (csPin))   == NULL)))
+  {
+    closePins (s) ;
+    pthread_mutex_unlock (&softSpiLock) ;
+    errno = ENODEV ;
+    return -1 ;
+  }
+
+  s->cpol      = (mode & 2) != 0 ;
+  s->cpha      = (mode & 1) != 0 ;
+  s->order     = MSBFIRST ;
+  s->halfLoops = (speed == 0) ? 0 : (unsigned int)((loopsPerMs * 500000000ULL / speed + 999999) / 1000000) ;
+
+// Idle the bus before the pins become outputs
+
+  if (s->cs != NULL)
+  {
+    wpiPinWrite (s->cs, HIGH) ;
+    pinMode (csPin, OUTPUT) ;
+  }
+  wpiPinWrite (s->sclk, s->cpol) ;
+  pinMode (sclkPin, OUTPUT) ;
+  if (s->mosi != NULL)
+  {
+    wpiPinWrite (s->mosi, LOW) ;
+    pinMode (mosiPin, OUTPUT) ;
+  }
+  if (s->miso != NULL)
+    pinMode (misoPin, INPUT) ;
+
+  pthread_mutex_init (&s->lock, NULL) ;
+  s->used = TRUE ;
+
+  pthread_mutex_unlock (&softSpiLock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * softSpiClose:
+ *	Finish with a soft SPI bus. The pins are left as they are.
+ *********************************************************************************
+ */
+
+int softSpiClose (int bus)
+{
+  struct softSpiStruct *s ;
+
+  if ((bus < 0) || (bus >= WPI_SOFT_SPI_MAX_BUS))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  pthread_mutex_lock (&softSpiLock) ;
+
+  s = &softSpis [bus] ;
+  if (s->used)
+  {
+    pthread_mutex_lock (&s->lock) ;
+      closePins (s) ;
+      s->used = FALSE ;
+    pthread_mutex_unlock (&s->lock) ;
+    pthread_mutex_destroy (&s->lock) ;
+  }
+
+  pthread_mutex_unlock (&softSpiLock) ;
+
+  return 0 ;
+}
@@ -0,0 +1,39 @@
+/*
+ * softSpi.h:
+ *	Bit-banged SPI on any pins
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+
+#define	WPI_SOFT_SPI_MAX_BUS	8
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int softSpiSetup    (int bus, int sclkPin, int mosiPin, int misoPin, int csPin, int speed, int mode) ;
+extern int softSpiBitOrder (int bus, int order) ;
+extern int softSpiDataRW   (int bus, unsigned char *data, int len) ;
+extern int softSpiClose    (int bus) ;
+
+#ifdef __cplusplus
+}
+#endif
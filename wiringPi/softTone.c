@@ -26,62 +26,384 @@
  ***********************************************************************
  */
 
+/*
+ * Notes:
+ *	One thread generates every tone. Each voice is a phase accumulator
+ *	run in time rather than in samples: we keep the absolute time of its
+ *	next edge, plus a 16-bit fraction of a nS, and add the half period to
+ *	it each time, so there's no rounding drift and high pitches stay as
+ *	accurate as low ones. The thread sleeps until the earliest edge and
+ *	toggles everything that's due in one masked write per bank.
+ *
+ *	A PWM capable pin gets the hardware PWM instead (only one at a time as
+ *	both PWM channels share the range register), and a GPIO clock pin gets
+ *	its clock whenever the note is high enough for the clock divider
+ *	(about 4.7KHz and up).
+ *
+ *	Each pin also has a queue of notes: softToneQueue adds a note (or a
+ *	rest with a frequency of 0) and the thread moves through them on its
+ *	own, so the program doesn't have to wake up for every note.
+ *
+ *	When there's nothing to time - every voice silent or on the hardware,
+ *	and no notes in progress - the thread waits on a condition variable
+ *	rather than waking up every millisecond, and anything that changes a
+ *	voice wakes it again.
+ *
+ *	With the executive running (piExecStart) the thread is a task on it
+ *	instead.
+ *********************************************************************************
+ */
+
 #include <stdio.h>
 #include <pthread.h>
+#include <sched.h>
 
 #include "wiringPi.h"
 #include "softTone.h"
 
 #define	MAX_PINS	64
+#define	MAX_NOTES	64
+
+#define	MAX_FREQ	5000
+#define	CLOCK_MIN_FREQ	4700	// 19.2MHz / 4095
+#define	PWM_CLOCK	600000	// 19.2MHz / 32 as set by pinMode PWM_OUTPUT
+#define	IDLE_NS		1000000ULL
+#define	NEVER		(~0ULL)
+
+// How each voice is being generated
+
+#define	TONE_SOFT	0
+#define	TONE_PWM	1
+#define	TONE_CLOCK	2
+
+struct noteStruct
+{
+  int freq ;
+  unsigned int ms ;
+} ;
+
+struct voiceStruct
+{
+  int                active ;
+  int                how ;
+  int                playing ;		// Frequency actually being output
+  int                level ;
+  wpiPin_t           handle ;
+
+  unsigned long long next ;		// nS
+  unsigned int       frac ;		// 1/65536ths of a nS
+  unsigned long long half ;		// Half period, nS << 16
+
+  struct noteStruct  notes [MAX_NOTES] ;
+  int                head, tail ;
+  int                inNote ;
+  unsigned long long noteEnd ;
+} ;
+
+static volatile int freqs [MAX_PINS] ;
+static struct voiceStruct voices [MAX_PINS] ;
+
+static int active [MAX_PINS] ;
+static int numActive     = 0 ;
+static int engineRunning = FALSE ;
+static int engineTask    = -1 ;		// On the executive
+static int pwmPin        = -1 ;		// The pin with the hardware PWM
+
+static          pthread_mutex_t toneLock = PTHREAD_MUTEX_INITIALIZER ;
+static          pthread_cond_t  toneWake = PTHREAD_COND_INITIALIZER ;
+static volatile int             toneIdle = FALSE ;	// The thread's waiting on toneWake
+
+// pinMode () stops any tone on the pin - with toneLock - so when we're
+//	the ones changing a voice's pin mode, with toneLock held, that has
+//	to be skipped.
+
+static __thread int             toneOwnMode = FALSE ;
+
+
+/*
+ * wakeEngine:
+ *	Get the thread (or task) going again if it's idle. Called with
+ *	toneLock held.
+ *********************************************************************************
+ */
+
+static void wakeEngine (void)
+{
+  toneIdle = FALSE ;
+  pthread_cond_broadcast (&toneWake) ;
+  if (engineTask >= 0)
+    piExecWake (engineTask, 0) ;
+}
+
+
+/*
+ * toneMode:
+ *	pinMode () for one of our own pins - toneLock held
+ *********************************************************************************
+ */
+
+static void toneMode (int pin, int mode)
+{
+  toneOwnMode = TRUE ;
+    pinMode (pin, mode) ;
+  toneOwnMode = FALSE ;
+}
+
+
+/*
+ * setFreq:
+ *	Change what a voice is putting out, switching between the software
+ *	and hardware ways of doing it as needed.
+ *********************************************************************************
+ */
+
+static void setFreq (int pin, int freq, unsigned long long now)
+{
+  struct voiceStruct *v = &voices [pin] ;
+  int how, range ;
+
+  /**/ if (pin == pwmPin)
+    how = TONE_PWM ;
+  else if ((freq >= CLOCK_MIN_FREQ) && pinModeCapable (pin, GPIO_CLOCK))
+    how = TONE_CLOCK ;
+  else
+    how = TONE_SOFT ;
+
+  if (how != v->how)
+  {
+    if (how == TONE_CLOCK)
+      toneMode (pin, GPIO_CLOCK) ;
+    else if (how == TONE_SOFT)
+    {
+      toneMode     (pin, OUTPUT) ;
+      digitalWrite (pin, LOW) ;
+      v->level = LOW ;
+    }
+    v->how = how ;
+  }
+
+  /**/ if (how == TONE_PWM)
+  {
+    if (freq == 0)
+      pwmWrite (pin, 0) ;
+    else
+    {
+      range = PWM_CLOCK / freq ;
+      pwmSetRange (range) ;
+      pwmWrite    (pin, range / 2) ;
+    }
+  }
+  else if (how == TONE_CLOCK)
+    gpioClockSet (pin, freq) ;
+  else if (freq != 0)
+  {
+    v->half = (500000000ULL << 16) / freq ;
+    v->next = now ;
+    v->frac = 0 ;
+  }
+  else if (v->level != LOW)
+  {
+    wpiPinWrite (v->handle, LOW) ;
+    v->level = LOW ;
+  }
+
+  v->playing = freq ;
+}
+
+
+/*
+ * toneStep:
+ *	Move every voice on and toggle what's due. toneLock is held.
+ *	Returns when there's next something to do, or NEVER for nothing.
+ *********************************************************************************
+ */
+
+static unsigned long long toneStep (void)
+{
+  struct voiceStruct *v ;
+  struct noteStruct  *n ;
+  unsigned long long now, wake ;
+  unsigned int setMask [2], clrMask [2] ;
+  int i, pin, freq ;
+
+  now  = nanos64 () ;
+  wake = NEVER ;
+  setMask [0] = setMask [1] = clrMask [0] = clrMask [1] = 0 ;
+
+  for (i = 0 ; i < numActive ; ++i)
+  {
+    pin = active [i] ;
+    v   = &voices [pin] ;
+
+// Move on through the queue
+
+    if (v->inNote && (now >= v->noteEnd))
+    {
+      v->inNote = FALSE ;
+      v->tail   = (v->tail + 1) % MAX_NOTES ;
+      if (v->tail == v->head)
+	freqs [pin] = 0 ;
+    }
+
+    if (!v->inNote && (v->tail != v->head))
+    {
+      n = &v->notes [v->tail] ;
+      freqs [pin] = n->freq ;
+      v->inNote   = TRUE ;
+      v->noteEnd  = now + n->ms * 1000000ULL ;
+    }
+
+    if (v->inNote && (v->noteEnd < wake))
+      wake = v->noteEnd ;
+
+    if ((freq = freqs [pin]) != v->playing)
+      setFreq (pin, freq, now) ;
+
+    if ((v->how != TONE_SOFT) || (v->playing == 0))
+      continue ;
+
+// Toggle if it's time
+
+    if (v->next <= now)
+    {
+      v->level = !v->level ;
+
+      if ((v->handle->set != NULL) && (v->handle->gpio >= 0))
+      {
+	if (v->level)
+	  setMask [v->handle->gpio >> 5] |= v->handle->mask ;
+	else
+	  clrMask [v->handle->gpio >> 5] |= v->handle->mask ;
+      }
+      else
+	wpiPinWrite (v->handle, v->level) ;
+
+      v->next += v->half >> 16 ;
+      v->frac += v->half & 0xFFFF ;
+      if (v->frac >= 0x10000)
+      {
+	v->frac -= 0x10000 ;
+	v->next += 1 ;
+      }
+
+      if (v->next <= now)		// Fallen behind: re-sync
+	v->next = now + (v->half >> 16) ;
+    }
+
+    if (v->next < wake)
+      wake = v->next ;
+  }
+
+  if ((setMask [0] | clrMask [0]) != 0)
+    digitalWriteMask (0, setMask [0], clrMask [0]) ;
+  if ((setMask [1] | clrMask [1]) != 0)
+    digitalWriteMask (1, setMask [1], clrMask [1]) ;
+
+  if ((wake != NEVER) && (wake > now + IDLE_NS))
+    wake = now + IDLE_NS ;
+
+  return wake ;
+}
+
 
-#define	PULSE_TIME	100
+/*
+ * goIdle:
+ *	Say we're waiting to be told something's changed - unless a
+ *	softToneWrite came in before we said so. toneLock is held.
+ *	Returns TRUE if we can wait.
+ *********************************************************************************
+ */
+
+static int goIdle (void)
+{
+  int i ;
+
+  toneIdle = TRUE ;
+  __atomic_thread_fence (__ATOMIC_SEQ_CST) ;
 
-static int freqs         [MAX_PINS] ;
-static pthread_t threads [MAX_PINS] ;
+  for (i = 0 ; i < numActive ; ++i)
+    if (freqs [active [i]] != voices [active [i]].playing)
+      toneIdle = FALSE ;
 
-static int newPin = -1 ;
+  return toneIdle ;
+}
 
 
 /*
  * softToneThread:
- *	Thread to do the actual PWM output
+ *	Thread to do the actual output for all of the pins
  *********************************************************************************
  */
 
 static PI_THREAD (softToneThread)
 {
-  int pin, freq, halfPeriod ;
   struct sched_param param ;
+  unsigned long long wake ;
 
   param.sched_priority = sched_get_priority_max (SCHED_RR) ;
   pthread_setschedparam (pthread_self (), SCHED_RR, &param) ;
 
-  pin    = newPin ;
-  newPin = -1 ;
-
   piHiPri (50) ;
 
   for (;;)
   {
-    freq = freqs [pin] ;
-    if (freq == 0)
-      delay (1) ;
-    else
+    pthread_mutex_lock (&toneLock) ;
+
+    if (numActive == 0)
     {
-      halfPeriod = 500000 / freq ;
+      engineRunning = FALSE ;
+      pthread_mutex_unlock (&toneLock) ;
+      break ;
+    }
 
-      digitalWrite (pin, HIGH) ;
-      delayMicroseconds (halfPeriod) ;
+    if ((wake = toneStep ()) == NEVER)
+    {
+      if (goIdle ())
+	while (toneIdle)
+	  pthread_cond_wait (&toneWake, &toneLock) ;
 
-      digitalWrite (pin, LOW) ;
-      delayMicroseconds (halfPeriod) ;
+      pthread_mutex_unlock (&toneLock) ;
+      continue ;
     }
+
+    pthread_mutex_unlock (&toneLock) ;
+
+    delayUntilNanos (wake) ;
   }
 
   return NULL ;
 }
 
 
+/*
+ * softToneExec:
+ *	The same as a task on the executive
+ *********************************************************************************
+ */
+
+static unsigned long long softToneExec (UNU void *ctx, UNU unsigned long long deadline)
+{
+  unsigned long long wake ;
+
+  pthread_mutex_lock (&toneLock) ;
+
+  if (numActive == 0)
+  {
+    engineRunning = FALSE ;
+    engineTask    = -1 ;
+    pthread_mutex_unlock (&toneLock) ;
+    return 0 ;
+  }
+
+  if (((wake = toneStep ()) == NEVER) && !goIdle ())
+    wake = nanos64 () ;
+
+  pthread_mutex_unlock (&toneLock) ;
+
+  return (wake == NEVER) ? PI_EXEC_IDLE : wake ;
+}
+
+
 /*
  * softToneWrite:
  *	Write a frequency value to the given pin
@@ -94,39 +416,161 @@ void softToneWrite (int pin, int freq)
 
   /**/ if (freq < 0)
     freq = 0 ;
-  else if (freq > 5000)	// Max 5KHz
-    freq = 5000 ;
+  else if (freq > MAX_FREQ)	// Max 5KHz
+    freq = MAX_FREQ ;
 
   freqs [pin] = freq ;
+
+  __atomic_thread_fence (__ATOMIC_SEQ_CST) ;
+  if (toneIdle)
+  {
+    pthread_mutex_lock (&toneLock) ;
+      wakeEngine () ;
+    pthread_mutex_unlock (&toneLock) ;
+  }
+}
+
+
+/*
+ * softToneQueue:
+ *	Add a note (or a rest, with a freq of 0) of the given length to the
+ *	pin's queue. It takes over from softToneWrite until the queue runs out,
+ *	then the pin goes quiet. Returns -1 if the queue is full.
+ *********************************************************************************
+ */
+
+int softToneQueue (int pin, int freq, unsigned int ms)
+{
+  struct voiceStruct *v ;
+  int next, res = 0 ;
+
+  pin &= 63 ;
+  v    = &voices [pin] ;
+
+  /**/ if (freq < 0)
+    freq = 0 ;
+  else if (freq > MAX_FREQ)
+    freq = MAX_FREQ ;
+
+  pthread_mutex_lock (&toneLock) ;
+    if (!v->active || ((next = (v->head + 1) % MAX_NOTES) == v->tail))
+      res = -1 ;
+    else
+    {
+      v->notes [v->head].freq = freq ;
+      v->notes [v->head].ms   = ms ;
+      v->head = next ;
+      wakeEngine () ;
+    }
+  pthread_mutex_unlock (&toneLock) ;
+
+  return res ;
+}
+
+
+/*
+ * softToneQueueLength:
+ * softToneQueueClear:
+ *	How many notes are left to play (including the one playing now), and
+ *	throw them all away.
+ *********************************************************************************
+ */
+
+int softToneQueueLength (int pin)
+{
+  struct voiceStruct *v = &voices [pin & 63] ;
+  int len ;
+
+  pthread_mutex_lock (&toneLock) ;
+    len = (v->head - v->tail + MAX_NOTES) % MAX_NOTES ;
+  pthread_mutex_unlock (&toneLock) ;
+
+  return len ;
+}
+
+void softToneQueueClear (int pin)
+{
+  struct voiceStruct *v = &voices [pin & 63] ;
+
+  pthread_mutex_lock (&toneLock) ;
+    if (v->tail != v->head)
+      freqs [pin & 63] = 0 ;
+    v->head = v->tail = 0 ;
+    v->inNote = FALSE ;
+    wakeEngine () ;
+  pthread_mutex_unlock (&toneLock) ;
 }
 
 
 /*
  * softToneCreate:
- *	Create a new tone thread.
+ *	Add a pin to the tone thread, starting the thread if needed.
  *********************************************************************************
  */
 
 int softToneCreate (int pin)
 {
-  int res ;
+  struct voiceStruct *v ;
   pthread_t myThread ;
+  int res = 0 ;
+
+  pin &= 63 ;
+  v    = &voices [pin] ;
+
+  if (v->active)
+    return -1 ;
 
   pinMode      (pin, OUTPUT) ;
   digitalWrite (pin, LOW) ;
 
-  if (threads [pin] != 0)
+  if ((v->handle = wiringPiPinOpen (pin)) == NULL)
     return -1 ;
 
+  pthread_mutex_lock (&toneLock) ;
+
   freqs [pin] = 0 ;
+  v->how      = TONE_SOFT ;
+  v->playing  = 0 ;
+  v->level    = LOW ;
+  v->head     = v->tail = 0 ;
+  v->inNote   = FALSE ;
+
+  if ((pwmPin == -1) && pinModeCapable (pin, PWM_OUTPUT))
+  {
+    pwmPin = pin ;
+    toneMode   (pin, PWM_OUTPUT) ;
+    pwmSetMode (PWM_MODE_MS) ;
+    pwmWrite   (pin, 0) ;
+    v->how = TONE_PWM ;
+  }
+
+  v->active = TRUE ;
+  active [numActive++] = pin ;
+  wakeEngine () ;
 
-  newPin = pin ;
-  res    = pthread_create (&myThread, NULL, softToneThread, NULL) ;
+  if (!engineRunning)
+  {
+    /**/ if (piExecActive ())
+      res = ((engineTask = piExecTimer (0, softToneExec, NULL)) < 0) ? -1 : 0 ;
+    else if ((res = pthread_create (&myThread, NULL, softToneThread, NULL)) == 0)
+      pthread_detach (myThread) ;
+
+    if (res == 0)
+      engineRunning = TRUE ;
+    else
+    {
+      v->active = FALSE ;
+      --numActive ;
+    }
+  }
 
-  while (newPin != -1)
-    delay (1) ;
+  pthread_mutex_unlock (&toneLock) ;
 
-  threads [pin] = myThread ;
+  if (res != 0)
+  {
+    wiringPiPinClose (v->handle) ;
+    v->handle = NULL ;
+  }
 
   return res ;
 }
@@ -134,17 +578,45 @@ int softToneCreate (int pin)
 
 /*
  * softToneStop:
- *	Stop an existing softTone thread
+ *	Take a pin off the tone thread
  *********************************************************************************
  */
 
 void softToneStop (int pin)
 {
-  if (threads [pin] != 0)
+  struct voiceStruct *v ;
+  int i ;
+
+  if (toneOwnMode)		// Our own pinMode (): leave it be
+    return ;
+
+  pin &= 63 ;
+  v    = &voices [pin] ;
+
+  pthread_mutex_lock (&toneLock) ;
+
+  if (!v->active)
   {
-    pthread_cancel (threads [pin]) ;
-    pthread_join   (threads [pin], NULL) ;
-    threads [pin] = 0 ;
-    digitalWrite (pin, LOW) ;
+    pthread_mutex_unlock (&toneLock) ;
+    return ;
   }
+
+  for (i = 0 ; i < numActive ; ++i)
+    if (active [i] == pin)
+    {
+      active [i] = active [--numActive] ;
+      break ;
+    }
+
+  v->active = FALSE ;
+  if (pin == pwmPin)
+    pwmPin = -1 ;
+  wakeEngine () ;
+
+  pthread_mutex_unlock (&toneLock) ;
+
+  pinMode      (pin, OUTPUT) ;
+  digitalWrite (pin, LOW) ;
+  wiringPiPinClose (v->handle) ;
+  v->handle = NULL ;
 }
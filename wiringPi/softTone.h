@@ -34,6 +34,10 @@ extern int  softToneCreate (int pin) ;
 extern void softToneStop   (int pin) ;
 extern void softToneWrite  (int pin, int freq) ;
 
+extern int  softToneQueue       (int pin, int freq, unsigned int ms) ;
+extern int  softToneQueueLength (int pin) ;
+extern void softToneQueueClear  (int pin) ;
+
 #ifdef __cplusplus
 }
 #endif
@@ -29,11 +29,89 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "wiringPi.h"
+#include "wiringShift.h"
+#include "wiringPiSPI.h"
+#include "pcmShift.h"
 
 #include "sr595.h"
 
+// Each chain keeps its output bits here, bit N of the chain in
+//	bits [N / 8], bit (N % 8), and node->data3 says which one.
+
+#define	MAX_CHAINS	8
+#define	MAX_BITS	256
+#define	HALF_PERIOD	100		// nS - 74xx595's are good for 20MHz+
+#define	LATCH_NS	100		// nS - the latch pulse, ~20nS minimum at 3.3v
+
+#define	SR595_GPIO	0
+#define	SR595_SPI	1
+#define	SR595_PCM	2
+
+struct sr595Struct
+{
+  int     transport ;
+  int     numBits ;
+  int     deferred ;			// Inside sr595Begin/sr595Commit
+  int     dirty ;
+  uint8_t bits [MAX_BITS / 8] ;
+} ;
+
+static struct sr595Struct chains [MAX_CHAINS] ;
+static int numChains = 0 ;
+
+
+/*
+ * latchOut:
+ *	Send the whole chain out and latch it.
+ *	Bytes go highest first, MSB first, so the last bit clocked in is
+ *	output 0. If the chain isn't a whole number of bytes the padding bits
+ *	go first and just fall out of the far end.
+ *********************************************************************************
+ */
+
+static void latchOut (struct wiringPiNodeStruct *node)
+{
+  struct sr595Struct *c = &chains [node->data3] ;
+  uint8_t buf [MAX_BITS / 8] ;
+  int     i, n ;
+
+// Clear dirty first: if it's the async worker here then anything
+//	changed while we copy goes out next time
+
+  __atomic_store_n (&c->dirty, FALSE, __ATOMIC_SEQ_CST) ;
+
+  n = (c->numBits + 7) / 8 ;
+  for (i = 0 ; i < n ; ++i)
+    buf [i] = c->bits [n - 1 - i] ;
+
+// SPI: CE goes high at the end of the transfer, and that low -> high is
+//	the latch
+
+  if (c->transport == SR595_SPI)
+  {
+    wiringPiSPIDataRW (node->data0, buf, n) ;
+    return ;
+  }
+
+// PCM: it's one frame, latched by FS at the start of the next, and sent
+//	again every frame until there's a new one
+
+  if (c->transport == SR595_PCM)
+  {
+    pcmShiftWrite (buf, 1) ;
+    return ;
+  }
+
+// A low -> high latch transition copies the latch to the output pins
+
+  digitalWrite (node->data2, LOW) ; delayNanoseconds (LATCH_NS) ;
+    shiftOutBuffer (node->data0, node->data1, MSBFIRST, buf, n, HALF_PERIOD) ;
+  digitalWrite (node->data2, HIGH) ; delayNanoseconds (LATCH_NS) ;
+}
+
 
 /*
  * myDigitalWrite:
@@ -42,37 +120,166 @@
 
 static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
 {
-  unsigned int mask ;
-  int  dataPin, clockPin, latchPin ;
-  int  bit, bits, output ;
+  struct sr595Struct *c = &chains [node->data3] ;
 
-  pin     -= node->pinBase ;				// Normalise pin number
-  bits     = node->pinMax - node->pinBase + 1 ;		// ie. number of clock pulses
-  dataPin  = node->data0 ;
-  clockPin = node->data1 ;
-  latchPin = node->data2 ;
-  output   = node->data3 ;
-
-  mask = 1 << pin ;
+  pin -= node->pinBase ;				// Normalise pin number
 
   if (value == LOW)
-    output &= (~mask) ;
+    c->bits [pin / 8] &= ~(1 << (pin % 8)) ;
   else
-    output |=   mask ;
+    c->bits [pin / 8] |=  (1 << (pin % 8)) ;
 
-  node->data3 = output ;
+  __atomic_store_n (&c->dirty, TRUE, __ATOMIC_RELEASE) ;
 
-// A low -> high latch transition copies the latch to the output pins
+  if (c->deferred)
+    return ;
 
-  digitalWrite (latchPin, LOW) ; delayMicroseconds (1) ;
-    for (bit = bits - 1 ; bit >= 0 ; --bit)
-    {
-      digitalWrite (dataPin, output & (1 << bit)) ;
+  if (wiringPiNodeDeferred (node))
+    wiringPiNodeChanged (node) ;
+  else
+    latchOut (node) ;
+}
+
+
+/*
+ * myDigitalRead:
+ *	Read back what we last wrote
+ *********************************************************************************
+ */
 
-      digitalWrite (clockPin, HIGH) ; delayMicroseconds (1) ;
-      digitalWrite (clockPin, LOW) ;  delayMicroseconds (1) ;
-    }
-  digitalWrite (latchPin, HIGH) ; delayMicroseconds (1) ;
+static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
+{
+  struct sr595Struct *c = &chains [node->data3] ;
+
+  pin -= node->pinBase ;
+
+  return (c->bits [pin / 8] >> (pin % 8)) & 1 ;
+}
+
+
+/*
+ * findChain:
+ *	Find the node for a chain from its pinBase
+ *********************************************************************************
+ */
+
+static struct wiringPiNodeStruct *findChain (int pinBase)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if ((node = wiringPiFindNode (pinBase)) == NULL)
+    return NULL ;
+
+  if (node->digitalWrite != myDigitalWrite)	// Not one of ours
+    return NULL ;
+
+  return node ;
+}
+
+
+/*
+ * sr595Begin:
+ * sr595Commit:
+ *	Hold off sending anything to the chain while lots of pins are changed
+ *	with digitalWrite, then send it all out and latch it once.
+ *********************************************************************************
+ */
+
+void sr595Begin (int pinBase)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if ((node = findChain (pinBase)) != NULL)
+    chains [node->data3].deferred = TRUE ;
+}
+
+void sr595Commit (int pinBase)
+{
+  struct wiringPiNodeStruct *node ;
+  struct sr595Struct *c ;
+
+  if ((node = findChain (pinBase)) == NULL)
+    return ;
+
+  c = &chains [node->data3] ;
+  c->deferred = FALSE ;
+
+  if (c->dirty)
+    latchOut (node) ;
+}
+
+
+/*
+ * myFlush:
+ *	For wiringPiCommit and async writes - unless we're inside sr595Begin
+ *********************************************************************************
+ */
+
+static void myFlush (struct wiringPiNodeStruct *node)
+{
+  struct sr595Struct *c = &chains [node->data3] ;
+
+  if (__atomic_load_n (&c->dirty, __ATOMIC_ACQUIRE) && !c->deferred)
+    latchOut (node) ;
+}
+
+
+/*
+ * sr595WriteBuffer:
+ *	Set every output in one go from a buffer - bit N of the chain in
+ *	bits [N / 8], bit (N % 8) - and latch once.
+ *********************************************************************************
+ */
+
+void sr595WriteBuffer (int pinBase, const uint8_t *bits)
+{
+  struct wiringPiNodeStruct *node ;
+  struct sr595Struct *c ;
+
+  if ((node = findChain (pinBase)) == NULL)
+    return ;
+
+  c = &chains [node->data3] ;
+  memcpy (c->bits, bits, (c->numBits + 7) / 8) ;
+  __atomic_store_n (&c->dirty, TRUE, __ATOMIC_RELEASE) ;
+
+  if (c->deferred)
+    return ;
+
+  if (wiringPiNodeDeferred (node))
+    wiringPiNodeChanged (node) ;
+  else
+    latchOut (node) ;
+}
+
+
+/*
+ * newChain:
+ *	Common setup
+ *********************************************************************************
+ */
+
+static struct wiringPiNodeStruct *newChain (const int pinBase, const int numPins, int transport)
+{
+  struct wiringPiNodeStruct *node ;
+  struct sr595Struct *c ;
+
+  if ((numChains == MAX_CHAINS) || (numPins < 1) || (numPins > MAX_BITS))
+    return NULL ;
+
+  node = wiringPiNewNode (pinBase, numPins) ;
+
+  c = &chains [numChains] ;
+  memset (c, 0, sizeof (*c)) ;
+  c->transport = transport ;
+  c->numBits   = numPins ;
+
+  node->data3        = numChains++ ;
+  node->digitalWrite = myDigitalWrite ;
+  node->digitalRead  = myDigitalRead ;
+  node->flush        = myFlush ;
+
+  return node ;
 }
 
 
@@ -87,13 +294,12 @@ int sr595Setup (const int pinBase, const int numPins,
 {
   struct wiringPiNodeStruct *node ;
 
-  node = wiringPiNewNode (pinBase, numPins) ;
+  if ((node = newChain (pinBase, numPins, SR595_GPIO)) == NULL)
+    return FALSE ;
 
   node->data0           = dataPin ;
   node->data1           = clockPin ;
   node->data2           = latchPin ;
-  node->data3           = 0 ;		// Output register
-  node->digitalWrite    = myDigitalWrite ;
 
 // Initialise the underlying hardware
 
@@ -107,3 +313,60 @@ int sr595Setup (const int pinBase, const int numPins,
 
   return TRUE ;
 }
+
+
+/*
+ * sr595SetupSPI:
+ *	As above, but the chain hangs off the SPI bus: MOSI to the data in,
+ *	SCLK to the shift clock and the channel's CE to the latch (RCLK).
+ *	Much faster for long chains.
+ *********************************************************************************
+ */
+
+int sr595SetupSPI (const int pinBase, const int numPins, const int spiChannel, const int speed)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if (wiringPiSPISetup (spiChannel, speed) < 0)
+    return FALSE ;
+
+  if ((node = newChain (pinBase, numPins, SR595_SPI)) == NULL)
+    return FALSE ;
+
+  node->data0 = spiChannel ;
+  latchOut (node) ;		// All off
+
+  return TRUE ;
+}
+
+
+/*
+ * sr595SetupPCM:
+ *	Or off the PCM peripheral, for chains of 8 to 64 bits: PCM_DOUT
+ *	(BCM_GPIO 21) to the data in, PCM_CLK (18) to the shift clock and
+ *	PCM_FS (19) to the latch. The chain is refreshed continuously at
+ *	clockHz / numPins, so a glitch on the outputs is gone a frame later.
+ *	Only one of these: it's the whole PCM block.
+ *********************************************************************************
+ */
+
+int sr595SetupPCM (const int pinBase, const int numPins, const int clockHz)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if ((numPins < PCM_SHIFT_MIN_BITS) || (numPins > PCM_SHIFT_MAX_BITS))
+    return FALSE ;
+
+  if (pcmShiftSetup (clockHz, numPins, 0) < 0)
+    return FALSE ;
+
+  if ((node = newChain (pinBase, numPins, SR595_PCM)) == NULL)
+  {
+    pcmShiftStop () ;
+    return FALSE ;
+  }
+
+  latchOut (node) ;		// All off
+
+  return TRUE ;
+}
@@ -28,6 +28,12 @@ extern "C" {
 
 extern int sr595Setup (const int pinBase, const int numPins,
 	const int dataPin, const int clockPin, const int latchPin) ;
+extern int sr595SetupSPI (const int pinBase, const int numPins, const int spiChannel, const int speed) ;
+extern int sr595SetupPCM (const int pinBase, const int numPins, const int clockHz) ;
+
+extern void sr595Begin       (int pinBase) ;
+extern void sr595Commit      (int pinBase) ;
+extern void sr595WriteBuffer (int pinBase, const unsigned char *bits) ;
 
 #ifdef __cplusplus
 }
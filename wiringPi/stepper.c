@@ -0,0 +1,762 @@
+/*
+ * stepper.c:
+ *	Step/direction stepper motor driving with acceleration profiles
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+/*
+ * Notes:
+ *	Each axis is a step and a direction pin on a driver (A4988, DRV8825,
+ *	TMC2208 ...). Its profile - top speed and acceleration - is turned
+ *	into a table of step intervals for the ramp once, when it's set, so
+ *	nothing is worked out per step: a move of n steps just reads the
+ *	table forwards to speed up, runs at the cruise interval, and reads it
+ *	backwards to slow down. A move too short to reach top speed meets in
+ *	the middle.
+ *
+ *	One thread runs every axis. It keeps the absolute time of each move's
+ *	next step, sleeps until the earliest one (spinning for the last few
+ *	uS, as delayUntilNanos does) and raises all the step pins that are
+ *	due in one masked write per bank, then drops them again after the
+ *	pulse width. Call piRtSetup () first with a CPU kept clear by
+ *	isolcpus= for the best timing at tens of KHz.
+ *
+ *	A multi-axis move is a straight line: the axis with the most steps
+ *	leads, the others step along with it Bresenham fashion, on the same
+ *	edges. The lead's speed and acceleration are scaled down so that no
+ *	axis goes over its own limits.
+ *
+ *	Moves are queued - up to STEPPER_MAX_MOVES - and run in order for
+ *	each axis; moves on different axes run at the same time.
+ *
+ *	For timing that's immune to the scheduler altogether stepperWave ()
+ *	turns a move into pulses for the DMA waveform engine instead.
+ *********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "wiringPi.h"
+#include "waveform.h"
+#include "stepper.h"
+
+#define	IDLE_NS		1000000ULL
+#define	DIR_SETUP_NS	5000		// Direction to first step
+#define	PULSE_NS	2000		// Default step pulse (and minimum low) time
+
+struct axisStruct
+{
+  int           active ;
+  wpiPin_t      step, dir ;
+  long long     position ;
+
+  unsigned int  maxRate ;		// Steps/sec
+  unsigned int  accel ;			// Steps/sec/sec
+  int           shape ;
+  unsigned int *ramp ;			// nS between steps while speeding up
+  unsigned int  rampLen ;
+  unsigned int  cruiseNs ;
+} ;
+
+struct moveStruct
+{
+  unsigned int        axes ;		// Bit mask
+  int                 numAxes ;
+  int                 axis  [STEPPER_MAX_AXES] ;
+  unsigned int        count [STEPPER_MAX_AXES] ;
+  int                 dir   [STEPPER_MAX_AXES] ;
+  unsigned int        err   [STEPPER_MAX_AXES] ;
+
+  unsigned int        n ;		// Steps of the lead axis
+  unsigned int        done ;
+  const unsigned int *ramp ;
+  unsigned int        rampLen ;
+  unsigned int        cruiseNs ;
+  unsigned int       *ownRamp ;		// Made for this move - free it after
+
+  int                 started ;
+  unsigned int        high ;		// Index bits of the step pins now high
+  unsigned long long  next ;		// Next step due
+  unsigned long long  lowAt ;		// Step pins go low, or 0 if low
+  unsigned long long  lowUntil ;	// Earliest next step after a pulse
+} ;
+
+static struct axisStruct  axes  [STEPPER_MAX_AXES] ;
+static struct moveStruct *queue [STEPPER_MAX_MOVES] ;
+static int                numAxes  = 0 ;
+static int                numMoves = 0 ;
+static unsigned int       pulseNs  = PULSE_NS ;
+static int                engineRunning = FALSE ;
+
+static pthread_mutex_t stepperLock = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_cond_t  stepperDone = PTHREAD_COND_INITIALIZER ;
+
+
+/*
+ * buildRamp:
+ *	Work out the intervals between the steps from standing to maxRate,
+ *	in nS. The time of step k is t(k), solved from the distance covered:
+ *	  Trapezoid: constant accel, so k = a t^2 / 2
+ *	  S-curve:   v = V (1 - cos (pi t / T)) / 2 over T = V / a - the same
+ *		     average acceleration, but with none at either end.
+ *	Either way the ramp is V^2 / 2a steps long.
+ *********************************************************************************
+ */
+
+static double scurveDistance (double t, double v, double T)
+{
+  return v / 2.0 * (t - T / M_PI * sin (M_PI * t / T)) ;
+}
+
+static unsigned int *buildRamp (double v, double a, int shape, unsigned int *len, unsigned int *cruise)
+{
+  unsigned int *ramp ;
+  unsigned int  k, steps ;
+  double T = v / a ;
+  double t, last, lo, hi ;
+  int i ;
+
+  *cruise = (unsigned int)(1.0e9 / v) ;
+  steps   = (unsigned int)(v * v / (2.0 * a)) ;
+  *len    = steps ;
+
+  if ((ramp = malloc ((steps + 1) * sizeof (unsigned int))) == NULL)
+    return NULL ;
+
+  for (last = 0.0, k = 0 ; k < steps ; ++k)
+  {
+    if (shape == STEPPER_SCURVE)
+    {
+      for (lo = last, hi = T, i = 0 ; i < 48 ; ++i)
+      {
+	t = (lo + hi) / 2.0 ;
+	if (scurveDistance (t, v, T) < (double)(k + 1))
+	  lo = t ;
+	else
+	  hi = t ;
+      }
+      t = (lo + hi) / 2.0 ;
+    }
+    else
+      t = sqrt (2.0 * (k + 1) / a) ;
+
+    ramp [k] = (unsigned int)((t - last) * 1.0e9) ;
+    if (ramp [k] < *cruise)
+      ramp [k] = *cruise ;
+    last = t ;
+  }
+
+  return ramp ;
+}
+
+
+/*
+ * movePlan:
+ *	Fill in a move from the axes and signed step counts, and find the
+ *	ramp for it.
+ *	Returns 0, 1 if there's nothing to do or -1 on an error.
+ *********************************************************************************
+ */
+
+static int movePlan (struct moveStruct *m, const int *axisList, const int *steps, int num)
+{
+  struct axisStruct *ax, *lead = NULL ;
+  double v, a, vLimit, aLimit ;
+  int    i, j, shape = STEPPER_TRAPEZOID ;
+
+  memset (m, 0, sizeof (*m)) ;
+
+  if ((num < 1) || (num > STEPPER_MAX_AXES))
+    return -1 ;
+
+  for (i = 0 ; i < num ; ++i)
+  {
+    if ((axisList [i] < 0) || (axisList [i] >= numAxes) || !axes [axisList [i]].active)
+      return -1 ;
+    if ((m->axes & (1u << axisList [i])) != 0)
+      return -1 ;
+    m->axes |= 1u << axisList [i] ;
+
+    if (steps [i] == 0)
+      continue ;
+
+    j = m->numAxes++ ;
+    m->axis  [j] = axisList [i] ;
+    m->count [j] = (steps [i] < 0) ? -steps [i] : steps [i] ;
+    m->dir   [j] = (steps [i] < 0) ? -1 : 1 ;
+    if (m->count [j] > m->n)
+    {
+      m->n = m->count [j] ;
+      lead = &axes [axisList [i]] ;
+    }
+  }
+
+  if (m->n == 0)
+    return 1 ;
+
+// The lead axis goes as fast as it can without any other axis going
+//	over its limits
+
+  v = lead->maxRate ;
+  a = lead->accel ;
+
+  for (i = 0 ; i < m->numAxes ; ++i)
+  {
+    ax     = &axes [m->axis [i]] ;
+    vLimit = (double)ax->maxRate * m->n / m->count [i] ;
+    aLimit = (double)ax->accel   * m->n / m->count [i] ;
+    if (vLimit < v) v = vLimit ;
+    if (aLimit < a) a = aLimit ;
+    if (ax->shape == STEPPER_SCURVE)
+      shape = STEPPER_SCURVE ;
+    m->err [i] = m->n / 2 ;
+  }
+
+  if ((v == lead->maxRate) && (a == lead->accel) && (shape == lead->shape))
+  {
+    m->ramp     = lead->ramp ;
+    m->rampLen  = lead->rampLen ;
+    m->cruiseNs = lead->cruiseNs ;
+  }
+  else
+  {
+    if ((m->ownRamp = buildRamp (v, a, shape, &m->rampLen, &m->cruiseNs)) == NULL)
+      return -1 ;
+    m->ramp = m->ownRamp ;
+  }
+
+  return 0 ;
+}
+
+
+/*
+ * moveGap:
+ *	nS from step j to step j+1 - the ramp read from both ends
+ *********************************************************************************
+ */
+
+static inline unsigned int moveGap (const struct moveStruct *m, unsigned int j)
+{
+  unsigned int r = m->n - 2 - j ;
+
+  if (j < r)
+    r = j ;
+
+  return (r < m->rampLen) ? m->ramp [r] : m->cruiseNs ;
+}
+
+
+/*
+ * moveStep:
+ *	Which axes step on the next edge, as index bits
+ *********************************************************************************
+ */
+
+static inline unsigned int moveStep (struct moveStruct *m)
+{
+  unsigned int stepped = 0 ;
+  int i ;
+
+  for (i = 0 ; i < m->numAxes ; ++i)
+    if ((m->err [i] += m->count [i]) >= m->n)
+    {
+      m->err [i] -= m->n ;
+      stepped    |= 1u << i ;
+    }
+
+  return stepped ;
+}
+
+
+/*
+ * stepPins:
+ *	Add the step pins of the indexed axes of a move to the bank masks,
+ *	or write them there and then if they're not memory mapped.
+ *********************************************************************************
+ */
+
+static void stepPins (const struct moveStruct *m, unsigned int which, int value, unsigned int masks [2])
+{
+  wpiPin_t h ;
+  int i ;
+
+  for (i = 0 ; i < m->numAxes ; ++i)
+    if ((which & (1u << i)) != 0)
+    {
+      h = axes [m->axis [i]].step ;
+      if ((h->set != NULL) && (h->gpio >= 0))
+	masks [h->gpio >> 5] |= h->mask ;
+      else
+	wpiPinWrite (h, value) ;
+    }
+}
+
+
+/*
+ * moveRemove:
+ *	Take a move off the queue and free it. Called locked.
+ *********************************************************************************
+ */
+
+static void moveRemove (int i)
+{
+  struct moveStruct *m = queue [i] ;
+
+  memmove (&queue [i], &queue [i + 1], (numMoves - i - 1) * sizeof (queue [0])) ;
+  --numMoves ;
+
+  free (m->ownRamp) ;
+  free (m) ;
+  pthread_cond_broadcast (&stepperDone) ;
+}
+
+
+/*
+ * stepperThread:
+ *	Thread to do the actual stepping for all of the axes
+ *********************************************************************************
+ */
+
+static PI_THREAD (stepperThread)
+{
+  struct moveStruct *m ;
+  unsigned long long now, wake, due ;
+  unsigned int setMask [2], clrMask [2], blocked, stepped ;
+  int i, j ;
+
+  piHiPri (55) ;
+
+  for (;;)
+  {
+    pthread_mutex_lock (&stepperLock) ;
+
+    if (numMoves == 0)
+    {
+      engineRunning = FALSE ;
+      pthread_mutex_unlock (&stepperLock) ;
+      break ;
+    }
+
+    now     = nanos64 () ;
+    wake    = now + IDLE_NS ;
+    blocked = 0 ;
+    setMask [0] = setMask [1] = clrMask [0] = clrMask [1] = 0 ;
+
+    for (i = 0 ; i < numMoves ; )
+    {
+      m = queue [i] ;
+
+// Start a move once the moves before it on the same axes are done
+
+      if (!m->started)
+      {
+	if ((m->axes & blocked) != 0)
+	{
+	  blocked |= m->axes ;
+	  ++i ;
+	  continue ;
+	}
+
+	for (j = 0 ; j < m->numAxes ; ++j)
+	  wpiPinWrite (axes [m->axis [j]].dir, (m->dir [j] > 0) ? HIGH : LOW) ;
+
+	m->next    = now + DIR_SETUP_NS ;
+	m->started = TRUE ;
+      }
+
+// End of a step pulse
+
+      if ((m->lowAt != 0) && (now >= m->lowAt))
+      {
+	stepPins (m, m->high, LOW, clrMask) ;
+	m->high     = 0 ;
+	m->lowAt    = 0 ;
+	m->lowUntil = now + pulseNs ;
+      }
+
+      if ((m->lowAt == 0) && (m->done == m->n))
+      {
+	moveRemove (i) ;
+	continue ;
+      }
+
+// Next step - if we're late, the intervals carry on from when it
+//	actually happened so the motor is never asked to jump ahead
+
+      due = (m->next > m->lowUntil) ? m->next : m->lowUntil ;
+
+      if ((m->lowAt == 0) && (now >= due))
+      {
+	stepped = moveStep (m) ;
+	stepPins (m, stepped, HIGH, setMask) ;
+
+	for (j = 0 ; j < m->numAxes ; ++j)
+	  if ((stepped & (1u << j)) != 0)
+	    axes [m->axis [j]].position += m->dir [j] ;
+
+	m->high  = stepped ;
+	m->lowAt = now + pulseNs ;
+
+	if (++m->done < m->n)
+	  m->next = ((now > m->next) ? now : m->next) + moveGap (m, m->done - 1) ;
+      }
+
+      due = (m->lowAt != 0) ? m->lowAt : ((m->next > m->lowUntil) ? m->next : m->lowUntil) ;
+      if (due < wake)
+	wake = due ;
+
+      blocked |= m->axes ;
+      ++i ;
+    }
+
+    if ((setMask [0] | clrMask [0]) != 0)
+      digitalWriteMask (0, setMask [0], clrMask [0]) ;
+    if ((setMask [1] | clrMask [1]) != 0)
+      digitalWriteMask (1, setMask [1], clrMask [1]) ;
+
+    pthread_mutex_unlock (&stepperLock) ;
+
+    delayUntilNanos (wake) ;
+  }
+
+  return NULL ;
+}
+
+
+/*
+ * stepperCreate:
+ *	Add an axis. Both pins are made outputs and set LOW. It starts with a
+ *	gentle profile of 1000 steps/sec and 5000 steps/sec/sec.
+ *	Returns the axis number or -1.
+ *********************************************************************************
+ */
+
+int stepperCreate (int stepPin, int dirPin)
+{
+  struct axisStruct *ax ;
+
+  if (numAxes == STEPPER_MAX_AXES)
+    return -1 ;
+
+  ax = &axes [numAxes] ;
+
+  pinMode      (stepPin, OUTPUT) ;
+  digitalWrite (stepPin, LOW) ;
+  pinMode      (dirPin,  OUTPUT) ;
+  digitalWrite (dirPin,  LOW) ;
+
+  if ((ax->step = wiringPiPinOpen (stepPin)) == NULL)
+    return -1 ;
+  if ((ax->dir = wiringPiPinOpen (dirPin)) == NULL)
+  {
+    wiringPiPinClose (ax->step) ;
+    return -1 ;
+  }
+
+  ax->position = 0 ;
+  ax->active   = TRUE ;
+
+  if (stepperProfile (numAxes, 1000, 5000, STEPPER_TRAPEZOID) < 0)
+  {
+    wiringPiPinClose (ax->step) ;
+    wiringPiPinClose (ax->dir) ;
+    ax->active = FALSE ;
+    return -1 ;
+  }
+
+  return numAxes++ ;
+}
+
+
+/*
+ * stepperProfile:
+ *	Set the top speed and acceleration of an axis. Any moves already
+ *	queued for it are finished first.
+ *********************************************************************************
+ */
+
+int stepperProfile (int axis, unsigned int maxRate, unsigned int accel, int shape)
+{
+  struct axisStruct *ax ;
+  unsigned int *ramp, len, cruise ;
+
+  if ((axis < 0) || (axis >= STEPPER_MAX_AXES) || !axes [axis].active || (maxRate == 0) || (accel == 0))
+    return -1 ;
+
+  if ((ramp = buildRamp (maxRate, accel, shape, &len, &cruise)) == NULL)
+    return -1 ;
+
+  stepperWait (axis) ;
+
+  ax = &axes [axis] ;
+  free (ax->ramp) ;
+  ax->ramp     = ramp ;
+  ax->rampLen  = len ;
+  ax->cruiseNs = cruise ;
+  ax->maxRate  = maxRate ;
+  ax->accel    = accel ;
+  ax->shape    = shape ;
+
+  return 0 ;
+}
+
+
+/*
+ * stepperPulseWidth:
+ *	Set the step pulse time that all the axes use - the default of 2uS
+ *	suits most drivers.
+ *********************************************************************************
+ */
+
+void stepperPulseWidth (unsigned int ns)
+{
+  pthread_mutex_lock (&stepperLock) ;
+    pulseNs = (ns == 0) ? PULSE_NS : ns ;
+  pthread_mutex_unlock (&stepperLock) ;
+}
+
+
+/*
+ * stepperMove: stepperMoveMulti:
+ *	Queue a relative move of one or more axes together, and return. Waits
+ *	for room if the queue is full.
+ *	Returns 0 or -1 on an error.
+ *********************************************************************************
+ */
+
+int stepperMoveMulti (const int *axisList, const int *steps, int num)
+{
+  struct moveStruct *m ;
+  pthread_t myThread ;
+  int res ;
+
+  if ((m = malloc (sizeof (*m))) == NULL)
+    return -1 ;
+
+  if ((res = movePlan (m, axisList, steps, num)) != 0)
+  {
+    free (m->ownRamp) ;
+    free (m) ;
+    return (res < 0) ? -1 : 0 ;
+  }
+
+  pthread_mutex_lock (&stepperLock) ;
+
+  while (numMoves == STEPPER_MAX_MOVES)
+    pthread_cond_wait (&stepperDone, &stepperLock) ;
+
+  queue [numMoves++] = m ;
+
+  if (!engineRunning)
+  {
+    if ((res = pthread_create (&myThread, NULL, stepperThread, NULL)) == 0)
+    {
+      pthread_detach (myThread) ;
+      engineRunning = TRUE ;
+    }
+    else
+    {
+      queue [--numMoves] = NULL ;
+      free (m->ownRamp) ;
+      free (m) ;
+    }
+  }
+
+  pthread_mutex_unlock (&stepperLock) ;
+
+  return (res == 0) ? 0 : -1 ;
+}
+
+int stepperMove (int axis, int steps)
+{
+  return stepperMoveMulti (&axis, &steps, 1) ;
+}
+
+
+/*
+ * stepperWave:
+ *	Add the pulses for a move to the waveform being built for
+ *	waveCreate () - see waveform.c - rather than queueing it. The step and
+ *	direction pins must be on-board GPIO 0 through 31 and the timing is
+ *	rounded to the waveform's uS. The positions aren't changed.
+ *	Returns the number of pulses in the waveform so far, or -1.
+ *********************************************************************************
+ */
+
+int stepperWave (const int *axisList, const int *steps, int num)
+{
+  struct moveStruct m ;
+  wpiPin_t h ;
+  unsigned int dirOn = 0, dirOff = 0, on, stepped, pulseUs, gapUs ;
+  unsigned long long t, tNext ;
+  int i, res ;
+
+  if ((res = movePlan (&m, axisList, steps, num)) != 0)
+    return (res < 0) ? -1 : 0 ;
+
+  for (i = 0 ; i < m.numAxes ; ++i)
+  {
+    if (((h = axes [m.axis [i]].step)->set == NULL) || (h->gpio < 0) || (h->gpio > 31) ||
+	((h = axes [m.axis [i]].dir )->set == NULL) || (h->gpio < 0) || (h->gpio > 31))
+    {
+      free (m.ownRamp) ;
+      return -1 ;
+    }
+    if (m.dir [i] > 0)
+      dirOn  |= h->mask ;
+    else
+      dirOff |= h->mask ;
+  }
+
+  pulseUs = (pulseNs + 999) / 1000 ;
+  res     = waveAddPulse (dirOn, dirOff, (DIR_SETUP_NS + 999) / 1000) ;
+
+// Step times are kept in nS and rounded as we go so the error never
+//	builds up
+
+  for (t = 0 ; (res >= 0) && (m.done < m.n) ; t = tNext)
+  {
+    stepped = moveStep (&m) ;
+    for (on = 0, i = 0 ; i < m.numAxes ; ++i)
+      if ((stepped & (1u << i)) != 0)
+	on |= axes [m.axis [i]].step->mask ;
+
+    if (++m.done < m.n)
+    {
+      tNext = t + moveGap (&m, m.done - 1) ;
+      gapUs = (unsigned int)((tNext + 500) / 1000 - (t + 500) / 1000) ;
+      gapUs = (gapUs > 2 * pulseUs) ? gapUs - pulseUs : pulseUs ;
+    }
+    else
+    {
+      tNext = t ;
+      gapUs = pulseUs ;
+    }
+
+    if ((res = waveAddPulse (on, 0, pulseUs)) >= 0)
+      res = waveAddPulse (0, on, gapUs) ;
+  }
+
+  free (m.ownRamp) ;
+  return res ;
+}
+
+
+/*
+ * stepperBusy: stepperWait:
+ *	See if an axis (or any, for -1) has moves queued or running, or wait
+ *	for it to finish them.
+ *********************************************************************************
+ */
+
+static int busy (int axis)
+{
+  int i ;
+
+  if (axis < 0)
+    return numMoves != 0 ;
+
+  for (i = 0 ; i < numMoves ; ++i)
+    if ((queue [i]->axes & (1u << axis)) != 0)
+      return TRUE ;
+
+  return FALSE ;
+}
+
+int stepperBusy (int axis)
+{
+  int res ;
+
+  pthread_mutex_lock (&stepperLock) ;
+    res = busy (axis) ;
+  pthread_mutex_unlock (&stepperLock) ;
+
+  return res ;
+}
+
+void stepperWait (int axis)
+{
+  pthread_mutex_lock (&stepperLock) ;
+    while (busy (axis))
+      pthread_cond_wait (&stepperDone, &stepperLock) ;
+  pthread_mutex_unlock (&stepperLock) ;
+}
+
+
+/*
+ * stepperStop:
+ *	Stop an axis (or all of them, for -1) dead and throw away its queued
+ *	moves, along with any multi-axis moves it was part of. There's no
+ *	slowing down, so the motor may well lose steps at speed.
+ *********************************************************************************
+ */
+
+void stepperStop (int axis)
+{
+  struct moveStruct *m ;
+  unsigned int clrMask [2] = { 0, 0 } ;
+  int i ;
+
+  pthread_mutex_lock (&stepperLock) ;
+
+  for (i = 0 ; i < numMoves ; )
+  {
+    m = queue [i] ;
+    if ((axis >= 0) && ((m->axes & (1u << axis)) == 0))
+    {
+      ++i ;
+      continue ;
+    }
+    if (m->high != 0)
+      stepPins (m, m->high, LOW, clrMask) ;
+    moveRemove (i) ;
+  }
+
+  if (clrMask [0] != 0) digitalWriteMask (0, 0, clrMask [0]) ;
+  if (clrMask [1] != 0) digitalWriteMask (1, 0, clrMask [1]) ;
+
+  pthread_mutex_unlock (&stepperLock) ;
+}
+
+
+/*
+ * stepperPosition:
+ *	Where an axis is, in steps from where it was created
+ *********************************************************************************
+ */
+
+long long stepperPosition (int axis)
+{
+  long long pos ;
+
+  if ((axis < 0) || (axis >= numAxes))
+    return 0 ;
+
+  pthread_mutex_lock (&stepperLock) ;
+    pos = axes [axis].position ;
+  pthread_mutex_unlock (&stepperLock) ;
+
+  return pos ;
+}
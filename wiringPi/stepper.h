@@ -0,0 +1,52 @@
+/*
+ * stepper.h:
+ *	Step/direction stepper motor driving with acceleration profiles
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#define	STEPPER_MAX_AXES	8
+#define	STEPPER_MAX_MOVES	32
+
+// Acceleration profiles
+
+#define	STEPPER_TRAPEZOID	0	// Constant acceleration
+#define	STEPPER_SCURVE		1	// Acceleration eases in and out
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int       stepperCreate     (int stepPin, int dirPin) ;
+extern int       stepperProfile    (int axis, unsigned int maxRate, unsigned int accel, int shape) ;
+extern void      stepperPulseWidth (unsigned int ns) ;
+
+extern int       stepperMove       (int axis, int steps) ;
+extern int       stepperMoveMulti  (const int *axes, const int *steps, int numAxes) ;
+extern int       stepperWave       (const int *axes, const int *steps, int numAxes) ;
+
+extern int       stepperBusy       (int axis) ;
+extern void      stepperWait       (int axis) ;
+extern void      stepperStop       (int axis) ;
+extern long long stepperPosition   (int axis) ;
+
+#ifdef __cplusplus
+}
+#endif
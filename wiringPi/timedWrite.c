@@ -0,0 +1,376 @@
+/*
+ * timedWrite.c:
+ *	Schedule output writes for an exact time.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+
+/*
+ * Notes:
+ *	One real-time thread serves a queue of writes, kept as a heap on
+ *	time. It sleeps until just before the first is due, then spins to
+ *	the time in delayUntilNanos (), so the edge is placed to within a
+ *	few uS rather than however late a sleeping thread gets woken.
+ *	Everything that's due together is done in one go, and the on-board
+ *	pins in a run of it go to digitalWritePins (), so outputs at the same
+ *	time change together. Times are on the nanos64 () clock.
+ *
+ *	With the busy-poll executive (piSpinStart) running there's no thread:
+ *	the queue is looked at every time round there instead, so there's no
+ *	waking up to be late for. If that stops, it's back to a thread.
+ *********************************************************************************
+ */
+
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "wiringPi.h"
+
+#define	MAX_TIMED_WRITES	256
+#define	WAKE_EARLY_NS		500000ULL	// Sleep till then, spin from there
+
+// Queued writes: a single pin, or a bank's set and clear masks
+
+struct timedWriteStruct
+{
+  unsigned long long tNs ;
+  unsigned int       seq ;		// Keeps writes at the same time in order
+  int                bank ;		// -1 for a pin
+  int                pin ;
+  unsigned int       setMask ;		// Or the pin's value
+  unsigned int       clrMask ;
+} ;
+
+static struct timedWriteStruct queue [MAX_TIMED_WRITES] ;
+static int             queued = 0 ;
+static unsigned int    nextSeq = 0 ;
+static int             running = FALSE ;
+static pthread_mutex_t timedLock = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_cond_t  timedWake ;
+
+
+/*
+ * before:
+ * heapPush:
+ * heapPop:
+ *	The queue, earliest at the top. Call with the lock held.
+ *********************************************************************************
+ */
+
+static inline int before (const struct timedWriteStruct *a, const struct timedWriteStruct *b)
+{
+  return (a->tNs < b->tNs) || ((a->tNs == b->tNs) && ((int)(a->seq - b->seq) < 0)) ;
+}
+
+static void heapPush (const struct timedWriteStruct *w)
+{
+  struct timedWriteStruct tmp ;
+  int i, parent ;
+
+  queue [i = queued++] = *w ;
+
+  while ((i > 0) && before (&queue [i], &queue [parent = (i - 1) / 2]))
+  {
+    tmp            = queue [i] ;
+    queue [i]      = queue [parent] ;
+    queue [parent] = tmp ;
+    i              = parent ;
+  }
+}
+
+static void heapPop (struct timedWriteStruct *w)
+{
+  struct timedWriteStruct tmp ;
+  int i = 0, child ;
+
+  *w = queue [0] ;
+  queue [0] = queue [--queued] ;
+
+  while ((child = 2 * i + 1) < queued)
+  {
+    if ((child + 1 < queued) && before (&queue [child + 1], &queue [child]))
+      ++child ;
+    if (!before (&queue [child], &queue [i]))
+      break ;
+    tmp           = queue [i] ;
+    queue [i]     = queue [child] ;
+    queue [child] = tmp ;
+    i             = child ;
+  }
+}
+
+
+/*
+ * doWrites:
+ *	Carry out a batch that's come due
+ *********************************************************************************
+ */
+
+static void doWrites (const struct timedWriteStruct *w, int n)
+{
+  int pins [32] ;
+  unsigned int values = 0 ;
+  int i, numPins = 0 ;
+
+  for (i = 0 ; i < n ; ++i, ++w)
+  {
+    if ((w->bank < 0) && ((w->pin & PI_GPIO_MASK) == 0))	// On-Board Pin: gather it up
+    {
+      if (numPins == 32)
+      {
+	digitalWritePins (pins, numPins, values) ;
+	numPins = values = 0 ;
+      }
+      if (w->setMask != LOW)
+	values |= 1u << numPins ;
+      pins [numPins++] = w->pin ;
+      continue ;
+    }
+
+    if (numPins > 0)
+    {
+      digitalWritePins (pins, numPins, values) ;
+      numPins = values = 0 ;
+    }
+
+    if (w->bank >= 0)
+      digitalWriteMask (w->bank, w->setMask, w->clrMask) ;
+    else
+      digitalWrite (w->pin, (int)w->setMask) ;
+  }
+
+  if (numPins > 0)
+    digitalWritePins (pins, numPins, values) ;
+}
+
+
+/*
+ * timedThread:
+ *	Wait for the next write to come due and do it
+ *********************************************************************************
+ */
+
+static void *timedThread (void *arg)
+{
+  struct timedWriteStruct due [MAX_TIMED_WRITES] ;
+  unsigned long long first, now, wake ;
+  struct timespec ts ;
+  int n ;
+
+  (void)arg ;
+  (void)piHiPri (90) ;
+
+  pthread_mutex_lock (&timedLock) ;
+
+  for (;;)
+  {
+    if (queued == 0)
+    {
+      pthread_cond_wait (&timedWake, &timedLock) ;
+      continue ;
+    }
+
+// A long way off? Sleep till nearly then, but start again if something
+//	earlier comes along in the meantime
+
+    first = queue [0].tNs ;
+    now   = nanos64 () ;
+
+    if (first > now + WAKE_EARLY_NS)
+    {
+      clock_gettime (CLOCK_MONOTONIC, &ts) ;
+      wake = (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec + (first - now) - WAKE_EARLY_NS ;
+      ts.tv_sec  = (time_t)(wake / 1000000000ULL) ;
+      ts.tv_nsec = (long)(wake % 1000000000ULL) ;
+      (void)pthread_cond_timedwait (&timedWake, &timedLock, &ts) ;
+      continue ;
+    }
+
+// Nearly there: spin to the time, then take everything that's due
+
+    pthread_mutex_unlock (&timedLock) ;
+      delayUntilNanos (first) ;
+      now = nanos64 () ;
+    pthread_mutex_lock (&timedLock) ;
+
+    for (n = 0 ; (queued > 0) && (queue [0].tNs <= now) ; ++n)
+      heapPop (&due [n]) ;
+
+    pthread_mutex_unlock (&timedLock) ;
+      doWrites (due, n) ;
+    pthread_mutex_lock (&timedLock) ;
+  }
+
+  return NULL ;
+}
+
+
+/*
+ * timedTask:
+ *	The queue as a busy-poll task: do whatever's due. It doesn't wait for
+ *	the lock - it'll be round again in a moment.
+ *********************************************************************************
+ */
+
+static int timedTask (UNU void *ctx, unsigned long long now)
+{
+  static struct timedWriteStruct due [MAX_TIMED_WRITES] ;
+  int n ;
+
+  if ((__atomic_load_n (&queued, __ATOMIC_RELAXED) == 0) || (pthread_mutex_trylock (&timedLock) != 0))
+    return TRUE ;
+
+  for (n = 0 ; (queued > 0) && (queue [0].tNs <= now) ; ++n)
+    heapPop (&due [n]) ;
+
+  pthread_mutex_unlock (&timedLock) ;
+
+  if (n > 0)
+    doWrites (due, n) ;
+
+  return TRUE ;
+}
+
+
+/*
+ * timedGone:
+ *	The busy-poll executive's stopped with the queue still on it: hand
+ *	it to a thread. If we can't, whatever's queued stays there until the
+ *	next write starts one.
+ *********************************************************************************
+ */
+
+static void timedGone (UNU void *ctx)
+{
+  pthread_t myThread ;
+
+  pthread_mutex_lock (&timedLock) ;
+
+  if (pthread_create (&myThread, NULL, timedThread, NULL) == 0)
+    pthread_detach (myThread) ;
+  else
+    running = FALSE ;
+
+  pthread_mutex_unlock (&timedLock) ;
+}
+
+
+/*
+ * queueWrite:
+ *	Add one, starting the thread if need be
+ *********************************************************************************
+ */
+
+static int queueWrite (struct timedWriteStruct *w)
+{
+  pthread_condattr_t attr ;
+  pthread_t myThread ;
+
+  pthread_mutex_lock (&timedLock) ;
+
+  if (!running)
+  {
+    pthread_condattr_init     (&attr) ;
+    pthread_condattr_setclock (&attr, CLOCK_MONOTONIC) ;
+    pthread_cond_init         (&timedWake, &attr) ;
+    pthread_condattr_destroy  (&attr) ;
+
+    if (!piSpinActive () || (piSpinAdd (timedTask, timedGone, NULL, 5000) < 0))	// nS: a batch of writes
+    {
+      if (pthread_create (&myThread, NULL, timedThread, NULL) != 0)
+      {
+	pthread_cond_destroy  (&timedWake) ;
+	pthread_mutex_unlock (&timedLock) ;
+	errno = EAGAIN ;
+	return -1 ;
+      }
+      pthread_detach (myThread) ;
+    }
+    running = TRUE ;
+  }
+
+  if (queued == MAX_TIMED_WRITES)
+  {
+    pthread_mutex_unlock (&timedLock) ;
+    errno = ENOSPC ;
+    return -1 ;
+  }
+
+  w->seq = nextSeq++ ;
+  heapPush (w) ;
+
+  if (queue [0].seq == w->seq)		// New first: the thread needs to know
+    pthread_cond_signal (&timedWake) ;
+
+  pthread_mutex_unlock (&timedLock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * digitalWriteAt:
+ * digitalWriteMaskAt:
+ *	digitalWrite () and digitalWriteMask () at tNs on the nanos64 () clock.
+ *	A time that's already gone is done straight away; writes for the same
+ *	time are done one after the other, in order, and the on-board pins
+ *	at the same instant. Up to MAX_TIMED_WRITES can be waiting.
+ *	A node that can keep time itself (drcNet) is given the write to do.
+ *	Return 0 or -1 with errno set.
+ *********************************************************************************
+ */
+
+int digitalWriteAt (int pin, int value, unsigned long long tNs)
+{
+  struct timedWriteStruct w ;
+  struct wiringPiNodeStruct *node ;
+
+  if (((pin & PI_GPIO_MASK) != 0) && ((node = wiringPiFindNode (pin)) != NULL) && (node->digitalWriteAt != NULL))
+    return node->digitalWriteAt (node, pin, value, tNs) ;
+
+  w.tNs     = tNs ;
+  w.bank    = -1 ;
+  w.pin     = pin ;
+  w.setMask = (value != LOW) ? HIGH : LOW ;
+  w.clrMask = 0 ;
+
+  return queueWrite (&w) ;
+}
+
+int digitalWriteMaskAt (int bank, unsigned int setMask, unsigned int clrMask, unsigned long long tNs)
+{
+  struct timedWriteStruct w ;
+
+  if ((bank < 0) || (bank > 1))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  w.tNs     = tNs ;
+  w.bank    = bank ;
+  w.pin     = 0 ;
+  w.setMask = setMask ;
+  w.clrMask = clrMask ;
+
+  return queueWrite (&w) ;
+}
@@ -0,0 +1,470 @@
+/*
+ * waveform.c:
+ *	DMA driven GPIO waveforms
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+/*
+ * Notes:
+ *	A waveform is a list of pulses: a set of GPIO pins to turn on, a set
+ *	to turn off and a delay in µS before the next pulse. Each pulse
+ *	becomes a short chain of DMA control blocks that write straight into
+ *	the GPSET0/GPCLR0 registers, followed by one that writes dummy words
+ *	into the PWM (or PCM) FIFO. That peripheral is clocked to take one
+ *	word every µS, so the DMA engine is held up by the FIFO for exactly
+ *	the delay - no CPU involved once it's going, and no Linux scheduling
+ *	jitter on the edges.
+ *
+ *	The masks are BCM_GPIO bit masks for GPIO 0 through 31 and the pins
+ *	must already be outputs.
+ *
+ *	Usage:
+ *		waveSetup (10, WAVE_PACE_PWM) ;
+ *		waveClear () ;
+ *		waveAddPulse (1 << 18, 0, 20) ;
+ *		waveAddPulse (0, 1 << 18, 80) ;
+ *		w = waveCreate () ;
+ *		waveSend (w, TRUE) ;	// Repeat until waveStop ()
+ *********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "wiringPi.h"
+#include "wiringPiDMA.h"
+#include "waveform.h"
+
+#define	BCM_PASSWORD		0x5A000000
+
+#define	CLOCK_OFFSET		0x101000
+#define	PWM_OFFSET		0x20C000
+#define	PCM_OFFSET		0x203000
+
+#define	GPSET0			0x1C
+#define	GPCLR0			0x28
+
+// Clock manager (word offsets into the clock block)
+
+#define	PCMCLK_CNTL		38
+#define	PCMCLK_DIV		39
+#define	PWMCLK_CNTL		40
+#define	PWMCLK_DIV		41
+
+#define	CLK_SRC_PLLD		6
+#define	CLK_ENAB		0x10
+#define	CLK_BUSY		0x80
+
+// PWM
+
+#define	PWM_CTL			0
+#define	PWM_DMAC		2
+#define	PWM_RNG1		4
+#define	PWM_FIFO		6
+
+#define	PWM_CTL_PWEN1		0x0001
+#define	PWM_CTL_MODE1		0x0002
+#define	PWM_CTL_CLRF1		0x0040
+#define	PWM_CTL_USEF1		0x0020
+#define	PWM_DMAC_ENAB		(1 << 31)
+
+// PCM
+
+#define	PCM_CS			0
+#define	PCM_FIFO		1
+#define	PCM_MODE		2
+#define	PCM_TXC			4
+#define	PCM_DREQ		5
+#define	PCM_INTSTC		7
+
+#define	PCM_CS_EN		(1 << 0)
+#define	PCM_CS_TXON		(1 << 2)
+#define	PCM_CS_TXCLR		(1 << 3)
+#define	PCM_CS_DMAEN		(1 << 9)
+#define	PCM_TXC_CH1WEX		(1 << 31)
+#define	PCM_TXC_CH1EN		(1 << 30)
+
+// The pacing peripheral is clocked at 10MHz and takes 10 clocks for
+//	each FIFO word, i.e. 1µS per word.
+
+#define	PACE_HZ			10000000
+#define	PACE_CLOCKS		10
+
+// Each pulse is up to 2 control blocks for the GPIO writes, one for
+//	each DELAY_CB_US of its delay and 2 data words. The lite channels
+//	(7 to 14) only have 16 bits of transfer length, so no one control
+//	block waits longer than that - whichever channel it is.
+
+#define	CBS_PER_PULSE		2
+#define	DELAY_CB_US		16383
+
+struct wavePulseStruct
+{
+  unsigned int on, off, delay ;
+} ;
+
+struct waveStruct
+{
+  struct dmaMemStruct mem ;
+  struct dmaCbStruct *first, *last ;
+  int                  inUse ;
+} ;
+
+static volatile unsigned int *clk = NULL ;
+static volatile unsigned int *paceReg = NULL ;
+
+static int dmaChannel = -1 ;
+static int pacer      = -1 ;
+static int current    = -1 ;
+
+static struct wavePulseStruct *pulses = NULL ;
+static int                     numPulses, maxPulses ;
+
+static struct waveStruct waves [WAVE_MAX_WAVES] ;
+
+
+/*
+ * setClock:
+ *	Stop the given clock, set the divisor and start it again from PLLD
+ *********************************************************************************
+ */
+
+static void setClock (int cntl, int div, unsigned int hz)
+{
+  unsigned int plld ;
+
+  plld = (wiringPiPeriBase () == 0xFE000000) ? 750000000 : 500000000 ;	// Pi 4 runs PLLD faster
+
+  *(clk + cntl) = BCM_PASSWORD | CLK_SRC_PLLD ;
+  delayMicroseconds (110) ;
+  while ((*(clk + cntl) & CLK_BUSY) != 0)
+    delayMicroseconds (1) ;
+
+  *(clk + div)  = BCM_PASSWORD | ((plld / hz) << 12) ;
+  *(clk + cntl) = BCM_PASSWORD | CLK_ENAB | CLK_SRC_PLLD ;
+}
+
+
+/*
+ * pacePwm:
+ * pacePcm:
+ *	Set the pacing peripheral up to ask the DMA engine for a word every µS
+ *********************************************************************************
+ */
+
+static void pacePwm (void)
+{
+  *(paceReg + PWM_CTL) = 0 ;
+  delayMicroseconds (10) ;
+
+  setClock (PWMCLK_CNTL, PWMCLK_DIV, PACE_HZ) ;
+
+  *(paceReg + PWM_RNG1) = PACE_CLOCKS ;
+  *(paceReg + PWM_DMAC) = PWM_DMAC_ENAB | (15 << 8) | 15 ;
+  *(paceReg + PWM_CTL)  = PWM_CTL_CLRF1 ;
+  delayMicroseconds (10) ;
+  *(paceReg + PWM_CTL)  = PWM_CTL_USEF1 | PWM_CTL_MODE1 | PWM_CTL_PWEN1 ;
+}
+
+static void pacePcm (void)
+{
+  *(paceReg + PCM_CS) = 0 ;
+  delayMicroseconds (10) ;
+
+  setClock (PCMCLK_CNTL, PCMCLK_DIV, PACE_HZ) ;
+
+  *(paceReg + PCM_CS)     = PCM_CS_EN ;
+  *(paceReg + PCM_MODE)   = (PACE_CLOCKS - 1) << 10 ;	// Frame length
+  *(paceReg + PCM_TXC)    = PCM_TXC_CH1WEX | PCM_TXC_CH1EN ;
+  *(paceReg + PCM_CS)    |= PCM_CS_TXCLR ;
+  delayMicroseconds (10) ;
+  *(paceReg + PCM_DREQ)   = (16 << 24) | (30 << 8) ;	// TX panic and request levels
+  *(paceReg + PCM_INTSTC) = 0x0F ;
+  *(paceReg + PCM_CS)    |= PCM_CS_DMAEN ;
+  *(paceReg + PCM_CS)    |= PCM_CS_TXON ;
+}
+
+
+/*
+ * waveSetup:
+ *	Get the DMA channel and the pacing peripheral ready.
+ *	Needs one of the wiringPiSetup functions (not Sys) to have been
+ *	called first, and root. Returns 0 or -1.
+ *********************************************************************************
+ */
+
+int waveSetup (int channel, int pace)
+{
+  if ((pace != WAVE_PACE_PWM) && (pace != WAVE_PACE_PCM))
+    return -1 ;
+
+  if (dmaChannelSetup (channel) < 0)
+    return -1 ;
+
+  if (clk == NULL)
+    if ((clk = wiringPiPeriMap (CLOCK_OFFSET, 4096)) == NULL)
+      return -1 ;
+
+  if (paceReg != NULL)
+    munmap ((void *)paceReg, 4096) ;
+
+  if ((paceReg = wiringPiPeriMap ((pace == WAVE_PACE_PWM) ? PWM_OFFSET : PCM_OFFSET, 4096)) == NULL)
+    return -1 ;
+
+  dmaChannel = channel ;
+  pacer      = pace ;
+
+  if (pacer == WAVE_PACE_PWM)
+    pacePwm () ;
+  else
+    pacePcm () ;
+
+  return 0 ;
+}
+
+
+/*
+ * waveClear:
+ * waveAddPulse:
+ *	Build up the list of pulses for the next waveCreate
+ *********************************************************************************
+ */
+
+void waveClear (void)
+{
+  numPulses = 0 ;
+}
+
+int waveAddPulse (unsigned int onMask, unsigned int offMask, unsigned int delayUs)
+{
+  struct wavePulseStruct *p ;
+
+  if (numPulses == maxPulses)
+  {
+    maxPulses = (maxPulses == 0) ? 64 : maxPulses * 2 ;
+    if ((p = realloc (pulses, maxPulses * sizeof (*p))) == NULL)
+      return -1 ;
+    pulses = p ;
+  }
+
+  p = &pulses [numPulses++] ;
+  p->on    = onMask ;
+  p->off   = offMask ;
+  p->delay = delayUs ;
+
+  return numPulses ;
+}
+
+
+/*
+ * waveChain:
+ *	Put a control block on the end of a wave's chain
+ *********************************************************************************
+ */
+
+static void waveChain (struct waveStruct *w, struct dmaCbStruct **prev, struct dmaCbStruct *cb)
+{
+  if (*prev != NULL)
+    (*prev)->next = dmaBusAddr (&w->mem, cb) ;
+  else
+    w->first = cb ;
+  *prev = cb ;
+}
+
+
+/*
+ * waveCreate:
+ *	Turn the current list of pulses into a chain of control blocks.
+ *	Returns the wave id or -1.
+ *********************************************************************************
+ */
+
+int waveCreate (void)
+{
+  struct waveStruct  *w ;
+  struct dmaCbStruct *cb, *prev ;
+  uint32_t           *data, *dummy ;
+  uint32_t            fifo ;
+  unsigned int        size, numCbs, delay, chunk ;
+  int                 i, id, dreq ;
+
+  if ((dmaChannel == -1) || (numPulses == 0))
+    return -1 ;
+
+  for (id = 0 ; id < WAVE_MAX_WAVES ; ++id)
+    if (!waves [id].inUse)
+      break ;
+  if (id == WAVE_MAX_WAVES)
+    return -1 ;
+
+  numCbs = 0 ;
+  for (i = 0 ; i < numPulses ; ++i)
+    numCbs += CBS_PER_PULSE + (pulses [i].delay + DELAY_CB_US - 1) / DELAY_CB_US ;
+
+  w    = &waves [id] ;
+  size = numCbs * sizeof (struct dmaCbStruct) + numPulses * 2 * sizeof (uint32_t) + sizeof (uint32_t) ;
+
+  if (dmaMemAlloc (&w->mem, size) < 0)
+    return -1 ;
+
+  if (pacer == WAVE_PACE_PWM)
+  {
+    fifo = DMA_BUS_PWM + PWM_FIFO * 4 ;
+    dreq = DMA_DREQ_PWM ;
+  }
+  else
+  {
+    fifo = DMA_BUS_PCM + PCM_FIFO * 4 ;
+    dreq = DMA_DREQ_PCM_TX ;
+  }
+
+  cb    = (struct dmaCbStruct *)w->mem.virt ;
+  data  = (uint32_t *)(cb + numCbs) ;
+  dummy = data + numPulses * 2 ;
+  prev  = NULL ;
+
+  for (i = 0 ; i < numPulses ; ++i)
+  {
+    data [0] = pulses [i].on ;
+    data [1] = pulses [i].off ;
+
+    if (pulses [i].on != 0)
+    {
+      cb->info   = DMA_TI_NO_WIDE_BURSTS | DMA_TI_WAIT_RESP ;
+      cb->src    = dmaBusAddr (&w->mem, &data [0]) ;
+      cb->dst    = DMA_BUS_GPIO + GPSET0 ;
+      cb->length = 4 ;
+      waveChain (w, &prev, cb++) ;
+    }
+
+    if (pulses [i].off != 0)
+    {
+      cb->info   = DMA_TI_NO_WIDE_BURSTS | DMA_TI_WAIT_RESP ;
+      cb->src    = dmaBusAddr (&w->mem, &data [1]) ;
+      cb->dst    = DMA_BUS_GPIO + GPCLR0 ;
+      cb->length = 4 ;
+      waveChain (w, &prev, cb++) ;
+    }
+
+    for (delay = pulses [i].delay ; delay != 0 ; delay -= chunk)
+    {
+      chunk      = (delay > DELAY_CB_US) ? DELAY_CB_US : delay ;
+      cb->info   = DMA_TI_NO_WIDE_BURSTS | DMA_TI_WAIT_RESP | DMA_TI_DEST_DREQ | DMA_TI_PERMAP (dreq) ;
+      cb->src    = dmaBusAddr (&w->mem, dummy) ;
+      cb->dst    = fifo ;
+      cb->length = chunk * 4 ;
+      waveChain (w, &prev, cb++) ;
+    }
+
+    data += 2 ;
+  }
+
+  if (prev == NULL)		// Nothing but empty pulses
+  {
+    dmaMemFree (&w->mem) ;
+    return -1 ;
+  }
+
+  w->last  = prev ;
+  w->inUse = TRUE ;
+
+  return id ;
+}
+
+
+/*
+ * waveDelete:
+ *	Free up a wave, stopping it first if it's the one running
+ *********************************************************************************
+ */
+
+int waveDelete (int wave)
+{
+  if ((wave < 0) || (wave >= WAVE_MAX_WAVES) || !waves [wave].inUse)
+    return -1 ;
+
+  if (wave == current)
+    waveStop () ;
+
+  dmaMemFree (&waves [wave].mem) ;
+  waves [wave].inUse = FALSE ;
+
+  return 0 ;
+}
+
+
+/*
+ * waveSend:
+ *	Start a wave, once or over and over until waveStop.
+ *	Anything already running is stopped first.
+ *********************************************************************************
+ */
+
+int waveSend (int wave, int repeat)
+{
+  struct waveStruct *w ;
+
+  if ((wave < 0) || (wave >= WAVE_MAX_WAVES) || !waves [wave].inUse)
+    return -1 ;
+
+  w = &waves [wave] ;
+
+  if (current != -1)
+    waveStop () ;
+
+  w->last->next = repeat ? dmaBusAddr (&w->mem, w->first) : 0 ;
+
+  current = wave ;
+  return dmaStart (dmaChannel, dmaBusAddr (&w->mem, w->first)) ;
+}
+
+
+/*
+ * waveBusy:
+ *	Is a wave still going?
+ *********************************************************************************
+ */
+
+int waveBusy (void)
+{
+  if (dmaChannel == -1)
+    return FALSE ;
+
+  return dmaBusy (dmaChannel) ;
+}
+
+
+/*
+ * waveStop:
+ *	Stop it, now.
+ *********************************************************************************
+ */
+
+void waveStop (void)
+{
+  if (dmaChannel != -1)
+    dmaStop (dmaChannel) ;
+
+  current = -1 ;
+}
@@ -0,0 +1,48 @@
+/*
+ * waveform.h:
+ *	DMA driven GPIO waveforms
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+// Pacing peripheral. Both take over the peripheral (and its clock) while
+//	the waveform engine is set up, so no hardware PWM or PCM audio then.
+
+#define	WAVE_PACE_PWM	0
+#define	WAVE_PACE_PCM	1
+
+#define	WAVE_MAX_WAVES	16
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int  waveSetup    (int dmaChannel, int pacer) ;
+extern void waveClear    (void) ;
+extern int  waveAddPulse (unsigned int onMask, unsigned int offMask, unsigned int delayUs) ;
+extern int  waveCreate   (void) ;
+extern int  waveDelete   (int wave) ;
+extern int  waveSend     (int wave, int repeat) ;
+extern int  waveBusy     (void) ;
+extern void waveStop     (void) ;
+
+#ifdef __cplusplus
+}
+#endif
@@ -61,20 +61,34 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <math.h>
 #include <time.h>
 #include <fcntl.h>
 #include <pthread.h>
+#include <sched.h>
 #include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <sys/ioctl.h>
+#include <sys/syscall.h>
 #include <asm/ioctl.h>
 
 #include "softPwm.h"
 #include "softTone.h"
 
 #include "wiringPi.h"
+#include "wiringPiGpioChip.h"
+#include "wiringPiDMA.h"
+#include "wiringPiTrace.h"
+#include "wiringPiSim.h"
+#include "wiringPiFilter.h"
+#include "wiringPiConfig.h"
+#include "wiringPiImage.h"
+#include "wiringPiRP1.h"
+#include "wiringPiBroker.h"
 #include "../version.h"
 
 // Environment Variables
@@ -82,6 +96,13 @@
 #define	ENV_DEBUG	"WIRINGPI_DEBUG"
 #define	ENV_CODES	"WIRINGPI_CODES"
 #define	ENV_GPIOMEM	"WIRINGPI_GPIOMEM"
+#define	ENV_SYSFS	"WIRINGPI_SYSFS"
+#define	ENV_STATS	"WIRINGPI_STATS"
+#define	ENV_FLIGHT	"WIRINGPI_FLIGHT"
+#define	ENV_LAZY	"WIRINGPI_LAZY"
+#define	ENV_MAPALL	"WIRINGPI_MAPALL"
+#define	ENV_SHARED	"WIRINGPI_SHARED"
+#define	ENV_IMAGE	"WIRINGPI_IMAGE"
 
 
 // Extend wiringPi with other pin-based devices and keep track of
@@ -89,6 +110,19 @@
 
 struct wiringPiNodeStruct *wiringPiNodes = NULL ;
 
+// The statistics table - see wiringPiStatsEnable () - up here as the
+//	pin and node calls count themselves into it
+
+static struct wpiStatsTableStruct  statsLocal ;
+static struct wpiStatsTableStruct *statsTable = &statsLocal ;
+static int statsOn = FALSE ;
+
+static inline void statsPin (int pin, int write)
+{
+  if (__builtin_expect (statsOn, FALSE) && ((pin & PI_GPIO_MASK) == 0))
+    __atomic_fetch_add (write ? &statsTable->pins [pin].writes : &statsTable->pins [pin].reads, 1, __ATOMIC_RELAXED) ;
+}
+
 // BCM Magic
 
 #define	BCM_PASSWORD		0x5A000000
@@ -140,6 +174,9 @@ static volatile unsigned int GPIO_PWM ;
 #define	BLOCK_SIZE		(4*1024)
 
 static unsigned int usingGpioMem    = FALSE ;
+static          int memFd           = -1 ;	// /dev/mem or /dev/gpiomem, for mapping later
+static          int simulating      = FALSE ;	// WIRINGPI_SIM: see wiringPiSim.c
+static          int rp1             = FALSE ;	// Pi 5: see wiringPiRP1.c
 static          int wiringPiSetuped = FALSE ;
 
 // PWM
@@ -151,6 +188,13 @@ static          int wiringPiSetuped = FALSE ;
 #define	PWM0_DATA   5
 #define	PWM1_RANGE  8
 #define	PWM1_DATA   9
+#define	PWM_DMAC    2
+#define	PWM_FIFO    6
+
+#define	PWM_STA_FULL1   0x0001
+#define	PWM_STA_ERRORS  0x010C	// BERR, RERR1, WERR1
+#define	PWM_CLRFIFO     0x0040
+#define	PWM_DMAC_ENAB   0x80000000
 
 //	Clock regsiter offsets
 
@@ -173,6 +217,30 @@ static          int wiringPiSetuped = FALSE ;
 #define	PWM1_SERIAL     0x0200  // Run in serial mode
 #define	PWM1_ENABLE     0x0100  // Channel Enable
 
+// The BCM2711 has a second PWM controller 0x800 bytes above the first,
+//	so in the same page. Its channels are our PWM channels 2 and 3.
+
+#define	PWM_CTLR1	(0x800 >> 2)
+
+// PWM FIFO streaming
+
+#define	PWM_STREAM_RING	4096
+
+static int  pwmDivisor   = 32 ;		// As last set by pwmSetClock
+static pthread_mutex_t pwmControlLock = PTHREAD_MUTEX_INITIALIZER ;
+static int  pwmStreamDmaChannel = 10 ;
+
+static struct dmaMemStruct pwmStreamMem ;
+static int                 pwmStreamDmaUp = FALSE ;
+
+static uint32_t        pwmRing [PWM_STREAM_RING] ;
+static volatile int    pwmRingHead, pwmRingTail ;
+static int             pwmStreamThreadUp = FALSE ;
+static volatile int    pwmStreamRate ;
+static int             pwmStreamChannel = -1 ;	// What it's set up for
+static pthread_mutex_t pwmRingLock  = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_cond_t  pwmRingSpace = PTHREAD_COND_INITIALIZER ;
+
 // Timer
 //	Word offsets
 
@@ -186,6 +254,14 @@ static          int wiringPiSetuped = FALSE ;
 #define	TIMER_PRE_DIV	(0x41C >> 2)
 #define	TIMER_COUNTER	(0x420 >> 2)
 
+// System Timer
+//	The free-running 64-bit 1MHz counter - unlike the ARM timer above it
+//	doesn't change speed with the core clock.
+
+#define	GPIO_SYS_TIMER_OFFSET	0x00003000
+#define	SYS_TIMER_CLO		(0x04 >> 2)
+#define	SYS_TIMER_CHI		(0x08 >> 2)
+
 // Locals to hold pointers to the hardware
 
 static volatile unsigned int *gpio ;
@@ -195,9 +271,21 @@ static volatile unsigned int *pads ;
 static volatile unsigned int *timer ;
 static volatile unsigned int *timerIrqRaw ;
 
+// gpioSet: gpioClr: gpioLev:
+//	Where each bank's set, clear and level words are: GPSET, GPCLR and
+//	GPLEV on the BCM chips, or the set and clear aliases of RIO OUT and
+//	RIO SYNC_IN on the RP1 - whose bank 0 is all there is on the header,
+//	so bank 1 goes nowhere.
+
+static volatile unsigned int *gpioSet [2] ;
+static volatile unsigned int *gpioClr [2] ;
+static volatile unsigned int *gpioLev [2] ;
+static volatile unsigned int  rp1Nowhere [3] ;
+
 // Export variables for the hardware pointers
 
 volatile unsigned int *_wiringPiGpio ;
+volatile unsigned int *_wiringPiGpioDirect ;	// As above, but NULL unless a store there really drives the pins
 volatile unsigned int *_wiringPiPwm ;
 volatile unsigned int *_wiringPiClk ;
 volatile unsigned int *_wiringPiPads ;
@@ -219,7 +307,7 @@ volatile unsigned int *_wiringPiTimerIrqRaw ;
 
 static volatile unsigned int piGpioBase = 0 ;
 
-const char *piModelNames [20] =
+const char *piModelNames [27] =
 {
   "Model A",	//  0
   "Model B",	//  1
@@ -241,6 +329,13 @@ const char *piModelNames [20] =
   "Pi 4B",	// 17
   "Unknown18",	// 18
   "Unknown19",	// 19
+  "Unknown20",	// 20
+  "Unknown21",	// 21
+  "Unknown22",	// 22
+  "Pi 5",	// 23
+  "CM5",	// 24
+  "Pi 500",	// 25
+  "CM5 Lite",	// 26
 } ;
 
 const char *piRevisionNames [18] =
@@ -292,20 +387,30 @@ const int piMemorySize [8] =
   1024,		//	 2
   2048,		//	 3
   4096,		//	 4
-     0,		//	 5
-     0,		//	 6
+  8192,		//	 5
+ 16384,		//	 6
      0,		//	 7
 } ;
 
 // Time for easy calculations
 
-static uint64_t epochMilli, epochMicro ;
+static uint64_t epochMilli, epochMicro, epochNano ;
+
+// Time source for the 64-bit time functions and the offset that keeps
+//	them continuous when the source is changed - it's taken off whichever
+//	source it is, starting with the epoch for the clock
+
+static          int   timeSource = WPI_TIME_CLOCK ;
+static volatile unsigned int *sysTimer = NULL ;
+static      int64_t   timeOffset = 0 ;
+static     uint64_t   cntFreq    = 0 ;
+
+static inline uint64_t sourceNanos (void) ;
 
 // Misc
 
 static int wiringPiMode = WPI_MODE_UNINITIALISED ;
-static volatile int    pinPass = -1 ;
-static pthread_mutex_t pinMutex ;
+static pthread_mutex_t pinMutex = PTHREAD_MUTEX_INITIALIZER ;
 
 // Debugging & Return codes
 
@@ -327,9 +432,50 @@ static int sysFds [64] =
   -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
 } ;
 
+// lineFds:
+//	GPIO character device line requests, one per BCM_GPIO pin. These are
+//	used in Sys mode for any pin that isn't exported in /sys/class/gpio,
+//	and for interrupts in all modes. We remember how each line was last
+//	configured so that changing one aspect doesn't lose the others.
+
+static int lineFds  [64] =
+{
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+} ;
+
+static int lineMode [64] ;
+static int linePud  [64] ;
+static int lineEdge [64] ;
+static unsigned int lineDebounceUs [64] ;	// Kernel glitch filter, from wiringPiISRFilter
+static int isrEdge  [64] ;	// What wiringPiISR asked for, to put back after OUTPUT
+static int useGpioChip = FALSE ;
+
 // ISR Data
+//	isrGpio maps the pin number the ISR was registered with to its BCM_GPIO
+//	pin so the dispatcher doesn't need the mode look-ups. A pin has either
+//	a plain function or, from wiringPiISRex, one that takes a context and
+//	the event.
+
+static void (*isrFunctions   [64])(void) ;
+static void (*isrExFunctions [64])(void *context, const struct wpiEdgeEventStruct *event) ;
+static void  *isrContexts    [64] ;
+static int    isrGpio        [64] ;
+
+// ISR filters, per BCM_GPIO pin, in uS - see wiringPiISRFilter
+
+static unsigned int isrDebounce [64] ;
+static unsigned int isrGlitch   [64] ;
+static uint64_t     isrAccepted [64] ;	// When the last edge we let through was
 
-static void (*isrFunctions [64])(void) ;
+// ISR Dispatcher
+//	When enabled, a small pool of threads waits in epoll_wait on all the
+//	interrupt pins rather than one thread per pin.
+
+static int isrEpollFd    = -1 ;
+static int isrDispatch   =  0 ;	// Number of dispatcher threads, 0 = thread per pin, -1 = caller polls
 
 
 // Doing it the Arduino way with lookup tables...
@@ -510,7 +656,6 @@ static uint8_t gpioToGPLEV [] =
 } ;
 
 
-#ifdef notYetReady
 // gpioToEDS
 //	(Word) offset to the Event Detect Status
 
@@ -537,7 +682,6 @@ static uint8_t gpioToFEN [] =
   22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,
   23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,
 } ;
-#endif
 
 
 // GPPUD:
@@ -601,8 +745,6 @@ static uint8_t gpioToPwmPort [] =
 //	for clocks 0 and 1 respectively, however I'll include the full
 //	list for completeness - maybe one day...
 
-#define	GPIO_CLOCK_SOURCE	1
-
 // gpioToGpClkALT0:
 
 static uint8_t gpioToGpClkALT0 [] =
@@ -704,12 +846,62 @@ static void usingGpioMemCheck (const char *what)
 {
   if (usingGpioMem)
   {
-    fprintf (stderr, "%s: Unable to do this when using /dev/gpiomem. Try sudo?\n", what) ;
+    fprintf (stderr, "%s: Unable to do this when using /dev/gpiomem. Try sudo, or a broker (wiringpid -b)?\n", what) ;
     exit (EXIT_FAILURE) ;
   }
 }
 
 
+/*
+ * brokered:
+ *	Under /dev/gpiomem the PWM, clocks and pads are out of reach, but
+ *	the broker may do it for us. TRUE if it's been handed over; pins are
+ *	BCM_GPIO.
+ *********************************************************************************
+ */
+
+static int brokered (int op, int pin, int a)
+{
+  return usingGpioMem && (wpiBroker (op, pin, a, 0, 0.0, NULL) == 0) ;
+}
+
+
+/*
+ * chipLine:
+ *	Make sure we have a GPIO character device request for the given
+ *	BCM_GPIO pin, configured as asked. -1 for any of mode, pud or edge
+ *	keeps what the line already has (or leaves the hardware as-is for a
+ *	new line)
+ *	Returns the request fd or -1.
+ *********************************************************************************
+ */
+
+static int chipLine (int pin, int mode, int pud, int edge)
+{
+  if (lineFds [pin] == -1)
+  {
+    lineMode [pin] = lineEdge [pin] = linePud [pin] = -1 ;
+    if (mode != -1) lineMode [pin] = mode ;
+    if (pud  != -1) linePud  [pin] = pud ;
+    if (edge != -1) lineEdge [pin] = edge ;
+    lineFds [pin] = gpioChipRequest (&pin, 1, lineMode [pin], linePud [pin], lineEdge [pin], lineDebounceUs [pin]) ;
+    return lineFds [pin] ;
+  }
+
+  if (((mode == -1) || (mode == lineMode [pin])) && ((pud == -1) || (pud == linePud [pin])) && ((edge == -1) || (edge == lineEdge [pin])))
+    return lineFds [pin] ;
+
+  if (mode != -1) lineMode [pin] = mode ;
+  if (pud  != -1) linePud  [pin] = pud ;
+  if (edge != -1) lineEdge [pin] = edge ;
+
+  if (gpioChipReconfig (lineFds [pin], 1, lineMode [pin], linePud [pin], lineEdge [pin], lineDebounceUs [pin]) < 0)
+    return -1 ;
+
+  return lineFds [pin] ;
+}
+
+
 
 /*
  * piGpioLayout:
@@ -745,17 +937,42 @@ static void piGpioLayoutOops (const char *why)
   exit (EXIT_FAILURE) ;
 }
 
-int piGpioLayout (void)
+/*
+ * piRevision:
+ *	Find the board revision code as a string of hex digits. The device
+ *	tree has it as a 32-bit big-endian number, which is one small read,
+ *	so try that first and only parse /proc/cpuinfo if it's not there.
+ *	It's not going to change, so the result is cached.
+ *********************************************************************************
+ */
+
+static const char *piRevision (void)
 {
+  static char revision [32] ;
+  unsigned char dt [4] ;
   FILE *cpuFd ;
   char line [120] ;
   char *c ;
-  static int  gpioLayout = -1 ;
+  int fd, n ;
 
-  if (gpioLayout != -1)	// No point checking twice
-    return gpioLayout ;
+  if (revision [0] != 0)
+    return revision ;
+
+  if (!wiringPiSimActive () && ((fd = open ("/proc/device-tree/system/linux,revision", O_RDONLY | O_CLOEXEC)) >= 0))
+  {
+    n = read (fd, dt, 4) ;
+    close (fd) ;
+
+    if (n == 4)
+    {
+      snprintf (revision, sizeof (revision), "%04x", ((unsigned int)dt [0] << 24) | (dt [1] << 16) | (dt [2] << 8) | dt [3]) ;
+      if (wiringPiDebug)
+	printf ("piRevision: Device tree revision: %s\n", revision) ;
+      return revision ;
+    }
+  }
 
-  if ((cpuFd = fopen ("/proc/cpuinfo", "r")) == NULL)
+  if ((cpuFd = (wiringPiSimActive () ? simCpuInfo () : fopen ("/proc/cpuinfo", "r"))) == NULL)
     piGpioLayoutOops ("Unable to open /proc/cpuinfo") ;
 
 // Start by looking for the Architecture to make sure we're really running
@@ -770,7 +987,7 @@ int piGpioLayout (void)
     piGpioLayoutOops ("No \"Hardware\" line") ;
 
   if (wiringPiDebug)
-    printf ("piGpioLayout: Hardware: %s\n", line) ;
+    printf ("piRevision: Hardware: %s\n", line) ;
 
 // See if it's BCM2708 or BCM2709 or the new BCM2835.
 
@@ -831,7 +1048,7 @@ int piGpioLayout (void)
     *c = 0 ;
 
   if (wiringPiDebug)
-    printf ("piGpioLayout: Revision string: %s\n", line) ;
+    printf ("piRevision: Revision string: %s\n", line) ;
 
 // Scan to the first character of the revision number
 
@@ -848,6 +1065,21 @@ int piGpioLayout (void)
   while (isspace (*c))
     ++c ;
 
+  strncpy (revision, c, sizeof (revision) - 1) ;
+
+  return revision ;
+}
+
+int piGpioLayout (void)
+{
+  const char *c ;
+  static int  gpioLayout = -1 ;
+
+  if (gpioLayout != -1)	// No point checking twice
+    return gpioLayout ;
+
+  c = piRevision () ;
+
   if (!isxdigit (*c))
     piGpioLayoutOops ("Bogus \"Revision\" line (no hex digit at start of revision)") ;
 
@@ -956,9 +1188,7 @@ int piBoardRev (void)
 
 void piBoardId (int *model, int *rev, int *mem, int *maker, int *warranty)
 {
-  FILE *cpuFd ;
-  char line [120] ;
-  char *c ;
+  const char *c ;
   unsigned int revision ;
   int bRev, bType, bProc, bMfg, bMem, bWarranty ;
 
@@ -967,42 +1197,10 @@ void piBoardId (int *model, int *rev, int *mem, int *maker, int *warranty)
 
   (void)piGpioLayout () ;	// Call this first to make sure all's OK. Don't care about the result.
 
-  if ((cpuFd = fopen ("/proc/cpuinfo", "r")) == NULL)
-    piGpioLayoutOops ("Unable to open /proc/cpuinfo") ;
-
-  while (fgets (line, 120, cpuFd) != NULL)
-    if (strncmp (line, "Revision", 8) == 0)
-      break ;
-
-  fclose (cpuFd) ;
-
-  if (strncmp (line, "Revision", 8) != 0)
-    piGpioLayoutOops ("No \"Revision\" line") ;
-
-// Chomp trailing CR/NL
-
-  for (c = &line [strlen (line) - 1] ; (*c == '\n') || (*c == '\r') ; --c)
-    *c = 0 ;
+  c = piRevision () ;
 
   if (wiringPiDebug)
-    printf ("piBoardId: Revision string: %s\n", line) ;
-
-// Need to work out if it's using the new or old encoding scheme:
-
-// Scan to the first character of the revision number
-
-  for (c = line ; *c ; ++c)
-    if (*c == ':')
-      break ;
-
-  if (*c != ':')
-    piGpioLayoutOops ("Bogus \"Revision\" line (no colon)") ;
-
-// Chomp spaces
-
-  ++c ;
-  while (isspace (*c))
-    ++c ;
+    printf ("piBoardId: Revision string: %s\n", c) ;
 
   if (!isxdigit (*c))
     piGpioLayoutOops ("Bogus \"Revision\" line (no hex digit at start of revision)") ;
@@ -1092,6 +1290,42 @@ void piBoardId (int *model, int *rev, int *mem, int *maker, int *warranty)
 
 
 
+/*
+ * wiringPiPeriBase:
+ * wiringPiPeriMap:
+ *	For the other parts of wiringPi that drive more of the BCM peripherals
+ *	(DMA, PCM, BSC, etc.) - return the physical base address of the
+ *	peripherals, and map a block of them at the given offset from that.
+ *	The map needs /dev/mem, i.e. root. Returns NULL on failure.
+ *********************************************************************************
+ */
+
+unsigned int wiringPiPeriBase (void)
+{
+  return piGpioBase ;
+}
+
+volatile unsigned int *wiringPiPeriMap (unsigned int offset, unsigned int size)
+{
+  int   fd ;
+  void *map ;
+
+  if ((piGpioBase == 0) || usingGpioMem || wiringPiSimActive ())	// Not running via /dev/mem
+    return NULL ;
+
+  if ((fd = open ("/dev/mem", O_RDWR | O_SYNC | O_CLOEXEC)) < 0)
+    return NULL ;
+
+  map = mmap (0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, piGpioBase + offset) ;
+  close (fd) ;
+
+  if (map == MAP_FAILED)
+    return NULL ;
+
+  return (volatile unsigned int *)map ;
+}
+
+
 /*
  * wpiPinToGpio:
  *	Translate a wiringPi Pin number to native GPIO pin number.
@@ -1118,6 +1352,88 @@ int physPinToGpio (int physPin)
 }
 
 
+/*
+ * mapBlock:
+ *	Map one of the peripheral blocks - or plain memory when simulating
+ *********************************************************************************
+ */
+
+static uint32_t *mapBlock (int fd, unsigned int base)
+{
+  volatile unsigned int *block ;
+
+  if (!simulating)
+    return (uint32_t *)mmap (0, BLOCK_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, base) ;
+
+  if ((block = simMap (BLOCK_SIZE)) == NULL)
+    return (uint32_t *)MAP_FAILED ;
+
+  return (uint32_t *)block ;
+}
+
+
+/*
+ * periMap:
+ * needPwm: needClk: needPads: needTimer:
+ *	The PWM, clock, pads and timer blocks aren't mapped until something
+ *	first uses them, so a program that just wiggles a few pins doesn't
+ *	pay for four extra mmaps at startup. The exported _wiringPiXxx
+ *	pointers are filled in at the same time - set WIRINGPI_MAPALL
+ *	to have them all mapped by wiringPiSetup () as they used to be.
+ *********************************************************************************
+ */
+
+static pthread_mutex_t periLock = PTHREAD_MUTEX_INITIALIZER ;
+
+static void periMap (volatile unsigned int **block, volatile unsigned int **exported, unsigned int base, const char *what)
+{
+  uint32_t *map ;
+
+  pthread_mutex_lock (&periLock) ;
+
+// The Pi 5 has none of these where the older chips do, so plain memory
+//	stands in and whatever's written there does nothing
+
+  if ((*block == NULL) && rp1)
+  {
+    if ((*block = simMap (BLOCK_SIZE)) == NULL)
+      (void)wiringPiFailure (WPI_FATAL, "wiringPi: mmap (%s) failed: %s\n", what, strerror (errno)) ;
+    *exported = *block ;
+  }
+
+  if (*block == NULL)
+  {
+    if ((map = mapBlock (memFd, base)) == MAP_FAILED)
+      (void)wiringPiFailure (WPI_FATAL, "wiringPi: mmap (%s) failed: %s\n", what, strerror (errno)) ;
+
+    *block    = map ;
+    *exported = map ;
+  }
+
+  pthread_mutex_unlock (&periLock) ;
+}
+
+static void needPwm  (void) { if (pwm  == NULL) periMap (&pwm,  &_wiringPiPwm,  GPIO_PWM,        "PWM")   ; }
+static void needClk  (void) { if (clk  == NULL) periMap (&clk,  &_wiringPiClk,  GPIO_CLOCK_BASE, "CLOCK") ; }
+static void needPads (void) { if (pads == NULL) periMap (&pads, &_wiringPiPads, GPIO_PADS,       "PADS")  ; }
+
+static void needTimer (void)
+{
+  if (timer != NULL)
+    return ;
+
+  periMap (&timer, &_wiringPiTimer, GPIO_TIMER, "TIMER") ;
+
+// Set the timer to free-running, 1MHz.
+//	0xF9 is 249, the timer divide is base clock / (divide+1)
+//	so base clock is 250MHz / 250 = 1MHz.
+
+  *(timer + TIMER_CONTROL) = 0x0000280 ;
+  *(timer + TIMER_PRE_DIV) = 0x00000F9 ;
+  timerIrqRaw = timer + TIMER_IRQ_RAW ;
+}
+
+
 /*
  * setPadDrive:
  *	Set the PAD driver value
@@ -1133,6 +1449,10 @@ void setPadDrive (int group, int value)
     if ((group < 0) || (group > 2))
       return ;
 
+    if (brokered (WPI_BROKER_PADS, group, value))
+      return ;
+
+    needPads () ;
     wrVal = BCM_PASSWORD | 0x18 | (value & 7) ;
     *(pads + group + 11) = wrVal ;
 
@@ -1165,6 +1485,9 @@ int getAlt (int pin)
   else if (wiringPiMode != WPI_MODE_GPIO)
     return 0 ;
 
+  if (rp1)
+    return rp1GetAlt (pin) ;
+
   fSel    = gpioToGPFSEL [pin] ;
   shift   = gpioToShift  [pin] ;
 
@@ -1175,910 +1498,5547 @@ int getAlt (int pin)
 
 
 /*
- * pwmSetMode:
- *	Select the native "balanced" mode, or standard mark:space mode
+ * pinModeCapable:
+ *	Can this pin be put into the given mode? Only really useful for
+ *	PWM_OUTPUT and GPIO_CLOCK which only some pins can do, and which need
+ *	direct access to the hardware (/dev/mem, not /dev/gpiomem)
  *********************************************************************************
  */
 
-void pwmSetMode (int mode)
+int pinModeCapable (int pin, int mode)
 {
-  if ((wiringPiMode == WPI_MODE_PINS) || (wiringPiMode == WPI_MODE_PHYS) || (wiringPiMode == WPI_MODE_GPIO))
-  {
-    if (mode == PWM_MODE_MS)
-      *(pwm + PWM_CONTROL) = PWM0_ENABLE | PWM1_ENABLE | PWM0_MS_MODE | PWM1_MS_MODE ;
-    else
-      *(pwm + PWM_CONTROL) = PWM0_ENABLE | PWM1_ENABLE ;
-  }
+  if ((pin & PI_GPIO_MASK) != 0)		// Not on-board
+    return FALSE ;
+
+  /**/ if (wiringPiMode == WPI_MODE_PINS)
+    pin = pinToGpio [pin] ;
+  else if (wiringPiMode == WPI_MODE_PHYS)
+    pin = physToGpio [pin] ;
+  else if (wiringPiMode != WPI_MODE_GPIO)
+    return FALSE ;
+
+  if ((pin < 0) || usingGpioMem)
+    return FALSE ;
+
+  /**/ if (rp1 && (mode == PWM_OUTPUT))
+    return rp1PwmChannel (pin) >= 0 ;
+  else if (rp1 && (mode == GPIO_CLOCK))
+    return FALSE ;
+  else if (mode == PWM_OUTPUT)
+    return gpioToPwmALT [pin] != 0 ;
+  else if (mode == GPIO_CLOCK)
+    return gpioToGpClkALT0 [pin] != 0 ;
+  else
+    return (mode == INPUT) || (mode == OUTPUT) ;
 }
 
 
 /*
- * pwmSetRange:
- *	Set the PWM range register. We set both range registers to the same
- *	value. If you want different in your own code, then write your own.
+ * PWM channel helpers:
+ *	Channels 0 and 1 are on the first controller, 2 and 3 on the
+ *	second one of the BCM2711. Each pair shares a control register,
+ *	one byte of it per channel.
  *********************************************************************************
  */
 
-void pwmSetRange (unsigned int range)
+static int pwmControllers (void)
 {
-  if ((wiringPiMode == WPI_MODE_PINS) || (wiringPiMode == WPI_MODE_PHYS) || (wiringPiMode == WPI_MODE_GPIO))
-  {
-    *(pwm + PWM0_RANGE) = range ; delayMicroseconds (10) ;
-    *(pwm + PWM1_RANGE) = range ; delayMicroseconds (10) ;
-  }
+  return ((piGpioBase == GPIO_PERI_BASE_2711) || rp1) ? 2 : 1 ;	// The RP1 has one, of 4 channels
 }
 
+static volatile unsigned int *pwmController (int channel)
+{
+  return (channel < 2) ? pwm : pwm + PWM_CTLR1 ;
+}
 
-/*
- * pwmSetClock:
- *	Set/Change the PWM clock. Originally my code, but changed
- *	(for the better!) by Chris Hall, <chris@kchall.plus.com>
- *	after further study of the manual and testing with a 'scope
- *********************************************************************************
- */
-
-void pwmSetClock (int divisor)
+static int gpioToPwmChannel (int pin)
 {
-  uint32_t pwm_control ;
+  int channel ;
 
-  if (piGpioBase == GPIO_PERI_BASE_2711)
+  if (rp1)
+    return rp1PwmChannel (pin) ;
+
+  if ((pin < 0) || (pin > 63) || (gpioToPwmPort [pin] == 0))
+    return -1 ;
+
+  channel = (gpioToPwmPort [pin] == PWM0_DATA) ? 0 : 1 ;
+
+// On the 2711 40 and 41 are on the second controller
+
+  if ((piGpioBase == GPIO_PERI_BASE_2711) && ((pin == 40) || (pin == 41)))
+    channel += 2 ;
+
+  return channel ;
+}
+
+static volatile unsigned int *pwmChannelCheck (int channel)
+{
+  if ((channel < 0) || (channel >= pwmControllers () * 2))
   {
-    divisor = 540*divisor/192;
+    errno = EINVAL ;
+    return NULL ;
   }
-  divisor &= 4095 ;
 
-  if ((wiringPiMode == WPI_MODE_PINS) || (wiringPiMode == WPI_MODE_PHYS) || (wiringPiMode == WPI_MODE_GPIO))
+  if ((wiringPiMode != WPI_MODE_PINS) && (wiringPiMode != WPI_MODE_PHYS) && (wiringPiMode != WPI_MODE_GPIO))
   {
-    if (wiringPiDebug)
-      printf ("Setting to: %d. Current: 0x%08X\n", divisor, *(clk + PWMCLK_DIV)) ;
-
-    pwm_control = *(pwm + PWM_CONTROL) ;		// preserve PWM_CONTROL
-
-// We need to stop PWM prior to stopping PWM clock in MS mode otherwise BUSY
-// stays high.
+    errno = ENODEV ;
+    return NULL ;
+  }
 
-    *(pwm + PWM_CONTROL) = 0 ;				// Stop PWM
+  needPwm () ;
+  return pwmController (channel) ;
+}
 
-// Stop PWM clock before changing divisor. The delay after this does need to
-// this big (95uS occasionally fails, 100uS OK), it's almost as though the BUSY
-// flag is not working properly in balanced mode. Without the delay when DIV is
-// adjusted the clock sometimes switches to very slow, once slow further DIV
-// adjustments do nothing and it's difficult to get out of this mode.
+// pwmControlBits:
+//	Set or clear one of the PWM0_ bits for a channel
 
-    *(clk + PWMCLK_CNTL) = BCM_PASSWORD | 0x01 ;	// Stop PWM Clock
-      delayMicroseconds (110) ;			// prevents clock going sloooow
+static int pwmControlBits (int channel, uint32_t bits, int on)
+{
+  volatile unsigned int *ctlr ;
 
-    while ((*(clk + PWMCLK_CNTL) & 0x80) != 0)	// Wait for clock to be !BUSY
-      delayMicroseconds (1) ;
+  if ((ctlr = pwmChannelCheck (channel)) == NULL)
+    return -1 ;
 
-    *(clk + PWMCLK_DIV)  = BCM_PASSWORD | (divisor << 12) ;
+  bits <<= (channel & 1) * 8 ;
 
-    *(clk + PWMCLK_CNTL) = BCM_PASSWORD | 0x11 ;	// Start PWM clock
-    *(pwm + PWM_CONTROL) = pwm_control ;		// restore PWM_CONTROL
+  pthread_mutex_lock (&pwmControlLock) ;
+    if (on)
+      *(ctlr + PWM_CONTROL) |=  bits ;
+    else
+      *(ctlr + PWM_CONTROL) &= ~bits ;
+  pthread_mutex_unlock (&pwmControlLock) ;
 
-    if (wiringPiDebug)
-      printf ("Set     to: %d. Now    : 0x%08X\n", divisor, *(clk + PWMCLK_DIV)) ;
-  }
+  return 0 ;
 }
 
 
 /*
- * gpioClockSet:
- *	Set the frequency on a GPIO clock pin
+ * pwmPinChannel:
+ *	Return the PWM channel of a pin, or -1 if it has none
  *********************************************************************************
  */
 
-void gpioClockSet (int pin, int freq)
+int pwmPinChannel (int pin)
 {
-  int divi, divr, divf ;
-
-  pin &= 63 ;
-
   /**/ if (wiringPiMode == WPI_MODE_PINS)
-    pin = pinToGpio [pin] ;
+    pin = ((pin >= 0) && (pin < 64)) ? pinToGpio [pin] : -1 ;
   else if (wiringPiMode == WPI_MODE_PHYS)
-    pin = physToGpio [pin] ;
+    pin = ((pin >= 0) && (pin < 64)) ? physToGpio [pin] : -1 ;
   else if (wiringPiMode != WPI_MODE_GPIO)
-    return ;
+    return -1 ;
 
-  divi = 19200000 / freq ;
-  divr = 19200000 % freq ;
-  divf = (int)((double)divr * 4096.0 / 19200000.0) ;
-
-  if (divi > 4095)
-    divi = 4095 ;
-
-  *(clk + gpioToClkCon [pin]) = BCM_PASSWORD | GPIO_CLOCK_SOURCE ;		// Stop GPIO Clock
-  while ((*(clk + gpioToClkCon [pin]) & 0x80) != 0)				// ... and wait
-    ;
-
-  *(clk + gpioToClkDiv [pin]) = BCM_PASSWORD | (divi << 12) | divf ;		// Set dividers
-  *(clk + gpioToClkCon [pin]) = BCM_PASSWORD | 0x10 | GPIO_CLOCK_SOURCE ;	// Start Clock
+  return gpioToPwmChannel (pin) ;
 }
 
 
 /*
- * wiringPiFindNode:
- *      Locate our device node
+ * pwmSetModeCh: pwmSetPolarityCh: pwmEnableCh:
+ *	Balanced or mark:space mode, inverted output and on/off for one
+ *	PWM channel, leaving the other channels as they are.
+ *	Return 0 or -1 with errno set.
  *********************************************************************************
  */
 
-struct wiringPiNodeStruct *wiringPiFindNode (int pin)
+int pwmSetModeCh (int channel, int mode)
 {
-  struct wiringPiNodeStruct *node = wiringPiNodes ;
+  if (brokered (WPI_BROKER_PWM_MODE_CH, channel, mode))
+    return 0 ;
 
-  while (node != NULL)
-    if ((pin >= node->pinBase) && (pin <= node->pinMax))
-      return node ;
-    else
-      node = node->next ;
+  if (rp1)
+    return rp1PwmSetMode (channel, mode) ;
 
-  return NULL ;
+  return pwmControlBits (channel, PWM0_MS_MODE, mode == PWM_MODE_MS) ;
 }
 
+int pwmSetPolarityCh (int channel, int invert)
+{
+  if (brokered (WPI_BROKER_PWM_POL_CH, channel, invert))
+    return 0 ;
 
-/*
- * wiringPiNewNode:
- *	Create a new GPIO node into the wiringPi handling system
- *********************************************************************************
- */
+  if (rp1)
+    return rp1PwmSetPolarity (channel, invert) ;
 
-static         void pinModeDummy             (UNU struct wiringPiNodeStruct *node, UNU int pin, UNU int mode)  { return ; }
-static         void pullUpDnControlDummy     (UNU struct wiringPiNodeStruct *node, UNU int pin, UNU int pud)   { return ; }
-static unsigned int digitalRead8Dummy        (UNU struct wiringPiNodeStruct *node, UNU int UNU pin)            { return 0 ; }
-static         void digitalWrite8Dummy       (UNU struct wiringPiNodeStruct *node, UNU int pin, UNU int value) { return ; }
-static          int digitalReadDummy         (UNU struct wiringPiNodeStruct *node, UNU int UNU pin)            { return LOW ; }
-static         void digitalWriteDummy        (UNU struct wiringPiNodeStruct *node, UNU int pin, UNU int value) { return ; }
-static         void pwmWriteDummy            (UNU struct wiringPiNodeStruct *node, UNU int pin, UNU int value) { return ; }
-static          int analogReadDummy          (UNU struct wiringPiNodeStruct *node, UNU int pin)            { return 0 ; }
-static         void analogWriteDummy         (UNU struct wiringPiNodeStruct *node, UNU int pin, UNU int value) { return ; }
+  return pwmControlBits (channel, PWM0_REVPOLAR, invert) ;
+}
 
-struct wiringPiNodeStruct *wiringPiNewNode (int pinBase, int numPins)
+int pwmEnableCh (int channel, int enable)
 {
-  int    pin ;
-  struct wiringPiNodeStruct *node ;
+  if (brokered (WPI_BROKER_PWM_EN_CH, channel, enable))
+    return 0 ;
 
-// Minimum pin base is 64
+  if (rp1)
+    return rp1PwmEnable (channel, enable) ;
 
-  if (pinBase < 64)
-    (void)wiringPiFailure (WPI_FATAL, "wiringPiNewNode: pinBase of %d is < 64\n", pinBase) ;
+  return pwmControlBits (channel, PWM0_ENABLE, enable) ;
+}
 
-// Check all pins in-case there is overlap:
 
-  for (pin = pinBase ; pin < (pinBase + numPins) ; ++pin)
-    if (wiringPiFindNode (pin) != NULL)
-      (void)wiringPiFailure (WPI_FATAL, "wiringPiNewNode: Pin %d overlaps with existing definition\n", pin) ;
+/*
+ * pwmSetRangeCh:
+ *	Set the range register of one PWM channel
+ *********************************************************************************
+ */
 
-  node = (struct wiringPiNodeStruct *)calloc (sizeof (struct wiringPiNodeStruct), 1) ;	// calloc zeros
-  if (node == NULL)
-    (void)wiringPiFailure (WPI_FATAL, "wiringPiNewNode: Unable to allocate memory: %s\n", strerror (errno)) ;
+int pwmSetRangeCh (int channel, unsigned int range)
+{
+  volatile unsigned int *ctlr ;
 
-  node->pinBase          = pinBase ;
-  node->pinMax           = pinBase + numPins - 1 ;
-  node->pinMode          = pinModeDummy ;
-  node->pullUpDnControl  = pullUpDnControlDummy ;
-  node->digitalRead      = digitalReadDummy ;
-//node->digitalRead8     = digitalRead8Dummy ;
-  node->digitalWrite     = digitalWriteDummy ;
-//node->digitalWrite8    = digitalWrite8Dummy ;
-  node->pwmWrite         = pwmWriteDummy ;
-  node->analogRead       = analogReadDummy ;
-  node->analogWrite      = analogWriteDummy ;
-  node->next             = wiringPiNodes ;
-  wiringPiNodes          = node ;
+  if (brokered (WPI_BROKER_PWM_RANGE_CH, channel, (int)range))
+    return 0 ;
 
-  return node ;
+  if (rp1)
+    return rp1PwmSetRange (channel, range) ;
+
+  if ((ctlr = pwmChannelCheck (channel)) == NULL)
+    return -1 ;
+
+  *(ctlr + ((channel & 1) ? PWM1_RANGE : PWM0_RANGE)) = range ;
+  delayMicroseconds (10) ;
+
+  return 0 ;
 }
 
 
-#ifdef notYetReady
 /*
- * pinED01:
- * pinED10:
- *	Enables edge-detect mode on a pin - from a 0 to a 1 or 1 to 0
- *	Pin must already be in input mode with appropriate pull up/downs set.
+ * pwmSetMode:
+ *	Select the native "balanced" mode, or standard mark:space mode
+ *	for all channels, and enable them.
  *********************************************************************************
  */
 
-void pinEnableED01Pi (int pin)
+void pwmSetMode (int mode)
 {
-  pin = pinToGpio [pin & 63] ;
+  int i ;
+
+  if (brokered (WPI_BROKER_PWM_MODE, 0, mode))
+    return ;
+
+  if (((wiringPiMode == WPI_MODE_PINS) || (wiringPiMode == WPI_MODE_PHYS) || (wiringPiMode == WPI_MODE_GPIO)) && rp1)
+  {
+    for (i = 0 ; i < 4 ; ++i)
+      if (rp1PwmSetMode (i, mode) == 0)
+	(void)rp1PwmEnable (i, TRUE) ;
+  }
+  else if ((wiringPiMode == WPI_MODE_PINS) || (wiringPiMode == WPI_MODE_PHYS) || (wiringPiMode == WPI_MODE_GPIO))
+  {
+    needPwm () ;
+    pthread_mutex_lock (&pwmControlLock) ;
+      for (i = 0 ; i < pwmControllers () ; ++i)
+	if (mode == PWM_MODE_MS)
+	  *(pwmController (i * 2) + PWM_CONTROL) = PWM0_ENABLE | PWM1_ENABLE | PWM0_MS_MODE | PWM1_MS_MODE ;
+	else
+	  *(pwmController (i * 2) + PWM_CONTROL) = PWM0_ENABLE | PWM1_ENABLE ;
+    pthread_mutex_unlock (&pwmControlLock) ;
+  }
 }
-#endif
 
 
 /*
- *********************************************************************************
- * Core Functions
+ * pwmSetRange:
+ *	Set the PWM range register. We set all the range registers to the
+ *	same value - use pwmSetRangeCh () for one channel.
  *********************************************************************************
  */
 
+void pwmSetRange (unsigned int range)
+{
+  int i ;
+
+  if ((wiringPiMode == WPI_MODE_PINS) || (wiringPiMode == WPI_MODE_PHYS) || (wiringPiMode == WPI_MODE_GPIO))
+    for (i = 0 ; i < pwmControllers () * 2 ; ++i)
+      pwmSetRangeCh (i, range) ;
+}
+
+
 /*
- * pinModeAlt:
- *	This is an un-documented special to let you set any pin to any mode
+ * Clock manager helpers
  *********************************************************************************
  */
 
-void pinModeAlt (int pin, int mode)
-{
-  int fSel, shift ;
+// Minimum DIVI for each MASH order
 
-  setupCheck ("pinModeAlt") ;
+static const int mashMinDivi [4] = { 1, 2, 3, 5 } ;
 
-  if ((pin & PI_GPIO_MASK) == 0)		// On-board pin
-  {
-    /**/ if (wiringPiMode == WPI_MODE_PINS)
-      pin = pinToGpio [pin] ;
-    else if (wiringPiMode == WPI_MODE_PHYS)
-      pin = physToGpio [pin] ;
-    else if (wiringPiMode != WPI_MODE_GPIO)
-      return ;
+static double clockSourceHz (int source)
+{
+  int is2711 = (piGpioBase == GPIO_PERI_BASE_2711) ;
+
+  /**/ if (source == WPI_CLOCK_OSC)
+    return is2711 ?  54000000.0 :  19200000.0 ;
+  else if (source == WPI_CLOCK_PLLD)
+    return is2711 ? 750000000.0 : 500000000.0 ;
+  else if (source == WPI_CLOCK_PLLC)
+    return 1000000000.0 ;
+  else
+    return -1.0 ;
+}
 
-    fSel  = gpioToGPFSEL [pin] ;
-    shift = gpioToShift  [pin] ;
+// clockWaitIdle:
+//	Wait for a stopped clock to go !BUSY - for up to 10mS, then kill it
+
+static int clockWaitIdle (int con)
+{
+  unsigned long long giveUp = nanos64 () + 10000000ULL ;
 
-    *(gpio + fSel) = (*(gpio + fSel) & ~(7 << shift)) | ((mode & 0x7) << shift) ;
+  while ((*(clk + con) & 0x80) != 0)
+  {
+    if (nanos64 () > giveUp)
+    {
+      *(clk + con) = BCM_PASSWORD | (*(clk + con) & 0x60F) | 0x20 ;	// KILL
+      delayMicroseconds (10) ;
+      *(clk + con) = BCM_PASSWORD | (*(clk + con) & 0x60F) ;
+      return ((*(clk + con) & 0x80) == 0) ? 0 : -1 ;
+    }
+    delayMicroseconds (1) ;
   }
+
+  return 0 ;
 }
 
 
 /*
- * pinMode:
- *	Sets the mode of a pin to be input, output or PWM output
+ * pwmSetClock:
+ *	Set/Change the PWM clock. Originally my code, but changed
+ *	(for the better!) by Chris Hall, <chris@kchall.plus.com>
+ *	after further study of the manual and testing with a 'scope
  *********************************************************************************
  */
 
-void pinMode (int pin, int mode)
+void pwmSetClock (int divisor)
 {
-  int    fSel, shift, alt ;
-  struct wiringPiNodeStruct *node = wiringPiNodes ;
-  int origPin = pin ;
+  uint32_t pwm_control [2] ;
+  int i ;
 
-  setupCheck ("pinMode") ;
+  if (divisor > 0)
+    pwmDivisor = divisor & 4095 ;
 
-  if ((pin & PI_GPIO_MASK) == 0)		// On-board pin
-  {
-    /**/ if (wiringPiMode == WPI_MODE_PINS)
-      pin = pinToGpio [pin] ;
-    else if (wiringPiMode == WPI_MODE_PHYS)
-      pin = physToGpio [pin] ;
-    else if (wiringPiMode != WPI_MODE_GPIO)
-      return ;
+  if (rp1)			// The kernel looks after the RP1's PWM clock
+    return ;
 
-    softPwmStop  (origPin) ;
-    softToneStop (origPin) ;
+  if (brokered (WPI_BROKER_PWM_CLOCK, 0, divisor))
+    return ;
 
-    fSel    = gpioToGPFSEL [pin] ;
-    shift   = gpioToShift  [pin] ;
+// The 2711 runs the PWM clock from its 54MHz oscillator rather than
+//	19.2MHz, so scale the divisor to keep the same PWM frequencies
 
-    /**/ if (mode == INPUT)
-      *(gpio + fSel) = (*(gpio + fSel) & ~(7 << shift)) ; // Sets bits to zero = input
-    else if (mode == OUTPUT)
-      *(gpio + fSel) = (*(gpio + fSel) & ~(7 << shift)) | (1 << shift) ;
-    else if (mode == SOFT_PWM_OUTPUT)
-      softPwmCreate (origPin, 0, 100) ;
-    else if (mode == SOFT_TONE_OUTPUT)
-      softToneCreate (origPin) ;
-    else if (mode == PWM_TONE_OUTPUT)
-    {
-      pinMode (origPin, PWM_OUTPUT) ;	// Call myself to enable PWM mode
-      pwmSetMode (PWM_MODE_MS) ;
-    }
-    else if (mode == PWM_OUTPUT)
-    {
-      if ((alt = gpioToPwmALT [pin]) == 0)	// Not a hardware capable PWM pin
-	return ;
+  if (piGpioBase == GPIO_PERI_BASE_2711)
+    divisor = (540 * divisor + 96) / 192 ;
 
-      usingGpioMemCheck ("pinMode PWM") ;
+  /**/ if (divisor > 4095)
+    divisor = 4095 ;
+  else if (divisor < 2)
+    divisor = 2 ;
 
-// Set pin to PWM mode
+  if ((wiringPiMode == WPI_MODE_PINS) || (wiringPiMode == WPI_MODE_PHYS) || (wiringPiMode == WPI_MODE_GPIO))
+  {
+    needPwm () ;
+    needClk () ;
 
-      *(gpio + fSel) = (*(gpio + fSel) & ~(7 << shift)) | (alt << shift) ;
-      delayMicroseconds (110) ;		// See comments in pwmSetClockWPi
+    if (wiringPiDebug)
+      printf ("Setting to: %d. Current: 0x%08X\n", divisor, *(clk + PWMCLK_DIV)) ;
 
-      pwmSetMode  (PWM_MODE_BAL) ;	// Pi default mode
-      pwmSetRange (1024) ;		// Default range of 1024
-      pwmSetClock (32) ;		// 19.2 / 32 = 600KHz - Also starts the PWM
-    }
-    else if (mode == GPIO_CLOCK)
-    {
-      if ((alt = gpioToGpClkALT0 [pin]) == 0)	// Not a GPIO_CLOCK pin
-	return ;
+// Both controllers run from the one PWM clock
 
-      usingGpioMemCheck ("pinMode CLOCK") ;
+    pthread_mutex_lock (&pwmControlLock) ;
 
-// Set pin to GPIO_CLOCK mode and set the clock frequency to 100KHz
+    for (i = 0 ; i < pwmControllers () ; ++i)
+      pwm_control [i] = *(pwmController (i * 2) + PWM_CONTROL) ;	// preserve PWM_CONTROL
 
-      *(gpio + fSel) = (*(gpio + fSel) & ~(7 << shift)) | (alt << shift) ;
-      delayMicroseconds (110) ;
-      gpioClockSet      (pin, 100000) ;
-    }
-  }
-  else
-  {
-    if ((node = wiringPiFindNode (pin)) != NULL)
-      node->pinMode (node, pin, mode) ;
-    return ;
-  }
-}
+// We need to stop PWM prior to stopping PWM clock in MS mode otherwise BUSY
+// stays high.
 
+    for (i = 0 ; i < pwmControllers () ; ++i)
+      *(pwmController (i * 2) + PWM_CONTROL) = 0 ;			// Stop PWM
 
-/*
- * pullUpDownCtrl:
- *	Control the internal pull-up/down resistors on a GPIO pin.
- *********************************************************************************
- */
+// Stop PWM clock before changing divisor. The delay after this does need to
+// this big (95uS occasionally fails, 100uS OK), it's almost as though the BUSY
+// flag is not working properly in balanced mode. Without the delay when DIV is
+// adjusted the clock sometimes switches to very slow, once slow further DIV
+// adjustments do nothing and it's difficult to get out of this mode.
 
-void pullUpDnControl (int pin, int pud)
-{
-  struct wiringPiNodeStruct *node = wiringPiNodes ;
+    *(clk + PWMCLK_CNTL) = BCM_PASSWORD | 0x01 ;	// Stop PWM Clock
+      delayMicroseconds (110) ;			// prevents clock going sloooow
 
-  setupCheck ("pullUpDnControl") ;
+    clockWaitIdle (PWMCLK_CNTL) ;
 
-  if ((pin & PI_GPIO_MASK) == 0)		// On-Board Pin
-  {
-    /**/ if (wiringPiMode == WPI_MODE_PINS)
-      pin = pinToGpio [pin] ;
-    else if (wiringPiMode == WPI_MODE_PHYS)
-      pin = physToGpio [pin] ;
-    else if (wiringPiMode != WPI_MODE_GPIO)
-      return ;
+    *(clk + PWMCLK_DIV)  = BCM_PASSWORD | (divisor << 12) ;
 
-    if (piGpioPupOffset == GPPUPPDN0)
-    {
-      // Pi 4B pull up/down method
-      int pullreg = GPPUPPDN0 + (pin>>4);
-      int pullshift = (pin & 0xf) << 1;
-      unsigned int pullbits;
-      unsigned int pull;
+    *(clk + PWMCLK_CNTL) = BCM_PASSWORD | 0x11 ;	// Start PWM clock
 
-      switch (pud)
-      {
-        case PUD_OFF: pull = 0; break;
-        case PUD_UP: pull = 1; break;
-        case PUD_DOWN: pull = 2; break;
-        default: return ; /* An illegal value */
-      }
+    for (i = 0 ; i < pwmControllers () ; ++i)
+      *(pwmController (i * 2) + PWM_CONTROL) = pwm_control [i] ;	// restore PWM_CONTROL
 
-      pullbits = *(gpio + pullreg);
-      pullbits &= ~(3 << pullshift);
-      pullbits |= (pull << pullshift);
-      *(gpio + pullreg) = pullbits;
-    }
-    else
-    {
-      // legacy pull up/down method
-      *(gpio + GPPUD)              = pud & 3 ;		delayMicroseconds (5) ;
-      *(gpio + gpioToPUDCLK [pin]) = 1 << (pin & 31) ;	delayMicroseconds (5) ;
+    pthread_mutex_unlock (&pwmControlLock) ;
 
-      *(gpio + GPPUD)              = 0 ;			delayMicroseconds (5) ;
-      *(gpio + gpioToPUDCLK [pin]) = 0 ;			delayMicroseconds (5) ;
-    }
-  }
-  else						// Extension module
-  {
-    if ((node = wiringPiFindNode (pin)) != NULL)
-      node->pullUpDnControl (node, pin, pud) ;
-    return ;
+    if (wiringPiDebug)
+      printf ("Set     to: %d. Now    : 0x%08X\n", divisor, *(clk + PWMCLK_DIV)) ;
   }
 }
 
 
 /*
- * digitalRead:
- *	Read the value of a given Pin, returning HIGH or LOW
+ * gpioClockSetFreq:
+ *	Set a GPIO clock pin to a frequency in Hz from one of the clock
+ *	sources - WPI_CLOCK_OSC, _PLLD or _PLLC, or WPI_CLOCK_ANY for the
+ *	closest from the oscillator or PLLD. mash is 0 for a plain integer
+ *	divisor, 1 to 3 for a fractional one with that order of MASH noise
+ *	shaping, or WPI_CLOCK_MASH_AUTO for integer if it's exact, else 1.
+ *	PLLC follows the core clock, so it's only used when asked for and
+ *	then only with a fixed core_freq.
+ *	Returns the frequency achieved, or -1.0
  *********************************************************************************
  */
 
-int digitalRead (int pin)
+// clockDivisor:
+//	Work out DIVI and DIVF for a source and MASH order. Returns what it
+//	will give, or -1.0 if it can't be done.
+
+static double clockDivisor (double srcHz, double freq, int mash, int *divi, int *divf)
 {
-  char c ;
-  struct wiringPiNodeStruct *node = wiringPiNodes ;
-  if ((pin & PI_GPIO_MASK) == 0)		// On-Board Pin
+  double div = srcHz / freq ;
+
+  if (mash == 0)
   {
-    /**/ if (wiringPiMode == WPI_MODE_GPIO_SYS)	// Sys mode
+    *divi = (int)(div + 0.5) ;
+    *divf = 0 ;
+  }
+  else
+  {
+    *divi = (int)div ;
+    *divf = (int)((div - *divi) * 4096.0 + 0.5) ;
+    if (*divf == 4096)
     {
-      if (sysFds [pin] == -1)
-	return LOW ;
-
-      lseek  (sysFds [pin], 0L, SEEK_SET) ;
-      read   (sysFds [pin], &c, 1) ;
-      return (c == '0') ? LOW : HIGH ;
+      ++*divi ;
+      *divf = 0 ;
     }
-    else if (wiringPiMode == WPI_MODE_PINS)
-      pin = pinToGpio [pin] ;
-    else if (wiringPiMode == WPI_MODE_PHYS)
-      pin = physToGpio [pin] ;
-    else if (wiringPiMode != WPI_MODE_GPIO)
-      return LOW ;
-
-    if ((*(gpio + gpioToGPLEV [pin]) & (1 << (pin & 31))) != 0)
-      return HIGH ;
-    else
-      return LOW ;
-  }
-  else
-  {
-    if ((node = wiringPiFindNode (pin)) == NULL)
-      return LOW ;
-    return node->digitalRead (node, pin) ;
   }
-}
 
+  if ((*divi < mashMinDivi [mash]) || (*divi > 4095))
+    return -1.0 ;
 
-/*
- * digitalRead8:
- *	Read 8-bits (a byte) from given start pin.
- *********************************************************************************
+  return srcHz / ((double)*divi + (double)*divf / 4096.0) ;
+}
 
-unsigned int digitalRead8 (int pin)
+double gpioClockSetFreq (int pin, double freq, int source, int mash)
 {
-  struct wiringPiNodeStruct *node = wiringPiNodes ;
+  static const int anySources [2] = { WPI_CLOCK_OSC, WPI_CLOCK_PLLD } ;
+  int    sources [2], numSources, mashes [2], numMashes ;
+  int    i, j, divi, divf, con ;
+  int    bestSrc = -1, bestMash = 0, bestDivi = 0, bestDivf = 0 ;
+  double got, best = -1.0 ;
 
-  if ((pin & PI_GPIO_MASK) == 0)		// On-Board Pin
-    return 0 ;
-  else
-  {
-    if ((node = wiringPiFindNode (pin)) == NULL)
-      return LOW ;
-    return node->digitalRead8 (node, pin) ;
-  }
-}
- */
+  pin &= 63 ;
 
+  /**/ if (wiringPiMode == WPI_MODE_PINS)
+    pin = pinToGpio [pin] ;
+  else if (wiringPiMode == WPI_MODE_PHYS)
+    pin = physToGpio [pin] ;
+  else if (wiringPiMode != WPI_MODE_GPIO)
+    return -1.0 ;
 
-/*
- * digitalWrite:
- *	Set an output bit
- *********************************************************************************
- */
+  if ((pin < 0) || (gpioToClkCon [pin] == (uint8_t)-1) || (freq <= 0.0) || (freq > 125000000.0) || (mash > 3))
+    return -1.0 ;
 
-void digitalWrite (int pin, int value)
-{
-  struct wiringPiNodeStruct *node = wiringPiNodes ;
+  if (usingGpioMem)
+    return (wpiBroker (WPI_BROKER_CLOCK_SET, pin, source, mash, freq, &got) == 0) ? got : -1.0 ;
 
-  if ((pin & PI_GPIO_MASK) == 0)		// On-Board Pin
+  if (source == WPI_CLOCK_ANY)
   {
-    /**/ if (wiringPiMode == WPI_MODE_GPIO_SYS)	// Sys mode
+    sources [0] = anySources [0] ;
+    sources [1] = anySources [1] ;
+    numSources  = 2 ;
+  }
+  else if (clockSourceHz (source) > 0.0)
+  {
+    sources [0] = source ;
+    numSources  = 1 ;
+  }
+  else
+    return -1.0 ;
+
+  if (mash == WPI_CLOCK_MASH_AUTO)
+  {
+    mashes [0] = 0 ;
+    mashes [1] = 1 ;
+    numMashes  = 2 ;
+  }
+  else if (mash >= 0)
+  {
+    mashes [0] = mash ;
+    numMashes  = 1 ;
+  }
+  else
+    return -1.0 ;
+
+// The closest wins; the first one tried on a tie - the oscillator and
+//	no MASH being the least jittery
+
+  for (i = 0 ; i < numSources ; ++i)
+    for (j = 0 ; j < numMashes ; ++j)
     {
-      if (sysFds [pin] != -1)
+      if ((got = clockDivisor (clockSourceHz (sources [i]), freq, mashes [j], &divi, &divf)) < 0.0)
+	continue ;
+
+      if ((bestSrc == -1) || (fabs (got - freq) < fabs (best - freq) - freq * 1e-12))
       {
-	if (value == LOW)
-	  write (sysFds [pin], "0\n", 2) ;
-	else
-	  write (sysFds [pin], "1\n", 2) ;
+	best     = got ;
+	bestSrc  = sources [i] ;
+	bestMash = mashes [j] ;
+	bestDivi = divi ;
+	bestDivf = divf ;
       }
-      return ;
     }
-    else if (wiringPiMode == WPI_MODE_PINS)
-      pin = pinToGpio [pin] ;
-    else if (wiringPiMode == WPI_MODE_PHYS)
-      pin = physToGpio [pin] ;
-    else if (wiringPiMode != WPI_MODE_GPIO)
-      return ;
 
-    if (value == LOW)
-      *(gpio + gpioToGPCLR [pin]) = 1 << (pin & 31) ;
-    else
-      *(gpio + gpioToGPSET [pin]) = 1 << (pin & 31) ;
-  }
-  else
-  {
-    if ((node = wiringPiFindNode (pin)) != NULL)
-      node->digitalWrite (node, pin, value) ;
-  }
-}
+  if (bestSrc == -1)
+    return -1.0 ;
 
+  needClk () ;
 
-/*
- * digitalWrite8:
- *	Set an output 8-bit byte on the device from the given pin number
- *********************************************************************************
+// Stop it, then change the source and MASH only while it's stopped
 
-void digitalWrite8 (int pin, int value)
-{
-  struct wiringPiNodeStruct *node = wiringPiNodes ;
+  con = gpioToClkCon [pin] ;
 
-  if ((pin & PI_GPIO_MASK) == 0)		// On-Board Pin
-    return ;
-  else
-  {
-    if ((node = wiringPiFindNode (pin)) != NULL)
-      node->digitalWrite8 (node, pin, value) ;
-  }
+  *(clk + con) = BCM_PASSWORD | (*(clk + con) & 0x60F) ;			// Stop GPIO Clock
+  if (clockWaitIdle (con) < 0)
+    return -1.0 ;
+
+  *(clk + con)                = BCM_PASSWORD | (bestMash << 9) | bestSrc ;
+  *(clk + gpioToClkDiv [pin]) = BCM_PASSWORD | (bestDivi << 12) | bestDivf ;	// Set dividers
+  *(clk + con)                = BCM_PASSWORD | (bestMash << 9) | 0x10 | bestSrc ;	// Start Clock
+
+  if (wiringPiDebug)
+    printf ("gpioClockSetFreq: %d: src %d, mash %d, divi %d, divf %d: %.3fHz\n", pin, bestSrc, bestMash, bestDivi, bestDivf, best) ;
+
+  return best ;
 }
- */
 
 
 /*
- * pwmWrite:
- *	Set an output PWM value
+ * gpioClockGet:
+ *	The frequency a GPIO clock pin is running at: 0 if it's stopped,
+ *	-1.0 if it's not a clock pin or on an unknown source.
  *********************************************************************************
  */
 
-void pwmWrite (int pin, int value)
+double gpioClockGet (int pin)
 {
-  struct wiringPiNodeStruct *node = wiringPiNodes ;
+  unsigned int ctl, div ;
+  double srcHz ;
 
-  setupCheck ("pwmWrite") ;
+  pin &= 63 ;
 
-  if ((pin & PI_GPIO_MASK) == 0)		// On-Board Pin
-  {
-    /**/ if (wiringPiMode == WPI_MODE_PINS)
-      pin = pinToGpio [pin] ;
-    else if (wiringPiMode == WPI_MODE_PHYS)
-      pin = physToGpio [pin] ;
-    else if (wiringPiMode != WPI_MODE_GPIO)
-      return ;
+  /**/ if (wiringPiMode == WPI_MODE_PINS)
+    pin = pinToGpio [pin] ;
+  else if (wiringPiMode == WPI_MODE_PHYS)
+    pin = physToGpio [pin] ;
+  else if (wiringPiMode != WPI_MODE_GPIO)
+    return -1.0 ;
 
-    usingGpioMemCheck ("pwmWrite") ;
-    *(pwm + gpioToPwmPort [pin]) = value ;
-  }
+  if ((pin < 0) || (gpioToClkCon [pin] == (uint8_t)-1))
+    return -1.0 ;
+
+  if (usingGpioMem)
+    return (wpiBroker (WPI_BROKER_CLOCK_GET, pin, 0, 0, 0.0, &srcHz) == 0) ? srcHz : -1.0 ;
+
+  needClk () ;
+
+  ctl = *(clk + gpioToClkCon [pin]) ;
+  div = *(clk + gpioToClkDiv [pin]) ;
+
+  if ((ctl & 0x10) == 0)
+    return 0.0 ;
+
+  if ((srcHz = clockSourceHz (ctl & 0x0F)) < 0.0)
+    return -1.0 ;
+
+  if (((ctl >> 9) & 3) == 0)
+    return srcHz / (double)((div >> 12) & 0xFFF) ;
   else
-  {
-    if ((node = wiringPiFindNode (pin)) != NULL)
-      node->pwmWrite (node, pin, value) ;
-  }
+    return srcHz / ((double)((div >> 12) & 0xFFF) + (double)(div & 0xFFF) / 4096.0) ;
 }
 
 
 /*
- * analogRead:
- *	Read the analog value of a given Pin.
- *	There is no on-board Pi analog hardware,
- *	so this needs to go to a new node.
+ * gpioClockSet:
+ *	Set the frequency on a GPIO clock pin - from the oscillator, with a
+ *	fractional divisor if an integer one won't do.
  *********************************************************************************
  */
 
-int analogRead (int pin)
+void gpioClockSet (int pin, int freq)
 {
-  struct wiringPiNodeStruct *node = wiringPiNodes ;
-
-  if ((node = wiringPiFindNode (pin)) == NULL)
-    return 0 ;
-  else
-    return node->analogRead (node, pin) ;
+  (void)gpioClockSetFreq (pin, (double)freq, WPI_CLOCK_OSC, WPI_CLOCK_MASH_AUTO) ;
 }
 
 
 /*
- * analogWrite:
- *	Write the analog value to the given Pin.
- *	There is no on-board Pi analog hardware,
- *	so this needs to go to a new node.
+ * nodeTable:
+ *	As well as the linked list (which is exported, so stays), keep an
+ *	array of the nodes sorted by pinBase. The pin ranges never overlap, so
+ *	finding the node for a pin is a binary search over this, and checking
+ *	a new node for overlap only needs to look at its neighbours.
+ *
+ *	Nodes can come and go while other threads are using them, so the table
+ *	is never changed in place: a new copy is made under nodeLock and
+ *	published with one atomic pointer store. Lookups take no lock - just a
+ *	read section, bracketed by nodeReadBegin () and nodeReadEnd (), which
+ *	only touches the thread's own counter. Before an old table or a
+ *	removed node is freed, nodeSynchronize () waits for every thread that
+ *	was inside a read section to leave it - by then nobody can still be
+ *	looking at it.
  *********************************************************************************
  */
 
-void analogWrite (int pin, int value)
+struct nodeTableStruct
 {
-  struct wiringPiNodeStruct *node = wiringPiNodes ;
+  int                        count ;
+  struct wiringPiNodeStruct *nodes [] ;
+} ;
 
-  if ((node = wiringPiFindNode (pin)) == NULL)
-    return ;
+static struct nodeTableStruct *nodeTable = NULL ;
+static pthread_mutex_t         nodeLock  = PTHREAD_MUTEX_INITIALIZER ;
 
-  node->analogWrite (node, pin, value) ;
-}
+// Each thread that has looked up a node has one of these - seq is odd
+//	while it's in a read section. They're on their own cache lines so
+//	the readers never share a line, and are re-used as threads come and go.
 
+struct nodeReaderStruct
+{
+  unsigned long            seq ;
+  int                      inUse ;
+  struct nodeReaderStruct *next ;
+} __attribute__ ((aligned (64))) ;
 
-/*
- * pwmToneWrite:
- *	Pi Specific.
- *      Output the given frequency on the Pi's PWM pin
- *********************************************************************************
- */
+static struct nodeReaderStruct *nodeReaders = NULL ;
+static pthread_key_t            nodeReaderKey ;
+static pthread_once_t           nodeReaderOnce = PTHREAD_ONCE_INIT ;
 
-void pwmToneWrite (int pin, int freq)
+static __thread struct nodeReaderStruct *myReader  = NULL ;
+static __thread int                      readDepth = 0 ;
+
+static void nodeReaderExit (void *arg)
+{
+  __atomic_store_n (&((struct nodeReaderStruct *)arg)->inUse, FALSE, __ATOMIC_RELEASE) ;
+}
+
+static void nodeReaderInit (void)
 {
-  int range ;
+  pthread_key_create (&nodeReaderKey, nodeReaderExit) ;
+}
 
-  setupCheck ("pwmToneWrite") ;
+static void __attribute__ ((noinline)) nodeReaderRegister (void)
+{
+  struct nodeReaderStruct *r ;
+  int unused = FALSE ;
 
-  if (freq == 0)
-    pwmWrite (pin, 0) ;             // Off
-  else
+  pthread_once (&nodeReaderOnce, nodeReaderInit) ;
+
+  for (r = __atomic_load_n (&nodeReaders, __ATOMIC_ACQUIRE) ; r != NULL ; r = r->next)
+    if (__atomic_compare_exchange_n (&r->inUse, &unused, TRUE, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+      break ;
+    else
+      unused = FALSE ;
+
+  if (r == NULL)
   {
-    range = 600000 / freq ;
-    pwmSetRange (range) ;
-    pwmWrite    (pin, freq / 2) ;
+    if (posix_memalign ((void **)&r, 64, sizeof (*r)) != 0)
+      (void)wiringPiFailure (WPI_FATAL, "wiringPi: Unable to allocate memory: %s\n", strerror (errno)) ;
+    r->seq   = 0 ;
+    r->inUse = TRUE ;
+    r->next  = __atomic_load_n (&nodeReaders, __ATOMIC_RELAXED) ;
+    while (!__atomic_compare_exchange_n (&nodeReaders, &r->next, r, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+      ;
   }
+
+  pthread_setspecific (nodeReaderKey, r) ;
+  myReader = r ;
+}
+
+static inline void nodeReadBegin (void)
+{
+  if (readDepth++ > 0)
+    return ;
+
+  if (myReader == NULL)
+    nodeReaderRegister () ;
+
+  __atomic_store_n (&myReader->seq, myReader->seq + 1, __ATOMIC_RELAXED) ;
+  __atomic_thread_fence (__ATOMIC_SEQ_CST) ;	// Seen to be inside before we look at the table
 }
 
+static inline void nodeReadEnd (void)
+{
+  if (--readDepth > 0)
+    return ;
+
+  __atomic_store_n (&myReader->seq, myReader->seq + 1, __ATOMIC_RELEASE) ;
+}
 
 
 /*
- * digitalWriteByte:
- * digitalReadByte:
- *	Pi Specific
- *	Write an 8-bit byte to the first 8 GPIO pins - try to do it as
- *	fast as possible.
- *	However it still needs 2 operations to set the bits, so any external
- *	hardware must not rely on seeing a change as there will be a change
- *	to set the outputs bits to zero, then another change to set the 1's
- *	Reading is just bit fiddling.
- *	These are wiringPi pin numbers 0..7, or BCM_GPIO pin numbers
- *	17, 18, 22, 23, 24, 24, 4 on a Pi v1 rev 0-3
- *	17, 18, 27, 23, 24, 24, 4 on a Pi v1 rev 3 onwards or B+, 2, 3, zero
+ * nodeSynchronize:
+ *	Wait for everyone who might have seen what we've just unpublished.
+ *	Not the calling thread, if it's in a read section itself.
  *********************************************************************************
  */
 
-void digitalWriteByte (const int value)
+static void nodeSynchronize (void)
 {
-  uint32_t pinSet = 0 ;
-  uint32_t pinClr = 0 ;
-  int mask = 1 ;
-  int pin ;
+  struct nodeReaderStruct *r ;
+  unsigned long seq ;
 
-  /**/ if (wiringPiMode == WPI_MODE_GPIO_SYS)
-  {
-    for (pin = 0 ; pin < 8 ; ++pin)
-    {
-      digitalWrite (pinToGpio [pin], value & mask) ;
-      mask <<= 1 ;
-    }
-    return ;
-  }
-  else
+  __atomic_thread_fence (__ATOMIC_SEQ_CST) ;
+
+  for (r = __atomic_load_n (&nodeReaders, __ATOMIC_ACQUIRE) ; r != NULL ; r = r->next)
   {
-    for (pin = 0 ; pin < 8 ; ++pin)
-    {
-      if ((value & mask) == 0)
-	pinClr |= (1 << pinToGpio [pin]) ;
-      else
-	pinSet |= (1 << pinToGpio [pin]) ;
+    if (r == myReader)
+      continue ;
 
-      mask <<= 1 ;
-    }
+    if (((seq = __atomic_load_n (&r->seq, __ATOMIC_ACQUIRE)) & 1) == 0)
+      continue ;
 
-    *(gpio + gpioToGPCLR [0]) = pinClr ;
-    *(gpio + gpioToGPSET [0]) = pinSet ;
+    while (__atomic_load_n (&r->seq, __ATOMIC_ACQUIRE) == seq)
+      sched_yield () ;
   }
 }
 
-unsigned int digitalReadByte (void)
+// nodeSlot:
+//	Return the index of the first node in the table with pinMax >= pin -
+//	i.e. the only node that could possibly hold pin - or count if none.
+
+static int nodeSlot (const struct nodeTableStruct *table, int pin)
 {
-  int pin, x ;
-  uint32_t raw ;
-  uint32_t data = 0 ;
+  int lo = 0 ;
+  int hi = (table == NULL) ? 0 : table->count ;
+  int mid ;
 
-  /**/ if (wiringPiMode == WPI_MODE_GPIO_SYS)
-  {
-    for (pin = 0 ; pin < 8 ; ++pin)
-    {
-      x = digitalRead (pinToGpio [pin]) ;
-      data = (data << 1) | x ;
-    }
-  }
-  else
+  while (lo < hi)
   {
-    raw = *(gpio + gpioToGPLEV [0]) ; // First bank for these pins
-    for (pin = 0 ; pin < 8 ; ++pin)
-    {
-      x = pinToGpio [pin] ;
-      data = (data << 1) | (((raw & (1 << x)) == 0) ? 0 : 1) ;
-    }
+    mid = (lo + hi) / 2 ;
+    if (table->nodes [mid]->pinMax < pin)
+      lo = mid + 1 ;
+    else
+      hi = mid ;
   }
-  return data ;
+  return lo ;
 }
 
 
 /*
- * digitalWriteByte2:
- * digitalReadByte2:
- *	Pi Specific
- *	Write an 8-bit byte to the second set of 8 GPIO pins. This is marginally
- *	faster than the first lot as these are consecutive BCM_GPIO pin numbers.
- *	However they overlap with the original read/write bytes.
+ * wiringPiNodeLazy: wiringPiNodeInit:
+ *	Drivers hand the part of their setup that talks to the device to
+ *	wiringPiNodeInit. Normally that just calls it, but in lazy mode
+ *	(wiringPiNodeLazy, or WIRINGPI_LAZY in the environment) it's left
+ *	until the first time anything looks the node up, so devices that
+ *	are described but never used cost nothing.
+ *	Returns what the init function does, or TRUE when it's put off.
  *********************************************************************************
  */
 
-void digitalWriteByte2 (const int value)
+static int             nodeLazy     = FALSE ;
+static pthread_mutex_t nodeInitLock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP ;
+static struct wiringPiNodeStruct *nodeIniting = NULL ;
+
+void wiringPiNodeLazy (int on)
 {
-  register int mask = 1 ;
-  register int pin ;
+  nodeLazy = on ;
+}
 
-  /**/ if (wiringPiMode == WPI_MODE_GPIO_SYS)
+int wiringPiNodeInit (struct wiringPiNodeStruct *node, int (*init)(struct wiringPiNodeStruct *node))
+{
+  node->init = init ;
+
+  if (!nodeLazy)
+    return init (node) ;
+
+  __atomic_fetch_or (&node->flags, WPI_NODE_INIT_PENDING, __ATOMIC_RELEASE) ;
+  return TRUE ;
+}
+
+// nodeLazyInit:
+//	Everybody else waits while it runs. The init function looking up
+//	its own pins gets straight back in.
+
+static void __attribute__ ((noinline)) nodeLazyInit (struct wiringPiNodeStruct *node)
+{
+  struct wiringPiNodeStruct *was ;
+
+  pthread_mutex_lock (&nodeInitLock) ;
+
+  if (((__atomic_load_n (&node->flags, __ATOMIC_ACQUIRE) & WPI_NODE_INIT_PENDING) != 0) && (nodeIniting != node))
   {
-    for (pin = 20 ; pin < 28 ; ++pin)
+    was         = nodeIniting ;
+    nodeIniting = node ;
+
+    if (!node->init (node))
+      (void)wiringPiFailure (WPI_ALMOST, "wiringPi: Unable to initialise the device at pin %d\n", node->pinBase) ;
+
+    nodeIniting = was ;
+    __atomic_fetch_and (&node->flags, ~WPI_NODE_INIT_PENDING, __ATOMIC_RELEASE) ;
+  }
+
+  pthread_mutex_unlock (&nodeInitLock) ;
+}
+
+
+/*
+ * wiringPiFindNode:
+ *      Locate our device node
+ *	The node can only go away through wiringPiNodeRemove (), and it's up
+ *	to whoever does that to make sure nobody's still using it outside
+ *	the core wiringPi calls.
+ *********************************************************************************
+ */
+
+WPI_TRACE_SEMAPHORE (node_dispatch) ;
+
+struct wiringPiNodeStruct *wiringPiFindNode (int pin)
+{
+  struct nodeTableStruct    *table ;
+  struct wiringPiNodeStruct *node = NULL ;
+  int slot ;
+
+  nodeReadBegin () ;
+
+  table = __atomic_load_n (&nodeTable, __ATOMIC_ACQUIRE) ;
+
+  if ((table != NULL) && ((slot = nodeSlot (table, pin)) < table->count))
+  {
+    node = table->nodes [slot] ;
+    if (pin < node->pinBase)
+      node = NULL ;
+  }
+
+  nodeReadEnd () ;
+
+  if (node != NULL)
+  {
+    if (__builtin_expect ((__atomic_load_n (&node->flags, __ATOMIC_ACQUIRE) & WPI_NODE_INIT_PENDING) != 0, FALSE))
+      nodeLazyInit (node) ;
+    if (__builtin_expect (statsOn, FALSE) && (node->stats != 0))
+      __atomic_fetch_add (&statsTable->nodes [node->stats - 1].calls, 1, __ATOMIC_RELAXED) ;
+    WPI_TRACE (node_dispatch, pin, node, node->pinBase) ;
+  }
+
+  return node ;
+}
+
+
+/*
+ * wiringPiNewNode:
+ *	Create a new GPIO node into the wiringPi handling system
+ *********************************************************************************
+ */
+
+static         void pinModeDummy             (UNU struct wiringPiNodeStruct *node, UNU int pin, UNU int mode)  { return ; }
+static         void pullUpDnControlDummy     (UNU struct wiringPiNodeStruct *node, UNU int pin, UNU int pud)   { return ; }
+static          int digitalReadDummy         (UNU struct wiringPiNodeStruct *node, UNU int UNU pin)            { return LOW ; }
+static         void digitalWriteDummy        (UNU struct wiringPiNodeStruct *node, UNU int pin, UNU int value) { return ; }
+static         void pwmWriteDummy            (UNU struct wiringPiNodeStruct *node, UNU int pin, UNU int value) { return ; }
+static          int analogReadDummy          (UNU struct wiringPiNodeStruct *node, UNU int pin)            { return 0 ; }
+static         void analogWriteDummy         (UNU struct wiringPiNodeStruct *node, UNU int pin, UNU int value) { return ; }
+
+// The multi-bit operations fall back to the node's single-pin ones, so
+//	every device gets them - drivers that can do better replace them.
+
+static unsigned int digitalReadBits (struct wiringPiNodeStruct *node, int pin, int bits)
+{
+  unsigned int value = 0 ;
+  int i ;
+
+  for (i = 0 ; (i < bits) && (pin + i <= node->pinMax) ; ++i)
+    if (node->digitalRead (node, pin + i) != LOW)
+      value |= (1 << i) ;
+
+  return value ;
+}
+
+static void digitalWriteMaskedBits (struct wiringPiNodeStruct *node, int pin, unsigned int value, unsigned int mask)
+{
+  int i ;
+
+  for (i = 0 ; (i < 32) && (pin + i <= node->pinMax) ; ++i)
+    if ((mask & (1u << i)) != 0)
+      node->digitalWrite (node, pin + i, ((value >> i) & 1) ? HIGH : LOW) ;
+}
+
+static unsigned int digitalRead8Bits         (struct wiringPiNodeStruct *node, int pin)            { return digitalReadBits (node, pin,  8) ; }
+static unsigned int digitalRead16Bits        (struct wiringPiNodeStruct *node, int pin)            { return digitalReadBits (node, pin, 16) ; }
+static         void digitalWrite8Bits        (struct wiringPiNodeStruct *node, int pin, int value) { digitalWriteMaskedBits (node, pin, value, 0x00FF) ; }
+static         void digitalWrite16Bits       (struct wiringPiNodeStruct *node, int pin, int value) { digitalWriteMaskedBits (node, pin, value, 0xFFFF) ; }
+
+static int analogReadMultiSingle (struct wiringPiNodeStruct *node, int pin, int *values, int count)
+{
+  int i ;
+
+  for (i = 0 ; i < count ; ++i)
+    values [i] = node->analogRead (node, pin) ;
+
+  return count ;
+}
+
+// The range ops: count consecutive pins from pin, all on the one node.
+//	Analog goes pin by pin, digital in 16 pin lumps through the node's
+//	digitalRead16 and digitalWriteMasked, so a driver with those gets
+//	its ranges in as few transactions for nothing.
+
+static int analogReadRangeSingle (struct wiringPiNodeStruct *node, int pin, int count, int *values)
+{
+  int i ;
+
+  for (i = 0 ; i < count ; ++i)
+    values [i] = node->analogRead (node, pin + i) ;
+
+  return count ;
+}
+
+static void analogWriteRangeSingle (struct wiringPiNodeStruct *node, int pin, int count, const int *values)
+{
+  int i ;
+
+  for (i = 0 ; i < count ; ++i)
+    node->analogWrite (node, pin + i, values [i]) ;
+}
+
+static int digitalReadRangeBits (struct wiringPiNodeStruct *node, int pin, int count, int *values)
+{
+  unsigned int bits ;
+  int i, n, done ;
+
+  for (done = 0 ; done < count ; done += n)
+  {
+    n    = (count - done > 16) ? 16 : count - done ;
+    bits = node->digitalRead16 (node, pin + done) ;
+    for (i = 0 ; i < n ; ++i)
+      values [done + i] = ((bits >> i) & 1) ? HIGH : LOW ;
+  }
+
+  return count ;
+}
+
+static void digitalWriteRangeBits (struct wiringPiNodeStruct *node, int pin, int count, const int *values)
+{
+  unsigned int bits ;
+  int i, n ;
+
+  for ( ; count > 0 ; pin += n, values += n, count -= n)
+  {
+    n    = (count > 16) ? 16 : count ;
+    bits = 0 ;
+    for (i = 0 ; i < n ; ++i)
+      if (values [i] != LOW)
+	bits |= 1u << i ;
+    node->digitalWriteMasked (node, pin, bits, (1u << n) - 1) ;
+  }
+}
+
+struct wiringPiNodeStruct *wiringPiNewNode (int pinBase, int numPins)
+{
+  int    slot, pin, count ;
+  struct wiringPiNodeStruct *node ;
+  struct nodeTableStruct    *oldTable, *newTable ;
+
+// Minimum pin base is 64
+
+  if (pinBase < 64)
+    (void)wiringPiFailure (WPI_FATAL, "wiringPiNewNode: pinBase of %d is < 64\n", pinBase) ;
+
+  pthread_mutex_lock (&nodeLock) ;
+
+// Check for overlap: Only the first node ending at or after our base can
+//	overlap us as the table is sorted and the ranges are disjoint
+
+  oldTable = nodeTable ;
+  count    = (oldTable == NULL) ? 0 : oldTable->count ;
+
+  slot = nodeSlot (oldTable, pinBase) ;
+  if ((slot < count) && (oldTable->nodes [slot]->pinBase <= (pinBase + numPins - 1)))
+  {
+    pin = (oldTable->nodes [slot]->pinBase > pinBase) ? oldTable->nodes [slot]->pinBase : pinBase ;
+    pthread_mutex_unlock (&nodeLock) ;
+    (void)wiringPiFailure (WPI_FATAL, "wiringPiNewNode: Pin %d overlaps with existing definition\n", pin) ;
+  }
+
+  node     = (struct wiringPiNodeStruct *)calloc (sizeof (struct wiringPiNodeStruct), 1) ;	// calloc zeros
+  newTable = (struct nodeTableStruct *)malloc (sizeof (struct nodeTableStruct) + (count + 1) * sizeof (node)) ;
+  if ((node == NULL) || (newTable == NULL))
+    (void)wiringPiFailure (WPI_FATAL, "wiringPiNewNode: Unable to allocate memory: %s\n", strerror (errno)) ;
+
+  node->pinBase          = pinBase ;
+  node->pinMax           = pinBase + numPins - 1 ;
+  node->pinMode          = pinModeDummy ;
+  node->pullUpDnControl  = pullUpDnControlDummy ;
+  node->digitalRead      = digitalReadDummy ;
+  node->digitalRead8     = digitalRead8Bits ;
+  node->digitalRead16    = digitalRead16Bits ;
+  node->digitalWrite     = digitalWriteDummy ;
+  node->digitalWrite8    = digitalWrite8Bits ;
+  node->digitalWrite16   = digitalWrite16Bits ;
+  node->digitalWriteMasked = digitalWriteMaskedBits ;
+  node->pwmWrite         = pwmWriteDummy ;
+  node->analogRead       = analogReadDummy ;
+  node->analogReadMulti  = analogReadMultiSingle ;
+  node->analogWrite      = analogWriteDummy ;
+  node->analogReadRange  = analogReadRangeSingle ;
+  node->analogWriteRange = analogWriteRangeSingle ;
+  node->digitalReadRange = digitalReadRangeBits ;
+  node->digitalWriteRange = digitalWriteRangeBits ;
+  node->next             = wiringPiNodes ;
+
+// A statistics slot, if there's one free
+
+  for (pin = 0 ; pin < WPI_STATS_NODES ; ++pin)
+    if (statsTable->nodes [pin].pinMax == 0)
     {
-      digitalWrite (pin, value & mask) ;
-      mask <<= 1 ;
+      statsTable->nodes [pin].pinBase = node->pinBase ;
+      statsTable->nodes [pin].calls   = 0 ;
+      __atomic_store_n (&statsTable->nodes [pin].pinMax, node->pinMax, __ATOMIC_RELEASE) ;
+      node->stats = pin + 1 ;
+      break ;
     }
-    return ;
+
+// Publish the new table and the list head, then wait for anyone still
+//	looking at the old table before freeing it
+
+  newTable->count = count + 1 ;
+  if (count > 0)
+  {
+    memcpy (&newTable->nodes [0],        &oldTable->nodes [0],    slot          * sizeof (node)) ;
+    memcpy (&newTable->nodes [slot + 1], &oldTable->nodes [slot], (count - slot) * sizeof (node)) ;
   }
-  else
+  newTable->nodes [slot] = node ;
+
+  __atomic_store_n (&wiringPiNodes, node,     __ATOMIC_RELEASE) ;
+  __atomic_store_n (&nodeTable,     newTable, __ATOMIC_RELEASE) ;
+
+  if (oldTable != NULL)
   {
-    *(gpio + gpioToGPCLR [0]) = (~value & 0xFF) << 20 ; // 0x0FF00000; ILJ > CHANGE: Old causes glitch
-    *(gpio + gpioToGPSET [0]) = ( value & 0xFF) << 20 ;
+    nodeSynchronize () ;
+    free (oldTable) ;
   }
+
+  pthread_mutex_unlock (&nodeLock) ;
+
+  return node ;
 }
 
-unsigned int digitalReadByte2 (void)
+
+/*
+ * wiringPiNodeRemove:
+ *	Take the node at pinBase out of wiringPi and free it, once no other
+ *	thread can be in the middle of a call to it. Anything the driver
+ *	itself holds - file descriptors, threads, its own tables - is left
+ *	alone; shut the device down first, and release any wpiPin handles
+ *	on its pins.
+ *	Returns 0 or -1 if there's no node there.
+ *********************************************************************************
+ */
+
+int wiringPiNodeRemove (int pinBase)
 {
-  int pin, x ;
-  uint32_t data = 0 ;
+  struct wiringPiNodeStruct *node, **link ;
+  struct nodeTableStruct    *oldTable, *newTable ;
+  int slot ;
 
-  /**/ if (wiringPiMode == WPI_MODE_GPIO_SYS)
+  wiringPiAsyncDisable (pinBase) ;
+
+  pthread_mutex_lock (&nodeLock) ;
+
+  oldTable = nodeTable ;
+  slot     = nodeSlot (oldTable, pinBase) ;
+
+  if ((oldTable == NULL) || (slot == oldTable->count) || (oldTable->nodes [slot]->pinBase != pinBase))
   {
-    for (pin = 20 ; pin < 28 ; ++pin)
+    pthread_mutex_unlock (&nodeLock) ;
+    return -1 ;
+  }
+
+  node = oldTable->nodes [slot] ;
+
+  if ((newTable = (struct nodeTableStruct *)malloc (sizeof (struct nodeTableStruct) + oldTable->count * sizeof (node))) == NULL)
+  {
+    pthread_mutex_unlock (&nodeLock) ;
+    return -1 ;
+  }
+
+  newTable->count = oldTable->count - 1 ;
+  memcpy (&newTable->nodes [0],    &oldTable->nodes [0],        slot                           * sizeof (node)) ;
+  memcpy (&newTable->nodes [slot], &oldTable->nodes [slot + 1], (oldTable->count - slot - 1) * sizeof (node)) ;
+
+// Unlink it from the list - its own next stays put for anyone walking
+//	past it right now
+
+  for (link = &wiringPiNodes ; *link != NULL ; link = &(*link)->next)
+    if (*link == node)
     {
-      x = digitalRead (pin) ;
-      data = (data << 1) | x ;
+      __atomic_store_n (link, node->next, __ATOMIC_RELEASE) ;
+      break ;
     }
-  }
+
+  __atomic_store_n (&nodeTable, newTable, __ATOMIC_RELEASE) ;
+
+  nodeSynchronize () ;
+  free (oldTable) ;
+  analogFilterFree (node) ;
+  if (node->stats != 0)
+    __atomic_store_n (&statsTable->nodes [node->stats - 1].pinMax, 0, __ATOMIC_RELEASE) ;
+  free (node) ;
+
+  pthread_mutex_unlock (&nodeLock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * wiringPiBegin:
+ * wiringPiCommit:
+ * wiringPiDeferred:
+ *	Between these, writes to extension nodes that can hold them (those
+ *	with a flush function) only update the node's shadow of its outputs.
+ *	wiringPiCommit then calls each node's flush once, so changing lots
+ *	of pins on a slow expander costs one bus transaction, not one per pin.
+ *	They nest, and work per thread - node drivers ask wiringPiDeferred ()
+ *	whether the calling thread is inside one (or wiringPiNodeDeferred ()
+ *	if they can do async writes too - see below.)
+ *********************************************************************************
+ */
+
+static __thread int deferDepth = 0 ;
+
+void wiringPiBegin (void)
+{
+  ++deferDepth ;
+}
+
+int wiringPiDeferred (void)
+{
+  return deferDepth > 0 ;
+}
+
+void wiringPiCommit (void)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if ((deferDepth == 0) || (--deferDepth > 0))
+    return ;
+
+  nodeReadBegin () ;
+    for (node = __atomic_load_n (&wiringPiNodes, __ATOMIC_ACQUIRE) ; node != NULL ; node = node->next)
+      if ((node->flush != NULL) && ((node->flags & WPI_NODE_INIT_PENDING) == 0))	// Nothing written yet
+	node->flush (node) ;
+  nodeReadEnd () ;
+}
+
+
+/*
+ * wiringPiNodeCacheOutputs:
+ *	Let the node at pinBase answer digitalRead on its output pins from
+ *	what was last written to them rather than reading the device - for
+ *	the drivers that keep an output shadow (mcp23017, mcp23s17, pcf8574)
+ *	Inputs still come from the device. Returns 0 or -1.
+ *********************************************************************************
+ */
+
+int wiringPiNodeCacheOutputs (int pinBase, int on)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if ((node = wiringPiFindNode (pinBase)) == NULL)
+    return -1 ;
+
+  if (on)
+    __atomic_fetch_or  (&node->flags,  WPI_NODE_CACHE_OUTPUTS, __ATOMIC_RELEASE) ;
   else
-    data = ((*(gpio + gpioToGPLEV [0])) >> 20) & 0xFF ; // First bank for these pins
+    __atomic_fetch_and (&node->flags, ~WPI_NODE_CACHE_OUTPUTS, __ATOMIC_RELEASE) ;
 
-  return data ;
+  return 0 ;
 }
 
 
 /*
- * waitForInterrupt:
- *	Pi Specific.
- *	Wait for Interrupt on a GPIO pin.
- *	This is actually done via the /sys/class/gpio interface regardless of
- *	the wiringPi access mode in-use. Maybe sometime it might get a better
- *	way for a bit more efficiency.
+ * Async nodes:
+ *	With wiringPiAsyncEnable () on a node, writes to it only ever update
+ *	the driver's shadow and return. A worker thread per bus - nodes given
+ *	the same bus number share one, so they're flushed in turn and never
+ *	fight over the bus - calls the node's flush when there's anything to
+ *	send, at most maxRate times a second. Everything written in between
+ *	goes together, and for a pin only the last value written gets there.
+ *	wiringPiAsyncFence () is for when the order matters: everything
+ *	written before it is out when it returns.
+ *
+ *	The node driver has to cope with its flush being called from another
+ *	thread: mcp23017, sr595 and drcNet do. Others just carry on writing
+ *	straight away.
  *********************************************************************************
  */
 
-int waitForInterrupt (int pin, int mS)
+#define	MAX_ASYNC_NODES	16
+#define	MAX_ASYNC_BUSES	8
+
+struct asyncBusStruct
 {
-  int fd, x ;
-  uint8_t c ;
-  struct pollfd polls ;
+  int                bus ;
+  unsigned long long periodNs ;
+  int                pending ;
+  pthread_t          thread ;
+  pthread_mutex_t    lock ;		// Pending and the wake-up
+  pthread_cond_t     wake ;
+  pthread_mutex_t    flushLock ;	// Held while flushing
+} ;
 
-  /**/ if (wiringPiMode == WPI_MODE_PINS)
-    pin = pinToGpio [pin] ;
-  else if (wiringPiMode == WPI_MODE_PHYS)
-    pin = physToGpio [pin] ;
+struct asyncNodeStruct
+{
+  struct wiringPiNodeStruct *node ;	// NULL if the slot is free
+  struct asyncBusStruct     *bus ;
+  int                        pending ;
+} ;
 
-  if ((fd = sysFds [pin]) == -1)
-    return -2 ;
+static struct asyncBusStruct  asyncBuses [MAX_ASYNC_BUSES] ;
+static struct asyncNodeStruct asyncNodes [MAX_ASYNC_NODES] ;
+static int                    numAsyncBuses = 0 ;
+static int                    numAsyncNodes = 0 ;
+static pthread_mutex_t        asyncLock = PTHREAD_MUTEX_INITIALIZER ;
 
-// Setup poll structure
+static struct asyncNodeStruct *asyncFind (struct wiringPiNodeStruct *node)
+{
+  int i, n = __atomic_load_n (&numAsyncNodes, __ATOMIC_ACQUIRE) ;
 
-  polls.fd     = fd ;
-  polls.events = POLLPRI | POLLERR ;
+  for (i = 0 ; i < n ; ++i)
+    if (__atomic_load_n (&asyncNodes [i].node, __ATOMIC_ACQUIRE) == node)
+      return &asyncNodes [i] ;
 
-// Wait for it ...
+  return NULL ;
+}
 
-  x = poll (&polls, 1, mS) ;
 
-// If no error, do a dummy read to clear the interrupt
-//	A one character read appars to be enough.
+/*
+ * asyncFlush:
+ *	Flush any node on the bus (or just the one) with writes waiting
+ *********************************************************************************
+ */
 
-  if (x > 0)
+static void asyncFlush (struct asyncBusStruct *bus, struct asyncNodeStruct *only)
+{
+  struct wiringPiNodeStruct *node ;
+  int i ;
+
+  pthread_mutex_lock (&bus->flushLock) ;
+
+  for (i = 0 ; i < numAsyncNodes ; ++i)
   {
-    lseek (fd, 0, SEEK_SET) ;	// Rewind
-    (void)read (fd, &c, 1) ;	// Read & clear
+    struct asyncNodeStruct *a = &asyncNodes [i] ;
+
+    if ((a->bus != bus) || ((only != NULL) && (a != only)))
+      continue ;
+
+    if ((node = __atomic_load_n (&a->node, __ATOMIC_ACQUIRE)) == NULL)
+      continue ;
+
+    if (__atomic_exchange_n (&a->pending, FALSE, __ATOMIC_ACQ_REL))
+      node->flush (node) ;
   }
 
-  return x ;
+  pthread_mutex_unlock (&bus->flushLock) ;
 }
 
 
 /*
- * interruptHandler:
- *	This is a thread and gets started to wait for the interrupt we're
- *	hoping to catch. It will call the user-function when the interrupt
- *	fires.
+ * asyncThread:
+ *	Wait for something to send, send it, then hold off until the next
+ *	slot so whatever comes in meanwhile goes in one go.
  *********************************************************************************
  */
 
-static void *interruptHandler (UNU void *arg)
+static void *asyncThread (void *arg)
 {
-  int myPin ;
-
-  (void)piHiPri (55) ;	// Only effective if we run as root
+  struct asyncBusStruct *bus = (struct asyncBusStruct *)arg ;
+  struct timespec next ;
 
-  myPin   = pinPass ;
-  pinPass = -1 ;
+  (void)piHiPri (50) ;
 
   for (;;)
-    if (waitForInterrupt (myPin, -1) > 0)
-      isrFunctions [myPin] () ;
+  {
+    pthread_mutex_lock (&bus->lock) ;
+      while (!bus->pending)
+	pthread_cond_wait (&bus->wake, &bus->lock) ;
+      bus->pending = FALSE ;
+    pthread_mutex_unlock (&bus->lock) ;
+
+    clock_gettime (CLOCK_MONOTONIC, &next) ;
+    asyncFlush (bus, NULL) ;
+
+    if (bus->periodNs == 0)
+      continue ;
+
+    next.tv_sec  += bus->periodNs / 1000000000ULL ;
+    next.tv_nsec += bus->periodNs % 1000000000ULL ;
+    if (next.tv_nsec >= 1000000000)
+    {
+      next.tv_nsec -= 1000000000 ;
+      ++next.tv_sec ;
+    }
+    while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+      ;
+  }
 
   return NULL ;
 }
 
 
 /*
- * wiringPiISR:
- *	Pi Specific.
- *	Take the details and create an interrupt handler that will do a call-
- *	back to the user supplied function.
+ * wiringPiNodeDeferred:
+ * wiringPiNodeChanged:
+ *	For node drivers: should a write to this node just go into the
+ *	shadow - inside wiringPiBegin, or an async node? If it was async, call
+ *	wiringPiNodeChanged () once the shadow's updated to get it sent.
  *********************************************************************************
  */
 
-int wiringPiISR (int pin, int mode, void (*function)(void))
+int wiringPiNodeDeferred (struct wiringPiNodeStruct *node)
 {
-  pthread_t threadId ;
-  const char *modeS ;
-  char fName   [64] ;
-  char  pinS [8] ;
-  pid_t pid ;
+  if (deferDepth > 0)
+    return TRUE ;
+
+  return (numAsyncNodes > 0) && (asyncFind (node) != NULL) ;
+}
+
+void wiringPiNodeChanged (struct wiringPiNodeStruct *node)
+{
+  struct asyncNodeStruct *a ;
+
+  if ((numAsyncNodes == 0) || ((a = asyncFind (node)) == NULL))
+    return ;
+
+  if (__atomic_exchange_n (&a->pending, TRUE, __ATOMIC_ACQ_REL))
+    return ;			// The worker already knows
+
+  pthread_mutex_lock (&a->bus->lock) ;
+    a->bus->pending = TRUE ;
+    pthread_cond_signal (&a->bus->wake) ;
+  pthread_mutex_unlock (&a->bus->lock) ;
+}
+
+
+/*
+ * wiringPiAsyncEnable:
+ *	Make writes to the node at pinBase asynchronous, flushed by the
+ *	worker for the given bus number at up to maxRate times a second
+ *	(0 for as fast as it can.) Returns 0 or -1.
+ *********************************************************************************
+ */
+
+int wiringPiAsyncEnable (int pinBase, int bus, int maxRate)
+{
+  struct wiringPiNodeStruct *node ;
+  struct asyncBusStruct *b = NULL ;
+  struct asyncNodeStruct *a = NULL ;
+  int i ;
+
+  if (((node = wiringPiFindNode (pinBase)) == NULL) || (node->flush == NULL) || (maxRate < 0))
+    return -1 ;
+
+  pthread_mutex_lock (&asyncLock) ;
+
+  if (asyncFind (node) != NULL)
+  {
+    pthread_mutex_unlock (&asyncLock) ;
+    return 0 ;
+  }
+
+// Find or start the bus worker
+
+  for (i = 0 ; i < numAsyncBuses ; ++i)
+    if (asyncBuses [i].bus == bus)
+      b = &asyncBuses [i] ;
+
+  if ((b == NULL) && (numAsyncBuses < MAX_ASYNC_BUSES))
+  {
+    b = &asyncBuses [numAsyncBuses] ;
+    memset (b, 0, sizeof (*b)) ;
+    b->bus      = bus ;
+    b->periodNs = (maxRate == 0) ? 0 : 1000000000ULL / maxRate ;
+    pthread_mutex_init (&b->lock,      NULL) ;
+    pthread_mutex_init (&b->flushLock, NULL) ;
+    pthread_cond_init  (&b->wake,      NULL) ;
+
+    if (pthread_create (&b->thread, NULL, asyncThread, b) != 0)
+      b = NULL ;
+    else
+    {
+      pthread_detach (b->thread) ;
+      ++numAsyncBuses ;
+    }
+  }
+
+// ... and a slot for the node
+
+  for (i = 0 ; (b != NULL) && (i < numAsyncNodes) ; ++i)
+    if (asyncNodes [i].node == NULL)
+      a = &asyncNodes [i] ;
+
+  if ((b != NULL) && (a == NULL) && (numAsyncNodes < MAX_ASYNC_NODES))
+    a = &asyncNodes [numAsyncNodes] ;
+
+  if (a == NULL)
+  {
+    pthread_mutex_unlock (&asyncLock) ;
+    return -1 ;
+  }
+
+  a->bus     = b ;
+  a->pending = FALSE ;
+  __atomic_store_n (&a->node, node, __ATOMIC_RELEASE) ;
+  if (a == &asyncNodes [numAsyncNodes])
+    __atomic_store_n (&numAsyncNodes, numAsyncNodes + 1, __ATOMIC_RELEASE) ;
+
+  pthread_mutex_unlock (&asyncLock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * wiringPiAsyncDisable:
+ *	Back to writing straight away, sending anything still waiting first
+ *********************************************************************************
+ */
+
+void wiringPiAsyncDisable (int pinBase)
+{
+  struct wiringPiNodeStruct *node ;
+  struct asyncNodeStruct *a ;
+
+  if ((node = wiringPiFindNode (pinBase)) == NULL)
+    return ;
+
+  pthread_mutex_lock (&asyncLock) ;
+
+  if ((a = asyncFind (node)) != NULL)
+  {
+    pthread_mutex_lock   (&a->bus->flushLock) ;
+      __atomic_store_n (&a->node, NULL, __ATOMIC_RELEASE) ;
+      node->flush (node) ;
+    pthread_mutex_unlock (&a->bus->flushLock) ;
+  }
+
+  pthread_mutex_unlock (&asyncLock) ;
+}
+
+
+/*
+ * wiringPiAsyncFence:
+ *	Don't return until everything written to the async node at pinBase
+ *	- or every async node, if pinBase is -1 - has been sent.
+ *********************************************************************************
+ */
+
+void wiringPiAsyncFence (int pinBase)
+{
+  struct wiringPiNodeStruct *node = NULL ;
+  struct asyncNodeStruct *a = NULL ;
+  int i ;
+
+  if (pinBase != -1)
+  {
+    if (((node = wiringPiFindNode (pinBase)) == NULL) || ((a = asyncFind (node)) == NULL))
+      return ;
+
+    asyncFlush (a->bus, a) ;
+    return ;
+  }
+
+  for (i = 0 ; i < numAsyncBuses ; ++i)
+    asyncFlush (&asyncBuses [i], NULL) ;
+}
+
+
+/*
+ * Flight recorder:
+ *	An always-on record of the last few thousand pin operations made by
+ *	each thread - pinMode, pullUpDnControl, digitalWrite, pwmWrite and
+ *	analogWrite, on- and off-board, and the multi-pin writes to nodes -
+ *	to look back at after something's gone wrong. Each thread gets its
+ *	own ring in shared memory that only it writes to, so a record is a
+ *	read of the CPU's counter and a few stores: no locks and no atomic
+ *	read-modify-writes. Ticks are turned into nS by whoever reads it.
+ *	The table is left in /dev/shm when the program ends - or crashes -
+ *	for gpio flight to dump.
+ *	Pin handles and the bank-mask calls don't come through here.
+ *********************************************************************************
+ */
+
+static struct wpiFlightTableStruct *flightTable   = NULL ;
+static struct wpiFlightRecordStruct *flightData   = NULL ;
+static int                          flightOn      = FALSE ;
+static pthread_mutex_t              flightLock    = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_key_t                flightKey ;
+
+static __thread struct wpiFlightRingStruct   *flightRing    = NULL ;
+static __thread struct wpiFlightRecordStruct *flightRecords = NULL ;
+static __thread int                           flightNoRing  = FALSE ;
+
+static inline unsigned long long flightTicks (void)
+{
+#if defined(__aarch64__)
+  unsigned long long t ;
+  __asm__ __volatile__ ("mrs %0, cntvct_el0" : "=r" (t)) ;
+  return t ;
+#elif defined(__arm__) && (__ARM_ARCH >= 7)
+  unsigned long long t ;
+  __asm__ __volatile__ ("mrrc p15, 1, %Q0, %R0, c14" : "=r" (t)) ;
+  return t ;
+#elif defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc () ;
+#else
+  return nanos64 () ;
+#endif
+}
+
+static void flightExit (void *ring)
+{
+  __atomic_store_n (&((struct wpiFlightRingStruct *)ring)->state, WPI_FLIGHT_EXITED, __ATOMIC_RELEASE) ;
+}
+
+// flightClaim:
+//	Give the calling thread a ring: a free one, or failing that the ring
+//	of a thread that's gone.
+
+static int flightClaim (void)
+{
+  static const int wants [2] = { WPI_FLIGHT_FREE, WPI_FLIGHT_EXITED } ;
+  struct wpiFlightRingStruct *r = NULL ;
+  int i, j ;
+
+  if (flightNoRing)
+    return FALSE ;
+
+  pthread_mutex_lock (&flightLock) ;
+    for (j = 0 ; (j < 2) && (r == NULL) ; ++j)
+      for (i = 0 ; i < WPI_FLIGHT_THREADS ; ++i)
+	if (flightTable->ring [i].state == wants [j])
+	{
+	  r = &flightTable->ring [i] ;
+	  break ;
+	}
+
+    if (r != NULL)
+    {
+      r->tid   = (int)syscall (SYS_gettid) ;
+      r->head  = 0 ;
+      r->state = WPI_FLIGHT_LIVE ;
+      flightRecords = flightData + (r - flightTable->ring) * flightTable->records ;
+      flightRing    = r ;
+      pthread_setspecific (flightKey, r) ;
+    }
+    else
+      flightNoRing = TRUE ;
+  pthread_mutex_unlock (&flightLock) ;
+
+  return r != NULL ;
+}
+
+static void __attribute__ ((noinline)) flightAdd (int pin, int op, int value)
+{
+  struct wpiFlightRecordStruct *rec ;
+  unsigned long long head ;
+
+  if ((flightRing == NULL) && !flightClaim ())
+    return ;
+
+  head       = flightRing->head ;
+  rec        = &flightRecords [head & (flightTable->records - 1)] ;
+  rec->ticks = flightTicks () ;
+  rec->pin   = pin ;
+  rec->op    = op ;
+  rec->value = value ;
+  __atomic_store_n (&flightRing->head, head + 1, __ATOMIC_RELEASE) ;
+}
+
+static inline void flightRecord (int pin, int op, int value)
+{
+  if (__builtin_expect (flightOn, FALSE))
+    flightAdd (pin, op, value) ;
+}
+
+
+/*
+ * wiringPiFlightRecorder:
+ *	Start recording, with a ring of at least the given number of records
+ *	for each thread (0 stops it again), in WPI_FLIGHT_SHM with our pid.
+ *	The size is fixed the first time.
+ *	Returns 0 or -1.
+ *********************************************************************************
+ */
+
+int wiringPiFlightRecorder (unsigned int records)
+{
+  struct wpiFlightTableStruct *table ;
+  unsigned long long t0, n0 ;
+  char   name [64] ;
+  size_t size ;
+  int    fd ;
+
+  if (records == 0)
+  {
+    __atomic_store_n (&flightOn, FALSE, __ATOMIC_RELEASE) ;
+    return 0 ;
+  }
+
+  pthread_mutex_lock (&flightLock) ;
+
+  if (flightTable == NULL)
+  {
+    records = (records < 64) ? 64 : 1u << (32 - __builtin_clz (records - 1)) ;
+    size    = sizeof (*table) + (size_t)WPI_FLIGHT_THREADS * records * sizeof (struct wpiFlightRecordStruct) ;
+
+    snprintf (name, sizeof (name), WPI_FLIGHT_SHM, (int)getpid ()) ;
+
+    if ((fd = shm_open (name, O_CREAT | O_RDWR | O_TRUNC, 0644)) < 0)
+    {
+      pthread_mutex_unlock (&flightLock) ;
+      return -1 ;
+    }
+
+    if (ftruncate (fd, size) < 0)
+      table = MAP_FAILED ;
+    else
+      table = (struct wpiFlightTableStruct *)mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) ;
+    close (fd) ;
+
+    if (table == MAP_FAILED)
+    {
+      shm_unlink (name) ;
+      pthread_mutex_unlock (&flightLock) ;
+      return -1 ;
+    }
+
+// Find the tick rate against nanos64 ()
+
+    t0 = flightTicks () ; n0 = nanos64 () ;
+    delayUntilNanos (n0 + 10000000ULL) ;
+    table->tickHz   = (flightTicks () - t0) * 1000000000ULL / (nanos64 () - n0) ;
+    table->tickBase = t0 ;
+    table->nsBase   = n0 ;
+
+    table->pid     = getpid () ;
+    table->records = records ;
+    table->threads = WPI_FLIGHT_THREADS ;
+    table->magic   = WPI_FLIGHT_MAGIC ;
+
+    pthread_key_create (&flightKey, flightExit) ;
+    flightData  = (struct wpiFlightRecordStruct *)(table + 1) ;
+    flightTable = table ;
+  }
+
+  pthread_mutex_unlock (&flightLock) ;
+
+  __atomic_store_n (&flightOn, TRUE, __ATOMIC_RELEASE) ;
+  return 0 ;
+}
+
+
+/*
+ *********************************************************************************
+ * Core Functions
+ *********************************************************************************
+ */
+
+/*
+ * pinModeAlt:
+ *	This is an un-documented special to let you set any pin to any mode
+ *********************************************************************************
+ */
+
+void pinModeAlt (int pin, int mode)
+{
+  int fSel, shift ;
+
+  setupCheck ("pinModeAlt") ;
+
+  if ((pin & PI_GPIO_MASK) == 0)		// On-board pin
+  {
+    /**/ if (wiringPiMode == WPI_MODE_PINS)
+      pin = pinToGpio [pin] ;
+    else if (wiringPiMode == WPI_MODE_PHYS)
+      pin = physToGpio [pin] ;
+    else if (wiringPiMode != WPI_MODE_GPIO)
+      return ;
+
+    if (rp1)
+    {
+      rp1PinModeAlt (pin, mode) ;
+      return ;
+    }
+
+    fSel  = gpioToGPFSEL [pin] ;
+    shift = gpioToShift  [pin] ;
+
+    wpiConfigLock (WPI_CONFIG_FSEL (fSel)) ;
+      *(gpio + fSel) = (*(gpio + fSel) & ~(7 << shift)) | ((mode & 0x7) << shift) ;
+    wpiConfigUnlock (WPI_CONFIG_FSEL (fSel)) ;
+  }
+}
+
+
+/*
+ * pinMode:
+ *	Sets the mode of a pin to be input, output or PWM output
+ *********************************************************************************
+ */
+
+void pinMode (int pin, int mode)
+{
+  int    fSel, shift, alt ;
+  struct wiringPiNodeStruct *node = wiringPiNodes ;
+  int origPin = pin ;
+
+  setupCheck ("pinMode") ;
+  flightRecord (pin, WPI_FLIGHT_MODE, mode) ;
+
+  if ((pin & PI_GPIO_MASK) == 0)		// On-board pin
+  {
+    /**/ if (wiringPiMode == WPI_MODE_GPIO_SYS)	// Sys mode
+    {
+      if (useGpioChip && (sysFds [pin] == -1) && ((mode == INPUT) || (mode == OUTPUT)))
+	(void)chipLine (pin, mode, -1, (mode == OUTPUT) ? INT_EDGE_SETUP : ((isrEdge [pin] != 0) ? isrEdge [pin] : -1)) ;
+      return ;
+    }
+    else if (wiringPiMode == WPI_MODE_PINS)
+      pin = pinToGpio [pin] ;
+    else if (wiringPiMode == WPI_MODE_PHYS)
+      pin = physToGpio [pin] ;
+    else if (wiringPiMode != WPI_MODE_GPIO)
+      return ;
+
+    softPwmStop  (origPin) ;
+    softToneStop (origPin) ;
+
+    fSel    = gpioToGPFSEL [pin] ;
+    shift   = gpioToShift  [pin] ;
+
+    /**/ if (rp1 && ((mode == INPUT) || (mode == OUTPUT)))
+      rp1PinMode (pin, mode) ;
+    else if (mode == INPUT)
+    {
+      wpiConfigLock (WPI_CONFIG_FSEL (fSel)) ;
+	*(gpio + fSel) = (*(gpio + fSel) & ~(7 << shift)) ; // Sets bits to zero = input
+      wpiConfigUnlock (WPI_CONFIG_FSEL (fSel)) ;
+    }
+    else if (mode == OUTPUT)
+    {
+      wpiConfigLock (WPI_CONFIG_FSEL (fSel)) ;
+	*(gpio + fSel) = (*(gpio + fSel) & ~(7 << shift)) | (1 << shift) ;
+      wpiConfigUnlock (WPI_CONFIG_FSEL (fSel)) ;
+    }
+    else if (mode == SOFT_PWM_OUTPUT)
+      softPwmCreate (origPin, 0, 100) ;
+    else if (mode == SOFT_TONE_OUTPUT)
+      softToneCreate (origPin) ;
+    else if (mode == PWM_TONE_OUTPUT)
+    {
+      pinMode (origPin, PWM_OUTPUT) ;	// Call myself to enable PWM mode
+      pwmSetMode (PWM_MODE_MS) ;
+    }
+    else if ((mode == PWM_OUTPUT) && rp1)
+    {
+      if (brokered (WPI_BROKER_PIN_MODE, pin, mode))
+	return ;
+
+      usingGpioMemCheck ("pinMode PWM") ;
+
+      if (rp1PwmPin (pin) < 0)		// Not a hardware capable PWM pin
+	return ;
+
+      pwmSetMode  (PWM_MODE_BAL) ;
+      pwmSetRange (1024) ;
+    }
+    else if (mode == PWM_OUTPUT)
+    {
+      if ((alt = gpioToPwmALT [pin]) == 0)	// Not a hardware capable PWM pin
+	return ;
+
+      if (brokered (WPI_BROKER_PIN_MODE, pin, mode))
+	return ;
+
+      usingGpioMemCheck ("pinMode PWM") ;
+
+// Set pin to PWM mode
+
+      wpiConfigLock (WPI_CONFIG_FSEL (fSel)) ;
+	*(gpio + fSel) = (*(gpio + fSel) & ~(7 << shift)) | (alt << shift) ;
+      wpiConfigUnlock (WPI_CONFIG_FSEL (fSel)) ;
+      delayMicroseconds (110) ;		// See comments in pwmSetClockWPi
+
+      pwmSetMode  (PWM_MODE_BAL) ;	// Pi default mode
+      pwmSetRange (1024) ;		// Default range of 1024
+      pwmSetClock (32) ;		// 19.2 / 32 = 600KHz - Also starts the PWM
+    }
+    else if (mode == GPIO_CLOCK)
+    {
+      if (rp1 || ((alt = gpioToGpClkALT0 [pin]) == 0))	// Not a GPIO_CLOCK pin
+	return ;
+
+      if (brokered (WPI_BROKER_PIN_MODE, pin, mode))
+	return ;
+
+      usingGpioMemCheck ("pinMode CLOCK") ;
+
+// Set pin to GPIO_CLOCK mode and set the clock frequency to 100KHz
+
+      wpiConfigLock (WPI_CONFIG_FSEL (fSel)) ;
+	*(gpio + fSel) = (*(gpio + fSel) & ~(7 << shift)) | (alt << shift) ;
+      wpiConfigUnlock (WPI_CONFIG_FSEL (fSel)) ;
+      delayMicroseconds (110) ;
+      gpioClockSet      (pin, 100000) ;
+    }
+  }
+  else
+  {
+    nodeReadBegin () ;
+      if ((node = wiringPiFindNode (pin)) != NULL)
+	node->pinMode (node, pin, mode) ;
+    nodeReadEnd () ;
+  }
+}
+
+
+/*
+ * pullUpDownCtrl:
+ *	Control the internal pull-up/down resistors on a GPIO pin.
+ *********************************************************************************
+ */
+
+void pullUpDnControl (int pin, int pud)
+{
+  struct wiringPiNodeStruct *node = wiringPiNodes ;
+
+  setupCheck ("pullUpDnControl") ;
+  flightRecord (pin, WPI_FLIGHT_PUD, pud) ;
+
+  if ((pin & PI_GPIO_MASK) == 0)		// On-Board Pin
+  {
+    /**/ if (wiringPiMode == WPI_MODE_GPIO_SYS)	// Sys mode - bias needs a direction
+    {
+      if (useGpioChip && (sysFds [pin] == -1))
+	(void)chipLine (pin, ((lineFds [pin] == -1) || (lineMode [pin] == -1)) ? INPUT : -1, pud, -1) ;
+      return ;
+    }
+    else if (wiringPiMode == WPI_MODE_PINS)
+      pin = pinToGpio [pin] ;
+    else if (wiringPiMode == WPI_MODE_PHYS)
+      pin = physToGpio [pin] ;
+    else if (wiringPiMode != WPI_MODE_GPIO)
+      return ;
+
+    if (rp1)
+      rp1PullUpDnControl (pin, pud) ;
+    else if (piGpioPupOffset == GPPUPPDN0)
+    {
+      // Pi 4B pull up/down method
+      int pullreg = GPPUPPDN0 + (pin>>4);
+      int pullshift = (pin & 0xf) << 1;
+      unsigned int pullbits;
+      unsigned int pull;
+
+      switch (pud)
+      {
+        case PUD_OFF: pull = 0; break;
+        case PUD_UP: pull = 1; break;
+        case PUD_DOWN: pull = 2; break;
+        default: return ; /* An illegal value */
+      }
+
+      wpiConfigLock (WPI_CONFIG_PULL (pin >> 4)) ;
+      pullbits = *(gpio + pullreg);
+      pullbits &= ~(3 << pullshift);
+      pullbits |= (pull << pullshift);
+      *(gpio + pullreg) = pullbits;
+      wpiConfigUnlock (WPI_CONFIG_PULL (pin >> 4)) ;
+    }
+    else
+    {
+      // legacy pull up/down method
+      wpiConfigLock (WPI_CONFIG_PUD) ;
+      *(gpio + GPPUD)              = pud & 3 ;		delayMicroseconds (5) ;
+      *(gpio + gpioToPUDCLK [pin]) = 1 << (pin & 31) ;	delayMicroseconds (5) ;
+
+      *(gpio + GPPUD)              = 0 ;			delayMicroseconds (5) ;
+      *(gpio + gpioToPUDCLK [pin]) = 0 ;			delayMicroseconds (5) ;
+      wpiConfigUnlock (WPI_CONFIG_PUD) ;
+    }
+  }
+  else						// Extension module
+  {
+    nodeReadBegin () ;
+      if ((node = wiringPiFindNode (pin)) != NULL)
+	node->pullUpDnControl (node, pin, pud) ;
+    nodeReadEnd () ;
+  }
+}
+
+
+/*
+ * digitalRead:
+ *	Read the value of a given Pin, returning HIGH or LOW
+ *********************************************************************************
+ */
+
+int digitalRead (int pin)
+{
+  char c ;
+  uint64_t value ;
+  int image ;
+  struct wiringPiNodeStruct *node = wiringPiNodes ;
+
+  statsPin (pin, FALSE) ;
+
+  if ((pin & PI_GPIO_MASK) == 0)		// On-Board Pin
+  {
+    /**/ if (wiringPiMode == WPI_MODE_GPIO_SYS)	// Sys mode
+    {
+      if (wpiImageOn && ((image = wpiImageLevel (pin)) >= 0))
+	return image ;
+
+      if (sysFds [pin] == -1)
+      {
+	if (!useGpioChip || (chipLine (pin, -1, -1, -1) == -1))
+	  return LOW ;
+	if (gpioChipGet (lineFds [pin], 1, &value) < 0)
+	  return LOW ;
+	return (value & 1) ? HIGH : LOW ;
+      }
+
+      lseek  (sysFds [pin], 0L, SEEK_SET) ;
+      read   (sysFds [pin], &c, 1) ;
+      return (c == '0') ? LOW : HIGH ;
+    }
+    else if (wiringPiMode == WPI_MODE_PINS)
+      pin = pinToGpio [pin] ;
+    else if (wiringPiMode == WPI_MODE_PHYS)
+      pin = physToGpio [pin] ;
+    else if (wiringPiMode != WPI_MODE_GPIO)
+      return LOW ;
+
+    if (wpiImageOn && ((image = wpiImageLevel (pin)) >= 0))
+      return image ;
+
+    if ((*gpioLev [pin >> 5] & (1 << (pin & 31))) != 0)
+      return HIGH ;
+    else
+      return LOW ;
+  }
+  else
+  {
+    int value = LOW ;
+
+    if (wpiImageOn && ((image = wpiImageExt (pin)) >= 0))
+      return image ;
+
+    nodeReadBegin () ;
+      if ((node = wiringPiFindNode (pin)) != NULL)
+	value = node->digitalRead (node, pin) ;
+    nodeReadEnd () ;
+
+    return value ;
+  }
+}
+
+
+/*
+ * digitalRead8:
+ * digitalRead16:
+ *	Read 8 or 16 bits from the given start pin, which is bit 0 of the
+ *	result. Device nodes can do this in one bus transaction, on-board
+ *	pins are simply read one at a time.
+ *********************************************************************************
+ */
+
+static unsigned int digitalReadN (int pin, int bits)
+{
+  struct wiringPiNodeStruct *node ;
+  unsigned int value = 0 ;
+  int i ;
+
+  if ((pin & PI_GPIO_MASK) == 0)		// On-Board Pin
+  {
+    for (i = 0 ; (i < bits) && ((pin + i) < 64) ; ++i)
+      if (digitalRead (pin + i) != LOW)
+	value |= (1 << i) ;
+    return value ;
+  }
+
+  nodeReadBegin () ;
+    if ((node = wiringPiFindNode (pin)) != NULL)
+      value = (bits == 8) ? node->digitalRead8 (node, pin) : node->digitalRead16 (node, pin) ;
+  nodeReadEnd () ;
+
+  return value ;
+}
+
+unsigned int digitalRead8  (int pin) { return digitalReadN (pin,  8) ; }
+unsigned int digitalRead16 (int pin) { return digitalReadN (pin, 16) ; }
+
+
+/*
+ * digitalWrite:
+ *	Set an output bit
+ *********************************************************************************
+ */
+
+void digitalWrite (int pin, int value)
+{
+  struct wiringPiNodeStruct *node = wiringPiNodes ;
+
+  flightRecord (pin, WPI_FLIGHT_WRITE, value) ;
+  statsPin     (pin, TRUE) ;
+
+  if ((pin & PI_GPIO_MASK) == 0)		// On-Board Pin
+  {
+    /**/ if (wiringPiMode == WPI_MODE_GPIO_SYS)	// Sys mode
+    {
+      if (sysFds [pin] != -1)
+      {
+	if (value == LOW)
+	  write (sysFds [pin], "0\n", 2) ;
+	else
+	  write (sysFds [pin], "1\n", 2) ;
+      }
+      else if (useGpioChip && (chipLine (pin, OUTPUT, -1, INT_EDGE_SETUP) != -1))
+	gpioChipSet (lineFds [pin], 1, (value == LOW) ? 0 : 1) ;
+      return ;
+    }
+    else if (wiringPiMode == WPI_MODE_PINS)
+      pin = pinToGpio [pin] ;
+    else if (wiringPiMode == WPI_MODE_PHYS)
+      pin = physToGpio [pin] ;
+    else if (wiringPiMode != WPI_MODE_GPIO)
+      return ;
+
+    if (value == LOW)
+      *gpioClr [pin >> 5] = 1 << (pin & 31) ;
+    else
+      *gpioSet [pin >> 5] = 1 << (pin & 31) ;
+
+    if (simulating)
+      simGpioApply () ;
+  }
+  else
+  {
+    nodeReadBegin () ;
+      if ((node = wiringPiFindNode (pin)) != NULL)
+	node->digitalWrite (node, pin, value) ;
+    nodeReadEnd () ;
+  }
+}
+
+
+/*
+ * digitalWrite8:
+ * digitalWrite16:
+ * digitalWriteMasked:
+ *	Set 8, 16 or (with a mask) up to 32 outputs starting at the given pin,
+ *	which takes bit 0 of the value. The masked write only changes the
+ *	pins whose mask bits are set.
+ *********************************************************************************
+ */
+
+void digitalWriteMasked (int pin, unsigned int value, unsigned int mask)
+{
+  struct wiringPiNodeStruct *node ;
+  int i ;
+
+  if ((pin & PI_GPIO_MASK) == 0)		// On-Board Pin
+  {
+    for (i = 0 ; (i < 32) && ((pin + i) < 64) ; ++i)
+      if ((mask & (1u << i)) != 0)
+	digitalWrite (pin + i, ((value >> i) & 1) ? HIGH : LOW) ;
+    return ;
+  }
+
+  flightRecord (pin, WPI_FLIGHT_MASKED, value) ;
+
+  nodeReadBegin () ;
+    if ((node = wiringPiFindNode (pin)) != NULL)
+      node->digitalWriteMasked (node, pin, value, mask) ;
+  nodeReadEnd () ;
+}
+
+
+/*
+ * digitalWriteSequence:
+ *	A run of masked writes to the same pins, one after another as fast
+ *	as they'll go - for bit-banging through an I/O expander. A node with
+ *	its own digitalWriteSequence sends them all in one bus transaction,
+ *	straight away even inside wiringPiBegin/wiringPiCommit.
+ *********************************************************************************
+ */
+
+void digitalWriteSequence (int pin, unsigned int mask, const unsigned int *values, int count)
+{
+  struct wiringPiNodeStruct *node ;
+  int i ;
+
+  if (count <= 0)
+    return ;
+
+  if ((pin & PI_GPIO_MASK) == 0)		// On-Board Pin
+  {
+    for (i = 0 ; i < count ; ++i)
+      digitalWriteMasked (pin, values [i], mask) ;
+    return ;
+  }
+
+  flightRecord (pin, WPI_FLIGHT_MASKED, values [count - 1]) ;
+
+  nodeReadBegin () ;
+    if ((node = wiringPiFindNode (pin)) != NULL)
+    {
+      if (node->digitalWriteSequence != NULL)
+	node->digitalWriteSequence (node, pin, mask, values, count) ;
+      else
+	for (i = 0 ; i < count ; ++i)
+	  node->digitalWriteMasked (node, pin, values [i], mask) ;
+    }
+  nodeReadEnd () ;
+}
+
+void digitalWrite8 (int pin, int value)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if ((pin & PI_GPIO_MASK) == 0)
+  {
+    digitalWriteMasked (pin, value, 0x00FF) ;
+    return ;
+  }
+
+  flightRecord (pin, WPI_FLIGHT_MASKED, value) ;
+
+  nodeReadBegin () ;
+    if ((node = wiringPiFindNode (pin)) != NULL)
+      node->digitalWrite8 (node, pin, value) ;
+  nodeReadEnd () ;
+}
+
+void digitalWrite16 (int pin, int value)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if ((pin & PI_GPIO_MASK) == 0)
+  {
+    digitalWriteMasked (pin, value, 0xFFFF) ;
+    return ;
+  }
+
+  flightRecord (pin, WPI_FLIGHT_MASKED, value) ;
+
+  nodeReadBegin () ;
+    if ((node = wiringPiFindNode (pin)) != NULL)
+      node->digitalWrite16 (node, pin, value) ;
+  nodeReadEnd () ;
+}
+
+
+/*
+ * wiringPiPinOpen:
+ * wiringPiPinClose:
+ *	Resolve a pin once into a handle for wpiPinWrite () and wpiPinRead ().
+ *	The handle is tied to the wiringPi mode in force when it's opened, so
+ *	open handles after calling one of the wiringPiSetup functions.
+ *	Returns NULL if the pin doesn't exist.
+ *********************************************************************************
+ */
+
+wpiPin_t wiringPiPinOpen (int pin)
+{
+  wpiPin_t h ;
+  struct wiringPiNodeStruct *node = NULL ;
+  int gpioPin = -1 ;
+
+  setupCheck ("wiringPiPinOpen") ;
+
+  if ((pin & PI_GPIO_MASK) == 0)		// On-Board Pin
+  {
+    /**/ if (wiringPiMode == WPI_MODE_PINS)
+      gpioPin = pinToGpio [pin] ;
+    else if (wiringPiMode == WPI_MODE_PHYS)
+      gpioPin = physToGpio [pin] ;
+    else if ((wiringPiMode == WPI_MODE_GPIO) || (wiringPiMode == WPI_MODE_GPIO_SYS))
+      gpioPin = pin ;
+
+    if (gpioPin < 0)
+      return NULL ;
+  }
+  else if ((node = wiringPiFindNode (pin)) == NULL)
+    return NULL ;
+
+  if ((h = (wpiPin_t)calloc (1, sizeof (struct wpiPinStruct))) == NULL)
+    return NULL ;
+
+  h->pin   = pin ;
+  h->gpio  = gpioPin ;
+  h->node  = node ;
+  h->sysFd = -1 ;
+
+  if (node == NULL)
+  {
+    if (wiringPiMode == WPI_MODE_GPIO_SYS)
+      h->sysFd = sysFds [gpioPin] ;
+    else
+    {
+      if (!simulating)		// Writes have to go the slow way to reach GPLEV
+      {
+	h->set  = gpioSet [gpioPin >> 5] ;
+	h->clr  = gpioClr [gpioPin >> 5] ;
+      }
+      h->lev  = gpioLev [gpioPin >> 5] ;
+      h->mask = 1 << (gpioPin & 31) ;
+    }
+  }
+
+  return h ;
+}
+
+void wiringPiPinClose (wpiPin_t h)
+{
+  free (h) ;
+}
+
+
+/*
+ * wpiPinWriteSlow:
+ * wpiPinReadSlow:
+ *	The out-of-line parts of wpiPinWrite () and wpiPinRead () for Sys mode
+ *	and extension node pins. The node and file descriptor are already
+ *	resolved so there's still no searching.
+ *********************************************************************************
+ */
+
+void wpiPinWriteSlow (wpiPin_t h, int value)
+{
+  if (h->node != NULL)
+    h->node->digitalWrite (h->node, h->pin, value) ;
+  else if (h->sysFd != -1)
+  {
+    if (value == LOW)
+      write (h->sysFd, "0\n", 2) ;
+    else
+      write (h->sysFd, "1\n", 2) ;
+  }
+  else if (simulating)
+  {
+    if (value == LOW)
+      *(gpio + gpioToGPCLR [h->gpio]) = h->mask ;
+    else
+      *(gpio + gpioToGPSET [h->gpio]) = h->mask ;
+    simGpioApply () ;
+  }
+}
+
+int wpiPinReadSlow (wpiPin_t h)
+{
+  char c ;
+
+  if (h->node != NULL)
+    return h->node->digitalRead (h->node, h->pin) ;
+
+  if (h->sysFd == -1)
+    return LOW ;
+
+  lseek (h->sysFd, 0L, SEEK_SET) ;
+  read  (h->sysFd, &c, 1) ;
+  return (c == '0') ? LOW : HIGH ;
+}
+
+
+/*
+ * pwmWrite:
+ *	Set an output PWM value
+ *********************************************************************************
+ */
+
+void pwmWrite (int pin, int value)
+{
+  struct wiringPiNodeStruct *node = wiringPiNodes ;
+  int channel ;
+
+  setupCheck ("pwmWrite") ;
+  flightRecord (pin, WPI_FLIGHT_PWM, value) ;
+  statsPin     (pin, TRUE) ;
+
+  if ((pin & PI_GPIO_MASK) == 0)		// On-Board Pin
+  {
+    /**/ if (wiringPiMode == WPI_MODE_PINS)
+      pin = pinToGpio [pin] ;
+    else if (wiringPiMode == WPI_MODE_PHYS)
+      pin = physToGpio [pin] ;
+    else if (wiringPiMode != WPI_MODE_GPIO)
+      return ;
+
+    if (brokered (WPI_BROKER_PWM_WRITE, pin, value))
+      return ;
+
+    usingGpioMemCheck ("pwmWrite") ;
+
+    if (rp1)
+    {
+      if ((channel = rp1PwmChannel (pin)) >= 0)
+	(void)rp1PwmWrite (channel, value) ;
+      return ;
+    }
+
+    needPwm () ;
+    if ((channel = gpioToPwmChannel (pin)) >= 0)
+      *(pwmController (channel) + ((channel & 1) ? PWM1_DATA : PWM0_DATA)) = value ;
+  }
+  else
+  {
+    nodeReadBegin () ;
+      if ((node = wiringPiFindNode (pin)) != NULL)
+	node->pwmWrite (node, pin, value) ;
+    nodeReadEnd () ;
+  }
+}
+
+
+/*
+ * analogRead:
+ *	Read the analog value of a given Pin.
+ *	There is no on-board Pi analog hardware,
+ *	so this needs to go to a new node.
+ *	Pins with a filter from analogReadFilter () go through that.
+ *********************************************************************************
+ */
+
+int analogRead (int pin)
+{
+  struct wiringPiNodeStruct *node ;
+  int value = 0 ;
+
+  nodeReadBegin () ;
+    if ((node = wiringPiFindNode (pin)) != NULL)
+    {
+      if (__atomic_load_n (&node->filters, __ATOMIC_ACQUIRE) == NULL)
+	value = node->analogRead (node, pin) ;
+      else
+	value = analogFilterRead (node, pin) ;
+    }
+  nodeReadEnd () ;
+
+  return value ;
+}
+
+
+/*
+ * analogWrite:
+ *	Write the analog value to the given Pin.
+ *	There is no on-board Pi analog hardware,
+ *	so this needs to go to a new node.
+ *********************************************************************************
+ */
+
+void analogWrite (int pin, int value)
+{
+  struct wiringPiNodeStruct *node ;
+
+  flightRecord (pin, WPI_FLIGHT_AWRITE, value) ;
+
+  nodeReadBegin () ;
+    if ((node = wiringPiFindNode (pin)) != NULL)
+      node->analogWrite (node, pin, value) ;
+  nodeReadEnd () ;
+}
+
+
+/*
+ * analogReadRange:
+ * analogWriteRange:
+ * digitalReadRange:
+ * digitalWriteRange:
+ *	Read or write count consecutive pins from pin, into or out of an
+ *	array. The range is split up by node and each piece goes to the
+ *	node in one call, which a driver can turn into a single transaction
+ *	(a scan of all the ADC channels, say). Pins that aren't on a node go
+ *	one at a time, as do analog reads of a node with filters.
+ *	The reads return the number of pins read.
+ *********************************************************************************
+ */
+
+static int nodeRange (int pin, int count, struct wiringPiNodeStruct **node)
+{
+  if ((*node = wiringPiFindNode (pin)) == NULL)
+    return 1 ;
+
+  return (pin + count - 1 > (*node)->pinMax) ? (*node)->pinMax - pin + 1 : count ;
+}
+
+int analogReadRange (int pin, int count, int *values)
+{
+  struct wiringPiNodeStruct *node ;
+  int i, n, done ;
+
+  nodeReadBegin () ;
+
+  for (done = 0 ; done < count ; done += n)
+  {
+    n = nodeRange (pin + done, count - done, &node) ;
+
+    /**/ if (node == NULL)
+      values [done] = 0 ;
+    else if (__atomic_load_n (&node->filters, __ATOMIC_ACQUIRE) != NULL)
+    {
+      for (i = 0 ; i < n ; ++i)
+	values [done + i] = analogFilterRead (node, pin + done + i) ;
+    }
+    else if (node->analogReadRange (node, pin + done, n, &values [done]) < n)
+    {
+      for (i = 0 ; i < n ; ++i)
+	values [done + i] = node->analogRead (node, pin + done + i) ;
+    }
+  }
+
+  nodeReadEnd () ;
+
+  return count ;
+}
+
+void analogWriteRange (int pin, int count, const int *values)
+{
+  struct wiringPiNodeStruct *node ;
+  int i, n, done ;
+
+  for (i = 0 ; i < count ; ++i)
+    flightRecord (pin + i, WPI_FLIGHT_AWRITE, values [i]) ;
+
+  nodeReadBegin () ;
+
+  for (done = 0 ; done < count ; done += n)
+  {
+    n = nodeRange (pin + done, count - done, &node) ;
+    if (node != NULL)
+      node->analogWriteRange (node, pin + done, n, &values [done]) ;
+  }
+
+  nodeReadEnd () ;
+}
+
+int digitalReadRange (int pin, int count, int *values)
+{
+  struct wiringPiNodeStruct *node ;
+  int n, done ;
+
+  nodeReadBegin () ;
+
+  for (done = 0 ; done < count ; done += n)
+  {
+    n = nodeRange (pin + done, count - done, &node) ;
+
+    if (node == NULL)
+      values [done] = digitalRead (pin + done) ;
+    else
+      node->digitalReadRange (node, pin + done, n, &values [done]) ;
+  }
+
+  nodeReadEnd () ;
+
+  return count ;
+}
+
+void digitalWriteRange (int pin, int count, const int *values)
+{
+  struct wiringPiNodeStruct *node ;
+  int i, n, done ;
+
+  nodeReadBegin () ;
+
+  for (done = 0 ; done < count ; done += n)
+  {
+    n = nodeRange (pin + done, count - done, &node) ;
+
+    if (node == NULL)
+      digitalWrite (pin + done, values [done]) ;
+    else
+    {
+      for (i = 0 ; i < n ; ++i)
+	flightRecord (pin + done + i, WPI_FLIGHT_WRITE, values [done + i]) ;
+      node->digitalWriteRange (node, pin + done, n, &values [done]) ;
+    }
+  }
+
+  nodeReadEnd () ;
+}
+
+
+/*
+ * pwmToneWrite:
+ *	Pi Specific.
+ *      Output the given frequency on the Pi's PWM pin
+ *********************************************************************************
+ */
+
+void pwmToneWrite (int pin, int freq)
+{
+  int range, channel ;
+
+  setupCheck ("pwmToneWrite") ;
+
+  if (freq == 0)
+    pwmWrite (pin, 0) ;             // Off
+  else
+  {
+    range = 600000 / freq ;
+    if (((pin & PI_GPIO_MASK) == 0) && ((channel = pwmPinChannel (pin)) >= 0))
+      pwmSetRangeCh (channel, range) ;
+    else
+      pwmSetRange (range) ;
+    pwmWrite    (pin, freq / 2) ;
+  }
+}
+
+
+/*
+ * pwmStreamThread:
+ *	The fall-back when there's no DMA: keep the PWM FIFO topped up from
+ *	the ring buffer. The FIFO is 16 words deep, so we sleep for about
+ *	half of that between checks.
+ *********************************************************************************
+ */
+
+static void *pwmStreamThread (void *arg)
+{
+  int moved ;
+
+  (void)arg ;
+
+  piHiPri (50) ;
+
+  for (;;)
+  {
+    pthread_mutex_lock (&pwmRingLock) ;
+      moved = 0 ;
+      while ((pwmRingTail != pwmRingHead) && ((*(pwm + PWM_STATUS) & PWM_STA_FULL1) == 0))
+      {
+	*(pwm + PWM_FIFO) = pwmRing [pwmRingTail] ;
+	pwmRingTail = (pwmRingTail + 1) % PWM_STREAM_RING ;
+	++moved ;
+      }
+      if (moved != 0)
+	pthread_cond_broadcast (&pwmRingSpace) ;
+    pthread_mutex_unlock (&pwmRingLock) ;
+
+    delayMicroseconds (8000000 / pwmStreamRate + 1) ;
+  }
+
+  return NULL ;
+}
+
+
+/*
+ * pwmStreamDma:
+ *	Pick the DMA channel pwmStream uses, or -1 to always use the
+ *	refill thread. The default is channel 10.
+ *********************************************************************************
+ */
+
+void pwmStreamDma (int dmaChannel)
+{
+  pwmStreamDmaChannel = dmaChannel ;
+}
+
+
+/*
+ * pwmStream:
+ *	Pi Specific.
+ *	Play a buffer of samples out on one of the PWM channels (0 or 1) at
+ *	the given sample rate, through the PWM FIFO. The PWM range is set to
+ *	PWM clock / sampleRate, with the clock as set by pwmSetClock, and is
+ *	returned so samples should lie in 0 to range-1. Call with no samples
+ *	to just set things up and find the range.
+ *
+ *	With DMA the buffer is copied and played in the background; a second
+ *	call waits for the first buffer to finish. Without it the samples go
+ *	into a ring buffer that a thread feeds into the FIFO, so calls can be
+ *	chained with no gaps - pwmStream blocks when the ring is full.
+ *	Only one channel can stream at a time. Returns -1 on error.
+ *********************************************************************************
+ */
+
+int pwmStream (int channel, const unsigned int *samples, int numSamples, int sampleRate)
+{
+  struct dmaCbStruct *cb ;
+  pthread_t myThread ;
+  uint32_t  ctrl, bits ;
+  int range, i, next ;
+
+  setupCheck        ("pwmStream") ;
+
+  if (rp1)
+    return wiringPiFailure (WPI_ALMOST, "pwmStream: Not available on the RP1\n") ;
+
+  usingGpioMemCheck ("pwmStream") ;
+  needPwm () ;
+
+  if ((channel < 0) || (channel > 1) || (sampleRate <= 0) || (numSamples < 0))
+    return -1 ;
+
+  if ((range = (19200000 / pwmDivisor) / sampleRate) < 2)
+    return wiringPiFailure (WPI_ALMOST, "pwmStream: Sample rate %d is too high for the PWM clock\n", sampleRate) ;
+
+// (Re)configure the channel for FIFO mark:space output if the rate or the
+//	channel changed
+
+  if ((sampleRate != pwmStreamRate) || (channel != pwmStreamChannel))
+  {
+    while (pwmStreamDmaUp && dmaBusy (pwmStreamDmaChannel))
+      delay (1) ;
+
+    *(pwm + (channel == 0 ? PWM0_RANGE : PWM1_RANGE)) = range ;
+    delayMicroseconds (10) ;
+
+    bits  = PWM0_MS_MODE | PWM0_USEFIFO | PWM0_ENABLE ;
+    pthread_mutex_lock (&pwmControlLock) ;
+      ctrl  = *(pwm + PWM_CONTROL) & ~((PWM0_USEFIFO | PWM1_USEFIFO) | (0xFF << (channel * 8))) ;
+      *(pwm + PWM_CONTROL) = ctrl | PWM_CLRFIFO ;
+      delayMicroseconds (10) ;
+      *(pwm + PWM_STATUS)  = PWM_STA_ERRORS ;
+      *(pwm + PWM_CONTROL) = ctrl | (bits << (channel * 8)) ;
+    pthread_mutex_unlock (&pwmControlLock) ;
+
+    pwmStreamRate    = sampleRate ;
+    pwmStreamChannel = channel ;
+  }
+
+  if (numSamples == 0)
+    return range ;
+
+// DMA
+
+  if ((pwmStreamDmaChannel >= 0) && !pwmStreamThreadUp)
+  {
+    if (!pwmStreamDmaUp)
+      pwmStreamDmaUp = (dmaChannelSetup (pwmStreamDmaChannel) == 0) ;
+
+    if (pwmStreamDmaUp)
+    {
+      while (dmaBusy (pwmStreamDmaChannel))
+	delay (1) ;
+
+      if ((pwmStreamMem.size < sizeof (*cb) + numSamples * sizeof (uint32_t)) || (pwmStreamMem.virt == NULL))
+      {
+	dmaMemFree (&pwmStreamMem) ;
+	if (dmaMemAlloc (&pwmStreamMem, sizeof (*cb) + numSamples * sizeof (uint32_t)) < 0)
+	  pwmStreamDmaUp = FALSE ;
+      }
+    }
+
+    if (pwmStreamDmaUp)
+    {
+      cb = (struct dmaCbStruct *)pwmStreamMem.virt ;
+      memcpy (cb + 1, samples, numSamples * sizeof (uint32_t)) ;
+
+      cb->info   = DMA_TI_NO_WIDE_BURSTS | DMA_TI_WAIT_RESP | DMA_TI_DEST_DREQ | DMA_TI_PERMAP (DMA_DREQ_PWM) | DMA_TI_SRC_INC ;
+      cb->src    = dmaBusAddr (&pwmStreamMem, cb + 1) ;
+      cb->dst    = DMA_BUS_PWM + PWM_FIFO * 4 ;
+      cb->length = numSamples * sizeof (uint32_t) ;
+      cb->stride = 0 ;
+      cb->next   = 0 ;
+
+      *(pwm + PWM_DMAC) = PWM_DMAC_ENAB | (7 << 8) | 7 ;
+      dmaStart (pwmStreamDmaChannel, pwmStreamMem.bus) ;
+
+      return range ;
+    }
+  }
+
+// No DMA: ring buffer and refill thread
+
+  *(pwm + PWM_DMAC) = 0 ;
+
+  if (!pwmStreamThreadUp)
+  {
+    if (pthread_create (&myThread, NULL, pwmStreamThread, NULL) != 0)
+      return wiringPiFailure (WPI_ALMOST, "pwmStream: Unable to start refill thread: %s\n", strerror (errno)) ;
+    pthread_detach (myThread) ;
+    pwmStreamThreadUp = TRUE ;
+  }
+
+  pthread_mutex_lock (&pwmRingLock) ;
+    for (i = 0 ; i < numSamples ; ++i)
+    {
+      next = (pwmRingHead + 1) % PWM_STREAM_RING ;
+      while (next == pwmRingTail)
+	pthread_cond_wait (&pwmRingSpace, &pwmRingLock) ;
+      pwmRing [pwmRingHead] = samples [i] ;
+      pwmRingHead = next ;
+    }
+  pthread_mutex_unlock (&pwmRingLock) ;
+
+  return range ;
+}
+
+
+/*
+ * pwmStreamBusy:
+ *	Are there still samples waiting to go out?
+ *********************************************************************************
+ */
+
+int pwmStreamBusy (void)
+{
+  if (pwmStreamThreadUp)
+    return pwmRingHead != pwmRingTail ;
+
+  if (pwmStreamDmaUp)
+    return dmaBusy (pwmStreamDmaChannel) ;
+
+  return FALSE ;
+}
+
+
+
+/*
+ * digitalWriteByte:
+ * digitalReadByte:
+ *	Pi Specific
+ *	Write an 8-bit byte to the first 8 GPIO pins - try to do it as
+ *	fast as possible.
+ *	However it still needs 2 operations to set the bits, so any external
+ *	hardware must not rely on seeing a change as there will be a change
+ *	to set the outputs bits to zero, then another change to set the 1's
+ *	Reading is just bit fiddling.
+ *	These are wiringPi pin numbers 0..7, or BCM_GPIO pin numbers
+ *	17, 18, 22, 23, 24, 24, 4 on a Pi v1 rev 0-3
+ *	17, 18, 27, 23, 24, 24, 4 on a Pi v1 rev 3 onwards or B+, 2, 3, zero
+ *********************************************************************************
+ */
+
+void digitalWriteByte (const int value)
+{
+  uint32_t pinSet = 0 ;
+  uint32_t pinClr = 0 ;
+  int mask = 1 ;
+  int pin ;
+
+  /**/ if (wiringPiMode == WPI_MODE_GPIO_SYS)
+  {
+    for (pin = 0 ; pin < 8 ; ++pin)
+    {
+      digitalWrite (pinToGpio [pin], value & mask) ;
+      mask <<= 1 ;
+    }
+    return ;
+  }
+  else
+  {
+    for (pin = 0 ; pin < 8 ; ++pin)
+    {
+      if ((value & mask) == 0)
+	pinClr |= (1 << pinToGpio [pin]) ;
+      else
+	pinSet |= (1 << pinToGpio [pin]) ;
+
+      mask <<= 1 ;
+    }
+
+    *gpioClr [0] = pinClr ;
+    *gpioSet [0] = pinSet ;
+
+    if (simulating)
+      simGpioApply () ;
+  }
+}
+
+unsigned int digitalReadByte (void)
+{
+  int pin, x ;
+  uint32_t raw ;
+  uint32_t data = 0 ;
+
+  /**/ if (wiringPiMode == WPI_MODE_GPIO_SYS)
+  {
+    for (pin = 0 ; pin < 8 ; ++pin)
+    {
+      x = digitalRead (pinToGpio [pin]) ;
+      data = (data << 1) | x ;
+    }
+  }
+  else
+  {
+    raw = *gpioLev [0] ; // First bank for these pins
+    for (pin = 0 ; pin < 8 ; ++pin)
+    {
+      x = pinToGpio [pin] ;
+      data = (data << 1) | (((raw & (1 << x)) == 0) ? 0 : 1) ;
+    }
+  }
+  return data ;
+}
+
+
+/*
+ * digitalWriteByte2:
+ * digitalReadByte2:
+ *	Pi Specific
+ *	Write an 8-bit byte to the second set of 8 GPIO pins. This is marginally
+ *	faster than the first lot as these are consecutive BCM_GPIO pin numbers.
+ *	However they overlap with the original read/write bytes.
+ *********************************************************************************
+ */
+
+void digitalWriteByte2 (const int value)
+{
+  register int mask = 1 ;
+  register int pin ;
+
+  /**/ if (wiringPiMode == WPI_MODE_GPIO_SYS)
+  {
+    for (pin = 20 ; pin < 28 ; ++pin)
+    {
+      digitalWrite (pin, value & mask) ;
+      mask <<= 1 ;
+    }
+    return ;
+  }
+  else
+  {
+    *gpioClr [0] = (~value & 0xFF) << 20 ; // 0x0FF00000; ILJ > CHANGE: Old causes glitch
+    *gpioSet [0] = ( value & 0xFF) << 20 ;
+
+    if (simulating)
+      simGpioApply () ;
+  }
+}
+
+unsigned int digitalReadByte2 (void)
+{
+  int pin, x ;
+  uint32_t data = 0 ;
+
+  /**/ if (wiringPiMode == WPI_MODE_GPIO_SYS)
+  {
+    for (pin = 20 ; pin < 28 ; ++pin)
+    {
+      x = digitalRead (pin) ;
+      data = (data << 1) | x ;
+    }
+  }
+  else
+    data = ((*gpioLev [0]) >> 20) & 0xFF ; // First bank for these pins
+
+  return data ;
+}
+
+
+/*
+ * digitalWriteMask:
+ *	Pi Specific
+ *	Set and clear any number of BCM_GPIO pins in one bank (0: GPIO 0-31,
+ *	1: GPIO 32-53) with at most one GPCLR and one GPSET store, so all the
+ *	pins in each mask change together.
+ *	As with digitalWriteByte, the clear happens before the set - except
+ *	on the RP1, where a mix of the two is one store to the XOR alias of
+ *	RIO OUT and they all change at once. Nothing else should be writing
+ *	those pins at the same time, as the XOR is worked out from OUT.
+ *********************************************************************************
+ */
+
+void digitalWriteMask (int bank, unsigned int setMask, unsigned int clrMask)
+{
+  unsigned int out ;
+  int pin ;
+
+  if ((bank < 0) || (bank > 1))
+    return ;
+
+  /**/ if (wiringPiMode == WPI_MODE_GPIO_SYS)
+  {
+    for (pin = 0 ; pin < 32 ; ++pin)
+    {
+      /**/ if ((clrMask & (1 << pin)) != 0)
+	digitalWrite (bank * 32 + pin, LOW) ;
+      else if ((setMask & (1 << pin)) != 0)
+	digitalWrite (bank * 32 + pin, HIGH) ;
+    }
+    return ;
+  }
+  else if (wiringPiMode == WPI_MODE_UNINITIALISED)
+    return ;
+
+  if (rp1 && (bank == 0) && (setMask != 0) && (clrMask != 0))
+  {
+    out = *(rp1Rio + RP1_RIO_OUT) ;
+    *(rp1Rio + RP1_XOR + RP1_RIO_OUT) = (((out & ~clrMask) | setMask) ^ out) ;
+    return ;
+  }
+
+  if (clrMask != 0)
+    *gpioClr [bank] = clrMask ;
+  if (setMask != 0)
+    *gpioSet [bank] = setMask ;
+
+  if (simulating)
+    simGpioApply () ;
+}
+
+
+/*
+ * digitalPulse:
+ * digitalBurst:
+ *	Pi Specific
+ *	One HIGH pulse of widthNs on a pin, or count of them with lowNs in
+ *	between, leaving it LOW. The pin is resolved to its GPSET/GPCLR
+ *	registers first so each edge is a single store, and the edges are
+ *	timed from one start on the nanos64 () clock - spun for, or slept
+ *	for if they're far enough apart - so they don't drift. The calling
+ *	thread runs at real-time priority for the length of it, if it can.
+ *	Sys mode, simulated and extension pins go through digitalWrite.
+ *	Returns 0 or -1 with errno set.
+ *********************************************************************************
+ */
+
+int digitalBurst (int pin, unsigned int highNs, unsigned int lowNs, int count)
+{
+  struct sched_param oldParam, newParam ;
+  volatile unsigned int *set = NULL, *clr = NULL ;
+  unsigned long long t ;
+  unsigned int bit = 0 ;
+  int i, gpioPin, oldPolicy, raised ;
+
+  if ((highNs == 0) || (count < 1) || ((count > 1) && (lowNs == 0)))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  if (((pin & PI_GPIO_MASK) == 0) && !simulating)
+  {
+    /**/ if (wiringPiMode == WPI_MODE_PINS)
+      gpioPin = pinToGpio [pin] ;
+    else if (wiringPiMode == WPI_MODE_PHYS)
+      gpioPin = physToGpio [pin] ;
+    else if (wiringPiMode == WPI_MODE_GPIO)
+      gpioPin = pin ;
+    else
+      gpioPin = -1 ;
+
+    if (gpioPin >= 0)
+    {
+      set = gpioSet [gpioPin >> 5] ;
+      clr = gpioClr [gpioPin >> 5] ;
+      bit = 1u << (gpioPin & 31) ;
+    }
+  }
+
+  delayUntilNanos (0) ;			// Calibrated now rather than in the burst
+
+  raised = pthread_getschedparam (pthread_self (), &oldPolicy, &oldParam) == 0 ;
+  if (raised)
+  {
+    newParam.sched_priority = sched_get_priority_max (SCHED_FIFO) ;
+    raised = pthread_setschedparam (pthread_self (), SCHED_FIFO, &newParam) == 0 ;
+  }
+
+  t = nanos64 () ;
+
+  for (i = 0 ; i < count ; ++i)
+  {
+    if (set != NULL) *set = bit ; else digitalWrite (pin, HIGH) ;
+    delayUntilNanos (t += highNs) ;
+    if (clr != NULL) *clr = bit ; else digitalWrite (pin, LOW) ;
+    if (i + 1 < count)
+      delayUntilNanos (t += lowNs) ;
+  }
+
+  if (raised)
+    pthread_setschedparam (pthread_self (), oldPolicy, &oldParam) ;
+
+  return 0 ;
+}
+
+int digitalPulse (int pin, unsigned int widthNs)
+{
+  return digitalBurst (pin, widthNs, 0, 1) ;
+}
+
+
+/*
+ * digitalWritePins:
+ *	Pi Specific
+ *	Write bit N of value to pins [N] for up to 32 on-board pins.
+ *	The pin numbers are in the current wiringPi mode and are translated
+ *	in one pass into per-bank set/clear masks which are then written with
+ *	digitalWriteMask - so at most 4 stores, no matter how many pins.
+ *********************************************************************************
+ */
+
+void digitalWritePins (const int *pins, int numPins, unsigned int value)
+{
+  unsigned int setMask [2] = { 0, 0 } ;
+  unsigned int clrMask [2] = { 0, 0 } ;
+  int i, pin ;
+
+  if (numPins > 32)
+    numPins = 32 ;
+
+  for (i = 0 ; i < numPins ; ++i)
+  {
+    if (((pin = pins [i]) & PI_GPIO_MASK) != 0)	// Not an on-board pin
+      continue ;
+
+    /**/ if (wiringPiMode == WPI_MODE_PINS)
+      pin = pinToGpio [pin] ;
+    else if (wiringPiMode == WPI_MODE_PHYS)
+      pin = physToGpio [pin] ;
+    else if ((wiringPiMode != WPI_MODE_GPIO) && (wiringPiMode != WPI_MODE_GPIO_SYS))
+      return ;
+
+    if (pin < 0)
+      continue ;
+
+    if ((value & (1 << i)) == 0)
+      clrMask [pin >> 5] |= 1 << (pin & 31) ;
+    else
+      setMask [pin >> 5] |= 1 << (pin & 31) ;
+  }
+
+  if ((setMask [0] | clrMask [0]) != 0)
+    digitalWriteMask (0, setMask [0], clrMask [0]) ;
+  if ((setMask [1] | clrMask [1]) != 0)
+    digitalWriteMask (1, setMask [1], clrMask [1]) ;
+}
+
+
+/*
+ * digitalReadBank:
+ *	Pi Specific
+ *	Return the whole GPLEV register for a bank (0: GPIO 0-31, 1: GPIO 32-53)
+ *	in a single load, so every bit is from the same instant.
+ *	In Sys mode we can only build it up from the exported pins.
+ *********************************************************************************
+ */
+
+unsigned int digitalReadBank (int bank)
+{
+  unsigned int data = 0 ;
+  int pin ;
+
+  if ((bank < 0) || (bank > 1))
+    return 0 ;
+
+  if (wpiImageOn && (wpiImageBank (bank, &data) == 0))
+    return data ;
+
+  /**/ if (wiringPiMode == WPI_MODE_GPIO_SYS)
+  {
+    for (pin = 0 ; pin < 32 ; ++pin)
+      if ((sysFds [bank * 32 + pin] != -1) || (lineFds [bank * 32 + pin] != -1))
+	if (digitalRead (bank * 32 + pin) == HIGH)
+	  data |= 1 << pin ;
+    return data ;
+  }
+  else if (wiringPiMode == WPI_MODE_UNINITIALISED)
+    return 0 ;
+
+  return *gpioLev [bank] ;
+}
+
+
+/*
+ * digitalReadPins:
+ *	Pi Specific
+ *	Read a list of on-board pins into out [], HIGH or LOW, from one snapshot
+ *	of each GPLEV bank. The pins are in the current wiringPi mode and are
+ *	translated up-front, then the banks are only read if a pin needs them.
+ *	Returns the number of pins read, or -1 if there was an invalid pin.
+ *********************************************************************************
+ */
+
+int digitalReadPins (const int *pins, int numPins, unsigned char *out)
+{
+  int    bcm [64] ;
+  unsigned int level [2] = { 0, 0 } ;
+  int    need [2] = { FALSE, FALSE } ;
+  int    i, pin ;
+
+  if (numPins > 64)
+    numPins = 64 ;
+
+// Translate once
+
+  for (i = 0 ; i < numPins ; ++i)
+  {
+    if (((pin = pins [i]) & PI_GPIO_MASK) != 0)
+      return -1 ;
+
+    /**/ if (wiringPiMode == WPI_MODE_PINS)
+      pin = pinToGpio [pin] ;
+    else if (wiringPiMode == WPI_MODE_PHYS)
+      pin = physToGpio [pin] ;
+    else if ((wiringPiMode != WPI_MODE_GPIO) && (wiringPiMode != WPI_MODE_GPIO_SYS))
+      return -1 ;
+
+    if (pin < 0)
+      return -1 ;
+
+    bcm  [i]        = pin ;
+    need [pin >> 5] = TRUE ;
+  }
+
+// Snapshot ...
+
+  if (need [0]) level [0] = digitalReadBank (0) ;
+  if (need [1]) level [1] = digitalReadBank (1) ;
+
+// ... and extract
+
+  for (i = 0 ; i < numPins ; ++i)
+    out [i] = ((level [bcm [i] >> 5] & (1 << (bcm [i] & 31))) == 0) ? LOW : HIGH ;
+
+  return numPins ;
+}
+
+
+/*
+ * fselWrite:
+ *	Write out the GPFSEL changes gathered up by pinModeMulti () and
+ *	pinModeMask () - one read-modify-write per register touched.
+ *********************************************************************************
+ */
+
+static void fselWrite (const unsigned int *clrBits, const unsigned int *setBits)
+{
+  int fSel ;
+
+  for (fSel = 0 ; fSel < 6 ; ++fSel)
+    if (clrBits [fSel] != 0)
+    {
+      wpiConfigLock (WPI_CONFIG_FSEL (fSel)) ;
+	*(gpio + fSel) = (*(gpio + fSel) & ~clrBits [fSel]) | setBits [fSel] ;
+      wpiConfigUnlock (WPI_CONFIG_FSEL (fSel)) ;
+    }
+}
+
+
+/*
+ * pinModeMulti:
+ *	Set the modes of a list of pins, modes [N] for pins [N], in the
+ *	current wiringPi mode. On-board pins going to INPUT or OUTPUT are
+ *	gathered by GPFSEL register, so however many there are that's at
+ *	most 6 read-modify-writes. Anything else - other modes, extension
+ *	pins, Sys mode - is handed to pinMode () as usual.
+ *********************************************************************************
+ */
+
+void pinModeMulti (const int *pins, const int *modes, int numPins)
+{
+  unsigned int clrBits [6] = { 0, 0, 0, 0, 0, 0 } ;
+  unsigned int setBits [6] = { 0, 0, 0, 0, 0, 0 } ;
+  int i, pin ;
+
+  setupCheck ("pinModeMulti") ;
+
+  for (i = 0 ; i < numPins ; ++i)
+  {
+    pin = pins [i] ;
+
+    if (((pin & PI_GPIO_MASK) != 0) || ((modes [i] != INPUT) && (modes [i] != OUTPUT)))
+    {
+      pinMode (pin, modes [i]) ;
+      continue ;
+    }
+
+    /**/ if (wiringPiMode == WPI_MODE_PINS)
+      pin = pinToGpio [pin] ;
+    else if (wiringPiMode == WPI_MODE_PHYS)
+      pin = physToGpio [pin] ;
+    else if (wiringPiMode != WPI_MODE_GPIO)
+    {
+      pinMode (pin, modes [i]) ;	// Sys mode
+      continue ;
+    }
+
+    if ((pin < 0) || (pin > 53))
+      continue ;
+
+    softPwmStop  (pins [i]) ;
+    softToneStop (pins [i]) ;
+
+    if (rp1)				// A register per pin: nothing to gather
+    {
+      rp1PinMode (pin, modes [i]) ;
+      continue ;
+    }
+
+    clrBits [gpioToGPFSEL [pin]] |= 7 << gpioToShift [pin] ;
+    if (modes [i] == OUTPUT)
+      setBits [gpioToGPFSEL [pin]] |= 1 << gpioToShift [pin] ;
+    else
+      setBits [gpioToGPFSEL [pin]] &= ~(7 << gpioToShift [pin]) ;	// Last one wins
+  }
+
+  fselWrite (clrBits, setBits) ;
+}
+
+
+/*
+ * pinModeMask:
+ *	Pi Specific
+ *	Set every BCM_GPIO pin in mask, in one bank (0: GPIO 0-31, 1: GPIO
+ *	32-53), to INPUT or OUTPUT - the companion to digitalWriteMask for
+ *	turning a bus around. No soft PWM or tone threads are stopped, so
+ *	don't use this on pins that have one running.
+ *********************************************************************************
+ */
+
+void pinModeMask (int bank, unsigned int mask, int mode)
+{
+  unsigned int clrBits [6] = { 0, 0, 0, 0, 0, 0 } ;
+  unsigned int setBits [6] = { 0, 0, 0, 0, 0, 0 } ;
+  int pin, gpioPin ;
+
+  if ((bank < 0) || (bank > 1) || ((mode != INPUT) && (mode != OUTPUT)))
+    return ;
+
+  /**/ if (wiringPiMode == WPI_MODE_GPIO_SYS)
+  {
+    for (pin = 0 ; pin < 32 ; ++pin)
+      if ((mask & (1 << pin)) != 0)
+	pinMode (bank * 32 + pin, mode) ;
+    return ;
+  }
+  else if (wiringPiMode == WPI_MODE_UNINITIALISED)
+    return ;
+
+  for (pin = 0 ; pin < 32 ; ++pin)
+  {
+    if ((mask & (1 << pin)) == 0)
+      continue ;
+
+    if ((gpioPin = bank * 32 + pin) > 53)
+      break ;
+
+    if (rp1)
+    {
+      rp1PinMode (gpioPin, mode) ;
+      continue ;
+    }
+
+    clrBits [gpioToGPFSEL [gpioPin]] |= 7 << gpioToShift [gpioPin] ;
+    if (mode == OUTPUT)
+      setBits [gpioToGPFSEL [gpioPin]] |= 1 << gpioToShift [gpioPin] ;
+  }
+
+  fselWrite (clrBits, setBits) ;
+}
+
+
+/*
+ * pudWrite:
+ *	Set the pulls gathered up by pullUpDnControlMulti () and pullUpDnMask ()
+ *	where masks [pud][bank] has a bit set for each BCM_GPIO pin to get that
+ *	pud. The legacy GPPUD/GPPUDCLK sequence takes a mask for each bank,
+ *	so it's done once per pull value, not once per pin, and on the 2711
+ *	each GPPUPPDN register gets one read-modify-write.
+ *********************************************************************************
+ */
+
+static void pudWrite (unsigned int masks [3][2])
+{
+  static const unsigned int bits2711 [3] = { 0, 2, 1 } ;	// PUD_OFF, PUD_DOWN, PUD_UP
+  unsigned int clrBits, setBits ;
+  int reg, pud, pin, gpioPin ;
+
+  if (rp1)				// One pad register per pin
+  {
+    for (pud = PUD_OFF ; pud <= PUD_UP ; ++pud)
+      for (pin = 0 ; pin < RP1_GPIO_PINS ; ++pin)
+	if ((masks [pud][0] & (1u << pin)) != 0)
+	  rp1PullUpDnControl (pin, pud) ;
+  }
+  else if (piGpioPupOffset == GPPUPPDN0)
+  {
+    for (reg = 0 ; reg < 4 ; ++reg)
+    {
+      clrBits = setBits = 0 ;
+
+      for (pud = PUD_OFF ; pud <= PUD_UP ; ++pud)
+	for (pin = 0 ; pin < 16 ; ++pin)
+	{
+	  gpioPin = reg * 16 + pin ;
+	  if ((masks [pud][gpioPin >> 5] & (1u << (gpioPin & 31))) != 0)
+	  {
+	    clrBits |= 3              << (pin << 1) ;
+	    setBits |= bits2711 [pud] << (pin << 1) ;
+	  }
+	}
+
+      if (clrBits != 0)
+      {
+	wpiConfigLock (WPI_CONFIG_PULL (reg)) ;
+	  *(gpio + GPPUPPDN0 + reg) = (*(gpio + GPPUPPDN0 + reg) & ~clrBits) | setBits ;
+	wpiConfigUnlock (WPI_CONFIG_PULL (reg)) ;
+      }
+    }
+  }
+  else
+  {
+    for (pud = PUD_OFF ; pud <= PUD_UP ; ++pud)
+    {
+      if ((masks [pud][0] | masks [pud][1]) == 0)
+	continue ;
+
+      wpiConfigLock (WPI_CONFIG_PUD) ;
+      *(gpio + GPPUD)             = pud ;		delayMicroseconds (5) ;
+      *(gpio + gpioToPUDCLK [0])  = masks [pud][0] ;
+      *(gpio + gpioToPUDCLK [32]) = masks [pud][1] ;	delayMicroseconds (5) ;
+
+      *(gpio + GPPUD)             = 0 ;			delayMicroseconds (5) ;
+      *(gpio + gpioToPUDCLK [0])  = 0 ;
+      *(gpio + gpioToPUDCLK [32]) = 0 ;			delayMicroseconds (5) ;
+      wpiConfigUnlock (WPI_CONFIG_PUD) ;
+    }
+  }
+}
+
+
+/*
+ * pullUpDnControlMulti:
+ *	Set the pull-up/down of a list of pins, puds [N] for pins [N], in the
+ *	current wiringPi mode. On-board pins are grouped by pull value (see
+ *	pudWrite above), extension pins and Sys mode go through
+ *	pullUpDnControl () one at a time.
+ *********************************************************************************
+ */
+
+void pullUpDnControlMulti (const int *pins, const int *puds, int numPins)
+{
+  unsigned int masks [3][2] = { { 0, 0 }, { 0, 0 }, { 0, 0 } } ;
+  int i, pin ;
+
+  setupCheck ("pullUpDnControlMulti") ;
+
+  for (i = 0 ; i < numPins ; ++i)
+  {
+    pin = pins [i] ;
+
+    if ((puds [i] < PUD_OFF) || (puds [i] > PUD_UP))
+      continue ;
+
+    if ((pin & PI_GPIO_MASK) != 0)
+    {
+      pullUpDnControl (pin, puds [i]) ;
+      continue ;
+    }
+
+    /**/ if (wiringPiMode == WPI_MODE_PINS)
+      pin = pinToGpio [pin] ;
+    else if (wiringPiMode == WPI_MODE_PHYS)
+      pin = physToGpio [pin] ;
+    else if (wiringPiMode != WPI_MODE_GPIO)
+    {
+      pullUpDnControl (pin, puds [i]) ;	// Sys mode
+      continue ;
+    }
+
+    if ((pin < 0) || (pin > 53))
+      continue ;
+
+    masks [PUD_OFF ][pin >> 5] &= ~(1u << (pin & 31)) ;	// Last one wins
+    masks [PUD_DOWN][pin >> 5] &= ~(1u << (pin & 31)) ;
+    masks [PUD_UP  ][pin >> 5] &= ~(1u << (pin & 31)) ;
+    masks [puds [i]][pin >> 5] |=   1u << (pin & 31) ;
+  }
+
+  pudWrite (masks) ;
+}
+
+
+/*
+ * pullUpDnMask:
+ *	Pi Specific
+ *	Set the pull-up/down of every BCM_GPIO pin in mask, in one bank
+ *	(0: GPIO 0-31, 1: GPIO 32-53), with a single GPPUD sequence.
+ *********************************************************************************
+ */
+
+void pullUpDnMask (int bank, unsigned int mask, int pud)
+{
+  unsigned int masks [3][2] = { { 0, 0 }, { 0, 0 }, { 0, 0 } } ;
+  int pin ;
+
+  if ((bank < 0) || (bank > 1) || (pud < PUD_OFF) || (pud > PUD_UP))
+    return ;
+
+  /**/ if (wiringPiMode == WPI_MODE_GPIO_SYS)
+  {
+    for (pin = 0 ; pin < 32 ; ++pin)
+      if ((mask & (1u << pin)) != 0)
+	pullUpDnControl (bank * 32 + pin, pud) ;
+    return ;
+  }
+  else if (wiringPiMode == WPI_MODE_UNINITIALISED)
+    return ;
+
+  if (bank == 1)
+    mask &= 0x003FFFFF ;		// GPIO 32-53
+
+  masks [pud][bank] = mask ;
+  pudWrite (masks) ;
+}
+
+
+/*
+ * wiringPiSnapshot:
+ *	Pi Specific
+ *	Capture the whole on-board GPIO configuration - every pin's function,
+ *	level and (on the 2711) pull - in one pass over the registers.
+ *	Returns 0, or -1 if there's no register access (e.g. Sys mode)
+ *********************************************************************************
+ */
+
+int wiringPiSnapshot (struct wpiStateStruct *state)
+{
+  int i ;
+
+  if ((wiringPiMode == WPI_MODE_GPIO_SYS) || (wiringPiMode == WPI_MODE_UNINITIALISED) || (gpio == NULL))
+    return -1 ;
+
+  for (i = 0 ; i < 6 ; ++i)
+    state->fsel [i] = *(gpio + i) ;
+
+  state->level [0] = *(gpio + gpioToGPLEV [0]) ;
+  state->level [1] = *(gpio + gpioToGPLEV [32]) ;
+
+  if ((state->havePulls = (piGpioPupOffset == GPPUPPDN0)))
+    for (i = 0 ; i < 4 ; ++i)
+      state->pull [i] = *(gpio + GPPUPPDN0 + i) ;
+  else
+    for (i = 0 ; i < 4 ; ++i)
+      state->pull [i] = 0 ;
+
+  return 0 ;
+}
+
+
+/*
+ * wiringPiRestore:
+ *	Pi Specific
+ *	Put back a configuration from wiringPiSnapshot (). The output levels
+ *	are set first, so pins that become outputs come up at the right level
+ *	rather than glitching, then the functions and pulls are written a
+ *	register at a time. Pulls are left alone unless the snapshot has them.
+ *	Returns 0 or -1 as above.
+ *********************************************************************************
+ */
+
+int wiringPiRestore (const struct wpiStateStruct *state)
+{
+  unsigned int outputs [2] = { 0, 0 } ;
+  int i, pin ;
+
+  if ((wiringPiMode == WPI_MODE_GPIO_SYS) || (wiringPiMode == WPI_MODE_UNINITIALISED) || (gpio == NULL))
+    return -1 ;
+
+  for (pin = 0 ; pin < 54 ; ++pin)
+    if (((state->fsel [gpioToGPFSEL [pin]] >> gpioToShift [pin]) & 7) == 1)
+      outputs [pin >> 5] |= 1u << (pin & 31) ;
+
+  for (i = 0 ; i < 2 ; ++i)
+  {
+    *(gpio + gpioToGPCLR [i * 32]) = outputs [i] & ~state->level [i] ;
+    *(gpio + gpioToGPSET [i * 32]) = outputs [i] &  state->level [i] ;
+  }
+
+  if (simulating)
+    simGpioApply () ;
+
+  for (i = 0 ; i < 6 ; ++i)
+  {
+    wpiConfigLock (WPI_CONFIG_FSEL (i)) ;
+      *(gpio + i) = state->fsel [i] ;
+    wpiConfigUnlock (WPI_CONFIG_FSEL (i)) ;
+  }
+
+  if (state->havePulls && (piGpioPupOffset == GPPUPPDN0))
+    for (i = 0 ; i < 4 ; ++i)
+    {
+      wpiConfigLock (WPI_CONFIG_PULL (i)) ;
+	*(gpio + GPPUPPDN0 + i) = state->pull [i] ;
+      wpiConfigUnlock (WPI_CONFIG_PULL (i)) ;
+    }
+
+  return 0 ;
+}
+
+
+/*
+ * Latency statistics:
+ *	Optional log-scale histograms of how late things happen - an ISR
+ *	being called after its edge, a softPwm or softServo edge after its
+ *	deadline. Each histogram only ever has one thread writing to it (the
+ *	one servicing that pin), so the updates are relaxed atomics, no locks,
+ *	and they're only made at all once wiringPiStatsEnable () is called.
+ *	wiringPiStatsShare () moves the table into shared memory so that
+ *	gpio stats can read it from outside.
+ *********************************************************************************
+ */
+
+static char statsName [64] ;
+
+static void statsAdd (struct wpiLatencyStruct *h, unsigned long long ns)
+{
+  int b = (ns == 0) ? 0 : 64 - __builtin_clzll (ns) ;
+
+  if (b >= WPI_STATS_BUCKETS)
+    b = WPI_STATS_BUCKETS - 1 ;
+
+  __atomic_fetch_add (&h->bucket [b], 1,  __ATOMIC_RELAXED) ;
+  __atomic_fetch_add (&h->count,      1,  __ATOMIC_RELAXED) ;
+  __atomic_fetch_add (&h->sumNs,      ns, __ATOMIC_RELAXED) ;
+  if (ns > __atomic_load_n (&h->maxNs, __ATOMIC_RELAXED))
+    __atomic_store_n (&h->maxNs, ns, __ATOMIC_RELAXED) ;
+}
+
+/*
+ * wiringPiStatsRecord: wiringPiStatsLate:
+ *	Add a latency to a histogram, or how late we are now for something
+ *	due at the given nanos64 () time. Cheap no-ops when stats are off.
+ *********************************************************************************
+ */
+
+void wiringPiStatsRecord (int type, int index, unsigned long long ns)
+{
+  if (!statsOn || (type < 0) || (type >= WPI_STATS_TYPES) || (index < 0) || (index >= WPI_STATS_INDEXES))
+    return ;
+
+  statsAdd (&statsTable->hist [type][index], ns) ;
+}
+
+void wiringPiStatsLate (int type, int index, unsigned long long deadline)
+{
+  unsigned long long now ;
+
+  if (!statsOn)
+    return ;
+
+  now = nanos64 () ;
+  wiringPiStatsRecord (type, index, (now > deadline) ? now - deadline : 0) ;
+}
+
+
+/*
+ * wiringPiStatsEnable:
+ * wiringPiStatsRead:
+ * wiringPiStatsReset:
+ *	Turn the recording on or off, copy a histogram out, and zero them all.
+ *********************************************************************************
+ */
+
+void wiringPiStatsEnable (int on)
+{
+  statsTable->magic = WPI_STATS_MAGIC ;
+  statsTable->pid   = getpid () ;
+
+  __atomic_store_n (&statsOn, on, __ATOMIC_RELEASE) ;
+}
+
+int wiringPiStatsRead (int type, int index, struct wpiLatencyStruct *hist)
+{
+  if ((type < 0) || (type >= WPI_STATS_TYPES) || (index < 0) || (index >= WPI_STATS_INDEXES))
+    return -1 ;
+
+  memcpy (hist, &statsTable->hist [type][index], sizeof (*hist)) ;
+
+  return 0 ;
+}
+
+void wiringPiStatsReset (void)
+{
+  struct wpiBusStatsStruct *b ;
+  int i ;
+
+  memset (statsTable->hist, 0, sizeof (statsTable->hist)) ;
+  memset (statsTable->pins, 0, sizeof (statsTable->pins)) ;
+
+  for (i = 0 ; i < WPI_STATS_NODES ; ++i)
+    __atomic_store_n (&statsTable->nodes [i].calls, 0, __ATOMIC_RELAXED) ;
+
+  for (i = 0 ; i < WPI_BUS_SLOTS ; ++i)
+  {
+    b = &statsTable->bus [i] ;
+    __atomic_store_n (&b->transactions, 0, __ATOMIC_RELAXED) ;
+    __atomic_store_n (&b->bytes,        0, __ATOMIC_RELAXED) ;
+    __atomic_store_n (&b->busyNs,       0, __ATOMIC_RELAXED) ;
+    __atomic_store_n (&b->errors,       0, __ATOMIC_RELAXED) ;
+    __atomic_store_n (&b->retries,      0, __ATOMIC_RELAXED) ;
+  }
+}
+
+
+/*
+ * Bus statistics:
+ *	Counters of transactions, bytes, time spent on the bus, errors and
+ *	retries, for each bus and each device on it. The drivers get a slot
+ *	when a device is opened, then bracket each transaction with
+ *	wiringPiBusStatsBegin () and wiringPiBusStatsEnd (). Devices can be
+ *	shared between threads, so unlike the histograms these really are
+ *	relaxed atomic adds, and like them they're skipped until
+ *	wiringPiStatsEnable () is called.
+ *********************************************************************************
+ */
+
+static pthread_mutex_t busStatsLock = PTHREAD_MUTEX_INITIALIZER ;
+
+static int busStatsFind (int type, const char *bus, int device, int parent)
+{
+  struct wpiBusStatsStruct *b ;
+  int i, spare = -1 ;
+
+  for (i = 0 ; i < WPI_BUS_SLOTS ; ++i)
+  {
+    b = &statsTable->bus [i] ;
+    if (b->type == 0)
+    {
+      if (spare < 0)
+	spare = i ;
+      continue ;
+    }
+    if ((b->type == type) && (b->device == device) && (strncmp (b->name, bus, WPI_BUS_NAME - 1) == 0))
+      return i ;
+  }
+
+  if (spare < 0)
+    return -1 ;
+
+  b = &statsTable->bus [spare] ;
+  memset (b, 0, sizeof (*b)) ;
+  strncpy (b->name, bus, WPI_BUS_NAME - 1) ;
+  b->device = device ;
+  b->bus    = (parent < 0) ? spare : parent ;
+  __atomic_store_n (&b->type, type, __ATOMIC_RELEASE) ;
+
+  return spare ;
+}
+
+/*
+ * wiringPiBusStatsSlot:
+ *	Find or make the slot for a device on a bus - an I2C address, SPI
+ *	channel, or -1 for a bus with only one thing on it - and the bus's
+ *	own slot for the totals. Returns the slot or -1 when they're all gone.
+ *********************************************************************************
+ */
+
+int wiringPiBusStatsSlot (int type, const char *bus, int device)
+{
+  int parent, slot ;
+
+  if ((type <= 0) || (bus == NULL))
+    return -1 ;
+
+  pthread_mutex_lock (&busStatsLock) ;
+    if ((parent = busStatsFind (type, bus, -1, -1)) < 0)
+      slot = -1 ;
+    else if (device < 0)
+      slot = parent ;
+    else
+      slot = busStatsFind (type, bus, device, parent) ;
+  pthread_mutex_unlock (&busStatsLock) ;
+
+  return slot ;
+}
+
+/*
+ * wiringPiBusStatsBegin: wiringPiBusStatsEnd: wiringPiBusStatsRetry:
+ *	Time a transaction and count it, with the bytes moved and whether it
+ *	failed, against the device and its bus. Cheap no-ops when stats are
+ *	off or the device has no slot.
+ *********************************************************************************
+ */
+
+unsigned long long wiringPiBusStatsBegin (void)
+{
+  return __atomic_load_n (&statsOn, __ATOMIC_RELAXED) ? nanos64 () : 0 ;
+}
+
+static void busStatsAdd (struct wpiBusStatsStruct *b, unsigned long long ns, unsigned int bytes, int error)
+{
+  __atomic_fetch_add (&b->transactions, 1,     __ATOMIC_RELAXED) ;
+  __atomic_fetch_add (&b->bytes,        bytes, __ATOMIC_RELAXED) ;
+  __atomic_fetch_add (&b->busyNs,       ns,    __ATOMIC_RELAXED) ;
+  if (error)
+    __atomic_fetch_add (&b->errors, 1, __ATOMIC_RELAXED) ;
+}
+
+void wiringPiBusStatsEnd (int slot, unsigned long long t0, unsigned int bytes, int error)
+{
+  unsigned long long now ;
+
+  if (!__atomic_load_n (&statsOn, __ATOMIC_RELAXED) || (slot < 0) || (slot >= WPI_BUS_SLOTS) || (t0 == 0))
+    return ;
+
+  now = nanos64 () ;
+  wiringPiBusStatsAdd (slot, (now > t0) ? now - t0 : 0, bytes, error) ;
+}
+
+/*
+ * wiringPiBusStatsAdd:
+ *	Count a transaction whose busy time is known rather than timed - a
+ *	serial port's is the time its bytes take on the wire.
+ *********************************************************************************
+ */
+
+void wiringPiBusStatsAdd (int slot, unsigned long long ns, unsigned int bytes, int error)
+{
+  struct wpiBusStatsStruct *b ;
+
+  if (!__atomic_load_n (&statsOn, __ATOMIC_RELAXED) || (slot < 0) || (slot >= WPI_BUS_SLOTS))
+    return ;
+
+  b = &statsTable->bus [slot] ;
+  busStatsAdd (b, ns, bytes, error) ;
+  if (b->bus != slot)
+    busStatsAdd (&statsTable->bus [b->bus], ns, bytes, error) ;
+}
+
+void wiringPiBusStatsRetry (int slot)
+{
+  struct wpiBusStatsStruct *b ;
+
+  if (!__atomic_load_n (&statsOn, __ATOMIC_RELAXED) || (slot < 0) || (slot >= WPI_BUS_SLOTS))
+    return ;
+
+  b = &statsTable->bus [slot] ;
+  __atomic_fetch_add (&b->retries, 1, __ATOMIC_RELAXED) ;
+  if (b->bus != slot)
+    __atomic_fetch_add (&statsTable->bus [b->bus].retries, 1, __ATOMIC_RELAXED) ;
+}
+
+/*
+ * wiringPiBusStatsRead:
+ *	Copy a slot out. Returns 0, or -1 if it's out of range or unused.
+ *********************************************************************************
+ */
+
+int wiringPiBusStatsRead (int slot, struct wpiBusStatsStruct *stats)
+{
+  struct wpiBusStatsStruct *b ;
+
+  if ((slot < 0) || (slot >= WPI_BUS_SLOTS))
+    return -1 ;
+
+  b = &statsTable->bus [slot] ;
+  if ((stats->type = __atomic_load_n (&b->type, __ATOMIC_ACQUIRE)) == 0)
+    return -1 ;
+
+  stats->device       = b->device ;
+  stats->bus          = b->bus ;
+  memcpy (stats->name, b->name, sizeof (stats->name)) ;
+  stats->transactions = __atomic_load_n (&b->transactions, __ATOMIC_RELAXED) ;
+  stats->bytes        = __atomic_load_n (&b->bytes,        __ATOMIC_RELAXED) ;
+  stats->busyNs       = __atomic_load_n (&b->busyNs,       __ATOMIC_RELAXED) ;
+  stats->errors       = __atomic_load_n (&b->errors,       __ATOMIC_RELAXED) ;
+  stats->retries      = __atomic_load_n (&b->retries,      __ATOMIC_RELAXED) ;
+
+  return 0 ;
+}
+
+
+/*
+ * wiringPiStatsShare:
+ *	Move the statistics into shared memory, WPI_STATS_SHM with our pid,
+ *	for gpio stats to find. It's removed again when we exit.
+ *	Returns 0 or -1.
+ *********************************************************************************
+ */
+
+static void statsUnlink (void)
+{
+  if (statsName [0] != 0)
+    shm_unlink (statsName) ;
+}
+
+int wiringPiStatsShare (void)
+{
+  struct wpiStatsTableStruct *shared ;
+  int fd ;
+
+  if (statsTable != &statsLocal)
+    return 0 ;
+
+  snprintf (statsName, sizeof (statsName), WPI_STATS_SHM, (int)getpid ()) ;
+
+  if ((fd = shm_open (statsName, O_CREAT | O_RDWR | O_TRUNC, 0644)) < 0)
+    return -1 ;
+
+  if (ftruncate (fd, sizeof (*shared)) < 0)
+  {
+    close (fd) ;
+    shm_unlink (statsName) ;
+    return -1 ;
+  }
+
+  shared = (struct wpiStatsTableStruct *)mmap (NULL, sizeof (*shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) ;
+  close (fd) ;
+
+  if (shared == MAP_FAILED)
+  {
+    shm_unlink (statsName) ;
+    return -1 ;
+  }
+
+  pthread_mutex_lock (&busStatsLock) ;
+    memcpy (shared, &statsLocal, sizeof (*shared)) ;
+    shared->magic = WPI_STATS_MAGIC ;
+    shared->pid   = getpid () ;
+    __atomic_store_n (&statsTable, shared, __ATOMIC_RELEASE) ;
+  pthread_mutex_unlock (&busStatsLock) ;
+
+  atexit (statsUnlink) ;
+
+  return 0 ;
+}
+
+
+/*
+ * Edge event rings:
+ *	Each BCM_GPIO pin can have a ring of timestamped edges, filled by the
+ *	interrupt code as it clears each interrupt down and emptied by
+ *	wiringPiEventRead (). A pin is only ever serviced by one thread at a
+ *	time and there is one reader, so each ring is single producer, single
+ *	consumer - a piRing with no locks.
+ *	With the GPIO character device we get every edge the kernel saw, with
+ *	the kernel's timestamp; with /sys/class/gpio we get one per wake-up,
+ *	the edge taken from the level we read back.
+ *********************************************************************************
+ */
+
+struct edgeRingStruct
+{
+  struct piRingStruct *ring ;
+  unsigned int  overruns ;
+  int           pin ;		// As passed to wiringPiEventEnable
+} ;
+
+static struct edgeRingStruct *edgeRings [64] ;
+static uint64_t isrEdgeTime [64] ;	// The last edge isrClear saw, for the ISR latency
+static uint64_t isrLastTime [64] ;	// ... and the most recent one, for the glitch filter
+static int      isrLastEdge [64] ;
+static int      edgeEventFd = -1 ;	// wiringPiEventFd, once asked for
+
+static void edgeSignal (void)
+{
+  uint64_t one = 1 ;
+  int fd = __atomic_load_n (&edgeEventFd, __ATOMIC_ACQUIRE) ;
+
+  if (fd != -1)
+    (void)write (fd, &one, sizeof (one)) ;
+}
+
+static void edgeRecord (int bcmGpioPin, int edge, uint64_t timestamp)
+{
+  struct edgeRingStruct *ring = edgeRings [bcmGpioPin] ;
+  struct wpiEdgeEventStruct ev ;
+
+  if (ring == NULL)
+    return ;
+
+  ev.pin       = ring->pin ;
+  ev.edge      = edge ;
+  ev.timestamp = timestamp ;
+
+  if (piRingPush (ring->ring, &ev, 1) == 0)	// Full
+    ++ring->overruns ;
+  else
+    edgeSignal () ;
+}
+
+
+/*
+ * Extension pin interrupts:
+ *	Pins on a node with an isr op get their edges from the node - an
+ *	expander's INT line, a remote server's pushes or a futex - as calls
+ *	to wiringPiNodeEdge () from a thread of the node's. Each pin that's
+ *	had wiringPiISR () or wiringPiEventEnable () has one of these; they
+ *	are never freed, so the list can be walked without the lock.
+ *********************************************************************************
+ */
+
+struct nodeIsrStruct
+{
+  int    pin ;
+  int    mode ;			// INT_EDGE_, or 0 when the node's not reporting
+  void (*function)(void) ;
+  void (*exFunction)(void *, const struct wpiEdgeEventStruct *) ;
+  void  *context ;
+  struct edgeRingStruct *ring ;
+  struct nodeIsrStruct  *next ;
+} ;
+
+static struct nodeIsrStruct *nodeIsrs = NULL ;
+static pthread_mutex_t       nodeIsrLock = PTHREAD_MUTEX_INITIALIZER ;
+
+static struct nodeIsrStruct *findNodeIsr (int pin, int create)
+{
+  struct nodeIsrStruct *n ;
+
+  for (n = __atomic_load_n (&nodeIsrs, __ATOMIC_ACQUIRE) ; n != NULL ; n = n->next)
+    if (n->pin == pin)
+      return n ;
+
+  if (!create)
+    return NULL ;
+
+  pthread_mutex_lock (&nodeIsrLock) ;
+
+  for (n = nodeIsrs ; n != NULL ; n = n->next)	// Someone else may have beaten us to it
+    if (n->pin == pin)
+      break ;
+
+  if ((n == NULL) && ((n = (struct nodeIsrStruct *)calloc (1, sizeof (struct nodeIsrStruct))) != NULL))
+  {
+    n->pin  = pin ;
+    n->next = nodeIsrs ;
+    __atomic_store_n (&nodeIsrs, n, __ATOMIC_RELEASE) ;
+  }
+
+  pthread_mutex_unlock (&nodeIsrLock) ;
+
+  return n ;
+}
+
+
+/*
+ * wiringPiNodeEdge:
+ *	For node drivers: an edge on one of the node's pins, at timestamp
+ *	(CLOCK_MONOTONIC nS, 0 for now). It goes into the pin's event ring
+ *	and to its ISR, which is called from here - so one thread at a time
+ *	for any one pin, please.
+ *********************************************************************************
+ */
+
+void wiringPiNodeEdge (int pin, int edge, unsigned long long timestamp)
+{
+  struct nodeIsrStruct *n ;
+  struct wpiEdgeEventStruct event ;
+  struct edgeRingStruct *ring ;
+  struct timespec ts ;
+  void (*function)(void) ;
+  void (*exFunction)(void *, const struct wpiEdgeEventStruct *) ;
+  void  *context ;
+  int    mode ;
+
+  if ((n = findNodeIsr (pin, FALSE)) == NULL)
+    return ;
+
+  if (timestamp == 0)
+  {
+    clock_gettime (CLOCK_MONOTONIC, &ts) ;
+    timestamp = (uint64_t)ts.tv_sec * (uint64_t)1000000000 + (uint64_t)ts.tv_nsec ;
+  }
+
+  pthread_mutex_lock (&nodeIsrLock) ;
+    mode       = n->mode ;
+    function   = n->function ;
+    exFunction = n->exFunction ;
+    context    = n->context ;
+    ring       = n->ring ;
+  pthread_mutex_unlock (&nodeIsrLock) ;
+
+  if ((mode == 0) || ((mode != INT_EDGE_BOTH) && (mode != edge)))
+    return ;
+
+  event.pin       = pin ;
+  event.edge      = edge ;
+  event.timestamp = timestamp ;
+
+  if (ring != NULL)
+  {
+    if (piRingPush (ring->ring, &event, 1) == 0)
+      ++ring->overruns ;
+    else
+      edgeSignal () ;
+  }
+
+  /**/ if (exFunction != NULL)
+    exFunction (context, &event) ;
+  else if (function != NULL)
+    function () ;
+}
+
+
+/*
+ * isrClear:
+ * isrCollect:
+ *	Clear down a pending interrupt on a BCM_GPIO pin, recording the
+ *	edge(s) if the pin has an event ring - and collecting up to maxOut
+ *	of them as well, numbered pin, for waitForInterrupts. Only call this
+ *	when we know there is something pending or it may block.
+ *********************************************************************************
+ */
+
+static int isrCollect (int bcmGpioPin, int pin, struct wpiEdgeEventStruct *out, int maxOut)
+{
+  struct wpiGpioEventStruct events [16] ;
+  struct timespec ts ;
+  uint8_t c ;
+  int n, i ;
+
+  if ((sysFds [bcmGpioPin] == -1) && (lineFds [bcmGpioPin] != -1))
+  {
+    n = gpioChipReadEvents (lineFds [bcmGpioPin], events, ((out == NULL) || (maxOut > 16)) ? 16 : maxOut) ;
+    for (i = 0 ; i < n ; ++i)
+    {
+      edgeRecord (bcmGpioPin, events [i].edge, events [i].timestamp) ;
+      if (out != NULL)
+      {
+	out [i].pin       = pin ;
+	out [i].edge      = events [i].edge ;
+	out [i].timestamp = events [i].timestamp ;
+      }
+    }
+    if (n > 0)
+    {
+      isrEdgeTime [bcmGpioPin] = events [0].timestamp ;	// The oldest is the latest to be serviced
+      isrLastTime [bcmGpioPin] = events [n - 1].timestamp ;
+      isrLastEdge [bcmGpioPin] = events [n - 1].edge ;
+    }
+    return (n < 0) ? 0 : n ;
+  }
+
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+  lseek (sysFds [bcmGpioPin], 0, SEEK_SET) ;	// Rewind
+  (void)read (sysFds [bcmGpioPin], &c, 1) ;	// Read & clear
+  isrEdgeTime [bcmGpioPin] = (uint64_t)ts.tv_sec * (uint64_t)1000000000 + (uint64_t)ts.tv_nsec ;
+  isrLastTime [bcmGpioPin] = isrEdgeTime [bcmGpioPin] ;
+  isrLastEdge [bcmGpioPin] = (c == '0') ? INT_EDGE_FALLING : INT_EDGE_RISING ;
+  edgeRecord (bcmGpioPin, isrLastEdge [bcmGpioPin], isrEdgeTime [bcmGpioPin]) ;
+
+  if ((out == NULL) || (maxOut < 1))
+    return 0 ;
+
+  out [0].pin       = pin ;
+  out [0].edge      = isrLastEdge [bcmGpioPin] ;
+  out [0].timestamp = isrEdgeTime [bcmGpioPin] ;
+
+  return 1 ;
+}
+
+static void isrClear (int bcmGpioPin)
+{
+  (void)isrCollect (bcmGpioPin, bcmGpioPin, NULL, 0) ;
+}
+
+
+/*
+ * isrFilter:
+ *	Decide whether the edge(s) just cleared on a pin get to the ISR.
+ *	Debounce: nothing within isrDebounce uS of the last edge let through.
+ *	Glitch: the pin has to stay at the level the edge left it at for
+ *	isrGlitch uS - unless the kernel is already doing that for us.
+ *********************************************************************************
+ */
+
+static int isrFilter (int pin, int bcmGpioPin)
+{
+  struct timespec ts ;
+  uint64_t edgeTime = isrEdgeTime [bcmGpioPin] ;
+  uint64_t now, settled ;
+
+  if ((isrDebounce [bcmGpioPin] != 0) && (isrAccepted [bcmGpioPin] != 0))
+    if ((edgeTime - isrAccepted [bcmGpioPin]) < (uint64_t)isrDebounce [bcmGpioPin] * 1000)
+      return FALSE ;
+
+  if ((isrGlitch [bcmGpioPin] != 0) && ((lineDebounceUs [bcmGpioPin] == 0) || (sysFds [bcmGpioPin] != -1)))
+  {
+    clock_gettime (CLOCK_MONOTONIC, &ts) ;
+    now     = (uint64_t)ts.tv_sec * (uint64_t)1000000000 + (uint64_t)ts.tv_nsec ;
+    settled = isrLastTime [bcmGpioPin] + (uint64_t)isrGlitch [bcmGpioPin] * 1000 ;
+
+    if (settled > now)
+      delayUntilNanos (nanos64 () + (settled - now)) ;
+
+    if (digitalRead (pin) != ((isrLastEdge [bcmGpioPin] == INT_EDGE_RISING) ? HIGH : LOW))
+      return FALSE ;
+  }
+
+  isrAccepted [bcmGpioPin] = edgeTime ;
+  return TRUE ;
+}
+
+
+/*
+ * isrCall:
+ *	Call the ISR for a pin, noting how long after the edge that was.
+ *	The edge times are CLOCK_MONOTONIC, so that's what we compare with.
+ *	With /sys/class/gpio we only know when we woke up, so that's just
+ *	the time it took to get here from there.
+ *********************************************************************************
+ */
+
+static void isrCall (int pin)
+{
+  struct wpiEdgeEventStruct event ;
+  struct timespec ts ;
+  uint64_t now ;
+  int bcmGpioPin = isrGpio [pin] ;
+
+  if (((isrDebounce [bcmGpioPin] | isrGlitch [bcmGpioPin]) != 0) && !isrFilter (pin, bcmGpioPin))
+    return ;
+
+  if (__atomic_load_n (&statsOn, __ATOMIC_RELAXED))
+  {
+    clock_gettime (CLOCK_MONOTONIC, &ts) ;
+    now = (uint64_t)ts.tv_sec * (uint64_t)1000000000 + (uint64_t)ts.tv_nsec ;
+    wiringPiStatsRecord (WPI_STATS_ISR, bcmGpioPin, (now > isrEdgeTime [bcmGpioPin]) ? now - isrEdgeTime [bcmGpioPin] : 0) ;
+  }
+
+  /**/ if (isrExFunctions [pin] != NULL)
+  {
+    event.pin       = pin ;
+    event.edge      = isrLastEdge [bcmGpioPin] ;
+    event.timestamp = isrLastTime [bcmGpioPin] ;
+    isrExFunctions [pin] (isrContexts [pin], &event) ;
+  }
+  else if (isrFunctions [pin] != NULL)
+    isrFunctions [pin] () ;
+}
+
+
+/*
+ * wiringPiEventEnable:
+ *	Start recording timestamped edges for a pin into a ring of the given
+ *	size (rounded up to a power of 2). Call this before wiringPiISR () on
+ *	the pin - the ISR function can be NULL if all you want is the events.
+ *	Extension pins work too if their node can interrupt.
+ *	Returns 0 or -1.
+ *********************************************************************************
+ */
+
+static struct edgeRingStruct *edgeRingCreate (int pin, int size)
+{
+  struct edgeRingStruct *ring ;
+
+  if (size < 16)
+    size = 16 ;
+
+  if ((ring = (struct edgeRingStruct *)calloc (1, sizeof (struct edgeRingStruct))) == NULL)
+    return NULL ;
+
+  if ((ring->ring = piRingCreate (PI_RING_SPSC, sizeof (struct wpiEdgeEventStruct), size, FALSE)) == NULL)
+  {
+    free (ring) ;
+    return NULL ;
+  }
+
+  ring->pin = pin ;
+
+  return ring ;
+}
+
+int wiringPiEventEnable (int pin, int size)
+{
+  struct edgeRingStruct *ring ;
+  struct nodeIsrStruct  *n ;
+  int bcmGpioPin ;
+
+  if ((pin < 0) || (pin > 63))
+  {
+    if ((n = findNodeIsr (pin, TRUE)) == NULL)
+      return -1 ;
+
+    pthread_mutex_lock (&nodeIsrLock) ;
+      if ((n->ring == NULL) && ((ring = edgeRingCreate (pin, size)) != NULL))
+	__atomic_store_n (&n->ring, ring, __ATOMIC_RELEASE) ;
+    pthread_mutex_unlock (&nodeIsrLock) ;
+
+    return (n->ring != NULL) ? 0 : -1 ;
+  }
+
+  /**/ if (wiringPiMode == WPI_MODE_PINS)
+    bcmGpioPin = pinToGpio [pin] ;
+  else if (wiringPiMode == WPI_MODE_PHYS)
+    bcmGpioPin = physToGpio [pin] ;
+  else if (wiringPiMode == WPI_MODE_UNINITIALISED)
+    return -1 ;
+  else
+    bcmGpioPin = pin ;
+
+  if (bcmGpioPin < 0)
+    return -1 ;
+
+  if (edgeRings [bcmGpioPin] != NULL)
+    return 0 ;
+
+  if ((ring = edgeRingCreate (pin, size)) == NULL)
+    return -1 ;
+
+  __atomic_store_n (&edgeRings [bcmGpioPin], ring, __ATOMIC_RELEASE) ;
+
+  return 0 ;
+}
+
+
+/*
+ * wiringPiEventFd:
+ *	An eventfd that's readable whenever any of the rings has edges in it,
+ *	for an event loop to wait on instead of polling wiringPiEventRead.
+ *	wiringPiEventRead clears it down, so read until it returns fewer than
+ *	you asked for. The same fd every time; returns -1 if it can't be made.
+ *********************************************************************************
+ */
+
+int wiringPiEventFd (void)
+{
+  int fd ;
+
+  if ((fd = __atomic_load_n (&edgeEventFd, __ATOMIC_ACQUIRE)) != -1)
+    return fd ;
+
+  if ((fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+    return -1 ;
+
+  pthread_mutex_lock (&pinMutex) ;
+    if (edgeEventFd == -1)
+      __atomic_store_n (&edgeEventFd, fd, __ATOMIC_RELEASE) ;
+    else
+    {
+      close (fd) ;
+      fd = edgeEventFd ;
+    }
+  pthread_mutex_unlock (&pinMutex) ;
+
+  return fd ;
+}
+
+
+/*
+ * wiringPiEventRead:
+ *	Copy up to maxEvents pending edges from all the pin rings into
+ *	events [] and return how many. It doesn't block. Events from one pin
+ *	are in order; there is no ordering between pins other than by the
+ *	timestamps. Only one thread should call this.
+ *********************************************************************************
+ */
+
+int wiringPiEventRead (struct wpiEdgeEventStruct *events, int maxEvents)
+{
+  struct edgeRingStruct *ring ;
+  int pin, count = 0 ;
+  uint64_t pending ;
+
+  struct nodeIsrStruct  *n ;
+
+  if (edgeEventFd != -1)		// Before we look, so nothing pushed after is missed
+    (void)read (edgeEventFd, &pending, sizeof (pending)) ;
+
+  for (pin = 0 ; (pin < 64) && (count < maxEvents) ; ++pin)
+  {
+    if ((ring = __atomic_load_n (&edgeRings [pin], __ATOMIC_ACQUIRE)) == NULL)
+      continue ;
+
+    count += piRingPop (ring->ring, &events [count], maxEvents - count) ;
+  }
+
+  for (n = __atomic_load_n (&nodeIsrs, __ATOMIC_ACQUIRE) ; (n != NULL) && (count < maxEvents) ; n = n->next)
+    if ((ring = __atomic_load_n (&n->ring, __ATOMIC_ACQUIRE)) != NULL)
+      count += piRingPop (ring->ring, &events [count], maxEvents - count) ;
+
+  return count ;
+}
+
+
+/*
+ * wiringPiEventReadPin:
+ *	As wiringPiEventRead, but just the one pin - for drivers that time
+ *	a pin's edges themselves without swallowing everyone else's.
+ *********************************************************************************
+ */
+
+int wiringPiEventReadPin (int pin, struct wpiEdgeEventStruct *events, int maxEvents)
+{
+  struct edgeRingStruct *ring ;
+  struct nodeIsrStruct  *n ;
+  int bcmGpioPin ;
+
+  if ((pin < 0) || (pin > 63))
+  {
+    if (((n = findNodeIsr (pin, FALSE)) == NULL) || ((ring = __atomic_load_n (&n->ring, __ATOMIC_ACQUIRE)) == NULL))
+      return -1 ;
+    return (maxEvents <= 0) ? 0 : (int)piRingPop (ring->ring, events, maxEvents) ;
+  }
+
+  /**/ if (wiringPiMode == WPI_MODE_PINS)
+    bcmGpioPin = pinToGpio [pin] ;
+  else if (wiringPiMode == WPI_MODE_PHYS)
+    bcmGpioPin = physToGpio [pin] ;
+  else
+    bcmGpioPin = pin ;
+
+  if ((bcmGpioPin < 0) || ((ring = __atomic_load_n (&edgeRings [bcmGpioPin], __ATOMIC_ACQUIRE)) == NULL))
+    return -1 ;
+
+  if (maxEvents <= 0)
+    return 0 ;
+
+  return piRingPop (ring->ring, events, maxEvents) ;
+}
+
+
+/*
+ * wiringPiEventPrecise:
+ *	Will the edges on this pin come from the GPIO character device - every
+ *	one, with the kernel's timestamp - once wiringPiISR () is called on it?
+ *	If not they're one per wake-up, timed when we got round to it, and
+ *	no good for measuring pulses.
+ *********************************************************************************
+ */
+
+int wiringPiEventPrecise (int pin)
+{
+  int bcmGpioPin ;
+
+  if ((pin < 0) || (pin > 63))
+    return FALSE ;
+
+  /**/ if (wiringPiMode == WPI_MODE_PINS)
+    bcmGpioPin = pinToGpio [pin] ;
+  else if (wiringPiMode == WPI_MODE_PHYS)
+    bcmGpioPin = physToGpio [pin] ;
+  else if (wiringPiMode == WPI_MODE_UNINITIALISED)
+    return FALSE ;
+  else
+    bcmGpioPin = pin ;
+
+  if (bcmGpioPin < 0)
+    return FALSE ;
+
+  return (sysFds [bcmGpioPin] == -1) && (gpioChipFd () != -1) ;
+}
+
+
+/*
+ * wiringPiEventOverruns:
+ *	How many edges have been lost on a pin because its ring was full.
+ *********************************************************************************
+ */
+
+unsigned int wiringPiEventOverruns (int pin)
+{
+  struct nodeIsrStruct *n ;
+  int bcmGpioPin ;
+
+  if ((pin < 0) || (pin > 63))
+    return (((n = findNodeIsr (pin, FALSE)) == NULL) || (n->ring == NULL)) ? 0 : n->ring->overruns ;
+
+  /**/ if (wiringPiMode == WPI_MODE_PINS)
+    bcmGpioPin = pinToGpio [pin] ;
+  else if (wiringPiMode == WPI_MODE_PHYS)
+    bcmGpioPin = physToGpio [pin] ;
+  else
+    bcmGpioPin = pin ;
+
+  if ((bcmGpioPin < 0) || (edgeRings [bcmGpioPin] == NULL))
+    return 0 ;
+
+  return edgeRings [bcmGpioPin]->overruns ;
+}
+
+
+/*
+ * waitForInterrupt:
+ *	Pi Specific.
+ *	Wait for Interrupt on a GPIO pin.
+ *	This is actually done via the kernel regardless of the wiringPi access
+ *	mode in-use - either a GPIO character device line request with edge
+ *	detection, or the older /sys/class/gpio interface.
+ *********************************************************************************
+ */
+
+int waitForInterrupt (int pin, int mS)
+{
+  int fd, x ;
+  struct pollfd polls ;
+
+  /**/ if (wiringPiMode == WPI_MODE_PINS)
+    pin = pinToGpio [pin] ;
+  else if (wiringPiMode == WPI_MODE_PHYS)
+    pin = physToGpio [pin] ;
+
+  if ((pin < 0) || (pin > 63))
+    return -2 ;
+
+// GPIO character device: Edges are queued by the kernel as events
+
+  if ((sysFds [pin] == -1) && (lineFds [pin] != -1) && (lineEdge [pin] > 0))
+  {
+    polls.fd     = lineFds [pin] ;
+    polls.events = POLLIN ;
+
+    if ((x = poll (&polls, 1, mS)) > 0)
+      isrClear (pin) ;	// Drain
+
+    return x ;
+  }
+
+  if ((fd = sysFds [pin]) == -1)
+    return -2 ;
+
+// Setup poll structure
+
+  polls.fd     = fd ;
+  polls.events = POLLPRI | POLLERR ;
+
+// Wait for it ...
+
+  x = poll (&polls, 1, mS) ;
+
+// If no error, do a dummy read to clear the interrupt
+//	A one character read appars to be enough.
+
+  if (x > 0)
+    isrClear (pin) ;
+
+  return x ;
+}
+
+
+/*
+ * waitForInterrupts:
+ *	Wait up to mS mS (-1 for ever) for an interrupt on any of n pins -
+ *	set up by the gpio program, or on the GPIO character device made
+ *	inputs with both edges the first time they're seen here. Not pins
+ *	with a wiringPiISR (), its thread would take the edges. Returns as
+ *	many of the pending edges as fit in out [], each with its pin as
+ *	given here and a CLOCK_MONOTONIC timestamp (the kernel's, on the
+ *	character device), 0 on timeout, -1 on error, or -2 if a pin isn't
+ *	an on-board one with interrupts on. With sysfs it's one edge per pin
+ *	per wake, timed when we saw it. Anything left over comes next call.
+ *********************************************************************************
+ */
+
+int waitForInterrupts (const int *pins, int n, int mS, struct wpiEdgeEventStruct *out, int maxOut)
+{
+  struct pollfd polls [64] ;
+  int bcm [64] ;
+  int i, pin, x, count ;
+
+  if ((pins == NULL) || (n < 1) || (n > 64) || (out == NULL) || (maxOut < 1))
+    return -2 ;
+
+  for (i = 0 ; i < n ; ++i)
+  {
+    pin = pins [i] ;
+
+    /**/ if (wiringPiMode == WPI_MODE_PINS)
+      pin = ((pin >= 0) && (pin < 64)) ? pinToGpio [pin] : -1 ;
+    else if (wiringPiMode == WPI_MODE_PHYS)
+      pin = ((pin >= 0) && (pin < 64)) ? physToGpio [pin] : -1 ;
+
+    if ((pin < 0) || (pin > 63))
+      return -2 ;
+
+    bcm [i] = pin ;
+
+    /**/ if (sysFds [pin] != -1)
+    {
+      polls [i].fd     = sysFds [pin] ;
+      polls [i].events = POLLPRI | POLLERR ;
+    }
+    else if (((lineFds [pin] != -1) && (lineEdge [pin] > 0)) ||
+	     ((gpioChipFd () != -1) && (chipLine (pin, INPUT, -1, INT_EDGE_BOTH) != -1)))
+    {
+      polls [i].fd     = lineFds [pin] ;
+      polls [i].events = POLLIN ;
+    }
+    else
+      return -2 ;
+  }
+
+  if ((x = poll (polls, n, mS)) <= 0)
+    return x ;
+
+  for (count = i = 0 ; (i < n) && (count < maxOut) ; ++i)
+    if (polls [i].revents != 0)
+      count += isrCollect (bcm [i], pins [i], &out [count], maxOut - count) ;
+
+  return count ;
+}
+
+
+/*
+ * interruptHandler:
+ *	This is a thread and gets started to wait for the interrupt we're
+ *	hoping to catch. It will call the user-function when the interrupt
+ *	fires.
+ *********************************************************************************
+ */
+
+static void *interruptHandler (void *arg)
+{
+  int myPin = (int)(intptr_t)arg ;
+
+  (void)piHiPri (55) ;	// Only effective if we run as root
+
+  for (;;)
+    if (waitForInterrupt (myPin, -1) > 0)
+      isrCall (myPin) ;
+
+  return NULL ;
+}
+
+
+/*
+ * isrEpollEvent:
+ *	Work out the fd and the epoll event for a BCM_GPIO interrupt pin.
+ *	/sys/class/gpio signals an edge as a priority event, the GPIO character
+ *	device as data to be read.
+ *********************************************************************************
+ */
+
+static int isrEpollEvent (int pin, struct epoll_event *ev)
+{
+  int bcmGpioPin = isrGpio [pin] ;
+
+  ev->data.u32 = pin ;
+
+  if (sysFds [bcmGpioPin] != -1)
+  {
+    ev->events = EPOLLPRI | EPOLLERR | EPOLLONESHOT ;
+    return sysFds [bcmGpioPin] ;
+  }
+
+  ev->events = EPOLLIN | EPOLLONESHOT ;
+  return lineFds [bcmGpioPin] ;
+}
+
+
+/*
+ * isrDispatchEvents: isrDispatcher:
+ *	A dispatcher thread. All of these wait on the one epoll set, and each
+ *	pin is registered one-shot so that a pin's callback never runs in two
+ *	threads at once - it's re-armed when the callback returns.
+ *********************************************************************************
+ */
+
+static int isrDispatchEvents (int timeout)
+{
+  struct epoll_event events [16] ;
+  struct epoll_event rearm ;
+  int    n, i, pin, fd ;
+
+  if ((n = epoll_wait (isrEpollFd, events, 16, timeout)) <= 0)
+    return n ;
+
+  for (i = 0 ; i < n ; ++i)
+  {
+    pin = events [i].data.u32 ;
+    isrClear (isrGpio [pin]) ;
+    isrCall  (pin) ;
+
+    fd = isrEpollEvent (pin, &rearm) ;
+    (void)epoll_ctl (isrEpollFd, EPOLL_CTL_MOD, fd, &rearm) ;
+  }
+
+  return n ;
+}
+
+static void *isrDispatcher (UNU void *arg)
+{
+  (void)piHiPri (55) ;	// Only effective if we run as root
+
+  for (;;)
+    if ((isrDispatchEvents (-1) < 0) && (errno != EINTR))
+      break ;
+
+  return NULL ;
+}
+
+// isrExecEvent:
+//	With the executive running, the epoll set is a watch on it - an
+//	epoll fd is readable when there's something in the set that's ready -
+//	and the callbacks run on the executive thread.
+
+static void isrExecEvent (UNU void *ctx, UNU unsigned int events)
+{
+  (void)isrDispatchEvents (0) ;
+}
+
+
+/*
+ * wiringPiISRDispatch:
+ *	Select how interrupts are delivered to ISRs registered from now on.
+ *	0 is the original way - a thread per pin. Anything else is the number
+ *	of dispatcher threads that will share all the interrupt pins. It only
+ *	makes sense to have more than 1 if callbacks may take a while.
+ *	Returns 0, or -1 if the dispatcher is already running with a different
+ *	number of threads.
+ *********************************************************************************
+ */
+
+int wiringPiISRDispatch (int numThreads)
+{
+  pthread_t threadId ;
+  int i ;
+
+  if (numThreads < 0)
+    numThreads = 0 ;
+
+  pthread_mutex_lock (&pinMutex) ;
+
+  if (isrEpollFd != -1)
+  {
+    pthread_mutex_unlock (&pinMutex) ;
+    return (numThreads == isrDispatch) ? 0 : -1 ;
+  }
+
+  if (numThreads > 0)
+  {
+    if ((isrEpollFd = epoll_create1 (EPOLL_CLOEXEC)) < 0)
+    {
+      isrEpollFd = -1 ;
+      pthread_mutex_unlock (&pinMutex) ;
+      return wiringPiFailure (WPI_ALMOST, "wiringPiISRDispatch: epoll_create1 failed: %s\n", strerror (errno)) ;
+    }
+
+    for (i = 0 ; i < numThreads ; ++i)
+      pthread_create (&threadId, NULL, isrDispatcher, NULL) ;
+  }
+
+  isrDispatch = numThreads ;
+  pthread_mutex_unlock (&pinMutex) ;
+
+  return 0 ;
+}
+
+
+/*
+ * wiringPiISRDispatchFd: wiringPiISRDispatchPoll:
+ *	The dispatcher with no threads at all, for a program with its own
+ *	event loop: the epoll set is handed back to be watched there (it's
+ *	readable when any pin has an edge waiting) and wiringPiISRDispatchPoll
+ *	runs the callbacks for whatever's ready, on the caller's thread,
+ *	without blocking. Call it before any wiringPiISR.
+ *	Returns the fd, or -1 with errno EBUSY if ISRs are already being
+ *	delivered some other way. Poll returns the number of pins serviced.
+ *********************************************************************************
+ */
+
+int wiringPiISRDispatchFd (void)
+{
+  int fd ;
+
+  pthread_mutex_lock (&pinMutex) ;
+
+  if (isrEpollFd != -1)
+  {
+    fd = isrEpollFd ;
+    pthread_mutex_unlock (&pinMutex) ;
+    if (isrDispatch == -1)
+      return fd ;
+    errno = EBUSY ;
+    return -1 ;
+  }
+
+  if ((isrEpollFd = epoll_create1 (EPOLL_CLOEXEC)) < 0)
+  {
+    isrEpollFd = -1 ;
+    pthread_mutex_unlock (&pinMutex) ;
+    return -1 ;
+  }
+
+  isrDispatch = -1 ;
+  fd = isrEpollFd ;
+  pthread_mutex_unlock (&pinMutex) ;
+
+  return fd ;
+}
+
+int wiringPiISRDispatchPoll (void)
+{
+  if (isrDispatch != -1)
+  {
+    errno = EBUSY ;
+    return -1 ;
+  }
+
+  return isrDispatchEvents (0) ;
+}
+
+
+/*
+ * Polled edge detection:
+ *	The GPIO block latches edges by itself - enable a pin in GPREN and/or
+ *	GPFEN and any edge sets its bit in GPEDS until it's cleared by writing
+ *	a 1 back. Spinning on GPEDS gets us edges well under a microsecond
+ *	after the fact, and catches pulses far too short to see by polling
+ *	the level, at the cost of a CPU - ideally one kept clear of everything
+ *	else with isolcpus=.
+ *	This bypasses the kernel, so don't use it on pins that also have a
+ *	wiringPiISR () - and note that the kernel sees GPEDS too, so it will
+ *	take an interrupt for each edge until we've cleared it.
+ *********************************************************************************
+ */
+
+static void            (*edgePollFunctions [64])(void) ;
+static unsigned int     edgePollMask [2] ;
+static volatile int     edgePollRunning = FALSE ;
+static pthread_t        edgePollThreadId ;
+static int              edgePollSpin    = -1 ;	// Its piSpin task, if it's there
+
+
+/*
+ * wiringPiEdgePoll:
+ *	Turn on hardware edge detection for a pin (in the current mode) and
+ *	give it a function to call from the polling thread, or NULL to just
+ *	collect the edges with wiringPiEdgePollRead (). An edge of
+ *	INT_EDGE_SETUP turns edge detection off again.
+ *	Returns 0 or -1.
+ *********************************************************************************
+ */
+
+int wiringPiEdgePoll (int pin, int edge, void (*function)(void))
+{
+  unsigned int bit ;
+  int bank ;
+
+  setupCheck ("wiringPiEdgePoll") ;
+
+  if ((pin & PI_GPIO_MASK) != 0)
+    return -1 ;
+
+  /**/ if (wiringPiMode == WPI_MODE_PINS)
+    pin = pinToGpio [pin] ;
+  else if (wiringPiMode == WPI_MODE_PHYS)
+    pin = physToGpio [pin] ;
+  else if (wiringPiMode != WPI_MODE_GPIO)
+    return -1 ;
+
+  if ((pin < 0) || (pin > 53) || (gpio == NULL))	// No GPEDS on the RP1
+    return -1 ;
+
+  bank = pin >> 5 ;
+  bit  = 1u << (pin & 31) ;
+
+  __atomic_and_fetch (&edgePollMask [bank], ~bit, __ATOMIC_RELEASE) ;
+  edgePollFunctions [pin] = function ;
+
+  if ((edge == INT_EDGE_RISING) || (edge == INT_EDGE_BOTH))
+    *(gpio + gpioToREN [pin]) |=  bit ;
+  else
+    *(gpio + gpioToREN [pin]) &= ~bit ;
+
+  if ((edge == INT_EDGE_FALLING) || (edge == INT_EDGE_BOTH))
+    *(gpio + gpioToFEN [pin]) |=  bit ;
+  else
+    *(gpio + gpioToFEN [pin]) &= ~bit ;
+
+  (void)wiringPiEdgePollRead (bank, bit) ;		// Forget anything stale
+
+  if (edge != INT_EDGE_SETUP)
+    __atomic_or_fetch (&edgePollMask [bank], bit, __ATOMIC_RELEASE) ;
+
+  return 0 ;
+}
+
+
+/*
+ * wiringPiEdgePollRead:
+ *	Return and clear the latched edges in a bank (0: GPIO 0-31, 1: GPIO
+ *	32-53) for the BCM_GPIO pins in mask - one read and one write. This is
+ *	for doing the spinning yourself rather than with wiringPiEdgePollStart.
+ *********************************************************************************
+ */
+
+unsigned int wiringPiEdgePollRead (int bank, unsigned int mask)
+{
+  unsigned int events ;
+
+  if ((bank < 0) || (bank > 1) || (gpio == NULL))
+    return 0 ;
+
+  if ((events = *(gpio + gpioToEDS [bank * 32]) & mask) != 0)
+  {
+    if (simulating)	// Plain memory - no write 1 to clear
+      __atomic_and_fetch (gpio + gpioToEDS [bank * 32], ~events, __ATOMIC_ACQ_REL) ;
+    else
+      *(gpio + gpioToEDS [bank * 32]) = events ;
+  }
+
+  return events ;
+}
+
+
+/*
+ * edgePollPass: edgePollThread: edgePollTask:
+ *	Look at GPEDS once, calling the functions for any pins with edges.
+ *	The thread does it for ever, so once it's running it has the CPU to
+ *	itself; on the busy-poll executive it's done once each time round.
+ *********************************************************************************
+ */
+
+static void edgePollPass (void)
+{
+  unsigned int events ;
+  int bank, bit ;
+
+  for (bank = 0 ; bank < 2 ; ++bank)
+  {
+    events = wiringPiEdgePollRead (bank, __atomic_load_n (&edgePollMask [bank], __ATOMIC_ACQUIRE)) ;
+
+    while (events != 0)
+    {
+      bit     = __builtin_ctz (events) ;
+      events &= events - 1 ;
+
+      if (edgePollFunctions [bank * 32 + bit] != NULL)
+	edgePollFunctions [bank * 32 + bit] () ;
+    }
+  }
+}
+
+static void *edgePollThread (UNU void *arg)
+{
+  while (edgePollRunning)
+    edgePollPass () ;
+
+  return NULL ;
+}
+
+static int edgePollTask (UNU void *ctx, UNU unsigned long long now)
+{
+  edgePollPass () ;
+  return TRUE ;
+}
+
+
+/*
+ * edgePollGone:
+ *	The busy-poll executive's stopped with us still on it: carry on with
+ *	a thread of our own.
+ *********************************************************************************
+ */
+
+static void edgePollGone (UNU void *ctx)
+{
+  edgePollSpin = -1 ;
+
+  if (pthread_create (&edgePollThreadId, NULL, edgePollThread, NULL) != 0)
+    edgePollRunning = FALSE ;
+}
+
+
+/*
+ * wiringPiEdgePollStart: wiringPiEdgePollStop:
+ *	Start the polling thread - on the given CPU if cpu is >= 0 - or stop it.
+ *	With the busy-poll executive running it's a task there instead, and
+ *	cpu is ignored - until piSpinStop (), when it's a thread again.
+ *	Returns 0 or -1.
+ *********************************************************************************
+ */
+
+int wiringPiEdgePollStart (int cpu)
+{
+  cpu_set_t cpus ;
+
+  setupCheck ("wiringPiEdgePollStart") ;
+
+  if ((wiringPiMode == WPI_MODE_GPIO_SYS) || edgePollRunning)
+    return -1 ;
+
+  edgePollRunning = TRUE ;
+
+  if (piSpinActive ())
+  {
+    if ((edgePollSpin = piSpinAdd (edgePollTask, edgePollGone, NULL, 2000)) < 0)	// nS: two reads and the callbacks
+    {
+      edgePollRunning = FALSE ;
+      return -1 ;
+    }
+    return 0 ;
+  }
+
+  if (pthread_create (&edgePollThreadId, NULL, edgePollThread, NULL) != 0)
+  {
+    edgePollRunning = FALSE ;
+    return -1 ;
+  }
+
+  if (cpu >= 0)
+  {
+    CPU_ZERO (&cpus) ;
+    CPU_SET  (cpu, &cpus) ;
+    if (pthread_setaffinity_np (edgePollThreadId, sizeof (cpus), &cpus) != 0)
+    {
+      wiringPiEdgePollStop () ;
+      return -1 ;
+    }
+  }
+
+  return 0 ;
+}
+
+void wiringPiEdgePollStop (void)
+{
+  if (!edgePollRunning)
+    return ;
+
+  edgePollRunning = FALSE ;
+
+  if (edgePollSpin >= 0)
+  {
+    piSpinRemove (edgePollSpin) ;
+    edgePollSpin = -1 ;
+  }
+  else
+    pthread_join (edgePollThreadId, NULL) ;
+}
+
+
+/*
+ * isrStart:
+ *	Hook the user function up to a pin that's now been setup for edges.
+ *	Either hand it to the dispatcher - which is just adding it to the epoll
+ *	set - or start a thread of its own.
+ *********************************************************************************
+ */
+
+static int isrStart (int pin, int bcmGpioPin, void (*function)(void),
+	void (*exFunction)(void *, const struct wpiEdgeEventStruct *), void *context)
+{
+  pthread_t threadId ;
+  struct epoll_event ev ;
+  int fd ;
+
+  pthread_mutex_lock (&pinMutex) ;
+
+  isrFunctions   [pin] = function ;
+  isrExFunctions [pin] = exFunction ;
+  isrContexts    [pin] = context ;
+  isrGpio      [pin] = bcmGpioPin ;
+
+  if ((isrEpollFd == -1) && piExecActive ())
+  {
+    if ((isrEpollFd = epoll_create1 (EPOLL_CLOEXEC)) >= 0)
+      if (piExecWatch (isrEpollFd, EPOLLIN, isrExecEvent, NULL) < 0)
+      {
+	close (isrEpollFd) ;
+	isrEpollFd = -1 ;
+      }
+  }
+
+  if (isrEpollFd == -1)
+  {
+    pthread_mutex_unlock (&pinMutex) ;
+    return pthread_create (&threadId, NULL, interruptHandler, (void *)(intptr_t)pin) ;
+  }
+
+  fd = isrEpollEvent (pin, &ev) ;
+
+  if (epoll_ctl (isrEpollFd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    if ((errno != EEXIST) || (epoll_ctl (isrEpollFd, EPOLL_CTL_MOD, fd, &ev) < 0))
+    {
+      pthread_mutex_unlock (&pinMutex) ;
+      return wiringPiFailure (WPI_FATAL, "wiringPiISR: epoll_ctl failed: %s\n", strerror (errno)) ;
+    }
+
+  pthread_mutex_unlock (&pinMutex) ;
+  return 0 ;
+}
+
+
+/*
+ * sysEdge:
+ *	Export a BCM_GPIO pin via /sys/class/gpio, make it an input and set the
+ *	edge to trigger on - all in-process. This is what "gpio edge" does, but
+ *	without the fork and exec. It needs write access to /sys/class/gpio so
+ *	will usually only work as root (or in the gpio group on newer kernels)
+ *	Returns 0 or -1 with errno set.
+ *********************************************************************************
+ */
+
+static int sysWrite (const char *fName, const char *data)
+{
+  int fd, len, ret ;
+
+  if ((fd = open (fName, O_WRONLY | O_CLOEXEC)) < 0)
+    return -1 ;
+
+  len = strlen (data) ;
+  ret = write (fd, data, len) ;
+  close (fd) ;
+
+  return (ret == len) ? 0 : -1 ;
+}
+
+static int sysEdge (int bcmGpioPin, const char *modeS)
+{
+  char fName [64] ;
+  char pinS   [8] ;
+
+  sprintf (pinS, "%d\n", bcmGpioPin) ;
+  if ((sysWrite ("/sys/class/gpio/export", pinS) < 0) && (errno != EBUSY))	// EBUSY: Already exported
+    return -1 ;
+
+  sprintf (fName, "/sys/class/gpio/gpio%d/direction", bcmGpioPin) ;
+  if (sysWrite (fName, "in\n") < 0)
+    return -1 ;
+
+  sprintf (fName, "/sys/class/gpio/gpio%d/edge", bcmGpioPin) ;
+  return sysWrite (fName, modeS) ;
+}
+
+
+/*
+ * wiringPiISRFilter:
+ *	Filter the edges on an interrupt pin before they reach its ISR, so
+ *	the ISR doesn't have to:
+ *	debounceUs: once an edge has got through, ignore any more for this
+ *	  long - contact bounce after a button press, say.
+ *	glitchUs: only pass edges where the pin then stays at its new level
+ *	  for this long, so noise spikes are ignored. With the GPIO character
+ *	  device the kernel does this (its "debounce"), otherwise the ISR
+ *	  thread waits out the time and checks the level.
+ *	0 turns either off. Call it before or after wiringPiISR ().
+ *	Returns 0 or -1.
+ *********************************************************************************
+ */
+
+int wiringPiISRFilter (int pin, unsigned int debounceUs, unsigned int glitchUs)
+{
+  int bcmGpioPin ;
+
+  if ((pin < 0) || (pin > 63))
+    return -1 ;
+
+  /**/ if (wiringPiMode == WPI_MODE_UNINITIALISED)
+    return -1 ;
+  else if (wiringPiMode == WPI_MODE_PINS)
+    bcmGpioPin = pinToGpio [pin] ;
+  else if (wiringPiMode == WPI_MODE_PHYS)
+    bcmGpioPin = physToGpio [pin] ;
+  else
+    bcmGpioPin = pin ;
+
+  if (bcmGpioPin < 0)
+    return -1 ;
+
+  isrDebounce [bcmGpioPin] = debounceUs ;
+  isrGlitch   [bcmGpioPin] = glitchUs ;
+  isrAccepted [bcmGpioPin] = 0 ;
+
+// Hand the glitch filter to the kernel if we can - now if the line's
+//	already requested, otherwise chipLine will when it is.
+
+  if ((sysFds [bcmGpioPin] != -1) || wiringPiSimActive ())
+    return 0 ;
+
+  lineDebounceUs [bcmGpioPin] = glitchUs ;
+
+  if (lineFds [bcmGpioPin] != -1)
+    if (gpioChipReconfig (lineFds [bcmGpioPin], 1, lineMode [bcmGpioPin], linePud [bcmGpioPin], lineEdge [bcmGpioPin], glitchUs) < 0)
+      lineDebounceUs [bcmGpioPin] = 0 ;		// Do it ourselves then
+
+  return 0 ;
+}
+
+
+/*
+ * nodeIsrAttach:
+ *	wiringPiISR () for a pin on an extension node: note the function and
+ *	ask the node to start reporting edges. INT_EDGE_SETUP means nothing
+ *	to a node, so it gets both edges.
+ *********************************************************************************
+ */
+
+static int nodeIsrAttach (int pin, int mode, void (*function)(void),
+	void (*exFunction)(void *, const struct wpiEdgeEventStruct *), void *context)
+{
+  struct wiringPiNodeStruct *node ;
+  struct nodeIsrStruct *n ;
+
+  if (((node = wiringPiFindNode (pin)) == NULL) || (node->isr == NULL))
+    return wiringPiFailure (WPI_FATAL, "wiringPiISR: pin %d can't interrupt - it must be 0-63 or on a node that can\n", pin) ;
+
+  if (mode == INT_EDGE_SETUP)
+    mode = INT_EDGE_BOTH ;
+
+  if ((n = findNodeIsr (pin, TRUE)) == NULL)
+    return wiringPiFailure (WPI_ALMOST, "wiringPiISR: Out of memory\n") ;
+
+  pthread_mutex_lock (&nodeIsrLock) ;
+    n->mode       = mode ;
+    n->function   = function ;
+    n->exFunction = exFunction ;
+    n->context    = context ;
+  pthread_mutex_unlock (&nodeIsrLock) ;
+
+  if (node->isr (node, pin, mode) < 0)
+  {
+    pthread_mutex_lock (&nodeIsrLock) ;
+      n->mode = 0 ;
+    pthread_mutex_unlock (&nodeIsrLock) ;
+    return wiringPiFailure (WPI_ALMOST, "wiringPiISR: pin %d: the node couldn't set up the interrupt\n", pin) ;
+  }
+
+  return 0 ;
+}
+
+
+/*
+ * isrAttach:
+ *	Pi Specific.
+ *	Take the details and create an interrupt handler that will do a call-
+ *	back to the user supplied function.
+ *********************************************************************************
+ */
+
+static int isrAttach (int pin, int mode, void (*function)(void),
+	void (*exFunction)(void *, const struct wpiEdgeEventStruct *), void *context)
+{
+  const char *modeS ;
+  char fName   [64] ;
+  char  pinS [8] ;
+  pid_t pid ;
   int   count, i ;
   char  c ;
   int   bcmGpioPin ;
 
-  if ((pin < 0) || (pin > 63))
-    return wiringPiFailure (WPI_FATAL, "wiringPiISR: pin must be 0-63 (%d)\n", pin) ;
+  if ((pin < 0) || (pin > 63))
+    return nodeIsrAttach (pin, mode, function, exFunction, context) ;
+
+  /**/ if (wiringPiMode == WPI_MODE_UNINITIALISED)
+    return wiringPiFailure (WPI_FATAL, "wiringPiISR: wiringPi has not been initialised. Unable to continue.\n") ;
+  else if (wiringPiMode == WPI_MODE_PINS)
+    bcmGpioPin = pinToGpio [pin] ;
+  else if (wiringPiMode == WPI_MODE_PHYS)
+    bcmGpioPin = physToGpio [pin] ;
+  else
+    bcmGpioPin = pin ;
+
+// If we have the GPIO character device, then request the line with edge
+//	detection directly - no exporting, no gpio program, no root.
+//	If the pin has already been exported via /sys/class/gpio then it's
+//	busy as far as the kernel is concerned, so we fall back to that.
+
+  if ((mode != INT_EDGE_SETUP) && (sysFds [bcmGpioPin] == -1) && (gpioChipFd () != -1))
+  {
+    useGpioChip = TRUE ;
+    if (chipLine (bcmGpioPin, INPUT, -1, mode) != -1)
+    {
+      isrEdge [bcmGpioPin] = mode ;
+      return isrStart (pin, bcmGpioPin, function, exFunction, context) ;
+    }
+  }
+
+// Now export the pin and set the right edge
+//	Try to do it ourselves first. If we're not allowed to, then we use the
+//	gpio program to do this, so it assumes a full installation of wiringPi.
+//	It's a bit 'clunky', but it is a way that will work when we're running
+//	in "Sys" mode, as a non-root user. (without sudo)
+
+  if (mode != INT_EDGE_SETUP)
+  {
+    /**/ if (mode == INT_EDGE_FALLING)
+      modeS = "falling" ;
+    else if (mode == INT_EDGE_RISING)
+      modeS = "rising" ;
+    else
+      modeS = "both" ;
+
+    sprintf (fName, "%s\n", modeS) ;
+    if (sysEdge (bcmGpioPin, fName) < 0)
+    {
+      sprintf (pinS, "%d", bcmGpioPin) ;
+
+      if ((pid = fork ()) < 0)	// Fail
+	return wiringPiFailure (WPI_FATAL, "wiringPiISR: fork failed: %s\n", strerror (errno)) ;
+
+      if (pid == 0)	// Child, exec
+      {
+	/**/ if (access ("/usr/local/bin/gpio", X_OK) == 0)
+	{
+	  execl ("/usr/local/bin/gpio", "gpio", "edge", pinS, modeS, (char *)NULL) ;
+	  return wiringPiFailure (WPI_FATAL, "wiringPiISR: execl failed: %s\n", strerror (errno)) ;
+	}
+	else if (access ("/usr/bin/gpio", X_OK) == 0)
+	{
+	  execl ("/usr/bin/gpio", "gpio", "edge", pinS, modeS, (char *)NULL) ;
+	  return wiringPiFailure (WPI_FATAL, "wiringPiISR: execl failed: %s\n", strerror (errno)) ;
+	}
+	else
+	  return wiringPiFailure (WPI_FATAL, "wiringPiISR: Can't find gpio program\n") ;
+      }
+      else		// Parent, wait
+	wait (NULL) ;
+    }
+  }
+
+// Now pre-open the /sys/class node - but it may already be open if
+//	we are in Sys mode...
+
+  if (sysFds [bcmGpioPin] == -1)
+  {
+    sprintf (fName, "/sys/class/gpio/gpio%d/value", bcmGpioPin) ;
+    if ((sysFds [bcmGpioPin] = open (fName, O_RDWR)) < 0)
+      return wiringPiFailure (WPI_FATAL, "wiringPiISR: unable to open %s: %s\n", fName, strerror (errno)) ;
+  }
+
+// Clear any initial pending interrupt
+
+  ioctl (sysFds [bcmGpioPin], FIONREAD, &count) ;
+  for (i = 0 ; i < count ; ++i)
+    read (sysFds [bcmGpioPin], &c, 1) ;
+
+  return isrStart (pin, bcmGpioPin, function, exFunction, context) ;
+}
+
+
+/*
+ * wiringPiISR: wiringPiISRex:
+ *	Call a function on edges on a pin: either a plain one, or one that's
+ *	given a context pointer of your own and the event - which edge and
+ *	when - so one function can look after any number of pins. If there
+ *	was a burst of edges by the time it's called, the event is the latest
+ *	of them (wiringPiEventRead has the lot).
+ *	Pins on extension nodes that can interrupt work the same way, the
+ *	function being called from the node's own thread.
+ *********************************************************************************
+ */
+
+int wiringPiISR (int pin, int mode, void (*function)(void))
+{
+  return isrAttach (pin, mode, function, NULL, NULL) ;
+}
+
+int wiringPiISRex (int pin, int mode, void (*function)(void *context, const struct wpiEdgeEventStruct *event), void *context)
+{
+  return isrAttach (pin, mode, NULL, function, context) ;
+}
+
+
+/*
+ * Quadrature encoders:
+ *	Both lines of an encoder go in the one GPIO character device request,
+ *	so the kernel hands us their edges in the order they happened. A
+ *	single thread, asleep in epoll, decodes the edges for every encoder
+ *	as they arrive with a table lookup - no user functions, no thread per
+ *	pin, and a burst of edges is just a bigger read. Edges the kernel had
+ *	to drop show up as gaps in the line sequence numbers.
+ *	Counts are kept in quarter cycles (every edge) and divided down for
+ *	X2 and X1 when read.
+ *********************************************************************************
+ */
+
+#define	MAX_ENCODERS	16
+
+struct encoderStruct
+{
+  int             fd ;		// Line request, -1 for a free slot
+  int             lines [2] ;	// BCM_GPIO of A and B
+  unsigned int    seqno [2] ;
+  int             divide ;	// Edges per count
+  int             state ;	// A << 1 | B
+  int64_t         count ;	// Edges, signed
+  uint64_t        lastEdge ;	// Timestamp of the last counted edge ...
+  uint64_t        interval ;	// ... and the time from the one before
+  unsigned int    errors ;
+  int64_t         readCount ;	// As at the last encoderRead
+  uint64_t        readEdge ;
+  double          velocity ;
+  pthread_mutex_t lock ;
+} ;
+
+static struct encoderStruct encoders [MAX_ENCODERS] ;
+static int encoderEpollFd = -1 ;
+
+// Old state << 2 | new state: +1 for A leading B, -1 for B leading A
+
+static const int quadTable [16] =
+{
+   0, -1,  1,  0,
+   1,  0,  0, -1,
+  -1,  0,  0,  1,
+   0,  1, -1,  0,
+} ;
+
+static void encoderDecode (struct encoderStruct *enc, const struct wpiGpioEventStruct *events, int n)
+{
+  int i, line, bit, state, step ;
+
+  for (i = 0 ; i < n ; ++i)
+  {
+    line = (events [i].line == enc->lines [0]) ? 0 : 1 ;
+    bit  = (line == 0) ? 2 : 1 ;
+
+    if ((enc->seqno [line] != 0) && (events [i].seqno != enc->seqno [line] + 1))
+      enc->errors += events [i].seqno - enc->seqno [line] - 1 ;
+    enc->seqno [line] = events [i].seqno ;
+
+    state = (events [i].edge == INT_EDGE_RISING) ? (enc->state | bit) : (enc->state & ~bit) ;
+    step  = quadTable [(enc->state << 2) | state] ;
+    enc->state = state ;
+
+    if (step == 0)
+      continue ;
+
+    enc->count += step ;
+    if (enc->lastEdge != 0)
+      enc->interval = events [i].timestamp - enc->lastEdge ;
+    enc->lastEdge = events [i].timestamp ;
+  }
+}
+
+static void *encoderThread (UNU void *arg)
+{
+  struct epoll_event        ready  [MAX_ENCODERS] ;
+  struct wpiGpioEventStruct events [64] ;
+  struct encoderStruct *enc ;
+  int n, i, got ;
+
+  (void)piHiPri (55) ;	// As the ISR threads
+
+  for (;;)
+  {
+    if ((n = epoll_wait (encoderEpollFd, ready, MAX_ENCODERS, -1)) < 0)
+    {
+      if (errno == EINTR)
+	continue ;
+      return NULL ;
+    }
+
+    for (i = 0 ; i < n ; ++i)
+    {
+      enc = (struct encoderStruct *)ready [i].data.ptr ;
+      if ((got = gpioChipReadEvents (enc->fd, events, 64)) <= 0)
+	continue ;
+
+      pthread_mutex_lock   (&enc->lock) ;
+      encoderDecode        (enc, events, got) ;
+      pthread_mutex_unlock (&enc->lock) ;
+    }
+  }
+
+  return NULL ;
+}
+
+
+/*
+ * encoderCreate:
+ *	Start decoding a quadrature encoder on two on-board pins, in the
+ *	current pin numbering. mode is ENCODER_X1, X2 or X4: counts per
+ *	cycle of A. The pins become inputs and belong to the encoder - don't
+ *	use wiringPiISR () on them. Needs the GPIO character device.
+ *	Returns the encoder number or -1.
+ *********************************************************************************
+ */
+
+int encoderCreate (int pinA, int pinB, int mode)
+{
+  struct epoll_event ev ;
+  struct timespec ts ;
+  struct encoderStruct *enc = NULL ;
+  pthread_t threadId ;
+  uint64_t values ;
+  int pins [2] = { pinA, pinB } ;
+  int i ;
+
+  setupCheck ("encoderCreate") ;
+
+  if ((mode != ENCODER_X1) && (mode != ENCODER_X2) && (mode != ENCODER_X4))
+    return -1 ;
+
+  for (i = 0 ; i < 2 ; ++i)
+  {
+    if ((pins [i] & PI_GPIO_MASK) != 0)
+      return -1 ;
+
+    /**/ if (wiringPiMode == WPI_MODE_PINS)
+      pins [i] = pinToGpio [pins [i]] ;
+    else if (wiringPiMode == WPI_MODE_PHYS)
+      pins [i] = physToGpio [pins [i]] ;
+    else if (wiringPiMode != WPI_MODE_GPIO)
+      return -1 ;
+
+    if ((pins [i] < 0) || (isrEdge [pins [i]] != 0) || (sysFds [pins [i]] != -1))
+      return -1 ;
+  }
+
+  if ((pins [0] == pins [1]) || (gpioChipFd () == -1))
+    return -1 ;
+
+  pthread_mutex_lock (&pinMutex) ;
+
+  if (encoderEpollFd == -1)
+  {
+    if ((encoderEpollFd = epoll_create1 (EPOLL_CLOEXEC)) < 0)
+    {
+      encoderEpollFd = -1 ;
+      pthread_mutex_unlock (&pinMutex) ;
+      return -1 ;
+    }
+
+    for (i = 0 ; i < MAX_ENCODERS ; ++i)
+    {
+      encoders [i].fd = -1 ;
+      pthread_mutex_init (&encoders [i].lock, NULL) ;
+    }
+
+    if (pthread_create (&threadId, NULL, encoderThread, NULL) != 0)
+    {
+      close (encoderEpollFd) ;
+      encoderEpollFd = -1 ;
+      pthread_mutex_unlock (&pinMutex) ;
+      return -1 ;
+    }
+    pthread_detach (threadId) ;
+  }
+
+  for (i = 0 ; i < MAX_ENCODERS ; ++i)
+    if (encoders [i].fd == -1)
+    {
+      enc = &encoders [i] ;
+      break ;
+    }
+
+  if (enc == NULL)
+  {
+    pthread_mutex_unlock (&pinMutex) ;
+    return -1 ;
+  }
+
+// The lines may already be ours from pinMode (), one at a time
+
+  for (i = 0 ; i < 2 ; ++i)
+    if (lineFds [pins [i]] != -1)
+    {
+      close (lineFds [pins [i]]) ;
+      lineFds [pins [i]] = -1 ;
+    }
+
+  pthread_mutex_lock (&enc->lock) ;
+
+  if ((enc->fd = gpioChipRequest (pins, 2, INPUT, -1, INT_EDGE_BOTH, 0)) < 0)
+  {
+    enc->fd = -1 ;
+    pthread_mutex_unlock (&enc->lock) ;
+    pthread_mutex_unlock (&pinMutex) ;
+    return -1 ;
+  }
+
+  if (gpioChipGet (enc->fd, 3, &values) < 0)
+    values = 0 ;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+
+  enc->lines [0]  = pins [0] ;
+  enc->lines [1]  = pins [1] ;
+  enc->seqno [0]  = enc->seqno [1] = 0 ;
+  enc->divide     = 4 / mode ;
+  enc->state      = (int)(((values & 1) << 1) | ((values >> 1) & 1)) ;
+  enc->count      = enc->readCount = 0 ;
+  enc->lastEdge   = enc->interval  = 0 ;
+  enc->readEdge   = (uint64_t)ts.tv_sec * (uint64_t)1000000000 + (uint64_t)ts.tv_nsec ;
+  enc->errors     = 0 ;
+  enc->velocity   = 0.0 ;
+
+  pthread_mutex_unlock (&enc->lock) ;
+
+  ev.events   = EPOLLIN ;
+  ev.data.ptr = enc ;
+  if (epoll_ctl (encoderEpollFd, EPOLL_CTL_ADD, enc->fd, &ev) < 0)
+  {
+    close (enc->fd) ;
+    enc->fd = -1 ;
+    pthread_mutex_unlock (&pinMutex) ;
+    return -1 ;
+  }
+
+  pthread_mutex_unlock (&pinMutex) ;
+
+  return (int)(enc - encoders) ;
+}
+
+
+/*
+ * encoderRead:
+ *	Return an encoder's count and, if velocity isn't NULL, its speed in
+ *	counts per second: over the edges since the last read, or the last
+ *	one, dropping to 0 once it's been still for a couple of those.
+ *********************************************************************************
+ */
+
+long long encoderRead (int encoder, double *velocity)
+{
+  struct encoderStruct *enc ;
+  struct timespec ts ;
+  uint64_t now ;
+  int64_t  count ;
+
+  if ((encoder < 0) || (encoder >= MAX_ENCODERS) || (encoders [encoder].fd == -1))
+    return 0 ;
 
-  /**/ if (wiringPiMode == WPI_MODE_UNINITIALISED)
-    return wiringPiFailure (WPI_FATAL, "wiringPiISR: wiringPi has not been initialised. Unable to continue.\n") ;
-  else if (wiringPiMode == WPI_MODE_PINS)
-    bcmGpioPin = pinToGpio [pin] ;
-  else if (wiringPiMode == WPI_MODE_PHYS)
-    bcmGpioPin = physToGpio [pin] ;
-  else
-    bcmGpioPin = pin ;
+  enc = &encoders [encoder] ;
 
-// Now export the pin and set the right edge
-//	We're going to use the gpio program to do this, so it assumes
-//	a full installation of wiringPi. It's a bit 'clunky', but it
-//	is a way that will work when we're running in "Sys" mode, as
-//	a non-root user. (without sudo)
+  pthread_mutex_lock (&enc->lock) ;
 
-  if (mode != INT_EDGE_SETUP)
+  if (enc->count != enc->readCount)
   {
-    /**/ if (mode == INT_EDGE_FALLING)
-      modeS = "falling" ;
-    else if (mode == INT_EDGE_RISING)
-      modeS = "rising" ;
-    else
-      modeS = "both" ;
+    if (enc->lastEdge > enc->readEdge)
+      enc->velocity = (double)(enc->count - enc->readCount) * 1.0e9 / (double)(enc->lastEdge - enc->readEdge) ;
+    enc->readCount = enc->count ;
+    enc->readEdge  = enc->lastEdge ;
+  }
+  else
+  {
+    clock_gettime (CLOCK_MONOTONIC, &ts) ;
+    now = (uint64_t)ts.tv_sec * (uint64_t)1000000000 + (uint64_t)ts.tv_nsec ;
+    if ((enc->interval == 0) || ((now - enc->lastEdge) > 2 * enc->interval))
+      enc->velocity = 0.0 ;
+  }
 
-    sprintf (pinS, "%d", bcmGpioPin) ;
+  count = enc->count ;
+  if (velocity != NULL)
+    *velocity = enc->velocity / enc->divide ;
 
-    if ((pid = fork ()) < 0)	// Fail
-      return wiringPiFailure (WPI_FATAL, "wiringPiISR: fork failed: %s\n", strerror (errno)) ;
+  pthread_mutex_unlock (&enc->lock) ;
 
-    if (pid == 0)	// Child, exec
-    {
-      /**/ if (access ("/usr/local/bin/gpio", X_OK) == 0)
-      {
-	execl ("/usr/local/bin/gpio", "gpio", "edge", pinS, modeS, (char *)NULL) ;
-	return wiringPiFailure (WPI_FATAL, "wiringPiISR: execl failed: %s\n", strerror (errno)) ;
-      }
-      else if (access ("/usr/bin/gpio", X_OK) == 0)
-      {
-	execl ("/usr/bin/gpio", "gpio", "edge", pinS, modeS, (char *)NULL) ;
-	return wiringPiFailure (WPI_FATAL, "wiringPiISR: execl failed: %s\n", strerror (errno)) ;
-      }
-      else
-	return wiringPiFailure (WPI_FATAL, "wiringPiISR: Can't find gpio program\n") ;
-    }
-    else		// Parent, wait
-      wait (NULL) ;
-  }
+  if (count >= 0)
+    return count / enc->divide ;
+  else
+    return -((-count + enc->divide - 1) / enc->divide) ;
+}
 
-// Now pre-open the /sys/class node - but it may already be open if
-//	we are in Sys mode...
 
-  if (sysFds [bcmGpioPin] == -1)
-  {
-    sprintf (fName, "/sys/class/gpio/gpio%d/value", bcmGpioPin) ;
-    if ((sysFds [bcmGpioPin] = open (fName, O_RDWR)) < 0)
-      return wiringPiFailure (WPI_FATAL, "wiringPiISR: unable to open %s: %s\n", fName, strerror (errno)) ;
-  }
+/*
+ * encoderWrite: encoderErrors:
+ *	Set an encoder's count, e.g. to zero it at a home switch, and return
+ *	how many edges the kernel has had to drop for it - each one is a
+ *	count that may be wrong.
+ *********************************************************************************
+ */
 
-// Clear any initial pending interrupt
+void encoderWrite (int encoder, long long value)
+{
+  struct encoderStruct *enc ;
 
-  ioctl (sysFds [bcmGpioPin], FIONREAD, &count) ;
-  for (i = 0 ; i < count ; ++i)
-    read (sysFds [bcmGpioPin], &c, 1) ;
+  if ((encoder < 0) || (encoder >= MAX_ENCODERS) || (encoders [encoder].fd == -1))
+    return ;
 
-  isrFunctions [pin] = function ;
+  enc = &encoders [encoder] ;
 
-  pthread_mutex_lock (&pinMutex) ;
-    pinPass = pin ;
-    pthread_create (&threadId, NULL, interruptHandler, NULL) ;
-    while (pinPass != -1)
-      delay (1) ;
-  pthread_mutex_unlock (&pinMutex) ;
+  pthread_mutex_lock (&enc->lock) ;
+  enc->count     = (int64_t)value * enc->divide ;
+  enc->readCount = enc->count ;
+  pthread_mutex_unlock (&enc->lock) ;
+}
 
-  return 0 ;
+unsigned int encoderErrors (int encoder)
+{
+  if ((encoder < 0) || (encoder >= MAX_ENCODERS) || (encoders [encoder].fd == -1))
+    return 0 ;
+
+  return __atomic_load_n (&encoders [encoder].errors, __ATOMIC_RELAXED) ;
 }
 
 
@@ -2104,6 +7064,8 @@ static void initialiseEpoch (void)
   epochMilli = (uint64_t)ts.tv_sec * (uint64_t)1000    + (uint64_t)(ts.tv_nsec / 1000000L) ;
   epochMicro = (uint64_t)ts.tv_sec * (uint64_t)1000000 + (uint64_t)(ts.tv_nsec /    1000L) ;
 #endif
+  epochNano  = epochMicro * (uint64_t)1000 ;
+  timeOffset = (timeSource == WPI_TIME_CLOCK) ? (int64_t)epochNano : (int64_t)sourceNanos () ;
 }
 
 
@@ -2139,20 +7101,26 @@ void delay (unsigned int howLong)
  *
  *      Plan B: It seems all might not be well with that plan, so changing it
  *      to use gettimeofday () and poll on that instead...
+ *
+ *	Plan C: gettimeofday is wall-clock time and jumps when NTP steps it,
+ *	so poll the raw monotonic clock instead.
  *********************************************************************************
  */
 
 void delayMicrosecondsHard (unsigned int howLong)
 {
-  struct timeval tNow, tLong, tEnd ;
+  struct timespec ts ;
+  uint64_t now, end ;
 
-  gettimeofday (&tNow, NULL) ;
-  tLong.tv_sec  = howLong / 1000000 ;
-  tLong.tv_usec = howLong % 1000000 ;
-  timeradd (&tNow, &tLong, &tEnd) ;
+  clock_gettime (CLOCK_MONOTONIC_RAW, &ts) ;
+  now = (uint64_t)ts.tv_sec * (uint64_t)1000000000 + (uint64_t)ts.tv_nsec ;
+  end = now + (uint64_t)howLong * (uint64_t)1000 ;
 
-  while (timercmp (&tNow, &tEnd, <))
-    gettimeofday (&tNow, NULL) ;
+  while (now < end)
+  {
+    clock_gettime (CLOCK_MONOTONIC_RAW, &ts) ;
+    now = (uint64_t)ts.tv_sec * (uint64_t)1000000000 + (uint64_t)ts.tv_nsec ;
+  }
 }
 
 void delayMicroseconds (unsigned int howLong)
@@ -2228,6 +7196,318 @@ unsigned int micros (void)
   return (uint32_t)(now - epochMicro) ;
 }
 
+
+/*
+ * Time sources:
+ *	The raw readings for the 64-bit time functions below.
+ *
+ *	WPI_TIME_CLOCK:    clock_gettime (CLOCK_MONOTONIC_RAW) as micros () uses
+ *	WPI_TIME_SYSTIMER: The BCM System Timer, memory mapped. 1uS resolution
+ *			   and it's a plain load, but needs /dev/mem (root)
+ *	WPI_TIME_CNTVCT:   The ARM generic timer virtual counter, read directly
+ *			   from user space. Not on the ARMv6 Pi 1 / Zero.
+ *********************************************************************************
+ */
+
+static inline uint64_t clockNanos (void)
+{
+  struct timespec ts ;
+
+  clock_gettime (CLOCK_MONOTONIC_RAW, &ts) ;
+  return (uint64_t)ts.tv_sec * (uint64_t)1000000000 + (uint64_t)ts.tv_nsec ;
+}
+
+static inline uint64_t sysTimerMicros (void)
+{
+  uint32_t hi, lo ;
+
+// The two halves can't be read atomically, so if the top half changes
+//	under us the bottom must have wrapped - read it again
+
+  do
+  {
+    hi = *(sysTimer + SYS_TIMER_CHI) ;
+    lo = *(sysTimer + SYS_TIMER_CLO) ;
+  } while (hi != *(sysTimer + SYS_TIMER_CHI)) ;
+
+  return ((uint64_t)hi << 32) | lo ;
+}
+
+static inline uint64_t cntvctRead (void)
+{
+  uint64_t count = 0 ;
+
+#if defined (__aarch64__)
+  __asm__ __volatile__ ("isb; mrs %0, cntvct_el0" : "=r" (count)) ;
+#elif defined (__ARM_ARCH) && (__ARM_ARCH >= 7)
+  uint32_t lo, hi ;
+  __asm__ __volatile__ ("isb; mrrc p15, 1, %0, %1, c14" : "=r" (lo), "=r" (hi)) ;
+  count = ((uint64_t)hi << 32) | lo ;
+#endif
+
+  return count ;
+}
+
+static uint64_t cntvctFreq (void)
+{
+  uint64_t freq = 0 ;
+
+#if defined (__aarch64__)
+  __asm__ __volatile__ ("mrs %0, cntfrq_el0" : "=r" (freq)) ;
+#elif defined (__ARM_ARCH) && (__ARM_ARCH >= 7)
+  uint32_t f ;
+  __asm__ __volatile__ ("mrc p15, 0, %0, c14, c0, 0" : "=r" (f)) ;
+  freq = f ;
+#endif
+
+  return freq ;
+}
+
+static inline uint64_t sourceNanos (void)
+{
+  uint64_t count ;
+
+  switch (timeSource)
+  {
+    case WPI_TIME_SYSTIMER:
+      return sysTimerMicros () * (uint64_t)1000 ;
+
+    case WPI_TIME_CNTVCT:
+      count = cntvctRead () ;
+      return (count / cntFreq) * (uint64_t)1000000000 + ((count % cntFreq) * (uint64_t)1000000000) / cntFreq ;
+
+    default:
+      return clockNanos () ;
+  }
+}
+
+
+/*
+ * wiringPiTimeSource:
+ *	Select where nanos64 (), micros64 () and millis64 () get their time.
+ *	The result carries on from the previous source without a jump.
+ *	Returns 0, or -1 if the source isn't available here.
+ *********************************************************************************
+ */
+
+int wiringPiTimeSource (int source)
+{
+  uint64_t now ;
+
+  now = nanos64 () ;
+
+  /**/ if (source == WPI_TIME_SYSTIMER)
+  {
+    if (sysTimer == NULL)
+      if ((sysTimer = wiringPiPeriMap (GPIO_SYS_TIMER_OFFSET, BLOCK_SIZE)) == NULL)
+	return -1 ;
+  }
+  else if (source == WPI_TIME_CNTVCT)
+  {
+    if ((cntFreq = cntvctFreq ()) == 0)
+      return -1 ;
+  }
+  else if (source != WPI_TIME_CLOCK)
+    return -1 ;
+
+  timeSource = source ;
+  timeOffset = (int64_t)(sourceNanos () - now) ;
+
+  return 0 ;
+}
+
+
+/*
+ * nanos64: micros64: millis64:
+ *	Return the time since the wiringPiSetup call as 64-bit values so there
+ *	are no wraps to worry about. The resolution depends on the time source,
+ *	see wiringPiTimeSource () - by default it's clock_gettime ().
+ *********************************************************************************
+ */
+
+unsigned long long nanos64 (void)
+{
+  return sourceNanos () - timeOffset ;
+}
+
+unsigned long long micros64 (void)
+{
+  return nanos64 () / 1000 ;
+}
+
+unsigned long long millis64 (void)
+{
+  return nanos64 () / 1000000 ;
+}
+
+
+/*
+ * delayCalibrate:
+ *	Find out how late clock_nanosleep wakes us up on this board, so that
+ *	delayUntil can sleep for all but that last part of a wait and spin for
+ *	the rest. We take the worst of a few short sleeps plus a little margin.
+ *	This is done once, the first time it's needed.
+ *********************************************************************************
+ */
+
+static uint64_t sleepSlack = 0 ;		// nS
+
+static void delayCalibrate (void)
+{
+  struct timespec sleeper ;
+  uint64_t start, late, worst = 0 ;
+  int i ;
+
+  sleeper.tv_sec  = 0 ;
+  sleeper.tv_nsec = 50000 ;
+
+  for (i = 0 ; i < 8 ; ++i)
+  {
+    start = clockNanos () ;
+    nanosleep (&sleeper, NULL) ;
+    late = clockNanos () - start - sleeper.tv_nsec ;
+    if (late > worst)
+      worst = late ;
+  }
+
+  worst += worst / 4 ;
+
+  /**/ if (worst <  10000) worst =  10000 ;	// 10uS to
+  else if (worst > 200000) worst = 200000 ;	// 200uS
+
+  if (wiringPiDebug)
+    printf ("delayCalibrate: Sleep slack: %llduS\n", (unsigned long long)(worst / 1000)) ;
+
+  sleepSlack = worst ;
+}
+
+
+/*
+ * delayUntilNanos: delayUntilMicros:
+ *	Wait until an absolute time, as returned by nanos64 () or micros64 ().
+ *	The bulk of the wait is an absolute clock_nanosleep, so the CPU is
+ *	free, with a short spin on the clock at the end for accuracy.
+ *	Use these for periodic work - add the period to the last deadline
+ *	rather than the current time and there's no accumulated drift.
+ *********************************************************************************
+ */
+
+void delayUntilNanos (unsigned long long deadline)
+{
+  struct timespec ts ;
+  uint64_t now, wake ;
+
+  if (sleepSlack == 0)
+    delayCalibrate () ;
+
+  if ((now = nanos64 ()) >= deadline)
+    return ;
+
+// clock_nanosleep doesn't do CLOCK_MONOTONIC_RAW, so sleep on CLOCK_MONOTONIC.
+//	They only differ in rate by NTP slew, which is negligible here and
+//	corrected by the spin anyway.
+
+  if ((deadline - now) > sleepSlack)
+  {
+    clock_gettime (CLOCK_MONOTONIC, &ts) ;
+    wake = (uint64_t)ts.tv_sec * (uint64_t)1000000000 + (uint64_t)ts.tv_nsec + (deadline - now) - sleepSlack ;
+    ts.tv_sec  = (time_t)(wake / 1000000000) ;
+    ts.tv_nsec = (long)(wake % 1000000000) ;
+    while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+      ;
+  }
+
+  while (nanos64 () < deadline)
+    ;
+}
+
+void delayUntilMicros (unsigned long long deadline)
+{
+  delayUntilNanos (deadline * 1000) ;
+}
+
+
+/*
+ * delayNanoseconds:
+ *	A short busy wait, for bit-banged timing finer than a microsecond.
+ *	Where there's an ARM generic timer it's watched directly - no system
+ *	call, no clock conversion - so the wait is right to within one tick
+ *	plus the ~20-50nS it takes to read it:
+ *	  Pi 2, 3, Zero 2:	19.2MHz - 52nS ticks
+ *	  Pi 4, 400, 5:		54MHz   - 18.5nS ticks
+ *	The ARMv6 Pi 1 and Zero have no counter user space can read, so it's
+ *	a loop calibrated against the clock the first time it's used, good
+ *	to ~10nS - as long as the CPU clock doesn't change after, so use the
+ *	performance governor.
+ *	Anything from 100uS up is delayUntilNanos (), which sleeps.
+ *	Like all busy waits it can be made longer by an interrupt or being
+ *	scheduled out. On the counter it's never shorter; the loop can be if
+ *	the CPU speeds up after it was calibrated.
+ *********************************************************************************
+ */
+
+static uint64_t delayFreq  = 0 ;		// Counter Hz, or 0 for the loop
+static uint64_t loopsPerNs = 0 ;		// Loops per nS << 16
+static int      delayReady = FALSE ;
+
+static void spinLoops (uint32_t loops)
+{
+  while (loops-- > 0)
+    __asm__ __volatile__ ("") ;
+}
+
+static void delayNanosCalibrate (void)
+{
+  uint64_t start, took, best = UINT64_MAX ;
+  int i ;
+
+  if ((delayFreq = cntvctFreq ()) == 0)
+  {
+    for (i = 0 ; i < 5 ; ++i)
+    {
+      start = clockNanos () ;
+      spinLoops (1000000) ;
+      if ((took = clockNanos () - start) < best)
+	best = took ;
+    }
+    loopsPerNs = (1000000ULL << 16) / ((best == 0) ? 1 : best) ;
+
+    if (wiringPiDebug)
+      printf ("delayNanoseconds: %llu loops per uS\n", (unsigned long long)((loopsPerNs * 1000) >> 16)) ;
+  }
+  else if (wiringPiDebug)
+    printf ("delayNanoseconds: counter at %lluHz\n", (unsigned long long)delayFreq) ;
+
+  __atomic_store_n (&delayReady, TRUE, __ATOMIC_RELEASE) ;
+}
+
+void delayNanoseconds (unsigned int howLong)
+{
+  uint64_t start, ticks ;
+
+  if (howLong == 0)
+    return ;
+
+  if (howLong >= 100000)
+  {
+    delayUntilNanos (nanos64 () + howLong) ;
+    return ;
+  }
+
+  if (!__atomic_load_n (&delayReady, __ATOMIC_ACQUIRE))
+    delayNanosCalibrate () ;
+
+  if (delayFreq != 0)
+  {
+    start = cntvctRead () ;
+    ticks = ((uint64_t)howLong * delayFreq + 999999999) / 1000000000 ;
+    while ((cntvctRead () - start) < ticks)
+      ;
+  }
+  else
+    spinLoops ((uint32_t)(((uint64_t)howLong * loopsPerNs) >> 16)) ;
+}
+
 /*
  * wiringPiVersion:
  *	Return our current version number
@@ -2272,6 +7552,24 @@ int wiringPiSetup (void)
   if (getenv (ENV_CODES) != NULL)
     wiringPiReturnCodes = TRUE ;
 
+  if (getenv (ENV_STATS) != NULL)
+  {
+    wiringPiStatsEnable (TRUE) ;
+    (void)wiringPiStatsShare () ;
+  }
+
+  if (getenv (ENV_FLIGHT) != NULL)
+    (void)wiringPiFlightRecorder ((atoi (getenv (ENV_FLIGHT)) > 0) ? atoi (getenv (ENV_FLIGHT)) : 4096) ;
+
+  if (getenv (ENV_LAZY) != NULL)
+    wiringPiNodeLazy (TRUE) ;
+
+  if ((getenv (ENV_SHARED) != NULL) && (wiringPiConfigShare () < 0))
+    (void)wiringPiFailure (WPI_ALMOST, "wiringPiSetup: Unable to share the configuration locks: %s\n", strerror (errno)) ;
+
+  if ((getenv (ENV_IMAGE) != NULL) && (wiringPiImageAttach () < 0))
+    (void)wiringPiFailure (WPI_ALMOST, "wiringPiSetup: Unable to attach to the input image: %s\n", strerror (errno)) ;
+
   if (wiringPiDebug)
     printf ("wiringPi: wiringPiSetup called\n") ;
 
@@ -2285,7 +7583,9 @@ int wiringPiSetup (void)
 
   if ((model == PI_MODEL_CM) ||
       (model == PI_MODEL_CM3) ||
-      (model == PI_MODEL_CM3P))
+      (model == PI_MODEL_CM3P) ||
+      (model == PI_MODEL_CM5) ||
+      (model == PI_MODEL_CM5L))
     wiringPiMode = WPI_MODE_GPIO ;
   else
     wiringPiMode = WPI_MODE_PINS ;
@@ -2318,6 +7618,13 @@ int wiringPiSetup (void)
       piGpioPupOffset = GPPUPPDN0 ;
       break ;
 
+    case PI_MODEL_5:	case PI_MODEL_CM5:
+    case PI_MODEL_500:	case PI_MODEL_CM5L:
+      piGpioBase = 0 ;			// No BCM peripherals to map: it's all on the RP1
+      piGpioPupOffset = GPPUD ;
+      rp1 = TRUE ;
+      break ;
+
     default:
       piGpioBase = GPIO_PERI_BASE_2835 ;
       piGpioPupOffset = GPPUD ;
@@ -2329,7 +7636,27 @@ int wiringPiSetup (void)
 //	Try /dev/mem. If that fails, then
 //	try /dev/gpiomem. If that fails then game over.
 
-  if ((fd = open ("/dev/mem", O_RDWR | O_SYNC | O_CLOEXEC)) < 0)
+  if ((simulating = wiringPiSimActive ()))
+  {
+    fd  = -1 ;
+    rp1 = FALSE ;		// The simulator is a BCM GPIO block, whatever the board
+  }
+  else if (rp1)
+  {
+    if (rp1Setup (&usingGpioMem) < 0)
+      return wiringPiFailure (WPI_ALMOST, "wiringPiSetup: Unable to map the RP1 GPIO with /dev/mem or /dev/gpiomem0: %s.\n"
+	"  Try running with sudo?\n", strerror (errno)) ;
+
+    gpioSet [0] = rp1Rio + RP1_SET + RP1_RIO_OUT ;
+    gpioClr [0] = rp1Rio + RP1_CLR + RP1_RIO_OUT ;
+    gpioLev [0] = rp1Rio + RP1_RIO_IN ;
+    gpioSet [1] = gpioClr [1] = gpioLev [1] = rp1Nowhere ;
+
+    initialiseEpoch () ;
+
+    return 0 ;
+  }
+  else if ((fd = open ("/dev/mem", O_RDWR | O_SYNC | O_CLOEXEC)) < 0)
   {
     if ((fd = open ("/dev/gpiomem", O_RDWR | O_SYNC | O_CLOEXEC) ) >= 0)	// We're using gpiomem
     {
@@ -2355,49 +7682,32 @@ int wiringPiSetup (void)
 
 //	GPIO:
 
-  gpio = (uint32_t *)mmap(0, BLOCK_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, GPIO_BASE) ;
+  gpio = mapBlock (fd, GPIO_BASE) ;
   if (gpio == MAP_FAILED)
     return wiringPiFailure (WPI_ALMOST, "wiringPiSetup: mmap (GPIO) failed: %s\n", strerror (errno)) ;
 
-//	PWM
-
-  pwm = (uint32_t *)mmap(0, BLOCK_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, GPIO_PWM) ;
-  if (pwm == MAP_FAILED)
-    return wiringPiFailure (WPI_ALMOST, "wiringPiSetup: mmap (PWM) failed: %s\n", strerror (errno)) ;
+  memFd = fd ;
 
-//	Clock control (needed for PWM)
-
-  clk = (uint32_t *)mmap(0, BLOCK_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, GPIO_CLOCK_BASE) ;
-  if (clk == MAP_FAILED)
-    return wiringPiFailure (WPI_ALMOST, "wiringPiSetup: mmap (CLOCK) failed: %s\n", strerror (errno)) ;
-
-//	The drive pads
-
-  pads = (uint32_t *)mmap(0, BLOCK_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, GPIO_PADS) ;
-  if (pads == MAP_FAILED)
-    return wiringPiFailure (WPI_ALMOST, "wiringPiSetup: mmap (PADS) failed: %s\n", strerror (errno)) ;
-
-//	The system timer
-
-  timer = (uint32_t *)mmap(0, BLOCK_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, GPIO_TIMER) ;
-  if (timer == MAP_FAILED)
-    return wiringPiFailure (WPI_ALMOST, "wiringPiSetup: mmap (TIMER) failed: %s\n", strerror (errno)) ;
-
-// Set the timer to free-running, 1MHz.
-//	0xF9 is 249, the timer divide is base clock / (divide+1)
-//	so base clock is 250MHz / 250 = 1MHz.
+  if (simulating)
+    simGpioAttach (gpio) ;
 
-  *(timer + TIMER_CONTROL) = 0x0000280 ;
-  *(timer + TIMER_PRE_DIV) = 0x00000F9 ;
-  timerIrqRaw = timer + TIMER_IRQ_RAW ;
+  gpioSet [0] = gpio + gpioToGPSET [0] ; gpioSet [1] = gpio + gpioToGPSET [32] ;
+  gpioClr [0] = gpio + gpioToGPCLR [0] ; gpioClr [1] = gpio + gpioToGPCLR [32] ;
+  gpioLev [0] = gpio + gpioToGPLEV [0] ; gpioLev [1] = gpio + gpioToGPLEV [32] ;
 
-// Export the base addresses for any external software that might need them
+// Export the base addresses for any external software that might need them.
+//	The rest are mapped on first use, unless asked for now
 
   _wiringPiGpio  = gpio ;
-  _wiringPiPwm   = pwm ;
-  _wiringPiClk   = clk ;
-  _wiringPiPads  = pads ;
-  _wiringPiTimer = timer ;
+  _wiringPiGpioDirect = simulating ? NULL : gpio ;
+
+  if (getenv (ENV_MAPALL) != NULL)
+  {
+    needPwm   () ;
+    needClk   () ;
+    needPads  () ;
+    needTimer () ;
+  }
 
   initialiseEpoch () ;
 
@@ -2456,6 +7766,10 @@ int wiringPiSetupPhys (void)
  * Initialisation (again), however this time we are using the /sys/class/gpio
  *	interface to the GPIO systems - slightly slower, but always usable as
  *	a non-root user, assuming the devices are already exported and setup correctly.
+ *
+ * Pins that are not exported are accessed via the GPIO character device
+ *	(/dev/gpiochip0) when the kernel has one, and there pinMode and
+ *	pullUpDnControl work too. Set WIRINGPI_SYSFS to use /sys/class/gpio only.
  */
 
 int wiringPiSetupSys (void)
@@ -2474,6 +7788,21 @@ int wiringPiSetupSys (void)
   if (getenv (ENV_CODES) != NULL)
     wiringPiReturnCodes = TRUE ;
 
+  if (getenv (ENV_STATS) != NULL)
+  {
+    wiringPiStatsEnable (TRUE) ;
+    (void)wiringPiStatsShare () ;
+  }
+
+  if (getenv (ENV_FLIGHT) != NULL)
+    (void)wiringPiFlightRecorder ((atoi (getenv (ENV_FLIGHT)) > 0) ? atoi (getenv (ENV_FLIGHT)) : 4096) ;
+
+  if (getenv (ENV_LAZY) != NULL)
+    wiringPiNodeLazy (TRUE) ;
+
+  if ((getenv (ENV_IMAGE) != NULL) && (wiringPiImageAttach () < 0))
+    (void)wiringPiFailure (WPI_ALMOST, "wiringPiSetupSys: Unable to attach to the input image: %s\n", strerror (errno)) ;
+
   if (wiringPiDebug)
     printf ("wiringPi: wiringPiSetupSys called\n") ;
 
@@ -2497,6 +7826,12 @@ int wiringPiSetupSys (void)
     sysFds [pin] = open (fName, O_RDWR) ;
   }
 
+// Anything not exported can be driven via the GPIO character device, unless
+//	we're told to stick to the old ways
+
+  if (getenv (ENV_SYSFS) == NULL)
+    useGpioChip = (gpioChipOpen (NULL) != -1) ;
+
   initialiseEpoch () ;
 
   wiringPiMode = WPI_MODE_GPIO_SYS ;
@@ -84,6 +84,44 @@
 #define	INT_EDGE_RISING		2
 #define	INT_EDGE_BOTH		3
 
+// Quadrature encoder counts per cycle
+
+#define	ENCODER_X1		1
+#define	ENCODER_X2		2
+#define	ENCODER_X4		4
+
+// piLockCreate types
+
+#define	PI_LOCK_NORMAL		0
+#define	PI_LOCK_PI		1
+#define	PI_LOCK_ADAPTIVE	2
+#define	PI_LOCK_TICKET		3
+
+// wiringPiNodeStruct flags
+
+#define	WPI_NODE_CACHE_OUTPUTS	1
+#define	WPI_NODE_INIT_PENDING	2	// Set by wiringPiNodeInit in lazy mode
+
+// gpioClockSetFreq sources - as the clock manager numbers them
+
+#define	WPI_CLOCK_ANY		0
+#define	WPI_CLOCK_OSC		1
+#define	WPI_CLOCK_PLLC		5
+#define	WPI_CLOCK_PLLD		6
+
+#define	WPI_CLOCK_MASH_AUTO	-1
+
+// piRingCreate types
+
+#define	PI_RING_SPSC		0
+#define	PI_RING_MPSC		1
+
+// Time sources for nanos64 (), micros64 () and millis64 ()
+
+#define	WPI_TIME_CLOCK		0
+#define	WPI_TIME_SYSTIMER	1
+#define	WPI_TIME_CNTVCT		2
+
 // Pi model types and version numbers
 //	Intended for the GPIO program Use at your own risk.
 
@@ -103,6 +141,10 @@
 #define	PI_MODEL_3AP 		14
 #define	PI_MODEL_CM3P 		16
 #define	PI_MODEL_4B 		17
+#define	PI_MODEL_5 		23
+#define	PI_MODEL_CM5 		24
+#define	PI_MODEL_500 		25
+#define	PI_MODEL_CM5L 		26
 
 #define	PI_VERSION_1		0
 #define	PI_VERSION_1_1		1
@@ -116,7 +158,7 @@
 #define	PI_MAKER_EMBEST4	4
 #define	PI_MAKER_STADIUM	5
 
-extern const char *piModelNames    [20] ;
+extern const char *piModelNames    [27] ;
 extern const char *piRevisionNames [18] ;
 extern const char *piMakerNames    [16] ;
 extern const int   piMemorySize    [ 8] ;
@@ -137,10 +179,9 @@ extern const int   piMemorySize    [ 8] ;
 // wiringPiNodeStruct:
 //	This describes additional device nodes in the extended wiringPi
 //	2.0 scheme of things.
-//	It's a simple linked list for now, but will hopefully migrate to
-//	a binary tree for efficiency reasons - but then again, the chances
-//	of more than 1 or 2 devices being added are fairly slim, so who
-//	knows....
+//	It's a simple linked list, but wiringPi also keeps the nodes in a
+//	table sorted by pinBase, so finding the node for a pin is a binary
+//	search rather than a walk down the list.
 
 struct wiringPiNodeStruct
 {
@@ -156,21 +197,221 @@ struct wiringPiNodeStruct
            void   (*pinMode)          (struct wiringPiNodeStruct *node, int pin, int mode) ;
            void   (*pullUpDnControl)  (struct wiringPiNodeStruct *node, int pin, int mode) ;
            int    (*digitalRead)      (struct wiringPiNodeStruct *node, int pin) ;
-//unsigned int    (*digitalRead8)     (struct wiringPiNodeStruct *node, int pin) ;
+  unsigned int    (*digitalRead8)     (struct wiringPiNodeStruct *node, int pin) ;
+  unsigned int    (*digitalRead16)    (struct wiringPiNodeStruct *node, int pin) ;
            void   (*digitalWrite)     (struct wiringPiNodeStruct *node, int pin, int value) ;
-//         void   (*digitalWrite8)    (struct wiringPiNodeStruct *node, int pin, int value) ;
+           void   (*digitalWrite8)    (struct wiringPiNodeStruct *node, int pin, int value) ;
+           void   (*digitalWrite16)   (struct wiringPiNodeStruct *node, int pin, int value) ;
+           void   (*digitalWriteMasked) (struct wiringPiNodeStruct *node, int pin, unsigned int value, unsigned int mask) ;
            void   (*pwmWrite)         (struct wiringPiNodeStruct *node, int pin, int value) ;
            int    (*analogRead)       (struct wiringPiNodeStruct *node, int pin) ;
+           int    (*analogReadMulti)  (struct wiringPiNodeStruct *node, int pin, int *values, int count) ;
            void   (*analogWrite)      (struct wiringPiNodeStruct *node, int pin, int value) ;
+           int    (*analogReadRange)  (struct wiringPiNodeStruct *node, int pin, int count, int *values) ;
+           void   (*analogWriteRange) (struct wiringPiNodeStruct *node, int pin, int count, const int *values) ;
+           int    (*digitalReadRange) (struct wiringPiNodeStruct *node, int pin, int count, int *values) ;
+           void   (*digitalWriteRange) (struct wiringPiNodeStruct *node, int pin, int count, const int *values) ;
+           void   (*digitalWriteSequence) (struct wiringPiNodeStruct *node, int pin, unsigned int mask, const unsigned int *values, int count) ;	// Optional
+           void   (*flush)            (struct wiringPiNodeStruct *node) ;	// Optional: see wiringPiCommit
+           int    (*init)             (struct wiringPiNodeStruct *node) ;	// Optional: see wiringPiNodeInit
+           int    (*isr)              (struct wiringPiNodeStruct *node, int pin, int mode) ;	// Optional: see wiringPiNodeEdge
+           int    (*digitalWriteAt)   (struct wiringPiNodeStruct *node, int pin, int value, unsigned long long tNs) ;	// Optional: see digitalWriteAt
+
+  unsigned int flags ;	// WPI_NODE_xxx
+  struct wpiAnalogFilterStruct *filters ;	// From analogReadFilter (), or NULL
+  int          stats ;	// Its slot in the statistics table plus one, or 0
 
   struct wiringPiNodeStruct *next ;
 } ;
 
 extern struct wiringPiNodeStruct *wiringPiNodes ;
 
-// Export variables for the hardware pointers
+// wpiPinStruct:
+//	A pre-resolved pin handle from wiringPiPinOpen (). All the work of
+//	mapping the pin through the current wiringPi mode and the look-up
+//	tables is done once, so the inline wpiPinWrite () and wpiPinRead ()
+//	below are just a test and a load or store for an on-board pin.
+//	Treat the contents as private.
+
+struct wpiPinStruct
+{
+  int pin ;				// As passed to wiringPiPinOpen
+  int gpio ;				// BCM_GPIO pin, or -1 for node pins
+
+  volatile unsigned int *set ;		// NULL if not memory mapped
+  volatile unsigned int *clr ;
+  volatile unsigned int *lev ;
+  unsigned int           mask ;
+
+  int sysFd ;				// Sys mode
+  struct wiringPiNodeStruct *node ;	// Extension node, or NULL
+} ;
+
+typedef struct wpiPinStruct *wpiPin_t ;
+
+// wpiEdgeEventStruct:
+//	A timestamped edge from wiringPiEventRead (), or for a wiringPiISRex ()
+//	function. A rising edge leaves the pin HIGH, a falling one LOW.
+//	The timestamp is CLOCK_MONOTONIC in nanoseconds.
+
+struct wpiEdgeEventStruct
+{
+  int pin ;				// As passed to wiringPiEventEnable
+  int edge ;				// INT_EDGE_RISING or INT_EDGE_FALLING
+  unsigned long long timestamp ;
+} ;
+
+// wpiLatencyStruct:
+//	A log-scale histogram from wiringPiStatsRead (), all in nS.
+//	bucket [0] counts latencies of 0, bucket [n] those from 2^(n-1) up to
+//	2^n, and the last bucket everything longer.
+
+#define	WPI_STATS_BUCKETS	32
+
+struct wpiLatencyStruct
+{
+  unsigned int       count ;
+  unsigned int       bucket [WPI_STATS_BUCKETS] ;
+  unsigned long long sumNs ;
+  unsigned long long maxNs ;
+} ;
+
+// What's measured, and what the index means for each
+
+#define	WPI_STATS_ISR		0	// Edge to ISR call, by BCM_GPIO pin
+#define	WPI_STATS_SOFTPWM	1	// How late softPwm edges are, by pin
+#define	WPI_STATS_SOFTSERVO	2	// How late softServo edges are, index 0
+#define	WPI_STATS_TYPES		3
+#define	WPI_STATS_INDEXES	64
+
+// The whole table, as shared by wiringPiStatsShare () under the name
+//	WPI_STATS_SHM with the pid filled in.
+
+#define	WPI_STATS_SHM		"/wiringPi-stats.%d"
+#define	WPI_STATS_MAGIC		0x57505333	// WPS3
+
+// wpiBusStatsStruct:
+//	Transaction counters for a bus, or for one device on it. A bus's own
+//	slot (device -1) is the total of all its devices; bus is the index
+//	of that slot for a device, and type 0 means the slot isn't in use.
+//	busyNs is the time spent inside transactions, so its rate against
+//	wall-clock time is the utilisation.
+
+#define	WPI_BUS_I2C		1
+#define	WPI_BUS_SPI		2
+#define	WPI_BUS_SERIAL		3
+#define	WPI_BUS_DRCNET		4
+
+#define	WPI_BUS_SLOTS		64
+#define	WPI_BUS_NAME		24
+
+struct wpiBusStatsStruct
+{
+  int                type ;
+  int                device ;
+  int                bus ;
+  char               name [WPI_BUS_NAME] ;
+  unsigned long long transactions ;
+  unsigned long long bytes ;
+  unsigned long long busyNs ;
+  unsigned long long errors ;
+  unsigned long long retries ;
+} ;
+
+// wpiPinStatsStruct: wpiNodeStatsStruct:
+//	Calls of digitalRead (), digitalWrite () and pwmWrite () on each
+//	on-board pin, by the number it was called with, and every call to an
+//	extension node. A node slot with pinMax 0 isn't in use.
+
+#define	WPI_STATS_NODES		32
+
+struct wpiPinStatsStruct
+{
+  unsigned long long reads ;
+  unsigned long long writes ;
+} ;
+
+struct wpiNodeStatsStruct
+{
+  int                pinBase ;
+  int                pinMax ;
+  unsigned long long calls ;
+} ;
+
+struct wpiStatsTableStruct
+{
+  unsigned int magic ;
+  int          pid ;
+  struct wpiLatencyStruct   hist  [WPI_STATS_TYPES][WPI_STATS_INDEXES] ;
+  struct wpiBusStatsStruct  bus   [WPI_BUS_SLOTS] ;
+  struct wpiPinStatsStruct  pins  [64] ;
+  struct wpiNodeStatsStruct nodes [WPI_STATS_NODES] ;
+} ;
+
+// The flight recorder, shared by wiringPiFlightRecorder () under the name
+//	WPI_FLIGHT_SHM with the pid filled in: a ring of records per thread.
+//	A record's time is in ticks of tickHz; tickBase was nanos64 () nsBase.
+
+#define	WPI_FLIGHT_SHM		"/wiringPi-flight.%d"
+#define	WPI_FLIGHT_MAGIC	0x57504631	// WPF1
+#define	WPI_FLIGHT_THREADS	32
+
+#define	WPI_FLIGHT_MODE		1	// pinMode
+#define	WPI_FLIGHT_PUD		2	// pullUpDnControl
+#define	WPI_FLIGHT_WRITE	3	// digitalWrite
+#define	WPI_FLIGHT_PWM		4	// pwmWrite
+#define	WPI_FLIGHT_AWRITE	5	// analogWrite
+#define	WPI_FLIGHT_MASKED	6	// digitalWrite8/16/Masked to a node
+
+#define	WPI_FLIGHT_FREE		0
+#define	WPI_FLIGHT_LIVE		1
+#define	WPI_FLIGHT_EXITED	2
+
+struct wpiFlightRecordStruct
+{
+  unsigned long long ticks ;
+  int                pin ;
+  unsigned int       op    :  8 ;
+  int                value : 24 ;
+} ;
+
+struct wpiFlightRingStruct
+{
+  int                state ;		// WPI_FLIGHT_FREE, _LIVE or _EXITED
+  int                tid ;
+  unsigned long long head ;		// Records written
+} __attribute__ ((aligned (64))) ;
+
+struct wpiFlightTableStruct
+{
+  unsigned int       magic ;
+  int                pid ;
+  unsigned int       records ;		// In each ring - a power of 2
+  unsigned int       threads ;
+  unsigned long long tickHz ;
+  unsigned long long tickBase ;
+  unsigned long long nsBase ;
+  struct wpiFlightRingStruct ring [WPI_FLIGHT_THREADS] ;
+} ;					// Then the records for each ring in turn
+
+// The on-board GPIO configuration from wiringPiSnapshot ()
+//	The pulls can only be read back on the 2711 (Pi 4) - havePulls says
+//	whether pull [] is valid.
+
+struct wpiStateStruct
+{
+  unsigned int fsel  [6] ;	// GPFSEL0-5: 3 bits per pin, 10 pins per register
+  unsigned int level [2] ;	// GPLEV0-1
+  unsigned int pull  [4] ;	// GPPUPPDN0-3: 2 bits per pin
+  int          havePulls ;
+} ;
+
+// Export variables for the hardware pointers.
+//	Only the GPIO is mapped by wiringPiSetup (), the rest on first use
+//	by wiringPi - set WIRINGPI_MAPALL to have them all mapped up-front.
 
 extern volatile unsigned int *_wiringPiGpio ;
+extern volatile unsigned int *_wiringPiGpioDirect ;	// NULL when stores won't drive the pins
 extern volatile unsigned int *_wiringPiPwm ;
 extern volatile unsigned int *_wiringPiClk ;
 extern volatile unsigned int *_wiringPiPads ;
@@ -196,6 +437,20 @@ extern int wiringPiFailure (int fatal, const char *message, ...) ;
 
 extern struct wiringPiNodeStruct *wiringPiFindNode (int pin) ;
 extern struct wiringPiNodeStruct *wiringPiNewNode  (int pinBase, int numPins) ;
+extern int                        wiringPiNodeRemove (int pinBase) ;
+
+extern void wiringPiBegin       (void) ;
+extern void wiringPiCommit      (void) ;
+extern int  wiringPiDeferred    (void) ;
+extern int  wiringPiNodeCacheOutputs (int pinBase, int on) ;
+extern void wiringPiNodeLazy     (int on) ;
+extern int  wiringPiNodeInit     (struct wiringPiNodeStruct *node, int (*init)(struct wiringPiNodeStruct *node)) ;
+
+extern int  wiringPiAsyncEnable  (int pinBase, int bus, int maxRate) ;
+extern void wiringPiAsyncDisable (int pinBase) ;
+extern void wiringPiAsyncFence   (int pinBase) ;
+extern int  wiringPiNodeDeferred (struct wiringPiNodeStruct *node) ;
+extern void wiringPiNodeChanged  (struct wiringPiNodeStruct *node) ;
 
 extern void wiringPiVersion	(int *major, int *minor) ;
 extern int  wiringPiSetup       (void) ;
@@ -209,10 +464,25 @@ extern          void pullUpDnControl     (int pin, int pud) ;
 extern          int  digitalRead         (int pin) ;
 extern          void digitalWrite        (int pin, int value) ;
 extern unsigned int  digitalRead8        (int pin) ;
+extern unsigned int  digitalRead16       (int pin) ;
 extern          void digitalWrite8       (int pin, int value) ;
+extern          void digitalWrite16      (int pin, int value) ;
+extern          void digitalWriteMasked  (int pin, unsigned int value, unsigned int mask) ;
+extern          void digitalWriteSequence (int pin, unsigned int mask, const unsigned int *values, int count) ;
 extern          void pwmWrite            (int pin, int value) ;
 extern          int  analogRead          (int pin) ;
 extern          void analogWrite         (int pin, int value) ;
+extern          int  analogReadRange     (int pin, int count, int *values) ;
+extern          void analogWriteRange    (int pin, int count, const int *values) ;
+extern          int  digitalReadRange    (int pin, int count, int *values) ;
+extern          void digitalWriteRange   (int pin, int count, const int *values) ;
+
+// Pre-resolved pin handles
+
+extern wpiPin_t      wiringPiPinOpen     (int pin) ;
+extern          void wiringPiPinClose    (wpiPin_t handle) ;
+extern          void wpiPinWriteSlow     (wpiPin_t handle, int value) ;
+extern          int  wpiPinReadSlow      (wpiPin_t handle) ;
 
 // PiFace specifics
 //	(Deprecated)
@@ -225,43 +495,191 @@ extern int  wiringPiSetupPiFaceForGpioProg (void) ;	// Don't use this - for gpio
 extern          int  piGpioLayout        (void) ;
 extern          int  piBoardRev          (void) ;	// Deprecated
 extern          void piBoardId           (int *model, int *rev, int *mem, int *maker, int *overVolted) ;
+extern unsigned int  wiringPiPeriBase    (void) ;
+extern volatile unsigned int *wiringPiPeriMap (unsigned int offset, unsigned int size) ;
 extern          int  wpiPinToGpio        (int wpiPin) ;
 extern          int  physPinToGpio       (int physPin) ;
 extern          void setPadDrive         (int group, int value) ;
 extern          int  getAlt              (int pin) ;
+extern          int  pinModeCapable      (int pin, int mode) ;
 extern          void pwmToneWrite        (int pin, int freq) ;
 extern          void pwmSetMode          (int mode) ;
 extern          void pwmSetRange         (unsigned int range) ;
+extern          int  pwmPinChannel       (int pin) ;
+extern          int  pwmSetModeCh        (int channel, int mode) ;
+extern          int  pwmSetRangeCh       (int channel, unsigned int range) ;
+extern          int  pwmSetPolarityCh    (int channel, int invert) ;
+extern          int  pwmEnableCh         (int channel, int enable) ;
 extern          void pwmSetClock         (int divisor) ;
+extern          void pwmStreamDma        (int dmaChannel) ;
+extern          int  pwmStream           (int channel, const unsigned int *samples, int numSamples, int sampleRate) ;
+extern          int  pwmStreamBusy       (void) ;
 extern          void gpioClockSet        (int pin, int freq) ;
+extern        double gpioClockSetFreq    (int pin, double freq, int source, int mash) ;
+extern        double gpioClockGet        (int pin) ;
 extern unsigned int  digitalReadByte     (void) ;
 extern unsigned int  digitalReadByte2    (void) ;
 extern          void digitalWriteByte    (int value) ;
 extern          void digitalWriteByte2   (int value) ;
+extern          void digitalWriteMask    (int bank, unsigned int setMask, unsigned int clrMask) ;
+extern          int  digitalWriteAt      (int pin, int value, unsigned long long tNs) ;
+extern          int  digitalWriteMaskAt  (int bank, unsigned int setMask, unsigned int clrMask, unsigned long long tNs) ;
+extern          int  digitalPulse        (int pin, unsigned int widthNs) ;
+extern          int  digitalBurst        (int pin, unsigned int highNs, unsigned int lowNs, int count) ;
+extern          void digitalWritePins    (const int *pins, int numPins, unsigned int value) ;
+extern unsigned int  digitalReadBank     (int bank) ;
+extern          int  digitalReadPins     (const int *pins, int numPins, unsigned char *out) ;
+extern          void pinModeMulti        (const int *pins, const int *modes, int numPins) ;
+extern          void pinModeMask         (int bank, unsigned int mask, int mode) ;
+extern          void pullUpDnControlMulti (const int *pins, const int *puds, int numPins) ;
+extern          void pullUpDnMask        (int bank, unsigned int mask, int pud) ;
+extern          int  wiringPiSnapshot    (struct wpiStateStruct *state) ;
+extern          int  wiringPiRestore     (const struct wpiStateStruct *state) ;
 
 // Interrupts
 //	(Also Pi hardware specific)
 
 extern int  waitForInterrupt    (int pin, int mS) ;
+extern int  waitForInterrupts   (const int *pins, int n, int mS, struct wpiEdgeEventStruct *out, int maxOut) ;
 extern int  wiringPiISR         (int pin, int mode, void (*function)(void)) ;
+extern int  wiringPiISRex       (int pin, int mode, void (*function)(void *context, const struct wpiEdgeEventStruct *event), void *context) ;
+extern int  wiringPiISRDispatch (int numThreads) ;
+extern int  wiringPiISRDispatchFd   (void) ;
+extern int  wiringPiISRDispatchPoll (void) ;
+extern int  wiringPiISRFilter   (int pin, unsigned int debounceUs, unsigned int glitchUs) ;
+extern void wiringPiNodeEdge    (int pin, int edge, unsigned long long timestamp) ;
+
+extern          int  wiringPiEdgePoll      (int pin, int edge, void (*function)(void)) ;
+extern unsigned int  wiringPiEdgePollRead  (int bank, unsigned int mask) ;
+extern          int  wiringPiEdgePollStart (int cpu) ;
+extern          void wiringPiEdgePollStop  (void) ;
+
+extern          int  encoderCreate         (int pinA, int pinB, int mode) ;
+extern long long     encoderRead           (int encoder, double *velocity) ;
+extern          void encoderWrite          (int encoder, long long value) ;
+extern unsigned int  encoderErrors         (int encoder) ;
+
+extern          int  wiringPiEventEnable   (int pin, int size) ;
+extern          int  wiringPiEventFd       (void) ;
+extern          int  wiringPiEventRead     (struct wpiEdgeEventStruct *events, int maxEvents) ;
+extern          int  wiringPiEventReadPin  (int pin, struct wpiEdgeEventStruct *events, int maxEvents) ;
+extern          int  wiringPiEventPrecise  (int pin) ;
+extern unsigned int  wiringPiEventOverruns (int pin) ;
 
 // Threads
 
 extern int  piThreadCreate      (void *(*fn)(void *)) ;
+extern int  piThreadCreateRT    (void *(*fn)(void *), void *arg, int policy, int prio, unsigned int cpuMask, unsigned int stackSize) ;
+extern int  piLockCreate        (int type) ;
 extern void piLock              (int key) ;
 extern void piUnlock            (int key) ;
 
+// Lock-free rings
+
+struct piRingStruct ;
+
+extern struct piRingStruct *piRingCreate (int type, unsigned int elemSize, unsigned int count, int wakeup) ;
+extern void                 piRingFree   (struct piRingStruct *ring) ;
+extern unsigned int         piRingPush   (struct piRingStruct *ring, const void *elems, unsigned int n) ;
+extern unsigned int         piRingPop    (struct piRingStruct *ring, void *elems, unsigned int max) ;
+extern unsigned int         piRingCount  (struct piRingStruct *ring) ;
+extern unsigned int         piRingSpace  (struct piRingStruct *ring) ;
+extern int                  piRingFd     (struct piRingStruct *ring) ;
+
+// Periodic tasks
+
+extern int  piPeriodicCreate (unsigned long long periodNs, void (*fn)(void *ctx), void *ctx, int prio) ;
+extern void piPeriodicDelete (int task) ;
+extern int  piPeriodicStats  (int task, unsigned int *overruns, unsigned int *maxNs, unsigned int *meanNs) ;
+extern int  piPeriodicFd     (int task) ;
+extern int  piPeriodicRun    (int task) ;
+
+// The single-thread executive: see piExec.c
+
+#define	PI_EXEC_IDLE	(~0ULL)
+
+extern int  piExecStart  (int prio, unsigned int cpuMask) ;
+extern int  piExecActive (void) ;
+extern int  piExecTimer  (unsigned long long deadline, unsigned long long (*fn)(void *ctx, unsigned long long deadline), void *ctx) ;
+extern int  piExecWatch  (int fd, unsigned int events, void (*fn)(void *ctx, unsigned int events), void *ctx) ;
+extern void piExecWake   (int task, unsigned long long deadline) ;
+extern void piExecCancel (int task) ;
+extern int  piExecStats  (int task, unsigned int *maxNs, unsigned int *meanNs) ;
+
+// The busy-poll executive: see piSpin.c
+
+extern int  piSpinStart  (int cpu, int prio) ;
+extern int  piSpinActive (void) ;
+extern int  piSpinAdd    (int (*fn)(void *ctx, unsigned long long now), void (*gone)(void *ctx), void *ctx, unsigned int budgetNs) ;
+extern void piSpinRemove (int task) ;
+extern int  piSpinStats  (int task, unsigned int *maxNs, unsigned int *overBudget) ;
+extern void piSpinStop   (void) ;
+
 // Schedulling priority
 
-extern int piHiPri (const int pri) ;
+extern int  piHiPri           (const int pri) ;
+extern int  piRtSetup         (unsigned int cpuMask) ;
+extern int  piRtCpus          (unsigned int mask) ;
+extern void piRtStackPrefault (void) ;
+extern int  piRtPerformanceBegin (unsigned int cpuMask) ;
+extern void piRtPerformanceEnd   (void) ;
 
 // Extras from arduino land
 
 extern void         delay             (unsigned int howLong) ;
 extern void         delayMicroseconds (unsigned int howLong) ;
+extern void         delayNanoseconds  (unsigned int howLong) ;
 extern unsigned int millis            (void) ;
 extern unsigned int micros            (void) ;
 
+extern int                wiringPiTimeSource (int source) ;
+extern unsigned long long nanos64            (void) ;
+extern unsigned long long micros64           (void) ;
+extern unsigned long long millis64           (void) ;
+extern void               delayUntilNanos    (unsigned long long deadline) ;
+extern void               delayUntilMicros   (unsigned long long deadline) ;
+
+// Latency statistics
+
+extern void wiringPiStatsEnable (int on) ;
+extern int  wiringPiStatsShare  (void) ;
+extern int  wiringPiStatsRead   (int type, int index, struct wpiLatencyStruct *hist) ;
+extern void wiringPiStatsReset  (void) ;
+extern void wiringPiStatsRecord (int type, int index, unsigned long long ns) ;
+extern void wiringPiStatsLate   (int type, int index, unsigned long long deadline) ;
+
+extern int  wiringPiBusStatsSlot  (int type, const char *bus, int device) ;
+extern unsigned long long wiringPiBusStatsBegin (void) ;
+extern void wiringPiBusStatsEnd   (int slot, unsigned long long t0, unsigned int bytes, int error) ;
+extern void wiringPiBusStatsAdd   (int slot, unsigned long long ns, unsigned int bytes, int error) ;
+extern void wiringPiBusStatsRetry (int slot) ;
+extern int  wiringPiBusStatsRead  (int slot, struct wpiBusStatsStruct *stats) ;
+
+// Flight recorder
+
+extern int  wiringPiFlightRecorder (unsigned int records) ;
+
+// wpiPinWrite: wpiPinRead:
+//	The fast paths for a pin handle. Anything that isn't a memory mapped
+//	on-board pin goes via the out-of-line versions.
+
+static inline void wpiPinWrite (wpiPin_t h, int value)
+{
+  if (h->set == 0)
+    wpiPinWriteSlow (h, value) ;
+  else if (value == LOW)
+    *h->clr = h->mask ;
+  else
+    *h->set = h->mask ;
+}
+
+static inline int wpiPinRead (wpiPin_t h)
+{
+  if (h->lev == 0)
+    return wpiPinReadSlow (h) ;
+  return ((*h->lev & h->mask) != 0) ? HIGH : LOW ;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,343 @@
+/*
+ * wiringPi.hpp:
+ *	Header-only C++ pins with the pin number fixed at compile time.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+/*
+ * Notes:
+ *	digitalWrite () has to map the pin through the current wiringPi mode
+ *	on every call. When the pin is known when the program is compiled
+ *	all of that can be done by the compiler, leaving a single store:
+ *
+ *	  typedef wpi::Pin<wpi::Bcm<17> > Led ;
+ *	  Led::mode (OUTPUT) ;
+ *	  Led::high () ;
+ *
+ *	  typedef wpi::PinGroup<wpi::Bcm<22>, wpi::Wpi<0>, wpi::Phys<13> > Bus ;
+ *	  Bus::write (0x5) ;		// One GPCLR and one GPSET store
+ *
+ *	Pins are named with Bcm<>, Wpi<> or Phys<> - whichever wiringPi mode
+ *	you set up with - or Node<> for extension node pins, which go through
+ *	the normal C calls. Wpi<> and Phys<> use the layout of every Pi since
+ *	the Rev 2 Model B.
+ *
+ *	Call one of the wiringPiSetup functions first as usual. The register
+ *	stores are only used when they really drive the pins - not in Sys
+ *	mode or when simulating - otherwise it's digitalWriteMask () and
+ *	friends, so programs still work everywhere, just more slowly.
+ *
+ *	Needs C++11.
+ *********************************************************************************
+ */
+
+#ifndef	__WIRING_PI_HPP__
+#define	__WIRING_PI_HPP__
+
+#include "wiringPi.h"
+
+namespace wpi
+{
+
+namespace detail
+{
+  // Word offsets of the bank 0 registers
+
+  enum { GPSET0 = 7, GPCLR0 = 10, GPLEV0 = 13 } ;
+
+  // As pinToGpioR2 [] and physToGpioR2 [] in wiringPi.c
+
+  constexpr int wpiTable [32] =
+  {
+    17, 18, 27, 22, 23, 24, 25,  4,  2,  3,  8,  7, 10,  9, 11, 14,
+    15, 28, 29, 30, 31,  5,  6, 13, 19, 26, 12, 16, 20, 21,  0,  1,
+  } ;
+
+  constexpr int physTable [41] =
+  {
+    -1, -1, -1,  2, -1,  3, -1,  4, 14, -1, 15, 17, 18, 27, -1, 22,
+    23, -1, 24, 10, -1,  9, 25, 11,  8, -1,  7,  0,  1,  5, -1,  6,
+    12, 13, -1, 19, 16, 26, 20, -1, 21,
+  } ;
+
+  constexpr int wpiToBcm (int pin)
+  {
+    return ((pin >= 0) && (pin < 32)) ? wpiTable [pin] : -1 ;
+  }
+
+  constexpr int physToBcm (int pin)		// P5 on the Rev 2 Model B is 51-54
+  {
+    return ((pin >= 0) && (pin < 41)) ? physTable [pin] : ((pin >= 51) && (pin <= 54)) ? pin - 23 : -1 ;
+  }
+}
+
+
+// Pin names
+
+template <int N> struct Bcm
+{
+  static_assert ((N >= 0) && (N < 54), "wpi::Bcm: no such GPIO") ;
+  static constexpr int pin  = N ;
+  static constexpr int gpio = N ;
+} ;
+
+template <int N> struct Wpi
+{
+  static_assert (detail::wpiToBcm (N) >= 0, "wpi::Wpi: no such wiringPi pin") ;
+  static constexpr int pin  = N ;
+  static constexpr int gpio = detail::wpiToBcm (N) ;
+} ;
+
+template <int N> struct Phys
+{
+  static_assert (detail::physToBcm (N) >= 0, "wpi::Phys: not a GPIO pin on the header") ;
+  static constexpr int pin  = N ;
+  static constexpr int gpio = detail::physToBcm (N) ;
+} ;
+
+template <int N> struct Node
+{
+  static_assert (N >= 64, "wpi::Node: extension node pins start at 64") ;
+  static constexpr int pin  = N ;
+  static constexpr int gpio = -1 ;
+} ;
+
+
+/*
+ * Pin:
+ *	One pin, all static - there's nothing to construct.
+ *********************************************************************************
+ */
+
+template <class P> struct Pin
+{
+  static constexpr int          gpio = P::gpio ;
+  static constexpr int          bank = gpio >> 5 ;
+  static constexpr unsigned int mask = 1u << (gpio & 31) ;
+
+  static inline void high (void)
+  {
+    volatile unsigned int *g = _wiringPiGpioDirect ;
+
+    if (g != nullptr)
+      g [detail::GPSET0 + bank] = mask ;
+    else
+      digitalWriteMask (bank, mask, 0) ;
+  }
+
+  static inline void low (void)
+  {
+    volatile unsigned int *g = _wiringPiGpioDirect ;
+
+    if (g != nullptr)
+      g [detail::GPCLR0 + bank] = mask ;
+    else
+      digitalWriteMask (bank, 0, mask) ;
+  }
+
+  static inline void write (int value)
+  {
+    if (value == LOW)
+      low () ;
+    else
+      high () ;
+  }
+
+  static inline int read (void)
+  {
+    volatile unsigned int *g = _wiringPiGpio ;
+
+    if ((g != nullptr) && (_wiringPiGpioDirect != nullptr))
+      return ((g [detail::GPLEV0 + bank] & mask) != 0) ? HIGH : LOW ;
+    return ((digitalReadBank (bank) & mask) != 0) ? HIGH : LOW ;
+  }
+
+  static inline void mode (int m)  { pinModeMask (bank, mask, m) ; }
+  static inline void pud  (int p)  { pullUpDnMask (bank, mask, p) ; }
+} ;
+
+// Extension node pins: the usual dispatch
+
+template <int N> struct Pin<Node<N> >
+{
+  static constexpr int gpio = -1 ;
+
+  static inline void high  (void)      { digitalWrite (N, HIGH) ; }
+  static inline void low   (void)      { digitalWrite (N, LOW) ; }
+  static inline void write (int value) { digitalWrite (N, value) ; }
+  static inline int  read  (void)      { return digitalRead (N) ; }
+  static inline void mode  (int m)     { pinMode (N, m) ; }
+  static inline void pud   (int p)     { pullUpDnControl (N, p) ; }
+} ;
+
+
+/*
+ * PinGroup:
+ *	Up to 32 pins written and read together. Bit N of a value is the Nth
+ *	pin in the list. The on-board pins in each bank change with one
+ *	GPCLR and one GPSET store, the masks all worked out by the compiler;
+ *	any Node<> pins follow one at a time.
+ *********************************************************************************
+ */
+
+namespace detail
+{
+  template <int Bank, class... Ps> struct Masks ;
+
+  template <int Bank> struct Masks<Bank>
+  {
+    static constexpr unsigned int all = 0 ;
+    static constexpr int          nodes = 0 ;
+
+    static inline unsigned int spread  (unsigned int, int)  { return 0 ; }
+    static inline unsigned int gather  (unsigned int, int)  { return 0 ; }
+    static inline void         nodeWrite (unsigned int, int) { }
+    static inline unsigned int nodeRead  (int)               { return 0 ; }
+    static inline void         nodeMode  (int)               { }
+  } ;
+
+  template <int Bank, class P, class... Ps> struct Masks<Bank, P, Ps...>
+  {
+    typedef Masks<Bank, Ps...> Rest ;
+
+    static constexpr bool         mine  = (P::gpio >= 0) && ((P::gpio >> 5) == Bank) ;
+    static constexpr unsigned int bit   = mine ? (1u << (P::gpio & 31)) : 0 ;
+    static constexpr unsigned int all   = bit | Rest::all ;
+    static constexpr int          nodes = (P::gpio < 0 ? 1 : 0) + Rest::nodes ;
+
+// Value bits (bit i for pin i) to register bits, and back
+
+    static inline unsigned int spread (unsigned int value, int i)
+    {
+      return (((value >> i) & 1) ? bit : 0) | Rest::spread (value, i + 1) ;
+    }
+
+    static inline unsigned int gather (unsigned int reg, int i)
+    {
+      return (((reg & bit) != 0) ? (1u << i) : 0) | Rest::gather (reg, i + 1) ;
+    }
+
+    static inline void nodeWrite (unsigned int value, int i)
+    {
+      if (P::gpio < 0)
+	digitalWrite (P::pin, (value >> i) & 1) ;
+      Rest::nodeWrite (value, i + 1) ;
+    }
+
+    static inline unsigned int nodeRead (int i)
+    {
+      return ((P::gpio < 0) ? ((unsigned int)digitalRead (P::pin) << i) : 0) | Rest::nodeRead (i + 1) ;
+    }
+
+    static inline void nodeMode (int m)
+    {
+      if (P::gpio < 0)
+	pinMode (P::pin, m) ;
+      Rest::nodeMode (m) ;
+    }
+  } ;
+}
+
+template <class... Ps> struct PinGroup
+{
+  static_assert (sizeof... (Ps) <= 32, "wpi::PinGroup: 32 pins at most") ;
+
+  typedef detail::Masks<0, Ps...> Bank0 ;
+  typedef detail::Masks<1, Ps...> Bank1 ;
+
+  static constexpr unsigned int mask0 = Bank0::all ;
+  static constexpr unsigned int mask1 = Bank1::all ;
+
+  static inline void writeMasks (unsigned int set0, unsigned int clr0, unsigned int set1, unsigned int clr1)
+  {
+    volatile unsigned int *g = _wiringPiGpioDirect ;
+
+    if (g != nullptr)
+    {
+      if (mask0 != 0) { g [detail::GPCLR0] = clr0 ; g [detail::GPSET0] = set0 ; }
+      if (mask1 != 0) { g [detail::GPCLR0 + 1] = clr1 ; g [detail::GPSET0 + 1] = set1 ; }
+    }
+    else
+    {
+      if (mask0 != 0) digitalWriteMask (0, set0, clr0) ;
+      if (mask1 != 0) digitalWriteMask (1, set1, clr1) ;
+    }
+  }
+
+  static inline void write (unsigned int value)
+  {
+    unsigned int set0 = Bank0::spread (value, 0) ;
+    unsigned int set1 = Bank1::spread (value, 0) ;
+
+    writeMasks (set0, mask0 & ~set0, set1, mask1 & ~set1) ;
+    if (Bank0::nodes != 0)
+      Bank0::nodeWrite (value, 0) ;
+  }
+
+  static inline void high (void)
+  {
+    writeMasks (mask0, 0, mask1, 0) ;
+    if (Bank0::nodes != 0)
+      Bank0::nodeWrite (~0u, 0) ;
+  }
+
+  static inline void low (void)
+  {
+    writeMasks (0, mask0, 0, mask1) ;
+    if (Bank0::nodes != 0)
+      Bank0::nodeWrite (0, 0) ;
+  }
+
+  static inline unsigned int read (void)
+  {
+    volatile unsigned int *g = _wiringPiGpio ;
+    unsigned int lev0 = 0, lev1 = 0, value ;
+
+    if ((g != nullptr) && (_wiringPiGpioDirect != nullptr))
+    {
+      if (mask0 != 0) lev0 = g [detail::GPLEV0] ;
+      if (mask1 != 0) lev1 = g [detail::GPLEV0 + 1] ;
+    }
+    else
+    {
+      if (mask0 != 0) lev0 = digitalReadBank (0) ;
+      if (mask1 != 0) lev1 = digitalReadBank (1) ;
+    }
+
+    value = Bank0::gather (lev0, 0) | Bank1::gather (lev1, 0) ;
+    if (Bank0::nodes != 0)
+      value |= Bank0::nodeRead (0) ;
+
+    return value ;
+  }
+
+  static inline void mode (int m)
+  {
+    if (mask0 != 0) pinModeMask (0, mask0, m) ;
+    if (mask1 != 0) pinModeMask (1, mask1, m) ;
+    if (Bank0::nodes != 0)
+      Bank0::nodeMode (m) ;
+  }
+} ;
+
+}
+
+#endif
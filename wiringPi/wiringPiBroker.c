@@ -0,0 +1,1095 @@
+/*
+ * wiringPiBroker.c:
+ *	Let programs using /dev/gpiomem have the PWM, clocks and pads done
+ *	for them by a privileged broker.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+
+/*
+ * Notes:
+ *	/dev/gpiomem only reaches the GPIO block, so without root pwmWrite (),
+ *	pwmSetClock (), gpioClockSet (), setPadDrive () and friends can't be
+ *	done. The broker - wiringpid -b, as root - does them instead: when
+ *	one of them is called under /dev/gpiomem, wiringPi connects to the
+ *	broker's socket (WIRINGPI_BROKER, or WPI_BROKER_SOCKET), which looks
+ *	up who we are with SO_PEERCRED and what we may touch in its config,
+ *	and hands back a shared memory ring and an eventfd doorbell.
+ *
+ *	From then on a command is 24 bytes in the ring and a store to head;
+ *	the doorbell is only rung if the broker has gone to sleep, so with
+ *	it busy-polling (-s) there's no system call on either side. Commands
+ *	are done in order and don't wait to be done - pwmWrite () and the
+ *	rest return nothing anyway - except for the two that return a clock
+ *	frequency, which wait for the answer. wiringPiBrokerSync () waits for
+ *	everything sent so far.
+ *
+ *	The ring is single producer, so the threads of a client take turns
+ *	at it under brokerLock. The broker copies each command out of the
+ *	ring before looking at it, and checks it against its own record of
+ *	the client's permissions; the copy in the ring is only there to let
+ *	the client fail early, with the usual /dev/gpiomem message.
+ *
+ *	The config is lines of what and who:
+ *		18,19	pi
+ *		12-13	@gpio
+ *		pwm	@gpio
+ *		pads	1001
+ *	what is BCM_GPIO pins, ranges, all, or pwm - anything that changes
+ *	every PWM channel: the mode, clock, ranges, and pin modes - and pads.
+ *	who is a user, @group, uid or *. Root can do anything.
+ *********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pwd.h>
+#include <grp.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "wiringPi.h"
+#include "wiringPiBroker.h"
+#include "piThread.h"
+
+#define	BROKER_MAGIC	0x57504232	// WPB2
+#define	BROKER_RULES	64
+#define	BROKER_GROUPS	64
+
+#define	BROKER_ANY	0
+#define	BROKER_UID	1
+#define	BROKER_GID	2
+
+#define	BROKER_LISTEN	((uint64_t)-1)	// epoll data for the listening socket
+
+struct wpiBrokerCmdStruct
+{
+  uint16_t op ;
+  int16_t  pin ;
+  int32_t  a ;
+  int32_t  b ;
+  uint32_t spare ;
+  double   f ;
+} ;
+
+struct wpiBrokerRingStruct
+{
+  uint32_t magic ;			// Set last, once the rest is ready
+  uint32_t allow ;			// What the client may do - a copy, for it
+  uint64_t pins ;			//  to fail early: the broker uses its own
+  uint32_t head __attribute__ ((aligned (64))) ;	// The client's
+  uint32_t syncWaiters ;
+  uint32_t tail __attribute__ ((aligned (64))) ;	// The broker's
+  uint32_t sleeping ;
+  uint32_t rejected ;
+  double   result ;			// Of the last command
+  struct wpiBrokerCmdStruct cmds [WPI_BROKER_RING] __attribute__ ((aligned (64))) ;
+} ;
+
+// The broker
+
+struct brokerRuleStruct
+{
+  uint64_t     pins ;
+  unsigned int allow ;
+  int          who ;
+  unsigned int id ;
+} ;
+
+struct brokerClientStruct
+{
+  int          sock ;
+  int          doorbell ;
+  pid_t        pid ;
+  uid_t        uid ;
+  uint64_t     pins ;
+  unsigned int allow ;
+  uint32_t     tail ;			// Ours - never read back from the ring
+  int          complained ;
+  struct wpiBrokerRingStruct *ring ;
+} ;
+
+static struct brokerRuleStruct    brokerRules   [BROKER_RULES] ;
+static struct brokerClientStruct *brokerClients [WPI_BROKER_MAX_CLIENTS] ;
+static int numRules = 0 ;
+static void (*brokerLog)(const char *message, ...) ;
+
+// A client
+
+static struct wpiBrokerRingStruct *ring = NULL ;
+static int      brokerSock  = -1 ;
+static int      brokerBell  = -1 ;
+static uint32_t head ;
+static int      attachTried = FALSE ;
+static pthread_mutex_t brokerLock = PTHREAD_MUTEX_INITIALIZER ;
+
+
+/*
+ * brokerLogNone:
+ *********************************************************************************
+ */
+
+static void brokerLogNone (const char *message, ...)
+{
+  (void)message ;
+}
+
+
+/*
+ * brokerAllowed:
+ *	May a client with these pins and allow bits send this command?
+ *********************************************************************************
+ */
+
+static int brokerAllowed (uint64_t pins, unsigned int allow, int op, int pin, int a)
+{
+  int pinOk = (pin >= 0) && (pin < 64) && (((pins >> pin) & 1) != 0) ;
+  int pwmOk = (allow & WPI_BROKER_ALLOW_PWM) != 0 ;
+
+  /**/ if ((op == WPI_BROKER_PWM_WRITE) || (op == WPI_BROKER_CLOCK_SET))
+    return pinOk ;
+  else if (op == WPI_BROKER_PIN_MODE)
+    return pinOk && (((a == PWM_OUTPUT) && pwmOk) || (a == GPIO_CLOCK)) ;
+  else if ((op == WPI_BROKER_PWM_MODE) || (op == WPI_BROKER_PWM_CLOCK))
+    return pwmOk ;
+  else if ((op >= WPI_BROKER_PWM_MODE_CH) && (op <= WPI_BROKER_PWM_RANGE_CH))
+    return pwmOk ;
+  else if (op == WPI_BROKER_CLOCK_GET)
+    return TRUE ;
+  else if (op == WPI_BROKER_PADS)
+    return (allow & WPI_BROKER_ALLOW_PADS) != 0 ;
+  else
+    return FALSE ;
+}
+
+
+/*
+ * brokerParseRule:
+ *	One line of the config. Returns 0, 1 if it's blank, or -1.
+ *********************************************************************************
+ */
+
+static int brokerParseRule (char *line, struct brokerRuleStruct *rule)
+{
+  char *what, *who, *item, *end, *save ;
+  struct passwd *pw ;
+  struct group  *gr ;
+  long from, to ;
+
+  if ((end = strchr (line, '#')) != NULL)
+    *end = 0 ;
+
+  if ((what = strtok_r (line, " \t\r\n", &save)) == NULL)
+    return 1 ;
+
+  if (((who = strtok_r (NULL, " \t\r\n", &save)) == NULL) || (strtok_r (NULL, " \t\r\n", &save) != NULL))
+    return -1 ;
+
+  memset (rule, 0, sizeof (*rule)) ;
+
+  for (item = strtok_r (what, ",", &save) ; item != NULL ; item = strtok_r (NULL, ",", &save))
+  {
+    /**/ if (strcasecmp (item, "all") == 0)
+      rule->pins = ~0ULL ;
+    else if (strcasecmp (item, "pwm") == 0)
+      rule->allow |= WPI_BROKER_ALLOW_PWM ;
+    else if (strcasecmp (item, "pads") == 0)
+      rule->allow |= WPI_BROKER_ALLOW_PADS ;
+    else
+    {
+      from = to = strtol (item, &end, 10) ;
+      if ((end != item) && (*end == '-'))
+	to = strtol (end + 1, &end, 10) ;
+      if ((end == item) || (*end != 0) || (from < 0) || (to > 63) || (from > to))
+	return -1 ;
+      for (; from <= to ; ++from)
+	rule->pins |= 1ULL << from ;
+    }
+  }
+
+  /**/ if (strcmp (who, "*") == 0)
+    rule->who = BROKER_ANY ;
+  else if (*who == '@')
+  {
+    if ((gr = getgrnam (who + 1)) == NULL)
+      return -1 ;
+    rule->who = BROKER_GID ;
+    rule->id  = gr->gr_gid ;
+  }
+  else if (isdigit ((unsigned char)*who))
+  {
+    rule->who = BROKER_UID ;
+    rule->id  = (unsigned int)strtoul (who, &end, 10) ;
+    if (*end != 0)
+      return -1 ;
+  }
+  else
+  {
+    if ((pw = getpwnam (who)) == NULL)
+      return -1 ;
+    rule->who = BROKER_UID ;
+    rule->id  = pw->pw_uid ;
+  }
+
+  return 0 ;
+}
+
+
+/*
+ * brokerLoadRules:
+ *	Read the config. Returns 0 or -1 with errno set.
+ *********************************************************************************
+ */
+
+static int brokerLoadRules (const char *config)
+{
+  FILE *fp ;
+  char  line [256] ;
+  int   lineNo = 0, result ;
+
+  if ((fp = fopen (config, "r")) == NULL)
+    return -1 ;
+
+  numRules = 0 ;
+  while (fgets (line, sizeof (line), fp) != NULL)
+  {
+    ++lineNo ;
+
+    if ((result = brokerParseRule (line, &brokerRules [numRules])) == 1)
+      continue ;
+
+    if ((result < 0) || (numRules == BROKER_RULES))
+    {
+      brokerLog ("Broker: %s:%d: invalid or one too many rules", config, lineNo) ;
+      fclose (fp) ;
+      errno = EINVAL ;
+      return -1 ;
+    }
+
+    ++numRules ;
+  }
+
+  fclose (fp) ;
+  return 0 ;
+}
+
+
+/*
+ * brokerPermissions:
+ *	Work out what a new client may do from its uid and groups
+ *********************************************************************************
+ */
+
+static void brokerPermissions (struct brokerClientStruct *client, uid_t uid, gid_t gid)
+{
+  struct passwd pw, *pwp ;
+  gid_t groups [BROKER_GROUPS] ;
+  char  buf [1024] ;
+  int   numGroups = BROKER_GROUPS ;
+  int   i, j, match ;
+
+  if (uid == 0)
+  {
+    client->pins  = ~0ULL ;
+    client->allow = WPI_BROKER_ALLOW_PWM | WPI_BROKER_ALLOW_PADS ;
+    return ;
+  }
+
+  if ((getpwuid_r (uid, &pw, buf, sizeof (buf), &pwp) != 0) || (pwp == NULL) ||
+	(getgrouplist (pw.pw_name, gid, groups, &numGroups) < 0))
+  {
+    groups [0] = gid ;
+    numGroups  = 1 ;
+  }
+
+  client->pins  = 0 ;
+  client->allow = 0 ;
+
+  for (i = 0 ; i < numRules ; ++i)
+  {
+    /**/ if (brokerRules [i].who == BROKER_ANY)
+      match = TRUE ;
+    else if (brokerRules [i].who == BROKER_UID)
+      match = (brokerRules [i].id == uid) ;
+    else
+      for (match = FALSE, j = 0 ; !match && (j < numGroups) ; ++j)
+	match = (brokerRules [i].id == groups [j]) ;
+
+    if (match)
+    {
+      client->pins  |= brokerRules [i].pins ;
+      client->allow |= brokerRules [i].allow ;
+    }
+  }
+}
+
+
+/*
+ * brokerListen:
+ *	Open the socket the clients connect to - anyone can, what they can
+ *	do once they have is up to the config.
+ *********************************************************************************
+ */
+
+static int brokerListen (const char *path)
+{
+  struct sockaddr_un addr ;
+  int fd ;
+
+  if (strlen (path) >= sizeof (addr.sun_path))
+  {
+    errno = ENAMETOOLONG ;
+    return -1 ;
+  }
+
+  memset (&addr, 0, sizeof (addr)) ;
+  addr.sun_family = AF_UNIX ;
+  strcpy (addr.sun_path, path) ;
+
+  if ((fd = socket (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0)
+    return -1 ;
+
+  (void)unlink (path) ;
+
+  if ((bind (fd, (struct sockaddr *)&addr, sizeof (addr)) < 0) || (chmod (path, 0666) < 0) || (listen (fd, 16) < 0))
+  {
+    close (fd) ;
+    return -1 ;
+  }
+
+  return fd ;
+}
+
+
+/*
+ * brokerDrop:
+ *	A client's gone
+ *********************************************************************************
+ */
+
+static void brokerDrop (int epollFd, int slot)
+{
+  struct brokerClientStruct *client = brokerClients [slot] ;
+
+  brokerLog ("Broker: pid %d (uid %d) gone", client->pid, client->uid) ;
+
+  epoll_ctl (epollFd, EPOLL_CTL_DEL, client->sock,     NULL) ;
+  epoll_ctl (epollFd, EPOLL_CTL_DEL, client->doorbell, NULL) ;
+  close  (client->sock) ;
+  close  (client->doorbell) ;
+  munmap (client->ring, sizeof (*client->ring)) ;
+  free   (client) ;
+
+  brokerClients [slot] = NULL ;
+}
+
+
+/*
+ * brokerAccept:
+ *	A new client: give it a ring and a doorbell, if we'll talk to it
+ *********************************************************************************
+ */
+
+static void brokerAccept (int epollFd, int listenFd)
+{
+  struct brokerClientStruct *client ;
+  struct epoll_event ev ;
+  struct ucred  cred ;
+  struct msghdr msg ;
+  struct iovec  iov ;
+  struct cmsghdr *cmsg ;
+  union { char buf [CMSG_SPACE (2 * sizeof (int))] ; struct cmsghdr align ; } control ;
+  socklen_t len ;
+  char byte = 0 ;
+  int  fd, memFd, fds [2], slot ;
+
+  while ((fd = accept4 (listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+  {
+    for (slot = 0 ; slot < WPI_BROKER_MAX_CLIENTS ; ++slot)
+      if (brokerClients [slot] == NULL)
+	break ;
+
+    len = sizeof (cred) ;
+    if ((slot == WPI_BROKER_MAX_CLIENTS) || (getsockopt (fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) ||
+	((client = calloc (1, sizeof (*client))) == NULL))
+    {
+      brokerLog ("Broker: can't take another client") ;
+      close (fd) ;
+      continue ;
+    }
+
+    client->sock = fd ;
+    client->pid  = cred.pid ;
+    client->uid  = cred.uid ;
+    brokerPermissions (client, cred.uid, cred.gid) ;
+
+    if ((client->pins == 0) && (client->allow == 0))
+    {
+      brokerLog ("Broker: pid %d (uid %d) may do nothing - dropped", cred.pid, cred.uid) ;
+      close (fd) ;
+      free  (client) ;
+      continue ;
+    }
+
+    client->ring     = MAP_FAILED ;
+    client->doorbell = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC) ;
+    if ((memFd = memfd_create ("wiringPi-broker", MFD_CLOEXEC)) >= 0)
+    {
+      if (ftruncate (memFd, sizeof (*client->ring)) == 0)
+	client->ring = (struct wpiBrokerRingStruct *)mmap (NULL, sizeof (*client->ring), PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0) ;
+    }
+
+    if ((client->doorbell < 0) || (client->ring == MAP_FAILED))
+    {
+      brokerLog ("Broker: no ring for pid %d: %s", cred.pid, strerror (errno)) ;
+      if (memFd >= 0)            close  (memFd) ;
+      if (client->doorbell >= 0) close  (client->doorbell) ;
+      if (client->ring != MAP_FAILED) munmap (client->ring, sizeof (*client->ring)) ;
+      close (fd) ;
+      free  (client) ;
+      continue ;
+    }
+
+    client->ring->pins  = client->pins ;
+    client->ring->allow = client->allow ;
+    __atomic_store_n (&client->ring->magic, BROKER_MAGIC, __ATOMIC_RELEASE) ;
+
+// Hand over the ring and doorbell
+
+    iov.iov_base = &byte ;
+    iov.iov_len  = 1 ;
+    memset (&msg, 0, sizeof (msg)) ;
+    msg.msg_iov        = &iov ;
+    msg.msg_iovlen     = 1 ;
+    msg.msg_control    = control.buf ;
+    msg.msg_controllen = sizeof (control.buf) ;
+    cmsg               = CMSG_FIRSTHDR (&msg) ;
+    cmsg->cmsg_level   = SOL_SOCKET ;
+    cmsg->cmsg_type    = SCM_RIGHTS ;
+    cmsg->cmsg_len     = CMSG_LEN (2 * sizeof (int)) ;
+    fds [0] = memFd ;
+    fds [1] = client->doorbell ;
+    memcpy (CMSG_DATA (cmsg), fds, sizeof (fds)) ;
+
+    brokerClients [slot] = client ;
+
+    ev.events   = EPOLLIN ;
+    ev.data.u64 = (uint64_t)slot * 2 ;
+    epoll_ctl (epollFd, EPOLL_CTL_ADD, client->doorbell, &ev) ;
+    ev.events   = EPOLLIN | EPOLLRDHUP ;
+    ev.data.u64 = (uint64_t)slot * 2 + 1 ;
+    epoll_ctl (epollFd, EPOLL_CTL_ADD, client->sock, &ev) ;
+
+    if (sendmsg (fd, &msg, MSG_NOSIGNAL) != 1)
+    {
+      close (memFd) ;
+      brokerDrop (epollFd, slot) ;
+      continue ;
+    }
+    close (memFd) ;
+
+    brokerLog ("Broker: pid %d (uid %d) connected: pins %016llX%s%s", cred.pid, cred.uid,
+	(unsigned long long)client->pins,
+	(client->allow & WPI_BROKER_ALLOW_PWM)  ? ", pwm"  : "",
+	(client->allow & WPI_BROKER_ALLOW_PADS) ? ", pads" : "") ;
+  }
+}
+
+
+/*
+ * brokerExec:
+ *	Do one command - it's been checked
+ *********************************************************************************
+ */
+
+static double brokerExec (const struct wpiBrokerCmdStruct *cmd)
+{
+  int pin = cmd->pin ;
+
+  /**/ if (cmd->op == WPI_BROKER_PWM_WRITE)
+    pwmWrite (pin, cmd->a) ;
+  else if (cmd->op == WPI_BROKER_PIN_MODE)
+    pinMode (pin, cmd->a) ;
+  else if (cmd->op == WPI_BROKER_PWM_MODE)
+    pwmSetMode (cmd->a) ;
+  else if (cmd->op == WPI_BROKER_PWM_CLOCK)
+    pwmSetClock (cmd->a) ;
+  else if (cmd->op == WPI_BROKER_PWM_MODE_CH)
+    return pwmSetModeCh (pin, cmd->a) ;
+  else if (cmd->op == WPI_BROKER_PWM_POL_CH)
+    return pwmSetPolarityCh (pin, cmd->a) ;
+  else if (cmd->op == WPI_BROKER_PWM_EN_CH)
+    return pwmEnableCh (pin, cmd->a) ;
+  else if (cmd->op == WPI_BROKER_PWM_RANGE_CH)
+    return pwmSetRangeCh (pin, (unsigned int)cmd->a) ;
+  else if (cmd->op == WPI_BROKER_CLOCK_SET)
+    return gpioClockSetFreq (pin, cmd->f, cmd->a, cmd->b) ;
+  else if (cmd->op == WPI_BROKER_CLOCK_GET)
+    return gpioClockGet (pin) ;
+  else if (cmd->op == WPI_BROKER_PADS)
+    setPadDrive (pin, cmd->a) ;
+
+  return 0.0 ;
+}
+
+
+/*
+ * brokerDrain:
+ *	Do everything a client has sent. Returns how many, or -1 if its
+ *	ring makes no sense.
+ *********************************************************************************
+ */
+
+static int brokerDrain (struct brokerClientStruct *client)
+{
+  struct wpiBrokerRingStruct *shm = client->ring ;
+  struct wpiBrokerCmdStruct   cmd ;
+  uint32_t newHead ;
+  double   result ;
+  int      n = 0 ;
+
+  newHead = __atomic_load_n (&shm->head, __ATOMIC_ACQUIRE) ;
+  if ((newHead - client->tail) > WPI_BROKER_RING)
+    return -1 ;
+
+  while (client->tail != newHead)
+  {
+    memcpy (&cmd, &shm->cmds [client->tail & (WPI_BROKER_RING - 1)], sizeof (cmd)) ;
+    __atomic_signal_fence (__ATOMIC_SEQ_CST) ;
+
+    if (brokerAllowed (client->pins, client->allow, cmd.op, cmd.pin, cmd.a))
+      result = brokerExec (&cmd) ;
+    else
+    {
+      if (!client->complained)
+	brokerLog ("Broker: pid %d (uid %d) not allowed command %d, pin %d", client->pid, client->uid, cmd.op, cmd.pin) ;
+      client->complained = TRUE ;
+      __atomic_add_fetch (&shm->rejected, 1, __ATOMIC_RELAXED) ;
+      result = -1.0 ;
+    }
+
+    shm->result = result ;
+    __atomic_store_n (&shm->tail, ++client->tail, __ATOMIC_RELEASE) ;
+    ++n ;
+  }
+
+  if ((n > 0) && (__atomic_load_n (&shm->syncWaiters, __ATOMIC_SEQ_CST) != 0))
+    piFutexWake (&shm->tail, INT_MAX) ;
+
+  return n ;
+}
+
+
+/*
+ * brokerEvents:
+ *	New clients, gone clients and doorbells
+ *********************************************************************************
+ */
+
+static void brokerEvents (int epollFd, int listenFd, int timeoutMs)
+{
+  struct epoll_event events [16] ;
+  uint64_t count ;
+  int i, n, slot ;
+
+  if ((n = epoll_wait (epollFd, events, 16, timeoutMs)) <= 0)
+    return ;
+
+  for (i = 0 ; i < n ; ++i)
+  {
+    if (events [i].data.u64 == BROKER_LISTEN)
+    {
+      brokerAccept (epollFd, listenFd) ;
+      continue ;
+    }
+
+    slot = (int)(events [i].data.u64 / 2) ;
+    if (brokerClients [slot] == NULL)		// Dropped earlier on in this lot
+      continue ;
+
+    if ((events [i].data.u64 & 1) == 0)
+      (void)read (brokerClients [slot]->doorbell, &count, sizeof (count)) ;
+    else					// Clients never send anything: it's gone
+    {
+      (void)brokerDrain (brokerClients [slot]) ;
+      brokerDrop (epollFd, slot) ;
+    }
+  }
+}
+
+
+/*
+ * wiringPiBrokerServe:
+ *	Be the broker: take commands from clients as allowed by the config,
+ *	busy-polling for spinUs after the last one before going to sleep on
+ *	the doorbells. Must be root, and set up with wiringPiSetupGpio ().
+ *	Only returns if it can't start, -1 with errno set.
+ *********************************************************************************
+ */
+
+int wiringPiBrokerServe (const char *config, int spinUs, void (*logFn)(const char *message, ...))
+{
+  struct epoll_event ev ;
+  unsigned long long lastWork, lastPoll, now, spinNs ;
+  const char *path ;
+  int epollFd, listenFd, i, n, work ;
+
+  brokerLog   = (logFn != NULL) ? logFn : brokerLogNone ;
+  attachTried = TRUE ;				// Never a client of ourselves
+
+  if (geteuid () != 0)
+  {
+    errno = EPERM ;
+    return -1 ;
+  }
+
+  if (brokerLoadRules ((config != NULL) ? config : WPI_BROKER_CONFIG) < 0)
+    return -1 ;
+
+  if ((path = getenv ("WIRINGPI_BROKER")) == NULL)
+    path = WPI_BROKER_SOCKET ;
+
+  if ((listenFd = brokerListen (path)) < 0)
+    return -1 ;
+
+  if ((epollFd = epoll_create1 (EPOLL_CLOEXEC)) < 0)
+    return -1 ;
+
+  ev.events   = EPOLLIN ;
+  ev.data.u64 = BROKER_LISTEN ;
+  if (epoll_ctl (epollFd, EPOLL_CTL_ADD, listenFd, &ev) < 0)
+    return -1 ;
+
+  brokerLog ("Broker: %d rules, listening on %s", numRules, path) ;
+
+  spinNs   = (spinUs > 0) ? (unsigned long long)spinUs * 1000ULL : 0 ;
+  lastWork = lastPoll = nanos64 () ;
+
+  for (;;)
+  {
+    for (work = 0, i = 0 ; i < WPI_BROKER_MAX_CLIENTS ; ++i)
+      if (brokerClients [i] != NULL)
+      {
+	if ((n = brokerDrain (brokerClients [i])) < 0)
+	{
+	  brokerLog ("Broker: pid %d sent nonsense", brokerClients [i]->pid) ;
+	  brokerDrop (epollFd, i) ;
+	}
+	else
+	  work += n ;
+      }
+
+    now = nanos64 () ;
+    if (work > 0)
+      lastWork = now ;
+
+// Still spinning: just keep an eye out for comings and goings
+
+    if ((now - lastWork) < spinNs)
+    {
+      if ((now - lastPoll) > 1000000ULL)
+      {
+	brokerEvents (epollFd, listenFd, 0) ;
+	lastPoll = now ;
+      }
+      continue ;
+    }
+
+// Go to sleep - telling the clients to ring first, then making sure
+//	nothing came in while we were doing that
+
+    for (i = 0 ; i < WPI_BROKER_MAX_CLIENTS ; ++i)
+      if (brokerClients [i] != NULL)
+	__atomic_store_n (&brokerClients [i]->ring->sleeping, 1, __ATOMIC_SEQ_CST) ;
+
+    for (work = 0, i = 0 ; i < WPI_BROKER_MAX_CLIENTS ; ++i)
+      if ((brokerClients [i] != NULL) && (__atomic_load_n (&brokerClients [i]->ring->head, __ATOMIC_SEQ_CST) != brokerClients [i]->tail))
+	work = TRUE ;
+
+    if (!work)
+      brokerEvents (epollFd, listenFd, 1000) ;
+
+    for (i = 0 ; i < WPI_BROKER_MAX_CLIENTS ; ++i)
+      if (brokerClients [i] != NULL)
+	__atomic_store_n (&brokerClients [i]->ring->sleeping, 0, __ATOMIC_RELAXED) ;
+
+    lastWork = lastPoll = nanos64 () ;
+  }
+
+  return 0 ;
+}
+
+
+/*
+ * brokerClose:
+ * brokerGone:
+ * brokerKick:
+ *	Client side helpers - all with brokerLock held
+ *********************************************************************************
+ */
+
+static void brokerClose (void)
+{
+  if (ring == NULL)
+    return ;
+
+  munmap (ring, sizeof (*ring)) ;
+  close  (brokerSock) ;
+  close  (brokerBell) ;
+  ring       = NULL ;
+  brokerSock = brokerBell = -1 ;
+}
+
+static int brokerGone (void)	// The broker never sends after the hello
+{
+  struct pollfd pfd ;
+
+  pfd.fd     = brokerSock ;
+  pfd.events = POLLIN ;
+
+  return poll (&pfd, 1, 0) != 0 ;
+}
+
+static void brokerKick (void)
+{
+  uint64_t one = 1 ;
+
+  __atomic_thread_fence (__ATOMIC_SEQ_CST) ;
+  if (__atomic_load_n (&ring->sleeping, __ATOMIC_RELAXED) != 0)
+    (void)write (brokerBell, &one, sizeof (one)) ;
+}
+
+
+/*
+ * brokerConnect:
+ *	Connect to the broker and map the ring it gives us. Returns 0 or -1
+ *	with errno set.
+ *********************************************************************************
+ */
+
+static int brokerConnect (const char *path)
+{
+  struct wpiBrokerRingStruct *shm ;
+  struct sockaddr_un addr ;
+  struct msghdr msg ;
+  struct iovec  iov ;
+  struct cmsghdr *cmsg ;
+  union { char buf [CMSG_SPACE (2 * sizeof (int))] ; struct cmsghdr align ; } control ;
+  struct timeval tv ;
+  struct stat st ;
+  char byte ;
+  int  fd, fds [2], err ;
+
+  if ((path == NULL) && ((path = getenv ("WIRINGPI_BROKER")) == NULL))
+    path = WPI_BROKER_SOCKET ;
+
+  if (strlen (path) >= sizeof (addr.sun_path))
+  {
+    errno = ENAMETOOLONG ;
+    return -1 ;
+  }
+
+  memset (&addr, 0, sizeof (addr)) ;
+  addr.sun_family = AF_UNIX ;
+  strcpy (addr.sun_path, path) ;
+
+  if ((fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+    return -1 ;
+
+  tv.tv_sec  = 1 ;
+  tv.tv_usec = 0 ;
+  setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof (tv)) ;
+
+  iov.iov_base = &byte ;
+  iov.iov_len  = 1 ;
+  memset (&msg, 0, sizeof (msg)) ;
+  msg.msg_iov        = &iov ;
+  msg.msg_iovlen     = 1 ;
+  msg.msg_control    = control.buf ;
+  msg.msg_controllen = sizeof (control.buf) ;
+
+  if ((connect (fd, (struct sockaddr *)&addr, sizeof (addr)) < 0) || (recvmsg (fd, &msg, MSG_CMSG_CLOEXEC) != 1))
+  {
+    err = (errno == 0) ? EPROTO : errno ;
+    close (fd) ;
+    errno = err ;
+    return -1 ;
+  }
+
+  if (((cmsg = CMSG_FIRSTHDR (&msg)) == NULL) || (cmsg->cmsg_level != SOL_SOCKET) ||
+	(cmsg->cmsg_type != SCM_RIGHTS) || (cmsg->cmsg_len != CMSG_LEN (2 * sizeof (int))))
+  {
+    close (fd) ;
+    errno = EPROTO ;
+    return -1 ;
+  }
+  memcpy (fds, CMSG_DATA (cmsg), sizeof (fds)) ;
+
+  if ((fstat (fds [0], &st) < 0) || (st.st_size < (off_t)sizeof (*shm)))
+    shm = MAP_FAILED ;
+  else
+    shm = (struct wpiBrokerRingStruct *)mmap (NULL, sizeof (*shm), PROT_READ | PROT_WRITE, MAP_SHARED, fds [0], 0) ;
+
+  err = errno ;
+  close (fds [0]) ;
+
+  if ((shm == MAP_FAILED) || (__atomic_load_n (&shm->magic, __ATOMIC_ACQUIRE) != BROKER_MAGIC))
+  {
+    if (shm != MAP_FAILED)
+    {
+      munmap (shm, sizeof (*shm)) ;
+      err = EPROTO ;
+    }
+    close (fds [1]) ;
+    close (fd) ;
+    errno = err ;
+    return -1 ;
+  }
+
+  ring       = shm ;
+  head       = __atomic_load_n (&shm->head, __ATOMIC_RELAXED) ;
+  brokerSock = fd ;
+  brokerBell = fds [1] ;
+
+  return 0 ;
+}
+
+
+/*
+ * brokerPut:
+ *	Put a command in the ring, waiting for room if it's full
+ *********************************************************************************
+ */
+
+static int brokerPut (int op, int pin, int a, int b, double f)
+{
+  struct wpiBrokerCmdStruct *cmd ;
+  unsigned int spins = 0 ;
+
+  while ((head - __atomic_load_n (&ring->tail, __ATOMIC_ACQUIRE)) >= WPI_BROKER_RING)
+  {
+    brokerKick () ;
+    if (((++spins % 1024) == 0) && brokerGone ())
+    {
+      errno = EPIPE ;
+      return -1 ;
+    }
+    sched_yield () ;
+  }
+
+  cmd = &ring->cmds [head & (WPI_BROKER_RING - 1)] ;
+  cmd->op  = (uint16_t)op ;
+  cmd->pin = (int16_t)pin ;
+  cmd->a   = a ;
+  cmd->b   = b ;
+  cmd->f   = f ;
+
+  __atomic_store_n (&ring->head, ++head, __ATOMIC_RELEASE) ;
+  brokerKick () ;
+
+  return 0 ;
+}
+
+
+/*
+ * brokerWait:
+ *	Wait for the broker to have done everything we've sent
+ *********************************************************************************
+ */
+
+static int brokerWait (int timeoutMs)
+{
+  struct timespec ts ;
+  unsigned long long giveUp = nanos64 () + (unsigned long long)timeoutMs * 1000000ULL ;
+  uint32_t tail ;
+  int result = 0 ;
+
+  ts.tv_sec  = 0 ;
+  ts.tv_nsec = 10000000 ;		// Look up every 10mS in case it's died
+
+  __atomic_add_fetch (&ring->syncWaiters, 1, __ATOMIC_SEQ_CST) ;
+
+  while ((tail = __atomic_load_n (&ring->tail, __ATOMIC_SEQ_CST)) != head)
+  {
+    brokerKick () ;
+
+    if (brokerGone ())
+    {
+      errno  = EPIPE ;
+      result = -1 ;
+      break ;
+    }
+
+    if (nanos64 () > giveUp)
+    {
+      errno  = ETIMEDOUT ;
+      result = -1 ;
+      break ;
+    }
+
+    (void)piFutexWait (&ring->tail, tail, &ts) ;
+  }
+
+  __atomic_sub_fetch (&ring->syncWaiters, 1, __ATOMIC_SEQ_CST) ;
+
+  return result ;
+}
+
+
+/*
+ * wiringPiBrokerAttach:
+ * wiringPiBrokerDetach:
+ *	Connect to the broker at path (NULL for WIRINGPI_BROKER or the
+ *	default) - not usually needed, as wiringPi does it when it needs to.
+ *	Attach returns 0 or -1 with errno set.
+ *********************************************************************************
+ */
+
+int wiringPiBrokerAttach (const char *path)
+{
+  int result = 0 ;
+
+  pthread_mutex_lock (&brokerLock) ;
+    attachTried = TRUE ;
+    if (ring == NULL)
+      result = brokerConnect (path) ;
+  pthread_mutex_unlock (&brokerLock) ;
+
+  return result ;
+}
+
+void wiringPiBrokerDetach (void)
+{
+  pthread_mutex_lock (&brokerLock) ;
+    brokerClose () ;
+  pthread_mutex_unlock (&brokerLock) ;
+}
+
+
+/*
+ * wiringPiBrokerSync:
+ *	Wait for up to timeoutMs for the broker to have done everything
+ *	sent so far. Returns 0 or -1 with errno set.
+ *********************************************************************************
+ */
+
+int wiringPiBrokerSync (int timeoutMs)
+{
+  int result ;
+
+  pthread_mutex_lock (&brokerLock) ;
+
+  if (ring == NULL)
+  {
+    pthread_mutex_unlock (&brokerLock) ;
+    errno = ENODEV ;
+    return -1 ;
+  }
+
+  if ((result = brokerWait (timeoutMs)) < 0 && (errno == EPIPE))
+    brokerClose () ;
+
+  pthread_mutex_unlock (&brokerLock) ;
+
+  return result ;
+}
+
+
+/*
+ * wiringPiBrokerRejected:
+ *	How many of our commands the broker has turned down
+ *********************************************************************************
+ */
+
+unsigned int wiringPiBrokerRejected (void)
+{
+  unsigned int result = 0 ;
+
+  pthread_mutex_lock (&brokerLock) ;
+    if (ring != NULL)
+      result = __atomic_load_n (&ring->rejected, __ATOMIC_RELAXED) ;
+  pthread_mutex_unlock (&brokerLock) ;
+
+  return result ;
+}
+
+
+/*
+ * wpiBroker:
+ *	Have the broker do a command, connecting to it the first time. If
+ *	result isn't NULL wait for it to be done and return what it returned.
+ *	Returns 0, or -1 with errno set if there is no broker or it won't
+ *	let us.
+ *********************************************************************************
+ */
+
+int wpiBroker (int op, int pin, int a, int b, double f, double *result)
+{
+  int r ;
+
+  pthread_mutex_lock (&brokerLock) ;
+
+  if ((ring == NULL) && !attachTried)
+  {
+    attachTried = TRUE ;
+    (void)brokerConnect (NULL) ;
+  }
+
+  if (ring == NULL)
+  {
+    pthread_mutex_unlock (&brokerLock) ;
+    errno = ENODEV ;
+    return -1 ;
+  }
+
+  if (!brokerAllowed (ring->pins, ring->allow, op, pin, a))
+  {
+    pthread_mutex_unlock (&brokerLock) ;
+    errno = EPERM ;
+    return -1 ;
+  }
+
+  if (((r = brokerPut (op, pin, a, b, f)) == 0) && (result != NULL))
+    if ((r = brokerWait (1000)) == 0)
+      *result = ring->result ;
+
+  if ((r < 0) && (errno == EPIPE))
+    brokerClose () ;
+
+  pthread_mutex_unlock (&brokerLock) ;
+
+  return r ;
+}
@@ -0,0 +1,68 @@
+/*
+ * wiringPiBroker.h:
+ *	Let programs using /dev/gpiomem have the PWM, clocks and pads done
+ *	for them by a privileged broker.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#define	WPI_BROKER_SOCKET	"/run/wiringPi-broker"
+#define	WPI_BROKER_CONFIG	"/etc/wiringPi-broker.conf"
+#define	WPI_BROKER_RING		256		// Commands, a power of 2
+#define	WPI_BROKER_MAX_CLIENTS	64
+
+// What a client may do besides its own pins
+
+#define	WPI_BROKER_ALLOW_PWM	1		// Anything that changes every PWM channel
+#define	WPI_BROKER_ALLOW_PADS	2
+
+// Commands. Pins are BCM_GPIO numbers.
+
+#define	WPI_BROKER_PWM_WRITE	1		// pin, a: value
+#define	WPI_BROKER_PIN_MODE	2		// pin, a: PWM_OUTPUT or GPIO_CLOCK
+#define	WPI_BROKER_PWM_MODE	3		// a: mode
+#define	WPI_BROKER_PWM_CLOCK	4		// a: divisor
+#define	WPI_BROKER_PWM_MODE_CH	5		// pin: channel, a: mode
+#define	WPI_BROKER_PWM_POL_CH	6		// pin: channel, a: invert
+#define	WPI_BROKER_PWM_EN_CH	7		// pin: channel, a: enable
+#define	WPI_BROKER_PWM_RANGE_CH	8		// pin: channel, a: range
+#define	WPI_BROKER_CLOCK_SET	9		// pin, a: source, b: mash, f: Hz
+#define	WPI_BROKER_CLOCK_GET	10		// pin
+#define	WPI_BROKER_PADS		11		// pin: group, a: value
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// For programs
+
+extern int          wiringPiBrokerServe    (const char *config, int spinUs, void (*logFn)(const char *message, ...)) ;
+extern int          wiringPiBrokerAttach   (const char *path) ;
+extern void         wiringPiBrokerDetach   (void) ;
+extern int          wiringPiBrokerSync     (int timeoutMs) ;
+extern unsigned int wiringPiBrokerRejected (void) ;
+
+// For the rest of wiringPi
+
+extern int wpiBroker (int op, int pin, int a, int b, double f, double *result) ;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,365 @@
+/*
+ * wiringPiCapture.c:
+ *	Logic analyser style capture of the GPIO levels to a file
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+/*
+ * Notes:
+ *	One thread does nothing but read GPLEV0 as fast as it can and compare
+ *	the pins of interest with what they were last time. Only when they
+ *	change is the clock read and a record - the new levels and the nS
+ *	since the last change - added to a ring in a memory mapped file, so
+ *	the sampling loop is just a load, a mask and a compare, and a quiet
+ *	bus costs no space at all. Give it a CPU of its own (isolcpus= on the
+ *	kernel command line, and that CPU in cpuMask) and it runs at SCHED_FIFO
+ *	there, sampling every few tens of nS; without one it runs as an
+ *	ordinary thread so it can't lock up the machine.
+ *
+ *	The file is left behind for "gpio capture -e" to turn into a VCD; it
+ *	can also be read while the capture runs - the header's head is only
+ *	moved on once a record is complete.
+ *
+ *	With a trigger set the capture stops a given number of records after
+ *	the captured pins first match it, so the ring holds what led up to it
+ *	as well as what came after.
+ *
+ *	With the busy-poll executive (piSpinStart) running, the sampling loop
+ *	is a task there instead: SPIN_SAMPLES reads each time round, so it
+ *	shares the spinning CPU with the other engines rather than needing
+ *	one to itself. Stopping the executive stops the capture.
+ *********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "wiringPi.h"
+#include "wiringPiCapture.h"
+
+#define	GPLEV0		13		// Word offset
+#define	CHECK_EVERY	1024		// Samples between looks at the clock
+#define	MAX_DELTA	0x80000000ULL	// Repeat a record before the delta overflows
+#define	SPIN_SAMPLES	64		// Each time round on the busy-poll executive
+
+static struct wpiCaptureHeaderStruct *header  = NULL ;
+static struct wpiCaptureRecordStruct *ring    = NULL ;
+static size_t                         mapSize = 0 ;
+
+static unsigned int trigMask = 0, trigValue = 0, trigPost = 0 ;
+
+static volatile int    stopCapture = FALSE ;
+static int             running     = FALSE ;
+static pthread_mutex_t captureLock = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_cond_t  captureDone = PTHREAD_COND_INITIALIZER ;
+
+
+/*
+ * addRecord:
+ *	Put the levels in the ring, moving the time of the oldest record on
+ *	as it's overwritten.
+ *********************************************************************************
+ */
+
+static inline void addRecord (uint32_t levels, uint64_t delta)
+{
+  uint64_t head = header->head ;
+  uint32_t n    = header->records ;
+
+  if (head >= n)
+    header->baseNs += ring [(head + 1) % n].deltaNs ;
+
+  ring [head % n].levels  = levels ;
+  ring [head % n].deltaNs = (uint32_t)delta ;
+
+  if ((header->trigger == WPI_CAPTURE_NONE) && (trigMask != 0) && ((levels & trigMask) == trigValue))
+    header->trigger = head ;
+
+  __atomic_store_n (&header->head, head + 1, __ATOMIC_RELEASE) ;
+}
+
+
+/*
+ * captureBegin: captureStep: captureEnd:
+ *	The sampling loop, in pieces so it can be a busy-poll task as well
+ *	as a thread: captureStep takes n samples, and returns FALSE once the
+ *	trigger's been and gone.
+ *********************************************************************************
+ */
+
+static volatile unsigned int *capLev ;
+static uint32_t capMask, capLast ;
+static uint64_t capLastNs, capSamples ;
+
+static void captureBegin (void)
+{
+  capLev     = (_wiringPiGpioDirect != NULL) ? _wiringPiGpio + GPLEV0 : NULL ;
+  capMask    = header->mask ;
+  capSamples = 0 ;
+
+  capLast   = ((capLev != NULL) ? *capLev : digitalReadBank (0)) & capMask ;
+  capLastNs = header->baseNs = header->startNs = nanos64 () ;
+  addRecord (capLast, 0) ;
+}
+
+static int captureStep (unsigned int n)
+{
+  volatile unsigned int *lev = capLev ;
+  uint32_t mask = capMask ;
+  uint32_t now ;
+  uint64_t t ;
+  unsigned int i ;
+
+  for (i = 0 ; i < n ; ++i)
+  {
+    now = ((lev != NULL) ? *lev : digitalReadBank (0)) & mask ;
+    if (now != capLast)
+    {
+      t = nanos64 () ;
+      addRecord (now, t - capLastNs) ;
+      capLast   = now ;
+      capLastNs = t ;
+    }
+  }
+  capSamples     += n ;
+  header->samples = capSamples ;
+
+  if (((t = nanos64 ()) - capLastNs) >= MAX_DELTA)
+  {
+    addRecord (capLast, t - capLastNs) ;
+    capLastNs = t ;
+  }
+
+  return !((header->trigger != WPI_CAPTURE_NONE) && (header->head - header->trigger > trigPost)) ;
+}
+
+static void captureEnd (void)
+{
+  header->endNs = nanos64 () ;
+
+  pthread_mutex_lock (&captureLock) ;
+    header->running = FALSE ;
+    running         = FALSE ;
+    pthread_cond_broadcast (&captureDone) ;
+  pthread_mutex_unlock (&captureLock) ;
+}
+
+
+/*
+ * captureThread: captureTask: captureGone:
+ *	The sampling loop as a thread of its own, or a busy-poll task - which
+ *	just stops if the executive does.
+ *********************************************************************************
+ */
+
+static void *captureThread (UNU void *arg)
+{
+  captureBegin () ;
+
+  while (!stopCapture && captureStep (CHECK_EVERY))
+    ;
+
+  captureEnd () ;
+
+  return NULL ;
+}
+
+static int captureTask (UNU void *ctx, UNU unsigned long long now)
+{
+  if (stopCapture || !captureStep (SPIN_SAMPLES))
+  {
+    captureEnd () ;
+    return FALSE ;
+  }
+
+  return TRUE ;
+}
+
+static void captureGone (UNU void *ctx)
+{
+  captureEnd () ;
+}
+
+
+/*
+ * captureTrigger:
+ *	Stop post records after the captured pins in mask first read as value.
+ *	A mask of 0 (the default) runs until captureStop ().
+ *	Set it before captureStart ().
+ *********************************************************************************
+ */
+
+void captureTrigger (unsigned int mask, unsigned int value, unsigned int post)
+{
+  trigMask  = mask ;
+  trigValue = value & mask ;
+  trigPost  = post ;
+}
+
+
+/*
+ * captureStart:
+ *	Capture the BCM_GPIO pins in mask to a ring of the given number of
+ *	records in the file, on the CPUs in cpuMask (0 for anywhere) - or on
+ *	the busy-poll executive if it's running.
+ *	Returns 0 or -1 with errno set.
+ *********************************************************************************
+ */
+
+int captureStart (const char *file, unsigned int records, unsigned int mask, unsigned int cpuMask)
+{
+  void *map ;
+  int fd, res ;
+
+  if ((records < 16) || (mask == 0) || running)
+  {
+    errno = running ? EBUSY : EINVAL ;
+    return -1 ;
+  }
+
+  if (header != NULL)
+    munmap (header, mapSize) ;
+  header = NULL ;
+
+  mapSize = WPI_CAPTURE_DATA + (size_t)records * sizeof (struct wpiCaptureRecordStruct) ;
+
+  if ((fd = open (file, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0)
+    return -1 ;
+
+  if (ftruncate (fd, mapSize) < 0)
+  {
+    close (fd) ;
+    return -1 ;
+  }
+
+  map = mmap (NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) ;
+  close (fd) ;
+  if (map == MAP_FAILED)
+    return -1 ;
+
+// Touch every page now so the sampling loop never takes a fault
+
+  memset (map, 0, mapSize) ;
+
+  header = (struct wpiCaptureHeaderStruct *)map ;
+  ring   = (struct wpiCaptureRecordStruct *)((char *)map + WPI_CAPTURE_DATA) ;
+
+  header->magic     = WPI_CAPTURE_MAGIC ;
+  header->version   = WPI_CAPTURE_VERSION ;
+  header->mask      = mask ;
+  header->records   = records ;
+  header->trigger   = WPI_CAPTURE_NONE ;
+  header->trigMask  = trigMask ;
+  header->trigValue = trigValue ;
+  header->post      = trigPost ;
+  header->running   = TRUE ;
+
+  stopCapture = FALSE ;
+  running     = TRUE ;
+
+  /**/ if (piSpinActive ())
+  {
+    captureBegin () ;
+    res = (piSpinAdd (captureTask, captureGone, NULL, 20000) < 0) ? ENOSPC : 0 ;	// nS: SPIN_SAMPLES reads
+  }
+  else if (cpuMask != 0)
+    res = piThreadCreateRT (captureThread, NULL, SCHED_FIFO, 50, cpuMask, 0) ;
+  else
+    res = piThreadCreateRT (captureThread, NULL, SCHED_OTHER, 0, 0, 0) ;
+
+  if (res != 0)
+  {
+    running = FALSE ;
+    munmap (header, mapSize) ;
+    header = NULL ;
+    errno  = res ;
+    return -1 ;
+  }
+
+  return 0 ;
+}
+
+
+/*
+ * captureRunning: captureWait:
+ *	See if the capture is still going, or wait up to ms for it to stop
+ *	(0 to wait for ever). captureWait returns TRUE if it has.
+ *********************************************************************************
+ */
+
+int captureRunning (void)
+{
+  return __atomic_load_n (&running, __ATOMIC_ACQUIRE) ;
+}
+
+int captureWait (unsigned int ms)
+{
+  struct timespec deadline ;
+  int res ;
+
+  clock_gettime (CLOCK_REALTIME, &deadline) ;
+  deadline.tv_sec  += ms / 1000 ;
+  deadline.tv_nsec += (ms % 1000) * 1000000L ;
+  if (deadline.tv_nsec >= 1000000000L)
+  {
+    deadline.tv_sec  += 1 ;
+    deadline.tv_nsec -= 1000000000L ;
+  }
+
+  pthread_mutex_lock (&captureLock) ;
+    while (running)
+      if (ms == 0)
+	pthread_cond_wait (&captureDone, &captureLock) ;
+      else if (pthread_cond_timedwait (&captureDone, &captureLock, &deadline) != 0)
+	break ;
+    res = !running ;
+  pthread_mutex_unlock (&captureLock) ;
+
+  return res ;
+}
+
+
+/*
+ * captureStop:
+ *	Stop the capture and write the file out
+ *********************************************************************************
+ */
+
+void captureStop (void)
+{
+  if (header == NULL)
+    return ;
+
+  stopCapture = TRUE ;
+  (void)captureWait (0) ;
+
+  msync (header, mapSize, MS_SYNC) ;
+  munmap (header, mapSize) ;
+  header = NULL ;
+}
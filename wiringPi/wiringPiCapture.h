@@ -0,0 +1,76 @@
+/*
+ * wiringPiCapture.h:
+ *	Logic analyser style capture of the GPIO levels to a file
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <stdint.h>
+
+// The capture file: this header, then a ring of records from
+//	WPI_CAPTURE_DATA on. A record is written each time any of the
+//	captured pins changes, with the time since the record before.
+//	The ring holds the last records of the head written so far - the
+//	oldest of them at baseNs.
+
+#define	WPI_CAPTURE_MAGIC	0x57504331	// WPC1
+#define	WPI_CAPTURE_VERSION	1
+#define	WPI_CAPTURE_DATA	128
+#define	WPI_CAPTURE_NONE	(~0ULL)
+
+struct wpiCaptureHeaderStruct
+{
+  uint32_t magic ;
+  uint32_t version ;
+  uint32_t mask ;		// BCM_GPIO 0-31 captured
+  uint32_t records ;		// Ring size
+
+  uint64_t baseNs ;		// CLOCK_MONOTONIC time of the oldest record
+  uint64_t head ;		// Records written
+  uint64_t trigger ;		// Record number of the trigger, or WPI_CAPTURE_NONE
+  uint64_t samples ;		// Times the levels were read
+  uint64_t startNs ;
+  uint64_t endNs ;		// 0 while still running
+
+  uint32_t trigMask ;
+  uint32_t trigValue ;
+  uint32_t post ;		// Records after the trigger before stopping
+  uint32_t running ;
+} ;
+
+struct wpiCaptureRecordStruct
+{
+  uint32_t levels ;
+  uint32_t deltaNs ;
+} ;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern void captureTrigger (unsigned int mask, unsigned int value, unsigned int post) ;
+extern int  captureStart   (const char *file, unsigned int records, unsigned int mask, unsigned int cpuMask) ;
+extern int  captureRunning (void) ;
+extern int  captureWait    (unsigned int ms) ;
+extern void captureStop    (void) ;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,207 @@
+/*
+ * wiringPiConfig.c:
+ *	Sharing the GPIO configuration registers with other processes.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+/*
+ * Notes:
+ *	pinMode (), pullUpDnControl () and friends change a few bits of a
+ *	register shared by 10 (or 16) pins with a read-modify-write, so two
+ *	processes setting up different pins in the same register at the same
+ *	time can undo each other's work. wiringPiConfigShare () (or running
+ *	with WIRINGPI_SHARED set) puts a lock round each of them, in a shared
+ *	memory segment every process using it maps.
+ *
+ *	A lock is a word: 0 when free, else the pid of the process holding
+ *	it, with the top bit set if anyone's waiting. Taking a free lock is
+ *	one compare-and-swap, and giving it back one exchange, so there's a
+ *	system call only when there's a wait. A waiter checks now and then
+ *	that the holder's still alive, and takes the lock over if not, so a
+ *	process dying in the middle can't wedge everyone else.
+ *
+ *	Without wiringPiConfigShare () the locks are just a test of a pointer.
+ *********************************************************************************
+ */
+
+#include <stdint.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include "wiringPi.h"
+#include "wiringPiConfig.h"
+#include "piThread.h"
+
+#define	CONFIG_SHM	"/wiringPi-config"
+#define	CONFIG_MAGIC	0x57504331	// WPC1
+
+#define	LOCK_WAITERS	0x80000000u
+#define	LOCK_CHECK_NS	10000000	// How often a waiter checks on the holder
+
+struct configShmStruct
+{
+  uint32_t magic ;
+  uint32_t locks [WPI_CONFIG_LOCKS] ;
+} ;
+
+static struct configShmStruct *configShm = NULL ;
+static pthread_mutex_t         configMapLock = PTHREAD_MUTEX_INITIALIZER ;
+static uint32_t                myPid ;
+
+
+/*
+ * wpiConfigLock:
+ * wpiConfigUnlock:
+ *	Take and give back a register's lock, if they're being shared.
+ *	Short sections - a read-modify-write or two - not to be nested.
+ *********************************************************************************
+ */
+
+void wpiConfigLock (int lock)
+{
+  struct configShmStruct *shm = __atomic_load_n (&configShm, __ATOMIC_ACQUIRE) ;
+  struct timespec timeout ;
+  uint32_t *l, old ;
+
+  if (shm == NULL)
+    return ;
+
+  l   = &shm->locks [lock] ;
+  old = 0 ;
+
+  if (__atomic_compare_exchange_n (l, &old, myPid, FALSE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    return ;
+
+// Contended: say there's a waiter and sleep until it's given back - taking
+//	it with the waiter bit set, as there may be others still waiting.
+
+  timeout.tv_sec  = 0 ;
+  timeout.tv_nsec = LOCK_CHECK_NS ;
+
+  for (;;)
+  {
+    if (old == 0)
+    {
+      if (__atomic_compare_exchange_n (l, &old, myPid | LOCK_WAITERS, FALSE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+	return ;
+      continue ;
+    }
+
+    if ((old & LOCK_WAITERS) == 0)
+      if (!__atomic_compare_exchange_n (l, &old, old | LOCK_WAITERS, FALSE, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	continue ;
+
+    old |= LOCK_WAITERS ;
+
+    if ((piFutexWait (l, old, &timeout) < 0) && (errno == ETIMEDOUT))
+    {
+      if ((kill ((pid_t)(old & ~LOCK_WAITERS), 0) < 0) && (errno == ESRCH))	// Holder's gone
+	if (__atomic_compare_exchange_n (l, &old, myPid | LOCK_WAITERS, FALSE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+	  return ;
+    }
+
+    old = __atomic_load_n (l, __ATOMIC_RELAXED) ;
+  }
+}
+
+void wpiConfigUnlock (int lock)
+{
+  struct configShmStruct *shm = __atomic_load_n (&configShm, __ATOMIC_ACQUIRE) ;
+
+  if (shm == NULL)
+    return ;
+
+  if ((__atomic_exchange_n (&shm->locks [lock], 0, __ATOMIC_RELEASE) & LOCK_WAITERS) != 0)
+    piFutexWake (&shm->locks [lock], 1) ;
+}
+
+
+/*
+ * wiringPiConfigShare:
+ *	Share the configuration register locks with every other process
+ *	doing the same. Call it before setting up any pins - changes made
+ *	before it aren't covered. The segment starts out all zeros, which is
+ *	all unlocked, so whoever gets there first just has to size it.
+ *	Returns 0 or -1 with errno set.
+ *********************************************************************************
+ */
+
+int wiringPiConfigShare (void)
+{
+  struct configShmStruct *shm ;
+  struct stat st ;
+  uint32_t magic = 0 ;
+  int fd, err ;
+
+  pthread_mutex_lock (&configMapLock) ;
+
+  if (configShm != NULL)
+  {
+    pthread_mutex_unlock (&configMapLock) ;
+    return 0 ;
+  }
+
+  if ((fd = shm_open (CONFIG_SHM, O_CREAT | O_RDWR, 0666)) < 0)
+  {
+    pthread_mutex_unlock (&configMapLock) ;
+    return -1 ;
+  }
+
+  (void)fchmod (fd, 0666) ;	// Past the umask, for other users - fails harmlessly if it's not ours
+
+  if ((fstat (fd, &st) < 0) || ((st.st_size < (off_t)sizeof (*shm)) && (ftruncate (fd, sizeof (*shm)) < 0)))
+    shm = MAP_FAILED ;
+  else
+    shm = (struct configShmStruct *)mmap (NULL, sizeof (*shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) ;
+
+  err = errno ;
+  close (fd) ;
+
+  if (shm == MAP_FAILED)
+  {
+    pthread_mutex_unlock (&configMapLock) ;
+    errno = err ;
+    return -1 ;
+  }
+
+  (void)__atomic_compare_exchange_n (&shm->magic, &magic, CONFIG_MAGIC, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) ;
+  if (__atomic_load_n (&shm->magic, __ATOMIC_ACQUIRE) != CONFIG_MAGIC)	// Someone else's, or a different layout
+  {
+    munmap (shm, sizeof (*shm)) ;
+    pthread_mutex_unlock (&configMapLock) ;
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  myPid = (uint32_t)getpid () ;
+  __atomic_store_n (&configShm, shm, __ATOMIC_RELEASE) ;
+
+  pthread_mutex_unlock (&configMapLock) ;
+
+  return 0 ;
+}
@@ -0,0 +1,47 @@
+/*
+ * wiringPiConfig.h:
+ *	Sharing the GPIO configuration registers with other processes.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+// The locks: one per register that gets a read-modify-write
+
+#define	WPI_CONFIG_FSEL(n)	(n)		// GPFSEL0-5
+#define	WPI_CONFIG_PULL(n)	(6 + (n))	// GPPUPPDN0-3 (2711)
+#define	WPI_CONFIG_PUD		10		// The GPPUD/GPPUDCLK sequence
+#define	WPI_CONFIG_LOCKS	11
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// For programs
+
+extern int  wiringPiConfigShare (void) ;
+
+// For the rest of wiringPi
+
+extern void wpiConfigLock   (int lock) ;
+extern void wpiConfigUnlock (int lock) ;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,307 @@
+/*
+ * wiringPiDMA.c:
+ *	BCM DMA controller and VideoCore memory access routines
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+/*
+ * Notes:
+ *	The DMA engine works with "bus" addresses (0x7Exxxxxx for the
+ *	peripherals) and needs its control blocks and data in memory that
+ *	isn't sitting in the ARM's cache, so we ask the VideoCore for that
+ *	via the mailbox (/dev/vcio) and map it in via /dev/mem.
+ *
+ *	Some DMA channels are used by the kernel and the GPU. Channels 5
+ *	and 10 through 14 are normally free on Raspberry Pi OS, but check
+ *	the brcm,dma-channel-mask property in the device tree on your
+ *	system if in doubt.
+ *
+ *	All of this needs root.
+ *********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "wiringPi.h"
+#include "wiringPiDMA.h"
+
+#define	DMA_OFFSET		0x007000
+#define	DMA_ENABLE		(0xFF0 / 4)
+
+// Per-channel registers (words)
+
+#define	DMA_CS			0
+#define	DMA_CONBLK_AD		1
+#define	DMA_DEBUG		8
+
+#define	DMA_CS_ACTIVE		(1 <<  0)
+#define	DMA_CS_END		(1 <<  1)
+#define	DMA_CS_INT		(1 <<  2)
+#define	DMA_CS_ERROR		(1 <<  8)
+#define	DMA_CS_PRIORITY(x)	((x) << 16)
+#define	DMA_CS_PANIC(x)		((x) << 20)
+#define	DMA_CS_WAIT_WRITES	(1 << 28)
+#define	DMA_CS_ABORT		(1 << 30)
+#define	DMA_CS_RESET		(1 << 31)
+
+// Mailbox
+
+#define	MBOX_PROPERTY		_IOWR (100, 0, char *)
+#define	MBOX_TAG_ALLOC		0x3000C
+#define	MBOX_TAG_LOCK		0x3000D
+#define	MBOX_TAG_UNLOCK		0x3000E
+#define	MBOX_TAG_RELEASE	0x3000F
+
+#define	MEM_FLAG_DIRECT		0x04	// 0xC alias, uncached
+#define	MEM_FLAG_COHERENT	0x08	// 0x8 alias, L2 only
+
+static volatile unsigned int *dma = NULL ;
+
+
+/*
+ * mboxCall:
+ *	Send a single tag with up to 3 words of arguments to the VideoCore
+ *	and return the first word of the reply, or 0 on failure.
+ *********************************************************************************
+ */
+
+static uint32_t mboxCall (uint32_t tag, int numArgs, uint32_t a0, uint32_t a1, uint32_t a2)
+{
+  uint32_t msg [32] __attribute__ ((aligned (16))) ;
+  int      fd, i = 0 ;
+
+  if ((fd = open ("/dev/vcio", O_RDWR | O_CLOEXEC)) < 0)
+    return 0 ;
+
+  msg [i++] = 0 ;		// Size, filled in below
+  msg [i++] = 0 ;		// Process request
+  msg [i++] = tag ;
+  msg [i++] = 12 ;		// Value buffer size
+  msg [i++] = numArgs * 4 ;
+  msg [i++] = a0 ;
+  msg [i++] = a1 ;
+  msg [i++] = a2 ;
+  msg [i++] = 0 ;		// End tag
+  msg [0]   = i * 4 ;
+
+  if (ioctl (fd, MBOX_PROPERTY, msg) < 0)
+    msg [5] = 0 ;
+
+  close (fd) ;
+
+  if ((msg [1] & 0x80000000) == 0)	// Not a response
+    return 0 ;
+
+  return msg [5] ;
+}
+
+
+/*
+ * dmaMemAlloc:
+ *	Allocate a block of uncached memory from the VideoCore and map it
+ *	into our address space. Returns 0 on success, -1 on failure.
+ *********************************************************************************
+ */
+
+int dmaMemAlloc (struct dmaMemStruct *mem, unsigned int size)
+{
+  uint32_t flags ;
+  int      fd ;
+  void    *map ;
+
+  memset (mem, 0, sizeof (*mem)) ;
+
+  if (wiringPiPeriBase () == 0)
+    return -1 ;
+
+  size  = (size + 4095) & ~4095 ;
+  flags = (wiringPiPeriBase () == 0x20000000) ? (MEM_FLAG_DIRECT | MEM_FLAG_COHERENT) : MEM_FLAG_DIRECT ;
+
+  if ((mem->handle = mboxCall (MBOX_TAG_ALLOC, 3, size, 4096, flags)) == 0)
+    return -1 ;
+
+  if ((mem->bus = mboxCall (MBOX_TAG_LOCK, 1, mem->handle, 0, 0)) == 0)
+  {
+    mboxCall (MBOX_TAG_RELEASE, 1, mem->handle, 0, 0) ;
+    return -1 ;
+  }
+
+  if ((fd = open ("/dev/mem", O_RDWR | O_SYNC | O_CLOEXEC)) < 0)
+  {
+    dmaMemFree (mem) ;
+    return -1 ;
+  }
+
+  map = mmap (0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, mem->bus & ~0xC0000000) ;
+  close (fd) ;
+
+  if (map == MAP_FAILED)
+  {
+    dmaMemFree (mem) ;
+    return -1 ;
+  }
+
+  mem->virt = map ;
+  mem->size = size ;
+  memset (mem->virt, 0, size) ;
+
+  return 0 ;
+}
+
+
+/*
+ * dmaMemFree:
+ *	Give it all back
+ *********************************************************************************
+ */
+
+void dmaMemFree (struct dmaMemStruct *mem)
+{
+  if (mem->virt != NULL)
+    munmap (mem->virt, mem->size) ;
+
+  if (mem->handle != 0)
+  {
+    mboxCall (MBOX_TAG_UNLOCK,  1, mem->handle, 0, 0) ;
+    mboxCall (MBOX_TAG_RELEASE, 1, mem->handle, 0, 0) ;
+  }
+
+  memset (mem, 0, sizeof (*mem)) ;
+}
+
+
+/*
+ * dmaBusAddr:
+ *	Translate a pointer into a dmaMem block into a bus address
+ *********************************************************************************
+ */
+
+uint32_t dmaBusAddr (struct dmaMemStruct *mem, const void *virt)
+{
+  return mem->bus + (uint32_t)((const uint8_t *)virt - (const uint8_t *)mem->virt) ;
+}
+
+
+/*
+ * dmaChannelSetup:
+ *	Map the DMA controller (once) and reset the given channel.
+ *	Channel 15 lives elsewhere and isn't supported.
+ *********************************************************************************
+ */
+
+int dmaChannelSetup (int channel)
+{
+  if ((channel < 0) || (channel >= DMA_CHANNELS))
+    return -1 ;
+
+  if (dma == NULL)
+    if ((dma = wiringPiPeriMap (DMA_OFFSET, 4096)) == NULL)
+      return -1 ;
+
+  *(dma + DMA_ENABLE) |= (1 << channel) ;
+  dmaStop (channel) ;
+
+  return 0 ;
+}
+
+
+/*
+ * dmaStart:
+ *	Start the channel running the chain of control blocks at cbBus
+ *********************************************************************************
+ */
+
+int dmaStart (int channel, uint32_t cbBus)
+{
+  volatile unsigned int *regs ;
+
+  if ((dma == NULL) || (channel < 0) || (channel >= DMA_CHANNELS))
+    return -1 ;
+
+  regs = dma + channel * (0x100 / 4) ;
+
+  *(regs + DMA_CS)        = DMA_CS_END | DMA_CS_INT ;	// Clear any left-overs
+  *(regs + DMA_CONBLK_AD) = cbBus ;
+  *(regs + DMA_DEBUG)     = 7 ;				// Clear errors
+  *(regs + DMA_CS)        = DMA_CS_WAIT_WRITES | DMA_CS_PANIC (15) | DMA_CS_PRIORITY (15) | DMA_CS_ACTIVE ;
+
+  return 0 ;
+}
+
+
+/*
+ * dmaStop:
+ *	Abort whatever the channel is doing and reset it
+ *********************************************************************************
+ */
+
+void dmaStop (int channel)
+{
+  volatile unsigned int *regs ;
+
+  if ((dma == NULL) || (channel < 0) || (channel >= DMA_CHANNELS))
+    return ;
+
+  regs = dma + channel * (0x100 / 4) ;
+
+  *(regs + DMA_CS) = DMA_CS_ABORT ;
+  delayMicroseconds (10) ;
+  *(regs + DMA_CS) = DMA_CS_RESET ;
+  *(regs + DMA_CONBLK_AD) = 0 ;
+  *(regs + DMA_DEBUG)     = 7 ;
+}
+
+
+/*
+ * dmaBusy:
+ *	Is the channel still running?
+ *********************************************************************************
+ */
+
+int dmaBusy (int channel)
+{
+  if ((dma == NULL) || (channel < 0) || (channel >= DMA_CHANNELS))
+    return FALSE ;
+
+  return (*(dma + channel * (0x100 / 4) + DMA_CS) & DMA_CS_ACTIVE) != 0 ;
+}
+
+
+/*
+ * dmaCurrentCb:
+ *	Return the bus address of the control block the channel is working on
+ *********************************************************************************
+ */
+
+uint32_t dmaCurrentCb (int channel)
+{
+  if ((dma == NULL) || (channel < 0) || (channel >= DMA_CHANNELS))
+    return 0 ;
+
+  return *(dma + channel * (0x100 / 4) + DMA_CONBLK_AD) ;
+}
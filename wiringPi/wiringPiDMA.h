@@ -0,0 +1,102 @@
+/*
+ * wiringPiDMA.h:
+ *	BCM DMA controller and VideoCore memory access routines
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <stdint.h>
+
+// DMA control block. Must be 32-byte aligned in memory the DMA engine
+//	can see, i.e. allocated with dmaMemAlloc.
+
+struct dmaCbStruct
+{
+  uint32_t info ;		// Transfer information (DMA_TI_*)
+  uint32_t src ;		// Source bus address
+  uint32_t dst ;		// Destination bus address
+  uint32_t length ;		// Transfer length in bytes
+  uint32_t stride ;
+  uint32_t next ;		// Bus address of the next control block, or 0
+  uint32_t pad [2] ;
+} ;
+
+// A block of uncached memory from the VideoCore. virt is our pointer,
+//	bus the address the DMA engine uses.
+
+struct dmaMemStruct
+{
+  void        *virt ;
+  uint32_t     bus ;
+  unsigned int size ;
+  unsigned int handle ;
+} ;
+
+// Transfer information bits
+
+#define	DMA_TI_INTEN		(1 <<  0)
+#define	DMA_TI_TDMODE		(1 <<  1)
+#define	DMA_TI_WAIT_RESP	(1 <<  3)
+#define	DMA_TI_DEST_INC		(1 <<  4)
+#define	DMA_TI_DEST_WIDTH	(1 <<  5)
+#define	DMA_TI_DEST_DREQ	(1 <<  6)
+#define	DMA_TI_DEST_IGNORE	(1 <<  7)
+#define	DMA_TI_SRC_INC		(1 <<  8)
+#define	DMA_TI_SRC_WIDTH	(1 <<  9)
+#define	DMA_TI_SRC_DREQ		(1 << 10)
+#define	DMA_TI_SRC_IGNORE	(1 << 11)
+#define	DMA_TI_PERMAP(x)	((x) << 16)
+#define	DMA_TI_WAITS(x)		((x) << 21)
+#define	DMA_TI_NO_WIDE_BURSTS	(1 << 26)
+
+// Peripheral DREQ numbers for DMA_TI_PERMAP
+
+#define	DMA_DREQ_PCM_TX		 2
+#define	DMA_DREQ_PCM_RX		 3
+#define	DMA_DREQ_PWM		 5
+#define	DMA_DREQ_SPI_TX		 6
+#define	DMA_DREQ_SPI_RX		 7
+
+// Peripheral block bus addresses
+
+#define	DMA_BUS_PERI		0x7E000000
+#define	DMA_BUS_GPIO		(DMA_BUS_PERI + 0x200000)
+#define	DMA_BUS_PWM		(DMA_BUS_PERI + 0x20C000)
+#define	DMA_BUS_PCM		(DMA_BUS_PERI + 0x203000)
+
+#define	DMA_CHANNELS		15
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int  dmaMemAlloc     (struct dmaMemStruct *mem, unsigned int size) ;
+extern void dmaMemFree      (struct dmaMemStruct *mem) ;
+extern uint32_t dmaBusAddr  (struct dmaMemStruct *mem, const void *virt) ;
+
+extern int  dmaChannelSetup (int channel) ;
+extern int  dmaStart        (int channel, uint32_t cbBus) ;
+extern void dmaStop         (int channel) ;
+extern int  dmaBusy         (int channel) ;
+extern uint32_t dmaCurrentCb (int channel) ;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,298 @@
+/*
+ * wiringPiFilter.c:
+ *	Oversampling and filtering of analogRead () on extension nodes.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+/*
+ * Notes:
+ *	Once a pin has a filter, every analogRead () of it goes in two
+ *	stages: samples conversions are fetched with the node's
+ *	analogReadMulti () - one SPI transaction on the mcp3004 - and
+ *	averaged, then the result goes through the filter across reads.
+ *
+ *	With extraBits the average is scaled up by 2^extraBits, which is
+ *	real resolution from oversampling and decimation as long as there's
+ *	some noise and samples is at least 4^extraBits. 16 samples and 2
+ *	extra bits turns the 10-bit mcp3004 into a 12-bit one.
+ *
+ *	Devices that convert in the background and hand back the latest
+ *	result (the ads1115 and mcp3422 when scanning) gain nothing from
+ *	samples; use the filter across reads on them instead.
+ *********************************************************************************
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "wiringPi.h"
+#include "wiringPiFilter.h"
+
+struct wpiAnalogFilterStruct
+{
+  pthread_mutex_t lock ;
+  int       samples ;		// 0 for no filter on this pin
+  int       extraBits ;
+  int       type ;
+  int       param ;
+
+  int       history [ADC_FILTER_MAX_WINDOW] ;
+  int       count ;		// Valid entries in history
+  int       next ;
+  long long sum ;		// Of history, for ADC_FILTER_MOVING
+  long long iir ;		// Q16
+} ;
+
+static pthread_mutex_t filterLock = PTHREAD_MUTEX_INITIALIZER ;
+
+
+/*
+ * sumSamples:
+ *	Add up a block of samples - four at a time with NEON
+ *********************************************************************************
+ */
+
+static long long sumSamples (const int *values, int n)
+{
+  long long sum = 0 ;
+  int i = 0 ;
+
+#if defined(__ARM_NEON)
+  int64x2_t acc = vdupq_n_s64 (0) ;
+
+  for ( ; i + 4 <= n ; i += 4)
+    acc = vpadalq_s32 (acc, vld1q_s32 (&values [i])) ;
+
+  sum = vgetq_lane_s64 (acc, 0) + vgetq_lane_s64 (acc, 1) ;
+#endif
+
+  for ( ; i < n ; ++i)
+    sum += values [i] ;
+
+  return sum ;
+}
+
+
+/*
+ * median:
+ *	Of up to ADC_FILTER_MAX_WINDOW values
+ *********************************************************************************
+ */
+
+static int median (const int *values, int n)
+{
+  int sorted [ADC_FILTER_MAX_WINDOW] ;
+  int i, j, v ;
+
+  for (i = 0 ; i < n ; ++i)
+  {
+    v = values [i] ;
+    for (j = i ; (j > 0) && (sorted [j - 1] > v) ; --j)
+      sorted [j] = sorted [j - 1] ;
+    sorted [j] = v ;
+  }
+
+  return sorted [n / 2] ;
+}
+
+
+/*
+ * analogFilterRead:
+ *	analogRead () of a pin on a node with filters
+ *********************************************************************************
+ */
+
+int analogFilterRead (struct wiringPiNodeStruct *node, int pin)
+{
+  struct wpiAnalogFilterStruct *f = &node->filters [pin - node->pinBase] ;
+  int       values [ADC_FILTER_MAX_SAMPLES] ;
+  long long x ;
+  int       n ;
+
+  pthread_mutex_lock (&f->lock) ;
+
+  if (f->samples == 0)
+  {
+    pthread_mutex_unlock (&f->lock) ;
+    return node->analogRead (node, pin) ;
+  }
+
+// Oversample
+
+  if (f->samples == 1)
+  {
+    values [0] = node->analogRead (node, pin) ;
+    n = 1 ;
+  }
+  else if ((n = node->analogReadMulti (node, pin, values, f->samples)) <= 0)
+  {
+    values [0] = node->analogRead (node, pin) ;
+    n = 1 ;
+  }
+
+  x = (sumSamples (values, n) * (1LL << f->extraBits) + n / 2) / n ;
+
+// and filter
+
+  switch (f->type)
+  {
+    case ADC_FILTER_MOVING:
+      if (f->count == f->param)
+	f->sum -= f->history [f->next] ;
+      else
+	++f->count ;
+      f->history [f->next] = (int)x ;
+      f->sum += x ;
+      f->next = (f->next + 1) % f->param ;
+      x = (f->sum + f->count / 2) / f->count ;
+      break ;
+
+    case ADC_FILTER_IIR:
+      if (f->count == 0)
+      {
+	f->iir   = x * 65536 ;
+	f->count = 1 ;
+      }
+      else
+	f->iir += (x * 65536 - f->iir) >> f->param ;
+      x = (f->iir + 0x8000) >> 16 ;
+      break ;
+
+    case ADC_FILTER_MEDIAN:
+      f->history [f->next] = (int)x ;
+      f->next = (f->next + 1) % f->param ;
+      if (f->count < f->param)
+	++f->count ;
+      x = median (f->history, f->count) ;
+      break ;
+  }
+
+  pthread_mutex_unlock (&f->lock) ;
+
+  return (int)x ;
+}
+
+
+/*
+ * analogReadFilter:
+ *	Filter analogRead () of an extension node pin from now on. Each
+ *	read takes samples conversions in one go (1 for just the one) and
+ *	averages them, scaled up by 2^extraBits, then applies a filter:
+ *	ADC_FILTER_NONE, or ADC_FILTER_MOVING, ADC_FILTER_IIR or
+ *	ADC_FILTER_MEDIAN with param as in wiringPiFilter.h
+ *	1 sample, no extra bits and ADC_FILTER_NONE turns filtering off.
+ *	Returns 0 or -1 with errno set.
+ *********************************************************************************
+ */
+
+int analogReadFilter (int pin, int samples, int extraBits, int type, int param)
+{
+  struct wiringPiNodeStruct *node ;
+  struct wpiAnalogFilterStruct *filters, *f ;
+  int i, numPins, valid = TRUE ;
+
+  if ((samples < 1) || (samples > ADC_FILTER_MAX_SAMPLES) || (extraBits < 0) || (extraBits > 8))
+    type = -1 ;
+
+  /**/ if (type == ADC_FILTER_NONE)
+    param = 1 ;
+  else if ((type == ADC_FILTER_MOVING) || (type == ADC_FILTER_MEDIAN))
+    valid = (param >= 1) && (param <= ADC_FILTER_MAX_WINDOW) ;
+  else if (type == ADC_FILTER_IIR)
+    valid = (param >= 1) && (param <= 15) ;
+  else
+    valid = FALSE ;
+
+  if (!valid)
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  if ((node = wiringPiFindNode (pin)) == NULL)
+  {
+    errno = ENODEV ;
+    return -1 ;
+  }
+
+// The first filter on a node makes the state for all its pins
+
+  pthread_mutex_lock (&filterLock) ;
+
+  if ((filters = node->filters) == NULL)
+  {
+    numPins = node->pinMax - node->pinBase + 1 ;
+    if ((filters = (struct wpiAnalogFilterStruct *)calloc (numPins, sizeof (*filters))) == NULL)
+    {
+      pthread_mutex_unlock (&filterLock) ;
+      errno = ENOMEM ;
+      return -1 ;
+    }
+
+    for (i = 0 ; i < numPins ; ++i)
+      pthread_mutex_init (&filters [i].lock, NULL) ;
+
+    __atomic_store_n (&node->filters, filters, __ATOMIC_RELEASE) ;
+  }
+
+  pthread_mutex_unlock (&filterLock) ;
+
+  f = &filters [pin - node->pinBase] ;
+
+  pthread_mutex_lock (&f->lock) ;
+    f->samples   = ((samples == 1) && (extraBits == 0) && (type == ADC_FILTER_NONE)) ? 0 : samples ;
+    f->extraBits = extraBits ;
+    f->type      = type ;
+    f->param     = param ;
+    f->count     = 0 ;
+    f->next      = 0 ;
+    f->sum       = 0 ;
+    f->iir       = 0 ;
+  pthread_mutex_unlock (&f->lock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * analogFilterFree:
+ *	The node is going
+ *********************************************************************************
+ */
+
+void analogFilterFree (struct wiringPiNodeStruct *node)
+{
+  int i ;
+
+  if (node->filters == NULL)
+    return ;
+
+  for (i = 0 ; i <= node->pinMax - node->pinBase ; ++i)
+    pthread_mutex_destroy (&node->filters [i].lock) ;
+
+  free (node->filters) ;
+  node->filters = NULL ;
+}
@@ -0,0 +1,50 @@
+/*
+ * wiringPiFilter.h:
+ *	Oversampling and filtering of analogRead () on extension nodes.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+// Filters across successive reads
+
+#define	ADC_FILTER_NONE		0
+#define	ADC_FILTER_MOVING	1	// Mean of the last param reads
+#define	ADC_FILTER_IIR		2	// y += (x - y) / 2^param
+#define	ADC_FILTER_MEDIAN	3	// Median of the last param reads
+
+#define	ADC_FILTER_MAX_SAMPLES	256
+#define	ADC_FILTER_MAX_WINDOW	32
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// For programs
+
+extern int analogReadFilter (int pin, int samples, int extraBits, int type, int param) ;
+
+// For the rest of wiringPi
+
+extern int  analogFilterRead (struct wiringPiNodeStruct *node, int pin) ;
+extern void analogFilterFree (struct wiringPiNodeStruct *node) ;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,324 @@
+/*
+ * wiringPiGpioChip.c:
+ *	GPIO character device (/dev/gpiochipN) access routines
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+
+/*
+ * Notes:
+ *	The /sys/class/gpio interface is deprecated and needs an lseek and a
+ *	read for every pin read, and gives us edges with no timestamp. The
+ *	GPIO character device (the v2 "uAPI" since Linux 5.10) hands back a
+ *	file descriptor for a "request" of up to 64 lines on a chip, which
+ *	we can then read or write in bulk with one ioctl, and which supplies
+ *	kernel timestamped edge events when edge detection is enabled.
+ *
+ *	It also works as a non-root user, as long as the user can open the
+ *	/dev/gpiochipN device (normally the gpio group on Raspbian)
+ *
+ *	We talk to the kernel directly rather than use libgpiod to keep
+ *	wiringPi free of extra dependencies.
+ *********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+#include "wiringPi.h"
+#include "wiringPiGpioChip.h"
+#include "wiringPiSim.h"
+
+#define	ENV_GPIOCHIP	"WIRINGPI_GPIOCHIP"
+#define	CONSUMER	"wiringPi"
+
+static int chipFd = -1 ;
+
+
+/*
+ * gpioChipOpen:
+ *	Open the given GPIO chip device, or /dev/gpiochip0 (which is the
+ *	on-board GPIO on all current Pi's) if NULL. The environment variable
+ *	WIRINGPI_GPIOCHIP overrides the default.
+ *	Returns the chip fd or -1.
+ *********************************************************************************
+ */
+
+int gpioChipOpen (const char *device)
+{
+  if (device == NULL)
+    if ((device = getenv (ENV_GPIOCHIP)) == NULL)
+      device = "/dev/gpiochip0" ;
+
+  if (chipFd != -1)
+    close (chipFd) ;
+
+  if (wiringPiSimActive ())
+    return chipFd = simChipOpen () ;
+
+  if ((chipFd = open (device, O_RDWR | O_CLOEXEC)) < 0)
+    return chipFd = -1 ;
+
+  return chipFd ;
+}
+
+
+/*
+ * gpioChipFd:
+ *	Return the chip fd, opening the default chip the first time through
+ *********************************************************************************
+ */
+
+int gpioChipFd (void)
+{
+  if (chipFd == -1)
+    return gpioChipOpen (NULL) ;
+
+  return chipFd ;
+}
+
+
+/*
+ * lineFlags:
+ *	Convert wiringPi mode, pull and edge values into a uAPI flag set.
+ *	A mode of -1 leaves the direction as-is.
+ *********************************************************************************
+ */
+
+static uint64_t lineFlags (int mode, int pud, int edge)
+{
+  uint64_t flags = 0 ;
+
+  /**/ if (mode == INPUT)
+    flags |= GPIO_V2_LINE_FLAG_INPUT ;
+  else if (mode == OUTPUT)
+    flags |= GPIO_V2_LINE_FLAG_OUTPUT ;
+
+  /**/ if (pud == PUD_UP)
+    flags |= GPIO_V2_LINE_FLAG_BIAS_PULL_UP ;
+  else if (pud == PUD_DOWN)
+    flags |= GPIO_V2_LINE_FLAG_BIAS_PULL_DOWN ;
+  else if (pud == PUD_OFF)
+    flags |= GPIO_V2_LINE_FLAG_BIAS_DISABLED ;
+
+// Edge detection only makes sense on an input
+
+  if ((edge == INT_EDGE_FALLING) || (edge == INT_EDGE_RISING) || (edge == INT_EDGE_BOTH))
+  {
+    flags &= ~GPIO_V2_LINE_FLAG_OUTPUT ;
+    flags |=  GPIO_V2_LINE_FLAG_INPUT ;
+
+    if ((edge == INT_EDGE_RISING)  || (edge == INT_EDGE_BOTH))
+      flags |= GPIO_V2_LINE_FLAG_EDGE_RISING ;
+    if ((edge == INT_EDGE_FALLING) || (edge == INT_EDGE_BOTH))
+      flags |= GPIO_V2_LINE_FLAG_EDGE_FALLING ;
+  }
+
+// Bias needs a direction
+
+  if ((flags & (GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_OUTPUT)) == 0)
+    flags &= ~(GPIO_V2_LINE_FLAG_BIAS_PULL_UP | GPIO_V2_LINE_FLAG_BIAS_PULL_DOWN | GPIO_V2_LINE_FLAG_BIAS_DISABLED) ;
+
+  return flags ;
+}
+
+
+/*
+ * lineDebounce:
+ *	Add a debounce period for all the lines to a configuration
+ *********************************************************************************
+ */
+
+static void lineDebounce (struct gpio_v2_line_config *config, int numLines, unsigned int debounceUs)
+{
+  if (debounceUs == 0)
+    return ;
+
+  config->attrs [0].attr.id                 = GPIO_V2_LINE_ATTR_ID_DEBOUNCE ;
+  config->attrs [0].attr.debounce_period_us = debounceUs ;
+  config->attrs [0].mask                    = (numLines >= 64) ? ~0ULL : (1ULL << numLines) - 1 ;
+  config->num_attrs                         = 1 ;
+}
+
+
+/*
+ * gpioChipRequest:
+ *	Request a group of lines, all with the same configuration.
+ *	mode is INPUT, OUTPUT or -1 for as-is, pud is PUD_xxx or -1 to leave it
+ *	alone and edge is INT_EDGE_xxx (INT_EDGE_SETUP for no edge detection)
+ *	debounceUs, if not 0, has the kernel filter out any edges that don't
+ *	stay put for that long.
+ *	Bit N of any mask passed to gpioChipGet and gpioChipSet corresponds
+ *	to lines [N] here.
+ *	Returns the request fd or -1 with errno set.
+ *********************************************************************************
+ */
+
+int gpioChipRequest (const int *lines, int numLines, int mode, int pud, int edge, unsigned int debounceUs)
+{
+  struct gpio_v2_line_request req ;
+  int i, fd ;
+
+  if ((numLines < 1) || (numLines > GPIO_V2_LINES_MAX))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  if ((fd = gpioChipFd ()) == -1)
+    return -1 ;
+
+  if (wiringPiSimActive ())
+    return simLineRequest (lines, numLines, mode, edge) ;
+
+  memset (&req, 0, sizeof (req)) ;
+
+  for (i = 0 ; i < numLines ; ++i)
+    req.offsets [i] = lines [i] ;
+
+  strncpy (req.consumer, CONSUMER, sizeof (req.consumer) - 1) ;
+  req.num_lines    = numLines ;
+  req.config.flags = lineFlags (mode, pud, edge) ;
+  lineDebounce (&req.config, numLines, debounceUs) ;
+
+  if (ioctl (fd, GPIO_V2_GET_LINE_IOCTL, &req) < 0)
+    return -1 ;
+
+  return req.fd ;
+}
+
+
+/*
+ * gpioChipReconfig:
+ *	Change the configuration of every line in a request. The lines stay
+ *	claimed throughout, so there are no glitches from releasing them.
+ *********************************************************************************
+ */
+
+int gpioChipReconfig (int reqFd, int numLines, int mode, int pud, int edge, unsigned int debounceUs)
+{
+  struct gpio_v2_line_config config ;
+
+  if (wiringPiSimActive ())
+    return simLineReconfig (reqFd, mode, edge) ;
+
+  memset (&config, 0, sizeof (config)) ;
+  config.flags = lineFlags (mode, pud, edge) ;
+  lineDebounce (&config, numLines, debounceUs) ;
+
+  return ioctl (reqFd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &config) ;
+}
+
+
+/*
+ * gpioChipGet: gpioChipSet:
+ *	Read or write any of the lines in a request in one ioctl.
+ *********************************************************************************
+ */
+
+int gpioChipGet (int reqFd, uint64_t mask, uint64_t *values)
+{
+  struct gpio_v2_line_values lv ;
+
+  if (wiringPiSimActive ())
+    return simLineGet (reqFd, mask, values) ;
+
+  lv.mask = mask ;
+  lv.bits = 0 ;
+
+  if (ioctl (reqFd, GPIO_V2_LINE_GET_VALUES_IOCTL, &lv) < 0)
+    return -1 ;
+
+  *values = lv.bits ;
+  return 0 ;
+}
+
+int gpioChipSet (int reqFd, uint64_t mask, uint64_t values)
+{
+  struct gpio_v2_line_values lv ;
+
+  if (wiringPiSimActive ())
+    return simLineSet (reqFd, mask, values) ;
+
+  lv.mask = mask ;
+  lv.bits = values ;
+
+  return ioctl (reqFd, GPIO_V2_LINE_SET_VALUES_IOCTL, &lv) ;
+}
+
+
+/*
+ * gpioChipReadEvents:
+ *	Read pending edge events in batches - up to maxEvents. This will
+ *	block if there are none, unless the fd has been made non-blocking,
+ *	so poll it first.
+ *	Returns the number of events read or -1.
+ *********************************************************************************
+ */
+
+int gpioChipReadEvents (int reqFd, struct wpiGpioEventStruct *events, int maxEvents)
+{
+  struct gpio_v2_line_event raw [16] ;
+  struct pollfd polls ;
+  int    got, n, i ;
+  int    total = 0 ;
+
+  while (total < maxEvents)
+  {
+    n = maxEvents - total ;
+    if (n > 16)
+      n = 16 ;
+
+    if ((got = read (reqFd, raw, n * sizeof (raw [0]))) < 0)
+      return (total > 0) ? total : -1 ;
+
+    got /= sizeof (raw [0]) ;
+
+    for (i = 0 ; i < got ; ++i, ++total)
+    {
+      events [total].line      = raw [i].offset ;
+      events [total].edge      = (raw [i].id == GPIO_V2_LINE_EVENT_RISING_EDGE) ? INT_EDGE_RISING : INT_EDGE_FALLING ;
+      events [total].timestamp = raw [i].timestamp_ns ;
+      events [total].seqno     = raw [i].line_seqno ;
+    }
+
+// Short read - nothing more pending right now, otherwise only go round
+//	again if there's more to read, so we never block part-way through
+
+    if (got < n)
+      break ;
+
+    polls.fd     = reqFd ;
+    polls.events = POLLIN ;
+    if (poll (&polls, 1, 0) <= 0)
+      break ;
+  }
+
+  return total ;
+}
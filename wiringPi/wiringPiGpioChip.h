@@ -0,0 +1,54 @@
+/*
+ * wiringPiGpioChip.h:
+ *	GPIO character device (/dev/gpiochipN) access routines
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <stdint.h>
+
+// wpiGpioEventStruct:
+//	One edge as reported by the kernel. The timestamp is CLOCK_MONOTONIC
+//	in nanoseconds, taken by the kernel when the edge happened.
+
+struct wpiGpioEventStruct
+{
+  int      line ;		// Line offset on the chip (BCM_GPIO for gpiochip0)
+  int      edge ;		// INT_EDGE_RISING or INT_EDGE_FALLING
+  uint64_t timestamp ;		// nS
+  unsigned int seqno ;		// Per-request sequence number
+} ;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int  gpioChipOpen       (const char *device) ;
+extern int  gpioChipFd         (void) ;
+
+extern int  gpioChipRequest    (const int *lines, int numLines, int mode, int pud, int edge, unsigned int debounceUs) ;
+extern int  gpioChipReconfig   (int reqFd, int numLines, int mode, int pud, int edge, unsigned int debounceUs) ;
+extern int  gpioChipGet        (int reqFd, uint64_t mask, uint64_t *values) ;
+extern int  gpioChipSet        (int reqFd, uint64_t mask, uint64_t values) ;
+extern int  gpioChipReadEvents (int reqFd, struct wpiGpioEventStruct *events, int maxEvents) ;
+
+#ifdef __cplusplus
+}
+#endif
@@ -42,6 +42,24 @@
  *
  *	Information here gained from: kernel/Documentation/i2c/dev-interface
  *	as well as other online resources.
+ *
+ *	Shared buses:
+ *	Normally each device gets its own open of /dev/i2c-N with I2C_SLAVE
+ *	set on it. In shared mode there's one fd per bus and each device just
+ *	gets a handle which is an index into our device table (offset so it
+ *	can't be confused with a real fd). All access to a shared device goes
+ *	through I2C_RDWR with the address in each message, under the bus lock,
+ *	so devices on the same bus can be used from many threads and batched
+ *	into one ioctl.
+ *
+ *	Soft buses:
+ *	A device name of "soft:N" is bus N from softI2cSetup () - always a
+ *	shared bus, with the messages going to softI2cTransfer () rather
+ *	than the kernel, so everything else here works on it unchanged.
+ *
+ *	Direct buses:
+ *	Likewise "bsc:N" is BSC master N from bscI2cSetup (), driven through
+ *	its registers. What bscI2cTransfer () can't do goes to /dev/i2c-N.
  *********************************************************************************
  */
 
@@ -51,17 +69,27 @@
 #include <errno.h>
 #include <string.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
 #include <asm/ioctl.h>
 
 #include "wiringPi.h"
 #include "wiringPiI2C.h"
+#include "softI2c.h"
+#include "bscI2c.h"
+#include "wiringPiSim.h"
+#include "wiringPiTrace.h"
+#include "piThread.h"
 
 // I2C definitions
 
 #define I2C_SLAVE	0x0703
+#define I2C_RDWR	0x0707	/* Combined R/W transfer (one STOP only) */
 #define I2C_SMBUS	0x0720	/* SMBus-level access */
 
+#define I2C_M_RD	0x0001
+
 #define I2C_SMBUS_READ	1
 #define I2C_SMBUS_WRITE	0
 
@@ -99,15 +127,121 @@ struct i2c_smbus_ioctl_data
   union i2c_smbus_data *data ;
 } ;
 
+struct i2c_msg
+{
+  uint16_t addr ;
+  uint16_t flags ;
+  uint16_t len ;
+  uint8_t *buf ;
+} ;
+
+struct i2c_rdwr_ioctl_data
+{
+  struct i2c_msg *msgs ;
+  uint32_t        nmsgs ;
+} ;
+
+// The I2C_RDWR messages need the device address, which the kernel only
+//	keeps to itself after I2C_SLAVE, so remember it for each fd.
+
+#define	MAX_I2C_FDS	1024
+
+static int i2cAddrs [MAX_I2C_FDS] ;
+
+// And its bus statistics slot, plus one so that zero is none
+
+static int i2cSlots [MAX_I2C_FDS] ;
+
+// Shared buses and the devices on them
+
+#define	MAX_I2C_BUSES		8
+#define	MAX_I2C_DEVS		128
+#define	I2C_SHARED_BASE		0x40000000
+#define	I2C_SOFT_PREFIX		"soft:"
+#define	I2C_BSC_PREFIX		"bsc:"
+
+#define	IS_SHARED(fd)	(((fd) >= I2C_SHARED_BASE) && ((fd) < I2C_SHARED_BASE + numDevs))
+
+struct i2cBusStruct
+{
+  char            device [32] ;
+  int             fd ;
+  int             soft ;		// softI2c bus, or -1
+  int             bsc ;			// bscI2c bus, or -1 - with fd for what it can't do
+  int             sim ;		// WIRINGPI_SIM: no real bus at all
+  pthread_mutex_t lock ;
+} ;
+
+struct i2cDevStruct
+{
+  int bus ;
+  int addr ;
+  int slot ;				// Bus statistics, or -1
+} ;
+
+static struct i2cBusStruct buses [MAX_I2C_BUSES] ;
+static struct i2cDevStruct devs  [MAX_I2C_DEVS] ;
+static int                 numBuses = 0 ;
+static int                 numDevs  = 0 ;
+static int                 shareAll = FALSE ;
+static char                defaultDevice [32] ;
+
+static pthread_mutex_t     tableLock = PTHREAD_MUTEX_INITIALIZER ;
+
+static int sharedSmbus (int fd, char rw, uint8_t command, int size, union i2c_smbus_data *data) ;
+
+/*
+ * statsSlot: msgBytes:
+ *	Where a handle's transactions are counted, and how many bytes a list
+ *	of messages moves.
+ *********************************************************************************
+ */
+
+static int statsSlot (int fd)
+{
+  if (IS_SHARED (fd))
+    return devs [fd - I2C_SHARED_BASE].slot ;
+  if ((fd >= 0) && (fd < MAX_I2C_FDS))
+    return i2cSlots [fd] - 1 ;
+  return -1 ;
+}
+
+static unsigned int msgBytes (const struct wpiI2cMsg *msgs, int numMsgs)
+{
+  unsigned int bytes = 0 ;
+  int i ;
+
+  for (i = 0 ; i < numMsgs ; ++i)
+    bytes += msgs [i].len ;
+
+  return bytes ;
+}
+
+WPI_TRACE_SEMAPHORE (i2c) ;
+
 static inline int i2c_smbus_access (int fd, char rw, uint8_t command, int size, union i2c_smbus_data *data)
 {
   struct i2c_smbus_ioctl_data args ;
+  unsigned long long t0 ;
+  int result ;
+  WPI_TRACE_BEGIN (i2c) ;
+
+  if (IS_SHARED (fd))
+    result = sharedSmbus (fd, rw, command, size, data) ;	// Counted as a transfer
+  else
+  {
+    args.read_write = rw ;
+    args.command    = command ;
+    args.size       = size ;
+    args.data       = data ;
+    t0     = wiringPiBusStatsBegin () ;
+    result = ioctl (fd, I2C_SMBUS, &args) ;
+    wiringPiBusStatsEnd (statsSlot (fd), t0, (size == I2C_SMBUS_WORD_DATA) ? 3 : (size == I2C_SMBUS_BYTE_DATA) ? 2 : 1, result < 0) ;
+  }
 
-  args.read_write = rw ;
-  args.command    = command ;
-  args.size       = size ;
-  args.data       = data ;
-  return ioctl (fd, I2C_SMBUS, &args) ;
+  WPI_TRACE_END (i2c, fd, command, size) ;
+
+  return result ;
 }
 
 
@@ -190,6 +324,344 @@ int wiringPiI2CWriteReg16 (int fd, int reg, int value)
 }
 
 
+/*
+ * rdwr:
+ *	Hand a list of messages to the kernel as one I2C_RDWR transaction,
+ *	each with its own address.
+ *********************************************************************************
+ */
+
+static int rdwr (int fd, const int *addrs, const struct wpiI2cMsg *msgs, int numMsgs)
+{
+  struct i2c_msg             m [WPI_I2C_MAX_MSGS] ;
+  struct i2c_rdwr_ioctl_data data ;
+  int i ;
+
+  for (i = 0 ; i < numMsgs ; ++i)
+  {
+    if (msgs [i].len > WPI_I2C_MAX_LEN)		// Would be cut short
+    {
+      errno = EINVAL ;
+      return -1 ;
+    }
+    m [i].addr  = addrs [i] ;
+    m [i].flags = msgs [i].read ? I2C_M_RD : 0 ;
+    m [i].len   = msgs [i].len ;
+    m [i].buf   = (uint8_t *)msgs [i].buf ;
+  }
+
+  data.msgs  = m ;
+  data.nmsgs = numMsgs ;
+
+  return (ioctl (fd, I2C_RDWR, &data) < 0) ? -1 : 0 ;
+}
+
+static int busRdwr (struct i2cBusStruct *bus, const int *addrs, const struct wpiI2cMsg *msgs, int numMsgs)
+{
+  if (bus->sim)
+    return simI2cTransfer (addrs, msgs, numMsgs) ;
+  if (bus->soft >= 0)
+    return softI2cTransfer (bus->soft, addrs, msgs, numMsgs) ;
+  if (bus->bsc >= 0)
+  {
+    if (bscI2cTransfer (bus->bsc, addrs, msgs, numMsgs) == 0)
+      return 0 ;
+    if ((errno != ENOTSUP) || (bus->fd < 0))
+      return -1 ;
+  }
+  return rdwr (bus->fd, addrs, msgs, numMsgs) ;
+}
+
+
+/*
+ * sharedSmbus:
+ *	The SMBus transactions we use, done as plain I2C messages for a
+ *	device on a shared bus.
+ *********************************************************************************
+ */
+
+static int sharedSmbus (int fd, char rw, uint8_t command, int size, union i2c_smbus_data *data)
+{
+  struct wpiI2cMsg msgs [2] ;
+  unsigned char    out [3], in [2] ;
+  int              n = 0, len = 0 ;
+
+  out [0] = command ;
+
+  /**/ if (size == I2C_SMBUS_BYTE)
+  {
+    if (rw == I2C_SMBUS_WRITE)
+      len = 1 ;				// The command is the data
+  }
+  else if (size == I2C_SMBUS_BYTE_DATA)
+  {
+    len = 1 ;
+    if (rw == I2C_SMBUS_WRITE)
+    {
+      out [1] = data->byte ;
+      len     = 2 ;
+    }
+  }
+  else if (size == I2C_SMBUS_WORD_DATA)
+  {
+    len = 1 ;
+    if (rw == I2C_SMBUS_WRITE)
+    {
+      out [1] = data->word & 0xFF ;
+      out [2] = data->word >> 8 ;
+      len     = 3 ;
+    }
+  }
+  else
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  if (len != 0)
+  {
+    msgs [n].buf = out ; msgs [n].len = len ; msgs [n].read = FALSE ;
+    ++n ;
+  }
+
+  if (rw == I2C_SMBUS_READ)
+  {
+    msgs [n].buf = in ; msgs [n].len = (size == I2C_SMBUS_WORD_DATA) ? 2 : 1 ; msgs [n].read = TRUE ;
+    ++n ;
+  }
+
+  if (wiringPiI2CTransfer (fd, msgs, n) < 0)
+    return -1 ;
+
+  if (rw == I2C_SMBUS_READ)
+  {
+    if (size == I2C_SMBUS_WORD_DATA)
+      data->word = in [0] | (in [1] << 8) ;
+    else
+      data->byte = in [0] ;
+  }
+
+  return 0 ;
+}
+
+
+/*
+ * wiringPiI2CTransfer:
+ *	Run a list of read and write messages as one combined transaction -
+ *	repeated starts between them and one stop at the end.
+ *	Returns 0 or -1.
+ *********************************************************************************
+ */
+
+int wiringPiI2CTransfer (int fd, const struct wpiI2cMsg *msgs, int numMsgs)
+{
+  int addrs [WPI_I2C_MAX_MSGS] ;
+  int i, res ;
+  unsigned long long t0 ;
+  struct i2cBusStruct *bus ;
+
+  if ((numMsgs < 1) || (numMsgs > WPI_I2C_MAX_MSGS) || (fd < 0) || (!IS_SHARED (fd) && (fd >= MAX_I2C_FDS)))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  if (!IS_SHARED (fd))
+  {
+    for (i = 0 ; i < numMsgs ; ++i)
+      addrs [i] = i2cAddrs [fd] ;
+    t0  = wiringPiBusStatsBegin () ;
+    res = rdwr (fd, addrs, msgs, numMsgs) ;
+    wiringPiBusStatsEnd (statsSlot (fd), t0, msgBytes (msgs, numMsgs), res < 0) ;
+    return res ;
+  }
+
+  for (i = 0 ; i < numMsgs ; ++i)
+    addrs [i] = devs [fd - I2C_SHARED_BASE].addr ;
+
+  bus = &buses [devs [fd - I2C_SHARED_BASE].bus] ;
+
+  pthread_mutex_lock   (&bus->lock) ;
+    t0  = wiringPiBusStatsBegin () ;
+    res = busRdwr (bus, addrs, msgs, numMsgs) ;
+    wiringPiBusStatsEnd (statsSlot (fd), t0, msgBytes (msgs, numMsgs), res < 0) ;
+  pthread_mutex_unlock (&bus->lock) ;
+
+  return res ;
+}
+
+
+/*
+ * wiringPiI2CTransferList:
+ *	As above, but each message says which device it's for, in its dev
+ *	member. The devices must all be on the same shared bus and the
+ *	lot goes out as one transaction.
+ *********************************************************************************
+ */
+
+int wiringPiI2CTransferList (const struct wpiI2cMsg *msgs, int numMsgs)
+{
+  int addrs [WPI_I2C_MAX_MSGS] ;
+  int i, busNum, res ;
+  unsigned long long t0 ;
+  struct i2cBusStruct *bus ;
+
+  if ((numMsgs < 1) || (numMsgs > WPI_I2C_MAX_MSGS) || !IS_SHARED (msgs [0].dev))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  busNum = devs [msgs [0].dev - I2C_SHARED_BASE].bus ;
+
+  for (i = 0 ; i < numMsgs ; ++i)
+  {
+    if (!IS_SHARED (msgs [i].dev) || (devs [msgs [i].dev - I2C_SHARED_BASE].bus != busNum))
+    {
+      errno = EINVAL ;
+      return -1 ;
+    }
+    addrs [i] = devs [msgs [i].dev - I2C_SHARED_BASE].addr ;
+  }
+
+  bus = &buses [busNum] ;
+
+// It all goes down as the first device's, busy time being the bus's
+
+  pthread_mutex_lock   (&bus->lock) ;
+    t0  = wiringPiBusStatsBegin () ;
+    res = busRdwr (bus, addrs, msgs, numMsgs) ;
+    wiringPiBusStatsEnd (statsSlot (msgs [0].dev), t0, msgBytes (msgs, numMsgs), res < 0) ;
+  pthread_mutex_unlock (&bus->lock) ;
+
+  return res ;
+}
+
+
+/*
+ * wiringPiI2CLock:
+ * wiringPiI2CUnlock:
+ *	Hold a shared device's bus for a sequence of operations that must
+ *	not be interleaved with anyone else's. They nest, and are no-ops on
+ *	an unshared device.
+ *********************************************************************************
+ */
+
+void wiringPiI2CLock (int fd)
+{
+  if (IS_SHARED (fd))
+    pthread_mutex_lock (&buses [devs [fd - I2C_SHARED_BASE].bus].lock) ;
+}
+
+void wiringPiI2CUnlock (int fd)
+{
+  if (IS_SHARED (fd))
+    pthread_mutex_unlock (&buses [devs [fd - I2C_SHARED_BASE].bus].lock) ;
+}
+
+
+/*
+ * wiringPiI2CReadBytes:
+ * wiringPiI2CWriteBytes:
+ *	Plain reads and writes of the device, with no register address -
+ *	what read () and write () on an unshared fd would do.
+ *	Returns the number of bytes or -1.
+ *********************************************************************************
+ */
+
+int wiringPiI2CReadBytes (int fd, unsigned char *buf, int len)
+{
+  struct wpiI2cMsg msg ;
+  unsigned long long t0 ;
+  int n ;
+
+  if (!IS_SHARED (fd))
+  {
+    t0 = wiringPiBusStatsBegin () ;
+    n  = read (fd, buf, len) ;
+    wiringPiBusStatsEnd (statsSlot (fd), t0, (n > 0) ? n : 0, n < 0) ;
+    return n ;
+  }
+
+  msg.buf = buf ; msg.len = len ; msg.read = TRUE ;
+
+  return (wiringPiI2CTransfer (fd, &msg, 1) < 0) ? -1 : len ;
+}
+
+int wiringPiI2CWriteBytes (int fd, const unsigned char *buf, int len)
+{
+  struct wpiI2cMsg msg ;
+  unsigned long long t0 ;
+  int n ;
+
+  if (!IS_SHARED (fd))
+  {
+    t0 = wiringPiBusStatsBegin () ;
+    n  = write (fd, buf, len) ;
+    wiringPiBusStatsEnd (statsSlot (fd), t0, (n > 0) ? n : 0, n < 0) ;
+    return n ;
+  }
+
+  msg.buf = (void *)buf ; msg.len = len ; msg.read = FALSE ;
+
+  return (wiringPiI2CTransfer (fd, &msg, 1) < 0) ? -1 : len ;
+}
+
+
+/*
+ * wiringPiI2CReadBlock:
+ * wiringPiI2CWriteBlock:
+ *	Read or write len bytes starting at the given register, in one
+ *	transaction. The device has to auto-increment its register address.
+ *	Returns len or -1, with errno EINVAL if len's out of range.
+ *********************************************************************************
+ */
+
+int wiringPiI2CReadBlock (int fd, int reg, unsigned char *buf, int len)
+{
+  struct wpiI2cMsg msgs [2] ;
+  unsigned char    r = reg ;
+
+  if ((buf == NULL) || (len <= 0) || (len > WPI_I2C_MAX_LEN))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  msgs [0].buf = &r ; msgs [0].len = 1   ; msgs [0].read = FALSE ;
+  msgs [1].buf = buf ; msgs [1].len = len ; msgs [1].read = TRUE ;
+
+  if (wiringPiI2CTransfer (fd, msgs, 2) < 0)
+    return -1 ;
+
+  return len ;
+}
+
+int wiringPiI2CWriteBlock (int fd, int reg, const unsigned char *buf, int len)
+{
+  struct wpiI2cMsg msg ;
+  unsigned char    data [WPI_I2C_MAX_BLOCK + 1] ;
+
+  if ((len < 0) || (len > WPI_I2C_MAX_BLOCK))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  data [0] = reg ;
+  memcpy (&data [1], buf, len) ;
+
+  msg.buf  = data ;
+  msg.len  = len + 1 ;
+  msg.read = FALSE ;
+
+  if (wiringPiI2CTransfer (fd, &msg, 1) < 0)
+    return -1 ;
+
+  return len ;
+}
+
+
 /*
  * wiringPiI2CSetupInterface:
  *	Undocumented access to set the interface explicitly - might be used
@@ -201,16 +673,168 @@ int wiringPiI2CSetupInterface (const char *device, int devId)
 {
   int fd ;
 
+  if (shareAll || wiringPiSimActive () || (strncmp (device, I2C_SOFT_PREFIX, strlen (I2C_SOFT_PREFIX)) == 0) ||
+	(strncmp (device, I2C_BSC_PREFIX, strlen (I2C_BSC_PREFIX)) == 0))
+    return wiringPiI2CSetupShared (device, devId) ;
+
   if ((fd = open (device, O_RDWR)) < 0)
     return wiringPiFailure (WPI_ALMOST, "Unable to open I2C device: %s\n", strerror (errno)) ;
 
   if (ioctl (fd, I2C_SLAVE, devId) < 0)
     return wiringPiFailure (WPI_ALMOST, "Unable to select I2C device: %s\n", strerror (errno)) ;
 
+  if (fd < MAX_I2C_FDS)
+  {
+    i2cAddrs [fd] = devId ;
+    i2cSlots [fd] = wiringPiBusStatsSlot (WPI_BUS_I2C, device, devId) + 1 ;
+  }
+
   return fd ;
 }
 
 
+/*
+ * wiringPiI2CSetupShared:
+ *	Get a handle for a device on a shared bus, opening the bus the first
+ *	time it's used. The handle works with all the wiringPiI2C functions.
+ *********************************************************************************
+ */
+
+int wiringPiI2CSetupShared (const char *device, int devId)
+{
+  struct i2cBusStruct *bus ;
+  char kernelDev [16] ;
+  int i, handle ;
+
+  pthread_mutex_lock (&tableLock) ;
+
+  for (i = 0 ; i < numBuses ; ++i)
+    if (strcmp (buses [i].device, device) == 0)
+      break ;
+
+  if (i == numBuses)
+  {
+    if ((numBuses == MAX_I2C_BUSES) || (strlen (device) >= sizeof (buses [0].device)))
+    {
+      pthread_mutex_unlock (&tableLock) ;
+      return wiringPiFailure (WPI_ALMOST, "Unable to share I2C device %s: Too many buses\n", device) ;
+    }
+
+    bus       = &buses [i] ;
+    bus->fd   = -1 ;
+    bus->soft = -1 ;
+    bus->bsc  = -1 ;
+    bus->sim  = wiringPiSimActive () ;
+
+    /**/ if (bus->sim)			// Nothing to open
+      bus->fd = -1 ;
+    else if (strncmp (device, I2C_SOFT_PREFIX, strlen (I2C_SOFT_PREFIX)) == 0)
+    {
+      bus->soft = atoi (device + strlen (I2C_SOFT_PREFIX)) ;
+      if (!softI2cActive (bus->soft))
+      {
+	pthread_mutex_unlock (&tableLock) ;
+	return wiringPiFailure (WPI_ALMOST, "Unable to open I2C device %s: Soft bus not set up\n", device) ;
+      }
+    }
+    else if (strncmp (device, I2C_BSC_PREFIX, strlen (I2C_BSC_PREFIX)) == 0)
+    {
+      bus->bsc = atoi (device + strlen (I2C_BSC_PREFIX)) ;
+      if (!bscI2cActive (bus->bsc))
+      {
+	pthread_mutex_unlock (&tableLock) ;
+	return wiringPiFailure (WPI_ALMOST, "Unable to open I2C device %s: BSC bus not set up\n", device) ;
+      }
+      snprintf (kernelDev, sizeof (kernelDev), "/dev/i2c-%d", bus->bsc) ;
+      bus->fd = open (kernelDev, O_RDWR) ;	// -1 is fine: we just can't fall back
+    }
+    else if ((bus->fd = open (device, O_RDWR)) < 0)
+    {
+      pthread_mutex_unlock (&tableLock) ;
+      return wiringPiFailure (WPI_ALMOST, "Unable to open I2C device: %s\n", strerror (errno)) ;
+    }
+
+    strcpy (bus->device, device) ;
+    piMutexInit (&bus->lock, PI_LOCK_PI, TRUE) ;	// Recursive, with priority inheritance
+    ++numBuses ;
+  }
+
+  if (numDevs == MAX_I2C_DEVS)
+  {
+    pthread_mutex_unlock (&tableLock) ;
+    return wiringPiFailure (WPI_ALMOST, "Unable to share I2C device %s: Too many devices\n", device) ;
+  }
+
+  devs [numDevs].bus  = i ;
+  devs [numDevs].addr = devId ;
+  devs [numDevs].slot = wiringPiBusStatsSlot (WPI_BUS_I2C, device, devId) ;
+  handle = I2C_SHARED_BASE + numDevs++ ;
+
+  pthread_mutex_unlock (&tableLock) ;
+
+  return handle ;
+}
+
+
+/*
+ * wiringPiI2CShareBuses:
+ *	Make wiringPiI2CSetup and wiringPiI2CSetupInterface (and so all the
+ *	device drivers) hand out shared bus handles from now on.
+ *	Returns the previous setting.
+ *********************************************************************************
+ */
+
+int wiringPiI2CShareBuses (int share)
+{
+  int was = shareAll ;
+
+  shareAll = share ;
+  return was ;
+}
+
+
+/*
+ * wiringPiI2CDefaultBus:
+ *	Make wiringPiI2CSetup (and so all the device drivers) open devices
+ *	on the given bus, e.g. "/dev/i2c-3" or "soft:0", from now on. NULL
+ *	goes back to the Pi's usual bus.
+ *	Returns 0 or -1 if the name is too long.
+ *********************************************************************************
+ */
+
+int wiringPiI2CDefaultBus (const char *device)
+{
+  if (device == NULL)
+    device = "" ;
+
+  if (strlen (device) >= sizeof (defaultDevice))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  strcpy (defaultDevice, device) ;
+  return 0 ;
+}
+
+
+/*
+ * defaultBus:
+ *	The bus wiringPiI2CSetup uses
+ *********************************************************************************
+ */
+
+static const char *defaultBus (void)
+{
+  /**/ if (defaultDevice [0] != 0)
+    return defaultDevice ;
+  else if (piGpioLayout () == 1)
+    return "/dev/i2c-0" ;
+  else
+    return "/dev/i2c-1" ;
+}
+
+
 /*
  * wiringPiI2CSetup:
  *	Open the I2C device, and regsiter the target device
@@ -219,15 +843,337 @@ int wiringPiI2CSetupInterface (const char *device, int devId)
 
 int wiringPiI2CSetup (const int devId)
 {
-  int rev ;
-  const char *device ;
+  return wiringPiI2CSetupInterface (defaultBus (), devId) ;
+}
+
+
+/*
+ * Bus scanning:
+ *	Probe every address on a bus, as i2cdetect does, but in-process.
+ *	The kernel says EBUSY to I2C_SLAVE when a driver owns an address.
+ *	The last scan of each bus is kept so wiringPiI2CPresent doesn't need
+ *	to go out to the bus again, and wiringPiI2CScanBuses does many buses
+ *	at once, a thread each.
+ *********************************************************************************
+ */
+
+#define	I2C_FUNCS			0x0705
+#define	I2C_FUNC_SMBUS_QUICK		0x00010000
+#define	I2C_FUNC_SMBUS_READ_BYTE	0x00020000
+
+#define	MAX_SCAN_BUSES	32
+
+struct i2cScanStruct
+{
+  char          device [32] ;
+  unsigned char found  [128] ;
+} ;
+
+static struct i2cScanStruct scans [MAX_SCAN_BUSES] ;
+static int                  numScans = 0 ;
+static pthread_mutex_t      scanLock = PTHREAD_MUTEX_INITIALIZER ;
+
+// What probe to use for an address: reads for the ranges quick writes can
+//	upset (EEPROM write-protect latches and the like), as i2cdetect does
+
+static int probeRead (int probe, int addr)
+{
+  if (probe == WPI_I2C_PROBE_AUTO)
+    return ((addr >= 0x30) && (addr <= 0x37)) || ((addr >= 0x50) && (addr <= 0x5F)) ;
+  return probe == WPI_I2C_PROBE_READ ;
+}
+
+static int scanKernel (const char *device, int probe, unsigned char *found)
+{
+  union i2c_smbus_data data ;
+  unsigned long funcs = 0 ;
+  int fd, addr, useRead, count = 0 ;
+
+  if ((fd = open (device, O_RDWR)) < 0)
+    return -1 ;
+
+  if (ioctl (fd, I2C_FUNCS, &funcs) < 0)
+    funcs = I2C_FUNC_SMBUS_QUICK | I2C_FUNC_SMBUS_READ_BYTE ;
+
+  for (addr = 0x03 ; addr <= 0x77 ; ++addr)
+  {
+    if (ioctl (fd, I2C_SLAVE, addr) < 0)
+    {
+      if (errno == EBUSY)
+      {
+	found [addr] = WPI_I2C_SCAN_BUSY ;
+	++count ;
+      }
+      continue ;
+    }
+
+    useRead = probeRead (probe, addr) ;
+    if (useRead && ((funcs & I2C_FUNC_SMBUS_READ_BYTE) == 0))
+      useRead = FALSE ;
+    else if (!useRead && ((funcs & I2C_FUNC_SMBUS_QUICK) == 0))
+      useRead = TRUE ;
+
+    if (i2c_smbus_access (fd, useRead ? I2C_SMBUS_READ : I2C_SMBUS_WRITE, 0,
+	  useRead ? I2C_SMBUS_BYTE : I2C_SMBUS_QUICK, useRead ? &data : NULL) >= 0)
+    {
+      found [addr] = WPI_I2C_SCAN_FOUND ;
+      ++count ;
+    }
+  }
+
+  close (fd) ;
+  return count ;
+}
+
+// A soft bus has no SMBus quick, but a zero-length write is the same thing
+
+static int scanSoft (int soft, int probe, unsigned char *found)
+{
+  struct i2cBusStruct *bus = NULL ;
+  struct wpiI2cMsg msg ;
+  unsigned char byte ;
+  int i, addr, count = 0 ;
+
+  if (!softI2cActive (soft))
+  {
+    errno = ENODEV ;
+    return -1 ;
+  }
+
+  pthread_mutex_lock (&tableLock) ;
+    for (i = 0 ; i < numBuses ; ++i)
+      if (buses [i].soft == soft)
+	bus = &buses [i] ;
+  pthread_mutex_unlock (&tableLock) ;
+
+  if (bus != NULL)
+    pthread_mutex_lock (&bus->lock) ;
 
-  rev = piGpioLayout () ;
+  for (addr = 0x03 ; addr <= 0x77 ; ++addr)
+  {
+    msg.buf  = &byte ;
+    msg.read = probeRead (probe, addr) ;
+    msg.len  = msg.read ? 1 : 0 ;
+    msg.dev  = 0 ;
 
-  if (rev == 1)
-    device = "/dev/i2c-0" ;
+    if (softI2cTransfer (soft, &addr, &msg, 1) == 0)
+    {
+      found [addr] = WPI_I2C_SCAN_FOUND ;
+      ++count ;
+    }
+  }
+
+  if (bus != NULL)
+    pthread_mutex_unlock (&bus->lock) ;
+
+  return count ;
+}
+
+
+/*
+ * wiringPiI2CScan:
+ *	Scan a bus - NULL for the one wiringPiI2CSetup uses - filling found
+ *	(which may be NULL) with a WPI_I2C_SCAN_ value for each address, and
+ *	remember the result.
+ *	Returns the number of addresses in use, or -1.
+ *********************************************************************************
+ */
+
+int wiringPiI2CScan (const char *device, int probe, unsigned char found [128])
+{
+  unsigned char map [128] ;
+  char kernelDev [16] ;
+  int i, count ;
+
+  if (device == NULL)
+    device = defaultBus () ;
+
+  if (strlen (device) >= sizeof (scans [0].device))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  memset (map, WPI_I2C_SCAN_NONE, sizeof (map)) ;
+
+  /**/ if (wiringPiSimActive ())
+  {
+    for (count = 0, i = 0x03 ; i <= 0x77 ; ++i)
+      if (simI2cPresent (i))
+      {
+	map [i] = WPI_I2C_SCAN_FOUND ;
+	++count ;
+      }
+  }
+  else if (strncmp (device, I2C_SOFT_PREFIX, strlen (I2C_SOFT_PREFIX)) == 0)
+    count = scanSoft (atoi (device + strlen (I2C_SOFT_PREFIX)), probe, map) ;
+  else if (strncmp (device, I2C_BSC_PREFIX, strlen (I2C_BSC_PREFIX)) == 0)	// Same wires, the kernel's way
+  {
+    snprintf (kernelDev, sizeof (kernelDev), "/dev/i2c-%d", atoi (device + strlen (I2C_BSC_PREFIX))) ;
+    count = scanKernel (kernelDev, probe, map) ;
+  }
   else
-    device = "/dev/i2c-1" ;
+    count = scanKernel (device, probe, map) ;
+
+  if (count < 0)
+    return -1 ;
+
+  pthread_mutex_lock (&scanLock) ;
+    for (i = 0 ; i < numScans ; ++i)
+      if (strcmp (scans [i].device, device) == 0)
+	break ;
+
+    if (i < MAX_SCAN_BUSES)
+    {
+      if (i == numScans)
+	strcpy (scans [numScans++].device, device) ;
+      memcpy (scans [i].found, map, sizeof (map)) ;
+    }
+  pthread_mutex_unlock (&scanLock) ;
+
+  if (found != NULL)
+    memcpy (found, map, sizeof (map)) ;
 
-  return wiringPiI2CSetupInterface (device, devId) ;
+  return count ;
+}
+
+
+/*
+ * wiringPiI2CScanBuses:
+ *	Scan a list of buses at the same time, a thread for each. A NULL
+ *	list is every /dev/i2c-N there is. found, if not NULL, has room for
+ *	each one's results; counts, if not NULL, gets each one's count or -1.
+ *	Returns the number of buses scanned, or -1 if there were none.
+ *********************************************************************************
+ */
+
+struct scanJobStruct
+{
+  char           device [32] ;
+  int            probe ;
+  unsigned char *found ;
+  int            count ;
+  pthread_t      thread ;
+} ;
+
+static void *scanThread (void *arg)
+{
+  struct scanJobStruct *job = (struct scanJobStruct *)arg ;
+
+  job->count = wiringPiI2CScan (job->device, job->probe, job->found) ;
+  return NULL ;
+}
+
+int wiringPiI2CScanBuses (const char * const *devices, int numDevices, int probe, unsigned char (*found)[128], int *counts)
+{
+  struct scanJobStruct jobs [MAX_SCAN_BUSES] ;
+  char name [32] ;
+  int  i, n = 0, done = 0 ;
+
+  if (devices == NULL)
+  {
+    for (i = 0 ; (i < MAX_SCAN_BUSES) && (n < MAX_SCAN_BUSES) ; ++i)
+    {
+      sprintf (name, "/dev/i2c-%d", i) ;
+      if (access (name, F_OK) == 0)
+	strcpy (jobs [n++].device, name) ;
+    }
+  }
+  else
+  {
+    if (numDevices > MAX_SCAN_BUSES)
+      numDevices = MAX_SCAN_BUSES ;
+
+    for (i = 0 ; i < numDevices ; ++i)
+    {
+      if (strlen (devices [i]) >= sizeof (jobs [0].device))
+      {
+	errno = EINVAL ;
+	return -1 ;
+      }
+      strcpy (jobs [n++].device, devices [i]) ;
+    }
+  }
+
+  if (n == 0)
+  {
+    errno = ENODEV ;
+    return -1 ;
+  }
+
+  for (i = 0 ; i < n ; ++i)
+  {
+    jobs [i].probe = probe ;
+    jobs [i].found = (found != NULL) ? found [i] : NULL ;
+    jobs [i].count = -1 ;
+    if (pthread_create (&jobs [i].thread, NULL, scanThread, &jobs [i]) != 0)
+    {
+      scanThread (&jobs [i]) ;
+      jobs [i].thread = pthread_self () ;
+    }
+  }
+
+  for (i = 0 ; i < n ; ++i)
+  {
+    if (!pthread_equal (jobs [i].thread, pthread_self ()))
+      pthread_join (jobs [i].thread, NULL) ;
+    if (counts != NULL)
+      counts [i] = jobs [i].count ;
+    if (jobs [i].count >= 0)
+      ++done ;
+  }
+
+  return done ;
+}
+
+
+/*
+ * wiringPiI2CPresent:
+ *	Is there something at the address? From the last scan of the bus if
+ *	there's been one, scanning it now if not.
+ *	Returns a WPI_I2C_SCAN_ value, or -1 if the bus can't be scanned.
+ *********************************************************************************
+ */
+
+int wiringPiI2CPresent (const char *device, int addr)
+{
+  unsigned char map [128] ;
+  int i, result = -1 ;
+
+  if ((addr < 0) || (addr > 127))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  if (device == NULL)
+    device = defaultBus () ;
+
+  pthread_mutex_lock (&scanLock) ;
+    for (i = 0 ; i < numScans ; ++i)
+      if (strcmp (scans [i].device, device) == 0)
+	result = scans [i].found [addr] ;
+  pthread_mutex_unlock (&scanLock) ;
+
+  if (result >= 0)
+    return result ;
+
+  if (wiringPiI2CScan (device, WPI_I2C_PROBE_AUTO, map) < 0)
+    return -1 ;
+
+  return map [addr] ;
+}
+
+
+/*
+ * wiringPiI2CScanForget:
+ *	Throw away the remembered scans, e.g. after plugging something in.
+ *********************************************************************************
+ */
+
+void wiringPiI2CScanForget (void)
+{
+  pthread_mutex_lock (&scanLock) ;
+    numScans = 0 ;
+  pthread_mutex_unlock (&scanLock) ;
 }
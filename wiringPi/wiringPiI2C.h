@@ -22,6 +22,31 @@
  ***********************************************************************
  */
 
+// wpiI2cMsg:
+//	One part of a combined transaction for wiringPiI2CTransfer
+
+struct wpiI2cMsg
+{
+  void         *buf ;
+  unsigned int  len ;
+  int           read ;		// TRUE to read into buf, FALSE to write it
+  int           dev ;		// Shared device handle - wiringPiI2CTransferList only
+} ;
+
+#define	WPI_I2C_MAX_MSGS	16
+#define	WPI_I2C_MAX_BLOCK	256
+#define	WPI_I2C_MAX_LEN		65535	// One message - the kernel's len is 16 bits
+
+// wiringPiI2CScan: what's at each address, and how to look
+
+#define	WPI_I2C_SCAN_NONE	0
+#define	WPI_I2C_SCAN_FOUND	1
+#define	WPI_I2C_SCAN_BUSY	2	// A kernel driver has it
+
+#define	WPI_I2C_PROBE_AUTO	0	// As i2cdetect: reads at 0x30-0x37 & 0x50-0x5F, quick writes elsewhere
+#define	WPI_I2C_PROBE_QUICK	1
+#define	WPI_I2C_PROBE_READ	2
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -34,8 +59,27 @@ extern int wiringPiI2CWrite          (int fd, int data) ;
 extern int wiringPiI2CWriteReg8      (int fd, int reg, int data) ;
 extern int wiringPiI2CWriteReg16     (int fd, int reg, int data) ;
 
+extern int wiringPiI2CReadBlock      (int fd, int reg,       unsigned char *buf, int len) ;
+extern int wiringPiI2CWriteBlock     (int fd, int reg, const unsigned char *buf, int len) ;
+extern int wiringPiI2CTransfer       (int fd, const struct wpiI2cMsg *msgs, int numMsgs) ;
+extern int wiringPiI2CTransferList   (const struct wpiI2cMsg *msgs, int numMsgs) ;
+
+extern int wiringPiI2CReadBytes      (int fd,       unsigned char *buf, int len) ;
+extern int wiringPiI2CWriteBytes     (int fd, const unsigned char *buf, int len) ;
+
+extern void wiringPiI2CLock          (int fd) ;
+extern void wiringPiI2CUnlock        (int fd) ;
+
 extern int wiringPiI2CSetupInterface (const char *device, int devId) ;
+extern int wiringPiI2CSetupShared    (const char *device, int devId) ;
 extern int wiringPiI2CSetup          (const int devId) ;
+extern int wiringPiI2CShareBuses     (int share) ;
+extern int wiringPiI2CDefaultBus     (const char *device) ;
+
+extern int  wiringPiI2CScan          (const char *device, int probe, unsigned char found [128]) ;
+extern int  wiringPiI2CScanBuses     (const char * const *devices, int numDevices, int probe, unsigned char (*found)[128], int *counts) ;
+extern int  wiringPiI2CPresent       (const char *device, int addr) ;
+extern void wiringPiI2CScanForget    (void) ;
 
 #ifdef __cplusplus
 }
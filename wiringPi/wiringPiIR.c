@@ -0,0 +1,718 @@
+/*
+ * wiringPiIR.c:
+ *	Decode infra-red remote controls from timestamped edges
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+/*
+ * Notes:
+ *	The decoder is a wiringPiISRex () function on both edges, so it's
+ *	run on the thread that got the edge, and the times it works from are
+ *	the event timestamps - the kernel's, with the gpio chip - rather than
+ *	when it happened to be woken. However late that is, the widths come
+ *	out right; only the key events are late.
+ *	Each edge ends a mark (carrier on) or a space, and its width is
+ *	handed to a small state machine for each protocol:
+ *	  NEC and Sony are pulse distance and pulse width codes, decoded
+ *	  a bit at a time.
+ *	  RC5 and RC6 are Manchester coded. The marks and spaces are cut
+ *	  into half bit slots, and a frame decoded when there are enough.
+ *	A Sony frame can be 12, 15 or 20 bits and there's no edge after the
+ *	last one, so those are finished by a periodic task once the line
+ *	has been quiet for long enough.
+ *********************************************************************************
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "wiringPi.h"
+#include "wiringPiIR.h"
+
+#define	MAX_IR			8
+
+#define	US			1000ULL
+#define	IDLE_NS			(20000 * US)	// A space this long ends anything
+#define	REPEAT_NS		(250000 * US)	// Frames closer than this are a held key
+#define	SONY_DONE_NS		(3000 * US)	// Quiet for this long after a Sony frame
+#define	SONY_SWEEP_NS		(5000 * US)
+
+#define	RC5_UNIT		(889 * US)
+#define	RC6_UNIT		(444 * US)
+#define	MAX_SLOTS		80		// RC6A: the start and mode bits, trailer, 32 bits
+
+// Manchester decoder states
+
+#define	MAN_OFF			0		// Waiting for an idle line
+#define	MAN_ARMED		1		// Idle: the next mark starts a frame
+#define	MAN_LEADER		2		// RC6 leader mark seen
+#define	MAN_SLOTS		3
+
+struct manchesterStruct
+{
+  int           state ;
+  int           count, target ;
+  unsigned char slots [MAX_SLOTS] ;	// 1 for a mark
+} ;
+
+struct wpiIrStruct
+{
+  int                  pin ;
+  int                  protocols, flags ;
+  volatile int         armed ;
+  struct piRingStruct *ring ;
+  unsigned int         lost ;
+  pthread_mutex_t      lock ;
+  int                  sweep ;		// Sony's periodic task, or -1
+
+  unsigned long long   lastEdgeNs ;
+  int                  lastLevel ;	// The line after the last edge, 1 for a mark
+
+  struct			// NEC
+  {
+    int          state, n ;
+    uint32_t     bits ;
+  } nec ;
+
+  struct			// Sony
+  {
+    int          state, n ;
+    uint32_t     bits ;
+  } sony ;
+
+  struct manchesterStruct rc5, rc6 ;
+
+  struct			// The last frame, for repeats
+  {
+    int                protocol ;
+    unsigned int       address, command ;
+    int                toggle ;
+    unsigned long long ns ;
+  } last ;
+} ;
+
+static struct wpiIrStruct *irs [MAX_IR] ;
+static pthread_mutex_t     irsLock = PTHREAD_MUTEX_INITIALIZER ;
+
+
+static unsigned long long monoNanos (void)
+{
+  struct timespec ts ;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec ;
+}
+
+static inline int within (unsigned long long d, unsigned int loUs, unsigned int hiUs)
+{
+  return (d >= loUs * US) && (d < hiUs * US) ;
+}
+
+static struct wpiIrStruct *findIr (int pin)
+{
+  int i ;
+
+  for (i = 0 ; i < MAX_IR ; ++i)
+    if ((irs [i] != NULL) && (irs [i]->pin == pin))
+      return irs [i] ;
+
+  return NULL ;
+}
+
+
+/*
+ * emit:
+ *	A frame's been decoded. toggle is the RC5/RC6 toggle bit, -1 for the
+ *	others, where a frame again soon enough is a repeat.
+ *********************************************************************************
+ */
+
+static void emit (struct wpiIrStruct *ir, unsigned long long ns, int protocol,
+		  unsigned int address, unsigned int command, int toggle)
+{
+  struct wpiIrEvent e ;
+
+  e.ns       = ns ;
+  e.protocol = protocol ;
+  e.address  = address ;
+  e.command  = command ;
+  e.repeat   = (ir->last.protocol == protocol) && (ir->last.address == address) &&
+	       (ir->last.command == command) && (ir->last.toggle == toggle) &&
+	       ((ns - ir->last.ns) < REPEAT_NS) ;
+
+  ir->last.protocol = protocol ;
+  ir->last.address  = address ;
+  ir->last.command  = command ;
+  ir->last.toggle   = toggle ;
+  ir->last.ns       = ns ;
+
+  if (piRingPush (ir->ring, &e, 1) != 1)
+    __atomic_add_fetch (&ir->lost, 1, __ATOMIC_RELAXED) ;
+}
+
+
+/*
+ * necFeed:
+ *	9mS mark, 4.5mS space, then 32 bits - a 560uS mark and a space of
+ *	560uS for a 0, 1690uS for a 1 - least significant first: address,
+ *	its inverse, command, its inverse. A held key sends a 9mS mark and a
+ *	2.25mS space every 110mS.
+ *********************************************************************************
+ */
+
+static void necFeed (struct wpiIrStruct *ir, int mark, unsigned long long d, unsigned long long ns)
+{
+  unsigned int address, command ;
+
+  if (mark && within (d, 7000, 11000))
+  {
+    ir->nec.state = 1 ;
+    return ;
+  }
+
+  switch (ir->nec.state)
+  {
+    case 1:			// After the leader
+      ir->nec.state = 0 ;
+      if (mark)
+	break ;
+      /**/ if (within (d, 3500, 5500))
+      {
+	ir->nec.state = 2 ;
+	ir->nec.n     = 0 ;
+	ir->nec.bits  = 0 ;
+      }
+      else if (within (d, 1800, 2800))
+      {
+	if ((ir->last.protocol == WPI_IR_NEC) && ((ns - ir->last.ns) < REPEAT_NS))
+	  emit (ir, ns, WPI_IR_NEC, ir->last.address, ir->last.command, -1) ;
+      }
+      break ;
+
+    case 2:			// A bit's mark
+      ir->nec.state = (mark && within (d, 300, 900)) ? 3 : 0 ;
+      break ;
+
+    case 3:			// And its space
+      ir->nec.state = 0 ;
+      if (mark)
+	break ;
+      /**/ if (within (d, 300, 1100))
+	;
+      else if (within (d, 1100, 2200))
+	ir->nec.bits |= 1u << ir->nec.n ;
+      else
+	break ;
+
+      if (++ir->nec.n < 32)
+      {
+	ir->nec.state = 2 ;
+	break ;
+      }
+
+      command = (ir->nec.bits >> 16) & 0xFF ;
+      if (((ir->nec.bits >> 24) ^ command) != 0xFF)
+	break ;
+      address = ir->nec.bits & 0xFF ;
+      if ((((ir->nec.bits >> 8) & 0xFF) ^ address) != 0xFF)
+	address = ir->nec.bits & 0xFFFF ;		// Extended NEC
+      emit (ir, ns, WPI_IR_NEC, address, command, -1) ;
+      break ;
+  }
+}
+
+
+/*
+ * sonyFeed:
+ * sonyDone:
+ *	2.4mS mark, then bits of a 600uS space and a mark of 600uS for a 0,
+ *	1200uS for a 1, least significant first: 7 bits of command, then 5,
+ *	8 or 13 of address. The frame's over once the space after a mark
+ *	goes on too long.
+ *********************************************************************************
+ */
+
+static void sonyDone (struct wpiIrStruct *ir, unsigned long long ns)
+{
+  int n = ir->sony.n ;
+
+  ir->sony.state = 0 ;
+  if ((n == 12) || (n == 15) || (n == 20))
+    emit (ir, ns, WPI_IR_SONY, ir->sony.bits >> 7, ir->sony.bits & 0x7F, -1) ;
+}
+
+static void sonyFeed (struct wpiIrStruct *ir, int mark, unsigned long long d, unsigned long long ns)
+{
+  if (mark && within (d, 2000, 3000))
+  {
+    if (ir->sony.state == 1)
+      sonyDone (ir, ir->lastEdgeNs) ;
+    ir->sony.state = 1 ;
+    ir->sony.n     = 0 ;
+    ir->sony.bits  = 0 ;
+    return ;
+  }
+
+  switch (ir->sony.state)
+  {
+    case 1:			// The space before a bit
+      /**/ if (!mark && within (d, 300, 900))
+	ir->sony.state = 2 ;
+      else if (!mark)
+	sonyDone (ir, ns - d) ;
+      else
+	ir->sony.state = 0 ;
+      break ;
+
+    case 2:			// The bit
+      ir->sony.state = 0 ;
+      if (!mark)
+	break ;
+      /**/ if (within (d, 300, 900))
+	;
+      else if (within (d, 900, 1600))
+	ir->sony.bits |= 1u << ir->sony.n ;
+      else
+	break ;
+
+      ir->sony.state = 1 ;
+      if (++ir->sony.n == 20)
+	sonyDone (ir, ns) ;
+      break ;
+  }
+}
+
+
+/*
+ * manchesterAdd:
+ * manchesterBit:
+ *	Cut a mark or space into unit wide slots, up to maxUnits of them,
+ *	returning FALSE if it won't go; and read the bit from a pair of slots,
+ *	-1 if they're the same.
+ *********************************************************************************
+ */
+
+static int manchesterAdd (struct manchesterStruct *m, int mark, unsigned long long d, unsigned long long unit, int maxUnits)
+{
+  int units = (int)((d + unit / 2) / unit) ;
+
+  if ((units < 1) || (units > maxUnits) || (m->count + units > MAX_SLOTS))
+    return FALSE ;
+
+  while (units-- > 0)
+    m->slots [m->count++] = mark ;
+
+  return TRUE ;
+}
+
+static inline int manchesterBit (struct manchesterStruct *m, int slot)
+{
+  return (m->slots [slot] == m->slots [slot + 1]) ? -1 : m->slots [slot] ;
+}
+
+// A frame's complete with all its slots, or all but the last if that's
+//	the space before the line goes idle
+
+static inline int manchesterFull (struct manchesterStruct *m)
+{
+  return (m->count >= m->target) || ((m->count == m->target - 1) && m->slots [m->count - 1]) ;
+}
+
+static void manchesterIdle (struct manchesterStruct *m, int mark, unsigned long long d)
+{
+  if (!mark && (d >= IDLE_NS / 4))
+    m->state = MAN_ARMED ;
+  else
+    m->state = MAN_OFF ;
+}
+
+
+/*
+ * rc5Feed:
+ *	14 bits of 1.778mS, a 1 a space then a mark: two start bits (the
+ *	second is the inverse of command bit 6 for RC5X), the toggle, 5 bits
+ *	of address and 6 of command, most significant first. The first half
+ *	of the first start bit is lost in the idle line.
+ *********************************************************************************
+ */
+
+static void rc5Feed (struct wpiIrStruct *ir, int mark, unsigned long long d, unsigned long long ns)
+{
+  struct manchesterStruct *m = &ir->rc5 ;
+  unsigned int bits = 0 ;
+  int i, b ;
+
+  if (m->state == MAN_ARMED)
+  {
+    if (!mark)
+      return ;
+    m->state = MAN_SLOTS ;
+    m->count  = 1 ;
+    m->target = 28 ;
+    m->slots [0] = 0 ;
+  }
+
+  if (m->state != MAN_SLOTS)
+  {
+    manchesterIdle (m, mark, d) ;
+    return ;
+  }
+
+  if (!manchesterAdd (m, mark, d, RC5_UNIT, 2))
+  {
+    manchesterIdle (m, mark, d) ;
+    return ;
+  }
+
+  if (!manchesterFull (m))
+    return ;
+
+  if (m->count < m->target)
+    m->slots [m->target - 1] = 0 ;
+  m->state = MAN_OFF ;
+
+  for (i = 0 ; i < 14 ; ++i)
+  {
+    if ((b = manchesterBit (m, i * 2)) == -1)
+      return ;
+    bits = (bits << 1) | (b == 0) ;		// Space first is a 1
+  }
+
+  if ((bits & 0x2000) == 0)
+    return ;
+
+  emit (ir, ns, WPI_IR_RC5, (bits >> 6) & 0x1F, (bits & 0x3F) | ((~bits & 0x1000) >> 6), (bits >> 11) & 1) ;
+}
+
+
+/*
+ * rc6Feed:
+ *	A 2.666mS mark and a 889uS space, then bits of 889uS, a 1 a mark then
+ *	a space: the start bit, 3 bits of mode and the toggle bit, which is
+ *	twice as long. Then in mode 0 8 bits of address, 8 of command; in
+ *	mode 6 (RC6A) 16 of each.
+ *********************************************************************************
+ */
+
+static void rc6Feed (struct wpiIrStruct *ir, int mark, unsigned long long d, unsigned long long ns)
+{
+  struct manchesterStruct *m = &ir->rc6 ;
+  uint32_t bits = 0 ;
+  int i, b, mode, toggle, numBits ;
+
+  if (mark && within (d, 2000, 3300))
+  {
+    m->state = MAN_LEADER ;
+    return ;
+  }
+
+  switch (m->state)
+  {
+    case MAN_LEADER:
+      if (mark || !within (d, 600, 1200))
+      {
+	manchesterIdle (m, mark, d) ;
+	return ;
+      }
+      m->state  = MAN_SLOTS ;
+      m->count  = 0 ;
+      m->target = 44 ;
+      return ;
+
+    case MAN_SLOTS:
+      if (!manchesterAdd (m, mark, d, RC6_UNIT, 3))
+      {
+	manchesterIdle (m, mark, d) ;
+	return ;
+      }
+      break ;
+
+    default:
+      return ;
+  }
+
+  if (m->count < 12)
+    return ;
+
+// The header's all there: check it, and see how long the frame is
+
+  if ((manchesterBit (m, 0) != 1) || (m->slots [8] != m->slots [9]) ||
+      (m->slots [10] != m->slots [11]) || (m->slots [8] == m->slots [10]))
+  {
+    m->state = MAN_OFF ;
+    return ;
+  }
+
+  for (mode = 0, i = 1 ; i < 4 ; ++i)
+  {
+    if ((b = manchesterBit (m, i * 2)) == -1)
+    {
+      m->state = MAN_OFF ;
+      return ;
+    }
+    mode = (mode << 1) | b ;
+  }
+
+  /**/ if (mode == 0)
+    m->target = 12 + 16 * 2 ;
+  else if (mode == 6)
+    m->target = 12 + 32 * 2 ;
+  else
+  {
+    m->state = MAN_OFF ;
+    return ;
+  }
+
+  if (!manchesterFull (m))
+    return ;
+
+  if (m->count < m->target)
+    m->slots [m->target - 1] = 0 ;
+  m->state = MAN_OFF ;
+  toggle   = m->slots [8] ;
+  numBits  = (m->target - 12) / 2 ;
+
+  for (i = 0 ; i < numBits ; ++i)
+  {
+    if ((b = manchesterBit (m, 12 + i * 2)) == -1)
+      return ;
+    bits = (bits << 1) | b ;
+  }
+
+  if (mode == 0)
+    emit (ir, ns, WPI_IR_RC6, bits >> 8, bits & 0xFF, toggle) ;
+  else
+    emit (ir, ns, WPI_IR_RC6, bits >> 16, bits & 0xFFFF, toggle) ;
+}
+
+
+/*
+ * irEdge:
+ *	The ISR: the width of what the edge ended, to each decoder
+ *********************************************************************************
+ */
+
+static void irEdge (void *context, const struct wpiEdgeEventStruct *event)
+{
+  struct wpiIrStruct *ir = (struct wpiIrStruct *)context ;
+  unsigned long long ns = event->timestamp, d ;
+  int level, mark ;
+
+  if (!ir->armed)
+    return ;
+
+  level = (event->edge == INT_EDGE_RISING) ;
+  if ((ir->flags & WPI_IR_ACTIVE_HIGH) == 0)
+    level = !level ;
+
+  pthread_mutex_lock (&ir->lock) ;
+
+  /**/ if (ir->lastEdgeNs == 0)			// The first edge
+    ;
+  else if ((level == ir->lastLevel) || (ns < ir->lastEdgeNs))	// Lost one - start again
+  {
+    ir->nec.state  = 0 ;
+    ir->sony.state = 0 ;
+    ir->rc5.state  = MAN_OFF ;
+    ir->rc6.state  = MAN_OFF ;
+  }
+  else
+  {
+    d    = ns - ir->lastEdgeNs ;
+    mark = ir->lastLevel ;
+
+    if ((ir->protocols & WPI_IR_NEC)  != 0) necFeed  (ir, mark, d, ns) ;
+    if ((ir->protocols & WPI_IR_SONY) != 0) sonyFeed (ir, mark, d, ns) ;
+    if ((ir->protocols & WPI_IR_RC5)  != 0) rc5Feed  (ir, mark, d, ns) ;
+    if ((ir->protocols & WPI_IR_RC6)  != 0) rc6Feed  (ir, mark, d, ns) ;
+  }
+
+  ir->lastEdgeNs = ns ;
+  ir->lastLevel  = level ;
+
+  pthread_mutex_unlock (&ir->lock) ;
+}
+
+
+/*
+ * irSweep:
+ *	Finish a Sony frame once the line's gone quiet after it
+ *********************************************************************************
+ */
+
+static void irSweep (void *ctx)
+{
+  struct wpiIrStruct *ir = (struct wpiIrStruct *)ctx ;
+  unsigned long long now = monoNanos () ;
+
+  pthread_mutex_lock (&ir->lock) ;
+    if ((ir->sony.state == 1) && !ir->lastLevel && ((now - ir->lastEdgeNs) >= SONY_DONE_NS))
+      sonyDone (ir, ir->lastEdgeNs) ;
+  pthread_mutex_unlock (&ir->lock) ;
+}
+
+
+/*
+ * wiringPiIRSetup:
+ *	Decode a receiver on pin for the protocols (WPI_IR_NEC etc.), keeping
+ *	depth keys until they're read. The pin wants to be on-board, or on a
+ *	node whose edges come with their times, for the widths to be right.
+ *	Returns 0 or -1 with errno set.
+ *********************************************************************************
+ */
+
+int wiringPiIRSetup (int pin, int protocols, int flags, int depth)
+{
+  struct wpiIrStruct *ir ;
+  int slot ;
+
+  if (((protocols & WPI_IR_ALL) == 0) || (depth < 1))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  pthread_mutex_lock (&irsLock) ;
+
+  if (findIr (pin) != NULL)
+  {
+    pthread_mutex_unlock (&irsLock) ;
+    errno = EBUSY ;
+    return -1 ;
+  }
+
+  for (slot = 0 ; slot < MAX_IR ; ++slot)
+    if (irs [slot] == NULL)
+      break ;
+
+  if ((slot == MAX_IR) || ((ir = (struct wpiIrStruct *)calloc (1, sizeof (*ir))) == NULL))
+  {
+    pthread_mutex_unlock (&irsLock) ;
+    errno = ENOMEM ;
+    return -1 ;
+  }
+
+  ir->pin       = pin ;
+  ir->protocols = protocols ;
+  ir->flags     = flags ;
+  ir->armed     = TRUE ;
+  ir->sweep     = -1 ;
+  ir->lastLevel = -1 ;
+  ir->rc5.state = MAN_ARMED ;
+  pthread_mutex_init (&ir->lock, NULL) ;
+
+  if ((ir->ring = piRingCreate (PI_RING_SPSC, sizeof (struct wpiIrEvent), depth, TRUE)) == NULL)
+  {
+    pthread_mutex_unlock (&irsLock) ;
+    free (ir) ;
+    errno = ENOMEM ;
+    return -1 ;
+  }
+
+  if (((protocols & WPI_IR_SONY) != 0) && ((ir->sweep = piPeriodicCreate (SONY_SWEEP_NS, irSweep, ir, 0)) < 0))
+  {
+    pthread_mutex_unlock (&irsLock) ;
+    piRingFree (ir->ring) ;
+    free (ir) ;
+    errno = EAGAIN ;
+    return -1 ;
+  }
+
+  irs [slot] = ir ;
+  pthread_mutex_unlock (&irsLock) ;
+
+  if (wiringPiISRex (pin, INT_EDGE_BOTH, irEdge, ir) < 0)
+  {
+    irs [slot] = NULL ;
+    if (ir->sweep != -1)
+    {
+      piPeriodicDelete (ir->sweep) ;
+      delay (1 + SONY_SWEEP_NS / 1000000) ;
+    }
+    piRingFree (ir->ring) ;
+    free (ir) ;
+    return -1 ;
+  }
+
+  return 0 ;
+}
+
+
+/*
+ * wiringPiIRRead:
+ * wiringPiIRFd:
+ * wiringPiIRLost:
+ *	Take up to max keys, oldest first, returning how many; an fd that
+ *	polls readable while there are some; and how many were lost because
+ *	the ring was full.
+ *********************************************************************************
+ */
+
+int wiringPiIRRead (int pin, struct wpiIrEvent *events, int max)
+{
+  struct wpiIrStruct *ir = findIr (pin) ;
+
+  if ((ir == NULL) || (max < 1))
+    return 0 ;
+
+  return (int)piRingPop (ir->ring, events, (unsigned int)max) ;
+}
+
+int wiringPiIRFd (int pin)
+{
+  struct wpiIrStruct *ir = findIr (pin) ;
+
+  return (ir == NULL) ? -1 : piRingFd (ir->ring) ;
+}
+
+unsigned int wiringPiIRLost (int pin)
+{
+  struct wpiIrStruct *ir = findIr (pin) ;
+
+  return (ir == NULL) ? 0 : __atomic_load_n (&ir->lost, __ATOMIC_RELAXED) ;
+}
+
+
+/*
+ * wiringPiIRStop:
+ *	Stop decoding. As with the triggers the ISR stays attached, so the
+ *	decoder and what's in its ring do too.
+ *********************************************************************************
+ */
+
+void wiringPiIRStop (int pin)
+{
+  struct wpiIrStruct *ir = findIr (pin) ;
+
+  if (ir == NULL)
+    return ;
+
+  ir->armed = FALSE ;
+  if (ir->sweep != -1)
+  {
+    piPeriodicDelete (ir->sweep) ;
+    ir->sweep = -1 ;
+  }
+}
@@ -0,0 +1,69 @@
+/*
+ * wiringPiIR.h:
+ *	Decode infra-red remote controls from timestamped edges
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+// Protocols, to or together for wiringPiIRSetup ()
+
+#define	WPI_IR_NEC		1
+#define	WPI_IR_RC5		2
+#define	WPI_IR_RC6		4
+#define	WPI_IR_SONY		8
+#define	WPI_IR_ALL		15
+
+// Flags: the usual receiver module (TSOP and the like) pulls its output
+//	low while it sees the carrier. One that doesn't wants this.
+
+#define	WPI_IR_ACTIVE_HIGH	1
+
+// wpiIrEvent:
+//	One key. ns is the CLOCK_MONOTONIC time of the edge that finished it.
+//	address and command are as the protocol has them:
+//	  NEC:  8 bit address (16 for extended NEC), 8 bit command
+//	  RC5:  5 bit address, 7 bit command (RC5X's extra bit is bit 6)
+//	  RC6:  8 bit address and command in mode 0, 16 of each for RC6A
+//	  Sony: 5, 8 or 13 bit address, 7 bit command
+//	repeat is set for the codes sent while a key is held: NEC's repeat
+//	codes, the same RC5/RC6 toggle bit again, a Sony frame again.
+
+struct wpiIrEvent
+{
+  unsigned long long ns ;
+  int                protocol ;
+  unsigned int       address ;
+  unsigned int       command ;
+  int                repeat ;
+} ;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int          wiringPiIRSetup (int pin, int protocols, int flags, int depth) ;
+extern int          wiringPiIRRead  (int pin, struct wpiIrEvent *events, int max) ;
+extern int          wiringPiIRFd    (int pin) ;
+extern unsigned int wiringPiIRLost  (int pin) ;
+extern void         wiringPiIRStop  (int pin) ;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,533 @@
+/*
+ * wiringPiImage.c:
+ *	A shared image of the inputs, scanned by one process for many.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+
+/*
+ * Notes:
+ *	One process - wiringPiD -i, or any program with access to the GPIO -
+ *	calls wiringPiImagePublish () and a thread reads GPLEV0/1 and a list
+ *	of extension pins at a fixed rate into shared memory. Other programs
+ *	call wiringPiImageAttach () (or run with WIRINGPI_IMAGE set) and from
+ *	then on digitalRead () and digitalReadBank () of those pins come from
+ *	the image, so the bus and register traffic stays the same however
+ *	many of them there are, and they need no access to the GPIO at all.
+ *
+ *	The image is written under a sequence count, odd while it's being
+ *	changed, for wiringPiImageRead () to get a consistent copy of the
+ *	lot; single pins are one word and just read. changes goes up when
+ *	any input changes, and is what wiringPiImageWait () sleeps on - the
+ *	clients only map the image read-only, so it's always woken.
+ *
+ *	If the publisher stops, or stops updating, the image goes stale
+ *	after 10 scans (at least 100mS) and reads go back to the hardware.
+ *********************************************************************************
+ */
+
+#include <stdint.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include "wiringPi.h"
+#include "wiringPiImage.h"
+#include "piThread.h"
+
+#define	IMAGE_SHM	"/wiringPi-image"
+#define	IMAGE_MAGIC	0x57504931	// WPI1
+#define	MIN_STALE_NS	100000000ULL
+
+struct wpiImageShmStruct
+{
+  uint32_t magic ;			// Set last, once the rest is ready
+  uint32_t pid ;			// Of the publisher
+  uint32_t seq ;
+  uint32_t changes ;
+  uint64_t stamp ;			// CLOCK_MONOTONIC_COARSE of the last scan, nS
+  uint64_t staleNs ;
+  uint32_t lev [2] ;
+  uint32_t numExt ;
+  int32_t  extPins   [WPI_IMAGE_MAX_EXT] ;
+  int32_t  extValues [WPI_IMAGE_MAX_EXT] ;
+} ;
+
+static struct wpiImageShmStruct *image = NULL ;	// Attached
+static struct wpiImageShmStruct *pubImage = NULL ;	// Publishing
+static struct wpiImageShmStruct *mapped = NULL ;	// Detached from, but still mapped
+static pthread_t        imageThreadId ;
+static volatile int     publishing = FALSE ;
+static unsigned int     periodNs ;
+static pthread_mutex_t  imageLock = PTHREAD_MUTEX_INITIALIZER ;
+
+volatile int wpiImageOn = FALSE ;
+
+
+/*
+ * coarseNs:
+ *********************************************************************************
+ */
+
+static uint64_t coarseNs (void)
+{
+  struct timespec ts ;
+
+  clock_gettime (CLOCK_MONOTONIC_COARSE, &ts) ;
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec ;
+}
+
+
+/*
+ * imageThread:
+ *	Scan the inputs, publish them and say if anything's changed
+ *********************************************************************************
+ */
+
+static void *imageThread (void *arg)
+{
+  struct wpiImageShmStruct *shm = (struct wpiImageShmStruct *)arg ;
+  uint32_t lev [2] ;
+  int32_t  ext [WPI_IMAGE_MAX_EXT] ;
+  unsigned long long next = nanos64 () ;
+  int i, changed, first = TRUE ;
+
+  while (publishing)
+  {
+    lev [0] = digitalReadBank (0) ;
+    lev [1] = digitalReadBank (1) ;
+    for (i = 0 ; i < (int)shm->numExt ; ++i)
+      ext [i] = digitalRead (shm->extPins [i]) ;
+
+    changed = first || (lev [0] != shm->lev [0]) || (lev [1] != shm->lev [1]) ;
+    for (i = 0 ; !changed && (i < (int)shm->numExt) ; ++i)
+      changed = (ext [i] != shm->extValues [i]) ;
+
+    if (changed)
+    {
+      __atomic_store_n (&shm->seq, shm->seq + 1, __ATOMIC_RELAXED) ;
+      __atomic_thread_fence (__ATOMIC_RELEASE) ;
+	__atomic_store_n (&shm->lev [0], lev [0], __ATOMIC_RELAXED) ;
+	__atomic_store_n (&shm->lev [1], lev [1], __ATOMIC_RELAXED) ;
+	for (i = 0 ; i < (int)shm->numExt ; ++i)
+	  __atomic_store_n (&shm->extValues [i], ext [i], __ATOMIC_RELAXED) ;
+      __atomic_store_n (&shm->seq, shm->seq + 1, __ATOMIC_RELEASE) ;
+    }
+
+    __atomic_store_n (&shm->stamp, coarseNs (), __ATOMIC_RELEASE) ;
+
+    if (changed)
+    {
+      __atomic_add_fetch (&shm->changes, 1, __ATOMIC_SEQ_CST) ;
+      piFutexWake (&shm->changes, INT_MAX) ;
+    }
+
+    first = FALSE ;
+
+    next += periodNs ;
+    if (next < nanos64 ())		// Fallen behind: re-sync
+      next = nanos64 () ;
+    delayUntilNanos (next) ;
+  }
+
+  return NULL ;
+}
+
+
+/*
+ * wiringPiImagePublish:
+ *	Start scanning the on-board inputs and the given extension pins (up
+ *	to WPI_IMAGE_MAX_EXT, numbered as in this program) rateHz times a
+ *	second into the shared image. Only one process can publish at a time.
+ *	Returns 0 or -1 with errno set.
+ *********************************************************************************
+ */
+
+int wiringPiImagePublish (int rateHz, const int *extPins, int numExt)
+{
+  struct wpiImageShmStruct *shm ;
+  struct stat st ;
+  uint32_t pid ;
+  int fd, i, err ;
+
+  if ((rateHz < 1) || (rateHz > 100000) || (numExt < 0) || (numExt > WPI_IMAGE_MAX_EXT))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  pthread_mutex_lock (&imageLock) ;
+
+  if (publishing || wpiImageOn)
+  {
+    pthread_mutex_unlock (&imageLock) ;
+    errno = EBUSY ;
+    return -1 ;
+  }
+
+// Re-use the segment if there is one, so attached clients carry on
+
+  if ((fd = shm_open (IMAGE_SHM, O_CREAT | O_RDWR, 0644)) < 0)
+  {
+    pthread_mutex_unlock (&imageLock) ;
+    return -1 ;
+  }
+
+  if ((fstat (fd, &st) < 0) || ((st.st_size < (off_t)sizeof (*shm)) && (ftruncate (fd, sizeof (*shm)) < 0)))
+    shm = MAP_FAILED ;
+  else
+    shm = (struct wpiImageShmStruct *)mmap (NULL, sizeof (*shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) ;
+
+  err = errno ;
+  close (fd) ;
+
+  if (shm == MAP_FAILED)
+  {
+    pthread_mutex_unlock (&imageLock) ;
+    errno = err ;
+    return -1 ;
+  }
+
+  pid = __atomic_load_n (&shm->pid, __ATOMIC_ACQUIRE) ;
+  if ((shm->magic == IMAGE_MAGIC) && (pid != 0) && (pid != (uint32_t)getpid ()) && (kill ((pid_t)pid, 0) == 0))
+  {
+    munmap (shm, sizeof (*shm)) ;
+    pthread_mutex_unlock (&imageLock) ;
+    errno = EBUSY ;
+    return -1 ;
+  }
+
+  __atomic_store_n (&shm->magic, 0, __ATOMIC_RELEASE) ;
+
+  periodNs     = 1000000000u / rateHz ;
+  shm->pid     = (uint32_t)getpid () ;
+  shm->staleNs = ((uint64_t)periodNs * 10 > MIN_STALE_NS) ? (uint64_t)periodNs * 10 : MIN_STALE_NS ;
+  shm->stamp   = 0 ;
+  shm->numExt  = numExt ;
+  for (i = 0 ; i < numExt ; ++i)
+  {
+    shm->extPins   [i] = extPins [i] ;
+    shm->extValues [i] = LOW ;
+  }
+
+  __atomic_store_n (&shm->magic, IMAGE_MAGIC, __ATOMIC_RELEASE) ;
+
+  publishing = TRUE ;
+  if (pthread_create (&imageThreadId, NULL, imageThread, shm) != 0)
+  {
+    publishing = FALSE ;
+    shm->pid   = 0 ;
+    munmap (shm, sizeof (*shm)) ;
+    pthread_mutex_unlock (&imageLock) ;
+    errno = EAGAIN ;
+    return -1 ;
+  }
+
+  pubImage = shm ;
+
+  pthread_mutex_unlock (&imageLock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * wiringPiImageStop:
+ *	Stop publishing. The clients go back to reading the hardware once
+ *	they notice.
+ *********************************************************************************
+ */
+
+void wiringPiImageStop (void)
+{
+  pthread_mutex_lock (&imageLock) ;
+
+  if (publishing)
+  {
+    publishing = FALSE ;
+    pthread_join (imageThreadId, NULL) ;
+
+    __atomic_store_n (&pubImage->pid,   0, __ATOMIC_RELEASE) ;
+    __atomic_store_n (&pubImage->stamp, 0, __ATOMIC_RELEASE) ;
+    munmap (pubImage, sizeof (*pubImage)) ;
+    pubImage = NULL ;
+  }
+
+  pthread_mutex_unlock (&imageLock) ;
+}
+
+
+/*
+ * wiringPiImageAttach:
+ * wiringPiImageDetach:
+ *	Start and stop taking digitalRead () from the published image.
+ *	Attach returns 0 or -1 with errno set - ENOENT if nobody's ever
+ *	published one.
+ *********************************************************************************
+ */
+
+int wiringPiImageAttach (void)
+{
+  struct wpiImageShmStruct *shm ;
+  struct stat st ;
+  int fd, err ;
+
+  pthread_mutex_lock (&imageLock) ;
+
+  if (publishing)
+  {
+    pthread_mutex_unlock (&imageLock) ;
+    errno = EBUSY ;
+    return -1 ;
+  }
+
+  if (image != NULL)
+  {
+    pthread_mutex_unlock (&imageLock) ;
+    return 0 ;
+  }
+
+  if (mapped != NULL)
+  {
+    image      = mapped ;
+    wpiImageOn = TRUE ;
+    pthread_mutex_unlock (&imageLock) ;
+    return 0 ;
+  }
+
+  if ((fd = shm_open (IMAGE_SHM, O_RDONLY, 0)) < 0)
+  {
+    pthread_mutex_unlock (&imageLock) ;
+    return -1 ;
+  }
+
+  if ((fstat (fd, &st) < 0) || (st.st_size < (off_t)sizeof (*shm)))
+  {
+    shm = MAP_FAILED ;
+    errno = EINVAL ;
+  }
+  else
+    shm = (struct wpiImageShmStruct *)mmap (NULL, sizeof (*shm), PROT_READ, MAP_SHARED, fd, 0) ;
+
+  err = errno ;
+  close (fd) ;
+
+  if (shm == MAP_FAILED)
+  {
+    pthread_mutex_unlock (&imageLock) ;
+    errno = err ;
+    return -1 ;
+  }
+
+  image      = shm ;
+  wpiImageOn = TRUE ;
+
+  pthread_mutex_unlock (&imageLock) ;
+
+  return 0 ;
+}
+
+void wiringPiImageDetach (void)
+{
+  pthread_mutex_lock (&imageLock) ;
+
+  if (image != NULL)		// Left mapped: another thread may be part way through a read
+  {
+    wpiImageOn = FALSE ;
+    mapped     = image ;
+    image      = NULL ;
+  }
+
+  pthread_mutex_unlock (&imageLock) ;
+}
+
+
+/*
+ * fresh:
+ *	Is the image there and being kept up?
+ *********************************************************************************
+ */
+
+static inline int fresh (struct wpiImageShmStruct *shm)
+{
+  uint64_t stamp ;
+
+  if ((shm == NULL) || (__atomic_load_n (&shm->magic, __ATOMIC_ACQUIRE) != IMAGE_MAGIC))
+    return FALSE ;
+
+  stamp = __atomic_load_n (&shm->stamp, __ATOMIC_ACQUIRE) ;
+
+  return (stamp != 0) && ((coarseNs () - stamp) <= shm->staleNs) ;
+}
+
+
+/*
+ * wpiImageLevel:
+ * wpiImageBank:
+ * wpiImageExt:
+ *	For digitalRead () and digitalReadBank (): a BCM_GPIO pin, a bank or
+ *	an extension pin from the image, or -1 to read the hardware as usual
+ *	(it's stale, or not a pin in the image).
+ *********************************************************************************
+ */
+
+int wpiImageLevel (int gpioPin)
+{
+  struct wpiImageShmStruct *shm = image ;
+
+  if ((gpioPin < 0) || (gpioPin > 63) || !fresh (shm))
+    return -1 ;
+
+  return (__atomic_load_n (&shm->lev [gpioPin >> 5], __ATOMIC_ACQUIRE) >> (gpioPin & 31)) & 1 ;
+}
+
+int wpiImageBank (int bank, unsigned int *data)
+{
+  struct wpiImageShmStruct *shm = image ;
+
+  if (!fresh (shm))
+    return -1 ;
+
+  *data = __atomic_load_n (&shm->lev [bank & 1], __ATOMIC_ACQUIRE) ;
+  return 0 ;
+}
+
+int wpiImageExt (int pin)
+{
+  struct wpiImageShmStruct *shm = image ;
+  uint32_t i ;
+
+  if (!fresh (shm))
+    return -1 ;
+
+  for (i = 0 ; (i < shm->numExt) && (i < WPI_IMAGE_MAX_EXT) ; ++i)
+    if (shm->extPins [i] == pin)
+      return __atomic_load_n (&shm->extValues [i], __ATOMIC_ACQUIRE) ;
+
+  return -1 ;
+}
+
+
+/*
+ * wiringPiImageRead:
+ *	A consistent copy of the whole image: lev [2] for GPIO 0-31 and
+ *	32-53, and the extension pins in the order they were published
+ *	(either can be NULL). Returns the number of extension pins, or -1 if
+ *	there's no up to date image.
+ *********************************************************************************
+ */
+
+int wiringPiImageRead (unsigned int *lev, int *extValues)
+{
+  struct wpiImageShmStruct *shm = image ;
+  uint32_t seq, n, i ;
+
+  if (!fresh (shm))
+    return -1 ;
+
+  n = shm->numExt ;
+  if (n > WPI_IMAGE_MAX_EXT)
+    n = WPI_IMAGE_MAX_EXT ;
+
+  do
+  {
+    while (((seq = __atomic_load_n (&shm->seq, __ATOMIC_ACQUIRE)) & 1) != 0)
+      ;
+
+    if (lev != NULL)
+    {
+      lev [0] = __atomic_load_n (&shm->lev [0], __ATOMIC_RELAXED) ;
+      lev [1] = __atomic_load_n (&shm->lev [1], __ATOMIC_RELAXED) ;
+    }
+    if (extValues != NULL)
+      for (i = 0 ; i < n ; ++i)
+	extValues [i] = __atomic_load_n (&shm->extValues [i], __ATOMIC_RELAXED) ;
+
+    __atomic_thread_fence (__ATOMIC_ACQUIRE) ;
+  }
+  while (__atomic_load_n (&shm->seq, __ATOMIC_RELAXED) != seq) ;
+
+  return (int)n ;
+}
+
+
+/*
+ * wiringPiImageWait:
+ *	Wait for an input in the image to change. Pass in what this returned
+ *	last time (or 0 to start) and it returns as soon as there's been a
+ *	change since, or after timeoutMs (-1: forever) with the same value
+ *	back if not.
+ *********************************************************************************
+ */
+
+unsigned int wiringPiImageWait (unsigned int last, int timeoutMs)
+{
+  struct wpiImageShmStruct *shm = image ;
+  struct timespec now, end, left ;
+  uint32_t changes ;
+
+  if (shm == NULL)
+    return last ;
+
+  if (((changes = __atomic_load_n (&shm->changes, __ATOMIC_ACQUIRE)) != last) || (timeoutMs == 0))
+    return changes ;
+
+  clock_gettime (CLOCK_MONOTONIC, &end) ;
+  end.tv_sec  += timeoutMs / 1000 ;
+  end.tv_nsec += (timeoutMs % 1000) * 1000000 ;
+  if (end.tv_nsec >= 1000000000)
+  {
+    end.tv_nsec -= 1000000000 ;
+    ++end.tv_sec ;
+  }
+
+  while ((changes = __atomic_load_n (&shm->changes, __ATOMIC_SEQ_CST)) == last)
+  {
+    if (timeoutMs > 0)
+    {
+      clock_gettime (CLOCK_MONOTONIC, &now) ;
+      left.tv_sec  = end.tv_sec  - now.tv_sec ;
+      left.tv_nsec = end.tv_nsec - now.tv_nsec ;
+      if (left.tv_nsec < 0)
+      {
+	left.tv_nsec += 1000000000 ;
+	--left.tv_sec ;
+      }
+      if (left.tv_sec < 0)
+	break ;
+    }
+
+    if ((piFutexWait (&shm->changes, last, (timeoutMs > 0) ? &left : NULL) < 0) && (errno == ETIMEDOUT))
+    {
+      changes = __atomic_load_n (&shm->changes, __ATOMIC_SEQ_CST) ;
+      break ;
+    }
+  }
+
+  return changes ;
+}
@@ -0,0 +1,50 @@
+/*
+ * wiringPiImage.h:
+ *	A shared image of the inputs, scanned by one process for many.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#define	WPI_IMAGE_MAX_EXT	64
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// For programs
+
+extern int          wiringPiImagePublish (int rateHz, const int *extPins, int numExt) ;
+extern void         wiringPiImageStop    (void) ;
+extern int          wiringPiImageAttach  (void) ;
+extern void         wiringPiImageDetach  (void) ;
+extern int          wiringPiImageRead    (unsigned int *lev, int *extValues) ;
+extern unsigned int wiringPiImageWait    (unsigned int last, int timeoutMs) ;
+
+// For the rest of wiringPi
+
+extern volatile int wpiImageOn ;
+
+extern int wpiImageLevel (int gpioPin) ;
+extern int wpiImageBank  (int bank, unsigned int *data) ;
+extern int wpiImageExt   (int pin) ;
+
+#ifdef __cplusplus
+}
+#endif
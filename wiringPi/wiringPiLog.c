@@ -0,0 +1,329 @@
+/*
+ * wiringPiLog.c:
+ *	Binary sample logging into memory-mapped segment files.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+
+/*
+ * Notes:
+ *	Samples go into a directory of segment files, each set to its full
+ *	size up-front with posix_fallocate () so the filesystem has nothing
+ *	to do as it fills, and mapped, so adding a record is a copy into
+ *	memory - no formatting, no write () - and the kernel writes the
+ *	pages back in its own time, whole, rather than a line at a time.
+ *	When a segment's full it's trimmed, the next one is started and,
+ *	with maxSegments, the oldest goes: a ring of files on the card.
+ *	gpio log dumps them.
+ *********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "wiringPi.h"
+#include "adcStream.h"
+#include "wiringPiLog.h"
+
+struct wpiLogStruct
+{
+  pthread_mutex_t lock ;
+  char           *dir ;
+  int             numValues ;
+  unsigned int    recordSize ;
+  unsigned int    capacity ;
+  int             maxSegments ;
+  unsigned long long sequence ;		// Of the segment being written
+
+  int             fd ;
+  size_t          mapSize ;
+  struct wpiLogHeaderStruct *header ;	// NULL if there isn't one
+  unsigned char  *data ;
+} ;
+
+
+/*
+ * segmentName:
+ *	File name for a sequence number
+ *********************************************************************************
+ */
+
+static void segmentName (const struct wpiLogStruct *log, unsigned long long sequence, char *name, size_t size)
+{
+  int n ;
+
+  n = snprintf (name, size, "%s/", log->dir) ;
+  snprintf (name + n, size - n, WPI_LOG_NAME, sequence) ;
+}
+
+
+/*
+ * segmentClose:
+ *	Finish off the segment: trim it to what's been written and let it go
+ *********************************************************************************
+ */
+
+static void segmentClose (struct wpiLogStruct *log)
+{
+  int res ;
+
+  if (log->header == NULL)
+    return ;
+
+  msync (log->header, log->mapSize, MS_SYNC) ;
+  res = ftruncate (log->fd, WPI_LOG_DATA + log->header->count * log->recordSize) ;
+  (void)res ;		// If not, it just stays full size
+  munmap (log->header, log->mapSize) ;
+  close (log->fd) ;
+
+  log->header = NULL ;
+  log->fd     = -1 ;
+}
+
+
+/*
+ * segmentOpen:
+ *	Start the next segment, dropping the oldest if there are too many
+ *********************************************************************************
+ */
+
+static int segmentOpen (struct wpiLogStruct *log)
+{
+  struct wpiLogHeaderStruct *h ;
+  char name [PATH_MAX] ;
+  void *map ;
+  int err ;
+
+  ++log->sequence ;
+  segmentName (log, log->sequence, name, sizeof (name)) ;
+
+  log->mapSize = WPI_LOG_DATA + (size_t)log->capacity * log->recordSize ;
+
+  if ((log->fd = open (name, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0)
+    return -1 ;
+
+  if ((err = posix_fallocate (log->fd, 0, log->mapSize)) != 0)
+  {
+    close (log->fd) ;
+    unlink (name) ;
+    errno = err ;
+    return -1 ;
+  }
+
+  if ((map = mmap (NULL, log->mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, log->fd, 0)) == MAP_FAILED)
+  {
+    err = errno ;
+    close (log->fd) ;
+    unlink (name) ;
+    errno = err ;
+    return -1 ;
+  }
+
+  h = (struct wpiLogHeaderStruct *)map ;
+  memset (h, 0, sizeof (*h)) ;
+  h->version     = WPI_LOG_VERSION ;
+  h->numValues   = log->numValues ;
+  h->recordSize  = log->recordSize ;
+  h->capacity    = log->capacity ;
+  h->indexStride = (log->capacity + WPI_LOG_INDEX - 1) / WPI_LOG_INDEX ;
+  h->sequence    = log->sequence ;
+  __atomic_store_n (&h->magic, WPI_LOG_MAGIC, __ATOMIC_RELEASE) ;
+
+  log->header = h ;
+  log->data   = (unsigned char *)map + WPI_LOG_DATA ;
+
+  if ((log->maxSegments > 0) && (log->sequence > (unsigned long long)log->maxSegments))
+  {
+    segmentName (log, log->sequence - log->maxSegments, name, sizeof (name)) ;
+    unlink (name) ;
+  }
+
+  return 0 ;
+}
+
+
+/*
+ * wiringPiLogOpen:
+ *	Log records of numValues ints into segments of segmentRecords each
+ *	in dir, keeping the newest maxSegments of them (0 for all of them).
+ *	Numbering carries on from any segments already there.
+ *	Returns the log, or NULL with errno set.
+ *********************************************************************************
+ */
+
+struct wpiLogStruct *wiringPiLogOpen (const char *dir, int numValues, unsigned int segmentRecords, int maxSegments)
+{
+  struct wpiLogStruct *log ;
+  struct dirent *d ;
+  unsigned long long sequence ;
+  DIR *dp ;
+  int err ;
+
+  if ((numValues < 1) || (numValues > WPI_LOG_MAX_VALUES) || (segmentRecords < 1) || (maxSegments < 0))
+  {
+    errno = EINVAL ;
+    return NULL ;
+  }
+
+  if ((dp = opendir (dir)) == NULL)
+    return NULL ;
+
+  if ((log = (struct wpiLogStruct *)calloc (1, sizeof (*log))) == NULL)
+  {
+    closedir (dp) ;
+    errno = ENOMEM ;
+    return NULL ;
+  }
+
+  while ((d = readdir (dp)) != NULL)
+    if ((sscanf (d->d_name, WPI_LOG_SCAN, &sequence) == 1) && (sequence > log->sequence))
+      log->sequence = sequence ;
+  closedir (dp) ;
+
+  pthread_mutex_init (&log->lock, NULL) ;
+  log->dir         = strdup (dir) ;
+  log->numValues   = numValues ;
+  log->recordSize  = (sizeof (struct wpiLogRecordStruct) + numValues * sizeof (int32_t) + 7) & ~7u ;
+  log->capacity    = segmentRecords ;
+  log->maxSegments = maxSegments ;
+  log->fd          = -1 ;
+
+  if ((log->dir == NULL) || (segmentOpen (log) < 0))
+  {
+    err = errno ;
+    free (log->dir) ;
+    free (log) ;
+    errno = err ;
+    return NULL ;
+  }
+
+  return log ;
+}
+
+
+/*
+ * wiringPiLogWrite:
+ *	Add a record. Times should go up, for the index to work.
+ *	Returns 0 or -1 with errno set if a new segment couldn't be made.
+ *********************************************************************************
+ */
+
+int wiringPiLogWrite (struct wpiLogStruct *log, unsigned long long timeNs, const int *values)
+{
+  struct wpiLogHeaderStruct *h ;
+  struct wpiLogRecordStruct *r ;
+  uint64_t count ;
+
+  pthread_mutex_lock (&log->lock) ;
+
+  if (((h = log->header) == NULL) || (h->count == h->capacity))
+  {
+    segmentClose (log) ;
+    if (segmentOpen (log) < 0)
+    {
+      pthread_mutex_unlock (&log->lock) ;
+      return -1 ;
+    }
+    h = log->header ;
+  }
+
+  count = h->count ;
+  r     = (struct wpiLogRecordStruct *)(log->data + count * log->recordSize) ;
+
+  r->timeNs = timeNs ;
+  memcpy (r->values, values, log->numValues * sizeof (int32_t)) ;
+
+  if (count == 0)
+    h->firstNs = timeNs ;
+  if ((count % h->indexStride) == 0)
+    h->index [count / h->indexStride] = timeNs ;
+  h->lastNs = timeNs ;
+
+  __atomic_store_n (&h->count, count + 1, __ATOMIC_RELEASE) ;
+
+  pthread_mutex_unlock (&log->lock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * wiringPiLogAdc:
+ *	Log what came out of adcStreamRead (): a record per scan, the
+ *	samples with the same timestamp, numValues of them, in order.
+ *	Returns the number of records, or -1.
+ *********************************************************************************
+ */
+
+int wiringPiLogAdc (struct wpiLogStruct *log, const struct adcSampleStruct *samples, int numSamples)
+{
+  int values [WPI_LOG_MAX_VALUES] ;
+  int i, n, records = 0 ;
+
+  for (i = 0 ; i < numSamples ; i += n)
+  {
+    memset (values, 0, sizeof (values)) ;
+    for (n = 0 ; (i + n < numSamples) && (n < log->numValues) && (samples [i + n].timestamp == samples [i].timestamp) ; ++n)
+      values [n] = samples [i + n].value ;
+
+    if (wiringPiLogWrite (log, samples [i].timestamp, values) < 0)
+      return -1 ;
+    ++records ;
+  }
+
+  return records ;
+}
+
+
+/*
+ * wiringPiLogSync:
+ * wiringPiLogClose:
+ *	Get what's been logged onto the card now, rather than when the
+ *	kernel gets round to it; and finish.
+ *********************************************************************************
+ */
+
+void wiringPiLogSync (struct wpiLogStruct *log)
+{
+  pthread_mutex_lock (&log->lock) ;
+    if (log->header != NULL)
+      msync (log->header, log->mapSize, MS_SYNC) ;
+  pthread_mutex_unlock (&log->lock) ;
+}
+
+void wiringPiLogClose (struct wpiLogStruct *log)
+{
+  if (log == NULL)
+    return ;
+
+  segmentClose (log) ;
+  pthread_mutex_destroy (&log->lock) ;
+  free (log->dir) ;
+  free (log) ;
+}
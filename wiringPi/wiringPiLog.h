@@ -0,0 +1,78 @@
+/*
+ * wiringPiLog.h:
+ *	Binary sample logging into memory-mapped segment files.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+
+#include <stdint.h>
+
+// A segment file: this header, then from WPI_LOG_DATA on, records of a
+//	timestamp and numValues ints. The index has the time of every
+//	indexStride'th record, so a time can be found with a look at the
+//	header and a short search. count only goes up once a record is
+//	complete, so a file can be read while it's being written.
+
+#define	WPI_LOG_MAGIC		0x57504C31	// WPL1
+#define	WPI_LOG_VERSION		1
+#define	WPI_LOG_DATA		4096
+#define	WPI_LOG_INDEX		256
+#define	WPI_LOG_MAX_VALUES	32
+#define	WPI_LOG_NAME		"%010llu.wpl"
+#define	WPI_LOG_SCAN		"%llu.wpl"
+
+struct wpiLogHeaderStruct
+{
+  uint32_t magic ;
+  uint32_t version ;
+  uint32_t numValues ;
+  uint32_t recordSize ;		// Bytes, a multiple of 8
+  uint32_t capacity ;		// Records
+  uint32_t indexStride ;
+  uint64_t sequence ;		// Of this segment
+  uint64_t count ;		// Records written
+  uint64_t firstNs ;
+  uint64_t lastNs ;
+  uint64_t index [WPI_LOG_INDEX] ;
+} ;
+
+struct wpiLogRecordStruct
+{
+  uint64_t timeNs ;
+  int32_t  values [] ;
+} ;
+
+struct wpiLogStruct ;
+struct adcSampleStruct ;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern struct wpiLogStruct *wiringPiLogOpen (const char *dir, int numValues, unsigned int segmentRecords, int maxSegments) ;
+extern int  wiringPiLogWrite (struct wpiLogStruct *log, unsigned long long timeNs, const int *values) ;
+extern int  wiringPiLogAdc   (struct wpiLogStruct *log, const struct adcSampleStruct *samples, int numSamples) ;
+extern void wiringPiLogSync  (struct wpiLogStruct *log) ;
+extern void wiringPiLogClose (struct wpiLogStruct *log) ;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,582 @@
+/*
+ * wiringPiParBus.c:
+ *	8080 and 6800 style parallel buses for displays
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+/*
+ * Notes:
+ *	The data pins and the RS (D/C), strobe and chip select pins are all
+ *	one port, so the port's tables give the whole state of the bus for a
+ *	cycle at once. An 8080 write is then two stores per bank: the data,
+ *	RS and WR going low together, then WR going back up to latch it. A
+ *	6800 write is the same with E going up and then down again.
+ *	Commands and data on their own select the chip around themselves;
+ *	between parBusBegin and parBusEnd it stays selected, which is what
+ *	a display wants for a command followed by its parameters.
+ *
+ *	With a DMA channel given, parBusWrite and parBusFill hand the cycles
+ *	to the DMA engine: a chain of control blocks storing straight into
+ *	GPSET0 and GPCLR0, a chunk at a time, the next chunk being filled in
+ *	while the one before runs. That needs all the pins in GPIO 0-31 on a
+ *	BCM283x (not the RP1 on a Pi 5). There's no pacing - it goes as fast
+ *	as the DMA engine can write the GPIO registers, a few MHz.
+ *
+ *	strobeNs and readNs stretch the strobes for slower controllers; a
+ *	read holds RD (or E) for readNs before sampling the data pins.
+ *
+ *	A bus isn't thread safe: give each one a thread.
+ *********************************************************************************
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "wiringPi.h"
+#include "wiringPiPort.h"
+#include "wiringPiDMA.h"
+#include "wiringPiParBus.h"
+
+#define	PAR_READ_NS		400		// Default RD low before sampling
+
+// DMA: cycles per chunk, and the registers
+
+#define	PAR_DMA_CYCLES		512
+#define	GPSET0			0x1C
+#define	GPCLR0			0x28
+
+struct parBusStruct
+{
+  int          type, width ;
+  wpiPort_t    port ;			// Data then controls
+  wpiPort_t    data ;			// Data on its own, for reads
+  int          fast ;			// wpiPortMasks works
+  unsigned int dataMask ;
+  unsigned int rsBit, wrBit, rdBit, csBit ;
+  unsigned int idle ;			// Controls with nothing going on
+  unsigned int state ;			// What the bus was left at
+  unsigned int strobeNs, readNs ;
+  int          selected ;		// parBusBegin nesting
+
+// The strobe's own stores: bank and mask
+
+  int          strobeBank ;
+  unsigned int strobeMask ;
+
+// DMA
+
+  int                  dmaChannel ;
+  struct dmaMemStruct  mem ;
+  struct dmaCbStruct  *cbs [2] ;
+  uint32_t            *words [2] ;	// Set and clear per cycle
+  uint32_t            *strobe ;		// The strobe mask, for the CBs to use
+  int                  cbsPerCycle ;
+  struct dmaCbStruct  *cut [2] ;	// Where a short chunk was cut off
+} ;
+
+
+/*
+ * strobeBit:
+ *	The port bit that's pulsed to make a cycle happen: WR for 8080, E
+ *	for 6800
+ *********************************************************************************
+ */
+
+static inline unsigned int strobeBit (struct parBusStruct *bus)
+{
+  return (bus->type == PAR_BUS_8080) ? bus->wrBit : bus->rdBit ;
+}
+
+
+/*
+ * parBusOpen:
+ * parBusClose:
+ *	Open a bus of width data pins, with RS and the strobe pins, and an
+ *	optional (-1 for none) chip select. rdPin is RD for 8080 and can be
+ *	-1 for a bus that's only written; for 6800 wrPin is R/W and rdPin is
+ *	E, which it must have. Everything is made an output and idle.
+ *********************************************************************************
+ */
+
+parBus_t parBusOpen (int type, const int *dataPins, int width, int rsPin, int wrPin, int rdPin, int csPin)
+{
+  struct parBusStruct *bus ;
+  unsigned int set [2], clr [2] ;
+  int pins [WPI_PORT_MAX_PINS] ;
+  int n ;
+
+  if ((dataPins == NULL) || (width < PAR_BUS_MIN_WIDTH) || (width > PAR_BUS_MAX_WIDTH) ||
+      ((type != PAR_BUS_8080) && (type != PAR_BUS_6800)) || (rsPin < 0) || (wrPin < 0) ||
+      ((type == PAR_BUS_6800) && (rdPin < 0)))
+  {
+    errno = EINVAL ;
+    return NULL ;
+  }
+
+  if ((bus = (struct parBusStruct *)calloc (1, sizeof (struct parBusStruct))) == NULL)
+    return NULL ;
+
+  bus->type       = type ;
+  bus->width      = width ;
+  bus->dataMask   = (1u << width) - 1 ;
+  bus->readNs     = PAR_READ_NS ;
+  bus->dmaChannel = -1 ;
+
+  memcpy (pins, dataPins, width * sizeof (int)) ;
+  n = width ;
+  bus->rsBit = 1u << n ; pins [n++] = rsPin ;
+  bus->wrBit = 1u << n ; pins [n++] = wrPin ;
+  if (rdPin >= 0) { bus->rdBit = 1u << n ; pins [n++] = rdPin ; }
+  if (csPin >= 0) { bus->csBit = 1u << n ; pins [n++] = csPin ; }
+
+// Idle: 8080 strobes high, 6800 E low and R/W left at write; not selected
+
+  bus->idle = bus->csBit ;
+  if (type == PAR_BUS_8080)
+    bus->idle |= bus->wrBit | bus->rdBit ;
+  bus->state = bus->idle ;
+
+  if (((bus->port = wiringPiPortOpen (pins, n))     == NULL) ||
+      ((bus->data = wiringPiPortOpen (pins, width)) == NULL))
+  {
+    parBusClose (bus) ;
+    errno = ENODEV ;
+    return NULL ;
+  }
+
+// The strobe's store on its own: WR up for 8080, E up (then down) for 6800
+
+  if (wpiPortMasks (bus->port, strobeBit (bus), set, clr) >= 0)
+  {
+    bus->fast       = TRUE ;
+    bus->strobeBank = (set [0] != 0) ? 0 : 1 ;
+    bus->strobeMask = set [bus->strobeBank] ;
+  }
+
+  wpiPortWrite (bus->port, bus->idle) ;
+  wpiPortMode  (bus->port, OUTPUT) ;
+
+  return bus ;
+}
+
+void parBusClose (parBus_t bus)
+{
+  if (bus == NULL)
+    return ;
+
+  (void)parBusDma (bus, -1) ;
+  wiringPiPortClose (bus->data) ;
+  wiringPiPortClose (bus->port) ;
+  free (bus) ;
+}
+
+
+/*
+ * parBusTiming:
+ *	Stretch the strobes: strobeNs is the least time a write strobe is
+ *	active for, readNs the time from RD (or E) going active to sampling
+ *	the data on a read.
+ *********************************************************************************
+ */
+
+void parBusTiming (parBus_t bus, unsigned int strobeNs, unsigned int readNs)
+{
+  bus->strobeNs = strobeNs ;
+  bus->readNs   = readNs ;
+}
+
+
+/*
+ * busStore: busStrobe:
+ *	Put the whole bus into a state, and pulse the strobe. Where the pins
+ *	are all on-board it's a masked store per bank; otherwise the port
+ *	gets written the slow way.
+ *********************************************************************************
+ */
+
+static void busStore (struct parBusStruct *bus, unsigned int state)
+{
+  unsigned int set [2], clr [2] ;
+  int b, banks ;
+
+  bus->state = state ;
+
+  if ((banks = wpiPortMasks (bus->port, state, set, clr)) < 0)
+  {
+    wpiPortWrite (bus->port, state) ;
+    return ;
+  }
+
+  for (b = 0 ; b < 2 ; ++b)
+    if ((banks & (1 << b)) != 0)
+      digitalWriteMask (b, set [b], clr [b]) ;
+}
+
+static void busStrobe (struct parBusStruct *bus, unsigned int state, int active)
+{
+  int on = (bus->type == PAR_BUS_8080) ? !active : active ;	// WR is active low, E high
+
+  if (bus->fast)
+    digitalWriteMask (bus->strobeBank, on ? bus->strobeMask : 0, on ? 0 : bus->strobeMask) ;
+  else
+    wpiPortWrite (bus->port, on ? (state | strobeBit (bus)) : (state & ~strobeBit (bus))) ;
+}
+
+
+/*
+ * cycleState: busCycle:
+ *	One write cycle of a value with RS (rs is 0 or rsBit). For 8080 the
+ *	first store takes WR low with the data, and the second latches it;
+ *	for 6800 E goes up and back down again (latching on the way down).
+ *	The chip must already be selected.
+ *********************************************************************************
+ */
+
+static inline unsigned int cycleState (struct parBusStruct *bus, unsigned int value, unsigned int rs)
+{
+  return (value & bus->dataMask) | rs | ((bus->type == PAR_BUS_8080) ? bus->rdBit : 0) ;
+}
+
+static void busCycle (struct parBusStruct *bus, unsigned int value, unsigned int rs)
+{
+  unsigned int state = cycleState (bus, value, rs) ;
+
+  if (bus->type == PAR_BUS_8080)
+  {
+    busStore (bus, state) ;
+    if (bus->strobeNs != 0)
+      delayNanoseconds (bus->strobeNs) ;
+    busStrobe (bus, state, FALSE) ;
+    bus->state = state | bus->wrBit ;
+  }
+  else
+  {
+    busStore  (bus, state) ;
+    busStrobe (bus, state, TRUE) ;
+    if (bus->strobeNs != 0)
+      delayNanoseconds (bus->strobeNs) ;
+    busStrobe (bus, state, FALSE) ;
+  }
+}
+
+
+/*
+ * parBusBegin: parBusEnd:
+ *	Select the chip until the matching parBusEnd. These nest. The data
+ *	and RS are left as the last cycle had them.
+ *********************************************************************************
+ */
+
+void parBusBegin (parBus_t bus)
+{
+  if ((bus->selected++ == 0) && (bus->csBit != 0))
+    busStore (bus, bus->state & ~bus->csBit) ;
+}
+
+void parBusEnd (parBus_t bus)
+{
+  if ((bus->selected > 0) && (--bus->selected == 0) && (bus->csBit != 0))
+    busStore (bus, bus->state | bus->csBit) ;
+}
+
+
+/*
+ * parBusCommand: parBusData:
+ *	Write one command (RS low) or one data value (RS high)
+ *********************************************************************************
+ */
+
+void parBusCommand (parBus_t bus, unsigned int cmd)
+{
+  parBusBegin (bus) ;
+    busCycle  (bus, cmd, 0) ;
+  parBusEnd   (bus) ;
+}
+
+void parBusData (parBus_t bus, unsigned int data)
+{
+  parBusBegin (bus) ;
+    busCycle  (bus, data, bus->rsBit) ;
+  parBusEnd   (bus) ;
+}
+
+
+/*
+ * parBusRead:
+ *	One read cycle, with RS high (rs TRUE) or low. The data pins are
+ *	inputs for the length of it. An 8080 bus without RD reads 0.
+ *********************************************************************************
+ */
+
+unsigned int parBusRead (parBus_t bus, int rs)
+{
+  unsigned int state, value ;
+
+  if ((bus->type == PAR_BUS_8080) && (bus->rdBit == 0))
+  {
+    errno = EINVAL ;
+    return 0 ;
+  }
+
+  parBusBegin (bus) ;
+  wpiPortMode (bus->data, INPUT) ;
+
+  state = (rs ? bus->rsBit : 0) | bus->wrBit ;	// 8080: WR up; 6800: R/W for read
+
+  if (bus->type == PAR_BUS_8080)
+  {
+    busStore (bus, state) ;			// RD down
+    delayNanoseconds (bus->readNs) ;
+    value = wpiPortRead (bus->data) ;
+    busStore (bus, state | bus->rdBit) ;		// RD up
+  }
+  else
+  {
+    busStore  (bus, state) ;
+    busStrobe (bus, state, TRUE) ;
+    delayNanoseconds (bus->readNs) ;
+    value = wpiPortRead (bus->data) ;
+    busStrobe (bus, state, FALSE) ;
+  }
+
+  wpiPortMode (bus->data, OUTPUT) ;
+  parBusEnd   (bus) ;
+
+  return value ;
+}
+
+
+/*
+ * element:
+ *	Value i of a pixel (or whatever) array: bytes for buses up to 8
+ *	bits wide, 16-bit words up to 16 and 32-bit words past that
+ *********************************************************************************
+ */
+
+static inline unsigned int element (struct parBusStruct *bus, const void *data, unsigned int i)
+{
+  /**/ if (bus->width <= 8)
+    return ((const uint8_t  *)data) [i] ;
+  else if (bus->width <= 16)
+    return ((const uint16_t *)data) [i] ;
+  else
+    return ((const uint32_t *)data) [i] ;
+}
+
+
+/*
+ * parBusDma:
+ *	Have parBusWrite and parBusFill use a DMA channel (-1 to stop). Set
+ *	up the control blocks for two chunks of cycles: per cycle a GPSET0
+ *	and a GPCLR0 store for the data, then the strobe - all that changes
+ *	from one write to the next is the data words.
+ *	Returns 0, or -1 if the pins or the Pi can't do it.
+ *********************************************************************************
+ */
+
+int parBusDma (parBus_t bus, int dmaChannel)
+{
+  struct dmaCbStruct *cb ;
+  unsigned int set [2], clr [2], size ;
+  int k, i, j ;
+
+  if (bus->dmaChannel != -1)
+  {
+    while (dmaBusy (bus->dmaChannel))
+      ;
+    dmaMemFree (&bus->mem) ;
+    bus->dmaChannel = -1 ;
+  }
+
+  if (dmaChannel < 0)
+    return 0 ;
+
+  if (!bus->fast || (wpiPortMasks (bus->port, 0, set, clr) != 1))	// Bank 0 only
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  bus->cbsPerCycle = (bus->type == PAR_BUS_8080) ? 3 : 4 ;
+  size = 2 * PAR_DMA_CYCLES * (bus->cbsPerCycle * sizeof (struct dmaCbStruct) + 2 * sizeof (uint32_t)) + sizeof (uint32_t) ;
+
+  if ((dmaChannelSetup (dmaChannel) < 0) || (dmaMemAlloc (&bus->mem, size) < 0))
+  {
+    errno = ENODEV ;
+    return -1 ;
+  }
+
+  cb = (struct dmaCbStruct *)bus->mem.virt ;
+  bus->cbs   [0] = cb ;
+  bus->cbs   [1] = cb + PAR_DMA_CYCLES * bus->cbsPerCycle ;
+  bus->words [0] = (uint32_t *)(cb + 2 * PAR_DMA_CYCLES * bus->cbsPerCycle) ;
+  bus->words [1] = bus->words [0] + 2 * PAR_DMA_CYCLES ;
+  bus->strobe    = bus->words [1] + 2 * PAR_DMA_CYCLES ;
+  *bus->strobe   = bus->strobeMask ;
+
+  for (k = 0 ; k < 2 ; ++k)
+  {
+    cb = bus->cbs [k] ;
+    for (i = 0 ; i < PAR_DMA_CYCLES ; ++i)
+    {
+      cb [0].src = dmaBusAddr (&bus->mem, &bus->words [k][2 * i]) ;
+      cb [0].dst = DMA_BUS_GPIO + GPSET0 ;
+      cb [1].src = dmaBusAddr (&bus->mem, &bus->words [k][2 * i + 1]) ;
+      cb [1].dst = DMA_BUS_GPIO + GPCLR0 ;
+      cb [2].src = dmaBusAddr (&bus->mem, bus->strobe) ;
+      cb [2].dst = DMA_BUS_GPIO + GPSET0 ;		// WR or E up
+      if (bus->cbsPerCycle == 4)
+      {
+	cb [3].src = dmaBusAddr (&bus->mem, bus->strobe) ;
+	cb [3].dst = DMA_BUS_GPIO + GPCLR0 ;		// E down
+      }
+      for (j = 0 ; j < bus->cbsPerCycle ; ++j, ++cb)
+      {
+	cb->info   = DMA_TI_NO_WIDE_BURSTS | DMA_TI_WAIT_RESP ;
+	cb->length = 4 ;
+	cb->stride = 0 ;
+	cb->next   = dmaBusAddr (&bus->mem, cb + 1) ;
+      }
+    }
+    (cb - 1)->next = 0 ;
+  }
+
+  bus->dmaChannel = dmaChannel ;
+  bus->cut [0]    = bus->cut [1] = NULL ;
+
+  return 0 ;
+}
+
+
+/*
+ * dmaCycles:
+ *	Run count data cycles through the DMA engine, filling one chunk
+ *	while the other one goes out
+ *********************************************************************************
+ */
+
+static void dmaCycles (struct parBusStruct *bus, const void *data, unsigned int value, unsigned int count)
+{
+  struct dmaCbStruct *last ;
+  unsigned int set [2], clr [2], done, n, i, v ;
+  uint32_t *w ;
+  int k = 0 ;
+
+  if (data == NULL)
+    (void)wpiPortMasks (bus->port, cycleState (bus, value, bus->rsBit), set, clr) ;
+
+  for (done = 0 ; done < count ; done += n, k ^= 1)
+  {
+    n = count - done ;
+    if (n > PAR_DMA_CYCLES)
+      n = PAR_DMA_CYCLES ;
+
+    w = bus->words [k] ;
+    for (i = 0 ; i < n ; ++i)
+    {
+      if (data != NULL)
+      {
+	v = element (bus, data, done + i) ;
+	(void)wpiPortMasks (bus->port, cycleState (bus, v, bus->rsBit), set, clr) ;
+      }
+      *w++ = set [0] ;
+      *w++ = clr [0] ;
+    }
+
+// Cut the chain short after the last cycle - putting back the cut from
+//	last time this chunk was used first
+
+    if (bus->cut [k] != NULL)
+      bus->cut [k]->next = dmaBusAddr (&bus->mem, bus->cut [k] + 1) ;
+    last = bus->cbs [k] + n * bus->cbsPerCycle - 1 ;
+    if (n < PAR_DMA_CYCLES)
+    {
+      last->next   = 0 ;
+      bus->cut [k] = last ;
+    }
+    else
+      bus->cut [k] = NULL ;
+
+    while (dmaBusy (bus->dmaChannel))
+      ;
+
+    __sync_synchronize () ;
+    dmaStart (bus->dmaChannel, dmaBusAddr (&bus->mem, bus->cbs [k])) ;
+  }
+
+  while (dmaBusy (bus->dmaChannel))
+    ;
+
+  if ((data != NULL) && (count != 0))
+    value = element (bus, data, count - 1) ;
+  bus->state = cycleState (bus, value, bus->rsBit) | ((bus->type == PAR_BUS_8080) ? bus->wrBit : 0) ;
+}
+
+
+/*
+ * parBusWrite:
+ * parBusFill:
+ *	Write count data cycles (RS high) from an array - uint8_t for buses
+ *	up to 8 bits wide, uint16_t up to 16 and uint32_t past that - or
+ *	all of the one value, with the chip selected for the lot.
+ *	Returns count.
+ *********************************************************************************
+ */
+
+static int busCycles (struct parBusStruct *bus, const void *data, unsigned int value, unsigned int count)
+{
+  unsigned int i ;
+
+  parBusBegin (bus) ;
+
+  if ((bus->dmaChannel != -1) && (bus->strobeNs == 0))
+  {
+    busStore  (bus, (bus->idle & ~bus->csBit) | bus->rsBit) ;	// Selected, RS up, strobe idle
+    dmaCycles (bus, data, value, count) ;
+  }
+  else if (data == NULL)
+    for (i = 0 ; i < count ; ++i)
+      busCycle (bus, value, bus->rsBit) ;
+  else
+    for (i = 0 ; i < count ; ++i)
+      busCycle (bus, element (bus, data, i), bus->rsBit) ;
+
+  parBusEnd (bus) ;
+
+  return (int)count ;
+}
+
+int parBusWrite (parBus_t bus, const void *data, unsigned int count)
+{
+  if (data == NULL)
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+  return busCycles (bus, data, 0, count) ;
+}
+
+int parBusFill (parBus_t bus, unsigned int value, unsigned int count)
+{
+  return busCycles (bus, NULL, value, count) ;
+}
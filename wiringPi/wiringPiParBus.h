@@ -0,0 +1,56 @@
+/*
+ * wiringPiParBus.h:
+ *	8080 and 6800 style parallel buses for displays
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+// Bus types: with 8080 the two strobes are WR and RD, both active low;
+//	with 6800 they're R/W (low to write) and E, active high.
+
+#define	PAR_BUS_8080		0
+#define	PAR_BUS_6800		1
+
+#define	PAR_BUS_MIN_WIDTH	4
+#define	PAR_BUS_MAX_WIDTH	24
+
+typedef struct parBusStruct *parBus_t ;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern parBus_t     parBusOpen    (int type, const int *dataPins, int width, int rsPin, int wrPin, int rdPin, int csPin) ;
+extern void         parBusClose   (parBus_t bus) ;
+extern void         parBusTiming  (parBus_t bus, unsigned int strobeNs, unsigned int readNs) ;
+extern int          parBusDma     (parBus_t bus, int dmaChannel) ;
+
+extern void         parBusBegin   (parBus_t bus) ;
+extern void         parBusEnd     (parBus_t bus) ;
+
+extern void         parBusCommand (parBus_t bus, unsigned int cmd) ;
+extern void         parBusData    (parBus_t bus, unsigned int data) ;
+extern unsigned int parBusRead    (parBus_t bus, int rs) ;
+extern int          parBusWrite   (parBus_t bus, const void *data, unsigned int count) ;
+extern int          parBusFill    (parBus_t bus, unsigned int value, unsigned int count) ;
+
+#ifdef __cplusplus
+}
+#endif
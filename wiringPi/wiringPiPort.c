@@ -0,0 +1,292 @@
+/*
+ * wiringPiPort.c:
+ *	Parallel ports over any list of pins
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+/*
+ * Notes:
+ *	A port is an ordered list of 4 to 32 pins written and read as one
+ *	value: bit 0 of the value is the first pin in the list. Unlike
+ *	digitalWriteByte the pins can be anywhere, and still each write is
+ *	one GPCLR and one GPSET store per GPIO bank the pins are in.
+ *
+ *	All the bit shuffling is done when the port is opened. For each byte
+ *	of the value there's a table of the GPSET and GPCLR masks each of its
+ *	256 values makes in each bank, so a write is a table load per byte
+ *	OR'd together; reads go the other way with a table per byte of each
+ *	GPLEV register the port has pins in, giving that byte's share of the
+ *	port value.
+ *
+ *	As with digitalWriteByte the clears go before the sets, so hardware
+ *	latching the bus must do so on a strobe of its own. Ports with pins
+ *	that aren't memory mapped (Sys mode, the simulator, extension nodes)
+ *	work a pin at a time instead.
+ *********************************************************************************
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "wiringPi.h"
+#include "wiringPiPort.h"
+
+#define	PORT_BANKS	2
+
+struct wpiPortStruct
+{
+  int          numPins ;
+  wpiPin_t     pins [WPI_PORT_MAX_PINS] ;
+  int          onBoard ;			// All the pins (so the tables are good)
+  int          slowWrite, slowRead ;
+
+// Per GPIO bank: the registers, and which bytes of GPLEV have port pins
+
+  unsigned int           banks ;			// Bit N: bank N in use
+  volatile unsigned int *set [PORT_BANKS], *clr [PORT_BANKS], *lev [PORT_BANKS] ;
+  unsigned int           levBytes [PORT_BANKS] ;	// Bit N: byte N
+
+// [value byte][byte value][bank] and [bank][GPLEV byte][byte value]
+
+  unsigned int setTab [4][256][PORT_BANKS] ;
+  unsigned int clrTab [4][256][PORT_BANKS] ;
+  unsigned int numBytes ;
+  unsigned int levTab [PORT_BANKS][4][256] ;
+} ;
+
+
+/*
+ * wiringPiPortOpen:
+ * wiringPiPortClose:
+ *	Make a port of the pins, and build its tables. As with the pin
+ *	handles it's tied to the wiringPi mode it's opened in. The pins'
+ *	modes are left alone - see wpiPortMode.
+ *	Returns NULL with errno set if a pin doesn't exist, or there are too
+ *	many or too few.
+ *********************************************************************************
+ */
+
+wpiPort_t wiringPiPortOpen (const int *pins, int numPins)
+{
+  struct wpiPortStruct *port ;
+  wpiPin_t h ;
+  unsigned int v, bit, mask ;
+  int i, b, byte ;
+
+  if ((pins == NULL) || (numPins < WPI_PORT_MIN_PINS) || (numPins > WPI_PORT_MAX_PINS))
+  {
+    errno = EINVAL ;
+    return NULL ;
+  }
+
+  if ((port = (struct wpiPortStruct *)calloc (1, sizeof (struct wpiPortStruct))) == NULL)
+    return NULL ;
+
+  port->numPins  = numPins ;
+  port->numBytes = (numPins + 7) / 8 ;
+  port->onBoard  = TRUE ;
+
+  for (i = 0 ; i < numPins ; ++i)
+  {
+    if ((h = port->pins [i] = wiringPiPinOpen (pins [i])) == NULL)
+    {
+      wiringPiPortClose (port) ;
+      errno = ENODEV ;
+      return NULL ;
+    }
+
+    if (h->set == NULL) port->slowWrite = TRUE ;
+    if (h->lev == NULL) port->slowRead  = TRUE ;
+
+    if (h->gpio < 0)
+    {
+      port->onBoard = FALSE ;
+      continue ;
+    }
+
+    b     = h->gpio >> 5 ;
+    mask  = 1u << (h->gpio & 31) ;
+    port->banks |= 1u << b ;
+    port->set [b] = h->set ;
+    port->clr [b] = h->clr ;
+    port->lev [b] = h->lev ;
+
+    byte = i / 8 ;
+    bit  = 1u << (i % 8) ;
+    for (v = 0 ; v < 256 ; ++v)
+      if ((v & bit) != 0)
+	port->setTab [byte][v][b] |= mask ;
+      else
+	port->clrTab [byte][v][b] |= mask ;
+
+    for (byte = 0 ; byte < 4 ; ++byte)
+    {
+      if ((mask & (0xFFu << (byte * 8))) == 0)
+	continue ;
+      port->levBytes [b] |= 1u << byte ;
+      for (v = 0 ; v < 256 ; ++v)
+	if (((v << (byte * 8)) & mask) != 0)
+	  port->levTab [b][byte][v] |= 1u << i ;
+    }
+  }
+
+  if (!port->onBoard)
+    port->slowWrite = port->slowRead = TRUE ;
+
+  return port ;
+}
+
+void wiringPiPortClose (wpiPort_t port)
+{
+  int i ;
+
+  if (port == NULL)
+    return ;
+
+  for (i = 0 ; i < port->numPins ; ++i)
+    if (port->pins [i] != NULL)
+      wiringPiPinClose (port->pins [i]) ;
+
+  free (port) ;
+}
+
+
+/*
+ * wpiPortMode:
+ *	Set all the pins in a port to INPUT or OUTPUT
+ *********************************************************************************
+ */
+
+void wpiPortMode (wpiPort_t port, int mode)
+{
+  int i ;
+
+  for (i = 0 ; i < port->numPins ; ++i)
+    pinMode (port->pins [i]->pin, mode) ;
+}
+
+
+/*
+ * wpiPortWrite:
+ *	Write a value to the port: the low numPins bits of it
+ *********************************************************************************
+ */
+
+void wpiPortWrite (wpiPort_t port, unsigned int value)
+{
+  unsigned int s, c, v0, v1, v2, v3 ;
+  int i, b ;
+
+  if (port->slowWrite)
+  {
+    for (i = 0 ; i < port->numPins ; ++i)
+      wpiPinWrite (port->pins [i], (value >> i) & 1) ;
+    return ;
+  }
+
+  v0 =  value        & 0xFF ;
+  v1 = (value >>  8) & 0xFF ;
+  v2 = (value >> 16) & 0xFF ;
+  v3 = (value >> 24) & 0xFF ;
+
+  for (b = 0 ; b < PORT_BANKS ; ++b)
+  {
+    if ((port->banks & (1u << b)) == 0)
+      continue ;
+
+    s = port->setTab [0][v0][b] ;
+    c = port->clrTab [0][v0][b] ;
+    if (port->numBytes > 1) { s |= port->setTab [1][v1][b] ; c |= port->clrTab [1][v1][b] ; }
+    if (port->numBytes > 2) { s |= port->setTab [2][v2][b] ; c |= port->clrTab [2][v2][b] ; }
+    if (port->numBytes > 3) { s |= port->setTab [3][v3][b] ; c |= port->clrTab [3][v3][b] ; }
+
+    if (c != 0) *port->clr [b] = c ;
+    if (s != 0) *port->set [b] = s ;
+  }
+}
+
+
+/*
+ * wpiPortMasks:
+ *	Work out the GPSET and GPCLR masks a value makes in each GPIO bank,
+ *	without writing them - for digitalWriteMask, waveforms and the like
+ *	that want to fold more pins into the same stores.
+ *	Returns a bit per bank with any port pins in it, or -1 if any of the
+ *	pins isn't on-board.
+ *********************************************************************************
+ */
+
+int wpiPortMasks (wpiPort_t port, unsigned int value, unsigned int set [2], unsigned int clr [2])
+{
+  unsigned int v, byte ;
+  int b ;
+
+  if (!port->onBoard)
+    return -1 ;
+
+  for (b = 0 ; b < PORT_BANKS ; ++b)
+  {
+    set [b] = clr [b] = 0 ;
+    for (byte = 0 ; byte < port->numBytes ; ++byte)
+    {
+      v = (value >> (byte * 8)) & 0xFF ;
+      set [b] |= port->setTab [byte][v][b] ;
+      clr [b] |= port->clrTab [byte][v][b] ;
+    }
+  }
+
+  return (int)port->banks ;
+}
+
+
+/*
+ * wpiPortRead:
+ *	Read the port's pins back as a value
+ *********************************************************************************
+ */
+
+unsigned int wpiPortRead (wpiPort_t port)
+{
+  unsigned int value = 0, lev, bytes ;
+  int i, b, byte ;
+
+  if (port->slowRead)
+  {
+    for (i = 0 ; i < port->numPins ; ++i)
+      if (wpiPinRead (port->pins [i]) != LOW)
+	value |= 1u << i ;
+    return value ;
+  }
+
+  for (b = 0 ; b < PORT_BANKS ; ++b)
+  {
+    if ((port->banks & (1u << b)) == 0)
+      continue ;
+    lev   = *port->lev [b] ;
+    bytes = port->levBytes [b] ;
+    for (byte = 0 ; bytes != 0 ; ++byte, bytes >>= 1)
+      if ((bytes & 1) != 0)
+	value |= port->levTab [b][byte][(lev >> (byte * 8)) & 0xFF] ;
+  }
+
+  return value ;
+}
@@ -0,0 +1,43 @@
+/*
+ * wiringPiPort.h:
+ *	Parallel ports over any list of pins
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#define	WPI_PORT_MIN_PINS	4
+#define	WPI_PORT_MAX_PINS	32
+
+typedef struct wpiPortStruct *wpiPort_t ;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern wpiPort_t    wiringPiPortOpen  (const int *pins, int numPins) ;
+extern void         wiringPiPortClose (wpiPort_t port) ;
+extern void         wpiPortWrite      (wpiPort_t port, unsigned int value) ;
+extern unsigned int wpiPortRead       (wpiPort_t port) ;
+extern void         wpiPortMode       (wpiPort_t port, int mode) ;
+extern int          wpiPortMasks      (wpiPort_t port, unsigned int value, unsigned int set [2], unsigned int clr [2]) ;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,427 @@
+/*
+ * wiringPiRP1.c:
+ *	The Raspberry Pi 5's GPIO and PWM, which are on the RP1
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+
+/*
+ * Notes:
+ *	The BCM2712 on the Pi 5 has no GPIO block where the older chips do.
+ *	The header pins are bank 0 of the RP1 I/O controller, at the far end
+ *	of PCIe, and each pin is set up in three places:
+ *	- IO_BANK0 has a control register per pin, whose FUNCSEL field says
+ *	  what drives it: one of the alternate functions, or SYS_RIO for
+ *	  plain input and output.
+ *	- SYS_RIO0 has one OUT, OE and SYNC_IN register for the bank, which
+ *	  do what GPSET/GPCLR, GPFSEL and GPLEV do on the BCM chips.
+ *	- PADS_BANK0 has a register per pad: the pulls, input enable, output
+ *	  disable and drive strength.
+ *	Every RP1 register also appears at +0x1000, +0x2000 and +0x3000 as an
+ *	atomic XOR, set and clear, so only the bits given change and there's
+ *	no read-modify-write. Stores to the set and clear aliases of OUT are
+ *	what digitalWrite uses, just as it uses GPSET and GPCLR. A field
+ *	(FUNCSEL, the pulls) is changed in one store to the XOR alias, so it
+ *	never passes through a value in between. Each pin has registers of
+ *	its own, so unlike GPFSEL and GPPUPPDN nothing needs the config locks.
+ *
+ *	The three blocks are in one 192KB window, which /dev/gpiomem0 hands
+ *	to anyone in the gpio group and /dev/mem to root. PWM0 is elsewhere
+ *	and needs /dev/mem. Its clock belongs to the kernel, so it only runs
+ *	once something has turned it on - the pwm-2chan overlay, say.
+ *********************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "wiringPi.h"
+#include "wiringPiRP1.h"
+
+// The RP1's peripherals, as the BCM2712 sees them over PCIe
+
+#define	RP1_PERI_BASE	0x1F00000000ULL
+#define	RP1_GPIO_OFFSET	0x000D0000	// IO_BANK0, then SYS_RIO0 and PADS_BANK0
+#define	RP1_GPIO_SIZE	0x00030000
+#define	RP1_PWM0_OFFSET	0x00098000
+#define	RP1_PWM_SIZE	0x00004000	// With the aliases
+
+// Word offsets of the blocks in the GPIO window
+
+#define	RP1_IO_BANK0	(0x00000 / 4)
+#define	RP1_SYS_RIO0	(0x10000 / 4)
+#define	RP1_PADS_BANK0	(0x20000 / 4)
+
+// IO_BANK0: a status and a control word per pin
+
+#define	RP1_IO_CTRL(pin)	((pin) * 2 + 1)
+#define	RP1_FUNCSEL_MASK	0x1F
+#define	RP1_FUNCSEL_RIO		5
+
+// PADS_BANK0: the voltage select, then a word per pin
+
+#define	RP1_PADS(pin)		((pin) + 1)
+#define	RP1_PAD_PDE		(1 << 2)
+#define	RP1_PAD_PUE		(1 << 3)
+#define	RP1_PAD_IE		(1 << 6)
+#define	RP1_PAD_OD		(1 << 7)
+
+// PWM0: global control, then four words per channel
+
+#define	RP1_PWM_GLOBAL		0
+#define	RP1_PWM_CTRL(ch)	(5 + (ch) * 4)
+#define	RP1_PWM_RANGE(ch)	(6 + (ch) * 4)
+#define	RP1_PWM_DUTY(ch)	(8 + (ch) * 4)
+
+#define	RP1_PWM_UPDATE		(1u << 31)	// In GLOBAL: latch the new settings
+#define	RP1_PWM_MODE_MASK	0x07
+#define	RP1_PWM_MODE_MS		1		// Trailing-edge mark:space
+#define	RP1_PWM_MODE_PDM	3		// Pulse density, to stand in for balanced
+#define	RP1_PWM_INVERT		(1 << 3)
+#define	RP1_PWM_POP_MASK	(1 << 8)	// Don't wait on the FIFO
+
+volatile unsigned int *rp1Rio ;
+
+static volatile unsigned int *rp1Io ;
+static volatile unsigned int *rp1Pads ;
+static volatile unsigned int *rp1Pwm ;
+
+static int             memFd = -1 ;		// /dev/mem, if we have it, for PWM0
+static pthread_mutex_t rp1PwmLock = PTHREAD_MUTEX_INITIALIZER ;
+
+// BCM GPFSEL values to RP1 functions and back: ALT0-4 are a0-a4. There's
+//	no ALT5 as a5 is SYS_RIO.
+
+#define	BCM_FSEL_INPT	0
+#define	BCM_FSEL_OUTP	1
+
+static const int bcmToRp1 [8] = { -1, -1, -1, 4, 0, 1, 2, 3 } ;
+static const int rp1ToBcm [5] = {  4,  5,  6, 7, 3 } ;
+
+// The PWM pins: GPIO 12 and 13 on a0, 18 and 19 on a3
+
+static const struct { int pin, func ; } rp1PwmPins [4] = { { 12, 0 }, { 13, 0 }, { 18, 3 }, { 19, 3 } } ;
+
+
+/*
+ * rp1Setup:
+ *	Map the GPIO window: through /dev/mem if we can, so PWM0 can be had
+ *	later on, otherwise /dev/gpiomem0 and *gpioMem is set to say so.
+ *	Returns 0 or -1 with errno set.
+ *********************************************************************************
+ */
+
+int rp1Setup (unsigned int *gpioMem)
+{
+  volatile unsigned int *map ;
+  int fd ;
+
+  *gpioMem = FALSE ;
+
+  if ((fd = open ("/dev/mem", O_RDWR | O_SYNC | O_CLOEXEC)) >= 0)
+  {
+    map = (volatile unsigned int *)mmap64 (NULL, RP1_GPIO_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, (off64_t)(RP1_PERI_BASE + RP1_GPIO_OFFSET)) ;
+    memFd = fd ;
+  }
+  else if ((fd = open ("/dev/gpiomem0", O_RDWR | O_SYNC | O_CLOEXEC)) >= 0)
+  {
+    map = (volatile unsigned int *)mmap (NULL, RP1_GPIO_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) ;
+    close (fd) ;
+    *gpioMem = TRUE ;
+  }
+  else
+    return -1 ;
+
+  if (map == MAP_FAILED)
+    return -1 ;
+
+  rp1Io   = map + RP1_IO_BANK0 ;
+  rp1Rio  = map + RP1_SYS_RIO0 ;
+  rp1Pads = map + RP1_PADS_BANK0 ;
+
+  return 0 ;
+}
+
+
+/*
+ * rp1FuncSel:
+ *	Hand a pin to a function, with its pad enabled as an input and not
+ *	disabled as an output - the pad's reset state has the output off.
+ *********************************************************************************
+ */
+
+static void rp1FuncSel (int pin, int func)
+{
+  unsigned int ctrl ;
+
+  *(rp1Pads + RP1_CLR + RP1_PADS (pin)) = RP1_PAD_OD ;
+  *(rp1Pads + RP1_SET + RP1_PADS (pin)) = RP1_PAD_IE ;
+
+  ctrl = *(rp1Io + RP1_IO_CTRL (pin)) ;
+  if ((ctrl & RP1_FUNCSEL_MASK) != (unsigned int)func)
+    *(rp1Io + RP1_XOR + RP1_IO_CTRL (pin)) = (ctrl ^ func) & RP1_FUNCSEL_MASK ;
+}
+
+
+/*
+ * rp1PinMode:
+ * rp1PinModeAlt:
+ *	INPUT or OUTPUT through SYS_RIO, or a BCM style FSEL_ALTn, for a
+ *	BCM_GPIO pin. Anything past bank 0 is ignored.
+ *********************************************************************************
+ */
+
+void rp1PinMode (int pin, int mode)
+{
+  if ((pin < 0) || (pin >= RP1_GPIO_PINS))
+    return ;
+
+  /**/ if (mode == INPUT)
+  {
+    *(rp1Rio + RP1_CLR + RP1_RIO_OE) = 1u << pin ;
+    rp1FuncSel (pin, RP1_FUNCSEL_RIO) ;
+  }
+  else if (mode == OUTPUT)
+  {
+    rp1FuncSel (pin, RP1_FUNCSEL_RIO) ;
+    *(rp1Rio + RP1_SET + RP1_RIO_OE) = 1u << pin ;
+  }
+}
+
+void rp1PinModeAlt (int pin, int alt)
+{
+  if ((pin < 0) || (pin >= RP1_GPIO_PINS))
+    return ;
+
+  /**/ if (alt == BCM_FSEL_INPT)
+    rp1PinMode (pin, INPUT) ;
+  else if (alt == BCM_FSEL_OUTP)
+    rp1PinMode (pin, OUTPUT) ;
+  else if (bcmToRp1 [alt & 7] >= 0)
+    rp1FuncSel (pin, bcmToRp1 [alt & 7]) ;
+}
+
+
+/*
+ * rp1GetAlt:
+ *	What a pin's doing, as the BCM GPFSEL value getAlt () would return.
+ *	a5-a8 and the NULL function read as an input.
+ *********************************************************************************
+ */
+
+int rp1GetAlt (int pin)
+{
+  int func ;
+
+  if ((pin < 0) || (pin >= RP1_GPIO_PINS))
+    return BCM_FSEL_INPT ;
+
+  func = *(rp1Io + RP1_IO_CTRL (pin)) & RP1_FUNCSEL_MASK ;
+
+  /**/ if (func == RP1_FUNCSEL_RIO)
+    return ((*(rp1Rio + RP1_RIO_OE) & (1u << pin)) != 0) ? BCM_FSEL_OUTP : BCM_FSEL_INPT ;
+  else if (func < 5)
+    return rp1ToBcm [func] ;
+  else
+    return BCM_FSEL_INPT ;
+}
+
+
+/*
+ * rp1PullUpDnControl:
+ *	Set a pad's pull-up and pull-down enables in one store
+ *********************************************************************************
+ */
+
+void rp1PullUpDnControl (int pin, int pud)
+{
+  unsigned int want, pad ;
+
+  if ((pin < 0) || (pin >= RP1_GPIO_PINS))
+    return ;
+
+  /**/ if (pud == PUD_OFF)
+    want = 0 ;
+  else if (pud == PUD_DOWN)
+    want = RP1_PAD_PDE ;
+  else if (pud == PUD_UP)
+    want = RP1_PAD_PUE ;
+  else
+    return ;
+
+  pad = *(rp1Pads + RP1_PADS (pin)) ;
+  if (((pad ^ want) & (RP1_PAD_PUE | RP1_PAD_PDE)) != 0)
+    *(rp1Pads + RP1_XOR + RP1_PADS (pin)) = (pad ^ want) & (RP1_PAD_PUE | RP1_PAD_PDE) ;
+}
+
+
+/*
+ * rp1PwmChannel:
+ * rp1PwmPin:
+ *	The PWM0 channel of a BCM_GPIO pin, or -1 if it hasn't got one - and
+ *	connect the pin to it.
+ *********************************************************************************
+ */
+
+int rp1PwmChannel (int pin)
+{
+  int channel ;
+
+  for (channel = 0 ; channel < 4 ; ++channel)
+    if (rp1PwmPins [channel].pin == pin)
+      return channel ;
+
+  return -1 ;
+}
+
+int rp1PwmPin (int pin)
+{
+  int channel ;
+
+  if ((channel = rp1PwmChannel (pin)) >= 0)
+    rp1FuncSel (pin, rp1PwmPins [channel].func) ;
+
+  return channel ;
+}
+
+
+/*
+ * rp1PwmCheck:
+ *	Map PWM0 the first time it's wanted. Returns NULL with errno set if
+ *	the channel is no good or we've not got /dev/mem.
+ *********************************************************************************
+ */
+
+static volatile unsigned int *rp1PwmCheck (int channel)
+{
+  void *map ;
+
+  if ((channel < 0) || (channel > 3))
+  {
+    errno = EINVAL ;
+    return NULL ;
+  }
+
+  if (rp1Pwm != NULL)
+    return rp1Pwm ;
+
+  if (memFd < 0)
+  {
+    errno = EACCES ;
+    return NULL ;
+  }
+
+  pthread_mutex_lock (&rp1PwmLock) ;
+    if (rp1Pwm == NULL)
+    {
+      map = mmap64 (NULL, RP1_PWM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, memFd, (off64_t)(RP1_PERI_BASE + RP1_PWM0_OFFSET)) ;
+      if (map != MAP_FAILED)
+	rp1Pwm = (volatile unsigned int *)map ;
+    }
+  pthread_mutex_unlock (&rp1PwmLock) ;
+
+  return rp1Pwm ;
+}
+
+
+/*
+ * rp1PwmSetMode: rp1PwmSetPolarity: rp1PwmEnable:
+ * rp1PwmSetRange: rp1PwmWrite:
+ *	The per-channel PWM calls. New settings don't reach the output until
+ *	the UPDATE bit is set, and then they all go together.
+ *	PWM_MODE_BAL is the RP1's pulse density mode, which spreads the high
+ *	time out over the range much as the BCM's balanced mode does.
+ *	Return 0 or -1 with errno set.
+ *********************************************************************************
+ */
+
+int rp1PwmSetMode (int channel, int mode)
+{
+  volatile unsigned int *pwm ;
+  unsigned int was, ctrl ;
+
+  if ((pwm = rp1PwmCheck (channel)) == NULL)
+    return -1 ;
+
+  was  = *(pwm + RP1_PWM_CTRL (channel)) ;
+  ctrl = (was & ~RP1_PWM_MODE_MASK) | RP1_PWM_POP_MASK | ((mode == PWM_MODE_MS) ? RP1_PWM_MODE_MS : RP1_PWM_MODE_PDM) ;
+  *(pwm + RP1_XOR + RP1_PWM_CTRL (channel)) = was ^ ctrl ;
+
+  *(pwm + RP1_SET + RP1_PWM_GLOBAL) = RP1_PWM_UPDATE ;
+  return 0 ;
+}
+
+int rp1PwmSetPolarity (int channel, int invert)
+{
+  volatile unsigned int *pwm ;
+
+  if ((pwm = rp1PwmCheck (channel)) == NULL)
+    return -1 ;
+
+  *(pwm + (invert ? RP1_SET : RP1_CLR) + RP1_PWM_CTRL (channel)) = RP1_PWM_INVERT ;
+
+  *(pwm + RP1_SET + RP1_PWM_GLOBAL) = RP1_PWM_UPDATE ;
+  return 0 ;
+}
+
+int rp1PwmEnable (int channel, int enable)
+{
+  volatile unsigned int *pwm ;
+
+  if ((pwm = rp1PwmCheck (channel)) == NULL)
+    return -1 ;
+
+  *(pwm + (enable ? RP1_SET : RP1_CLR) + RP1_PWM_GLOBAL) = 1u << channel ;
+
+  *(pwm + RP1_SET + RP1_PWM_GLOBAL) = RP1_PWM_UPDATE ;
+  return 0 ;
+}
+
+int rp1PwmSetRange (int channel, unsigned int range)
+{
+  volatile unsigned int *pwm ;
+
+  if ((pwm = rp1PwmCheck (channel)) == NULL)
+    return -1 ;
+
+  *(pwm + RP1_PWM_RANGE (channel)) = range ;
+
+  *(pwm + RP1_SET + RP1_PWM_GLOBAL) = RP1_PWM_UPDATE ;
+  return 0 ;
+}
+
+int rp1PwmWrite (int channel, unsigned int value)
+{
+  volatile unsigned int *pwm ;
+
+  if ((pwm = rp1PwmCheck (channel)) == NULL)
+    return -1 ;
+
+  *(pwm + RP1_PWM_DUTY (channel)) = value ;
+
+  *(pwm + RP1_SET + RP1_PWM_GLOBAL) = RP1_PWM_UPDATE ;
+  return 0 ;
+}
@@ -0,0 +1,63 @@
+/*
+ * wiringPiRP1.h:
+ *	The Raspberry Pi 5's GPIO and PWM, which are on the RP1
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+// Bank 0 is the only one that reaches the header: GPIO 0-27
+
+#define	RP1_GPIO_PINS	28
+
+// Word offsets of the atomic aliases every RP1 register has
+
+#define	RP1_XOR		(0x1000 / 4)
+#define	RP1_SET		(0x2000 / 4)
+#define	RP1_CLR		(0x3000 / 4)
+
+// SYS_RIO0 registers
+
+#define	RP1_RIO_OUT	0
+#define	RP1_RIO_OE	1
+#define	RP1_RIO_IN	2		// SYNC_IN
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern volatile unsigned int *rp1Rio ;
+
+extern int  rp1Setup        (unsigned int *gpioMem) ;
+extern void rp1PinMode      (int pin, int mode) ;
+extern void rp1PinModeAlt   (int pin, int alt) ;
+extern int  rp1GetAlt       (int pin) ;
+extern void rp1PullUpDnControl (int pin, int pud) ;
+
+extern int  rp1PwmChannel   (int pin) ;
+extern int  rp1PwmPin       (int pin) ;
+extern int  rp1PwmSetMode   (int channel, int mode) ;
+extern int  rp1PwmSetPolarity (int channel, int invert) ;
+extern int  rp1PwmEnable    (int channel, int enable) ;
+extern int  rp1PwmSetRange  (int channel, unsigned int range) ;
+extern int  rp1PwmWrite     (int channel, unsigned int value) ;
+
+#ifdef __cplusplus
+}
+#endif
@@ -26,28 +26,364 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <string.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
+#include <sys/eventfd.h>
 #include <asm/ioctl.h>
 #include <linux/spi/spidev.h>
 
 #include "wiringPi.h"
 
 #include "wiringPiSPI.h"
+#include "wiringPiSim.h"
+#include "wiringPiTrace.h"
+#include "piThread.h"
 
 
 // The SPI bus parameters
 //	Variables as they need to be passed as pointers later on
+//
+//	Each device (/dev/spidevB.C - bus B, chip-select C) has its own fd,
+//	mode and speed. The mode belongs to the fd and the speed goes into
+//	every transfer, so devices sharing a bus don't upset each other.
+//	Each bus has a lock which is held for exactly one transaction: the
+//	kernel won't interleave messages, but this also protects our tables
+//	against a device being set up or closed in the middle of a transfer.
+//	Different buses never share a lock.
 
 //static const char       *spiDev0  = "/dev/spidev0.0" ;
 //static const char       *spiDev1  = "/dev/spidev0.1" ;
 static const uint8_t     spiBPW   = 8 ;
 static const uint16_t    spiDelay = 0 ;
 
-static uint32_t    spiSpeeds [2] ;
-static int         spiFds [2] ;
+static uint32_t    spiSpeeds [WPI_SPI_MAX_BUS][WPI_SPI_MAX_CHANNEL] ;
+static int         spiFds    [WPI_SPI_MAX_BUS][WPI_SPI_MAX_CHANNEL] =
+{
+  { -1, -1, -1 }, { -1, -1, -1 }, { -1, -1, -1 }, { -1, -1, -1 },
+  { -1, -1, -1 }, { -1, -1, -1 }, { -1, -1, -1 },
+} ;
+
+// The bus locks are priority inheritance mutexes, so a real-time thread
+//	waiting on a bus isn't held up behind a lower priority one that has
+//	it and has been pre-empted.
+
+static pthread_mutex_t spiBusLocks [WPI_SPI_MAX_BUS] ;
+
+// Bus statistics slots, plus one so that zero is none
+
+static int         spiSlots  [WPI_SPI_MAX_BUS][WPI_SPI_MAX_CHANNEL] ;
+static pthread_once_t  spiLockOnce = PTHREAD_ONCE_INIT ;
+
+
+// Asynchronous requests: a queue and a worker thread per bus
+
+//	With wiringPiSPIxDoneFd, requests with no callback are handed back
+//	on the done list and the eventfd's bumped, for an event loop.
+
+struct spiQueueStruct
+{
+  struct wpiSpiRequest *head, *tail ;
+  pthread_mutex_t       lock ;
+  pthread_cond_t        work ;
+  int                   running ;
+  int                   doneFd ;	// -1 until asked for
+  struct wpiSpiRequest *doneHead, *doneTail ;
+} ;
+
+static struct spiQueueStruct spiQueues [WPI_SPI_MAX_BUS] ;
+static pthread_once_t        spiQueueOnce = PTHREAD_ONCE_INIT ;
+
+
+// GPIO chip selects
+//	These devices go out through the /dev/spidevB.C they're set up on
+//	(the carrier) in SPI_NO_CS mode, so the kernel leaves its CE line
+//	alone and we drive our own chip select around each transfer. All
+//	the devices on a carrier share one fd, with the mode changed to suit
+//	each device as needed - so don't use the carrier as a device itself.
+//	A decoder chip select is a binary address on up to 8 pins, with
+//	an idle address for no device selected; a plain GPIO chip select is
+//	just a 1-pin decoder with an address of 0 and idle of 1.
+
+struct spiCsStruct
+{
+  int          used ;
+  int          opened ;		// By wiringPiSPISetup
+  int          bus, carrier ;
+  uint8_t      mode ;
+  uint32_t     speed ;
+  int          slot ;		// Bus statistics, or -1
+
+  int          numPins ;
+  wpiPin_t     pins [WPI_SPI_MAX_CS_PINS] ;
+  unsigned int address, idle ;
+
+// With all the pins memory mapped, selecting is a store to GPSET and/or
+//	GPCLR in each bank used
+
+  int                    mapped ;
+  volatile unsigned int *set [2], *clr [2] ;
+  unsigned int           setMask [2][2], clrMask [2][2] ;	// [selected][bank]
+} ;
+
+static struct spiCsStruct spiCs [WPI_SPI_MAX_GPIO_CS] ;
+static int                spiCsFds   [WPI_SPI_MAX_BUS][WPI_SPI_MAX_CHANNEL] =
+{
+  { -1, -1, -1 }, { -1, -1, -1 }, { -1, -1, -1 }, { -1, -1, -1 },
+  { -1, -1, -1 }, { -1, -1, -1 }, { -1, -1, -1 },
+} ;
+static uint8_t            spiCsModes [WPI_SPI_MAX_BUS][WPI_SPI_MAX_CHANNEL] ;
+static int                spiCsUsers [WPI_SPI_MAX_BUS][WPI_SPI_MAX_CHANNEL] ;
+static pthread_mutex_t    spiCsLock = PTHREAD_MUTEX_INITIALIZER ;
+
+static int csTransfer (int channel, const struct wpiSpiSeg *segs, int numSegs) ;
+
+
+// Direct SPI0
+//	With wiringPiSPIDirect () a channel of SPI0 can skip spidev for short
+//	transfers: we drive the controller's FIFO ourselves, polled, with the
+//	bus lock held. The kernel still owns the controller, and does the long
+//	transfers - it sets up the clock divider for each one, so we learn the
+//	divider for a speed from what it leaves in CLK after the first.
+//	Chip select is the controller's own if CE0/CE1 are on ALT0, or if the
+//	kernel's using them as GPIO chip selects (cs-gpios) we set and clear
+//	the GPIO ourselves.
+
+#define	SPI0_OFFSET		0x204000
+#define	GPIO_OFFSET		0x200000
+
+#define	SPI_CS			0
+#define	SPI_FIFO		1
+#define	SPI_CLK			2
+#define	SPI_DLEN		3
+
+#define	SPI_CS_CPHA		0x00000004
+#define	SPI_CS_CPOL		0x00000008
+#define	SPI_CS_CLEAR		0x00000030
+#define	SPI_CS_TA		0x00000080
+#define	SPI_CS_DONE		0x00010000
+#define	SPI_CS_RXD		0x00020000
+#define	SPI_CS_TXD		0x00040000
+
+#define	SPI_FIFO_SIZE		64
+
+struct spiDirectStruct
+{
+  int          on ;
+  uint32_t     speed ;		// The last speed the kernel ran at ...
+  uint32_t     cdiv ;		// ... and its clock divider, 0 until then
+  int          gpioCs ;		// BCM_GPIO of a kernel GPIO chip select, or -1
+} ;
+
+static const int spiCePins [2] = { 8, 7 } ;	// CE0, CE1
+
+static struct spiDirectStruct  spiDirect [2] ;
+static volatile unsigned int  *spi0 ;
+static uint8_t                 spiModes [WPI_SPI_MAX_BUS][WPI_SPI_MAX_CHANNEL] ;
+
+/*
+ * spiOpen: spiSet: spiMessage:
+ *	Open a spidev, change a setting and run a message on it - or, when
+ *	simulating, pretend to: there's only /dev/null to open.
+ *********************************************************************************
+ */
+
+static int spiOpen (const char *device)
+{
+  return open (wiringPiSimActive () ? "/dev/null" : device, O_RDWR | O_CLOEXEC) ;
+}
+
+static int spiSet (int fd, unsigned long request, const void *value)
+{
+  return wiringPiSimActive () ? 0 : ioctl (fd, request, value) ;
+}
+
+static int spiMessage (int fd, int n, struct spi_ioc_transfer *spi)
+{
+  if (wiringPiSimActive ())
+    return simSpiTransfer (spi, n) ;
+  return ioctl (fd, SPI_IOC_MESSAGE(n), spi) ;
+}
+
+
+/*
+ * statsSlot: segBytes:
+ *	Get the bus statistics slot for a device, and count the bytes in a
+ *	list of segments.
+ *********************************************************************************
+ */
+
+static int statsSlot (int bus, int channel)
+{
+  char name [16] ;
+
+  snprintf (name, sizeof (name), "spi%d", bus) ;
+
+  return wiringPiBusStatsSlot (WPI_BUS_SPI, name, channel) ;
+}
+
+static unsigned int segBytes (const struct wpiSpiSeg *segs, int numSegs)
+{
+  unsigned int bytes = 0 ;
+  int i ;
+
+  for (i = 0 ; i < numSegs ; ++i)
+    bytes += segs [i].len ;
+
+  return bytes ;
+}
+
+/*
+ * spiLockInit:
+ *********************************************************************************
+ */
+
+static void spiLockInit (void)
+{
+  int bus ;
+
+  for (bus = 0 ; bus < WPI_SPI_MAX_BUS ; ++bus)
+    piMutexInit (&spiBusLocks [bus], PI_LOCK_PI, FALSE) ;
+}
+
+
+/*
+ * spiValid:
+ *	Check a bus/channel pair
+ *********************************************************************************
+ */
+
+static int spiValid (int bus, int channel)
+{
+  if ((bus < 0) || (bus >= WPI_SPI_MAX_BUS) || (channel < 0) || (channel >= WPI_SPI_MAX_CHANNEL))
+  {
+    errno = EINVAL ;
+    return FALSE ;
+  }
+  return TRUE ;
+}
+
+
+/*
+ * directFits: directCalibrate: directTransfer:
+ *	See if a transaction can go the direct way, learn the clock divider
+ *	from the kernel after one that didn't, and run one that can.
+ *	All with the bus lock held.
+ *********************************************************************************
+ */
+
+static int directFits (int bus, int channel, const struct wpiSpiSeg *segs, int numSegs)
+{
+  struct spiDirectStruct *d ;
+  int i ;
+
+  if ((bus != 0) || (channel > 1) || !spiDirect [channel].on)
+    return FALSE ;
+
+  d = &spiDirect [channel] ;
+  if (d->cdiv == 0)
+    return FALSE ;
+
+  if (segBytes (segs, numSegs) > WPI_SPI_DIRECT_MAX)
+    return FALSE ;
+
+  for (i = 0 ; i < numSegs ; ++i)
+  {
+    if (segs [i].delayUs != 0)
+      return FALSE ;
+    if (segs [i].csChange && (i != numSegs - 1))
+      return FALSE ;
+    if (((segs [i].speedHz == 0) ? spiSpeeds [0][channel] : segs [i].speedHz) != d->speed)
+      return FALSE ;
+  }
+
+  return TRUE ;
+}
+
+static void directCalibrate (int bus, int channel, const struct wpiSpiSeg *segs, int numSegs)
+{
+  struct spiDirectStruct *d ;
+  const struct wpiSpiSeg *last ;
+
+  if ((bus != 0) || (channel > 1) || !spiDirect [channel].on)
+    return ;
+
+  d    = &spiDirect [channel] ;
+  last = &segs [numSegs - 1] ;
+
+  d->speed = (last->speedHz == 0) ? spiSpeeds [0][channel] : last->speedHz ;
+  d->cdiv  = *(spi0 + SPI_CLK) & 0xFFFF ;
+  if (d->cdiv == 0)				// 0 is 65536, the slowest
+    d->cdiv = 65536 ;
+}
+
+static int directTransfer (int channel, const struct wpiSpiSeg *segs, int numSegs)
+{
+  struct spiDirectStruct *d = &spiDirect [channel] ;
+  uint32_t cs ;
+  unsigned int total, sent, got, segTx, segRx ;
+  int txSeg, rxSeg ;
+  uint8_t byte ;
+
+  total = segBytes (segs, numSegs) ;
+  if (total == 0)
+    return 0 ;
+
+  cs = channel | (((spiModes [0][channel] & 1) != 0) ? SPI_CS_CPHA : 0) | (((spiModes [0][channel] & 2) != 0) ? SPI_CS_CPOL : 0) ;
+
+  if (d->gpioCs >= 0)
+    *(_wiringPiGpio + 10) = 1 << d->gpioCs ;	// GPCLR0
+
+  __sync_synchronize () ;
+  *(spi0 + SPI_CLK) = d->cdiv & 0xFFFF ;
+  *(spi0 + SPI_CS)  = cs | SPI_CS_CLEAR ;
+  *(spi0 + SPI_CS)  = cs | SPI_CS_TA ;
+
+// Keep the FIFO topped up while draining it: never more than a FIFO's
+//	worth in flight, so nothing gets lost on the receive side.
+
+  sent = got = 0 ;
+  txSeg = rxSeg = 0 ;
+  segTx = segRx = 0 ;
+
+  while (got < total)
+  {
+    while ((sent < total) && (sent - got < SPI_FIFO_SIZE) && ((*(spi0 + SPI_CS) & SPI_CS_TXD) != 0))
+    {
+      while (segTx == segs [txSeg].len)
+        { ++txSeg ; segTx = 0 ; }
+      *(spi0 + SPI_FIFO) = (segs [txSeg].tx == NULL) ? 0 : ((const uint8_t *)segs [txSeg].tx) [segTx] ;
+      ++segTx ;
+      ++sent ;
+    }
+
+    while ((got < sent) && ((*(spi0 + SPI_CS) & SPI_CS_RXD) != 0))
+    {
+      while (segRx == segs [rxSeg].len)
+        { ++rxSeg ; segRx = 0 ; }
+      byte = *(spi0 + SPI_FIFO) & 0xFF ;
+      if (segs [rxSeg].rx != NULL)
+        ((uint8_t *)segs [rxSeg].rx) [segRx] = byte ;
+      ++segRx ;
+      ++got ;
+    }
+  }
+
+  while ((*(spi0 + SPI_CS) & SPI_CS_DONE) == 0)
+    ;
+
+  *(spi0 + SPI_CS) = cs ;
+  __sync_synchronize () ;
+
+  if (d->gpioCs >= 0)
+    *(_wiringPiGpio + 7) = 1 << d->gpioCs ;	// GPSET0
+
+  return (int)total ;
+}
 
 
 /*
@@ -56,9 +392,25 @@ static int         spiFds [2] ;
  *********************************************************************************
  */
 
+int wiringPiSPIxGetFd (int bus, int channel)
+{
+  if (!spiValid (bus, channel))
+    return -1 ;
+
+  return spiFds [bus][channel] ;
+}
+
 int wiringPiSPIGetFd (int channel)
 {
-  return spiFds [channel & 1] ;
+  struct spiCsStruct *cs ;
+
+  if (WPI_SPI_IS_GPIO_CS (channel))
+  {
+    cs = &spiCs [channel - WPI_SPI_GPIO_CS_BASE] ;
+    return cs->opened ? spiCsFds [cs->bus][cs->carrier] : -1 ;
+  }
+
+  return wiringPiSPIxGetFd (WPI_SPI_BUS (channel), WPI_SPI_CS (channel)) ;
 }
 
 
@@ -71,25 +423,195 @@ int wiringPiSPIGetFd (int channel)
  *********************************************************************************
  */
 
+WPI_TRACE_SEMAPHORE (spi) ;
+
+int wiringPiSPIxDataRW (int bus, int channel, unsigned char *data, int len)
+{
+  struct wpiSpiSeg seg ;
+  int result ;
+  WPI_TRACE_BEGIN (spi) ;
+
+  memset (&seg, 0, sizeof (seg)) ;
+
+  seg.tx      = data ;
+  seg.rx      = data ;
+  seg.len     = len ;
+  seg.delayUs = spiDelay ;
+
+  result = wiringPiSPIxTransfer (bus, channel, &seg, 1) ;
+
+  WPI_TRACE_END (spi, (bus << 4) | channel, len, result) ;
+
+  return result ;
+}
+
 int wiringPiSPIDataRW (int channel, unsigned char *data, int len)
 {
-  struct spi_ioc_transfer spi ;
+  struct wpiSpiSeg seg ;
 
-  channel &= 1 ;
+  if (WPI_SPI_IS_GPIO_CS (channel))
+  {
+    memset (&seg, 0, sizeof (seg)) ;
+    seg.tx  = data ;
+    seg.rx  = data ;
+    seg.len = len ;
+    return csTransfer (channel, &seg, 1) ;
+  }
 
-// Mentioned in spidev.h but not used in the original kernel documentation
-//	test program )-:
+  return wiringPiSPIxDataRW (WPI_SPI_BUS (channel), WPI_SPI_CS (channel), data, len) ;
+}
 
-  memset (&spi, 0, sizeof (spi)) ;
 
-  spi.tx_buf        = (unsigned long)data ;
-  spi.rx_buf        = (unsigned long)data ;
-  spi.len           = len ;
-  spi.delay_usecs   = spiDelay ;
-  spi.speed_hz      = spiSpeeds [channel] ;
-  spi.bits_per_word = spiBPW ;
+/*
+ * fillTransfer:
+ *	Fill in one kernel transfer from one of our segments
+ *********************************************************************************
+ */
 
-  return ioctl (spiFds [channel], SPI_IOC_MESSAGE(1), &spi) ;
+static void fillTransfer (struct spi_ioc_transfer *spi, const struct wpiSpiSeg *seg, uint32_t speed)
+{
+  spi->tx_buf        = (unsigned long)seg->tx ;
+  spi->rx_buf        = (unsigned long)seg->rx ;
+  spi->len           = seg->len ;
+  spi->delay_usecs   = seg->delayUs ;
+  spi->speed_hz      = (seg->speedHz == 0) ? speed : seg->speedHz ;
+  spi->bits_per_word = spiBPW ;
+  spi->cs_change     = seg->csChange ? 1 : 0 ;
+}
+
+
+/*
+ * wiringPiSPITransfer:
+ *	Run a whole transaction of several segments, each with its own
+ *	transmit and receive buffers, in one ioctl. Nothing gets copied and
+ *	the transmit data isn't overwritten.
+ *********************************************************************************
+ */
+
+int wiringPiSPIxTransfer (int bus, int channel, const struct wpiSpiSeg *segs, int numSegs)
+{
+  struct spi_ioc_transfer spi [WPI_SPI_MAX_SEGS] ;
+  unsigned long long t0 ;
+  int i, res ;
+
+  if (!spiValid (bus, channel))
+    return -1 ;
+
+  if ((numSegs < 1) || (numSegs > WPI_SPI_MAX_SEGS))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  memset (spi, 0, numSegs * sizeof (spi [0])) ;
+
+  pthread_mutex_lock (&spiBusLocks [bus]) ;
+
+  for (i = 0 ; i < numSegs ; ++i)
+    fillTransfer (&spi [i], &segs [i], spiSpeeds [bus][channel]) ;
+
+  t0  = wiringPiBusStatsBegin () ;
+  if (directFits (bus, channel, segs, numSegs))
+    res = directTransfer (channel, segs, numSegs) ;
+  else
+  {
+    res = spiMessage (spiFds [bus][channel], numSegs, spi) ;
+    if (res >= 0)
+      directCalibrate (bus, channel, segs, numSegs) ;
+  }
+  wiringPiBusStatsEnd (spiSlots [bus][channel] - 1, t0, segBytes (segs, numSegs), res < 0) ;
+
+  pthread_mutex_unlock (&spiBusLocks [bus]) ;
+
+  return res ;
+}
+
+int wiringPiSPITransfer (int channel, const struct wpiSpiSeg *segs, int numSegs)
+{
+  if (WPI_SPI_IS_GPIO_CS (channel))
+    return csTransfer (channel, segs, numSegs) ;
+
+  return wiringPiSPIxTransfer (WPI_SPI_BUS (channel), WPI_SPI_CS (channel), segs, numSegs) ;
+}
+
+
+/*
+ * wiringPiSPIDirect:
+ *	Let short transfers on a channel of SPI0 skip spidev and go straight
+ *	to the controller. Only on the BCM283x/2711, and only with /dev/mem.
+ *	We share the controller with the kernel without telling it, so
+ *	nothing else should be using SPI0 while we do.
+ *********************************************************************************
+ */
+
+int wiringPiSPIxDirect (int bus, int channel, int enable)
+{
+  static int warned = FALSE ;
+  struct spiDirectStruct *d ;
+  int fsel, shift ;
+
+  if (!spiValid (bus, channel))
+    return -1 ;
+
+  if ((bus != 0) || (channel > 1))
+  {
+    errno = ENODEV ;
+    return -1 ;
+  }
+
+  pthread_once (&spiLockOnce, spiLockInit) ;
+
+  d = &spiDirect [channel] ;
+
+  if (!enable)
+  {
+    pthread_mutex_lock (&spiBusLocks [0]) ;
+      d->on = FALSE ;
+    pthread_mutex_unlock (&spiBusLocks [0]) ;
+    return 0 ;
+  }
+
+  if (spiFds [0][channel] == -1)
+  {
+    errno = EBADF ;
+    return -1 ;
+  }
+
+  if ((_wiringPiGpio == NULL) || ((spi0 == NULL) && ((spi0 = wiringPiPeriMap (SPI0_OFFSET, 4096)) == NULL)))
+  {
+    errno = ENODEV ;
+    return -1 ;
+  }
+
+// Which chip select: the controller's (CE on ALT0) or a GPIO the kernel drives
+
+  shift = (spiCePins [channel] % 10) * 3 ;
+  fsel  = (*(_wiringPiGpio + spiCePins [channel] / 10) >> shift) & 7 ;
+
+  pthread_mutex_lock (&spiBusLocks [0]) ;
+    d->gpioCs = (fsel == 1) ? spiCePins [channel] : -1 ;
+    d->cdiv   = 0 ;				// Learn it again from the kernel
+    d->on     = TRUE ;
+  pthread_mutex_unlock (&spiBusLocks [0]) ;
+
+  if (!warned)
+  {
+    warned = TRUE ;
+    fprintf (stderr, "wiringPiSPIDirect: using SPI0 directly - nothing else must use it\n") ;
+  }
+
+  return 0 ;
+}
+
+int wiringPiSPIDirect (int channel, int enable)
+{
+  if (WPI_SPI_IS_GPIO_CS (channel))
+  {
+    errno = ENODEV ;
+    return -1 ;
+  }
+
+  return wiringPiSPIxDirect (WPI_SPI_BUS (channel), WPI_SPI_CS (channel), enable) ;
 }
 
 
@@ -99,38 +621,65 @@ int wiringPiSPIDataRW (int channel, unsigned char *data, int len)
  *********************************************************************************
  */
 
-int wiringPiSPISetupMode (int channel, int speed, int mode)
+int wiringPiSPIxSetupMode (int bus, int channel, int speed, int mode)
 {
   int fd ;
   char spiDev [32] ;
 
   mode    &= 3 ;	// Mode is 0, 1, 2 or 3
 
-// Channel can be anything - lets hope for the best
-//  channel &= 1 ;	// Channel is 0 or 1
+  if (!spiValid (bus, channel))
+    return wiringPiFailure (WPI_ALMOST, "Invalid SPI bus (%d) or channel (%d)\n", bus, channel) ;
 
-  snprintf (spiDev, 31, "/dev/spidev0.%d", channel) ;
+  pthread_once (&spiLockOnce, spiLockInit) ;
 
-  if ((fd = open (spiDev, O_RDWR)) < 0)
-    return wiringPiFailure (WPI_ALMOST, "Unable to open SPI device: %s\n", strerror (errno)) ;
+  snprintf (spiDev, 31, "/dev/spidev%d.%d", bus, channel) ;
 
-  spiSpeeds [channel] = speed ;
-  spiFds    [channel] = fd ;
+  if ((fd = spiOpen (spiDev)) < 0)
+    return wiringPiFailure (WPI_ALMOST, "Unable to open SPI device: %s\n", strerror (errno)) ;
 
 // Set SPI parameters.
 
-  if (ioctl (fd, SPI_IOC_WR_MODE, &mode)            < 0)
+  if (spiSet (fd, SPI_IOC_WR_MODE, &mode)            < 0)
+  {
+    close (fd) ;
     return wiringPiFailure (WPI_ALMOST, "SPI Mode Change failure: %s\n", strerror (errno)) ;
+  }
   
-  if (ioctl (fd, SPI_IOC_WR_BITS_PER_WORD, &spiBPW) < 0)
+  if (spiSet (fd, SPI_IOC_WR_BITS_PER_WORD, &spiBPW) < 0)
+  {
+    close (fd) ;
     return wiringPiFailure (WPI_ALMOST, "SPI BPW Change failure: %s\n", strerror (errno)) ;
+  }
 
-  if (ioctl (fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed)   < 0)
+  if (spiSet (fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed)   < 0)
+  {
+    close (fd) ;
     return wiringPiFailure (WPI_ALMOST, "SPI Speed Change failure: %s\n", strerror (errno)) ;
+  }
+
+  pthread_mutex_lock (&spiBusLocks [bus]) ;
+    if (spiFds [bus][channel] != -1)		// Set up again - replace it
+      close (spiFds [bus][channel]) ;
+    spiSpeeds [bus][channel] = speed ;
+    spiModes  [bus][channel] = mode ;
+    spiFds    [bus][channel] = fd ;
+    spiSlots  [bus][channel] = statsSlot (bus, channel) + 1 ;
+  pthread_mutex_unlock (&spiBusLocks [bus]) ;
 
   return fd ;
 }
 
+static int csSetupMode (int channel, int speed, int mode) ;
+
+int wiringPiSPISetupMode (int channel, int speed, int mode)
+{
+  if (WPI_SPI_IS_GPIO_CS (channel))
+    return csSetupMode (channel, speed, mode) ;
+
+  return wiringPiSPIxSetupMode (WPI_SPI_BUS (channel), WPI_SPI_CS (channel), speed, mode) ;
+}
+
 
 /*
  * wiringPiSPISetup:
@@ -138,7 +687,994 @@ int wiringPiSPISetupMode (int channel, int speed, int mode)
  *********************************************************************************
  */
 
+int wiringPiSPIxSetup (int bus, int channel, int speed)
+{
+  return wiringPiSPIxSetupMode (bus, channel, speed, 0) ;
+}
+
 int wiringPiSPISetup (int channel, int speed)
 {
   return wiringPiSPISetupMode (channel, speed, 0) ;
 }
+
+
+/*
+ * wiringPiSPIClose:
+ *	Close a device, waiting for any transfer in progress on its bus
+ *********************************************************************************
+ */
+
+int wiringPiSPIxClose (int bus, int channel)
+{
+  int res = 0 ;
+
+  if (!spiValid (bus, channel))
+    return -1 ;
+
+  pthread_mutex_lock (&spiBusLocks [bus]) ;
+    if (spiFds [bus][channel] != -1)
+    {
+      res = close (spiFds [bus][channel]) ;
+      spiFds [bus][channel] = -1 ;
+    }
+    if ((bus == 0) && (channel < 2))
+      spiDirect [channel].on = FALSE ;
+  pthread_mutex_unlock (&spiBusLocks [bus]) ;
+
+  return res ;
+}
+
+static int csClose (int channel) ;
+
+int wiringPiSPIClose (int channel)
+{
+  if (WPI_SPI_IS_GPIO_CS (channel))
+    return csClose (channel) ;
+
+  return wiringPiSPIxClose (WPI_SPI_BUS (channel), WPI_SPI_CS (channel)) ;
+}
+
+
+/*
+ * spiQueueInit:
+ *********************************************************************************
+ */
+
+static void spiQueueInit (void)
+{
+  int bus ;
+
+  for (bus = 0 ; bus < WPI_SPI_MAX_BUS ; ++bus)
+  {
+    pthread_mutex_init (&spiQueues [bus].lock, NULL) ;
+    pthread_cond_init  (&spiQueues [bus].work, NULL) ;
+    spiQueues [bus].doneFd = -1 ;
+  }
+}
+
+
+/*
+ * spiComplete:
+ *	A request's finished: call it back, or put it on the done list if
+ *	it's to be picked up by wiringPiSPIxDone.
+ *********************************************************************************
+ */
+
+static void spiComplete (struct spiQueueStruct *q, struct wpiSpiRequest *req)
+{
+  uint64_t one = 1 ;
+
+  if ((req->callback == NULL) && (q->doneFd != -1))
+  {
+    req->next = NULL ;
+    pthread_mutex_lock (&q->lock) ;
+      if (q->doneTail == NULL)
+	q->doneHead = req ;
+      else
+	q->doneTail->next = req ;
+      q->doneTail = req ;
+    pthread_mutex_unlock (&q->lock) ;
+    __atomic_store_n (&req->done, TRUE, __ATOMIC_RELEASE) ;
+    (void)write (q->doneFd, &one, sizeof (one)) ;
+    return ;
+  }
+
+  __atomic_store_n (&req->done, TRUE, __ATOMIC_RELEASE) ;
+  if (req->callback != NULL)
+    req->callback (req) ;
+}
+
+
+/*
+ * spiWorker:
+ *	Work through the queue for one bus. Requests queued back to back for
+ *	the same device are sent together in one ioctl (as many as fit in
+ *	WPI_SPI_MAX_SEGS segments), with CS dropped between them.
+ *********************************************************************************
+ */
+
+static void *spiWorker (void *arg)
+{
+  struct spiQueueStruct *q ;
+  struct wpiSpiRequest  *batch, *req, *last, *next ;
+  struct spi_ioc_transfer spi [WPI_SPI_MAX_SEGS] ;
+  unsigned long long t0 ;
+  unsigned int bytes ;
+  int bus = (int)(intptr_t)arg ;
+  int channel, n, i, res ;
+
+  q = &spiQueues [bus] ;
+
+  for (;;)
+  {
+    pthread_mutex_lock (&q->lock) ;
+      while (q->head == NULL)
+	pthread_cond_wait (&q->work, &q->lock) ;
+
+// Take the first request and all the ones after it for the same device
+//	that fit
+
+      batch   = q->head ;
+      channel = batch->channel ;
+      n       = batch->numSegs ;
+      last    = batch ;
+      while ((last->next != NULL) && (last->next->channel == channel) && (n + last->next->numSegs <= WPI_SPI_MAX_SEGS))
+      {
+	last  = last->next ;
+	n    += last->numSegs ;
+      }
+      q->head    = last->next ;
+      last->next = NULL ;
+      if (q->head == NULL)
+	q->tail = NULL ;
+    pthread_mutex_unlock (&q->lock) ;
+
+// GPIO chip select devices can't be batched into one ioctl
+
+    if (WPI_SPI_IS_GPIO_CS (channel))
+    {
+      for (req = batch ; req != NULL ; req = next)
+      {
+	next        = req->next ;
+	req->result = csTransfer (channel, req->segs, req->numSegs) ;
+	spiComplete (q, req) ;
+      }
+      continue ;
+    }
+
+    memset (spi, 0, n * sizeof (spi [0])) ;
+
+    pthread_mutex_lock (&spiBusLocks [bus]) ;
+      n     = 0 ;
+      bytes = 0 ;
+      for (req = batch ; req != NULL ; req = req->next)
+      {
+	for (i = 0 ; i < req->numSegs ; ++i)
+	  fillTransfer (&spi [n++], &req->segs [i], spiSpeeds [bus][channel]) ;
+	if (req->next != NULL)
+	  spi [n - 1].cs_change = 1 ;		// Each request is a CS frame of its own
+	bytes += segBytes (req->segs, req->numSegs) ;
+      }
+      t0  = wiringPiBusStatsBegin () ;
+      res = spiMessage (spiFds [bus][channel], n, spi) ;
+      wiringPiBusStatsEnd (spiSlots [bus][channel] - 1, t0, bytes, res < 0) ;
+    pthread_mutex_unlock (&spiBusLocks [bus]) ;
+
+    for (req = batch ; req != NULL ; req = next)
+    {
+      next = req->next ;
+
+      if (res < 0)
+	req->result = -1 ;
+      else
+	for (req->result = 0, i = 0 ; i < req->numSegs ; ++i)
+	  req->result += req->segs [i].len ;
+
+      spiComplete (q, req) ;
+    }
+  }
+
+  return NULL ;
+}
+
+
+/*
+ * wiringPiSPISubmit:
+ *	Queue a transaction for the bus worker thread and return at once.
+ *	The callback (which may be NULL - poll req->done instead) is run
+ *	from the worker thread, so keep it short. It may submit more.
+ *	Returns 0, or -1 if the request is bad or the worker can't start.
+ *********************************************************************************
+ */
+
+static int spiSubmit (int bus, int channel, struct wpiSpiRequest *req, void (*callback)(struct wpiSpiRequest *req))
+{
+  struct spiQueueStruct *q ;
+  pthread_t myThread ;
+  int res = 0 ;
+
+  if ((req->numSegs < 1) || (req->numSegs > WPI_SPI_MAX_SEGS))
+    return -1 ;
+
+  pthread_once (&spiQueueOnce, spiQueueInit) ;
+
+  q = &spiQueues [bus] ;
+
+  req->channel  = channel ;
+  req->callback = callback ;
+  req->done     = FALSE ;
+  req->result   = 0 ;
+  req->next     = NULL ;
+
+  pthread_mutex_lock (&q->lock) ;
+
+  if (!q->running)
+  {
+    if ((res = pthread_create (&myThread, NULL, spiWorker, (void *)(intptr_t)bus)) == 0)
+    {
+      pthread_detach (myThread) ;
+      q->running = TRUE ;
+    }
+  }
+
+  if (res == 0)
+  {
+    if (q->tail == NULL)
+      q->head = req ;
+    else
+      q->tail->next = req ;
+    q->tail = req ;
+    pthread_cond_signal (&q->work) ;
+  }
+
+  pthread_mutex_unlock (&q->lock) ;
+
+  return (res == 0) ? 0 : -1 ;
+}
+
+int wiringPiSPIxSubmit (int bus, int channel, struct wpiSpiRequest *req, void (*callback)(struct wpiSpiRequest *req))
+{
+  if (!spiValid (bus, channel))
+    return -1 ;
+
+  return spiSubmit (bus, channel, req, callback) ;
+}
+
+int wiringPiSPISubmit (int channel, struct wpiSpiRequest *req, void (*callback)(struct wpiSpiRequest *req))
+{
+  struct spiCsStruct *cs ;
+
+  if (WPI_SPI_IS_GPIO_CS (channel))
+  {
+    cs = &spiCs [channel - WPI_SPI_GPIO_CS_BASE] ;
+    if (!cs->used)
+    {
+      errno = EINVAL ;
+      return -1 ;
+    }
+    return spiSubmit (cs->bus, channel, req, callback) ;
+  }
+
+  return wiringPiSPIxSubmit (WPI_SPI_BUS (channel), WPI_SPI_CS (channel), req, callback) ;
+}
+
+
+/*
+ * wiringPiSPIDoneFd: wiringPiSPIDone:
+ *	For an event loop: from now on, requests submitted on the bus with no
+ *	callback are kept for wiringPiSPIDone when they finish, and the
+ *	eventfd returned is readable while there are any. wiringPiSPIDone
+ *	hands back up to max of them, in the order they finished, without
+ *	blocking. Don't submit one again till it's come back this way.
+ *	The queue is per bus, so any channel on it will do for these.
+ *	Returns the fd or -1, and the number of requests put in reqs [].
+ *********************************************************************************
+ */
+
+int wiringPiSPIxDoneFd (int bus)
+{
+  struct spiQueueStruct *q ;
+  int fd ;
+
+  if ((bus < 0) || (bus >= WPI_SPI_MAX_BUS))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  pthread_once (&spiQueueOnce, spiQueueInit) ;
+
+  q = &spiQueues [bus] ;
+
+  pthread_mutex_lock (&q->lock) ;
+    if (q->doneFd == -1)
+      q->doneFd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC) ;
+    fd = q->doneFd ;
+  pthread_mutex_unlock (&q->lock) ;
+
+  return fd ;
+}
+
+int wiringPiSPIxDone (int bus, struct wpiSpiRequest **reqs, int max)
+{
+  struct spiQueueStruct *q ;
+  uint64_t count, one = 1 ;
+  int n = 0 ;
+
+  if ((bus < 0) || (bus >= WPI_SPI_MAX_BUS))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  pthread_once (&spiQueueOnce, spiQueueInit) ;
+
+  q = &spiQueues [bus] ;
+
+  pthread_mutex_lock (&q->lock) ;
+    if (q->doneFd != -1)
+      (void)read (q->doneFd, &count, sizeof (count)) ;
+    while ((n < max) && (q->doneHead != NULL))
+    {
+      reqs [n++]  = q->doneHead ;
+      q->doneHead = q->doneHead->next ;
+    }
+    if (q->doneHead == NULL)
+      q->doneTail = NULL ;
+    else
+      (void)write (q->doneFd, &one, sizeof (one)) ;	// Still some left
+  pthread_mutex_unlock (&q->lock) ;
+
+  return n ;
+}
+
+static int spiChannelBus (int channel)
+{
+  if (WPI_SPI_IS_GPIO_CS (channel))
+    return spiCs [channel - WPI_SPI_GPIO_CS_BASE].used ? spiCs [channel - WPI_SPI_GPIO_CS_BASE].bus : -1 ;
+
+  return WPI_SPI_BUS (channel) ;
+}
+
+int wiringPiSPIDoneFd (int channel)
+{
+  return wiringPiSPIxDoneFd (spiChannelBus (channel)) ;
+}
+
+int wiringPiSPIDone (int channel, struct wpiSpiRequest **reqs, int max)
+{
+  return wiringPiSPIxDone (spiChannelBus (channel), reqs, max) ;
+}
+
+
+/*
+ * csSelect:
+ *	Select or deselect a GPIO chip select device
+ *********************************************************************************
+ */
+
+static void csSelect (struct spiCsStruct *cs, int selected)
+{
+  unsigned int value ;
+  int i ;
+
+  if (cs->mapped)
+  {
+    for (i = 0 ; i < 2 ; ++i)
+    {
+      if (cs->setMask [selected][i] != 0) *cs->set [i] = cs->setMask [selected][i] ;
+      if (cs->clrMask [selected][i] != 0) *cs->clr [i] = cs->clrMask [selected][i] ;
+    }
+    return ;
+  }
+
+  value = selected ? cs->address : cs->idle ;
+  for (i = 0 ; i < cs->numPins ; ++i)
+    wpiPinWrite (cs->pins [i], (value >> i) & 1) ;
+}
+
+
+/*
+ * csCarrier:
+ *	Get the carrier fd for a GPIO chip select device, in its mode.
+ *	Called with the bus lock held.
+ *********************************************************************************
+ */
+
+static int csCarrier (struct spiCsStruct *cs)
+{
+  uint8_t mode ;
+  int fd ;
+
+  if (!cs->opened)
+  {
+    errno = EBADF ;
+    return -1 ;
+  }
+
+  fd = spiCsFds [cs->bus][cs->carrier] ;
+
+  if (spiCsModes [cs->bus][cs->carrier] != cs->mode)
+  {
+    mode = cs->mode | SPI_NO_CS ;
+    if (spiSet (fd, SPI_IOC_WR_MODE, &mode) < 0)
+      return -1 ;
+    spiCsModes [cs->bus][cs->carrier] = cs->mode ;
+  }
+
+  return fd ;
+}
+
+
+/*
+ * csTransfer:
+ *	wiringPiSPITransfer on a GPIO chip select device. Each run of
+ *	segments up to one with csChange set is a separate ioctl with the
+ *	device selected around it.
+ *********************************************************************************
+ */
+
+static int csTransfer (int channel, const struct wpiSpiSeg *segs, int numSegs)
+{
+  struct spi_ioc_transfer spi [WPI_SPI_MAX_SEGS] ;
+  struct spiCsStruct *cs = &spiCs [channel - WPI_SPI_GPIO_CS_BASE] ;
+  unsigned long long t0 ;
+  int i, fd, first = 0, res = 0, n ;
+
+  if (!cs->used || (numSegs < 1) || (numSegs > WPI_SPI_MAX_SEGS))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  memset (spi, 0, numSegs * sizeof (spi [0])) ;
+
+  pthread_mutex_lock (&spiBusLocks [cs->bus]) ;
+
+  if ((fd = csCarrier (cs)) < 0)
+  {
+    pthread_mutex_unlock (&spiBusLocks [cs->bus]) ;
+    return -1 ;
+  }
+
+  for (i = 0 ; i < numSegs ; ++i)
+  {
+    fillTransfer (&spi [i], &segs [i], cs->speed) ;
+    spi [i].cs_change = 0 ;
+
+    if (segs [i].csChange || (i == numSegs - 1))
+    {
+      t0 = wiringPiBusStatsBegin () ;
+      csSelect (cs, TRUE) ;
+	n = spiMessage (fd, i - first + 1, &spi [first]) ;
+      csSelect (cs, FALSE) ;
+      wiringPiBusStatsEnd (cs->slot, t0, segBytes (&segs [first], i - first + 1), n < 0) ;
+
+      if (n < 0)
+      {
+	res = -1 ;
+	break ;
+      }
+      res  += n ;
+      first = i + 1 ;
+    }
+  }
+
+  pthread_mutex_unlock (&spiBusLocks [cs->bus]) ;
+
+  return res ;
+}
+
+
+/*
+ * spiChunkSize:
+ *	spidev copies each message through a bounce buffer of bufsiz bytes
+ *	(a module parameter, 4096 unless it's been changed), and a message
+ *	whose transfers add up to more than that fails. So that's as much
+ *	as we can put in one ioctl.
+ *********************************************************************************
+ */
+
+static unsigned int   spiBufSiz ;
+static pthread_once_t spiBufSizOnce = PTHREAD_ONCE_INIT ;
+
+static void spiBufSizInit (void)
+{
+  FILE *fp ;
+  unsigned int n ;
+
+  spiBufSiz = 4096 ;
+
+  if (wiringPiSimActive ())
+    return ;
+
+  if ((fp = fopen ("/sys/module/spidev/parameters/bufsiz", "r")) != NULL)
+  {
+    if ((fscanf (fp, "%u", &n) == 1) && (n > 0))
+      spiBufSiz = n ;
+    fclose (fp) ;
+  }
+}
+
+static unsigned int spiChunkSize (void)
+{
+  pthread_once (&spiBufSizOnce, spiBufSizInit) ;
+  return spiBufSiz ;
+}
+
+
+// Double buffering for wiringPiSPIStream:
+//	A filler thread runs the callback into one buffer while the other
+//	is going out. ready [] is the length in each buffer, or 0 while it's
+//	free to fill.
+
+struct spiStreamStruct
+{
+  int          (*fill)(void *arg, unsigned char *buf, unsigned int offset, unsigned int len) ;
+  void          *arg ;
+  unsigned char *buf [2] ;
+  unsigned int   ready [2] ;
+  unsigned int   len, chunk ;
+  int            failed ;		// The callback gave up, or we did
+  pthread_mutex_t lock ;
+  pthread_cond_t  cond ;
+} ;
+
+static void *spiFiller (void *arg)
+{
+  struct spiStreamStruct *st = (struct spiStreamStruct *)arg ;
+  unsigned int offset, n ;
+  int k = 0 ;
+
+  for (offset = 0 ; offset < st->len ; offset += n, k ^= 1)
+  {
+    n = st->len - offset ;
+    if (n > st->chunk)
+      n = st->chunk ;
+
+    pthread_mutex_lock (&st->lock) ;
+      while ((st->ready [k] != 0) && !st->failed)
+	pthread_cond_wait (&st->cond, &st->lock) ;
+    pthread_mutex_unlock (&st->lock) ;
+
+    if (st->failed)
+      break ;
+
+    if (st->fill (st->arg, st->buf [k], offset, n) < 0)
+    {
+      pthread_mutex_lock (&st->lock) ;
+	st->failed = TRUE ;
+	pthread_cond_broadcast (&st->cond) ;
+      pthread_mutex_unlock (&st->lock) ;
+      break ;
+    }
+
+    pthread_mutex_lock (&st->lock) ;
+      st->ready [k] = n ;
+      pthread_cond_broadcast (&st->cond) ;
+    pthread_mutex_unlock (&st->lock) ;
+  }
+
+  return NULL ;
+}
+
+
+/*
+ * spiLarge:
+ *	Run one long transfer as a train of ioctls of up to a chunk each,
+ *	holding the bus for the lot so nothing gets in between. A kernel
+ *	chip select is kept asserted from one ioctl to the next with
+ *	cs_change on the last (only) transfer of each but the final one -
+ *	for the end of a message that means leave CS alone; a GPIO chip
+ *	select is simply held around the lot.
+ *	With a stream, the transmit data comes from its buffers as they're
+ *	filled rather than from tx.
+ *********************************************************************************
+ */
+
+static int spiLarge (int channel, const unsigned char *tx, unsigned char *rx, unsigned int len, struct spiStreamStruct *st)
+{
+  struct spi_ioc_transfer spi ;
+  struct spiCsStruct *cs = NULL ;
+  unsigned long long t0 ;
+  const unsigned char *src ;
+  unsigned int offset, n, ready, chunk = spiChunkSize () ;
+  uint32_t speed ;
+  int bus, fd, slot, k = 0, res = 0 ;
+
+  if (len > INT_MAX)
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  if (WPI_SPI_IS_GPIO_CS (channel))
+  {
+    cs = &spiCs [channel - WPI_SPI_GPIO_CS_BASE] ;
+    if (!cs->used)
+    {
+      errno = EINVAL ;
+      return -1 ;
+    }
+    bus = cs->bus ;
+  }
+  else
+    bus = WPI_SPI_BUS (channel) ;
+
+  pthread_once (&spiLockOnce, spiLockInit) ;
+
+  pthread_mutex_lock (&spiBusLocks [bus]) ;
+
+  if (cs != NULL)
+  {
+    if ((fd = csCarrier (cs)) < 0)
+    {
+      pthread_mutex_unlock (&spiBusLocks [bus]) ;
+      return -1 ;
+    }
+    speed = cs->speed ;
+    slot  = cs->slot ;
+  }
+  else
+  {
+    fd    = spiFds    [bus][WPI_SPI_CS (channel)] ;
+    speed = spiSpeeds [bus][WPI_SPI_CS (channel)] ;
+    slot  = spiSlots  [bus][WPI_SPI_CS (channel)] - 1 ;
+  }
+
+  t0 = wiringPiBusStatsBegin () ;
+  if (cs != NULL)
+    csSelect (cs, TRUE) ;
+
+  for (offset = 0 ; offset < len ; offset += n, k ^= 1)
+  {
+    n = len - offset ;
+    if (n > chunk)
+      n = chunk ;
+
+    if (st != NULL)
+    {
+      pthread_mutex_lock (&st->lock) ;
+	while ((st->ready [k] == 0) && !st->failed)
+	  pthread_cond_wait (&st->cond, &st->lock) ;
+	ready = st->ready [k] ;
+      pthread_mutex_unlock (&st->lock) ;
+      if (ready == 0)
+      {
+	errno = ECANCELED ;
+	res   = -1 ;
+	break ;
+      }
+      src = st->buf [k] ;
+    }
+    else
+      src = (tx == NULL) ? NULL : tx + offset ;
+
+    memset (&spi, 0, sizeof (spi)) ;
+    spi.tx_buf        = (unsigned long)src ;
+    spi.rx_buf        = (rx == NULL) ? 0 : (unsigned long)(rx + offset) ;
+    spi.len           = n ;
+    spi.speed_hz      = speed ;
+    spi.bits_per_word = spiBPW ;
+    spi.cs_change     = ((cs == NULL) && (offset + n < len)) ? 1 : 0 ;
+
+    if (spiMessage (fd, 1, &spi) < 0)
+    {
+      res = -1 ;
+      break ;
+    }
+    res += n ;
+
+    if (st != NULL)
+    {
+      pthread_mutex_lock (&st->lock) ;
+	st->ready [k] = 0 ;
+	pthread_cond_broadcast (&st->cond) ;
+      pthread_mutex_unlock (&st->lock) ;
+    }
+  }
+
+  if (cs != NULL)
+    csSelect (cs, FALSE) ;
+  wiringPiBusStatsEnd (slot, t0, (res < 0) ? 0 : res, res < 0) ;
+
+  pthread_mutex_unlock (&spiBusLocks [bus]) ;
+
+  return res ;
+}
+
+
+/*
+ * wiringPiSPIDataRWLarge:
+ *	A transfer of any length as one chip select frame: the bytes in tx
+ *	go out and what comes back goes into rx (either may be NULL, and
+ *	they may be the same buffer). Returns the number of bytes, or -1.
+ *********************************************************************************
+ */
+
+int wiringPiSPIxDataRWLarge (int bus, int channel, const unsigned char *tx, unsigned char *rx, unsigned int len)
+{
+  if (!spiValid (bus, channel))
+    return -1 ;
+
+  return spiLarge (WPI_SPI_CHANNEL (bus, channel), tx, rx, len, NULL) ;
+}
+
+int wiringPiSPIDataRWLarge (int channel, const unsigned char *tx, unsigned char *rx, unsigned int len)
+{
+  if (!WPI_SPI_IS_GPIO_CS (channel))
+    return wiringPiSPIxDataRWLarge (WPI_SPI_BUS (channel), WPI_SPI_CS (channel), tx, rx, len) ;
+
+  return spiLarge (channel, tx, rx, len, NULL) ;
+}
+
+
+/*
+ * wiringPiSPIStream:
+ *	Send len bytes as one chip select frame, generated a chunk at a time
+ *	by fill (arg, buf, offset, n) into one buffer while the one before
+ *	is going out - so a frame can be rendered while it's being sent.
+ *	fill returns < 0 to give up, which cuts the frame short with errno
+ *	ECANCELED. Returns the number of bytes, or -1.
+ *********************************************************************************
+ */
+
+int wiringPiSPIStream (int channel, unsigned int len, int (*fill)(void *arg, unsigned char *buf, unsigned int offset, unsigned int len), void *arg)
+{
+  struct spiStreamStruct st ;
+  pthread_t myThread ;
+  int res ;
+
+  if ((fill == NULL) || (!WPI_SPI_IS_GPIO_CS (channel) && !spiValid (WPI_SPI_BUS (channel), WPI_SPI_CS (channel))))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  if (len == 0)
+    return 0 ;
+
+  memset (&st, 0, sizeof (st)) ;
+  st.fill  = fill ;
+  st.arg   = arg ;
+  st.len   = len ;
+  st.chunk = spiChunkSize () ;
+
+  if ((st.buf [0] = malloc (2 * st.chunk)) == NULL)
+    return -1 ;
+  st.buf [1] = st.buf [0] + st.chunk ;
+
+  pthread_mutex_init (&st.lock, NULL) ;
+  pthread_cond_init  (&st.cond, NULL) ;
+
+  if ((res = pthread_create (&myThread, NULL, spiFiller, &st)) != 0)
+  {
+    errno = res ;
+    res   = -1 ;
+  }
+  else
+  {
+    res = spiLarge (channel, NULL, NULL, len, &st) ;
+
+    pthread_mutex_lock (&st.lock) ;
+      st.failed = TRUE ;			// Stop the filler if we stopped early
+      pthread_cond_broadcast (&st.cond) ;
+    pthread_mutex_unlock (&st.lock) ;
+    pthread_join (myThread, NULL) ;
+  }
+
+  pthread_cond_destroy  (&st.cond) ;
+  pthread_mutex_destroy (&st.lock) ;
+  free (st.buf [0]) ;
+
+  return res ;
+}
+
+int wiringPiSPIxStream (int bus, int channel, unsigned int len, int (*fill)(void *arg, unsigned char *buf, unsigned int offset, unsigned int len), void *arg)
+{
+  if (!spiValid (bus, channel))
+    return -1 ;
+
+  return wiringPiSPIStream (WPI_SPI_CHANNEL (bus, channel), len, fill, arg) ;
+}
+
+
+/*
+ * csSetupMode:
+ *	wiringPiSPISetupMode on a GPIO chip select device: open its carrier
+ *	if it's the first, and give it its speed and mode.
+ *********************************************************************************
+ */
+
+static int csSetupMode (int channel, int speed, int mode)
+{
+  struct spiCsStruct *cs = &spiCs [channel - WPI_SPI_GPIO_CS_BASE] ;
+  char    spiDev [32] ;
+  uint8_t m = SPI_NO_CS ;
+  int     fd ;
+
+  if (!cs->used)
+    return wiringPiFailure (WPI_ALMOST, "Invalid SPI GPIO chip select channel (0x%X)\n", channel) ;
+
+  pthread_once (&spiLockOnce, spiLockInit) ;
+
+  pthread_mutex_lock (&spiCsLock) ;
+
+  if ((fd = spiCsFds [cs->bus][cs->carrier]) == -1)
+  {
+    snprintf (spiDev, 31, "/dev/spidev%d.%d", cs->bus, cs->carrier) ;
+
+    if ((fd = spiOpen (spiDev)) < 0)
+    {
+      pthread_mutex_unlock (&spiCsLock) ;
+      return wiringPiFailure (WPI_ALMOST, "Unable to open SPI device: %s\n", strerror (errno)) ;
+    }
+
+    if ((spiSet (fd, SPI_IOC_WR_MODE, &m) < 0) || (spiSet (fd, SPI_IOC_WR_BITS_PER_WORD, &spiBPW) < 0))
+    {
+      close (fd) ;
+      pthread_mutex_unlock (&spiCsLock) ;
+      return wiringPiFailure (WPI_ALMOST, "SPI no chip select mode failure: %s\n", strerror (errno)) ;
+    }
+
+    spiCsModes [cs->bus][cs->carrier] = 0 ;
+    spiCsFds   [cs->bus][cs->carrier] = fd ;
+  }
+
+  pthread_mutex_lock (&spiBusLocks [cs->bus]) ;
+    cs->speed = speed ;
+    cs->mode  = mode & 3 ;
+    cs->slot  = statsSlot (cs->bus, channel) ;
+    if (!cs->opened)
+    {
+      cs->opened = TRUE ;
+      ++spiCsUsers [cs->bus][cs->carrier] ;
+    }
+  pthread_mutex_unlock (&spiBusLocks [cs->bus]) ;
+
+  pthread_mutex_unlock (&spiCsLock) ;
+
+  return fd ;
+}
+
+
+/*
+ * csClose:
+ *	wiringPiSPIClose on a GPIO chip select device. It's gone for good,
+ *	and the carrier is closed after the last one.
+ *********************************************************************************
+ */
+
+static int csClose (int channel)
+{
+  struct spiCsStruct *cs = &spiCs [channel - WPI_SPI_GPIO_CS_BASE] ;
+  int i, res = 0 ;
+
+  pthread_mutex_lock (&spiCsLock) ;
+
+  if (!cs->used)
+  {
+    pthread_mutex_unlock (&spiCsLock) ;
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  pthread_once (&spiLockOnce, spiLockInit) ;
+
+  pthread_mutex_lock (&spiBusLocks [cs->bus]) ;
+    if (cs->opened && (--spiCsUsers [cs->bus][cs->carrier] == 0))
+    {
+      res = close (spiCsFds [cs->bus][cs->carrier]) ;
+      spiCsFds [cs->bus][cs->carrier] = -1 ;
+    }
+    for (i = 0 ; i < cs->numPins ; ++i)
+      wiringPiPinClose (cs->pins [i]) ;
+    cs->opened = FALSE ;
+    cs->used   = FALSE ;
+  pthread_mutex_unlock (&spiBusLocks [cs->bus]) ;
+
+  pthread_mutex_unlock (&spiCsLock) ;
+
+  return res ;
+}
+
+
+/*
+ * wiringPiSPIDecoderCS:
+ * wiringPiSPIGpioCS:
+ *	Make a new SPI device on the bus of the given channel (its CE is the
+ *	carrier, see above) selected by putting an address on a set of pins,
+ *	pins [0] taking bit 0, or by taking one GPIO pin low. The pins are
+ *	made outputs and left at the idle address.
+ *	Returns a channel number for all the wiringPiSPI functions and
+ *	device drivers (call wiringPiSPISetup on it next), or -1.
+ *********************************************************************************
+ */
+
+int wiringPiSPIDecoderCS (int channel, const int *pins, int numPins, int address, int idle)
+{
+  struct spiCsStruct *cs ;
+  int bus = WPI_SPI_BUS (channel), carrier = WPI_SPI_CS (channel) ;
+  int i, n, bank, on ;
+  unsigned int bit ;
+
+  if (WPI_SPI_IS_GPIO_CS (channel) || !spiValid (bus, carrier))
+    return -1 ;
+
+  if ((numPins < 1) || (numPins > WPI_SPI_MAX_CS_PINS) || (address < 0) || (idle < 0) ||
+	(address >= (1 << numPins)) || (idle >= (1 << numPins)) || (address == idle))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  pthread_mutex_lock (&spiCsLock) ;
+
+  for (n = 0 ; n < WPI_SPI_MAX_GPIO_CS ; ++n)
+    if (!spiCs [n].used)
+      break ;
+
+  if (n == WPI_SPI_MAX_GPIO_CS)
+  {
+    pthread_mutex_unlock (&spiCsLock) ;
+    errno = ENOSPC ;
+    return -1 ;
+  }
+
+  cs = &spiCs [n] ;
+  memset (cs, 0, sizeof (*cs)) ;
+
+  for (i = 0 ; i < numPins ; ++i)
+    if ((cs->pins [i] = wiringPiPinOpen (pins [i])) == NULL)
+    {
+      while (--i >= 0)
+	wiringPiPinClose (cs->pins [i]) ;
+      pthread_mutex_unlock (&spiCsLock) ;
+      errno = ENODEV ;
+      return -1 ;
+    }
+
+  cs->bus     = bus ;
+  cs->carrier = carrier ;
+  cs->numPins = numPins ;
+  cs->address = address ;
+  cs->idle    = idle ;
+
+// Work out the GPSET/GPCLR stores for each state
+
+  cs->mapped = TRUE ;
+  for (i = 0 ; i < numPins ; ++i)
+  {
+    if (cs->pins [i]->set == NULL)
+    {
+      cs->mapped = FALSE ;
+      break ;
+    }
+
+    bank = cs->pins [i]->gpio >> 5 ;
+    bit  = 1u << (cs->pins [i]->gpio & 31) ;
+    cs->set [bank] = cs->pins [i]->set ;
+    cs->clr [bank] = cs->pins [i]->clr ;
+
+    for (on = 0 ; on < 2 ; ++on)
+      if ((((on ? address : idle) >> i) & 1) != 0)
+	cs->setMask [on][bank] |= bit ;
+      else
+	cs->clrMask [on][bank] |= bit ;
+  }
+
+  csSelect (cs, FALSE) ;
+  for (i = 0 ; i < numPins ; ++i)
+    pinMode (pins [i], OUTPUT) ;
+
+  cs->used = TRUE ;
+
+  pthread_mutex_unlock (&spiCsLock) ;
+
+  return WPI_SPI_GPIO_CS_BASE + n ;
+}
+
+int wiringPiSPIGpioCS (int channel, int csPin)
+{
+  return wiringPiSPIDecoderCS (channel, &csPin, 1, 0, 1) ;
+}
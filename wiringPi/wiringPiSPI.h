@@ -22,14 +22,111 @@
  ***********************************************************************
  */
 
+// wpiSpiSeg:
+//	One segment of an SPI transaction for wiringPiSPITransfer. Either
+//	buffer may be NULL (send zeros/discard what comes back). A speedHz of
+//	0 means the speed the channel was set up with.
+
+struct wpiSpiSeg
+{
+  const void   *tx ;
+  void         *rx ;
+  unsigned int  len ;
+  int           csChange ;	// Drop CS after this segment
+  unsigned int  delayUs ;	// Delay after this segment
+  unsigned int  speedHz ;
+} ;
+
+#define	WPI_SPI_MAX_SEGS	32
+
+// wiringPiSPIDirect: transactions up to this long go straight to the
+//	SPI0 controller rather than through spidev
+
+#define	WPI_SPI_DIRECT_MAX	96
+
+// wpiSpiRequest:
+//	An asynchronous transaction for wiringPiSPISubmit. The request and its
+//	segments and buffers must stay put until done is set (just before the
+//	callback, if any, is called from the bus worker thread) - or until
+//	wiringPiSPIDone hands it back, if the bus has a done fd.
+
+struct wpiSpiRequest
+{
+  const struct wpiSpiSeg *segs ;
+  int                     numSegs ;
+  void                   *userData ;
+
+  volatile int            done ;	// Set by wiringPi
+  int                     result ;	// Bytes transferred or -1
+
+  void (*callback) (struct wpiSpiRequest *req) ;
+
+  int                     channel ;	// Private
+  struct wpiSpiRequest   *next ;
+} ;
+
+// /dev/spidevB.C: SPI0 - SPI6 (the Pi 4 has 7), CE0 - CE2
+
+#define	WPI_SPI_MAX_BUS		7
+#define	WPI_SPI_MAX_CHANNEL	3
+
+// The channel number the non-x functions (and the device drivers) take
+//	can carry a bus number too. Plain 0 and 1 are still /dev/spidev0.0/1.
+
+#define	WPI_SPI_CHANNEL(bus,cs)	(((bus) << 4) | (cs))
+#define	WPI_SPI_BUS(channel)	(((channel) >> 4) & 15)
+#define	WPI_SPI_CS(channel)	((channel) & 15)
+
+// Devices with a GPIO chip select (or a decoder address) get channel
+//	numbers of their own from wiringPiSPIGpioCS/wiringPiSPIDecoderCS
+
+#define	WPI_SPI_GPIO_CS_BASE	0x1000
+#define	WPI_SPI_MAX_GPIO_CS	64
+#define	WPI_SPI_MAX_CS_PINS	8
+#define	WPI_SPI_IS_GPIO_CS(channel)	(((channel) >= WPI_SPI_GPIO_CS_BASE) && ((channel) < WPI_SPI_GPIO_CS_BASE + WPI_SPI_MAX_GPIO_CS))
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 int wiringPiSPIGetFd     (int channel) ;
 int wiringPiSPIDataRW    (int channel, unsigned char *data, int len) ;
+int wiringPiSPITransfer  (int channel, const struct wpiSpiSeg *segs, int numSegs) ;
 int wiringPiSPISetupMode (int channel, int speed, int mode) ;
 int wiringPiSPISetup     (int channel, int speed) ;
+int wiringPiSPIClose     (int channel) ;
+int wiringPiSPISubmit    (int channel, struct wpiSpiRequest *req, void (*callback)(struct wpiSpiRequest *req)) ;
+int wiringPiSPIDoneFd    (int channel) ;
+int wiringPiSPIDone      (int channel, struct wpiSpiRequest **reqs, int max) ;
+
+// Transfers longer than spidev takes in one go (its bufsiz), as one
+//	chip select frame
+
+int wiringPiSPIDataRWLarge (int channel, const unsigned char *tx, unsigned char *rx, unsigned int len) ;
+int wiringPiSPIStream      (int channel, unsigned int len, int (*fill)(void *arg, unsigned char *buf, unsigned int offset, unsigned int len), void *arg) ;
+
+int wiringPiSPIGpioCS    (int channel, int csPin) ;
+int wiringPiSPIDecoderCS (int channel, const int *pins, int numPins, int address, int idle) ;
+
+// Short transfers on SPI0 without spidev: see wiringPiSPI.c. The first
+//	one at a speed still goes through the kernel.
+
+int wiringPiSPIDirect    (int channel, int enable) ;
+
+// As above, but on any bus: /dev/spidev<bus>.<channel>
+
+int wiringPiSPIxGetFd     (int bus, int channel) ;
+int wiringPiSPIxDataRW    (int bus, int channel, unsigned char *data, int len) ;
+int wiringPiSPIxTransfer  (int bus, int channel, const struct wpiSpiSeg *segs, int numSegs) ;
+int wiringPiSPIxSetupMode (int bus, int channel, int speed, int mode) ;
+int wiringPiSPIxSetup     (int bus, int channel, int speed) ;
+int wiringPiSPIxClose     (int bus, int channel) ;
+int wiringPiSPIxSubmit    (int bus, int channel, struct wpiSpiRequest *req, void (*callback)(struct wpiSpiRequest *req)) ;
+int wiringPiSPIxDoneFd    (int bus) ;
+int wiringPiSPIxDone      (int bus, struct wpiSpiRequest **reqs, int max) ;
+int wiringPiSPIxDataRWLarge (int bus, int channel, const unsigned char *tx, unsigned char *rx, unsigned int len) ;
+int wiringPiSPIxStream      (int bus, int channel, unsigned int len, int (*fill)(void *arg, unsigned char *buf, unsigned int offset, unsigned int len), void *arg) ;
+int wiringPiSPIxDirect      (int bus, int channel, int enable) ;
 
 #ifdef __cplusplus
 }
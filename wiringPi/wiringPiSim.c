@@ -0,0 +1,753 @@
+/*
+ * wiringPiSim.c:
+ *	A simulated Pi, for running and benchmarking wiringPi programs on a
+ *	build host. With WIRINGPI_SIM set in the environment:
+ *
+ *	- /proc/cpuinfo is replaced by one describing a Pi 3B, or whatever
+ *	  board the revision code in WIRINGPI_SIM (hex, e.g. c03111) says.
+ *	- The peripheral blocks are ordinary memory. Writes to GPSET/GPCLR
+ *	  are applied to GPLEV, so pins read back what was written.
+ *	- The GPIO character device is replaced too, so wiringPiISR () and
+ *	  the edge event rings work, driven by output changes and by inputs
+ *	  set with wiringPiSimInput ().
+ *	- GPREN/GPFEN and GPEDS work, for polled edge detection.
+ *	- wiringPiSimNode () gives an extension node with whatever latency
+ *	  you like, to stand in for an I2C or SPI expander.
+ *	- I2C and SPI don't need any hardware or kernel drivers: any bus will
+ *	  do, and all of them reach the same simulated devices. An I2C device
+ *	  is a bank of 256 auto-incrementing registers at an address made with
+ *	  wiringPiSimI2c () and filled with wiringPiSimI2cLoad (); every SPI
+ *	  device reads back zeros. They count
+ *	  what they see, with the time it would have taken on the wire, for
+ *	  wiringPiSimBusCounts ().
+ *
+ *	There's no DMA, PWM or clock hardware behind any of it, so those
+ *	registers just hold what's written to them.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <linux/gpio.h>
+#include <linux/spi/spidev.h>
+
+#include "wiringPi.h"
+#include "wiringPiI2C.h"
+#include "wiringPiSim.h"
+
+#define	ENV_SIM		"WIRINGPI_SIM"
+#define	SIM_REVISION	"a02082"	// Pi 3B, 1GB, Sony
+
+// Word offsets into the GPIO block
+
+#define	SIM_GPSET0	 7
+#define	SIM_GPCLR0	10
+#define	SIM_GPLEV0	13
+#define	SIM_GPEDS0	16
+#define	SIM_GPREN0	19
+#define	SIM_GPFEN0	22
+
+#define	SIM_BLOCK_SIZE	(4*1024)
+#define	MAX_SIM_LINES	64
+#define	MAX_SIM_REQS	64
+#define	MAX_SIM_NODES	8
+
+#define	SIM_I2C_HZ	100000		// The Pi's default
+
+static int active = -1 ;
+static char cpuInfo [128] ;
+
+static volatile unsigned int *simGpio = NULL ;
+
+// Edge events: per line, which edges were asked for and where they go
+
+static int          lineEdge  [MAX_SIM_LINES] ;
+static int          lineWfd   [MAX_SIM_LINES] ;
+static unsigned int lineSeqno [MAX_SIM_LINES] ;
+static unsigned int seqno ;
+
+struct simReqStruct
+{
+  int fd, wfd ;
+  int numLines ;
+  int lines [MAX_SIM_LINES] ;
+} ;
+
+static struct simReqStruct reqs [MAX_SIM_REQS] ;
+static pthread_mutex_t     reqLock = PTHREAD_MUTEX_INITIALIZER ;
+
+// Simulated expander nodes
+
+struct simNodeStruct
+{
+  struct wiringPiNodeStruct *node ;
+  int *values ;
+} ;
+
+static struct simNodeStruct simNodes [MAX_SIM_NODES] ;
+
+// Simulated I2C devices: the registers and the register pointer
+
+struct simI2cStruct
+{
+  unsigned char regs [256] ;
+  unsigned char pointer ;
+} ;
+
+static struct simI2cStruct *simI2cs [128] ;
+static pthread_mutex_t      simBusLock = PTHREAD_MUTEX_INITIALIZER ;
+
+static struct wiringPiSimCountStruct simCounts [2] ;	// I2C, SPI
+
+
+/*
+ * wiringPiSimActive:
+ *	Are we simulating? Decided once, from the environment.
+ *********************************************************************************
+ */
+
+int wiringPiSimActive (void)
+{
+  if (active == -1)
+    active = (getenv (ENV_SIM) != NULL) ;
+
+  return active ;
+}
+
+
+/*
+ * simCpuInfo:
+ *	A stand-in for /proc/cpuinfo with just the lines wiringPi looks at
+ *********************************************************************************
+ */
+
+FILE *simCpuInfo (void)
+{
+  const char *rev = getenv (ENV_SIM) ;
+  const char *c ;
+
+  if ((rev == NULL) || (strlen (rev) < 4))
+    rev = SIM_REVISION ;
+  else
+    for (c = rev ; *c ; ++c)
+      if (strchr ("0123456789abcdefABCDEF", *c) == NULL)
+      {
+	rev = SIM_REVISION ;
+	break ;
+      }
+
+  snprintf (cpuInfo, sizeof (cpuInfo), "Hardware\t: BCM2835\nRevision\t: %s\n", rev) ;
+
+  return fmemopen (cpuInfo, strlen (cpuInfo), "r") ;
+}
+
+
+/*
+ * simMap: simGpioAttach:
+ *	Get some memory to stand in for a peripheral block, and tell us which
+ *	one is the GPIO.
+ *********************************************************************************
+ */
+
+volatile unsigned int *simMap (unsigned int size)
+{
+  void *map ;
+
+  map = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0) ;
+
+  return (map == MAP_FAILED) ? NULL : (volatile unsigned int *)map ;
+}
+
+void simGpioAttach (volatile unsigned int *gpio)
+{
+  simGpio = gpio ;
+}
+
+static volatile unsigned int *simRegs (void)
+{
+  if (simGpio == NULL)		// Sys mode - nobody's mapped one
+  {
+    pthread_mutex_lock (&reqLock) ;
+    if (simGpio == NULL)
+      simGpio = simMap (SIM_BLOCK_SIZE) ;
+    pthread_mutex_unlock (&reqLock) ;
+  }
+
+  return simGpio ;
+}
+
+
+/*
+ * simEdges:
+ *	Some lines in a bank changed level: send an edge to any that want it
+ *********************************************************************************
+ */
+
+static void simEdges (int bank, unsigned int before, unsigned int after)
+{
+  struct gpio_v2_line_event ev ;
+  struct timespec ts ;
+  unsigned int changed = before ^ after ;
+  int bit, line, rising ;
+
+  if (changed == 0)
+    return ;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+
+  for (bit = 0 ; bit < 32 ; ++bit)
+  {
+    if ((changed & (1u << bit)) == 0)
+      continue ;
+
+    line   = bank * 32 + bit ;
+    rising = (after & (1u << bit)) != 0 ;
+
+// Latch it in GPEDS if it's enabled in GPREN/GPFEN
+
+    if ((simGpio [(rising ? SIM_GPREN0 : SIM_GPFEN0) + bank] & (1u << bit)) != 0)
+      __atomic_or_fetch (&simGpio [SIM_GPEDS0 + bank], 1u << bit, __ATOMIC_ACQ_REL) ;
+
+    if (lineWfd [line] <= 0)
+      continue ;
+    if ((lineEdge [line] & (rising ? INT_EDGE_RISING : INT_EDGE_FALLING)) == 0)
+      continue ;
+
+    memset (&ev, 0, sizeof (ev)) ;
+    ev.timestamp_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec ;
+    ev.id           = rising ? GPIO_V2_LINE_EVENT_RISING_EDGE : GPIO_V2_LINE_EVENT_FALLING_EDGE ;
+    ev.offset       = line ;
+    ev.seqno        = __atomic_add_fetch (&seqno, 1, __ATOMIC_RELAXED) ;
+    ev.line_seqno   = ++lineSeqno [line] ;
+
+    (void)send (lineWfd [line] - 1, &ev, sizeof (ev), MSG_DONTWAIT | MSG_NOSIGNAL) ;	// Lost if nobody's reading
+  }
+}
+
+
+/*
+ * simSetLevels:
+ *	Clear then set bits in a bank's level register, with the edges
+ *********************************************************************************
+ */
+
+static void simSetLevels (int bank, unsigned int setMask, unsigned int clrMask)
+{
+  volatile unsigned int *gpio = simRegs () ;
+  unsigned int before, after ;
+
+  if (gpio == NULL)
+    return ;
+
+  before = __atomic_fetch_and (&gpio [SIM_GPLEV0 + bank], ~clrMask, __ATOMIC_ACQ_REL) ;
+  after  = before & ~clrMask ;
+  simEdges (bank, before, after) ;
+
+  before = __atomic_fetch_or (&gpio [SIM_GPLEV0 + bank], setMask, __ATOMIC_ACQ_REL) ;
+  after  = before | setMask ;
+  simEdges (bank, before, after) ;
+}
+
+
+/*
+ * simGpioApply:
+ *	Called after anything's been stored in GPSET or GPCLR: do what the
+ *	hardware would and move it into GPLEV.
+ *********************************************************************************
+ */
+
+void simGpioApply (void)
+{
+  unsigned int setMask, clrMask ;
+  int bank ;
+
+  if (simGpio == NULL)
+    return ;
+
+  for (bank = 0 ; bank < 2 ; ++bank)
+  {
+    setMask = __atomic_exchange_n (&simGpio [SIM_GPSET0 + bank], 0, __ATOMIC_ACQ_REL) ;
+    clrMask = __atomic_exchange_n (&simGpio [SIM_GPCLR0 + bank], 0, __ATOMIC_ACQ_REL) ;
+
+    if ((setMask | clrMask) != 0)
+      simSetLevels (bank, setMask, clrMask) ;
+  }
+}
+
+
+/*
+ * wiringPiSimInput:
+ *	Drive a (BCM_GPIO numbered) pin from outside, as if something was
+ *	connected to it. Edges are delivered as usual.
+ *	Returns 0, or -1 if we're not simulating or the pin's no good.
+ *********************************************************************************
+ */
+
+int wiringPiSimInput (int pin, int value)
+{
+  unsigned int mask ;
+
+  if (!wiringPiSimActive () || (pin < 0) || (pin >= MAX_SIM_LINES))
+    return -1 ;
+
+  mask = 1u << (pin & 31) ;
+
+  if (value == LOW)
+    simSetLevels (pin >> 5, 0, mask) ;
+  else
+    simSetLevels (pin >> 5, mask, 0) ;
+
+  return 0 ;
+}
+
+
+/*
+ * Simulated GPIO character device:
+ *	A request is one end of a socket pair, which edges are written to in the kernel's
+ *	format so gpioChipReadEvents () can't tell the difference. Line
+ *	values come from the simulated registers.
+ *********************************************************************************
+ */
+
+static struct simReqStruct *findReq (int fd)
+{
+  int i ;
+
+  for (i = 0 ; i < MAX_SIM_REQS ; ++i)
+    if ((reqs [i].numLines != 0) && (reqs [i].fd == fd))
+      return &reqs [i] ;
+
+  return NULL ;
+}
+
+int simChipOpen (void)
+{
+  return open ("/dev/null", O_RDWR | O_CLOEXEC) ;
+}
+
+int simLineRequest (const int *lines, int numLines, UNU int mode, int edge)
+{
+  struct simReqStruct *r = NULL ;
+  int fds [2] ;
+  int i ;
+
+  if ((numLines < 1) || (numLines > MAX_SIM_LINES))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  for (i = 0 ; i < numLines ; ++i)
+    if ((lines [i] < 0) || (lines [i] >= MAX_SIM_LINES))
+    {
+      errno = EINVAL ;
+      return -1 ;
+    }
+
+  if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+    return -1 ;
+
+  pthread_mutex_lock (&reqLock) ;
+
+  for (i = 0 ; i < MAX_SIM_REQS ; ++i)
+    if (reqs [i].numLines == 0)
+    {
+      r = &reqs [i] ;
+      break ;
+    }
+
+  if (r == NULL)
+  {
+    pthread_mutex_unlock (&reqLock) ;
+    close (fds [0]) ;
+    close (fds [1]) ;
+    errno = EBUSY ;
+    return -1 ;
+  }
+
+  r->fd       = fds [0] ;
+  r->wfd      = fds [1] ;
+  r->numLines = numLines ;
+  memcpy (r->lines, lines, numLines * sizeof (int)) ;
+
+  for (i = 0 ; i < numLines ; ++i)
+  {
+    lineEdge [lines [i]] = edge ;
+    __atomic_store_n (&lineWfd [lines [i]], fds [1] + 1, __ATOMIC_RELEASE) ;	// + 1 so 0 is none
+  }
+
+  pthread_mutex_unlock (&reqLock) ;
+
+  (void)simRegs () ;
+
+  return fds [0] ;
+}
+
+int simLineReconfig (int reqFd, UNU int mode, int edge)
+{
+  struct simReqStruct *r ;
+  int i ;
+
+  pthread_mutex_lock (&reqLock) ;
+
+  if ((r = findReq (reqFd)) == NULL)
+  {
+    pthread_mutex_unlock (&reqLock) ;
+    errno = EBADF ;
+    return -1 ;
+  }
+
+  for (i = 0 ; i < r->numLines ; ++i)
+    lineEdge [r->lines [i]] = edge ;
+
+  pthread_mutex_unlock (&reqLock) ;
+
+  return 0 ;
+}
+
+int simLineGet (int reqFd, uint64_t mask, uint64_t *values)
+{
+  volatile unsigned int *gpio = simRegs () ;
+  struct simReqStruct *r ;
+  int i, line ;
+
+  if (((r = findReq (reqFd)) == NULL) || (gpio == NULL))
+  {
+    errno = EBADF ;
+    return -1 ;
+  }
+
+  *values = 0 ;
+  for (i = 0 ; i < r->numLines ; ++i)
+  {
+    line = r->lines [i] ;
+    if (((mask & (1ULL << i)) != 0) && ((gpio [SIM_GPLEV0 + (line >> 5)] & (1u << (line & 31))) != 0))
+      *values |= 1ULL << i ;
+  }
+
+  return 0 ;
+}
+
+int simLineSet (int reqFd, uint64_t mask, uint64_t values)
+{
+  struct simReqStruct *r ;
+  int i, line ;
+
+  if ((r = findReq (reqFd)) == NULL)
+  {
+    errno = EBADF ;
+    return -1 ;
+  }
+
+  for (i = 0 ; i < r->numLines ; ++i)
+  {
+    if ((mask & (1ULL << i)) == 0)
+      continue ;
+
+    line = r->lines [i] ;
+    if ((values & (1ULL << i)) != 0)
+      simSetLevels (line >> 5, 1u << (line & 31), 0) ;
+    else
+      simSetLevels (line >> 5, 0, 1u << (line & 31)) ;
+  }
+
+  return 0 ;
+}
+
+
+/*
+ * Simulated expander:
+ *	A node of plain values where every access takes latencyUs (held in
+ *	data0) - roughly what an I2C or SPI round trip would cost.
+ *********************************************************************************
+ */
+
+static struct simNodeStruct *findSimNode (struct wiringPiNodeStruct *node)
+{
+  int i ;
+
+  for (i = 0 ; i < MAX_SIM_NODES ; ++i)
+    if (simNodes [i].node == node)
+      return &simNodes [i] ;
+
+  return NULL ;
+}
+
+static int *simValue (struct wiringPiNodeStruct *node, int pin)
+{
+  struct simNodeStruct *s = findSimNode (node) ;
+
+  if (node->data0 != 0)
+    delayUntilNanos (nanos64 () + (unsigned long long)node->data0 * 1000ULL) ;
+
+  return &s->values [pin - node->pinBase] ;
+}
+
+static void myPinMode (struct wiringPiNodeStruct *node, int pin, UNU int mode)
+{
+  (void)simValue (node, pin) ;
+}
+
+static void myPullUpDnControl (struct wiringPiNodeStruct *node, int pin, int pud)
+{
+  int *v = simValue (node, pin) ;
+
+  /**/ if (pud == PUD_UP)
+    *v = HIGH ;
+  else if (pud == PUD_DOWN)
+    *v = LOW ;
+}
+
+static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
+{
+  return (*simValue (node, pin) != 0) ? HIGH : LOW ;
+}
+
+static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  *simValue (node, pin) = (value != LOW) ? HIGH : LOW ;
+}
+
+static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
+{
+  return *simValue (node, pin) ;
+}
+
+static void myAnalogWrite (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  *simValue (node, pin) = value ;
+}
+
+
+/*
+ * wiringPiSimNode:
+ *	Create a simulated expander of numPins pins at pinBase. It works
+ *	whether or not we're simulating the Pi itself.
+ *	Returns TRUE or FALSE.
+ *********************************************************************************
+ */
+
+int wiringPiSimNode (int pinBase, int numPins, int latencyUs)
+{
+  struct wiringPiNodeStruct *node ;
+  struct simNodeStruct *s ;
+  int *values ;
+
+  if ((numPins < 1) || (latencyUs < 0))
+    return FALSE ;
+
+  if ((s = findSimNode (NULL)) == NULL)
+    return FALSE ;
+
+  if ((values = (int *)calloc (numPins, sizeof (int))) == NULL)
+    return FALSE ;
+
+  node = wiringPiNewNode (pinBase, numPins) ;
+
+  node->data0           = latencyUs ;
+  node->pinMode         = myPinMode ;
+  node->pullUpDnControl = myPullUpDnControl ;
+  node->digitalRead     = myDigitalRead ;
+  node->digitalWrite    = myDigitalWrite ;
+  node->analogRead      = myAnalogRead ;
+  node->analogWrite     = myAnalogWrite ;
+  node->pwmWrite        = myAnalogWrite ;
+
+  s->values = values ;
+  s->node   = node ;
+
+  return TRUE ;
+}
+
+
+/*
+ * wiringPiSimI2c:
+ *	Put a simulated device at an I2C address, its registers all zero.
+ *	Returns TRUE or FALSE.
+ *********************************************************************************
+ */
+
+int wiringPiSimI2c (int addr)
+{
+  struct simI2cStruct *d ;
+
+  if ((addr < 0) || (addr > 127))
+    return FALSE ;
+
+  if ((d = (struct simI2cStruct *)calloc (1, sizeof (*d))) == NULL)
+    return FALSE ;
+
+  pthread_mutex_lock (&simBusLock) ;
+    free (simI2cs [addr]) ;
+    simI2cs [addr] = d ;
+  pthread_mutex_unlock (&simBusLock) ;
+
+  return TRUE ;
+}
+
+
+/*
+ * wiringPiSimI2cLoad:
+ *	Fill a simulated device's registers from reg on, for drivers that
+ *	need calibration data or an ID to work with.
+ *	Returns TRUE or FALSE.
+ *********************************************************************************
+ */
+
+int wiringPiSimI2cLoad (int addr, int reg, const unsigned char *data, int n)
+{
+  int i ;
+
+  if (!simI2cPresent (addr) || (reg < 0) || (n < 0) || (reg + n > 256))
+    return FALSE ;
+
+  pthread_mutex_lock (&simBusLock) ;
+    for (i = 0 ; i < n ; ++i)
+      simI2cs [addr]->regs [reg + i] = data [i] ;
+  pthread_mutex_unlock (&simBusLock) ;
+
+  return TRUE ;
+}
+
+
+/*
+ * wiringPiSimBusCounts:
+ *	Copy out what the simulated I2C or SPI bus has seen, and optionally
+ *	start again from zero.
+ *	Returns 0, or -1 if the bus isn't WPI_SIM_I2C or WPI_SIM_SPI.
+ *********************************************************************************
+ */
+
+int wiringPiSimBusCounts (int bus, struct wiringPiSimCountStruct *counts, int reset)
+{
+  if ((bus != WPI_SIM_I2C) && (bus != WPI_SIM_SPI))
+    return -1 ;
+
+  pthread_mutex_lock (&simBusLock) ;
+    if (counts != NULL)
+      *counts = simCounts [bus] ;
+    if (reset)
+      memset (&simCounts [bus], 0, sizeof (simCounts [bus])) ;
+  pthread_mutex_unlock (&simBusLock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * simI2cPresent: simI2cTransfer:
+ *	Is there a device at this address, and run a combined transaction.
+ *	A write's first byte sets the register pointer and the rest go into
+ *	the registers from there; a read comes from the pointer on. Each
+ *	byte costs 9 bit times, and each message a start and an address.
+ *	A message to an empty address fails as the kernel would.
+ *********************************************************************************
+ */
+
+int simI2cPresent (int addr)
+{
+  return (addr >= 0) && (addr <= 127) && (simI2cs [addr] != NULL) ;
+}
+
+int simI2cTransfer (const int *addrs, const struct wpiI2cMsg *msgs, int numMsgs)
+{
+  struct simI2cStruct *d ;
+  unsigned char *buf ;
+  unsigned long long bits = 1 ;		// The stop
+  unsigned int i, j ;
+  int result = 0 ;
+
+  pthread_mutex_lock (&simBusLock) ;
+
+  for (i = 0 ; i < (unsigned int)numMsgs ; ++i)
+  {
+    bits += 1 + 9 ;
+    if ((addrs [i] < 0) || (addrs [i] > 127) || ((d = simI2cs [addrs [i]]) == NULL))
+    {
+      result = -1 ;			// No ACK: give up here
+      break ;
+    }
+
+    buf   = (unsigned char *)msgs [i].buf ;
+    bits += 9ULL * msgs [i].len ;
+    simCounts [WPI_SIM_I2C].bytes += msgs [i].len ;
+
+    for (j = 0 ; j < msgs [i].len ; ++j)
+      /**/ if (msgs [i].read)
+	buf [j] = d->regs [d->pointer++] ;
+      else if (j == 0)
+	d->pointer = buf [0] ;
+      else
+	d->regs [d->pointer++] = buf [j] ;
+  }
+
+  simCounts [WPI_SIM_I2C].transactions += 1 ;
+  simCounts [WPI_SIM_I2C].busNs        += bits * 1000000000ULL / SIM_I2C_HZ ;
+  if (result < 0)
+    simCounts [WPI_SIM_I2C].errors += 1 ;
+
+  pthread_mutex_unlock (&simBusLock) ;
+
+  if (result < 0)
+    errno = EREMOTEIO ;
+
+  return result ;
+}
+
+
+/*
+ * simSpiTransfer:
+ *	Stands in for the SPI_IOC_MESSAGE ioctl: every segment reads zeros.
+ *	Returns the number of bytes, as the ioctl does.
+ *********************************************************************************
+ */
+
+int simSpiTransfer (const struct spi_ioc_transfer *spi, int n)
+{
+  unsigned long long ns = 0 ;
+  int i, bytes = 0 ;
+
+  for (i = 0 ; i < n ; ++i)
+  {
+    if (spi [i].rx_buf != 0)
+      memset ((void *)(uintptr_t)spi [i].rx_buf, 0, spi [i].len) ;
+    bytes += spi [i].len ;
+    ns    += 8ULL * spi [i].len * 1000000000ULL / ((spi [i].speed_hz == 0) ? 1000000 : spi [i].speed_hz) ;
+    ns    += 1000ULL * spi [i].delay_usecs ;
+  }
+
+  pthread_mutex_lock (&simBusLock) ;
+    simCounts [WPI_SIM_SPI].transactions += 1 ;
+    simCounts [WPI_SIM_SPI].bytes        += bytes ;
+    simCounts [WPI_SIM_SPI].busNs        += ns ;
+  pthread_mutex_unlock (&simBusLock) ;
+
+  return bytes ;
+}
@@ -0,0 +1,78 @@
+/*
+ * wiringPiSim.h:
+ *	A simulated Pi: set WIRINGPI_SIM and wiringPi runs on anything, with
+ *	the GPIO registers in ordinary memory.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+// wiringPiSimBusCounts: what a simulated bus has seen, and how long it
+//	would have taken a real one
+
+#define	WPI_SIM_I2C	0
+#define	WPI_SIM_SPI	1
+
+struct wiringPiSimCountStruct
+{
+  unsigned long long transactions ;
+  unsigned long long bytes ;
+  unsigned long long busNs ;
+  unsigned long long errors ;
+} ;
+
+struct wpiI2cMsg ;
+struct spi_ioc_transfer ;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// For programs
+
+extern int  wiringPiSimActive (void) ;
+extern int  wiringPiSimInput  (int pin, int value) ;
+extern int  wiringPiSimNode   (int pinBase, int numPins, int latencyUs) ;
+extern int  wiringPiSimI2c    (int addr) ;
+extern int  wiringPiSimI2cLoad (int addr, int reg, const unsigned char *data, int n) ;
+extern int  wiringPiSimBusCounts (int bus, struct wiringPiSimCountStruct *counts, int reset) ;
+
+// For the rest of wiringPi
+
+extern FILE                  *simCpuInfo   (void) ;
+extern volatile unsigned int *simMap       (unsigned int size) ;
+extern void                   simGpioAttach (volatile unsigned int *gpio) ;
+extern void                   simGpioApply (void) ;
+
+extern int  simChipOpen     (void) ;
+extern int  simLineRequest  (const int *lines, int numLines, int mode, int edge) ;
+extern int  simLineReconfig (int reqFd, int mode, int edge) ;
+extern int  simLineGet      (int reqFd, uint64_t mask, uint64_t *values) ;
+extern int  simLineSet      (int reqFd, uint64_t mask, uint64_t values) ;
+
+extern int  simI2cPresent   (int addr) ;
+extern int  simI2cTransfer  (const int *addrs, const struct wpiI2cMsg *msgs, int numMsgs) ;
+extern int  simSpiTransfer  (const struct spi_ioc_transfer *spi, int n) ;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,414 @@
+/*
+ * wiringPiSlave.c:
+ *	The Pi as an I2C or SPI slave, with the BSC slave peripheral.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+
+/*
+ * Notes:
+ *	The BCM2835-2711 have one BSC slave, which can be an I2C or SPI slave
+ *	with 16 byte FIFOs each way. It can't stretch the clock, and has no
+ *	interrupt we can get at from user space, so a thread (real-time if
+ *	given a priority) busy-polls it and looks after the FIFOs.
+ *
+ *	It looks to the master like a register file of numRegs bytes, as most
+ *	I2C devices do: the first byte of a transaction is the register, any
+ *	more are written there and on, and a read - after a repeated start -
+ *	gets the register and on. onWrite is called from the thread once a
+ *	transaction that wrote something is over, with the first register
+ *	and how many, so keep it short. Registers made read-only ignore the
+ *	master's writes.
+ *
+ *	The slave can't see START or STOP, so a transaction is taken to be
+ *	over once the bus has been quiet (nothing in the FIFOs, not busy) for
+ *	WPI_SLAVE_GAP_US - change with wiringPiSlaveGap (). Then whatever the
+ *	master didn't read is thrown away, so reads must come after the
+ *	register's been written, as they do with SMBus. As an SPI slave a
+ *	master reading needs to leave a few uS after the register byte for
+ *	the thread to have the data ready.
+ *
+ *	The pins are GPIO 18 (SDA/MOSI), 19 (SCL/SCLK), 20 (MISO) and 21 (CE)
+ *	on the earlier chips, 10, 11, 9 and 8 on the 2711. It needs /dev/mem,
+ *	and isn't there on the Pi 5.
+ *********************************************************************************
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <pthread.h>
+
+#include "wiringPi.h"
+#include "wiringPiConfig.h"
+#include "wiringPiSlave.h"
+
+#define	BSC_SL_OFFSET	0x00214000
+
+// Registers (word offsets)
+
+#define	BSC_DR		0
+#define	BSC_RSR		1
+#define	BSC_SLV		2
+#define	BSC_CR		3
+#define	BSC_FR		4
+#define	BSC_IMSC	6
+
+#define	BSC_RSR_OE	0x01
+#define	BSC_RSR_UE	0x02
+
+#define	BSC_CR_EN	0x001
+#define	BSC_CR_SPI	0x002
+#define	BSC_CR_I2C	0x004
+#define	BSC_CR_CPHA	0x008
+#define	BSC_CR_CPOL	0x010
+#define	BSC_CR_BRK	0x080
+#define	BSC_CR_TXE	0x100
+#define	BSC_CR_RXE	0x200
+
+#define	BSC_FR_TXBUSY	0x01
+#define	BSC_FR_RXFE	0x02
+#define	BSC_FR_TXFF	0x04
+#define	BSC_FR_RXBUSY	0x20
+
+#define	FSEL_ALT3	7
+
+// SDA/MOSI, SCL/SCLK, MISO, CE
+
+static const int pins2835 [4] = { 18, 19, 20, 21 } ;
+static const int pins2711 [4] = { 10, 11,  9,  8 } ;
+
+static volatile unsigned int *bsc = NULL ;
+static const int   *slavePins ;
+static int          numPins ;
+static uint32_t     slaveCr ;
+static int          numRegs ;
+static int          slavePri ;
+static void       (*onWrite)(void *context, int reg, int n) ;
+static void        *onWriteContext ;
+static uint8_t      regs     [WPI_SLAVE_MAX_REGS] ;
+static uint8_t      readOnly [WPI_SLAVE_MAX_REGS / 8] ;
+static unsigned int errors ;
+static unsigned long long gapNs = WPI_SLAVE_GAP_US * 1000ULL ;
+
+static pthread_t        slaveThreadId ;
+static volatile int     running = FALSE ;
+static pthread_mutex_t  slaveLock = PTHREAD_MUTEX_INITIALIZER ;
+
+
+/*
+ * slaveFsel:
+ *	Set the function of one BCM_GPIO pin
+ *********************************************************************************
+ */
+
+static void slaveFsel (int pin, int fsel)
+{
+  volatile unsigned int *reg = _wiringPiGpio + (pin / 10) ;
+  int shift = (pin % 10) * 3 ;
+
+  wpiConfigLock (WPI_CONFIG_FSEL (pin / 10)) ;
+    *reg = (*reg & ~(7 << shift)) | (fsel << shift) ;
+  wpiConfigUnlock (WPI_CONFIG_FSEL (pin / 10)) ;
+}
+
+
+/*
+ * slaveThread:
+ *	Keep the FIFOs going
+ *********************************************************************************
+ */
+
+static void *slaveThread (void *arg)
+{
+  unsigned long long lastBusy = 0, now ;
+  uint32_t fr ;
+  int active = FALSE, moved, first = 0, n = 0, reg = 0, next = 0, b ;
+
+  (void)arg ;
+
+  if (slavePri > 0)
+    (void)piHiPri (slavePri) ;
+
+  while (running)
+  {
+    fr    = *(bsc + BSC_FR) ;
+    moved = FALSE ;
+
+// From the master: the register, then what's to be written there and on
+
+    while ((fr & BSC_FR_RXFE) == 0)
+    {
+      b = *(bsc + BSC_DR) & 0xFF ;
+
+      if (!active)
+      {
+	active = TRUE ;
+	reg    = first = next = b % numRegs ;
+	n      = 0 ;
+      }
+      else
+      {
+	if ((readOnly [reg / 8] & (1 << (reg % 8))) == 0)
+	  __atomic_store_n (&regs [reg], (uint8_t)b, __ATOMIC_RELAXED) ;
+	reg = (reg + 1) % numRegs ;
+	++n ;
+      }
+
+      moved = TRUE ;
+      fr    = *(bsc + BSC_FR) ;
+    }
+
+// To the master: keep the transmit FIFO full from the register on
+
+    if (active)
+      while ((fr & BSC_FR_TXFF) == 0)
+      {
+	*(bsc + BSC_DR) = __atomic_load_n (&regs [next], __ATOMIC_RELAXED) ;
+	next = (next + 1) % numRegs ;
+	fr   = *(bsc + BSC_FR) ;
+      }
+
+    if ((*(bsc + BSC_RSR) & (BSC_RSR_OE | BSC_RSR_UE)) != 0)
+    {
+      __atomic_add_fetch (&errors, 1, __ATOMIC_RELAXED) ;
+      *(bsc + BSC_RSR) = 0 ;
+    }
+
+// Quiet for long enough: it's over. Throw away what wasn't read.
+
+    now = nanos64 () ;
+
+    if (moved || ((fr & (BSC_FR_RXBUSY | BSC_FR_TXBUSY)) != 0))
+      lastBusy = now ;
+    else if (active && ((now - lastBusy) > __atomic_load_n (&gapNs, __ATOMIC_RELAXED)))
+    {
+      *(bsc + BSC_CR) = slaveCr | BSC_CR_BRK ;
+      *(bsc + BSC_CR) = slaveCr ;
+      active = FALSE ;
+
+      if ((n > 0) && (onWrite != NULL))
+	onWrite (onWriteContext, first, n) ;
+    }
+  }
+
+  return NULL ;
+}
+
+
+/*
+ * wiringPiSlaveSetup:
+ *	Start being an I2C slave at addr, or an SPI slave in the given mode,
+ *	with numRegs registers, all 0 to start with. pri, if not 0, is the
+ *	real-time priority of the thread.
+ *	Returns 0 or -1 with errno set.
+ *********************************************************************************
+ */
+
+int wiringPiSlaveSetup (int mode, int addr, int count, void (*function)(void *context, int reg, int n), void *context, int pri)
+{
+  unsigned int base = wiringPiPeriBase () ;
+  int i ;
+
+  if ((mode < WPI_SLAVE_I2C) || (mode > WPI_SLAVE_SPI3) || (count < 1) || (count > WPI_SLAVE_MAX_REGS) ||
+	((mode == WPI_SLAVE_I2C) && ((addr < 0x08) || (addr > 0x77))))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  pthread_mutex_lock (&slaveLock) ;
+
+  if (running)
+  {
+    pthread_mutex_unlock (&slaveLock) ;
+    errno = EBUSY ;
+    return -1 ;
+  }
+
+  if ((base == 0) || (_wiringPiGpio == NULL))		// No /dev/mem, or a Pi 5
+  {
+    pthread_mutex_unlock (&slaveLock) ;
+    errno = ENODEV ;
+    return -1 ;
+  }
+
+  if ((bsc == NULL) && ((bsc = wiringPiPeriMap (BSC_SL_OFFSET, 4096)) == NULL))
+  {
+    pthread_mutex_unlock (&slaveLock) ;
+    errno = EACCES ;
+    return -1 ;
+  }
+
+  slavePins      = (base == 0xFE000000) ? pins2711 : pins2835 ;
+  numPins        = (mode == WPI_SLAVE_I2C) ? 2 : 4 ;
+  numRegs        = count ;
+  onWrite        = function ;
+  onWriteContext = context ;
+  slavePri       = pri ;
+  errors         = 0 ;
+  memset (regs,     0, sizeof (regs)) ;
+  memset (readOnly, 0, sizeof (readOnly)) ;
+
+  if (mode == WPI_SLAVE_I2C)
+    slaveCr = BSC_CR_EN | BSC_CR_I2C | BSC_CR_TXE | BSC_CR_RXE ;
+  else
+    slaveCr = BSC_CR_EN | BSC_CR_SPI | BSC_CR_TXE | BSC_CR_RXE |
+	(((mode & 1) != 0) ? BSC_CR_CPHA : 0) | (((mode & 2) != 0) ? BSC_CR_CPOL : 0) ;
+
+  *(bsc + BSC_CR)   = 0 ;
+  *(bsc + BSC_IMSC) = 0 ;
+  *(bsc + BSC_RSR)  = 0 ;
+  *(bsc + BSC_SLV)  = (mode == WPI_SLAVE_I2C) ? addr : 0 ;
+
+  for (i = 0 ; i < numPins ; ++i)
+    slaveFsel (slavePins [i], FSEL_ALT3) ;
+
+  *(bsc + BSC_CR) = slaveCr | BSC_CR_BRK ;
+  *(bsc + BSC_CR) = slaveCr ;
+
+  running = TRUE ;
+  if (pthread_create (&slaveThreadId, NULL, slaveThread, NULL) != 0)
+  {
+    running = FALSE ;
+    *(bsc + BSC_CR) = 0 ;
+    for (i = 0 ; i < numPins ; ++i)
+      slaveFsel (slavePins [i], 0) ;
+    pthread_mutex_unlock (&slaveLock) ;
+    errno = EAGAIN ;
+    return -1 ;
+  }
+
+  pthread_mutex_unlock (&slaveLock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * wiringPiSlaveStop:
+ *	Stop being a slave and put the pins back to inputs
+ *********************************************************************************
+ */
+
+void wiringPiSlaveStop (void)
+{
+  int i ;
+
+  pthread_mutex_lock (&slaveLock) ;
+
+  if (running)
+  {
+    running = FALSE ;
+    pthread_join (slaveThreadId, NULL) ;
+
+    *(bsc + BSC_CR) = BSC_CR_BRK ;
+    *(bsc + BSC_CR) = 0 ;
+    for (i = 0 ; i < numPins ; ++i)
+      slaveFsel (slavePins [i], 0) ;
+  }
+
+  pthread_mutex_unlock (&slaveLock) ;
+}
+
+
+/*
+ * wiringPiSlaveRead:
+ * wiringPiSlaveWrite:
+ *	Our side of the register file. A register written here is what
+ *	the master reads from the next transaction on. Read returns the
+ *	register, Write 0; both -1 with errno set for a bad register.
+ *********************************************************************************
+ */
+
+int wiringPiSlaveRead (int reg)
+{
+  if ((reg < 0) || (reg >= numRegs))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  return __atomic_load_n (&regs [reg], __ATOMIC_RELAXED) ;
+}
+
+int wiringPiSlaveWrite (int reg, int value)
+{
+  if ((reg < 0) || (reg >= numRegs))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  __atomic_store_n (&regs [reg], (uint8_t)value, __ATOMIC_RELAXED) ;
+
+  return 0 ;
+}
+
+
+/*
+ * wiringPiSlaveReadOnly:
+ *	Have the master's writes to a register ignored, or not
+ *********************************************************************************
+ */
+
+int wiringPiSlaveReadOnly (int reg, int on)
+{
+  if ((reg < 0) || (reg >= numRegs))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  if (on)
+    __atomic_or_fetch  (&readOnly [reg / 8],  (uint8_t)(1 << (reg % 8)), __ATOMIC_RELAXED) ;
+  else
+    __atomic_and_fetch (&readOnly [reg / 8], (uint8_t)~(1 << (reg % 8)), __ATOMIC_RELAXED) ;
+
+  return 0 ;
+}
+
+
+/*
+ * wiringPiSlaveGap:
+ *	How long the bus needs to be quiet for to end a transaction
+ *********************************************************************************
+ */
+
+void wiringPiSlaveGap (int us)
+{
+  if (us > 0)
+    __atomic_store_n (&gapNs, (unsigned long long)us * 1000ULL, __ATOMIC_RELAXED) ;
+}
+
+
+/*
+ * wiringPiSlaveErrors:
+ *	How many times the master's overrun the receive FIFO, or been
+ *	sent nothing
+ *********************************************************************************
+ */
+
+unsigned int wiringPiSlaveErrors (void)
+{
+  return __atomic_load_n (&errors, __ATOMIC_RELAXED) ;
+}
@@ -0,0 +1,50 @@
+/*
+ * wiringPiSlave.h:
+ *	The Pi as an I2C or SPI slave, with the BSC slave peripheral.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+// Modes: I2C, or SPI mode 0-3 (CPOL << 1 | CPHA)
+
+#define	WPI_SLAVE_I2C		-1
+#define	WPI_SLAVE_SPI0		0
+#define	WPI_SLAVE_SPI1		1
+#define	WPI_SLAVE_SPI2		2
+#define	WPI_SLAVE_SPI3		3
+
+#define	WPI_SLAVE_MAX_REGS	256
+#define	WPI_SLAVE_GAP_US	50		// Quiet on the bus for this long ends a transaction
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int          wiringPiSlaveSetup    (int mode, int addr, int numRegs, void (*onWrite)(void *context, int reg, int n), void *context, int pri) ;
+extern void         wiringPiSlaveStop     (void) ;
+extern int          wiringPiSlaveRead     (int reg) ;
+extern int          wiringPiSlaveWrite    (int reg, int value) ;
+extern int          wiringPiSlaveReadOnly (int reg, int readOnly) ;
+extern void         wiringPiSlaveGap      (int us) ;
+extern unsigned int wiringPiSlaveErrors   (void) ;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,81 @@
+/*
+ * wiringPiTrace.h:
+ *	Static (USDT) tracepoints for the hot paths. These are compiled out
+ *	unless built with WIRINGPI_USDT (make USDT=1), which needs <sys/sdt.h>
+ *	from systemtap-sdt-dev. Even then each probe is guarded by its
+ *	semaphore, which the kernel only sets while bpftrace or perf is
+ *	attached, so the clock isn't even read unless someone is looking.
+ *	The provider is "wiringpi" and the probes, with their arguments, are:
+ *
+ *	node_dispatch	(pin, node, pinBase)
+ *	i2c		(fd, command, size, nS)
+ *	spi		(bus << 4 | channel, len, result, nS)
+ *	serial_write	(fd, len, result, nS)
+ *	serial_getchar	(fd, char or -1, 1, nS)
+ *	drcnet_send	(pin, node, command, nS)
+ *	drcnet_transact	(pin, node, command, nS)
+ *	drcnet_batch	(node, bytes, replies, nS)
+ *
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#ifdef	WIRINGPI_USDT
+
+#define	_SDT_HAS_SEMAPHORES	1
+#include <sys/sdt.h>
+#include <time.h>
+
+static inline unsigned long long wpiTraceNow (void)
+{
+  struct timespec ts ;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec ;
+}
+
+// Define a probe's semaphore, once, in the file with the probe
+
+#define	WPI_TRACE_SEMAPHORE(name)	\
+	unsigned short wiringpi_##name##_semaphore __attribute__ ((section (".probes")))
+
+#define	WPI_TRACE_ON(name)	__builtin_expect (wiringpi_##name##_semaphore != 0, 0)
+
+// A timed probe: BEGIN at the start, END with three values at the end
+
+#define	WPI_TRACE_BEGIN(name)	\
+	unsigned long long wpiTrace_##name = WPI_TRACE_ON (name) ? wpiTraceNow () : 0
+
+#define	WPI_TRACE_END(name, a, b, c)	\
+	do { if (WPI_TRACE_ON (name)) DTRACE_PROBE4 (wiringpi, name, a, b, c, wpiTraceNow () - wpiTrace_##name) ; } while (0)
+
+// An instant
+
+#define	WPI_TRACE(name, a, b, c)	\
+	do { if (WPI_TRACE_ON (name)) DTRACE_PROBE3 (wiringpi, name, a, b, c) ; } while (0)
+
+#else
+
+#define	WPI_TRACE_SEMAPHORE(name)	struct wpiTraceUnused_##name
+#define	WPI_TRACE_BEGIN(name)		do { } while (0)
+#define	WPI_TRACE_END(name, a, b, c)	do { } while (0)
+#define	WPI_TRACE(name, a, b, c)	do { } while (0)
+
+#endif
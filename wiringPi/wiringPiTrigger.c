@@ -0,0 +1,273 @@
+/*
+ * wiringPiTrigger.c:
+ *	Sample an ADC on an edge, from the ISR dispatcher.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+
+/*
+ * Notes:
+ *	A trigger is a wiringPiISRex () function that does the one thing:
+ *	runs a transaction set up beforehand - analogReadRange () on a node,
+ *	which the mcp300x drivers do in one SPI transfer, or a raw SPI
+ *	transfer with the bytes ready to go - and puts the result, with the
+ *	edge time and the times either side of the transfer, into a ring.
+ *	So the sample is taken on the thread that got the edge, as soon as
+ *	it's woken, rather than after waking another to do it.
+ *	Read the samples with wiringPiTriggerRead (), or wait for them on
+ *	wiringPiTriggerFd ().
+ *********************************************************************************
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "wiringPi.h"
+#include "wiringPiSPI.h"
+#include "wiringPiTrigger.h"
+
+#define	TRIGGER_NODE	0
+#define	TRIGGER_SPI	1
+
+struct wpiTriggerStruct
+{
+  struct piRingStruct *ring ;
+  volatile int         armed ;
+  int                  type ;
+  int                  adcPin ;		// TRIGGER_NODE
+  int                  count ;
+  int                  channel ;	// TRIGGER_SPI
+  unsigned char        tx [WPI_TRIGGER_MAX_VALUES] ;
+  unsigned char        rx [WPI_TRIGGER_MAX_VALUES] ;
+  struct wpiSpiSeg     seg ;
+  unsigned int         lost ;		// Ring was full
+} ;
+
+static struct wpiTriggerStruct *triggers [64] ;
+
+
+static unsigned long long monoNanos (void)
+{
+  struct timespec ts ;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec ;
+}
+
+
+/*
+ * triggerFire:
+ *	The ISR: take the sample
+ *********************************************************************************
+ */
+
+static void triggerFire (void *context, const struct wpiEdgeEventStruct *event)
+{
+  struct wpiTriggerStruct *t = (struct wpiTriggerStruct *)context ;
+  struct wpiTriggerSample s ;
+  int i ;
+
+  if (!t->armed)
+    return ;
+
+  s.edgeNs  = event->timestamp ;
+  s.edge    = event->edge ;
+  s.startNs = monoNanos () ;
+
+  if (t->type == TRIGGER_NODE)
+    s.count = analogReadRange (t->adcPin, t->count, s.values) ;
+  else
+  {
+    if ((s.count = wiringPiSPITransfer (t->channel, &t->seg, 1)) < 0)
+      s.count = 0 ;
+    for (i = 0 ; i < s.count ; ++i)
+      s.values [i] = t->rx [i] ;
+  }
+
+  s.doneNs = monoNanos () ;
+
+  if (piRingPush (t->ring, &s, 1) != 1)
+    __atomic_add_fetch (&t->lost, 1, __ATOMIC_RELAXED) ;
+}
+
+
+/*
+ * triggerCreate:
+ *	Set up a trigger and hook it on to the pin
+ *********************************************************************************
+ */
+
+static int triggerCreate (int pin, int mode, struct wpiTriggerStruct *proto, int depth)
+{
+  struct wpiTriggerStruct *t ;
+
+  if ((pin < 0) || (pin > 63) || (depth < 1))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  if (triggers [pin] != NULL)
+  {
+    errno = EBUSY ;
+    return -1 ;
+  }
+
+  if ((t = (struct wpiTriggerStruct *)malloc (sizeof (*t))) == NULL)
+  {
+    errno = ENOMEM ;
+    return -1 ;
+  }
+
+  *t = *proto ;
+  t->lost      = 0 ;
+  t->armed     = TRUE ;
+  t->seg.tx    = t->tx ;
+  t->seg.rx    = t->rx ;
+
+  if ((t->ring = piRingCreate (PI_RING_SPSC, sizeof (struct wpiTriggerSample), depth, TRUE)) == NULL)
+  {
+    free (t) ;
+    errno = ENOMEM ;
+    return -1 ;
+  }
+
+  triggers [pin] = t ;
+
+  if (wiringPiISRex (pin, mode, triggerFire, t) < 0)
+  {
+    triggers [pin] = NULL ;
+    piRingFree (t->ring) ;
+    free (t) ;
+    return -1 ;
+  }
+
+  return 0 ;
+}
+
+
+/*
+ * wiringPiTriggerAnalog:
+ *	On each mode edge (INT_EDGE_RISING etc.) of an on-board pin, read
+ *	count pins of an analog node from adcPin on, all in one go if the
+ *	driver can. depth samples are kept until read.
+ *	Returns 0 or -1 with errno set.
+ *********************************************************************************
+ */
+
+int wiringPiTriggerAnalog (int pin, int mode, int adcPin, int count, int depth)
+{
+  struct wpiTriggerStruct proto ;
+
+  if ((count < 1) || (count > WPI_TRIGGER_MAX_VALUES) || (wiringPiFindNode (adcPin) == NULL))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  memset (&proto, 0, sizeof (proto)) ;
+  proto.type   = TRIGGER_NODE ;
+  proto.adcPin = adcPin ;
+  proto.count  = count ;
+
+  return triggerCreate (pin, mode, &proto, depth) ;
+}
+
+
+/*
+ * wiringPiTriggerSPI:
+ *	As above, but send len bytes of tx on an SPI channel that's already
+ *	been set up, and keep the bytes that come back - for an ADC without
+ *	a driver, or to skip the driver's work on the way.
+ *********************************************************************************
+ */
+
+int wiringPiTriggerSPI (int pin, int mode, int channel, const unsigned char *tx, int len, int depth)
+{
+  struct wpiTriggerStruct proto ;
+
+  if ((len < 1) || (len > WPI_TRIGGER_MAX_VALUES) || (tx == NULL))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  memset (&proto, 0, sizeof (proto)) ;
+  proto.type    = TRIGGER_SPI ;
+  proto.channel = channel ;
+  proto.count   = len ;
+  memcpy (proto.tx, tx, len) ;
+  proto.seg.len = len ;
+
+  return triggerCreate (pin, mode, &proto, depth) ;
+}
+
+
+/*
+ * wiringPiTriggerRead:
+ * wiringPiTriggerFd:
+ * wiringPiTriggerLost:
+ *	Take up to max samples, oldest first, returning how many; an fd that
+ *	polls readable while there are some; and how many were lost because
+ *	the ring was full.
+ *********************************************************************************
+ */
+
+int wiringPiTriggerRead (int pin, struct wpiTriggerSample *samples, int max)
+{
+  if ((pin < 0) || (pin > 63) || (triggers [pin] == NULL) || (max < 1))
+    return 0 ;
+
+  return (int)piRingPop (triggers [pin]->ring, samples, (unsigned int)max) ;
+}
+
+int wiringPiTriggerFd (int pin)
+{
+  if ((pin < 0) || (pin > 63) || (triggers [pin] == NULL))
+    return -1 ;
+
+  return piRingFd (triggers [pin]->ring) ;
+}
+
+unsigned int wiringPiTriggerLost (int pin)
+{
+  if ((pin < 0) || (pin > 63) || (triggers [pin] == NULL))
+    return 0 ;
+
+  return __atomic_load_n (&triggers [pin]->lost, __ATOMIC_RELAXED) ;
+}
+
+
+/*
+ * wiringPiTriggerStop:
+ *	Stop sampling on a pin's edges. The ISR stays attached (there is no
+ *	taking one off), so the trigger and what's in its ring do too, and
+ *	another trigger can't go on the pin.
+ *********************************************************************************
+ */
+
+void wiringPiTriggerStop (int pin)
+{
+  if ((pin >= 0) && (pin <= 63) && (triggers [pin] != NULL))
+    triggers [pin]->armed = FALSE ;
+}
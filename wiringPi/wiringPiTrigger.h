@@ -0,0 +1,56 @@
+/*
+ * wiringPiTrigger.h:
+ *	Sample an ADC on an edge, from the ISR dispatcher.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#define	WPI_TRIGGER_MAX_VALUES	16
+
+// wpiTriggerSample:
+//	One triggered sample. The times are CLOCK_MONOTONIC in nS: the edge
+//	(as the kernel saw it, with the gpio chip) and either side of the
+//	transaction. values are the node's analogRead () values, or the bytes
+//	that came back for a raw SPI trigger.
+
+struct wpiTriggerSample
+{
+  unsigned long long edgeNs ;
+  unsigned long long startNs ;
+  unsigned long long doneNs ;
+  int                edge ;		// INT_EDGE_RISING or INT_EDGE_FALLING
+  int                count ;
+  int                values [WPI_TRIGGER_MAX_VALUES] ;
+} ;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int  wiringPiTriggerAnalog (int pin, int mode, int adcPin, int count, int depth) ;
+extern int  wiringPiTriggerSPI    (int pin, int mode, int channel, const unsigned char *tx, int len, int depth) ;
+extern int  wiringPiTriggerRead   (int pin, struct wpiTriggerSample *samples, int max) ;
+extern int  wiringPiTriggerFd     (int pin) ;
+extern unsigned int wiringPiTriggerLost (int pin) ;
+extern void wiringPiTriggerStop   (int pin) ;
+
+#ifdef __cplusplus
+}
+#endif
@@ -31,21 +31,233 @@
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <linux/serial.h>
 
+#include "wiringPi.h"
 #include "wiringSerial.h"
+#include "wiringPiTrace.h"
+
+// Optional userspace output buffering, per fd. Off by default so
+//	serialPutchar () etc. behave as they always have.
+
+#define	MAX_SERIAL_FDS	1024
+
+struct serialOutStruct
+{
+  unsigned int  threshold ;	// Flush when we get this many bytes
+  unsigned int  count ;
+  unsigned char buf [SERIAL_OUT_BUF_SIZE] ;
+} ;
+
+static struct serialOutStruct *outBufs [MAX_SERIAL_FDS] ;
+
+// Background reader: a thread per port that pulls data from the UART into
+//	a piRing as soon as it arrives. The ring's eventfd is readable while
+//	there's data in it so it can go into a poll/epoll loop. The ring has
+//	the one consumer, so only one thread should read a port at a time.
+
+struct serialInStruct
+{
+  int                  fd ;
+  int                  stopFd ;
+  pthread_t            thread ;
+  struct piRingStruct *ring ;
+  int                  error ;
+} ;
+
+static struct serialInStruct *inBufs [MAX_SERIAL_FDS] ;
+
+static unsigned char nonBlocking [MAX_SERIAL_FDS] ;
+
+// Bus statistics: each port's slot, plus one so that zero is none, and
+//	how long a character takes so its busy time is its time on the wire
+
+static int          statsSlots  [MAX_SERIAL_FDS] ;
+static unsigned int statsCharNs [MAX_SERIAL_FDS] ;
+
+// RS-485 with a GPIO driver enable: writes are handed to a thread of the
+//	port's own, at real-time priority, which raises DE, writes, watches for
+//	the transmitter to empty and drops DE again, while the writer waits.
+
+struct serialRS485Struct
+{
+  int             fd ;
+  wpiPin_t        de ;
+  unsigned int    preUs ;
+  unsigned int    postUs ;
+  unsigned int    charNs ;		// One character on the wire
+  pthread_t       thread ;
+  pthread_mutex_t lock ;
+  pthread_cond_t  work ;
+  pthread_cond_t  done ;
+  const unsigned char *buf ;		// A frame to send, NULL for none
+  unsigned int    len ;
+  int             result ;
+  int             stop ;
+} ;
+
+static struct serialRS485Struct *rs485s [MAX_SERIAL_FDS] ;
+
+static int rs485Send (struct serialRS485Struct *r, const unsigned char *buf, unsigned int len) ;
+
+// The kernel's termios2 lets us ask for any baud rate (BOTHER) rather
+//	than just the Bxxx ones. glibc's <termios.h> and the kernel's
+//	<asm/termbits.h> can't both be included, so we have our own copy.
+
+struct wpiTermios2
+{
+  tcflag_t c_iflag ;
+  tcflag_t c_oflag ;
+  tcflag_t c_cflag ;
+  tcflag_t c_lflag ;
+  cc_t     c_line ;
+  cc_t     c_cc [19] ;
+  speed_t  c_ispeed ;
+  speed_t  c_ospeed ;
+} ;
+
+#define	WPI_TCGETS2	_IOR ('T', 0x2A, struct wpiTermios2)
+#define	WPI_TCSETS2	_IOW ('T', 0x2B, struct wpiTermios2)
+
+#ifndef	BOTHER
+#define	BOTHER		0010000
+#endif
+
+#ifndef	IBSHIFT
+#define	IBSHIFT		16
+#endif
+
+static unsigned int charTime (const int fd) ;
+
+static struct serialOutStruct *outBuf (const int fd)
+{
+  if ((fd < 0) || (fd >= MAX_SERIAL_FDS))
+    return NULL ;
+
+  return outBufs [fd] ;
+}
+
+
+/*
+ * serialStats: serialRetry:
+ *	Count a read or write of n bytes, or one that had to go round again
+ *********************************************************************************
+ */
+
+static void serialStats (const int fd, int n, int error)
+{
+  if ((fd < 0) || (fd >= MAX_SERIAL_FDS))
+    return ;
+
+  if (n < 0)
+    n = 0 ;
+
+  wiringPiBusStatsAdd (statsSlots [fd] - 1, (unsigned long long)n * statsCharNs [fd], n, error) ;
+}
+
+static void serialRetry (const int fd)
+{
+  if ((fd >= 0) && (fd < MAX_SERIAL_FDS))
+    wiringPiBusStatsRetry (statsSlots [fd] - 1) ;
+}
+
+
+/*
+ * writeRaw:
+ * writeAll:
+ *	Push out a buffer, coping with partial writes and signals - via the
+ *	RS-485 thread if the port has one
+ *********************************************************************************
+ */
+
+static int writeRaw (const int fd, const unsigned char *buf, unsigned int len)
+{
+  unsigned int total = len ;
+  ssize_t n ;
+
+  while (len > 0)
+  {
+    if ((n = write (fd, buf, len)) < 0)
+    {
+      if (errno == EINTR)
+      {
+        serialRetry (fd) ;
+        continue ;
+      }
+      serialStats (fd, total - len, TRUE) ;
+      return -1 ;
+    }
+    buf += n ;
+    len -= n ;
+    if (len > 0)
+      serialRetry (fd) ;		// A partial write
+  }
+
+  serialStats (fd, total, FALSE) ;
+
+  return 0 ;
+}
+
+static int writeAll (const int fd, const unsigned char *buf, unsigned int len)
+{
+  if ((fd >= 0) && (fd < MAX_SERIAL_FDS) && (rs485s [fd] != NULL))
+    return rs485Send (rs485s [fd], buf, len) ;
+
+  return writeRaw (fd, buf, len) ;
+}
+
+/*
+ * setCustomBaud:
+ *	Set a non-standard baud rate via termios2
+ *********************************************************************************
+ */
+
+static int setCustomBaud (const int fd, const int baud)
+{
+  struct wpiTermios2 tio ;
+
+  if (ioctl (fd, WPI_TCGETS2, &tio) == -1)
+    return -1 ;
+
+  tio.c_cflag &= ~CBAUD ;
+  tio.c_cflag |=  BOTHER ;
+  tio.c_cflag &= ~(CBAUD << IBSHIFT) ;
+  tio.c_cflag |=  BOTHER << IBSHIFT ;
+  tio.c_ispeed = baud ;
+  tio.c_ospeed = baud ;
+
+  return ioctl (fd, WPI_TCSETS2, &tio) ;
+}
+
 
 /*
  * serialOpen:
+ * serialOpenEx:
  *	Open and initialise the serial port, setting all the right
  *	port parameters - or as many as are required - hopefully!
+ *	serialOpen is 8N1 with no flow control. serialOpenEx takes a
+ *	serialOptsStruct (or NULL for the same defaults) for the frame
+ *	format, RTS/CTS flow control, the driver's low-latency flag and
+ *	non-blocking reads.
+ *	Any baud rate is allowed: the standard ones go through termios as
+ *	usual and anything else is set with termios2/BOTHER, if the UART
+ *	driver can do it.
  *********************************************************************************
  */
 
-int serialOpen (const char *device, const int baud)
+int serialOpenEx (const char *device, const int baud, const struct serialOptsStruct *opts)
 {
   struct termios options ;
+  struct serial_struct serial ;
   speed_t myBaud ;
   int     status, fd ;
+  int     dataBits, stopBits ;
+  char    parity ;
 
   switch (baud)
   {
@@ -81,9 +293,29 @@ int serialOpen (const char *device, const int baud)
     case 4000000:	myBaud = B4000000 ; break ;
 
     default:
-      return -2 ;
+      if (baud <= 0)
+        return -2 ;
+      myBaud = B38400 ;		// Placeholder until we set the real one
+      break ;
   }
 
+  dataBits = 8 ;
+  parity   = 'N' ;
+  stopBits = 1 ;
+
+  if (opts != NULL)
+  {
+    if (opts->dataBits != 0) dataBits = opts->dataBits ;
+    if (opts->parity   != 0) parity   = opts->parity ;
+    if (opts->stopBits != 0) stopBits = opts->stopBits ;
+  }
+
+  if ((dataBits < 5) || (dataBits > 8) || ((stopBits != 1) && (stopBits != 2)))
+    return -2 ;
+
+  if ((parity != 'N') && (parity != 'E') && (parity != 'O'))
+    return -2 ;
+
   if ((fd = open (device, O_RDWR | O_NOCTTY | O_NDELAY | O_NONBLOCK)) == -1)
     return -1 ;
 
@@ -98,10 +330,26 @@ int serialOpen (const char *device, const int baud)
     cfsetospeed (&options, myBaud) ;
 
     options.c_cflag |= (CLOCAL | CREAD) ;
-    options.c_cflag &= ~PARENB ;
+    options.c_cflag &= ~(PARENB | PARODD) ;
+    if (parity != 'N')
+      options.c_cflag |= PARENB ;
+    if (parity == 'O')
+      options.c_cflag |= PARODD ;
     options.c_cflag &= ~CSTOPB ;
+    if (stopBits == 2)
+      options.c_cflag |= CSTOPB ;
     options.c_cflag &= ~CSIZE ;
-    options.c_cflag |= CS8 ;
+    /**/ if (dataBits == 5) options.c_cflag |= CS5 ;
+    else if (dataBits == 6) options.c_cflag |= CS6 ;
+    else if (dataBits == 7) options.c_cflag |= CS7 ;
+    else                    options.c_cflag |= CS8 ;
+    if (opts != NULL)
+    {
+      if (opts->flowControl)
+        options.c_cflag |=  CRTSCTS ;
+      else
+        options.c_cflag &= ~CRTSCTS ;
+    }
     options.c_lflag &= ~(ICANON | ECHO | ECHOE | ISIG) ;
     options.c_oflag &= ~OPOST ;
 
@@ -110,6 +358,24 @@ int serialOpen (const char *device, const int baud)
 
   tcsetattr (fd, TCSANOW, &options) ;
 
+  if ((myBaud == B38400) && (baud != 38400))
+  {
+    if (setCustomBaud (fd, baud) == -1)
+    {
+      close (fd) ;
+      return -2 ;
+    }
+  }
+
+  if ((opts != NULL) && opts->lowLatency)
+  {
+    if (ioctl (fd, TIOCGSERIAL, &serial) == 0)
+    {
+      serial.flags |= ASYNC_LOW_LATENCY ;
+      ioctl (fd, TIOCSSERIAL, &serial) ;
+    }
+  }
+
   ioctl (fd, TIOCMGET, &status);
 
   status |= TIOCM_DTR ;
@@ -119,9 +385,23 @@ int serialOpen (const char *device, const int baud)
 
   usleep (10000) ;	// 10mS
 
+  if ((opts != NULL) && opts->nonBlocking)
+    serialSetNonBlocking (fd, 1) ;
+
+  if (fd < MAX_SERIAL_FDS)
+  {
+    statsCharNs [fd] = charTime (fd) ;
+    statsSlots  [fd] = wiringPiBusStatsSlot (WPI_BUS_SERIAL, (strncmp (device, "/dev/", 5) == 0) ? device + 5 : device, -1) + 1 ;
+  }
+
   return fd ;
 }
 
+int serialOpen (const char *device, const int baud)
+{
+  return serialOpenEx (device, baud, NULL) ;
+}
+
 
 /*
  * serialFlush:
@@ -131,10 +411,82 @@ int serialOpen (const char *device, const int baud)
 
 void serialFlush (const int fd)
 {
+  struct serialOutStruct *ob = outBuf (fd) ;
+
+  if (ob != NULL)
+    ob->count = 0 ;
+
   tcflush (fd, TCIOFLUSH) ;
 }
 
 
+/*
+ * serialBufferOut:
+ *	Turn on output buffering for this port. Bytes are held in userspace
+ *	until threshold are waiting (capped at SERIAL_OUT_BUF_SIZE), the
+ *	program reads from the port, or serialFlushOut () is called.
+ *	A threshold of 0 turns buffering off again, sending anything pending.
+ *********************************************************************************
+ */
+
+int serialBufferOut (const int fd, int threshold)
+{
+  struct serialOutStruct *ob ;
+
+  if ((fd < 0) || (fd >= MAX_SERIAL_FDS))
+    return -1 ;
+
+  if (threshold <= 0)
+  {
+    if ((ob = outBufs [fd]) != NULL)
+    {
+      serialFlushOut (fd) ;
+      outBufs [fd] = NULL ;
+      free (ob) ;
+    }
+    return 0 ;
+  }
+
+  if (threshold > SERIAL_OUT_BUF_SIZE)
+    threshold = SERIAL_OUT_BUF_SIZE ;
+
+  if ((ob = outBufs [fd]) == NULL)
+  {
+    if ((ob = calloc (1, sizeof (struct serialOutStruct))) == NULL)
+      return -1 ;
+    outBufs [fd] = ob ;
+  }
+
+  ob->threshold = threshold ;
+  if (ob->count >= ob->threshold)
+    return serialFlushOut (fd) ;
+
+  return 0 ;
+}
+
+
+/*
+ * serialFlushOut:
+ *	Send anything waiting in the output buffer. Unlike serialFlush ()
+ *	this doesn't throw anything away.
+ *********************************************************************************
+ */
+
+int serialFlushOut (const int fd)
+{
+  struct serialOutStruct *ob = outBuf (fd) ;
+  unsigned int count ;
+
+  if ((ob == NULL) || (ob->count == 0))
+    return 0 ;
+
+  count     = ob->count ;
+  ob->count = 0 ;
+
+  return writeAll (fd, ob->buf, count) ;
+}
+
+
 /*
  * serialClose:
  *	Release the serial port
@@ -143,10 +495,72 @@ void serialFlush (const int fd)
 
 void serialClose (const int fd)
 {
+  serialBufferOut  (fd, 0) ;
+  serialSetRS485   (fd, SERIAL_RS485_OFF, 0, 0) ;
+  serialReaderStop (fd) ;
+  if ((fd >= 0) && (fd < MAX_SERIAL_FDS))
+  {
+    nonBlocking [fd] = 0 ;
+    statsSlots  [fd] = 0 ;
+  }
   close (fd) ;
 }
 
 
+/*
+ * serialWrite:
+ *	Send a block of bytes to the serial port. With buffering on it's
+ *	appended to the buffer, otherwise it's sent in one write ().
+ *********************************************************************************
+ */
+
+static int bufferedWrite (const int fd, const unsigned char *p, int n)
+{
+  struct serialOutStruct *ob = outBuf (fd) ;
+
+  if (ob == NULL)
+    return writeAll (fd, p, n) ;
+
+// Too big to be worth buffering? Send what's waiting then this.
+
+  if ((unsigned int)n >= ob->threshold)
+  {
+    if (serialFlushOut (fd) < 0)
+      return -1 ;
+    return writeAll (fd, p, n) ;
+  }
+
+  if (ob->count + n > SERIAL_OUT_BUF_SIZE)
+    if (serialFlushOut (fd) < 0)
+      return -1 ;
+
+  memcpy (ob->buf + ob->count, p, n) ;
+  ob->count += n ;
+
+  if (ob->count >= ob->threshold)
+    return serialFlushOut (fd) ;
+
+  return 0 ;
+}
+
+WPI_TRACE_SEMAPHORE (serial_write) ;
+
+int serialWrite (const int fd, const void *buf, int n)
+{
+  int result ;
+  WPI_TRACE_BEGIN (serial_write) ;
+
+  if (n <= 0)
+    return 0 ;
+
+  result = bufferedWrite (fd, (const unsigned char *)buf, n) ;
+
+  WPI_TRACE_END (serial_write, fd, n, result) ;
+
+  return result ;
+}
+
+
 /*
  * serialPutchar:
  *	Send a single character to the serial port
@@ -155,7 +569,7 @@ void serialClose (const int fd)
 
 void serialPutchar (const int fd, const unsigned char c)
 {
-  write (fd, &c, 1) ;
+  serialWrite (fd, &c, 1) ;
 }
 
 
@@ -167,7 +581,7 @@ void serialPutchar (const int fd, const unsigned char c)
 
 void serialPuts (const int fd, const char *s)
 {
-  write (fd, s, strlen (s)) ;
+  serialWrite (fd, s, strlen (s)) ;
 }
 
 /*
@@ -189,9 +603,299 @@ void serialPrintf (const int fd, const char *message, ...)
 }
 
 
+/*
+ * serialSetNonBlocking:
+ *	With non-blocking on, serialGetchar () returns -1 straight away when
+ *	there's nothing there rather than waiting for the 10 second time-out.
+ *********************************************************************************
+ */
+
+int serialSetNonBlocking (const int fd, const int on)
+{
+  struct termios options ;
+  int flags ;
+
+  if ((fd < 0) || (fd >= MAX_SERIAL_FDS))
+    return -1 ;
+
+  if ((flags = fcntl (fd, F_GETFL)) == -1)
+    return -1 ;
+
+  if (on)
+    flags |=  O_NONBLOCK ;
+  else
+    flags &= ~O_NONBLOCK ;
+
+  if (fcntl (fd, F_SETFL, flags) == -1)
+    return -1 ;
+
+  if (tcgetattr (fd, &options) == 0)
+  {
+    options.c_cc [VMIN]  = 0 ;
+    options.c_cc [VTIME] = on ? 0 : 100 ;
+    tcsetattr (fd, TCSANOW, &options) ;
+  }
+
+  nonBlocking [fd] = on ? 1 : 0 ;
+
+  return 0 ;
+}
+
+
+/*
+ * readerThread:
+ *	Pull data off the UART into the ring buffer
+ *********************************************************************************
+ */
+
+static void *readerThread (void *arg)
+{
+  struct serialInStruct *in = (struct serialInStruct *)arg ;
+  struct pollfd polls [2] ;
+  unsigned char buf [256] ;
+  unsigned int space ;
+  uint64_t one = 1 ;
+  ssize_t  n ;
+
+  polls [0].fd     = in->fd ;
+  polls [0].events = POLLIN ;
+  polls [1].fd     = in->stopFd ;
+  polls [1].events = POLLIN ;
+
+  for (;;)
+  {
+    if (poll (polls, 2, -1) < 0)
+    {
+      if (errno == EINTR)
+        continue ;
+      break ;
+    }
+
+    if (polls [1].revents != 0)
+      break ;
+
+    if ((polls [0].revents & (POLLERR | POLLHUP | POLLNVAL)) != 0)
+      break ;
+
+    if ((polls [0].revents & POLLIN) == 0)
+      continue ;
+
+// Wait for room, then read as much as will fit. The reader only ever
+//	makes more room, so it all goes in.
+
+    while ((space = piRingSpace (in->ring)) == 0)
+      if (poll (&polls [1], 1, 1) > 0)
+        goto stop ;
+
+    if (space > sizeof (buf))
+      space = sizeof (buf) ;
+
+    if ((n = read (in->fd, buf, space)) <= 0)
+    {
+      if ((n < 0) && ((errno == EINTR) || (errno == EAGAIN)))
+        continue ;
+      if (n == 0)
+        continue ;
+      serialStats (in->fd, 0, TRUE) ;
+      break ;
+    }
+
+    serialStats (in->fd, n, FALSE) ;
+    piRingPush (in->ring, buf, n) ;
+  }
+
+// Wake up anyone waiting so they see the error
+
+  __atomic_store_n (&in->error, 1, __ATOMIC_RELEASE) ;
+  write (piRingFd (in->ring), &one, sizeof (one)) ;
+
+stop:
+  return NULL ;
+}
+
+
+/*
+ * serialReaderStart:
+ *	Start a background reader for this port with a ring buffer of size
+ *	bytes (0 for the default.) From then on serialRead (), serialGetchar ()
+ *	and serialDataAvail () all come from the ring. Returns an eventfd that
+ *	becomes readable when there's data waiting, or -1.
+ *********************************************************************************
+ */
+
+int serialReaderStart (const int fd, int size)
+{
+  struct serialInStruct *in ;
+
+  if ((fd < 0) || (fd >= MAX_SERIAL_FDS))
+    return -1 ;
+
+  if (inBufs [fd] != NULL)
+    return piRingFd (inBufs [fd]->ring) ;
+
+  if (size <= 0)
+    size = SERIAL_IN_BUF_SIZE ;
+
+  if ((in = calloc (1, sizeof (struct serialInStruct))) == NULL)
+    return -1 ;
+
+  if ((in->ring = piRingCreate (PI_RING_SPSC, 1, size, TRUE)) == NULL)
+  {
+    free (in) ;
+    return -1 ;
+  }
+
+  in->fd     = fd ;
+  in->stopFd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC) ;
+
+  if ((in->stopFd < 0) || (pthread_create (&in->thread, NULL, readerThread, in) != 0))
+  {
+    if (in->stopFd >= 0) close (in->stopFd) ;
+    piRingFree (in->ring) ;
+    free (in) ;
+    return -1 ;
+  }
+
+  inBufs [fd] = in ;
+
+  return piRingFd (in->ring) ;
+}
+
+
+/*
+ * serialReaderStop:
+ *	Stop the background reader. Anything still in the ring is lost.
+ *********************************************************************************
+ */
+
+void serialReaderStop (const int fd)
+{
+  struct serialInStruct *in ;
+  uint64_t one = 1 ;
+
+  if ((fd < 0) || (fd >= MAX_SERIAL_FDS) || ((in = inBufs [fd]) == NULL))
+    return ;
+
+  write (in->stopFd, &one, sizeof (one)) ;
+  pthread_join (in->thread, NULL) ;
+
+  inBufs [fd] = NULL ;
+
+  close (in->stopFd) ;
+  piRingFree (in->ring) ;
+  free (in) ;
+}
+
+
+/*
+ * ringRead:
+ *	Take up to max bytes out of the ring, waiting up to timeoutMs for some
+ *	to arrive (forever if < 0)
+ *********************************************************************************
+ */
+
+static int ringRead (struct serialInStruct *in, unsigned char *buf, int max, int timeoutMs)
+{
+  struct pollfd pfd ;
+  struct timespec now ;
+  long long deadline = 0, left ;
+  uint64_t one = 1 ;
+  int n ;
+
+  if (timeoutMs > 0)
+  {
+    clock_gettime (CLOCK_MONOTONIC, &now) ;
+    deadline = (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000 + timeoutMs ;
+  }
+
+  pfd.fd     = piRingFd (in->ring) ;
+  pfd.events = POLLIN ;
+
+  for (;;)
+  {
+    if ((n = piRingPop (in->ring, buf, max)) > 0)
+      return n ;
+
+// Keep the eventfd readable after an error so pollers see it too
+
+    if (__atomic_load_n (&in->error, __ATOMIC_ACQUIRE))
+    {
+      write (pfd.fd, &one, sizeof (one)) ;
+      return -1 ;
+    }
+
+    if (timeoutMs == 0)
+      return 0 ;
+
+    left = -1 ;
+    if (timeoutMs > 0)
+    {
+      clock_gettime (CLOCK_MONOTONIC, &now) ;
+      if ((left = deadline - ((long long)now.tv_sec * 1000 + now.tv_nsec / 1000000)) <= 0)
+        return 0 ;
+    }
+
+// Readable's only a hint: round again to see what's really in there
+
+    if ((poll (&pfd, 1, (int)left) < 0) && (errno != EINTR))
+      return -1 ;
+  }
+}
+
+
+/*
+ * serialRead:
+ *	Read up to max bytes, waiting up to timeoutMs (-1 for ever, 0 for not
+ *	at all) for the first to arrive. Returns the number of bytes read,
+ *	0 on a time-out or -1 on error.
+ *********************************************************************************
+ */
+
+int serialRead (const int fd, void *buf, int max, int timeoutMs)
+{
+  struct pollfd pfd ;
+  struct serialInStruct *in ;
+  int n ;
+
+  if ((fd < 0) || (fd >= MAX_SERIAL_FDS) || (max <= 0))
+    return -1 ;
+
+  serialFlushOut (fd) ;
+
+  if ((in = inBufs [fd]) != NULL)
+    return ringRead (in, (unsigned char *)buf, max, timeoutMs) ;
+
+  pfd.fd     = fd ;
+  pfd.events = POLLIN ;
+
+  for (;;)
+  {
+    if ((n = poll (&pfd, 1, timeoutMs)) < 0)
+    {
+      if (errno == EINTR)
+        continue ;
+      return -1 ;
+    }
+    if (n == 0)
+      return 0 ;
+
+    if ((n = read (fd, buf, max)) < 0)
+    {
+      if ((errno == EINTR) || (errno == EAGAIN))
+        return 0 ;
+      serialStats (fd, 0, TRUE) ;
+      return -1 ;
+    }
+    serialStats (fd, n, FALSE) ;
+    return n ;
+  }
+}
+
+
 /*
  * serialDataAvail:
  *	Return the number of bytes of data avalable to be read in the serial port
+ *	(sending any buffered output first)
  *********************************************************************************
  */
 
@@ -199,6 +903,11 @@ int serialDataAvail (const int fd)
 {
   int result ;
 
+  serialFlushOut (fd) ;
+
+  if ((fd >= 0) && (fd < MAX_SERIAL_FDS) && (inBufs [fd] != NULL))
+    return piRingCount (inBufs [fd]->ring) ;
+
   if (ioctl (fd, FIONREAD, &result) == -1)
     return -1 ;
 
@@ -211,15 +920,362 @@ int serialDataAvail (const int fd)
  *	Get a single character from the serial device.
  *	Note: Zero is a valid character and this function will time-out after
  *	10 seconds.
+ *	Any buffered output is sent first - it's likely the request we're
+ *	waiting for the reply to.
  *********************************************************************************
  */
 
+WPI_TRACE_SEMAPHORE (serial_getchar) ;
+
 int serialGetchar (const int fd)
 {
   uint8_t x ;
+  int result ;
+  WPI_TRACE_BEGIN (serial_getchar) ;
+
+  serialFlushOut (fd) ;
+
+  /**/ if ((fd >= 0) && (fd < MAX_SERIAL_FDS) && (inBufs [fd] != NULL))
+    result = (ringRead (inBufs [fd], &x, 1, nonBlocking [fd] ? 0 : 10000) == 1) ? x : -1 ;
+  else if (read (fd, &x, 1) != 1)
+    result = -1 ;
+  else
+  {
+    serialStats (fd, 1, FALSE) ;
+    result = ((int)x) & 0xFF ;
+  }
+
+  WPI_TRACE_END (serial_getchar, fd, result, 1) ;
+
+  return result ;
+}
+
+
+/*
+ * charTime:
+ *	How long a character takes on the wire, in nS, from the port's
+ *	actual speed and framing
+ *********************************************************************************
+ */
+
+static unsigned int charTime (const int fd)
+{
+  struct wpiTermios2 tio ;
+  unsigned int bits ;
+
+  if ((ioctl (fd, WPI_TCGETS2, &tio) < 0) || (tio.c_ospeed == 0))
+    return 1000000 ;		// Call it 10 bits at 10k
+
+  /**/ if ((tio.c_cflag & CSIZE) == CS5) bits = 5 ;
+  else if ((tio.c_cflag & CSIZE) == CS6) bits = 6 ;
+  else if ((tio.c_cflag & CSIZE) == CS7) bits = 7 ;
+  else                                   bits = 8 ;
+
+  bits += 1 + (((tio.c_cflag & PARENB) != 0) ? 1 : 0) + (((tio.c_cflag & CSTOPB) != 0) ? 2 : 1) ;
+
+  return (unsigned int)((unsigned long long)bits * 1000000000ULL / tio.c_ospeed) ;
+}
+
+
+/*
+ * rs485Transmit:
+ *	Send a frame with DE up: sleep through most of it, then watch the
+ *	line status for the last stop bit to go before letting DE go. Ports
+ *	that can't say (some USB adapters) tcdrain () instead.
+ *********************************************************************************
+ */
+
+static int rs485Transmit (struct serialRS485Struct *r, const unsigned char *buf, unsigned int len)
+{
+  unsigned long long start, end ;
+  unsigned int lsr ;
+  int result ;
+
+  wpiPinWrite (r->de, HIGH) ;
+  if (r->preUs != 0)
+    delayMicroseconds (r->preUs) ;
+
+  start  = nanos64 () ;
+  result = writeRaw (r->fd, buf, len) ;
+  end    = start + (unsigned long long)len * r->charNs ;
+
+  if (len > 1)
+    delayUntilNanos (end - r->charNs) ;
+
+  for (;;)
+  {
+    if (ioctl (r->fd, TIOCSERGETLSR, &lsr) < 0)
+    {
+      tcdrain (r->fd) ;
+      break ;
+    }
+    if (((lsr & TIOCSER_TEMT) != 0) || (nanos64 () > end + 100000000ULL))	// Or 100mS too long
+      break ;
+  }
+
+  if (r->postUs != 0)
+    delayMicroseconds (r->postUs) ;
+  wpiPinWrite (r->de, LOW) ;
 
-  if (read (fd, &x, 1) != 1)
+  return result ;
+}
+
+
+/*
+ * rs485Thread:
+ * rs485Send:
+ *	The port's transmitter, and handing it a frame
+ *********************************************************************************
+ */
+
+static void *rs485Thread (void *arg)
+{
+  struct serialRS485Struct *r = (struct serialRS485Struct *)arg ;
+  int result ;
+
+  (void)piHiPri (55) ;
+
+  pthread_mutex_lock (&r->lock) ;
+
+  for (;;)
+  {
+    while ((r->buf == NULL) && !r->stop)
+      pthread_cond_wait (&r->work, &r->lock) ;
+
+    if (r->stop)
+      break ;
+
+    pthread_mutex_unlock (&r->lock) ;
+      result = rs485Transmit (r, r->buf, r->len) ;
+    pthread_mutex_lock (&r->lock) ;
+
+    r->result = result ;
+    r->buf    = NULL ;
+    pthread_cond_broadcast (&r->done) ;
+  }
+
+  pthread_mutex_unlock (&r->lock) ;
+
+  return NULL ;
+}
+
+static int rs485Send (struct serialRS485Struct *r, const unsigned char *buf, unsigned int len)
+{
+  int result ;
+
+  pthread_mutex_lock (&r->lock) ;
+
+  while (r->buf != NULL)		// Another writer's frame
+    pthread_cond_wait (&r->done, &r->lock) ;
+
+  r->buf = buf ;
+  r->len = len ;
+  pthread_cond_signal (&r->work) ;
+
+  while (r->buf == buf)
+    pthread_cond_wait (&r->done, &r->lock) ;
+  result = r->result ;
+
+  pthread_mutex_unlock (&r->lock) ;
+
+  return result ;
+}
+
+
+/*
+ * serialSetRS485:
+ *	Half-duplex RS-485: drive the transceiver's driver enable for every
+ *	write. SERIAL_RS485_RTS has the kernel do it with RTS, if the UART
+ *	driver can (its delays are in mS, so the uS delays are rounded up);
+ *	a wiringPi pin has our own thread do it with preDelayUs after raising
+ *	it and postDelayUs before dropping it. SERIAL_RS485_OFF stops either.
+ *	Returns 0 or -1 with errno set.
+ *********************************************************************************
+ */
+
+int serialSetRS485 (const int fd, int dePin, unsigned int preDelayUs, unsigned int postDelayUs)
+{
+  struct serialRS485Struct *r ;
+  struct serial_rs485 rs485 ;
+
+  if ((fd < 0) || (fd >= MAX_SERIAL_FDS) || (dePin < SERIAL_RS485_OFF))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+// Whatever it was doing, stop
+
+  if ((r = rs485s [fd]) != NULL)
+  {
+    pthread_mutex_lock (&r->lock) ;
+      while (r->buf != NULL)
+	pthread_cond_wait (&r->done, &r->lock) ;
+      r->stop = TRUE ;
+      pthread_cond_signal (&r->work) ;
+    pthread_mutex_unlock (&r->lock) ;
+    pthread_join (r->thread, NULL) ;
+
+    rs485s [fd] = NULL ;
+
+    wpiPinWrite (r->de, LOW) ;
+    wiringPiPinClose (r->de) ;
+    pthread_cond_destroy  (&r->work) ;
+    pthread_cond_destroy  (&r->done) ;
+    pthread_mutex_destroy (&r->lock) ;
+    free (r) ;
+  }
+
+  memset (&rs485, 0, sizeof (rs485)) ;
+
+  if (dePin == SERIAL_RS485_OFF)
+  {
+    if ((ioctl (fd, TIOCGRS485, &rs485) == 0) && ((rs485.flags & SER_RS485_ENABLED) != 0))
+    {
+      rs485.flags &= ~SER_RS485_ENABLED ;
+      ioctl (fd, TIOCSRS485, &rs485) ;
+    }
+    return 0 ;
+  }
+
+  if (dePin == SERIAL_RS485_RTS)
+  {
+    rs485.flags                 = SER_RS485_ENABLED | SER_RS485_RTS_ON_SEND ;
+    rs485.delay_rts_before_send = (preDelayUs  + 999) / 1000 ;
+    rs485.delay_rts_after_send  = (postDelayUs + 999) / 1000 ;
+    return (ioctl (fd, TIOCSRS485, &rs485) < 0) ? -1 : 0 ;
+  }
+
+  if ((r = (struct serialRS485Struct *)calloc (1, sizeof (*r))) == NULL)
+  {
+    errno = ENOMEM ;
+    return -1 ;
+  }
+
+  if ((r->de = wiringPiPinOpen (dePin)) == NULL)
+  {
+    free (r) ;
+    errno = ENODEV ;
+    return -1 ;
+  }
+
+  pinMode     (dePin, OUTPUT) ;
+  wpiPinWrite (r->de, LOW) ;
+
+  r->fd     = fd ;
+  r->preUs  = preDelayUs ;
+  r->postUs = postDelayUs ;
+  r->charNs = charTime (fd) ;
+  pthread_mutex_init (&r->lock, NULL) ;
+  pthread_cond_init  (&r->work, NULL) ;
+  pthread_cond_init  (&r->done, NULL) ;
+
+  if (pthread_create (&r->thread, NULL, rs485Thread, r) != 0)
+  {
+    wiringPiPinClose (r->de) ;
+    free (r) ;
+    errno = EAGAIN ;
+    return -1 ;
+  }
+
+  rs485s [fd] = r ;
+
+  return 0 ;
+}
+
+
+/*
+ * serialSendFrame:
+ *	Send a frame and return once it's all gone out on the line (and, on
+ *	RS-485, the driver's been turned off). Anything buffered goes first.
+ *	Returns 0 or -1.
+ *********************************************************************************
+ */
+
+int serialSendFrame (const int fd, const void *buf, int n)
+{
+  if ((fd < 0) || (fd >= MAX_SERIAL_FDS) || (n < 0))
+    return -1 ;
+
+  if ((serialFlushOut (fd) < 0) || ((n > 0) && (writeAll (fd, (const unsigned char *)buf, n) < 0)))
     return -1 ;
 
-  return ((int)x) & 0xFF ;
+  if (rs485s [fd] == NULL)	// Otherwise it's already gone
+    tcdrain (fd) ;
+
+  return 0 ;
+}
+
+
+/*
+ * serialReadFrame:
+ *	Wait up to timeoutMs (-1 for ever) for a frame to start, then take
+ *	bytes until the line's been quiet for gapUs - 0 for the Modbus RTU
+ *	3.5 characters (1750uS above 19200 baud) - or max have come.
+ *	Returns the length of the frame, 0 on a time-out or -1 on error.
+ *********************************************************************************
+ */
+
+int serialReadFrame (const int fd, void *buf, int max, unsigned int gapUs, int timeoutMs)
+{
+  struct serialInStruct *in ;
+  struct pollfd pfd ;
+  struct timespec gap ;
+  unsigned char *p = (unsigned char *)buf ;
+  unsigned int charNs ;
+  int n, got ;
+
+  if ((got = serialRead (fd, buf, max, timeoutMs)) <= 0)
+    return got ;
+
+  if (gapUs == 0)
+  {
+    charNs = charTime (fd) ;
+    gapUs  = (charNs < 520833) ? 1750 : (charNs * 7 / 2 + 999) / 1000 ;	// 520833nS: 11 bits at 19200
+  }
+
+  gap.tv_sec  = gapUs / 1000000 ;
+  gap.tv_nsec = (gapUs % 1000000) * 1000 ;
+
+  in         = inBufs [fd] ;
+  pfd.fd     = (in != NULL) ? piRingFd (in->ring) : fd ;
+  pfd.events = POLLIN ;
+
+  while (got < max)
+  {
+    if (in != NULL)
+    {
+      if ((n = piRingPop (in->ring, p + got, max - got)) > 0)
+      {
+	got += n ;
+	continue ;
+      }
+      if (__atomic_load_n (&in->error, __ATOMIC_ACQUIRE))
+	return -1 ;
+    }
+
+    if ((n = ppoll (&pfd, 1, &gap, NULL)) < 0)
+    {
+      if (errno == EINTR)
+	continue ;
+      return -1 ;
+    }
+    if (n == 0)				// The gap: that's the frame
+      break ;
+
+    if (in != NULL)
+      continue ;
+
+    if ((n = read (fd, p + got, max - got)) < 0)
+    {
+      if ((errno == EINTR) || (errno == EAGAIN))
+	continue ;
+      serialStats (fd, 0, TRUE) ;
+      return -1 ;
+    }
+    serialStats (fd, n, FALSE) ;
+    got += n ;
+  }
+
+  return got ;
 }
@@ -24,14 +24,48 @@
 extern "C" {
 #endif
 
+#define	SERIAL_OUT_BUF_SIZE	256
+#define	SERIAL_IN_BUF_SIZE	4096
+
+// Options for serialOpenEx. Zero fields take the defaults: 8N1, no flow
+//	control, blocking reads.
+
+struct serialOptsStruct
+{
+  int  dataBits ;	// 5-8
+  char parity ;		// 'N', 'E' or 'O'
+  int  stopBits ;	// 1 or 2
+  int  flowControl ;	// RTS/CTS
+  int  lowLatency ;	// Ask the driver for ASYNC_LOW_LATENCY
+  int  nonBlocking ;	// As serialSetNonBlocking ()
+} ;
+
+// serialSetRS485 driver enables: a wiringPi pin, or
+
+#define	SERIAL_RS485_RTS	-1	// The UART's RTS, switched by the kernel
+#define	SERIAL_RS485_OFF	-2
+
 extern int   serialOpen      (const char *device, const int baud) ;
+extern int   serialOpenEx    (const char *device, const int baud, const struct serialOptsStruct *opts) ;
 extern void  serialClose     (const int fd) ;
 extern void  serialFlush     (const int fd) ;
+extern int   serialBufferOut (const int fd, int threshold) ;
+extern int   serialFlushOut  (const int fd) ;
+extern int   serialWrite     (const int fd, const void *buf, int n) ;
 extern void  serialPutchar   (const int fd, const unsigned char c) ;
 extern void  serialPuts      (const int fd, const char *s) ;
 extern void  serialPrintf    (const int fd, const char *message, ...) ;
 extern int   serialDataAvail (const int fd) ;
 extern int   serialGetchar   (const int fd) ;
+extern int   serialRead      (const int fd, void *buf, int max, int timeoutMs) ;
+
+extern int   serialSetRS485  (const int fd, int dePin, unsigned int preDelayUs, unsigned int postDelayUs) ;
+extern int   serialSendFrame (const int fd, const void *buf, int n) ;
+extern int   serialReadFrame (const int fd, void *buf, int max, unsigned int gapUs, int timeoutMs) ;
+
+extern int   serialSetNonBlocking (const int fd, const int on) ;
+extern int   serialReaderStart    (const int fd, int size) ;
+extern void  serialReaderStop     (const int fd) ;
 
 #ifdef __cplusplus
 }
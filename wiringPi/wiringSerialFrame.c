@@ -0,0 +1,658 @@
+/*
+ * wiringSerialFrame.c:
+ *	Frame-at-a-time binary protocols over a serial port.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+/*
+ * Notes:
+ *	Rather than a serialGetchar () per byte, the framer pulls in as much
+ *	as there is with one serialRead () - from the background reader's
+ *	ring if the port has one - into a window of its own, finds the ends
+ *	of frames there with memchr (), and undoes the COBS or SLIP stuffing
+ *	in place. serialFrameRead () hands back a pointer to the frame in the
+ *	window, so the payload isn't copied again.
+ *
+ *	Frames that fail their check, won't decode, or are too long are
+ *	counted and skipped; empty ones are just skipped. A window full of
+ *	bytes with no end of frame in sight is thrown away along with the
+ *	rest of that frame.
+ *********************************************************************************
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "wiringPi.h"
+#include "wiringSerial.h"
+#include "wiringSerialFrame.h"
+
+#define	SLIP_END	0xC0
+#define	SLIP_ESC	0xDB
+#define	SLIP_ESC_END	0xDC
+#define	SLIP_ESC_ESC	0xDD
+
+struct serialFrameStruct
+{
+  int            fd ;
+  int            type ;
+  int            param ;
+  int            crc ;
+  unsigned int   crcLen ;
+  unsigned int   maxFrame ;	// Payload, without the check
+  unsigned int   maxRaw ;	// The most a frame can take on the wire
+  int            delim ;
+
+  unsigned char *buf ;
+  unsigned int   size ;
+  unsigned int   start ;	// Next frame starts here
+  unsigned int   scan ;		// Looked for its end up to here
+  unsigned int   end ;
+  int            overrun ;	// Lost the start of the frame in hand
+
+  unsigned char *tx ;
+
+  unsigned int   frames ;
+  unsigned int   crcErrors ;
+  unsigned int   dropped ;
+} ;
+
+static uint16_t crcCcittTable  [256] ;
+static uint16_t crcModbusTable [256] ;
+static uint32_t crc32Table     [256] ;
+
+static pthread_once_t crcOnce = PTHREAD_ONCE_INIT ;
+
+
+/*
+ * crcInit:
+ * crcLength:
+ * crcTrailer:
+ *	Byte at a time tables, how long each check is, and the check of a
+ *	block the way it goes on the wire
+ *********************************************************************************
+ */
+
+static void crcInit (void)
+{
+  uint32_t c ;
+  int i, j ;
+
+  for (i = 0 ; i < 256 ; ++i)
+  {
+    c = (uint32_t)i << 8 ;
+    for (j = 0 ; j < 8 ; ++j)
+      c = (c & 0x8000) ? (c << 1) ^ 0x1021 : c << 1 ;
+    crcCcittTable [i] = (uint16_t)c ;
+
+    c = i ;
+    for (j = 0 ; j < 8 ; ++j)
+      c = (c & 1) ? (c >> 1) ^ 0xA001 : c >> 1 ;
+    crcModbusTable [i] = (uint16_t)c ;
+
+    c = i ;
+    for (j = 0 ; j < 8 ; ++j)
+      c = (c & 1) ? (c >> 1) ^ 0xEDB88320 : c >> 1 ;
+    crc32Table [i] = c ;
+  }
+}
+
+static int crcLength (int crc)
+{
+  switch (crc)
+  {
+    case SERIAL_CRC_NONE:	return 0 ;
+    case SERIAL_CRC_CCITT:	return 2 ;
+    case SERIAL_CRC_MODBUS:	return 2 ;
+    case SERIAL_CRC_32:		return 4 ;
+    default:			return -1 ;
+  }
+}
+
+static void crcTrailer (int crc, const unsigned char *p, unsigned int n, unsigned char *trailer)
+{
+  uint32_t c ;
+
+  switch (crc)
+  {
+    case SERIAL_CRC_CCITT:
+      for (c = 0xFFFF ; n > 0 ; --n)
+	c = ((c << 8) & 0xFFFF) ^ crcCcittTable [((c >> 8) ^ *p++) & 0xFF] ;
+      trailer [0] = c >> 8 ;
+      trailer [1] = c ;
+      break ;
+
+    case SERIAL_CRC_MODBUS:
+      for (c = 0xFFFF ; n > 0 ; --n)
+	c = (c >> 8) ^ crcModbusTable [(c ^ *p++) & 0xFF] ;
+      trailer [0] = c ;
+      trailer [1] = c >> 8 ;
+      break ;
+
+    case SERIAL_CRC_32:
+      for (c = 0xFFFFFFFF ; n > 0 ; --n)
+	c = (c >> 8) ^ crc32Table [(c ^ *p++) & 0xFF] ;
+      c ^= 0xFFFFFFFF ;
+      trailer [0] = c ;
+      trailer [1] = c >> 8 ;
+      trailer [2] = c >> 16 ;
+      trailer [3] = c >> 24 ;
+      break ;
+  }
+}
+
+
+/*
+ * cobsDecode:
+ * slipDecode:
+ *	Undo the stuffing of a frame in place - it only ever gets shorter.
+ *	Returns the new length or -1 if it's not a valid frame.
+ *********************************************************************************
+ */
+
+static int cobsDecode (unsigned char *p, unsigned int n)
+{
+  unsigned int in = 0, out = 0, code ;
+
+  while (in < n)
+  {
+    code = p [in++] ;			// Never 0: we split on those
+    if (in + code - 1 > n)
+      return -1 ;
+
+    memmove (p + out, p + in, code - 1) ;
+    in  += code - 1 ;
+    out += code - 1 ;
+
+    if ((code != 0xFF) && (in < n))
+      p [out++] = 0 ;
+  }
+
+  return out ;
+}
+
+static int slipDecode (unsigned char *p, unsigned int n)
+{
+  unsigned char *esc ;
+  unsigned int in, out ;
+  unsigned char c ;
+
+// Nothing moves until the first escape
+
+  if ((esc = memchr (p, SLIP_ESC, n)) == NULL)
+    return n ;
+
+  for (in = out = esc - p ; in < n ; ++in)
+  {
+    if ((c = p [in]) == SLIP_ESC)
+    {
+      if (++in == n)
+	return -1 ;
+
+      /**/ if (p [in] == SLIP_ESC_END) c = SLIP_END ;
+      else if (p [in] == SLIP_ESC_ESC) c = SLIP_ESC ;
+      else
+	return -1 ;
+    }
+    p [out++] = c ;
+  }
+
+  return out ;
+}
+
+
+/*
+ * nextFrame:
+ *	Find the next good frame in the window. Returns its payload length
+ *	with *frame pointing at it, or 0 if a whole one isn't in yet.
+ *********************************************************************************
+ */
+
+static int nextFrame (struct serialFrameStruct *f, const unsigned char **frame)
+{
+  unsigned char trailer [4] ;
+  unsigned char *raw, *p ;
+  unsigned int len, first ;
+  int n ;
+
+  for (;;)
+  {
+    raw   = f->buf + f->start ;
+    first = f->start ;
+
+    if (f->type == SERIAL_FRAME_FIXED)
+    {
+      if (f->end - f->start < (unsigned int)f->param)
+	return 0 ;
+      len = f->param ;
+      f->start += len ;
+    }
+    else if (f->type == SERIAL_FRAME_LENGTH)
+    {
+      if (f->end - f->start < (unsigned int)f->param)
+	return 0 ;
+
+      len = raw [0] ;
+      if (f->param == 2)
+	len |= raw [1] << 8 ;
+
+// A count that can't be right: we're out of step, so slide on a byte
+
+      if (len > f->maxFrame + f->crcLen)
+      {
+	++f->dropped ;
+	++f->start ;
+	continue ;
+      }
+
+      if (f->end - f->start < f->param + len)
+	return 0 ;
+
+      raw      += f->param ;
+      f->start += f->param + len ;
+    }
+    else
+    {
+      if ((p = memchr (f->buf + f->scan, f->delim, f->end - f->scan)) == NULL)
+      {
+	f->scan = f->end ;
+	return 0 ;
+      }
+
+      len      = p - raw ;
+      f->start = f->scan = p + 1 - f->buf ;
+
+      if (f->overrun)			// The end of one we've already dropped
+      {
+	f->overrun = FALSE ;
+	continue ;
+      }
+
+      if (len == 0)
+	continue ;
+
+      /**/ if (f->type == SERIAL_FRAME_COBS) n = cobsDecode (raw, len) ;
+      else if (f->type == SERIAL_FRAME_SLIP) n = slipDecode (raw, len) ;
+      else                                   n = len ;
+
+      if ((n < 0) || ((unsigned int)n > f->maxFrame + f->crcLen))
+      {
+	++f->dropped ;
+	continue ;
+      }
+
+      len = n ;
+    }
+
+// A bad length-prefixed frame may just mean we're out of step, so hunt
+//	for the next one a byte on rather than trusting its count
+
+    if (f->crcLen > 0)
+    {
+      if (len < f->crcLen)
+      {
+	++f->dropped ;
+	if (f->type == SERIAL_FRAME_LENGTH)
+	  f->start = first + 1 ;
+	continue ;
+      }
+
+      len -= f->crcLen ;
+      crcTrailer (f->crc, raw, len, trailer) ;
+      if (memcmp (trailer, raw + len, f->crcLen) != 0)
+      {
+	++f->crcErrors ;
+	if (f->type == SERIAL_FRAME_LENGTH)
+	  f->start = first + 1 ;
+	continue ;
+      }
+    }
+
+    if (len == 0)
+      continue ;
+
+    ++f->frames ;
+    *frame = raw ;
+    return len ;
+  }
+}
+
+
+/*
+ * serialFrameOpen:
+ *	Start framing the serial port fd. type is one of the SERIAL_FRAME_
+ *	types, with param as in wiringSerialFrame.h, and crc one of the
+ *	SERIAL_CRC_ checks, which goes on the end of each frame and is
+ *	checked and stripped on the way in. maxFrame is the largest payload,
+ *	capped at what a 1 byte length can say; a fixed frame is param less
+ *	the check.
+ *	Returns the framer or NULL with errno set.
+ *********************************************************************************
+ */
+
+struct serialFrameStruct *serialFrameOpen (const int fd, int type, int param, int crc, int maxFrame)
+{
+  struct serialFrameStruct *f ;
+  int crcLen, valid ;
+
+  pthread_once (&crcOnce, crcInit) ;
+
+  crcLen = crcLength (crc) ;
+
+  /**/ if (type == SERIAL_FRAME_FIXED)
+  {
+    valid = (param > crcLen) && (param <= SERIAL_FRAME_MAX) ;
+    maxFrame = param - crcLen ;
+  }
+  else if (type == SERIAL_FRAME_DELIM)
+    valid = (param >= 0) && (param <= 255) && (crc == SERIAL_CRC_NONE) ;
+  else if (type == SERIAL_FRAME_LENGTH)
+  {
+    valid = (param == 1) || (param == 2) ;
+    if ((param == 1) && (maxFrame > 255 - crcLen))
+      maxFrame = 255 - crcLen ;
+  }
+  else
+    valid = (type == SERIAL_FRAME_COBS) || (type == SERIAL_FRAME_SLIP) ;
+
+  if (!valid || (fd < 0) || (crcLen < 0) || (maxFrame < 1) || (maxFrame > SERIAL_FRAME_MAX))
+  {
+    errno = EINVAL ;
+    return NULL ;
+  }
+
+  if ((f = (struct serialFrameStruct *)calloc (1, sizeof (*f))) == NULL)
+  {
+    errno = ENOMEM ;
+    return NULL ;
+  }
+
+  f->fd       = fd ;
+  f->type     = type ;
+  f->param    = param ;
+  f->crc      = crc ;
+  f->crcLen   = crcLen ;
+  f->maxFrame = maxFrame ;
+  f->delim    = (type == SERIAL_FRAME_SLIP) ? SLIP_END : (type == SERIAL_FRAME_DELIM) ? param : 0 ;
+
+  switch (type)
+  {
+    case SERIAL_FRAME_COBS:   f->maxRaw = maxFrame + crcLen + (maxFrame + crcLen) / 254 + 2 ; break ;
+    case SERIAL_FRAME_SLIP:   f->maxRaw = (maxFrame + crcLen) * 2 + 2 ;                        break ;
+    case SERIAL_FRAME_FIXED:  f->maxRaw = param ;                                              break ;
+    case SERIAL_FRAME_DELIM:  f->maxRaw = maxFrame + 1 ;                                       break ;
+    case SERIAL_FRAME_LENGTH: f->maxRaw = param + maxFrame + crcLen ;                          break ;
+  }
+
+// Room for a couple of frames, and big enough to make each read worth it
+
+  f->size = f->maxRaw * 2 ;
+  if (f->size < SERIAL_IN_BUF_SIZE)
+    f->size = SERIAL_IN_BUF_SIZE ;
+
+  f->buf = (unsigned char *)malloc (f->size) ;
+  f->tx  = (unsigned char *)malloc (f->maxRaw) ;
+
+  if ((f->buf == NULL) || (f->tx == NULL))
+  {
+    serialFrameClose (f) ;
+    errno = ENOMEM ;
+    return NULL ;
+  }
+
+  return f ;
+}
+
+
+/*
+ * serialFrameClose:
+ *	Finished with the framer. The port stays open.
+ *********************************************************************************
+ */
+
+void serialFrameClose (struct serialFrameStruct *f)
+{
+  if (f == NULL)
+    return ;
+
+  free (f->buf) ;
+  free (f->tx) ;
+  free (f) ;
+}
+
+
+/*
+ * serialFrameRead:
+ *	Wait up to timeoutMs (-1 for ever, 0 for not at all) for a whole
+ *	frame. Returns the payload length with *frame pointing at it, 0 on a
+ *	time-out or -1 on error. The frame stays put until the next read.
+ *********************************************************************************
+ */
+
+int serialFrameRead (struct serialFrameStruct *f, const unsigned char **frame, int timeoutMs)
+{
+  struct timespec now ;
+  long long deadline = 0, left ;
+  int n ;
+
+  if (timeoutMs > 0)
+  {
+    clock_gettime (CLOCK_MONOTONIC, &now) ;
+    deadline = (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000 + timeoutMs ;
+  }
+
+  for (;;)
+  {
+    if ((n = nextFrame (f, frame)) > 0)
+      return n ;
+
+// Move what there is of the next frame down to make room
+
+    if (f->start > 0)
+    {
+      memmove (f->buf, f->buf + f->start, f->end - f->start) ;
+      f->end  -= f->start ;
+      f->scan -= f->start ;
+      f->start = 0 ;
+    }
+
+    if (f->end == f->size)
+    {
+      ++f->dropped ;
+      f->overrun = TRUE ;
+      f->scan    = f->end = 0 ;
+    }
+
+    left = timeoutMs ;
+    if (timeoutMs > 0)
+    {
+      clock_gettime (CLOCK_MONOTONIC, &now) ;
+      if ((left = deadline - ((long long)now.tv_sec * 1000 + now.tv_nsec / 1000000)) < 0)
+	left = 0 ;
+    }
+
+    if ((n = serialRead (f->fd, f->buf + f->end, f->size - f->end, (int)left)) <= 0)
+      return n ;
+
+    f->end += n ;
+  }
+}
+
+
+/*
+ * serialFrameEncode:
+ *	Build a frame of n bytes of payload (with its check) straight into
+ *	out, which has room for max bytes. Twice the payload and check, plus
+ *	2, is always enough.
+ *	Returns the frame's length, or -1 with errno set.
+ *********************************************************************************
+ */
+
+int serialFrameEncode (int type, int param, int crc, const void *payload, int n, void *out, int max)
+{
+  const unsigned char *p = (const unsigned char *)payload ;
+  unsigned char *o = (unsigned char *)out ;
+  unsigned char trailer [4], c ;
+  unsigned int i, len, body, code, codeAt ;
+  int crcLen ;
+
+  pthread_once (&crcOnce, crcInit) ;
+
+  if (((crcLen = crcLength (crc)) < 0) || (n < 0) || (n > SERIAL_FRAME_MAX) || (max < 0))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  crcTrailer (crc, p, n, trailer) ;
+  body = n + crcLen ;
+  len  = 0 ;
+
+  switch (type)
+  {
+    case SERIAL_FRAME_COBS:
+      if (max < 2)
+	goto tooBig ;
+      codeAt = 0 ;
+      code   = 1 ;
+      len    = 1 ;
+      for (i = 0 ; i < body ; ++i)
+      {
+	c = (i < (unsigned int)n) ? p [i] : trailer [i - n] ;
+	if (c != 0)
+	{
+	  if (len >= (unsigned int)max)
+	    goto tooBig ;
+	  o [len++] = c ;
+	  if (++code != 0xFF)
+	    continue ;
+	}
+	o [codeAt] = code ;
+	if (len >= (unsigned int)max)
+	  goto tooBig ;
+	codeAt = len++ ;
+	code   = 1 ;
+      }
+      o [codeAt] = code ;
+      if (len >= (unsigned int)max)
+	goto tooBig ;
+      o [len++] = 0 ;
+      return len ;
+
+    case SERIAL_FRAME_SLIP:
+      if (max < 1)
+	goto tooBig ;
+      o [len++] = SLIP_END ;		// Flushes out any line noise
+      for (i = 0 ; i < body ; ++i)
+      {
+	c = (i < (unsigned int)n) ? p [i] : trailer [i - n] ;
+	if (len + 2 > (unsigned int)max)
+	  goto tooBig ;
+	/**/ if (c == SLIP_END) { o [len++] = SLIP_ESC ; o [len++] = SLIP_ESC_END ; }
+	else if (c == SLIP_ESC) { o [len++] = SLIP_ESC ; o [len++] = SLIP_ESC_ESC ; }
+	else                      o [len++] = c ;
+      }
+      if (len >= (unsigned int)max)
+	goto tooBig ;
+      o [len++] = SLIP_END ;
+      return len ;
+
+    case SERIAL_FRAME_FIXED:
+      if (body != (unsigned int)param)
+	break ;
+      if (body > (unsigned int)max)
+	goto tooBig ;
+      memcpy (o, p, n) ;
+      memcpy (o + n, trailer, crcLen) ;
+      return body ;
+
+    case SERIAL_FRAME_DELIM:
+      if ((crc != SERIAL_CRC_NONE) || (param < 0) || (param > 255) || (memchr (p, param, n) != NULL))
+	break ;
+      if (body + 1 > (unsigned int)max)
+	goto tooBig ;
+      memcpy (o, p, n) ;
+      o [n] = param ;
+      return n + 1 ;
+
+    case SERIAL_FRAME_LENGTH:
+      if (((param != 1) && (param != 2)) || (body > ((param == 1) ? 255u : 65535u)))
+	break ;
+      if (param + body > (unsigned int)max)
+	goto tooBig ;
+      o [0] = body ;
+      if (param == 2)
+	o [1] = body >> 8 ;
+      memcpy (o + param, p, n) ;
+      memcpy (o + param + n, trailer, crcLen) ;
+      return param + body ;
+  }
+
+  errno = EINVAL ;
+  return -1 ;
+
+tooBig:
+  errno = EMSGSIZE ;
+  return -1 ;
+}
+
+
+/*
+ * serialFrameWrite:
+ *	Frame up a payload and send it in one go.
+ *	Returns 0 or -1 with errno set.
+ *********************************************************************************
+ */
+
+int serialFrameWrite (struct serialFrameStruct *f, const void *payload, int n)
+{
+  int len ;
+
+  if ((n < 0) || ((unsigned int)n > f->maxFrame))
+  {
+    errno = EMSGSIZE ;
+    return -1 ;
+  }
+
+  if ((len = serialFrameEncode (f->type, f->param, f->crc, payload, n, f->tx, f->maxRaw)) < 0)
+    return -1 ;
+
+  return serialWrite (f->fd, f->tx, len) ;
+}
+
+
+/*
+ * serialFrameStats:
+ *	Good frames handed out, frames that failed their check, and frames
+ *	dropped for not decoding or being too long. Any can be NULL.
+ *********************************************************************************
+ */
+
+void serialFrameStats (struct serialFrameStruct *f, unsigned int *frames, unsigned int *crcErrors, unsigned int *dropped)
+{
+  if (frames    != NULL) *frames    = f->frames ;
+  if (crcErrors != NULL) *crcErrors = f->crcErrors ;
+  if (dropped   != NULL) *dropped   = f->dropped ;
+}
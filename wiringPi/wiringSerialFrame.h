@@ -0,0 +1,57 @@
+/*
+ * wiringSerialFrame.h:
+ *	Frame-at-a-time binary protocols over a serial port.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+// Framing
+
+#define	SERIAL_FRAME_COBS	0	// Consistent overhead byte stuffing, 0x00 terminated
+#define	SERIAL_FRAME_SLIP	1	// RFC 1055
+#define	SERIAL_FRAME_FIXED	2	// param bytes a frame, check included
+#define	SERIAL_FRAME_DELIM	3	// Ends with the byte param. No check allowed.
+#define	SERIAL_FRAME_LENGTH	4	// A param (1 or 2) byte little-endian count of what follows
+
+// Checks on the end of each frame
+
+#define	SERIAL_CRC_NONE		0
+#define	SERIAL_CRC_CCITT	1	// CRC-16/CCITT-FALSE, high byte first
+#define	SERIAL_CRC_MODBUS	2	// CRC-16/MODBUS, low byte first
+#define	SERIAL_CRC_32		3	// CRC-32 as zlib, low byte first
+
+#define	SERIAL_FRAME_MAX	65535
+
+struct serialFrameStruct ;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern struct serialFrameStruct *serialFrameOpen (const int fd, int type, int param, int crc, int maxFrame) ;
+extern void serialFrameClose  (struct serialFrameStruct *f) ;
+extern int  serialFrameRead   (struct serialFrameStruct *f, const unsigned char **frame, int timeoutMs) ;
+extern int  serialFrameWrite  (struct serialFrameStruct *f, const void *payload, int n) ;
+extern int  serialFrameEncode (int type, int param, int crc, const void *payload, int n, void *out, int max) ;
+extern void serialFrameStats  (struct serialFrameStruct *f, unsigned int *frames, unsigned int *crcErrors, unsigned int *dropped) ;
+
+#ifdef __cplusplus
+}
+#endif
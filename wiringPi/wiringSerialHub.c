@@ -0,0 +1,694 @@
+/*
+ * wiringSerialHub.c:
+ *	Service many serial ports from one thread.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+/*
+ * Notes:
+ *	Ports from serialOpen () are added to the hub, which then has the one
+ *	thread and the one epoll set for all of them rather than a reader
+ *	thread each. Whatever has arrived on a port is read in one go and
+ *	either handed to the port's function - on the hub thread, so it
+ *	mustn't hang about - or put in a ring for serialHubRead ().
+ *
+ *	serialHubWrite () never blocks: if nothing's queued for the port it
+ *	writes straight away, and anything the UART won't take yet is queued
+ *	and sent by the hub when epoll says there's room.
+ *
+ *	The ports are non-blocking while they're in the hub. Use only the
+ *	serialHub calls on them until they're removed.
+ *
+ *	A program with its own event loop can have the hub with no thread at
+ *	all - serialHubPollFd () gives it the epoll set to watch.
+ *********************************************************************************
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "wiringPi.h"
+#include "wiringSerial.h"
+#include "wiringSerialHub.h"
+#include "piThread.h"
+
+#define	MAX_HUB_FDS	1024
+#define	HUB_EVENTS	32
+
+struct hubPortStruct
+{
+  int                  fd ;
+  int                  flags ;		// To put back when it's removed
+  void               (*function)(void *context, int fd, const unsigned char *data, int n) ;
+  void                *context ;
+  struct piRingStruct *ring ;		// No function: what's come in
+  unsigned int         lost ;		// Ring was full
+  int                  error ;
+
+  pthread_mutex_t      outLock ;
+  unsigned int         outStart ;
+  unsigned int         outEnd ;
+  int                  outArmed ;	// Waiting for EPOLLOUT
+  unsigned char        out [SERIAL_HUB_OUT_SIZE] ;
+} ;
+
+static struct hubPortStruct *ports [MAX_HUB_FDS] ;
+
+// The hub thread has hubLock while it deals with a batch of events, so
+//	ports can't go from under it. It's recursive so the port functions
+//	can add and remove ports.
+
+static pthread_once_t  hubOnce = PTHREAD_ONCE_INIT ;
+static pthread_mutex_t hubLock ;
+static pthread_t       hubThread ;
+static int             hubRunning = FALSE ;
+static int             hubCaller  = FALSE ;	// No thread: serialHubPoll does its work
+static int             epollFd    = -1 ;
+static int             wakeFd     = -1 ;
+
+static void hubInit (void)
+{
+  piMutexInit (&hubLock, PI_LOCK_NORMAL, TRUE) ;
+}
+
+
+/*
+ * hubArm:
+ *	Tell epoll what we want to know about a port
+ *********************************************************************************
+ */
+
+static void hubArm (struct hubPortStruct *p, int out)
+{
+  struct epoll_event ev ;
+
+  ev.events  = EPOLLIN | (out ? EPOLLOUT : 0) ;
+  ev.data.fd = p->fd ;
+  epoll_ctl (epollFd, EPOLL_CTL_MOD, p->fd, &ev) ;
+
+  p->outArmed = out ;
+}
+
+
+/*
+ * hubSend:
+ *	Write as much of the queue as the port will take. Called with its
+ *	outLock held.
+ *********************************************************************************
+ */
+
+static void hubSend (struct hubPortStruct *p)
+{
+  ssize_t n ;
+
+  while (p->outStart < p->outEnd)
+  {
+    if ((n = write (p->fd, p->out + p->outStart, p->outEnd - p->outStart)) > 0)
+    {
+      p->outStart += n ;
+      continue ;
+    }
+
+    if ((n < 0) && (errno == EINTR))
+      continue ;
+
+    if ((n < 0) && (errno != EAGAIN))	// It's not going anywhere
+      p->outStart = p->outEnd ;
+
+    break ;
+  }
+
+  if (p->outStart == p->outEnd)
+  {
+    p->outStart = p->outEnd = 0 ;
+    if (p->outArmed)
+      hubArm (p, FALSE) ;
+  }
+  else if (!p->outArmed)
+    hubArm (p, TRUE) ;
+}
+
+
+/*
+ * hubReceive:
+ *	Read everything that's waiting on a port and pass it on
+ *********************************************************************************
+ */
+
+static void hubReceive (struct hubPortStruct *p, unsigned char *buf, unsigned int size, int hangup)
+{
+  uint64_t one = 1 ;
+  unsigned int pushed ;
+  ssize_t n ;
+  int fd = p->fd ;
+
+  for (;;)
+  {
+    if ((n = read (fd, buf, size)) > 0)
+    {
+      if (p->function != NULL)
+      {
+	p->function (p->context, fd, buf, n) ;
+	if (ports [fd] != p)		// It removed itself
+	  return ;
+      }
+      else if ((pushed = piRingPush (p->ring, buf, n)) < (unsigned int)n)
+	p->lost += n - pushed ;
+
+      if ((unsigned int)n < size)	// That's all there is for now
+	return ;
+      continue ;
+    }
+
+    if ((n < 0) && (errno == EINTR))
+      continue ;
+
+    if (((n < 0) && (errno == EAGAIN)) || ((n == 0) && !hangup))
+      return ;
+
+    break ;
+  }
+
+// Gone - unplugged, most likely. Stop listening and let the owner know.
+
+  epoll_ctl (epollFd, EPOLL_CTL_DEL, fd, NULL) ;
+  p->error = TRUE ;
+
+  if (p->function != NULL)
+    p->function (p->context, fd, NULL, -1) ;
+  else
+    (void)write (piRingFd (p->ring), &one, sizeof (one)) ;
+}
+
+
+/*
+ * hubEvents: hubLoop:
+ *	Wait up to timeout mS for a batch of events and deal with them.
+ *	hubLoop is the hub thread, which just does that until it's stopped -
+ *	hubEvents fails with ESHUTDOWN then.
+ *********************************************************************************
+ */
+
+static int hubEvents (int timeout)
+{
+  struct epoll_event events [HUB_EVENTS] ;
+  struct hubPortStruct *p ;
+  unsigned char buf [SERIAL_IN_BUF_SIZE] ;
+  uint64_t value ;
+  int i, n, fd ;
+
+  if ((n = epoll_wait (epollFd, events, HUB_EVENTS, timeout)) <= 0)
+    return n ;
+
+  pthread_mutex_lock (&hubLock) ;
+
+  for (i = 0 ; i < n ; ++i)
+  {
+    if ((fd = events [i].data.fd) < 0)
+    {
+      (void)read (wakeFd, &value, sizeof (value)) ;
+      if (!hubRunning)
+      {
+	pthread_mutex_unlock (&hubLock) ;
+	errno = ESHUTDOWN ;
+	return -1 ;
+      }
+      continue ;
+    }
+
+    if ((p = ports [fd]) == NULL)
+      continue ;
+
+    if ((events [i].events & EPOLLOUT) != 0)
+    {
+      pthread_mutex_lock (&p->outLock) ;
+	hubSend (p) ;
+      pthread_mutex_unlock (&p->outLock) ;
+    }
+
+    if ((events [i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) != 0)
+      hubReceive (p, buf, sizeof (buf), (events [i].events & (EPOLLERR | EPOLLHUP)) != 0) ;
+  }
+
+  pthread_mutex_unlock (&hubLock) ;
+
+  return n ;
+}
+
+static void *hubLoop (void *arg)
+{
+  (void)arg ;
+
+  for (;;)
+    if ((hubEvents (-1) < 0) && (errno != EINTR))
+      break ;
+
+  return NULL ;
+}
+
+
+/*
+ * hubStart:
+ *	The first port starts the hub. Called with hubLock held.
+ *********************************************************************************
+ */
+
+static int hubStart (void)
+{
+  struct epoll_event ev ;
+
+  if (hubRunning)
+    return 0 ;
+
+  if ((epollFd = epoll_create1 (EPOLL_CLOEXEC)) < 0)
+    return -1 ;
+
+  if ((wakeFd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+    goto fail ;
+
+  ev.events  = EPOLLIN ;
+  ev.data.fd = -1 ;
+  if (epoll_ctl (epollFd, EPOLL_CTL_ADD, wakeFd, &ev) < 0)
+    goto fail ;
+
+  hubRunning = TRUE ;
+
+  if (hubCaller)
+    return 0 ;
+
+  if (pthread_create (&hubThread, NULL, hubLoop, NULL) != 0)
+  {
+    hubRunning = FALSE ;
+    errno = EAGAIN ;
+    goto fail ;
+  }
+
+  return 0 ;
+
+fail:
+  if (wakeFd >= 0) close (wakeFd) ;
+  close (epollFd) ;
+  wakeFd = epollFd = -1 ;
+  return -1 ;
+}
+
+
+/*
+ * serialHubAdd:
+ *	Have the hub look after the serial port fd. With a function, it's
+ *	called on the hub thread with each lump of data that arrives, and
+ *	with a NULL one and n of -1 if the port goes away. Without one, the
+ *	data goes in a ring of ringSize bytes (0 for the default) for
+ *	serialHubRead ().
+ *	Returns the ring's eventfd, readable while there's data (0 with a
+ *	function), or -1 with errno set.
+ *********************************************************************************
+ */
+
+int serialHubAdd (const int fd, void (*function)(void *context, int fd, const unsigned char *data, int n), void *context, int ringSize)
+{
+  struct hubPortStruct *p ;
+  struct epoll_event ev ;
+
+  if ((fd < 0) || (fd >= MAX_HUB_FDS))
+  {
+    errno = EBADF ;
+    return -1 ;
+  }
+
+  pthread_once (&hubOnce, hubInit) ;
+
+  pthread_mutex_lock (&hubLock) ;
+
+  if (ports [fd] != NULL)
+  {
+    pthread_mutex_unlock (&hubLock) ;
+    errno = EBUSY ;
+    return -1 ;
+  }
+
+  if (hubStart () < 0)
+  {
+    pthread_mutex_unlock (&hubLock) ;
+    return -1 ;
+  }
+
+  if ((p = (struct hubPortStruct *)calloc (1, sizeof (*p))) == NULL)
+  {
+    pthread_mutex_unlock (&hubLock) ;
+    errno = ENOMEM ;
+    return -1 ;
+  }
+
+  p->fd       = fd ;
+  p->function = function ;
+  p->context  = context ;
+
+  if (function == NULL)
+  {
+    if (ringSize <= 0)
+      ringSize = SERIAL_IN_BUF_SIZE ;
+
+    if ((p->ring = piRingCreate (PI_RING_SPSC, 1, ringSize, TRUE)) == NULL)
+    {
+      pthread_mutex_unlock (&hubLock) ;
+      free (p) ;
+      errno = ENOMEM ;
+      return -1 ;
+    }
+  }
+
+  p->flags = fcntl (fd, F_GETFL) ;
+  fcntl (fd, F_SETFL, p->flags | O_NONBLOCK) ;
+
+  piMutexInit (&p->outLock, PI_LOCK_NORMAL, FALSE) ;
+
+  ev.events  = EPOLLIN ;
+  ev.data.fd = fd ;
+  if (epoll_ctl (epollFd, EPOLL_CTL_ADD, fd, &ev) < 0)
+  {
+    pthread_mutex_unlock (&hubLock) ;
+    fcntl (fd, F_SETFL, p->flags) ;
+    pthread_mutex_destroy (&p->outLock) ;
+    piRingFree (p->ring) ;
+    free (p) ;
+    return -1 ;
+  }
+
+  __atomic_store_n (&ports [fd], p, __ATOMIC_RELEASE) ;
+
+  pthread_mutex_unlock (&hubLock) ;
+
+  return (p->ring != NULL) ? piRingFd (p->ring) : 0 ;
+}
+
+
+/*
+ * serialHubRemove:
+ *	Take a port out of the hub, dropping anything not yet sent or read.
+ *	The port is blocking again, as it was.
+ *********************************************************************************
+ */
+
+void serialHubRemove (const int fd)
+{
+  struct hubPortStruct *p ;
+
+  if ((fd < 0) || (fd >= MAX_HUB_FDS) || (ports [fd] == NULL))
+    return ;
+
+  pthread_mutex_lock (&hubLock) ;
+
+  if ((p = ports [fd]) == NULL)
+  {
+    pthread_mutex_unlock (&hubLock) ;
+    return ;
+  }
+
+  __atomic_store_n (&ports [fd], NULL, __ATOMIC_RELEASE) ;
+  epoll_ctl (epollFd, EPOLL_CTL_DEL, fd, NULL) ;
+
+  pthread_mutex_unlock (&hubLock) ;
+
+  fcntl (fd, F_SETFL, p->flags) ;
+  pthread_mutex_destroy (&p->outLock) ;
+  piRingFree (p->ring) ;
+  free (p) ;
+}
+
+
+/*
+ * serialHubRead:
+ *	Read up to max bytes of what the hub has collected for a port with
+ *	no function, waiting up to timeoutMs (-1 for ever, 0 for not at
+ *	all). Returns the number of bytes, 0 on a time-out or -1 on error.
+ *********************************************************************************
+ */
+
+int serialHubRead (const int fd, void *buf, int max, int timeoutMs)
+{
+  struct hubPortStruct *p ;
+  struct pollfd pfd ;
+  struct timespec now ;
+  long long deadline = 0, left ;
+  uint64_t one = 1 ;
+  int n ;
+
+  if ((fd < 0) || (fd >= MAX_HUB_FDS) || (max <= 0) ||
+      ((p = __atomic_load_n (&ports [fd], __ATOMIC_ACQUIRE)) == NULL) || (p->ring == NULL))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  if (timeoutMs > 0)
+  {
+    clock_gettime (CLOCK_MONOTONIC, &now) ;
+    deadline = (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000 + timeoutMs ;
+  }
+
+  pfd.fd     = piRingFd (p->ring) ;
+  pfd.events = POLLIN ;
+
+  for (;;)
+  {
+    if ((n = piRingPop (p->ring, buf, max)) > 0)
+      return n ;
+
+    if (__atomic_load_n (&p->error, __ATOMIC_ACQUIRE))
+    {
+      (void)write (pfd.fd, &one, sizeof (one)) ;	// For other pollers
+      errno = EIO ;
+      return -1 ;
+    }
+
+    if (timeoutMs == 0)
+      return 0 ;
+
+    left = -1 ;
+    if (timeoutMs > 0)
+    {
+      clock_gettime (CLOCK_MONOTONIC, &now) ;
+      if ((left = deadline - ((long long)now.tv_sec * 1000 + now.tv_nsec / 1000000)) <= 0)
+	return 0 ;
+    }
+
+    if ((poll (&pfd, 1, (int)left) < 0) && (errno != EINTR))
+      return -1 ;
+  }
+}
+
+
+/*
+ * serialHubWrite:
+ *	Send n bytes to a port in the hub without waiting. It all goes, or
+ *	if there isn't room in the port's queue none of it does.
+ *	Returns 0 or -1 with errno set (EAGAIN for a full queue).
+ *********************************************************************************
+ */
+
+int serialHubWrite (const int fd, const void *buf, int n)
+{
+  struct hubPortStruct *p ;
+
+  if ((fd < 0) || (fd >= MAX_HUB_FDS) || (n < 0) ||
+      ((p = __atomic_load_n (&ports [fd], __ATOMIC_ACQUIRE)) == NULL))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  if (n == 0)
+    return 0 ;
+
+  pthread_mutex_lock (&p->outLock) ;
+
+  if (p->error)
+  {
+    pthread_mutex_unlock (&p->outLock) ;
+    errno = EIO ;
+    return -1 ;
+  }
+
+  if ((unsigned int)n > SERIAL_HUB_OUT_SIZE - p->outEnd)
+  {
+    memmove (p->out, p->out + p->outStart, p->outEnd - p->outStart) ;
+    p->outEnd  -= p->outStart ;
+    p->outStart = 0 ;
+
+    if ((unsigned int)n > SERIAL_HUB_OUT_SIZE - p->outEnd)
+    {
+      pthread_mutex_unlock (&p->outLock) ;
+      errno = EAGAIN ;
+      return -1 ;
+    }
+  }
+
+  memcpy (p->out + p->outEnd, buf, n) ;
+  p->outEnd += n ;
+
+// Nothing ahead of it? Then try it now, and only involve the hub for
+//	what the UART won't take
+
+  if (!p->outArmed)
+    hubSend (p) ;
+
+  pthread_mutex_unlock (&p->outLock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * serialHubPending:
+ * serialHubLost:
+ *	Bytes still queued to go out, and bytes that came in while the ring
+ *	was full
+ *********************************************************************************
+ */
+
+int serialHubPending (const int fd)
+{
+  struct hubPortStruct *p ;
+  int n ;
+
+  if ((fd < 0) || (fd >= MAX_HUB_FDS) || ((p = __atomic_load_n (&ports [fd], __ATOMIC_ACQUIRE)) == NULL))
+    return -1 ;
+
+  pthread_mutex_lock (&p->outLock) ;
+    n = p->outEnd - p->outStart ;
+  pthread_mutex_unlock (&p->outLock) ;
+
+  return n ;
+}
+
+unsigned int serialHubLost (const int fd)
+{
+  struct hubPortStruct *p ;
+
+  if ((fd < 0) || (fd >= MAX_HUB_FDS) || ((p = __atomic_load_n (&ports [fd], __ATOMIC_ACQUIRE)) == NULL))
+    return 0 ;
+
+  return p->lost ;
+}
+
+
+/*
+ * serialHubStop:
+ *	Take out all the ports and stop the hub thread. Not from a port's
+ *	function.
+ *********************************************************************************
+ */
+
+void serialHubStop (void)
+{
+  uint64_t one = 1 ;
+  int fd ;
+
+  pthread_once (&hubOnce, hubInit) ;
+
+  for (fd = 0 ; fd < MAX_HUB_FDS ; ++fd)
+    serialHubRemove (fd) ;
+
+  pthread_mutex_lock (&hubLock) ;
+
+  if (!hubRunning)
+  {
+    pthread_mutex_unlock (&hubLock) ;
+    return ;
+  }
+
+  hubRunning = FALSE ;
+  (void)write (wakeFd, &one, sizeof (one)) ;
+
+  pthread_mutex_unlock (&hubLock) ;
+
+  if (hubCaller)
+    hubCaller = FALSE ;
+  else
+    pthread_join (hubThread, NULL) ;
+
+  close (wakeFd) ;
+  close (epollFd) ;
+  wakeFd = epollFd = -1 ;
+}
+
+
+/*
+ * serialHubPollFd: serialHubPoll:
+ *	Run the hub from the caller's own event loop rather than a thread of
+ *	its own. Ask for the fd before the first serialHubAdd and watch it for
+ *	reading; when it's ready, serialHubPoll deals with whatever's there
+ *	without blocking - the port functions are called from it, and queued
+ *	writes go out from it too. Ring ports still have their own eventfds.
+ *	Returns the fd, or -1 with errno EBUSY if the hub thread's running.
+ *	Poll returns the number of events dealt with.
+ *********************************************************************************
+ */
+
+int serialHubPollFd (void)
+{
+  int fd ;
+
+  pthread_once (&hubOnce, hubInit) ;
+
+  pthread_mutex_lock (&hubLock) ;
+
+  if (hubRunning && !hubCaller)
+  {
+    pthread_mutex_unlock (&hubLock) ;
+    errno = EBUSY ;
+    return -1 ;
+  }
+
+  hubCaller = TRUE ;
+  if (hubStart () < 0)
+  {
+    hubCaller = FALSE ;
+    pthread_mutex_unlock (&hubLock) ;
+    return -1 ;
+  }
+
+  fd = epollFd ;
+  pthread_mutex_unlock (&hubLock) ;
+
+  return fd ;
+}
+
+int serialHubPoll (void)
+{
+  if (!hubCaller || !hubRunning)
+  {
+    errno = EBUSY ;
+    return -1 ;
+  }
+
+  return hubEvents (0) ;
+}
@@ -0,0 +1,43 @@
+/*
+ * wiringSerialHub.h:
+ *	Service many serial ports from one thread.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#define	SERIAL_HUB_OUT_SIZE	4096
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int  serialHubAdd     (const int fd, void (*function)(void *context, int fd, const unsigned char *data, int n), void *context, int ringSize) ;
+extern void serialHubRemove  (const int fd) ;
+extern int  serialHubRead    (const int fd, void *buf, int max, int timeoutMs) ;
+extern int  serialHubWrite   (const int fd, const void *buf, int n) ;
+extern int  serialHubPending (const int fd) ;
+extern unsigned int serialHubLost (const int fd) ;
+extern void serialHubStop    (void) ;
+extern int  serialHubPollFd  (void) ;
+extern int  serialHubPoll    (void) ;
+
+#ifdef __cplusplus
+}
+#endif
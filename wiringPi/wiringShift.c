@@ -23,6 +23,7 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
 
 #include "wiringPi.h"
 #include "wiringShift.h"
@@ -81,3 +82,102 @@ void shiftOut (uint8_t dPin, uint8_t cPin, uint8_t order, uint8_t val)
       digitalWrite (cPin, LOW) ;
     }
 }
+
+
+/*
+ * halfWait:
+ *	Hold the clock for at least the given number of nS, if any
+ *********************************************************************************
+ */
+
+static inline void halfWait (unsigned int ns)
+{
+  if (ns != 0)
+    delayNanoseconds (ns) ;
+}
+
+
+/*
+ * shiftOutBuffer:
+ * shiftInBuffer:
+ *	Shift a whole buffer of bytes out/in. The pins are resolved once into
+ *	handles so on-board pins are clocked with direct GPSET/GPCLR stores
+ *	rather than a full digitalWrite per edge. That can be too fast for
+ *	some devices, so halfPeriodNs sets a minimum time for each half of the
+ *	clock - 0 for as fast as it'll go.
+ *	Returns 0, or -1 if either pin doesn't exist.
+ *********************************************************************************
+ */
+
+int shiftOutBuffer (int dPin, int cPin, int order, const uint8_t *buf, size_t n, unsigned int halfPeriodNs)
+{
+  wpiPin_t d, c ;
+  size_t   j ;
+  int      i ;
+  uint8_t  val ;
+
+  if ((d = wiringPiPinOpen (dPin)) == NULL)
+    return -1 ;
+  if ((c = wiringPiPinOpen (cPin)) == NULL)
+  {
+    wiringPiPinClose (d) ;
+    return -1 ;
+  }
+
+  for (j = 0 ; j < n ; ++j)
+  {
+    val = buf [j] ;
+    for (i = 0 ; i < 8 ; ++i)
+    {
+      if (order == MSBFIRST)
+	wpiPinWrite (d, (val & (0x80 >> i)) != 0) ;
+      else
+	wpiPinWrite (d, (val & (0x01 << i)) != 0) ;
+      halfWait (halfPeriodNs) ;
+      wpiPinWrite (c, HIGH) ;
+      halfWait (halfPeriodNs) ;
+      wpiPinWrite (c, LOW) ;
+    }
+  }
+
+  wiringPiPinClose (c) ;
+  wiringPiPinClose (d) ;
+
+  return 0 ;
+}
+
+int shiftInBuffer (int dPin, int cPin, int order, uint8_t *buf, size_t n, unsigned int halfPeriodNs)
+{
+  wpiPin_t d, c ;
+  size_t   j ;
+  int      i ;
+  uint8_t  val ;
+
+  if ((d = wiringPiPinOpen (dPin)) == NULL)
+    return -1 ;
+  if ((c = wiringPiPinOpen (cPin)) == NULL)
+  {
+    wiringPiPinClose (d) ;
+    return -1 ;
+  }
+
+  for (j = 0 ; j < n ; ++j)
+  {
+    val = 0 ;
+    for (i = 0 ; i < 8 ; ++i)
+    {
+      wpiPinWrite (c, HIGH) ;
+      halfWait (halfPeriodNs) ;
+      if (wpiPinRead (d) != LOW)
+	val |= (order == MSBFIRST) ? (0x80 >> i) : (0x01 << i) ;
+      wpiPinWrite (c, LOW) ;
+      halfWait (halfPeriodNs) ;
+    }
+    buf [j] = val ;
+  }
+
+  wiringPiPinClose (c) ;
+  wiringPiPinClose (d) ;
+
+  return 0 ;
+}
@@ -28,6 +28,7 @@
 #ifndef	_STDINT_H
 #  include <stdint.h>
 #endif
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -36,6 +37,9 @@ extern "C" {
 extern uint8_t shiftIn      (uint8_t dPin, uint8_t cPin, uint8_t order) ;
 extern void    shiftOut     (uint8_t dPin, uint8_t cPin, uint8_t order, uint8_t val) ;
 
+extern int     shiftOutBuffer (int dPin, int cPin, int order, const uint8_t *buf, size_t n, unsigned int halfPeriodNs) ;
+extern int     shiftInBuffer  (int dPin, int cPin, int order,       uint8_t *buf, size_t n, unsigned int halfPeriodNs) ;
+
 #ifdef __cplusplus
 }
 #endif
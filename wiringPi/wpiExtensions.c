@@ -35,6 +35,7 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <fcntl.h>
+#include <pthread.h>
 
 #include <wiringPi.h>
 
@@ -54,6 +55,7 @@
 #include "max5322.h"
 #include "ads1115.h"
 #include "sn3218.h"
+#include "pca9685.h"
 #include "drcSerial.h"
 #include "drcNet.h"
 #include "../wiringPiD/drcNetCmd.h"
@@ -62,13 +64,16 @@
 #include "htu21d.h"
 #include "ds18b20.h"
 #include "rht03.h"
+#include "wiringPiSPI.h"
+#include "wiringPiI2C.h"
+#include "wiringPiSim.h"
 
 #include "wpiExtensions.h"
 
 extern int wiringPiDebug ;
 
 static int verbose ;
-static char errorMessage [1024] ;
+static __thread char errorMessage [1024] ;
 
 
 // Local structure to hold details
@@ -77,8 +82,19 @@ struct extensionFunctionStruct
 {
   const char *name ;
   int	(*function)(char *progName, int pinBase, char *params) ;
+  int	numPins ;	// Or the default if ...
+  int	pinsFirst ;	// ... the first parameter is the pin count
+  int	bus ;		// EXT_BUS_xxx, for wiringPiLoadConfig
+  int	i2cAddr ;	// Its fixed I2C address, EXT_ADDR_PARAM or 0
 } ;
 
+#define	EXT_BUS_NONE	0	// On-board pins or nothing at all
+#define	EXT_BUS_I2C	1
+#define	EXT_BUS_SPI	2	// The first parameter says which
+#define	EXT_BUS_OWN	3	// A serial port or network connection of its own
+
+#define	EXT_ADDR_PARAM	(-1)	// The I2C address is the first parameter
+
 
 /*
  * verbError:
@@ -134,6 +150,67 @@ static char *extractInt (char *progName, char *p, int *num)
 }
 
 
+/*
+ * extractSpi:
+ *	Check & return an SPI channel at the given location (prefixed by a :)
+ *	Either just the chip-select (0 or 1, on SPI0) or bus.cs, e.g. 3.0
+ *	for /dev/spidev3.0, and then optionally @pin for a GPIO chip select
+ *	with that as the carrier, e.g. 0.1@17
+ *********************************************************************************
+ */
+
+static char *extractSpi (char *progName, char *p, int *spi)
+{
+  int bus = 0, cs, pin ;
+
+  if ((p = extractInt (progName, p, &cs)) == NULL)
+    return NULL ;
+
+  if (*p == '.')
+  {
+    bus = cs ;
+    ++p ;
+    if (!isdigit (*p))
+    {
+      verbError ("%s: digit expected", progName) ;
+      return NULL ;
+    }
+    cs = strtol (p, NULL, 10) ;
+    while (isdigit (*p))
+      ++p ;
+  }
+
+  if ((bus < 0) || (bus >= WPI_SPI_MAX_BUS) || (cs < 0) || (cs >= WPI_SPI_MAX_CHANNEL))
+  {
+    verbError ("%s: SPI bus (%d) or channel (%d) out of range", progName, bus, cs) ;
+    return NULL ;
+  }
+
+  *spi = WPI_SPI_CHANNEL (bus, cs) ;
+
+  if (*p == '@')
+  {
+    ++p ;
+    if (!isdigit (*p))
+    {
+      verbError ("%s: chip select pin expected", progName) ;
+      return NULL ;
+    }
+    pin = strtol (p, NULL, 10) ;
+    while (isdigit (*p))
+      ++p ;
+
+    if ((*spi = wiringPiSPIGpioCS (*spi, pin)) < 0)
+    {
+      verbError ("%s: Unable to use pin %d as an SPI chip select", progName, pin) ;
+      return NULL ;
+    }
+  }
+
+  return p ;
+}
+
+
 /*
  * extractStr:
  *	Check & return a string at the given location (prefixed by a :)
@@ -274,7 +351,7 @@ static int doExtensionMcp23017 (char *progName, int pinBase, char *params)
 /*
  * doExtensionMcp23s08:
  *	MCP23s08 - 8-bit SPI GPIO expansion chip
- *	mcp23s08:base:spi:port
+ *	mcp23s08:base:spi:port		(spi is cs, or bus.cs)
  *********************************************************************************
  */
 
@@ -282,15 +359,9 @@ static int doExtensionMcp23s08 (char *progName, int pinBase, char *params)
 {
   int spi, port ;
 
-  if ((params = extractInt (progName, params, &spi)) == NULL)
+  if ((params = extractSpi (progName, params, &spi)) == NULL)
     return FALSE ;
 
-  if ((spi < 0) || (spi > 1))
-  {
-    verbError ("%s: SPI address (%d) out of range", progName, spi) ;
-    return FALSE ;
-  }
-
   if ((params = extractInt (progName, params, &port)) == NULL)
     return FALSE ;
 
@@ -309,7 +380,7 @@ static int doExtensionMcp23s08 (char *progName, int pinBase, char *params)
 /*
  * doExtensionMcp23s17:
  *	MCP23s17 - 16-bit SPI GPIO expansion chip
- *	mcp23s17:base:spi:port
+ *	mcp23s17:base:spi:port		(spi is cs, or bus.cs)
  *********************************************************************************
  */
 
@@ -317,15 +388,9 @@ static int doExtensionMcp23s17 (char *progName, int pinBase, char *params)
 {
   int spi, port ;
 
-  if ((params = extractInt (progName, params, &spi)) == NULL)
+  if ((params = extractSpi (progName, params, &spi)) == NULL)
     return FALSE ;
 
-  if ((spi < 0) || (spi > 1))
-  {
-    verbError ("%s: SPI address (%d) out of range", progName, spi) ;
-    return FALSE ;
-  }
-
   if ((params = extractInt (progName, params, &port)) == NULL)
     return FALSE ;
 
@@ -458,29 +523,76 @@ static int doExtensionPcf8591 (char *progName, int pinBase, char *params)
 
 /*
  * doExtensionPseudoPins:
- *	64 Memory resident pseudo pins
- *	pseudoPins:base
+ *	64 (or numPins) Memory resident pseudo pins
+ *	pseudoPins:base[:numPins]
  *********************************************************************************
  */
 
-static int doExtensionPseudoPins (UNU char *progName, int pinBase, UNU char *params)
+static int doExtensionPseudoPins (char *progName, int pinBase, char *params)
 {
-  pseudoPinsSetup (pinBase) ;
+  int numPins = 64 ;
 
-  return TRUE ;
+  if (*params == ':')
+    if ((params = extractInt (progName, params, &numPins)) == NULL)
+      return FALSE ;
+
+  return pseudoPinsSetupN (pinBase, numPins) ;
+}
+
+
+/*
+ * doExtensionSim:
+ *	Simulated expander with a fixed latency per access
+ *	sim:base[:numPins[:latencyUs]]
+ *********************************************************************************
+ */
+
+static int doExtensionSim (char *progName, int pinBase, char *params)
+{
+  int numPins   = 16 ;
+  int latencyUs = 0 ;
+
+  if (*params == ':')
+    if ((params = extractInt (progName, params, &numPins)) == NULL)
+      return FALSE ;
+
+  if (*params == ':')
+    if ((params = extractInt (progName, params, &latencyUs)) == NULL)
+      return FALSE ;
+
+  if ((numPins < 1) || (latencyUs < 0))
+  {
+    verbError ("%s: sim: bad pin count or latency", progName) ;
+    return FALSE ;
+  }
+
+  return wiringPiSimNode (pinBase, numPins, latencyUs) ;
 }
 
 
 /*
  * doExtensionBmp180:
  *	Analog Temp + Pressure
- *	bmp180:base
+ *	bmp180:base[:oversampling]	(0-3)
  *********************************************************************************
  */
 
-static int doExtensionBmp180 (UNU char *progName, int pinBase, UNU char *params)
+static int doExtensionBmp180 (char *progName, int pinBase, char *params)
 {
+  int oss = 0 ;
+
+  if (*params == ':')
+    if ((params = extractInt (progName, params, &oss)) == NULL)
+      return FALSE ;
+
+  if ((oss < 0) || (oss > 3))
+  {
+    verbError ("%s: bmp180: oversampling (%d) out of range (0-3)", progName, oss) ;
+    return FALSE ;
+  }
+
   bmp180Setup (pinBase) ;
+  bmp180Oversampling (oss) ;
 
   return TRUE ;
 }
@@ -503,36 +615,52 @@ static int doExtensionHtu21d (UNU char *progName, int pinBase, UNU char *params)
 
 /*
  * doExtensionDs18b20:
- *	1-Wire Temperature
- *	htu21d:base:serialNum
+ *	1-Wire Temperature - with a period, cached and refreshed in the background
+ *	ds18b20:base:serialNum[:periodMs]
  *********************************************************************************
  */
 
 static int doExtensionDs18b20 (char *progName, int pinBase, char *params)
 {
   char *serialNum ;
+  int   periodMs ;
 
   if ((params = extractStr (progName, params, &serialNum)) == NULL)
     return FALSE ;
 
+  if (*params == ':')
+  {
+    if ((params = extractInt (progName, params, &periodMs)) == NULL)
+      return FALSE ;
+    return ds18b20SetupCached (pinBase, serialNum, periodMs) ;
+  }
+
   return ds18b20Setup (pinBase, serialNum) ;
 }
 
 
 /*
  * doExtensionRht03:
- *	Maxdetect 1-Wire Temperature & Humidity
- *	rht03:base:piPin
+ *	Maxdetect 1-Wire Temperature & Humidity - with a period, sampled in
+ *	the background
+ *	rht03:base:piPin[:periodMs]
  *********************************************************************************
  */
 
 static int doExtensionRht03 (char *progName, int pinBase, char *params)
 {
-  int piPin ;
+  int piPin, periodMs ;
 
   if ((params = extractInt (progName, params, &piPin)) == NULL)
     return FALSE ;
 
+  if (*params == ':')
+  {
+    if ((params = extractInt (progName, params, &periodMs)) == NULL)
+      return FALSE ;
+    return rht03SetupCached (pinBase, piPin, periodMs) ;
+  }
+
   return rht03Setup (pinBase, piPin) ;
 }
 
@@ -540,7 +668,7 @@ static int doExtensionRht03 (char *progName, int pinBase, char *params)
 /*
  * doExtensionMax31855:
  *	Analog IO
- *	max31855:base:spiChan
+ *	max31855:base:spiChan		(spiChan is cs, or bus.cs)
  *********************************************************************************
  */
 
@@ -548,14 +676,8 @@ static int doExtensionMax31855 (char *progName, int pinBase, char *params)
 {
   int spi ;
 
-  if ((params = extractInt (progName, params, &spi)) == NULL)
-    return FALSE ;
-
-  if ((spi < 0) || (spi > 1))
-  {
-    verbError ("%s: SPI channel (%d) out of range", progName, spi) ;
+  if ((params = extractSpi (progName, params, &spi)) == NULL)
     return FALSE ;
-  }
 
   max31855Setup (pinBase, spi) ;
 
@@ -566,7 +688,7 @@ static int doExtensionMax31855 (char *progName, int pinBase, char *params)
 /*
  * doExtensionMcp3002:
  *	Analog IO
- *	mcp3002:base:spiChan
+ *	mcp3002:base:spiChan		(spiChan is cs, or bus.cs)
  *********************************************************************************
  */
 
@@ -574,15 +696,9 @@ static int doExtensionMcp3002 (char *progName, int pinBase, char *params)
 {
   int spi ;
 
-  if ((params = extractInt (progName, params, &spi)) == NULL)
+  if ((params = extractSpi (progName, params, &spi)) == NULL)
     return FALSE ;
 
-  if ((spi < 0) || (spi > 1))
-  {
-    verbError ("%s: SPI channel (%d) out of range", progName, spi) ;
-    return FALSE ;
-  }
-
   mcp3002Setup (pinBase, spi) ;
 
   return TRUE ;
@@ -592,7 +708,7 @@ static int doExtensionMcp3002 (char *progName, int pinBase, char *params)
 /*
  * doExtensionMcp3004:
  *	Analog IO
- *	mcp3004:base:spiChan
+ *	mcp3004:base:spiChan		(spiChan is cs, or bus.cs)
  *********************************************************************************
  */
 
@@ -600,14 +716,8 @@ static int doExtensionMcp3004 (char *progName, int pinBase, char *params)
 {
   int spi ;
 
-  if ((params = extractInt (progName, params, &spi)) == NULL)
-    return FALSE ;
-
-  if ((spi < 0) || (spi > 1))
-  {
-    verbError ("%s: SPI channel (%d) out of range", progName, spi) ;
+  if ((params = extractSpi (progName, params, &spi)) == NULL)
     return FALSE ;
-  }
 
   mcp3004Setup (pinBase, spi) ;
 
@@ -618,7 +728,7 @@ static int doExtensionMcp3004 (char *progName, int pinBase, char *params)
 /*
  * doExtensionMax5322:
  *	Analog O
- *	max5322:base:spiChan
+ *	max5322:base:spiChan		(spiChan is cs, or bus.cs)
  *********************************************************************************
  */
 
@@ -626,14 +736,8 @@ static int doExtensionMax5322 (char *progName, int pinBase, char *params)
 {
   int spi ;
 
-  if ((params = extractInt (progName, params, &spi)) == NULL)
-    return FALSE ;
-
-  if ((spi < 0) || (spi > 1))
-  {
-    verbError ("%s: SPI channel (%d) out of range", progName, spi) ;
+  if ((params = extractSpi (progName, params, &spi)) == NULL)
     return FALSE ;
-  }
 
   max5322Setup (pinBase, spi) ;
 
@@ -644,7 +748,7 @@ static int doExtensionMax5322 (char *progName, int pinBase, char *params)
 /*
  * doExtensionMcp4802:
  *	Analog IO
- *	mcp4802:base:spiChan
+ *	mcp4802:base:spiChan		(spiChan is cs, or bus.cs)
  *********************************************************************************
  */
 
@@ -652,14 +756,8 @@ static int doExtensionMcp4802 (char *progName, int pinBase, char *params)
 {
   int spi ;
 
-  if ((params = extractInt (progName, params, &spi)) == NULL)
-    return FALSE ;
-
-  if ((spi < 0) || (spi > 1))
-  {
-    verbError ("%s: SPI channel (%d) out of range", progName, spi) ;
+  if ((params = extractSpi (progName, params, &spi)) == NULL)
     return FALSE ;
-  }
 
   mcp4802Setup (pinBase, spi) ;
 
@@ -681,6 +779,42 @@ static int doExtensionSn3218 (UNU char *progName, int pinBase, UNU char *params)
 }
 
 
+/*
+ * doExtensionPca9685:
+ *	Analog Output (PWM/Servo Driver)
+ *	pca9685:base:i2cAddr[:freq]
+ *********************************************************************************
+ */
+
+static int doExtensionPca9685 (char *progName, int pinBase, char *params)
+{
+  int i2c, freq = 0 ;
+
+  if ((params = extractInt (progName, params, &i2c)) == NULL)
+    return FALSE ;
+
+  if ((i2c < 0x03) || (i2c > 0x77))
+  {
+    verbError ("%s: i2c address (0x%X) out of range", progName, i2c) ;
+    return FALSE ;
+  }
+
+  if (*params == ':')
+  {
+    if ((params = extractInt (progName, params, &freq)) == NULL)
+      return FALSE ;
+
+    if ((freq < 24) || (freq > 1526))
+    {
+      verbError ("%s: frequency (%d) out of range", progName, freq) ;
+      return FALSE ;
+    }
+  }
+
+  return pca9685Setup (pinBase, i2c, freq) ;
+}
+
+
 /*
  * doExtensionMcp3422:
  *	Analog IO
@@ -831,59 +965,58 @@ static int doExtensionDrcNet (char *progName, int pinBase, char *params)
 
 static struct extensionFunctionStruct extensionFunctions [] = 
 {
-  { "mcp23008",		&doExtensionMcp23008 	},
-  { "mcp23016",		&doExtensionMcp23016 	},
-  { "mcp23017",		&doExtensionMcp23017 	},
-  { "mcp23s08",		&doExtensionMcp23s08 	},
-  { "mcp23s17",		&doExtensionMcp23s17 	},
-  { "sr595",		&doExtensionSr595	},
-  { "pcf8574",		&doExtensionPcf8574	},
-  { "pcf8591",		&doExtensionPcf8591	},
-  { "bmp180",		&doExtensionBmp180	},
-  { "pseudoPins",	&doExtensionPseudoPins	},
-  { "htu21d",		&doExtensionHtu21d	},
-  { "ds18b20",		&doExtensionDs18b20	},
-  { "rht03",		&doExtensionRht03	},
-  { "mcp3002",		&doExtensionMcp3002	},
-  { "mcp3004",		&doExtensionMcp3004	},
-  { "mcp4802",		&doExtensionMcp4802	},
-  { "mcp3422",		&doExtensionMcp3422	},
-  { "max31855",		&doExtensionMax31855	},
-  { "ads1115",		&doExtensionAds1115	},
-  { "max5322",		&doExtensionMax5322	},
-  { "sn3218",		&doExtensionSn3218	},
-  { "drcs",		&doExtensionDrcS	},
-  { "drcn",		&doExtensionDrcNet	},
-  { NULL,		NULL		 	},
+  { "mcp23008",		&doExtensionMcp23008,	 8, FALSE,	EXT_BUS_I2C,	EXT_ADDR_PARAM	},
+  { "mcp23016",		&doExtensionMcp23016,	16, FALSE,	EXT_BUS_I2C,	EXT_ADDR_PARAM	},
+  { "mcp23017",		&doExtensionMcp23017,	16, FALSE,	EXT_BUS_I2C,	EXT_ADDR_PARAM	},
+  { "mcp23s08",		&doExtensionMcp23s08,	 8, FALSE,	EXT_BUS_SPI,	0	},
+  { "mcp23s17",		&doExtensionMcp23s17,	16, FALSE,	EXT_BUS_SPI,	0	},
+  { "sr595",		&doExtensionSr595,	 0, TRUE,	EXT_BUS_NONE,	0	},
+  { "pcf8574",		&doExtensionPcf8574,	 8, FALSE,	EXT_BUS_I2C,	EXT_ADDR_PARAM	},
+  { "pcf8591",		&doExtensionPcf8591,	 4, FALSE,	EXT_BUS_I2C,	EXT_ADDR_PARAM	},
+  { "bmp180",		&doExtensionBmp180,	 4, FALSE,	EXT_BUS_I2C,	0x77	},
+  { "pseudoPins",	&doExtensionPseudoPins,	64, TRUE,	EXT_BUS_NONE,	0	},
+  { "sim",		&doExtensionSim,	16, TRUE,	EXT_BUS_NONE,	0	},
+  { "htu21d",		&doExtensionHtu21d,	 2, FALSE,	EXT_BUS_I2C,	0x40	},
+  { "ds18b20",		&doExtensionDs18b20,	 1, FALSE,	EXT_BUS_NONE,	0	},
+  { "rht03",		&doExtensionRht03,	 2, FALSE,	EXT_BUS_NONE,	0	},
+  { "mcp3002",		&doExtensionMcp3002,	 2, FALSE,	EXT_BUS_SPI,	0	},
+  { "mcp3004",		&doExtensionMcp3004,	 8, FALSE,	EXT_BUS_SPI,	0	},
+  { "mcp4802",		&doExtensionMcp4802,	 2, FALSE,	EXT_BUS_SPI,	0	},
+  { "mcp3422",		&doExtensionMcp3422,	 4, FALSE,	EXT_BUS_I2C,	EXT_ADDR_PARAM	},
+  { "max31855",		&doExtensionMax31855,	 4, FALSE,	EXT_BUS_SPI,	0	},
+  { "ads1115",		&doExtensionAds1115,	 8, FALSE,	EXT_BUS_I2C,	EXT_ADDR_PARAM	},
+  { "max5322",		&doExtensionMax5322,	 2, FALSE,	EXT_BUS_SPI,	0	},
+  { "sn3218",		&doExtensionSn3218,	18, FALSE,	EXT_BUS_I2C,	0x54	},
+  { "pca9685",		&doExtensionPca9685,	16, FALSE,	EXT_BUS_I2C,	EXT_ADDR_PARAM	},
+  { "drcs",		&doExtensionDrcS,	 0, TRUE,	EXT_BUS_OWN,	0	},
+  { "drcn",		&doExtensionDrcNet,	 0, TRUE,	EXT_BUS_OWN,	0	},
+  { NULL,		NULL,			 0, FALSE,	EXT_BUS_NONE,	0	},
 } ;
 
 
 /*
- * loadWPiExtension:
- *	Load in a wiringPi extension
- *	The extensionData always starts with the name, a colon then the pinBase
- *	number. Other parameters after that are decoded by the module in question.
+ * splitExtension:
+ *	The extension name and pinBase at the front of an extension string.
+ *	Terminates the name and returns a pointer to the parameters after
+ *	the pinBase, or NULL.
  *********************************************************************************
  */
 
-int loadWPiExtension (char *progName, char *extensionData, int printErrors)
+static char *splitExtension (char *progName, char *extensionData, int *pinBase)
 {
   char *p ;
-  char *extension = extensionData ;
-  struct extensionFunctionStruct *extensionFn ;
-  int pinBase = 0 ;
 
-  verbose = printErrors ;
+  *pinBase = 0 ;
 
 // Get the extension name by finding the first colon
 
-  p = extension ;
+  p = extensionData ;
   while (*p != ':')
   {
     if (!*p)	// ran out of characters
     {
       verbError ("%s: extension name not terminated by a colon", progName) ;
-      return FALSE ;
+      return NULL ;
     }
     ++p ;
   }
@@ -894,35 +1027,317 @@ int loadWPiExtension (char *progName, char *extensionData, int printErrors)
   if (!isdigit (*p))
   {
     verbError ("%s: decimal pinBase number expected after extension name", progName) ;
-    return FALSE ;
+    return NULL ;
   }
 
   while (isdigit (*p))
   {
-    if (pinBase > 2147483647) // 2^31-1 ... Lets be realistic here...
+    if (*pinBase > 2147483647) // 2^31-1 ... Lets be realistic here...
     {
       verbError ("%s: pinBase too large", progName) ;
-      return FALSE ;
+      return NULL ;
     }
 
-    pinBase = pinBase * 10 + (*p - '0') ;
+    *pinBase = *pinBase * 10 + (*p - '0') ;
     ++p ;
   }
 
-  if (pinBase < 64)
+  if (*pinBase < 64)
   {
-    verbError ("%s: pinBase (%d) too small. Minimum is 64.", progName, pinBase) ;
-    return FALSE ;
+    verbError ("%s: pinBase (%d) too small. Minimum is 64.", progName, *pinBase) ;
+    return NULL ;
   }
 
-// Search for extensions:
+  return p ;
+}
+
+static struct extensionFunctionStruct *findExtension (const char *name)
+{
+  struct extensionFunctionStruct *extensionFn ;
 
   for (extensionFn = extensionFunctions ; extensionFn->name != NULL ; ++extensionFn)
+    if (strcmp (extensionFn->name, name) == 0)
+      return extensionFn ;
+
+  return NULL ;
+}
+
+
+/*
+ * loadWPiExtension:
+ *	Load in a wiringPi extension
+ *	The extensionData always starts with the name, a colon then the pinBase
+ *	number. Other parameters after that are decoded by the module in question.
+ *********************************************************************************
+ */
+
+int loadWPiExtension (char *progName, char *extensionData, int printErrors)
+{
+  char *p ;
+  struct extensionFunctionStruct *extensionFn ;
+  int pinBase ;
+
+  verbose = printErrors ;
+
+  if ((p = splitExtension (progName, extensionData, &pinBase)) == NULL)
+    return FALSE ;
+
+// Search for extensions:
+
+  if ((extensionFn = findExtension (extensionData)) != NULL)
+    return extensionFn->function (progName, pinBase, p) ;
+
+  fprintf (stderr, "%s: extension %s not found", progName, extensionData) ;
+  return FALSE ;
+}
+
+
+/*
+ * wiringPiLoadConfig:
+ *	Load a whole board's worth of extensions from a file, one per line
+ *	in the same form as loadWPiExtension, with # comments.
+ *	The lot is checked first - names, parameters that give pin counts
+ *	any pin ranges that overlap each other or nodes already there, and
+ *	I2C addresses with nothing there (from a cached scan of the bus) -
+ *	and nothing is set up unless it's all good. Then the I2C devices
+ *	share bus handles and the devices on each bus are set up in turn,
+ *	with a thread for each bus so slow ones don't hold up the rest.
+ *********************************************************************************
+ */
+
+#define	MAX_CONFIG_LINES	256
+
+struct configLineStruct
+{
+  char  text [256] ;		// Name, then the parameters
+  char *params ;
+  char  busKey [64] ;
+  int   lineNum ;
+  int   pinBase ;
+  int   numPins ;
+  int   group ;
+  struct extensionFunctionStruct *fn ;
+} ;
+
+struct configGroupStruct
+{
+  char      *progName ;
+  struct configLineStruct *lines ;
+  int        numLines ;
+  int        group ;
+  int        ok ;
+  pthread_t  thread ;
+} ;
+
+static void *configGroupThread (void *arg)
+{
+  struct configGroupStruct *g = (struct configGroupStruct *)arg ;
+  struct configLineStruct  *l ;
+  int i ;
+
+  for (i = 0 ; i < g->numLines ; ++i)
   {
-    if (strcmp (extensionFn->name, extension) == 0)
-      return extensionFn->function (progName, pinBase, p) ;
+    l = &g->lines [i] ;
+    if (l->group != g->group)
+      continue ;
+
+    if (!l->fn->function (g->progName, l->pinBase, l->params))
+    {
+      verbError ("%s: line %d: %s setup failed", g->progName, l->lineNum, l->text) ;
+      g->ok = FALSE ;
+    }
   }
 
-  fprintf (stderr, "%s: extension %s not found", progName, extension) ;
-  return FALSE ;
+  return NULL ;
+}
+
+static int comparePinBase (const void *a, const void *b)
+{
+  return (*(struct configLineStruct * const *)a)->pinBase - (*(struct configLineStruct * const *)b)->pinBase ;
+}
+
+int wiringPiLoadConfig (char *progName, const char *path, int printErrors)
+{
+  FILE *fd ;
+  struct configLineStruct  *lines, *l, *sorted [MAX_CONFIG_LINES] ;
+  struct configGroupStruct  groups [MAX_CONFIG_LINES] ;
+  char  buf [256], *p, *q ;
+  int   numLines = 0, numGroups = 0, lineNum = 0 ;
+  int   i, j, pin, addr, share, ok = TRUE ;
+
+  verbose = printErrors ;
+
+  if ((fd = fopen (path, "r")) == NULL)
+  {
+    verbError ("%s: Unable to open %s: %s", progName, path, strerror (errno)) ;
+    return FALSE ;
+  }
+
+  if ((lines = (struct configLineStruct *)calloc (MAX_CONFIG_LINES, sizeof (*lines))) == NULL)
+  {
+    fclose (fd) ;
+    verbError ("%s: Out of memory", progName) ;
+    return FALSE ;
+  }
+
+// Read and check it all
+
+  while (fgets (buf, sizeof (buf), fd) != NULL)
+  {
+    ++lineNum ;
+
+    if ((p = strchr (buf, '#')) != NULL)
+      *p = 0 ;
+    for (p = buf ; isspace (*p) ; ++p)
+      ;
+    for (q = p + strlen (p) ; (q > p) && isspace (q [-1]) ; --q)
+      ;
+    *q = 0 ;
+
+    if (*p == 0)
+      continue ;
+
+    if (numLines == MAX_CONFIG_LINES)
+    {
+      verbError ("%s: %s: line %d: too many extensions", progName, path, lineNum) ;
+      ok = FALSE ;
+      break ;
+    }
+
+    l = &lines [numLines] ;
+    strcpy (l->text, p) ;
+    l->lineNum = lineNum ;
+
+    if ((l->params = splitExtension (progName, l->text, &l->pinBase)) == NULL)
+    {
+      verbError ("%s: %s: line %d: bad extension", progName, path, lineNum) ;
+      ok = FALSE ;
+      continue ;
+    }
+
+    if ((l->fn = findExtension (l->text)) == NULL)
+    {
+      verbError ("%s: %s: line %d: extension %s not found", progName, path, lineNum, l->text) ;
+      ok = FALSE ;
+      continue ;
+    }
+
+    l->numPins = l->fn->numPins ;
+    if (l->fn->pinsFirst && (*l->params == ':'))
+      l->numPins = atoi (l->params + 1) ;
+
+    if (l->numPins < 1)
+    {
+      verbError ("%s: %s: line %d: pin count expected", progName, path, lineNum) ;
+      ok = FALSE ;
+      continue ;
+    }
+
+// Devices on the same bus go in the same group
+
+    /**/ if (l->fn->bus == EXT_BUS_I2C)
+      strcpy (l->busKey, "i2c") ;
+    else if (l->fn->bus == EXT_BUS_SPI)		// cs, or bus.cs
+      snprintf (l->busKey, sizeof (l->busKey), "spi%d", (l->params [1 + strspn (l->params + 1, "0123456789")] == '.') ? atoi (l->params + 1) : 0) ;
+    else if (l->fn->bus == EXT_BUS_OWN)
+      snprintf (l->busKey, sizeof (l->busKey), "own%d", numLines) ;
+    else
+      strcpy (l->busKey, "none") ;
+
+    sorted [numLines++] = l ;
+  }
+
+  fclose (fd) ;
+
+// Overlaps with each other, and with what's already there
+
+  qsort (sorted, numLines, sizeof (sorted [0]), comparePinBase) ;
+
+  for (i = 0 ; ok && (i < numLines) ; ++i)
+  {
+    if ((i > 0) && (sorted [i - 1]->pinBase + sorted [i - 1]->numPins > sorted [i]->pinBase))
+    {
+      verbError ("%s: %s: line %d: pins %d-%d overlap line %d", progName, path, sorted [i]->lineNum,
+	sorted [i]->pinBase, sorted [i]->pinBase + sorted [i]->numPins - 1, sorted [i - 1]->lineNum) ;
+      ok = FALSE ;
+    }
+
+    for (pin = sorted [i]->pinBase ; ok && (pin < sorted [i]->pinBase + sorted [i]->numPins) ; ++pin)
+      if (wiringPiFindNode (pin) != NULL)
+      {
+	verbError ("%s: %s: line %d: pin %d is already in use", progName, path, sorted [i]->lineNum, pin) ;
+	ok = FALSE ;
+      }
+  }
+
+// Is there anything at each I2C address? One scan of the bus, and it's
+//	remembered, rather than each driver timing out in turn. If the bus
+//	can't be scanned at all, the drivers find out for themselves.
+
+  for (i = 0 ; ok && (i < numLines) ; ++i)
+  {
+    l = &lines [i] ;
+    if (l->fn->bus != EXT_BUS_I2C)
+      continue ;
+
+    if ((addr = l->fn->i2cAddr) == EXT_ADDR_PARAM)
+      addr = (*l->params == ':') ? strtol (l->params + 1, NULL, 0) : 0 ;
+
+    if ((addr >= 0x03) && (addr <= 0x77) && (wiringPiI2CPresent (NULL, addr) == WPI_I2C_SCAN_NONE))
+    {
+      verbError ("%s: %s: line %d: nothing at I2C address 0x%02X", progName, path, l->lineNum, addr) ;
+      ok = FALSE ;
+    }
+  }
+
+  if (!ok)
+  {
+    free (lines) ;
+    return FALSE ;
+  }
+
+// Set them up: a thread for each bus
+
+  for (i = 0 ; i < numLines ; ++i)
+  {
+    for (j = 0 ; (j < i) && (strcmp (lines [j].busKey, lines [i].busKey) != 0) ; ++j)
+      ;
+    if (j < i)
+      lines [i].group = lines [j].group ;
+    else
+    {
+      groups [numGroups].progName = progName ;
+      groups [numGroups].lines    = lines ;
+      groups [numGroups].numLines = numLines ;
+      groups [numGroups].group    = numGroups ;
+      groups [numGroups].ok       = TRUE ;
+      lines [i].group = numGroups++ ;
+    }
+  }
+
+  share = wiringPiI2CShareBuses (TRUE) ;
+
+  if (numGroups == 1)
+    configGroupThread (&groups [0]) ;
+  else
+  {
+    for (i = 0 ; i < numGroups ; ++i)
+      if (pthread_create (&groups [i].thread, NULL, configGroupThread, &groups [i]) != 0)
+      {
+	configGroupThread (&groups [i]) ;
+	groups [i].thread = pthread_self () ;
+      }
+
+    for (i = 0 ; i < numGroups ; ++i)
+      if (!pthread_equal (groups [i].thread, pthread_self ()))
+	pthread_join (groups [i].thread, NULL) ;
+  }
+
+  (void)wiringPiI2CShareBuses (share) ;
+
+  for (i = 0 ; i < numGroups ; ++i)
+    ok = ok && groups [i].ok ;
+
+  free (lines) ;
+  return ok ;
 }
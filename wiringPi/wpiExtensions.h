@@ -23,4 +23,5 @@
  */
 
 
-extern int loadWPiExtension (char *progName, char *extensionData, int verbose) ;
+extern int loadWPiExtension   (char *progName, char *extensionData, int verbose) ;
+extern int wiringPiLoadConfig (char *progName, const char *path, int verbose) ;
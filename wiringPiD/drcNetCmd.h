@@ -20,6 +20,12 @@
  ***********************************************************************
  */
 
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
 #define	DEFAULT_SERVER_PORT	6124
 
 #define	DRCN_PIN_MODE		1
@@ -34,11 +40,312 @@
 #define	DRCN_DIGITAL_READ8	8
 #define	DRCN_ANALOG_READ	9
 
+// Reply with the number of DRCN_NO_ACK commands run since the last one
+
+#define	DRCN_SYNC		10
+
+// A batch: this header, with the count in data, followed by that many
+//	commands run in order. The reply is a header with the number of
+//	results, followed by each read command with its data filled in.
+//	Writes in a batch aren't acknowledged individually.
+
+#define	DRCN_BATCH		11
+#define	DRCN_MAX_BATCH		64
+
+// Subscribe to edges on a pin: data is the INT_EDGE_ mode (0 to cancel)
+//	in the bottom 8 bits and a debounce time in mS above that. The reply
+//	data is 0 if it worked.
+//	From then on the server can send a DRCN_EVENT frame at any time: this
+//	header with the count in data, followed by that many drcNetEventStructs.
+
+#define	DRCN_SUBSCRIBE		12
+#define	DRCN_EVENT		13
+
+// Faster transports, set up over the TCP connection once logged in.
+//	Both reply with a header, data being the length of what follows.
+//	UDP_OPEN: a drcNetUdpKeyStruct. Writes can then be sent as
+//	drcNetUdpStruct datagrams to the same port, unacknowledged.
+//	SHM_OPEN: data is the client's pid. The reply is the name of an
+//	abstract AF_UNIX socket (no leading NUL sent) to connect to, which
+//	hands a memfd holding a drcNetShmStruct over with SCM_RIGHTS - but
+//	only to a peer that SO_PEERCRED says is that pid - and then closes.
+
+#define	DRCN_UDP_OPEN		14
+#define	DRCN_SHM_OPEN		15
+
+// 16-bit versions of DIGITAL_WRITE8/READ8, starting at pin. WRITE_MASKED
+//	has the mask in the top 16 bits of data and the value in the bottom.
+
+#define	DRCN_DIGITAL_WRITE16	16
+#define	DRCN_DIGITAL_READ16	17
+#define	DRCN_DIGITAL_WRITE_MASK	18
+
+// Ask, once logged in, for a session id and key (a drcNetSessionStruct
+//	after the reply header, as for UDP_OPEN). On a later connection the
+//	client can answer the challenge with
+//		Resume <id> <mac>\n
+//	instead of the password hash, both as 16 hex digits, where mac is the
+//	SipHash of the challenge salt with the session key. That saves the
+//	crypt () at both ends. Asking again on a resumed connection changes
+//	the key.
+
+#define	DRCN_SESSION		19
+#define	DRCN_RESUME_LEN		41
+
+// Clocks: TIME's reply header has data the length of the drcNetTimeStruct
+//	that follows - when the server read the request and when it sent the
+//	reply, on its CLOCK_MONOTONIC - so the client can work out the offset
+//	NTP fashion. WRITE_AT is a DIGITAL_WRITE with 8 more bytes after the
+//	header: the server's CLOCK_MONOTONIC nS to do it at. It's acknowledged
+//	like any other write, data 0 if it's queued.
+
+#define	DRCN_TIME		20
+#define	DRCN_WRITE_AT		21
+
+// A macro: a header like a batch's, followed by that many steps the
+//	server runs itself, at real-time priority, without waiting on the
+//	network in between. A step is any command, or one of the DRCN_M_'s
+//	below. The reply is a header with pin 0 (or DRCN_MACRO_ABORTED if it
+//	ran out of time or steps, when a delay or wait that would have gone
+//	past the end is cut short, or DRCN_MACRO_BAD if a LOOP or SKIP went
+//	outside the macro and nothing was run) and data the number of
+//	results, followed by each read step with its data filled in - and
+//	WAIT's, data 1 if the pin got there. It runs on a thread of its own:
+//	other clients carry on, but this one's later commands wait for it.
+
+#define	DRCN_MACRO		22
+#define	DRCN_MACRO_RESULTS	256
+#define	DRCN_MACRO_STEPS	100000		// Run, counting loops
+#define	DRCN_MACRO_MAX_NS	1000000000ULL
+#define	DRCN_MACRO_PRI		50
+#define	DRCN_MACRO_ABORTED	1
+#define	DRCN_MACRO_BAD		2
+
+#define	DRCN_M_DELAY		0x40	// data uS on from the last delay (or wait)
+#define	DRCN_M_LOOP		0x41	// Back to step pin (not after this) until it's been done data times
+#define	DRCN_M_SKIP_EQ		0x42	// Skip pin steps (at most to the end) if the last read was data
+#define	DRCN_M_SKIP_NE		0x43	//	... wasn't
+#define	DRCN_M_SKIP_LT		0x44	//	... was less than
+#define	DRCN_M_SKIP_GE		0x45	//	... was at least
+#define	DRCN_M_WAIT		0x46	// Wait (data >> 1) uS for pin to read (data & 1)
+
+// The cmd word is the command in the bottom 8 bits, an optional tag the
+//	server echoes back in the next 16 and flags at the top.
+
+#define	DRCN_CMD_MASK		0x000000FF
+#define	DRCN_TAG_MASK		0x00FFFF00
+#define	DRCN_TAG_SHIFT		8
+#define	DRCN_NO_ACK		0x80000000	// Don't reply to a write
+
 
 struct drcNetComStruct
 {
   uint32_t pin ;
   uint32_t cmd ;
   uint32_t data ;
-} comDat ;
+} ;
+
+struct drcNetTimeStruct
+{
+  uint64_t received ;
+  uint64_t sent ;
+} ;
+
+static inline uint64_t drcNetClock (void)
+{
+  struct timespec ts ;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec ;
+}
+
+struct drcNetEventStruct
+{
+  uint32_t pin ;
+  uint32_t edge ;		// INT_EDGE_RISING or INT_EDGE_FALLING
+  uint64_t timestamp ;		// CLOCK_MONOTONIC nS on the server
+} ;
+
+
+// UDP: each datagram carries a session id, a sequence number that must go
+//	up each time (so they can't be replayed) and a SipHash-2-4 MAC of the
+//	whole thing (with mac zero) using the session key.
+
+#define	DRCN_UDP_MAX		64
+
+struct drcNetUdpKeyStruct
+{
+  uint64_t session ;
+  uint8_t  key [16] ;
+} ;
+
+struct drcNetUdpStruct
+{
+  uint64_t session ;
+  uint32_t seq ;
+  uint32_t count ;
+  uint64_t mac ;
+  struct drcNetComStruct cmds [DRCN_UDP_MAX] ;
+} ;
+
+struct drcNetSessionStruct
+{
+  uint64_t id ;
+  uint8_t  key [16] ;
+} ;
 
+#define	SIP_ROTL(x,b)	(uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+#define	SIP_ROUND					\
+  do {							\
+    v0 += v1 ; v1 = SIP_ROTL (v1, 13) ; v1 ^= v0 ; v0 = SIP_ROTL (v0, 32) ;	\
+    v2 += v3 ; v3 = SIP_ROTL (v3, 16) ; v3 ^= v2 ;				\
+    v0 += v3 ; v3 = SIP_ROTL (v3, 21) ; v3 ^= v0 ;				\
+    v2 += v1 ; v1 = SIP_ROTL (v1, 17) ; v1 ^= v2 ; v2 = SIP_ROTL (v2, 32) ;	\
+  } while (0)
+
+static inline uint64_t drcNetSipHash (const uint8_t key [16], const void *data, unsigned int len)
+{
+  const uint8_t *in = (const uint8_t *)data ;
+  uint64_t k0 = 0, k1 = 0, m, b ;
+  uint64_t v0, v1, v2, v3 ;
+  unsigned int i, j ;
+
+  for (i = 0 ; i < 8 ; ++i)
+  {
+    k0 |= (uint64_t)key [i]     << (8 * i) ;
+    k1 |= (uint64_t)key [i + 8] << (8 * i) ;
+  }
+
+  v0 = k0 ^ 0x736f6d6570736575ULL ;
+  v1 = k1 ^ 0x646f72616e646f6dULL ;
+  v2 = k0 ^ 0x6c7967656e657261ULL ;
+  v3 = k1 ^ 0x7465646279746573ULL ;
+
+  for (i = 0 ; i + 8 <= len ; i += 8)
+  {
+    for (m = 0, j = 0 ; j < 8 ; ++j)
+      m |= (uint64_t)in [i + j] << (8 * j) ;
+    v3 ^= m ; SIP_ROUND ; SIP_ROUND ; v0 ^= m ;
+  }
+
+  for (b = (uint64_t)len << 56, j = 0 ; i + j < len ; ++j)
+    b |= (uint64_t)in [i + j] << (8 * j) ;
+
+  v3 ^= b ; SIP_ROUND ; SIP_ROUND ; v0 ^= b ;
+  v2 ^= 0xff ;
+  SIP_ROUND ; SIP_ROUND ; SIP_ROUND ; SIP_ROUND ;
+
+  return v0 ^ v1 ^ v2 ^ v3 ;
+}
+
+
+// Shared memory: a pair of single producer, single consumer rings.
+//	seq is bumped on every push and is the futex a sleeping consumer
+//	waits on; sleeping is set while it does so the producer knows to wake it.
+
+#define	DRCN_SHM_SLOTS		256		// Power of 2
+#define	DRCN_SHM_MAGIC		0x44524353	// "DRCS"
+#define	DRCN_SHM_SPIN		2000
+
+struct drcNetShmRingStruct
+{
+  uint32_t head ;
+  uint32_t tail ;
+  uint32_t seq ;
+  uint32_t sleeping ;
+  struct drcNetComStruct slots [DRCN_SHM_SLOTS] ;
+} ;
+
+struct drcNetShmStruct
+{
+  uint32_t magic ;
+  uint32_t alive ;			// Cleared by either side to hang up
+  struct drcNetShmRingStruct toServer ;
+  struct drcNetShmRingStruct toClient ;
+} ;
+
+static inline int drcNetShmPush (struct drcNetShmRingStruct *ring, const struct drcNetComStruct *cmd)
+{
+  uint32_t head = ring->head ;
+
+  if ((head - __atomic_load_n (&ring->tail, __ATOMIC_ACQUIRE)) == DRCN_SHM_SLOTS)
+    return -1 ;
+
+  ring->slots [head & (DRCN_SHM_SLOTS - 1)] = *cmd ;
+  __atomic_store_n (&ring->head, head + 1, __ATOMIC_RELEASE) ;
+  __atomic_add_fetch (&ring->seq, 1, __ATOMIC_SEQ_CST) ;
+
+  if (__atomic_load_n (&ring->sleeping, __ATOMIC_SEQ_CST))
+    syscall (SYS_futex, &ring->seq, FUTEX_WAKE, 1, NULL, NULL, 0) ;
+
+  return 0 ;
+}
+
+// Spin for a while then sleep until there's something there, or the
+//	other end goes away - or stop, if it's not NULL, is set: the server
+//	uses a flag of its own, as the client can write alive. Returns 0 or -1.
+
+static inline int drcNetShmPop (struct drcNetShmStruct *shm, struct drcNetShmRingStruct *ring, struct drcNetComStruct *cmd, const int *stop)
+{
+  uint32_t tail = ring->tail ;
+  uint32_t seq ;
+  int spin = 0 ;
+
+  while (tail == __atomic_load_n (&ring->head, __ATOMIC_ACQUIRE))
+  {
+    if (!__atomic_load_n (&shm->alive, __ATOMIC_ACQUIRE) || ((stop != NULL) && __atomic_load_n (stop, __ATOMIC_ACQUIRE)))
+      return -1 ;
+
+    if (++spin < DRCN_SHM_SPIN)
+      continue ;
+
+    seq = __atomic_load_n (&ring->seq, __ATOMIC_SEQ_CST) ;
+    __atomic_store_n (&ring->sleeping, 1, __ATOMIC_SEQ_CST) ;
+    if (tail == __atomic_load_n (&ring->head, __ATOMIC_ACQUIRE))
+    {
+      struct timespec ts = { 0, 100000000 } ;	// Check alive every 100mS
+      syscall (SYS_futex, &ring->seq, FUTEX_WAIT, seq, &ts, NULL, 0) ;
+    }
+    __atomic_store_n (&ring->sleeping, 0, __ATOMIC_SEQ_CST) ;
+  }
+
+  *cmd = ring->slots [tail & (DRCN_SHM_SLOTS - 1)] ;
+  __atomic_store_n (&ring->tail, tail + 1, __ATOMIC_RELEASE) ;
+
+  return 0 ;
+}
+
+
+
+// Multicast: wiringPiD -M sends the pins it's been told to watch to a
+//	group for anyone to listen to - no login, and no way to write. Each
+//	datagram has a sequence number one up on the last; a keyframe has
+//	every pin, the rest only those that changed. A listener that misses
+//	one, or sees source change (the publisher restarted), waits for the
+//	next keyframe. Analog pins have DRCN_MCAST_ANALOG set in pin.
+
+#define	DRCN_MCAST_GROUP	"239.192.61.24"
+#define	DRCN_MCAST_PORT		6125
+#define	DRCN_MCAST_MAGIC	0x4452434D	// "DRCM"
+#define	DRCN_MCAST_MAX_PINS	128
+#define	DRCN_MCAST_KEY_MS	1000
+#define	DRCN_MCAST_KEYFRAME	1
+#define	DRCN_MCAST_ANALOG	0x80000000
+
+struct drcNetMcastPinStruct
+{
+  uint32_t pin ;
+  int32_t  value ;
+} ;
+
+struct drcNetMcastStruct
+{
+  uint32_t magic ;
+  uint32_t source ;		// Random, for each run of the publisher
+  uint32_t seq ;
+  uint16_t flags ;
+  uint16_t count ;
+  uint64_t stamp ;		// drcNetClock () of the scan
+  struct drcNetMcastPinStruct pins [DRCN_MCAST_MAX_PINS] ;
+} ;
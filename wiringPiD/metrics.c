@@ -0,0 +1,363 @@
+/*
+ * metrics.c:
+ *	Part of wiringPiD
+ *	Counters for how busy the daemon is, served over HTTP.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/socket.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "drcNetCmd.h"
+#include "network.h"
+#include "metrics.h"
+
+/*
+ * Notes:
+ *	Everything's counted with relaxed atomics - the UDP and shared memory
+ *	paths run commands off the main thread too, and a counter being a
+ *	moment behind doesn't matter to anyone reading it.
+ *
+ *	One thread of its own answers on the metrics port, so a slow scraper
+ *	never holds up the clients:
+ *	  GET /metrics	Prometheus text format
+ *	  GET /health	200 if the main loop has been round in the last
+ *			METRICS_STALL_NS, else 503
+ *
+ *	wiringpid_busy_seconds_total is the time the main loop spent doing
+ *	something rather than waiting in epoll - its rate heading for 1 is
+ *	the daemon saturating.
+ *********************************************************************************
+ */
+
+#define	MAX_CMD_TYPES	32		// Anything above is counted as "other"
+#define	NUM_BUCKETS	14
+
+static const uint64_t bucketNs [NUM_BUCKETS - 1] =
+{
+  1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000,
+  1000000, 2000000, 5000000, 10000000,
+} ;
+
+static const char *cmdNames [MAX_CMD_TYPES] =
+{
+  NULL,
+  "pin_mode",     "pull_up_dn",    "digital_write", "digital_write8",
+  "analog_write", "pwm_write",     "digital_read",  "digital_read8",
+  "analog_read",  "sync",          "batch",         "subscribe",
+  "event",        "udp_open",      "shm_open",      "digital_write16",
+  "digital_read16", "digital_write_mask", "session", "time",
+  "write_at",     "macro",
+} ;
+
+static uint64_t commands [MAX_CMD_TYPES + 1] ;
+static uint64_t hwBuckets [MAX_CMD_TYPES][NUM_BUCKETS] ;
+static uint64_t hwSumNs   [MAX_CMD_TYPES] ;
+static uint64_t bytesIn, bytesOut ;
+static uint64_t drops [METRICS_DROP_REASONS] ;
+static uint64_t busyNs, lastLoop ;
+static int      connected ;
+static uint64_t started ;
+
+static const char *dropNames [METRICS_DROP_REASONS] = { "password", "timeout", "full", "closed" } ;
+
+static int metricsFd = -1 ;
+static pthread_t metricsThreadId ;
+
+
+/*
+ * now:
+ *********************************************************************************
+ */
+
+static uint64_t now (void)
+{
+  struct timespec ts ;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec ;
+}
+
+
+/*
+ * metricsCommand:
+ * metricsHardware:
+ * metricsBytes:
+ * metricsClient:
+ * metricsDrop:
+ * metricsLoop:
+ *	Count things as they happen
+ *********************************************************************************
+ */
+
+void metricsCommand (uint32_t cmd)
+{
+  cmd &= DRCN_CMD_MASK ;
+
+  __atomic_add_fetch (&commands [(cmd < MAX_CMD_TYPES) ? cmd : MAX_CMD_TYPES], 1, __ATOMIC_RELAXED) ;
+}
+
+void metricsHardware (uint32_t cmd, uint64_t ns)
+{
+  int b ;
+
+  if ((cmd &= DRCN_CMD_MASK) >= MAX_CMD_TYPES)
+    return ;
+
+  for (b = 0 ; b < NUM_BUCKETS - 1 ; ++b)
+    if (ns <= bucketNs [b])
+      break ;
+
+  __atomic_add_fetch (&hwBuckets [cmd][b], 1,  __ATOMIC_RELAXED) ;
+  __atomic_add_fetch (&hwSumNs   [cmd],    ns, __ATOMIC_RELAXED) ;
+}
+
+void metricsBytes (int in, int out)
+{
+  if (in  > 0) __atomic_add_fetch (&bytesIn,  in,  __ATOMIC_RELAXED) ;
+  if (out > 0) __atomic_add_fetch (&bytesOut, out, __ATOMIC_RELAXED) ;
+}
+
+void metricsClient (int delta)
+{
+  __atomic_add_fetch (&connected, delta, __ATOMIC_RELAXED) ;
+}
+
+void metricsDrop (int reason)
+{
+  if ((reason >= 0) && (reason < METRICS_DROP_REASONS))
+    __atomic_add_fetch (&drops [reason], 1, __ATOMIC_RELAXED) ;
+}
+
+void metricsLoop (uint64_t ns)
+{
+  __atomic_add_fetch (&busyNs,   ns,    __ATOMIC_RELAXED) ;
+  __atomic_store_n   (&lastLoop, now (), __ATOMIC_RELAXED) ;
+}
+
+
+/*
+ * load:
+ *	Read a counter
+ *********************************************************************************
+ */
+
+static inline uint64_t load (uint64_t *counter)
+{
+  return __atomic_load_n (counter, __ATOMIC_RELAXED) ;
+}
+
+
+/*
+ * writeMetrics:
+ *	All of it in the Prometheus text format
+ *********************************************************************************
+ */
+
+static void writeMetrics (FILE *fd)
+{
+  uint64_t total, count ;
+  int i, b ;
+
+  fprintf (fd, "# HELP wiringpid_uptime_seconds Time since the daemon started.\n") ;
+  fprintf (fd, "# TYPE wiringpid_uptime_seconds gauge\n") ;
+  fprintf (fd, "wiringpid_uptime_seconds %.3f\n", (now () - started) / 1e9) ;
+
+  fprintf (fd, "# HELP wiringpid_busy_seconds_total Time the main loop spent working rather than waiting.\n") ;
+  fprintf (fd, "# TYPE wiringpid_busy_seconds_total counter\n") ;
+  fprintf (fd, "wiringpid_busy_seconds_total %.6f\n", load (&busyNs) / 1e9) ;
+
+  fprintf (fd, "# HELP wiringpid_clients Clients connected now.\n") ;
+  fprintf (fd, "# TYPE wiringpid_clients gauge\n") ;
+  fprintf (fd, "wiringpid_clients %d\n", __atomic_load_n (&connected, __ATOMIC_RELAXED)) ;
+
+  fprintf (fd, "# HELP wiringpid_clients_dropped_total Clients disconnected, by why.\n") ;
+  fprintf (fd, "# TYPE wiringpid_clients_dropped_total counter\n") ;
+  for (i = 0 ; i < METRICS_DROP_REASONS ; ++i)
+    fprintf (fd, "wiringpid_clients_dropped_total{reason=\"%s\"} %llu\n", dropNames [i], (unsigned long long)load (&drops [i])) ;
+
+  fprintf (fd, "# HELP wiringpid_auth_failures_total Logins that gave the wrong password.\n") ;
+  fprintf (fd, "# TYPE wiringpid_auth_failures_total counter\n") ;
+  fprintf (fd, "wiringpid_auth_failures_total %llu\n", (unsigned long long)load (&drops [METRICS_DROP_PASSWORD])) ;
+
+  fprintf (fd, "# HELP wiringpid_bytes_total Bytes to and from TCP clients.\n") ;
+  fprintf (fd, "# TYPE wiringpid_bytes_total counter\n") ;
+  fprintf (fd, "wiringpid_bytes_total{direction=\"in\"} %llu\n",  (unsigned long long)load (&bytesIn)) ;
+  fprintf (fd, "wiringpid_bytes_total{direction=\"out\"} %llu\n", (unsigned long long)load (&bytesOut)) ;
+
+  fprintf (fd, "# HELP wiringpid_commands_total Commands received, by type.\n") ;
+  fprintf (fd, "# TYPE wiringpid_commands_total counter\n") ;
+  for (i = 1 ; i < MAX_CMD_TYPES ; ++i)
+    if (cmdNames [i] != NULL)
+      fprintf (fd, "wiringpid_commands_total{command=\"%s\"} %llu\n", cmdNames [i], (unsigned long long)load (&commands [i])) ;
+  fprintf (fd, "wiringpid_commands_total{command=\"other\"} %llu\n",
+	(unsigned long long)(load (&commands [0]) + load (&commands [MAX_CMD_TYPES]))) ;
+
+// Only the operations that have actually been run
+
+  fprintf (fd, "# HELP wiringpid_hardware_seconds Time taken by the pin operation itself.\n") ;
+  fprintf (fd, "# TYPE wiringpid_hardware_seconds histogram\n") ;
+  for (i = 1 ; i < MAX_CMD_TYPES ; ++i)
+  {
+    for (count = 0, b = 0 ; b < NUM_BUCKETS ; ++b)
+      count += load (&hwBuckets [i][b]) ;
+
+    if ((count == 0) || (cmdNames [i] == NULL))
+      continue ;
+
+    for (total = 0, b = 0 ; b < NUM_BUCKETS ; ++b)
+    {
+      total += load (&hwBuckets [i][b]) ;
+      if (b < NUM_BUCKETS - 1)
+	fprintf (fd, "wiringpid_hardware_seconds_bucket{op=\"%s\",le=\"%g\"} %llu\n", cmdNames [i], bucketNs [b] / 1e9, (unsigned long long)total) ;
+      else
+	fprintf (fd, "wiringpid_hardware_seconds_bucket{op=\"%s\",le=\"+Inf\"} %llu\n", cmdNames [i], (unsigned long long)total) ;
+    }
+    fprintf (fd, "wiringpid_hardware_seconds_sum{op=\"%s\"} %.9f\n", cmdNames [i], load (&hwSumNs [i]) / 1e9) ;
+    fprintf (fd, "wiringpid_hardware_seconds_count{op=\"%s\"} %llu\n", cmdNames [i], (unsigned long long)total) ;
+  }
+}
+
+
+/*
+ * serveRequest:
+ *	Answer one HTTP request, then hang up
+ *********************************************************************************
+ */
+
+static void serveRequest (int fd)
+{
+  struct timeval tv = { 1, 0 } ;
+  char   request [1024] ;
+  char  *body  = NULL ;
+  size_t bodyLen = 0 ;
+  const char *status = "200 OK" ;
+  FILE  *out ;
+  ssize_t n ;
+  int    len = 0 ;
+
+  setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof (tv)) ;
+  setsockopt (fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof (tv)) ;
+
+// Only the request line matters, but take the headers too so closing
+//	doesn't reset the connection under the reply
+
+  while (len < (int)sizeof (request) - 1)
+  {
+    if ((n = recv (fd, request + len, sizeof (request) - 1 - len, 0)) <= 0)
+      break ;
+    len += n ;
+    request [len] = 0 ;
+    if (strstr (request, "\r\n\r\n") != NULL)
+      break ;
+  }
+  request [len] = 0 ;
+
+  if ((out = open_memstream (&body, &bodyLen)) == NULL)
+    return ;
+
+  /**/ if ((strncmp (request, "GET /metrics ", 13) == 0) || (strncmp (request, "GET / ", 6) == 0))
+    writeMetrics (out) ;
+  else if (strncmp (request, "GET /health ", 12) == 0)
+  {
+    if ((now () - __atomic_load_n (&lastLoop, __ATOMIC_RELAXED)) > METRICS_STALL_NS)
+    {
+      status = "503 Service Unavailable" ;
+      fprintf (out, "stalled\n") ;
+    }
+    else
+      fprintf (out, "ok\n") ;
+  }
+  else
+  {
+    status = "404 Not Found" ;
+    fprintf (out, "Not found\n") ;
+  }
+
+  fclose (out) ;
+
+  dprintf (fd, "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", status, bodyLen) ;
+  if (bodyLen > 0)
+    (void)send (fd, body, bodyLen, MSG_NOSIGNAL) ;
+
+  free (body) ;
+}
+
+
+/*
+ * metricsThread:
+ * metricsServe:
+ *	Serve the metrics port. Returns -1 if it can't be opened.
+ *********************************************************************************
+ */
+
+static void *metricsThread (__attribute__((unused)) void *arg)
+{
+  struct pollfd pfd ;
+  int fd ;
+
+  pfd.fd     = metricsFd ;
+  pfd.events = POLLIN ;
+
+  for (;;)
+  {
+    if (poll (&pfd, 1, -1) < 0)
+      continue ;
+
+    while ((fd = accept4 (metricsFd, NULL, NULL, SOCK_CLOEXEC)) >= 0)
+    {
+      serveRequest (fd) ;
+      close (fd) ;
+    }
+  }
+
+  return NULL ;
+}
+
+int metricsServe (int port)
+{
+  started  = now () ;
+  lastLoop = started ;
+
+  if ((metricsFd = openServer (port)) < 0)
+    return -1 ;
+
+  if (pthread_create (&metricsThreadId, NULL, metricsThread, NULL) != 0)
+  {
+    close (metricsFd) ;
+    metricsFd = -1 ;
+    return -1 ;
+  }
+
+  pthread_detach (metricsThreadId) ;
+
+  return 0 ;
+}
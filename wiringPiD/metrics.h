@@ -0,0 +1,44 @@
+/*
+ * metrics.h:
+ *	Part of wiringPiD
+ *	Counters for how busy the daemon is, served over HTTP.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <stdint.h>
+
+#define	METRICS_STALL_NS	5000000000ULL	// Main loop quiet this long: unhealthy
+
+// Why a client went
+
+#define	METRICS_DROP_PASSWORD	0
+#define	METRICS_DROP_TIMEOUT	1
+#define	METRICS_DROP_FULL	2	// Wasn't reading its replies
+#define	METRICS_DROP_CLOSED	3
+#define	METRICS_DROP_REASONS	4
+
+extern int  metricsServe    (int port) ;
+
+extern void metricsCommand  (uint32_t cmd) ;
+extern void metricsHardware (uint32_t cmd, uint64_t ns) ;
+extern void metricsBytes    (int in, int out) ;
+extern void metricsClient   (int delta) ;
+extern void metricsDrop     (int reason) ;
+extern void metricsLoop     (uint64_t busyNs) ;
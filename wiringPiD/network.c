@@ -21,124 +21,239 @@
  ***********************************************************************
  */
 
+#define _GNU_SOURCE
+
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdarg.h>
+#include <errno.h>
+#include <time.h>
 #include <malloc.h>
+#include <pthread.h>
 
 #include <fcntl.h>
 #include <crypt.h>
+#include <inttypes.h>
+#include <sys/random.h>
+#include <sys/eventfd.h>
 
+#include "drcNetCmd.h"
 #include "network.h"
+#include "metrics.h"
 
 #define	TRUE	(1==1)
 #define	FALSE	(!TRUE)
 
 // Local data
 
-#define	SALT_LEN	16
+// Length of the SHA-512 hash we expect back from the client
+
+#define	HASH_LEN	86
 
-static char salt [SALT_LEN + 1] ;
-static char *returnedHash = NULL ;
-static int serverFd = -1 ;
+// How long a client gets to answer the challenge
 
-// Union for the server Socket Address
+#define	AUTH_TIMEOUT	10
 
-static union
+// An SHA-512 crypt () is thousands of rounds, so each answer is checked
+//	on a thread of its own rather than holding up the main loop. The
+//	thread pokes authFd when it's done. If the client goes first, the
+//	thread is left to free it.
+
+struct wpidAuthStruct
 {
-  struct sockaddr_in  sin ;
-  struct sockaddr_in6 sin6 ;
-} serverSockAddr ; 
+  struct crypt_data data ;
+  char        salted [SALT_LEN + 5] ;	// $6$salt$
+  char        hash   [HASH_LEN] ;
+  const char *password ;
+  int         match ;
+  int         done ;			// done and orphan under authLock
+  int         orphan ;
+} ;
+
+static int             authFd   = -1 ;
+static pthread_mutex_t authLock = PTHREAD_MUTEX_INITIALIZER ;
+
+// Sessions a client can resume without the password. Each one lasts an
+//	hour from when it was last used; when they're all taken the oldest goes.
 
-// and client address
+#define	MAX_SESSIONS	64
+#define	SESSION_LIFE	3600
 
-static union
+struct sessionStruct
+{
+  uint64_t id ;
+  uint8_t  key [16] ;
+  time_t   expires ;
+} ;
+
+static struct sessionStruct sessions [MAX_SESSIONS] ;
+
+// Union for a Socket Address
+
+union sockAddrUnion
 {
   struct sockaddr_in  sin ;
   struct sockaddr_in6 sin6 ;
-} clientSockAddr ;
+} ;
 
 
 /*
- * getClientIP:
- *	Returns a pointer to a static string containing the clients IP address
+ * clientIP:
+ *	Fill in a printable version of the clients IP address
  *********************************************************************************
  */
 
-char *getClientIP (void)
+static void clientIP (union sockAddrUnion *addr, char *ipAddress, int size)
 {
   char buf [INET6_ADDRSTRLEN] ;
-  static char ipAddress [1024] ;
 
-  if (clientSockAddr.sin.sin_family == AF_INET)	// IPv4
+  if (addr->sin.sin_family == AF_INET)	// IPv4
   {
-    if (snprintf (ipAddress, 1024, "IPv4: %s", 
-	inet_ntop (clientSockAddr.sin.sin_family, (void *)&clientSockAddr.sin.sin_addr, buf, sizeof (buf))) == 1024)
+    if (snprintf (ipAddress, size, "IPv4: %s", 
+	inet_ntop (addr->sin.sin_family, (void *)&addr->sin.sin_addr, buf, sizeof (buf))) >= size)
       strcpy (ipAddress, "Too long") ;
   }
   else						// IPv6
   {
-    if (clientSockAddr.sin.sin_family == AF_INET6 && IN6_IS_ADDR_V4MAPPED (&clientSockAddr.sin6.sin6_addr))
+    if (addr->sin.sin_family == AF_INET6 && IN6_IS_ADDR_V4MAPPED (&addr->sin6.sin6_addr))
     {
-      if (snprintf (ipAddress, 1024, "IPv4in6: %s", 
-	inet_ntop (clientSockAddr.sin.sin_family, (char *)&clientSockAddr.sin6.sin6_addr, buf, sizeof(buf))) == 1024)
+      if (snprintf (ipAddress, size, "IPv4in6: %s", 
+	inet_ntop (addr->sin.sin_family, (char *)&addr->sin6.sin6_addr, buf, sizeof(buf))) >= size)
       strcpy (ipAddress, "Too long") ;
     }
     else
     {
-      if (snprintf (ipAddress, 1024, "IPv6: %s", 
-	inet_ntop (clientSockAddr.sin.sin_family, (char *)&clientSockAddr.sin6.sin6_addr, buf, sizeof(buf))) == 1024)
+      if (snprintf (ipAddress, size, "IPv6: %s", 
+	inet_ntop (addr->sin.sin_family, (char *)&addr->sin6.sin6_addr, buf, sizeof(buf))) >= size)
       strcpy (ipAddress, "Too long") ;
     }
   }
+}
+
+
+/*
+ * clientWrite:
+ * clientFlush:
+ *	Send data to a client without blocking. Anything the socket won't take
+ *	right now is kept in the clients output buffer and sent by clientFlush
+ *	when the socket is writable again. A client that lets the buffer fill
+ *	up is dropped rather than holding everyone else up.
+ *********************************************************************************
+ */
+
+int clientFlush (struct wpidClientStruct *client)
+{
+  ssize_t n ;
+
+  while (client->outLen > 0)
+  {
+    if ((n = send (client->fd, client->outBuf, client->outLen, MSG_NOSIGNAL)) < 0)
+    {
+      if (errno == EINTR)
+	continue ;
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+	return 0 ;
+      return -1 ;
+    }
+
+    metricsBytes (0, n) ;
+    memmove (client->outBuf, client->outBuf + n, client->outLen - n) ;
+    client->outLen -= n ;
+  }
 
-  return ipAddress ;
+  return 0 ;
 }
 
+int clientWrite (struct wpidClientStruct *client, const void *buf, int len)
+{
+  if (client->outLen + len > CLIENT_OUT_SIZE)
+  {
+    errno = ENOBUFS ;
+    return -1 ;
+  }
+
+  memcpy (client->outBuf + client->outLen, buf, len) ;
+  client->outLen += len ;
+
+  return clientFlush (client) ;
+}
 
 
 /*
- * clientPstr: clientPrintf:
- *	Print over a network socket
+ * clientRead:
+ *	Read whatever's waiting into the clients input buffer.
+ *	Returns -1 on hangup or error.
  *********************************************************************************
  */
 
-static int clientPstr (int fd, char *s)
+int clientRead (struct wpidClientStruct *client)
 {
-  int len = strlen (s) ;
-  return (write (fd, s, len) == len) ? 0 : -1 ;
+  ssize_t n ;
+  int on = 1 ;
+
+  for (;;)
+  {
+    if (client->inLen == CLIENT_IN_SIZE)	// Full - process what we have first
+      return 0 ;
+
+    if ((n = recv (client->fd, client->inBuf + client->inLen, CLIENT_IN_SIZE - client->inLen, 0)) < 0)
+    {
+      if (errno == EINTR)
+	continue ;
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+	return 0 ;
+      return -1 ;
+    }
+
+    if (n == 0)		// Remote hangup
+      return -1 ;
+
+    client->inLen += n ;
+    metricsBytes (n, 0) ;
+
+// Linux drops quick-ack mode again as it sees fit, so keep asking
+
+    setsockopt (client->fd, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof (on)) ;
+  }
 }
 
-static int clientPrintf (const int fd, const char *message, ...)
-{
-  va_list argp ;
-  char buffer [1024] ;
 
-  va_start (argp, message) ;
-    vsnprintf (buffer, 1023, message, argp) ;
-  va_end (argp) ;
+/*
+ * clientConsume:
+ *	Remove bytes we've dealt with from the front of the input buffer
+ *********************************************************************************
+ */
 
-  return clientPstr (fd, buffer) ;
+void clientConsume (struct wpidClientStruct *client, int len)
+{
+  memmove (client->inBuf, client->inBuf + len, client->inLen - len) ;
+  client->inLen -= len ;
 }
 
 
 /*
- * sendGreeting:
- *	Send some text to the client device
+ * clientPrintf:
+ *	Print over a network socket
  *********************************************************************************
  */
 
-int sendGreeting (int clientFd)
+static int clientPrintf (struct wpidClientStruct *client, const char *message, ...)
 {
-  if (clientPrintf (clientFd, "200 Welcome to wiringPiD - http://wiringpi.com/\n") < 0)
-    return -1 ;
+  va_list argp ;
+  char buffer [1024] ;
+
+  va_start (argp, message) ;
+    vsnprintf (buffer, 1023, message, argp) ;
+  va_end (argp) ;
 
-  return clientPrintf (clientFd, "200 Connecting from: %s\n", getClientIP ()) ;
+  return clientWrite (client, buffer, strlen (buffer)) ;
 }
 
 
@@ -161,7 +276,10 @@ static int getSalt (char drySalt [])
     return fd ;
 
   if (read (fd, wetSalt, SALT_LEN) != SALT_LEN)
+  {
+    close (fd) ;
     return -1 ;
+  }
 
   close (fd) ;
 
@@ -175,102 +293,316 @@ static int getSalt (char drySalt [])
 
 
 /*
+ * sendGreeting:
  * sendChallenge:
- *	Create and send our salt (aka nonce) to the remote device
+ *	Send the greeting text, then create and send our salt (aka nonce) to
+ *	the remote device
  *********************************************************************************
  */
 
-int sendChallenge (int clientFd)
+static int sendGreeting (struct wpidClientStruct *client)
 {
-  if (getSalt (salt) < 0)
+  if (clientPrintf (client, "200 Welcome to wiringPiD - http://wiringpi.com/\n") < 0)
     return -1 ;
 
-  return clientPrintf (clientFd, "Challenge %s\n", salt) ;
+  return clientPrintf (client, "200 Connecting from: %s\n", client->ip) ;
+}
+
+static int sendChallenge (struct wpidClientStruct *client)
+{
+  if (getSalt (client->salt) < 0)
+    return -1 ;
+
+  return clientPrintf (client, "Challenge %s\n", client->salt) ;
 }
 
 
 /*
- * getResponse:
- *	Read the encrypted password from the remote device.
+ * findSession:
+ * clientNewSession:
+ *	Give a logged in client a session it can resume later - or a new key
+ *	for the one it's already got. Returns 0 or -1 if there's no randomness.
  *********************************************************************************
  */
 
+static struct sessionStruct *findSession (uint64_t id)
+{
+  int i ;
+
+  if (id == 0)
+    return NULL ;
 
-int getResponse (int clientFd)
+  for (i = 0 ; i < MAX_SESSIONS ; ++i)
+    if ((sessions [i].id == id) && (sessions [i].expires > time (NULL)))
+      return &sessions [i] ;
+
+  return NULL ;
+}
+
+int clientNewSession (struct wpidClientStruct *client, struct drcNetSessionStruct *session)
 {
-  char reply [1024] ;
-  int len ;
+  struct sessionStruct *s ;
+  int i ;
 
-// Being sort of lazy about this. I'm expecting an SHA-512 hash back and these
-//	are exactly 86 characters long, so no reason not to, I guess...
+  if ((s = findSession (client->session)) == NULL)
+  {
+    for (s = &sessions [0], i = 1 ; i < MAX_SESSIONS ; ++i)
+      if (sessions [i].expires < s->expires)
+	s = &sessions [i] ;
 
-  len = 86 ;
+    do
+    {
+      if (getrandom (&s->id, sizeof (s->id), 0) != sizeof (s->id))
+	return -1 ;
+    }
+    while (s->id == 0) ;
+  }
 
-  if (setsockopt (clientFd, SOL_SOCKET, SO_RCVLOWAT, (void *)&len, sizeof (len)) < 0)
+  if (getrandom (s->key, sizeof (s->key), 0) != sizeof (s->key))
+  {
+    s->id = 0 ;
     return -1 ;
+  }
+
+  s->expires      = time (NULL) + SESSION_LIFE ;
+  client->session = s->id ;
 
-  len = recv (clientFd, reply, 86, 0) ;
-  if (len != 86)
+  session->id = s->id ;
+  memcpy (session->key, s->key, sizeof (session->key)) ;
+
+  return 0 ;
+}
+
+
+/*
+ * resumeSession:
+ *	The client has answered the challenge with a session id and the MAC of
+ *	our salt, rather than the password hash.
+ *	Returns 0 if we need more, 2 if it's good, -1 if not.
+ *********************************************************************************
+ */
+
+static int resumeSession (struct wpidClientStruct *client)
+{
+  struct sessionStruct *s ;
+  char     line [DRCN_RESUME_LEN + 1] ;
+  uint64_t id, mac ;
+
+  if (client->inLen < DRCN_RESUME_LEN)
+    return 0 ;
+
+  memcpy (line, client->inBuf, DRCN_RESUME_LEN) ;
+  line [DRCN_RESUME_LEN] = 0 ;
+  clientConsume (client, DRCN_RESUME_LEN) ;
+
+  if (sscanf (line, "Resume %16" SCNx64 " %16" SCNx64, &id, &mac) != 2)
     return -1 ;
 
-  reply [len] = 0 ;
+  if ((s = findSession (id)) == NULL)
+    return -1 ;
 
-  if ((returnedHash = malloc (len + 1)) == NULL)
+  if (drcNetSipHash (s->key, client->salt, SALT_LEN) != mac)
     return -1 ;
 
-  strcpy (returnedHash, reply) ;
+  s->expires      = time (NULL) + SESSION_LIFE ;
+  client->session = id ;
+  client->state   = CLIENT_RUNNING ;
 
-  return 0 ;
+  return 2 ;
 }
 
 
 /*
- * passwordMatch:
- *	See if there's a match. If not, we simply dump them.
+ * authCheck:
+ * authThread:
+ *	Work out the hash the client should have sent and compare it with
+ *	what it did - all of it, every time, so how long that takes doesn't
+ *	say how much of it was right.
  *********************************************************************************
  */
 
-int passwordMatch (const char *password)
+static void authCheck (struct wpidAuthStruct *auth)
 {
+  unsigned char diff = 0 ;
   char *encrypted ;
-  char salted [1024] ;
+  int   i ;
 
-  sprintf (salted, "$6$%s$", salt) ;
+// 20: $6$ then 16 characters of salt, then $
 
-  encrypted = crypt (password, salted) ;
+  if (((encrypted = crypt_r (auth->password, auth->salted, &auth->data)) == NULL) || (strlen (encrypted) != 20 + HASH_LEN))
+  {
+    auth->match = FALSE ;
+    return ;
+  }
 
-// 20: $6$ then 16 characters of salt, then $
-// 86 is the length of an SHA-512 hash
+  for (i = 0 ; i < HASH_LEN ; ++i)
+    diff |= encrypted [20 + i] ^ auth->hash [i] ;
+
+  auth->match = (diff == 0) ;
+}
+
+static void *authThread (void *arg)
+{
+  struct wpidAuthStruct *auth = (struct wpidAuthStruct *)arg ;
+  uint64_t one = 1 ;
+  int orphan ;
+
+  authCheck (auth) ;
+
+  pthread_mutex_lock   (&authLock) ;
+    auth->done = TRUE ;
+    orphan     = auth->orphan ;
+  pthread_mutex_unlock (&authLock) ;
+
+  if (orphan)
+    free (auth) ;
+  else
+    (void)write (authFd, &one, sizeof (one)) ;
+
+  return NULL ;
+}
 
-  return strncmp (encrypted + 20, returnedHash, 86) == 0 ;
+
+/*
+ * clientAuthSetup:
+ * clientAuthClear:
+ *	The eventfd the main loop waits on for finished password checks
+ *********************************************************************************
+ */
+
+int clientAuthSetup (void)
+{
+  if (authFd == -1)
+    authFd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC) ;
+
+  return authFd ;
+}
+
+void clientAuthClear (void)
+{
+  uint64_t dummy ;
+
+  (void)read (authFd, &dummy, sizeof (dummy)) ;
+}
+
+
+/*
+ * clientAuthenticate:
+ *	Called as data arrives from a client that hasn't logged in yet, and
+ *	when a check finishes. We're expecting the encrypted password back -
+ *	an SHA-512 hash which is exactly 86 characters long - or a Resume
+ *	line. The hash can't have a space in it, so the two are easy to tell
+ *	apart.
+ *	Returns 0 if we need more (or it's still being checked), 1 if it
+ *	matches, 2 if it resumed a session, -1 if not. If not we simply dump
+ *	them.
+ *********************************************************************************
+ */
+
+int clientAuthenticate (struct wpidClientStruct *client, const char *password)
+{
+  struct wpidAuthStruct *auth ;
+  pthread_attr_t attr ;
+  pthread_t      thread ;
+  int done, result ;
+
+  if ((auth = client->auth) != NULL)		// Being checked
+  {
+    pthread_mutex_lock   (&authLock) ;
+      done = auth->done ;
+    pthread_mutex_unlock (&authLock) ;
+
+    if (!done)
+      return 0 ;
+
+    client->auth = NULL ;
+  }
+  else
+  {
+    if ((client->inLen >= 7) && (memcmp (client->inBuf, "Resume ", 7) == 0))
+      return resumeSession (client) ;
+
+    if (client->inLen < HASH_LEN)
+      return 0 ;
+
+    if ((auth = calloc (1, sizeof (struct wpidAuthStruct))) == NULL)
+      return -1 ;
+
+    sprintf (auth->salted, "$6$%s$", client->salt) ;
+    memcpy  (auth->hash, client->inBuf, HASH_LEN) ;
+    auth->password = password ;
+
+    clientConsume (client, HASH_LEN) ;
+
+    if (authFd != -1)
+    {
+      pthread_attr_init           (&attr) ;
+      pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED) ;
+      result = pthread_create (&thread, &attr, authThread, auth) ;
+      pthread_attr_destroy        (&attr) ;
+
+      if (result == 0)
+      {
+	client->auth = auth ;
+	return 0 ;
+      }
+    }
+
+    authCheck (auth) ;		// No thread - do it here after all
+  }
+
+  result = auth->match ;
+  free (auth) ;
+
+  if (!result)
+    return -1 ;
+
+  client->state = CLIENT_RUNNING ;
+
+  return 1 ;
+}
+
+
+/*
+ * clientTimedOut:
+ *	See if a client has taken too long to log in
+ *********************************************************************************
+ */
+
+int clientTimedOut (struct wpidClientStruct *client)
+{
+  return (client->state == CLIENT_AUTH) && (time (NULL) > client->deadline) ;
 }
 
 
 /* 
- * setupServer:
+ * bindServer:
+ * openServer:
+ * openUdpServer:
  *	Do what's needed to create a local server socket instance that can listen
- *	on both IPv4 and IPv6 interfaces.
+ *	on both IPv4 and IPv6 interfaces - the TCP one for connections and a UDP
+ *	one on the same port for datagram writes. The sockets are non-blocking,
+ *	ready to go into an epoll set.
  *********************************************************************************
  */
 
-int setupServer (int serverPort)
+static int bindServer (int type, int serverPort)
 {
-  socklen_t clientSockAddrSize = sizeof (clientSockAddr) ;
-
+  union sockAddrUnion serverSockAddr ;
   int on = 1 ;
   int family ;
   socklen_t serverSockAddrSize ;
-  int clientFd ;
+  int serverFd ;
 
 // Try to create an IPv6 socket
 
-  serverFd = socket (PF_INET6, SOCK_STREAM, 0) ;
+  serverFd = socket (PF_INET6, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0) ;
 
 // If it didn't work, then fall-back to IPv4.
 
   if (serverFd < 0)
   {
-    if ((serverFd = socket (PF_INET, SOCK_STREAM, 0)) < 0)
+    if ((serverFd = socket (PF_INET, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0)
       return -1 ;
 
     family             = AF_INET ;
@@ -283,7 +615,7 @@ int setupServer (int serverPort)
   }
 
   if (setsockopt (serverFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof (on)) < 0)
-    return -1 ;
+    goto fail ;
 
 // Setup the servers socket address - cope with IPv4 and v6.
 
@@ -302,29 +634,105 @@ int setupServer (int serverPort)
       serverSockAddr.sin6.sin6_port   = htons (serverPort) ;
   }
 
-// Bind, listen and accept
-
   if (bind (serverFd, (struct sockaddr *)&serverSockAddr, serverSockAddrSize) < 0)
-    return -1 ;
+    goto fail ;
+
+  return serverFd ;
+
+fail:
+  close (serverFd) ;
+  return -1 ;
+}
+
+int openServer (int serverPort)
+{
+  int serverFd ;
 
-  if (listen (serverFd, 4) < 0)	// Really only going to talk to one client at a time...
+  if ((serverFd = bindServer (SOCK_STREAM, serverPort)) < 0)
     return -1 ;
 
-  if ((clientFd = accept (serverFd, (struct sockaddr *)&clientSockAddr, &clientSockAddrSize)) < 0)
+  if (listen (serverFd, MAX_CLIENTS) < 0)
+  {
+    close (serverFd) ;
     return -1 ;
+  }
+
+  return serverFd ;
+}
+
+int openUdpServer (int serverPort)
+{
+  return bindServer (SOCK_DGRAM, serverPort) ;
+}
+
+
+/*
+ * acceptClient:
+ *	Accept a new connection, send it the greeting and challenge and get it
+ *	ready to authenticate. Returns NULL if there's nothing to accept or it
+ *	went wrong.
+ *********************************************************************************
+ */
 
-  return clientFd ;
+struct wpidClientStruct *acceptClient (int serverFd)
+{
+  union sockAddrUnion clientSockAddr ;
+  socklen_t clientSockAddrSize = sizeof (clientSockAddr) ;
+  struct wpidClientStruct *client ;
+  int fd, on = 1 ;
+
+  if ((fd = accept4 (serverFd, (struct sockaddr *)&clientSockAddr, &clientSockAddrSize, SOCK_NONBLOCK | SOCK_CLOEXEC)) < 0)
+    return NULL ;
+
+  if ((client = calloc (1, sizeof (struct wpidClientStruct))) == NULL)
+  {
+    close (fd) ;
+    return NULL ;
+  }
+
+// Requests and replies are small and latency matters more than packing
+//	them, so no Nagle and no delayed acks.
+
+  setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof (on)) ;
+  setsockopt (fd, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof (on)) ;
+
+  client->fd       = fd ;
+  client->state    = CLIENT_AUTH ;
+  client->deadline = time (NULL) + AUTH_TIMEOUT ;
+  clientIP (&clientSockAddr, client->ip, sizeof (client->ip)) ;
+
+  if ((sendGreeting (client) < 0) || (sendChallenge (client) < 0))
+  {
+    closeClient (client) ;
+    return NULL ;
+  }
+
+  return client ;
 }
 
 
 /*
- * closeServer:
+ * closeClient:
  *********************************************************************************
  */
 
-void closeServer (int clientFd)
+void closeClient (struct wpidClientStruct *client)
 {
-  if (serverFd != -1) close (serverFd) ;
-  if (clientFd != -1) close (clientFd) ;
-  serverFd = clientFd = -1 ;
+  struct wpidAuthStruct *auth ;
+  int done ;
+
+  if ((auth = client->auth) != NULL)		// Still being checked
+  {
+    pthread_mutex_lock   (&authLock) ;
+      done         = auth->done ;
+      auth->orphan = TRUE ;
+    pthread_mutex_unlock (&authLock) ;
+
+    if (done)
+      free (auth) ;
+  }
+
+  if (client->fd != -1)
+    close (client->fd) ;
+  free (client) ;
 }
@@ -21,11 +21,91 @@
  ***********************************************************************
  */
 
-extern char *getClientIP   (void) ;
-extern int   getResponce   (int clientFd) ;
-extern int   setupServer   (int serverPort) ;
-extern int   sendGreeting  (int clientFd) ;
-extern int   sendChallenge (int clientFd) ;
-extern int   getResponse   (int clientFd) ;
-extern int   passwordMatch (const char *password) ;
-extern void  closeServer   (int clientFd) ;
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+#include <pthread.h>
+
+#define	MAX_CLIENTS	16
+
+struct drcNetShmStruct ;
+struct drcNetSessionStruct ;
+struct wpidMacroStruct ;
+struct wpidAuthStruct ;
+
+#define	SALT_LEN	16
+
+// Big enough for a full batch frame (DRCN_MAX_BATCH + 1 commands)
+
+#define	CLIENT_IN_SIZE	1024
+#define	CLIENT_OUT_SIZE	16384
+
+// Pin change subscriptions per client
+
+#define	MAX_SUBS	16
+
+struct wpidSubStruct
+{
+  int      pin ;
+  int      mode ;		// INT_EDGE_..., 0 for an empty slot
+  uint64_t debounce ;		// nS
+  uint64_t last ;		// When we last sent one
+} ;
+
+// Client states
+
+#define	CLIENT_AUTH	0	// Sent the challenge, waiting for the response
+#define	CLIENT_RUNNING	1	// Logged in and sending commands
+
+struct wpidClientStruct
+{
+  int           fd ;
+  int           state ;
+  time_t        deadline ;		// To log in by
+  char          ip   [128] ;
+  char          salt [SALT_LEN + 1] ;
+  struct wpidAuthStruct *auth ;		// The answer's being checked
+  uint64_t      session ;		// Resumable session id, or 0
+  unsigned char inBuf  [CLIENT_IN_SIZE] ;
+  int           inLen ;
+  unsigned char outBuf [CLIENT_OUT_SIZE] ;
+  int           outLen ;
+  uint32_t      unAcked ;		// DRCN_NO_ACK writes since the last sync
+  struct wpidSubStruct subs [MAX_SUBS] ;
+
+// UDP write transport
+
+  int           udpOpen ;
+  uint64_t      udpSession ;
+  uint8_t       udpKey [16] ;
+  uint32_t      udpSeq ;		// Last one we accepted
+
+// Shared memory transport
+
+  struct drcNetShmStruct *shm ;
+  char          shmName [64] ;		// The abstract socket it's handed over on
+  int           shmListen ;		// ... listening there, till the thread has it
+  int           shmMemFd ;
+  pid_t         shmPid ;		// Who it's for
+  int           shmStop ;		// Only we write this
+  pthread_t     shmThread ;
+
+// A macro running on its own thread
+
+  struct wpidMacroStruct *macro ;
+} ;
+
+extern int   openServer         (int serverPort) ;
+extern int   openUdpServer      (int serverPort) ;
+extern struct wpidClientStruct *acceptClient (int serverFd) ;
+extern void  closeClient        (struct wpidClientStruct *client) ;
+
+extern int   clientRead         (struct wpidClientStruct *client) ;
+extern void  clientConsume      (struct wpidClientStruct *client, int len) ;
+extern int   clientWrite        (struct wpidClientStruct *client, const void *buf, int len) ;
+extern int   clientFlush        (struct wpidClientStruct *client) ;
+extern int   clientAuthSetup    (void) ;
+extern void  clientAuthClear    (void) ;
+extern int   clientAuthenticate (struct wpidClientStruct *client, const char *password) ;
+extern int   clientNewSession   (struct wpidClientStruct *client, struct drcNetSessionStruct *session) ;
+extern int   clientTimedOut     (struct wpidClientStruct *client) ;
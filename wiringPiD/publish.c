@@ -0,0 +1,229 @@
+/*
+ * publish.c:
+ *	Part of wiringPiD
+ *	Multicast the pins for passive monitors.
+ *	Copyright (c) 2020 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/random.h>
+
+#include <wiringPi.h>
+
+#include "drcNetCmd.h"
+#include "network.h"
+#include "runRemote.h"
+#include "publish.h"
+
+/*
+ * Notes:
+ *	-M rate:pin,pin,aPin,...[@group[:port]]
+ *	A thread reads the pins rate times a second - through the same lock
+ *	as the clients, so it takes its turn with them - and multicasts
+ *	anything that's changed, and everything every DRCN_MCAST_KEY_MS.
+ *	Pins are numbered as the clients see them; an 'a' in front asks for
+ *	analogRead () rather than digitalRead ().
+ *	However many monitors there are, the Pi does the same work.
+ *
+ *	The multicast TTL is 1, so it stays on the LAN.
+ *********************************************************************************
+ */
+
+static struct drcNetMcastPinStruct pins [DRCN_MCAST_MAX_PINS] ;
+static int numPins ;
+static int periodNs ;
+static int mcastFd = -1 ;
+static struct sockaddr_in group ;
+static pthread_t publishThreadId ;
+
+
+/*
+ * sendFrame:
+ *********************************************************************************
+ */
+
+static void sendFrame (struct drcNetMcastStruct *frame, int count)
+{
+  frame->count = count ;
+  (void)sendto (mcastFd, frame, offsetof (struct drcNetMcastStruct, pins) + count * sizeof (struct drcNetMcastPinStruct), 0,
+	(struct sockaddr *)&group, sizeof (group)) ;
+  ++frame->seq ;
+}
+
+
+/*
+ * publishThread:
+ *	Scan, and send what's changed
+ *********************************************************************************
+ */
+
+static void *publishThread (__attribute__((unused)) void *arg)
+{
+  struct drcNetMcastStruct frame ;
+  unsigned long long next, keyDue ;
+  uint32_t pin ;
+  int32_t  value ;
+  int i, count ;
+
+  frame.magic = DRCN_MCAST_MAGIC ;
+  frame.seq   = 0 ;
+  if (getrandom (&frame.source, sizeof (frame.source), 0) != sizeof (frame.source))
+    frame.source = (uint32_t)nanos64 () ^ (uint32_t)getpid () ;
+
+  for (i = 0 ; i < numPins ; ++i)
+    pins [i].value = remoteRead (pins [i].pin & ~DRCN_MCAST_ANALOG, (pins [i].pin & DRCN_MCAST_ANALOG) != 0) ;
+
+  next = keyDue = nanos64 () ;
+
+  for (;;)
+  {
+    frame.stamp = drcNetClock () ;
+    frame.flags = 0 ;
+    count       = 0 ;
+
+    for (i = 0 ; i < numPins ; ++i)
+    {
+      pin   = pins [i].pin ;
+      value = remoteRead (pin & ~DRCN_MCAST_ANALOG, (pin & DRCN_MCAST_ANALOG) != 0) ;
+      if (value != pins [i].value)
+      {
+	pins [i].value       = value ;
+	frame.pins [count++] = pins [i] ;
+      }
+    }
+
+    if (nanos64 () >= keyDue)
+    {
+      frame.flags = DRCN_MCAST_KEYFRAME ;
+      memcpy (frame.pins, pins, numPins * sizeof (pins [0])) ;
+      sendFrame (&frame, numPins) ;
+      keyDue += (unsigned long long)DRCN_MCAST_KEY_MS * 1000000 ;
+    }
+    else if (count > 0)
+      sendFrame (&frame, count) ;
+
+    next += periodNs ;
+    if (next < nanos64 ())		// Fallen behind: re-sync
+      next = nanos64 () ;
+    delayUntilNanos (next) ;
+  }
+
+  return NULL ;
+}
+
+
+/*
+ * publishSetup:
+ *	Parse the -M argument and start publishing.
+ *	Returns 0, or -1 with errno set.
+ *********************************************************************************
+ */
+
+int publishSetup (const char *spec)
+{
+  const char *addr = DRCN_MCAST_GROUP ;
+  char  host [64] ;
+  char *p, *at ;
+  int   rate, port = DRCN_MCAST_PORT ;
+  int   ttl = 1, loop = 1 ;
+
+  rate    = (int)strtol (spec, &p, 10) ;
+  numPins = 0 ;
+
+  while ((*p == ':') || (*p == ','))
+  {
+    if (numPins == DRCN_MCAST_MAX_PINS)
+    {
+      errno = E2BIG ;
+      return -1 ;
+    }
+    ++p ;
+    if (*p == 'a')
+    {
+      pins [numPins].pin = DRCN_MCAST_ANALOG ;
+      ++p ;
+    }
+    else
+      pins [numPins].pin = 0 ;
+    pins [numPins++].pin |= (uint32_t)strtol (p, &p, 10) & ~DRCN_MCAST_ANALOG ;
+  }
+
+  if (*p == '@')
+  {
+    if (strlen (p + 1) >= sizeof (host))
+    {
+      errno = EINVAL ;
+      return -1 ;
+    }
+    strcpy (host, p + 1) ;
+    if ((at = strchr (host, ':')) != NULL)
+    {
+      *at  = 0 ;
+      port = atoi (at + 1) ;
+    }
+    addr = host ;
+    p   += strlen (p) ;
+  }
+
+  if ((*p != 0) || (rate < 1) || (rate > 10000) || (numPins == 0) || (port < 1) || (port > 65535))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  memset (&group, 0, sizeof (group)) ;
+  group.sin_family = AF_INET ;
+  group.sin_port   = htons (port) ;
+  if ((inet_pton (AF_INET, addr, &group.sin_addr) != 1) || !IN_MULTICAST (ntohl (group.sin_addr.s_addr)))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  if ((mcastFd = socket (AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)) < 0)
+    return -1 ;
+
+  setsockopt (mcastFd, IPPROTO_IP, IP_MULTICAST_TTL,  &ttl,  sizeof (ttl)) ;
+  setsockopt (mcastFd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof (loop)) ;
+
+  periodNs = 1000000000 / rate ;
+
+  if (pthread_create (&publishThreadId, NULL, publishThread, NULL) != 0)
+  {
+    close (mcastFd) ;
+    mcastFd = -1 ;
+    errno   = EAGAIN ;
+    return -1 ;
+  }
+
+  pthread_detach (publishThreadId) ;
+
+  return 0 ;
+}
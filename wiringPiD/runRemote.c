@@ -22,6 +22,8 @@
  ***********************************************************************
  */
 
+#define _GNU_SOURCE
+
 #include <arpa/inet.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -29,6 +31,16 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <stddef.h>
+#include <sys/eventfd.h>
+#include <sys/random.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <pthread.h>
 //#include <stdarg.h>
 
 #include <wiringPi.h>
@@ -37,90 +49,1069 @@
 #include "drcNetCmd.h"
 #include "network.h"
 #include "runRemote.h"
+#include "metrics.h"
 
 
 
 int noLocalPins = FALSE ;
 
+// Shared memory clients have threads of their own, so everything that
+//	touches the hardware (or unAcked) does it holding this.
+
+static pthread_mutex_t hwLock = PTHREAD_MUTEX_INITIALIZER ;
+
+// Edge events for subscribed pins. The wiringPi ISR thread just pokes
+//	the eventfd and the main loop picks the events out of wiringPi's
+//	event ring and sends them on to whoever wants them. Macro threads
+//	poke it too when they finish.
+
+#define	MAX_EVENTS	64
+
+static int eventFd = -1 ;
+static unsigned char watching [64] ;
+
+static struct wpiEdgeEventStruct events [MAX_EVENTS] ;
+static int numEvents = 0 ;
 
-void runRemoteCommands (int fd)
+
+/*
+ * reply:
+ *	Echo a command back to the client - unless it's a write it asked us
+ *	not to acknowledge, in which case we just count it.
+ *********************************************************************************
+ */
+
+static int reply (struct wpidClientStruct *client, struct drcNetComStruct *cmd, int isWrite)
 {
-  register uint32_t pin ;
-  int len ;
-  struct drcNetComStruct cmd ;
+  if (isWrite && ((cmd->cmd & DRCN_NO_ACK) != 0))
+  {
+    pthread_mutex_lock   (&hwLock) ;
+      ++client->unAcked ;
+    pthread_mutex_unlock (&hwLock) ;
+    return 0 ;
+  }
+
+  return clientWrite (client, cmd, sizeof (*cmd)) ;
+}
+
+
+/*
+ * execute:
+ *	Run a single command. Returns TRUE if it was a read (and cmd->data now
+ *	has the answer), FALSE for a write, or -1 if we don't know it.
+ *********************************************************************************
+ */
+
+static int executeLocked (struct drcNetComStruct *cmd)
+{
+  uint32_t pin = cmd->pin ;
+  int      act = !(noLocalPins && ((pin & PI_GPIO_MASK) == 0)) ;	// Else just echo it
 
-  len = sizeof (struct drcNetComStruct) ;
+  switch (cmd->cmd & DRCN_CMD_MASK)
+  {
+    case DRCN_PIN_MODE:       if (act) pinMode         (pin, cmd->data) ; return FALSE ;
+    case DRCN_PULL_UP_DN:     if (act) pullUpDnControl (pin, cmd->data) ; return FALSE ;
+    case DRCN_PWM_WRITE:      if (act) pwmWrite        (pin, cmd->data) ; return FALSE ;
+    case DRCN_DIGITAL_WRITE:  if (act) digitalWrite    (pin, cmd->data) ; return FALSE ;
+    case DRCN_DIGITAL_WRITE8: if (act) digitalWrite8   (pin, cmd->data) ; return FALSE ;
+    case DRCN_DIGITAL_WRITE16:if (act) digitalWrite16  (pin, cmd->data) ; return FALSE ;
+    case DRCN_DIGITAL_WRITE_MASK:
+      if (act) digitalWriteMasked (pin, cmd->data & 0xFFFF, cmd->data >> 16) ;
+      return FALSE ;
+    case DRCN_ANALOG_WRITE:   if (act) analogWrite     (pin, cmd->data) ; return FALSE ;
+
+    case DRCN_DIGITAL_READ:   if (act) cmd->data = digitalRead  (pin) ; return TRUE ;
+    case DRCN_DIGITAL_READ8:  if (act) cmd->data = digitalRead8 (pin) ; return TRUE ;
+    case DRCN_DIGITAL_READ16: if (act) cmd->data = digitalRead16 (pin) ; return TRUE ;
+    case DRCN_ANALOG_READ:    if (act) cmd->data = analogRead   (pin) ; return TRUE ;
+  }
+
+  return -1 ;
+}
+
+static int execute (struct drcNetComStruct *cmd)
+{
+  unsigned long long start ;
+  int result ;
+
+  pthread_mutex_lock   (&hwLock) ;
+    start  = nanos64 () ;
+    result = executeLocked (cmd) ;
+    if (result >= 0)
+      metricsHardware (cmd->cmd, nanos64 () - start) ;
+  pthread_mutex_unlock (&hwLock) ;
+
+  return result ;
+}
+
+
+/*
+ * remoteRead:
+ *	Read a pin for someone other than a client, in turn with them
+ *********************************************************************************
+ */
+
+int remoteRead (int pin, int analog)
+{
+  int value ;
+
+  if (noLocalPins && ((pin & PI_GPIO_MASK) == 0))
+    return 0 ;
+
+  pthread_mutex_lock   (&hwLock) ;
+    value = analog ? analogRead (pin) : digitalRead (pin) ;
+  pthread_mutex_unlock (&hwLock) ;
+
+  return value ;
+}
+
+
+/*
+ * runBatch:
+ *	Run a batch of commands, then send back one frame with the results of
+ *	all the reads in it.
+ *********************************************************************************
+ */
+
+static int runBatch (struct wpidClientStruct *client, struct drcNetComStruct *header, const unsigned char *body, int count)
+{
+  struct drcNetComStruct cmds [DRCN_MAX_BATCH + 1] ;
+  int i, results ;
 
-  if (setsockopt (fd, SOL_SOCKET, SO_RCVLOWAT, (void *)&len, sizeof (len)) < 0)
+  memcpy (&cmds [1], body, count * sizeof (struct drcNetComStruct)) ;
+
+  for (results = 0, i = 1 ; i <= count ; ++i)
+    if (execute (&cmds [i]) == TRUE)
+      cmds [++results] = cmds [i] ;
+
+  cmds [0]      = *header ;
+  cmds [0].data = results ;
+
+  return clientWrite (client, cmds, (results + 1) * sizeof (struct drcNetComStruct)) ;
+}
+
+
+/*
+ * isrWake:
+ * remoteEventSetup:
+ *	Set up the eventfd the main loop waits on for pin changes
+ *********************************************************************************
+ */
+
+static void isrWake (void)
+{
+  uint64_t one = 1 ;
+
+  (void)write (eventFd, &one, sizeof (one)) ;
+}
+
+int remoteEventSetup (void)
+{
+  if (eventFd == -1)
+    eventFd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC) ;
+
+  return eventFd ;
+}
+
+
+/*
+ * subscribe:
+ *	Add, change or (mode 0) remove a clients interest in a pin
+ *********************************************************************************
+ */
+
+static int subscribe (struct wpidClientStruct *client, struct drcNetComStruct *cmd)
+{
+  struct wpidSubStruct *sub, *empty = NULL ;
+  int pin  = cmd->pin ;
+  int mode = cmd->data & 0xFF ;
+  int i ;
+
+  if (noLocalPins || (pin < 0) || (pin > 63) || (mode > INT_EDGE_BOTH) || (eventFd == -1))
+    return -1 ;
+
+  for (sub = NULL, i = 0 ; i < MAX_SUBS ; ++i)
+  {
+    if ((client->subs [i].mode != 0) && (client->subs [i].pin == pin))
+      sub = &client->subs [i] ;
+    else if ((client->subs [i].mode == 0) && (empty == NULL))
+      empty = &client->subs [i] ;
+  }
+
+  if (mode == 0)
+  {
+    if (sub != NULL)
+      sub->mode = 0 ;
+    return 0 ;
+  }
+
+  if ((sub == NULL) && ((sub = empty) == NULL))
+    return -1 ;
+
+// We watch both edges and filter per client
+
+  if (!watching [pin])
+  {
+    if (wiringPiEventEnable (pin, 64) < 0)
+      return -1 ;
+    if (wiringPiISR (pin, INT_EDGE_BOTH, isrWake) < 0)
+      return -1 ;
+    watching [pin] = TRUE ;
+  }
+
+  sub->pin      = pin ;
+  sub->mode     = mode ;
+  sub->debounce = (uint64_t)(cmd->data >> 8) * 1000000 ;
+  sub->last     = 0 ;
+
+  return 0 ;
+}
+
+
+/*
+ * remoteEventRead:
+ * remoteEventSend:
+ *	When the eventfd goes off, read the new events once then offer them
+ *	to each client in turn.
+ *********************************************************************************
+ */
+
+void remoteEventRead (void)
+{
+  uint64_t dummy ;
+
+  (void)read (eventFd, &dummy, sizeof (dummy)) ;
+
+  numEvents = wiringPiEventRead (events, MAX_EVENTS) ;
+  if (numEvents < 0)
+    numEvents = 0 ;
+}
+
+int remoteEventSend (struct wpidClientStruct *client)
+{
+  struct drcNetComStruct   header ;
+  struct drcNetEventStruct out [MAX_EVENTS] ;
+  unsigned char            frame [sizeof (header) + sizeof (out)] ;
+  struct wpidSubStruct *sub ;
+  int i, j, count ;
+
+  if (client->state != CLIENT_RUNNING)
+    return 0 ;
+
+  for (count = 0, i = 0 ; i < numEvents ; ++i)
+    for (j = 0 ; j < MAX_SUBS ; ++j)
+    {
+      sub = &client->subs [j] ;
+      if ((sub->mode == 0) || (sub->pin != events [i].pin))
+	continue ;
+      if ((sub->mode != INT_EDGE_BOTH) && (sub->mode != events [i].edge))
+	continue ;
+      if ((sub->last != 0) && ((events [i].timestamp - sub->last) < sub->debounce))
+	continue ;
+
+      sub->last = events [i].timestamp ;
+
+      out [count].pin       = events [i].pin ;
+      out [count].edge      = events [i].edge ;
+      out [count].timestamp = events [i].timestamp ;
+      ++count ;
+    }
+
+  if (count == 0)
+    return 0 ;
+
+  header.pin  = 0 ;
+  header.cmd  = DRCN_EVENT ;
+  header.data = count ;
+
+// The events follow the 12 byte header straight on - no padding to line
+//	the timestamps up, as a struct of the two would have
+
+  memcpy (frame,                   &header, sizeof (header)) ;
+  memcpy (frame + sizeof (header), out,     count * sizeof (struct drcNetEventStruct)) ;
+
+  return clientWrite (client, frame, sizeof (header) + count * sizeof (struct drcNetEventStruct)) ;
+}
+
+
+/*
+ * macroCheck:
+ *	Make sure every LOOP and SKIP in a macro lands inside it - a LOOP on
+ *	itself or a step before, a SKIP no further than just past the end.
+ *	Returns TRUE if they all do.
+ *********************************************************************************
+ */
+
+static int macroCheck (const struct drcNetComStruct *steps, int count)
+{
+  int pc ;
+
+  for (pc = 0 ; pc < count ; ++pc)
+    switch (steps [pc].cmd & DRCN_CMD_MASK)
+    {
+      case DRCN_M_LOOP:
+	if (steps [pc].pin > (uint32_t)pc)
+	  return FALSE ;
+	break ;
+
+      case DRCN_M_SKIP_EQ:
+      case DRCN_M_SKIP_NE:
+      case DRCN_M_SKIP_LT:
+      case DRCN_M_SKIP_GE:
+	if (steps [pc].pin > (uint32_t)(count - pc - 1))
+	  return FALSE ;
+	break ;
+    }
+
+  return TRUE ;
+}
+
+
+/*
+ * Macros run on a thread of their own, so a long one doesn't hold up
+ *	everyone else - that client's later commands wait behind it, so its
+ *	replies still come back in order. The thread pokes the eventfd when
+ *	it's done. If the client goes first, the thread is left to free it.
+ *********************************************************************************
+ */
+
+struct wpidMacroStruct
+{
+  struct drcNetComStruct header ;
+  struct drcNetComStruct steps [DRCN_MAX_BATCH] ;
+  struct drcNetComStruct out   [DRCN_MACRO_RESULTS + 1] ;
+  int count ;
+  int outLen ;
+  int done ;		// done and orphan under macroLock
+  int orphan ;
+} ;
+
+static pthread_mutex_t macroLock = PTHREAD_MUTEX_INITIALIZER ;
+
+
+/*
+ * macroRun:
+ *	Run a macro through to the end and leave the results in out. Delays
+ *	are taken from the end of the delay before rather than from now, so
+ *	the time the steps in between take doesn't add up. No delay or wait
+ *	goes past DRCN_MACRO_MAX_NS from the start.
+ *********************************************************************************
+ */
+
+static void macroRun (struct wpidMacroStruct *macro)
+{
+  struct drcNetComStruct *steps = macro->steps ;
+  struct drcNetComStruct *out   = macro->out ;
+  struct drcNetComStruct  rd, *step ;
+  uint32_t           loops [DRCN_MAX_BATCH] ;
+  unsigned long long start, mark, until, limit ;
+  int pc, isRead, level ;
+  int results = 0, last = 0, status = 0, budget = DRCN_MACRO_STEPS ;
+
+  memset (loops, 0, sizeof (loops)) ;
+
+  out [0] = macro->header ;
+
+  if (!macroCheck (steps, macro->count))
+  {
+    out [0].pin   = DRCN_MACRO_BAD ;
+    out [0].data  = 0 ;
+    macro->outLen = sizeof (struct drcNetComStruct) ;
     return ;
+  }
 
-  for (;;)
+  start = mark = nanos64 () ;
+  limit = start + DRCN_MACRO_MAX_NS ;
+
+  for (pc = 0 ; pc < macro->count ; ++pc)
+  {
+    if ((--budget < 0) || (nanos64 () >= limit) || __atomic_load_n (&macro->orphan, __ATOMIC_ACQUIRE))
+    {
+      status = DRCN_MACRO_ABORTED ;
+      break ;
+    }
+
+    step = &steps [pc] ;
+
+    switch (step->cmd & DRCN_CMD_MASK)
+    {
+      case DRCN_M_DELAY:
+	mark += (unsigned long long)step->data * 1000 ;
+	if (mark > limit)
+	{
+	  mark   = limit ;
+	  status = DRCN_MACRO_ABORTED ;
+	}
+	delayUntilNanos (mark) ;
+	break ;
+
+      case DRCN_M_LOOP:
+	if (loops [pc] == 0)
+	  loops [pc] = step->data ;
+	if ((loops [pc] > 1) && ((int)step->pin <= pc))
+	{
+	  --loops [pc] ;
+	  pc = step->pin - 1 ;
+	}
+	else
+	  loops [pc] = 0 ;		// Ready for next time round an outer loop
+	break ;
+
+      case DRCN_M_SKIP_EQ: if (last == (int)step->data) pc += step->pin ; break ;
+      case DRCN_M_SKIP_NE: if (last != (int)step->data) pc += step->pin ; break ;
+      case DRCN_M_SKIP_LT: if (last <  (int)step->data) pc += step->pin ; break ;
+      case DRCN_M_SKIP_GE: if (last >= (int)step->data) pc += step->pin ; break ;
+
+      case DRCN_M_WAIT:
+	until  = nanos64 () + (unsigned long long)(step->data >> 1) * 1000 ;
+	if (until > limit)
+	{
+	  until  = limit ;
+	  status = DRCN_MACRO_ABORTED ;	// If it doesn't get there first
+	}
+	level  = step->data & 1 ;
+	rd.pin = step->pin ;
+	for (;;)
+	{
+	  rd.cmd = DRCN_DIGITAL_READ ;
+	  if ((execute (&rd) == TRUE) && ((int)rd.data == level))
+	  {
+	    last   = 1 ;
+	    status = 0 ;
+	    break ;
+	  }
+	  if ((nanos64 () >= until) || __atomic_load_n (&macro->orphan, __ATOMIC_ACQUIRE))
+	  {
+	    last = 0 ;
+	    break ;
+	  }
+	}
+	mark = nanos64 () ;
+	if (results < DRCN_MACRO_RESULTS)
+	{
+	  out [++results]    = *step ;
+	  out [results].data = last ;
+	}
+	break ;
+
+      default:
+	if ((isRead = execute (step)) != TRUE)
+	  break ;
+	last = (int)step->data ;
+	if (results < DRCN_MACRO_RESULTS)
+	  out [++results] = *step ;
+	break ;
+    }
+  }
+
+  out [0].pin   = status ;
+  out [0].data  = results ;
+  macro->outLen = (results + 1) * sizeof (struct drcNetComStruct) ;
+}
+
+
+/*
+ * macroThread:
+ *	Run a macro at real-time priority, then tell the main loop - or if
+ *	the client's gone meanwhile, free it.
+ *********************************************************************************
+ */
+
+static void *macroThread (void *arg)
+{
+  struct wpidMacroStruct *macro = (struct wpidMacroStruct *)arg ;
+  uint64_t one = 1 ;
+  int orphan ;
+
+  (void)piHiPri (DRCN_MACRO_PRI) ;
+
+  macroRun (macro) ;
+
+  pthread_mutex_lock   (&macroLock) ;
+    macro->done = TRUE ;
+    orphan      = macro->orphan ;
+  pthread_mutex_unlock (&macroLock) ;
+
+  if (orphan)
+    free (macro) ;
+  else
+    (void)write (eventFd, &one, sizeof (one)) ;
+
+  return NULL ;
+}
+
+
+/*
+ * runMacro:
+ *	Start a macro off on its own thread. If we can't, run it here after
+ *	all and send the results straight back.
+ *********************************************************************************
+ */
+
+static int runMacro (struct wpidClientStruct *client, struct drcNetComStruct *header, const unsigned char *body, int count)
+{
+  struct wpidMacroStruct *macro ;
+  pthread_attr_t attr ;
+  pthread_t      thread ;
+  int result ;
+
+  if ((macro = calloc (1, sizeof (struct wpidMacroStruct))) == NULL)
+    return -1 ;
+
+  macro->header = *header ;
+  macro->count  = count ;
+  memcpy (macro->steps, body, count * sizeof (struct drcNetComStruct)) ;
+
+  if (eventFd != -1)
   {
-    if (recv (fd, &cmd, sizeof (cmd), 0) != sizeof (cmd))	// Probably remote hangup
-      return ;
+    pthread_attr_init           (&attr) ;
+    pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED) ;
+    result = pthread_create (&thread, &attr, macroThread, macro) ;
+    pthread_attr_destroy        (&attr) ;
 
-    pin = cmd.pin ;
-    if (noLocalPins && ((pin & PI_GPIO_MASK) == 0))
+    if (result == 0)
     {
-      if (send (fd, &cmd, sizeof (cmd), 0) != sizeof (cmd))
-	return ;
+      client->macro = macro ;
+      return 0 ;
+    }
+  }
+
+  macroRun (macro) ;
+  result = clientWrite (client, macro->out, macro->outLen) ;
+  free (macro) ;
+
+  return result ;
+}
+
+
+/*
+ * udpOpen:
+ *	Give the client a session id and key for sending writes by UDP
+ *********************************************************************************
+ */
+
+static int udpOpen (struct wpidClientStruct *client, struct drcNetComStruct *cmd)
+{
+  struct drcNetUdpKeyStruct key ;
+
+  if (!client->udpOpen)
+  {
+    if ((getrandom (&client->udpSession, sizeof (client->udpSession), 0) != sizeof (client->udpSession)) ||
+	(getrandom (client->udpKey, sizeof (client->udpKey), 0) != sizeof (client->udpKey)))
+    {
+      cmd->data = 0 ;
+      return clientWrite (client, cmd, sizeof (*cmd)) ;
+    }
+    client->udpSeq  = 0 ;
+    client->udpOpen = TRUE ;
+  }
+
+  key.session = client->udpSession ;
+  memcpy (key.key, client->udpKey, sizeof (key.key)) ;
+
+  cmd->data = sizeof (key) ;
+
+  if (clientWrite (client, cmd, sizeof (*cmd)) < 0)
+    return -1 ;
+
+  return clientWrite (client, &key, sizeof (key)) ;
+}
+
+
+/*
+ * sessionOpen:
+ *	Give the client a session to resume next time it connects
+ *********************************************************************************
+ */
+
+static int sessionOpen (struct wpidClientStruct *client, struct drcNetComStruct *cmd)
+{
+  struct drcNetSessionStruct session ;
+
+  if (clientNewSession (client, &session) < 0)
+  {
+    cmd->data = 0 ;
+    return clientWrite (client, cmd, sizeof (*cmd)) ;
+  }
+
+  cmd->data = sizeof (session) ;
+
+  if (clientWrite (client, cmd, sizeof (*cmd)) < 0)
+    return -1 ;
+
+  return clientWrite (client, &session, sizeof (session)) ;
+}
+
+
+/*
+ * remoteUdp:
+ *	A datagram has arrived. If it's from a client we know, has the right
+ *	MAC and a sequence number we've not seen, run the writes in it.
+ *	Anything else is quietly dropped.
+ *********************************************************************************
+ */
+
+void remoteUdp (const void *buf, int len, struct wpidClientStruct *clients [], int numClients)
+{
+  struct drcNetUdpStruct dgram ;
+  struct wpidClientStruct *client = NULL ;
+  uint64_t mac ;
+  uint32_t i ;
+  int j, isRead ;
+
+  if ((len < (int)offsetof (struct drcNetUdpStruct, cmds)) || (len > (int)sizeof (dgram)))
+    return ;
+
+  memcpy (&dgram, buf, len) ;
+
+  if ((dgram.count > DRCN_UDP_MAX) || (len != (int)(offsetof (struct drcNetUdpStruct, cmds) + dgram.count * sizeof (struct drcNetComStruct))))
+    return ;
+
+  for (j = 0 ; j < numClients ; ++j)
+    if ((clients [j] != NULL) && clients [j]->udpOpen && (clients [j]->udpSession == dgram.session))
+      client = clients [j] ;
+
+  if ((client == NULL) || ((int32_t)(dgram.seq - client->udpSeq) <= 0))
+    return ;
+
+  mac       = dgram.mac ;
+  dgram.mac = 0 ;
+  if (drcNetSipHash (client->udpKey, &dgram, len) != mac)
+    return ;
+
+  client->udpSeq = dgram.seq ;
+
+  for (i = 0 ; i < dgram.count ; ++i)
+  {
+    metricsCommand (dgram.cmds [i].cmd) ;
+    if ((isRead = execute (&dgram.cmds [i])) == FALSE)	// Only writes - there's no reply
+    {
+      pthread_mutex_lock   (&hwLock) ;
+	++client->unAcked ;
+      pthread_mutex_unlock (&hwLock) ;
+    }
+  }
+}
+
+
+/*
+ * shmHandOver:
+ *	Wait (a while) on the client's abstract socket for the process it
+ *	told us it was, and give it the memfd. Anyone else who connects is
+ *	turned away - the socket's name is no secret, as /proc/net/unix lists
+ *	them, but SO_PEERCRED can't be faked.
+ *	Returns 0 or -1.
+ *********************************************************************************
+ */
+
+static int shmHandOver (struct wpidClientStruct *client)
+{
+  struct pollfd   pfd ;
+  struct ucred    cred ;
+  struct msghdr   msg ;
+  struct iovec    iov ;
+  struct cmsghdr *cmsg ;
+  union { char buf [CMSG_SPACE (sizeof (int))] ; struct cmsghdr align ; } control ;
+  socklen_t len ;
+  char byte = 0 ;
+  int  fd, tries, res = -1 ;
+
+  for (tries = 0 ; (tries < 50) && (res < 0) && !__atomic_load_n (&client->shmStop, __ATOMIC_ACQUIRE) ; ++tries)
+  {
+    pfd.fd     = client->shmListen ;
+    pfd.events = POLLIN ;
+    if (poll (&pfd, 1, 100) <= 0)
+      continue ;
+
+    if ((fd = accept4 (client->shmListen, NULL, NULL, SOCK_CLOEXEC)) < 0)
+      continue ;
+
+    len = sizeof (cred) ;
+    if ((getsockopt (fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) || (cred.pid != client->shmPid))
+    {
+      close (fd) ;
+      continue ;
+    }
+
+    iov.iov_base = &byte ;
+    iov.iov_len  = 1 ;
+    memset (&msg, 0, sizeof (msg)) ;
+    msg.msg_iov        = &iov ;
+    msg.msg_iovlen     = 1 ;
+    msg.msg_control    = control.buf ;
+    msg.msg_controllen = sizeof (control.buf) ;
+    cmsg               = CMSG_FIRSTHDR (&msg) ;
+    cmsg->cmsg_level   = SOL_SOCKET ;
+    cmsg->cmsg_type    = SCM_RIGHTS ;
+    cmsg->cmsg_len     = CMSG_LEN (sizeof (int)) ;
+    memcpy (CMSG_DATA (cmsg), &client->shmMemFd, sizeof (int)) ;
+
+    if (sendmsg (fd, &msg, MSG_NOSIGNAL) == 1)
+      res = 0 ;
+    close (fd) ;
+  }
+
+  close (client->shmListen) ;
+  close (client->shmMemFd) ;
+  client->shmListen = client->shmMemFd = -1 ;
+
+  return res ;
+}
+
+
+/*
+ * shmThread:
+ *	Serve a shared memory client: hand it the segment, then take commands
+ *	off one ring, run them and put the replies on the other. It stops
+ *	when shmStop is set - the client can't hold it up, as alive is
+ *	theirs to write too.
+ *********************************************************************************
+ */
+
+static void *shmThread (void *arg)
+{
+  struct wpidClientStruct *client = (struct wpidClientStruct *)arg ;
+  struct drcNetShmStruct  *shm    = client->shm ;
+  struct drcNetComStruct   cmd ;
+  int isRead ;
+
+  if (shmHandOver (client) < 0)
+    return NULL ;
+
+  while (!__atomic_load_n (&client->shmStop, __ATOMIC_ACQUIRE) && (drcNetShmPop (shm, &shm->toServer, &cmd, &client->shmStop) == 0))
+  {
+    metricsCommand (cmd.cmd) ;
+
+    if ((cmd.cmd & DRCN_CMD_MASK) == DRCN_SYNC)
+    {
+      pthread_mutex_lock   (&hwLock) ;
+	cmd.data        = client->unAcked ;
+	client->unAcked = 0 ;
+      pthread_mutex_unlock (&hwLock) ;
+      isRead = TRUE ;
+    }
+    else if ((isRead = execute (&cmd)) < 0)
+      continue ;
+
+    if (!isRead && ((cmd.cmd & DRCN_NO_ACK) != 0))
+    {
+      pthread_mutex_lock   (&hwLock) ;
+	++client->unAcked ;
+      pthread_mutex_unlock (&hwLock) ;
       continue ;
     }
 
-    switch (cmd.cmd)
+    while (drcNetShmPush (&shm->toClient, &cmd) < 0)		// Full - they'll catch up
+    {
+      if (__atomic_load_n (&client->shmStop, __ATOMIC_ACQUIRE) || !__atomic_load_n (&shm->alive, __ATOMIC_ACQUIRE))
+	return NULL ;
+      usleep (100) ;
+    }
+  }
+
+  return NULL ;
+}
+
+
+/*
+ * shmClose:
+ *	Stop a client's shared memory thread and let the segment go
+ *********************************************************************************
+ */
+
+static void shmClose (struct wpidClientStruct *client)
+{
+  if (client->shm == NULL)
+    return ;
+
+  __atomic_store_n (&client->shmStop, TRUE, __ATOMIC_RELEASE) ;
+  syscall (SYS_futex, &client->shm->toServer.seq, FUTEX_WAKE, 1, NULL, NULL, 0) ;
+  pthread_join (client->shmThread, NULL) ;
+
+  munmap (client->shm, sizeof (struct drcNetShmStruct)) ;
+  client->shm = NULL ;
+}
+
+
+/*
+ * shmOpen:
+ *	Create a shared memory ring pair for a client on the same machine,
+ *	in a memfd no-one else can find, and a thread to serve it that hands
+ *	it over on an abstract socket - and tell the client where that is.
+ *	Asking again starts again with a new one.
+ *********************************************************************************
+ */
+
+static int shmOpen (struct wpidClientStruct *client, struct drcNetComStruct *cmd)
+{
+  struct sockaddr_un addr ;
+  uint8_t rnd [8] ;
+  int memFd = -1, lfd = -1, i, len ;
+  void *ptr = MAP_FAILED ;
+
+  shmClose (client) ;
+
+  if ((cmd->data == 0) || (getrandom (rnd, sizeof (rnd), 0) != sizeof (rnd)))
+    goto fail ;
+
+  len = sprintf (client->shmName, "wiringPiD-%d-", getpid ()) ;
+  for (i = 0 ; i < 8 ; ++i)
+    len += sprintf (client->shmName + len, "%02x", rnd [i]) ;
+
+  if ((memFd = memfd_create ("wiringPiD-shm", MFD_CLOEXEC)) < 0)
+    goto fail ;
+
+  if (ftruncate (memFd, sizeof (struct drcNetShmStruct)) < 0)
+    goto fail ;
+
+  if ((ptr = mmap (NULL, sizeof (struct drcNetShmStruct), PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0)) == MAP_FAILED)
+    goto fail ;
+
+  memset (&addr, 0, sizeof (addr)) ;
+  addr.sun_family = AF_UNIX ;
+  memcpy (addr.sun_path + 1, client->shmName, len) ;	// [0] stays 0: abstract
+
+  if (((lfd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) ||
+      (bind (lfd, (struct sockaddr *)&addr, offsetof (struct sockaddr_un, sun_path) + 1 + len) < 0) ||
+      (listen (lfd, 4) < 0))
+    goto fail ;
+
+  client->shm        = (struct drcNetShmStruct *)ptr ;
+  client->shm->magic = DRCN_SHM_MAGIC ;
+  client->shm->alive = TRUE ;
+  client->shmListen  = lfd ;
+  client->shmMemFd   = memFd ;
+  client->shmPid     = (pid_t)cmd->data ;
+  client->shmStop    = FALSE ;
+
+  if (pthread_create (&client->shmThread, NULL, shmThread, client) != 0)
+  {
+    client->shm = NULL ;
+    goto fail ;
+  }
+
+  cmd->data = len + 1 ;
+
+  if (clientWrite (client, cmd, sizeof (*cmd)) < 0)
+    return -1 ;
+
+  return clientWrite (client, client->shmName, len + 1) ;
+
+fail:
+  if (ptr   != MAP_FAILED) munmap (ptr, sizeof (struct drcNetShmStruct)) ;
+  if (memFd >= 0)          close (memFd) ;
+  if (lfd   >= 0)          close (lfd) ;
+  client->shmName [0] = 0 ;
+  cmd->data           = 0 ;
+  return clientWrite (client, cmd, sizeof (*cmd)) ;
+}
+
+
+/*
+ * remoteClientGone:
+ *	Tidy up anything a client had running before it's freed
+ *********************************************************************************
+ */
+
+void remoteClientGone (struct wpidClientStruct *client)
+{
+  struct wpidMacroStruct *macro ;
+  int done ;
+
+  shmClose (client) ;
+
+  if ((macro = client->macro) != NULL)
+  {
+    pthread_mutex_lock   (&macroLock) ;
+      done = macro->done ;
+      __atomic_store_n (&macro->orphan, TRUE, __ATOMIC_RELEASE) ;
+    pthread_mutex_unlock (&macroLock) ;
+
+    if (done)
+      free (macro) ;
+    client->macro = NULL ;
+  }
+}
+
+
+/*
+ * timeReply:
+ *	Our clock, for the client to compare with its own
+ *********************************************************************************
+ */
+
+static int timeReply (struct wpidClientStruct *client, struct drcNetComStruct *cmd, uint64_t received)
+{
+  struct drcNetTimeStruct t ;
+  unsigned char buf [sizeof (*cmd) + sizeof (t)] ;
+
+  cmd->data  = sizeof (t) ;
+  t.received = received ;
+  memcpy (buf, cmd, sizeof (*cmd)) ;
+
+  t.sent = drcNetClock () ;
+  memcpy (buf + sizeof (*cmd), &t, sizeof (t)) ;
+
+  return clientWrite (client, buf, sizeof (buf)) ;
+}
+
+
+/*
+ * writeAt:
+ *	Queue a write for when on our CLOCK_MONOTONIC - digitalWriteAt ()
+ *	wants it on the nanos64 () clock
+ *********************************************************************************
+ */
+
+static int writeAt (struct drcNetComStruct *cmd, uint64_t when)
+{
+  unsigned long long local = nanos64 () ;
+  uint64_t           now   = drcNetClock () ;
+
+  if (noLocalPins && ((cmd->pin & PI_GPIO_MASK) == 0))
+    return 0 ;
+
+  return digitalWriteAt (cmd->pin, cmd->data, (when > now) ? local + (when - now) : local) ;
+}
+
+
+/*
+ * runRemoteCommands:
+ *	Run every complete command (or batch) waiting in the clients input
+ *	buffer, leaving any partial one there until the rest arrives.
+ *	Returns -1 if the client should be dropped.
+ *********************************************************************************
+ */
+
+int runRemoteCommands (struct wpidClientStruct *client)
+{
+  struct drcNetComStruct cmd ;
+  uint64_t now = drcNetClock () ;
+  uint64_t when ;
+  int isRead, len ;
+  uint32_t count ;
+
+  while (client->inLen >= (int)sizeof (cmd))
+  {
+    if (client->macro != NULL)		// Still running - the rest waits
+      return 0 ;
+
+    memcpy (&cmd, client->inBuf, sizeof (cmd)) ;
+    len = sizeof (cmd) ;
+
+    metricsCommand (cmd.cmd) ;
+
+    switch (cmd.cmd & DRCN_CMD_MASK)
     {
-      case DRCN_PIN_MODE:
-	pinMode (pin, cmd.data) ;
-	if (send (fd, &cmd, sizeof (cmd), 0) != sizeof (cmd))
-	  return ;
+      case DRCN_SYNC:
+	pthread_mutex_lock   (&hwLock) ;
+	  cmd.data         = client->unAcked ;
+	  client->unAcked  = 0 ;
+	pthread_mutex_unlock (&hwLock) ;
+	if (reply (client, &cmd, FALSE) < 0)
+	  return -1 ;
+	break ;
+
+      case DRCN_UDP_OPEN:
+	if (udpOpen (client, &cmd) < 0)
+	  return -1 ;
 	break ;
 
-      case DRCN_PULL_UP_DN:
-	pullUpDnControl (pin, cmd.data) ;
+      case DRCN_SHM_OPEN:
+	if (shmOpen (client, &cmd) < 0)
+	  return -1 ;
 	break ;
 
-      case DRCN_PWM_WRITE:
-	pwmWrite (pin, cmd.data) ;
-	if (send (fd, &cmd, sizeof (cmd), 0) != sizeof (cmd))
-	  return ;
+      case DRCN_SESSION:
+	if (sessionOpen (client, &cmd) < 0)
+	  return -1 ;
 	break ;
 
-      case DRCN_DIGITAL_WRITE:
-	digitalWrite (pin, cmd.data) ;
-	if (send (fd, &cmd, sizeof (cmd), 0) != sizeof (cmd))
-	  return ;
+      case DRCN_SUBSCRIBE:
+	cmd.data = (subscribe (client, &cmd) < 0) ? 0xFFFFFFFF : 0 ;
+	if (reply (client, &cmd, FALSE) < 0)
+	  return -1 ;
 	break ;
 
-      case DRCN_DIGITAL_WRITE8:
-	//digitalWrite8 (pin, cmd.data) ;
-	if (send (fd, &cmd, sizeof (cmd), 0) != sizeof (cmd))
-	  return ;
+      case DRCN_TIME:
+	if (timeReply (client, &cmd, now) < 0)
+	  return -1 ;
 	break ;
 
-      case DRCN_DIGITAL_READ:
-	cmd.data = digitalRead (pin) ;
-	if (send (fd, &cmd, sizeof (cmd), 0) != sizeof (cmd))
-	  return ;
+      case DRCN_WRITE_AT:
+	len = sizeof (cmd) + sizeof (when) ;
+	if (client->inLen < len)		// Wait for the rest of it
+	  return 0 ;
+	memcpy (&when, client->inBuf + sizeof (cmd), sizeof (when)) ;
+	cmd.data = (writeAt (&cmd, when) < 0) ? 0xFFFFFFFF : 0 ;
+	if (reply (client, &cmd, TRUE) < 0)
+	  return -1 ;
 	break ;
 
-      case DRCN_DIGITAL_READ8:
-	//cmd.data = digitalRead8 (pin) ;
-	if (send (fd, &cmd, sizeof (cmd), 0) != sizeof (cmd))
-	  return ;
+      case DRCN_MACRO:
+	if ((count = cmd.data) > DRCN_MAX_BATCH)
+	  return -1 ;
+	len = (count + 1) * sizeof (cmd) ;
+	if (client->inLen < len)		// Wait for the rest of it
+	  return 0 ;
+	if (runMacro (client, &cmd, client->inBuf + sizeof (cmd), count) < 0)
+	  return -1 ;
 	break ;
 
-      case DRCN_ANALOG_WRITE:
-	analogWrite (pin, cmd.data) ;
-	if (send (fd, &cmd, sizeof (cmd), 0) != sizeof (cmd))
-	  return ;
+      case DRCN_BATCH:
+	if ((count = cmd.data) > DRCN_MAX_BATCH)
+	  return -1 ;
+	len = (count + 1) * sizeof (cmd) ;
+	if (client->inLen < len)		// Wait for the rest of it
+	  return 0 ;
+	if (runBatch (client, &cmd, client->inBuf + sizeof (cmd), count) < 0)
+	  return -1 ;
 	break ;
 
-      case DRCN_ANALOG_READ:
-	cmd.data = analogRead (pin) ;
-	if (send (fd, &cmd, sizeof (cmd), 0) != sizeof (cmd))
-	  return ;
+      default:
+	if ((isRead = execute (&cmd)) < 0)	// Unknown - ignore it
+	  break ;
+	if (reply (client, &cmd, !isRead) < 0)
+	  return -1 ;
 	break ;
     }
+
+    clientConsume (client, len) ;
   }
 
+  return 0 ;
+}
+
+
+/*
+ * remoteMacroDone:
+ *	When the eventfd goes off, see if a client's macro has finished and
+ *	if so send the results back, then carry on with whatever was waiting
+ *	behind it. Returns -1 if the client should be dropped.
+ *********************************************************************************
+ */
+
+int remoteMacroDone (struct wpidClientStruct *client)
+{
+  struct wpidMacroStruct *macro ;
+  int done, result ;
+
+  if ((macro = client->macro) == NULL)
+    return 0 ;
+
+  pthread_mutex_lock   (&macroLock) ;
+    done = macro->done ;
+  pthread_mutex_unlock (&macroLock) ;
+
+  if (!done)
+    return 0 ;
+
+  client->macro = NULL ;
+  result = clientWrite (client, macro->out, macro->outLen) ;
+  free (macro) ;
+
+  if (result < 0)
+    return -1 ;
+
+  return runRemoteCommands (client) ;
 }
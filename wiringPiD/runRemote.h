@@ -26,4 +26,13 @@
 
 extern int noLocalPins ;
 
-extern void runRemoteCommands (int fd) ;
+extern int  runRemoteCommands (struct wpidClientStruct *client) ;
+extern int  remoteRead        (int pin, int analog) ;
+
+extern int  remoteEventSetup  (void) ;
+extern void remoteEventRead   (void) ;
+extern int  remoteEventSend   (struct wpidClientStruct *client) ;
+extern int  remoteMacroDone   (struct wpidClientStruct *client) ;
+
+extern void remoteUdp         (const void *buf, int len, struct wpidClientStruct *clients [], int numClients) ;
+extern void remoteClientGone  (struct wpidClientStruct *client) ;
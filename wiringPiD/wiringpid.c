@@ -30,14 +30,19 @@
 #include <syslog.h>
 #include <signal.h>
 #include <errno.h>
+#include <sys/epoll.h>
 
 #include <wiringPi.h>
 #include <wpiExtensions.h>
+#include <wiringPiImage.h>
+#include <wiringPiBroker.h>
 
 #include "drcNetCmd.h"
 #include "network.h"
 #include "runRemote.h"
 #include "daemonise.h"
+#include "metrics.h"
+#include "publish.h"
 
 
 #define	PIDFILE	"/var/run/wiringPiD.pid"
@@ -45,9 +50,20 @@
 
 // Globals
 
-static const char *usage = "[-h] [-d] [-g | -1 | -z] [[-x extension:pin:params] ...] password" ;
+static const char *usage = "[-h] [-d] [-g | -1 | -z] [[-x extension:pin:params] ...] [-i rate[:pin,...]] [-m port]\n"
+			    "       [-M rate:pin,a<pin>,...[@group[:port]]] password\n"
+			    "       [-d] -b config [-s spinUs]" ;
 static int doDaemon = FALSE ;
 
+// Connected clients. They're all served from the one thread, so hardware
+//	access is naturally serialised - one command at a time.
+
+static struct wpidClientStruct *clients [MAX_CLIENTS] ;
+static int epollFd = -1 ;
+static int eventMarker ;	// epoll data for the pin event fd
+static int udpMarker ;		//  and the UDP socket
+static int authMarker ;		//  and finished password checks
+
 //
 
 static void logMsg (const char *message, ...)
@@ -117,6 +133,132 @@ void setupSigHandler (void)
 }
 
 
+/*
+ * addClient:
+ * dropClient:
+ * watchClient:
+ *	Keep track of our clients and what we want to hear about from epoll
+ *	for them - input unless they've a macro or password check still
+ *	running (what they send meanwhile can wait), and output as long as they've got data
+ *	waiting to go.
+ *********************************************************************************
+ */
+
+static int addClient (struct wpidClientStruct *client)
+{
+  struct epoll_event ev ;
+  int i ;
+
+  for (i = 0 ; i < MAX_CLIENTS ; ++i)
+    if (clients [i] == NULL)
+      break ;
+
+  if (i == MAX_CLIENTS)
+  {
+    logMsg ("Too many clients - dropping: %s", client->ip) ;
+    return -1 ;
+  }
+
+  ev.events   = EPOLLIN | EPOLLOUT ;
+  ev.data.ptr = client ;
+
+  if (epoll_ctl (epollFd, EPOLL_CTL_ADD, client->fd, &ev) < 0)
+    return -1 ;
+
+  clients [i] = client ;
+  metricsClient (1) ;
+
+  return 0 ;
+}
+
+static void dropClient (struct wpidClientStruct *client, int reason)
+{
+  int i ;
+
+  for (i = 0 ; i < MAX_CLIENTS ; ++i)
+    if (clients [i] == client)
+      clients [i] = NULL ;
+
+  metricsClient (-1) ;
+  metricsDrop   (reason) ;
+
+  epoll_ctl (epollFd, EPOLL_CTL_DEL, client->fd, NULL) ;
+  remoteClientGone (client) ;
+  closeClient      (client) ;
+}
+
+static void watchClient (struct wpidClientStruct *client)
+{
+  struct epoll_event ev ;
+
+  ev.events   = (((client->macro == NULL) && (client->auth == NULL)) ? EPOLLIN : 0) | ((client->outLen > 0) ? EPOLLOUT : 0) ;
+  ev.data.ptr = client ;
+
+  epoll_ctl (epollFd, EPOLL_CTL_MOD, client->fd, &ev) ;
+}
+
+
+/*
+ * serviceClient:
+ * runClient:
+ *	Something's happened on a clients socket, or a check of its password
+ *	has finished: log it in if it isn't yet, then run what it's sent.
+ *	Returns -1 if it should go, with why in reason.
+ *********************************************************************************
+ */
+
+static int runClient (struct wpidClientStruct *client, const char *password, int *reason)
+{
+  int result ;
+
+  *reason = METRICS_DROP_CLOSED ;
+
+  if (client->state == CLIENT_AUTH)
+  {
+    if ((result = clientAuthenticate (client, password)) == 0)
+      return 0 ;
+
+    if (result < 0)
+    {
+      logMsg ("Password failure: %s", client->ip) ;
+      *reason = METRICS_DROP_PASSWORD ;
+      return -1 ;
+    }
+
+    if (result == 2)
+      logMsg ("Session resumed - Starting: %s", client->ip) ;
+    else
+      logMsg ("Password OK - Starting: %s", client->ip) ;
+  }
+
+  if ((result = runRemoteCommands (client)) < 0)
+    if (errno == ENOBUFS)
+      *reason = METRICS_DROP_FULL ;
+
+  return result ;
+}
+
+static int serviceClient (struct wpidClientStruct *client, uint32_t events, const char *password, int *reason)
+{
+  *reason = METRICS_DROP_CLOSED ;
+
+  if ((events & EPOLLOUT) != 0)
+    if (clientFlush (client) < 0)
+      return -1 ;
+
+  if ((events & (EPOLLIN | EPOLLERR | EPOLLHUP)) == 0)
+    return 0 ;
+
+  if (clientRead (client) < 0)
+  {
+    logMsg ("Connection closed: %s", client->ip) ;
+    return -1 ;
+  }
+
+  return runClient (client, password, reason) ;
+}
+
+
 /*
  * The works...
  *********************************************************************************
@@ -124,11 +266,25 @@ void setupSigHandler (void)
 
 int main (int argc, char *argv [])
 {
-  int clientFd ;
+  struct epoll_event events [MAX_CLIENTS + 1] ;
+  struct wpidClientStruct *client ;
+  int serverFd, udpFd, eventFd, authFd, numEvents ;
+  int authDone = FALSE ;
+  unsigned char dgram [2048] ;
+  ssize_t len ;
   char *p, *password ;
-  int i ;
+  int i, j ;
   int port = DEFAULT_SERVER_PORT ;
   int wpiSetup = 0 ;
+  char *image = NULL ;
+  int imagePins [WPI_IMAGE_MAX_EXT] ;
+  int imageRate, numImagePins ;
+  char *broker = NULL ;
+  int spinUs = 0 ;
+  int metricsPort = 0 ;
+  char *publish = NULL ;
+  unsigned long long awake ;
+  int reason ;
 
   if (argc < 2)
   {
@@ -166,7 +322,7 @@ int main (int argc, char *argv [])
 
 // Scan all other arguments
 
-  while (*argv [1] == '-')
+  while ((argc > 1) && (*argv [1] == '-'))
   {
 
 // Look for wiringPi setup arguments:
@@ -269,6 +425,103 @@ int main (int argc, char *argv [])
 	exit (EXIT_FAILURE) ;
       }
 
+// Shift args down by 2
+
+      for (i = 3 ; i < argc ; ++i)
+	argv [i - 2] = argv [i] ;
+      argc -= 2 ;
+
+      continue ;
+    }
+
+// -i to publish an image of the inputs for other programs to read
+//	-i rate[:pin,pin,...]
+//	Done once everything's set up, so extension pins can be in it.
+
+    if (strcasecmp (argv [1], "-i") == 0)
+    {
+      if (argc < 3)
+      {
+	logMsg ("-i missing scan rate") ;
+	exit (EXIT_FAILURE) ;
+      }
+
+      image = argv [2] ;
+
+// Shift args down by 2
+
+      for (i = 3 ; i < argc ; ++i)
+	argv [i - 2] = argv [i] ;
+      argc -= 2 ;
+
+      continue ;
+    }
+
+// -M to multicast pins for monitors that only watch
+//	-M rate:pin,a<pin>,...[@group[:port]]
+//	Started with -i, once the extensions are loaded.
+
+    if (strcmp (argv [1], "-M") == 0)
+    {
+      if (argc < 3)
+      {
+	logMsg ("-M missing rate and pins") ;
+	exit (EXIT_FAILURE) ;
+      }
+
+      publish = argv [2] ;
+
+// Shift args down by 2
+
+      for (i = 3 ; i < argc ; ++i)
+	argv [i - 2] = argv [i] ;
+      argc -= 2 ;
+
+      continue ;
+    }
+
+// -m to serve the metrics and health check over HTTP on another port
+
+    if (strcmp (argv [1], "-m") == 0)
+    {
+      if (argc < 3)
+      {
+	logMsg ("-m missing metrics port") ;
+	exit (EXIT_FAILURE) ;
+      }
+
+      metricsPort = atoi (argv [2]) ;
+      if ((metricsPort < 1) || (metricsPort > 65535))
+      {
+	logMsg ("Invalid metrics port: %d", metricsPort) ;
+	exit (EXIT_FAILURE) ;
+      }
+
+// Shift args down by 2
+
+      for (i = 3 ; i < argc ; ++i)
+	argv [i - 2] = argv [i] ;
+      argc -= 2 ;
+
+      continue ;
+    }
+
+// -b to be the broker for programs only able to use /dev/gpiomem
+//	-b config [-s spinUs]
+
+    if ((strcasecmp (argv [1], "-b") == 0) || (strcasecmp (argv [1], "-s") == 0))
+    {
+      if (argc < 3)
+      {
+	logMsg ("%s missing its argument", argv [1]) ;
+	exit (EXIT_FAILURE) ;
+      }
+
+      if (strcasecmp (argv [1], "-b") == 0)
+	broker = argv [2] ;
+      else
+	spinUs = atoi (argv [2]) ;
+
 // Shift args down by 2
 
       for (i = 3 ; i < argc ; ++i)
@@ -282,6 +535,27 @@ int main (int argc, char *argv [])
     exit (EXIT_FAILURE) ;
   }
 
+// The broker does nothing else, and always in BCM_GPIO mode as that's
+//	what its clients send
+
+  if (broker != NULL)
+  {
+    if ((wpiSetup != 0) || (image != NULL) || (metricsPort != 0) || (publish != NULL) || (argc != 1))
+    {
+      logMsg ("-b only goes with -d and -s") ;
+      exit (EXIT_FAILURE) ;
+    }
+
+    logMsg ("Broker mode selected") ;
+    wiringPiSetupGpio () ;
+    setupSigHandler   () ;
+
+    (void)wiringPiBrokerServe (broker, spinUs, logMsg) ;
+
+    logMsg ("Unable to start the broker: %s", strerror (errno)) ;
+    exit (EXIT_FAILURE) ;
+  }
+
 // Default to wiringPi mode
 
   if (wpiSetup == 0)
@@ -290,6 +564,46 @@ int main (int argc, char *argv [])
     wiringPiSetup () ;
   }
 
+  if (image != NULL)
+  {
+    imageRate    = (int)strtol (image, &p, 10) ;
+    numImagePins = 0 ;
+    while ((*p == ':') || (*p == ','))
+    {
+      if (numImagePins == WPI_IMAGE_MAX_EXT)
+      {
+	logMsg ("-i: too many pins, at most %d", WPI_IMAGE_MAX_EXT) ;
+	exit (EXIT_FAILURE) ;
+      }
+      imagePins [numImagePins++] = (int)strtol (p + 1, &p, 10) ;
+    }
+
+    if (*p != 0)
+    {
+      logMsg ("-i: invalid rate or pin list: %s", image) ;
+      exit (EXIT_FAILURE) ;
+    }
+
+    if (wiringPiImagePublish (imageRate, imagePins, numImagePins) < 0)
+    {
+      logMsg ("Unable to publish the input image: %s", strerror (errno)) ;
+      exit (EXIT_FAILURE) ;
+    }
+
+    logMsg ("Publishing the inputs %d times a second", imageRate) ;
+  }
+
+  if (publish != NULL)
+  {
+    if (publishSetup (publish) < 0)
+    {
+      logMsg ("Unable to multicast the pins (%s): %s", publish, strerror (errno)) ;
+      exit (EXIT_FAILURE) ;
+    }
+
+    logMsg ("Multicasting pins: %s", publish) ;
+  }
+
 // Finally, should just be one arg left - the password...
 
   if (argc != 2)
@@ -319,63 +633,156 @@ int main (int argc, char *argv [])
 
   setupSigHandler () ;
  
-// Enter our big loop
+  if ((serverFd = openServer (port)) < 0)
+  {
+    logMsg ("Unable to setup server: %s", strerror (errno)) ;
+    exit (EXIT_FAILURE) ;
+  }
 
-  for (;;)
+  if ((epollFd = epoll_create1 (EPOLL_CLOEXEC)) < 0)
   {
+    logMsg ("Unable to create epoll instance: %s", strerror (errno)) ;
+    exit (EXIT_FAILURE) ;
+  }
 
-    if (!doDaemon)
-      printf ("-=-\nWaiting for a new connection...\n") ;
+  events [0].events   = EPOLLIN ;
+  events [0].data.ptr = NULL ;		// NULL is the server socket
+  if (epoll_ctl (epollFd, EPOLL_CTL_ADD, serverFd, &events [0]) < 0)
+  {
+    logMsg ("Unable to watch server socket: %s", strerror (errno)) ;
+    exit (EXIT_FAILURE) ;
+  }
 
-    if ((clientFd = setupServer (port)) < 0)
-    {
-      logMsg ("Unable to setup server: %s", strerror (errno)) ;
-      exit (EXIT_FAILURE) ;
-    }
+  if ((udpFd = openUdpServer (port)) < 0)
+    logMsg ("Unable to setup UDP server - only TCP will work: %s", strerror (errno)) ;
+  else
+  {
+    events [0].events   = EPOLLIN ;
+    events [0].data.ptr = &udpMarker ;
+    epoll_ctl (epollFd, EPOLL_CTL_ADD, udpFd, &events [0]) ;
+  }
 
-    logMsg ("New connection from: %s.", getClientIP ()) ;
+  if ((eventFd = remoteEventSetup ()) < 0)
+    logMsg ("Unable to setup pin events - subscriptions won't work: %s", strerror (errno)) ;
+  else
+  {
+    events [0].events   = EPOLLIN ;
+    events [0].data.ptr = &eventMarker ;
+    epoll_ctl (epollFd, EPOLL_CTL_ADD, eventFd, &events [0]) ;
+  }
 
-    if (!doDaemon)
-      printf ("Sending Greeting.\n") ;
+  if ((authFd = clientAuthSetup ()) < 0)
+    logMsg ("Unable to setup password checks - logins will hold things up: %s", strerror (errno)) ;
+  else
+  {
+    events [0].events   = EPOLLIN ;
+    events [0].data.ptr = &authMarker ;
+    epoll_ctl (epollFd, EPOLL_CTL_ADD, authFd, &events [0]) ;
+  }
 
-    if (sendGreeting (clientFd) < 0)
-    {
-      logMsg ("Unable to send greeting message: %s", strerror (errno)) ;
-      closeServer (clientFd) ;
-      continue ;
-    }
+  if (metricsPort != 0)
+  {
+    if (metricsServe (metricsPort) < 0)
+      logMsg ("Unable to serve metrics on port %d: %s", metricsPort, strerror (errno)) ;
+    else
+      logMsg ("Serving metrics on port %d", metricsPort) ;
+  }
+
+  if (!doDaemon)
+    printf ("-=-\nWaiting for connections...\n") ;
 
-    if (!doDaemon)
-      printf ("Sending Challenge.\n") ;
+// Enter our big loop
 
-    if (sendChallenge (clientFd) < 0)
+  for (;;)
+  {
+    if ((numEvents = epoll_wait (epollFd, events, MAX_CLIENTS + 1, 1000)) < 0)
     {
-      logMsg ("Unable to send challenge message: %s", strerror (errno)) ;
-      closeServer (clientFd) ;
-      continue ;
+      if (errno == EINTR)
+	continue ;
+      logMsg ("epoll_wait failed: %s", strerror (errno)) ;
+      exit (EXIT_FAILURE) ;
     }
 
-    if (!doDaemon)
-      printf ("Waiting for response.\n") ;
+    awake = nanos64 () ;
 
-    if (getResponse (clientFd) < 0)
+    for (i = 0 ; i < numEvents ; ++i)
     {
-      logMsg ("Connection closed waiting for response: %s", strerror (errno)) ;
-      closeServer (clientFd) ;
-      continue ;
+      if ((client = (struct wpidClientStruct *)events [i].data.ptr) == NULL)
+      {
+	while ((client = acceptClient (serverFd)) != NULL)
+	{
+	  logMsg ("New connection from: %s.", client->ip) ;
+	  if (addClient (client) < 0)
+	    closeClient (client) ;
+	}
+	continue ;
+      }
+
+// UDP writes
+
+      if (events [i].data.ptr == &udpMarker)
+      {
+	while ((len = recv (udpFd, dgram, sizeof (dgram), 0)) >= 0)
+	  remoteUdp (dgram, len, clients, MAX_CLIENTS) ;
+	continue ;
+      }
+
+// Pin events and finished macros - clients that can't take them are
+//	shut down, and then dropped when epoll tells us about it.
+
+      if (events [i].data.ptr == &eventMarker)
+      {
+	remoteEventRead () ;
+	for (j = 0 ; j < MAX_CLIENTS ; ++j)
+	  if (clients [j] != NULL)
+	  {
+	    if ((remoteEventSend (clients [j]) < 0) || (remoteMacroDone (clients [j]) < 0))
+	      shutdown (clients [j]->fd, SHUT_RDWR) ;
+	    else
+	      watchClient (clients [j]) ;
+	  }
+	continue ;
+      }
+
+// Password checks - see whose are done once we're through these, as
+//	some might have to go
+
+      if (events [i].data.ptr == &authMarker)
+      {
+	clientAuthClear () ;
+	authDone = TRUE ;
+	continue ;
+      }
+
+      if (serviceClient (client, events [i].events, password, &reason) < 0)
+	dropClient (client, reason) ;
+      else
+	watchClient (client) ;
     }
 
-    if (!passwordMatch (password))
+    if (authDone)
     {
-      logMsg ("Password failure") ;
-      closeServer (clientFd) ;
-      continue ;
+      for (i = 0 ; i < MAX_CLIENTS ; ++i)
+	if ((clients [i] != NULL) && (clients [i]->auth != NULL))
+	{
+	  if (runClient (clients [i], password, &reason) < 0)
+	    dropClient (clients [i], reason) ;
+	  else
+	    watchClient (clients [i]) ;
+	}
+      authDone = FALSE ;
     }
 
-    logMsg ("Password OK - Starting") ;
+// Time-out anyone who's taking too long to log in
+
+    for (i = 0 ; i < MAX_CLIENTS ; ++i)
+      if ((clients [i] != NULL) && clientTimedOut (clients [i]))
+      {
+	logMsg ("Login timed out: %s", clients [i]->ip) ;
+	dropClient (clients [i], METRICS_DROP_TIMEOUT) ;
+      }
 
-    runRemoteCommands (clientFd) ;
-    closeServer       (clientFd) ;
+    metricsLoop (nanos64 () - awake) ;
   }
 
   return 0 ;